@@ -279,6 +279,15 @@ namespace asp {
       vw::Vector2 start = m_image_size / 2.0; // Use the center as the initial guess
       if (starty >= 0) // If the user provided a line number guess..
 	start[1] = starty;
+
+      // The adjustments are small, so the projection into the
+      // unadjusted camera is a much better guess, and the solver then
+      // needs only a few iterations
+      try {
+        vw::Vector2 pix = m_cam->point_to_pixel(point);
+        if (pix == pix) // not NaN
+          start = pix;
+      } catch (...) {}
       
       // Solver constants
       const double ABS_TOL = 1e-16;
@@ -487,6 +496,76 @@ namespace asp {
 
   };
 
+  // Make a DG camera with the piecewise adjustments applied once to
+  // its tabulated positions, velocities, and poses, rather than
+  // composed with them on each call, as AdjustedLinescanDGModel does.
+  // The result agrees with that model at the sample times, and in
+  // between the adjustments are interpolated along with the samples,
+  // which are much closer together than the adjustments. Use this
+  // when the adjustments are fixed, as in mapproject and stereo.
+  inline boost::shared_ptr<vw::camera::CameraModel>
+  bake_piecewise_dg_adjustments(boost::shared_ptr<vw::camera::CameraModel> cam,
+                                int interp_type,
+                                vw::Vector2 const& adjustment_bounds,
+                                std::vector<vw::Vector3> const& position_adjustments,
+                                std::vector<vw::Quat>    const& pose_adjustments) {
+
+    VW_ASSERT(position_adjustments.size() == pose_adjustments.size(),
+              vw::ArgumentErr()
+              << "Expecting the number of position and pose adjustments to agree.\n");
+
+    DGCameraModel const* dg_cam = get_dg_ptr(cam);
+    AdjustableDGPosition adj_position(dg_cam, interp_type, adjustment_bounds,
+                                      position_adjustments, g_num_wts, g_sigma);
+    AdjustableDGPose adj_pose(dg_cam, interp_type, adjustment_bounds,
+                              pose_adjustments, g_num_wts, g_sigma);
+
+    // The positions. The adjustment changes with time, so its rate of
+    // change is added to the velocities, which are used to interpolate
+    // the positions.
+    auto const& position_func = dg_cam->get_position_func();
+    auto const& velocity_func = dg_cam->get_velocity_func();
+    double ephem_t0 = position_func.get_t0(), ephem_dt = position_func.get_dt();
+    int num_pos = round((position_func.get_tend() - ephem_t0) / ephem_dt) + 1;
+    if (num_pos < 2)
+      vw::vw_throw(vw::ArgumentErr() << "Expecting at least two position samples.\n");
+    auto adjustment = [&](double t) {
+      return adj_position(t) - dg_cam->get_camera_center_at_time(t);
+    };
+    std::vector<vw::Vector3> positions(num_pos), velocities(num_pos);
+    for (int it = 0; it < num_pos; it++) {
+      // Stay within the samples at the ends
+      double t    = ephem_t0 + it * ephem_dt;
+      double t_lo = ephem_t0 + std::max(it - 0.5, 0.0) * ephem_dt;
+      double t_hi = ephem_t0 + std::min(it + 0.5, num_pos - 1.0) * ephem_dt;
+      positions[it]  = position_func(t) + adjustment(t);
+      velocities[it] = velocity_func(t)
+        + (adjustment(t_hi) - adjustment(t_lo)) / (t_hi - t_lo);
+    }
+
+    // The poses
+    auto const& pose_func = dg_cam->get_pose_func();
+    std::vector<vw::Quat> poses(pose_func.m_pose_samples.size());
+    for (size_t it = 0; it < poses.size(); it++) {
+      double t = pose_func.m_t0 + it * pose_func.m_dt;
+      poses[it] = adj_pose(t) * inverse(dg_cam->get_camera_pose_at_time(t))
+        * pose_func.m_pose_samples[it];
+    }
+
+    // As for AdjustedLinescanDGModel, no velocity aberration or
+    // atmospheric refraction corrections
+    return boost::shared_ptr<vw::camera::CameraModel>
+      (new DGCameraModel
+       (vw::camera::PiecewiseAPositionInterpolation(positions, velocities,
+                                                    ephem_t0, ephem_dt),
+        vw::camera::LinearPiecewisePositionInterpolation(velocities, ephem_t0, ephem_dt),
+        vw::camera::SLERPPoseInterpolation(poses, pose_func.m_t0, pose_func.m_dt),
+        dg_cam->get_time_func(), dg_cam->get_image_size(),
+        dg_cam->get_detector_origin(), dg_cam->get_focal_length(),
+        0.0, // Mean ground elevation
+        false, false));
+  }
+
 }      // namespace asp
 
 #endif//__STEREO_CAMERA_ADJUSTED_LINESCAN_DG_MODEL_H__
@@ -0,0 +1,271 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/ApproxCameraTable.h>
+#include <asp/Core/FileUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Interpolation.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // Written at the start of each table file. Change this if the format changes.
+  const std::string APPROX_CAMERA_TABLE_MAGIC = "ASP approx camera table 1";
+
+  ApproxCameraTable::ApproxCameraTable():
+    m_gridx(0.0), m_gridy(0.0), m_height(0.0), m_num_valid(0) {}
+
+  void ApproxCameraTable::build(vw::camera::CameraModel const& cam,
+                                vw::cartography::GeoReference const& geo,
+                                vw::BBox2 const& point_box, double gridx, double gridy,
+                                double height) {
+
+    if (gridx <= 0 || gridy <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "ApproxCameraTable: Expecting a positive grid size.\n");
+
+    m_geo       = geo;
+    m_point_box = point_box;
+    m_gridx     = gridx;
+    m_gridy     = gridy;
+    m_height    = height;
+
+    int numx = point_box.width()  / gridx;
+    int numy = point_box.height() / gridy;
+    m_dirs.set_size(numx, numy);
+    m_pixels.set_size(numx, numy);
+
+    // Find along the way the mean direction from the camera to the ground
+    m_num_valid = 0;
+    m_mean_dir = vw::Vector3();
+    for (int x = 0; x < numx; x++) {
+      for (int y = 0; y < numy; y++) {
+
+        vw::Vector2 pt(point_box.min().x() + x*gridx, point_box.min().y() + y*gridy);
+        vw::Vector2 lonlat = geo.point_to_lonlat(pt);
+        vw::Vector3 xyz = geo.datum().geodetic_to_cartesian
+          (vw::Vector3(lonlat[0], lonlat[1], height));
+
+        bool success = true;
+        vw::Vector2 pix;
+        vw::Vector3 vec;
+        try {
+          pix = cam.point_to_pixel(xyz);
+          vec = cam.pixel_to_vector(pix);
+        } catch(...) {
+          success = false;
+        }
+
+        m_dirs(x, y)   = vec;
+        m_pixels(x, y) = pix;
+        if (success) {
+          m_dirs(x, y).validate();
+          m_pixels(x, y).validate();
+          m_mean_dir += vec;
+          m_num_valid++;
+        } else {
+          m_dirs(x, y).invalidate();
+          m_pixels(x, y).invalidate();
+        }
+      }
+    }
+
+    m_mean_dir /= std::max(1, m_num_valid);
+    if (m_num_valid > 0)
+      m_mean_dir = m_mean_dir / norm_2(m_mean_dir);
+  }
+
+  bool ApproxCameraTable::point_to_pixel(vw::Vector3 const& xyz, vw::Vector2 & pix) const {
+
+    // Interpolating with an edge extension keeps the lookups read-only
+    vw::InterpolationView<vw::EdgeExtensionView<vw::ImageView< vw::PixelMask<vw::Vector3> >,
+                                                vw::ConstantEdgeExtension>,
+                          vw::BilinearInterpolation> dir_interp
+      = vw::interpolate(m_dirs, vw::BilinearInterpolation(), vw::ConstantEdgeExtension());
+    vw::InterpolationView<vw::EdgeExtensionView<vw::ImageView< vw::PixelMask<vw::Vector2> >,
+                                                vw::ConstantEdgeExtension>,
+                          vw::BilinearInterpolation> pix_interp
+      = vw::interpolate(m_pixels, vw::BilinearInterpolation(), vw::ConstantEdgeExtension());
+
+    if (m_num_valid == 0)
+      return false;
+
+    vw::Vector3 dir = m_mean_dir;
+    double major_radius = m_geo.datum().semi_major_axis() + m_height;
+    double minor_radius = m_geo.datum().semi_minor_axis() + m_height;
+    for (size_t i = 0; i < 10; i++) {
+
+      vw::Vector3 S = xyz - 1.1*major_radius*dir; // push the point outside the sphere
+      if (norm_2(S) <= major_radius)
+        return false; // should not happen
+
+      vw::Vector3 datum_pt
+        = vw::cartography::datum_intersection(major_radius, minor_radius, S, dir);
+      vw::Vector3 llh = m_geo.datum().cartesian_to_geodetic(datum_pt);
+      vw::Vector2 pt = m_geo.lonlat_to_point(subvector(llh, 0, 2));
+
+      double x = (pt.x() - m_point_box.min().x())/m_gridx;
+      double y = (pt.y() - m_point_box.min().y())/m_gridy;
+      if (!(x >= 0 && x < m_dirs.cols() - 2 && y >= 0 && y < m_dirs.rows() - 2))
+        return false; // out of range, or NaN
+
+      vw::PixelMask<vw::Vector3> masked_dir = dir_interp(x, y);
+      vw::PixelMask<vw::Vector2> masked_pix = pix_interp(x, y);
+      if (!is_valid(masked_dir) || !is_valid(masked_pix))
+        return false;
+
+      dir = masked_dir.child();
+      pix = masked_pix.child();
+    }
+
+    return true;
+  }
+
+  void ApproxCameraTable::write(std::string const& file, std::string const& key) const {
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial table.
+    std::string tmp_file = file + ".tmp";
+    vw::create_out_dir(file);
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+
+      ofs << APPROX_CAMERA_TABLE_MAGIC << "\n" << key << "\n";
+      int32_t dims[3] = {m_dirs.cols(), m_dirs.rows(), m_num_valid};
+      ofs.write((char const*)dims, sizeof(dims));
+      ofs.write((char const*)&m_mean_dir[0], 3*sizeof(double));
+      for (int y = 0; y < m_dirs.rows(); y++) {
+        for (int x = 0; x < m_dirs.cols(); x++) {
+          vw::PixelMask<vw::Vector3> const& d = m_dirs(x, y);
+          vw::PixelMask<vw::Vector2> const& p = m_pixels(x, y);
+          double vals[6] = {double(is_valid(d) && is_valid(p)),
+                            d.child()[0], d.child()[1], d.child()[2],
+                            p.child()[0], p.child()[1]};
+          ofs.write((char const*)vals, sizeof(vals));
+        }
+      }
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    fs::rename(tmp_file, file);
+  }
+
+  bool ApproxCameraTable::read(std::string const& file, std::string const& key,
+                               vw::cartography::GeoReference const& geo) {
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic, file_key;
+    std::getline(ifs, magic);
+    std::getline(ifs, file_key);
+    if (magic != APPROX_CAMERA_TABLE_MAGIC || file_key != key)
+      return false;
+
+    int32_t dims[3] = {0, 0, 0};
+    vw::Vector3 mean_dir;
+    ifs.read((char*)dims, sizeof(dims));
+    ifs.read((char*)&mean_dir[0], 3*sizeof(double));
+    if (!ifs.good() || dims[0] < 0 || dims[1] < 0)
+      return false;
+
+    vw::ImageView< vw::PixelMask<vw::Vector3> > dirs(dims[0], dims[1]);
+    vw::ImageView< vw::PixelMask<vw::Vector2> > pixels(dims[0], dims[1]);
+    for (int y = 0; y < dims[1]; y++) {
+      for (int x = 0; x < dims[0]; x++) {
+        double vals[6];
+        ifs.read((char*)vals, sizeof(vals));
+        dirs(x, y)   = vw::Vector3(vals[1], vals[2], vals[3]);
+        pixels(x, y) = vw::Vector2(vals[4], vals[5]);
+        if (vals[0] != 0) {
+          dirs(x, y).validate();
+          pixels(x, y).validate();
+        } else {
+          dirs(x, y).invalidate();
+          pixels(x, y).invalidate();
+        }
+      }
+    }
+    if (!ifs.good())
+      return false;
+
+    // The key has the extent, spacing, and height, so parse them back
+    // from it rather than storing them twice.
+    std::istringstream is(key);
+    std::string token;
+    while (is >> token && token != "table:") {}
+    double minx, miny, maxx, maxy, gridx, gridy, height;
+    if (!(is >> minx >> miny >> maxx >> maxy >> gridx >> gridy >> height))
+      return false;
+
+    m_geo       = geo;
+    m_point_box = vw::BBox2(vw::Vector2(minx, miny), vw::Vector2(maxx, maxy));
+    m_gridx     = gridx;
+    m_gridy     = gridy;
+    m_height    = height;
+    m_dirs      = dirs;
+    m_pixels    = pixels;
+    m_mean_dir  = mean_dir;
+    m_num_valid = dims[2];
+    return true;
+  }
+
+  std::string approx_camera_table_key(std::string const& camera_file,
+                                      vw::camera::AdjustedCameraModel const& cam,
+                                      vw::cartography::GeoReference const& geo,
+                                      vw::BBox2 const& point_box,
+                                      double gridx, double gridy, double height) {
+
+    std::ostringstream os;
+    os << std::setprecision(17);
+
+    os << "camera: " << camera_file << " " << asp::file_timestamp(camera_file) << " ";
+
+    vw::Quat q = cam.rotation();
+    os << "adjustment: " << cam.translation()[0] << " " << cam.translation()[1] << " "
+       << cam.translation()[2] << " " << q.w() << " " << q.x() << " " << q.y() << " "
+       << q.z() << " " << cam.pixel_offset()[0] << " " << cam.pixel_offset()[1] << " "
+       << cam.scale() << " ";
+
+    os << "georef: " << geo.overall_proj4_str() << " ";
+
+    os << "table: " << point_box.min().x() << " " << point_box.min().y() << " "
+       << point_box.max().x() << " " << point_box.max().y() << " "
+       << gridx << " " << gridy << " " << height;
+
+    return os.str();
+  }
+
+  std::string approx_camera_table_file(std::string const& dir, std::string const& key) {
+    return asp::cache_file_name(dir, "approx-camera-", key, ".tbl");
+  }
+
+} // end namespace asp
@@ -0,0 +1,109 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ApproxCameraTable.h
+///
+/// A table of ground-to-image projections of a camera over a DEM
+/// footprint, used to replace slow exact cameras, such as ISIS ones,
+/// when many points near the same terrain must be projected. The table
+/// can be saved to disk and loaded later, so it is not recomputed by
+/// each run on the same clip.
+
+#ifndef __ASP_CAMERA_APPROX_CAMERA_TABLE_H__
+#define __ASP_CAMERA_APPROX_CAMERA_TABLE_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+
+#include <string>
+
+namespace asp {
+
+  // The camera is tabulated at the nodes of a grid in projected
+  // coordinates of the given georeference, at a fixed height above the
+  // datum. At each node the pixel the ground point projects into and
+  // the ray direction at that pixel are stored. To project a point,
+  // the ray through it is intersected with the datum at that height,
+  // and the table is interpolated there. As the ray is not known in
+  // advance, this is iterated starting from the mean ray direction.
+  //
+  // The table is fully built, or loaded, before it is used, and is not
+  // modified after that, so lookups from several threads need no lock.
+  class ApproxCameraTable {
+
+  public:
+    ApproxCameraTable();
+
+    // Tabulate the camera. Nodes at which the camera fails are marked
+    // as invalid.
+    void build(vw::camera::CameraModel const& cam,
+               vw::cartography::GeoReference const& geo,
+               vw::BBox2 const& point_box, double gridx, double gridy,
+               double height);
+
+    // Find the pixel a point projects into. Return false if the
+    // intersection of the ray with the datum leaves the table, or
+    // lands on invalid nodes. The caller must then use the exact camera.
+    bool point_to_pixel(vw::Vector3 const& xyz, vw::Vector2 & pix) const;
+
+    // Save the table, labeled with a key describing what it was built
+    // from, as produced by approx_camera_table_key().
+    void write(std::string const& file, std::string const& key) const;
+
+    // Load a table saved with write(). Return false if the file does
+    // not exist, cannot be parsed, or was saved with a different key.
+    bool read(std::string const& file, std::string const& key,
+              vw::cartography::GeoReference const& geo);
+
+    int cols() const { return m_pixels.cols(); }
+    int rows() const { return m_pixels.rows(); }
+
+    // The tabulated pixel at a node
+    vw::PixelMask<vw::Vector2> const& pixel(int x, int y) const { return m_pixels(x, y); }
+
+    vw::Vector3 const& mean_dir()  const { return m_mean_dir;  }
+    int                num_valid() const { return m_num_valid; }
+
+  private:
+    vw::cartography::GeoReference m_geo;
+    vw::BBox2 m_point_box;
+    double m_gridx, m_gridy, m_height;
+    vw::ImageView< vw::PixelMask<vw::Vector3> > m_dirs;
+    vw::ImageView< vw::PixelMask<vw::Vector2> > m_pixels;
+    vw::Vector3 m_mean_dir; // mean direction from the camera to the ground
+    int m_num_valid;
+  };
+
+  // A string which identifies a table. It has the camera file and its
+  // modification time, the camera adjustment, the georeference, and the
+  // extent, spacing, and height of the table. A table saved with a
+  // different key is not reused.
+  std::string approx_camera_table_key(std::string const& camera_file,
+                                      vw::camera::AdjustedCameraModel const& cam,
+                                      vw::cartography::GeoReference const& geo,
+                                      vw::BBox2 const& point_box,
+                                      double gridx, double gridy, double height);
+
+  // The file in the given directory in which a table with this key is saved
+  std::string approx_camera_table_file(std::string const& dir, std::string const& key);
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_APPROX_CAMERA_TABLE_H__
@@ -23,12 +23,17 @@
 
 #include <asp/Camera/BundleAdjustCamera.h>
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
+#include <asp/Core/MatchDatabase.h>
 
 #include <vw/Cartography/CameraBBox.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/InterestPoint/Matcher.h>
 #include <vw/FileIO/KML.h>
 #include <asp/Camera/CameraResectioning.h>
 
+#include <map>
+#include <sstream>
 #include <string>
 
 using namespace vw;
@@ -720,22 +725,19 @@ void asp::align_cameras_to_ground(std::vector< std::vector<Vector3> > const& xyz
 /// to the corresponding IP in the original non-map-projected image.
 /// - Return false if the pixel could not be converted.
 bool asp::projected_ip_to_raw_ip(vw::ip::InterestPoint &P,
-                                 vw::ImageViewRef<vw::PixelMask<double>> const& interp_dem,
+                                 asp::DemRayIntersector const& dem,
                                  asp::CameraModelPtr camera_model,
-                                 vw::cartography::GeoReference const& georef,
-                                 vw::cartography::GeoReference const& dem_georef) {
+                                 vw::cartography::GeoReference const& georef) {
   // Get IP coordinate in the DEM
   Vector2 pix(P.x, P.y);
   Vector2 ll      = georef.pixel_to_lonlat(pix);
-  Vector2 dem_pix = dem_georef.lonlat_to_pixel(ll);
-  if (!interp_dem.pixel_in_bounds(dem_pix))
-    return false;
+  Vector2 dem_pix = dem.georef().lonlat_to_pixel(ll);
   // Load the elevation from the DEM
-  PixelMask<double> dem_val = interp_dem(dem_pix[0], dem_pix[1]);
-  if (!is_valid(dem_val))
+  double height = 0.0;
+  if (!dem.height(dem_pix, height))
     return false;
-  Vector3 llh(ll[0], ll[1], dem_val.child());
-  Vector3 xyz = dem_georef.datum().geodetic_to_cartesian(llh);
+  Vector3 llh(ll[0], ll[1], height);
+  Vector3 xyz = dem.georef().datum().geodetic_to_cartesian(llh);
 
   // Project into the camera
   Vector2 cam_pix;
@@ -751,6 +753,80 @@ bool asp::projected_ip_to_raw_ip(vw::ip::InterestPoint &P,
   return true;
 }
 
+namespace {
+
+  // Undo the map-projection of all interest points in the map-projected
+  // image of one camera. The DEM and georeference are copies, as
+  // georeferences are not thread-safe.
+  class ProjectedIpsToRawTask: public vw::Task, private boost::noncopyable {
+    asp::DemRayIntersector m_dem;
+    vw::cartography::GeoReference m_georef;
+    asp::CameraModelPtr m_camera_model;
+    std::vector<std::vector<vw::ip::InterestPoint>*> m_ips;
+    std::vector<std::vector<bool>*> m_good;
+  public:
+    ProjectedIpsToRawTask(asp::DemRayIntersector const& dem,
+                          vw::cartography::GeoReference const& georef,
+                          asp::CameraModelPtr camera_model,
+                          std::vector<std::vector<vw::ip::InterestPoint>*> const& ips,
+                          std::vector<std::vector<bool>*> const& good):
+      m_dem(dem), m_georef(georef), m_camera_model(camera_model),
+      m_ips(ips), m_good(good) {}
+
+    void operator()() {
+      for (size_t set_it = 0; set_it < m_ips.size(); set_it++) {
+        std::vector<vw::ip::InterestPoint> & ips = *m_ips[set_it];
+        std::vector<bool> & good = *m_good[set_it];
+        good.assign(ips.size(), false);
+        for (size_t ip_it = 0; ip_it < ips.size(); ip_it++) {
+          try {
+            good[ip_it] = asp::projected_ip_to_raw_ip(ips[ip_it], m_dem,
+                                                      m_camera_model, m_georef);
+          } catch (...) {}
+        }
+      }
+    }
+  };
+
+} // end anonymous namespace
+
+void asp::projected_ips_to_raw_ips(std::vector<std::vector<vw::ip::InterestPoint>> & ips,
+                                   std::vector<int> const& cam_indices,
+                                   asp::DemRayIntersector const& dem,
+                                   std::vector<asp::CameraModelPtr> const& camera_models,
+                                   std::vector<vw::cartography::GeoReference> const& georefs,
+                                   int num_threads,
+                                   std::vector<std::vector<bool>> & good) {
+
+  if (ips.size() != cam_indices.size())
+    vw_throw(ArgumentErr() << "Expecting a camera for each set of interest points.\n");
+
+  good.clear();
+  good.resize(ips.size());
+
+  // Group the sets by camera
+  std::map<int, std::vector<size_t>> cam_sets;
+  for (size_t it = 0; it < cam_indices.size(); it++)
+    cam_sets[cam_indices[it]].push_back(it);
+
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  FifoWorkQueue queue(num_threads);
+  for (auto const& cam_set: cam_sets) {
+    std::vector<std::vector<vw::ip::InterestPoint>*> cam_ips;
+    std::vector<std::vector<bool>*> cam_good;
+    for (size_t it = 0; it < cam_set.second.size(); it++) {
+      cam_ips.push_back(&ips[cam_set.second[it]]);
+      cam_good.push_back(&good[cam_set.second[it]]);
+    }
+    queue.add_task(boost::shared_ptr<ProjectedIpsToRawTask>
+                   (new ProjectedIpsToRawTask(dem, georefs[cam_set.first],
+                                              camera_models[cam_set.first],
+                                              cam_ips, cam_good)));
+  }
+  queue.join_all();
+}
+
 // This function takes advantage of the fact that when it is called the cam_ptrs have the same
 //  information as is in param_storage!
 void apply_transform_to_cameras_optical_bar(vw::Matrix4x4 const& M,
@@ -1009,6 +1085,7 @@ void asp::saveMapprojOffsets(std::string const& mapproj_offsets_stats_file,
 // reloading interest point matches, which is expensive so the matches
 // are used for both operations.
 void asp::matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
+                               asp::BAObservations const& obs,
                                asp::BaBaseOptions const& opt,
                                std::vector<asp::CameraModelPtr> const& optimized_cams,
                                bool remove_outliers, std::set<int> const& outliers,
@@ -1031,6 +1108,11 @@ void asp::matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
   
   int num_cameras = opt.image_files.size();
   mapprojOffsetsPerCam.resize(num_cameras);
+
+  // Read the matches from the packed database when available
+  asp::MatchDatabase match_db;
+  if (!opt.match_database.empty() && match_db.open(opt.match_database))
+    vw_out() << "Reading matches from: " << opt.match_database << "\n";
   
   // Work on individual image pairs
   for (auto match_it = opt.match_files.begin(); match_it != opt.match_files.end(); match_it++) {
@@ -1045,17 +1127,20 @@ void asp::matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
     size_t left_index  = cam_pair.first;
     size_t right_index = cam_pair.second;
 
-    // Just skip over match files that don't exist.
-    if (!boost::filesystem::exists(match_file)) {
-      vw_out() << "Skipping non-existent match file: " << match_file << std::endl;
-      continue;
-    }
-
     // Read the original IP, to ensure later we write to disk only
     // the subset of the IP from the control network which
     // are part of these original ones. 
     std::vector<ip::InterestPoint> orig_left_ip, orig_right_ip;
-    ip::read_binary_match_file(match_file, orig_left_ip, orig_right_ip);
+    if (!match_db.is_open() ||
+        !match_db.read(opt.image_files[left_index], opt.image_files[right_index],
+                       orig_left_ip, orig_right_ip)) {
+      // Just skip over match files that don't exist.
+      if (!boost::filesystem::exists(match_file)) {
+        vw_out() << "Skipping non-existent match file: " << match_file << std::endl;
+        continue;
+      }
+      ip::read_binary_match_file(match_file, orig_left_ip, orig_right_ip);
+    }
 
     // Create a new convergence angle storage struct
     convAngles.push_back(asp::MatchPairStats()); // add an element, will populate it soon
@@ -1100,40 +1185,39 @@ void asp::matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
       lookup[left_set] = right_set;
     }
 
-    // Iterate over the control network, and, for each control point,
-    // look only at the measure for left_index and right_index
-    int ipt = -1;
-    for (ControlNetwork::const_iterator iter = cnet.begin(); iter != cnet.end(); iter++) {
-
-      ipt++; // control point index
+    // Find the points seen in both images. The observations in each
+    // image are in the order of the points, so the two lists are merged.
+    size_t left_it = obs.begin(left_index), right_it = obs.begin(right_index);
+    while (left_it < obs.end(left_index) && right_it < obs.end(right_index)) {
 
-      // Skip gcp
-      if (cnet[ipt].type() == ControlPoint::GroundControlPoint) {
+      int ipt = obs.point_id(left_it); // control point index
+      if (ipt < obs.point_id(right_it)) {
+        left_it++;
         continue;
       }
-        
-      bool has_left = true, has_right = false;
-      ip::InterestPoint cnet_left_ip, cnet_right_ip;
-      for (ControlPoint::const_iterator measure = (*iter).begin();
-            measure != (*iter).end(); ++measure) {
-        if (measure->image_id() == left_index) {
-          has_left = true;
-          cnet_left_ip = ip::InterestPoint(measure->position()[0], measure->position()[1],
-                                   measure->sigma()[0]);
-        }else if (measure->image_id() == right_index) {
-          has_right = true;
-          cnet_right_ip = ip::InterestPoint(measure->position()[0], measure->position()[1],
-                                   measure->sigma()[0]);
-        }
+      if (obs.point_id(right_it) < ipt) {
+        right_it++;
+        continue;
       }
 
-      // Keep only ip for these two images
-      if (!has_left || !has_right)
+      // If a point is seen more than once in an image, use the last time
+      size_t left_obs = left_it, right_obs = right_it;
+      while (left_it < obs.end(left_index) && obs.point_id(left_it) == ipt)
+        left_obs = left_it++;
+      while (right_it < obs.end(right_index) && obs.point_id(right_it) == ipt)
+        right_obs = right_it++;
+
+      // Skip gcp
+      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
         continue;
 
       if (outliers.find(ipt) != outliers.end())
         continue; // skip outliers
 
+      Vector2 left_pix = obs.pixel(left_obs), right_pix = obs.pixel(right_obs);
+      ip::InterestPoint cnet_left_ip(left_pix[0], left_pix[1], obs.sigma(left_obs)[0]);
+      ip::InterestPoint cnet_right_ip(right_pix[0], right_pix[1], obs.sigma(right_obs)[0]);
+
       // Only add ip that were there originally
       Triplet left_set(left_index, cnet_left_ip.x, cnet_left_ip.y); 
       Triplet right_set(right_index, cnet_right_ip.x, cnet_right_ip.y); 
@@ -1209,3 +1293,13 @@ void asp::matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
     
   } // End loop through the match files
 }
+
+int read_reference_disparity_list(std::string const& disp_list,
+                                  std::vector<std::string> & disp_files) {
+  disp_files.clear();
+  std::istringstream is(disp_list);
+  std::string disp_file;
+  while (is >> disp_file)
+    disp_files.push_back(disp_file);
+  return static_cast<int>(disp_files.size());
+}
@@ -41,12 +41,14 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/DemRayIntersect.h>
 
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
 // TODO(oalexan1): Move all this code to the .cc file and to the asp namespace.
 
+#include <algorithm>
 #include <string>
 
 namespace asp {
@@ -56,10 +58,11 @@ typedef boost::shared_ptr<vw::camera::CameraModel> CameraModelPtr;
 // Options shared by bundle_adjust and jitter_solve
 struct BaBaseOptions: public vw::GdalWriteOptions {
   std::string out_prefix, stereo_session, input_prefix, match_files_prefix,
-    clean_match_files_prefix, ref_dem, heights_from_dem, mapproj_dem;
+    clean_match_files_prefix, ref_dem, heights_from_dem, mapproj_dem, match_database,
+    camera_cache_dir;
   int overlap_limit, min_matches, max_pairwise_matches, num_iterations,
     ip_edge_buffer_percent;
-  bool match_first_to_last, single_threaded_cameras;
+  bool match_first_to_last, single_threaded_cameras, profile_cost_functions;
   double min_triangulation_angle, max_init_reproj_error, robust_threshold, parameter_tolerance;
   double ref_dem_weight, ref_dem_robust_threshold, heights_from_dem_weight,
     heights_from_dem_robust_threshold, camera_weight, rotation_weight, translation_weight,
@@ -73,7 +76,7 @@ struct BaBaseOptions: public vw::GdalWriteOptions {
   BaBaseOptions(): min_triangulation_angle(0.0), camera_weight(-1.0),
                    rotation_weight(0.0), translation_weight(0.0), tri_weight(0.0),
                    robust_threshold(0.0), min_matches(0),
-                   num_iterations(0), overlap_limit(0) {}
+                   num_iterations(0), overlap_limit(0), profile_cost_functions(false) {}
 };
   
 // This must be const or else there's a crash
@@ -119,6 +122,9 @@ struct IntrinsicOptions {
 namespace asp {
 /// Class to store parameters as they are being bundle adjusted.
 /// - Currently only supports either one camera or all unique cameras.
+/// - All values are in one array, with the cameras first, then the
+///   intrinsics, then the points, so that a copy is a single
+///   allocation and the number of points can change at the end.
 class BAParams {
 
 public:
@@ -147,51 +153,23 @@ public:
       m_num_distortion_params(num_distortion_params),
       m_focus_offset(0),
       m_distortion_offset(0),
+      m_num_intrinsics    (0),
       m_intrin_options    (intrin_opts),
-      m_points_vec        (num_points *PARAMS_PER_POINT,  0),
-      m_cameras_vec       (num_cameras*NUM_CAMERA_PARAMS, 0),
-      m_intrinsics_vec    (0),
       m_outlier_points_vec(num_points, false),
       m_rand_gen(std::time(0)) {
 
-        if (!using_intrinsics)
-          return; // If we are not using intrinsics, nothing else to do.
-
-        // Calculate how many values are stored per-camera, and
-        //  what the offset is to a particular intrinsic value.
-        // - The start of the array is always an entry for each intrinsic in case
-        //   it is shared.
-        if (!intrin_opts.center_shared)
-          m_num_intrinsics_per_camera += NUM_CENTER_PARAMS;
-        if (intrin_opts.focus_shared)
-          m_focus_offset = NUM_CENTER_PARAMS;
-        else {
-          m_num_intrinsics_per_camera += NUM_FOCUS_PARAMS;
-          if (!intrin_opts.center_shared)
-            m_focus_offset = NUM_CENTER_PARAMS;
-        }
-        if (intrin_opts.distortion_shared)
-          m_distortion_offset = NUM_CENTER_PARAMS + NUM_FOCUS_PARAMS;
-        else {
-          m_num_intrinsics_per_camera += num_distortion_params;
-          if (!intrin_opts.center_shared)
-            m_distortion_offset += NUM_CENTER_PARAMS;
-          if (!intrin_opts.focus_shared)
-            m_distortion_offset += NUM_FOCUS_PARAMS;
-        }
+        if (using_intrinsics)
+          init_intrinsics(num_distortion_params, intrin_opts);
 
-        // For simplicity, we always set this to the same size even
-        //  if none of the parameters are shared.
-        m_num_shared_intrinsics = NUM_CENTER_PARAMS + NUM_FOCUS_PARAMS
-                                  + num_distortion_params;
-
-        m_intrinsics_vec.resize(m_num_shared_intrinsics +
-                                num_cameras*m_num_intrinsics_per_camera);
+        m_params.resize(points_offset() + num_points*PARAMS_PER_POINT, 0.0);
       }
 
-  // Copy constructor
-  BAParams(BAParams const& other)
-    : m_num_points        (other.m_num_points),
+  /// Copy constructor. Without the points, only the cameras and
+  /// intrinsics are copied, as for the initial values the cameras are
+  /// held to, which saves memory when there are very many points. Then
+  /// num_points() is 0.
+  BAParams(BAParams const& other, bool copy_points = true)
+    : m_num_points        (copy_points ? other.m_num_points : 0),
       m_num_cameras       (other.m_num_cameras),
       m_params_per_point  (other.m_params_per_point),
       m_num_pose_params   (other.m_num_pose_params),
@@ -200,55 +178,83 @@ public:
       m_num_distortion_params(other.m_num_distortion_params),
       m_focus_offset      (other.m_focus_offset),
       m_distortion_offset (other.m_distortion_offset),
+      m_num_intrinsics    (other.m_num_intrinsics),
       m_intrin_options    (other.m_intrin_options),
-      m_points_vec        (other.m_points_vec.size()        ),
-      m_cameras_vec       (other.m_cameras_vec.size()       ),
-      m_intrinsics_vec    (other.m_intrinsics_vec.size()    ),
-      m_outlier_points_vec(other.m_outlier_points_vec.size()),
-      m_rand_gen(std::time(0)) {
-    copy_points    (other);
-    copy_cameras   (other);
-    copy_intrinsics(other);
-    copy_outliers  (other);
+      m_params            (other.m_params.begin(),
+                           other.m_params.begin() + other.points_offset()
+                           + (copy_points ? other.m_num_points*other.m_params_per_point : 0)),
+      m_outlier_points_vec(copy_points ? other.m_outlier_points_vec : std::vector<bool>()),
+      m_rand_gen(std::time(0)) {}
+
+  /// Copy the values of another instance of the same size. The
+  /// memory is reused.
+  BAParams & operator=(BAParams const& other) {
+    VW_ASSERT(m_params.size() == other.m_params.size(),
+              vw::LogicErr() << "Cannot copy parameters of a different size.\n");
+    std::copy(other.m_params.begin(), other.m_params.end(), m_params.begin());
+    m_outlier_points_vec = other.m_outlier_points_vec;
+    return *this;
+  }
+
+  /// Change the number of points, keeping the cameras and intrinsics.
+  /// The new points are zero and not outliers.
+  void resize_points(int num_points) {
+    m_num_points = num_points;
+    m_params.resize(points_offset() + num_points*m_params_per_point, 0.0);
+    m_params.shrink_to_fit();
+    m_outlier_points_vec.resize(num_points, false);
   }
 
   // Set all camera position and pose values to zero.
   void clear_cameras() {
-    for (int i=0; i < m_cameras_vec.size(); ++i)
-      m_cameras_vec[i] = 0.0;
+    std::fill(m_params.begin(), m_params.begin() + m_num_cameras*m_num_pose_params, 0.0);
   }
 
-  // When using the copy functions, the sizes must match!
+private:
 
-  /// Copy one set of values from another instance.
-  void copy_points(BAParams const& other) {
-    for (size_t i=0; i<m_points_vec.size(); ++i)
-      m_points_vec[i] = other.m_points_vec[i];
-  }
-  void copy_cameras(BAParams const& other) {
-    for (size_t i=0; i<m_cameras_vec.size(); ++i)
-      m_cameras_vec[i] = other.m_cameras_vec[i];
-  }
-  void copy_intrinsics(BAParams const& other) {
-    for (size_t i=0; i<m_intrinsics_vec.size(); ++i)
-      m_intrinsics_vec[i] = other.m_intrinsics_vec[i];
-  }
-  void copy_outliers(BAParams const& other) {
-    for (size_t i=0; i<m_outlier_points_vec.size(); ++i)
-      m_outlier_points_vec[i] = other.m_outlier_points_vec[i];
+  /// Find the layout of the intrinsics
+  void init_intrinsics(int num_distortion_params, IntrinsicOptions const& intrin_opts) {
+
+    // Calculate how many values are stored per-camera, and
+    //  what the offset is to a particular intrinsic value.
+    // - The start of the array is always an entry for each intrinsic in case
+    //   it is shared.
+    if (!intrin_opts.center_shared)
+      m_num_intrinsics_per_camera += NUM_CENTER_PARAMS;
+    if (intrin_opts.focus_shared)
+      m_focus_offset = NUM_CENTER_PARAMS;
+    else {
+      m_num_intrinsics_per_camera += NUM_FOCUS_PARAMS;
+      if (!intrin_opts.center_shared)
+        m_focus_offset = NUM_CENTER_PARAMS;
+    }
+    if (intrin_opts.distortion_shared)
+      m_distortion_offset = NUM_CENTER_PARAMS + NUM_FOCUS_PARAMS;
+    else {
+      m_num_intrinsics_per_camera += num_distortion_params;
+      if (!intrin_opts.center_shared)
+        m_distortion_offset += NUM_CENTER_PARAMS;
+      if (!intrin_opts.focus_shared)
+        m_distortion_offset += NUM_FOCUS_PARAMS;
+    }
+
+    // For simplicity, we always set this to the same size even
+    //  if none of the parameters are shared.
+    m_num_shared_intrinsics = NUM_CENTER_PARAMS + NUM_FOCUS_PARAMS
+                              + num_distortion_params;
+
+    m_num_intrinsics = m_num_shared_intrinsics + m_num_cameras*m_num_intrinsics_per_camera;
   }
 
+public:
+
   /// Apply a random offset to each camera position.
   void randomize_cameras() {
     // These are stored as x,y,z, axis_angle.
     // - We move the position +/- 5 meters.
     // - Currently we don't adjust the angle.
     boost::random::uniform_int_distribution<> xyz_dist(0, 10);
-    const size_t NUM_CAMERA_PARAMS = 6;
-    VW_ASSERT((m_cameras_vec.size() % NUM_CAMERA_PARAMS) == 0,
-              vw::LogicErr() << "Camera parameter length is not a multiple of 6!");
-    const size_t num_cameras = m_cameras_vec.size() / NUM_CAMERA_PARAMS;
-    for (size_t c=0; c<num_cameras; ++c) {
+    for (int c=0; c<m_num_cameras; ++c) {
       double* ptr = get_camera_ptr(c);
       for (size_t i=0; i<3; ++i) {
         int o = xyz_dist(m_rand_gen) - 5;
@@ -324,56 +330,46 @@ public:
   int params_per_point () const {return m_params_per_point;}
   int params_per_camera() const {return m_num_pose_params;}
 
-  std::vector<double> & get_point_vector() {
-    return m_points_vec;
-  }
-  std::vector<double> & get_camera_vector() {
-    return m_cameras_vec;
-  }
-  std::vector<double> & get_intrinsics_vector() {
-    return m_intrinsics_vec;
-  }
-  
   double* get_point_ptr(int point_index) {
-    return &(m_points_vec[point_index*m_params_per_point]);
+    return &(m_params[points_offset() + point_index*m_params_per_point]);
   }
   double const* get_point_ptr(int point_index) const {
-    return &(m_points_vec[point_index*m_params_per_point]);
+    return &(m_params[points_offset() + point_index*m_params_per_point]);
   }
   
   double* get_camera_ptr(int cam_index) {
-    return &(m_cameras_vec[cam_index*m_num_pose_params]);
+    return &(m_params[cam_index*m_num_pose_params]);
   }
   double const* get_camera_ptr(int cam_index) const {
-    return &(m_cameras_vec[cam_index*m_num_pose_params]);
+    return &(m_params[cam_index*m_num_pose_params]);
   }
 
   // ------- These functions are only needed for pinhole cameras ------
   double* get_intrinsic_center_ptr(int cam_index) {
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_center_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_center_offset(cam_index)]);
   }
   double const* get_intrinsic_center_ptr(int cam_index) const {
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_center_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_center_offset(cam_index)]);
   }
   
   double* get_intrinsic_focus_ptr(int cam_index) {
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_focus_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_focus_offset(cam_index)]);
   }
   double const* get_intrinsic_focus_ptr(int cam_index) const{
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_focus_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_focus_offset(cam_index)]);
   }
 
   double* get_intrinsic_distortion_ptr(int cam_index) {
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_distortion_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_distortion_offset(cam_index)]);
   }
   double const* get_intrinsic_distortion_ptr(int cam_index) const{
-    if (m_intrinsics_vec.empty()) return 0;
-    return &(m_intrinsics_vec[get_distortion_offset(cam_index)]);
+    if (m_num_intrinsics == 0) return 0;
+    return &(m_params[intrinsics_offset() + get_distortion_offset(cam_index)]);
   }
   // ------- End pinhole camera functions ------
   
@@ -387,7 +383,7 @@ public:
   /// Return the number of points flagged as outliers.
   int get_num_outliers() const {
     int count = 0;
-    for (size_t i=0; i<m_num_points; ++i) {
+    for (int i=0; i<m_num_points; ++i) {
       if (m_outlier_points_vec[i])
         ++count;
     }
@@ -448,24 +444,34 @@ private: // Variables
 
   int m_num_points, m_num_cameras, m_params_per_point, m_num_pose_params;
   
-  // m_intrinsics_vec starts out with m_num_shared_intrinsics values which are
+  // The intrinsics start out with m_num_shared_intrinsics values which are
   //  shared between all cameras, followed by the per-camera intrinsics for each camera.
   int m_num_shared_intrinsics, m_num_intrinsics_per_camera, m_num_distortion_params;
   
   // These store the offset to the focus or distortion data from the start of
-  //  either the shared parameters at the start of m_intrinsics_vec or from
+  //  either the shared parameters at the start of the intrinsics or from
   //  the block of intrinsics data for the specified camera.
   int m_focus_offset, m_distortion_offset;
+
+  // The total number of intrinsics, shared and per camera
+  int m_num_intrinsics;
   
   IntrinsicOptions m_intrin_options;
   
-  // Raw data storage
-  std::vector<double> m_points_vec, m_cameras_vec, m_intrinsics_vec;
+  // Raw data storage. The cameras, then the intrinsics, then the points.
+  std::vector<double> m_params;
   std::vector<bool> m_outlier_points_vec;
 
 private: // Functions
 
-  /// Compute the offset in m_intrinsics_vec to the requested data.
+  size_t intrinsics_offset() const {
+    return size_t(m_num_cameras)*m_num_pose_params;
+  }
+  size_t points_offset() const {
+    return intrinsics_offset() + m_num_intrinsics;
+  }
+
+  /// Compute the offset in the intrinsics to the requested data.
   size_t get_center_offset(int cam_index) const {
     if (m_intrin_options.center_shared)
       return 0;
@@ -611,31 +617,11 @@ void apply_transform_to_cameras_optical_bar(vw::Matrix4x4 const& M,
 
 //=================================================================
 
-/// Load all of the reference disparities specified in the input text file
-/// and store them in the vectors.  Return the number loaded.
-// TODO(oalexan1): This need not be a template. The disparity type
-// is always PixelMask<Vector2f>.
-template <class DispPixelT>
-int load_reference_disparities(std::string const& disp_list_filename,
-                               std::vector< vw::ImageView   <DispPixelT>> &disp_vec,
-                               std::vector< vw::ImageViewRef<DispPixelT>> &interp_disp) {
-  // TODO: Disparities can be large, but if small it is better to
-  // read them in memory.
-  std::istringstream is(disp_list_filename);
-  std::string disp_file;
-  while (is >> disp_file) {
-    if (disp_file != "none") {
-      vw::vw_out() << "Reading: " << disp_file << std::endl;
-      disp_vec.push_back(copy(vw::DiskImageView<DispPixelT>(disp_file)));
-    }else{
-      // Read in an empty disparity
-      disp_vec.push_back(vw::ImageView<DispPixelT>());
-    }
-    interp_disp.push_back(interpolate(disp_vec.back(),
-                                      vw::BilinearInterpolation(), vw::ConstantEdgeExtension()));
-  }
-  return static_cast<int>(disp_vec.size());
-}
+/// Read the list of reference disparities, one for each pair of
+/// consecutive cameras, separated by spaces. An entry of "none" means
+/// that pair has no disparity. Return the number of entries.
+int read_reference_disparity_list(std::string const& disp_list,
+                                  std::vector<std::string> & disp_files);
 
 /// Apply a scale-rotate-translate transform to pinhole cameras and control points
 void apply_rigid_transform(vw::Matrix3x3 const & rotation,
@@ -697,12 +683,27 @@ void align_cameras_to_ground(std::vector< std::vector<vw::Vector3>> const& xyz,
 
 /// Take an interest point from a map projected image and convert it
 /// to the corresponding IP in the original non-map-projected image.
+/// The heights are looked up in the DEM the image was projected onto,
+/// kept in memory, as from asp::load_mapproj_dem().
 /// - Return false if the pixel could not be converted.
 bool projected_ip_to_raw_ip(vw::ip::InterestPoint &P,
-                            vw::ImageViewRef<vw::PixelMask<double>> const& interp_dem,
+                            asp::DemRayIntersector const& dem,
                             asp::CameraModelPtr camera_model,
-                            vw::cartography::GeoReference const& georef,
-                            vw::cartography::GeoReference const& dem_georef);
+                            vw::cartography::GeoReference const& georef);
+
+/// Convert many sets of interest points from map-projected images to
+/// the raw images. Set k is in the map-projected image of camera
+/// cam_indices[k], with georeference georefs[cam_indices[k]]. The
+/// cameras are processed in parallel, and each camera by one thread
+/// only, as the camera models need not be thread-safe. Record in
+/// 'good' which points were converted.
+void projected_ips_to_raw_ips(std::vector<std::vector<vw::ip::InterestPoint>> & ips,
+                              std::vector<int> const& cam_indices,
+                              asp::DemRayIntersector const& dem,
+                              std::vector<asp::CameraModelPtr> const& camera_models,
+                              std::vector<vw::cartography::GeoReference> const& georefs,
+                              int num_threads,
+                              std::vector<std::vector<bool>> & good);
 
 // TODO(oalexan1): Move the asp namespace to encompass the whole header file
 // Save convergence angle percentiles for each image pair having matches
@@ -737,6 +738,7 @@ void saveMapprojOffsets(std::string const& mapproj_offsets_stats_file,
 // reloading interest point matches, which is expensive so the matches
 // are used for both operations.
 void matchFilesProcessing(vw::ba::ControlNetwork const& cnet,
+                          asp::BAObservations const& obs,
                           asp::BaBaseOptions const& opt,
                           std::vector<asp::CameraModelPtr> const& optimized_cams,
                           bool remove_outliers, std::set<int> const& outliers,
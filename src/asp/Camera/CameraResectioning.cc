@@ -78,18 +78,53 @@ void findCameraPose(std::vector<vw::Vector3> const& ground_points,
     cv_pixel_observations.push_back(cv::Point2d(P[0], P[1]));
   }
   
-  // Call PnP
-  bool useExtrinsicGuess = false;
-  int iterationsCount = 1000; // This algorithm is cheap, let it try hard
+  // The ground points are far from the origin. Shift them to their mean,
+  // for the accuracy of the closed-form solution.
+  cv::Point3d mean(0, 0, 0);
+  for (size_t it = 0; it < cv_ground_points.size(); it++)
+    mean += cv_ground_points[it];
+  mean *= 1.0 / cv_ground_points.size();
+  for (size_t it = 0; it < cv_ground_points.size(); it++)
+    cv_ground_points[it] -= mean;
+
   float reprojectionError = 20.0; // because of un-modeled distortion, relax things here
-  double confidence = 0.95;
   cv::Mat rvec(3, 1, cv::DataType<double>::type, cv::Scalar(0)); // Rodrigues rotation 
   cv::Mat tvec(3, 1, cv::DataType<double>::type, cv::Scalar(0)); // translation
-  bool result = cv::solvePnPRansac(cv_ground_points, cv_pixel_observations,
-                                   intrinsics, distortion,
-                                   rvec, tvec, // outputs
-                                   useExtrinsicGuess, iterationsCount, reprojectionError,
-                                   confidence);
+
+  // First try the closed-form EPnP solution, refined with Levenberg-Marquardt.
+  // This is fast and accurate when there are no outliers.
+  bool result = false;
+  try {
+    result = cv::solvePnP(cv_ground_points, cv_pixel_observations,
+                          intrinsics, distortion, rvec, tvec, false, cv::SOLVEPNP_EPNP);
+    if (result) {
+      cv::solvePnPRefineLM(cv_ground_points, cv_pixel_observations,
+                           intrinsics, distortion, rvec, tvec);
+      std::vector<cv::Point2d> projected;
+      cv::projectPoints(cv_ground_points, rvec, tvec, intrinsics, distortion, projected);
+      for (size_t it = 0; it < projected.size(); it++) {
+        // Also check for NaN
+        if (!(cv::norm(projected[it] - cv_pixel_observations[it]) <= reprojectionError))
+          result = false;
+      }
+    }
+  } catch (...) {
+    result = false;
+  }
+  
+  // Otherwise use PnP with RANSAC
+  if (!result) {
+    bool useExtrinsicGuess = false;
+    int iterationsCount = 1000; // This algorithm is cheap, let it try hard
+    double confidence = 0.95;
+    rvec = cv::Scalar(0);
+    tvec = cv::Scalar(0);
+    result = cv::solvePnPRansac(cv_ground_points, cv_pixel_observations,
+                                intrinsics, distortion,
+                                rvec, tvec, // outputs
+                                useExtrinsicGuess, iterationsCount, reprojectionError,
+                                confidence);
+  }
   if (!result)
     vw::vw_throw(vw::ArgumentErr()
                  << "Failed to find camera orientation using pixel and ground data.\n");
@@ -102,7 +137,8 @@ void findCameraPose(std::vector<vw::Vector3> const& ground_points,
   // Make world2cam into cam2world
   Eigen::Matrix3d cam2world = rotation.inverse(); 
   Eigen::Vector3d cam_ctr = -rotation.inverse() *
-    Eigen::Vector3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+    Eigen::Vector3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2))
+    + Eigen::Vector3d(mean.x, mean.y, mean.z); // undo the shift
 
   // Convert Eigen matrix and vector to VW
   vw::Matrix3x3 rot;
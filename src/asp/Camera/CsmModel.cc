@@ -43,6 +43,9 @@
 #include <ale/Rotation.h>
 #include <Eigen/Geometry>
 
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <streambuf>
 
 namespace dll = boost::dll;
@@ -67,6 +70,11 @@ enum USGSCSM_MODEL_TYPE {
 
 vw::Mutex csm_init_mutex;
 
+// The CSM plugin libraries loaded by this process, by path. They are
+// kept open for as long as the process runs, as their plugins stay
+// registered with csm::Plugin. Protected by csm_init_mutex.
+std::map<std::string, dll::shared_library> csm_loaded_libs;
+
 // -----------------------------------------------------------------
 // Helper functions
 
@@ -280,34 +288,92 @@ const csm::Plugin* find_plugin_for_isd(csm::Isd const& support_data,
 } // End function find_plugin_for_isd
 
 
-void CsmModel::initialize_plugins() {
+// Read the plugin manifest, if present. Each line has the file name
+// of a plugin library in the plugin folder, followed by the names of
+// the models it provides. Lines starting with '#' are ignored.
+bool read_csm_plugin_manifest(std::string const& folder,
+                              std::map<std::string, std::string> & model_to_lib) {
+  model_to_lib.clear();
+  fs::path manifest = fs::path(folder) / "csm_plugins.txt";
+  std::ifstream ifs(manifest.string().c_str());
+  if (!ifs.good())
+    return false;
+
+  std::string line;
+  while (std::getline(ifs, line)) {
+    std::istringstream is(line);
+    std::string lib, model;
+    if (!(is >> lib) || lib[0] == '#')
+      continue;
+    while (is >> model)
+      model_to_lib[model] = (fs::path(folder) / lib).string();
+  }
+  return true;
+}
+
+// The model name in an ISD, or the empty string if it has none
+std::string isd_model_name(std::string const& isd_path) {
+  std::ifstream ifs(isd_path);
+  json json_isd;
+  try {
+    ifs >> json_isd;
+    return json_isd.at("name_model").get<std::string>();
+  } catch (...) {
+  }
+  return "";
+}
+
+// Return true if a plugin providing this model is registered
+bool csm_model_is_registered(std::string const& model_name) {
+  csm::PluginList plugins = csm::Plugin::getList();
+  for (auto iter = plugins.begin(); iter != plugins.end(); iter++) {
+    for (size_t i = 0; i < (*iter)->getNumModels(); i++) {
+      if ((*iter)->getModelName(i) == model_name)
+        return true;
+    }
+  }
+  return false;
+}
+
+void CsmModel::initialize_plugins(std::string const& model_name) {
 
   // Only let one thread at a time in here.
   vw::Mutex::Lock lock(csm_init_mutex);
 
-  // If we already have plugins loaded, don't do initialization again.
-  csm::PluginList plugins = csm::Plugin::getList();
-  if (!plugins.empty())
+  // Plugins linked into the executable, or loaded before by any
+  // CsmModel in this process, are registered already. If the ISD does
+  // not name its model, any registered plugin will be tried.
+  if (model_name != "" && csm_model_is_registered(model_name))
+    return;
+  if (model_name == "" && !csm::Plugin::getList().empty())
     return;
-  
-  //vw_out() << "Initializing CSM plugins...\n";
 
-  // Find all of the available CSM plugin DLL files.
+  // Load only the plugin the manifest lists for this model, if
+  // possible, else the default plugins.
   std::vector<std::string> plugin_files;
-  size_t num_plugin_files = find_csm_plugins(plugin_files);
-  //vw_out() << "Found " << num_plugin_files << " CSM plugin files.\n";
+  std::map<std::string, std::string> model_to_lib;
+  auto it = model_to_lib.end();
+  if (model_name != "" &&
+      read_csm_plugin_manifest(get_csm_plugin_folder(), model_to_lib)) 
+    it = model_to_lib.find(model_name);
+  if (it != model_to_lib.end())
+    plugin_files.push_back(it->second);
+  else
+    find_csm_plugins(plugin_files);
 
-  // Load all of the plugins.
-  for (size_t i = 0; i < num_plugin_files; i++) {
+  bool loaded_new = false;
+  for (size_t i = 0; i < plugin_files.size(); i++) {
+    if (csm_loaded_libs.find(plugin_files[i]) != csm_loaded_libs.end())
+      continue;
     // Get the DLL in memory, causing it to automatically register itself
     //  with the main Plugin interface.
     vw_out() << "Loading CSM plugin: " << plugin_files[i] << std::endl;
-    boost::dll::shared_library lib_usgs(plugin_files[i]);
+    csm_loaded_libs[plugin_files[i]] = dll::shared_library(plugin_files[i]);
+    loaded_new = true;
   }
 
-  //csm::Plugin::setDataDirectory(plugin_folder); // Don't think we need this.
-
-  print_available_models();
+  if (loaded_new)
+    print_available_models();
 }
 
 // Read the semi-major and semi-minor axes
@@ -401,8 +467,8 @@ void CsmModel::load_model(std::string const& isd_path) {
   
 void CsmModel::load_model_from_isd(std::string const& isd_path) {
 
-  // This only happens the first time it is called.
-  initialize_plugins();
+  // Load a plugin for this model, unless one is registered already
+  initialize_plugins(isd_model_name(isd_path));
 
   // Load ISD data
   csm::Isd support_data(isd_path);
@@ -599,6 +665,27 @@ Vector2 CsmModel::point_to_pixel(Vector3 const& point) const {
   return imageCoordToVector(imagePt) - ASP_TO_CSM_SHIFT;
 }
 
+void CsmModel::point_to_pixel(std::vector<Vector3> const& points,
+                              std::vector<Vector2> & pixels) const {
+  throw_if_not_init();
+
+  pixels.resize(points.size());
+  
+  // Do not show warnings, it becomes too verbose
+  double achievedPrecision = -1.0;
+  csm::WarningList * warnings_ptr = NULL;
+  csm::RasterGM const* gm_model = m_gm_model.get();
+  csm::EcefCoord ecef;
+  for (size_t it = 0; it < points.size(); it++) {
+    ecef.x = points[it][0];
+    ecef.y = points[it][1];
+    ecef.z = points[it][2];
+    csm::ImageCoord imagePt = gm_model->groundToImage(ecef, m_desired_precision,
+                                                      &achievedPrecision, warnings_ptr);
+    fromCsmPixel(pixels[it], imagePt);
+  }
+}
+
 Vector3 CsmModel::pixel_to_vector(Vector2 const& pix) const {
   throw_if_not_init();
 
@@ -756,9 +843,67 @@ void CsmModel::saveTransformedState(std::string const& json_state_file,
   return;
 }
 
+// Apply a transform to the positions, velocities, and quaternions of a
+// linescan model in place. This is the same as what
+// UsgsAstroLsSensorModel::applyTransformToState() does to the model
+// state, without going through the json state.
+void applyTransformToLsModel(vw::Matrix4x4 const& transform,
+                             UsgsAstroLsSensorModel * ls_model) {
+
+  double scale = pow(det(transform), 1.0/3.0);
+  if (std::abs(scale - 1.0) > 1e-6)
+    vw_throw(ArgumentErr()
+             << "CSM camera models do not support applying a transform with a scale.\n");
+
+  vw::Matrix3x3 rotation_matrix = submatrix(transform, 0, 0, 3, 3);
+  vw::Vector3 translation(transform(0, 3), transform(1, 3), transform(2, 3));
+
+  // The velocities are only rotated
+  std::vector<double> & positions  = ls_model->m_positions;
+  std::vector<double> & velocities = ls_model->m_velocities;
+  for (size_t it = 0; it + 2 < positions.size(); it += 3) {
+    vw::Vector3 p(positions[it], positions[it + 1], positions[it + 2]);
+    p = rotation_matrix * p + translation;
+    for (int c = 0; c < 3; c++)
+      positions[it + c] = p[c];
+  }
+  for (size_t it = 0; it + 2 < velocities.size(); it += 3) {
+    vw::Vector3 v(velocities[it], velocities[it + 1], velocities[it + 2]);
+    v = rotation_matrix * v;
+    for (int c = 0; c < 3; c++)
+      velocities[it + c] = v[c];
+  }
+
+  // The quaternions are stored as x, y, z, w, while ALE expects w, x, y, z
+  std::vector<double> rotation_vec;
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++) {
+      rotation_vec.push_back(rotation_matrix(row, col));
+    }
+  }
+  ale::Rotation r(rotation_vec);
+  std::vector<double> & quaternions = ls_model->m_quaternions;
+  for (size_t it = 0; it + 3 < quaternions.size(); it += 4) {
+    double * quat = &quaternions[it];
+    ale::Rotation q(quat[3], quat[0], quat[1], quat[2]);
+    q = r * q;
+    std::vector<double> v = q.toQuaternion();
+    quat[0] = v[1]; quat[1] = v[2]; quat[2] = v[3]; quat[3] = v[0];
+  }
+}
+
 // Apply a transform to a CSM model
 void CsmModel::applyTransform(vw::Matrix4x4 const& transform) {
 
+  // Linescan models can have very many samples, so update those in
+  // place rather than writing and parsing back the model state.
+  UsgsAstroLsSensorModel * ls_model
+    = dynamic_cast<UsgsAstroLsSensorModel*>(this->m_gm_model.get());
+  if (ls_model != NULL) {
+    applyTransformToLsModel(transform, ls_model);
+    return;
+  }
+
   csm::RasterGM const* gm_model
     = dynamic_cast<csm::RasterGM const*>(this->m_gm_model.get());
   
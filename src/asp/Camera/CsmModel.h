@@ -27,6 +27,8 @@
 #include <vw/Camera/CameraModel.h>
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
 namespace csm {
   // Forward declarations
   class RasterGM; 
@@ -59,6 +61,12 @@ namespace asp {
 
     virtual vw::Vector2 point_to_pixel (vw::Vector3 const& point) const;
 
+    /// Project many points at once. This calls the CSM model directly
+    /// for each point, without the per-call conversions and virtual
+    /// calls through CameraModel. Throws if any point fails to project.
+    void point_to_pixel(std::vector<vw::Vector3> const& points,
+                        std::vector<vw::Vector2> & pixels) const;
+
     virtual vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
 
     virtual vw::Vector3 camera_center(vw::Vector2 const& pix) const;
@@ -128,9 +136,14 @@ namespace asp {
     /// if desired to adjust an existing model.
     void setModelFromStateString(std::string const& model_state, bool recreate_model);
 
-    /// Find and load any available CSM plugin libraries from disk.
-    /// - This does nothing after the first time it finds any plugins.
-    void initialize_plugins();
+    /// Load from disk a CSM plugin library providing the given model,
+    /// unless one is registered already. The library is looked up in
+    /// the csm_plugins.txt manifest in the plugin folder, if present,
+    /// else the default plugins are loaded. Loaded libraries stay
+    /// registered for all CsmModel objects in the process. With an
+    /// empty model name, this loads the default plugins only if none
+    /// are registered.
+    void initialize_plugins(std::string const& model_name);
 
     /// Throw an exception if we have not loaded the model yet.
     void throw_if_not_init() const;
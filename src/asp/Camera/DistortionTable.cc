@@ -0,0 +1,200 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/DistortionTable.h>
+
+#include <vw/Camera/LensDistortion.h>
+#include <vw/Core/Exception.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  // Each block has this many cells in each direction
+  const int DISTORTION_TABLE_BLOCK_SIZE = 16;
+
+  // The margin, in units of node spacing, by which the table extends
+  // beyond the image, as observations can be a bit outside it while
+  // the solver iterates.
+  const int DISTORTION_TABLE_MARGIN = 2;
+
+  // The most tables kept for a camera
+  const int DISTORTION_TABLE_CACHE_SIZE = 64;
+
+  DistortionTable::DistortionTable(vw::camera::PinholeModel const& cam,
+                                   vw::Vector2i const& image_size, int spacing,
+                                   double max_error):
+    m_cam(cam), m_undist_cam(cam), m_spacing(spacing), m_max_error(max_error),
+    m_num_built(0), m_num_exact(0) {
+
+    if (spacing <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The distortion table spacing must be positive.\n");
+    if (image_size.x() <= 0 || image_size.y() <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The distortion table needs a non-empty image.\n");
+
+    vw::camera::NullLensDistortion no_distortion;
+    m_undist_cam.set_lens_distortion(&no_distortion);
+
+    m_box = vw::BBox2i(0, 0, image_size.x(), image_size.y());
+    m_box.expand(DISTORTION_TABLE_MARGIN * spacing);
+
+    m_num_cells_x  = (m_box.width()  + spacing - 1) / spacing;
+    m_num_cells_y  = (m_box.height() + spacing - 1) / spacing;
+    m_num_blocks_x = (m_num_cells_x + DISTORTION_TABLE_BLOCK_SIZE - 1)
+      / DISTORTION_TABLE_BLOCK_SIZE;
+    m_num_blocks_y = (m_num_cells_y + DISTORTION_TABLE_BLOCK_SIZE - 1)
+      / DISTORTION_TABLE_BLOCK_SIZE;
+    m_blocks.reset(new Block[m_num_blocks_x * m_num_blocks_y]);
+  }
+
+  // Go along the ray of the camera without distortion, and project
+  // back with the distortion
+  vw::Vector2 DistortionTable::exact_pixel(vw::Vector2 const& undist_pix) const {
+    vw::Vector3 point = m_undist_cam.camera_center(undist_pix)
+      + m_undist_cam.pixel_to_vector(undist_pix);
+    return m_cam.point_to_pixel_no_check(point);
+  }
+
+  void DistortionTable::build_block(int bx, int by, Block & block) const {
+
+    m_num_built++;
+    block.use_exact = false;
+
+    const int N = DISTORTION_TABLE_BLOCK_SIZE + 1; // nodes per side
+    block.pixels.resize(N * N);
+
+    vw::Vector2 corner = vw::Vector2(m_box.min())
+      + double(m_spacing) * vw::Vector2(bx * DISTORTION_TABLE_BLOCK_SIZE,
+                                        by * DISTORTION_TABLE_BLOCK_SIZE);
+    try {
+      for (int j = 0; j < N; j++) {
+        for (int i = 0; i < N; i++)
+          block.pixels[j * N + i] = exact_pixel(corner + double(m_spacing) * vw::Vector2(i, j));
+      }
+
+      // Check the interpolated pixels at the cell centers, where the
+      // interpolation error is largest
+      for (int j = 0; j < DISTORTION_TABLE_BLOCK_SIZE && !block.use_exact; j++) {
+        for (int i = 0; i < DISTORTION_TABLE_BLOCK_SIZE; i++) {
+          int n = j * N + i;
+          vw::Vector2 interp = (block.pixels[n] + block.pixels[n + 1] +
+                                block.pixels[n + N] + block.pixels[n + N + 1]) / 4.0;
+          vw::Vector2 exact
+            = exact_pixel(corner + double(m_spacing) * vw::Vector2(i + 0.5, j + 0.5));
+          if (!(vw::math::norm_2(interp - exact) <= m_max_error)) { // also catches NaN
+            block.use_exact = true;
+            break;
+          }
+        }
+      }
+    } catch (...) {
+      // The exact camera failed somewhere in this block
+      block.use_exact = true;
+    }
+
+    if (block.use_exact) {
+      m_num_exact++;
+      block.pixels.clear();
+    }
+  }
+
+  bool DistortionTable::distorted_pixel(vw::Vector2 const& undist_pix,
+                                        vw::Vector2 & pix) const {
+
+    double fx = (undist_pix.x() - m_box.min().x()) / m_spacing;
+    double fy = (undist_pix.y() - m_box.min().y()) / m_spacing;
+    if (!(fx >= 0 && fy >= 0 && fx < m_num_cells_x && fy < m_num_cells_y))
+      return false; // outside the table, or NaN
+
+    int cx = int(fx), cy = int(fy);
+    int bx = cx / DISTORTION_TABLE_BLOCK_SIZE, by = cy / DISTORTION_TABLE_BLOCK_SIZE;
+    int lx = cx - bx * DISTORTION_TABLE_BLOCK_SIZE;
+    int ly = cy - by * DISTORTION_TABLE_BLOCK_SIZE;
+    double tx = fx - cx, ty = fy - cy;
+
+    Block & block = m_blocks[by * m_num_blocks_x + bx];
+    std::call_once(block.flag, &DistortionTable::build_block, this, bx, by, std::ref(block));
+    if (block.use_exact)
+      return false;
+
+    const int N = DISTORTION_TABLE_BLOCK_SIZE + 1;
+    int n = ly * N + lx;
+    std::vector<vw::Vector2> const& p = block.pixels;
+    pix = (1 - ty) * ((1 - tx) * p[n]     + tx * p[n + 1]) +
+          ty       * ((1 - tx) * p[n + N] + tx * p[n + N + 1]);
+    return true;
+  }
+
+  DistortionTableCache::DistortionTableCache(vw::Vector2i const& image_size,
+                                             int spacing, double max_error):
+    m_image_size(image_size), m_spacing(spacing), m_max_error(max_error) {}
+
+  boost::shared_ptr<DistortionTable>
+  DistortionTableCache::table(vw::camera::PinholeModel const& cam) {
+
+    // Everything the distortion in pixels depends on
+    KeyT key;
+    vw::Vector2 focus = cam.focal_length(), offset = cam.point_offset();
+    vw::Vector<double> lens = cam.lens_distortion()->distortion_parameters();
+    key.push_back(focus[0]);
+    key.push_back(focus[1]);
+    key.push_back(offset[0]);
+    key.push_back(offset[1]);
+    key.push_back(cam.pixel_pitch());
+    for (size_t i = 0; i < lens.size(); i++)
+      key.push_back(lens[i]);
+
+    // Making a table is cheap, as its blocks are built when needed
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tables.find(key);
+    if (it != m_tables.end())
+      return it->second;
+
+    boost::shared_ptr<DistortionTable> table
+      (new DistortionTable(cam, m_image_size, m_spacing, m_max_error));
+    m_tables[key] = table;
+    m_order.push_back(key);
+
+    // Keep at least enough for the values of the intrinsics in an
+    // iteration and in the next one. Tables in use are kept alive by
+    // their users.
+    size_t max_size = std::max(DISTORTION_TABLE_CACHE_SIZE, 2 * int(key.size() + 1));
+    while (m_order.size() > max_size) {
+      m_tables.erase(m_order.front());
+      m_order.pop_front();
+    }
+
+    return table;
+  }
+
+  vw::Vector2 point_to_pixel_with_table(vw::camera::PinholeModel const& cam,
+                                        DistortionTable const& table,
+                                        vw::Vector3 const& point) {
+    vw::camera::PinholeModel undist_cam = cam;
+    vw::camera::NullLensDistortion no_distortion;
+    undist_cam.set_lens_distortion(&no_distortion);
+
+    vw::Vector2 pix;
+    if (table.distorted_pixel(undist_cam.point_to_pixel_no_check(point), pix))
+      return pix;
+
+    return cam.point_to_pixel_no_check(point);
+  }
+
+} // end namespace asp
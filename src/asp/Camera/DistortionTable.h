@@ -0,0 +1,121 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DistortionTable.h
+///
+/// A table of the lens distortion of a pinhole camera, that is, of the
+/// pixel at which the camera sees a point as a function of the pixel
+/// at which the same camera without distortion would see it. For many
+/// distortion models this needs an iterative solver, which is slow when
+/// done for every observation, as in bundle adjustment. The table is
+/// interpolated bilinearly instead. It does not depend on the camera
+/// pose, so it stays valid while only the pose changes.
+
+#ifndef __ASP_CAMERA_DISTORTION_TABLE_H__
+#define __ASP_CAMERA_DISTORTION_TABLE_H__
+
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace asp {
+
+  // As for RayTableCamera, the table is split into blocks of cells,
+  // and each block is built the first time a pixel in it is needed.
+  // The interpolated pixels at the center of each cell of a new block
+  // are checked against the exact camera. If the error is above the
+  // given bound, in pixels, or the exact camera fails, that block uses
+  // the exact camera instead. Pixels outside the image, with a margin,
+  // also use the exact camera.
+  class DistortionTable {
+
+  public:
+    // The camera is copied, so later changes to it do not affect the table
+    DistortionTable(vw::camera::PinholeModel const& cam,
+                    vw::Vector2i const& image_size, int spacing, double max_error);
+
+    // Find the pixel for the given undistorted pixel. Return false if
+    // the table does not have it, and then the exact camera must be used.
+    bool distorted_pixel(vw::Vector2 const& undist_pix, vw::Vector2 & pix) const;
+
+    // How many blocks were built, and how many of those failed the
+    // error check and use the exact camera
+    int num_built_blocks() const { return m_num_built;  }
+    int num_exact_blocks() const { return m_num_exact; }
+
+  private:
+
+    struct Block {
+      std::once_flag flag;
+      bool use_exact;
+      std::vector<vw::Vector2> pixels; // at the nodes of the block
+    };
+
+    // The exact pixel for an undistorted pixel
+    vw::Vector2 exact_pixel(vw::Vector2 const& undist_pix) const;
+    void build_block(int bx, int by, Block & block) const;
+
+    vw::camera::PinholeModel m_cam, m_undist_cam;
+    vw::BBox2i m_box;     // the region covered by the table, in undistorted pixels
+    int m_spacing;        // the distance between nodes, in pixels
+    double m_max_error;
+    int m_num_cells_x, m_num_cells_y, m_num_blocks_x, m_num_blocks_y;
+    boost::scoped_array<Block> m_blocks;
+    mutable std::atomic<int> m_num_built, m_num_exact;
+  };
+
+  // The tables for the recent intrinsics of a camera. Bundle adjustment
+  // evaluates the camera at several values of the intrinsics in each
+  // iteration, to find the derivatives, while those are fixed across
+  // all the observations in the camera. The tables are keyed by the
+  // exact intrinsics, so a new table is made when they change, and the
+  // oldest ones are dropped. Safe to use from several threads.
+  class DistortionTableCache {
+
+  public:
+    DistortionTableCache(vw::Vector2i const& image_size, int spacing, double max_error);
+
+    // The table for the intrinsics of this camera
+    boost::shared_ptr<DistortionTable> table(vw::camera::PinholeModel const& cam);
+
+  private:
+    typedef std::vector<double> KeyT;
+    vw::Vector2i m_image_size;
+    int m_spacing;
+    double m_max_error;
+    std::map<KeyT, boost::shared_ptr<DistortionTable>> m_tables;
+    std::deque<KeyT> m_order; // oldest first
+    std::mutex m_mutex;
+  };
+
+  /// Project a point into a pinhole camera using a table of its
+  /// distortion. Use the exact camera where the table does not apply.
+  vw::Vector2 point_to_pixel_with_table(vw::camera::PinholeModel const& cam,
+                                        DistortionTable const& table,
+                                        vw::Vector3 const& point);
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_DISTORTION_TABLE_H__
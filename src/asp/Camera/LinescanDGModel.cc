@@ -18,11 +18,14 @@
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Camera/LinescanDGModel.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/BinaryIO.h>
 #include <asp/Camera/CsmModel.h>
 
 #include <usgscsm/UsgsAstroLsSensorModel.h>
 #include <usgscsm/Utilities.h>
 
+#include <cmath>
+
 using namespace vw;
 
 namespace asp {
@@ -43,7 +46,7 @@ boost::posix_time::ptime parse_dg_time(std::string str) {
   return boost::posix_time::time_from_string(str); // Never reached!
 }
 
-boost::shared_ptr<vw::camera::CameraModel> load_dg_camera_model_from_xml(std::string const& path){
+void read_dg_camera_state(std::string const& path, DGCameraState & state) {
 
   // Parse the Digital Globe XML file
   GeometricXML geo;
@@ -135,10 +138,45 @@ boost::shared_ptr<vw::camera::CameraModel> load_dg_camera_model_from_xml(std::st
 							      geo.detector_origin[1],
 							      0)), 0, 2);
 
-  double et0 = convert(parse_dg_time(eph.start_time));
-  double at0 = convert(parse_dg_time(att.start_time));
-  double edt = eph.time_interval;
-  double adt = att.time_interval;
+  state.positions             = eph.position_vec;
+  state.velocities            = eph.velocity_vec;
+  state.ephem_t0              = convert(parse_dg_time(eph.start_time));
+  state.ephem_dt              = eph.time_interval;
+  state.poses                 = att.quat_vec;
+  state.pose_t0               = convert(parse_dg_time(att.start_time));
+  state.pose_dt               = att.time_interval;
+  state.tlc                   = img.tlc_vec;
+  state.tlc_t0                = convert(parse_dg_time(img.tlc_start_time));
+  state.image_size            = img.image_size;
+  state.detector_origin       = final_detector_origin;
+  state.focal_length          = geo.principal_distance;
+  state.mean_ground_elevation = mean_ground_elevation;
+} // End function read_dg_camera_state()
+
+void DGCameraState::write_state(std::ostream & os) const {
+  write_binary(os, positions);  write_binary(os, velocities);
+  write_binary(os, ephem_t0);   write_binary(os, ephem_dt);
+  write_binary(os, poses);
+  write_binary(os, pose_t0);    write_binary(os, pose_dt);
+  write_binary(os, tlc);        write_binary(os, tlc_t0);
+  write_binary(os, image_size); write_binary(os, detector_origin);
+  write_binary(os, focal_length);
+  write_binary(os, mean_ground_elevation);
+}
+
+void DGCameraState::read_state(std::istream & is) {
+  read_binary(is, positions);  read_binary(is, velocities);
+  read_binary(is, ephem_t0);   read_binary(is, ephem_dt);
+  read_binary(is, poses);
+  read_binary(is, pose_t0);    read_binary(is, pose_dt);
+  read_binary(is, tlc);        read_binary(is, tlc_t0);
+  read_binary(is, image_size); read_binary(is, detector_origin);
+  read_binary(is, focal_length);
+  read_binary(is, mean_ground_elevation);
+}
+
+boost::shared_ptr<vw::camera::CameraModel>
+load_dg_camera_model(DGCameraState const& state) {
 
   if ((stereo_settings().enable_correct_velocity_aberration ||
        stereo_settings().enable_correct_atmospheric_refraction) &&
@@ -148,15 +186,22 @@ boost::shared_ptr<vw::camera::CameraModel> load_dg_camera_model_from_xml(std::st
   
   return boost::shared_ptr<vw::camera::CameraModel>
     (new DGCameraModel
-     (vw::camera::PiecewiseAPositionInterpolation(eph.position_vec,
-                                                  eph.velocity_vec, et0, edt),
-      vw::camera::LinearPiecewisePositionInterpolation(eph.velocity_vec,
-                                                       et0, edt),
-      vw::camera::SLERPPoseInterpolation(att.quat_vec, at0, adt),
-      tlc_time_interpolation, img.image_size, final_detector_origin,
-      geo.principal_distance, mean_ground_elevation,
+     (vw::camera::PiecewiseAPositionInterpolation(state.positions, state.velocities,
+                                                  state.ephem_t0, state.ephem_dt),
+      vw::camera::LinearPiecewisePositionInterpolation(state.velocities,
+                                                       state.ephem_t0, state.ephem_dt),
+      vw::camera::SLERPPoseInterpolation(state.poses, state.pose_t0, state.pose_dt),
+      vw::camera::TLCTimeInterpolation(state.tlc, state.tlc_t0),
+      state.image_size, state.detector_origin,
+      state.focal_length, state.mean_ground_elevation,
       stereo_settings().enable_correct_velocity_aberration,
       stereo_settings().enable_correct_atmospheric_refraction));
+}
+
+boost::shared_ptr<vw::camera::CameraModel> load_dg_camera_model_from_xml(std::string const& path){
+  DGCameraState state;
+  read_dg_camera_state(path, state);
+  return load_dg_camera_model(state);
 } // End function load_dg_camera_model()
 
 
@@ -173,7 +218,8 @@ DGCameraModel::DGCameraModel
    bool                                                    correct_velocity,
    bool                                                    correct_atmosphere):
     DGCameraModelBase(position, velocity, pose, time, image_size, detector_origin, focal_length,
-                      mean_ground_elevation, correct_velocity, correct_atmosphere) {
+                      mean_ground_elevation, correct_velocity, correct_atmosphere),
+    m_has_corrections(correct_velocity || correct_atmosphere) {
 
   if (stereo_settings().dg_use_csm) 
     vw_out() << "Using the CSM model with DigitalGlobe cameras.\n";
@@ -181,6 +227,9 @@ DGCameraModel::DGCameraModel
   // It is convenient to have the CSM model exist even if it is not used.
   // The cam_test.cc and jitter_solve.cc tools uses this assumption.
   populateCsmModel();
+
+  m_tables.build(m_position_func, m_velocity_func, m_pose_func,
+                 m_time_func(0.0), m_time_func(m_image_size[1] - 1.0));
 }
   
 // This is a lengthy function that does many initializations  
@@ -359,7 +408,10 @@ vw::Vector3 DGCameraModel::get_camera_center_at_time(double time) const {
     csm::EcefCoord ecef = m_ls_model->getSensorPosition(time);
     return vw::Vector3(ecef.x, ecef.y, ecef.z);
   }
-  
+
+  vw::Vector3 ctr;
+  if (m_tables.position(time, ctr))
+    return ctr;
   return m_position_func(time);
 }
 
@@ -368,7 +420,10 @@ vw::Vector3 DGCameraModel::get_camera_velocity_at_time(double time) const {
     csm::EcefVector ecef = m_ls_model->getSensorVelocity(time);
     return vw::Vector3(ecef.x, ecef.y, ecef.z);
   }
-  
+
+  vw::Vector3 vel;
+  if (m_tables.velocity(time, vel))
+    return vel;
   return m_velocity_func(time);
 }
 
@@ -400,7 +455,10 @@ vw::Quat DGCameraModel::get_camera_pose_at_time(double time) const {
     getQuaternions(time, q);
     return vw::Quat(q[3], q[0], q[1], q[2]); // go from (x, y, z, w) to (w, x, y, z)
   }
-  
+
+  vw::Quat q;
+  if (m_tables.pose(time, q))
+    return q;
   return m_pose_func(time);
 }
   
@@ -437,6 +495,118 @@ double DGCameraModel::errorFunc(double y, vw::Vector3 const& point) const {
   return pt.y() / pt.z() - m_detector_origin[1] / m_focal_length;
 }
   
+// See the .h file for the documentation.
+double DGCameraModel::errorFuncAndDeriv(double y, vw::Vector3 const& point,
+                                        double & deriv) const {
+
+  // The time is linear in the line between TLC entries
+  double t    = get_time_at_line(y);
+  double dtdy = get_time_at_line(y + 1.0) - t;
+
+  vw::Quat    q   = get_camera_pose_at_time(t);
+  vw::Vector3 ctr = get_camera_center_at_time(t);
+  vw::Vector3 vel = get_camera_velocity_at_time(t);
+  vw::Vector3 dir = point - ctr;
+  vw::Vector3 pt  = inverse(q).rotate(dir);
+
+  // Derivative of pt in time. The attitude is sampled much less
+  // densely than the lines, so a step of 1/10 of a line is enough.
+  double dt = 0.1 * dtdy;
+  vw::Vector3 dpt = -inverse(q).rotate(vel);
+  if (dt != 0)
+    dpt += (inverse(get_camera_pose_at_time(t + dt)).rotate(dir) - pt) / dt;
+
+  deriv = dtdy * (dpt.y() * pt.z() - pt.y() * dpt.z()) / (pt.z() * pt.z());
+
+  return pt.y() / pt.z() - m_detector_origin[1] / m_focal_length;
+}
+
+// See the .h file for the documentation.
+bool DGCameraModel::solveLine(vw::Vector3 const& point, double start, double & line) const {
+
+  // The lines are found to this precision. It is much less than what
+  // is achieved with the full solver from the image center.
+  const double LINE_TOL       = 1e-8;
+  const int    MAX_ITERATIONS = 20;
+
+  // Do not step further than this from the start, as then the guess
+  // is likely for a different part of the image.
+  double max_step = 2.0 * m_image_size.y() + 1.0;
+  
+  line = start;
+  for (int it = 0; it < MAX_ITERATIONS; it++) {
+    double deriv = 0.0;
+    double err = errorFuncAndDeriv(line, point, deriv);
+    if (deriv == 0 || std::isnan(deriv) || std::isnan(err))
+      return false;
+
+    double step = err / deriv;
+    line -= step;
+    if (std::abs(line - start) > max_step)
+      return false;
+    
+    if (std::abs(step) < LINE_TOL)
+      return true;
+  }
+  
+  return false;
+}
+
+namespace {
+  // The lines found by the last point_to_pixel() calls in a thread,
+  // for the last few cameras. Nearby ground points nearly always
+  // project to nearby lines, so these are good starting guesses.
+  const int NUM_LINE_GUESSES = 4;
+  struct LineGuess {
+    const void* cam;
+    double line;
+  };
+  thread_local LineGuess g_line_guesses[NUM_LINE_GUESSES] = {{NULL, 0}, {NULL, 0},
+                                                             {NULL, 0}, {NULL, 0}};
+  thread_local int g_next_line_guess = 0;
+  
+  LineGuess * find_line_guess(const void* cam) {
+    for (int it = 0; it < NUM_LINE_GUESSES; it++) {
+      if (g_line_guesses[it].cam == cam)
+        return &g_line_guesses[it];
+    }
+    return NULL;
+  }
+}
+
+// See the .h file for the documentation.
+bool DGCameraModel::pointToPixelNewton(vw::Vector3 const& point, double starty,
+                                       vw::Vector2 & pix) const {
+
+  double line = 0.0;
+  LineGuess * guess = find_line_guess(this);
+  bool success = false;
+  if (starty >= 0)
+    success = solveLine(point, starty, line);
+  if (!success && guess != NULL)
+    success = solveLine(point, guess->line, line);
+  if (!success) 
+    success = solveLine(point, m_image_size.y()/2.0, line);
+  if (!success)
+    return false;
+
+  // Remember this line for the next call
+  if (guess == NULL) {
+    guess = &g_line_guesses[g_next_line_guess];
+    guess->cam = this;
+    g_next_line_guess = (g_next_line_guess + 1) % NUM_LINE_GUESSES;
+  }
+  guess->line = line;
+
+  // Solve for sample location now that we know the correct line
+  double t = get_time_at_line(line);
+  vw::Vector3 pt = inverse(get_camera_pose_at_time(t)).rotate(point - get_camera_center_at_time(t));
+  pt *= m_focal_length / pt.z();
+  pix = vw::Vector2(pt.x() - m_detector_origin[0], line);
+
+  return true;
+}
+  
 // Point to pixel with no initial guess
 vw::Vector2 DGCameraModel::point_to_pixel(vw::Vector3 const& point) const {
   if (stereo_settings().dg_use_csm) {
@@ -522,10 +692,20 @@ vw::Vector2 DGCameraModel::point_to_pixel(vw::Vector3 const& point, double start
     vw::vw_throw(vw::ArgumentErr()
                  << "point_to_pixel(point, starty): Cannot be called in CSM mode.\n");
     
-  // Use the uncorrected function to get a fast but good starting seed.
+  // Without corrections, solving for the line is all that is needed.
+  // Otherwise this is the starting guess for the solver below.
+  vw::Vector2 start;
+  bool success = pointToPixelNewton(point, starty, start);
+  if (success && !m_has_corrections)
+    return start;
+
+  // If Newton's method failed, use the less efficient uncorrected function
+  // to get a starting seed.
+  if (!success)
+    start = point_to_pixel_uncorrected(point, starty);
+  
   vw::camera::CameraGenericLMA model(this, point);
   int status = -1;
-  vw::Vector2 start = point_to_pixel_uncorrected(point, starty);
   
   // Run the solver
   vw::Vector3 objective(0, 0, 0);
@@ -25,6 +25,7 @@
 #define __STEREO_CAMERA_LINESCAN_DG_MODEL_H__
 
 #include <asp/Camera/TimeProcessing.h>
+#include <asp/Camera/LinescanTables.h>
 
 #include <vw/Camera/CameraSolve.h>
 #include <vw/Camera/LinescanModel.h>
@@ -325,6 +326,33 @@ namespace asp {
     // given line. This is analogous to LinescanLMA logic.
     double errorFunc(double y, vw::Vector3 const& point) const;
 
+    // Find errorFunc() and its derivative with respect to the line. The
+    // derivative is analytic in the position, with the velocity from
+    // the ephemeris, and uses a finite difference for the attitude,
+    // which changes slowly.
+    double errorFuncAndDeriv(double y, vw::Vector3 const& point, double & deriv) const;
+
+    // Find the line at which the point projects with Newton's method,
+    // starting at the given line. Return false if it fails to converge.
+    bool solveLine(vw::Vector3 const& point, double start, double & line) const;
+
+    // Find the line at which the point projects, starting from the
+    // given guess if non-negative, then from the line found by the
+    // previous call in this thread, then from the image center. Then
+    // find the sample, without velocity aberration and atmospheric
+    // refraction correction.
+    bool pointToPixelNewton(vw::Vector3 const& point, double starty,
+                            vw::Vector2 & pix) const;
+
+    // If velocity aberration or atmospheric refraction are corrected,
+    // in which case the solution from pointToPixelNewton() is only
+    // the starting guess for the full solver.
+    bool m_has_corrections;
+
+    // The positions, velocities, and poses at uniform times, used
+    // instead of the functors when not using CSM
+    LinescanTables m_tables;
+
     // Digital Globe implementation using CSM. Eventually this will
     // replace LinescanDGModel, and the class
     // PiecewiseAdjustedLinescanModel will go away as well.  Note that the
@@ -334,9 +362,36 @@ namespace asp {
     void populateCsmModel();
   };
 
-  /// Load a DG camera model from an XML file. This function does not
-  /// take care of Xerces XML init/de-init, the caller must make sure
-  /// this is done before/after this function is called.
+  /// What a DG camera model is made from, as read from an XML file and
+  /// converted to the conventions of the model. It can be cached, so
+  /// that the XML file need not be parsed again.
+  struct DGCameraState {
+    std::vector<vw::Vector3> positions, velocities; // camera center, ECEF
+    double ephem_t0, ephem_dt;
+    std::vector<vw::Quat> poses; // camera to world
+    double pose_t0, pose_dt;
+    std::vector<std::pair<double, double>> tlc; // line to time offset
+    double tlc_t0;
+    vw::Vector2i image_size;
+    vw::Vector2 detector_origin; // in pixels
+    double focal_length;         // in pixels
+    double mean_ground_elevation;
+
+    void write_state(std::ostream & os) const;
+    void read_state (std::istream & is);
+  };
+
+  /// Parse a DG XML file. This function does not take care of Xerces
+  /// XML init/de-init, the caller must make sure this is done
+  /// before/after this function is called.
+  void read_dg_camera_state(std::string const& path, DGCameraState & state);
+
+  /// Create a DG camera model from what was read from an XML file.
+  boost::shared_ptr<vw::camera::CameraModel>
+  load_dg_camera_model(DGCameraState const& state);
+
+  /// Load a DG camera model from an XML file. As read_dg_camera_state(),
+  /// the caller must handle the Xerces XML init/de-init.
   boost::shared_ptr<vw::camera::CameraModel>
   load_dg_camera_model_from_xml(std::string const& path);
 
@@ -68,17 +68,31 @@ void PeruSatCameraModel::check_time(double time, std::string const& location) co
                  << m_min_time << " <-> "<<m_max_time<<")\n");
 }
 
+void PeruSatCameraModel::build_tables() {
+  m_tables.build(m_position_func, m_velocity_func, m_pose_func,
+                 m_time_func(0.0), m_time_func(m_image_size[1] - 1.0));
+}
+
 vw::Vector3 PeruSatCameraModel::get_camera_center_at_time(double time) const {
   check_time(time, "get_camera_center_at_time");
+  vw::Vector3 ctr;
+  if (m_tables.position(time, ctr))
+    return ctr;
   return m_position_func(time);
 }
 vw::Vector3 PeruSatCameraModel::get_camera_velocity_at_time(double time) const { 
   check_time(time, "get_camera_velocity_at_time");
+  vw::Vector3 vel;
+  if (m_tables.velocity(time, vel))
+    return vel;
   return m_velocity_func(time); 
 }
 vw::Quat PeruSatCameraModel::get_camera_pose_at_time(double time) const {
   check_time(time, "get_camera_pose_at_time");
- return m_pose_func(time); 
+  vw::Quat q;
+  if (m_tables.pose(time, q))
+    return q;
+  return m_pose_func(time); 
 }
 
 double PeruSatCameraModel::get_time_at_line(double line) const {
@@ -298,6 +298,11 @@ load_pleiades_camera_model_from_xml(std::string const& path) {
   // Parse the Pleiades XML file
   PleiadesXML xml_reader;
   xml_reader.read_xml(path);
+  return load_pleiades_camera_model(xml_reader);
+}
+
+boost::shared_ptr<PleiadesCameraModel>
+load_pleiades_camera_model(PleiadesXML const& xml_reader) {
 
   // Get all the initial functors
   vw::camera::LinearTimeInterpolation
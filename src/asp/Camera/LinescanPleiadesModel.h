@@ -121,6 +121,11 @@ namespace asp {
   boost::shared_ptr<PleiadesCameraModel>
   load_pleiades_camera_model_from_xml(std::string const& path);
 
+  /// Create a Pleiades camera model from a parsed XML file.
+  class PleiadesXML;
+  boost::shared_ptr<PleiadesCameraModel>
+  load_pleiades_camera_model(PleiadesXML const& xml_reader);
+
 } // end namespace asp
 
 
@@ -62,17 +62,31 @@ void SPOTCameraModel::check_time(double time, std::string const& location) const
                  << m_min_time << " <-> "<<m_max_time<<")\n");
 }
 
+void SPOTCameraModel::build_tables() {
+  m_tables.build(m_position_func, m_velocity_func, m_pose_func,
+                 m_time_func(0.0), m_time_func(m_image_size[1] - 1.0));
+}
+
 vw::Vector3 SPOTCameraModel::get_camera_center_at_time(double time) const {
   check_time(time, "get_camera_center_at_time");
+  vw::Vector3 ctr;
+  if (m_tables.position(time, ctr))
+    return ctr;
   return m_position_func(time);
 }
 vw::Vector3 SPOTCameraModel::get_camera_velocity_at_time(double time) const { 
   check_time(time, "get_camera_velocity_at_time");
+  vw::Vector3 vel;
+  if (m_tables.velocity(time, vel))
+    return vel;
   return m_velocity_func(time); 
 }
 vw::Quat SPOTCameraModel::get_camera_pose_at_time(double time) const {
   check_time(time, "get_camera_pose_at_time");
- return m_pose_func(time); 
+  vw::Quat q;
+  if (m_tables.pose(time, q))
+    return q;
+  return m_pose_func(time); 
 }
 double SPOTCameraModel::get_time_at_line(double line) const {
   if ((line < 0.0) || (static_cast<int>(line) >= m_image_size[1]))
@@ -198,6 +212,10 @@ boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model_from_xml(std::string
   // Parse the SPOT5 XML file
   SpotXML xml_reader;
   xml_reader.read_xml(path);
+  return load_spot5_camera_model(xml_reader);
+}
+
+boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model(SpotXML const& xml_reader) {
 
   // Get all the initial functors
   vw::camera::LagrangianInterpolation position_func  = xml_reader.setup_position_func();
@@ -28,6 +28,7 @@
 #include <vw/Camera/LinescanModel.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
+#include <asp/Camera/LinescanTables.h>
 
 
 namespace asp {
@@ -110,7 +111,9 @@ namespace asp {
       m_position_func(position), m_velocity_func(velocity),
       m_pose_func(pose),         m_time_func(time),
       m_look_angles(look_angles),
-      m_min_time(min_time), m_max_time(max_time) {}
+      m_min_time(min_time), m_max_time(max_time) {
+      build_tables();
+    }
 		    
     virtual ~SPOTCameraModel() {}
     virtual std::string type() const { return "LinescanSPOT"; }
@@ -174,6 +177,11 @@ namespace asp {
     /// - Pass the caller location in to get a nice error message.
     void check_time(double time, std::string const& location) const;
 
+    /// The positions, velocities, and poses at uniform times, used
+    /// instead of the functors within the times they cover
+    LinescanTables m_tables;
+    void build_tables();
+
   }; // End class SPOTCameraModel
 
 
@@ -182,6 +190,10 @@ namespace asp {
   ///   make sure this is done before/after this function is called!
   boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model_from_xml(std::string const& path);
 
+  /// Create a SPOT5 camera model from a parsed XML file.
+  class SpotXML;
+  boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model(SpotXML const& xml_reader);
+
 }      // namespace asp
 
 
@@ -0,0 +1,132 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Camera/LinescanTables.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  // Stop resampling at this many samples per source sample, and per
+  // image time range. Cubic interpolation at that spacing agrees with
+  // the source to well under a millimeter for satellite orbits.
+  const int SAMPLES_PER_SOURCE_SAMPLE = 8;
+  const int SAMPLES_PER_IMAGE         = 1024;
+
+  // Below this angle between poses SLERP is the same as linear
+  // interpolation to double precision
+  const double SLERP_MIN_ANGLE = 1.0e-8;
+
+  bool Vector3Table::interp(double t, vw::Vector3 & val) const {
+
+    int num = m_x.size();
+    if (num < 4)
+      return false;
+    double s = (t - m_t0) * m_inv_dt;
+    if (!(s >= 0.0 && s <= num - 1.0)) // also rejects NaN
+      return false;
+
+    // The cubic through samples i - 1, ..., i + 2, evaluated at i + u.
+    // At the ends, the nearest four samples are used.
+    int i = std::max(1, std::min(num - 3, int(s)));
+    double u = s - i;
+    double a = u + 1.0, b = u - 1.0, c = u - 2.0;
+    double w0 = -u * b * c / 6.0;
+    double w1 =  a * b * c / 2.0;
+    double w2 = -a * u * c / 2.0;
+    double w3 =  a * u * b / 6.0;
+    val = vw::Vector3(w0 * m_x[i-1] + w1 * m_x[i] + w2 * m_x[i+1] + w3 * m_x[i+2],
+                      w0 * m_y[i-1] + w1 * m_y[i] + w2 * m_y[i+1] + w3 * m_y[i+2],
+                      w0 * m_z[i-1] + w1 * m_z[i] + w2 * m_z[i+1] + w3 * m_z[i+2]);
+    return true;
+  }
+
+  void PoseTable::set(std::vector<vw::Quat> const& samples, double t0, double dt) {
+
+    m_t0 = t0; m_dt = dt; m_inv_dt = 1.0 / dt;
+    int num = samples.size();
+    m_w.resize(num); m_x.resize(num); m_y.resize(num); m_z.resize(num);
+    m_theta.resize(std::max(num - 1, 0));
+    m_inv_sin.resize(std::max(num - 1, 0));
+
+    for (int it = 0; it < num; it++) {
+      vw::Quat q = samples[it];
+      m_w[it] = q.w(); m_x[it] = q.x(); m_y[it] = q.y(); m_z[it] = q.z();
+      if (it == 0)
+        continue;
+
+      double d = m_w[it-1] * m_w[it] + m_x[it-1] * m_x[it]
+        + m_y[it-1] * m_y[it] + m_z[it-1] * m_z[it];
+      if (d < 0.0) {
+        // The same rotation, on the side of the previous quaternion
+        m_w[it] = -m_w[it]; m_x[it] = -m_x[it]; m_y[it] = -m_y[it]; m_z[it] = -m_z[it];
+        d = -d;
+      }
+      double theta = std::acos(std::min(d, 1.0));
+      m_theta[it-1]   = theta;
+      m_inv_sin[it-1] = (theta > SLERP_MIN_ANGLE) ? 1.0 / std::sin(theta) : 0.0;
+    }
+  }
+
+  bool PoseTable::interp(double t, vw::Quat & q) const {
+
+    int num = m_w.size();
+    if (num < 2)
+      return false;
+    double s = (t - m_t0) * m_inv_dt;
+    if (!(s >= 0.0 && s <= num - 1.0))
+      return false;
+
+    int i = std::min(num - 2, int(s));
+    double u = s - i;
+    double theta = m_theta[i], wa = 1.0 - u, wb = u;
+    if (theta > SLERP_MIN_ANGLE) {
+      wa = std::sin(wa * theta) * m_inv_sin[i];
+      wb = std::sin(wb * theta) * m_inv_sin[i];
+    }
+    q = vw::Quat(wa * m_w[i] + wb * m_w[i+1], wa * m_x[i] + wb * m_x[i+1],
+                 wa * m_y[i] + wb * m_y[i+1], wa * m_z[i] + wb * m_z[i+1]);
+    if (theta <= SLERP_MIN_ANGLE)
+      q = normalize(q);
+    return true;
+  }
+
+  void LinescanTables::table_times(double t_beg, double t_end, double sample_dt,
+                                   double t_first, double t_last,
+                                   double & t0, double & dt, int & num) {
+    t0 = 0.0; dt = 1.0; num = 0;
+
+    double t_min = std::min(t_first, t_last), t_max = std::max(t_first, t_last);
+    double span = t_max - t_min;
+    if (!(span > 0.0) || !(sample_dt > 0.0))
+      return;
+
+    dt = std::min(sample_dt / SAMPLES_PER_SOURCE_SAMPLE, span / SAMPLES_PER_IMAGE);
+    t0 = std::max(t_beg, t_min - span);
+    double t1 = std::min(t_end, t_max + span);
+    if (!(t1 > t0))
+      return;
+
+    // The last sample must not be past the end of the valid range
+    num = int(std::floor((t1 - t0) / dt)) + 1;
+    while (num > 0 && t0 + (num - 1) * dt > t1)
+      num--;
+  }
+
+} // end namespace asp
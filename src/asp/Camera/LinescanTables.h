@@ -0,0 +1,132 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file LinescanTables.h
+///
+/// Tables of the positions, velocities, and poses of a linescan
+/// camera at uniformly spaced times, so that finding these at a given
+/// time computes the index of the samples directly, rather than going
+/// through the general interpolation functors.
+
+#ifndef __ASP_CAMERA_LINESCAN_TABLES_H__
+#define __ASP_CAMERA_LINESCAN_TABLES_H__
+
+#include <vw/Camera/Extrinsics.h>
+#include <vw/Math/Quaternion.h>
+#include <vw/Math/Vector.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// A vector function of time sampled at uniformly spaced times, with
+  /// each coordinate in its own contiguous array. In between the
+  /// samples it is interpolated with the cubic through the four nearest
+  /// ones.
+  class Vector3Table {
+  public:
+    Vector3Table(): m_t0(0.0), m_dt(1.0), m_inv_dt(1.0) {}
+
+    /// Sample the function at num times, starting at t0, spaced by dt
+    template <class FuncT>
+    void resample(FuncT const& func, double t0, double dt, int num) {
+      m_t0 = t0; m_dt = dt; m_inv_dt = 1.0 / dt;
+      m_x.resize(num); m_y.resize(num); m_z.resize(num);
+      for (int it = 0; it < num; it++) {
+        vw::Vector3 v = func(t0 + it * dt);
+        m_x[it] = v[0]; m_y[it] = v[1]; m_z[it] = v[2];
+      }
+    }
+
+    /// Interpolate at the given time. Return false, with no value, if
+    /// the time is not within the samples.
+    bool interp(double t, vw::Vector3 & val) const;
+
+  private:
+    double m_t0, m_dt, m_inv_dt;
+    std::vector<double> m_x, m_y, m_z;
+  };
+
+  /// Poses at uniformly spaced times, with each quaternion component in
+  /// its own contiguous array, interpolated with SLERP. The sign of
+  /// each quaternion is chosen so that it is on the same side as the
+  /// previous one, and the angle between them is precomputed.
+  class PoseTable {
+  public:
+    PoseTable(): m_t0(0.0), m_dt(1.0), m_inv_dt(1.0) {}
+
+    void set(std::vector<vw::Quat> const& samples, double t0, double dt);
+
+    /// Interpolate at the given time. Return false, with no value, if
+    /// the time is not within the samples.
+    bool interp(double t, vw::Quat & q) const;
+
+  private:
+    double m_t0, m_dt, m_inv_dt;
+    std::vector<double> m_w, m_x, m_y, m_z;
+    std::vector<double> m_theta, m_inv_sin; // for each interval
+  };
+
+  /// The position, velocity, and pose tables of a linescan camera. The
+  /// functors they are made from must still be used where the tables
+  /// return false.
+  class LinescanTables {
+  public:
+
+    /// Build the tables for a camera whose lines are seen between times
+    /// t_first and t_last. The positions and velocities are resampled
+    /// in that range extended by its length on either side, as
+    /// ground-to-image solvers may look somewhat past the image. The
+    /// pose samples are used as they are, as SLERP is found exactly
+    /// from them.
+    template <class PositionFuncT, class VelocityFuncT>
+    void build(PositionFuncT const& position, VelocityFuncT const& velocity,
+               vw::camera::SLERPPoseInterpolation const& pose,
+               double t_first, double t_last) {
+      double t0 = 0.0, dt = 1.0;
+      int num = 0;
+      table_times(position.get_t0(), position.get_tend(), position.get_dt(),
+                  t_first, t_last, t0, dt, num);
+      m_position.resample(position, t0, dt, num);
+      table_times(velocity.get_t0(), velocity.get_tend(), velocity.get_dt(),
+                  t_first, t_last, t0, dt, num);
+      m_velocity.resample(velocity, t0, dt, num);
+      m_pose.set(pose.m_pose_samples, pose.m_t0, pose.m_dt);
+    }
+
+    bool position(double t, vw::Vector3 & val) const { return m_position.interp(t, val); }
+    bool velocity(double t, vw::Vector3 & val) const { return m_velocity.interp(t, val); }
+    bool pose    (double t, vw::Quat    & q)   const { return m_pose.interp(t, q);       }
+
+  private:
+
+    /// Pick the times at which to sample a function valid between t_beg
+    /// and t_end, which is made from samples spaced by sample_dt. The
+    /// spacing is a fraction of that and of the image time range. A
+    /// zero num means this cannot be done.
+    static void table_times(double t_beg, double t_end, double sample_dt,
+                            double t_first, double t_last,
+                            double & t0, double & dt, int & num);
+
+    Vector3Table m_position, m_velocity;
+    PoseTable    m_pose;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_LINESCAN_TABLES_H__
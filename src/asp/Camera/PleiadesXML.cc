@@ -27,6 +27,7 @@
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/TimeProcessing.h>
+#include <asp/Core/BinaryIO.h>
 
 #include <xercesc/parsers/XercesDOMParser.hpp>
 #include <xercesc/sax/HandlerBase.hpp>
@@ -103,6 +104,29 @@ void PleiadesXML::read_xml(std::string const& xml_path) {
   parse_xml(root);
 }
 
+void PleiadesXML::write_state(std::ostream & os) const {
+  write_binary(os, m_image_size);
+  write_binary(os, m_coeff_psi_x);      write_binary(os, m_coeff_psi_y);
+  write_binary(os, m_ref_row);          write_binary(os, m_ref_col);
+  write_binary(os, m_quat_offset_time); write_binary(os, m_quat_scale);
+  write_binary(os, m_quaternion_coeffs);
+  write_binary(os, m_start_time);       write_binary(os, m_end_time);
+  write_binary(os, m_line_period);
+  write_binary(os, m_positions);        write_binary(os, m_velocities);
+}
+
+void PleiadesXML::read_state(std::istream & is) {
+  read_binary(is, m_image_size);
+  read_binary(is, m_coeff_psi_x);      read_binary(is, m_coeff_psi_y);
+  read_binary(is, m_ref_row);          read_binary(is, m_ref_col);
+  read_binary(is, m_quat_offset_time); read_binary(is, m_quat_scale);
+  read_binary(is, m_quaternion_coeffs);
+  read_binary(is, m_start_time);       read_binary(is, m_end_time);
+  read_binary(is, m_line_period);
+  read_binary(is, m_positions);        read_binary(is, m_velocities);
+  m_start_time_is_set = true;
+}
+
 void PleiadesXML::parse_xml(xercesc::DOMElement* root) {
 
   xercesc::DOMElement* metadata_id = get_node<DOMElement>(root, "Metadata_Identification");
@@ -70,6 +70,11 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Write and read in binary the parsed data the camera is made
+    /// from, for a cache which is faster to read than the XML file.
+    void write_state(std::ostream & os) const;
+    void read_state (std::istream & is);
+
     // Functions to setup functors which manage the raw input data.
     vw::camera::LinearTimeInterpolation setup_time_func() const;
     vw::camera::LagrangianInterpolation setup_position_func
@@ -20,6 +20,7 @@
 #include <vw/FileIO/FileUtils.h>
 #include <vw/Cartography/Datum.h>
 #include <vw/Cartography/GeoReference.h>
+#include <vw/Math/LinearAlgebra.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Core/Common.h>
 
@@ -29,6 +30,9 @@
 #include <boost/smart_ptr/scoped_ptr.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 using namespace vw;
 
 namespace asp {
@@ -63,9 +67,11 @@ namespace asp {
     m_line_den_coeff   = CoeffVec(gdal_rpc.adfLINE_DEN_COEFF);
     m_sample_num_coeff = CoeffVec(gdal_rpc.adfSAMP_NUM_COEFF);
     m_sample_den_coeff = CoeffVec(gdal_rpc.adfSAMP_DEN_COEFF);
+
+    fit_inverse();
   }
 
-  RPCModel::RPCModel(std::string const& filename) {
+  RPCModel::RPCModel(std::string const& filename): m_has_inverse(false) {
     std::string ext = get_extension(filename);
     if (ext == ".rpb") {
       load_rpb_file(filename);
@@ -84,7 +90,7 @@ namespace asp {
     
   }
 
-  RPCModel::RPCModel(DiskImageResourceGDAL* resource ) {
+  RPCModel::RPCModel(DiskImageResourceGDAL* resource ): m_has_inverse(false) {
     initialize(resource);
   }
 
@@ -106,7 +112,10 @@ namespace asp {
     m_xy_offset(xy_offset),
     m_xy_scale(xy_scale), 
     m_lonlatheight_offset(lonlatheight_offset),
-    m_lonlatheight_scale(lonlatheight_scale) {}
+    m_lonlatheight_scale(lonlatheight_scale),
+    m_has_inverse(false) {
+    fit_inverse();
+  }
     
 
   void RPCModel::load_rpb_file(std::string const& filename) {
@@ -199,6 +208,77 @@ namespace asp {
     if (max_coeff_index != 20)
       vw_throw(ArgumentErr() << "Error reading file " << filename
                << ", loaded wrong number of coefficients!");
+
+    fit_inverse();
+  }
+
+  // The inverse is fitted on a grid of this many points in each of the
+  // normalized lon and lat, and this many heights.
+  const int RPC_INVERSE_GRID_SIZE   = 11;
+  const int RPC_INVERSE_HEIGHT_SIZE = 5;
+
+  // The largest error allowed for the inverse at the centers of the
+  // grid cells, in normalized pixels. Newton's method converges in a
+  // couple of iterations from a guess this close.
+  const double RPC_INVERSE_MAX_ERROR = 0.01;
+
+  void RPCModel::fit_inverse() {
+
+    m_has_inverse = false;
+
+    int n = RPC_INVERSE_GRID_SIZE, nh = RPC_INVERSE_HEIGHT_SIZE;
+    int num = n * n * nh;
+    Matrix<double> A(num, 20);
+    Vector<double> lon(num), lat(num);
+    int count = 0;
+    for (int k = 0; k < nh; k++) {
+      for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+          Vector3 G(-1.0 + 2.0 * i / (n - 1), -1.0 + 2.0 * j / (n - 1),
+                    -1.0 + 2.0 * k / (nh - 1));
+          Vector2 p = normalized_geodetic_to_normalized_pixel(G);
+          if (!(std::abs(p[0]) < 1e+10 && std::abs(p[1]) < 1e+10))
+            return; // Not a valid model, such as when all coefficients are zero
+          select_row(A, count) = calculate_terms(Vector3(p[0], p[1], G[2]));
+          lon[count] = G[0];
+          lat[count] = G[1];
+          count++;
+        }
+      }
+    }
+
+    try {
+      // least_squares() can overwrite its inputs
+      Matrix<double> A_lon = A, A_lat = A;
+      m_inv_lon_coeff = least_squares(A_lon, lon);
+      m_inv_lat_coeff = least_squares(A_lat, lat);
+    } catch (...) {
+      return;
+    }
+
+    // Check the inverse between the points it was fitted at
+    for (int k = 0; k < nh - 1; k++) {
+      for (int j = 0; j < n - 1; j++) {
+        for (int i = 0; i < n - 1; i++) {
+          Vector3 G(-1.0 + (2.0 * i + 1.0) / (n - 1), -1.0 + (2.0 * j + 1.0) / (n - 1),
+                    -1.0 + (2.0 * k + 1.0) / (nh - 1));
+          Vector2 p = normalized_geodetic_to_normalized_pixel(G);
+          Vector2 ll = inverse_normalized_lonlat(p, G[2]);
+          Vector2 q = normalized_geodetic_to_normalized_pixel(Vector3(ll[0], ll[1], G[2]));
+          if (!(norm_2(q - p) <= RPC_INVERSE_MAX_ERROR)) // also catches NaN
+            return;
+        }
+      }
+    }
+
+    m_has_inverse = true;
+  }
+
+  Vector2 RPCModel::inverse_normalized_lonlat(Vector2 const& normalized_pixel,
+                                              double normalized_height) const {
+    CoeffVec T = calculate_terms(Vector3(normalized_pixel[0], normalized_pixel[1],
+                                         normalized_height));
+    return Vector2(dot_prod(T, m_inv_lon_coeff), dot_prod(T, m_inv_lat_coeff));
   }
 
   // All of these implementations are largely inspired by the GDAL
@@ -237,6 +317,103 @@ namespace asp {
     return normalized_pixel;
   }
 
+  // How many points geodetic_to_pixel() processes at once. The terms
+  // for a chunk must fit in the L1 cache.
+  const size_t RPC_CHUNK_SIZE = 64;
+
+  void RPCModel::geodetic_to_pixel(size_t num_points,
+                                   double const* lon, double const* lat, double const* height,
+                                   double * col, double * row) const {
+
+    // The polynomial terms for a chunk, one array per term, as in
+    // calculate_terms().
+    double t[20][RPC_CHUNK_SIZE];
+    double sn[RPC_CHUNK_SIZE], sd[RPC_CHUNK_SIZE], ln[RPC_CHUNK_SIZE], ld[RPC_CHUNK_SIZE];
+
+    // Same operations as in geodetic_to_pixel() for one point, in the
+    // same order, so the results agree exactly
+    double x0 = m_lonlatheight_offset[0], y0 = m_lonlatheight_offset[1],
+      z0 = m_lonlatheight_offset[2];
+    double xs = m_lonlatheight_scale[0], ys = m_lonlatheight_scale[1],
+      zs = m_lonlatheight_scale[2];
+    
+    for (size_t start = 0; start < num_points; start += RPC_CHUNK_SIZE) {
+      size_t n = std::min(RPC_CHUNK_SIZE, num_points - start);
+      double const* lon_c    = lon    + start;
+      double const* lat_c    = lat    + start;
+      double const* height_c = height + start;
+      
+      for (size_t i = 0; i < n; i++) {
+        double x = (lon_c[i]    - x0) / xs; // normalized lon
+        double y = (lat_c[i]    - y0) / ys; // normalized lat
+        double z = (height_c[i] - z0) / zs; // normalized height
+        t[ 0][i] = 1.0;
+        t[ 1][i] = x;
+        t[ 2][i] = y;
+        t[ 3][i] = z;
+        t[ 4][i] = x*y;
+        t[ 5][i] = x*z;
+        t[ 6][i] = y*z;
+        t[ 7][i] = x*x;
+        t[ 8][i] = y*y;
+        t[ 9][i] = z*z;
+        t[10][i] = x*y*z;
+        t[11][i] = x*x*x;
+        t[12][i] = x*y*y;
+        t[13][i] = x*z*z;
+        t[14][i] = x*x*y;
+        t[15][i] = y*y*y;
+        t[16][i] = y*z*z;
+        t[17][i] = x*x*z;
+        t[18][i] = y*y*z;
+        t[19][i] = z*z*z;
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        sn[i] = 0; sd[i] = 0; ln[i] = 0; ld[i] = 0;
+      }
+      for (int k = 0; k < 20; k++) {
+        double a = m_sample_num_coeff[k], b = m_sample_den_coeff[k],
+          c = m_line_num_coeff[k], d = m_line_den_coeff[k];
+        double const* tk = t[k];
+        for (size_t i = 0; i < n; i++) {
+          sn[i] += a * tk[i];
+          sd[i] += b * tk[i];
+          ln[i] += c * tk[i];
+          ld[i] += d * tk[i];
+        }
+      }
+
+      double * col_c = col + start;
+      double * row_c = row + start;
+      for (size_t i = 0; i < n; i++) {
+        col_c[i] = (sn[i] / sd[i]) * m_xy_scale[0] + m_xy_offset[0];
+        row_c[i] = (ln[i] / ld[i]) * m_xy_scale[1] + m_xy_offset[1];
+      }
+    }
+  }
+
+  void RPCModel::point_to_pixel(std::vector<Vector3> const& points,
+                                std::vector<Vector2> & pixels) const {
+
+    size_t num = points.size();
+    pixels.clear();
+    if (num == 0)
+      return;
+    
+    std::vector<double> lon(num), lat(num), height(num), col(num), row(num);
+    for (size_t i = 0; i < num; i++) {
+      Vector3 llh = m_datum.cartesian_to_geodetic(points[i]);
+      lon[i] = llh[0]; lat[i] = llh[1]; height[i] = llh[2];
+    }
+
+    geodetic_to_pixel(num, &lon[0], &lat[0], &height[0], &col[0], &row[0]);
+
+    pixels.resize(num);
+    for (size_t i = 0; i < num; i++)
+      pixels[i] = Vector2(col[i], row[i]);
+  }
+
   Vector2 RPCModel::normalized_geodetic_to_normalized_pixel
   (Vector3 const& normalized_geodetic) const {
 
@@ -452,14 +629,21 @@ namespace asp {
     double abs_tolerance = 1e-6;
 
     Vector2 normalized_pixel = elem_quot(pixel - m_xy_offset, m_xy_scale);
-
-    // Initial guess for the normalized lon and lat
-    if (lonlat_guess == Vector2(0.0, 0.0)){
-      lonlat_guess = subvector(m_lonlatheight_offset, 0, 2);
+    double normalized_height = (height - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+
+    // Initial guess for the normalized lon and lat. Without one, use
+    // the approximate inverse, if available.
+    Vector2 normalized_lonlat;
+    if (lonlat_guess == Vector2(0.0, 0.0) && m_has_inverse) {
+      normalized_lonlat = inverse_normalized_lonlat(normalized_pixel, normalized_height);
+    } else {
+      if (lonlat_guess == Vector2(0.0, 0.0)){
+        lonlat_guess = subvector(m_lonlatheight_offset, 0, 2);
+      }
+      normalized_lonlat = elem_quot(lonlat_guess - subvector(m_lonlatheight_offset, 0, 2),
+                                    subvector(m_lonlatheight_scale, 0, 2)
+                                    );
     }
-    Vector2 normalized_lonlat = elem_quot(lonlat_guess - subvector(m_lonlatheight_offset, 0, 2),
-                                          subvector(m_lonlatheight_scale, 0, 2)
-                                          );
     double len = norm_2(normalized_lonlat);
     if (len != len || len > 1.5){
       // If the input guess is NaN or unreasonable, use 0 as initial guess
@@ -472,9 +656,16 @@ namespace asp {
       Vector3 normalized_geodetic;
       normalized_geodetic[0] = normalized_lonlat[0];
       normalized_geodetic[1] = normalized_lonlat[1];
-      normalized_geodetic[2] = (height - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+      normalized_geodetic[2] = normalized_height;
+
+      // Absolute error convergence criterion. From a good initial
+      // guess, no iterations may be needed.
+      Vector2 p = normalized_geodetic_to_normalized_pixel(normalized_geodetic);
+      Vector2 error_try = p - normalized_pixel;
+      if (norm_2(error_try) < abs_tolerance) {
+        break;
+      }
 
-      Vector2              p = normalized_geodetic_to_normalized_pixel(normalized_geodetic);
       Matrix<double, 2, 2> J = normalized_geodetic_to_pixel_Jacobian(normalized_geodetic);
 
       // The inverse matrix computed analytically
@@ -488,15 +679,7 @@ namespace asp {
 
       // Newton's method for F(x) = y is
       // x = x - J^{-1}(F(x) - y)
-      Vector2 error_try = p - normalized_pixel;
       normalized_lonlat -= invJ*error_try;
-
-      // Absolute error convergence criterion
-      double  norm_try = norm_2(error_try);
-      if (norm_try < abs_tolerance) {
-        break;
-      }
-
     }
 
     Vector2 lonlat = elem_prod(normalized_lonlat, subvector(m_lonlatheight_scale, 0, 2))
@@ -521,11 +704,18 @@ namespace asp {
     //vw_out() << "Height up = " << height_up << std::endl;
     //vw_out() << "Height dn = " << height_dn << std::endl;
 
-    // Given the pixel and elevation, estimate lon-lat.
-    // Use m_lonlatheight_offset as initial guess for lonlat_up,
-    // and then use lonlat_up as initial guess for lonlat_dn.
-    Vector2 lonlat_up = image_to_ground(pix, height_up, subvector(m_lonlatheight_offset, 0, 2));
-    Vector2 lonlat_dn = image_to_ground(pix, height_dn, lonlat_up);
+    // Given the pixel and elevation, estimate lon-lat. Start from the
+    // approximate inverse, if available. Otherwise, use
+    // m_lonlatheight_offset as initial guess for lonlat_up, and then
+    // use lonlat_up as initial guess for lonlat_dn.
+    Vector2 lonlat_up, lonlat_dn;
+    if (m_has_inverse) {
+      lonlat_up = image_to_ground(pix, height_up);
+      lonlat_dn = image_to_ground(pix, height_dn);
+    } else {
+      lonlat_up = image_to_ground(pix, height_up, subvector(m_lonlatheight_offset, 0, 2));
+      lonlat_dn = image_to_ground(pix, height_dn, lonlat_up);
+    }
 
     //vw_out() << "lonlat_up = " << lonlat_up << std::endl;
     //vw_out() << "lonlat_dn = " << lonlat_dn << std::endl;
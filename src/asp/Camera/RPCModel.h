@@ -37,6 +37,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -93,6 +94,19 @@ namespace asp {
 
     vw::Vector2 geodetic_to_pixel( vw::Vector3 const& geodetic ) const;
 
+    /// Project many points at once. The inputs and outputs are separate
+    /// arrays for each coordinate, with lon and lat in degrees and
+    /// height in meters above the datum. The points are processed in
+    /// chunks, one polynomial term at a time for the whole chunk,
+    /// which the compiler turns into SIMD instructions.
+    void geodetic_to_pixel(size_t num_points,
+                           double const* lon, double const* lat, double const* height,
+                           double * col, double * row) const;
+
+    /// Project many ECEF points at once. See geodetic_to_pixel().
+    void point_to_pixel(std::vector<vw::Vector3> const& points,
+                        std::vector<vw::Vector2> & pixels) const;
+
     // Access to constants
     vw::cartography::Datum const& datum   () const { return m_datum;               }
     CoeffVec    const& line_num_coeff     () const { return m_line_num_coeff;      }
@@ -129,6 +143,10 @@ namespace asp {
     /// and the direction of the ray going through that point.
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir ) const;
 
+    /// If the approximate inverse of the model was found accurate
+    /// enough to be the initial guess in image_to_ground().
+    bool has_inverse() const { return m_has_inverse; }
+
   private:
     vw::cartography::Datum m_datum;
 
@@ -140,7 +158,17 @@ namespace asp {
     vw::Vector3 m_lonlatheight_offset;
     vw::Vector3 m_lonlatheight_scale;
 
+    // An approximate inverse of the model, a cubic polynomial from the
+    // normalized sample, line, and height to the normalized lon and
+    // lat, with the terms of calculate_terms(). It is fitted once when
+    // the model is created and used only if accurate.
+    bool        m_has_inverse;
+    CoeffVec    m_inv_lon_coeff, m_inv_lat_coeff;
+
     void initialize( vw::DiskImageResourceGDAL* resource );
+    void fit_inverse();
+    vw::Vector2 inverse_normalized_lonlat(vw::Vector2 const& normalized_pixel,
+                                          double normalized_height) const;
   };
 
   std::ostream& operator<<(std::ostream& os, const RPCModel& rpc);
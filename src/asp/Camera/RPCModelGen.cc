@@ -70,6 +70,65 @@ namespace asp {
     return;
   }
 
+  RpcSolveLMA::RpcSolveLMA(const vw::Vector<double>& normalizedGeodetics,
+                           const vw::Vector<double>& normalizedPixels,
+                           double penaltyWeight):
+    m_normalizedGeodetics(normalizedGeodetics),
+    m_normalizedPixels(normalizedPixels),
+    m_wt(penaltyWeight) {
+
+    int numPts = m_normalizedGeodetics.size()/RPCModel::GEODETIC_COORD_SIZE;
+    m_terms.resize(numPts);
+    for (int i = 0; i < numPts; i++) {
+      Vector3 G = subvector(m_normalizedGeodetics, RPCModel::GEODETIC_COORD_SIZE*i,
+                            RPCModel::GEODETIC_COORD_SIZE);
+      m_terms[i] = RPCModel::calculate_terms(G);
+    }
+  }
+
+  RpcSolveLMA::jacobian_type RpcSolveLMA::jacobian(domain_type const& C) const {
+
+    RPCModel::CoeffVec lineNum, lineDen, sampNum, sampDen;
+    unpackCoeffs(C, lineNum, lineDen, sampNum, sampDen);
+
+    // Where each group of coefficients starts in C. See unpackCoeffs().
+    // The 0-th denominator coefficients are fixed at 1 and not in C.
+    const int lineNumStart = 0, lineDenStart = 20, sampNumStart = 39, sampDenStart = 59;
+
+    int numPts = m_terms.size();
+    jacobian_type J(m_normalizedPixels.size(), C.size()); // starts as zero
+
+    for (int i = 0; i < numPts; i++) {
+      RPCModel::CoeffVec const& T = m_terms[i];
+
+      // For p = N.T / D.T, dp/dN_k = T_k / D.T and dp/dD_k = -p * T_k / D.T.
+      double sampD = dot_prod(T, sampDen), samp = dot_prod(T, sampNum) / sampD;
+      double lineD = dot_prod(T, lineDen), line = dot_prod(T, lineNum) / lineD;
+      int sampRow = RPCModel::IMAGE_COORD_SIZE*i + 0;
+      int lineRow = RPCModel::IMAGE_COORD_SIZE*i + 1;
+      for (int k = 0; k < 20; k++) {
+        J(sampRow, sampNumStart + k) = T[k] / sampD;
+        J(lineRow, lineNumStart + k) = T[k] / lineD;
+      }
+      for (int k = 1; k < 20; k++) {
+        J(sampRow, sampDenStart + k - 1) = -samp * T[k] / sampD;
+        J(lineRow, lineDenStart + k - 1) = -line * T[k] / lineD;
+      }
+    }
+
+    // The penalty terms are linear in the coefficients
+    int row = RPCModel::IMAGE_COORD_SIZE*numPts;
+    vw::Vector<int,20> coeff_order = RPCModel::get_coeff_order();
+    for (int i = 4; i < 20; i++) J(row++, lineNumStart + i)     = m_wt * (coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(row++, lineDenStart + i - 1) = m_wt * (coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(row++, sampNumStart + i)     = m_wt * (coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(row++, sampDenStart + i - 1) = m_wt * (coeff_order[i]-1);
+
+    VW_ASSERT(row == (int)J.rows(), vw::ArgumentErr() << "Book-keeping error.\n");
+
+    return J;
+  }
+
   /// Print out a name followed by the vector of values
   void print_vec(std::string const& name, Vector<double> const& vals){
     std::cout.precision(16);
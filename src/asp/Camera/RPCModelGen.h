@@ -23,6 +23,8 @@
 #include <asp/Camera/RPCModel.h>
 #include <vw/Math/LevenbergMarquardt.h>
 
+#include <vector>
+
 namespace asp {
 
   /// Unpack the 78 RPC coefficients from one long vector into four seperate vectors.
@@ -45,6 +47,9 @@ namespace asp {
     vw::Vector<double> m_normalizedGeodetics, 
                        m_normalizedPixels; ///< Also contains the extra penalty terms
     double             m_wt; ///< The penalty weight, k in the reference paper.
+    /// The polynomial terms at each normalized geodetic. These do not
+    /// depend on the coefficients, so they are computed only once.
+    std::vector<RPCModel::CoeffVec> m_terms;
     
   public:
    
@@ -59,10 +64,7 @@ namespace asp {
     RpcSolveLMA( const vw::Vector<double>& normalizedGeodetics,
                  const vw::Vector<double>& normalizedPixels,
                  double penaltyWeight
-                 ) :
-      m_normalizedGeodetics(normalizedGeodetics),
-      m_normalizedPixels(normalizedPixels),
-      m_wt(penaltyWeight){}
+                 );
 
     /// Given a set of RPC coefficients, compute the projected pixels.
     inline result_type operator()( domain_type const& C ) const {
@@ -85,15 +87,12 @@ namespace asp {
       
       // Loop through each test point
       for (int i = 0; i < numPts; i++){
-        // Unpack the normalized Geodetic coordinate
-        vw::Vector3 G = subvector(m_normalizedGeodetics, RPCModel::GEODETIC_COORD_SIZE*i, RPCModel::GEODETIC_COORD_SIZE);
-        
-        // Project the normalized geodetic coordinate into the RPC camera to get a normalized pixel
-        vw::Vector2 pxn = RPCModel::normalized_geodetic_to_normalized_pixel(G, lineNum, lineDen, sampNum, sampDen);
-             
-        // Pack the normalized pixel into the output result vector
-        subvector(result, RPCModel::IMAGE_COORD_SIZE*i, RPCModel::IMAGE_COORD_SIZE) = pxn;
-
+        // Project the normalized geodetic coordinate into the RPC
+        // camera to get a normalized pixel, as done by
+        // RPCModel::normalized_geodetic_to_normalized_pixel().
+        RPCModel::CoeffVec const& T = m_terms[i];
+        result[RPCModel::IMAGE_COORD_SIZE*i + 0] = dot_prod(T, sampNum) / dot_prod(T, sampDen);
+        result[RPCModel::IMAGE_COORD_SIZE*i + 1] = dot_prod(T, lineNum) / dot_prod(T, lineDen);
       }
 
       // There are 4*20 - 2 = 78 coefficients we optimize. Of those, 2
@@ -115,6 +114,13 @@ namespace asp {
       return result;
     }
 
+    /// The analytic Jacobian of operator() with respect to the RPC
+    /// coefficients. The numerator and denominator are linear in the
+    /// coefficients, so this is exact and much cheaper than the
+    /// numerical Jacobian, which calls operator() for each of the 78
+    /// coefficients.
+    jacobian_type jacobian(domain_type const& C) const;
+
   };
 
   /// Print out a name followed by the vector of values
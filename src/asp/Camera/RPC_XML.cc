@@ -33,7 +33,6 @@
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/lexical_cast.hpp>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -43,6 +42,17 @@ namespace fs=boost::filesystem;
 
 using asp::XmlUtils::get_node;
 using asp::XmlUtils::cast_xmlch;
+using asp::XmlUtils::parse_numbers;
+
+namespace {
+  // The entries of the ephemeris and attitude lists start with a
+  // 1-based index, stored as a floating point number.
+  size_t list_index(double val, size_t num_points) {
+    if (!(val >= 0.5) || size_t(val + 0.5) > num_points)
+      vw_throw(ArgumentErr() << "Invalid list index: " << val << "\n");
+    return size_t(val + 0.5) - 1;
+  }
+}
 
 //========================================================================
 // ImageXML class
@@ -66,17 +76,19 @@ void asp::ImageXML::parse_band_tdi(xercesc::DOMElement* node, int & out_tdi) {
 }
 
 void asp::ImageXML::parse_tlc_list(xercesc::DOMElement* node) {
-  DOMNodeList* children = node->getChildNodes();
   size_t count = 0;
-
-  for (XMLSize_t i = 0; i < children->getLength(); i++) {
-    if (children->item(i)->getNodeType() == DOMNode::ELEMENT_NODE) {
-      DOMElement* element = dynamic_cast<DOMElement*>(children->item(i));
-      std::string buffer;
-      cast_xmlch(element->getTextContent(), buffer);
-
-      std::istringstream istr(buffer);
-      istr >> tlc_vec[count].first >> tlc_vec[count].second;
+  std::vector<char> buffer;
+  double vals[2];
+
+  for (DOMNode* child = node->getFirstChild(); child != NULL;
+       child = child->getNextSibling()) {
+    if (child->getNodeType() == DOMNode::ELEMENT_NODE) {
+      if (count >= tlc_vec.size())
+        vw_throw(IOErr() << "Read incorrect number of TLC.");
+      DOMElement* element = static_cast<DOMElement*>(child);
+      if (parse_numbers(element, buffer, vals, 2) != 2)
+        vw_throw(ArgumentErr() << "Expecting two values for each TLC.\n");
+      tlc_vec[count] = std::make_pair(vals[0], vals[1]);
 
       count++;
     }
@@ -322,31 +334,25 @@ void asp::EphemerisXML::parse_meta(xercesc::DOMElement* node) {
 }
 
 void asp::EphemerisXML::parse_eph_list(xercesc::DOMElement* node) {
-  DOMNodeList* children = node->getChildNodes();
   size_t count = 0;
-
-  for (XMLSize_t i = 0; i < children->getLength(); i++) {
-    if (children->item(i)->getNodeType() == DOMNode::ELEMENT_NODE) {
-      DOMElement* element = dynamic_cast<DOMElement*>(children->item(i));
-      std::string buffer;
-      cast_xmlch(element->getTextContent(), buffer);
-
-      std::istringstream istr(buffer);
-      std::string index_b;
-      istr >> index_b;
-      size_t index;
-      try{
-        index = size_t(boost::lexical_cast<float>(index_b) + 0.5) - 1;
-      } catch (boost::bad_lexical_cast const& e) {
-        vw_throw(ArgumentErr() << "Failed to parse string: " << index_b << "\n");
-      }
-
-      istr >> position_vec  [index][0] >> position_vec  [index][1]
-           >> position_vec  [index][2] >> velocity_vec  [index][0]
-           >> velocity_vec  [index][1] >> velocity_vec  [index][2];
-      istr >> covariance_vec[index][0] >> covariance_vec[index][1]
-           >> covariance_vec[index][2] >> covariance_vec[index][3]
-           >> covariance_vec[index][4] >> covariance_vec[index][5];
+  std::vector<char> buffer;
+  double vals[13]; // index, position, velocity, covariance
+
+  // Walk the siblings rather than indexing the child list, which is
+  // linear in the index for a long list
+  for (DOMNode* child = node->getFirstChild(); child != NULL;
+       child = child->getNextSibling()) {
+    if (child->getNodeType() == DOMNode::ELEMENT_NODE) {
+      DOMElement* element = static_cast<DOMElement*>(child);
+      int num = parse_numbers(element, buffer, vals, 13);
+      if (num < 7)
+        vw_throw(ArgumentErr() << "Incomplete ephemeris entry: " << &buffer[0] << "\n");
+      size_t index = list_index(vals[0], position_vec.size());
+
+      position_vec[index] = Vector3(vals[1], vals[2], vals[3]);
+      velocity_vec[index] = Vector3(vals[4], vals[5], vals[6]);
+      for (int k = 7; k < num; k++)
+        covariance_vec[index][k - 7] = vals[k];
 
       count++;
     }
@@ -379,33 +385,22 @@ void asp::AttitudeXML::parse_meta(xercesc::DOMElement* node) {
 }
 
 void asp::AttitudeXML::parse_att_list(xercesc::DOMElement* node) {
-  DOMNodeList* children = node->getChildNodes();
   size_t count = 0;
-  Vector4 qbuf;
-
-  for (XMLSize_t i = 0; i < children->getLength(); i++) {
-    if (children->item(i)->getNodeType() == DOMNode::ELEMENT_NODE) {
-      DOMElement* element = dynamic_cast<DOMElement*>(children->item(i));
-      std::string buffer;
-      cast_xmlch(element->getTextContent(), buffer);
-
-      std::istringstream istr(buffer);
-      std::string index_b;
-      istr >> index_b;
-      size_t index;
-      try {
-        index = size_t(boost::lexical_cast<float>(index_b) + 0.5) - 1;
-      } catch (boost::bad_lexical_cast const& e) {
-        vw_throw(ArgumentErr() << "Failed to parse string: " << index_b << "\n");
-      }
-
-      istr >> qbuf[0] >> qbuf[1] >> qbuf[2] >> qbuf[3];
-      quat_vec[index] = Quat(qbuf[3], qbuf[0], qbuf[1], qbuf[2]);
-      istr >> covariance_vec[index][0] >> covariance_vec[index][1]
-           >> covariance_vec[index][2] >> covariance_vec[index][3]
-           >> covariance_vec[index][4] >> covariance_vec[index][5]
-           >> covariance_vec[index][6] >> covariance_vec[index][7]
-           >> covariance_vec[index][8] >> covariance_vec[index][9];
+  std::vector<char> buffer;
+  double vals[15]; // index, quaternion, covariance
+
+  for (DOMNode* child = node->getFirstChild(); child != NULL;
+       child = child->getNextSibling()) {
+    if (child->getNodeType() == DOMNode::ELEMENT_NODE) {
+      DOMElement* element = static_cast<DOMElement*>(child);
+      int num = parse_numbers(element, buffer, vals, 15);
+      if (num < 5)
+        vw_throw(ArgumentErr() << "Incomplete attitude entry: " << &buffer[0] << "\n");
+      size_t index = list_index(vals[0], quat_vec.size());
+
+      quat_vec[index] = Quat(vals[4], vals[1], vals[2], vals[3]);
+      for (int k = 5; k < num; k++)
+        covariance_vec[index][k - 5] = vals[k];
 
       count++;
     }
@@ -431,14 +426,10 @@ void asp::AttitudeXML::parse(xercesc::DOMElement* node) {
 
 void asp::RPCXML::parse_vector(xercesc::DOMElement* node,
                                Vector<double,20>& vec) {
-  std::string buffer;
-  cast_xmlch(node->getTextContent(), buffer);
-
-  std::istringstream istr(buffer);
-  istr >> vec[0] >> vec[1] >> vec[2] >> vec[3] >> vec[4] >> vec[5]
-       >> vec[6] >> vec[7] >> vec[8] >> vec[9] >> vec[10] >> vec[11]
-       >> vec[12] >> vec[13] >> vec[14] >> vec[15] >> vec[16] >> vec[17]
-       >> vec[18] >> vec[19];
+  std::vector<char> buffer;
+  if (parse_numbers(node, buffer, &vec[0], vec.size()) != int(vec.size()))
+    vw_throw(ArgumentErr() << "Expecting " << vec.size()
+             << " RPC coefficients in: " << &buffer[0] << "\n");
 }
 
 asp::RPCXML::RPCXML() : BitChecker(2) {}
@@ -0,0 +1,194 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/RayTableCamera.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Math/Vector.h>
+
+#include <cmath>
+#include <limits>
+
+namespace asp {
+
+  // Each block has this many cells in each direction
+  const int RAY_TABLE_BLOCK_SIZE = 16;
+
+  // The margin, in units of node spacing, by which the table extends
+  // beyond the image, to handle disparities pointing a bit outside it.
+  const int RAY_TABLE_MARGIN = 2;
+
+  RayTableCamera::RayTableCamera(boost::shared_ptr<vw::camera::CameraModel> cam,
+                                 vw::Vector2i const& image_size, int spacing,
+                                 double max_error):
+    m_cam(cam), m_spacing(spacing), m_max_error(max_error),
+    m_num_built(0), m_num_exact(0), m_max_checked_error(0.0) {
+
+    if (spacing <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The ray table spacing must be positive.\n");
+    if (image_size.x() <= 0 || image_size.y() <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The ray table needs a non-empty image.\n");
+
+    m_box = vw::BBox2i(0, 0, image_size.x(), image_size.y());
+    m_box.expand(RAY_TABLE_MARGIN * spacing);
+
+    m_num_cells_x  = (m_box.width()  + spacing - 1) / spacing;
+    m_num_cells_y  = (m_box.height() + spacing - 1) / spacing;
+    m_num_blocks_x = (m_num_cells_x + RAY_TABLE_BLOCK_SIZE - 1) / RAY_TABLE_BLOCK_SIZE;
+    m_num_blocks_y = (m_num_cells_y + RAY_TABLE_BLOCK_SIZE - 1) / RAY_TABLE_BLOCK_SIZE;
+    m_blocks.reset(new Block[m_num_blocks_x * m_num_blocks_y]);
+  }
+
+  double RayTableCamera::max_checked_error() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_max_checked_error;
+  }
+
+  void RayTableCamera::build_block(int bx, int by, Block & block) const {
+
+    m_num_built++;
+    block.use_exact = false;
+
+    const int N = RAY_TABLE_BLOCK_SIZE + 1; // nodes per side
+    block.centers.resize(N * N);
+    block.dirs.resize(N * N);
+
+    vw::Vector2 corner = vw::Vector2(m_box.min())
+      + double(m_spacing) * vw::Vector2(bx * RAY_TABLE_BLOCK_SIZE, by * RAY_TABLE_BLOCK_SIZE);
+
+    double block_error = 0.0;
+    try {
+      for (int j = 0; j < N; j++) {
+        for (int i = 0; i < N; i++) {
+          vw::Vector2 pix = corner + double(m_spacing) * vw::Vector2(i, j);
+          block.centers[j * N + i] = m_cam->camera_center(pix);
+          block.dirs   [j * N + i] = m_cam->pixel_to_vector(pix);
+        }
+      }
+
+      // The angle between neighboring rays, and how much the camera
+      // center moves, per pixel. Used to express the errors in pixels.
+      double ifov = std::numeric_limits<double>::max(), center_step = 0.0;
+      for (int k = 0; k < 2; k++) {
+        int next = (k == 0) ? 1 : N; // the neighbor in x, then in y
+        double angle = std::acos(std::min(1.0, vw::math::dot_prod(block.dirs[0],
+                                                                  block.dirs[next])));
+        if (angle > 0)
+          ifov = std::min(ifov, angle / m_spacing);
+        center_step = std::max(center_step,
+                               vw::math::norm_2(block.centers[next] - block.centers[0])
+                               / m_spacing);
+      }
+
+      // Check the interpolated rays at the cell centers, where the
+      // interpolation error is largest.
+      const double center_tol = 1.0e-6; // in meters, for cameras with a fixed center
+      for (int j = 0; j < RAY_TABLE_BLOCK_SIZE && !block.use_exact; j++) {
+        for (int i = 0; i < RAY_TABLE_BLOCK_SIZE; i++) {
+          vw::Vector2 pix = corner + double(m_spacing) * vw::Vector2(i + 0.5, j + 0.5);
+          int n = j * N + i;
+          vw::Vector3 dir = vw::math::normalize(block.dirs[n] + block.dirs[n + 1] +
+                                                block.dirs[n + N] + block.dirs[n + N + 1]);
+          vw::Vector3 ctr = (block.centers[n] + block.centers[n + 1] +
+                             block.centers[n + N] + block.centers[n + N + 1]) / 4.0;
+
+          double angle = std::acos(std::min(1.0, vw::math::dot_prod
+                                            (dir, m_cam->pixel_to_vector(pix))));
+          double dist = vw::math::norm_2(ctr - m_cam->camera_center(pix));
+
+          double err = angle / ifov;
+          if (center_step > 0)
+            err = std::max(err, dist / center_step);
+          else if (dist > center_tol)
+            err = std::numeric_limits<double>::max();
+
+          block_error = std::max(block_error, err);
+          if (block_error > m_max_error) {
+            block.use_exact = true;
+            break;
+          }
+        }
+      }
+    } catch (...) {
+      // The exact camera failed somewhere in this block
+      block.use_exact = true;
+    }
+
+    if (block.use_exact) {
+      m_num_exact++;
+      block.centers.clear();
+      block.dirs.clear();
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_checked_error = std::max(m_max_checked_error, block_error);
+  }
+
+  RayTableCamera::Block const*
+  RayTableCamera::find_block(vw::Vector2 const& pix, int & lx, int & ly,
+                             double & tx, double & ty) const {
+
+    double fx = (pix.x() - m_box.min().x()) / m_spacing;
+    double fy = (pix.y() - m_box.min().y()) / m_spacing;
+    if (!(fx >= 0 && fy >= 0 && fx < m_num_cells_x && fy < m_num_cells_y))
+      return NULL; // outside the table, or NaN
+
+    int cx = int(fx), cy = int(fy);
+    int bx = cx / RAY_TABLE_BLOCK_SIZE, by = cy / RAY_TABLE_BLOCK_SIZE;
+    lx = cx - bx * RAY_TABLE_BLOCK_SIZE;
+    ly = cy - by * RAY_TABLE_BLOCK_SIZE;
+    tx = fx - cx;
+    ty = fy - cy;
+
+    Block & block = m_blocks[by * m_num_blocks_x + bx];
+    std::call_once(block.flag, &RayTableCamera::build_block, this, bx, by, std::ref(block));
+    if (block.use_exact)
+      return NULL;
+
+    return &block;
+  }
+
+  vw::Vector3 RayTableCamera::pixel_to_vector(vw::Vector2 const& pix) const {
+    int lx = 0, ly = 0;
+    double tx = 0, ty = 0;
+    Block const* block = find_block(pix, lx, ly, tx, ty);
+    if (block == NULL)
+      return m_cam->pixel_to_vector(pix);
+
+    const int N = RAY_TABLE_BLOCK_SIZE + 1;
+    int n = ly * N + lx;
+    std::vector<vw::Vector3> const& d = block->dirs;
+    return vw::math::normalize((1 - ty) * ((1 - tx) * d[n]     + tx * d[n + 1]) +
+                               ty       * ((1 - tx) * d[n + N] + tx * d[n + N + 1]));
+  }
+
+  vw::Vector3 RayTableCamera::camera_center(vw::Vector2 const& pix) const {
+    int lx = 0, ly = 0;
+    double tx = 0, ty = 0;
+    Block const* block = find_block(pix, lx, ly, tx, ty);
+    if (block == NULL)
+      return m_cam->camera_center(pix);
+
+    const int N = RAY_TABLE_BLOCK_SIZE + 1;
+    int n = ly * N + lx;
+    std::vector<vw::Vector3> const& c = block->centers;
+    return (1 - ty) * ((1 - tx) * c[n]     + tx * c[n + 1]) +
+           ty       * ((1 - tx) * c[n + N] + tx * c[n + N + 1]);
+  }
+
+} // end namespace asp
@@ -0,0 +1,108 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file RayTableCamera.h
+///
+/// A camera model which wraps another one, and finds the camera center
+/// and ray direction at a pixel by bilinear interpolation in a table
+/// sampled from the wrapped camera. This is much faster than calling
+/// an exact linescan, CSM, or ISIS model for every pixel.
+
+#ifndef __ASP_CAMERA_RAY_TABLE_CAMERA_H__
+#define __ASP_CAMERA_RAY_TABLE_CAMERA_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace asp {
+
+  // The table is split into blocks of cells, and each block is built
+  // the first time a pixel in it is needed, so only the part of the
+  // image that is used, such as a parallel_stereo tile, is sampled.
+  // When a block is built, the interpolated rays at the center of each
+  // of its cells are checked against the exact camera. If the error
+  // is above the given bound, or the exact camera fails, that block
+  // uses the exact camera instead. Pixels outside the image, with a
+  // margin, also use the exact camera.
+  class RayTableCamera: public vw::camera::CameraModel {
+
+  public:
+    // The error bound is in pixels. The ray direction error is
+    // converted to pixels using the angle between neighboring rays,
+    // and the camera center error using how much the center moves from
+    // pixel to pixel, as for linescan cameras.
+    RayTableCamera(boost::shared_ptr<vw::camera::CameraModel> cam,
+                   vw::Vector2i const& image_size, int spacing, double max_error);
+
+    virtual ~RayTableCamera() {}
+
+    virtual std::string type() const { return "RayTable"; }
+
+    virtual vw::Vector2 point_to_pixel (vw::Vector3 const& point) const {
+      return m_cam->point_to_pixel(point);
+    }
+    virtual vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
+    virtual vw::Vector3 camera_center  (vw::Vector2 const& pix) const;
+    virtual vw::Quat    camera_pose    (vw::Vector2 const& pix) const {
+      return m_cam->camera_pose(pix);
+    }
+
+    // How many blocks were built, and how many of those failed the
+    // error check and use the exact camera
+    int num_built_blocks() const { return m_num_built;  }
+    int num_exact_blocks() const { return m_num_exact; }
+
+    // The largest error, in pixels, at the check points of the blocks
+    // which passed the error check
+    double max_checked_error() const;
+
+  private:
+
+    struct Block {
+      std::once_flag flag;
+      bool use_exact;
+      std::vector<vw::Vector3> centers, dirs; // at the nodes of the block
+    };
+
+    // Find the block having this pixel, build it if needed, and find
+    // the interpolation weights. Return NULL if the exact camera must be used.
+    Block const* find_block(vw::Vector2 const& pix, int & lx, int & ly,
+                            double & tx, double & ty) const;
+    void build_block(int bx, int by, Block & block) const;
+
+    boost::shared_ptr<vw::camera::CameraModel> m_cam;
+    vw::BBox2i m_box;     // the region covered by the table, in pixels
+    int m_spacing;        // the distance between nodes, in pixels
+    double m_max_error;
+    int m_num_cells_x, m_num_cells_y, m_num_blocks_x, m_num_blocks_y;
+    boost::scoped_array<Block> m_blocks;
+    mutable std::atomic<int> m_num_built, m_num_exact;
+    mutable std::mutex m_mutex; // protects m_max_checked_error
+    mutable double m_max_checked_error;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_RAY_TABLE_CAMERA_H__
@@ -25,6 +25,7 @@
 #include <asp/Camera/SPOT_XML.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/XMLBase.h>
+#include <asp/Core/BinaryIO.h>
 
 #include <xercesc/parsers/XercesDOMParser.hpp>
 #include <xercesc/sax/HandlerBase.hpp>
@@ -105,6 +106,26 @@ void SpotXML::read_xml(std::string const& xml_path) {
   parse_xml(elementRoot);
 }
 
+void SpotXML::write_state(std::ostream & os) const {
+  write_binary(os, lonlat_corners); write_binary(os, pixel_corners);
+  write_binary(os, look_angles);
+  write_binary(os, pose_logs);
+  write_binary(os, position_logs);  write_binary(os, velocity_logs);
+  write_binary(os, image_size);     write_binary(os, line_period);
+  write_binary(os, center_time);
+  write_binary(os, center_line);    write_binary(os, center_col);
+}
+
+void SpotXML::read_state(std::istream & is) {
+  read_binary(is, lonlat_corners); read_binary(is, pixel_corners);
+  read_binary(is, look_angles);
+  read_binary(is, pose_logs);
+  read_binary(is, position_logs);  read_binary(is, velocity_logs);
+  read_binary(is, image_size);     read_binary(is, line_period);
+  read_binary(is, center_time);
+  read_binary(is, center_line);    read_binary(is, center_col);
+}
+
 std::vector<vw::Vector2> SpotXML::get_lonlat_corners(std::string const& xml_path) {
   SpotXML xml_reader;
   DOMElement * root = xml_reader.open_xml_file(xml_path);
@@ -77,6 +77,11 @@ namespace asp {
     /// Parse an XML tree to populate the data
     void parse_xml(xercesc::DOMElement* node);
 
+    /// Write and read in binary the parsed data, for a cache which is
+    /// faster to read than the XML file.
+    void write_state(std::ostream & os) const;
+    void read_state (std::istream & is);
+
     /// Load the estimated image lonlat corners from the XML file
     /// - Corners are returned in clockwise order.
     static std::vector<vw::Vector2> get_lonlat_corners(std::string const& xml_path);
@@ -18,6 +18,57 @@
 
 #include <asp/Camera/XMLBase.h>
 
+#include <cstdlib>
+
 using namespace vw;
 
+namespace asp {
+namespace XmlUtils {
+
+int parse_numbers(xercesc::DOMElement* element, std::vector<char> & buffer,
+                  double* dst, int max_count) {
+
+  // Usually the element has a single text node. Its value can be read
+  // in place, while getTextContent() makes a copy in the document
+  // memory, which is only freed with the document.
+  const XMLCh* ch = NULL;
+  xercesc::DOMNode* child = element->getFirstChild();
+  if (child != NULL && child->getNextSibling() == NULL &&
+      child->getNodeType() == xercesc::DOMNode::TEXT_NODE)
+    ch = child->getNodeValue();
+  else
+    ch = element->getTextContent();
+
+  // Numbers are plain ASCII, so there is no need to transcode
+  buffer.clear();
+  for (const XMLCh* p = ch; p != NULL && *p != 0; p++) {
+    if (*p > 127)
+      vw_throw(ArgumentErr() << "Failed to parse numbers from XML text.\n");
+    buffer.push_back(char(*p));
+  }
+  buffer.push_back('\0');
+
+  char* pos = &buffer[0];
+  int count = 0;
+  while (1) {
+    while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+      pos++;
+    if (*pos == '\0')
+      break;
+    if (count >= max_count)
+      vw_throw(ArgumentErr() << "Expecting at most " << max_count
+               << " numbers in the XML text: " << &buffer[0] << "\n");
+    char* end = NULL;
+    dst[count] = strtod(pos, &end);
+    if (end == pos || (*end != '\0' && *end != ' ' && *end != '\t' &&
+                       *end != '\n' && *end != '\r'))
+      vw_throw(ArgumentErr() << "Failed to parse string: " << &buffer[0] << "\n");
+    pos = end;
+    count++;
+  }
+
+  return count;
+}
 
+} // End namespace XmlUtils
+} // End namespace asp
@@ -27,6 +27,7 @@
 #include <vw/Core/FundamentalTypes.h>
 
 #include <string>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 
@@ -58,6 +59,16 @@ void cast_xmlch( const XMLCh* ch, T& dst) {
   xercesc::XMLString::release( &text );
 }
 
+/// Parse up to max_count whitespace-separated numbers from the text
+/// of an element straight into dst, without string streams, and
+/// return how many were found. The buffer is reused across calls, so
+/// that parsing long lists, such as the ephemeris and attitude ones,
+/// does not allocate for every entry. Throws if the text has
+/// characters that are not part of a number, or more numbers than
+/// max_count.
+int parse_numbers(xercesc::DOMElement* element, std::vector<char> & buffer,
+                  double* dst, int max_count);
+
 /// Helper function to retreive a node via string and verify that only one exists.
 template <class T>
 T* get_node( xercesc::DOMElement* element, std::string const& tag ) {
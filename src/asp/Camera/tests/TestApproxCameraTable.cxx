@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Cartography/GeoReference.h>
+#include <test/Helpers.h>
+#include <asp/Camera/ApproxCameraTable.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace vw::camera;
+using namespace vw::cartography;
+using namespace asp;
+
+// A pinhole camera 700 km above the point with lon = lat = 0, looking down
+boost::shared_ptr<CameraModel> nadir_pinhole(GeoReference const& geo) {
+  Vector3 ctr(geo.datum().semi_major_axis() + 700000.0, 0, 0);
+  Matrix3x3 rotation;
+  rotation(0, 0) =  0; rotation(0, 1) = 0; rotation(0, 2) = -1;
+  rotation(1, 0) =  1; rotation(1, 1) = 0; rotation(1, 2) =  0;
+  rotation(2, 0) =  0; rotation(2, 1) = -1; rotation(2, 2) = 0;
+  return boost::shared_ptr<CameraModel>
+    (new PinholeModel(ctr, rotation, 60000.0, 60000.0, 500.0, 500.0));
+}
+
+TEST(ApproxCameraTable, MatchesExactCamera) {
+
+  GeoReference geo;
+  geo.set_well_known_geogcs("WGS84");
+  boost::shared_ptr<CameraModel> cam = nadir_pinhole(geo);
+
+  BBox2 point_box(Vector2(-0.05, -0.05), Vector2(0.05, 0.05));
+  double grid = 0.001, height = 100.0;
+  ApproxCameraTable table;
+  table.build(*cam, geo, point_box, grid, grid, height);
+  EXPECT_EQ(table.cols() * table.rows(), table.num_valid());
+
+  // Points at, above, and below the table height project as with the
+  // exact camera
+  for (double ht = -200.0; ht <= 400.0; ht += 300.0) {
+    for (double lon = -0.03; lon <= 0.03; lon += 0.0137) {
+      for (double lat = -0.03; lat <= 0.03; lat += 0.0111) {
+        Vector3 xyz = geo.datum().geodetic_to_cartesian(Vector3(lon, lat, ht));
+        Vector2 pix;
+        ASSERT_TRUE(table.point_to_pixel(xyz, pix));
+        EXPECT_VECTOR_NEAR(cam->point_to_pixel(xyz), pix, 0.05);
+      }
+    }
+  }
+
+  // Points outside the table are left to the exact camera
+  Vector2 pix;
+  Vector3 far_xyz = geo.datum().geodetic_to_cartesian(Vector3(1.0, 1.0, 0.0));
+  EXPECT_FALSE(table.point_to_pixel(far_xyz, pix));
+}
+
+TEST(ApproxCameraTable, WriteAndRead) {
+
+  GeoReference geo;
+  geo.set_well_known_geogcs("WGS84");
+  boost::shared_ptr<CameraModel> cam = nadir_pinhole(geo);
+  AdjustedCameraModel adj_cam(cam);
+
+  BBox2 point_box(Vector2(-0.02, -0.02), Vector2(0.02, 0.02));
+  double grid = 0.001, height = 0.0;
+  ApproxCameraTable table;
+  table.build(adj_cam, geo, point_box, grid, grid, height);
+
+  std::string key = approx_camera_table_key("test.tsai", adj_cam, geo, point_box,
+                                            grid, grid, height);
+  std::string file = approx_camera_table_file("approx_camera_table_test", key);
+  EXPECT_NO_THROW(table.write(file, key));
+
+  // Reading back gives the same projections
+  ApproxCameraTable table2;
+  ASSERT_TRUE(table2.read(file, key, geo));
+  EXPECT_EQ(table.cols(), table2.cols());
+  EXPECT_EQ(table.rows(), table2.rows());
+  Vector3 xyz = geo.datum().geodetic_to_cartesian(Vector3(0.0031, -0.0047, 30.0));
+  Vector2 pix1, pix2;
+  ASSERT_TRUE(table.point_to_pixel(xyz, pix1));
+  ASSERT_TRUE(table2.point_to_pixel(xyz, pix2));
+  EXPECT_VECTOR_NEAR(pix1, pix2, 1e-12);
+
+  // A table made for a different adjustment is not reused
+  AdjustedCameraModel adj_cam2(cam, Vector3(1, 0, 0), Quat(math::identity_matrix<3>()));
+  std::string key2 = approx_camera_table_key("test.tsai", adj_cam2, geo, point_box,
+                                             grid, grid, height);
+  EXPECT_NE(file, approx_camera_table_file("approx_camera_table_test", key2));
+  ApproxCameraTable table3;
+  EXPECT_FALSE(table3.read(file, key2, geo));
+
+  boost::filesystem::remove_all("approx_camera_table_test");
+}
@@ -17,10 +17,12 @@
 
 
 #include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/AdjustedLinescanDGModel.h>
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Camera/XMLBase.h>
 #include <asp/Camera/RPCModel.h>
 #include <boost/scoped_ptr.hpp>
+#include <sstream>
 #include <test/Helpers.h>
 
 #include <vw/Stereo/StereoModel.h>
@@ -158,3 +160,103 @@ TEST(DGCameraModel, CreateCamera) {
   XMLPlatformUtils::Terminate();
 }
 
+
+TEST(DGCameraModel, PointToPixelStartingGuess) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<vw::camera::CameraModel>
+    cam(load_dg_camera_model_from_xml("dg_example1.xml"));
+  DGCameraModel * dg_cam = dynamic_cast<DGCameraModel*>(cam.get());
+  ASSERT_TRUE( dg_cam != NULL );
+
+  // The solution must not depend on the starting line, whether given,
+  // from the previous call, or the image center.
+  for ( size_t i = 0; i < 30000; i += 3000 ) {
+    for ( size_t j = 0; j < 24000; j += 3000 ) {
+      Vector2 pix(i, j);
+      Vector3 xyz = cam->camera_center(pix) + 2e4 * cam->pixel_to_vector(pix);
+      Vector2 pix0 = dg_cam->point_to_pixel(xyz);
+      EXPECT_VECTOR_NEAR( pix, pix0, 1e-1 );
+      EXPECT_VECTOR_NEAR( pix0, dg_cam->point_to_pixel(xyz, 0.0), 1e-6 );
+      EXPECT_VECTOR_NEAR( pix0, dg_cam->point_to_pixel(xyz, 23707.0), 1e-6 );
+    }
+  }
+
+  XMLPlatformUtils::Terminate();
+}
+
+
+TEST(DGCameraModel, CachedState) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  // A camera made from the parsed state written and read back in
+  // binary must be the same as the one made from the XML file.
+  DGCameraState state, cached;
+  read_dg_camera_state("dg_example1.xml", state);
+  std::stringstream ss;
+  state.write_state(ss);
+  cached.read_state(ss);
+  ASSERT_TRUE( ss.good() );
+  EXPECT_EQ( state.poses.size(), cached.poses.size() );
+  EXPECT_EQ( state.tlc.size(), cached.tlc.size() );
+
+  boost::shared_ptr<vw::camera::CameraModel>
+    cam1(load_dg_camera_model(state)), cam2(load_dg_camera_model(cached));
+  for ( size_t i = 0; i < 30000; i += 5000 ) {
+    for ( size_t j = 0; j < 24000; j += 5000 ) {
+      Vector2 pix(i, j);
+      EXPECT_VECTOR_NEAR( cam1->camera_center(pix), cam2->camera_center(pix), 1e-8 );
+      EXPECT_VECTOR_NEAR( cam1->pixel_to_vector(pix), cam2->pixel_to_vector(pix), 1e-12 );
+    }
+  }
+
+  // A truncated state is detected
+  std::string str = ss.str();
+  std::stringstream truncated(str.substr(0, str.size() / 2));
+  DGCameraState bad;
+  bad.read_state(truncated);
+  EXPECT_FALSE( truncated.good() );
+
+  XMLPlatformUtils::Terminate();
+}
+
+
+TEST(DGCameraModel, BakedPiecewiseAdjustments) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  // The adjustments applied to the samples must give the same camera
+  // as when they are composed with it on each call
+  boost::shared_ptr<vw::camera::CameraModel>
+    cam(load_dg_camera_model_from_xml("dg_example1.xml"));
+  Vector2i image_size(30000, 24000);
+  Vector2 adjustment_bounds(0, image_size[1] - 1);
+  std::vector<Vector3> position_adjustments;
+  std::vector<Quat> pose_adjustments;
+  for (int it = 0; it < 4; it++) {
+    position_adjustments.push_back(Vector3(1.0 + it, -2.0 * it, 0.5));
+    pose_adjustments.push_back(math::axis_angle_to_quaternion
+                               (Vector3(1e-6 * it, -2e-6, 1e-6 * (3 - it))));
+  }
+
+  AdjustedLinescanDGModel composed(cam, LinearInterp, adjustment_bounds,
+                                   position_adjustments, pose_adjustments, image_size);
+  boost::shared_ptr<vw::camera::CameraModel> baked
+    = bake_piecewise_dg_adjustments(cam, LinearInterp, adjustment_bounds,
+                                    position_adjustments, pose_adjustments);
+  ASSERT_TRUE( dynamic_cast<DGCameraModel*>(baked.get()) != NULL );
+
+  for ( size_t i = 0; i < 30000; i += 5000 ) {
+    for ( size_t j = 0; j < 24000; j += 2999 ) {
+      Vector2 pix(i, j);
+      EXPECT_VECTOR_NEAR( composed.camera_center(pix), baked->camera_center(pix), 1e-3 );
+      EXPECT_VECTOR_NEAR( composed.pixel_to_vector(pix), baked->pixel_to_vector(pix), 1e-9 );
+      Vector3 xyz = composed.camera_center(pix) + 2e4 * composed.pixel_to_vector(pix);
+      EXPECT_VECTOR_NEAR( pix, baked->point_to_pixel(xyz), 1e-1 );
+    }
+  }
+
+  XMLPlatformUtils::Terminate();
+}
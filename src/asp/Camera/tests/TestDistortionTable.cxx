@@ -0,0 +1,89 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Camera/LensDistortion.h>
+#include <test/Helpers.h>
+#include <asp/Camera/DistortionTable.h>
+
+using namespace vw;
+using namespace vw::camera;
+using namespace asp;
+
+PinholeModel test_distorted_pinhole(double k1) {
+  Matrix3x3 rotation = math::identity_matrix<3>();
+  TsaiLensDistortion distortion(Vector4(k1, 0.05, 1e-4, -2e-4));
+  return PinholeModel(Vector3(10, 20, 30), rotation, 5000.0, 5000.0, 500.0, 400.0,
+                      &distortion);
+}
+
+TEST(DistortionTable, MatchesExactCamera) {
+
+  PinholeModel cam = test_distorted_pinhole(-0.2);
+  DistortionTable table(cam, Vector2i(1000, 800), 32, 0.01);
+  EXPECT_EQ(0, table.num_built_blocks()); // built on demand
+
+  // Points seen all over the image
+  for (int row = 0; row < 800; row += 37) {
+    for (int col = 0; col < 1000; col += 41) {
+      Vector2 pix(col + 0.3, row + 0.7);
+      Vector3 point = cam.camera_center(pix) + 100.0 * cam.pixel_to_vector(pix);
+      EXPECT_VECTOR_NEAR(cam.point_to_pixel(point),
+                         point_to_pixel_with_table(cam, table, point), 0.01);
+    }
+  }
+
+  EXPECT_GT(table.num_built_blocks(), 0);
+  EXPECT_EQ(0, table.num_exact_blocks());
+
+  // Pixels far outside the image are not in the table
+  Vector2 pix;
+  EXPECT_FALSE(table.distorted_pixel(Vector2(-5000, 9000), pix));
+}
+
+TEST(DistortionTable, FallsBackWhenErrorTooLarge) {
+
+  PinholeModel cam = test_distorted_pinhole(-0.2);
+  DistortionTable table(cam, Vector2i(1000, 800), 512, 1e-12);
+
+  Vector2 pix;
+  EXPECT_FALSE(table.distorted_pixel(Vector2(123.4, 567.8), pix));
+  EXPECT_GT(table.num_exact_blocks(), 0);
+}
+
+TEST(DistortionTable, NewTableWhenIntrinsicsChange) {
+
+  DistortionTableCache cache(Vector2i(1000, 800), 32, 0.01);
+  PinholeModel cam1 = test_distorted_pinhole(-0.2), cam2 = test_distorted_pinhole(-0.1);
+
+  boost::shared_ptr<DistortionTable> table1 = cache.table(cam1);
+  EXPECT_EQ(table1.get(), cache.table(cam1).get());
+
+  // Only the pose changed
+  PinholeModel moved = cam1;
+  moved.set_camera_center(Vector3(1, 2, 3));
+  EXPECT_EQ(table1.get(), cache.table(moved).get());
+
+  boost::shared_ptr<DistortionTable> table2 = cache.table(cam2);
+  EXPECT_NE(table1.get(), table2.get());
+
+  Vector2 pix1, pix2;
+  ASSERT_TRUE(table1->distorted_pixel(Vector2(900, 700), pix1));
+  ASSERT_TRUE(table2->distorted_pixel(Vector2(900, 700), pix2));
+  EXPECT_GT(norm_2(pix1 - pix2), 1e-3);
+}
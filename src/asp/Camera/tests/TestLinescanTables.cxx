@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <asp/Camera/LinescanTables.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  struct CubicFunc {
+    Vector3 operator()(double t) const {
+      return Vector3(1.0 + 2.0 * t - t * t * t, 3.0 * t * t, -5.0 + 0.5 * t * t * t);
+    }
+  };
+
+  // A rotation about a fixed axis, by an angle linear in time
+  Quat rotation(double t) {
+    double angle = 0.3 + 0.05 * t;
+    Vector3 axis = normalize(Vector3(1.0, 2.0, 3.0));
+    return Quat(std::cos(angle / 2.0), std::sin(angle / 2.0) * axis[0],
+                std::sin(angle / 2.0) * axis[1], std::sin(angle / 2.0) * axis[2]);
+  }
+}
+
+TEST( LinescanTables, CubicIsExact ) {
+  CubicFunc func;
+  Vector3Table table;
+  table.resample(func, -2.0, 0.25, 17);
+
+  Vector3 val;
+  for (double t = -2.0; t <= 2.0; t += 0.0625) {
+    ASSERT_TRUE(table.interp(t, val));
+    EXPECT_VECTOR_NEAR(func(t), val, 1e-10);
+  }
+
+  // Outside the samples the caller must use the function itself
+  EXPECT_FALSE(table.interp(-2.01, val));
+  EXPECT_FALSE(table.interp(2.01, val));
+  EXPECT_FALSE(Vector3Table().interp(0.0, val));
+}
+
+TEST( LinescanTables, SlerpIsExact ) {
+  std::vector<Quat> samples;
+  double t0 = 10.0, dt = 2.0;
+  for (int it = 0; it < 6; it++) {
+    Quat q = rotation(t0 + it * dt);
+    // The same rotation with the opposite sign must not change anything
+    if (it % 2 == 1)
+      q = Quat(-q.w(), -q.x(), -q.y(), -q.z());
+    samples.push_back(q);
+  }
+
+  PoseTable table;
+  table.set(samples, t0, dt);
+  Quat q;
+  for (double t = t0; t <= t0 + 5 * dt; t += 0.3) {
+    ASSERT_TRUE(table.interp(t, q));
+    Quat e = rotation(t);
+    double d = std::abs(q.w() * e.w() + q.x() * e.x() + q.y() * e.y() + q.z() * e.z());
+    EXPECT_NEAR(1.0, d, 1e-12);
+    EXPECT_NEAR(1.0, norm_2(Vector4(q.w(), q.x(), q.y(), q.z())), 1e-12);
+  }
+  EXPECT_FALSE(table.interp(t0 - 0.1, q));
+}
+
+TEST( LinescanTables, IdenticalPoses ) {
+  std::vector<Quat> samples(3, rotation(1.0));
+  PoseTable table;
+  table.set(samples, 0.0, 1.0);
+  Quat q;
+  ASSERT_TRUE(table.interp(0.7, q));
+  EXPECT_NEAR(samples[0].w(), q.w(), 1e-15);
+  EXPECT_NEAR(samples[0].z(), q.z(), 1e-15);
+}
@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Camera/RPCModelGen.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+TEST( RPCModelGen, AnalyticJacobian ) {
+
+  // Normalized geodetics on a small grid
+  int numPts = 27;
+  Vector<double> geodetics(RPCModel::GEODETIC_COORD_SIZE * numPts);
+  Vector<double> pixels(RPCModel::IMAGE_COORD_SIZE * numPts + RpcSolveLMA::NUM_PENALTY_TERMS);
+  int count = 0;
+  for (int i = -1; i <= 1; i++) {
+    for (int j = -1; j <= 1; j++) {
+      for (int k = -1; k <= 1; k++) {
+        geodetics[count++] = 0.9 * i + 0.05 * j;
+        geodetics[count++] = 0.8 * j - 0.03 * k;
+        geodetics[count++] = 0.7 * k + 0.02 * i;
+      }
+    }
+  }
+  RpcSolveLMA model(geodetics, pixels, 0.5);
+
+  // Coefficients with small denominators terms, as for a real camera
+  Vector<double> C(RPCModel::NUM_RPC_COEFFS);
+  for (size_t i = 0; i < C.size(); i++)
+    C[i] = 0.01 * std::sin(1.0 + 3.0 * i);
+  C[1]  = 0.9; C[2]  = 0.1;   // line numerator
+  C[40] = 0.1; C[41] = -0.8;  // sample numerator
+
+  RpcSolveLMA::jacobian_type J = model.jacobian(C);
+  ASSERT_EQ(pixels.size(), J.rows());
+  ASSERT_EQ(C.size(), J.cols());
+
+  // Compare with central differences
+  double h = 1e-6;
+  for (size_t c = 0; c < C.size(); c++) {
+    Vector<double> Cp = C, Cm = C;
+    Cp[c] += h;
+    Cm[c] -= h;
+    Vector<double> diff = (model(Cp) - model(Cm)) / (2.0 * h);
+    for (size_t r = 0; r < J.rows(); r++)
+      EXPECT_NEAR(diff[r], J(r, c), 1e-7);
+  }
+}
@@ -192,6 +192,39 @@ TEST( StereoSessionRPC, InstantiateTest ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST( RPCModel, BatchProjection ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  // More points than in one chunk, and not a multiple of it
+  size_t num = 150;
+  std::vector<double> lon(num), lat(num), height(num), col(num), row(num);
+  std::vector<Vector3> points(num);
+  for ( size_t i = 0; i < num; i++ ) {
+    double s = double(i)/num - 0.5;
+    lon[i]    = -105.2903 + 0.1345 * s;
+    lat[i]    =   39.7454 - 0.1003 * s * s;
+    height[i] =   2281.0  + 637.0  * s;
+    points[i] = model.datum().geodetic_to_cartesian(Vector3(lon[i], lat[i], height[i]));
+  }
+
+  model.geodetic_to_pixel( num, &lon[0], &lat[0], &height[0], &col[0], &row[0] );
+  std::vector<Vector2> pixels;
+  model.point_to_pixel( points, pixels );
+  ASSERT_EQ( num, pixels.size() );
+  
+  for ( size_t i = 0; i < num; i++ ) {
+    Vector2 pix = model.geodetic_to_pixel( Vector3(lon[i], lat[i], height[i]) );
+    EXPECT_VECTOR_NEAR( pix, Vector2(col[i], row[i]), 1e-8 );
+    EXPECT_VECTOR_NEAR( model.point_to_pixel(points[i]), pixels[i], 1e-8 );
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 TEST( StereoSessionRPC, CheckStereo ) {
 
   xercesc::XMLPlatformUtils::Initialize();
@@ -250,3 +283,34 @@ TEST( StereoSessionRPC, CheckRpcCrop ) {
 
   xercesc::XMLPlatformUtils::Terminate();
 }
+
+TEST( RPCModel, ApproxInverse ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+  EXPECT_TRUE( model.has_inverse() );
+
+  // Starting from the inverse, and from an explicit guess, must
+  // arrive at the same place, which projects back into the pixel.
+  Vector3 offset = model.lonlatheight_offset(), scale = model.lonlatheight_scale();
+  for ( int i = -2; i <= 2; i++ ) {
+    for ( int j = -2; j <= 2; j++ ) {
+      Vector3 geo = offset + elem_prod( Vector3(0.4 * i, 0.4 * j, 0.3 * (i - j)), scale );
+      Vector2 pix = model.geodetic_to_pixel( geo );
+      Vector2 lonlat1 = model.image_to_ground( pix, geo[2] );
+      Vector2 lonlat2 = model.image_to_ground( pix, geo[2], subvector(offset, 0, 2) );
+      EXPECT_VECTOR_NEAR( subvector(geo, 0, 2), lonlat1, 1e-6 );
+      EXPECT_VECTOR_NEAR( lonlat1, lonlat2, 1e-6 );
+    }
+  }
+
+  // Without valid coefficients there is no inverse
+  RPCModel::CoeffVec zero;
+  RPCModel bad( model.datum(), zero, zero, zero, zero, Vector2(), Vector2(1, 1),
+                Vector3(), Vector3(1, 1, 1) );
+  EXPECT_FALSE( bad.has_inverse() );
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
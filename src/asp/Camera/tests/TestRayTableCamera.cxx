@@ -0,0 +1,67 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Camera/PinholeModel.h>
+#include <test/Helpers.h>
+#include <asp/Camera/RayTableCamera.h>
+
+using namespace vw;
+using namespace vw::camera;
+using namespace asp;
+
+boost::shared_ptr<CameraModel> test_pinhole() {
+  Matrix3x3 rotation = math::identity_matrix<3>();
+  return boost::shared_ptr<CameraModel>
+    (new PinholeModel(Vector3(10, 20, 30), rotation, 5000.0, 5000.0, 500.0, 400.0));
+}
+
+TEST(RayTableCamera, MatchesExactCamera) {
+
+  boost::shared_ptr<CameraModel> exact = test_pinhole();
+  RayTableCamera table(exact, Vector2i(1000, 800), 32, 0.01);
+
+  EXPECT_EQ(0, table.num_built_blocks()); // built on demand
+
+  for (int row = 0; row < 800; row += 37) {
+    for (int col = 0; col < 1000; col += 41) {
+      Vector2 pix(col + 0.3, row + 0.7);
+      EXPECT_VECTOR_NEAR(exact->camera_center(pix), table.camera_center(pix), 1e-8);
+      EXPECT_VECTOR_NEAR(exact->pixel_to_vector(pix), table.pixel_to_vector(pix), 1e-5);
+    }
+  }
+
+  EXPECT_GT(table.num_built_blocks(), 0);
+  EXPECT_EQ(0, table.num_exact_blocks());
+  EXPECT_LE(table.max_checked_error(), 0.01);
+
+  // Pixels far outside the image use the exact camera
+  Vector2 far_pix(-5000, 9000);
+  EXPECT_VECTOR_NEAR(exact->pixel_to_vector(far_pix), table.pixel_to_vector(far_pix), 1e-12);
+}
+
+TEST(RayTableCamera, FallsBackWhenErrorTooLarge) {
+
+  // With a huge spacing and a tiny error bound the check fails,
+  // and the exact camera is used everywhere.
+  boost::shared_ptr<CameraModel> exact = test_pinhole();
+  RayTableCamera table(exact, Vector2i(1000, 800), 512, 1e-12);
+
+  Vector2 pix(123.4, 567.8);
+  EXPECT_VECTOR_NEAR(exact->pixel_to_vector(pix), table.pixel_to_vector(pix), 1e-12);
+  EXPECT_GT(table.num_exact_blocks(), 0);
+}
@@ -0,0 +1,155 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/BBoxIndex.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  BBoxIndex::BBoxIndex(std::vector<vw::BBox2i> const& boxes, int cell_size):
+    m_boxes(boxes), m_cell_size(cell_size), m_num_cells_x(0), m_num_cells_y(0) {
+
+    if (cell_size <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The index cell size must be positive.\n");
+
+    for (size_t it = 0; it < m_boxes.size(); it++) {
+      if (!m_boxes[it].empty())
+        m_extent.grow(m_boxes[it]);
+    }
+    if (m_extent.empty())
+      return;
+
+    m_num_cells_x = (m_extent.width()  + cell_size - 1) / cell_size;
+    m_num_cells_y = (m_extent.height() + cell_size - 1) / cell_size;
+    m_cells.resize(m_num_cells_x * m_num_cells_y);
+
+    // Adding the boxes in order keeps the indices in each cell sorted
+    for (size_t it = 0; it < m_boxes.size(); it++) {
+      int beg_x = 0, beg_y = 0, end_x = 0, end_y = 0;
+      if (m_boxes[it].empty() || !cell_range(m_boxes[it], beg_x, beg_y, end_x, end_y))
+        continue;
+      for (int y = beg_y; y < end_y; y++)
+        for (int x = beg_x; x < end_x; x++)
+          m_cells[y * m_num_cells_x + x].push_back(it);
+    }
+  }
+
+  bool BBoxIndex::cell_range(vw::BBox2i const& box, int & beg_x, int & beg_y,
+                             int & end_x, int & end_y) const {
+
+    vw::BBox2i b = box;
+    b.crop(m_extent);
+    if (b.empty())
+      return false;
+
+    // The max corner of a box is exclusive
+    beg_x = (b.min().x() - m_extent.min().x()) / m_cell_size;
+    beg_y = (b.min().y() - m_extent.min().y()) / m_cell_size;
+    end_x = (b.max().x() - 1 - m_extent.min().x()) / m_cell_size + 1;
+    end_y = (b.max().y() - 1 - m_extent.min().y()) / m_cell_size + 1;
+    return true;
+  }
+
+  void BBoxIndex::query(vw::BBox2i const& box, std::vector<int> & ids) const {
+
+    ids.clear();
+    int beg_x = 0, beg_y = 0, end_x = 0, end_y = 0;
+    if (box.empty() || m_cells.empty() || !cell_range(box, beg_x, beg_y, end_x, end_y))
+      return;
+
+    for (int y = beg_y; y < end_y; y++) {
+      for (int x = beg_x; x < end_x; x++) {
+        std::vector<int> const& cell = m_cells[y * m_num_cells_x + x];
+        for (size_t it = 0; it < cell.size(); it++) {
+          if (m_boxes[cell[it]].intersects(box))
+            ids.push_back(cell[it]);
+        }
+      }
+    }
+
+    // A box spanning several cells is found in each of them
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  }
+
+  void overlapping_box_pairs(std::vector<vw::BBox2> const& boxes,
+                             std::vector<std::pair<int, int>> & pairs) {
+
+    pairs.clear();
+
+    vw::BBox2 extent;
+    std::vector<double> sizes;
+    for (size_t it = 0; it < boxes.size(); it++) {
+      if (boxes[it].empty())
+        continue;
+      extent.grow(boxes[it]);
+      sizes.push_back(std::max(boxes[it].width(), boxes[it].height()));
+    }
+    if (sizes.empty())
+      return;
+
+    double num = sizes.size();
+    std::nth_element(sizes.begin(), sizes.begin() + sizes.size()/2, sizes.end());
+    double median = sizes[sizes.size()/2];
+    double max_extent = std::max(extent.width(), extent.height());
+
+    // The grid unit is small compared to a box, so rounding changes the
+    // boxes little, but not so small that the extent overflows an int.
+    double unit = std::max(median / 64.0, max_extent / 1.0e+8);
+    if (!(unit > 0.0))
+      unit = 1.0; // all boxes are the same point
+
+    // Index cells about the size of a box, but not many more cells than boxes
+    double cell = std::max(median, std::sqrt(extent.width() * extent.height() / (4.0 * num)));
+    cell = std::max(cell, max_extent / (4.0 * num));
+    int cell_size = std::max(1, int(std::ceil(cell / unit)));
+
+    // The max corner of an integer box is exclusive
+    std::vector<vw::BBox2i> int_boxes(boxes.size());
+    for (size_t it = 0; it < boxes.size(); it++) {
+      if (boxes[it].empty())
+        continue;
+      vw::Vector2 beg = (boxes[it].min() - extent.min()) / unit;
+      vw::Vector2 end = (boxes[it].max() - extent.min()) / unit;
+      int_boxes[it] = vw::BBox2i(vw::Vector2i(std::floor(beg.x()), std::floor(beg.y())),
+                                 vw::Vector2i(std::floor(end.x()) + 1,
+                                              std::floor(end.y()) + 1));
+    }
+
+    BBoxIndex index(int_boxes, cell_size);
+    std::vector<int> ids;
+    for (size_t i = 0; i < boxes.size(); i++) {
+      if (boxes[i].empty())
+        continue;
+      index.query(int_boxes[i], ids);
+      for (size_t k = 0; k < ids.size(); k++) {
+        int j = ids[k];
+        if (j <= int(i))
+          continue;
+        vw::BBox2 box = boxes[i]; // deep copy
+        box.crop(boxes[j]);
+        if (!box.empty())
+          pairs.push_back(std::make_pair(int(i), j));
+      }
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file BBoxIndex.h
+///
+/// A spatial index for finding quickly which of many boxes intersect
+/// a given box.
+
+#ifndef __ASP_CORE_BBOX_INDEX_H__
+#define __ASP_CORE_BBOX_INDEX_H__
+
+#include <vw/Math/BBox.h>
+
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  /// The boxes are put in the cells of a uniform grid that they
+  /// intersect. A query only looks at the boxes in the cells the query
+  /// box intersects. This works well when the boxes are of similar
+  /// size, such as for the footprints of many DEMs in a mosaic, and
+  /// the cell size is comparable to the query box size.
+  /// The index is not modified by queries, so it can be used from
+  /// several threads at once.
+  class BBoxIndex {
+  public:
+    BBoxIndex(): m_cell_size(1), m_num_cells_x(0), m_num_cells_y(0) {}
+
+    /// Index these boxes. Empty boxes are never found.
+    BBoxIndex(std::vector<vw::BBox2i> const& boxes, int cell_size);
+
+    /// Find the indices of the boxes which intersect the given box,
+    /// in increasing order.
+    void query(vw::BBox2i const& box, std::vector<int> & ids) const;
+
+    int size() const { return m_boxes.size(); }
+
+    /// The box with the given index
+    vw::BBox2i const& box(int id) const { return m_boxes[id]; }
+
+  private:
+    // The range of cells a box intersects, clamped to the grid. Return false if none.
+    bool cell_range(vw::BBox2i const& box, int & beg_x, int & beg_y,
+                    int & end_x, int & end_y) const;
+
+    std::vector<vw::BBox2i> m_boxes;
+    vw::BBox2i m_extent; // the union of all boxes
+    int m_cell_size, m_num_cells_x, m_num_cells_y;
+    std::vector< std::vector<int> > m_cells; // box indices in each cell, row-major
+  };
+
+  /// Find the pairs of boxes which intersect, as (i, j) with i < j, in
+  /// increasing order. The boxes are rounded outward to a grid and
+  /// indexed, so each box is compared only with those near it. That
+  /// takes about linear time when each box overlaps a few others, such
+  /// as for the footprints of many images. Empty boxes are never paired.
+  void overlapping_box_pairs(std::vector<vw::BBox2> const& boxes,
+                             std::vector<std::pair<int, int>> & pairs);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BBOX_INDEX_H__
@@ -0,0 +1,93 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BackgroundWriter.cc
+///
+
+#include <asp/Core/BackgroundWriter.h>
+
+#include <vw/Core/Log.h>
+
+#include <exception>
+
+namespace asp {
+
+  BackgroundWriter::BackgroundWriter(): m_have_pending(false), m_busy(false),
+                                        m_stop(false), m_num_skipped(0) {
+    m_thread = std::thread(&BackgroundWriter::run, this);
+  }
+
+  BackgroundWriter::~BackgroundWriter() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void BackgroundWriter::submit(std::function<void()> const& job) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_have_pending)
+        m_num_skipped++;
+      m_pending = job;
+      m_have_pending = true;
+    }
+    m_cond.notify_all();
+  }
+
+  void BackgroundWriter::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return !m_have_pending && !m_busy; });
+  }
+
+  int BackgroundWriter::num_skipped() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_skipped;
+  }
+
+  void BackgroundWriter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_cond.wait(lock, [this] { return m_have_pending || m_stop; });
+      if (!m_have_pending)
+        break; // stopped, with nothing left to do
+
+      std::function<void()> job;
+      job.swap(m_pending);
+      m_have_pending = false;
+      m_busy = true;
+      lock.unlock();
+
+      // Failing to save intermediate results must not end the run
+      try {
+        job();
+      } catch (std::exception const& e) {
+        vw::vw_out(vw::WarningMessage) << "Failed to save intermediate results: "
+                                       << e.what() << "\n";
+      }
+
+      lock.lock();
+      m_busy = false;
+      m_cond.notify_all();
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,70 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BackgroundWriter.h
+///
+/// Save intermediate results in a background thread, so that the
+/// caller, such as a solver callback, only takes a snapshot of its
+/// state. At most one job waits to run. A job submitted while another
+/// is waiting replaces it, so if writing falls behind, only the
+/// latest snapshot is written, and the last one submitted is always
+/// written.
+
+#ifndef __ASP_CORE_BACKGROUND_WRITER_H__
+#define __ASP_CORE_BACKGROUND_WRITER_H__
+
+#include <boost/noncopyable.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace asp {
+
+  class BackgroundWriter: private boost::noncopyable {
+  public:
+    BackgroundWriter();
+
+    /// Finish the jobs submitted so far
+    ~BackgroundWriter();
+
+    /// Run this job when the current one, if any, is done. It replaces
+    /// a job still waiting to run.
+    void submit(std::function<void()> const& job);
+
+    /// Wait until all jobs submitted so far are done
+    void wait();
+
+    /// How many jobs were replaced before they ran
+    int num_skipped() const;
+
+  private:
+    void run();
+
+    std::function<void()> m_pending;
+    bool m_have_pending, m_busy, m_stop;
+    int m_num_skipped;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BACKGROUND_WRITER_H__
@@ -145,10 +145,122 @@ namespace asp {
     return projection.datum().geodetic_to_cartesian(projection.point_to_geodetic(proj_pt));
   }
 
+  // The quadratic approximations of the water surface projection are
+  // used within this distance, in meters, of their center. For Earth,
+  // their error there is a fraction of a millimeter.
+  const double PROJ_APPROX_RADIUS = 3000.0;
+
+  // The step, in meters, for finding the derivatives of the projection
+  const double PROJ_APPROX_STEP = 100.0;
+
+  // The approximations are not used if their error, in meters, is more than this
+  const double PROJ_APPROX_TOL = 1e-3;
+
+  // Points farther than the radius are converted exactly. After this
+  // many of them, the approximations are found again centered at the
+  // latest one. That way outliers do not make this be redone each time.
+  const int PROJ_APPROX_MAX_MISSES = 16;
+
+  // Find the second-order Taylor polynomial of a map at a point, with
+  // central differences
+  template <class MapT>
+  void fit_quadratic(MapT const& map, Vector3 const& center, double h, QuadraticMap3 & q) {
+
+    q.center = center;
+    q.value  = map(center);
+
+    Vector3 fp[3], fm[3];
+    for (int i = 0; i < 3; i++) {
+      Vector3 e;
+      e[i] = h;
+      fp[i] = map(center + e);
+      fm[i] = map(center - e);
+      select_col(q.jacobian, i) = (fp[i] - fm[i]) / (2.0 * h);
+      for (int c = 0; c < 3; c++)
+        q.hessian[c](i, i) = (fp[i][c] - 2.0 * q.value[c] + fm[i][c]) / (h * h);
+    }
+
+    for (int i = 0; i < 3; i++) {
+      for (int j = i + 1; j < 3; j++) {
+        Vector3 ei, ej;
+        ei[i] = h;
+        ej[j] = h;
+        Vector3 d = (map(center + ei + ej) - map(center + ei - ej)
+                     - map(center - ei + ej) + map(center - ei - ej)) / (4.0 * h * h);
+        for (int c = 0; c < 3; c++) {
+          q.hessian[c](i, j) = d[c];
+          q.hessian[c](j, i) = d[c];
+        }
+      }
+    }
+  }
+
+  void WaterSurfaceProjCache::build(vw::cartography::GeoReference const& projection,
+                                    Vector3 const& xyz) {
+
+    auto proj_fun   = [&projection](Vector3 const& p) { return proj_point(projection, p); };
+    auto unproj_fun = [&projection](Vector3 const& p) { return unproj_point(projection, p); };
+
+    m_ready      = true;
+    m_accurate   = false;
+    m_num_misses = 0;
+    fit_quadratic(proj_fun, xyz, PROJ_APPROX_STEP, m_proj);
+    fit_quadratic(unproj_fun, m_proj.value, PROJ_APPROX_STEP, m_unproj);
+
+    // Check the error at the corners of a cube inscribed in the region
+    // where the approximations are used. A NaN error is too large.
+    double r = PROJ_APPROX_RADIUS / sqrt(3.0);
+    for (int k = 0; k < 8; k++) {
+      Vector3 d((k & 1) ? r : -r, (k & 2) ? r : -r, (k & 4) ? r : -r);
+      Vector3 p = m_proj.center + d;
+      if (!(norm_2(m_proj(p) - proj_fun(p)) <= PROJ_APPROX_TOL))
+        return;
+      Vector3 q = m_unproj.center + d;
+      if (!(norm_2(m_unproj(q) - unproj_fun(q)) <= PROJ_APPROX_TOL))
+        return;
+    }
+
+    m_accurate = true;
+  }
+
+  Vector3 WaterSurfaceProjCache::proj(vw::cartography::GeoReference const& projection,
+                                      Vector3 const& xyz) {
+    if (xyz != xyz) // NaN
+      return proj_point(projection, xyz);
+
+    if (!m_ready || norm_2(xyz - m_proj.center) > PROJ_APPROX_RADIUS) {
+      if (m_ready && ++m_num_misses < PROJ_APPROX_MAX_MISSES)
+        return proj_point(projection, xyz);
+      build(projection, xyz);
+    }
+
+    if (!m_accurate)
+      return proj_point(projection, xyz);
+    return m_proj(xyz);
+  }
+
+  Vector3 WaterSurfaceProjCache::unproj(vw::cartography::GeoReference const& projection,
+                                        Vector3 const& proj_pt) {
+    if (proj_pt != proj_pt) // NaN
+      return unproj_point(projection, proj_pt);
+
+    if (!m_ready || norm_2(proj_pt - m_unproj.center) > PROJ_APPROX_RADIUS) {
+      Vector3 xyz = unproj_point(projection, proj_pt);
+      if (m_ready && ++m_num_misses < PROJ_APPROX_MAX_MISSES)
+        return xyz;
+      build(projection, xyz);
+    }
+
+    if (!m_accurate)
+      return unproj_point(projection, proj_pt);
+    return m_unproj(proj_pt);
+  }
+
   // Given a ECEF point xyz, and two planes, find if xyz is above or below each of the
   // plane by finding the signed distances to them.
   void signed_distances_to_planes(bool use_curved_water_surface,
                                   std::vector<BathyPlaneSettings> const& bathy_set,
+                                  std::vector<WaterSurfaceProjCache> & proj_cache,
                                   vw::Vector3 const& xyz,
                                   std::vector<double> & distances) {
     
@@ -160,8 +272,8 @@ namespace asp {
       // For a curved water surface need to first convert xyz to projected coordinates
       if (use_curved_water_surface)
         distances[it] = signed_dist_to_plane(bathy_set[it].bathy_plane,
-                                             proj_point(bathy_set[it].water_surface_projection,
-                                                        xyz));
+                                             proj_cache[it].proj
+                                             (bathy_set[it].water_surface_projection, xyz));
       else
         distances[it] = signed_dist_to_plane(bathy_set[it].bathy_plane, xyz);
     }
@@ -341,9 +453,12 @@ namespace asp {
   // a point on the outgoing ray in projected coordinates Find another
   // close point further along it. Undo the projection for these two
   // points. That will give the outgoing direction in ECEF.
+  // The conversions to and from projected coordinates are done with
+  // the given cache.
   bool snells_law_curved(Vector3 const& in_xyz, Vector3 const& in_dir,
                          std::vector<double> const& plane,
                          vw::cartography::GeoReference const& water_surface_projection,
+                         WaterSurfaceProjCache & proj_cache,
                          double refraction_index, 
                          Vector3 & out_xyz, Vector3 & out_dir) {
         
@@ -364,8 +479,8 @@ namespace asp {
     // Move a little up the ray
     Vector3 prev_xyz = guess_xyz - 1.0 * in_dir;
           
-    Vector3 in_proj_xyz = proj_point(water_surface_projection, guess_xyz);
-    Vector3 prev_proj_xyz = proj_point(water_surface_projection, prev_xyz);
+    Vector3 in_proj_xyz = proj_cache.proj(water_surface_projection, guess_xyz);
+    Vector3 prev_proj_xyz = proj_cache.proj(water_surface_projection, prev_xyz);
           
     Vector3 in_proj_dir = in_proj_xyz - prev_proj_xyz;
     in_proj_dir /= norm_2(in_proj_dir);
@@ -383,8 +498,8 @@ namespace asp {
     Vector3 next_proj_xyz = out_proj_xyz + 1.0 * out_proj_dir;
 
     // Convert back to ECEF
-    out_xyz = unproj_point(water_surface_projection, out_proj_xyz);
-    Vector3 next_xyz = unproj_point(water_surface_projection, next_proj_xyz);
+    out_xyz = proj_cache.unproj(water_surface_projection, out_proj_xyz);
+    Vector3 next_xyz = proj_cache.unproj(water_surface_projection, next_proj_xyz);
 
     // Finally get the outgoing direction according to Snell's law in ECEF
     out_dir = next_xyz - out_xyz;
@@ -425,6 +540,7 @@ namespace asp {
     m_bathy_correct = true;
     m_refraction_index = refraction_index;
     m_bathy_set = bathy_set;
+    m_proj_cache.assign(2, WaterSurfaceProjCache());
     
     if (m_refraction_index <= 1) 
       vw::vw_throw(vw::ArgumentErr() << "The water refraction index must be bigger than 1.");
@@ -565,7 +681,8 @@ namespace asp {
           
           // The more complex case, the water surface is curved. It is
           // however flat (a plane) if we switch to proj coordinates.
-          Vector3 proj_pt = proj_point(m_bathy_set[0].water_surface_projection, uncorr_tri_pt);
+          Vector3 proj_pt = m_proj_cache[0].proj(m_bathy_set[0].water_surface_projection,
+                                                 uncorr_tri_pt);
           double ht_val = signed_dist_to_plane(m_bathy_set[0].bathy_plane, proj_pt);
           if (ht_val >= 0) {
             // the rays intersect above the water surface
@@ -575,9 +692,11 @@ namespace asp {
           
           for (size_t it = 0; it < 2; it++) {
             // Bend each ray at the surface according to Snell's law.
+            // The planes are the same, so share the cached projection
             bool ans = snells_law_curved(camCtrs[it], camDirs[it],
                                          m_bathy_set[it].bathy_plane,  
                                          m_bathy_set[it].water_surface_projection,
+                                         m_proj_cache[0],
                                          m_refraction_index,
                                          waterCtrs[it], waterDirs[it]);
             if (!ans) {
@@ -612,6 +731,7 @@ namespace asp {
           bool ans = snells_law_curved(camCtrs[it], camDirs[it],
                                        m_bathy_set[it].bathy_plane,  
                                        m_bathy_set[it].water_surface_projection,
+                                       m_proj_cache[it],
                                        m_refraction_index,
                                        waterCtrs[it], waterDirs[it]);
           if (!ans)
@@ -630,7 +750,8 @@ namespace asp {
 
       // See if the unbent portions intersect above their planes
       tri_pt = triangulate_pair(camDirs[0], camCtrs[0], camDirs[1], camCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, m_proj_cache,
+                                 tri_pt, signed_dists);
       if (signed_dists[0] >= 0 && signed_dists[1] >= 0) {
         did_bathy = false; // since the rays did not reach the bathy plane
         errorVec = err;
@@ -639,7 +760,8 @@ namespace asp {
       
       // See if the bent portions intersect below their planes
       tri_pt = triangulate_pair(waterDirs[0], waterCtrs[0], waterDirs[1], waterCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, m_proj_cache,
+                                 tri_pt, signed_dists);
       if (signed_dists[0] <= 0 && signed_dists[1] <= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -649,7 +771,8 @@ namespace asp {
       // See if the left unbent portion intersects the right bent portion,
       // above left's water plane and below right's water plane
       tri_pt = triangulate_pair(camDirs[0], camCtrs[0], waterDirs[1], waterCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, m_proj_cache,
+                                 tri_pt, signed_dists);
       if (signed_dists[0] >= 0 && signed_dists[1] <= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -659,7 +782,8 @@ namespace asp {
       // See if the left bent portion intersects the right unbent portion,
       // below left's water plane and above right's water plane
       tri_pt = triangulate_pair(waterDirs[0], waterCtrs[0], camDirs[1], camCtrs[1], err);
-      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, tri_pt, signed_dists);
+      signed_distances_to_planes(use_curved_water_surface, m_bathy_set, m_proj_cache,
+                                 tri_pt, signed_dists);
       if (signed_dists[0] <= 0 && signed_dists[1] >= 0) {
         did_bathy = true; // the resulting point is at least under one plane
         errorVec = err;
@@ -22,6 +22,7 @@
 #ifndef __ASP_CORE_BATHYMETRY_H__
 #define __ASP_CORE_BATHYMETRY_H__
 
+#include <vw/Math/Matrix.h>
 #include <vw/Math/Vector.h>
 #include <vw/Stereo/StereoModel.h>
 #include <vw/Cartography/GeoReference.h>
@@ -51,6 +52,48 @@ namespace asp {
   bool snells_law(vw::Vector3 const& in_xyz, vw::Vector3 const& in_dir,
                   std::vector<double> const& plane, double refraction_index,
                            vw::Vector3 & out_xyz, vw::Vector3 & out_dir);
+
+  /// A map from 3D to 3D approximated near a point by its second-order
+  /// Taylor polynomial.
+  struct QuadraticMap3 {
+    vw::Vector3   center, value;
+    vw::Matrix3x3 jacobian;
+    vw::Matrix3x3 hessian[3]; // of each output coordinate
+
+    vw::Vector3 operator()(vw::Vector3 const& p) const {
+      vw::Vector3 d = p - center;
+      vw::Vector3 ans = value + jacobian * d;
+      for (int c = 0; c < 3; c++)
+        ans[c] += 0.5 * dot_prod(d, hessian[c] * d);
+      return ans;
+    }
+  };
+
+  /// Convert ECEF points to and from the projection in which a curved
+  /// water surface is a plane. Doing this exactly for each ray, with
+  /// PROJ, is the most expensive part of bathymetry
+  /// triangulation. Here, the first point given is the center of
+  /// quadratic approximations of both conversions, which are used
+  /// for points within a few kilometers of it, if found accurate. Other
+  /// points are converted exactly, and if there are many of them, the
+  /// approximations are found again, centered at the latest. Points in
+  /// a tile are usually close, so each tile needs this done only once
+  /// or a few times. Not thread-safe.
+  class WaterSurfaceProjCache {
+  public:
+    WaterSurfaceProjCache(): m_ready(false), m_accurate(false), m_num_misses(0) {}
+
+    vw::Vector3 proj  (vw::cartography::GeoReference const& projection,
+                       vw::Vector3 const& xyz);
+    vw::Vector3 unproj(vw::cartography::GeoReference const& projection,
+                       vw::Vector3 const& proj_pt);
+
+  private:
+    void build(vw::cartography::GeoReference const& projection, vw::Vector3 const& xyz);
+    bool          m_ready, m_accurate;
+    int           m_num_misses;
+    QuadraticMap3 m_proj, m_unproj;
+  };
   
   class BathyStereoModel: public vw::stereo::StereoModel {
   public:
@@ -99,6 +142,11 @@ namespace asp {
     bool m_single_bathy_plane;                   // if the left and right images use same plane 
     double m_refraction_index;                   // Water refraction index
     std::vector<BathyPlaneSettings> m_bathy_set; // Bathy plane settings
+
+    // The projections of the left and right water surfaces near the
+    // current points. Each tile triangulated by stereo_tri has its own
+    // copy of this model, so these need no locking.
+    mutable std::vector<WaterSurfaceProjCache> m_proj_cache;
   };
   
 } // end namespace asp
@@ -0,0 +1,141 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BinaryIO.h
+///
+/// Write and read values in binary, in the byte order of the machine,
+/// for caches that are faster to read than the files they came from.
+/// On reading, the state of the stream must be checked at the end.
+
+#ifndef __ASP_CORE_BINARY_IO_H__
+#define __ASP_CORE_BINARY_IO_H__
+
+#include <vw/Math/Quaternion.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/cstdint.hpp>
+
+#include <iostream>
+#include <list>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  template <class T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  write_binary(std::ostream & os, T const& val) {
+    os.write(reinterpret_cast<const char*>(&val), sizeof(T));
+  }
+  template <class T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  read_binary(std::istream & is, T & val) {
+    is.read(reinterpret_cast<char*>(&val), sizeof(T));
+  }
+
+  // Containers start with their size. Before those are read, the
+  // stream is checked, so that a truncated file does not result in a
+  // bogus size.
+  inline void write_size(std::ostream & os, size_t len) {
+    write_binary(os, boost::uint64_t(len));
+  }
+  inline size_t read_size(std::istream & is) {
+    boost::uint64_t len = 0;
+    read_binary(is, len);
+    return is.good() ? size_t(len) : 0;
+  }
+
+  inline void write_binary(std::ostream & os, std::string const& val) {
+    write_size(os, val.size());
+    os.write(val.data(), val.size());
+  }
+  inline void read_binary(std::istream & is, std::string & val) {
+    val.resize(read_size(is));
+    if (!val.empty())
+      is.read(&val[0], val.size());
+  }
+
+  template <class T, int N>
+  void write_binary(std::ostream & os, vw::Vector<T, N> const& val) {
+    for (size_t it = 0; it < val.size(); it++)
+      write_binary(os, val[it]);
+  }
+  template <class T, int N>
+  void read_binary(std::istream & is, vw::Vector<T, N> & val) {
+    for (size_t it = 0; it < val.size(); it++)
+      read_binary(is, val[it]);
+  }
+
+  template <class T>
+  void write_binary(std::ostream & os, vw::math::Quaternion<T> const& val) {
+    write_binary(os, val.w()); write_binary(os, val.x());
+    write_binary(os, val.y()); write_binary(os, val.z());
+  }
+  template <class T>
+  void read_binary(std::istream & is, vw::math::Quaternion<T> & val) {
+    T w = 0, x = 0, y = 0, z = 0;
+    read_binary(is, w); read_binary(is, x); read_binary(is, y); read_binary(is, z);
+    val = vw::math::Quaternion<T>(w, x, y, z);
+  }
+
+  template <class A, class B>
+  void write_binary(std::ostream & os, std::pair<A, B> const& val) {
+    write_binary(os, val.first);
+    write_binary(os, val.second);
+  }
+  template <class A, class B>
+  void read_binary(std::istream & is, std::pair<A, B> & val) {
+    read_binary(is, val.first);
+    read_binary(is, val.second);
+  }
+
+  template <class T>
+  void write_binary(std::ostream & os, std::vector<T> const& val) {
+    write_size(os, val.size());
+    for (size_t it = 0; it < val.size(); it++)
+      write_binary(os, val[it]);
+  }
+  template <class T>
+  void read_binary(std::istream & is, std::vector<T> & val) {
+    val.resize(read_size(is));
+    for (size_t it = 0; it < val.size() && is.good(); it++)
+      read_binary(is, val[it]);
+  }
+
+  template <class T>
+  void write_binary(std::ostream & os, std::list<T> const& val) {
+    write_size(os, val.size());
+    for (auto it = val.begin(); it != val.end(); it++)
+      write_binary(os, *it);
+  }
+  template <class T>
+  void read_binary(std::istream & is, std::list<T> & val) {
+    size_t len = read_size(is);
+    val.clear();
+    for (size_t it = 0; it < len && is.good(); it++) {
+      T elem;
+      read_binary(is, elem);
+      val.push_back(elem);
+    }
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BINARY_IO_H__
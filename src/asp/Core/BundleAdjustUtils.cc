@@ -19,15 +19,25 @@
 ///
 
 #include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Camera/CameraModel.h>
 #include <vw/BundleAdjustment/ControlNetwork.h>
 #include <vw/Stereo/StereoModel.h>
 #include <vw/Cartography/GeoReference.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/CameraBBox.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMath.h>
 #include <vw/BundleAdjustment/CameraRelation.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/CameraFootprint.h>
+#include <asp/Core/BBoxIndex.h>
+#include <asp/Core/DemRayIntersect.h>
+#include <asp/Core/DemTileStore.h>
 
+#include <map>
 #include <string>
 
 using namespace vw;
@@ -171,67 +181,93 @@ void asp::compute_stereo_residuals(std::vector<boost::shared_ptr<CameraModel>> c
            << "  max: " << max_error << "  average: " << (error_sum/n) << "\n";
 }
 
+// The file having the cached footprint bounding box of an image
+static std::string camera_bbox_cache_file(std::string const& out_prefix,
+                                          std::string const& image_file) {
+  return out_prefix + '-' + fs::path(image_file).stem().string() + "-bbox.txt";
+}
+
 // See the .h file for documentation
 vw::BBox2 asp::camera_bbox_with_cache(std::string const& dem_file,
                                       std::string const& image_file,
                                       boost::shared_ptr<vw::camera::CameraModel> const&
                                       camera_model,
                                       std::string const& out_prefix) {
-  
-  namespace fs = boost::filesystem;
 
-  vw_out() << "Computing ground footprint bounding box of: " + image_file << std::endl;
+  std::vector<std::string> image_files(1, image_file);
+  std::vector<boost::shared_ptr<vw::camera::CameraModel>> camera_models(1, camera_model);
+  std::vector<vw::BBox2> boxes;
+  int num_threads = 1;
+  asp::camera_bboxes_with_cache(dem_file, image_files, camera_models, out_prefix,
+                                num_threads, boxes);
+  return boxes[0];
+}
 
-  vw::BBox2 box;
-  
-  std::string box_path = out_prefix + '-' + fs::path(image_file).stem().string() + "-bbox.txt";
-  if (fs::exists(box_path)) {
-    double min_x, min_y, max_x, max_y;
-    std::ifstream ifs(box_path);
-    if (ifs >> min_x >> min_y >> max_x >> max_y) {
-      box.min() = vw::Vector2(min_x, min_y);
-      box.max() = vw::Vector2(max_x, max_y);
-      vw_out() << "Read cached ground footprint bbox from: " << box_path << ":\n" << box << "\n";
-      return box;
+// See the .h file for documentation
+void asp::camera_bboxes_with_cache(std::string const& dem_file,
+                                   std::vector<std::string> const& image_files,
+                                   std::vector<boost::shared_ptr<vw::camera::CameraModel>>
+                                   const& camera_models,
+                                   std::string const& out_prefix,
+                                   int num_threads,
+                                   std::vector<vw::BBox2> & boxes) {
+
+  if (image_files.size() != camera_models.size())
+    vw_throw( ArgumentErr() << "Expecting as many images as cameras.\n");
+
+  boxes.clear();
+  boxes.resize(image_files.size());
+
+  // Read the cached boxes, and see which ones must be computed
+  std::vector<int> todo;
+  for (size_t it = 0; it < image_files.size(); it++) {
+    std::string box_path = camera_bbox_cache_file(out_prefix, image_files[it]);
+    if (fs::exists(box_path)) {
+      double min_x, min_y, max_x, max_y;
+      std::ifstream ifs(box_path);
+      if (ifs >> min_x >> min_y >> max_x >> max_y) {
+        boxes[it].min() = vw::Vector2(min_x, min_y);
+        boxes[it].max() = vw::Vector2(max_x, max_y);
+        vw_out() << "Read cached ground footprint bbox from: " << box_path << ":\n"
+                 << boxes[it] << "\n";
+        continue;
+      }
     }
+    todo.push_back(it);
+  }
+  if (todo.empty())
+    return;
+
+  // The DEM is loaded once for all cameras
+  asp::FootprintDem dem(dem_file);
+
+  std::vector<boost::shared_ptr<vw::camera::CameraModel>> todo_cams;
+  std::vector<vw::Vector2i> todo_sizes;
+  for (size_t it = 0; it < todo.size(); it++) {
+    std::string const& image_file = image_files[todo[it]];
+    vw_out() << "Computing ground footprint bounding box of: " + image_file << std::endl;
+    todo_cams.push_back(camera_models[todo[it]]);
+    todo_sizes.push_back(vw::file_image_size(image_file));
   }
 
-  // Read the DEM and supporting data
-  vw::cartography::GeoReference dem_georef;
-  DiskImageView<float> dem_disk_image(dem_file);
-  ImageViewRef<PixelMask<float>> dem;
-  boost::shared_ptr<DiskImageResource> dem_rsrc(DiskImageResourcePtr(dem_file));
-  if (dem_rsrc->has_nodata_read())
-    dem = create_mask(dem_disk_image, dem_rsrc->nodata_read());
-  else
-    dem = pixel_cast<PixelMask<float>>(dem_disk_image); // all pixels are valid
-  
-  bool has_georef = vw::cartography::read_georeference(dem_georef, dem_file);
-  if (!has_georef)
-    vw_throw( ArgumentErr() << "There is no georeference information in: "
-              << dem_file << ".\n" );
-
+  std::vector<vw::BBox2> todo_boxes;
   try {
-    DiskImageView<float> img(image_file);
-    float auto_res = -1.0;  // Will be updated
-    bool quick = false;     // Do a thorough job
-    box = vw::cartography::camera_bbox(dem, dem_georef, dem_georef,
-                                       camera_model, img.cols(), img.rows(),
-                                       auto_res, quick);
+    asp::camera_footprints(dem, todo_cams, todo_sizes, num_threads, todo_boxes);
   } catch (std::exception const& e) {
     vw_throw( ArgumentErr() << e.what() << "\n"
-              << "Failed to compute the footprint of camera image: " << image_file
-              << " onto DEM: " << dem_file << ".\n");
+              << "Failed to compute the camera footprints onto DEM: " << dem_file << ".\n");
   }
 
-  vw_out() << "Writing: " << box_path << "\n";
-  std::ofstream ofs(box_path.c_str());
-  ofs.precision(17);
-  ofs << box.min().x() << " " <<  box.min().y() << " "
-      << box.max().x() << " " <<  box.max().y() << "\n";
-  ofs.close();
-  
-  return box;
+  for (size_t it = 0; it < todo.size(); it++) {
+    boxes[todo[it]] = todo_boxes[it];
+    std::string box_path = camera_bbox_cache_file(out_prefix, image_files[todo[it]]);
+    vw_out() << "Writing: " << box_path << "\n";
+    std::ofstream ofs(box_path.c_str());
+    ofs.precision(17);
+    ofs << todo_boxes[it].min().x() << " " <<  todo_boxes[it].min().y() << " "
+        << todo_boxes[it].max().x() << " " <<  todo_boxes[it].max().y() << "\n";
+    ofs.close();
+  }
 }
 
 // See the .h file for the documentation.
@@ -248,42 +284,35 @@ void asp::build_overlap_list_based_on_dem
   if (image_files.size() != camera_models.size())
     vw_throw( ArgumentErr() << "Expecting as many images as cameras.\n");
   
+  // Expand the boxes by the given factor
+  double factor = pct_for_overlap / 100.0;
+
+  // The expansion factor can be negative, but not if it results in an empty box
+  if (factor <= -1.0) 
+    vw_throw(ArgumentErr() << "Invalid percentage when computing the footprint of camera image: "
+             << pct_for_overlap  << ".\n");
+
+  // By this stage the camera bboxes are already computed in parallel
+  // and cached, they just need to be loaded.
   int num_images = image_files.size();
-  std::vector<vw::BBox2> boxes(num_images);
+  int num_threads = 1; // ISIS cameras must be single-threaded
+  std::vector<vw::BBox2> boxes;
+  asp::camera_bboxes_with_cache(dem_file, image_files, camera_models, out_prefix,
+                                num_threads, boxes);
   for (int it = 0; it < num_images; it++) {
-    // By this stage the camera bboxes are already computed and cached,
-    // they just need to be loaded.
-    boxes[it] = asp::camera_bbox_with_cache(dem_file, image_files[it], camera_models[it],  
-                                            out_prefix);
-
-    // Expand the box by the given factor
-    double factor = pct_for_overlap / 100.0;
-
-    // The expansion factor can be negative, but not if it results in an empty box
-    if (factor <= -1.0) 
-      vw_throw(ArgumentErr() << "Invalid percentage when computing the footprint of camera image: "
-               << pct_for_overlap  << ".\n");
-      
     double half_extra_x = 0.5 * boxes[it].width()  * factor;
     double half_extra_y = 0.5 * boxes[it].height() * factor;
     boxes[it].min() -= Vector2(half_extra_x, half_extra_y);
     boxes[it].max() += Vector2(half_extra_x, half_extra_y);
   }
 
-  // See which boxes overlap. While this is an O(N^2) computation,
-  // likely N is at most a thousand or two, which should be
-  // manageable. A 2D tree of box corners could be used, and two boxes
-  // would then overlap if corners from one box are contained in a
-  // second box. That would be a O(N * log(N)) lookup.
-  // TODO(oalexan1): Use a tree.
-  for (int it1 = 0; it1 < num_images; it1++) {
-    for (int it2 = it1 + 1; it2 < num_images; it2++) {
-      BBox2 box = boxes[it1]; // deep copy
-      box.crop(boxes[it2]);
-      if (!box.empty())
-        overlap_list.insert(std::make_pair(image_files[it1], image_files[it2]));
-    }
-  }
+  // See which boxes overlap. With a spatial index this takes about
+  // linear time, which matters for tens of thousands of images.
+  std::vector<std::pair<int, int>> pairs;
+  asp::overlapping_box_pairs(boxes, pairs);
+  for (size_t it = 0; it < pairs.size(); it++)
+    overlap_list.insert(std::make_pair(image_files[pairs[it].first],
+                                       image_files[pairs[it].second]));
 
   return;
 }
@@ -334,6 +363,26 @@ void asp::check_for_duplicates(std::vector<std::string> const& image_files,
   }
 }
 
+// If this option is set, don't try to match cameras that are too far apart
+static bool camera_positions_close(bool got_est_cam_positions, double position_filter_dist,
+                                   std::vector<vw::Vector3> const& estimated_camera_gcc,
+                                   int i, int j) {
+  if (!got_est_cam_positions || position_filter_dist <= 0)
+    return true;
+
+  Vector3 this_pos  = estimated_camera_gcc[i];
+  Vector3 other_pos = estimated_camera_gcc[j];
+  if ((this_pos  != Vector3(0,0,0)) && // If both positions are known
+      (other_pos != Vector3(0,0,0)) && // and they are too far apart
+      (norm_2(this_pos - other_pos) > position_filter_dist)) {
+    vw_out() << "Skipping position: " << this_pos << " and "
+             << other_pos << " with distance " << norm_2(this_pos - other_pos)
+             << std::endl;
+    return false; // Skip this image pair
+  }
+  return true;
+}
+
 // Make a list of all of the image pairs to find matches for
 void asp::determine_image_pairs(// Inputs
                                 int overlap_limit,
@@ -359,6 +408,38 @@ void asp::determine_image_pairs(// Inputs
   std::set<std::pair<int, int>> local_set;
   
   int num_images = image_files.size();
+
+  // With an overlap list, such as from the camera footprints, only its
+  // pairs are examined, rather than all pairs within the overlap limit,
+  // as there can be very many images. Pair (i, j), with i < j, is within
+  // the limit if j - i is, or, when matching the first to the last
+  // image, if going from j to i with wrap-around is.
+  if (have_overlap_list) {
+    std::map<std::string, int> image_index;
+    for (int it = 0; it < num_images; it++)
+      image_index[image_files[it]] = it;
+    for (auto it = overlap_list.begin(); it != overlap_list.end(); it++) {
+      auto pos1 = image_index.find(it->first);
+      auto pos2 = image_index.find(it->second);
+      if (pos1 == image_index.end() || pos2 == image_index.end())
+        continue;
+      int i = std::min(pos1->second, pos2->second);
+      int j = std::max(pos1->second, pos2->second);
+      if (i == j)
+        continue;
+      if (j - i > overlap_limit &&
+          (!match_first_to_last || i + num_images - j > overlap_limit))
+        continue;
+      if (!camera_positions_close(got_est_cam_positions, position_filter_dist,
+                                  estimated_camera_gcc, i, j))
+        continue;
+      local_set.insert(std::make_pair(i, j));
+    }
+    for (auto it = local_set.begin(); it != local_set.end(); it++)
+      all_pairs.push_back(*it);
+    return;
+  }
+
   for (int i0 = 0; i0 < num_images; i0++){
 
     for (int j0 = i0 + 1; j0 <= i0 + overlap_limit; j0++){
@@ -380,29 +461,9 @@ void asp::determine_image_pairs(// Inputs
           std::swap(i, j);
       }
       
-      // Apply the overlap list if manually specified. Otherwise every
-      // image pair i, j as above will be matched.
-      if (have_overlap_list) {
-        auto pair1 = std::make_pair(image_files[i], image_files[j]);
-        auto pair2 = std::make_pair(image_files[j], image_files[i]);
-        if (overlap_list.find(pair1) == overlap_list.end() &&
-            overlap_list.find(pair2) == overlap_list.end())
-          continue;
-      }
-
-      // If this option is set, don't try to match cameras that are too far apart.
-      if (got_est_cam_positions && (position_filter_dist > 0)) {
-        Vector3 this_pos  = estimated_camera_gcc[i];
-        Vector3 other_pos = estimated_camera_gcc[j];
-        if ((this_pos  != Vector3(0,0,0)) && // If both positions are known
-            (other_pos != Vector3(0,0,0)) && // and they are too far apart
-            (norm_2(this_pos - other_pos) > position_filter_dist)) {
-          vw_out() << "Skipping position: " << this_pos << " and "
-                   << other_pos << " with distance " << norm_2(this_pos - other_pos)
-                   << std::endl;
-          continue; // Skip this image pair
-        }
-      }
+      if (!camera_positions_close(got_est_cam_positions, position_filter_dist,
+                                  estimated_camera_gcc, i, j))
+        continue;
 
       local_set.insert(std::make_pair(i,j));
     }
@@ -425,9 +486,12 @@ void asp::create_interp_dem(std::string const& dem_file,
   if (vw::read_nodata_val(dem_file, nodata_val))
     vw_out() << "Found DEM nodata value: " << nodata_val << std::endl;
 
-  // Create the interpolated DEM
-  ImageViewRef<PixelMask<double>> dem
-    = create_mask(DiskImageView<double>(dem_file), nodata_val);
+  // Create the interpolated DEM. The DEM is looked up at scattered
+  // places, so read it in tiles kept in memory, rather than through
+  // the block cache of the file.
+  asp::DemTileStore store(pixel_cast<PixelMask<float>>
+                          (create_mask(DiskImageView<double>(dem_file), nodata_val)));
+  ImageViewRef<PixelMask<double>> dem = pixel_cast<PixelMask<double>>(asp::DemTileView(store));
   interp_dem = interpolate(dem, BilinearInterpolation(), ConstantEdgeExtension());
 
   // Read the georef
@@ -438,6 +502,53 @@ void asp::create_interp_dem(std::string const& dem_file,
   }
 }
 
+// See the .h file for documentation
+asp::DemRayIntersector asp::load_mapproj_dem(std::string const& dem_file,
+                                             std::vector<std::string> const& map_files) {
+
+  vw::cartography::GeoReference dem_georef;
+  ImageViewRef<PixelMask<double>> interp_dem;
+  asp::create_interp_dem(dem_file, dem_georef, interp_dem);
+
+  // The DEM pixels under the map-projected images, found by sampling
+  // the image borders
+  BBox2 pix_box;
+  const int num_samples = 20;
+  for (size_t it = 0; it < map_files.size(); it++) {
+    vw::cartography::GeoReference georef;
+    if (!vw::cartography::read_georeference(georef, map_files[it]))
+      vw_throw(ArgumentErr() << "Error: Cannot read a georeference from: "
+               << map_files[it] << ".\n");
+    Vector2 last = Vector2(vw::file_image_size(map_files[it])) - Vector2(1, 1);
+    for (int s = 0; s <= num_samples; s++) {
+      double t = double(s) / num_samples;
+      Vector2 border[4] = {Vector2(t * last[0], 0), Vector2(t * last[0], last[1]),
+                           Vector2(0, t * last[1]), Vector2(last[0], t * last[1])};
+      for (int k = 0; k < 4; k++) {
+        try {
+          pix_box.grow(dem_georef.lonlat_to_pixel(georef.pixel_to_lonlat(border[k])));
+        } catch (...) {}
+      }
+    }
+  }
+
+  // Use the whole DEM if the images could not be located on it
+  BBox2i crop_box = bounding_box(interp_dem);
+  if (!pix_box.empty()) {
+    // A margin, as the image borders may curve between the samples
+    pix_box.expand(std::max(2.0, 0.05 * std::max(pix_box.width(), pix_box.height())));
+    BBox2i box(Vector2i(floor(pix_box.min().x()), floor(pix_box.min().y())),
+               Vector2i(ceil(pix_box.max().x()) + 1, ceil(pix_box.max().y()) + 1));
+    box.crop(crop_box);
+    if (box.width() >= 2 && box.height() >= 2)
+      crop_box = box;
+  }
+
+  return asp::DemRayIntersector(crop(interp_dem, crop_box),
+                                vw::cartography::crop(dem_georef, crop_box.min().x(),
+                                                      crop_box.min().y()));
+}
+
 // Given an xyz point in ECEF coordinates, update its height above datum
 // by interpolating into a DEM. The user must check the return status.
 bool asp::update_point_height_from_dem(vw::cartography::GeoReference const& dem_georef,
@@ -526,11 +637,49 @@ void asp::update_point_height_from_dem(vw::ba::ControlNetwork const& cnet,
   return;
 }
 
+asp::BAObservations::BAObservations(vw::ba::ControlNetwork const& cnet, int num_cameras):
+  m_cam_beg(num_cameras + 1, 0) {
+
+  // Count the observations in each camera, then put each in its place
+  for (size_t ipt = 0; ipt < cnet.size(); ipt++) {
+    for (auto cm = cnet[ipt].begin(); cm != cnet[ipt].end(); cm++) {
+      int icam = cm->image_id();
+      if (icam < 0 || icam >= num_cameras)
+        vw_throw(ArgumentErr() << "Out of bounds in the number of cameras.\n");
+      m_cam_beg[icam + 1]++;
+    }
+  }
+  for (int icam = 0; icam < num_cameras; icam++)
+    m_cam_beg[icam + 1] += m_cam_beg[icam];
+
+  size_t num_obs = m_cam_beg[num_cameras];
+  m_pixels.resize(num_obs);
+  m_sigmas.resize(num_obs);
+  m_point_ids.resize(num_obs);
+  std::vector<size_t> pos(m_cam_beg.begin(), m_cam_beg.end() - 1);
+  for (size_t ipt = 0; ipt < cnet.size(); ipt++) {
+    for (auto cm = cnet[ipt].begin(); cm != cnet[ipt].end(); cm++) {
+      size_t iobs = pos[cm->image_id()]++;
+      m_pixels[iobs]    = vw::Vector2f(cm->position());
+      m_sigmas[iobs]    = vw::Vector2f(cm->sigma());
+      m_point_ids[iobs] = ipt;
+    }
+  }
+}
+
+void asp::BAObservations::count_point_observations(int num_points,
+                                                   std::vector<int> & counts) const {
+  counts.assign(num_points, 0);
+  for (size_t iobs = 0; iobs < m_point_ids.size(); iobs++)
+    counts[m_point_ids[iobs]]++;
+}
+
 // Shoot rays from all matching interest point. Intersect those with a
 // DEM. Find their average.  Invalid or uncomputable xyz are set to
-// the zero vector.
+// the zero vector. The part of the DEM around the triangulated points
+// is loaded in memory, and the rays are intersected with it in parallel.
 void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
-                                         vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& crn,
+                                         BAObservations const& obs,
                                          std::set<int> const& outliers,
                                          std::vector<boost::shared_ptr<vw::camera::CameraModel>>
                                          const& camera_models,
@@ -543,13 +692,17 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
 
   dem_xyz_vec = std::vector<vw::Vector3>(num_tri_points, vw::Vector3(0, 0, 0));
   std::vector<int> dem_xyz_count(num_tri_points, 0);
-  
-  for (int icam = 0; icam < (int)crn.size(); icam++) {
+
+  // Collect the rays, and the DEM pixels of the triangulated points
+  std::vector<Vector3> ctrs, dirs;
+  std::vector<int> ray_points;
+  BBox2 pix_box;
+  for (int icam = 0; icam < obs.num_cameras(); icam++) {
     
-    for (auto fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
+    for (size_t iobs = obs.begin(icam); iobs < obs.end(icam); iobs++) {
         
       // The index of the 3D point
-      int ipt = (**fiter).m_point_id;
+      int ipt = obs.point_id(iobs);
 
       if (cnet[ipt].type() == vw::ba::ControlPoint::GroundControlPoint)
         continue; // GCP do not get modified
@@ -559,10 +712,10 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
         
       // The observed value for the projection of point with index ipt into
       // the camera with index icam.
-      Vector2 observation = (**fiter).m_location;
+      Vector2 observation = obs.pixel(iobs);
         
-      // Ideally this point projects back to the pixel observation, so use the
-      // triangulated position as initial guess.
+      // Ideally this point projects back to the pixel observation, so
+      // the ray meets the DEM near the triangulated position.
       Vector3 xyz_guess = cnet[ipt].position();
 
       // Points at planet center are outliers. This check is likely redundant,
@@ -570,26 +723,39 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
       if (xyz_guess == Vector3(0, 0, 0))
         continue;
 
-      bool treat_nodata_as_zero = false;
-      bool has_intersection = false;
-      double height_error_tol = 0.001; // 1 mm should be enough
-      double max_abs_tol      = 1e-14; // abs cost fun change b/w iterations
-      double max_rel_tol      = 1e-14;
-      int num_max_iter        = 25;   // Using many iterations can be very slow
-
-      Vector3 dem_xyz = vw::cartography::camera_pixel_to_dem_xyz
-        (camera_models[icam]->camera_center(observation),
-         camera_models[icam]->pixel_to_vector(observation),
-         interp_dem, dem_georef, treat_nodata_as_zero, has_intersection,
-         height_error_tol, max_abs_tol, max_rel_tol, num_max_iter, xyz_guess);
+      ctrs.push_back(camera_models[icam]->camera_center(observation));
+      dirs.push_back(camera_models[icam]->pixel_to_vector(observation));
+      ray_points.push_back(ipt);
 
-      if (!has_intersection) 
-        continue;
-
-      dem_xyz_vec[ipt] += dem_xyz;
-      dem_xyz_count[ipt]++;
+      Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz_guess);
+      pix_box.grow(dem_georef.lonlat_to_pixel(subvector(llh, 0, 2)));
     }
   }
+  if (ctrs.empty())
+    return;
+
+  // Load the DEM around the triangulated points, with a margin in case
+  // they are off
+  double margin = std::max(256.0, 0.1 * std::max(pix_box.width(), pix_box.height()));
+  pix_box.expand(margin);
+  BBox2i crop_box(Vector2i(floor(pix_box.min().x()), floor(pix_box.min().y())),
+                  Vector2i(ceil(pix_box.max().x()) + 1, ceil(pix_box.max().y()) + 1));
+  crop_box.crop(bounding_box(interp_dem));
+  if (crop_box.width() < 2 || crop_box.height() < 2)
+    return;
+  asp::DemRayIntersector dem(crop(interp_dem, crop_box),
+                             vw::cartography::crop(dem_georef, crop_box.min().x(),
+                                                   crop_box.min().y()));
+
+  std::vector<Vector3> ray_xyz;
+  int num_threads = vw_settings().default_num_threads();
+  dem.intersect(ctrs, dirs, num_threads, ray_xyz);
+  for (size_t it = 0; it < ray_xyz.size(); it++) {
+    if (ray_xyz[it] == Vector3())
+      continue;
+    dem_xyz_vec[ray_points[it]] += ray_xyz[it];
+    dem_xyz_count[ray_points[it]]++;
+  }
 
   // Average the successful intersections
   for (size_t xyz_it = 0; xyz_it < dem_xyz_vec.size(); xyz_it++) {
@@ -602,63 +768,94 @@ void asp::calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
   return;
 }
 
+namespace {
+
+  // Find the points whose projection into one camera is too far from
+  // where they are observed. Each camera has its own list of outliers,
+  // so no lock is needed.
+  class FlagCameraOutliersTask: public vw::Task, private boost::noncopyable {
+    vw::ba::ControlNetwork const& m_cnet;
+    vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& m_crn;
+    vw::camera::CameraModel const& m_camera;
+    int m_icam;
+    double m_max_init_reproj_error;
+    std::vector<int> & m_outliers;
+
+  public:
+    FlagCameraOutliersTask(vw::ba::ControlNetwork const& cnet,
+                           vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& crn,
+                           vw::camera::CameraModel const& camera, int icam,
+                           double max_init_reproj_error, std::vector<int> & outliers):
+      m_cnet(cnet), m_crn(crn), m_camera(camera), m_icam(icam),
+      m_max_init_reproj_error(max_init_reproj_error), m_outliers(outliers) {}
+
+    virtual void operator()() {
+
+      int num_tri_points = m_cnet.size();
+      for (auto fiter = m_crn[m_icam].begin(); fiter != m_crn[m_icam].end(); fiter++) {
+
+        // The index of the triangulated point
+        int ipt = (**fiter).m_point_id;
+        VW_ASSERT(ipt < num_tri_points,
+                  ArgumentErr() << "Out of bounds in the number of points.");
+
+        // The observed value for the projection of point with index ipt into
+        // the camera with index icam.
+        Vector2 observation = (**fiter).m_location;
+
+        Vector3 const& tri_point = m_cnet[ipt].position(); // alias
+
+        if (tri_point == Vector3(0, 0, 0)) {
+          // Points at planet center are outliers
+          m_outliers.push_back(ipt);
+          continue;
+        }
+
+        try {
+          vw::Vector2 pix = m_camera.point_to_pixel(tri_point);
+          bool is_good = (norm_2(pix - observation) <= m_max_init_reproj_error);
+          if (!is_good) // this checks for NaN too
+            m_outliers.push_back(ipt);
+        } catch(...) {
+          m_outliers.push_back(ipt);
+        }
+      }
+    }
+  };
+
+} // end anonymous namespace
+
 // Flag outliers by reprojection error with input cameras. This assumes that
-// the input cameras are pretty accurate.
+// the input cameras are pretty accurate. The cameras are processed in parallel.
 void asp::flag_initial_outliers(vw::ba::ControlNetwork const& cnet,
                                 vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& crn,
                                 std::vector<boost::shared_ptr<vw::camera::CameraModel>>
                                 const& camera_models,
-                                double max_init_reproj_error,
+                                double max_init_reproj_error, int num_threads,
                                 // Output
                                 std::set<int> & outliers) {
   // Wipe the output
   outliers.clear();
 
   int num_cameras = camera_models.size();
-  int num_tri_points = cnet.size();
-
-  for (int icam = 0; icam < (int)crn.size(); icam++) {
-
-    for (auto fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
-      
-      // The index of the triangulated point
-      int ipt = (**fiter).m_point_id;
-      
-      VW_ASSERT(icam < num_cameras, ArgumentErr() << "Out of bounds in the number of cameras.");
-      VW_ASSERT(ipt < num_tri_points, ArgumentErr() << "Out of bounds in the number of points.");
-
-      if (outliers.find(ipt) != outliers.end()) {
-        // Is an outlier
-        continue;
-      }
-      
-      // The observed value for the projection of point with index ipt into
-      // the camera with index icam.
-      Vector2 observation = (**fiter).m_location;
-
-      Vector3 const& tri_point = cnet[ipt].position(); // alias
+  VW_ASSERT((int)crn.size() <= num_cameras,
+            ArgumentErr() << "Out of bounds in the number of cameras.");
+
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+
+  std::vector<std::vector<int>> cam_outliers(crn.size());
+  {
+    FifoWorkQueue queue(num_threads);
+    for (size_t icam = 0; icam < crn.size(); icam++)
+      queue.add_task(boost::shared_ptr<FlagCameraOutliersTask>
+                     (new FlagCameraOutliersTask(cnet, crn, *camera_models[icam], icam,
+                                                 max_init_reproj_error, cam_outliers[icam])));
+    queue.join_all();
+  }
 
-      if (tri_point == Vector3(0, 0, 0)) {
-        // Points at planet center are outliers
-        outliers.insert(ipt);
-        continue;
-      }
-      
-      vw::Vector2 pix;
-      try {
-        pix = camera_models[icam]->point_to_pixel(tri_point);
-        bool is_good = (norm_2(pix - observation) <= max_init_reproj_error);
-        if (!is_good) { // this checks for NaN too
-          outliers.insert(ipt);
-          continue;
-        }
-      } catch(...) {
-        outliers.insert(ipt);
-        continue;
-      }
-    }
-    
-  } // end iterating over cameras
+  for (size_t icam = 0; icam < cam_outliers.size(); icam++)
+    outliers.insert(cam_outliers[icam].begin(), cam_outliers[icam].end());
 
   return;
 }
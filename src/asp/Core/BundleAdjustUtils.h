@@ -25,6 +25,7 @@
 #include <vw/Math/Quaternion.h>
 #include <vw/Math/BBox.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <set>
@@ -58,6 +59,38 @@ namespace vw {
 }
 
 namespace asp{
+  class DemRayIntersector;
+
+  /// The pixel observations of the points, grouped by camera, and for
+  /// each camera in the order of the points in the control network. Each
+  /// is a pixel and its sigma in single precision and the index of the
+  /// point, which is much less memory than a CameraRelationNetwork.
+  class BAObservations {
+  public:
+    BAObservations(): m_cam_beg(1, 0) {}
+    BAObservations(vw::ba::ControlNetwork const& cnet, int num_cameras);
+
+    int    num_cameras() const { return int(m_cam_beg.size()) - 1; }
+    size_t size       () const { return m_point_ids.size(); }
+
+    /// The observations in camera icam are those with indices from
+    /// begin(icam) to end(icam), not including the latter.
+    size_t begin(int icam) const { return m_cam_beg[icam];     }
+    size_t end  (int icam) const { return m_cam_beg[icam + 1]; }
+
+    int         point_id(size_t obs) const { return m_point_ids[obs]; }
+    vw::Vector2 pixel   (size_t obs) const { return vw::Vector2(m_pixels[obs]); }
+    vw::Vector2 sigma   (size_t obs) const { return vw::Vector2(m_sigmas[obs]); }
+
+    /// The number of observations of each point
+    void count_point_observations(int num_points, std::vector<int> & counts) const;
+
+  private:
+    std::vector<size_t>       m_cam_beg;
+    std::vector<vw::Vector2f> m_pixels, m_sigmas;
+    std::vector<std::int32_t> m_point_ids;
+  };
+
   /// Read both kinds of adjustments
   void read_adjustments(std::string const& filename,
                         bool        & piecewise_adjustments,
@@ -92,6 +125,16 @@ namespace asp{
                                    boost::shared_ptr<vw::camera::CameraModel> const&
                                    camera_model,
                                    std::string const& out_prefix);
+
+  // The same for several cameras, with the DEM loaded once, and the
+  // footprints not cached yet computed with this many threads.
+  void camera_bboxes_with_cache(std::string const& dem_file,
+                                std::vector<std::string> const& image_files,
+                                std::vector<boost::shared_ptr<vw::camera::CameraModel>>
+                                const& camera_models,
+                                std::string const& out_prefix,
+                                int num_threads,
+                                std::vector<vw::BBox2> & boxes);
   
   // Determine which camera images overlap by finding the lon-lat
   // bounding boxes of their footprints given the specified DEM, expand
@@ -135,11 +178,18 @@ namespace asp{
                              // Output
                              std::vector<std::pair<int,int>> & all_pairs);
 
-  /// Load a DEM from disk to use for interpolation.
+  /// Load a DEM from disk to use for interpolation. The DEM is read in
+  /// tiles when first needed, and they are kept in memory.
   void create_interp_dem(std::string const& dem_file,
                          vw::cartography::GeoReference & dem_georef,
                          vw::ImageViewRef<vw::PixelMask<double>> & interp_dem);
 
+  /// Load in memory the part of a DEM under the given images which
+  /// were map-projected onto it, to look up the heights when undoing
+  /// the map-projection.
+  asp::DemRayIntersector load_mapproj_dem(std::string const& dem_file,
+                                          std::vector<std::string> const& map_files);
+
   // Given an xyz point in ECEF coordinates, update its height above datum
   // by interpolating into a DEM. The user must check the return status.
   bool update_point_height_from_dem(vw::cartography::GeoReference const& dem_georef,
@@ -165,9 +215,10 @@ namespace asp{
                                     std::vector<vw::Vector3> & dem_xyz_vec);
   
   // Shoot rays from all matching interest point. Intersect those with a DEM.
-  // Find their average.
+  // Find their average. The part of the DEM around the triangulated points
+  // is loaded in memory, and the first intersection along each ray is used.
   void calc_avg_intersection_with_dem(vw::ba::ControlNetwork const& cnet,
-                                      vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& crn,
+                                      BAObservations const& obs,
                                       std::set<int> const& outliers,
                                       std::vector<boost::shared_ptr<vw::camera::CameraModel>> const&
                                       camera_models,
@@ -183,7 +234,7 @@ namespace asp{
                              vw::ba::CameraRelationNetwork<vw::ba::JFeature> const& crn,
                              std::vector<boost::shared_ptr<vw::camera::CameraModel>>
                              const& camera_models,
-                             double max_init_reproj_error,
+                             double max_init_reproj_error, int num_threads,
                              // Output
                              std::set<int> & outliers);
   
@@ -0,0 +1,382 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraFootprint.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/BlockRasterize.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/Transform.h>
+#include <vw/FileIO/DiskImageUtils.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Cartography/CameraBBox.h>
+#include <asp/Core/CameraFootprint.h>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+
+using namespace vw;
+
+namespace asp {
+
+  // Full-resolution DEM tiles, shared by the copies of a FootprintDem.
+  // When full, the oldest tile is dropped.
+  struct FootprintTileCache {
+    static const int TILE_SIZE = 256;
+    static const size_t MAX_TILES = 256; // 128 MB
+    std::mutex mutex;
+    std::map<std::pair<int, int>, ImageView<PixelMask<float>>> tiles;
+    std::deque<std::pair<int, int>> order;
+  };
+
+  FootprintDem::FootprintDem(std::string const& dem_file, int lowres_size):
+    m_dem(dem_file), m_nodata(-std::numeric_limits<float>::max()),
+    m_cache(new FootprintTileCache) {
+
+    if (!vw::cartography::read_georeference(m_georef, dem_file))
+      vw_throw(ArgumentErr() << "There is no georeference information in: "
+               << dem_file << ".\n");
+    vw::read_nodata_val(dem_file, m_nodata);
+
+    if (lowres_size <= 0)
+      vw_throw(ArgumentErr() << "The low-resolution DEM size must be positive.\n");
+
+    // The DEM is read once here, in parallel. The low-resolution
+    // version only serves to find a first intersection, so pixels are
+    // just skipped rather than averaged.
+    m_scale = std::max(1, (int)ceil(double(std::max(m_dem.cols(), m_dem.rows()))
+                                    / lowres_size));
+    m_lowres = DemRayIntersector(pixel_cast<PixelMask<double>>
+                                 (subsample(create_mask(m_dem, m_nodata), m_scale)),
+                                 vw::cartography::resample(m_georef, 1.0 / m_scale));
+  }
+
+  bool FootprintDem::intersect_lowres(Vector3 const& ctr, Vector3 const& dir,
+                                      Vector3 & xyz) const {
+
+    return m_lowres.intersect(ctr, dir, xyz);
+  }
+
+  void FootprintDem::read_window(BBox2i const& box,
+                                 ImageView<PixelMask<float>> & window) const {
+
+    window.set_size(box.width(), box.height());
+    for (int row = 0; row < window.rows(); row++) {
+      for (int col = 0; col < window.cols(); col++)
+        window(col, row).invalidate();
+    }
+
+    const int ts = FootprintTileCache::TILE_SIZE;
+    BBox2i dem_box = bounding_box(m_dem);
+    for (int ty = box.min().y() / ts; ty <= (box.max().y() - 1) / ts; ty++) {
+      for (int tx = box.min().x() / ts; tx <= (box.max().x() - 1) / ts; tx++) {
+
+        BBox2i tile_box(tx * ts, ty * ts, ts, ts);
+        tile_box.crop(dem_box);
+        if (tile_box.empty())
+          continue;
+
+        // Look up the tile, or read it. The read is done without the
+        // lock, so other threads are not held up by the disk.
+        ImageView<PixelMask<float>> tile;
+        std::pair<int, int> key(tx, ty);
+        bool found = false;
+        {
+          std::lock_guard<std::mutex> lock(m_cache->mutex);
+          auto it = m_cache->tiles.find(key);
+          if (it != m_cache->tiles.end()) {
+            tile = it->second; // shallow copy
+            found = true;
+          }
+        }
+        if (!found) {
+          tile = crop(create_mask(m_dem, m_nodata), tile_box);
+          std::lock_guard<std::mutex> lock(m_cache->mutex);
+          if (m_cache->tiles.find(key) == m_cache->tiles.end()) {
+            m_cache->tiles[key] = tile;
+            m_cache->order.push_back(key);
+            if (m_cache->order.size() > FootprintTileCache::MAX_TILES) {
+              m_cache->tiles.erase(m_cache->order.front());
+              m_cache->order.pop_front();
+            }
+          }
+        }
+
+        BBox2i overlap = tile_box;
+        overlap.crop(box);
+        for (int row = overlap.min().y(); row < overlap.max().y(); row++) {
+          for (int col = overlap.min().x(); col < overlap.max().x(); col++)
+            window(col - box.min().x(), row - box.min().y())
+              = tile(col - tile_box.min().x(), row - tile_box.min().y());
+        }
+      }
+    }
+  }
+
+  void FootprintDem::refine(Vector3 const& ctr, Vector3 const& dir,
+                            Vector3 & xyz) const {
+
+    // The full-resolution pixel at the low-resolution intersection
+    Vector3 llh = m_georef.datum().cartesian_to_geodetic(xyz);
+    Vector2 pix = m_georef.lonlat_to_pixel(subvector(llh, 0, 2));
+
+    // Search a few low-resolution pixels around it
+    int half = std::max(32, 4 * m_scale);
+    BBox2i box(Vector2i(floor(pix[0]) - half, floor(pix[1]) - half),
+               Vector2i(floor(pix[0]) + half + 1, floor(pix[1]) + half + 1));
+    box.crop(bounding_box(m_dem));
+    if (box.width() < 2 || box.height() < 2)
+      return;
+
+    ImageView<PixelMask<float>> window;
+    read_window(box, window);
+    vw::cartography::GeoReference window_georef
+      = vw::cartography::crop(m_georef, box.min().x(), box.min().y());
+
+    bool treat_nodata_as_zero = false;
+    bool has_intersection = false;
+    double height_error_tol = 0.001; // 1 mm should be enough
+    double max_abs_tol      = 1e-14;
+    double max_rel_tol      = 1e-14;
+    int num_max_iter        = 25;
+    Vector3 refined;
+    try {
+      refined = vw::cartography::camera_pixel_to_dem_xyz
+        (ctr, dir, window, window_georef, treat_nodata_as_zero, has_intersection,
+         height_error_tol, max_abs_tol, max_rel_tol, num_max_iter, xyz);
+    } catch (...) {
+      return;
+    }
+    if (!has_intersection || refined == Vector3())
+      return;
+
+    // The intersection must be inside the window, not at its edge
+    llh = m_georef.datum().cartesian_to_geodetic(refined);
+    pix = window_georef.lonlat_to_pixel(subvector(llh, 0, 2));
+    if (pix[0] < 1 || pix[0] > window.cols() - 2 ||
+        pix[1] < 1 || pix[1] > window.rows() - 2)
+      return;
+
+    xyz = refined;
+  }
+
+  namespace {
+
+    // A pixel on the image and where its ray meets the DEM
+    struct FootprintSample {
+      Vector2 pix;
+      bool    hit;
+      bool    edge; // on the image boundary, or at the DEM edge
+      Vector3 xyz;
+      FootprintSample(): hit(false), edge(false) {}
+    };
+
+    void intersect_sample(FootprintDem const& dem, camera::CameraModel const& cam,
+                          FootprintSample & s) {
+      Vector3 ctr, dir;
+      try {
+        ctr = cam.camera_center(s.pix);
+        dir = cam.pixel_to_vector(s.pix);
+      } catch (...) {
+        s.hit = false;
+        return;
+      }
+      s.hit = dem.intersect_lowres(ctr, dir, s.xyz);
+    }
+
+    // Sample the segment from beg to end, not including end. Where one
+    // sample meets the DEM and the next does not, bisect to within a
+    // pixel to find where the DEM edge is.
+    void trace_segment(FootprintDem const& dem, camera::CameraModel const& cam,
+                       Vector2 const& beg, Vector2 const& end, int num_samples,
+                       bool on_boundary, std::vector<FootprintSample> & samples) {
+
+      FootprintSample prev;
+      for (int it = 0; it < num_samples; it++) {
+        FootprintSample curr;
+        curr.pix = beg + (end - beg) * double(it) / double(num_samples);
+        curr.edge = on_boundary;
+        intersect_sample(dem, cam, curr);
+
+        if (it > 0 && prev.hit != curr.hit) {
+          FootprintSample a = prev, b = curr;
+          while (norm_2(b.pix - a.pix) > 1.0) {
+            FootprintSample mid;
+            mid.pix = (a.pix + b.pix) / 2.0;
+            intersect_sample(dem, cam, mid);
+            if (mid.hit == a.hit)
+              a = mid;
+            else
+              b = mid;
+          }
+          FootprintSample transition = a.hit ? a : b;
+          transition.edge = true;
+          samples.push_back(transition);
+        }
+
+        samples.push_back(curr);
+        prev = curr;
+      }
+    }
+
+  } // end anonymous namespace
+
+  vw::BBox2 camera_footprint(FootprintDem const& dem,
+                             camera::CameraModel const& cam,
+                             Vector2i const& image_size,
+                             double & mean_gsd,
+                             std::vector<Vector3> * boundary,
+                             int num_samples,
+                             std::vector<Vector3> * edge_points) {
+
+    mean_gsd = 0.0;
+    if (boundary != NULL)
+      boundary->clear();
+    if (edge_points != NULL)
+      edge_points->clear();
+
+    if (image_size[0] <= 0 || image_size[1] <= 0)
+      vw_throw(ArgumentErr() << "Expecting an image with positive dimensions.\n");
+    if (num_samples <= 0)
+      vw_throw(ArgumentErr() << "The number of samples must be positive.\n");
+
+    // Trace the image boundary, clockwise from the upper-left corner
+    double wid = image_size[0] - 1, hgt = image_size[1] - 1;
+    Vector2 corners[4] = {Vector2(0, 0), Vector2(wid, 0), Vector2(wid, hgt), Vector2(0, hgt)};
+    std::vector<FootprintSample> samples;
+    for (int side = 0; side < 4; side++)
+      trace_segment(dem, cam, corners[side], corners[(side + 1) % 4], num_samples,
+                    true, samples);
+    int num_boundary = samples.size();
+
+    // If some boundary rays miss, the DEM ends inside the image, or the
+    // image sees past the horizon. Trace rows and columns to find where.
+    bool all_hit = true;
+    for (int it = 0; it < num_boundary; it++)
+      all_hit = all_hit && samples[it].hit;
+    if (!all_hit) {
+      for (int it = 1; it < num_samples; it++) {
+        double y = hgt * double(it) / num_samples;
+        trace_segment(dem, cam, Vector2(0, y), Vector2(wid, y), num_samples, false, samples);
+        double x = wid * double(it) / num_samples;
+        trace_segment(dem, cam, Vector2(x, 0), Vector2(x, hgt), num_samples, false, samples);
+      }
+    }
+
+    // Refine the points on the footprint edge, and grow the box
+    vw::cartography::GeoReference const& georef = dem.georef();
+    BBox2 box;
+    int num_hits = 0;
+    std::vector<Vector2> proj(samples.size());
+    for (size_t it = 0; it < samples.size(); it++) {
+      FootprintSample & s = samples[it];
+      if (!s.hit)
+        continue;
+      if (s.edge)
+        dem.refine(cam.camera_center(s.pix), cam.pixel_to_vector(s.pix), s.xyz);
+      Vector3 llh = georef.datum().cartesian_to_geodetic(s.xyz);
+      proj[it] = georef.lonlat_to_point(subvector(llh, 0, 2));
+      box.grow(proj[it]);
+      num_hits++;
+      if (boundary != NULL && (int)it < num_boundary)
+        boundary->push_back(s.xyz);
+      if (edge_points != NULL && s.edge)
+        edge_points->push_back(s.xyz);
+    }
+
+    if (num_hits == 0)
+      vw_throw(ArgumentErr() << "The camera footprint does not intersect the DEM.\n");
+
+    // The ground sample distance between neighboring boundary samples
+    int count = 0;
+    for (int it = 1; it < num_boundary; it++) {
+      FootprintSample const& a = samples[it - 1];
+      FootprintSample const& b = samples[it];
+      double pix_dist = norm_2(b.pix - a.pix);
+      if (!a.hit || !b.hit || pix_dist <= 0)
+        continue;
+      mean_gsd += norm_2(proj[it] - proj[it - 1]) / pix_dist;
+      count++;
+    }
+    if (count > 0)
+      mean_gsd /= count;
+
+    return box;
+  }
+
+  // Find the footprint of one camera, with its own copy of the DEM
+  // georeference. Record the error, if any.
+  class CameraFootprintTask: public vw::Task, private boost::noncopyable {
+    FootprintDem m_dem;
+    boost::shared_ptr<camera::CameraModel> m_cam;
+    Vector2i m_image_size;
+    BBox2 & m_box;
+    std::string & m_error;
+  public:
+    CameraFootprintTask(FootprintDem const& dem,
+                        boost::shared_ptr<camera::CameraModel> cam,
+                        Vector2i const& image_size, BBox2 & box, std::string & error):
+      m_dem(dem), m_cam(cam), m_image_size(image_size), m_box(box), m_error(error) {}
+    void operator()() {
+      try {
+        double mean_gsd = 0.0;
+        m_box = camera_footprint(m_dem, *m_cam, m_image_size, mean_gsd);
+      } catch (std::exception const& e) {
+        m_error = e.what();
+      }
+    }
+  };
+
+  void camera_footprints(FootprintDem const& dem,
+                         std::vector<boost::shared_ptr<camera::CameraModel>> const& cams,
+                         std::vector<Vector2i> const& image_sizes,
+                         int num_threads,
+                         std::vector<BBox2> & boxes) {
+
+    if (cams.size() != image_sizes.size())
+      vw_throw(ArgumentErr() << "Expecting as many image sizes as cameras.\n");
+
+    // Each task writes to its own slot, so no lock is needed
+    boxes.clear();
+    boxes.resize(cams.size());
+    std::vector<std::string> errors(cams.size());
+    {
+      vw::FifoWorkQueue queue(std::max(num_threads, 1));
+      for (size_t it = 0; it < cams.size(); it++)
+        queue.add_task(boost::shared_ptr<CameraFootprintTask>
+                       (new CameraFootprintTask(dem, cams[it], image_sizes[it],
+                                                boxes[it], errors[it])));
+      queue.join_all();
+    }
+
+    for (size_t it = 0; it < errors.size(); it++) {
+      if (errors[it] != "")
+        vw_throw(ArgumentErr() << "Camera " << it << ": " << errors[it]);
+    }
+  }
+
+} // end namespace asp
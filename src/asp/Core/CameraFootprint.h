@@ -0,0 +1,113 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraFootprint.h
+///
+/// The footprint of a camera on a DEM. Only rays through the image
+/// boundary are intersected with the DEM. Where some of these rays
+/// miss, the transition is found by bisection, and image rows and
+/// columns are traced to find the DEM edge inside the image. The rays
+/// are intersected with a low-resolution version of the DEM kept in
+/// memory, and only the points on the footprint edge are refined at
+/// full resolution, with cached DEM tiles.
+
+#ifndef __ASP_CORE_CAMERA_FOOTPRINT_H__
+#define __ASP_CORE_CAMERA_FOOTPRINT_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <asp/Core/DemRayIntersect.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/smart_ptr/shared_ptr.hpp>
+
+namespace asp {
+
+  struct FootprintTileCache;
+
+  /// A DEM prepared for finding the footprints of many cameras. Copies
+  /// share the DEM data and the tile cache, and have their own
+  /// georeferences, which are not thread-safe, so each thread must use
+  /// its own copy.
+  class FootprintDem {
+  public:
+
+    /// Load a version of the DEM with at most this many pixels on a side
+    FootprintDem(std::string const& dem_file, int lowres_size = 1024);
+
+    vw::cartography::GeoReference const& georef() const { return m_georef; }
+
+    /// Intersect a ray with the low-resolution DEM. Return false if
+    /// there is no intersection.
+    bool intersect_lowres(vw::Vector3 const& ctr, vw::Vector3 const& dir,
+                          vw::Vector3 & xyz) const;
+
+    /// Refine the intersection of a ray with the low-resolution DEM
+    /// using the full-resolution DEM around it. If this fails, the
+    /// input is kept.
+    void refine(vw::Vector3 const& ctr, vw::Vector3 const& dir,
+                vw::Vector3 & xyz) const;
+
+  private:
+    // Read a box of the full-resolution DEM, using the tile cache
+    void read_window(vw::BBox2i const& box,
+                     vw::ImageView<vw::PixelMask<float>> & window) const;
+
+    vw::cartography::GeoReference m_georef;
+    vw::DiskImageView<float> m_dem;
+    float m_nodata;
+    int m_scale; // full-resolution pixels per low-resolution pixel
+    DemRayIntersector m_lowres;
+    boost::shared_ptr<FootprintTileCache> m_cache;
+  };
+
+  /// Find the footprint bounding box of a camera in the DEM projection,
+  /// and the mean ground sample distance in its units. Optionally
+  /// return the points on the footprint boundary, in ECEF. The image
+  /// boundary is sampled at num_samples pixels per side. Throw an
+  /// exception if no ray meets the DEM. Also optionally return all
+  /// points found on the footprint edge, including where the DEM ends
+  /// inside the image, so the footprint is within their convex hull,
+  /// up to the sampling.
+  vw::BBox2 camera_footprint(FootprintDem const& dem,
+                             vw::camera::CameraModel const& cam,
+                             vw::Vector2i const& image_size,
+                             double & mean_gsd,
+                             std::vector<vw::Vector3> * boundary = NULL,
+                             int num_samples = 100,
+                             std::vector<vw::Vector3> * edge_points = NULL);
+
+  /// Find the footprints of several cameras in parallel, given the
+  /// size of each camera's image. Each camera is used by one thread
+  /// only. If any footprint fails, throw an exception naming the first
+  /// failing camera in the list.
+  void camera_footprints(FootprintDem const& dem,
+                         std::vector<boost::shared_ptr<vw::camera::CameraModel>> const& cams,
+                         std::vector<vw::Vector2i> const& image_sizes,
+                         int num_threads,
+                         std::vector<vw::BBox2> & boxes);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CAMERA_FOOTPRINT_H__
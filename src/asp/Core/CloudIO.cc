@@ -0,0 +1,392 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CloudIO.cc
+///
+
+#include <asp/Core/CloudIO.h>
+#include <asp/Core/FileUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <cpl_conv.h>
+#include <cpl_vsi.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // The prefix of the paths read through the chunk cache
+  const char * CLOUD_CACHE_PREFIX = "/vsiaspcache/";
+
+  // How many chunks after the last one needed to also fetch
+  const int CLOUD_READ_AHEAD = 4;
+
+  // The GDAL prefixes of remote files
+  const char * REMOTE_PREFIXES[] = {"/vsis3/", "/vsigs/", "/vsiaz/", "/vsicurl/"};
+
+  std::string g_cloud_cache_dir;
+  vw::Mutex   g_cloud_io_mutex;
+  bool        g_cloud_io_configured = false;
+
+  bool is_remote_gdal_path(std::string const& path) {
+    for (size_t it = 0; it < sizeof(REMOTE_PREFIXES)/sizeof(REMOTE_PREFIXES[0]); it++) {
+      if (boost::starts_with(path, REMOTE_PREFIXES[it]))
+        return true;
+    }
+    return false;
+  }
+
+  bool is_cloud_path(std::string const& path) {
+    return boost::starts_with(path, "s3://") || boost::starts_with(path, "gs://") ||
+      boost::starts_with(path, CLOUD_CACHE_PREFIX) || is_remote_gdal_path(path);
+  }
+
+  std::string cloud_to_gdal_path(std::string const& path) {
+    std::string out = path;
+    if (boost::starts_with(out, "s3://"))
+      out = "/vsis3/" + out.substr(5);
+    else if (boost::starts_with(out, "gs://"))
+      out = "/vsigs/" + out.substr(5);
+
+    const char * cache_dir = getenv("ASP_CLOUD_CACHE_DIR");
+    if (cache_dir != NULL && std::string(cache_dir) != "" && is_remote_gdal_path(out))
+      out = std::string(CLOUD_CACHE_PREFIX) + out;
+
+    return out;
+  }
+
+  // A remote file read through the chunk cache
+  struct CloudCachedFile {
+    VSILFILE *   remote;
+    std::string  key;   // the remote path, size, and time
+    vsi_l_offset size;
+    vsi_l_offset pos;
+    bool         eof;
+  };
+
+  std::string remote_path(const char * filename) {
+    std::string path(filename);
+    if (boost::starts_with(path, CLOUD_CACHE_PREFIX))
+      path = path.substr(strlen(CLOUD_CACHE_PREFIX));
+    return path;
+  }
+
+  // The cached chunks start with a line with the key and the chunk
+  // index, as different keys may have the same file name
+  std::string chunk_key(CloudCachedFile const& f, vsi_l_offset chunk) {
+    std::ostringstream os;
+    os << f.key << " chunk: " << chunk;
+    return os.str();
+  }
+
+  std::string chunk_file(CloudCachedFile const& f, vsi_l_offset chunk) {
+    return asp::cache_file_name(g_cloud_cache_dir, "cloud", chunk_key(f, chunk), ".bin");
+  }
+
+  size_t chunk_len(CloudCachedFile const& f, vsi_l_offset chunk) {
+    vsi_l_offset beg = chunk * CLOUD_CHUNK_SIZE;
+    return size_t(std::min(f.size - beg, vsi_l_offset(CLOUD_CHUNK_SIZE)));
+  }
+
+  bool read_cached_chunk(CloudCachedFile const& f, vsi_l_offset chunk,
+                         std::vector<char> & data) {
+    std::ifstream ifs(chunk_file(f, chunk).c_str(), std::ios::binary);
+    std::string line;
+    if (!ifs.good() || !std::getline(ifs, line) || line != chunk_key(f, chunk))
+      return false;
+    data.resize(chunk_len(f, chunk));
+    ifs.read(&data[0], data.size());
+    return ifs.gcount() == std::streamsize(data.size());
+  }
+
+  void write_cached_chunk(CloudCachedFile const& f, vsi_l_offset chunk,
+                          std::vector<char> const& data) {
+    // Write to a temporary file first, as other processes may read it
+    std::string out_file = chunk_file(f, chunk);
+    std::string tmp_file = out_file + "." + fs::unique_path("%%%%-%%%%-%%%%").string()
+      + ".tmp";
+    try {
+      {
+        std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+        ofs << chunk_key(f, chunk) << "\n";
+        ofs.write(&data[0], data.size());
+        if (!ofs.good())
+          vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+      }
+      fs::rename(tmp_file, out_file);
+    } catch (...) {
+      // The cache is only an optimization
+      boost::system::error_code ec;
+      fs::remove(tmp_file, ec);
+    }
+  }
+
+  // Get the given chunks. Those not in the cache, and a few after the
+  // last one, are fetched in one multi-range request, which GDAL does
+  // with parallel range requests.
+  bool get_chunks(CloudCachedFile & f, std::set<vsi_l_offset> const& chunks,
+                  std::map<vsi_l_offset, std::vector<char>> & data) {
+
+    if (chunks.empty())
+      return true;
+
+    vsi_l_offset num_chunks = (f.size + CLOUD_CHUNK_SIZE - 1) / CLOUD_CHUNK_SIZE;
+    std::set<vsi_l_offset> wanted = chunks;
+    for (int it = 1; it <= CLOUD_READ_AHEAD; it++) {
+      vsi_l_offset next = *chunks.rbegin() + it;
+      if (next < num_chunks)
+        wanted.insert(next);
+    }
+
+    std::vector<vsi_l_offset> missing;
+    for (auto it = wanted.begin(); it != wanted.end(); it++) {
+      std::vector<char> chunk_data;
+      bool needed = (chunks.find(*it) != chunks.end());
+      if (needed && read_cached_chunk(f, *it, chunk_data))
+        data[*it].swap(chunk_data);
+      else if (!needed && fs::exists(chunk_file(f, *it)))
+        continue; // read ahead before
+      else
+        missing.push_back(*it);
+    }
+
+    if (missing.empty())
+      return true;
+
+    std::vector<std::vector<char>> buffers(missing.size());
+    std::vector<void*>        ptrs(missing.size());
+    std::vector<vsi_l_offset> offsets(missing.size());
+    std::vector<size_t>       sizes(missing.size());
+    for (size_t it = 0; it < missing.size(); it++) {
+      buffers[it].resize(chunk_len(f, missing[it]));
+      ptrs[it]    = &buffers[it][0];
+      offsets[it] = missing[it] * CLOUD_CHUNK_SIZE;
+      sizes[it]   = buffers[it].size();
+    }
+    if (VSIFReadMultiRangeL(int(missing.size()), &ptrs[0], &offsets[0], &sizes[0],
+                            f.remote) != 0)
+      return false;
+
+    for (size_t it = 0; it < missing.size(); it++) {
+      write_cached_chunk(f, missing[it], buffers[it]);
+      if (chunks.find(missing[it]) != chunks.end())
+        data[missing[it]].swap(buffers[it]);
+    }
+
+    return true;
+  }
+
+  // Copy the bytes of a range from the chunks containing it
+  bool read_range(CloudCachedFile & f, vsi_l_offset offset, size_t len, char * out) {
+    if (len == 0)
+      return true;
+    std::set<vsi_l_offset> chunks;
+    for (vsi_l_offset c = offset / CLOUD_CHUNK_SIZE;
+         c <= (offset + len - 1) / CLOUD_CHUNK_SIZE; c++)
+      chunks.insert(c);
+
+    std::map<vsi_l_offset, std::vector<char>> data;
+    if (!get_chunks(f, chunks, data))
+      return false;
+
+    vsi_l_offset pos = offset, end = offset + len;
+    while (pos < end) {
+      vsi_l_offset c = pos / CLOUD_CHUNK_SIZE;
+      vsi_l_offset chunk_end = std::min(end, (c + 1) * CLOUD_CHUNK_SIZE);
+      memcpy(out + (pos - offset), &data[c][pos - c * CLOUD_CHUNK_SIZE],
+             size_t(chunk_end - pos));
+      pos = chunk_end;
+    }
+    return true;
+  }
+
+  // The callbacks of the /vsiaspcache/ handler
+
+  int cloud_cache_stat(void * /*user_data*/, const char * filename,
+                       VSIStatBufL * stat_buf, int flags) {
+    return VSIStatExL(remote_path(filename).c_str(), stat_buf, flags);
+  }
+
+  void * cloud_cache_open(void * /*user_data*/, const char * filename, const char * access) {
+    if (std::string(access).find_first_of("wa+") != std::string::npos)
+      return NULL; // read only
+
+    std::string path = remote_path(filename);
+    VSIStatBufL stat_buf;
+    if (VSIStatL(path.c_str(), &stat_buf) != 0)
+      return NULL;
+    VSILFILE * remote = VSIFOpenL(path.c_str(), "rb");
+    if (remote == NULL)
+      return NULL;
+
+    CloudCachedFile * f = new CloudCachedFile;
+    std::ostringstream os;
+    os << "file: " << path << " size: " << stat_buf.st_size
+       << " time: " << stat_buf.st_mtime;
+    f->remote = remote;
+    f->key    = os.str();
+    f->size   = stat_buf.st_size;
+    f->pos    = 0;
+    f->eof    = false;
+    return f;
+  }
+
+  vsi_l_offset cloud_cache_tell(void * file) {
+    return ((CloudCachedFile*)file)->pos;
+  }
+
+  int cloud_cache_seek(void * file, vsi_l_offset offset, int whence) {
+    CloudCachedFile * f = (CloudCachedFile*)file;
+    if (whence == SEEK_SET)
+      f->pos = offset;
+    else if (whence == SEEK_CUR)
+      f->pos += offset;
+    else if (whence == SEEK_END)
+      f->pos = f->size + offset;
+    else
+      return -1;
+    f->eof = false;
+    return 0;
+  }
+
+  size_t cloud_cache_read(void * file, void * buffer, size_t size, size_t count) {
+    CloudCachedFile * f = (CloudCachedFile*)file;
+    if (size == 0 || count == 0)
+      return 0;
+    vsi_l_offset avail = (f->pos < f->size) ? f->size - f->pos : 0;
+    size_t len = size_t(std::min(vsi_l_offset(size * count), avail));
+    len -= len % size; // whole elements only
+    if (len < size * count)
+      f->eof = true;
+    if (!read_range(*f, f->pos, len, (char*)buffer))
+      return 0;
+    f->pos += len;
+    return len / size;
+  }
+
+  int cloud_cache_read_multi_range(void * file, int num_ranges, void ** data,
+                                   const vsi_l_offset * offsets, const size_t * sizes) {
+    CloudCachedFile * f = (CloudCachedFile*)file;
+
+    // Fetch all chunks needed for all the ranges at once
+    std::set<vsi_l_offset> chunks;
+    for (int r = 0; r < num_ranges; r++) {
+      if (sizes[r] == 0)
+        continue;
+      if (offsets[r] + sizes[r] > f->size)
+        return -1;
+      for (vsi_l_offset c = offsets[r] / CLOUD_CHUNK_SIZE;
+           c <= (offsets[r] + sizes[r] - 1) / CLOUD_CHUNK_SIZE; c++)
+        chunks.insert(c);
+    }
+    std::map<vsi_l_offset, std::vector<char>> chunk_data;
+    if (!get_chunks(*f, chunks, chunk_data))
+      return -1;
+
+    for (int r = 0; r < num_ranges; r++) {
+      vsi_l_offset pos = offsets[r], end = offsets[r] + sizes[r];
+      char * out = (char*)data[r];
+      while (pos < end) {
+        vsi_l_offset c = pos / CLOUD_CHUNK_SIZE;
+        vsi_l_offset chunk_end = std::min(end, (c + 1) * CLOUD_CHUNK_SIZE);
+        memcpy(out + (pos - offsets[r]), &chunk_data[c][pos - c * CLOUD_CHUNK_SIZE],
+               size_t(chunk_end - pos));
+        pos = chunk_end;
+      }
+    }
+    return 0;
+  }
+
+  int cloud_cache_eof(void * file) {
+    return ((CloudCachedFile*)file)->eof ? 1 : 0;
+  }
+
+  int cloud_cache_close(void * file) {
+    CloudCachedFile * f = (CloudCachedFile*)file;
+    int ans = VSIFCloseL(f->remote);
+    delete f;
+    return ans;
+  }
+
+  // Set a GDAL option unless the user set it already
+  void set_gdal_option_maybe(const char * key, const char * val) {
+    if (CPLGetConfigOption(key, NULL) == NULL)
+      CPLSetConfigOption(key, val);
+  }
+
+  void configure_cloud_io() {
+
+    vw::Mutex::Lock lock(g_cloud_io_mutex);
+    if (g_cloud_io_configured)
+      return;
+    g_cloud_io_configured = true;
+
+    // Do not list the bucket to look for side-car files, merge the
+    // ranges of adjacent blocks, fetch the ranges of several blocks
+    // in parallel, and retry on transient errors.
+    set_gdal_option_maybe("GDAL_DISABLE_READDIR_ON_OPEN",       "EMPTY_DIR");
+    set_gdal_option_maybe("GDAL_HTTP_MERGE_CONSECUTIVE_RANGES", "YES");
+    set_gdal_option_maybe("GDAL_HTTP_MULTIRANGE",               "YES");
+    set_gdal_option_maybe("GDAL_HTTP_MAX_RETRY",                "5");
+    set_gdal_option_maybe("GDAL_HTTP_RETRY_DELAY",              "1");
+    set_gdal_option_maybe("CPL_VSIL_CURL_CHUNK_SIZE",           "262144");
+
+    const char * cache_dir = getenv("ASP_CLOUD_CACHE_DIR");
+    if (cache_dir == NULL || std::string(cache_dir) == "")
+      return;
+
+    g_cloud_cache_dir = cache_dir;
+    boost::system::error_code ec;
+    fs::create_directories(g_cloud_cache_dir, ec);
+    if (!fs::is_directory(g_cloud_cache_dir))
+      vw::vw_throw(vw::ArgumentErr() << "Cannot create the directory ASP_CLOUD_CACHE_DIR: "
+                   << g_cloud_cache_dir << "\n");
+
+    VSIFilesystemPluginCallbacksStruct * cb = VSIAllocFilesystemPluginCallbacksStruct();
+    cb->stat             = cloud_cache_stat;
+    cb->open             = cloud_cache_open;
+    cb->tell             = cloud_cache_tell;
+    cb->seek             = cloud_cache_seek;
+    cb->read             = cloud_cache_read;
+    cb->read_multi_range = cloud_cache_read_multi_range;
+    cb->eof              = cloud_cache_eof;
+    cb->close            = cloud_cache_close;
+    cb->nCacheSize       = 16 * CLOUD_CHUNK_SIZE; // small reads are served from memory
+    if (VSIInstallPluginHandler(CLOUD_CACHE_PREFIX, cb) != 0)
+      vw::vw_out(vw::WarningMessage) << "Could not install the cloud cache file handler.\n";
+    VSIFreeFilesystemPluginCallbacksStruct(cb);
+
+    vw::vw_out() << "Caching the remote files in: " << g_cloud_cache_dir << "\n";
+  }
+
+} // end namespace asp
@@ -0,0 +1,55 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CloudIO.h
+///
+/// Read images from object storage with GDAL, fetching only the byte
+/// ranges that are needed. Paths like s3://bucket/key and gs://bucket/key
+/// are turned into the GDAL /vsis3/ and /vsigs/ paths. If the
+/// environment variable ASP_CLOUD_CACHE_DIR is set, remote files are
+/// read instead through the /vsiaspcache/ prefix, which fetches them in
+/// chunks of CLOUD_CHUNK_SIZE bytes, several at a time with parallel
+/// range requests, reads ahead a few chunks, and keeps the chunks in that
+/// directory, so later reads of the same file, by this or another
+/// process, are local.
+
+#ifndef __ASP_CORE_CLOUD_IO_H__
+#define __ASP_CORE_CLOUD_IO_H__
+
+#include <string>
+
+namespace asp {
+
+  const int CLOUD_CHUNK_SIZE = 1024 * 1024;
+
+  /// True for s3://, gs://, and GDAL network paths such as /vsis3/
+  bool is_cloud_path(std::string const& path);
+
+  /// The path with which GDAL reads the given file. Local paths are
+  /// returned unchanged. Applying this more than once has no effect.
+  std::string cloud_to_gdal_path(std::string const& path);
+
+  /// Set GDAL options suited for reading the image blocks of remote
+  /// files, unless set by the user, and install the /vsiaspcache/
+  /// handler if a cache directory is set. Does nothing after the first
+  /// call.
+  void configure_cloud_io();
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CLOUD_IO_H__
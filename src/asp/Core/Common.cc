@@ -16,14 +16,19 @@
 // __END_LICENSE__
 
 #include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
 #include <vw/Core/System.h>
 #include <vw/Math/BBox.h>
 #include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/GdalWriteOptions.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/CloudIO.h>
+#include <asp/Core/ProcessMetrics.h>
 
 #include <asp/asp_date_config.h>
 
+#include <list>
 #include <map>
 #include <sstream>
 #include <string>
@@ -31,6 +36,9 @@
 #include <unistd.h>
 
 #include <gdal_version.h>
+#include <gdal.h>
+#include <cpl_conv.h>
+#include <cpl_string.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -542,7 +550,29 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
   usage_comment = ostr.str();
 
   set_asp_env_vars();
-  
+
+  // Save the progress periodically if ASP_METRICS_DIR is set
+  asp::start_metrics_from_env(asp::extract_prog_name(argv[0]));
+
+  // Let images be read from object storage, as s3://bucket/key or
+  // gs://bucket/key, by passing them to GDAL as /vsis3/ or /vsigs/
+  // paths. The strings must live as long as argv.
+  static std::list<std::string> cloud_args;
+  bool have_cloud_args = false;
+  for (int it = 1; it < argc; it++) {
+    std::string arg = argv[it];
+    if (!asp::is_cloud_path(arg))
+      continue;
+    have_cloud_args = true;
+    std::string gdal_path = asp::cloud_to_gdal_path(arg);
+    if (gdal_path == arg)
+      continue;
+    cloud_args.push_back(gdal_path);
+    argv[it] = const_cast<char*>(cloud_args.back().c_str());
+  }
+  if (have_cloud_args)
+    asp::configure_cloud_io();
+
   // We distinguish between all_public_options, which is all the
   // options we must parse, even if we don't need some of them, and
   // public_options, which are the options specifically used by the
@@ -574,6 +604,23 @@ asp::check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
     opt.gdal_options["BIGTIFF"] = "IF_SAFER";
   }
 
+  // Read uncompressed TIFF files, such as intermediate disparities
+  // written with --uncompressed-intermediates, by mapping them into
+  // memory rather than copying each block, if there is enough RAM.
+  // Compressed files are not affected.
+  if (CPLGetConfigOption("GTIFF_VIRTUAL_MEM_IO", NULL) == NULL)
+    CPLSetConfigOption("GTIFF_VIRTUAL_MEM_IO", "IF_ENOUGH_RAM");
+
+  // Let GDAL compress the blocks of TIFF files in a pool of threads,
+  // rather than on the thread writing them. The blocks are still
+  // written in order.
+  if (opt.gdal_options.find("NUM_THREADS") == opt.gdal_options.end()) {
+    int num_threads = opt.num_threads;
+    if (num_threads <= 0)
+      num_threads = vw_settings().default_num_threads();
+    opt.gdal_options["NUM_THREADS"] = vw::num_to_str(num_threads);
+  }
+
   if ( vm.count("help") )
     vw::vw_throw(vw::ArgumentErr() << usage_comment << public_options);
 
@@ -741,6 +788,63 @@ std::string asp::read_target_name(std::string const& filename) {
   return target;
 }
 
+// GDAL's COG driver makes the overviews from the full image, and
+// places the overviews before the full-resolution tiles, as readers
+// over the network expect.
+void asp::write_cog(std::string const& filename, vw::GdalWriteOptions const& opt,
+                    std::string const& resampling) {
+
+  GDALAllRegister();
+  GDALDriverH driver = GDALGetDriverByName("COG");
+  if (driver == NULL)
+    vw::vw_throw(vw::NoImplErr() << "Cannot write cloud-optimized GeoTIFF files. "
+                 << "This needs GDAL 3.1 or later.\n");
+
+  GDALDatasetH src = GDALOpen(filename.c_str(), GA_ReadOnly);
+  if (src == NULL)
+    vw::vw_throw(vw::ArgumentErr() << "Cannot open: " << filename << "\n");
+
+  std::string compress = "LZW";
+  auto it = opt.gdal_options.find("COMPRESS");
+  if (it != opt.gdal_options.end())
+    compress = it->second;
+  std::string bigtiff = "IF_SAFER";
+  it = opt.gdal_options.find("BIGTIFF");
+  if (it != opt.gdal_options.end())
+    bigtiff = it->second;
+  // COG blocks are square, and are a power of two
+  int block_size = 512;
+  if (opt.raster_tile_size[0] == opt.raster_tile_size[1] &&
+      opt.raster_tile_size[0] >= 64 && opt.raster_tile_size[0] <= 4096 &&
+      (int(opt.raster_tile_size[0]) & (int(opt.raster_tile_size[0]) - 1)) == 0)
+    block_size = opt.raster_tile_size[0];
+  int num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+
+  char ** options = NULL;
+  options = CSLSetNameValue(options, "COMPRESS",   compress.c_str());
+  options = CSLSetNameValue(options, "BIGTIFF",    bigtiff.c_str());
+  options = CSLSetNameValue(options, "BLOCKSIZE",  vw::num_to_str(block_size).c_str());
+  options = CSLSetNameValue(options, "RESAMPLING", resampling.c_str());
+  options = CSLSetNameValue(options, "NUM_THREADS", vw::num_to_str(num_threads).c_str());
+
+  std::string tmp_file = fs::path(filename).replace_extension(".cog.tmp.tif").string();
+  vw_out() << "Writing cloud-optimized GeoTIFF: " << filename << "\n";
+  GDALDatasetH dst = GDALCreateCopy(driver, tmp_file.c_str(), src, FALSE, options,
+                                    GDALTermProgress, NULL);
+  CSLDestroy(options);
+  GDALClose(src);
+  if (dst == NULL) {
+    if (fs::exists(tmp_file))
+      fs::remove(tmp_file);
+    vw::vw_throw(vw::IOErr() << "Failed to write: " << tmp_file << "\n");
+  }
+  GDALClose(dst);
+
+  fs::rename(tmp_file, filename);
+}
+
 void asp::BitChecker::check_argument(vw::uint8 arg) {
   // Turn on the arg'th bit in m_checksum
   m_checksum.set(arg);
@@ -41,11 +41,16 @@
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/program_options.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
 
+#include <cmath>
+#include <limits>
 #include <map>
+#include <sstream>
 #include <string>
 
 namespace vw {
@@ -126,6 +131,13 @@ namespace asp {
   /// Read the target name (planet name) from the plain text portion of an ISIS cub file
   std::string read_target_name(std::string const& filename);
 
+  /// Rewrite a GeoTIFF written by VW as a cloud-optimized GeoTIFF, with
+  /// internal overviews made with the given GDAL resampling method,
+  /// such as "AVERAGE" or "NEAREST". The compression and block size
+  /// in the options are kept. Requires GDAL 3.1 or later.
+  void write_cog(std::string const& filename, vw::GdalWriteOptions const& opt,
+                 std::string const& resampling);
+
   boost::program_options::variables_map
   check_command_line(int argc, char *argv[], vw::GdalWriteOptions& opt,
                      boost::program_options::options_description const& public_options,
@@ -152,6 +164,10 @@ namespace asp {
   // Note: We use this constant in the python code as well
   const std::string ASP_POINT_OFFSET_TAG_STR = "POINT_OFFSET";
 
+  /// String to indicate that the points were saved as integers, which
+  /// must be multiplied by this value before adding the offset.
+  const std::string ASP_POINT_SCALE_TAG_STR = "POINT_SCALE";
+
   // Specialized functions for reading/writing images with a shift.
   // The shift is meant to bring the pixel values closer to origin,
   // with goal of saving the pixels as float instead of double.
@@ -198,6 +214,43 @@ namespace asp {
       ( image.impl(), RoundImagePixels<typename ImageT::pixel_type>(rounding_error) );
   }
 
+  /// Divide the pixels by the given quantum and round to int32. Zero
+  /// pixels stay zero. A nonzero pixel whose first 3 components
+  /// became zero is moved by one quantum, so that it stays valid, and
+  /// a pixel out of the int32 range becomes zero, so invalid.
+  template <class VecT>
+  struct QuantizeImagePixels:
+    public vw::ReturnFixedType<typename vw::CompoundChannelCast<VecT, vw::int32>::type> {
+    typedef typename vw::CompoundChannelCast<VecT, vw::int32>::type IntVecT;
+    double m_quantum;
+    QuantizeImagePixels(double quantum):m_quantum(quantum){
+      VW_ASSERT( m_quantum > 0.0,
+                 vw::ArgumentErr() << "The quantum must be positive.");
+    }
+    IntVecT operator() (VecT const& pt) const {
+      IntVecT out;
+      int len = std::min(3, (int)pt.size());
+      if (subvector(pt, 0, len) == subvector(vw::Vector3(), 0, len))
+        return out;
+      const double max_val = std::numeric_limits<vw::int32>::max();
+      for (size_t it = 0; it < pt.size(); it++) {
+        double val = round(pt[it]/m_quantum);
+        if (!(std::abs(val) <= max_val))
+          return IntVecT();
+        out[it] = vw::int32(val);
+      }
+      if (subvector(out, 0, len) == subvector(vw::Vector3i(), 0, len))
+        out[0] = (pt[0] >= 0 ? 1 : -1);
+      return out;
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, QuantizeImagePixels<typename ImageT::pixel_type> >
+  inline quantize_image_pixels( vw::ImageViewBase<ImageT> const& image,
+                                double quantum ) {
+    return vw::UnaryPerPixelView<ImageT, QuantizeImagePixels<typename ImageT::pixel_type> >
+      ( image.impl(), QuantizeImagePixels<typename ImageT::pixel_type>(quantum) );
+  }
 
   /// To help with compression, round to about 1mm, but
   /// use for rounding a number with few digits in binary.
@@ -212,6 +265,13 @@ namespace asp {
   /// inverse power of 2, 1/2^10 for Earth and proportionally less for smaller bodies.
   double get_rounding_error(vw::Vector3 const& shift, double rounding_error);
 
+  /// For images with floating-point channels which are compressed with
+  /// LZW, Deflate, or ZSTD, use the floating-point predictor, unless a
+  /// predictor was set already. That makes DEMs and disparities
+  /// compress better.
+  template <class PixelT>
+  vw::GdalWriteOptions float_predictor_options(vw::GdalWriteOptions const& opt);
+
   /// Block write image while subtracting a given value from all pixels
   /// and casting the result to float, while rounding to nearest mm.
   template <class ImageT>
@@ -246,6 +306,24 @@ namespace asp {
                                std::map<std::string, std::string>() );
 
 
+  /// Write an image while subtracting a given value from all pixels,
+  /// and saving the result as int32 multiples of the rounding error,
+  /// which compress better than floats. The shift and the rounding
+  /// error are saved as keywords. Use block writing if so desired.
+  template <class ImageT>
+  void write_quantized_gdal_image(const std::string &filename,
+                                  vw::Vector3 const& shift,
+                                  double rounding_error,
+                                  vw::ImageViewBase<ImageT> const& image,
+                                  bool has_georef,
+                                  vw::cartography::GeoReference const& georef,
+                                  bool use_block_write,
+                                  vw::GdalWriteOptions const& opt,
+                                  vw::ProgressCallback const& progress_callback
+                                  = vw::ProgressCallback::dummy_instance(),
+                                  std::map<std::string, std::string> const& keywords =
+                                  std::map<std::string, std::string>() );
+
   /// Often times, we'd like to save an image to disk by using big
   /// blocks, for performance reasons, then re-write it with desired blocks.
   template <class ImageT>
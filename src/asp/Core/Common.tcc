@@ -26,6 +26,23 @@ namespace asp {
   // with goal of saving the pixels as float instead of double.
 
 
+  template <class PixelT>
+  vw::GdalWriteOptions float_predictor_options(vw::GdalWriteOptions const& opt) {
+    vw::GdalWriteOptions out = opt;
+    typedef typename vw::CompoundChannelType<PixelT>::type ChannelT;
+    if (!boost::is_floating_point<ChannelT>::value ||
+        out.gdal_options.find("PREDICTOR") != out.gdal_options.end())
+      return out;
+
+    auto it = out.gdal_options.find("COMPRESS");
+    if (it == out.gdal_options.end())
+      return out;
+    std::string compress = boost::to_upper_copy(it->second);
+    if (compress == "LZW" || compress == "DEFLATE" || compress == "ZSTD")
+      out.gdal_options["PREDICTOR"] = "3";
+    return out;
+  }
+
   // Block write image while subtracting a given value from all pixels
   // and casting the result to float, while rounding to nearest mm.
   template <class ImageT>
@@ -47,16 +64,20 @@ namespace asp {
       std::map<std::string, std::string> local_keywords = keywords;
       local_keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
 
+      typedef typename ImageT::pixel_type PixelT;
+      typedef typename vw::CompoundChannelCast<PixelT, float>::type FloatPixelT;
       block_write_gdal_image(filename,
                              vw::channel_cast<float>
                              (round_image_pixels(subtract_shift(image.impl(), shift),
                                                  get_rounding_error(shift, rounding_error))),
                              has_georef, georef, has_nodata, nodata,
-                             opt, progress_callback, local_keywords);
+                             float_predictor_options<FloatPixelT>(opt),
+                             progress_callback, local_keywords);
 
     }else{
       block_write_gdal_image(filename, image, has_georef, georef,
-                             has_nodata, nodata, opt,
+                             has_nodata, nodata,
+                             float_predictor_options<typename ImageT::pixel_type>(opt),
                              progress_callback, keywords);
     }
 
@@ -81,18 +102,63 @@ namespace asp {
       // Add the point shift to keywords
       std::map<std::string, std::string> local_keywords = keywords;
       local_keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
+      typedef typename ImageT::pixel_type PixelT;
+      typedef typename vw::CompoundChannelCast<PixelT, float>::type FloatPixelT;
       write_gdal_image(filename,
                        vw::channel_cast<float>
                        (round_image_pixels(subtract_shift(image.impl(), shift),
                                            get_rounding_error(shift, rounding_error))),
                        has_georef, georef, has_nodata, nodata,
-                       opt, progress_callback, local_keywords);
+                       float_predictor_options<FloatPixelT>(opt),
+                       progress_callback, local_keywords);
     }else{
       write_gdal_image(filename, image, has_georef, georef,
-                       has_nodata, nodata, opt, progress_callback, keywords);
+                       has_nodata, nodata,
+                       float_predictor_options<typename ImageT::pixel_type>(opt),
+                       progress_callback, keywords);
     }
   }
 
+  template <class ImageT>
+  void write_quantized_gdal_image(const std::string &filename,
+                                  vw::Vector3 const& shift,
+                                  double rounding_error,
+                                  vw::ImageViewBase<ImageT> const& image,
+                                  bool has_georef,
+                                  vw::cartography::GeoReference const& georef,
+                                  bool use_block_write,
+                                  vw::GdalWriteOptions const& opt,
+                                  vw::ProgressCallback const& progress_callback,
+                                  std::map<std::string, std::string> const& keywords){
+
+    double quantum = get_rounding_error(shift, rounding_error);
+    std::ostringstream os;
+    os.precision(17);
+    os << quantum;
+    std::map<std::string, std::string> local_keywords = keywords;
+    local_keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
+    local_keywords[ASP_POINT_SCALE_TAG_STR]  = os.str();
+
+    // Integers compress best with horizontal differencing
+    vw::GdalWriteOptions local_opt = opt;
+    if (local_opt.gdal_options.find("COMPRESS")  != local_opt.gdal_options.end() &&
+        local_opt.gdal_options.find("PREDICTOR") == local_opt.gdal_options.end())
+      local_opt.gdal_options["PREDICTOR"] = "2";
+
+    bool has_nodata = false;
+    double nodata = 0.0;
+    if (use_block_write)
+      block_write_gdal_image(filename,
+                             quantize_image_pixels(subtract_shift(image.impl(), shift), quantum),
+                             has_georef, georef, has_nodata, nodata, local_opt,
+                             progress_callback, local_keywords);
+    else
+      write_gdal_image(filename,
+                       quantize_image_pixels(subtract_shift(image.impl(), shift), quantum),
+                       has_georef, georef, has_nodata, nodata, local_opt,
+                       progress_callback, local_keywords);
+  }
+
   // Often times, we'd like to save an image to disk by using big
   // blocks, for performance reasons, then re-write it with desired blocks.
   template <class ImageT>
@@ -105,9 +171,11 @@ namespace asp {
                                  vw::GdalWriteOptions & opt,
                                  vw::ProgressCallback const& tpc){
 
+    typedef typename ImageT::pixel_type PixelT;
     vw::Vector2 orig_block_size = opt.raster_tile_size;
     opt.raster_tile_size = vw::Vector2(big_block_size, big_block_size);
-    block_write_gdal_image(filename, img, has_georef, georef, has_nodata, nodata, opt, tpc);
+    block_write_gdal_image(filename, img, has_georef, georef, has_nodata, nodata,
+                           float_predictor_options<PixelT>(opt), tpc);
 
     if (opt.raster_tile_size != orig_block_size){
       std::string tmp_file
@@ -118,7 +186,8 @@ namespace asp {
       vw::vw_out() << "Re-writing with blocks of size: "
                    << opt.raster_tile_size[0] << " x " << opt.raster_tile_size[1] << ".\n";
       vw::cartography::block_write_gdal_image(filename, tmp_img, has_georef, georef,
-                                  has_nodata, nodata, opt, tpc);
+                                  has_nodata, nodata, float_predictor_options<PixelT>(opt),
+                                  tpc);
       boost::filesystem::remove(tmp_file);
     }
     return;
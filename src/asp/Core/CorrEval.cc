@@ -0,0 +1,342 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CorrEval.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/CorrEval.h>
+
+#include <cmath>
+#include <map>
+#include <vector>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+  // Read a box of an image. Pixels outside the image are invalid.
+  void read_masked_box(ImageViewRef<PixelMask<float>> const& img, BBox2i const& box,
+                       ImageView<PixelMask<float>> & out) {
+
+    out.set_size(box.width(), box.height());
+    for (int row = 0; row < out.rows(); row++) {
+      for (int col = 0; col < out.cols(); col++)
+        out(col, row).invalidate();
+    }
+
+    BBox2i in_box = box;
+    in_box.crop(bounding_box(img));
+    if (in_box.empty())
+      return;
+
+    ImageView<PixelMask<float>> in = crop(img, in_box);
+    for (int row = 0; row < in.rows(); row++) {
+      for (int col = 0; col < in.cols(); col++)
+        out(col + in_box.min().x() - box.min().x(), row + in_box.min().y() - box.min().y())
+          = in(col, row);
+    }
+  }
+
+  // Summed-area tables over a region, one per quantity. Entry (col, row)
+  // of a table is the sum over the pixels above and to the left of it.
+  class SumTables {
+    int m_cols, m_rows;
+    std::vector<std::vector<double>> m_tables;
+  public:
+    SumTables(int num, int cols, int rows):
+      m_cols(cols), m_rows(rows),
+      m_tables(num, std::vector<double>((cols + 1) * (rows + 1), 0.0)) {}
+
+    // Set the value at a pixel, before integrating
+    double & val(int table, int col, int row) {
+      return m_tables[table][(row + 1) * (m_cols + 1) + col + 1];
+    }
+
+    void integrate() {
+      int stride = m_cols + 1;
+      for (size_t t = 0; t < m_tables.size(); t++) {
+        std::vector<double> & s = m_tables[t];
+        for (int row = 1; row <= m_rows; row++) {
+          double row_sum = 0.0;
+          for (int col = 1; col <= m_cols; col++) {
+            row_sum += s[row * stride + col];
+            s[row * stride + col] = row_sum + s[(row - 1) * stride + col];
+          }
+        }
+      }
+    }
+
+    // The sum over a box, after integrating
+    double box_sum(int table, BBox2i const& box) const {
+      std::vector<double> const& s = m_tables[table];
+      int stride = m_cols + 1;
+      return s[box.max().y() * stride + box.max().x()] - s[box.min().y() * stride + box.max().x()]
+        -    s[box.max().y() * stride + box.min().x()] + s[box.min().y() * stride + box.min().x()];
+    }
+  };
+
+  } // end anonymous namespace
+
+  class CorrEvalView: public ImageViewBase<CorrEvalView> {
+    ImageViewRef<PixelMask<float>>   m_left, m_right;
+    ImageViewRef<PixelMask<Vector2f>> m_disp;
+    Vector2i    m_kernel_size;
+    bool        m_use_ncc;
+    int         m_sample_rate;
+    bool        m_round_to_int;
+
+  public:
+    CorrEvalView(ImageViewRef<PixelMask<float>> const& left,
+                 ImageViewRef<PixelMask<float>> const& right,
+                 ImageViewRef<PixelMask<Vector2f>> const& disp,
+                 Vector2i const& kernel_size, bool use_ncc,
+                 int sample_rate, bool round_to_int):
+      m_left(left), m_right(right), m_disp(disp), m_kernel_size(kernel_size),
+      m_use_ncc(use_ncc), m_sample_rate(sample_rate), m_round_to_int(round_to_int) {}
+
+    typedef PixelMask<float> pixel_type;
+    typedef pixel_type result_type;
+    typedef ProceduralPixelAccessor<CorrEvalView> pixel_accessor;
+
+    inline int32 cols  () const { return m_left.cols(); }
+    inline int32 rows  () const { return m_left.rows(); }
+    inline int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline pixel_type operator()(double /*i*/, double /*j*/, int32 /*p*/ = 0) const {
+      vw_throw(NoImplErr() << "CorrEvalView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef CropView<ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  CorrEvalView::prerasterize_type CorrEvalView::prerasterize(BBox2i const& bbox) const {
+
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++)
+        tile(col, row).invalidate();
+    }
+    prerasterize_type out(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+
+    Vector2i half = m_kernel_size / 2;
+    ImageView<PixelMask<Vector2f>> disp_tile = crop(m_disp, bbox);
+
+    // Group the pixels to evaluate by the integer part of the disparity,
+    // and find the region of the right image each group needs.
+    std::map<std::pair<int, int>, std::vector<Vector2i>> groups;
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        if ((col + bbox.min().x()) % m_sample_rate != 0 ||
+            (row + bbox.min().y()) % m_sample_rate != 0)
+          continue;
+        PixelMask<Vector2f> const& d = disp_tile(col, row);
+        if (!is_valid(d))
+          continue;
+        Vector2i D;
+        if (m_round_to_int)
+          D = Vector2i(round(d.child()[0]), round(d.child()[1]));
+        else
+          D = Vector2i(floor(d.child()[0]), floor(d.child()[1]));
+        groups[std::make_pair(D[0], D[1])].push_back(Vector2i(col, row));
+      }
+    }
+    if (groups.empty())
+      return out;
+
+    // Read the left image with a collar once for the tile
+    BBox2i left_box = bbox;
+    left_box.expand(std::max(half[0], half[1]));
+    ImageView<PixelMask<float>> left_tile;
+    read_masked_box(m_left, left_box, left_tile);
+
+    // With interpolation, the right pixel, its right neighbor, the one
+    // below, and the one diagonally across are used.
+    int num_shifts = m_round_to_int ? 1 : 4;
+    Vector2i shifts[4] = {Vector2i(0, 0), Vector2i(1, 0), Vector2i(0, 1), Vector2i(1, 1)};
+
+    // The tables are: count, left sum, left squares, then for each
+    // shift the right sum and the left-right products, then the
+    // right-right products for each pair of shifts.
+    int num_pairs = num_shifts * (num_shifts + 1) / 2;
+    int N = 0, L = 1, LL = 2, R = 3, LR = 3 + num_shifts, RR = 3 + 2 * num_shifts;
+    int num_tables = RR + num_pairs;
+
+    // Read the right image for all groups at once, unless outliers in
+    // the disparity make that region much larger than the tile.
+    BBox2i right_union;
+    for (auto const& g: groups) {
+      Vector2i D(g.first.first, g.first.second);
+      BBox2i b = left_box + D;
+      b.max() += Vector2i(num_shifts > 1, num_shifts > 1);
+      right_union.grow(b);
+    }
+    bool read_once = (double(right_union.width()) * right_union.height()
+                      <= 4.0 * double(left_box.width()) * left_box.height());
+    ImageView<PixelMask<float>> right_all;
+    if (read_once)
+      read_masked_box(m_right, right_union, right_all);
+
+    for (auto const& g: groups) {
+      Vector2i D(g.first.first, g.first.second);
+      std::vector<Vector2i> const& pixels = g.second;
+
+      // The region covered by the patches of this group, in tile coordinates
+      BBox2i group_box;
+      for (size_t it = 0; it < pixels.size(); it++)
+        group_box.grow(pixels[it]);
+      group_box.max() += Vector2i(1, 1);
+      group_box.min() -= half;
+      group_box.max() += half;
+
+      // Its offset in the left tile and in the right image
+      Vector2i left_off = group_box.min() + bbox.min() - left_box.min();
+      BBox2i right_box = group_box + bbox.min() + D;
+      right_box.max() += Vector2i(num_shifts > 1, num_shifts > 1);
+      ImageView<PixelMask<float>> right_group;
+      Vector2i right_off;
+      if (read_once) {
+        right_off = right_box.min() - right_union.min();
+      } else {
+        read_masked_box(m_right, right_box, right_group);
+        right_off = Vector2i(0, 0);
+      }
+      ImageView<PixelMask<float>> const& right_img = read_once ? right_all : right_group;
+
+      SumTables sums(num_tables, group_box.width(), group_box.height());
+      double r[4];
+      for (int row = 0; row < group_box.height(); row++) {
+        for (int col = 0; col < group_box.width(); col++) {
+          PixelMask<float> const& lp = left_tile(col + left_off.x(), row + left_off.y());
+          if (!is_valid(lp))
+            continue;
+          bool valid = true;
+          for (int s = 0; s < num_shifts; s++) {
+            PixelMask<float> const& rp = right_img(col + right_off.x() + shifts[s].x(),
+                                                   row + right_off.y() + shifts[s].y());
+            valid = valid && is_valid(rp);
+            r[s] = rp.child();
+          }
+          if (!valid)
+            continue;
+
+          double l = lp.child();
+          sums.val(N,  col, row) = 1.0;
+          sums.val(L,  col, row) = l;
+          sums.val(LL, col, row) = l * l;
+          int pair = 0;
+          for (int s = 0; s < num_shifts; s++) {
+            sums.val(R  + s, col, row) = r[s];
+            sums.val(LR + s, col, row) = l * r[s];
+            for (int t = s; t < num_shifts; t++) {
+              sums.val(RR + pair, col, row) = r[s] * r[t];
+              pair++;
+            }
+          }
+        }
+      }
+      sums.integrate();
+
+      for (size_t it = 0; it < pixels.size(); it++) {
+        Vector2i const& pix = pixels[it];
+        BBox2i patch(pix - half - group_box.min(), pix + half + Vector2i(1, 1) - group_box.min());
+
+        double n = sums.box_sum(N, patch);
+        if (n <= 0)
+          continue;
+
+        // The bilinear interpolation weights
+        double w[4] = {1.0, 0.0, 0.0, 0.0};
+        if (!m_round_to_int) {
+          Vector2f d = disp_tile(pix.x(), pix.y()).child();
+          double fx = d[0] - D[0], fy = d[1] - D[1];
+          w[0] = (1 - fx) * (1 - fy);
+          w[1] = fx * (1 - fy);
+          w[2] = (1 - fx) * fy;
+          w[3] = fx * fy;
+        }
+
+        // The sums for the interpolated right patch are weighted sums
+        // of the box sums at the shifts.
+        double sl = sums.box_sum(L, patch), sll = sums.box_sum(LL, patch);
+        double sr = 0.0, slr = 0.0, srr = 0.0;
+        int pair = 0;
+        for (int s = 0; s < num_shifts; s++) {
+          sr  += w[s] * sums.box_sum(R  + s, patch);
+          slr += w[s] * sums.box_sum(LR + s, patch);
+          for (int t = s; t < num_shifts; t++) {
+            double prod = w[s] * w[t] * sums.box_sum(RR + pair, patch);
+            srr += (s == t) ? prod : 2.0 * prod;
+            pair++;
+          }
+        }
+
+        double val = 0.0;
+        if (m_use_ncc) {
+          double den = sll * srr;
+          if (!(den > 0))
+            continue;
+          val = slr / sqrt(den);
+        } else {
+          double lvar = std::max(sll / n - (sl / n) * (sl / n), 0.0);
+          double rvar = std::max(srr / n - (sr / n) * (sr / n), 0.0);
+          val = (sqrt(lvar) + sqrt(rvar)) / 2.0;
+        }
+        tile(pix.x(), pix.y()) = pixel_type(val);
+      }
+    }
+
+    return out;
+  }
+
+  ImageViewRef<PixelMask<float>>
+  corr_eval(ImageViewRef<PixelMask<float>> const& left,
+            ImageViewRef<PixelMask<float>> const& right,
+            ImageViewRef<PixelMask<Vector2f>> const& disp,
+            Vector2i const& kernel_size, std::string const& metric,
+            int sample_rate, bool round_to_int) {
+
+    if (kernel_size[0] <= 0 || kernel_size[1] <= 0 ||
+        kernel_size[0] % 2 == 0 || kernel_size[1] % 2 == 0)
+      vw_throw(ArgumentErr() << "The kernel size must be positive and odd.\n");
+    if (metric != "ncc" && metric != "stddev")
+      vw_throw(ArgumentErr() << "Unknown metric: " << metric << ".\n");
+    if (sample_rate < 1)
+      vw_throw(ArgumentErr() << "The sample rate must be positive.\n");
+    if (left.cols() != disp.cols() || left.rows() != disp.rows())
+      vw_throw(ArgumentErr() << "The left image and disparity must have the same size.\n");
+
+    return CorrEvalView(left, right, disp, kernel_size, metric == "ncc",
+                        sample_rate, round_to_int);
+  }
+
+} // end namespace asp
@@ -0,0 +1,60 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CorrEval.h
+///
+/// Evaluate the quality of a disparity with the NCC or the standard
+/// deviation of matching patches, using summed-area tables, so the cost
+/// per pixel does not depend on the patch size.
+///
+/// The right patch of a left pixel is shifted by the disparity at that
+/// pixel. The pixels in a tile are grouped by the integer part of their
+/// disparity. For each group, the products of the left image and the
+/// right image shifted by this integer part and its neighbors are
+/// integrated over the region the group's patches cover. The patch sums
+/// for bilinearly interpolated right patches are then weighted sums of
+/// these box sums. A pixel contributes to a patch only if it and the
+/// right pixels it is interpolated from are valid.
+
+#ifndef __ASP_CORE_CORR_EVAL_H__
+#define __ASP_CORE_CORR_EVAL_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+
+namespace asp {
+
+  /// The quality of the disparity at each left image pixel. The metric
+  /// is "ncc" or "stddev". NCC does not subtract the patch means. The
+  /// other metric is the mean of the standard deviations of the left
+  /// and right patches. Only one out of sample_rate rows and columns is
+  /// evaluated. With round_to_int, the disparity is rounded rather than
+  /// the right image interpolated.
+  vw::ImageViewRef<vw::PixelMask<float>>
+  corr_eval(vw::ImageViewRef<vw::PixelMask<float>> const& left,
+            vw::ImageViewRef<vw::PixelMask<float>> const& right,
+            vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& disp,
+            vw::Vector2i const& kernel_size, std::string const& metric,
+            int sample_rate, bool round_to_int);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CORR_EVAL_H__
@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/CostProfile.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <tuple>
+
+namespace asp {
+
+  CostProfile::CostProfile(): m_enabled(false) {}
+
+  CostProfile::Stats * CostProfile::stats(std::string const& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_stats.find(name);
+    if (it == m_stats.end()) {
+      m_names.push_back(name);
+      it = m_stats.emplace(std::piecewise_construct, std::forward_as_tuple(name),
+                           std::forward_as_tuple()).first;
+    }
+    return &it->second;
+  }
+
+  void CostProfile::add_solver_stat(std::string const& name, double value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_solver_stats.find(name);
+    if (it == m_solver_stats.end()) {
+      m_solver_names.push_back(name);
+      it = m_solver_stats.insert(std::make_pair(name, 0.0)).first;
+    }
+    it->second += value;
+  }
+
+  void CostProfile::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_names.clear();
+    m_solver_names.clear();
+    m_stats.clear();
+    m_solver_stats.clear();
+  }
+
+  std::string CostProfile::json() const {
+    std::ostringstream os;
+    os << std::setprecision(10);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    os << "{\n";
+    os << "  \"cost_functions\": [";
+    for (size_t it = 0; it < m_names.size(); it++) {
+      Stats const& s = m_stats.find(m_names[it])->second;
+      double seconds = s.nanoseconds / 1.0e+9;
+      std::int64_t num_calls = s.num_calls;
+      os << (it == 0 ? "\n" : ",\n")
+         << "    {\"name\": \"" << m_names[it] << "\""
+         << ", \"evaluations\": " << num_calls
+         << ", \"jacobian_evaluations\": " << s.num_jacobian_calls
+         << ", \"seconds\": " << seconds
+         << ", \"microseconds_per_evaluation\": "
+         << (num_calls > 0 ? 1.0e+6 * seconds / num_calls : 0.0) << "}";
+    }
+    os << "\n  ],\n";
+    os << "  \"solver\": {";
+    for (size_t it = 0; it < m_solver_names.size(); it++)
+      os << (it == 0 ? "\n" : ",\n") << "    \"" << m_solver_names[it] << "\": "
+         << m_solver_stats.find(m_solver_names[it])->second;
+    os << "\n  }\n";
+    os << "}\n";
+    return os.str();
+  }
+
+  std::string CostProfile::profile_file(std::string const& out_prefix) const {
+    return out_prefix + "-cost-profile.json";
+  }
+
+  void CostProfile::write(std::string const& out_prefix) const {
+    std::string file = profile_file(out_prefix);
+    vw::create_out_dir(file);
+    std::ofstream ofs(file.c_str());
+    if (!ofs.good())
+      vw::vw_throw(vw::IOErr() << "Cannot write: " << file << "\n");
+    ofs << json();
+    vw::vw_out() << "Writing: " << file << "\n";
+  }
+
+  CostProfile & cost_profile() {
+    static CostProfile profile;
+    return profile;
+  }
+
+} // end namespace asp
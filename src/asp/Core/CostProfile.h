@@ -0,0 +1,86 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CostProfile.h
+///
+/// Count how many times each type of cost function is evaluated by a
+/// solver, and how long that takes, and save that, together with the
+/// timings reported by the solver, as JSON next to the output prefix.
+/// This is opt-in, as timing each evaluation has a cost.
+
+#ifndef __ASP_CORE_COST_PROFILE_H__
+#define __ASP_CORE_COST_PROFILE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  class CostProfile {
+  public:
+
+    // The counters for one type of cost function. They are updated
+    // without a lock by the solver threads.
+    struct Stats {
+      std::atomic<std::int64_t> num_calls, num_jacobian_calls, nanoseconds;
+      Stats(): num_calls(0), num_jacobian_calls(0), nanoseconds(0) {}
+    };
+
+    CostProfile();
+
+    void set_enabled(bool enabled) { m_enabled = enabled; }
+    bool enabled() const { return m_enabled; }
+
+    // The counters for the cost function of given name, created the
+    // first time. The pointer stays valid for the life of this object.
+    Stats * stats(std::string const& name);
+
+    // Add to a solver statistic, such as the number of iterations or
+    // the time spent in the linear solver. Values add up over solves.
+    void add_solver_stat(std::string const& name, double value);
+
+    // Forget all counters and statistics
+    void reset();
+
+    // The profile as JSON
+    std::string json() const;
+
+    // The file this profile will be saved to: <out_prefix>-cost-profile.json
+    std::string profile_file(std::string const& out_prefix) const;
+
+    // Save the profile
+    void write(std::string const& out_prefix) const;
+
+  private:
+    std::atomic<bool> m_enabled;
+    std::vector<std::string> m_names, m_solver_names; // in the order first seen
+    std::map<std::string, Stats> m_stats;
+    std::map<std::string, double> m_solver_stats;
+    mutable std::mutex m_mutex;
+  };
+
+  /// The cost function profile of this process
+  CostProfile & cost_profile();
+
+} // end namespace asp
+
+#endif // __ASP_CORE_COST_PROFILE_H__
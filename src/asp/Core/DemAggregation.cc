@@ -0,0 +1,115 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemAggregation.cc
+///
+
+#include <asp/Core/DemAggregation.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    // Values this close to an integer are taken as that integer, so that
+    // grids which line up are not perturbed by roundoff
+    const double GRID_SNAP_TOL = 1e-6;
+
+    double snap_to_int(double val) {
+      double r = std::round(val);
+      return (std::abs(val - r) < GRID_SNAP_TOL) ? r : val;
+    }
+  }
+
+  void grid_overlaps(double center, double half_width,
+                     std::vector<std::pair<int, double>> & overlaps) {
+    overlaps.clear();
+    double beg = snap_to_int(center - half_width);
+    double end = snap_to_int(center + half_width);
+    for (int i = int(std::floor(beg + 0.5)); i <= int(std::ceil(end - 0.5)); i++) {
+      double len = std::min(i + 0.5, end) - std::max(i - 0.5, beg);
+      if (len > 0)
+        overlaps.push_back(std::make_pair(i, len));
+    }
+  }
+
+  AggregatedDemView::prerasterize_type
+  AggregatedDemView::prerasterize(BBox2i const& bbox) const {
+
+    // Each output pixel is a grid point. Its cell in units of fine cells.
+    double fine_spacing = m_fine_transform(0, 0);
+    double half_width   = 0.5 * m_transform(0, 0) / fine_spacing;
+    std::vector<std::vector<std::pair<int, double>>> col_overlaps(bbox.width()),
+      row_overlaps(bbox.height());
+    for (int c = 0; c < bbox.width(); c++) {
+      double x = m_transform(0, 2) + (bbox.min().x() + c) * m_transform(0, 0);
+      grid_overlaps((x - m_fine_transform(0, 2)) / fine_spacing, half_width, col_overlaps[c]);
+    }
+    for (int r = 0; r < bbox.height(); r++) {
+      double y = m_transform(1, 2) + (bbox.min().y() + r) * m_transform(1, 1);
+      grid_overlaps((m_fine_transform(1, 2) - y) / fine_spacing, half_width, row_overlaps[r]);
+    }
+
+    // The fine cells needed, read in one go
+    int beg_col = col_overlaps.front().front().first, end_col = col_overlaps.back().back().first;
+    int beg_row = row_overlaps.front().front().first, end_row = row_overlaps.back().back().first;
+    BBox2i fine_box(Vector2i(beg_col, beg_row), Vector2i(end_col + 1, end_row + 1));
+    fine_box.crop(bounding_box(m_accum));
+    ImageView<Vector2> fine;
+    if (!fine_box.empty())
+      fine = crop(m_accum, fine_box);
+
+    ImageView<pixel_type> result(bbox.width(), bbox.height());
+    std::int64_t num_unset = 0;
+    for (int r = 0; r < bbox.height(); r++) {
+      for (int c = 0; c < bbox.width(); c++) {
+        double sum = 0.0, weight = 0.0;
+        for (size_t kr = 0; kr < row_overlaps[r].size(); kr++) {
+          int fr = row_overlaps[r][kr].first - fine_box.min().y();
+          if (fr < 0 || fr >= fine.rows())
+            continue;
+          for (size_t kc = 0; kc < col_overlaps[c].size(); kc++) {
+            int fc = col_overlaps[c][kc].first - fine_box.min().x();
+            if (fc < 0 || fc >= fine.cols())
+              continue;
+            double area = row_overlaps[r][kr].second * col_overlaps[c][kc].second;
+            sum    += area * fine(fc, fr)[0];
+            weight += area * fine(fc, fr)[1];
+          }
+        }
+        if (weight > 0) {
+          result(c, r) = sum / weight;
+        } else {
+          result(c, r) = m_nodata;
+          num_unset++;
+        }
+      }
+    }
+
+    { // Lock and update the total number of invalid pixels
+      vw::Mutex::Lock lock(*m_count_mutex);
+      (*m_num_invalid_pixels) += num_unset;
+    }
+
+    return prerasterize_type(result, BBox2i(-bbox.min().x(), -bbox.min().y(), cols(), rows()));
+  }
+
+} // end namespace asp
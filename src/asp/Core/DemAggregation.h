@@ -0,0 +1,105 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemAggregation.h
+///
+/// Make DEMs at several grid spacings with one pass over the point
+/// cloud. The weighted sums of heights and the sums of weights are
+/// found once on the finest grid, and each DEM adds them up over its
+/// own grid cells, then divides. A fine cell contributes to a coarser
+/// cell in proportion to the area they have in common, so when the
+/// coarser spacing is an integer multiple of the finer one, whole fine
+/// cells are added up, and otherwise the fine cells are split among
+/// the coarser cells they overlap.
+
+#ifndef __ASP_CORE_DEM_AGGREGATION_H__
+#define __ASP_CORE_DEM_AGGREGATION_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/Vector.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  /// The fine grid cells overlapping a coarser cell along one axis. The
+  /// coarser cell is centered at 'center' and has half width
+  /// 'half_width', both in units of fine cells, with fine cell i
+  /// centered at i. Return the index of each fine cell and the length
+  /// of the overlap.
+  void grid_overlaps(double center, double half_width,
+                     std::vector<std::pair<int, double>> & overlaps);
+
+  /// A DEM from the sums of heights and of weights on a finer grid. The
+  /// grids are given by their affine transforms from pixels to
+  /// projected coordinates, as from OrthoRasterizerView::geo_transform().
+  class AggregatedDemView: public vw::ImageViewBase<AggregatedDemView> {
+    vw::ImageViewRef<vw::Vector2> m_accum;
+    vw::Matrix3x3 m_fine_transform, m_transform;
+    int           m_cols, m_rows;
+    double        m_nodata;
+    std::int64_t * m_num_invalid_pixels; // must be a pointer, as in OrthoRasterizerView
+    vw::Mutex    * m_count_mutex;
+
+  public:
+    typedef vw::PixelGray<float> pixel_type;
+    typedef const pixel_type     result_type;
+    typedef vw::ProceduralPixelAccessor<AggregatedDemView> pixel_accessor;
+
+    AggregatedDemView(vw::ImageViewRef<vw::Vector2> const& accum,
+                      vw::Matrix3x3 const& fine_transform,
+                      vw::Matrix3x3 const& transform,
+                      int cols, int rows, double nodata,
+                      std::int64_t * num_invalid_pixels, vw::Mutex * count_mutex):
+      m_accum(accum), m_fine_transform(fine_transform), m_transform(transform),
+      m_cols(cols), m_rows(rows), m_nodata(nodata),
+      m_num_invalid_pixels(num_invalid_pixels), m_count_mutex(count_mutex) {}
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+    inline result_type operator()(int /*i*/, int /*j*/, int /*p*/ = 0) const {
+      vw_throw(vw::NoImplErr() << "AggregatedDemView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const;
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DEM_AGGREGATION_H__
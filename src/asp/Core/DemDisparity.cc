@@ -28,17 +28,109 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/FileIO/MatrixIO.h>
+#include <vw/FileIO/FileUtils.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/DemDisparity.h>
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/PixelMapGrid.h>
+#include <asp/Core/FileUtils.h>
 
 #include <boost/filesystem/operations.hpp>
 namespace fs = boost::filesystem;
 
+#include <fstream>
+#include <limits>
+#include <sstream>
+
 using namespace vw;
 using namespace vw::cartography;
 
 namespace asp {
 
+  /// The low-resolution right image pixel seen from a low-resolution
+  /// left image pixel, through the point where the left ray meets the
+  /// DEM, moved along the ray by the given multiple of the DEM
+  /// error. NaN where the ray misses the DEM or a projection fails.
+  template <class DEMImageT>
+  class DemRightPixelMap: public PixelMap {
+    DEMImageT    const& m_dem;
+    GeoReference const& m_dem_georef;
+    Vector2f            m_downsample_scale;
+    camera::CameraModel const* m_left_camera_model;
+    camera::CameraModel const* m_right_camera_model;
+    bool                m_do_align;
+    Matrix<double>      m_align_left_matrix, m_align_right_matrix;
+    double              m_dem_error, m_bias;
+
+  public:
+    DemRightPixelMap(DEMImageT const& dem, GeoReference const& dem_georef,
+                     Vector2f const& downsample_scale,
+                     camera::CameraModel const* left_camera_model,
+                     camera::CameraModel const* right_camera_model,
+                     bool do_align,
+                     Matrix<double> const& align_left_matrix,
+                     Matrix<double> const& align_right_matrix,
+                     double dem_error, double bias):
+      m_dem(dem), m_dem_georef(dem_georef), m_downsample_scale(downsample_scale),
+      m_left_camera_model(left_camera_model), m_right_camera_model(right_camera_model),
+      m_do_align(do_align), m_align_left_matrix(align_left_matrix),
+      m_align_right_matrix(align_right_matrix), m_dem_error(dem_error), m_bias(bias) {}
+
+    virtual Vector2 operator()(Vector2 const& left_lowres_pix) const {
+
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      double height_error_tol = std::max(m_dem_error/4.0, 1.0); // height error in meters
+      double max_abs_tol      = height_error_tol/4.0; // abs cost function change b/w iterations
+      double max_rel_tol      = 1e-14;                // rel cost function change b/w iterations
+      int    num_max_iter     = 50;
+      bool   treat_nodata_as_zero = false;
+
+      Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
+      if (m_do_align){
+        // Need to go to the image pixel in the untransformed image
+        left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
+      }
+
+      bool has_intersection;
+      Vector3 left_camera_ctr, left_camera_vec;
+      try {
+        left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
+        left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
+      } catch (...) {
+        return Vector2(nan, nan);
+      }
+      Vector3 prev_xyz;
+      Vector3 xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
+                                            m_dem, m_dem_georef,
+                                            treat_nodata_as_zero,
+                                            has_intersection,
+                                            height_error_tol, max_abs_tol,
+                                            max_rel_tol, num_max_iter,
+                                            prev_xyz
+                                            );
+      if ( !has_intersection || xyz == Vector3() )
+        return Vector2(nan, nan);
+
+      // Since our DEM is only known approximately, the true
+      // intersection point of the ray coming from the left camera
+      // with the DEM could be anywhere within m_dem_error from
+      // xyz. Use that to get an estimate of the disparity
+      // error.
+      Vector2 right_fullres_pix;
+      try {
+        right_fullres_pix
+          = m_right_camera_model->point_to_pixel(xyz + m_bias*m_dem_error*left_camera_vec);
+      } catch (...) {
+        return Vector2(nan, nan);
+      }
+      if (m_do_align){
+        right_fullres_pix = HomographyTransform(m_align_right_matrix).forward(right_fullres_pix);
+      }
+
+      return elem_prod(right_fullres_pix, m_downsample_scale);
+    }
+  };
+
   template <class ImageT, class DEMImageT>
   class DemDisparity : public ImageViewBase<DemDisparity<ImageT, DEMImageT> > {
     ImageT            m_left_image;
@@ -173,78 +265,63 @@ namespace asp {
       GeoReference georef_crop = crop(m_dem_georef, dem_box);
       ImageView <PixelMask<float> > dem_crop = crop(m_dem, dem_box);
 
-      // Compute the DEM disparity. Use one in every 'm_pixel_sample' pixels.
+      // Compute the DEM disparity. Use one in every 'm_pixel_sample'
+      // pixels. Where the DEM is smooth, the right image pixels at
+      // the ends of the disparity range change smoothly too, so
+      // compute them exactly on a grid and interpolate in between.
+      // The interpolation is checked, and is refined where the error
+      // is larger than the tolerance.
+      const int    grid_spacing = 16;   // low-res pixels
+      const double grid_tol     = 0.25; // low-res pixels
+      typedef ImageView<PixelMask<float>> DemCropT;
+      DemRightPixelMap<DemCropT> minus_map(dem_crop, georef_crop, m_downsample_scale,
+                                           m_left_camera_model.get(),
+                                           m_right_camera_model.get(), m_do_align,
+                                           m_align_left_matrix, m_align_right_matrix,
+                                           m_dem_error, -1.0);
+      DemRightPixelMap<DemCropT> plus_map(dem_crop, georef_crop, m_downsample_scale,
+                                          m_left_camera_model.get(),
+                                          m_right_camera_model.get(), m_do_align,
+                                          m_align_left_matrix, m_align_right_matrix,
+                                          m_dem_error, 1.0);
+      DemRightPixelMap<DemCropT> mid_map(dem_crop, georef_crop, m_downsample_scale,
+                                         m_left_camera_model.get(),
+                                         m_right_camera_model.get(), m_do_align,
+                                         m_align_left_matrix, m_align_right_matrix,
+                                         m_dem_error, 0.0);
+      std::vector<Vector2> minus_pix, plus_pix;
+      interp_pixel_map(minus_map, bbox, grid_spacing, grid_tol, minus_pix);
+      interp_pixel_map(plus_map,  bbox, grid_spacing, grid_tol, plus_pix);
 
       for (int row = bbox.min().y(); row < bbox.max().y(); row++){
         if (row%m_pixel_sample != 0) continue;
 
-        // Must wipe the previous guess since we are now too far from it
-        prev_xyz = Vector3();
-
         for (int col = bbox.min().x(); col < bbox.max().x(); col++){
           if (col%m_pixel_sample != 0) continue;
 
           Vector2 left_lowres_pix = Vector2(col, row);
+          size_t pos = size_t(row - bbox.min().y()) * bbox.width() + (col - bbox.min().x());
 
-          Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
-          if (m_do_align){
-            // Need to go to the image pixel in the untransformed image
-            left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
+          BBox2f search_range;
+          int num_valid = 0;
+          Vector2 ends[] = {minus_pix[pos], plus_pix[pos]};
+          for (int k = 0; k < 2; k++) {
+            if (std::isnan(ends[k].x()) || std::isnan(ends[k].y()))
+              continue;
+            search_range.grow(ends[k] - left_lowres_pix);
+            num_valid++;
           }
 
-          bool has_intersection;
-          Vector3 left_camera_ctr, left_camera_vec;
-          try {
-            left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
-            left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
-          } catch (...) {
-            continue;
-          }
-          Vector3 xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
-                                                dem_crop, georef_crop,
-                                                treat_nodata_as_zero,
-                                                has_intersection,
-                                                height_error_tol, max_abs_tol,
-                                                max_rel_tol, num_max_iter,
-                                                prev_xyz
-                                                );
-          if ( !has_intersection || xyz == Vector3() ) continue;
-          prev_xyz = xyz;
-
-          // Since our DEM is only known approximately, the true
-          // intersection point of the ray coming from the left camera
-          // with the DEM could be anywhere within m_dem_error from
-          // xyz. Use that to get an estimate of the disparity
-          // error.
-
-          ImageView< PixelMask<Vector2> > curr_pixel_disp_range(3, 1);
-          double bias[] = {-1.0, 1.0, 0.0};
-          int success[] = {0, 0, 0};
-
-          for (int k = 0; k < curr_pixel_disp_range.cols(); k++){
-
-            Vector2 right_fullres_pix;
-            try {
-              right_fullres_pix = m_right_camera_model->point_to_pixel(xyz + bias[k]*m_dem_error*left_camera_vec);
-            } catch (...) {
-              curr_pixel_disp_range(k, 0).invalidate();
-              continue;
+          // If the disparities at the endpoints of the range were not
+          // both successful, use also the middle estimate.
+          if (num_valid < 2) {
+            Vector2 mid = mid_map(left_lowres_pix);
+            if (!std::isnan(mid.x()) && !std::isnan(mid.y())) {
+              search_range.grow(mid - left_lowres_pix);
+              num_valid++;
             }
-            if (m_do_align){
-              right_fullres_pix = HomographyTransform(m_align_right_matrix).forward(right_fullres_pix);
-            }
-
-            Vector2 right_lowres_pix = elem_prod(right_fullres_pix, m_downsample_scale);
-            curr_pixel_disp_range(k, 0) = right_lowres_pix - left_lowres_pix;
-            success[k] = 1;
-
-            // If the disparities at the endpoints of the range were successful,
-            // don't bother with the middle estimate.
-            if (k == 1 && success[0] && success[1]) break;
           }
-
-          BBox2f search_range = stereo::get_disparity_range(curr_pixel_disp_range);
-          if (search_range ==  BBox2f(0,0,0,0)) continue;
+          if (num_valid == 0) continue;
 
           lowres_disparity(col, row) = round( (search_range.min() + search_range.max())/2.0 );
           m_disparity_spread(col, row) = ceil( (search_range.max() - search_range.min())/2.0 );
@@ -285,6 +362,87 @@ namespace asp {
                         );
   }
 
+  // What the low-resolution disparity from a DEM is found from, to
+  // key it in --disparity-estimation-dem-cache-dir. The cameras are
+  // keyed by their contents, and the large images and DEM by their
+  // modification times.
+  std::string dem_disparity_cache_key(ASPGlobalOptions const& opt,
+                                      std::string const& session_name,
+                                      std::string const& dem_file, double dem_error,
+                                      Vector2i const& left_size, Vector2i const& left_sub_size,
+                                      Matrix<double> const& align_left_matrix,
+                                      Matrix<double> const& align_right_matrix,
+                                      int pixel_sample) {
+    std::ostringstream os;
+    os.precision(17);
+    os << "dem-disparity-version: 2 "
+       << "dem: " << dem_file << " " << asp::file_timestamp(dem_file) << " " << dem_error << " "
+       << "images: " << opt.in_file1 << " " << asp::file_timestamp(opt.in_file1) << " "
+       << opt.in_file2 << " " << asp::file_timestamp(opt.in_file2) << " "
+       << "cameras: " << session_name << " "
+       << opt.cam_file1 << " " << asp::file_content_hash(opt.cam_file1) << " "
+       << opt.cam_file2 << " " << asp::file_content_hash(opt.cam_file2) << " "
+       << "adjustments: " << stereo_settings().bundle_adjust_prefix << " "
+       << "alignment: " << stereo_settings().alignment_method << " "
+       << align_left_matrix << " " << align_right_matrix << " "
+       << "size: " << left_size << " " << left_sub_size << " " << pixel_sample;
+    return os.str();
+  }
+
+  // If D_sub and D_sub_spread for this key are in the cache, copy them
+  // to the output prefix.
+  bool read_dem_disparity_cache(std::string const& cache_base, std::string const& key,
+                                std::string const& disparity_file,
+                                std::string const& disp_spread_file) {
+    std::ifstream ifs((cache_base + ".txt").c_str());
+    std::string cached_key;
+    if (!ifs.good() || !std::getline(ifs, cached_key) || cached_key != key)
+      return false;
+
+    try {
+      fs::copy_file(cache_base + "-D_sub.tif", disparity_file,
+                    fs::copy_option::overwrite_if_exists);
+      fs::copy_file(cache_base + "-D_sub_spread.tif", disp_spread_file,
+                    fs::copy_option::overwrite_if_exists);
+    } catch (std::exception const& e) {
+      vw_out(WarningMessage) << "Could not read the cached low-resolution disparity: "
+                             << cache_base << ". " << e.what() << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  // Save D_sub and D_sub_spread in the cache. The key is written last,
+  // and each file is renamed into place, so other processes never see
+  // a partial entry. Failing to write the cache is not an error.
+  void write_dem_disparity_cache(std::string const& cache_base, std::string const& key,
+                                 std::string const& disparity_file,
+                                 std::string const& disp_spread_file) {
+    try {
+      vw::create_out_dir(cache_base);
+      std::string files[] = {disparity_file, disp_spread_file, ""};
+      std::string suffixes[] = {"-D_sub.tif", "-D_sub_spread.tif", ".txt"};
+      for (int it = 0; it < 3; it++) {
+        std::string cache_file = cache_base + suffixes[it];
+        std::string tmp_file
+          = fs::unique_path(cache_file + ".%%%%-%%%%-%%%%.tmp").string();
+        if (files[it] != "") {
+          fs::copy_file(files[it], tmp_file);
+        } else {
+          std::ofstream ofs(tmp_file.c_str());
+          ofs << key << "\n";
+          ofs.close();
+          if (!ofs)
+            vw_throw(IOErr() << "Could not write: " << tmp_file);
+        }
+        fs::rename(tmp_file, cache_file);
+      }
+    } catch (std::exception const& e) {
+      vw_out(WarningMessage) << "Could not cache the low-resolution disparity in: "
+                             << cache_base << ". " << e.what() << "\n";
+    }
+  }
+
   void produce_dem_disparity( ASPGlobalOptions & opt,
                               boost::shared_ptr<camera::CameraModel> left_camera_model,
                               boost::shared_ptr<camera::CameraModel> right_camera_model,
@@ -299,7 +457,7 @@ namespace asp {
     // Skip pixels to speed things up, particularly for ISIS and DG.
     int pixel_sample = 2;
 
-    DiskImageView<PixelGray<float> > left_image(opt.out_prefix+"-L.tif");
+    vw::Vector2i left_size = asp::aligned_image_size(opt.out_prefix, true);
     DiskImageView<PixelGray<float> > left_image_sub(opt.out_prefix+"-L_sub.tif");
 
     std::string dem_file = stereo_settings().disparity_estimation_dem;
@@ -327,8 +485,8 @@ namespace asp {
         dem = create_mask(dem_disk_image, nodata_value);
     }
 
-    Vector2f downsample_scale( float(left_image_sub.cols()) / float(left_image.cols()),
-                               float(left_image_sub.rows()) / float(left_image.rows()));
+    Vector2f downsample_scale( float(left_image_sub.cols()) / float(left_size.x()),
+                               float(left_image_sub.rows()) / float(left_size.y()));
 
     Matrix<double> align_left_matrix  = math::identity_matrix<3>();
     Matrix<double> align_right_matrix = math::identity_matrix<3>();
@@ -348,6 +506,27 @@ namespace asp {
       vw_out(DebugMessage,"asp") << "Right alignment matrix: " << align_right_matrix << "\n";
     }
 
+    std::string disparity_file = opt.out_prefix + "-D_sub.tif";
+    std::string disp_spread_file = opt.out_prefix + "-D_sub_spread.tif";
+
+    // With a cache directory, reuse the result of an earlier run with the
+    // same DEM, cameras, and alignment, for example with other correlation
+    // parameters. Not when cropping, as with the interest point cache.
+    bool crop_left  = (stereo_settings().left_image_crop_win  != BBox2i(0, 0, 0, 0));
+    bool crop_right = (stereo_settings().right_image_crop_win != BBox2i(0, 0, 0, 0));
+    std::string cache_dir = stereo_settings().disparity_estimation_dem_cache_dir;
+    std::string cache_key, cache_base;
+    if (cache_dir != "" && !crop_left && !crop_right) {
+      cache_key = dem_disparity_cache_key(opt, session_name, dem_file, dem_error, left_size,
+                                          Vector2i(left_image_sub.cols(), left_image_sub.rows()),
+                                          align_left_matrix, align_right_matrix, pixel_sample);
+      cache_base = asp::cache_file_name(cache_dir, "dem-disp-", cache_key, "");
+      if (read_dem_disparity_cache(cache_base, cache_key, disparity_file, disp_spread_file)) {
+        vw_out() << "Using cached low-resolution disparity: " << cache_base << "\n";
+        return;
+      }
+    }
+
     // Smaller tiles is better
     Vector2 orig_tile_size = opt.raster_tile_size;
     opt.raster_tile_size = Vector2i(64, 64);
@@ -364,7 +543,6 @@ namespace asp {
                                                        align_left_matrix, align_right_matrix,
                                                        pixel_sample, disparity_spread
                                                        ));
-    std::string disparity_file = opt.out_prefix + "-D_sub.tif";
     vw_out() << "Writing low-resolution disparity: " << disparity_file << "\n";
     if ( session_name == "isis" ){
       // ISIS does not support multi-threading
@@ -380,7 +558,6 @@ namespace asp {
                                               ("asp", "\t--> Low-resolution disparity:") );
     }
 
-    std::string disp_spread_file = opt.out_prefix + "-D_sub_spread.tif";
     vw_out() << "Writing low-resolution disparity spread: " << disp_spread_file << "\n";
     vw::cartography::block_write_gdal_image(disp_spread_file,
                                             disparity_spread,
@@ -391,6 +568,9 @@ namespace asp {
     // Go back to the original tile size
     opt.raster_tile_size = orig_tile_size;
 
+    if (cache_base != "")
+      write_dem_disparity_cache(cache_base, cache_key, disparity_file, disp_spread_file);
+
 #if 0 // Debug code
     ImageView<PixelMask<Vector2i> > lowres_disparity_disk;
     read_image( lowres_disparity_disk, opt.out_prefix + "-D_sub.tif" );
@@ -0,0 +1,135 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemHillshade.cc
+///
+
+#include <asp/Core/DemHillshade.h>
+
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Core/Exception.h>
+#include <vw/FileIO/DiskImageUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/MaskViews.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  Vector2 pixel_size_in_meters(cartography::GeoReference const& georef,
+                               Vector2 const& pix) {
+    Vector2 ll  = georef.pixel_to_lonlat(pix);
+    Vector2 llx = georef.pixel_to_lonlat(pix + Vector2(1, 0));
+    Vector2 lly = georef.pixel_to_lonlat(pix + Vector2(0, 1));
+    double meters_per_deg = georef.datum().semi_major_axis() * M_PI / 180.0;
+    double cos_lat = cos(ll[1] * M_PI / 180.0);
+    double dx = meters_per_deg * norm_2(Vector2((llx[0] - ll[0])*cos_lat, llx[1] - ll[1]));
+    double dy = meters_per_deg * norm_2(Vector2((lly[0] - ll[0])*cos_lat, lly[1] - ll[1]));
+    if (!(dx > 0) || !(dy > 0))
+      return Vector2(1, 1); // cannot find the pixel size, so any will do
+    return Vector2(dx, dy);
+  }
+
+  int subsample_factor(int cols, int rows, double max_pixels) {
+    if (max_pixels <= 0)
+      vw_throw(ArgumentErr() << "The maximum number of pixels must be positive.\n");
+    int factor = 1;
+    while ((double(cols) / factor) * (double(rows) / factor) > max_pixels)
+      factor++;
+    return factor;
+  }
+
+  void hillshade(ImageView<PixelMask<float>> const& dem,
+                 Vector2 const& pixel_size, double azimuth, double elevation,
+                 float nodata, ImageView<float> & shade) {
+
+    // The light direction, with x going east and y going north
+    double az = azimuth * M_PI / 180.0, el = elevation * M_PI / 180.0;
+    Vector3 light(cos(el)*sin(az), cos(el)*cos(az), sin(el));
+
+    int cols = dem.cols(), rows = dem.rows();
+    shade.set_size(cols, rows);
+    auto valid = [&dem](int c, int r) {
+      return is_valid(dem(c, r)) && !std::isnan(dem(c, r).child());
+    };
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        if (!valid(col, row)) {
+          shade(col, row) = nodata;
+          continue;
+        }
+
+        // Central differences, or one-sided ones at the edges or next
+        // to invalid pixels
+        double v = dem(col, row).child();
+        double grad[2] = {0.0, 0.0};
+        int lo[2] = {col - 1, row - 1}, hi[2] = {col + 1, row + 1};
+        for (int d = 0; d < 2; d++) {
+          double vlo = v, vhi = v;
+          int ilo = (d == 0) ? col : row, ihi = ilo;
+          int clo = (d == 0) ? lo[d] : col, rlo = (d == 0) ? row : lo[d];
+          int chi = (d == 0) ? hi[d] : col, rhi = (d == 0) ? row : hi[d];
+          if (lo[d] >= 0 && valid(clo, rlo)) {
+            vlo = dem(clo, rlo).child();
+            ilo = lo[d];
+          }
+          if (hi[d] < ((d == 0) ? cols : rows) && valid(chi, rhi)) {
+            vhi = dem(chi, rhi).child();
+            ihi = hi[d];
+          }
+          if (ihi > ilo)
+            grad[d] = (vhi - vlo) / (ihi - ilo);
+        }
+
+        // The rows go down, so the y gradient changes sign
+        Vector3 normal(-grad[0]/pixel_size[0], grad[1]/pixel_size[1], 1.0);
+        shade(col, row) = std::max(0.0, dot_prod(normal, light) / norm_2(normal));
+      }
+    }
+  }
+
+  void hillshade_dem_file(std::string const& dem_file, int factor,
+                          double azimuth, double elevation, float nodata,
+                          ImageView<float> & shade) {
+
+    if (factor < 1)
+      vw_throw(ArgumentErr() << "The subsample factor must be positive.\n");
+
+    cartography::GeoReference georef;
+    if (!cartography::read_georeference(georef, dem_file))
+      vw_throw(ArgumentErr() << "Missing georeference in: " << dem_file << ".\n");
+    double dem_nodata = -std::numeric_limits<double>::max();
+    vw::read_nodata_val(dem_file, dem_nodata);
+
+    DiskImageView<float> disk_dem(dem_file);
+    ImageView<PixelMask<float>> dem
+      = subsample(create_mask_less_or_equal(disk_dem, dem_nodata), factor);
+
+    // The pixel size at the DEM center, in subsampled pixels
+    Vector2 center(disk_dem.cols()/2.0, disk_dem.rows()/2.0);
+    Vector2 pixel_size = factor * pixel_size_in_meters(georef, center);
+
+    hillshade(dem, pixel_size, azimuth, elevation, nodata, shade);
+  }
+
+} // end namespace asp
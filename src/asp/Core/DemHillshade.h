@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemHillshade.h
+///
+/// Hillshade DEMs in memory, for finding interest point matches
+/// between them, as done by the hillshade tool, but without writing
+/// the result to disk.
+
+#ifndef __ASP_CORE_DEM_HILLSHADE_H__
+#define __ASP_CORE_DEM_HILLSHADE_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+
+namespace asp {
+
+  /// The size of a pixel of a georeferenced image in meters, along its
+  /// columns and rows, near the given pixel. Using the lon-lat works
+  /// for both projected and geographic images. Return (1, 1) if it
+  /// cannot be found.
+  vw::Vector2 pixel_size_in_meters(vw::cartography::GeoReference const& georef,
+                                   vw::Vector2 const& pix);
+
+  /// The smallest factor to subsample an image by so that it has at most
+  /// the given number of pixels
+  int subsample_factor(int cols, int rows, double max_pixels);
+
+  /// Hillshade a DEM. The light has the given azimuth, clockwise from
+  /// north, and elevation, both in degrees, with the DEM columns going
+  /// east and the rows going south. The shade is between 0 and 1, and
+  /// is 'nodata' where the DEM is invalid. The slopes are found with
+  /// central differences, or one-sided ones at the DEM edges or next
+  /// to invalid pixels.
+  void hillshade(vw::ImageView<vw::PixelMask<float>> const& dem,
+                 vw::Vector2 const& pixel_size, double azimuth, double elevation,
+                 float nodata, vw::ImageView<float> & shade);
+
+  /// Read a DEM, subsampled by the given factor, and hillshade it.
+  /// Heights no more than the DEM no-data value are invalid.
+  void hillshade_dem_file(std::string const& dem_file, int factor,
+                          double azimuth, double elevation, float nodata,
+                          vw::ImageView<float> & shade);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DEM_HILLSHADE_H__
@@ -0,0 +1,194 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/DemIndex.h>
+#include <asp/Core/FileUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // Written at the start of each index file. Change this if the format changes.
+  const std::string DEM_INDEX_MAGIC = "ASP DEM index 1";
+
+  DemInfo read_dem_info(std::string const& dem_file) {
+
+    DemInfo info;
+    info.file      = dem_file;
+    info.timestamp = asp::file_timestamp(dem_file);
+
+    boost::shared_ptr<vw::DiskImageResource> rsrc(vw::DiskImageResourcePtr(dem_file));
+    info.pixel_box = vw::BBox2i(0, 0, rsrc->cols(), rsrc->rows());
+    info.has_nodata = rsrc->has_nodata_read();
+    if (info.has_nodata)
+      info.nodata = rsrc->nodata_read();
+
+    if (!vw::cartography::read_georeference(info.georef, dem_file))
+      vw::vw_throw(vw::ArgumentErr() << "No georeference found in " << dem_file << ".\n");
+
+    info.lonlat_box = info.georef.pixel_to_lonlat_bbox(info.pixel_box);
+
+    return info;
+  }
+
+  bool read_dem_index(std::string const& index_file, std::vector<DemInfo> & infos) {
+
+    infos.clear();
+    std::ifstream ifs(index_file.c_str());
+    if (!ifs.good())
+      return false;
+
+    std::string magic;
+    std::getline(ifs, magic);
+    if (magic != DEM_INDEX_MAGIC)
+      return false;
+
+    // Each record has the file name, the numbers, and the WKT, each on its own line
+    while (1) {
+      DemInfo info;
+      std::string line, wkt;
+      if (!std::getline(ifs, info.file) || !std::getline(ifs, line) ||
+          !std::getline(ifs, wkt))
+        break;
+
+      std::istringstream is(line);
+      int cols = 0, rows = 0, has_nodata = 0, pixel_interp = 0, lon_center = 0;
+      vw::Matrix3x3 transform;
+      if (!(is >> info.timestamp >> cols >> rows >> has_nodata >> info.nodata
+            >> pixel_interp >> lon_center))
+        break;
+      for (int row = 0; row < 3; row++)
+        for (int col = 0; col < 3; col++)
+          is >> transform(row, col);
+      double minx, miny, maxx, maxy;
+      if (!(is >> minx >> miny >> maxx >> maxy))
+        break;
+
+      info.pixel_box  = vw::BBox2i(0, 0, cols, rows);
+      info.has_nodata = has_nodata;
+      info.lonlat_box = vw::BBox2(vw::Vector2(minx, miny), vw::Vector2(maxx, maxy));
+
+      // Set the transform after the WKT, as the latter resets the georeference
+      info.georef.set_wkt(wkt);
+      info.georef.set_pixel_interpretation
+        (vw::cartography::GeoReference::PixelInterpretation(pixel_interp));
+      info.georef.set_transform(transform);
+      info.georef.set_lon_center(lon_center);
+
+      infos.push_back(info);
+    }
+
+    return true;
+  }
+
+  void write_dem_index(std::string const& index_file, std::vector<DemInfo> const& infos) {
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial index.
+    std::string tmp_file = index_file + ".tmp";
+    vw::create_out_dir(index_file);
+    {
+      std::ofstream ofs(tmp_file.c_str());
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+
+      ofs.precision(17);
+      ofs << DEM_INDEX_MAGIC << "\n";
+      for (size_t it = 0; it < infos.size(); it++) {
+        DemInfo const& info = infos[it];
+        vw::Matrix3x3 const& transform = info.georef.transform();
+        ofs << info.file << "\n";
+        ofs << info.timestamp << " " << info.pixel_box.width() << " "
+            << info.pixel_box.height() << " " << int(info.has_nodata) << " "
+            << info.nodata << " " << int(info.georef.pixel_interpretation()) << " "
+            << int(info.georef.is_lon_center_around_zero());
+        for (int row = 0; row < 3; row++)
+          for (int col = 0; col < 3; col++)
+            ofs << " " << transform(row, col);
+        ofs << " " << info.lonlat_box.min().x() << " " << info.lonlat_box.min().y()
+            << " " << info.lonlat_box.max().x() << " " << info.lonlat_box.max().y() << "\n";
+        ofs << info.georef.get_wkt() << "\n";
+      }
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    fs::rename(tmp_file, index_file);
+  }
+
+  void load_dem_infos(std::vector<std::string> const& dem_files,
+                      std::string const& index_file,
+                      std::vector<DemInfo> & infos) {
+
+    infos.clear();
+
+    // The DEMs already in the index
+    std::vector<DemInfo> index_infos;
+    std::map<std::string, int> file_to_index;
+    if (index_file != "" && read_dem_index(index_file, index_infos)) {
+      for (size_t it = 0; it < index_infos.size(); it++)
+        file_to_index[index_infos[it].file] = it;
+    }
+
+    int num_read = 0;
+    for (size_t it = 0; it < dem_files.size(); it++) {
+      std::map<std::string, int>::const_iterator map_it = file_to_index.find(dem_files[it]);
+      if (map_it != file_to_index.end() &&
+          index_infos[map_it->second].timestamp == asp::file_timestamp(dem_files[it])) {
+        infos.push_back(index_infos[map_it->second]);
+        continue;
+      }
+
+      infos.push_back(read_dem_info(dem_files[it]));
+      num_read++;
+
+      // Replace a stale record, or add a new one
+      if (map_it != file_to_index.end()) {
+        index_infos[map_it->second] = infos.back();
+      } else {
+        file_to_index[dem_files[it]] = index_infos.size();
+        index_infos.push_back(infos.back());
+      }
+    }
+
+    if (index_file != "" && num_read > 0) {
+      vw::vw_out() << "Writing: " << index_file << "\n";
+      write_dem_index(index_file, index_infos);
+    }
+  }
+
+  void dems_in_lonlat_box(std::vector<DemInfo> const& infos, vw::BBox2 const& lonlat_box,
+                          std::vector<int> & ids) {
+    ids.clear();
+    for (size_t it = 0; it < infos.size(); it++) {
+      if (infos[it].lonlat_box.intersects(lonlat_box))
+        ids.push_back(it);
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,72 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DemIndex.h
+///
+/// An index of what tools need to know about many DEMs, such as each
+/// one's size, georeference, no-data value, and footprint. The index
+/// is saved to a file. When it is loaded again only the DEMs which
+/// are new or have changed are opened. With thousands of DEMs, this
+/// is much faster than opening all of them.
+
+#ifndef __ASP_CORE_DEM_INDEX_H__
+#define __ASP_CORE_DEM_INDEX_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Math/BBox.h>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The information about a DEM kept in the index
+  struct DemInfo {
+    std::string file;
+    std::string timestamp;    // as from file_timestamp(), to detect changes
+    vw::BBox2i  pixel_box;    // the DEM extent in pixels
+    bool        has_nodata;
+    double      nodata;
+    vw::cartography::GeoReference georef;
+    vw::BBox2   lonlat_box;   // the footprint of the DEM
+    DemInfo(): has_nodata(false), nodata(0.0) {}
+  };
+
+  /// Read the information about a DEM from the DEM itself
+  DemInfo read_dem_info(std::string const& dem_file);
+
+  /// Find the information about the given DEMs, in the same order. If
+  /// the index file name is not empty, the DEMs found in that index
+  /// with the same modification time are not opened. The index is then
+  /// updated with the DEMs which were opened, if any.
+  void load_dem_infos(std::vector<std::string> const& dem_files,
+                      std::string const& index_file,
+                      std::vector<DemInfo> & infos);
+
+  /// Read and write an index file. Reading returns false if the file
+  /// does not exist or has a different format. A record which cannot
+  /// be parsed ends the reading.
+  bool read_dem_index(std::string const& index_file, std::vector<DemInfo> & infos);
+  void write_dem_index(std::string const& index_file, std::vector<DemInfo> const& infos);
+
+  /// The indices of the DEMs whose footprint intersects a lon-lat box
+  void dems_in_lonlat_box(std::vector<DemInfo> const& infos, vw::BBox2 const& lonlat_box,
+                          std::vector<int> & ids);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DEM_INDEX_H__
@@ -0,0 +1,376 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemRayIntersect.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/BlockRasterize.h>
+#include <vw/Cartography/Datum.h>
+#include <asp/Core/DemRayIntersect.h>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    // A point on a ray, at distance t from its origin, with its height
+    // above the datum and its DEM pixel
+    struct RayPoint {
+      double  t, h;
+      Vector2 pix;
+    };
+
+    RayPoint ray_point(cartography::GeoReference const& georef,
+                       Vector3 const& ctr, Vector3 const& dir, double t) {
+      RayPoint p;
+      p.t = t;
+      Vector3 llh = georef.datum().cartesian_to_geodetic(ctr + t * dir);
+      p.h   = llh[2];
+      p.pix = georef.lonlat_to_pixel(subvector(llh, 0, 2));
+      return p;
+    }
+
+    // Where the ray from ctr along the unit vector dir meets the
+    // ellipsoid with the given semi-axes, with t0 <= t1. Return false
+    // if it does not.
+    bool ellipsoid_hits(Vector3 const& ctr, Vector3 const& dir, double a, double b,
+                        double & t0, double & t1) {
+      if (a <= 0 || b <= 0)
+        return false;
+
+      // Scale z so that the ellipsoid becomes a sphere of radius a
+      double s = a / b;
+      Vector3 c(ctr[0], ctr[1], s * ctr[2]), d(dir[0], dir[1], s * dir[2]);
+      double A = dot_prod(d, d), B = 2.0 * dot_prod(c, d), C = dot_prod(c, c) - a * a;
+      double disc = B * B - 4.0 * A * C;
+      if (disc < 0)
+        return false;
+      double sq = sqrt(disc);
+      t0 = (-B - sq) / (2.0 * A);
+      t1 = (-B + sq) / (2.0 * A);
+      return true;
+    }
+
+    // The ellipsoid with the semi-axes grown by a height is not quite at
+    // that height above the datum, so leave some room
+    double height_margin(double h) {
+      return 1.0 + 0.01 * std::abs(h);
+    }
+
+    // When a point moving at velocity v leaves a box it is in
+    double exit_time(Vector2 const& p, Vector2 const& v, BBox2 const& box) {
+      double t = std::numeric_limits<double>::max();
+      for (int it = 0; it < 2; it++) {
+        if (v[it] > 0)
+          t = std::min(t, (box.max()[it] - p[it]) / v[it]);
+        else if (v[it] < 0)
+          t = std::min(t, (box.min()[it] - p[it]) / v[it]);
+      }
+      return std::max(t, 0.0);
+    }
+
+    // When a point moving at velocity v enters a box, or a negative
+    // number if it does not
+    double entry_time(Vector2 const& p, Vector2 const& v, BBox2 const& box) {
+      double t0 = 0.0, t1 = std::numeric_limits<double>::max();
+      for (int it = 0; it < 2; it++) {
+        if (v[it] == 0) {
+          if (p[it] < box.min()[it] || p[it] > box.max()[it])
+            return -1.0;
+          continue;
+        }
+        double a = (box.min()[it] - p[it]) / v[it];
+        double b = (box.max()[it] - p[it]) / v[it];
+        if (a > b)
+          std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+      }
+      if (t0 > t1)
+        return -1.0;
+      return t0;
+    }
+
+    // Intersect a range of rays. The task has its own copy of the
+    // intersector, for the georeference.
+    class IntersectRaysTask: public vw::Task, private boost::noncopyable {
+      DemRayIntersector m_dem;
+      std::vector<Vector3> const& m_ctrs;
+      std::vector<Vector3> const& m_dirs;
+      size_t m_beg, m_end;
+      std::vector<Vector3> & m_xyz;
+    public:
+      IntersectRaysTask(DemRayIntersector const& dem,
+                        std::vector<Vector3> const& ctrs, std::vector<Vector3> const& dirs,
+                        size_t beg, size_t end, std::vector<Vector3> & xyz):
+        m_dem(dem), m_ctrs(ctrs), m_dirs(dirs), m_beg(beg), m_end(end), m_xyz(xyz) {}
+
+      void operator()() {
+        for (size_t it = m_beg; it < m_end; it++) {
+          if (!m_dem.intersect(m_ctrs[it], m_dirs[it], m_xyz[it]))
+            m_xyz[it] = Vector3();
+        }
+      }
+    };
+
+  } // end anonymous namespace
+
+  DemRayIntersector::DemRayIntersector():
+    m_min_height(std::numeric_limits<double>::max()),
+    m_max_height(-std::numeric_limits<double>::max()),
+    m_pixel_size(1.0) {}
+
+  DemRayIntersector::DemRayIntersector(ImageViewRef<PixelMask<double>> const& dem,
+                                       cartography::GeoReference const& georef):
+    m_georef(georef),
+    m_min_height(std::numeric_limits<double>::max()),
+    m_max_height(-std::numeric_limits<double>::max()),
+    m_pixel_size(1.0) {
+
+    ImageView<PixelMask<double>> masked
+      = block_rasterize(dem, Vector2i(256, 256), vw_settings().default_num_threads());
+    int cols = masked.cols(), rows = masked.rows();
+    m_dem.set_size(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        double h = masked(col, row).child();
+        if (!is_valid(masked(col, row)) || std::isnan(h)) {
+          m_dem(col, row) = std::numeric_limits<float>::quiet_NaN();
+          continue;
+        }
+        m_dem(col, row) = h;
+        m_min_height = std::min(m_min_height, h);
+        m_max_height = std::max(m_max_height, h);
+      }
+    }
+
+    if (cols < 2 || rows < 2)
+      return; // there are no cells
+
+    // The largest height of each cell, then of blocks of 2x2 cells,
+    // and so on, until there is one block
+    const float no_cell = -std::numeric_limits<float>::infinity();
+    ImageView<float> cells(cols - 1, rows - 1);
+    for (int row = 0; row < rows - 1; row++) {
+      for (int col = 0; col < cols - 1; col++) {
+        float v[4] = {m_dem(col, row), m_dem(col + 1, row),
+                      m_dem(col, row + 1), m_dem(col + 1, row + 1)};
+        float max_v = v[0];
+        for (int it = 0; it < 4; it++) {
+          if (std::isnan(v[it])) {
+            max_v = no_cell;
+            break;
+          }
+          max_v = std::max(max_v, v[it]);
+        }
+        cells(col, row) = max_v;
+      }
+    }
+    m_max.push_back(cells);
+    while (m_max.back().cols() > 1 || m_max.back().rows() > 1) {
+      ImageView<float> fine = m_max.back(); // shallow copy
+      ImageView<float> coarse((fine.cols() + 1) / 2, (fine.rows() + 1) / 2);
+      for (int row = 0; row < coarse.rows(); row++) {
+        for (int col = 0; col < coarse.cols(); col++) {
+          float max_v = no_cell;
+          for (int r = 2 * row; r <= std::min(2 * row + 1, fine.rows() - 1); r++) {
+            for (int c = 2 * col; c <= std::min(2 * col + 1, fine.cols() - 1); c++)
+              max_v = std::max(max_v, fine(c, r));
+          }
+          coarse(col, row) = max_v;
+        }
+      }
+      m_max.push_back(coarse);
+    }
+
+    // The size of a pixel at the DEM center sets the step sizes
+    try {
+      Vector2 c(0.5 * (cols - 1), 0.5 * (rows - 1));
+      cartography::Datum const& datum = m_georef.datum();
+      Vector2 ll0 = m_georef.pixel_to_lonlat(c);
+      Vector2 ll1 = m_georef.pixel_to_lonlat(c + Vector2(1, 0));
+      Vector2 ll2 = m_georef.pixel_to_lonlat(c + Vector2(0, 1));
+      Vector3 p0 = datum.geodetic_to_cartesian(Vector3(ll0[0], ll0[1], 0));
+      Vector3 p1 = datum.geodetic_to_cartesian(Vector3(ll1[0], ll1[1], 0));
+      Vector3 p2 = datum.geodetic_to_cartesian(Vector3(ll2[0], ll2[1], 0));
+      double size = std::min(norm_2(p1 - p0), norm_2(p2 - p0));
+      if (size > 0 && size < std::numeric_limits<double>::max())
+        m_pixel_size = size;
+    } catch (...) {}
+  }
+
+  bool DemRayIntersector::height(Vector2 const& pix, double & h) const {
+
+    int cols = m_dem.cols(), rows = m_dem.rows();
+    if (cols < 2 || rows < 2 ||
+        !(pix[0] >= 0 && pix[0] <= cols - 1 && pix[1] >= 0 && pix[1] <= rows - 1))
+      return false;
+
+    // No-data values are NaN, so they spoil the result
+    int col = std::min((int)floor(pix[0]), cols - 2);
+    int row = std::min((int)floor(pix[1]), rows - 2);
+    double x = pix[0] - col, y = pix[1] - row;
+    h = (1 - x) * (1 - y) * m_dem(col, row)     + x * (1 - y) * m_dem(col + 1, row) +
+        (1 - x) * y       * m_dem(col, row + 1) + x * y       * m_dem(col + 1, row + 1);
+    return !std::isnan(h);
+  }
+
+  bool DemRayIntersector::intersect(Vector3 const& ctr, Vector3 const& dir_in,
+                                    Vector3 & xyz) const {
+
+    if (m_max.empty() || m_min_height > m_max_height)
+      return false;
+    double len = norm_2(dir_in);
+    if (!(len > 0))
+      return false;
+    Vector3 dir = dir_in / len;
+
+    try {
+      // The part of the ray between the largest and smallest DEM
+      // heights. Below the smallest height, the ray is under the DEM.
+      cartography::Datum const& datum = m_georef.datum();
+      double a = datum.semi_major_axis(), b = datum.semi_minor_axis();
+      double hi = m_max_height + height_margin(m_max_height);
+      double lo = m_min_height - height_margin(m_min_height);
+      double t0 = 0, t1 = 0;
+      if (!ellipsoid_hits(ctr, dir, a + hi, b + hi, t0, t1) || t1 <= 0)
+        return false;
+      double t_beg = std::max(t0, 0.0), t_end = t1;
+      if (ellipsoid_hits(ctr, dir, a + lo, b + lo, t0, t1) && t0 > t_beg)
+        t_end = std::min(t_end, t0);
+
+      int cols = m_dem.cols(), rows = m_dem.rows();
+      BBox2 dem_box(Vector2(0, 0), Vector2(cols - 1, rows - 1));
+      double diff_step = 0.1 * m_pixel_size; // for finite differences, in meters
+      double tol = 1e-3;                     // a millimeter
+      int max_steps = 16 * (cols + rows) + 10000;
+
+      RayPoint p = ray_point(m_georef, ctr, dir, t_beg);
+      for (int step = 0; step < max_steps && p.t < t_end; step++) {
+
+        // How fast the ray moves across the DEM, in pixels per meter,
+        // and up or down. The fine step is a quarter of a pixel.
+        RayPoint q = ray_point(m_georef, ctr, dir, p.t + diff_step);
+        Vector2 vpix = (q.pix - p.pix) / diff_step;
+        double vh = (q.h - p.h) / diff_step;
+        double speed = norm_2(vpix);
+        double fine_dt = t_end - p.t;
+        if (speed > 0)
+          fine_dt = std::min(fine_dt, 0.25 / speed);
+
+        if (!(p.pix[0] >= 0 && p.pix[0] <= cols - 1 &&
+              p.pix[1] >= 0 && p.pix[1] <= rows - 1)) {
+          // Jump to where the ray enters the DEM, if it does
+          double dt = entry_time(p.pix, vpix, dem_box);
+          if (dt < 0)
+            return false;
+          p = ray_point(m_georef, ctr, dir, p.t + std::max(dt, 0.1 * fine_dt));
+          continue;
+        }
+
+        // The coarsest block under the ray which is all below it
+        int col = std::min((int)floor(p.pix[0]), cols - 2);
+        int row = std::min((int)floor(p.pix[1]), rows - 2);
+        int level = -1;
+        for (int L = int(m_max.size()) - 1; L >= 0; L--) {
+          if (m_max[L](col >> L, row >> L) < p.h) {
+            level = L;
+            break;
+          }
+        }
+
+        if (level >= 0) {
+          // Go to where the ray leaves the block, or comes down to its
+          // largest height, and a bit further
+          int s = 1 << level;
+          int c0 = (col >> level) * s, r0 = (row >> level) * s;
+          BBox2 block(Vector2(c0, r0), Vector2(std::min(c0 + s, cols - 1),
+                                               std::min(r0 + s, rows - 1)));
+          double dt = exit_time(p.pix, vpix, block);
+          if (vh < 0)
+            dt = std::min(dt, (p.h - m_max[level](col >> level, row >> level)) / (-vh));
+          dt += tol;
+          if (dt >= 0.5 * fine_dt) {
+            p = ray_point(m_georef, ctr, dir, p.t + dt);
+            continue;
+          }
+        }
+
+        // Close to the terrain. See if the ray goes under it within a
+        // fine step, and if so, find where by bisection.
+        RayPoint n = ray_point(m_georef, ctr, dir, p.t + std::max(fine_dt, tol));
+        double h1 = 0, h2 = 0;
+        if (height(p.pix, h1) && height(n.pix, h2) && p.h > h1 && n.h <= h2) {
+          double ta = p.t, tb = n.t;
+          while (tb - ta > tol) {
+            double tm = 0.5 * (ta + tb);
+            RayPoint m = ray_point(m_georef, ctr, dir, tm);
+            double hm = 0;
+            if (height(m.pix, hm) && m.h <= hm)
+              tb = tm;
+            else
+              ta = tm;
+          }
+          xyz = ctr + tb * dir;
+          return true;
+        }
+        p = n;
+      }
+    } catch (...) {
+      // The georeference may fail far from the DEM
+    }
+
+    return false;
+  }
+
+  void DemRayIntersector::intersect(std::vector<Vector3> const& ctrs,
+                                    std::vector<Vector3> const& dirs,
+                                    int num_threads,
+                                    std::vector<Vector3> & xyz) const {
+
+    if (ctrs.size() != dirs.size())
+      vw_throw(ArgumentErr() << "Expecting as many ray directions as centers.\n");
+
+    xyz.assign(ctrs.size(), Vector3());
+    if (num_threads <= 0)
+      num_threads = vw_settings().default_num_threads();
+
+    // Enough tasks to balance the load, each with many rays
+    size_t num_tasks = std::max(size_t(1), std::min(ctrs.size() / 100 + 1,
+                                                    size_t(16 * num_threads)));
+    size_t chunk = (ctrs.size() + num_tasks - 1) / num_tasks;
+    vw::FifoWorkQueue queue(num_threads);
+    for (size_t beg = 0; beg < ctrs.size(); beg += chunk) {
+      size_t end = std::min(beg + chunk, ctrs.size());
+      queue.add_task(boost::shared_ptr<IntersectRaysTask>
+                     (new IntersectRaysTask(*this, ctrs, dirs, beg, end, xyz)));
+    }
+    queue.join_all();
+  }
+
+} // end namespace asp
@@ -0,0 +1,96 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemRayIntersect.h
+///
+/// Intersect rays with a DEM kept in memory. A pyramid stores the
+/// largest height of each block of DEM cells, with the block size
+/// doubling at each level. A ray is marched from where it enters the
+/// range of DEM heights, skipping at once any block it passes above,
+/// and is sampled finely only close to the terrain. The first place
+/// where the ray goes below the bilinearly interpolated DEM is then
+/// found by bisection. Unlike with a solver started from a guess, the
+/// result is the first intersection along the ray.
+
+#ifndef __ASP_CORE_DEM_RAY_INTERSECT_H__
+#define __ASP_CORE_DEM_RAY_INTERSECT_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// Copies share the DEM and the pyramid, and have their own
+  /// georeferences, which are not thread-safe, so each thread must use
+  /// its own copy.
+  class DemRayIntersector {
+  public:
+
+    /// An empty DEM, which no ray meets
+    DemRayIntersector();
+
+    /// Load the DEM into memory and build the pyramid. The DEM is read
+    /// in parallel.
+    DemRayIntersector(vw::ImageViewRef<vw::PixelMask<double>> const& dem,
+                      vw::cartography::GeoReference const& georef);
+
+    vw::cartography::GeoReference const& georef() const { return m_georef; }
+
+    int cols() const { return m_dem.cols(); }
+    int rows() const { return m_dem.rows(); }
+
+    /// The range of the valid heights. If there are none, the smallest
+    /// is larger than the largest.
+    double min_height() const { return m_min_height; }
+    double max_height() const { return m_max_height; }
+
+    /// The DEM height at a pixel, bilinearly interpolated. Return false
+    /// if the pixel is outside the DEM or next to a no-data value.
+    bool height(vw::Vector2 const& pix, double & h) const;
+
+    /// Find the first point where the ray from ctr along dir meets the
+    /// DEM, to within a millimeter. Return false if there is none.
+    bool intersect(vw::Vector3 const& ctr, vw::Vector3 const& dir,
+                   vw::Vector3 & xyz) const;
+
+    /// Intersect many rays in parallel. Where a ray misses the DEM,
+    /// the result is the zero vector.
+    void intersect(std::vector<vw::Vector3> const& ctrs,
+                   std::vector<vw::Vector3> const& dirs,
+                   int num_threads,
+                   std::vector<vw::Vector3> & xyz) const;
+
+  private:
+    vw::cartography::GeoReference m_georef;
+    vw::ImageView<float> m_dem; // no-data is NaN
+
+    // Level k has the largest height of each block of 2^k by 2^k DEM
+    // cells. A cell spans four DEM pixels, and is -Inf if any is no-data.
+    std::vector<vw::ImageView<float>> m_max;
+
+    double m_min_height, m_max_height;
+    double m_pixel_size; // about the size of a DEM pixel, in meters
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DEM_RAY_INTERSECT_H__
@@ -0,0 +1,281 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemTileStore.cc
+///
+
+#include <asp/Core/DemTileStore.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    // Neighboring tiles share a row and column of pixels
+    const int TILE_STRIDE = DemTileStore::TILE_SIZE - 1;
+
+    // Spread the bits of x apart, putting zeros in the odd positions
+    std::uint64_t spread_bits(std::uint32_t x) {
+      std::uint64_t v = x;
+      v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+      v = (v | (v <<  8)) & 0x00FF00FF00FF00FFULL;
+      v = (v | (v <<  4)) & 0x0F0F0F0F0F0F0F0FULL;
+      v = (v | (v <<  2)) & 0x3333333333333333ULL;
+      v = (v | (v <<  1)) & 0x5555555555555555ULL;
+      return v;
+    }
+  }
+
+  std::uint64_t morton_code(std::uint32_t x, std::uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+  }
+
+  void blocked_grid_order(BBox2i const& box, int block_size,
+                          std::vector<Vector2i> & points) {
+    if (block_size <= 0)
+      vw_throw(ArgumentErr() << "The block size must be positive.\n");
+
+    points.clear();
+    if (box.empty())
+      return;
+
+    int num_block_cols = (box.width()  + block_size - 1) / block_size;
+    int num_block_rows = (box.height() + block_size - 1) / block_size;
+    std::vector<std::pair<std::uint64_t, Vector2i>> blocks;
+    for (int r = 0; r < num_block_rows; r++)
+      for (int c = 0; c < num_block_cols; c++)
+        blocks.push_back(std::make_pair(morton_code(c, r), Vector2i(c, r)));
+    std::sort(blocks.begin(), blocks.end(),
+              [](std::pair<std::uint64_t, Vector2i> const& a,
+                 std::pair<std::uint64_t, Vector2i> const& b) { return a.first < b.first; });
+
+    points.reserve(std::int64_t(box.width()) * box.height());
+    for (size_t it = 0; it < blocks.size(); it++) {
+      int beg_col = box.min().x() + blocks[it].second.x() * block_size;
+      int beg_row = box.min().y() + blocks[it].second.y() * block_size;
+      int end_col = std::min(beg_col + block_size, box.max().x());
+      int end_row = std::min(beg_row + block_size, box.max().y());
+      for (int row = beg_row; row < end_row; row++)
+        for (int col = beg_col; col < end_col; col++)
+          points.push_back(Vector2i(col, row));
+    }
+  }
+
+  // The tiles, with the most recently used at the front of the list
+  struct DemTileStore::Cache {
+    std::mutex mutex;
+    size_t max_tiles;
+    std::int64_t num_reads;
+    std::list<std::int64_t> lru;
+    std::unordered_map<std::int64_t,
+                       std::pair<TilePtr, std::list<std::int64_t>::iterator>> tiles;
+  };
+
+  DemTileStore::DemTileStore(): m_cols(0), m_rows(0), m_num_tile_cols(0), m_num_tile_rows(0),
+                                m_cache(new Cache) {
+    m_cache->max_tiles = 1;
+    m_cache->num_reads = 0;
+  }
+
+  DemTileStore::DemTileStore(ImageViewRef<PixelMask<float>> const& dem, double cache_mb):
+    m_dem(dem), m_cols(dem.cols()), m_rows(dem.rows()), m_cache(new Cache) {
+    // The last tile must start before the last pixel, so that the
+    // pixel before that and the last one are in the same tile
+    m_num_tile_cols = std::max(m_cols - 2, 0) / TILE_STRIDE + 1;
+    m_num_tile_rows = std::max(m_rows - 2, 0) / TILE_STRIDE + 1;
+    double tile_mb = double(TILE_SIZE) * TILE_SIZE * sizeof(float) / (1024.0 * 1024.0);
+    m_cache->max_tiles = std::max(size_t(cache_mb / tile_mb), size_t(1));
+    m_cache->num_reads = 0;
+  }
+
+  std::int64_t DemTileStore::num_tile_reads() const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    return m_cache->num_reads;
+  }
+
+  void DemTileStore::tile_of(int col, int row, int & tile_col, int & tile_row) const {
+    tile_col = std::min(col / TILE_STRIDE, m_num_tile_cols - 1);
+    tile_row = std::min(row / TILE_STRIDE, m_num_tile_rows - 1);
+  }
+
+  DemTileStore::TilePtr DemTileStore::tile(int tile_col, int tile_row) const {
+
+    std::int64_t key = std::int64_t(tile_row) * m_num_tile_cols + tile_col;
+    {
+      std::lock_guard<std::mutex> lock(m_cache->mutex);
+      auto it = m_cache->tiles.find(key);
+      if (it != m_cache->tiles.end()) {
+        m_cache->lru.splice(m_cache->lru.begin(), m_cache->lru, it->second.second);
+        return it->second.first;
+      }
+    }
+
+    // Read the tile without holding the lock, so that other threads
+    // can use the tiles already read. Two threads may read the same
+    // tile at once, and then the second one is discarded.
+    BBox2i box(tile_col * TILE_STRIDE, tile_row * TILE_STRIDE, TILE_SIZE, TILE_SIZE);
+    box.crop(bounding_box(m_dem));
+    ImageView<PixelMask<float>> region = crop(m_dem, box);
+    boost::shared_ptr<std::vector<float>>
+      data(new std::vector<float>(TILE_SIZE * TILE_SIZE,
+                                  std::numeric_limits<float>::quiet_NaN()));
+    for (int row = 0; row < region.rows(); row++) {
+      for (int col = 0; col < region.cols(); col++) {
+        if (is_valid(region(col, row)))
+          (*data)[morton_code(col, row)] = region(col, row).child();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    m_cache->num_reads++;
+    auto it = m_cache->tiles.find(key);
+    if (it != m_cache->tiles.end())
+      return it->second.first;
+    while (m_cache->tiles.size() >= m_cache->max_tiles) {
+      m_cache->tiles.erase(m_cache->lru.back());
+      m_cache->lru.pop_back();
+    }
+    m_cache->lru.push_front(key);
+    TilePtr tile_ptr = data;
+    m_cache->tiles[key] = std::make_pair(tile_ptr, m_cache->lru.begin());
+    return tile_ptr;
+  }
+
+  PixelMask<float> DemTileStore::pixel(int col, int row) const {
+    if (col < 0 || col >= m_cols || row < 0 || row >= m_rows)
+      vw_throw(ArgumentErr() << "Pixel (" << col << ", " << row << ") is outside the DEM.\n");
+    int tile_col, tile_row;
+    tile_of(col, row, tile_col, tile_row);
+    float val = (*tile(tile_col, tile_row))[morton_code(col - tile_col * TILE_STRIDE,
+                                                        row - tile_row * TILE_STRIDE)];
+    PixelMask<float> ans(val);
+    if (std::isnan(val))
+      ans.invalidate();
+    return ans;
+  }
+
+  namespace {
+    // Interpolate bilinearly in a tile, at a position relative to the
+    // tile origin, which must have a pixel to its right and below it
+    double interp_in_tile(std::vector<float> const& tile, double x, double y) {
+      int c = int(floor(x)), r = int(floor(y));
+      double a = x - c, b = y - r;
+      return (1.0 - a) * (1.0 - b) * tile[morton_code(c,     r    )]
+        +    a         * (1.0 - b) * tile[morton_code(c + 1, r    )]
+        +    (1.0 - a) * b         * tile[morton_code(c,     r + 1)]
+        +    a         * b         * tile[morton_code(c + 1, r + 1)];
+    }
+  }
+
+  bool DemTileStore::height(Vector2 const& pix, double & h) const {
+    // Same bounds as interpolating the DEM image
+    if (!(pix[0] >= 0 && pix[0] < m_cols - 1 && pix[1] >= 0 && pix[1] < m_rows - 1))
+      return false;
+    int tile_col, tile_row;
+    tile_of(int(pix[0]), int(pix[1]), tile_col, tile_row);
+    h = interp_in_tile(*tile(tile_col, tile_row),
+                       pix[0] - tile_col * TILE_STRIDE, pix[1] - tile_row * TILE_STRIDE);
+    return !std::isnan(h); // NaN if any of the four pixels is no-data
+  }
+
+  void DemTileStore::heights(std::vector<Vector2> const& pixels,
+                             std::vector<double> & heights) const {
+
+    heights.assign(pixels.size(), std::numeric_limits<double>::quiet_NaN());
+
+    // Visit the pixels tile by tile, with the tiles in Z-order, so
+    // that the tiles used together are near each other
+    std::vector<std::pair<std::uint64_t, size_t>> order;
+    order.reserve(pixels.size());
+    for (size_t it = 0; it < pixels.size(); it++) {
+      Vector2 const& pix = pixels[it];
+      if (!(pix[0] >= 0 && pix[0] < m_cols - 1 && pix[1] >= 0 && pix[1] < m_rows - 1))
+        continue;
+      int tile_col, tile_row;
+      tile_of(int(pix[0]), int(pix[1]), tile_col, tile_row);
+      order.push_back(std::make_pair(morton_code(tile_col, tile_row), it));
+    }
+    std::sort(order.begin(), order.end());
+
+    TilePtr curr_tile;
+    std::uint64_t curr_code = 0;
+    for (size_t it = 0; it < order.size(); it++) {
+      Vector2 const& pix = pixels[order[it].second];
+      int tile_col, tile_row;
+      tile_of(int(pix[0]), int(pix[1]), tile_col, tile_row);
+      if (curr_tile.get() == NULL || order[it].first != curr_code) {
+        curr_tile = tile(tile_col, tile_row);
+        curr_code = order[it].first;
+      }
+      heights[order[it].second]
+        = interp_in_tile(*curr_tile, pix[0] - tile_col * TILE_STRIDE,
+                         pix[1] - tile_row * TILE_STRIDE);
+    }
+  }
+
+  void DemTileStore::read(BBox2i const& box, ImageView<PixelMask<float>> & out) const {
+    out.set_size(box.width(), box.height());
+    for (int row = 0; row < out.rows(); row++)
+      for (int col = 0; col < out.cols(); col++)
+        out(col, row).invalidate();
+
+    BBox2i dem_box = box;
+    dem_box.crop(BBox2i(0, 0, m_cols, m_rows));
+    if (dem_box.empty())
+      return;
+
+    // Copy from one tile at a time
+    int beg_tile_col, beg_tile_row, end_tile_col, end_tile_row;
+    tile_of(dem_box.min().x(),     dem_box.min().y(),     beg_tile_col, beg_tile_row);
+    tile_of(dem_box.max().x() - 1, dem_box.max().y() - 1, end_tile_col, end_tile_row);
+    for (int tile_row = beg_tile_row; tile_row <= end_tile_row; tile_row++) {
+      for (int tile_col = beg_tile_col; tile_col <= end_tile_col; tile_col++) {
+        // The pixels for which this is the tile given by tile_of()
+        BBox2i tile_box(tile_col * TILE_STRIDE, tile_row * TILE_STRIDE,
+                        TILE_STRIDE, TILE_STRIDE);
+        if (tile_col == m_num_tile_cols - 1)
+          tile_box.max().x() = m_cols;
+        if (tile_row == m_num_tile_rows - 1)
+          tile_box.max().y() = m_rows;
+        tile_box.crop(dem_box);
+        if (tile_box.empty())
+          continue;
+        TilePtr curr_tile = tile(tile_col, tile_row);
+        for (int row = tile_box.min().y(); row < tile_box.max().y(); row++) {
+          for (int col = tile_box.min().x(); col < tile_box.max().x(); col++) {
+            float val = (*curr_tile)[morton_code(col - tile_col * TILE_STRIDE,
+                                                 row - tile_row * TILE_STRIDE)];
+            if (!std::isnan(val))
+              out(col - box.min().x(), row - box.min().y()) = PixelMask<float>(val);
+          }
+        }
+      }
+    }
+  }
+
+} // end namespace asp
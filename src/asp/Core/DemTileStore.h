@@ -0,0 +1,149 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemTileStore.h
+///
+/// Look up heights in a DEM from many places at random, as done when
+/// comparing points to a DEM. Reading single pixels through the block
+/// cache of a disk image decodes the same blocks again and again. Here
+/// the DEM is read in tiles of TILE_SIZE x TILE_SIZE pixels, which
+/// overlap by one pixel, so that bilinear interpolation never needs
+/// two tiles. Within a tile the heights are stored in Z-order (Morton
+/// order), so the four pixels used for interpolation are close
+/// together in memory. At most a given amount of memory is used for
+/// tiles, and the least recently used tiles are dropped first. When
+/// the whole DEM fits, it is read only once.
+
+#ifndef __ASP_CORE_DEM_TILE_STORE_H__
+#define __ASP_CORE_DEM_TILE_STORE_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace asp {
+
+  /// Interleave the bits of x and y, with those of x in the even
+  /// positions
+  std::uint64_t morton_code(std::uint32_t x, std::uint32_t y);
+
+  /// The grid points in a box, in square blocks of the given size. The
+  /// blocks are in Morton order, and the points of each block are in
+  /// row-major order. Work done in this order on an image that is
+  /// stored row by row touches a few rows at a time.
+  void blocked_grid_order(vw::BBox2i const& box, int block_size,
+                          std::vector<vw::Vector2i> & points);
+
+  /// Copies share the tiles. All functions can be called from several
+  /// threads at once.
+  class DemTileStore {
+  public:
+
+    static const int TILE_SIZE = 256;
+
+    /// An empty DEM, with no valid heights
+    DemTileStore();
+
+    /// Read tiles of this DEM when first needed, keeping at most
+    /// 'cache_mb' megabytes of them
+    DemTileStore(vw::ImageViewRef<vw::PixelMask<float>> const& dem, double cache_mb = 1024.0);
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    /// The DEM value at a pixel, which must be in the DEM
+    vw::PixelMask<float> pixel(int col, int row) const;
+
+    /// The DEM height at a pixel, bilinearly interpolated. Return false
+    /// if the pixel is outside the DEM or next to a no-data value.
+    bool height(vw::Vector2 const& pix, double & h) const;
+
+    /// The heights at many pixels, with each needed tile looked up
+    /// once. Where there is no height, the result is NaN.
+    void heights(std::vector<vw::Vector2> const& pixels, std::vector<double> & heights) const;
+
+    /// Copy a region of the DEM
+    void read(vw::BBox2i const& box, vw::ImageView<vw::PixelMask<float>> & out) const;
+
+    /// How many times a tile was read from the DEM
+    std::int64_t num_tile_reads() const;
+
+  private:
+    typedef boost::shared_ptr<const std::vector<float>> TilePtr; // no-data is NaN
+    struct Cache;
+
+    // The tile with given index, read if not in the cache
+    TilePtr tile(int tile_col, int tile_row) const;
+
+    // The tile having the pixel and the pixel to its right and below
+    // it, if these exist
+    void tile_of(int col, int row, int & tile_col, int & tile_row) const;
+
+    vw::ImageViewRef<vw::PixelMask<float>> m_dem;
+    int m_cols, m_rows, m_num_tile_cols, m_num_tile_rows;
+    boost::shared_ptr<Cache> m_cache;
+  };
+
+  /// A DemTileStore as an image, to be interpolated as any other
+  class DemTileView: public vw::ImageViewBase<DemTileView> {
+    DemTileStore m_store;
+
+  public:
+    typedef vw::PixelMask<float> pixel_type;
+    typedef pixel_type           result_type;
+    typedef vw::ProceduralPixelAccessor<DemTileView> pixel_accessor;
+
+    DemTileView(DemTileStore const& store): m_store(store) {}
+
+    inline vw::int32 cols  () const { return m_store.cols(); }
+    inline vw::int32 rows  () const { return m_store.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 /*p*/ = 0) const {
+      return m_store.pixel(i, j);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> region;
+      m_store.read(bbox, region);
+      return prerasterize_type(region, vw::BBox2i(-bbox.min().x(), -bbox.min().y(),
+                                                  cols(), rows()));
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DEM_TILE_STORE_H__
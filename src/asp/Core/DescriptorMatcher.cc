@@ -0,0 +1,260 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/DescriptorMatcher.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/Matrix.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace asp {
+
+  // The number of values in each descriptor. All must have the same length.
+  int descriptor_length(std::vector<vw::ip::InterestPoint> const& ip) {
+    if (ip.empty())
+      return 0;
+    int len = ip[0].descriptor.size();
+    for (size_t it = 0; it < ip.size(); it++) {
+      if (int(ip[it].descriptor.size()) != len)
+        vw::vw_throw(vw::ArgumentErr() << "All interest point descriptors "
+                     << "must have the same length.\n");
+    }
+    return len;
+  }
+
+  BruteForceL2Matcher::BruteForceL2Matcher(std::vector<vw::ip::InterestPoint> const& ip):
+    m_num(ip.size()), m_len(descriptor_length(ip)) {
+    m_data.resize(size_t(m_num) * m_len);
+    for (int it = 0; it < m_num; it++)
+      for (int c = 0; c < m_len; c++)
+        m_data[size_t(it) * m_len + c] = ip[it].descriptor[c];
+  }
+
+  bool BruteForceL2Matcher::find_two_nearest(vw::ip::InterestPoint::descriptor_type const&
+                                             descriptor,
+                                             int & nearest, double & dist1,
+                                             double & dist2) const {
+    nearest = -1;
+    dist1 = dist2 = std::numeric_limits<double>::max();
+    if (m_num < 2)
+      return false;
+    if (int(descriptor.size()) != m_len)
+      vw::vw_throw(vw::ArgumentErr() << "Mismatched interest point descriptor lengths.\n");
+
+    // Copy the query to have it contiguous too
+    std::vector<float> query(m_len);
+    for (int c = 0; c < m_len; c++)
+      query[c] = descriptor[c];
+
+    for (int it = 0; it < m_num; it++) {
+      float const* data = &m_data[size_t(it) * m_len];
+      double dist = 0.0;
+      for (int c = 0; c < m_len; c++) {
+        double diff = query[c] - data[c];
+        dist += diff * diff;
+        if (dist >= dist2)
+          break; // cannot be one of the two nearest
+      }
+      if (dist < dist1) {
+        dist2   = dist1;
+        dist1   = dist;
+        nearest = it;
+      } else if (dist < dist2) {
+        dist2 = dist;
+      }
+    }
+    return true;
+  }
+
+  BruteForceHammingMatcher::BruteForceHammingMatcher(std::vector<vw::ip::InterestPoint>
+                                                     const& ip):
+    m_num(ip.size()), m_len(descriptor_length(ip)) {
+    m_num_words = (m_len + 7) / 8;
+    m_data.resize(size_t(m_num) * m_num_words);
+    for (int it = 0; it < m_num; it++)
+      pack(ip[it].descriptor, &m_data[size_t(it) * m_num_words]);
+  }
+
+  void BruteForceHammingMatcher::pack(vw::ip::InterestPoint::descriptor_type const&
+                                      descriptor, std::uint64_t * words) const {
+    if (int(descriptor.size()) != m_len)
+      vw::vw_throw(vw::ArgumentErr() << "Mismatched interest point descriptor lengths.\n");
+    for (int w = 0; w < m_num_words; w++)
+      words[w] = 0;
+    for (int c = 0; c < m_len; c++) {
+      std::uint64_t byte = static_cast<unsigned char>(descriptor[c]);
+      words[c / 8] |= (byte << (8 * (c % 8)));
+    }
+  }
+
+  bool BruteForceHammingMatcher::find_two_nearest(vw::ip::InterestPoint::descriptor_type const&
+                                                  descriptor,
+                                                  int & nearest, double & dist1,
+                                                  double & dist2) const {
+    nearest = -1;
+    dist1 = dist2 = std::numeric_limits<double>::max();
+    if (m_num < 2)
+      return false;
+
+    std::vector<std::uint64_t> query(m_num_words);
+    pack(descriptor, &query[0]);
+
+    // Integer counts are exact, so compare them as integers
+    int best1 = std::numeric_limits<int>::max(), best2 = best1;
+    for (int it = 0; it < m_num; it++) {
+      std::uint64_t const* data = &m_data[size_t(it) * m_num_words];
+      int dist = 0;
+      for (int w = 0; w < m_num_words; w++)
+        dist += __builtin_popcountll(query[w] ^ data[w]);
+      if (dist < best1) {
+        best2   = best1;
+        best1   = dist;
+        nearest = it;
+      } else if (dist < best2) {
+        best2 = dist;
+      }
+    }
+    dist1 = best1;
+    dist2 = best2;
+    return true;
+  }
+
+  FlannMatcher::FlannMatcher(std::vector<vw::ip::InterestPoint> const& ip, bool binary):
+    m_binary(binary), m_num(ip.size()) {
+
+    if (m_num < 2)
+      return; // nothing to search
+
+    int len = descriptor_length(ip);
+    if (m_binary) {
+      vw::Matrix<unsigned char> data(m_num, len);
+      for (int it = 0; it < m_num; it++)
+        for (int c = 0; c < len; c++)
+          data(it, c) = static_cast<unsigned char>(ip[it].descriptor[c]);
+      m_tree_uchar.load_match_data(data, vw::math::FLANN_DistType_Hamming);
+    } else {
+      vw::Matrix<float> data(m_num, len);
+      for (int it = 0; it < m_num; it++)
+        for (int c = 0; c < len; c++)
+          data(it, c) = ip[it].descriptor[c];
+      m_tree_float.load_match_data(data, vw::math::FLANN_DistType_L2);
+    }
+  }
+
+  bool FlannMatcher::find_two_nearest(vw::ip::InterestPoint::descriptor_type const&
+                                      descriptor,
+                                      int & nearest, double & dist1,
+                                      double & dist2) const {
+    nearest = -1;
+    dist1 = dist2 = std::numeric_limits<double>::max();
+    if (m_num < 2)
+      return false;
+
+    const size_t knn = 2;
+    vw::Vector<int>    indices(knn);
+    vw::Vector<double> distances(knn);
+    size_t num_found = 0;
+    if (m_binary) {
+      vw::Vector<unsigned char> query(descriptor.size());
+      for (size_t c = 0; c < descriptor.size(); c++)
+        query[c] = static_cast<unsigned char>(descriptor[c]);
+      num_found = m_tree_uchar.knn_search(query, indices, distances, knn);
+    } else {
+      num_found = m_tree_float.knn_search(descriptor, indices, distances, knn);
+    }
+    if (num_found < knn)
+      return false;
+
+    nearest = indices[0];
+    dist1   = distances[0];
+    dist2   = distances[1];
+    return true;
+  }
+
+  boost::shared_ptr<DescriptorMatcher>
+  make_descriptor_matcher(std::vector<vw::ip::InterestPoint> const& ip,
+                          std::string const& method, bool binary) {
+
+    if (method == "brute-force") {
+      if (binary)
+        return boost::shared_ptr<DescriptorMatcher>(new BruteForceHammingMatcher(ip));
+      return boost::shared_ptr<DescriptorMatcher>(new BruteForceL2Matcher(ip));
+    }
+
+    if (method == "flann")
+      return boost::shared_ptr<DescriptorMatcher>(new FlannMatcher(ip, binary));
+
+    vw::vw_throw(vw::ArgumentErr() << "Unknown interest point matching method: "
+                 << method << ". Use 'brute-force' or 'flann'.\n");
+    return boost::shared_ptr<DescriptorMatcher>();
+  }
+
+  // Match a range of interest points. Each task writes only its part of
+  // the output.
+  class MatchDescriptorsTask: public vw::Task, private boost::noncopyable {
+    std::vector<vw::ip::InterestPoint> const& m_ip1;
+    DescriptorMatcher const& m_matcher;
+    double m_uniqueness_threshold;
+    int m_beg, m_end;
+    std::vector<int> & m_match_index;
+  public:
+    MatchDescriptorsTask(std::vector<vw::ip::InterestPoint> const& ip1,
+                         DescriptorMatcher const& matcher, double uniqueness_threshold,
+                         int beg, int end, std::vector<int> & match_index):
+      m_ip1(ip1), m_matcher(matcher), m_uniqueness_threshold(uniqueness_threshold),
+      m_beg(beg), m_end(end), m_match_index(match_index) {}
+
+    void operator()() {
+      for (int it = m_beg; it < m_end; it++) {
+        int nearest = -1;
+        double dist1 = 0.0, dist2 = 0.0;
+        m_match_index[it] = -1;
+        if (!m_matcher.find_two_nearest(m_ip1[it].descriptor, nearest, dist1, dist2))
+          continue;
+        if (dist1 < m_uniqueness_threshold * dist2)
+          m_match_index[it] = nearest;
+      }
+    }
+  };
+
+  void match_descriptors(std::vector<vw::ip::InterestPoint> const& ip1,
+                         DescriptorMatcher const& matcher,
+                         double uniqueness_threshold, int num_threads,
+                         std::vector<int> & match_index) {
+
+    int num_ip = ip1.size();
+    match_index.assign(num_ip, -1);
+    if (num_ip == 0)
+      return;
+
+    // Several tasks per thread, in case some finish sooner
+    int num_tasks = std::min(num_ip, 4 * std::max(num_threads, 1));
+    vw::FifoWorkQueue queue(std::max(num_threads, 1));
+    for (int task = 0; task < num_tasks; task++) {
+      int beg = (long long)(num_ip) * task / num_tasks;
+      int end = (long long)(num_ip) * (task + 1) / num_tasks;
+      queue.add_task(boost::shared_ptr<MatchDescriptorsTask>
+                     (new MatchDescriptorsTask(ip1, matcher, uniqueness_threshold,
+                                               beg, end, match_index)));
+    }
+    queue.join_all();
+  }
+
+} // end namespace asp
@@ -0,0 +1,126 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DescriptorMatcher.h
+///
+/// Find the nearest neighbors of interest point descriptors among the
+/// descriptors of another image, to match interest points.
+
+#ifndef __ASP_CORE_DESCRIPTOR_MATCHER_H__
+#define __ASP_CORE_DESCRIPTOR_MATCHER_H__
+
+#include <vw/InterestPoint/InterestData.h>
+#include <vw/Math/FLANNTree.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The descriptors of the interest points of one image, packed for
+  /// searching. Once built, it is not modified, so it can be searched
+  /// from several threads, and reused for all the pairs the image is in.
+  class DescriptorMatcher {
+  public:
+    virtual ~DescriptorMatcher() {}
+
+    /// Find the nearest and second nearest descriptor to the given one.
+    /// The distance is the squared L2 distance, or the number of
+    /// differing bits for binary descriptors. Return false if there are
+    /// fewer than two descriptors to search.
+    virtual bool find_two_nearest(vw::ip::InterestPoint::descriptor_type const& descriptor,
+                                  int & nearest, double & dist1,
+                                  double & dist2) const = 0;
+
+    virtual int size() const = 0;
+  };
+
+  /// Search all descriptors. The descriptors are stored contiguously,
+  /// and the search stops early for a descriptor once it is farther
+  /// than the second nearest one so far.
+  class BruteForceL2Matcher: public DescriptorMatcher {
+  public:
+    BruteForceL2Matcher(std::vector<vw::ip::InterestPoint> const& ip);
+    virtual bool find_two_nearest(vw::ip::InterestPoint::descriptor_type const& descriptor,
+                                  int & nearest, double & dist1,
+                                  double & dist2) const;
+    virtual int size() const { return m_num; }
+  private:
+    int m_num, m_len;
+    std::vector<float> m_data;
+  };
+
+  /// Search all binary descriptors, such as from ORB, where each value
+  /// is a byte. The bytes are packed into 64-bit words, and the differing
+  /// bits are counted a word at a time.
+  class BruteForceHammingMatcher: public DescriptorMatcher {
+  public:
+    BruteForceHammingMatcher(std::vector<vw::ip::InterestPoint> const& ip);
+    virtual bool find_two_nearest(vw::ip::InterestPoint::descriptor_type const& descriptor,
+                                  int & nearest, double & dist1,
+                                  double & dist2) const;
+    virtual int size() const { return m_num; }
+
+    /// Pack a descriptor as done for the database
+    void pack(vw::ip::InterestPoint::descriptor_type const& descriptor,
+              std::uint64_t * words) const;
+  private:
+    int m_num, m_len, m_num_words;
+    std::vector<std::uint64_t> m_data;
+  };
+
+  /// Approximate search with a FLANN index, using the Hamming distance
+  /// for binary descriptors. This is faster for many interest points,
+  /// but may miss some matches.
+  class FlannMatcher: public DescriptorMatcher {
+  public:
+    FlannMatcher(std::vector<vw::ip::InterestPoint> const& ip, bool binary);
+    virtual bool find_two_nearest(vw::ip::InterestPoint::descriptor_type const& descriptor,
+                                  int & nearest, double & dist1,
+                                  double & dist2) const;
+    virtual int size() const { return m_num; }
+  private:
+    bool m_binary;
+    int m_num;
+    // The search does not change the trees, but their API is not const
+    mutable vw::math::FLANNTree<float>         m_tree_float;
+    mutable vw::math::FLANNTree<unsigned char> m_tree_uchar;
+  };
+
+  /// Make a matcher for these interest points. The method is
+  /// "brute-force" or "flann". Binary descriptors, such as for ORB,
+  /// use the Hamming distance.
+  boost::shared_ptr<DescriptorMatcher>
+  make_descriptor_matcher(std::vector<vw::ip::InterestPoint> const& ip,
+                          std::string const& method, bool binary);
+
+  /// For each interest point in ip1, find its nearest neighbor with the
+  /// matcher, and keep the match if the distance to it is less than
+  /// uniqueness_threshold times the distance to the second nearest.
+  /// Set match_index[i] to the index of the match of ip1[i], or to -1.
+  /// This is done in parallel.
+  void match_descriptors(std::vector<vw::ip::InterestPoint> const& ip1,
+                         DescriptorMatcher const& matcher,
+                         double uniqueness_threshold, int num_threads,
+                         std::vector<int> & match_index);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DESCRIPTOR_MATCHER_H__
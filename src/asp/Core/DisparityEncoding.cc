@@ -0,0 +1,169 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityEncoding.cc
+///
+
+#include <asp/Core/DisparityEncoding.h>
+#include <asp/Core/StereoSettings.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/StringUtils.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/PixelMath.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+  bool use_compact_disparity() {
+    return stereo_settings().compact_disparity &&
+      stereo_settings().seed_mode > 0 &&
+      stereo_settings().alignment_method != "local_epipolar";
+  }
+
+  // FNV-1a over the size, and the validity and bits of each pixel
+  std::string disparity_seed_hash(ImageView<PixelMask<Vector2f>> const& sub_disp) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](uint32_t val) {
+      for (int b = 0; b < 4; b++) {
+        hash ^= (val >> (8 * b)) & 0xff;
+        hash *= 1099511628211ULL;
+      }
+    };
+    add(sub_disp.cols());
+    add(sub_disp.rows());
+    for (int row = 0; row < sub_disp.rows(); row++) {
+      for (int col = 0; col < sub_disp.cols(); col++) {
+        PixelMask<Vector2f> const& d = sub_disp(col, row);
+        add(is_valid(d));
+        if (!is_valid(d))
+          continue;
+        for (int it = 0; it < 2; it++) {
+          uint32_t bits;
+          float val = d.child()[it];
+          std::memcpy(&bits, &val, sizeof(bits));
+          add(bits);
+        }
+      }
+    }
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return os.str();
+  }
+
+  std::map<std::string, std::string>
+  compact_disparity_keywords(ImageView<PixelMask<Vector2f>> const& sub_disp,
+                             Vector2 const& seed_scale, Vector2i const& origin,
+                             double quantum) {
+    std::map<std::string, std::string> keywords;
+    keywords[ASP_DISP_ENCODING_TAG_STR] = DISP_ENCODING_SEED_RESIDUAL;
+
+    std::ostringstream scale, seed, orig;
+    scale.precision(17);
+    seed.precision(17);
+    scale << quantum;
+    seed << seed_scale[0] << " " << seed_scale[1];
+    orig << origin[0] << " " << origin[1];
+    keywords[ASP_DISP_SCALE_TAG_STR]      = scale.str();
+    keywords[ASP_DISP_SEED_SCALE_TAG_STR] = seed.str();
+    keywords[ASP_DISP_ORIGIN_TAG_STR]     = orig.str();
+    keywords[ASP_DISP_SEED_HASH_TAG_STR]  = disparity_seed_hash(sub_disp);
+    return keywords;
+  }
+
+  std::string disparity_seed_file(std::string const& disp_file) {
+    std::string stem = boost::filesystem::path(disp_file).replace_extension("").string();
+    size_t pos = stem.rfind("-");
+    if (pos == std::string::npos)
+      vw_throw(ArgumentErr() << "Cannot find the output prefix of: " << disp_file << ".\n");
+    return stem.substr(0, pos) + "-D_sub.tif";
+  }
+
+  // Only GDAL files, such as GeoTiff, can be in the compact format
+  bool read_disparity_encoding(DiskImageResource const& rsrc, std::string & encoding) {
+    return dynamic_cast<DiskImageResourceGDAL const*>(&rsrc) != NULL &&
+      cartography::read_header_string(rsrc, ASP_DISP_ENCODING_TAG_STR, encoding);
+  }
+
+  bool is_compact_disparity(std::string const& disp_file) {
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(disp_file));
+    std::string encoding;
+    return read_disparity_encoding(*rsrc.get(), encoding);
+  }
+
+  ImageViewRef<PixelMask<Vector2f>> read_disparity(std::string const& disp_file) {
+
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(disp_file));
+    std::string encoding;
+    if (!read_disparity_encoding(*rsrc.get(), encoding)) {
+      if (rsrc->channel_type() == VW_CHANNEL_INT32) // Cast the integer file to float
+        return pixel_cast<PixelMask<Vector2f>>(DiskImageView<PixelMask<Vector2i>>(disp_file));
+      return DiskImageView<PixelMask<Vector2f>>(disp_file);
+    }
+
+    if (encoding != DISP_ENCODING_SEED_RESIDUAL)
+      vw_throw(ArgumentErr() << "Unknown disparity encoding " << encoding
+               << " in: " << disp_file << ".\n");
+
+    std::string scale_str, seed_scale_str, origin_str, hash_str;
+    if (!cartography::read_header_string(*rsrc.get(), ASP_DISP_SCALE_TAG_STR, scale_str) ||
+        !cartography::read_header_string(*rsrc.get(), ASP_DISP_SEED_SCALE_TAG_STR,
+                                         seed_scale_str) ||
+        !cartography::read_header_string(*rsrc.get(), ASP_DISP_ORIGIN_TAG_STR, origin_str) ||
+        !cartography::read_header_string(*rsrc.get(), ASP_DISP_SEED_HASH_TAG_STR, hash_str))
+      vw_throw(ArgumentErr() << "Incomplete disparity encoding in: " << disp_file << ".\n");
+
+    double quantum = atof(scale_str.c_str());
+    Vector2 seed_scale = str_to_vec<Vector2>(seed_scale_str);
+    Vector2 origin = str_to_vec<Vector2>(origin_str);
+    if (quantum <= 0.0 || seed_scale[0] <= 0.0 || seed_scale[1] <= 0.0)
+      vw_throw(ArgumentErr() << "Invalid disparity encoding in: " << disp_file << ".\n");
+
+    // The disparity was saved relative to D_sub, which must not have changed
+    std::string seed_file = disparity_seed_file(disp_file);
+    if (!boost::filesystem::exists(seed_file))
+      vw_throw(ArgumentErr() << "Cannot read " << disp_file << " without: "
+               << seed_file << ".\n");
+    ImageView<PixelMask<Vector2f>> sub_disp;
+    boost::shared_ptr<DiskImageResource> seed_rsrc(DiskImageResourcePtr(seed_file));
+    if (seed_rsrc->channel_type() == VW_CHANNEL_INT32)
+      sub_disp = pixel_cast<PixelMask<Vector2f>>(DiskImageView<PixelMask<Vector2i>>(seed_file));
+    else
+      sub_disp = DiskImageView<PixelMask<Vector2f>>(seed_file);
+    if (disparity_seed_hash(sub_disp) != hash_str)
+      vw_throw(ArgumentErr() << disp_file << " was saved relative to a different "
+               << seed_file << ". Redo correlation.\n");
+
+    DiskImageView<DispCodeT> codes(disp_file);
+    DisparitySeedView seed(sub_disp, seed_scale, Vector2i(origin[0], origin[1]),
+                           codes.cols(), codes.rows());
+    return per_pixel_view(codes, seed, DecodeDisparity(quantum));
+  }
+
+} // end namespace asp
@@ -0,0 +1,228 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityEncoding.h
+///
+/// Compact storage of the full-resolution disparities D.tif and RD.tif.
+/// Each pixel is saved as two 16-bit integers, the difference from a
+/// seed made by upsampling the low-resolution disparity D_sub, in units
+/// of a quantum. This difference is small even when the disparity is
+/// large, so it fits in 16 bits and compresses well. Invalid pixels
+/// have DISP_CODE_INVALID in the first band. The file records how it
+/// was saved, and read_disparity() gives back the disparity, to within
+/// half a quantum.
+
+#ifndef __ASP_CORE_DISPARITY_ENCODING_H__
+#define __ASP_CORE_DISPARITY_ENCODING_H__
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Core/Functors.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/FileIO/GdalWriteOptions.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+
+namespace asp {
+
+  // Tag names must be synced with parallel_stereo
+  const std::string ASP_DISP_ENCODING_TAG_STR   = "DISPARITY_ENCODING";
+  const std::string ASP_DISP_SCALE_TAG_STR      = "DISPARITY_SCALE";
+  const std::string ASP_DISP_SEED_SCALE_TAG_STR = "DISPARITY_SEED_SCALE";
+  const std::string ASP_DISP_ORIGIN_TAG_STR     = "DISPARITY_ORIGIN";
+  const std::string ASP_DISP_SEED_HASH_TAG_STR  = "DISPARITY_SEED_HASH";
+
+  /// The value of the encoding tag
+  const std::string DISP_ENCODING_SEED_RESIDUAL = "SEED_RESIDUAL_INT16";
+
+  /// The quanta for D.tif, which has integer disparities, and for
+  /// RD.tif. The latter keeps differences from the seed of up to
+  /// 1023 pixels.
+  const double D_DISP_QUANTUM  = 1.0;
+  const double RD_DISP_QUANTUM = 1.0/32.0;
+
+  typedef vw::Vector<vw::int16, 2> DispCodeT;
+  const vw::int16 DISP_CODE_INVALID = -32768;
+
+  /// If to save D.tif and RD.tif in the compact format. That needs
+  /// D_sub, and is not done with local epipolar alignment, as then
+  /// each tile has its own D_sub.
+  bool use_compact_disparity();
+
+  /// The seed disparity at each pixel of a region of the full-resolution
+  /// image. The low-resolution disparity at the corresponding pixel is
+  /// scaled and rounded to integers. Invalid pixels of D_sub give the
+  /// mean of the valid ones. The writer and the reader must compute
+  /// this the same way, so there is no interpolation.
+  class DisparitySeedView: public vw::ImageViewBase<DisparitySeedView> {
+    vw::ImageView<vw::PixelMask<vw::Vector2f>> m_sub_disp;
+    vw::Vector2  m_seed_scale;
+    vw::Vector2i m_origin;
+    int          m_cols, m_rows;
+    vw::Vector2f m_fill;
+
+  public:
+    typedef vw::Vector2f pixel_type;
+    typedef pixel_type   result_type;
+    typedef vw::ProceduralPixelAccessor<DisparitySeedView> pixel_accessor;
+
+    DisparitySeedView(vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp,
+                      vw::Vector2 const& seed_scale, vw::Vector2i const& origin,
+                      int cols, int rows):
+      m_sub_disp(sub_disp), m_seed_scale(seed_scale), m_origin(origin),
+      m_cols(cols), m_rows(rows) {
+      vw::Vector2 sum;
+      double count = 0;
+      for (int row = 0; row < m_sub_disp.rows(); row++) {
+        for (int col = 0; col < m_sub_disp.cols(); col++) {
+          if (!is_valid(m_sub_disp(col, row)))
+            continue;
+          sum += m_sub_disp(col, row).child();
+          count++;
+        }
+      }
+      if (count > 0)
+        m_fill = vw::Vector2f(std::round(sum[0] / count * m_seed_scale[0]),
+                              std::round(sum[1] / count * m_seed_scale[1]));
+    }
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 /*p*/ = 0) const {
+      int si = int(std::floor((i + m_origin[0]) / m_seed_scale[0]));
+      int sj = int(std::floor((j + m_origin[1]) / m_seed_scale[1]));
+      si = std::min(std::max(si, 0), m_sub_disp.cols() - 1);
+      sj = std::min(std::max(sj, 0), m_sub_disp.rows() - 1);
+      vw::PixelMask<vw::Vector2f> const& d = m_sub_disp(si, sj);
+      if (!is_valid(d))
+        return m_fill;
+      return result_type(std::round(d.child()[0] * m_seed_scale[0]),
+                         std::round(d.child()[1] * m_seed_scale[1]));
+    }
+
+    typedef DisparitySeedView prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& /*bbox*/) const { return *this; }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Save the difference from the seed in units of the quantum. Pixels
+  /// whose difference does not fit in 16 bits become invalid.
+  struct EncodeDisparity: public vw::ReturnFixedType<DispCodeT> {
+    double m_quantum;
+    EncodeDisparity(double quantum): m_quantum(quantum) {}
+    DispCodeT operator()(vw::PixelMask<vw::Vector2f> const& disp,
+                         vw::Vector2f const& seed) const {
+      DispCodeT code(DISP_CODE_INVALID, 0);
+      if (!is_valid(disp))
+        return code;
+      for (int it = 0; it < 2; it++) {
+        double val = std::round((disp.child()[it] - seed[it]) / m_quantum);
+        if (!(std::abs(val) <= 32767.0))
+          return DispCodeT(DISP_CODE_INVALID, 0);
+        code[it] = vw::int16(val);
+      }
+      return code;
+    }
+  };
+
+  struct DecodeDisparity: public vw::ReturnFixedType<vw::PixelMask<vw::Vector2f>> {
+    double m_quantum;
+    DecodeDisparity(double quantum): m_quantum(quantum) {}
+    vw::PixelMask<vw::Vector2f> operator()(DispCodeT const& code,
+                                           vw::Vector2f const& seed) const {
+      if (code[0] == DISP_CODE_INVALID)
+        return vw::PixelMask<vw::Vector2f>();
+      return vw::PixelMask<vw::Vector2f>
+        (vw::Vector2f(seed[0] + code[0] * m_quantum, seed[1] + code[1] * m_quantum));
+    }
+  };
+
+  /// A checksum of D_sub, saved with the disparity, so that it is not
+  /// decoded with a D_sub that was made later
+  std::string disparity_seed_hash(vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp);
+
+  /// The keywords to save in the compact disparity file
+  std::map<std::string, std::string>
+  compact_disparity_keywords(vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp,
+                             vw::Vector2 const& seed_scale, vw::Vector2i const& origin,
+                             double quantum);
+
+  /// The D_sub file next to a disparity file. For <prefix>-RD.tif it is
+  /// <prefix>-D_sub.tif.
+  std::string disparity_seed_file(std::string const& disp_file);
+
+  /// Write the disparity in the compact format. The pixel (0, 0) of the
+  /// image is at 'origin' in the full-resolution left image, and
+  /// 'seed_scale' is the ratio of the size of that image to the size
+  /// of D_sub.
+  template <class ImageT>
+  void block_write_compact_disparity(std::string const& filename,
+                                     vw::ImageViewBase<ImageT> const& disp,
+                                     vw::Vector2i const& origin,
+                                     vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp,
+                                     vw::Vector2 const& seed_scale,
+                                     double quantum,
+                                     bool has_georef,
+                                     vw::cartography::GeoReference const& georef,
+                                     vw::GdalWriteOptions const& opt,
+                                     vw::ProgressCallback const& progress_callback) {
+
+    DisparitySeedView seed(sub_disp, seed_scale, origin,
+                           disp.impl().cols(), disp.impl().rows());
+
+    // Integers compress best with horizontal differencing
+    vw::GdalWriteOptions local_opt = opt;
+    if (local_opt.gdal_options.find("COMPRESS")  != local_opt.gdal_options.end() &&
+        local_opt.gdal_options.find("PREDICTOR") == local_opt.gdal_options.end())
+      local_opt.gdal_options["PREDICTOR"] = "2";
+
+    bool has_nodata = false;
+    double nodata = 0.0;
+    vw::cartography::block_write_gdal_image
+      (filename, vw::per_pixel_view(disp.impl(), seed, EncodeDisparity(quantum)),
+       has_georef, georef, has_nodata, nodata, local_opt, progress_callback,
+       compact_disparity_keywords(sub_disp, seed_scale, origin, quantum));
+  }
+
+  /// If a disparity file is in the compact format
+  bool is_compact_disparity(std::string const& disp_file);
+
+  /// Read a disparity saved by stereo, in the compact format or not
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> read_disparity(std::string const& disp_file);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISPARITY_ENCODING_H__
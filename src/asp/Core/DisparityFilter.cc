@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityFilter.cc
+///
+
+#include <asp/Core/DisparityFilter.h>
+#include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/ImageAlignment.h>
+
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/PixelTypes.h>
+
+#include <algorithm>
+
+using namespace vw;
+
+namespace asp {
+
+ImageViewRef<PixelMask<Vector2f>>
+local_disparity_filter(ASPGlobalOptions const& opt,
+                       ImageViewRef<PixelMask<Vector2f>> const& disp) {
+
+  // Applying additional clipping from the edge. We make new
+  // mask files to avoid a weird and tricky segfault due to ownership issues.
+  DiskImageView<vw::uint8> left_mask (opt.out_prefix + "-lMask.tif");
+  DiskImageView<vw::uint8> right_mask(opt.out_prefix + "-rMask.tif");
+  int32 mask_buffer = stereo_settings().mask_buffer_size;
+  if (mask_buffer < 0) // If Unset, set to the subpixel kernel size.
+    mask_buffer = std::max(stereo_settings().subpixel_kernel[0],
+                           stereo_settings().subpixel_kernel[1]);
+
+  // If the user wants to do no filtering at all, that amounts
+  // to doing no passes.
+  if (stereo_settings().filter_mode == 0)
+    stereo_settings().rm_cleanup_passes = 0;
+
+  typedef ImageViewRef<PixelMask<Vector2f>> DispT;
+  DispT cleaned;
+  if (stereo_settings().rm_cleanup_passes >= 1) {
+    // Apply an outlier removal filter
+    cleaned = MultipleDisparityCleanUp<DispT>()(disp, stereo_settings().rm_cleanup_passes);
+  } else {
+    ImageViewRef<PixelGray<float>> left_image
+      = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, true));
+    cleaned = texture_aware_disparity_filter
+      (left_image, disp,
+       stereo_settings().median_filter_size,
+       stereo_settings().disp_smooth_size+2, // Compute texture a little larger than smooth radius
+       stereo_settings().disp_smooth_texture,
+       stereo_settings().disp_smooth_size);
+  }
+
+  return vw::stereo::disparity_mask
+    (cleaned,
+     apply_mask(asp::threaded_edge_mask(left_mask,  0, mask_buffer, 1024)),
+     apply_mask(asp::threaded_edge_mask(right_mask, 0, mask_buffer, 1024)));
+}
+
+bool stream_filtering() {
+
+  if (!stereo_settings().stream_filtering)
+    return false;
+
+  if (stereo_settings().enable_fill_holes || stereo_settings().erode_max_size > 0 ||
+      stereo_settings().mask_flatfield || stereo_settings().gotcha_disparity_refinement)
+    vw_throw(ArgumentErr() << "The option --stream-filtering cannot be used with "
+             << "--enable-fill-holes, --erode-max-size, --mask-flatfield, or "
+             << "--gotcha-disparity-refinement, as these need the whole disparity.\n");
+
+  return true;
+}
+
+std::string filtered_disparity_file(std::string const& out_prefix) {
+  if (stream_filtering())
+    return out_prefix + "-RD.tif";
+  return out_prefix + "-F.tif";
+}
+
+} // end namespace asp
@@ -0,0 +1,198 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityFilter.h
+///
+/// The filters applied to the refined disparity which need only a
+/// neighborhood of each pixel. They are used by stereo_fltr to make
+/// F.tif, and by stereo_tri to filter the disparity on the fly, tile
+/// by tile, when F.tif is not written.
+
+#ifndef __ASP_CORE_DISPARITY_FILTER_H__
+#define __ASP_CORE_DISPARITY_FILTER_H__
+
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/MedianFilter.h>
+#include <asp/Core/TileArena.h>
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Stereo/DisparityMap.h>
+#include <vw/Stereo/Algorithms.h>
+
+#include <string>
+
+namespace asp {
+
+  /// Apply a set of smoothing filters to the subpixel disparity results.
+  template <class ImageT, class DispImageT>
+  class TextureAwareDisparityFilter:
+    public vw::ImageViewBase<TextureAwareDisparityFilter<ImageT, DispImageT>> {
+    ImageT     m_img;
+    DispImageT m_disp_img;
+
+    int   m_median_filter_size;     ///< Step 1: Apply a median filter of this size
+    int   m_texture_smooth_range;   ///< Step 2: Compute texture measure of input image with this kernel size
+    float m_texture_max;            ///< Step 3: Perform texture-aware smoothing of the disparity.  m_texture_max
+    int   m_max_smooth_kernel_size; ///<         smooths more pixels, and the smooth_kernel_size increases the smoothing intensity.
+
+  public:
+    TextureAwareDisparityFilter(vw::ImageViewBase<ImageT    > const& img,
+                                vw::ImageViewBase<DispImageT> const& disp_img,
+                                int   median_filter_size,
+                                int   texture_smooth_range,
+                                float texture_max,
+                                int   max_smooth_kernel_size):
+      m_img(img.impl()), m_disp_img(disp_img.impl()),
+      m_median_filter_size(median_filter_size),
+      m_texture_smooth_range(texture_smooth_range),
+      m_texture_max(texture_max),
+      m_max_smooth_kernel_size(max_smooth_kernel_size)
+    {}
+
+    // Image View interface
+    typedef typename DispImageT::pixel_type pixel_type;
+    typedef pixel_type                      result_type;
+    typedef vw::ProceduralPixelAccessor<TextureAwareDisparityFilter> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_disp_img.cols(); }
+    inline vw::int32 rows  () const { return m_disp_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline pixel_type operator()(double /*i*/, double /*j*/, vw::int32 /*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr()
+                   << "TextureAwareDisparityFilter::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      // The temporaries of the tile are taken from the arena of this
+      // thread, and given back when the tile is done
+      TileArenaScope scope;
+
+      // Figure out the largest kernel expansion we need to support the filtering
+      int max_half_kernel = m_texture_smooth_range;
+      if (m_max_smooth_kernel_size > max_half_kernel)
+        max_half_kernel = m_max_smooth_kernel_size;
+      max_half_kernel += m_median_filter_size; // Don't forget we apply two kernels in succession
+      max_half_kernel /= 2;
+
+      // Rasterize both input image regions
+      vw::BBox2i bbox2 = bbox;
+      bbox2.expand(max_half_kernel);
+      bbox2.crop(bounding_box(m_img)); // Restrict to valid input area
+      vw::ImageView<typename ImageT::pixel_type> input_tile      = crop(m_img,      bbox2);
+      vw::ImageView<pixel_type                 > input_disp_tile = crop(m_disp_img, bbox2);
+
+      vw::ImageView<float> texture_image;
+      vw::stereo::texture_measure(input_tile, texture_image, m_texture_smooth_range);
+
+      // The tiles are already done in parallel, so use one thread for each
+      vw::ImageView<pixel_type> disp_tile_median;
+      asp::disparity_median_filter(input_disp_tile, m_median_filter_size, 1, disp_tile_median);
+
+      vw::ImageView<pixel_type> disp_tile_filtered;
+      vw::stereo::texture_preserving_disparity_filter(disp_tile_median, disp_tile_filtered,
+                                                      texture_image, m_texture_max,
+                                                      m_max_smooth_kernel_size);
+
+      // Fake the bounds on the returned image region
+      return prerasterize_type(disp_tile_filtered,
+                               -bbox2.min().x(), -bbox2.min().y(),
+                               cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT, class DispImageT>
+  TextureAwareDisparityFilter<ImageT, DispImageT>
+  texture_aware_disparity_filter(vw::ImageViewBase<ImageT    > const& img,
+                                 vw::ImageViewBase<DispImageT> const& disp_img,
+                                 int   median_filter_size,
+                                 int   texture_smooth_range,
+                                 float texture_max,
+                                 int   max_smooth_kernel_size) {
+    typedef TextureAwareDisparityFilter<ImageT, DispImageT> return_type;
+    return return_type(img.impl(), disp_img.impl(), median_filter_size,
+                       texture_smooth_range, texture_max, max_smooth_kernel_size);
+  }
+
+  // Run several cleanup passes with desired cleanup mode.
+  template <class ViewT>
+  struct MultipleDisparityCleanUp {
+    typedef vw::ImageViewRef<typename ViewT::pixel_type> result_type;
+
+    inline result_type operator()(vw::ImageViewBase<ViewT> const& input, int N) {
+
+      result_type out = input;
+      for (int i = 0; i < N; i++) {
+        int mode = stereo_settings().filter_mode;
+        if (mode == 1) {
+          out = vw::stereo::disparity_cleanup_using_mean
+            (out.impl(),
+             stereo_settings().rm_half_kernel.x(),
+             stereo_settings().rm_half_kernel.y(),
+             stereo_settings().max_mean_diff);
+        } else if (mode == 2) {
+          out = vw::stereo::disparity_cleanup_using_thresh
+            (out.impl(),
+             stereo_settings().rm_half_kernel.x(),
+             stereo_settings().rm_half_kernel.y(),
+             stereo_settings().rm_threshold,
+             stereo_settings().rm_min_matches/100.0);
+        } else
+          vw::vw_throw(vw::ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
+                       << "Got: " << mode << "\n");
+      }
+
+      return out;
+    }
+  };
+
+  /// Remove the outliers in the disparity with the cleanup passes, or,
+  /// if there are none, smooth it in a texture-aware way. Then
+  /// invalidate the pixels close to the edges of the left and right
+  /// masks, or mapping to outside the right mask.
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2f>>
+  local_disparity_filter(ASPGlobalOptions const& opt,
+                         vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& disp);
+
+  /// If --stream-filtering is set, and F.tif would be the same as the
+  /// output of local_disparity_filter(), with no hole filling, blob
+  /// removal, dust masking, or Gotcha refinement, so the filtering can
+  /// be done on the fly in triangulation instead of writing F.tif.
+  /// Throws if --stream-filtering is set but the filtering is not local.
+  bool stream_filtering();
+
+  /// The disparity file triangulation starts from. This is F.tif, or,
+  /// with stream_filtering(), RD.tif, to be passed through
+  /// local_disparity_filter().
+  std::string filtered_disparity_file(std::string const& out_prefix);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISPARITY_FILTER_H__
@@ -26,6 +26,14 @@
 #include <vw/Core/Stopwatch.h>
 #include <vw/Cartography/Map2CamTrans.h>
 #include <vw/InterestPoint/InterestData.h>
+#include <vw/Image/Transform.h>
+#include <vw/Core/ThreadPool.h>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -402,6 +410,118 @@ void filter_D_sub_using_spread(ASPGlobalOptions const& opt, std::string const& d
                          TerminalProgressCallback("asp","\t D_sub: "));
 } 
 
+// Estimate the relative cost of correlating each given region of L.tif,
+// as the number of valid full-resolution pixels times the area of the
+// local full-resolution search range, both based on D_sub.
+void estimate_corr_costs(DispImageType          const& sub_disp_ref,
+                         vw::Vector2            const& upsample_scale,
+                         std::vector<vw::BBox2i> const& boxes,
+                         std::vector<double>          & costs) {
+
+  // D_sub is small, so read it fully in memory, as it will be accessed
+  // once per box.
+  vw::ImageView<vw::PixelMask<vw::Vector2f>> sub_disp = sub_disp_ref;
+  BBox2i sub_box = bounding_box(sub_disp);
+
+  costs.resize(boxes.size());
+  for (size_t it = 0; it < boxes.size(); it++) {
+
+    // Find the corresponding region in D_sub
+    BBox2i box = boxes[it];
+    Vector2i beg = floor(elem_quot(Vector2(box.min()), upsample_scale));
+    Vector2i end = ceil (elem_quot(Vector2(box.max()), upsample_scale));
+    BBox2i local_box(beg, end);
+    local_box.crop(sub_box);
+
+    double num_valid = 0.0;
+    BBox2 search_range;
+    for (int col = local_box.min().x(); col < local_box.max().x(); col++) {
+      for (int row = local_box.min().y(); row < local_box.max().y(); row++) {
+        PixelMask<Vector2f> const& disp = sub_disp(col, row);
+        if (!is_valid(disp))
+          continue;
+        num_valid++;
+        search_range.grow(Vector2(disp.child()));
+      }
+    }
+
+    if (num_valid == 0) {
+      // No valid disparities. Most likely nothing to correlate.
+      costs[it] = 0.0;
+      continue;
+    }
+    
+    // Convert to full resolution
+    num_valid *= upsample_scale.x() * upsample_scale.y();
+    double search_area = (search_range.width()  * upsample_scale.x() + 1.0) *
+                         (search_range.height() * upsample_scale.y() + 1.0);
+    costs[it] = num_valid * search_area;
+  }
+}
+
+bool unalign_homography(vw::TransformPtr const& tx, BBox2i const& box, Matrix3x3 & H) {
+
+  if (dynamic_cast<vw::HomographyTransform const*>(tx.get()) == NULL || box.empty())
+    return false;
+
+  // Normalize the coordinates so that the fit is well-conditioned
+  std::vector<Vector2> in(4), out(4);
+  Vector2 lo = box.min(), hi = box.max() - Vector2(1, 1);
+  in[0] = lo; in[1] = Vector2(hi.x(), lo.y()); in[2] = hi; in[3] = Vector2(lo.x(), hi.y());
+  try {
+    for (int i = 0; i < 4; i++)
+      out[i] = tx->reverse(in[i]);
+  } catch (...) {
+    return false;
+  }
+  Vector2 in_ctr = (in[0] + in[2]) / 2.0, out_ctr = (out[0] + out[1] + out[2] + out[3]) / 4.0;
+  double in_scale = std::max(1.0, norm_2(in[2] - in[0]) / 2.0), out_scale = 0.0;
+  for (int i = 0; i < 4; i++)
+    out_scale = std::max(out_scale, norm_2(out[i] - out_ctr));
+  out_scale = std::max(1.0, out_scale);
+
+  // Solve for the homography between the normalized corners, with the
+  // last entry being 1.
+  Eigen::Matrix<double, 8, 8> A;
+  Eigen::Matrix<double, 8, 1> b;
+  for (int i = 0; i < 4; i++) {
+    Vector2 p = (in[i] - in_ctr) / in_scale, q = (out[i] - out_ctr) / out_scale;
+    A.row(2*i)     << p.x(), p.y(), 1.0, 0.0, 0.0, 0.0, -q.x()*p.x(), -q.x()*p.y();
+    A.row(2*i + 1) << 0.0, 0.0, 0.0, p.x(), p.y(), 1.0, -q.y()*p.x(), -q.y()*p.y();
+    b(2*i) = q.x(); b(2*i + 1) = q.y();
+  }
+  Eigen::Matrix<double, 8, 1> h = A.fullPivLu().solve(b);
+  Matrix3x3 Hn;
+  Hn(0, 0) = h(0); Hn(0, 1) = h(1); Hn(0, 2) = h(2);
+  Hn(1, 0) = h(3); Hn(1, 1) = h(4); Hn(1, 2) = h(5);
+  Hn(2, 0) = h(6); Hn(2, 1) = h(7); Hn(2, 2) = 1.0;
+
+  // Undo the normalization
+  Matrix3x3 T_in = math::identity_matrix<3>(), T_out_inv = math::identity_matrix<3>();
+  T_in(0, 0) = T_in(1, 1) = 1.0 / in_scale;
+  T_in(0, 2) = -in_ctr.x() / in_scale; T_in(1, 2) = -in_ctr.y() / in_scale;
+  T_out_inv(0, 0) = T_out_inv(1, 1) = out_scale;
+  T_out_inv(0, 2) = out_ctr.x(); T_out_inv(1, 2) = out_ctr.y();
+  H = T_out_inv * Hn * T_in;
+
+  // Check the fit on a grid over the box
+  const int num = 5;
+  const double tol = 1e-3; // pixels
+  try {
+    for (int j = 0; j < num; j++) {
+      for (int i = 0; i < num; i++) {
+        Vector2 p = lo + elem_prod(Vector2(i, j) / (num - 1.0), hi - lo);
+        if (!(norm_2(apply_homography(H, p) - tx->reverse(p)) <= tol))
+          return false;
+      }
+    }
+  } catch (...) {
+    return false;
+  }
+
+  return true;
+}
+
 // Compute an unaligned disparity image from the input disparity image
 // and the image transforms.
 // Note that the output image size is not the same as the input disparity image.
@@ -415,6 +535,10 @@ class UnalignDisparityView: public ImageViewBase<UnalignDisparityView>{
   int m_num_cols, m_num_rows;
   bool m_is_map_projected;
   std::map <std::pair<int, int>, Vector2> m_unaligned_trans;
+
+  // With homographies, the transforms are applied inline
+  bool m_use_homography;
+  Matrix3x3 m_left_unalign, m_left_align, m_right_unalign;
 public:
   UnalignDisparityView(bool is_map_projected,
                        DispImageType    const& disparity,
@@ -424,7 +548,15 @@ public:
     m_is_map_projected(is_map_projected), 
     m_disparity(disparity), m_left_transform(left_transform), 
     m_right_transform(right_transform), m_opt(opt),
-    m_num_cols(0), m_num_rows(0){
+    m_num_cols(0), m_num_rows(0), m_use_homography(false) {
+
+    if (!m_is_map_projected) {
+      m_use_homography
+        = (unalign_homography(m_left_transform,  bounding_box(m_disparity), m_left_unalign) &&
+           unalign_homography(m_right_transform, bounding_box(m_disparity), m_right_unalign));
+      if (m_use_homography)
+        m_left_align = vw::math::inverse(m_left_unalign);
+    }
 
     // Compute the output image size
     
@@ -555,7 +687,31 @@ public:
     // For mapprojected images the forward() function is not always accurate,
     // and it is also very slow, hence avoid it.
     BBox2i disp_bbox;
-    if (!m_is_map_projected) {
+    bool have_disp_bbox = false;
+    if (m_use_homography) {
+      // The image of the box is the quadrilateral with the images of
+      // its corners as vertices, unless the box crosses the line that
+      // goes to infinity.
+      Vector2 lo = curr_bbox.min(), hi = curr_bbox.max() - Vector2(1, 1);
+      Vector2 corners[] = {lo, Vector2(hi.x(), lo.y()), hi, Vector2(lo.x(), hi.y())};
+      BBox2 box;
+      int num_positive = 0;
+      for (int i = 0; i < 4; i++) {
+        Matrix3x3 const& H = m_left_align;
+        double w = H(2, 0) * corners[i].x() + H(2, 1) * corners[i].y() + H(2, 2);
+        if (w > 0)
+          num_positive++;
+        box.grow(apply_homography(H, corners[i]));
+      }
+      if (num_positive == 4 || num_positive == 0) {
+        disp_bbox = BBox2i(floor(box.min()), floor(box.max()) + Vector2(1, 1));
+        disp_bbox.crop(bounding_box(m_disparity));
+        have_disp_bbox = true;
+      }
+    }
+    if (have_disp_bbox) {
+      // Done above
+    } else if (!m_is_map_projected) {
       BBox2i full_disp_bbox = bounding_box(m_disparity);
       for (int col = 0; col < unaligned_disp.cols(); col++) {
 	for (int row = 0; row < unaligned_disp.rows(); row++) {
@@ -611,8 +767,21 @@ public:
     typedef typename DispImageType::pixel_type DispPixelT;
     ImageView<DispPixelT> disp = crop(m_disparity, disp_bbox);
 
-    for (int col = 0; col < disp.cols(); col++) {
-      for (int row = 0; row < disp.rows(); row++) {
+    Matrix3x3 const& HL = m_left_unalign;
+    for (int row = 0; row < disp.rows(); row++) {
+
+      // With a homography, the numerators and denominator of the left
+      // pixel change by a constant from one column to the next.
+      int urow = row + disp_bbox.min().y();
+      double lx = 0.0, ly = 0.0, lw = 0.0;
+      if (m_use_homography) {
+        double ucol0 = disp_bbox.min().x();
+        lx = HL(0, 0) * ucol0 + HL(0, 1) * urow + HL(0, 2);
+        ly = HL(1, 0) * ucol0 + HL(1, 1) * urow + HL(1, 2);
+        lw = HL(2, 0) * ucol0 + HL(2, 1) * urow + HL(2, 2);
+      }
+      
+      for (int col = 0; col < disp.cols(); col++, lx += HL(0, 0), ly += HL(1, 0), lw += HL(2, 0)) {
 	
 	DispPixelT dpix = disp(col, row);
 	if (!is_valid(dpix))
@@ -621,17 +790,22 @@ public:
 	// Go from position in the cropped disparity to the
 	// position in the full disparity.
 	int ucol = col + disp_bbox.min().x();
-	int urow = row + disp_bbox.min().y();
 	
 	// De-warp left and right pixels to be in the camera coordinate system
 	Vector2 left_pix, right_pix;
-	try{
-	  left_pix  = local_left_transform->reverse (Vector2(ucol, urow));
-	  right_pix = local_right_transform->reverse(Vector2(ucol, urow)
-                                                     + stereo::DispHelper(dpix));
-	}catch(...){
-	  continue;
-	}
+        if (m_use_homography) {
+          left_pix  = Vector2(lx / lw, ly / lw);
+          right_pix = apply_homography(m_right_unalign,
+                                       Vector2(ucol, urow) + stereo::DispHelper(dpix));
+        } else {
+          try{
+            left_pix  = local_left_transform->reverse (Vector2(ucol, urow));
+            right_pix = local_right_transform->reverse(Vector2(ucol, urow)
+                                                       + stereo::DispHelper(dpix));
+          }catch(...){
+            continue;
+          }
+        }
 	Vector2 dir = right_pix - left_pix; // disparity value
 	
 	// This averaging is useful in filling tiny holes and avoiding staircasing.
@@ -704,6 +878,167 @@ void unalign_disparity(bool is_map_projected,
   
 }
 
+/// Take aligned left and right pixels to the unaligned images. With
+/// homographies the matrices are applied inline. Otherwise the
+/// transforms are used. Mapprojection transforms are not thread-safe,
+/// so each thread must use its own copy, made with thread_copy().
+class PixelUnaligner {
+  bool m_use_homography, m_is_map_projected;
+  Matrix3x3 m_left_unalign, m_right_unalign;
+  vw::TransformPtr m_left_trans, m_right_trans;
+public:
+  PixelUnaligner(bool use_homography,
+                 Matrix3x3 const& left_unalign, Matrix3x3 const& right_unalign,
+                 vw::TransformPtr const& left_trans, vw::TransformPtr const& right_trans,
+                 bool is_map_projected):
+    m_use_homography(use_homography), m_is_map_projected(is_map_projected),
+    m_left_unalign(left_unalign), m_right_unalign(right_unalign),
+    m_left_trans(left_trans), m_right_trans(right_trans) {}
+  PixelUnaligner thread_copy() const {
+    PixelUnaligner copy = *this;
+    if (!m_use_homography && m_is_map_projected) {
+      copy.m_left_trans  = vw::cartography::mapproj_trans_copy(m_left_trans);
+      copy.m_right_trans = vw::cartography::mapproj_trans_copy(m_right_trans);
+    }
+    return copy;
+  }
+  Vector2 left(Vector2 const& pix) const {
+    if (m_use_homography)
+      return apply_homography(m_left_unalign, pix);
+    return m_left_trans->reverse(pix);
+  }
+  Vector2 right(Vector2 const& pix) const {
+    if (m_use_homography)
+      return apply_homography(m_right_unalign, pix);
+    return m_right_trans->reverse(pix);
+  }
+};
+
+/// A match found from the disparity at a given disparity pixel
+struct DispMatch {
+  int col, row;
+  Vector2 left_pix, right_pix;
+  bool operator<(DispMatch const& other) const {
+    return col < other.col || (col == other.col && row < other.row);
+  }
+};
+
+/// Find the matches for a group of disparity pixels in the background.
+/// Errors are saved, to be raised in the main thread.
+class DispMatchTask: public vw::Task, private boost::noncopyable {
+  std::function<void(PixelUnaligner const&, std::vector<DispMatch>&)> m_func;
+  PixelUnaligner           m_unaligner;
+  std::vector<DispMatch> & m_matches;
+  std::mutex             & m_mutex;
+  std::string            & m_error;
+  vw::TerminalProgressCallback & m_tpc;
+  double                   m_inc_amount;
+public:
+  DispMatchTask(std::function<void(PixelUnaligner const&, std::vector<DispMatch>&)> func,
+                PixelUnaligner const& unaligner, std::vector<DispMatch> & matches,
+                std::mutex & mutex, std::string & error,
+                vw::TerminalProgressCallback & tpc, double inc_amount):
+    m_func(func), m_unaligner(unaligner.thread_copy()), m_matches(matches),
+    m_mutex(mutex), m_error(error), m_tpc(tpc), m_inc_amount(inc_amount) {}
+  void operator()() {
+    try {
+      m_func(m_unaligner, m_matches);
+    } catch (std::exception const& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_error == "")
+        m_error = e.what();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tpc.report_incremental_progress(m_inc_amount);
+  }
+};
+
+/// The matches at the pixels of the disparity in a column of bins
+void matches_in_bin_column(DispImageType const& disp, int posx, int leny, double bin_len,
+                           PixelUnaligner const& unaligner,
+                           std::vector<DispMatch> & matches) {
+  for (int biny = 0; biny < leny; biny++) {
+
+    int posy = round((biny+0.5)*bin_len);
+
+    if (posx >= disp.cols() || posy >= disp.rows()) 
+      continue;
+    DispImageType::pixel_type dpix = disp(posx, posy);
+    if (!is_valid(dpix))
+      continue;
+
+    // De-warp left and right pixels to be in the camera coordinate system
+    DispMatch m;
+    m.col = posx; m.row = posy;
+    m.left_pix  = unaligner.left (Vector2(posx, posy));
+    m.right_pix = unaligner.right(Vector2(posx, posy) + stereo::DispHelper(dpix));
+    matches.push_back(m);
+  }
+}
+
+/// The matches at the pixels of a block of the disparity whose right
+/// pixel is at a multiple of the bin length
+void matches_on_right_bins(DispImageType const& disp, BBox2i const& block, int bin_len,
+                           PixelUnaligner const& unaligner,
+                           std::vector<DispMatch> & matches) {
+  typedef DispImageType::pixel_type DispPixelT;
+  ImageView<DispPixelT> disp_block = crop(disp, block);
+  for (int row = 0; row < disp_block.rows(); row++) {
+    for (int col = 0; col < disp_block.cols(); col++) {
+
+      DispPixelT dpix = disp_block(col, row);
+      if (!is_valid(dpix))
+        continue;
+
+      // Compute the left and right pixels. 
+      Vector2 trans_left_pix(col + block.min().x(), row + block.min().y());
+      Vector2 trans_right_pix = trans_left_pix + stereo::DispHelper(dpix);
+      Vector2 right_pix = unaligner.right(trans_right_pix);
+
+      // If the right pixel is a multiple of the bin size, keep
+      // it.
+      right_pix = round(right_pix); // very important
+      if (int(right_pix[0]) % bin_len != 0) continue;
+      if (int(right_pix[1]) % bin_len != 0) continue;
+
+      DispMatch m;
+      m.col = trans_left_pix.x(); m.row = trans_left_pix.y();
+      m.left_pix  = unaligner.left(trans_left_pix);
+      m.right_pix = right_pix;
+      matches.push_back(m);
+    }
+  }
+}
+
+/// Run the given function for each group of disparity pixels in parallel,
+/// and return the matches of all groups, in order.
+void find_disp_matches
+(std::vector<std::function<void(PixelUnaligner const&, std::vector<DispMatch>&)>> const& funcs,
+ PixelUnaligner const& unaligner, std::vector<DispMatch> & matches) {
+
+  std::vector<std::vector<DispMatch>> group_matches(funcs.size());
+  std::mutex mutex;
+  std::string error;
+  vw::TerminalProgressCallback tpc("asp", "\t--> ");
+  double inc_amount = 1.0 / std::max(double(funcs.size()), 1.0);
+  tpc.report_progress(0);
+  {
+    vw::FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (size_t it = 0; it < funcs.size(); it++)
+      queue.add_task(boost::shared_ptr<DispMatchTask>
+                     (new DispMatchTask(funcs[it], unaligner, group_matches[it],
+                                        mutex, error, tpc, inc_amount)));
+    queue.join_all();
+  }
+  tpc.report_finished();
+  if (error != "")
+    vw_throw(vw::ArgumentErr() << error);
+
+  matches.clear();
+  for (size_t it = 0; it < group_matches.size(); it++)
+    matches.insert(matches.end(), group_matches[it].begin(), group_matches[it].end());
+}
+
 /// Bin the disparities, and from each bin get a disparity value.
 /// This will create a correspondence from the left to right image,
 /// which we save in the match format.
@@ -720,6 +1055,15 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
 
   std::vector<vw::ip::InterestPoint> left_ip, right_ip;
 
+  // Apply the transforms inline if they are homographies
+  Matrix3x3 left_unalign, right_unalign;
+  bool use_homography = (!is_map_projected &&
+                         unalign_homography(left_trans,  bounding_box(disp), left_unalign) &&
+                         unalign_homography(right_trans, bounding_box(disp), right_unalign));
+  PixelUnaligner unaligner(use_homography, left_unalign, right_unalign,
+                           left_trans, right_trans, is_map_projected);
+  typedef std::function<void(PixelUnaligner const&, std::vector<DispMatch>&)> MatchFunc;
+
   if (!gen_triplets) {
 
     // Use doubles to avoid integer overflow
@@ -730,40 +1074,27 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
     int lenx = round(disp.cols()/bin_len); lenx = std::max(1, lenx);
     int leny = round(disp.rows()/bin_len); leny = std::max(1, leny);
 
-    // Iterate over bins.
+    // Iterate over bins. Each column of bins is done in parallel.
 
     vw_out() << "Computing interest point matches based on disparity.\n";
-    vw::TerminalProgressCallback tpc("asp", "\t--> ");
-    double inc_amount = 1.0 / double(lenx);
-    tpc.report_progress(0);
-
+    std::vector<MatchFunc> funcs;
     for (int binx = 0; binx < lenx; binx++) {
-
       // Pick the disparity at the center of the bin
       int posx = round((binx+0.5)*bin_len);
-
-      for (int biny = 0; biny < leny; biny++) {
-
-        int posy = round((biny+0.5)*bin_len);
-
-        if (posx >= disp.cols() || posy >= disp.rows()) 
-          continue;
-        typedef typename DispImageType::pixel_type DispPixelT;
-        DispPixelT dpix = disp(posx, posy);
-        if (!is_valid(dpix))
-          continue;
-
-        // De-warp left and right pixels to be in the camera coordinate system
-        Vector2 left_pix  = left_trans->reverse (Vector2(posx, posy));
-        Vector2 right_pix = right_trans->reverse(Vector2(posx, posy) + stereo::DispHelper(dpix));
-
-        left_ip.push_back(ip::InterestPoint(left_pix.x(), left_pix.y()));
-        right_ip.push_back(ip::InterestPoint(right_pix.x(), right_pix.y()));
-      }
-
-      tpc.report_incremental_progress(inc_amount);
+      funcs.push_back([&disp, posx, leny, bin_len]
+                      (PixelUnaligner const& unaligner, std::vector<DispMatch> & matches) {
+                        matches_in_bin_column(disp, posx, leny, bin_len, unaligner, matches);
+                      });
+    }
+    std::vector<DispMatch> matches;
+    find_disp_matches(funcs, unaligner, matches);
+
+    for (size_t it = 0; it < matches.size(); it++) {
+      left_ip.push_back(ip::InterestPoint(matches[it].left_pix.x(),
+                                          matches[it].left_pix.y()));
+      right_ip.push_back(ip::InterestPoint(matches[it].right_pix.x(),
+                                           matches[it].right_pix.y()));
     }
-    tpc.report_finished();
 
   } else{
 
@@ -841,7 +1172,7 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
           if (!is_valid(dpix))
             continue;
           trans_right_pix = trans_left_pix + stereo::DispHelper(dpix);
-          right_pix = right_trans->reverse(trans_right_pix);
+          right_pix = unaligner.right(trans_right_pix);
 
           // Add this ip unless found already. This is clumsy, but we
           // can't use a set since there is no ordering for pairs.
@@ -873,33 +1204,27 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
       int bin_len = round(sqrt(num_pixels/std::min(double(max_num_matches), num_pixels)));
       VW_ASSERT(bin_len >= 1, vw::ArgumentErr() << "Expecting bin_len >= 1.\n");
 
-      // Iterate over disparity.
-
-      vw_out() << "Doing a second pass. This will be very slow.\n";
-      vw::TerminalProgressCallback tpc("asp", "\t--> ");
-      double inc_amount = 1.0 / double(disp.cols());
-      tpc.report_progress(0);
-
-      for (int col = 0; col < disp.cols(); col++) {
-        for (int row = 0; row < disp.rows(); row++) {
-
-          Vector2 trans_left_pix(col, row);
-          Vector2 left_pix, trans_right_pix, right_pix;
+      // Iterate over the disparity, in blocks in parallel. The matches
+      // are then sorted by column and row, as the order matters below.
+
+      vw_out() << "Doing a second pass over the disparity.\n";
+      std::vector<MatchFunc> funcs;
+      std::vector<BBox2i> blocks = subdivide_bbox(disp, 1024, 1024);
+      for (size_t it = 0; it < blocks.size(); it++) {
+        BBox2i block = blocks[it];
+        funcs.push_back([&disp, block, bin_len]
+                        (PixelUnaligner const& unaligner, std::vector<DispMatch> & matches) {
+                          matches_on_right_bins(disp, block, bin_len, unaligner, matches);
+                        });
+      }
+      std::vector<DispMatch> matches;
+      find_disp_matches(funcs, unaligner, matches);
+      std::sort(matches.begin(), matches.end());
 
-          DispPixelT dpix = disp(trans_left_pix[0], trans_left_pix[1]);
-          if (!is_valid(dpix))
-            continue;
+      for (size_t match_it = 0; match_it < matches.size(); match_it++) {
 
-          // Compute the left and right pixels. 
-          left_pix        = left_trans->reverse(trans_left_pix);
-          trans_right_pix = trans_left_pix + stereo::DispHelper(dpix);
-          right_pix       = right_trans->reverse(trans_right_pix);
-
-          // If the right pixel is a multiple of the bin size, keep
-          // it.
-          right_pix = round(right_pix); // very important
-          if (int(right_pix[0]) % bin_len != 0) continue;
-          if (int(right_pix[1]) % bin_len != 0) continue;
+          Vector2 left_pix  = matches[match_it].left_pix;
+          Vector2 right_pix = matches[match_it].right_pix;
 
           // Add this ip unless found already. This is clumsy, but we
           // can't use a set since there is no ordering for pairs.
@@ -914,11 +1239,7 @@ void compute_matches_from_disp(ASPGlobalOptions const& opt,
           ip::InterestPoint rip(right_pix.x(), right_pix.y());
           left_ip.push_back(lip); 
           right_ip.push_back(rip);
-        }
-        
-        tpc.report_incremental_progress(inc_amount);
       }
-      tpc.report_finished();
     }
     
   } // end considering multi-image friendly ip
@@ -23,6 +23,8 @@
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Camera/CameraModel.h>
 #include <vw/Math/Transform.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/BBox.h>
 #include <vw/Cartography/Datum.h>
 
 namespace asp {
@@ -57,6 +59,29 @@ namespace asp {
   void filter_D_sub_using_spread(ASPGlobalOptions const& opt, std::string const& d_sub_file,
                                  double max_disp_spread);
   
+  /// Estimate the relative cost of correlating each given region of
+  /// L.tif, as the number of valid full-resolution pixels times the
+  /// area of the local full-resolution search range, both based on D_sub.
+  void estimate_corr_costs(DispImageType               const& sub_disp,
+                           vw::Vector2                 const& upsample_scale,
+                           std::vector<vw::BBox2i>     const& boxes,
+                           std::vector<double>              & costs);
+
+  /// If the alignment transform is a homography, which is the case for
+  /// all alignment methods with images that are not mapprojected, find
+  /// the matrix taking aligned pixels to unaligned ones. It is fit to the
+  /// transform at the corners of the given box, and accepted only if it
+  /// agrees with the transform elsewhere in the box.
+  bool unalign_homography(vw::TransformPtr const& tx, vw::BBox2i const& box,
+                          vw::Matrix3x3 & H);
+
+  /// Apply a homography to a pixel
+  inline vw::Vector2 apply_homography(vw::Matrix3x3 const& H, vw::Vector2 const& p) {
+    double w = H(2, 0) * p[0] + H(2, 1) * p[1] + H(2, 2);
+    return vw::Vector2((H(0, 0) * p[0] + H(0, 1) * p[1] + H(0, 2)) / w,
+                       (H(1, 0) * p[0] + H(1, 1) * p[1] + H(1, 2)) / w);
+  }
+
   // Take a given disparity and make it between the original unaligned images
   void unalign_disparity(bool is_map_projected,
                          DispImageType    const& disparity,
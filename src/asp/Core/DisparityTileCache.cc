@@ -0,0 +1,149 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityTileCache.cc
+///
+
+#include <asp/Core/DisparityTileCache.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/Manipulation.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+  void DisparityTileCache::load(ImageViewRef<pixel_type> const& disp,
+                                std::vector<Vector2> const& pixels,
+                                double margin, int subsample, int tile_size) {
+
+    if (subsample < 1 || tile_size < 1)
+      vw_throw(ArgumentErr() << "The disparity subsample factor and tile size "
+               << "must be positive.\n");
+
+    m_disp_cols  = disp.cols();
+    m_disp_rows  = disp.rows();
+    m_subsample  = subsample;
+    m_tile_size  = tile_size;
+    m_cols       = (disp.cols() + subsample - 1) / subsample;
+    m_rows       = (disp.rows() + subsample - 1) / subsample;
+    m_tiles_x    = (m_cols + tile_size - 1) / tile_size;
+    m_tiles_y    = (m_rows + tile_size - 1) / tile_size;
+    m_tile_index.assign(std::int64_t(m_tiles_x) * m_tiles_y, -1);
+    m_tiles.clear();
+    if (m_cols == 0 || m_rows == 0)
+      return;
+
+    // Mark the tiles to read. One more pixel on each side is needed for
+    // interpolation.
+    std::vector<bool> needed(m_tile_index.size(), false);
+    double sub_margin = margin / subsample + 1.0;
+    for (size_t it = 0; it < pixels.size(); it++) {
+      if (pixels[it] != pixels[it])
+        continue; // NaN
+      Vector2 q = (pixels[it] + Vector2(0.5, 0.5)) / double(subsample) - Vector2(0.5, 0.5);
+      int beg_x = std::max(0, int(std::floor((q[0] - sub_margin) / tile_size)));
+      int beg_y = std::max(0, int(std::floor((q[1] - sub_margin) / tile_size)));
+      int end_x = std::min(m_tiles_x - 1, int(std::floor((q[0] + sub_margin) / tile_size)));
+      int end_y = std::min(m_tiles_y - 1, int(std::floor((q[1] + sub_margin) / tile_size)));
+      for (int ty = beg_y; ty <= end_y; ty++)
+        for (int tx = beg_x; tx <= end_x; tx++)
+          needed[std::int64_t(ty) * m_tiles_x + tx] = true;
+    }
+
+    // Read each tile in one go, and average the valid pixels in each
+    // block if subsampling
+    for (int ty = 0; ty < m_tiles_y; ty++) {
+      for (int tx = 0; tx < m_tiles_x; tx++) {
+        std::int64_t index = std::int64_t(ty) * m_tiles_x + tx;
+        if (!needed[index])
+          continue;
+
+        BBox2i sub_box(tx * tile_size, ty * tile_size, tile_size, tile_size);
+        sub_box.crop(BBox2i(0, 0, m_cols, m_rows));
+        BBox2i box(sub_box.min() * subsample, sub_box.max() * subsample);
+        box.crop(bounding_box(disp));
+        ImageView<pixel_type> full = crop(disp, box);
+
+        ImageView<pixel_type> tile(sub_box.width(), sub_box.height());
+        for (int row = 0; row < tile.rows(); row++) {
+          for (int col = 0; col < tile.cols(); col++) {
+            Vector2 sum;
+            int count = 0;
+            int end_c = std::min(full.cols(), (col + 1) * subsample);
+            int end_r = std::min(full.rows(), (row + 1) * subsample);
+            for (int r = row * subsample; r < end_r; r++) {
+              for (int c = col * subsample; c < end_c; c++) {
+                if (!is_valid(full(c, r)))
+                  continue;
+                sum += full(c, r).child();
+                count++;
+              }
+            }
+            if (count > 0)
+              tile(col, row) = pixel_type(Vector2f(sum / double(count)));
+            else
+              tile(col, row).invalidate();
+          }
+        }
+
+        m_tile_index[index] = static_cast<int>(m_tiles.size());
+        m_tiles.push_back(tile);
+      }
+    }
+  }
+
+  bool DisparityTileCache::pixel(int col, int row, pixel_type & val) const {
+    int index = m_tile_index[std::int64_t(row / m_tile_size) * m_tiles_x + col / m_tile_size];
+    if (index < 0)
+      return false;
+    val = m_tiles[index](col % m_tile_size, row % m_tile_size);
+    return is_valid(val);
+  }
+
+  bool DisparityTileCache::interpolate(Vector2 const& pix, Vector2 & disp) const {
+
+    if (m_cols == 0 || m_rows == 0)
+      return false;
+
+    // Bounds of the full-resolution disparity
+    if (!(pix[0] >= 0 && pix[1] >= 0 && pix[0] <= m_disp_cols - 1 && pix[1] <= m_disp_rows - 1))
+      return false;
+
+    Vector2 q = (pix + Vector2(0.5, 0.5)) / double(m_subsample) - Vector2(0.5, 0.5);
+    q[0] = std::min(std::max(q[0], 0.0), double(m_cols - 1));
+    q[1] = std::min(std::max(q[1], 0.0), double(m_rows - 1));
+
+    int x0 = int(std::floor(q[0])), y0 = int(std::floor(q[1]));
+    int x1 = std::min(x0 + 1, m_cols - 1), y1 = std::min(y0 + 1, m_rows - 1);
+    double wx = q[0] - x0, wy = q[1] - y0;
+
+    pixel_type p00, p10, p01, p11;
+    if (!pixel(x0, y0, p00) || !pixel(x1, y0, p10) ||
+        !pixel(x0, y1, p01) || !pixel(x1, y1, p11))
+      return false;
+
+    disp = (1.0 - wy) * ((1.0 - wx) * Vector2(p00.child()) + wx * Vector2(p10.child())) +
+      wy * ((1.0 - wx) * Vector2(p01.child()) + wx * Vector2(p11.child()));
+    return true;
+  }
+
+} // end namespace asp
@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityTileCache.h
+///
+/// Keep in memory only the parts of a disparity that are needed, as
+/// square tiles, and interpolate in them. The disparity can be
+/// subsampled when read, by averaging the valid pixels in each block.
+/// The values are still in units of full-resolution pixels, and so are
+/// the pixels at which it is interpolated.
+
+#ifndef __ASP_CORE_DISPARITY_TILE_CACHE_H__
+#define __ASP_CORE_DISPARITY_TILE_CACHE_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Vector.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace asp {
+
+  class DisparityTileCache {
+  public:
+    typedef vw::PixelMask<vw::Vector2f> pixel_type;
+
+    DisparityTileCache(): m_disp_cols(0), m_disp_rows(0), m_cols(0), m_rows(0),
+                          m_subsample(1), m_tile_size(0), m_tiles_x(0), m_tiles_y(0) {}
+
+    /// Read the tiles of the disparity within 'margin' full-resolution
+    /// pixels of any of the given pixels. The disparity is subsampled
+    /// by the given factor. An empty disparity is allowed, then nothing
+    /// can be interpolated.
+    void load(vw::ImageViewRef<pixel_type> const& disp,
+              std::vector<vw::Vector2> const& pixels,
+              double margin, int subsample, int tile_size = 256);
+
+    /// Bilinear interpolation at a full-resolution pixel. Return false
+    /// if the pixel is out of bounds, or any of the pixels around it
+    /// was not read or is invalid, as for bilinear interpolation of a
+    /// masked image.
+    bool interpolate(vw::Vector2 const& pix, vw::Vector2 & disp) const;
+
+    /// The number of tiles read
+    int num_tiles() const { return static_cast<int>(m_tiles.size()); }
+
+  private:
+    // The pixel of the subsampled disparity, if its tile was read
+    bool pixel(int col, int row, pixel_type & val) const;
+
+    int m_disp_cols, m_disp_rows;
+    int m_cols, m_rows; // of the subsampled disparity
+    int m_subsample, m_tile_size, m_tiles_x, m_tiles_y;
+    std::vector<int> m_tile_index; // -1 for tiles not read
+    std::vector<vw::ImageView<pixel_type>> m_tiles;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISPARITY_TILE_CACHE_H__
@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/DistanceTransform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace asp {
+
+  void distance_transform_1d(double const* f, int n, double * d,
+                             std::vector<int> & v, std::vector<double> & z) {
+
+    if (n <= 0)
+      return;
+
+    v.resize(n);
+    z.resize(n + 1);
+
+    // The locations of the parabolas in the lower envelope, and the
+    // boundaries between them
+    int k = 0;
+    v[0] = 0;
+    z[0] = -std::numeric_limits<double>::infinity();
+    z[1] =  std::numeric_limits<double>::infinity();
+    for (int q = 1; q < n; q++) {
+      double s = 0.0;
+      while (1) {
+        int p = v[k];
+        s = ((f[q] + double(q)*q) - (f[p] + double(p)*p)) / (2.0*(q - p));
+        if (s > z[k])
+          break;
+        k--; // the parabola at p is hidden, z[0] stops this at k == 0
+      }
+      k++;
+      v[k]   = q;
+      z[k]   = s;
+      z[k+1] = std::numeric_limits<double>::infinity();
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+      while (z[k+1] < q)
+        k++;
+      double diff = q - v[k];
+      d[q] = diff*diff + f[v[k]];
+    }
+  }
+
+  void euclidean_distance(vw::ImageView<double> const& mask, bool ignore_borders,
+                          vw::ImageView<double> & dist) {
+
+    int cols = mask.cols(), rows = mask.rows();
+
+    // Unless the borders are ignored, pad the image with a ring of
+    // pixels with zero mask
+    int pad = ignore_borders ? 0 : 1;
+    int ext_cols = cols + 2*pad, ext_rows = rows + 2*pad;
+
+    // Larger than any squared distance in the image, with room to add
+    // to it without overflow
+    double big = 2.0 * (double(ext_cols)*ext_cols + double(ext_rows)*ext_rows) + 1.0;
+
+    std::vector<double> sq(size_t(ext_cols) * ext_rows, 0.0);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        if (mask(col, row) > 0)
+          sq[(row + pad) * ext_cols + col + pad] = big;
+      }
+    }
+
+    std::vector<int> v;
+    std::vector<double> z, f(std::max(ext_cols, ext_rows)), d(std::max(ext_cols, ext_rows));
+
+    // Transform along the columns, then along the rows
+    for (int col = 0; col < ext_cols; col++) {
+      for (int row = 0; row < ext_rows; row++)
+        f[row] = sq[row * ext_cols + col];
+      distance_transform_1d(&f[0], ext_rows, &d[0], v, z);
+      for (int row = 0; row < ext_rows; row++)
+        sq[row * ext_cols + col] = d[row];
+    }
+    for (int row = 0; row < ext_rows; row++) {
+      distance_transform_1d(&sq[row * ext_cols], ext_cols, &d[0], v, z);
+      std::copy(d.begin(), d.begin() + ext_cols, sq.begin() + row * ext_cols);
+    }
+
+    dist.set_size(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++)
+        dist(col, row) = std::sqrt(sq[(row + pad) * ext_cols + col + pad]);
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,52 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DistanceTransform.h
+///
+/// The exact Euclidean distance transform, as in Felzenszwalb and
+/// Huttenlocher, "Distance Transforms of Sampled Functions", 2012. It
+/// is done as a pass over the columns followed by a pass over the rows,
+/// each in time linear in the number of pixels.
+
+#ifndef __ASP_CORE_DISTANCE_TRANSFORM_H__
+#define __ASP_CORE_DISTANCE_TRANSFORM_H__
+
+#include <vw/Image/ImageView.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// Given squared distances f at n samples, with a large value at the
+  /// samples which are not sources, find the lower envelope
+  /// d(q) = min_p (q - p)^2 + f(p). The arrays v and z are work space.
+  void distance_transform_1d(double const* f, int n, double * d,
+                             std::vector<int> & v, std::vector<double> & z);
+
+  /// For each pixel with a positive value in the mask, find the distance
+  /// to the nearest pixel with a non-positive value, which is 0 at the
+  /// latter. Unless borders are ignored, pixels outside the image count
+  /// as having zero mask, so the valid pixels at the image boundary get a
+  /// distance of 1. If there is no such pixel at all, large values are
+  /// returned. Like vw::grassfire(), but with the Euclidean distance, so
+  /// the distance grows the same way in all directions.
+  void euclidean_distance(vw::ImageView<double> const& mask, bool ignore_borders,
+                          vw::ImageView<double> & dist);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISTANCE_TRANSFORM_H__
@@ -21,6 +21,15 @@
 
 #include <asp/Core/EigenUtils.h>
 
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+
 using namespace vw;
 using namespace vw::cartography;
 
@@ -88,6 +97,253 @@ void random_pc_subsample(std::int64_t m, DoubleMatrix& points){
   points.conservativeResize(Eigen::NoChange, m);
 }
 
+// A point read from a CSV file, with its longitude
+struct CsvPoint {
+  vw::Vector3 xyz;
+  double lon;
+};
+
+// The CSV files are read in chunks of this many bytes, in parallel
+const std::int64_t CSV_CHUNK_SIZE = 64 * 1024 * 1024;
+
+// How to parse the lines of a CSV file
+struct CsvParseParams {
+  std::string file_name;
+  vw::BBox2 lonlat_box;
+  vw::cartography::GeoReference geo;
+  CsvConv csv_conv;
+  bool is_lola_rdr_format, verbose;
+};
+
+// Parse a line of a CSV file. Return false if the line has no valid
+// point in the box. The header may only be the first line.
+bool parse_csv_point(CsvParseParams const& params, std::string const& line,
+                     bool & is_first_line, CsvPoint & point) {
+
+  std::string sep_str = csv_separator();
+  const char* sep = sep_str.c_str();
+  const std::int64_t bufSize = 1024;
+  char temp[bufSize];
+  char* saveptr = NULL;
+
+  vw::BBox2 const& lonlat_box = params.lonlat_box;
+  vw::cartography::GeoReference const& geo = params.geo;
+  vw::Vector3 xyz;
+  double lon = 0.0, lat = 0.0;
+
+  if (params.csv_conv.is_configured()){
+
+    // Parse custom CSV file with given format string
+    bool success;
+    CsvConv::CsvRecord vals = params.csv_conv.parse_csv_line(is_first_line, success, line);
+    if (!success)
+      return false;
+
+    // Decide if the point is in the box. Also save for the future
+    // the longitude of the point, we'll use it to compute the mean longitude.
+    vw::Vector2 lonlat;
+    xyz = params.csv_conv.csv_to_cartesian_and_lonlat(vals, geo, lonlat);
+    lon = lonlat[0]; // Needed for mean calculation below
+    lat = lonlat[1];
+
+    // TODO: We really need a lonlat bbox function that handles wraparound!!!!!!
+    // Skip points outside the given box
+    if (!lonlat_box.empty() && !lonlat_box.contains(lonlat)
+                            && !lonlat_box.contains(lonlat+vw::Vector2(360,0))
+                            && !lonlat_box.contains(lonlat-vw::Vector2(360,0))) {
+      return false;
+    }
+
+  }else if (!params.is_lola_rdr_format){
+
+    // lat,lon,height format
+    double height;
+
+    strncpy(temp, line.c_str(), bufSize);
+    temp[bufSize - 1] = '\0';
+    const char* token = strtok_r(temp, sep, &saveptr); null_check(token, line);
+    std::int64_t ret = sscanf(token, "%lg", &lat);
+
+    token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &lon);
+
+    token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &height);
+
+    // Be prepared for the fact that the first line may be the header.
+    if (ret != 3){
+      if (!is_first_line){
+        vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
+      }else{
+        is_first_line = false;
+        return false;
+      }
+    }
+    is_first_line = false;
+
+    // Skip points outside the given box
+    if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
+      return false;
+
+    vw::Vector3 llh( lon, lat, height );
+    xyz = geo.datum().geodetic_to_cartesian( llh );
+    if ( xyz == vw::Vector3() || !(xyz == xyz) ) return false; // invalid and NaN check
+
+  }else{
+
+    // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
+    // copied from Ara Nefian's lidar2dem tool.
+    // We will ignore lines which do not start with year (or a value that
+    // cannot be converted into an integer greater than zero, specifically).
+
+    std::int64_t year = 0, month, day, hour, min;
+    double rad, sec, is_invalid;
+
+    strncpy(temp, line.c_str(), bufSize);
+    temp[bufSize - 1] = '\0';
+    const char* token = strtok_r(temp, sep, &saveptr); null_check(token, line);
+
+    std::int64_t ret = sscanf(token, "%lld-%lld-%lldT%lld:%lld:%lg", &year, &month, &day, &hour,
+                     &min, &sec);
+    if( year <= 0 )
+      return false;
+
+    token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &lon);
+
+    token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &lat);
+    token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &rad);
+    rad *= 1000; // km to m
+
+    // Scan 7 more fields, until we get to the is_invalid flag.
+    for (std::int64_t i = 0; i < 7; i++)
+      token = strtok_r(NULL, sep, &saveptr); null_check(token, line);
+    ret += sscanf(token, "%lg", &is_invalid);
+
+    // Be prepared for the fact that the first line may be the header.
+    if (ret != 10){
+      if (!is_first_line){
+        vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
+      }else{
+        is_first_line = false;
+        return false;
+      }
+    }
+    is_first_line = false;
+
+    if (is_invalid)
+      return false;
+
+    // Skip points outside the given box
+    if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
+      return false;
+
+    vw::Vector3 lonlatrad( lon, lat, 0 );
+
+    xyz = geo.datum().geodetic_to_cartesian( lonlatrad );
+    if ( xyz == vw::Vector3() || !(xyz == xyz) )
+      return false; // invalid and NaN check
+
+    // Adjust the point so that it is at the right distance from
+    // planet center.
+    xyz = rad*(xyz/norm_2(xyz));
+  }
+
+  // Throw an error if the lon and lat are not within bounds.
+  // Note that we allow some slack for lon, perhaps the point
+  // cloud is say from 350 to 370 degrees.
+  if (std::abs(lat) > 90.0)
+    vw_throw(vw::ArgumentErr() << "Invalid latitude value: "
+             << lat << " in " << params.file_name << "\n");
+  if (lon < -360.0 || lon > 2*360.0)
+    vw_throw(vw::ArgumentErr() << "Invalid longitude value: "
+             << lon << " in " << params.file_name << "\n");
+
+  point.xyz = xyz;
+  point.lon = lon;
+  return true;
+}
+
+// Read the lines starting in a byte range of a CSV file, and keep a
+// uniform random sample of at most the given number of their valid
+// points, with reservoir sampling. A line starts in the range if its
+// first byte is in it, so each line is read by one chunk.
+class CsvChunkTask: public vw::Task, private boost::noncopyable {
+  CsvParseParams const& m_params;
+  std::int64_t m_beg, m_end, m_max_points, m_chunk;
+  std::vector<CsvPoint> & m_sample;
+  std::int64_t & m_num_valid;
+  std::mutex  & m_mutex;
+  std::string & m_error;
+public:
+  CsvChunkTask(CsvParseParams const& params, std::int64_t beg, std::int64_t end,
+               std::int64_t max_points, std::int64_t chunk,
+               std::vector<CsvPoint> & sample, std::int64_t & num_valid,
+               std::mutex & mutex, std::string & error):
+    m_params(params), m_beg(beg), m_end(end), m_max_points(max_points), m_chunk(chunk),
+    m_sample(sample), m_num_valid(num_valid), m_mutex(mutex), m_error(error) {}
+
+  void operator()() {
+    try {
+      std::ifstream file(m_params.file_name.c_str(), std::ios::binary);
+      if (!file)
+        vw_throw(vw::IOErr() << "Unable to open file: " << m_params.file_name << "\n");
+
+      // Skip the line starting in the previous chunk
+      std::int64_t pos = m_beg;
+      std::string line;
+      if (m_beg > 0) {
+        file.seekg(m_beg - 1);
+        char prev = '\0';
+        file.get(prev);
+        if (prev != '\n' && getline(file, line, '\n'))
+          pos += line.size() + 1;
+      }
+
+      // The seed depends only on the chunk, so the sample does not
+      // depend on the number of threads
+      std::mt19937_64 gen(m_chunk);
+      bool is_first_line = (m_beg == 0);
+      CsvPoint point;
+      while (pos < m_end && getline(file, line, '\n')) {
+        pos += line.size() + 1;
+
+        if (!is_first_line && !line.empty() && line[0] == '#' && m_params.verbose) {
+          vw::vw_out() << "Ignoring line starting with comment: " << line << std::endl;
+          continue;
+        }
+        if (!is_valid_csv_line(line))
+          continue;
+        if (!parse_csv_point(m_params, line, is_first_line, point))
+          continue;
+
+        // Reservoir sampling
+        if (m_num_valid < m_max_points) {
+          m_sample.push_back(point);
+        } else {
+          std::int64_t r = std::uniform_int_distribution<std::int64_t>(0, m_num_valid)(gen);
+          if (r < m_max_points)
+            m_sample[r] = point;
+        }
+        m_num_valid++;
+      }
+
+      // Random order, so that any number of the first points is a
+      // uniform sample as well
+      std::shuffle(m_sample.begin(), m_sample.end(), gen);
+    } catch (std::exception const& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_error == "")
+        m_error = e.what();
+    }
+  }
+};
+
+// Read a CSV file in parallel chunks, and keep a uniform random sample
+// of at most num_points_to_load of its valid points. Return the number
+// of valid points in the file.
 std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_to_load,
                           vw::BBox2 const& lonlat_box,
                           bool calc_shift, vw::Vector3 & shift,
@@ -100,8 +356,6 @@ std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_
 
   is_lola_rdr_format = false;
 
-  std::int64_t num_total_points = csv_file_size(file_name);
-
   std::string sep_str = csv_separator();
   const char* sep = sep_str.c_str();
 
@@ -111,25 +365,22 @@ std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_
   if (!file)
     vw_throw(vw::IOErr() << "Unable to open file: " << file_name << "\n");
 
-  // We will randomly pick or not a point with probability load_ratio
-  double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_total_points);
-
-  data.conservativeResize(DIM+1, std::min(num_points_to_load, num_total_points));
-
   // Peek at the first valid line and see how many elements it has
   std::string line;
   while ( getline(file, line, '\n') ) {
     if (is_valid_csv_line(line))
       break;
   }
+  file.close();
 
-  file.clear(); file.seekg(0, std::ios_base::beg); // go back to start of file
   strncpy(temp, line.c_str(), bufSize);
-  const char* token = strtok (temp, sep);
+  temp[bufSize - 1] = '\0';
+  char* saveptr = NULL;
+  const char* token = strtok_r(temp, sep, &saveptr);
   std::int64_t numTokens = 0;
   while (token != NULL){
     numTokens++;
-    token = strtok (NULL, sep);
+    token = strtok_r(NULL, sep, &saveptr);
   }
   if (numTokens < 3){
     vw_throw( vw::IOErr() << "Expecting at least three fields on each "
@@ -159,177 +410,68 @@ std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_
               << "as expected for the Moon.\n" );
   }
 
-  bool shift_was_calc = false;
-  bool is_first_line  = true;
-  std::int64_t points_count = 0;
-  std::vector<double> longitudes;
-  line = "";
-  while (getline(file, line, '\n')) {
-
-    if (!is_first_line && !line.empty() && line[0] == '#' && verbose) {
-      vw::vw_out() << "Ignoring line starting with comment: " << line << std::endl;
-      continue;
-    }
-    
-    if (points_count >= num_points_to_load)
-      break;
-
-    if (!is_valid_csv_line(line))
-      continue;
-
-    // Randomly skip a percentage of points
-    double r = (double)std::rand()/(double)RAND_MAX;
-    if (r > load_ratio)
-      continue;
-
-    // We went with C-style file reading instead of C++ in this instance
-    // because we found it to be significantly faster on large files.
-
-    vw::Vector3 xyz;
-    double lon = 0.0, lat = 0.0;
-
-    if (csv_conv.is_configured()){
-
-      // Parse custom CSV file with given format string
-      bool success;
-      CsvConv::CsvRecord vals = csv_conv.parse_csv_line(is_first_line, success, line);
-      if (!success)
-        continue;
-
-      xyz = csv_conv.csv_to_cartesian(vals, geo);
-
-      // Decide if the point is in the box. Also save for the future
-      // the longitude of the point, we'll use it to compute the mean longitude.
-      vw::Vector2 lonlat = csv_conv.csv_to_lonlat(vals, geo);
-      lon = lonlat[0]; // Needed for mean calculation below
-      lat = lonlat[1];
-
-      // TODO: We really need a lonlat bbox function that handles wraparound!!!!!!
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(lonlat)
-                              && !lonlat_box.contains(lonlat+vw::Vector2(360,0))
-                              && !lonlat_box.contains(lonlat-vw::Vector2(360,0))) {
-        continue;
-      }
-
-    }else if (!is_lola_rdr_format){
-
-      // lat,lon,height format
-      double height;
-
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
-      std::int64_t ret = sscanf(token, "%lg", &lat);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &height);
-
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 3){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
-        }
-      }
-      is_first_line = false;
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
-        continue;
-
-      vw::Vector3 llh( lon, lat, height );
-      xyz = geo.datum().geodetic_to_cartesian( llh );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) ) continue; // invalid and NaN check
-
-    }else{
-
-      // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
-      // copied from Ara Nefian's lidar2dem tool.
-      // We will ignore lines which do not start with year (or a value that
-      // cannot be converted into an integer greater than zero, specifically).
-
-      std::int64_t year, month, day, hour, min;
-      double lat, rad, sec, is_invalid;
-
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
-
-      std::int64_t ret = sscanf(token, "%lld-%lld-%lldT%lld:%lld:%lg", &year, &month, &day, &hour,
-                       &min, &sec);
-      if( year <= 0 )
-        continue;
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lat);
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &rad);
-      rad *= 1000; // km to m
-
-      // Scan 7 more fields, until we get to the is_invalid flag.
-      for (std::int64_t i = 0; i < 7; i++)
-        token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &is_invalid);
-
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 10){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
-        }
-      }
-      is_first_line = false;
-
-      if (is_invalid)
-        continue;
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(vw::Vector2(lon, lat)))
-        continue;
-
-      vw::Vector3 lonlatrad( lon, lat, 0 );
-
-      xyz = geo.datum().geodetic_to_cartesian( lonlatrad );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
-
-      // Adjust the point so that it is at the right distance from
-      // planet center.
-      xyz = rad*(xyz/norm_2(xyz));
+  CsvParseParams params;
+  params.file_name          = file_name;
+  params.lonlat_box         = lonlat_box;
+  params.geo                = geo;
+  params.csv_conv           = csv_conv;
+  params.is_lola_rdr_format = is_lola_rdr_format;
+  params.verbose            = verbose;
+
+  // Sample each chunk in parallel
+  std::int64_t file_size = boost::filesystem::file_size(file_name);
+  std::int64_t num_chunks = std::max(std::int64_t(1),
+                                     (file_size + CSV_CHUNK_SIZE - 1) / CSV_CHUNK_SIZE);
+  std::int64_t max_points = std::max(num_points_to_load, std::int64_t(0));
+  std::vector<std::vector<CsvPoint>> samples(num_chunks);
+  std::vector<std::int64_t> num_valid(num_chunks, 0);
+  std::mutex mutex;
+  std::string error;
+  {
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (std::int64_t chunk = 0; chunk < num_chunks; chunk++) {
+      std::int64_t beg = chunk * CSV_CHUNK_SIZE;
+      std::int64_t end = std::min(beg + CSV_CHUNK_SIZE, file_size);
+      queue.add_task(boost::shared_ptr<CsvChunkTask>
+                     (new CsvChunkTask(params, beg, end, max_points, chunk,
+                                       samples[chunk], num_valid[chunk], mutex, error)));
     }
-
-    if (calc_shift && !shift_was_calc){
-      shift = xyz;
-      shift_was_calc = true;
+    queue.join_all();
+  }
+  if (error != "")
+    vw_throw(vw::ArgumentErr() << error);
+
+  // Merge the samples. Each point is taken from a chunk with probability
+  // proportional to the valid points in it not yet accounted for, which
+  // gives a uniform sample of all valid points.
+  std::int64_t num_total_points = 0;
+  for (std::int64_t chunk = 0; chunk < num_chunks; chunk++)
+    num_total_points += num_valid[chunk];
+  std::int64_t num_to_take = std::min(max_points, num_total_points);
+  std::vector<std::int64_t> remaining = num_valid, taken(num_chunks, 0);
+  std::int64_t num_remaining = num_total_points;
+  std::mt19937_64 gen(num_chunks);
+  data.conservativeResize(DIM+1, num_to_take);
+  std::vector<double> longitudes;
+  for (std::int64_t count = 0; count < num_to_take; count++) {
+    std::int64_t r = std::uniform_int_distribution<std::int64_t>(0, num_remaining - 1)(gen);
+    std::int64_t chunk = 0;
+    while (r >= remaining[chunk]) {
+      r -= remaining[chunk];
+      chunk++;
     }
+    CsvPoint const& point = samples[chunk][taken[chunk]];
+    taken[chunk]++;
+    remaining[chunk]--;
+    num_remaining--;
 
+    if (calc_shift && count == 0)
+      shift = point.xyz;
     for (std::int64_t row = 0; row < DIM; row++)
-      data(row, points_count) = xyz[row] - shift[row];
-    data(DIM, points_count) = 1;
-
-    points_count++;
-    longitudes.push_back(lon);
-
-    // Throw an error if the lon and lat are not within bounds.
-    // Note that we allow some slack for lon, perhaps the point
-    // cloud is say from 350 to 370 degrees.
-    if (std::abs(lat) > 90.0)
-      vw_throw(vw::ArgumentErr() << "Invalid latitude value: "
-               << lat << " in " << file_name << "\n");
-    if (lon < -360.0 || lon > 2*360.0)
-      vw_throw(vw::ArgumentErr() << "Invalid longitude value: "
-               << lon << " in " << file_name << "\n");
+      data(row, count) = point.xyz[row] - shift[row];
+    data(DIM, count) = 1;
+    longitudes.push_back(point.lon);
   }
-  data.conservativeResize(Eigen::NoChange, points_count);
 
   median_longitude = 0.0;
   std::sort(longitudes.begin(), longitudes.end());
@@ -339,7 +481,8 @@ std::int64_t load_csv_aux(std::string const& file_name, std::int64_t num_points_
   return num_total_points;
 }
 
-// Load a csv file
+// Load a csv file. All of it is read, and a uniform random sample
+// of the points in the box is kept.
 void load_csv(std::string const& file_name,
                  std::int64_t num_points_to_load,
                  vw::BBox2 const& lonlat_box,
@@ -352,38 +495,77 @@ void load_csv(std::string const& file_name,
                  bool verbose,
                  DoubleMatrix & data){
 
-  std::int64_t num_total_points = load_csv_aux(file_name, num_points_to_load,
-                                      lonlat_box,
-                                      calc_shift, shift,
-                                      geo, csv_conv, is_lola_rdr_format,
-                                      median_longitude, verbose, data);
-  
-  std::int64_t num_loaded_points = data.cols();
-  if (!lonlat_box.empty()                    &&
-      num_loaded_points < num_points_to_load &&
-      num_loaded_points < num_total_points){
-    // We loaded too few points. Just load them all, as CSV files are
-    // not too large, we will drop extraneous points later.
-    load_csv_aux(file_name, num_total_points, lonlat_box,
-                 calc_shift, shift,
-                 geo, csv_conv, is_lola_rdr_format,
-                 median_longitude,
-                 false, // Skip repeating same messages
-                 data);
-  }
-  
-  return;
+  load_csv_aux(file_name, num_points_to_load, lonlat_box,
+               calc_shift, shift,
+               geo, csv_conv, is_lola_rdr_format,
+               median_longitude, verbose, data);
 }
 
-// Load a DEM
+// Read every stride-th pixel of some rows of a DEM, starting with the
+// first row and column of the box, and keep the valid points in it.
+template<typename DemPixelType>
+class DemRowsTask: public vw::Task, private boost::noncopyable {
+  vw::DiskImageView<DemPixelType> m_dem;
+  vw::cartography::GeoReference const& m_dem_geo;
+  DemPixelType m_nodata;
+  vw::BBox2 const& m_lonlat_box;
+  vw::BBox2i m_pix_box;
+  std::int64_t m_stride, m_beg_row, m_end_row;
+  std::vector<vw::Vector3> & m_points;
+  std::mutex  & m_mutex;
+  std::string & m_error;
+public:
+  DemRowsTask(vw::DiskImageView<DemPixelType> const& dem,
+              vw::cartography::GeoReference const& dem_geo, DemPixelType nodata,
+              vw::BBox2 const& lonlat_box, vw::BBox2i const& pix_box,
+              std::int64_t stride, std::int64_t beg_row, std::int64_t end_row,
+              std::vector<vw::Vector3> & points, std::mutex & mutex, std::string & error):
+    m_dem(dem), m_dem_geo(dem_geo), m_nodata(nodata), m_lonlat_box(lonlat_box),
+    m_pix_box(pix_box), m_stride(stride), m_beg_row(beg_row), m_end_row(end_row),
+    m_points(points), m_mutex(mutex), m_error(error) {}
+
+  void operator()() {
+    try {
+      for (std::int64_t j = m_beg_row; j < m_end_row; j += m_stride) {
+        vw::ImageView<DemPixelType> row
+          = vw::crop(m_dem, vw::BBox2i(m_pix_box.min().x(), j, m_pix_box.width(), 1));
+        for (std::int64_t c = 0; c < row.cols(); c += m_stride) {
+          DemPixelType h = row(c, 0);
+          if (h == m_nodata || std::isnan(h) || std::isinf(h))
+            continue;
+
+          std::int64_t i = m_pix_box.min().x() + c;
+          vw::Vector2 lonlat = m_dem_geo.pixel_to_lonlat(vw::Vector2(i, j));
+
+          // Skip points outside the given box
+          if (!m_lonlat_box.empty() && !m_lonlat_box.contains(lonlat))
+            continue;
+
+          vw::Vector3 llh(lonlat.x(), lonlat.y(), h);
+          vw::Vector3 xyz = m_dem_geo.datum().geodetic_to_cartesian(llh);
+          if (xyz == vw::Vector3() || !(xyz == xyz))
+            continue; // invalid and NaN check
+
+          m_points.push_back(xyz);
+        }
+      }
+    } catch (std::exception const& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_error == "")
+        m_error = e.what();
+    }
+  }
+};
+
+// Load a DEM. Pixels on a regular grid are read, with a stride chosen
+// so that there are about num_points_to_load of them, and the bands
+// of rows of the grid are read in parallel.
 template<typename DemPixelType>
 void load_dem_pixel_type(std::string const& file_name,
                          std::int64_t num_points_to_load, vw::BBox2 const& lonlat_box,
                          bool calc_shift, vw::Vector3 & shift,
                          bool verbose, DoubleMatrix & data){
   
-  data.conservativeResize(DIM+1, num_points_to_load);
-
   vw::cartography::GeoReference dem_geo;
   bool has_georef = vw::cartography::read_georeference( dem_geo, file_name );
   if (!has_georef)
@@ -418,64 +600,59 @@ void load_dem_pixel_type(std::string const& file_name,
   if (pix_box.empty())
     pix_box = bounding_box(dem);
 
-  // We will randomly pick or not a point with probability load_ratio.
   // Use int64_t to avoid integer overflow
   std::int64_t num_points = std::int64_t(pix_box.width()) * std::int64_t(pix_box.height());
-  double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_points);
-
-  bool shift_was_calc = false;
-  std::int64_t  points_count   = 0;
-
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / double(pix_box.width() );
-  if (verbose)
-    tpc.report_progress(0);
-
-  for (std::int64_t i = pix_box.min().x(); i < pix_box.max().x(); i++ ) {
-
-    for (std::int64_t j = pix_box.min().y(); j < pix_box.max().y(); j++ ) {
-      if (points_count >= num_points_to_load)
-        break;
-
-      double r = (double)std::rand()/(double)RAND_MAX;
-      if (r > load_ratio)
-        continue;
-
-      DemPixelType h = dem(i, j);
-      if ( h == nodata || std::isnan(h) || std::isinf(h) )
-        continue;
-      
-      vw::Vector2 lonlat = dem_geo.pixel_to_lonlat( vw::Vector2(i,j) );
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(lonlat))
-        continue;
-
-      vw::Vector3 llh( lonlat.x(), lonlat.y(), h );
-      vw::Vector3 xyz = dem_geo.datum().geodetic_to_cartesian( llh );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
+  std::int64_t stride = 1;
+  if (num_points_to_load > 0)
+    stride = std::max(std::int64_t(1),
+                      std::int64_t(std::sqrt(double(num_points) / double(num_points_to_load))));
+
+  // Each task gets a band of rows of the grid
+  const std::int64_t rows_per_task = 64;
+  std::int64_t band = rows_per_task * stride;
+  std::int64_t num_tasks = (pix_box.height() + band - 1) / band;
+  std::vector<std::vector<vw::Vector3>> points(num_tasks);
+  std::mutex mutex;
+  std::string error;
+  {
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (std::int64_t t = 0; t < num_tasks; t++) {
+      std::int64_t beg_row = pix_box.min().y() + t * band;
+      std::int64_t end_row = std::min(beg_row + band, std::int64_t(pix_box.max().y()));
+      queue.add_task(boost::shared_ptr<DemRowsTask<DemPixelType>>
+                     (new DemRowsTask<DemPixelType>(dem, dem_geo, nodata, lonlat_box,
+                                                    pix_box, stride, beg_row, end_row,
+                                                    points[t], mutex, error)));
+    }
+    queue.join_all();
+  }
+  if (error != "")
+    vw_throw(vw::ArgumentErr() << error);
 
-      if (calc_shift && !shift_was_calc){
+  std::int64_t points_count = 0;
+  for (std::int64_t t = 0; t < num_tasks; t++)
+    points_count += points[t].size();
+  data.conservativeResize(DIM+1, points_count);
+  std::int64_t col = 0;
+  for (std::int64_t t = 0; t < num_tasks; t++) {
+    for (size_t it = 0; it < points[t].size(); it++) {
+      vw::Vector3 const& xyz = points[t][it];
+      if (calc_shift && col == 0)
         shift = xyz;
-        shift_was_calc = true;
-      }
-
       for (std::int64_t row = 0; row < DIM; row++)
-        data(row, points_count) = xyz[row] - shift[row];
-      data(DIM, points_count) = 1; // Extend to be a homogenous coordinate
-
-      points_count++;
-    } // end y loop
+        data(row, col) = xyz[row] - shift[row];
+      data(DIM, col) = 1; // Extend to be a homogenous coordinate
+      col++;
+    }
+  }
 
-    if (verbose)
-      tpc.report_incremental_progress( inc_amount );
-  } // end x loop
+  // The grid may have a few more points than needed
+  if (points_count > num_points_to_load)
+    random_pc_subsample(num_points_to_load, data);
+  
   if (verbose)
-    tpc.report_finished();
-
-  data.conservativeResize(Eigen::NoChange, points_count);
-
+    vw::vw_out() << "Read " << data.cols() << " points from " << file_name
+                 << " with a stride of " << stride << " pixels.\n";
 }
 
 // Load a DEM
@@ -624,6 +801,29 @@ void bestFitPlane(const std::vector<Eigen::Vector3d>& points, Eigen::Vector3d& c
 
   plane_normal = svd.matrixU().rightCols<1>();
 }
+
+void bestFitPlane(Eigen::Vector3d const* points, int num_points,
+                  Eigen::Vector3d& centroid, Eigen::Vector3d& plane_normal) {
+
+  if (num_points < 3)
+    vw_throw( ArgumentErr() << "Need 3 points to fit a plane.\n");
+
+  centroid = Eigen::Vector3d::Zero();
+  for (int i = 0; i < num_points; i++)
+    centroid += points[i];
+  centroid /= num_points;
+
+  // Subtract the centroid first, as the points may be far from the origin
+  Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+  for (int i = 0; i < num_points; i++) {
+    Eigen::Vector3d d = points[i] - centroid;
+    scatter += d * d.transpose();
+  }
+
+  // The eigenvalues are sorted in increasing order
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(scatter);
+  plane_normal = solver.eigenvectors().col(0);
+}
   
 // Compute a rigid transform between n point correspondences.
 // There exists another version of this using vw matrices
@@ -46,7 +46,9 @@ const int DIM = 3;
 // Return at most m random points out of the input point cloud.
 void random_pc_subsample(std::int64_t m, DoubleMatrix& points);
   
-// Load a csv file, perhaps sub-sampling it along the way
+// Load a csv file, perhaps sub-sampling it along the way. The file is
+// read in parallel chunks, and the points kept are a uniform random
+// sample of the valid ones, the same for any number of threads.
 void load_csv(std::string const& file_name,
               std::int64_t num_points_to_load,
               vw::BBox2 const& lonlat_box,
@@ -58,7 +60,8 @@ void load_csv(std::string const& file_name,
               double & median_longitude, bool verbose,
               DoubleMatrix & data);
   
-// Load a DEM, perhaps subsampling it along the way
+// Load a DEM, perhaps subsampling it along the way. Only the pixels on
+// a regular grid with about num_points_to_load points are read.
 void load_dem(std::string const& file_name,
               std::int64_t num_points_to_load, vw::BBox2 const& lonlat_box,
               bool calc_shift, vw::Vector3 & shift, bool verbose, 
@@ -78,6 +81,13 @@ void load_pc(std::string const& file_name,
 void bestFitPlane(const std::vector<Eigen::Vector3d>& points, Eigen::Vector3d& centroid,
                   Eigen::Vector3d& plane_normal);
 
+// Same as above for a few points in an array. The normal is found as
+// the eigenvector for the smallest eigenvalue of the 3x3 scatter
+// matrix, with no memory allocated, which is much faster when called
+// for each of many small neighborhoods.
+void bestFitPlane(Eigen::Vector3d const* points, int num_points,
+                  Eigen::Vector3d& centroid, Eigen::Vector3d& plane_normal);
+
   // Compute a rigid transform between n point correspondences.
 // There exists another version of this using vw matrices
 // in VisionWorkbench called find_3D_transform().  
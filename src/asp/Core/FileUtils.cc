@@ -17,6 +17,10 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <boost/cstdint.hpp>
+
+#include <iomanip>
+#include <vector>
 
 #include <asp/Core/FileUtils.h>
 
@@ -61,6 +65,54 @@ namespace asp{
     return is_latest_timestamp(test_file, vec);
   }
 
+  std::string file_timestamp(std::string const& file) {
+    std::ostringstream os;
+    try {
+      os << boost::filesystem::last_write_time(file);
+    } catch(...) {
+      os << 0;
+    }
+    return os.str();
+  }
+
+  // The FNV-1a hash. Unlike std::hash, it is the same for all compilers.
+  const boost::uint64_t FNV_OFFSET = 14695981039346656037ULL;
+  void fnv_hash(const char * data, size_t len, boost::uint64_t & hash) {
+    for (size_t it = 0; it < len; it++) {
+      hash ^= (unsigned char)data[it];
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  std::string cache_file_name(std::string const& dir, std::string const& prefix,
+                              std::string const& key, std::string const& suffix) {
+
+    boost::uint64_t hash = FNV_OFFSET;
+    fnv_hash(key.data(), key.size(), hash);
+
+    std::ostringstream os;
+    os << dir << "/" << prefix << std::hex << std::setw(16) << std::setfill('0')
+       << hash << suffix;
+    return os.str();
+  }
+
+  std::string file_content_hash(std::string const& file) {
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return "0";
+
+    boost::uint64_t hash = FNV_OFFSET;
+    std::vector<char> buf(1 << 16);
+    while (ifs) {
+      ifs.read(&buf[0], buf.size());
+      fnv_hash(&buf[0], ifs.gcount(), hash);
+    }
+
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return os.str();
+  }
+
   void read_1d_points(std::string const& file, std::vector<double> & points){
 
     std::ifstream ifs(file.c_str());
@@ -40,6 +40,24 @@ namespace asp {
                            std::string const& f1, std::string const& f2,
                            std::string const& f3, std::string const& f4);
 
+  /// The modification time of a file, as a string, or "0" if the file
+  /// does not exist. Used in keys describing what a cached result was
+  /// computed from, so that it is not reused once an input changes.
+  std::string file_timestamp(std::string const& file);
+
+  /// The name of a file in the given directory in which to cache a
+  /// result computed from what the key describes. The name has a hash
+  /// of the key which does not depend on the compiler, so it is the
+  /// same for all builds. Different keys may give the same name, so
+  /// the key must also be saved in the file and checked on reading.
+  std::string cache_file_name(std::string const& dir, std::string const& prefix,
+                              std::string const& key, std::string const& suffix);
+
+  /// A hash of the contents of a file, as a hex string, or "0" if it
+  /// cannot be read. As with cache_file_name(), it is the same for all
+  /// builds.
+  std::string file_content_hash(std::string const& file);
+
   void read_1d_points(std::string const& file, std::vector<double> & points);
   void read_2d_points(std::string const& file, std::vector<vw::Vector2> & points);
   void read_3d_points(std::string const& file, std::vector<vw::Vector3> & points);
@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file FootprintMask.cc
+///
+
+#include <asp/Core/FootprintMask.h>
+
+#include <algorithm>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    // Positive if o, a, b turn counterclockwise
+    double cross(Vector2 const& o, Vector2 const& a, Vector2 const& b) {
+      return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+    }
+
+    bool less_xy(Vector2 const& a, Vector2 const& b) {
+      return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    }
+  }
+
+  // Andrew's monotone chain
+  void convex_hull(std::vector<Vector2> const& points, std::vector<Vector2> & hull) {
+    hull.clear();
+    std::vector<Vector2> pts = points;
+    std::sort(pts.begin(), pts.end(), less_xy);
+    pts.erase(std::unique(pts.begin(), pts.end()), pts.end());
+    if (pts.size() < 3) {
+      hull = pts;
+      return;
+    }
+
+    std::vector<Vector2> h(2 * pts.size());
+    size_t k = 0;
+    for (size_t i = 0; i < pts.size(); i++) { // lower hull
+      while (k >= 2 && cross(h[k - 2], h[k - 1], pts[i]) <= 0)
+        k--;
+      h[k++] = pts[i];
+    }
+    for (size_t i = pts.size() - 1, t = k + 1; i > 0; i--) { // upper hull
+      while (k >= t && cross(h[k - 2], h[k - 1], pts[i - 1]) <= 0)
+        k--;
+      h[k++] = pts[i - 1];
+    }
+    h.resize(k - 1); // the last point is the first one
+    hull = h;
+  }
+
+  // Two convex shapes do not intersect if and only if there is a line
+  // separating them, perpendicular to an edge of one of them.
+  bool convex_polygon_intersects_box(std::vector<Vector2> const& poly, BBox2 const& box) {
+    if (poly.empty() || box.empty())
+      return false;
+
+    // The axes of the box
+    BBox2 poly_box;
+    for (size_t i = 0; i < poly.size(); i++)
+      poly_box.grow(poly[i]);
+    if (poly_box.max().x() < box.min().x() || poly_box.min().x() > box.max().x() ||
+        poly_box.max().y() < box.min().y() || poly_box.min().y() > box.max().y())
+      return false;
+
+    // The edges of the polygon. The box corners all on the outer side
+    // of an edge means there is no intersection.
+    if (poly.size() < 3)
+      return true;
+    Vector2 corners[4] = {box.min(), Vector2(box.max().x(), box.min().y()),
+                          box.max(), Vector2(box.min().x(), box.max().y())};
+    for (size_t i = 0; i < poly.size(); i++) {
+      Vector2 const& a = poly[i];
+      Vector2 const& b = poly[(i + 1) % poly.size()];
+      bool all_outside = true;
+      for (int c = 0; c < 4; c++)
+        all_outside = all_outside && (cross(a, b, corners[c]) < 0);
+      if (all_outside)
+        return false;
+    }
+    return true;
+  }
+
+} // end namespace asp
@@ -0,0 +1,115 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file FootprintMask.h
+///
+/// Skip the tiles of an image which are outside of a footprint, given
+/// as a convex polygon in the pixels of the image. Such tiles are
+/// filled with a given pixel, without evaluating the image, so for a
+/// mapprojected image there are no camera calls for them.
+
+#ifndef __ASP_CORE_FOOTPRINT_MASK_H__
+#define __ASP_CORE_FOOTPRINT_MASK_H__
+
+#include <vw/Image/Algorithms.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// The convex hull of points in the plane, in counterclockwise order
+  /// for the x axis to the right and the y axis up, with no collinear
+  /// points.
+  void convex_hull(std::vector<vw::Vector2> const& points,
+                   std::vector<vw::Vector2> & hull);
+
+  /// If a convex polygon, as from convex_hull(), intersects a box
+  bool convex_polygon_intersects_box(std::vector<vw::Vector2> const& poly,
+                                     vw::BBox2 const& box);
+
+  /// An image whose tiles which do not intersect the footprint, grown
+  /// by a margin, are filled with a given pixel. An empty footprint
+  /// means that all tiles are evaluated.
+  template <class ImageT>
+  class FootprintMaskView: public vw::ImageViewBase<FootprintMaskView<ImageT>> {
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<FootprintMaskView<ImageT>> pixel_accessor;
+
+    FootprintMaskView(ImageT const& image, std::vector<vw::Vector2> const& footprint,
+                      double margin, pixel_type const& fill_pixel):
+      m_image(image), m_footprint(footprint), m_margin(margin), m_fill(fill_pixel) {}
+
+    inline vw::int32 cols  () const { return m_image.cols(); }
+    inline vw::int32 rows  () const { return m_image.rows(); }
+    inline vw::int32 planes() const { return m_image.planes(); }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p = 0) const {
+      return m_image(i, j, p);
+    }
+
+    /// If the tile with this box is evaluated
+    bool in_footprint(vw::BBox2i const& bbox) const {
+      vw::BBox2 grown = bbox;
+      grown.expand(m_margin);
+      return m_footprint.empty() || convex_polygon_intersects_box(m_footprint, grown);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      if (in_footprint(bbox))
+        tile = vw::crop(m_image, bbox);
+      else
+        vw::fill(tile, m_fill);
+      return prerasterize_type(tile, vw::BBox2i(-bbox.min().x(), -bbox.min().y(),
+                                                cols(), rows()));
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+
+  private:
+    ImageT                   m_image;
+    std::vector<vw::Vector2> m_footprint;
+    double                   m_margin;
+    pixel_type               m_fill;
+  };
+
+  template <class ImageT>
+  FootprintMaskView<ImageT>
+  footprint_mask(vw::ImageViewBase<ImageT> const& image,
+                 std::vector<vw::Vector2> const& footprint, double margin,
+                 typename ImageT::pixel_type const& fill_pixel) {
+    return FootprintMaskView<ImageT>(image.impl(), footprint, margin, fill_pixel);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_FOOTPRINT_MASK_H__
@@ -0,0 +1,235 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/FileUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/FileIO/FileUtils.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Transform.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // Written at the start of each alignment file. Change this if the format changes.
+  const std::string IMAGE_ALIGNMENT_MAGIC = "ASP image alignment 1";
+
+  ImageAlignment::ImageAlignment():
+    method("none"), interp("bilinear"),
+    left_nodata(std::numeric_limits<float>::quiet_NaN()),
+    right_nodata(std::numeric_limits<float>::quiet_NaN()),
+    left_matrix(vw::math::identity_matrix<3>()), right_matrix(vw::math::identity_matrix<3>()),
+    left_lo(0.0), left_hi(1.0), right_lo(0.0), right_hi(1.0) {}
+
+  std::string image_alignment_file(std::string const& out_prefix) {
+    return out_prefix + "-align.txt";
+  }
+
+  std::string aligned_image_file(std::string const& out_prefix, bool is_left) {
+    return out_prefix + (is_left ? "-L.tif" : "-R.tif");
+  }
+
+  // Read the record for one image. The no-data value may be NaN,
+  // which the stream operators do not parse.
+  bool read_image_record(std::istream & ifs, std::string & image, std::string & timestamp,
+                         float & nodata, vw::Vector2i & size, double & lo, double & hi,
+                         vw::Matrix3x3 & matrix) {
+    std::string line, nodata_str;
+    if (!std::getline(ifs, image) || !std::getline(ifs, line))
+      return false;
+    std::istringstream is(line);
+    if (!(is >> timestamp >> nodata_str >> size[0] >> size[1] >> lo >> hi))
+      return false;
+    nodata = std::strtod(nodata_str.c_str(), NULL);
+    for (int row = 0; row < 3; row++)
+      for (int col = 0; col < 3; col++)
+        is >> matrix(row, col);
+    return bool(is);
+  }
+
+  void write_image_record(std::ostream & ofs, std::string const& image,
+                          std::string const& timestamp, float nodata,
+                          vw::Vector2i const& size, double lo, double hi,
+                          vw::Matrix3x3 const& matrix) {
+    ofs << image << "\n";
+    ofs << timestamp << " " << nodata << " " << size[0] << " " << size[1] << " "
+        << lo << " " << hi;
+    for (int row = 0; row < 3; row++)
+      for (int col = 0; col < 3; col++)
+        ofs << " " << matrix(row, col);
+    ofs << "\n";
+  }
+
+  bool read_image_alignment(std::string const& file, ImageAlignment & align) {
+
+    std::ifstream ifs(file.c_str());
+    if (!ifs.good())
+      return false;
+
+    std::string magic, line;
+    std::getline(ifs, magic);
+    if (magic != IMAGE_ALIGNMENT_MAGIC || !std::getline(ifs, line))
+      return false;
+    std::istringstream is(line);
+    if (!(is >> align.method >> align.interp))
+      return false;
+
+    if (!read_image_record(ifs, align.left_image, align.left_timestamp, align.left_nodata,
+                           align.left_size, align.left_lo, align.left_hi,
+                           align.left_matrix) ||
+        !read_image_record(ifs, align.right_image, align.right_timestamp, align.right_nodata,
+                           align.right_size, align.right_lo, align.right_hi,
+                           align.right_matrix))
+      return false;
+
+    // The alignment is stale if an input image changed
+    return (align.left_timestamp  == asp::file_timestamp(align.left_image) &&
+            align.right_timestamp == asp::file_timestamp(align.right_image));
+  }
+
+  void write_image_alignment(std::string const& file, ImageAlignment const& align) {
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial file.
+    std::string tmp_file = file + ".tmp";
+    vw::create_out_dir(file);
+    {
+      std::ofstream ofs(tmp_file.c_str());
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+
+      ofs.precision(17);
+      ofs << IMAGE_ALIGNMENT_MAGIC << "\n";
+      ofs << align.method << " " << align.interp << "\n";
+      write_image_record(ofs, align.left_image, align.left_timestamp, align.left_nodata,
+                         align.left_size, align.left_lo, align.left_hi, align.left_matrix);
+      write_image_record(ofs, align.right_image, align.right_timestamp, align.right_nodata,
+                         align.right_size, align.right_lo, align.right_hi, align.right_matrix);
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    fs::rename(tmp_file, file);
+  }
+
+  vw::ImageViewRef<vw::PixelMask<float>> aligned_image(ImageAlignment const& align,
+                                                       bool is_left) {
+
+    if (align.interp != "bilinear")
+      vw::vw_throw(vw::ArgumentErr() << "Unsupported interpolation for image alignment: "
+                   << align.interp << ".\n");
+
+    std::string   const& image  = is_left ? align.left_image  : align.right_image;
+    vw::Matrix3x3 const& matrix = is_left ? align.left_matrix : align.right_matrix;
+    vw::Vector2i  const& size   = is_left ? align.left_size   : align.right_size;
+    float  nodata = is_left ? align.left_nodata : align.right_nodata;
+    double lo     = is_left ? align.left_lo     : align.right_lo;
+    double hi     = is_left ? align.left_hi     : align.right_hi;
+
+    // This must agree with how StereoSession::preprocessing_hook()
+    // writes L.tif and R.tif.
+    vw::ImageViewRef<vw::PixelMask<float>> masked
+      = vw::create_mask_less_or_equal(vw::DiskImageView<float>(image), nodata);
+    if (align.method != "none")
+      masked = vw::transform(masked, vw::HomographyTransform(matrix), size.x(), size.y());
+    return vw::normalize(masked, lo, hi, 0.0, 1.0);
+  }
+
+  // Read the alignment for this prefix, or throw an error
+  void read_prefix_alignment(std::string const& out_prefix, bool is_left,
+                             ImageAlignment & align) {
+    std::string align_file = image_alignment_file(out_prefix);
+    if (!read_image_alignment(align_file, align))
+      vw::vw_throw(vw::ArgumentErr() << "Could not read: "
+                   << aligned_image_file(out_prefix, is_left)
+                   << ". There is also no valid alignment in: " << align_file
+                   << ", to produce it from the input images. Run stereo_pprc again.\n");
+  }
+
+  vw::ImageViewRef<float> read_aligned_image(std::string const& out_prefix, bool is_left,
+                                             float & nodata) {
+
+    std::string image_file = aligned_image_file(out_prefix, is_left);
+    if (fs::exists(image_file)) {
+      boost::shared_ptr<vw::DiskImageResource> rsrc(vw::DiskImageResourcePtr(image_file));
+      nodata = std::numeric_limits<float>::quiet_NaN();
+      if (rsrc->has_nodata_read())
+        nodata = rsrc->nodata_read();
+      return vw::DiskImageView<float>(rsrc);
+    }
+
+    ImageAlignment align;
+    read_prefix_alignment(out_prefix, is_left, align);
+    nodata = ALIGNED_IMAGE_NODATA;
+    return vw::apply_mask(aligned_image(align, is_left), ALIGNED_IMAGE_NODATA);
+  }
+
+  vw::ImageViewRef<float> read_aligned_image(std::string const& out_prefix, bool is_left) {
+    float nodata = 0.0;
+    return read_aligned_image(out_prefix, is_left, nodata);
+  }
+
+  bool aligned_image_exists(std::string const& out_prefix, bool is_left) {
+    ImageAlignment align;
+    return (fs::exists(aligned_image_file(out_prefix, is_left)) ||
+            read_image_alignment(image_alignment_file(out_prefix), align));
+  }
+
+  vw::Vector2i aligned_image_size(std::string const& out_prefix, bool is_left) {
+
+    std::string image_file = aligned_image_file(out_prefix, is_left);
+    if (fs::exists(image_file)) {
+      boost::shared_ptr<vw::DiskImageResource> rsrc(vw::DiskImageResourcePtr(image_file));
+      return vw::Vector2i(rsrc->cols(), rsrc->rows());
+    }
+
+    ImageAlignment align;
+    read_prefix_alignment(out_prefix, is_left, align);
+    return is_left ? align.left_size : align.right_size;
+  }
+
+  bool read_aligned_georef(std::string const& out_prefix, bool is_left,
+                           vw::cartography::GeoReference & georef) {
+
+    std::string image_file = aligned_image_file(out_prefix, is_left);
+    if (fs::exists(image_file))
+      return vw::cartography::read_georeference(georef, image_file);
+
+    ImageAlignment align;
+    read_prefix_alignment(out_prefix, is_left, align);
+    if (align.method != "none")
+      return false;
+    return vw::cartography::read_georeference(georef, is_left ? align.left_image :
+                                              align.right_image);
+  }
+
+} // end namespace asp
@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImageAlignment.h
+///
+/// What is needed to produce the aligned and normalized images,
+/// L.tif and R.tif, from the cropped input images: the alignment
+/// matrices, the interpolation, and the normalization. It is saved
+/// by stereo_pprc, so that later stages can resample just the tiles
+/// they need from the input images instead of reading L.tif and
+/// R.tif, which then do not need to be written.
+
+#ifndef __ASP_CORE_IMAGE_ALIGNMENT_H__
+#define __ASP_CORE_IMAGE_ALIGNMENT_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+
+namespace vw { namespace cartography {
+  class GeoReference;
+}}
+
+namespace asp {
+
+  /// The no-data value of the aligned images. It must be < 0 as the
+  /// images are scaled to around [0, 1].
+  const float ALIGNED_IMAGE_NODATA = -32768.0;
+
+  /// How each aligned image is found from a cropped input image. With
+  /// alignment method none the matrices are not used, and the images
+  /// are only normalized.
+  struct ImageAlignment {
+    std::string   method;     // the alignment method
+    std::string   interp;     // the interpolation, only "bilinear" for now
+    std::string   left_image,     right_image;     // the cropped input images
+    std::string   left_timestamp, right_timestamp; // as from file_timestamp()
+    float         left_nodata,    right_nodata;    // NaN if none
+    vw::Matrix3x3 left_matrix,    right_matrix;    // from input to aligned pixels
+    vw::Vector2i  left_size,      right_size;      // of the aligned images
+    double        left_lo, left_hi, right_lo, right_hi; // mapped to [0, 1]
+    ImageAlignment();
+  };
+
+  /// The file having the alignment for the given output prefix
+  std::string image_alignment_file(std::string const& out_prefix);
+
+  /// Read and write an alignment file. Reading returns false if the
+  /// file is missing or invalid, or if one of the input images changed
+  /// after the file was written.
+  bool read_image_alignment(std::string const& file, ImageAlignment & align);
+  void write_image_alignment(std::string const& file, ImageAlignment const& align);
+
+  /// The aligned and normalized image, produced on the fly. Invalid
+  /// pixels are those which are no-data or outside the input image.
+  vw::ImageViewRef<vw::PixelMask<float>> aligned_image(ImageAlignment const& align,
+                                                       bool is_left);
+
+  /// The aligned image out_prefix-L.tif, or out_prefix-R.tif if not
+  /// is_left. If it was not written, produce it on the fly with the
+  /// alignment saved for this prefix, having the no-data value
+  /// ALIGNED_IMAGE_NODATA. Return the no-data value, or NaN if there
+  /// is none.
+  vw::ImageViewRef<float> read_aligned_image(std::string const& out_prefix, bool is_left,
+                                             float & nodata);
+  vw::ImageViewRef<float> read_aligned_image(std::string const& out_prefix, bool is_left);
+
+  /// If the aligned image can be read by read_aligned_image()
+  bool aligned_image_exists(std::string const& out_prefix, bool is_left);
+
+  /// The size of the aligned image, without reading the input images
+  vw::Vector2i aligned_image_size(std::string const& out_prefix, bool is_left);
+
+  /// Read the georeference of the aligned image. When produced on the
+  /// fly, this is the georeference of the input image with alignment
+  /// method none, and there is none otherwise, as for L.tif.
+  bool read_aligned_georef(std::string const& out_prefix, bool is_left,
+                           vw::cartography::GeoReference & georef);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_IMAGE_ALIGNMENT_H__
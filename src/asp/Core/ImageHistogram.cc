@@ -0,0 +1,399 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImageHistogram.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/FileIO/FileUtils.h>
+#include <asp/Core/BinaryIO.h>
+#include <asp/Core/FileUtils.h>
+#include <asp/Core/ImageHistogram.h>
+
+#include <boost/core/noncopyable.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+using namespace vw;
+
+namespace asp {
+
+  // Written at the start of each histogram file. Change this if the format changes.
+  const std::string IMAGE_HISTOGRAM_MAGIC = "ASP image histogram 2";
+
+  // The bin of a value, for num_bins bins spanning [min_val, max_val]
+  inline int hist_bin(double val, double min_val, double max_val, int num_bins) {
+    if (max_val <= min_val)
+      return 0;
+    int bin = (int)((val - min_val) / (max_val - min_val) * num_bins);
+    return std::min(std::max(bin, 0), num_bins - 1);
+  }
+
+  // Scan a tile of the image. In the first pass, find the range of its
+  // valid values, and their sum and sum of squares. In the second pass,
+  // count its values in each bin. The range and counts are merged into
+  // the shared ones under a lock. The sums are kept per tile and added
+  // in tile order, so that the result does not depend on the order in
+  // which the tiles finish.
+  class HistogramTask: public vw::Task, private boost::noncopyable {
+    ImageViewRef<PixelMask<double>> m_img;
+    BBox2i m_box;
+    bool m_find_range;
+    std::mutex & m_mutex;
+    double & m_min;
+    double & m_max;
+    Vector2 & m_tile_sums;
+    std::vector<std::int64_t> & m_counts;
+    std::string & m_error;
+  public:
+    HistogramTask(ImageViewRef<PixelMask<double>> const& img, BBox2i const& box,
+                  bool find_range, std::mutex & mutex, double & min_val, double & max_val,
+                  Vector2 & tile_sums, std::vector<std::int64_t> & counts,
+                  std::string & error):
+      m_img(img), m_box(box), m_find_range(find_range), m_mutex(mutex),
+      m_min(min_val), m_max(max_val), m_tile_sums(tile_sums), m_counts(counts),
+      m_error(error) {}
+
+    void operator()() {
+      try {
+        ImageView<PixelMask<double>> tile = crop(m_img, m_box);
+
+        if (m_find_range) {
+          double min_val = std::numeric_limits<double>::max();
+          double max_val = -min_val, sum = 0.0, sum2 = 0.0;
+          for (int row = 0; row < tile.rows(); row++) {
+            for (int col = 0; col < tile.cols(); col++) {
+              if (!is_valid(tile(col, row)))
+                continue;
+              double val = tile(col, row).child();
+              if (std::isnan(val))
+                continue;
+              if (val < min_val) min_val = val;
+              if (val > max_val) max_val = val;
+              sum  += val;
+              sum2 += val * val;
+            }
+          }
+          m_tile_sums = Vector2(sum, sum2);
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_min = std::min(m_min, min_val);
+          m_max = std::max(m_max, max_val);
+          return;
+        }
+
+        int num_bins = m_counts.size();
+        std::vector<std::int64_t> counts(num_bins, 0);
+        for (int row = 0; row < tile.rows(); row++) {
+          for (int col = 0; col < tile.cols(); col++) {
+            if (!is_valid(tile(col, row)))
+              continue;
+            double val = tile(col, row).child();
+            if (std::isnan(val))
+              continue;
+            counts[hist_bin(val, m_min, m_max, num_bins)]++;
+          }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int bin = 0; bin < num_bins; bin++)
+          m_counts[bin] += counts[bin];
+      } catch (std::exception const& e) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = e.what();
+      }
+    }
+  };
+
+  ImageHistogram::ImageHistogram(): m_num_valid(0), m_min(0.0), m_max(0.0),
+                                    m_sum(0.0), m_sum2(0.0) {}
+
+  void ImageHistogram::compute(ImageViewRef<PixelMask<double>> const& img,
+                               int num_bins, int num_threads, int tile_size) {
+
+    if (num_bins <= 0 || tile_size <= 0)
+      vw_throw(ArgumentErr() << "The number of histogram bins and the tile size "
+               << "must be positive.\n");
+
+    std::vector<BBox2i> tiles;
+    for (int row = 0; row < img.rows(); row += tile_size) {
+      for (int col = 0; col < img.cols(); col += tile_size)
+        tiles.push_back(BBox2i(col, row, std::min(tile_size, img.cols() - col),
+                               std::min(tile_size, img.rows() - row)));
+    }
+
+    std::mutex mutex;
+    std::string error;
+    double min_val = std::numeric_limits<double>::max();
+    double max_val = -min_val;
+    std::vector<Vector2> tile_sums(tiles.size());
+    std::vector<std::int64_t> counts(num_bins, 0);
+    for (int pass = 0; pass < 2; pass++) {
+
+      bool find_range = (pass == 0);
+      if (!find_range && min_val > max_val)
+        break; // no valid values
+
+      vw::FifoWorkQueue queue(std::max(num_threads, 1));
+      for (size_t it = 0; it < tiles.size(); it++)
+        queue.add_task(boost::shared_ptr<HistogramTask>
+                       (new HistogramTask(img, tiles[it], find_range, mutex,
+                                          min_val, max_val, tile_sums[it], counts,
+                                          error)));
+      queue.join_all();
+
+      if (error != "")
+        vw_throw(ArgumentErr() << "Failed to compute the image histogram: " << error);
+    }
+
+    *this = ImageHistogram();
+    m_counts = counts;
+    for (int bin = 0; bin < num_bins; bin++)
+      m_num_valid += counts[bin];
+    if (m_num_valid > 0) {
+      m_min = min_val;
+      m_max = max_val;
+      for (size_t it = 0; it < tile_sums.size(); it++) {
+        m_sum  += tile_sums[it][0];
+        m_sum2 += tile_sums[it][1];
+      }
+    }
+  }
+
+  double ImageHistogram::mean() const {
+    if (empty())
+      return 0.0;
+    return m_sum / m_num_valid;
+  }
+
+  double ImageHistogram::stddev() const {
+    if (empty())
+      return 0.0;
+    double mean_val = mean();
+    return std::sqrt(std::max(m_sum2 / m_num_valid - mean_val * mean_val, 0.0));
+  }
+
+  void ImageHistogram::write(std::string const& file, std::string const& key) const {
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial file.
+    std::string tmp_file = file + ".tmp";
+    vw::create_out_dir(file);
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw_throw(IOErr() << "Cannot write: " << tmp_file << "\n");
+
+      ofs << IMAGE_HISTOGRAM_MAGIC << "\n" << key << "\n";
+      asp::write_binary(ofs, m_num_valid);
+      asp::write_binary(ofs, m_min);
+      asp::write_binary(ofs, m_max);
+      asp::write_binary(ofs, m_sum);
+      asp::write_binary(ofs, m_sum2);
+      asp::write_binary(ofs, m_counts);
+      if (!ofs.good())
+        vw_throw(IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    fs::rename(tmp_file, file);
+  }
+
+  bool ImageHistogram::read(std::string const& file, std::string const& key) {
+
+    *this = ImageHistogram();
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic, file_key;
+    std::getline(ifs, magic);
+    std::getline(ifs, file_key);
+    if (magic != IMAGE_HISTOGRAM_MAGIC || file_key != key)
+      return false;
+
+    ImageHistogram hist;
+    asp::read_binary(ifs, hist.m_num_valid);
+    asp::read_binary(ifs, hist.m_min);
+    asp::read_binary(ifs, hist.m_max);
+    asp::read_binary(ifs, hist.m_sum);
+    asp::read_binary(ifs, hist.m_sum2);
+    asp::read_binary(ifs, hist.m_counts);
+    if (ifs.fail() || hist.m_counts.empty())
+      return false;
+
+    std::int64_t total = 0;
+    for (size_t bin = 0; bin < hist.m_counts.size(); bin++)
+      total += hist.m_counts[bin];
+    if (total != hist.m_num_valid)
+      return false;
+
+    *this = hist;
+    return true;
+  }
+
+  std::vector<std::int64_t> ImageHistogram::coarse_counts(int num_bins) const {
+
+    if (num_bins <= 0 || m_counts.size() % num_bins != 0)
+      vw_throw(ArgumentErr() << "Cannot make a histogram with " << num_bins
+               << " bins from one with " << m_counts.size() << " bins.\n");
+
+    int factor = m_counts.size() / num_bins;
+    std::vector<std::int64_t> counts(num_bins, 0);
+    for (size_t bin = 0; bin < m_counts.size(); bin++)
+      counts[bin / factor] += m_counts[bin];
+    return counts;
+  }
+
+  double ImageHistogram::percentile(double q) const {
+
+    if (empty())
+      vw_throw(ArgumentErr() << "Cannot find a percentile of an empty histogram.\n");
+
+    q = std::min(std::max(q, 0.0), 1.0);
+    double rank = q * m_num_valid;
+    double bin_width = (m_max - m_min) / m_counts.size();
+
+    // Find the first non-empty bin which takes the count to the rank
+    std::int64_t before = 0;
+    for (size_t bin = 0; bin < m_counts.size(); bin++) {
+      if (m_counts[bin] == 0)
+        continue;
+      if (before + m_counts[bin] >= rank || bin + 1 == m_counts.size()) {
+        double frac = (rank - before) / m_counts[bin];
+        double val = m_min + (bin + std::min(std::max(frac, 0.0), 1.0)) * bin_width;
+        return std::min(std::max(val, m_min), m_max);
+      }
+      before += m_counts[bin];
+    }
+
+    return m_max; // not reached
+  }
+
+  bool ImageHistogram::outlier_brackets(double pct, double outlier_factor,
+                                        double & b, double & e) const {
+    b = 0.0; e = 0.0;
+    if (empty())
+      return false;
+
+    b = percentile(1.0 - pct);
+    e = percentile(pct);
+    double d = std::max(e - b, 0.0);
+    b = std::max(b - outlier_factor * d, m_min);
+    e = std::min(e + outlier_factor * d, m_max);
+
+    return true;
+  }
+
+  double ImageHistogram::otsu_threshold(int num_bins) const {
+
+    if (empty())
+      vw_throw(ArgumentErr() << "Cannot find the Otsu threshold of an empty histogram.\n");
+
+    std::vector<std::int64_t> counts = coarse_counts(num_bins);
+    double bin_width = (m_max - m_min) / num_bins;
+
+    // The bin centers are used as the values in each bin
+    double total = 0.0, total_sum = 0.0;
+    for (int bin = 0; bin < num_bins; bin++) {
+      total     += counts[bin];
+      total_sum += counts[bin] * (m_min + (bin + 0.5) * bin_width);
+    }
+
+    // Maximize the variance between the two classes
+    double w0 = 0.0, sum0 = 0.0, best_var = -1.0;
+    int best_bin = num_bins - 1;
+    for (int bin = 0; bin < num_bins - 1; bin++) {
+      w0   += counts[bin];
+      sum0 += counts[bin] * (m_min + (bin + 0.5) * bin_width);
+      double w1 = total - w0;
+      if (w0 == 0)
+        continue;
+      if (w1 == 0)
+        break;
+      double diff = sum0 / w0 - (total_sum - sum0) / w1;
+      double var = w0 * w1 * diff * diff;
+      if (var > best_var) {
+        best_var = var;
+        best_bin = bin;
+      }
+    }
+
+    return m_min + (best_bin + 1) * bin_width;
+  }
+
+  int fine_histogram_bins(int num_bins) {
+    if (num_bins <= 0)
+      vw_throw(ArgumentErr() << "The number of histogram bins must be positive.\n");
+    int min_bins = 16384;
+    return num_bins * std::max(1, (min_bins + num_bins - 1) / num_bins);
+  }
+
+  std::string image_histogram_key(std::string const& image_file, int band,
+                                  double nodata, int subsample,
+                                  BBox2i const& roi) {
+    std::ostringstream os;
+    os << std::setprecision(17);
+    os << "image: " << image_file << " " << asp::file_timestamp(image_file) << " "
+       << "band: " << band << " "
+       << "nodata: " << nodata << " "
+       << "subsample: " << subsample << " "
+       << "roi: " << roi.min().x() << " " << roi.min().y() << " "
+       << roi.max().x() << " " << roi.max().y();
+    return os.str();
+  }
+
+  std::string image_histogram_file(std::string const& image_file, int band) {
+    std::ostringstream os;
+    os << image_file << "-band" << band + 1 << ".hist";
+    return os.str();
+  }
+
+  ImageHistogram cached_image_histogram(ImageViewRef<PixelMask<double>> const& img,
+                                        std::string const& file, std::string const& key,
+                                        int num_bins, int num_threads) {
+    ImageHistogram hist;
+    if (file != "" && hist.read(file, key) && hist.num_bins() % num_bins == 0) {
+      vw_out() << "Read image histogram: " << file << "\n";
+      return hist;
+    }
+
+    hist.compute(img, fine_histogram_bins(num_bins), num_threads);
+
+    if (file != "") {
+      try {
+        hist.write(file, key);
+        vw_out() << "Wrote image histogram: " << file << "\n";
+      } catch (std::exception const& e) {
+        vw_out(WarningMessage) << "Cannot save the image histogram to " << file
+                               << ". " << e.what() << "\n";
+      }
+    }
+
+    return hist;
+  }
+
+} // end namespace asp
@@ -0,0 +1,128 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImageHistogram.h
+///
+/// A histogram of the valid values of an image, computed by scanning
+/// the image in tiles in parallel, which can be saved to a file next
+/// to the image and read back by later runs. It keeps the exact range
+/// of values and many fine bins. Coarser histograms, percentiles, and
+/// the Otsu threshold are found from the fine bins without reading the
+/// image again.
+
+#ifndef __ASP_CORE_IMAGE_HISTOGRAM_H__
+#define __ASP_CORE_IMAGE_HISTOGRAM_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  class ImageHistogram {
+  public:
+    ImageHistogram();
+
+    /// Split the range of the valid values of the image into the given
+    /// number of bins, and count the values in each. The image is read
+    /// twice, first for the range, then for the counts, in square tiles
+    /// of the given size. NaN values are ignored.
+    void compute(vw::ImageViewRef<vw::PixelMask<double>> const& img,
+                 int num_bins, int num_threads, int tile_size = 1024);
+
+    /// Save to a file, together with a key describing what the
+    /// histogram was computed from.
+    void write(std::string const& file, std::string const& key) const;
+
+    /// Read a histogram saved with write(). Return false if the file
+    /// does not exist, cannot be parsed, or was saved with a different key.
+    bool read(std::string const& file, std::string const& key);
+
+    bool         empty()     const { return m_num_valid == 0; }
+    std::int64_t num_valid() const { return m_num_valid; }
+    int          num_bins()  const { return m_counts.size(); }
+
+    /// The exact smallest and largest valid values
+    double min_val() const { return m_min; }
+    double max_val() const { return m_max; }
+
+    /// The exact mean and standard deviation of the valid values
+    double mean()   const;
+    double stddev() const;
+
+    std::vector<std::int64_t> const& counts() const { return m_counts; }
+
+    /// The histogram with this many bins over the same range, made by
+    /// adding groups of adjacent bins. The number of bins must divide
+    /// the number of bins of this histogram.
+    std::vector<std::int64_t> coarse_counts(int num_bins) const;
+
+    /// The value with a fraction q of the valid values below it, for q
+    /// in [0, 1]. Values are assumed to be spread evenly in each bin, so
+    /// the result is off by the width of a bin at most.
+    double percentile(double q) const;
+
+    /// The range of values without outliers, as in find_outlier_brackets()
+    /// in QuantileSketch.h. Return false if there are no valid values.
+    bool outlier_brackets(double pct, double outlier_factor,
+                          double & b, double & e) const;
+
+    /// The Otsu threshold of the histogram with the given number of
+    /// bins, as for coarse_counts(). It is the upper edge of the last
+    /// bin in the darker class. Must not be empty.
+    double otsu_threshold(int num_bins) const;
+
+  private:
+    std::int64_t m_num_valid;
+    double m_min, m_max;
+    double m_sum, m_sum2; // the sum of the values and of their squares
+    std::vector<std::int64_t> m_counts;
+  };
+
+  /// The number of fine bins to use so that histograms with num_bins
+  /// bins can be found exactly, and percentiles are accurate. It is a
+  /// multiple of num_bins which is at least 16384.
+  int fine_histogram_bins(int num_bins);
+
+  /// A string which identifies a histogram of a band of an image file,
+  /// with its modification time, the nodata value, the subsampling
+  /// factor, and the region which was used. An empty region stands for
+  /// the whole image.
+  std::string image_histogram_key(std::string const& image_file, int band,
+                                  double nodata, int subsample,
+                                  vw::BBox2i const& roi);
+
+  /// The file next to the image in which the histogram of a band is saved
+  std::string image_histogram_file(std::string const& image_file, int band);
+
+  /// Read the histogram from the given file if it was saved with this
+  /// key and its number of bins is a multiple of num_bins. Otherwise
+  /// compute it with fine_histogram_bins(num_bins) bins and save it. If
+  /// the file cannot be written, just print a warning. If the file name
+  /// is empty, always compute the histogram and do not save it.
+  ImageHistogram cached_image_histogram(vw::ImageViewRef<vw::PixelMask<double>> const& img,
+                                        std::string const& file, std::string const& key,
+                                        int num_bins, int num_threads);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_IMAGE_HISTOGRAM_H__
@@ -21,6 +21,7 @@
 #include <asp/Core/ImageNormalization.h>
 #include <asp/Core/StereoSettings.h>
 
+#include <algorithm>
 #include <limits>
 
 using namespace vw;
@@ -57,5 +58,94 @@ namespace asp {
 
     return;
   }
+
+  Vector6f histogram_stats(ImageHistogram const& hist) {
+    Vector6f stats;
+    if (hist.empty())
+      return stats;
+    stats[0] = hist.min_val();
+    stats[1] = hist.max_val();
+    stats[2] = hist.mean();
+    stats[3] = hist.stddev();
+    stats[4] = hist.percentile(0.02);
+    stats[5] = hist.percentile(0.98);
+    return stats;
+  }
+
+  void normalization_bounds(bool force_use_entire_range,
+                            bool individually_normalize,
+                            bool use_percentile_stretch,
+                            bool do_not_exceed_min_max,
+                            vw::Vector6f const& left_stats,
+                            vw::Vector6f const& right_stats,
+                            double & left_lo,  double & left_hi,
+                            double & right_lo, double & right_hi) {
+
+    // These arguments must contain: (min, max, mean, std)
+    VW_ASSERT(left_stats.size() == 6 && right_stats.size() == 6,
+              vw::ArgumentErr() << "Expecting a vector of size 6 in normalize_images()\n");
+
+    // If the input stats don't contain the stddev, must use the entire range version.
+    // - This should only happen when normalizing ISIS images for ip_matching purposes.
+    if ((left_stats[3] == 0) || (right_stats[3] == 0))
+      force_use_entire_range = true;
+
+    if (force_use_entire_range) { // Stretch between the min and max values
+      if (individually_normalize) {
+        vw::vw_out() << "\t--> Individually normalize images to their respective min max\n";
+        left_lo  = left_stats [0]; left_hi  = left_stats [1];
+        right_lo = right_stats[0]; right_hi = right_stats[1];
+      } else { // Normalize using the same stats
+        double low = std::min(left_stats[0], right_stats[0]);
+        double hi  = std::max(left_stats[1], right_stats[1]);
+        vw::vw_out() << "\t--> Normalizing globally to: [" << low << " " << hi << "]\n";
+        left_lo  = low; left_hi  = hi;
+        right_lo = low; right_hi = hi;
+      }
+      return;
+    }
+
+    // Don't force the entire range
+    double left_min, left_max, right_min, right_max;
+    if (use_percentile_stretch) {
+      // Percentile stretch
+      left_min  = left_stats [4];
+      left_max  = left_stats [5];
+      right_min = right_stats[4];
+      right_max = right_stats[5];
+    } else {
+      // Two standard deviation stretch
+      left_min  = left_stats [2] - 2*left_stats [3];
+      left_max  = left_stats [2] + 2*left_stats [3];
+      right_min = right_stats[2] - 2*right_stats[3];
+      right_max = right_stats[2] + 2*right_stats[3];
+
+      if (do_not_exceed_min_max) {
+        // This is important for ISIS which may have special pixels beyond the min and max
+        left_min = std::max(left_min,   (double)left_stats[0]);
+        left_max = std::min(left_max,   (double)left_stats[1]);
+        right_min = std::max(right_min, (double)right_stats[0]);
+        right_max = std::min(right_max, (double)right_stats[1]);
+      }
+    }
+
+    // The images are normalized so most pixels fall into this range
+    if (individually_normalize > 0) {
+      vw::vw_out() << "\t--> Individually normalize images\n";
+      left_lo  = left_min;  left_hi  = left_max;
+      right_lo = right_min; right_hi = right_max;
+    } else { // Normalize using the same stats
+      double low = std::min(left_min, right_min);
+      double hi  = std::max(left_max, right_max);
+      vw::vw_out() << "\t--> Normalizing globally to: [" << low << " " << hi << "]\n";
+      if (!do_not_exceed_min_max) {
+        left_lo  = low; left_hi  = hi;
+        right_lo = low; right_hi = hi;
+      } else {
+        left_lo  = std::max(low, left_min);  left_hi  = std::min(hi, left_max);
+        right_lo = std::max(low, right_min); right_hi = std::min(hi, right_max);
+      }
+    }
+  }
   
 }
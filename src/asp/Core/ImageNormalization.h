@@ -23,6 +23,11 @@
 #define __IMAGE_NORMALIZATION_H__
 
 #include <vw/Image/Algorithms.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Image/PixelMask.h>
+
+#include <asp/Core/ImageHistogram.h>
 
 #include <boost/shared_ptr.hpp>
 
@@ -40,6 +45,47 @@ namespace asp {
                          float & left_nodata_value,
                          float & right_nodata_value);
 
+  /// The first channel of a pixel, as a double, keeping its mask
+  struct FirstChannelToDouble: public vw::ReturnFixedType<vw::PixelMask<double>> {
+    template <class PixelT>
+    vw::PixelMask<double> operator()(PixelT const& pix) const {
+      if (!is_valid(pix))
+        return vw::PixelMask<double>();
+      return vw::PixelMask<double>(vw::compound_select_channel<double>(pix, 0));
+    }
+  };
+
+  /// The image statistics from its histogram: the min, max, mean,
+  /// standard deviation, and the 2% and 98% percentiles. All are zero
+  /// if there are no valid pixels.
+  Vector6f histogram_stats(ImageHistogram const& hist);
+
+  /// Find the statistics of the valid pixels of an image, using one out
+  /// of every 'stat_scale' rows and columns. The image is scanned in
+  /// tiles in parallel, and the result does not depend on the number
+  /// of threads.
+  template <class ViewT>
+  Vector6f image_stats(vw::ImageViewBase<ViewT> const& image, int stat_scale,
+                       int num_threads) {
+    ImageHistogram hist;
+    int tile_size = 256;
+    hist.compute(vw::per_pixel_filter(vw::subsample(image.impl(), stat_scale),
+                                      FirstChannelToDouble()),
+                 fine_histogram_bins(256), num_threads, tile_size);
+    return histogram_stats(hist);
+  }
+
+  /// Find the intensity ranges of two grayscale images which
+  /// normalize_images() maps to [0, 1], based on input statistics.
+  void normalization_bounds(bool force_use_entire_range,
+                            bool individually_normalize,
+                            bool use_percentile_stretch,
+                            bool do_not_exceed_min_max,
+                            vw::Vector6f const& left_stats,
+                            vw::Vector6f const& right_stats,
+                            double & left_lo,  double & left_hi,
+                            double & right_lo, double & right_hi);
+
   /// Normalize the intensity of two grayscale images based on input statistics
   template<class ImageT>
   void normalize_images(bool force_use_entire_range,
@@ -49,75 +95,16 @@ namespace asp {
                         vw::Vector6f const& left_stats,
                         vw::Vector6f const& right_stats,
                         ImageT & left_img, ImageT & right_img){
-    
-    // These arguments must contain: (min, max, mean, std)
-    VW_ASSERT(left_stats.size() == 6 && right_stats.size() == 6,
-              vw::ArgumentErr() << "Expecting a vector of size 6 in normalize_images()\n");
-
-    // If the input stats don't contain the stddev, must use the entire range version.
-    // - This should only happen when normalizing ISIS images for ip_matching purposes.
-    if ((left_stats[3] == 0) || (right_stats[3] == 0))
-      force_use_entire_range = true;
-
-    if (force_use_entire_range) { // Stretch between the min and max values
-      if (individually_normalize) {
-        vw::vw_out() << "\t--> Individually normalize images to their respective min max\n";
-        left_img = normalize(left_img, left_stats [0], left_stats [1], 0.0, 1.0);
-        right_img = normalize(right_img, right_stats[0], right_stats[1], 0.0, 1.0);
-      } else { // Normalize using the same stats
-        double low = std::min(left_stats[0], right_stats[0]);
-        double hi  = std::max(left_stats[1], right_stats[1]);
-        vw::vw_out() << "\t--> Normalizing globally to: [" << low << " " << hi << "]\n";
-        left_img = normalize(left_img, low, hi, 0.0, 1.0);
-        right_img = normalize(right_img, low, hi, 0.0, 1.0);
-      }
-    } else { // Don't force the entire range
-      double left_min, left_max, right_min, right_max;
-      if (use_percentile_stretch) {
-        // Percentile stretch
-        left_min  = left_stats [4];
-        left_max  = left_stats [5];
-        right_min = right_stats[4];
-        right_max = right_stats[5];
-      } else {
-        // Two standard deviation stretch
-        left_min  = left_stats [2] - 2*left_stats [3];
-        left_max  = left_stats [2] + 2*left_stats [3];
-        right_min = right_stats[2] - 2*right_stats[3];
-        right_max = right_stats[2] + 2*right_stats[3];
-
-        if (do_not_exceed_min_max) {
-          // This is important for ISIS which may have special pixels beyond the min and max
-          left_min = std::max(left_min,   (double)left_stats[0]);
-          left_max = std::min(left_max,   (double)left_stats[1]);
-          right_min = std::max(right_min, (double)right_stats[0]);
-          right_max = std::min(right_max, (double)right_stats[1]);
-        }
-      }
-
-      // The images are normalized so most pixels fall into this range,
-      // but the data is not clamped so some pixels can fall outside this range.
-      if (individually_normalize > 0) {
-        vw::vw_out() << "\t--> Individually normalize images\n";
-        left_img = normalize(left_img, left_min,  left_max,  0.0, 1.0);
-        right_img = normalize(right_img, right_min, right_max, 0.0, 1.0);
-      } else { // Normalize using the same stats
-        double low = std::min(left_min, right_min);
-        double hi  = std::max(left_max, right_max);
-        vw::vw_out() << "\t--> Normalizing globally to: [" << low << " " << hi << "]\n";
-        if (!do_not_exceed_min_max) {
-          left_img = normalize(left_img, low, hi, 0.0, 1.0);
-          right_img = normalize(right_img, low, hi, 0.0, 1.0);
-        }else{
-          left_img  = normalize(left_img,  std::max(low, left_min),  std::min(hi, left_max),
-                                0.0, 1.0);
-          right_img = normalize(right_img, std::max(low, right_min), std::min(hi, right_max),
-                                0.0, 1.0);
-        }
-      }
-    }
-  
-    return;
+
+    double left_lo, left_hi, right_lo, right_hi;
+    normalization_bounds(force_use_entire_range, individually_normalize,
+                         use_percentile_stretch, do_not_exceed_min_max,
+                         left_stats, right_stats,
+                         left_lo, left_hi, right_lo, right_hi);
+
+    // The data is not clamped so some pixels can fall outside [0, 1].
+    left_img  = normalize(left_img,  left_lo,  left_hi,  0.0, 1.0);
+    right_img = normalize(right_img, right_lo, right_hi, 0.0, 1.0);
   }
   
 }
@@ -66,26 +66,23 @@ Vector3 EpipolarLinePointMatcher::epipolar_line(Vector2 const& feature,
     Vector3 p1  = p0 + 10*cam_ip->pixel_to_vector( feature ); // Extend the point below the datum
     Vector2 ep0 = cam_obj->point_to_pixel( p0 ); // Project the intersection and extension into the other camera
     Vector2 ep1 = cam_obj->point_to_pixel( p1 );
-    Matrix<double> matrix( 2, 3 );
-    select_col( matrix, 2 ) = Vector2(1,1);
-    matrix(0,0) = ep0.x();
-    matrix(0,1) = ep0.y();
-    matrix(1,0) = ep1.x();
-    matrix(1,1) = ep1.y();
-
-    if (matrix != matrix){ // Got back NaN values. Can't proceed.
+
+    // The line through two points is the cross product of their
+    // homogeneous coordinates. This is the nullspace of the matrix
+    // having these as rows, without needing an SVD.
+    Vector3 line = cross_prod(Vector3(ep0.x(), ep0.y(), 1.0), Vector3(ep1.x(), ep1.y(), 1.0));
+    if (line != line){ // Got back NaN values. Can't proceed.
       success = false;
       return Vector3();
     }
 
-    // If the input matrix is bad this can result in some weird errors!
-    Matrix<double> nsp = nullspace( matrix );
-    if (nsp.cols() <= 0 || nsp.rows() <= 0){ // Failed to find the nullspace
+    // The points must be distinct for the line to be defined
+    if (norm_2(subvector(line, 0, 2)) == 0) {
       success = false;
       return Vector3();
     }
 
-    return select_col(nsp,0);
+    return line;
 
   } catch (std::exception const& e) {
     // Turn this off, it can be verbose
@@ -109,37 +106,73 @@ double EpipolarLinePointMatcher::distance_point_line(Vector3 const& line,
     norm_2(subvector(line, 0, 2));
 }
 
+// Find the epipolar lines for a range of interest points, in the
+// other image. Each task writes only its part of the output.
+class EpipolarLineTask : public Task, private boost::noncopyable {
+  std::vector<Vector2> const&     m_points;
+  size_t                          m_beg, m_end;
+  camera::CameraModel            *m_cam1, *m_cam2;
+  EpipolarLinePointMatcher const& m_matcher;
+  bool                            m_single_threaded_camera;
+  Mutex&                          m_camera_mutex;
+  std::vector<Vector3>          & m_lines;
+  std::vector<char>             & m_found;
+public:
+  EpipolarLineTask(std::vector<Vector2> const& points, size_t beg, size_t end,
+                   camera::CameraModel* cam1, camera::CameraModel* cam2,
+                   EpipolarLinePointMatcher const& matcher,
+                   bool single_threaded_camera, Mutex& camera_mutex,
+                   std::vector<Vector3> & lines, std::vector<char> & found):
+    m_points(points), m_beg(beg), m_end(end), m_cam1(cam1), m_cam2(cam2),
+    m_matcher(matcher), m_single_threaded_camera(single_threaded_camera),
+    m_camera_mutex(camera_mutex), m_lines(lines), m_found(found) {}
+
+  void operator()() {
+    for (size_t it = m_beg; it < m_end; it++) {
+      bool found_epipolar = false;
+      if (m_single_threaded_camera) {
+        // ISIS camera is single-threaded
+        Mutex::Lock lock(m_camera_mutex);
+        m_lines[it] = EpipolarLinePointMatcher::epipolar_line(m_points[it], m_matcher.m_datum,
+                                                              m_cam1, m_cam2, found_epipolar);
+      } else {
+        m_lines[it] = EpipolarLinePointMatcher::epipolar_line(m_points[it], m_matcher.m_datum,
+                                                              m_cam1, m_cam2, found_epipolar);
+      }
+      m_found[it] = found_epipolar;
+    }
+  }
+};
+
 // Local class definition -----
 class EpipolarLineMatchTask : public Task, private boost::noncopyable {
   typedef ip::InterestPointList::const_iterator IPListIter;
-  bool                            m_single_threaded_camera;
   bool                            m_use_uchar_tree;
   math::FLANNTree<float        >& m_tree_float;
   math::FLANNTree<unsigned char>& m_tree_uchar;
   IPListIter                      m_start, m_end;
-  ip::InterestPointList const&    m_ip_other;
-  camera::CameraModel            *m_cam1, *m_cam2;
+  size_t                          m_start_index;
+  std::vector<Vector3> const&     m_lines;      // epipolar lines of ip1
+  std::vector<char>    const&     m_found;      // if the line was found
+  std::vector<Vector2> const&     m_ip2_coords; // ip2 locations, for random access
   EpipolarLinePointMatcher const& m_matcher;
-  Mutex&                          m_camera_mutex;
   std::vector<size_t>::iterator   m_output;
 public:
-  EpipolarLineMatchTask( bool single_threaded_camera,
-                         bool use_uchar_tree,
+  EpipolarLineMatchTask( bool use_uchar_tree,
                          math::FLANNTree<float        >& tree_float,
                          math::FLANNTree<unsigned char>& tree_uchar,
                          ip::InterestPointList::const_iterator start,
                          ip::InterestPointList::const_iterator end,
-                         ip::InterestPointList const& ip2,
-                         camera::CameraModel* cam1,
-                         camera::CameraModel* cam2,
+                         size_t start_index,
+                         std::vector<Vector3> const& lines,
+                         std::vector<char>    const& found,
+                         std::vector<Vector2> const& ip2_coords,
                          EpipolarLinePointMatcher const& matcher,
-                         Mutex& camera_mutex,
                          std::vector<size_t>::iterator output ) :
-    m_single_threaded_camera(single_threaded_camera),
     m_use_uchar_tree(use_uchar_tree), m_tree_float(tree_float), m_tree_uchar(tree_uchar),
-    m_start(start), m_end(end), m_ip_other(ip2),
-    m_cam1(cam1), m_cam2(cam2),
-    m_matcher( matcher ), m_camera_mutex(camera_mutex), m_output(output) {}
+    m_start(start), m_end(end), m_start_index(start_index),
+    m_lines(lines), m_found(found), m_ip2_coords(ip2_coords),
+    m_matcher( matcher ), m_output(output) {}
 
   void operator()() {
 
@@ -147,19 +180,12 @@ public:
     Vector<int   > indices  (NUM_MATCHES_TO_FIND);
     Vector<double> distances(NUM_MATCHES_TO_FIND);
 
-    for ( IPListIter ip = m_start; ip != m_end; ip++ ) {
-      Vector2 ip_org_coord = Vector2( ip->x, ip->y );
-      Vector3 line_eq;
+    size_t ip_index = m_start_index;
+    for ( IPListIter ip = m_start; ip != m_end; ip++, ip_index++ ) {
 
-      // Find the equation that describes the epipolar line
-      bool found_epipolar = false;
-      if (m_single_threaded_camera){
-        // ISIS camera is single-threaded
-        Mutex::Lock lock( m_camera_mutex );
-        line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
-      }else{
-        line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
-      }
+      // The equation that describes the epipolar line
+      Vector3 line_eq = m_lines[ip_index];
+      bool found_epipolar = m_found[ip_index];
 
       if (!found_epipolar) {
         *m_output++ = (size_t)(-1); // Failed to find a match, return a flag!
@@ -196,11 +222,8 @@ public:
       double small_epipolar_threshold = m_matcher.m_epipolar_threshold;
       double large_epipolar_threshold = small_epipolar_threshold + EPIPOLAR_BAND_EXPANSION;
       for ( size_t i = 0; i < num_matches_valid; i++ ) {
-        IPListIter ip2_it = m_ip_other.begin();
-        std::advance( ip2_it, indices[i] );
-
         if (found_epipolar){
-          Vector2 ip2_org_coord = Vector2( ip2_it->x, ip2_it->y );
+          Vector2 ip2_org_coord = m_ip2_coords[indices[i]];
           double  line_distance = m_matcher.distance_point_line( line_eq, ip2_org_coord );
           if ( line_distance < large_epipolar_threshold ) {
             if ( line_distance < small_epipolar_threshold )
@@ -272,7 +295,15 @@ void EpipolarLinePointMatcher::operator()( ip::InterestPointList const& ip1,
 
   vw_out(InfoMessage,"interest_point") << "FLANN-Tree created. Searching...\n";
 
-  FifoWorkQueue matching_queue; // Create a thread pool object
+  // Put the ip locations in vectors, for random access
+  std::vector<Vector2> ip1_coords, ip2_coords;
+  ip1_coords.reserve(ip1_size);
+  ip2_coords.reserve(ip2_size);
+  for (IPListIter it = ip1.begin(); it != ip1.end(); it++)
+    ip1_coords.push_back(Vector2(it->x, it->y));
+  for (IPListIter it = ip2.begin(); it != ip2.end(); it++)
+    ip2_coords.push_back(Vector2(it->x, it->y));
+
   Mutex camera_mutex;
 
   // Jobs set to 2x the number of cores. This is just incase all jobs are not equal.
@@ -289,8 +320,27 @@ void EpipolarLinePointMatcher::operator()( ip::InterestPointList const& ip1,
   if (ip1_size < number_of_jobs)
     number_of_jobs = ip1_size;
 
+  // Find all epipolar lines first. With a single-threaded camera this
+  // is serialized, but the descriptor search below is not.
+  std::vector<Vector3> lines(ip1_size);
+  std::vector<char> found(ip1_size, 0);
+  {
+    FifoWorkQueue line_queue;
+    for (size_t i = 0; i < number_of_jobs; i++) {
+      size_t beg = ip1_size * i / number_of_jobs, end = ip1_size * (i + 1) / number_of_jobs;
+      line_queue.add_task(boost::shared_ptr<Task>
+                          (new EpipolarLineTask(ip1_coords, beg, end, cam1, cam2, *this,
+                                                m_single_threaded_camera, camera_mutex,
+                                                lines, found)));
+    }
+    line_queue.join_all();
+  }
+
+  FifoWorkQueue matching_queue; // Create a thread pool object
+
   // Get input and output iterators
   IPListIter start_it = ip1.begin();
+  size_t start_index = 0;
   std::vector<size_t>::iterator output_it = output_indices.begin();
 
   for ( size_t i = 0; i < number_of_jobs - 1; i++ ) { // For each job...
@@ -298,21 +348,20 @@ void EpipolarLinePointMatcher::operator()( ip::InterestPointList const& ip1,
     IPListIter end_it = start_it;
     std::advance( end_it, ip1_size / number_of_jobs );
     boost::shared_ptr<Task>
-      match_task( new EpipolarLineMatchTask( m_single_threaded_camera,
-                                             use_uchar_FLANN, kd_float, kd_uchar,
-                                             start_it, end_it,
-                                             ip2, cam1, cam2, *this,
-                                             camera_mutex, output_it ) );
+      match_task( new EpipolarLineMatchTask( use_uchar_FLANN, kd_float, kd_uchar,
+                                             start_it, end_it, start_index,
+                                             lines, found, ip2_coords, *this,
+                                             output_it ) );
     matching_queue.add_task( match_task );
     start_it = end_it;
+    start_index += ip1_size / number_of_jobs;
     std::advance( output_it, ip1_size / number_of_jobs );
   }
   boost::shared_ptr<Task>
-    match_task( new EpipolarLineMatchTask( m_single_threaded_camera,
-                                           use_uchar_FLANN, kd_float, kd_uchar,
-                                           start_it, ip1.end(),
-                                           ip2, cam1, cam2, *this,
-                                           camera_mutex, output_it ) );
+    match_task( new EpipolarLineMatchTask( use_uchar_FLANN, kd_float, kd_uchar,
+                                           start_it, ip1.end(), start_index,
+                                           lines, found, ip2_coords, *this,
+                                           output_it ) );
   matching_queue.add_task( match_task );
   matching_queue.join_all(); // Wait for all the jobs to finish.
 }
@@ -537,6 +586,45 @@ void side_ip_filtering(vw::ip::InterestPointList& ip1,
            << num_removed_right << " points from the right side of the right image.\n";
 } // End side IP filtering
   
+void match_ip_pair(vw::ip::InterestPointList const& ip1,
+                   vw::ip::InterestPointList const& ip2,
+                   std::vector<vw::ip::InterestPoint>& matched_ip1,
+                   std::vector<vw::ip::InterestPoint>& matched_ip2) {
+
+  // Replace the IP lists with IP vectors
+  std::vector<vw::ip::InterestPoint> ip1_copy, ip2_copy;
+  ip1_copy.reserve(ip1.size());
+  ip2_copy.reserve(ip2.size());
+  std::copy(ip1.begin(), ip1.end(), std::back_inserter(ip1_copy));
+  std::copy(ip2.begin(), ip2.end(), std::back_inserter(ip2_copy));
+
+  DetectIpMethod detect_method = static_cast<DetectIpMethod>(stereo_settings().ip_matching_method);
+
+  // Best point must be closer than the next best point
+  double th = stereo_settings().ip_uniqueness_thresh;
+  vw_out() << "\t--> Uniqueness threshold: " << th << "\n";
+  // ORB descriptors are binary, so use for them the Hamming distance
+  bool binary = (detect_method == DETECT_IP_METHOD_ORB);
+  vw_out() << "\t    Matching with the " << stereo_settings().ip_nn_method << " method.\n";
+  boost::shared_ptr<DescriptorMatcher> matcher
+    = make_descriptor_matcher(ip2_copy, stereo_settings().ip_nn_method, binary);
+  std::vector<int> match_index;
+  match_descriptors(ip1_copy, *matcher, th, vw_settings().default_num_threads(),
+                    match_index);
+  matched_ip1.clear();
+  matched_ip2.clear();
+  for (size_t it = 0; it < match_index.size(); it++) {
+    if (match_index[it] < 0)
+      continue;
+    matched_ip1.push_back(ip1_copy[it]);
+    matched_ip2.push_back(ip2_copy[match_index[it]]);
+  }
+
+  ip::remove_duplicates(matched_ip1, matched_ip2);
+
+  vw_out() << "\n\t    Matched points: " << matched_ip1.size() << std::endl;
+}
+  
 bool tri_ip_filtering( std::vector<ip::InterestPoint> const& matched_ip1,
                   std::vector<ip::InterestPoint> const& matched_ip2,
                   vw::camera::CameraModel* cam1,
@@ -733,7 +821,96 @@ bool stddev_ip_filtering( std::vector<vw::ip::InterestPoint> const& ip1,
   return valid_indices.size();
 }
 
-size_t filter_ip_by_lonlat_and_elevation(vw::TransformPtr         tx_left,
+// Triangulate a range of interest point matches. Each task writes
+// only its part of the output.
+class TriangulateIpTask: public Task, private boost::noncopyable {
+  std::vector<ip::InterestPoint> const& m_ip1;
+  std::vector<ip::InterestPoint> const& m_ip2;
+  size_t                                m_beg, m_end;
+  vw::TransformPtr                      m_tx1, m_tx2;
+  stereo::StereoModel const&            m_model;
+  bool                                  m_single_threaded_camera;
+  Mutex&                                m_camera_mutex;
+  std::vector<Vector3>                & m_xyz;
+
+  // Undo the alignment, if any, and triangulate. Return the zero
+  // vector on failure.
+  Vector3 triangulate(size_t it) const {
+    Vector2 p1(m_ip1[it].x, m_ip1[it].y), p2(m_ip2[it].x, m_ip2[it].y);
+    double err = -1.0;
+    Vector3 xyz;
+    try {
+      if (m_tx1.get() != NULL && m_tx2.get() != NULL) {
+        p1 = m_tx1->reverse(p1);
+        p2 = m_tx2->reverse(p2);
+      }
+      xyz = m_model(p1, p2, err);
+    } catch(...) {
+      return Vector3();
+    }
+    if (err <= 0.0)
+      return Vector3();
+    return xyz;
+  }
+
+public:
+  TriangulateIpTask(std::vector<ip::InterestPoint> const& ip1,
+                    std::vector<ip::InterestPoint> const& ip2,
+                    size_t beg, size_t end,
+                    vw::TransformPtr tx1, vw::TransformPtr tx2,
+                    stereo::StereoModel const& model,
+                    bool single_threaded_camera, Mutex& camera_mutex,
+                    std::vector<Vector3> & xyz):
+    m_ip1(ip1), m_ip2(ip2), m_beg(beg), m_end(end), m_tx1(tx1), m_tx2(tx2),
+    m_model(model), m_single_threaded_camera(single_threaded_camera),
+    m_camera_mutex(camera_mutex), m_xyz(xyz) {}
+
+  void operator()() {
+    for (size_t it = m_beg; it < m_end; it++) {
+      if (m_single_threaded_camera) {
+        // ISIS camera is single-threaded
+        Mutex::Lock lock(m_camera_mutex);
+        m_xyz[it] = triangulate(it);
+      } else {
+        m_xyz[it] = triangulate(it);
+      }
+    }
+  }
+};
+
+// Triangulate the interest point matches in parallel. If the
+// transforms are set, the interest points are aligned, and they are
+// unaligned first. A match which fails to triangulate gets the zero
+// vector.
+void triangulate_ip(bool single_threaded_camera,
+                    vw::TransformPtr tx_left, vw::TransformPtr tx_right,
+                    vw::camera::CameraModel* left_camera_model,
+                    vw::camera::CameraModel* right_camera_model,
+                    std::vector<vw::ip::InterestPoint> const& ip1,
+                    std::vector<vw::ip::InterestPoint> const& ip2,
+                    std::vector<Vector3> & xyz) {
+
+  double angle_tolerance = vw::stereo::StereoModel::robust_1_minus_cos
+    (stereo_settings().min_triangulation_angle*M_PI/180);
+  vw::stereo::StereoModel model(left_camera_model, right_camera_model, 
+                                stereo_settings().use_least_squares, angle_tolerance);
+
+  size_t num_ip = ip1.size();
+  xyz.assign(num_ip, Vector3());
+  size_t number_of_jobs = std::min(size_t(vw_settings().default_num_threads() * 2), num_ip);
+  Mutex camera_mutex;
+  FifoWorkQueue queue;
+  for (size_t i = 0; i < number_of_jobs; i++) {
+    size_t beg = num_ip * i / number_of_jobs, end = num_ip * (i + 1) / number_of_jobs;
+    queue.add_task(boost::shared_ptr<Task>
+                   (new TriangulateIpTask(ip1, ip2, beg, end, tx_left, tx_right, model,
+                                          single_threaded_camera, camera_mutex, xyz)));
+  }
+  queue.join_all();
+}
+
+size_t filter_ip_by_lonlat_and_elevation(bool single_threaded_camera,
+                                         vw::TransformPtr         tx_left,
                                          vw::TransformPtr         tx_right,
                                          vw::camera::CameraModel* left_camera_model,
                                          vw::camera::CameraModel* right_camera_model,
@@ -767,45 +944,22 @@ size_t filter_ip_by_lonlat_and_elevation(vw::TransformPtr         tx_left,
   ip1_out.reserve(num_ip);
   ip2_out.reserve(num_ip);
 
-  // Set up stereo model
-  double angle_tolerance = vw::stereo::StereoModel::robust_1_minus_cos
-    (stereo_settings().min_triangulation_angle*M_PI/180);
-  vw::stereo::StereoModel model(left_camera_model, right_camera_model, 
-                                stereo_settings().use_least_squares, angle_tolerance);
-    
-  // This function can be called with both unaligned and aligned interest points
-  bool aligned_ip = (tx_left.get() != NULL && tx_right != NULL);
+  // This function can be called with both unaligned and aligned
+  // interest points. All are triangulated at once, in parallel.
+  std::vector<Vector3> points;
+  triangulate_ip(single_threaded_camera, tx_left, tx_right,
+                 left_camera_model, right_camera_model, ip1_in, ip2_in, points);
 
   // For each interest point, compute the height and only keep it if the height falls within
   // the specified range.
   for (size_t i = 0; i < num_ip; ++i) {
 
-    // We must not both apply a transform and a scale at the same time
-    // as these are meant to do the same thing in different circumstances.
-    Vector2 p1 = Vector2(ip1_in[i].x, ip1_in[i].y);
-    Vector2 p2 = Vector2(ip2_in[i].x, ip2_in[i].y);
-
-    if (aligned_ip) {
-      // Unalign
-      p1 = tx_left->reverse (p1);
-      p2 = tx_right->reverse(p2);
-    }
-      
-    // Triangulate
-    double err = -1.0;
-    Vector3 xyz(0.0, 0.0, 0.0);
-    try {
-      xyz = model(p1, p2, err);
-    } catch(...) {
-      xyz = Vector3();
-    }
-
-    if (err <= 0.0 || xyz == Vector3()) {
+    if (points[i] == Vector3()) {
       // Triangulation failed
       continue;
     }
       
-    Vector3 llh = datum.cartesian_to_geodetic(xyz);
+    Vector3 llh = datum.cartesian_to_geodetic(points[i]);
     if ( (elevation_limit[0] < elevation_limit[1]) && 
          ( (llh[2] < elevation_limit[0]) || (llh[2] > elevation_limit[1]) ) ) {
       // vw_out() << "Removing IP diff: " << p2 - p1 << " with llh " << llh << std::endl;
@@ -990,7 +1144,8 @@ size_t filter_ip_homog(std::vector<ip::InterestPoint> const& ip1_in,
 // Filter IP using a given DEM and max height difference.  Assume that
 // the interest points have alignment applied to them (either via a
 // transform or from mapprojection).
-void ip_filter_using_dem(std::string              const & ip_filter_using_dem,
+void ip_filter_using_dem(bool single_threaded_camera,
+                         std::string              const & ip_filter_using_dem,
                          vw::TransformPtr                 tx_left,
                          vw::TransformPtr                 tx_right,
                          boost::shared_ptr<vw::camera::CameraModel> left_camera_model, 
@@ -1024,6 +1179,45 @@ void ip_filter_using_dem(std::string              const & ip_filter_using_dem,
     vw_throw(ArgumentErr() << "There is no georeference information in: "
              << dem_file << ".\n" );
   
+  // Undo the alignment or mapprojection and triangulate, in parallel
+  std::vector<Vector3> points;
+  triangulate_ip(single_threaded_camera, tx_left, tx_right,
+                 left_camera_model.get(), right_camera_model.get(),
+                 left_aligned_ip, right_aligned_ip, points);
+
+  // Find where the points project in the DEM
+  std::set<int> invalid_indices;
+  std::vector<Vector3> llh(points.size());
+  std::vector<Vector2> dem_pix(points.size());
+  BBox2 dem_box;
+  for (size_t it = 0; it < points.size(); it++) {
+    if (points[it] == Vector3()) {
+      invalid_indices.insert(it);
+      continue;
+    }
+    llh[it] = dem_georef.datum().cartesian_to_geodetic(points[it]);
+
+    // This was tested to give correct results with the DEM
+    // having its longitude in both [-180, 0] and [180, 360].
+    dem_pix[it] = dem_georef.lonlat_to_pixel(Vector2(llh[it][0], llh[it][1]));
+    dem_box.grow(dem_pix[it]);
+  }
+
+  // Read in memory the part of the DEM the points project in, if not
+  // too large, rather than reading it from disk for each point. Grow
+  // it by a couple of pixels, so that the interpolation is the same.
+  const double MAX_DEM_PIXELS = 25.0e+6;
+  Vector2 crop_origin(0, 0);
+  if (invalid_indices.size() < points.size()) {
+    BBox2i crop_box = grow_bbox_to_int(dem_box);
+    crop_box.expand(2);
+    crop_box.crop(bounding_box(dem));
+    if (!crop_box.empty() && double(crop_box.width()) * crop_box.height() <= MAX_DEM_PIXELS) {
+      dem = ImageView<PixelMask<float>>(crop(dem, crop_box));
+      crop_origin = crop_box.min();
+    }
+  }
+
   // An invalid pixel value used for edge extension
   PixelMask<float> nodata_pix(0); nodata_pix.invalidate();
   ValueEdgeExtension<PixelMask<float>> nodata_ext(nodata_pix); 
@@ -1032,42 +1226,14 @@ void ip_filter_using_dem(std::string              const & ip_filter_using_dem,
   ImageViewRef<PixelMask<float>> interp_dem
     = interpolate(dem, BilinearInterpolation(), nodata_ext);
 
-  // Set up the stereo model for doing triangulation
-  double angle_tol = vw::stereo::StereoModel
-    ::robust_1_minus_cos(stereo_settings().min_triangulation_angle*M_PI/180);
-  stereo::StereoModel model(left_camera_model.get(), right_camera_model.get(),
-                            stereo_settings().use_least_squares, angle_tol);
-
-  std::set<int> invalid_indices;
-  for (size_t it = 0; it < left_aligned_ip.size(); it++) {
-
-    // Undo the alignment or mapprojection
-    Vector2 left_pix  = tx_left->reverse (Vector2(left_aligned_ip[it].x,  left_aligned_ip[it].y));
-    Vector2 right_pix = tx_right->reverse(Vector2(right_aligned_ip[it].x, right_aligned_ip[it].y));
-
-    // Triangulate
-    double err = -1.0;
-    Vector3 xyz(0.0, 0.0, 0.0);
-    try {
-      xyz = model(left_pix, right_pix, err);
-    } catch(...) {
-      xyz = Vector3();
-    }
-
-    if (err <= 0.0 || xyz == Vector3()) {
-      invalid_indices.insert(it);
+  for (size_t it = 0; it < points.size(); it++) {
+    if (points[it] == Vector3())
       continue;
-    }
-
-    Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz);
-
-    // This was tested to give correct results with the DEM
-    // having its longitude in both [-180, 0] and [180, 360].
-    Vector2 pix = dem_georef.lonlat_to_pixel(Vector2(llh[0], llh[1]));
 
+    Vector2 pix = dem_pix[it] - crop_origin;
     PixelMask<float> dem_val = interp_dem(pix.x(), pix.y());
 
-    if (!is_valid(dem_val) || std::abs(dem_val.child() - llh[2]) > max_height_diff)
+    if (!is_valid(dem_val) || std::abs(dem_val.child() - llh[it][2]) > max_height_diff)
       invalid_indices.insert(it);
   }
 
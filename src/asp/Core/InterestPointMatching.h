@@ -23,6 +23,7 @@
 #define __ASP_CORE_INTEREST_POINT_MATCHING_H__
 
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Image/ImageViewBase.h>
 #include <vw/Image/MaskViews.h>
 #include <vw/Camera/CameraModel.h>
@@ -36,6 +37,7 @@
 #include <vw/FileIO/FileUtils.h>
 
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/DescriptorMatcher.h>
 #include <boost/foreach.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
 
@@ -200,7 +202,8 @@ bool ip_matching_no_align(bool single_threaded_camera,
 
 
   // Filter IP by ensuring that the triangulated IP are in the given lon-lat-height box
-  size_t filter_ip_by_lonlat_and_elevation(vw::TransformPtr         tx_left,
+  size_t filter_ip_by_lonlat_and_elevation(bool single_threaded_camera,
+                                           vw::TransformPtr         tx_left,
                                            vw::TransformPtr         tx_right,
                                            vw::camera::CameraModel* left_camera_model,
                                            vw::camera::CameraModel* right_camera_model,
@@ -231,7 +234,8 @@ bool ip_matching_no_align(bool single_threaded_camera,
   // Filter IP using a given DEM and max height difference.  Assume that
   // the interest points have alignment applied to them (either via a
   // transform or from mapprojection).
-  void ip_filter_using_dem(std::string              const & ip_filter_using_dem,
+  void ip_filter_using_dem(bool single_threaded_camera,
+                           std::string              const & ip_filter_using_dem,
                            vw::TransformPtr                 tx_left,
                            vw::TransformPtr                 tx_right,
                            boost::shared_ptr<vw::camera::CameraModel> left_camera_model, 
@@ -285,13 +289,16 @@ vw::BBox2 search_range_using_spread(double max_disp_spread,
   /// Detect interest points
   ///
   /// This is not meant to be used directly. Use ip_matching() or
-  /// homography_ip_matching().
+  /// homography_ip_matching(). If tiles are given, detect only in
+  /// those tiles of the image, rather than in all its 1024 x 1024
+  /// tiles.
   template <class Image1T>
   void detect_ip(vw::ip::InterestPointList& ip1, 
 		 vw::ImageViewBase<Image1T> const& image,
 		 int ip_per_tile,
 		 std::string const file_path="",
-		 double nodata = std::numeric_limits<double>::quiet_NaN());
+		 double nodata = std::numeric_limits<double>::quiet_NaN(),
+		 std::vector<vw::BBox2i> const& tiles = std::vector<vw::BBox2i>());
 
   /// Detect IP in a pair of images and apply rudimentary filtering.
   /// - Returns false if either image ended up with zero IP.
@@ -342,6 +349,13 @@ vw::BBox2 search_range_using_spread(double max_disp_spread,
 			    double nodata2 = std::numeric_limits<double>::quiet_NaN());
 
 
+  /// Match interest points by their descriptors, keeping the unique
+  /// matches, as in detect_match_ip().
+  void match_ip_pair(vw::ip::InterestPointList const& ip1,
+                     vw::ip::InterestPointList const& ip2,
+                     std::vector<vw::ip::InterestPoint>& matched_ip1,
+                     std::vector<vw::ip::InterestPoint>& matched_ip2);
+
   /// Detect interest points and use a simple matching technique.
   /// This is not meant to be used directly. Use ip_matching().
   template <class Image1T, class Image2T>
@@ -398,15 +412,116 @@ vw::BBox2 search_range_using_spread(double max_disp_spread,
     static double distance_point_line(vw::Vector3 const& line, vw::Vector2 const& point);
 
     friend class EpipolarLineMatchTask;
+    friend class EpipolarLineTask;
   };
 
   //-------------------------------------------------------------------------------------------
   // Implementations below
 
+// Make a new detector for each tile, as the detectors keep state, such
+// as the adjusted threshold, and may not be thread-safe.
+struct IntegralDetectorMaker {
+  typedef vw::ip::IntegralAutoGainDetector DetectorT;
+  int m_points_per_tile, m_num_scales;
+  IntegralDetectorMaker(int points_per_tile, int num_scales):
+    m_points_per_tile(points_per_tile), m_num_scales(num_scales) {}
+  boost::shared_ptr<DetectorT> operator()() const {
+    return boost::shared_ptr<DetectorT>(new DetectorT(m_points_per_tile, m_num_scales));
+  }
+};
+
+struct OpenCvDetectorMaker {
+  typedef vw::ip::OpenCvInterestPointDetector DetectorT;
+  vw::ip::OpenCvIpDetectorType m_method;
+  bool m_normalize, m_build_descriptors;
+  int m_points_per_tile;
+  OpenCvDetectorMaker(vw::ip::OpenCvIpDetectorType method, bool normalize,
+                      bool build_descriptors, int points_per_tile):
+    m_method(method), m_normalize(normalize), m_build_descriptors(build_descriptors),
+    m_points_per_tile(points_per_tile) {}
+  boost::shared_ptr<DetectorT> operator()() const {
+    return boost::shared_ptr<DetectorT>(new DetectorT(m_method, m_normalize,
+                                                      m_build_descriptors,
+                                                      m_points_per_tile));
+  }
+};
+
+// Detect interest points in one tile, expanded by a margin so that the
+// detector response and descriptors near the tile edges are as for the
+// whole image. Keep only the points in the tile itself, so that the
+// tiles do not produce the same points twice.
+template <class ViewT, class MakerT>
+class DetectIpTileTask: public vw::Task, private boost::noncopyable {
+  ViewT m_view;
+  MakerT m_maker;
+  vw::BBox2i m_tile;
+  int m_margin, m_points_per_tile;
+  vw::ip::InterestPointList & m_ip;
+public:
+  DetectIpTileTask(ViewT const& view, MakerT const& maker, vw::BBox2i const& tile,
+                   int margin, int points_per_tile, vw::ip::InterestPointList & ip):
+    m_view(view), m_maker(maker), m_tile(tile), m_margin(margin),
+    m_points_per_tile(points_per_tile), m_ip(ip) {}
+
+  void operator()() {
+    vw::BBox2i box = m_tile;
+    box.expand(m_margin);
+    box.crop(vw::bounding_box(m_view));
+
+    boost::shared_ptr<typename MakerT::DetectorT> detector = m_maker();
+    vw::ip::InterestPointList tile_ip
+      = vw::ip::detect_interest_points(vw::crop(m_view, box), *detector, m_points_per_tile);
+
+    m_ip.clear();
+    for (auto it = tile_ip.begin(); it != tile_ip.end(); it++) {
+      vw::ip::InterestPoint ip = *it;
+      ip.x  += box.min().x(); ip.ix += box.min().x();
+      ip.y  += box.min().y(); ip.iy += box.min().y();
+      if (m_tile.contains(vw::Vector2i(ip.ix, ip.iy)))
+        m_ip.push_back(ip);
+    }
+  }
+};
+
+// Detect interest points in each tile in parallel, aiming for the same
+// number of points in each tile, with the detector threshold adapting
+// to each tile. The points are put together in the order of the tiles,
+// so the result does not depend on the timing of the threads.
+template <class ViewT, class MakerT>
+vw::ip::InterestPointList detect_ip_in_tiles(ViewT const& view, MakerT const& maker,
+                                             std::vector<vw::BBox2i> const& tiles,
+                                             int points_per_tile) {
+
+  const int margin = 64; // in pixels
+  std::vector<vw::ip::InterestPointList> tile_ip(tiles.size());
+
+  vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+  for (size_t it = 0; it < tiles.size(); it++)
+    queue.add_task(boost::shared_ptr< DetectIpTileTask<ViewT, MakerT> >
+                   (new DetectIpTileTask<ViewT, MakerT>(view, maker, tiles[it], margin,
+                                                        points_per_tile, tile_ip[it])));
+  queue.join_all();
+
+  vw::ip::InterestPointList ip;
+  for (size_t it = 0; it < tile_ip.size(); it++)
+    ip.splice(ip.end(), tile_ip[it]);
+
+  return ip;
+}
+
+// Detect interest points in each tile of the given size
+template <class ViewT, class MakerT>
+vw::ip::InterestPointList detect_ip_in_tiles(ViewT const& view, MakerT const& maker,
+                                             int tile_size, int points_per_tile) {
+  return detect_ip_in_tiles(view, maker, vw::subdivide_bbox(view, tile_size, tile_size),
+                            points_per_tile);
+}
+
 template <class Image1T>
 void detect_ip(vw::ip::InterestPointList& ip,
 	       vw::ImageViewBase<Image1T> const& image,
-	       int ip_per_tile, std::string const file_path, double nodata) {
+	       int ip_per_tile, std::string const file_path, double nodata,
+	       std::vector<vw::BBox2i> const& tiles) {
   using namespace vw;
   ip.clear();
 
@@ -448,6 +563,10 @@ void detect_ip(vw::ip::InterestPointList& ip,
 
   vw_out() << "\t    Using " << points_per_tile << " interest points per tile (1024^2 px).\n";
 
+  std::vector<BBox2i> ip_tiles = tiles;
+  if (ip_tiles.empty())
+    ip_tiles = subdivide_bbox(image.impl(), tile_size, tile_size);
+
   const bool has_nodata = !boost::math::isnan(nodata);
   
   // Load the detection method from stereo_settings.
@@ -465,15 +584,16 @@ void detect_ip(vw::ip::InterestPointList& ip,
     else
       vw_out() << "\t    Using " << num_scales << " scales in OBALoG interest point detection.\n";
 
-    vw::ip::IntegralAutoGainDetector detector(points_per_tile, num_scales);
+    IntegralDetectorMaker maker(points_per_tile, num_scales);
 
     // This detector can't handle a mask so if there is nodata just set those pixels to zero.
 
     vw_out() << "\t    Detecting IP\n";
     if (!has_nodata)
-      ip = detect_interest_points(image.impl(), detector, points_per_tile);
+      ip = detect_ip_in_tiles(image.impl(), maker, ip_tiles, points_per_tile);
     else
-      ip = detect_interest_points(apply_mask(create_mask_less_or_equal(image.impl(),nodata)), detector, points_per_tile);
+      ip = detect_ip_in_tiles(apply_mask(create_mask_less_or_equal(image.impl(),nodata)),
+                              maker, ip_tiles, points_per_tile);
   } else {
 
     // Initialize the OpenCV detector.  Conveniently we can just pass in the type argument.
@@ -493,15 +613,17 @@ void detect_ip(vw::ip::InterestPointList& ip,
       vw_out() << "\t    Using per-tile image normalization for IP detection...\n";
 
     bool build_opencv_descriptors = true;
-    vw::ip::OpenCvInterestPointDetector detector(cv_method, opencv_normalize, build_opencv_descriptors, points_per_tile);
+    OpenCvDetectorMaker maker(cv_method, opencv_normalize, build_opencv_descriptors,
+                              points_per_tile);
 
     // These detectors do accept a mask so use one if applicable.
 
     vw_out() << "\t    Detecting IP\n";
     if (!has_nodata)
-      ip = detect_interest_points(image.impl(), detector, points_per_tile);
+      ip = detect_ip_in_tiles(image.impl(), maker, ip_tiles, points_per_tile);
     else
-      ip = detect_interest_points(create_mask_less_or_equal(image.impl(),nodata), detector, points_per_tile);
+      ip = detect_ip_in_tiles(create_mask_less_or_equal(image.impl(),nodata),
+                              maker, ip_tiles, points_per_tile);
   } // End OpenCV case
 
   sw.stop();
@@ -531,10 +653,14 @@ void detect_ip(vw::ip::InterestPointList& ip,
 
   vw_out() << "\t    Found interest points: " << ip.size() << std::endl;
 
-  // If a file path was provided, record the IP to disk.
+  // If a file path was provided, record the IP to disk. Write to a
+  // temporary file first, then rename it, so that another process
+  // sharing this file never reads it partially written.
   if (file_path != "") {
     vw_out() << "\t    Recording interest points to file: " << file_path << std::endl;
-    ip::write_binary_ip_file(file_path, ip);
+    std::string tmp_file = file_path + "." + boost::filesystem::unique_path().string();
+    ip::write_binary_ip_file(tmp_file, ip);
+    boost::filesystem::rename(tmp_file, file_path);
   }
 }
 
@@ -772,7 +898,7 @@ bool epipolar_ip_matching(bool single_threaded_camera,
       !stereo_settings().lon_lat_limit.empty()) {
 
     std::vector<ip::InterestPoint> matched_ip1_out, matched_ip2_out;
-    filter_ip_by_lonlat_and_elevation(tx1, tx2,
+    filter_ip_by_lonlat_and_elevation(single_threaded_camera, tx1, tx2,
                                       cam1, cam2,
                                       datum,  matched_ip1, matched_ip2,
                                       stereo_settings().elevation_limit,  
@@ -808,37 +934,7 @@ void detect_match_ip(std::vector<vw::ip::InterestPoint>& matched_ip1,
                  left_file_path, right_file_path, nodata1, nodata2);
   
   // Match the interset points using the default matcher
-
-  // Replace the IP lists with IP vectors
-  std::vector<vw::ip::InterestPoint> ip1_copy, ip2_copy;
-  ip1_copy.reserve(ip1.size());
-  ip2_copy.reserve(ip2.size());
-  std::copy(ip1.begin(), ip1.end(), std::back_inserter(ip1_copy));
-  std::copy(ip2.begin(), ip2.end(), std::back_inserter(ip2_copy));
-
-  DetectIpMethod detect_method = static_cast<DetectIpMethod>(stereo_settings().ip_matching_method);
-
-  // Best point must be closer than the next best point
-  double th = stereo_settings().ip_uniqueness_thresh;
-  vw_out() << "\t--> Uniqueness threshold: " << th << "\n";
-  // TODO: Should probably unify the ip::InterestPointMatcher class
-  // with the EpipolarLinePointMatcher class!
-  if (detect_method != DETECT_IP_METHOD_ORB) {
-    // For all L2Norm distance metrics
-    ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(th);
-    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-	    TerminalProgressCallback("asp", "\t   Matching: "));
-  }
-  else {
-    // For Hamming distance metrics
-    ip::InterestPointMatcher<ip::HammingMetric,ip::NullConstraint> matcher(th);
-    matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-	    TerminalProgressCallback("asp", "\t   Matching: "));
-  }
-
-  ip::remove_duplicates(matched_ip1, matched_ip2);
-
-  vw_out() << "\n\t    Matched points: " << matched_ip1.size() << std::endl;
+  match_ip_pair(ip1, ip2, matched_ip1, matched_ip2);
 
   if (stereo_settings().ip_debug_images) {
     vw_out() << "\t    Writing IP initial match debug image.\n";
@@ -20,11 +20,13 @@
 ///
 
 #include <vw/Math/Transform.h>
+#include <vw/Math/LinearAlgebra.h>
 #include <vw/Image/PixelMask.h>
 #include <vw/Image/Interpolation.h>
 
 #include <asp/Core/LocalAlignment.h>
 #include <asp/Core/ImageNormalization.h>
+#include <asp/Core/ImageAlignment.h>
 #include <asp/Core/AffineEpipolar.h>
 #include <asp/Core/InterestPointMatching.h>  // Slow-to-compile header
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
@@ -38,6 +40,9 @@
 #include <boost/dll.hpp>
 #include <limits>
 #include <cctype>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 using namespace vw;
 namespace fs = boost::filesystem;
@@ -86,6 +91,119 @@ namespace asp {
 
     return out_box;
   }
+
+  // Interest points are detected on a fixed grid of blocks of this size
+  // in the globally aligned images, and this many blocks are kept.
+  const int    IP_BLOCK_SIZE       = 1024;
+  const size_t MAX_CACHED_IP_BLOCKS = 256;
+
+  // The number of interest points to detect in each block, so that
+  // their density is the same as when detecting them in a crop of
+  // the given tile size, with the logic of detect_ip().
+  int ip_per_block(int ip_per_tile, double tile_size) {
+    double block_area = double(IP_BLOCK_SIZE) * IP_BLOCK_SIZE;
+    double tile_area  = std::max(tile_size * tile_size, 1.0);
+    double points_per_tile = ip_per_tile;
+    if (ip_per_tile == 0) {
+      int ip_per_image = 5000; // default
+      if (stereo_settings().ip_per_image > 0)
+        ip_per_image = stereo_settings().ip_per_image;
+      points_per_tile = std::floor(ip_per_image / (tile_area / block_area));
+      points_per_tile = std::max(50.0, std::min(5000.0, points_per_tile));
+    }
+    // A crop smaller than a block is a single detection tile
+    return std::max(1, int(round(points_per_tile * block_area
+                                 / std::min(tile_area, block_area))));
+  }
+
+  // Interest points of the globally aligned images, detected block by
+  // block. Tiles correlated in the same process, as with
+  // --corr-worker-mode, are neighbors whose crop windows overlap, so
+  // each block is detected only once for all of them.
+  class IpBlockCache {
+  public:
+    IpBlockCache(): m_use_count(0) {}
+
+    // The interest points in the window, relative to its corner
+    template <class ImageT>
+    void find(std::string const& image_file, ImageT const& image, double nodata,
+              int points_per_block, BBox2i const& win, vw::ip::InterestPointList & ip) {
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      BBox2i bounds = bounding_box(image);
+      BBox2i box = win;
+      box.crop(bounds);
+      ip.clear();
+      if (box.empty())
+        return;
+
+      int beg_col = box.min().x() / IP_BLOCK_SIZE, end_col = (box.max().x() - 1) / IP_BLOCK_SIZE;
+      int beg_row = box.min().y() / IP_BLOCK_SIZE, end_row = (box.max().y() - 1) / IP_BLOCK_SIZE;
+
+      // Detect together, in parallel, the blocks not seen before
+      std::vector<BBox2i> missing;
+      for (int row = beg_row; row <= end_row; row++) {
+        for (int col = beg_col; col <= end_col; col++) {
+          if (m_blocks.find(Key(image_file, points_per_block, col, row)) != m_blocks.end())
+            continue;
+          BBox2i block(col * IP_BLOCK_SIZE, row * IP_BLOCK_SIZE, IP_BLOCK_SIZE, IP_BLOCK_SIZE);
+          block.crop(bounds);
+          missing.push_back(block);
+          m_blocks[Key(image_file, points_per_block, col, row)] = Block();
+        }
+      }
+      if (!missing.empty()) {
+        vw::ip::InterestPointList found;
+        detect_ip(found, image, points_per_block, "", nodata, missing);
+        for (auto it = found.begin(); it != found.end(); it++)
+          m_blocks[Key(image_file, points_per_block, it->ix / IP_BLOCK_SIZE,
+                       it->iy / IP_BLOCK_SIZE)].ip.push_back(*it);
+      }
+
+      for (int row = beg_row; row <= end_row; row++) {
+        for (int col = beg_col; col <= end_col; col++) {
+          Block & block = m_blocks[Key(image_file, points_per_block, col, row)];
+          block.last_use = m_use_count++;
+          for (size_t it = 0; it < block.ip.size(); it++) {
+            vw::ip::InterestPoint p = block.ip[it];
+            if (!win.contains(Vector2i(p.ix, p.iy)))
+              continue;
+            p.x  -= win.min().x(); p.ix -= win.min().x();
+            p.y  -= win.min().y(); p.iy -= win.min().y();
+            ip.push_back(p);
+          }
+        }
+      }
+
+      // Forget the blocks used least recently
+      while (m_blocks.size() > MAX_CACHED_IP_BLOCKS) {
+        auto oldest = m_blocks.begin();
+        for (auto it = m_blocks.begin(); it != m_blocks.end(); it++) {
+          if (it->second.last_use < oldest->second.last_use)
+            oldest = it;
+        }
+        m_blocks.erase(oldest);
+      }
+    }
+
+  private:
+    typedef std::tuple<std::string, int, int, int> Key; // file, points, col, row
+    struct Block {
+      long long last_use;
+      std::vector<vw::ip::InterestPoint> ip;
+      Block(): last_use(0) {}
+    };
+
+    std::mutex            m_mutex;
+    std::map<Key, Block>  m_blocks;
+    long long             m_use_count;
+  };
+
+  IpBlockCache & ip_block_cache() {
+    static IpBlockCache cache;
+    return cache;
+  }
   
   // Estimate the region in the right image corresponding
   // to left_trans_crop_win based on ip in the current box and
@@ -379,24 +497,20 @@ namespace asp {
     if (crop_right) 
       right_unaligned_file = opt.out_prefix + "-R-cropped.tif";
 
-    // Read the globally aligned images and alignment transforms
-  
+    // Read the globally aligned images and alignment transforms. The
+    // file names only identify the images in the cache of interest
+    // points, as the images may be produced on the fly.
     std::string left_globally_aligned_file = opt.out_prefix + "-L.tif";
     std::string right_globally_aligned_file = opt.out_prefix + "-R.tif";
-    boost::shared_ptr<DiskImageResource>
-      left_rsrc (vw::DiskImageResourcePtr(left_globally_aligned_file)),
-      right_rsrc(vw::DiskImageResourcePtr(right_globally_aligned_file));
-
-    float left_nodata_value  = std::numeric_limits<float>::quiet_NaN();
-    float right_nodata_value = std::numeric_limits<float>::quiet_NaN();
-    if ( left_rsrc->has_nodata_read() )
-      left_nodata_value  = left_rsrc->nodata_read();
-    if ( right_rsrc->has_nodata_read() )
-      right_nodata_value = right_rsrc->nodata_read();
+    float left_nodata_value = 0.0, right_nodata_value = 0.0;
 
     // Note that we do not create masked images using nodata values.
-    DiskImageView<PixelGray<float>> left_globally_aligned_image(left_rsrc),
-      right_globally_aligned_image(right_rsrc);
+    ImageViewRef<PixelGray<float>> left_globally_aligned_image
+      = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, true,
+                                                             left_nodata_value));
+    ImageViewRef<PixelGray<float>> right_globally_aligned_image
+      = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, false,
+                                                             right_nodata_value));
 
     // At image edges, the tile we work with can be a sliver which can
     // cause issues. Grow it to a square tile, then crop it to the
@@ -432,16 +546,25 @@ namespace asp {
     // But do not introduced hard-coded values.
     
     // Redo ip matching in the current tile. It should be more accurate after alignment
-    // and cropping.
+    // and cropping. The ip are shared with the neighboring tiles.
     std::vector<vw::ip::InterestPoint> left_local_ip, right_local_ip;
-    detect_match_ip(left_local_ip, right_local_ip,
-                    crop(left_globally_aligned_image, left_trans_crop_win),
-                    crop(right_globally_aligned_image, right_trans_crop_win), 
-                    stereo_settings().ip_per_tile,
-                    "", "", // do not save any results to disk  
-                    left_nodata_value, right_nodata_value,
-                    "" // do not save any match file to disk
-                    );
+    {
+      int points_per_block = ip_per_block(stereo_settings().ip_per_tile,
+                                          left_extra_factor * max_tile_size);
+      vw::ip::InterestPointList left_ip, right_ip;
+      vw_out() << "\t    Looking for IP in left image...\n";
+      ip_block_cache().find(left_globally_aligned_file, left_globally_aligned_image,
+                            left_nodata_value, points_per_block, left_trans_crop_win,
+                            left_ip);
+      vw_out() << "\t    Looking for IP in right image...\n";
+      ip_block_cache().find(right_globally_aligned_file, right_globally_aligned_image,
+                            right_nodata_value, points_per_block, right_trans_crop_win,
+                            right_ip);
+      side_ip_filtering(left_ip, right_ip,
+                        BBox2i(0, 0, left_trans_crop_win.width(), left_trans_crop_win.height()),
+                        BBox2i(0, 0, right_trans_crop_win.width(), right_trans_crop_win.height()));
+      match_ip_pair(left_ip, right_ip, left_local_ip, right_local_ip);
+    }
 
     if (stereo_settings().local_alignment_debug) {
       // These clips have global but not local alignment
@@ -810,11 +933,101 @@ namespace asp {
   }
 #endif
   
+  // The position in the aligned image of each pixel in a row of the
+  // unaligned tile. The homography is applied to the whole row at once.
+  void align_row(vw::math::Matrix<double> const& H, int row, int cols,
+                 std::vector<Vector2> & pix) {
+    pix.resize(cols);
+    double u0 = H(0, 1) * row + H(0, 2);
+    double v0 = H(1, 1) * row + H(1, 2);
+    double w0 = H(2, 1) * row + H(2, 2);
+    for (int col = 0; col < cols; col++) {
+      double w = H(2, 0) * col + w0;
+      pix[col] = Vector2((H(0, 0) * col + u0) / w, (H(1, 0) * col + v0) / w);
+    }
+  }
+
+  // Apply a homography to a point
+  inline Vector2 apply_homography(vw::math::Matrix<double> const& H, Vector2 const& p) {
+    double w = H(2, 0) * p.x() + H(2, 1) * p.y() + H(2, 2);
+    return Vector2((H(0, 0) * p.x() + H(0, 1) * p.y() + H(0, 2)) / w,
+                   (H(1, 0) * p.x() + H(1, 1) * p.y() + H(1, 2)) / w);
+  }
+
+  // Bilinear interpolation, with pixels beyond the image being
+  // invalid. The result is valid only if the four pixels around are
+  // valid. This is as with BilinearInterpolation and an invalid
+  // ValueEdgeExtension, but without the per-pixel virtual calls.
+  template <class PixelT>
+  vw::PixelMask<PixelT> interp_masked(vw::ImageView<vw::PixelMask<PixelT>> const& img,
+                                      Vector2 const& p) {
+    vw::PixelMask<PixelT> result;
+    result.invalidate();
+    if (!(p.x() >= 0 && p.y() >= 0 && p.x() < img.cols() - 1 && p.y() < img.rows() - 1))
+      return result;
+
+    int x = int(p.x()), y = int(p.y());
+    vw::PixelMask<PixelT> const& p00 = img(x,     y);
+    vw::PixelMask<PixelT> const& p10 = img(x + 1, y);
+    vw::PixelMask<PixelT> const& p01 = img(x,     y + 1);
+    vw::PixelMask<PixelT> const& p11 = img(x + 1, y + 1);
+    if (!is_valid(p00) || !is_valid(p10) || !is_valid(p01) || !is_valid(p11))
+      return result;
+
+    float nx = p.x() - x, ny = p.y() - y;
+    result.child() = (1.0f - ny) * ((1.0f - nx) * p00.child() + nx * p10.child())
+      + ny * ((1.0f - nx) * p01.child() + nx * p11.child());
+    result.validate();
+    return result;
+  }
+
+  // Undo the alignment of a 2D disparity, which is done for 1D
+  // disparities too, as those differ only in having a zero y
+  // component. Each row of the tile is done in one pass.
+  void unalign_disparity_rows(vw::ImageView<vw::PixelMask<vw::Vector2f>> const& aligned_disp,
+                              vw::BBox2i const& left_crop_win, 
+                              vw::BBox2i const& right_crop_win,
+                              vw::math::Matrix<double> const& left_align_mat,
+                              vw::math::Matrix<double> const& right_align_mat,
+                              vw::ImageView<vw::PixelMask<vw::Vector2f>> & unaligned_disp_2d) {
+
+    vw::math::Matrix<double> right_unalign_mat = vw::math::inverse(right_align_mat);
+
+    // Adjust for the fact that the two tiles before alignment
+    // were crops from larger images
+    Vector2 crop_offset = right_crop_win.min() - left_crop_win.min();
+
+    int cols = left_crop_win.width(), rows = left_crop_win.height();
+    unaligned_disp_2d.set_size(cols, rows);
+    std::vector<Vector2> left_trans_pix;
+    for (int row = 0; row < rows; row++) {
+      align_row(left_align_mat, row, cols, left_trans_pix);
+      for (int col = 0; col < cols; col++) {
+        PixelMask<vw::Vector2f> interp_disp = interp_masked(aligned_disp, left_trans_pix[col]);
+        if (!is_valid(interp_disp)) {
+          unaligned_disp_2d(col, row) = PixelMask<Vector2f>();
+          unaligned_disp_2d(col, row).invalidate();
+          continue;
+        }
+
+        // Do the math with doubles rather than with floats, so cast
+        // Vector2f to Vector2.
+        Vector2 right_trans_pix = left_trans_pix[col] + Vector2(interp_disp.child());
+
+        // Undo the transform, and find the un-transformed disparity
+        Vector2 right_pix = apply_homography(right_unalign_mat, right_trans_pix);
+        Vector2 disp_pix = right_pix - Vector2(col, row) + crop_offset;
+      
+        unaligned_disp_2d(col, row).child() = Vector2f(disp_pix.x(), disp_pix.y());
+        unaligned_disp_2d(col, row).validate();
+      }   
+    }
+  }
+  
   // TODO(oalexan1): if left pix or right pix is invalid in the image,
   // the disparity must be invalid! Test with OpenCV SGBM, libelas, and mgm!
   // Also implement for unalign_2d_disparity.
   
-  // DO the same for unalign_2d_disparity.
   // Go from 1D disparity of images with affine epipolar alignment to the 2D
   // disparity by undoing the transforms that applied this alignment.
   void unalign_1d_disparity(// Inputs
@@ -826,56 +1039,28 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<vw::Vector2f>> & unaligned_disp_2d) {
 
-    vw::HomographyTransform left_align_trans (left_align_mat);
-    vw::HomographyTransform right_align_trans(right_align_mat);
-
     float nan_nodata = std::numeric_limits<float>::quiet_NaN(); // NaN value
-    PixelMask<float> nodata_mask = PixelMask<float>(); // invalid value for a PixelMask
-
-    ImageViewRef<PixelMask<float>> masked_aligned_disp_1d
+    ImageView<PixelMask<float>> masked_aligned_disp_1d
       = create_mask(aligned_disp_1d, nan_nodata);
 
+    // Since the disparity is 1D, the y value (row) is the same
+    // as for the input.
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<PixelMask<float>> interp_aligned_disp_1d
-      = interpolate(masked_aligned_disp_1d, BilinearInterpolation(),
-                    ValueEdgeExtension<PixelMask<float>>(nodata_mask));
-    
-    unaligned_disp_2d.set_size(left_crop_win.width(), left_crop_win.height());
-
-    for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
-      for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
-        PixelMask<float> interp_disp
-          = interp_aligned_disp_1d(left_trans_pix.x(), left_trans_pix.y());
-
-        if (!is_valid(interp_disp)) {
-          unaligned_disp_2d(col, row) = PixelMask<Vector2f>();
-          unaligned_disp_2d(col, row).invalidate();
-          continue;
-        }
-
-        // Since the disparity is 1D, the y value (row) is the same
-        // as for the input.
-        Vector2 right_trans_pix(left_trans_pix.x() + interp_disp.child(), left_trans_pix.y());
-
-        // Undo the transform
-        Vector2 right_pix = right_align_trans.reverse(right_trans_pix);
-
-        // Un-transformed disparity
-        Vector2 disp_pix = right_pix - left_pix;
-
-        // Adjust for the fact that the two tiles before alignment
-        // were crops from larger images
-        disp_pix += (right_crop_win.min() - left_crop_win.min());
-      
-        unaligned_disp_2d(col, row).child() = Vector2f(disp_pix.x(), disp_pix.y());
-        unaligned_disp_2d(col, row).validate();
-      }   
+    ImageView<PixelMask<Vector2f>> aligned_disp_2d(masked_aligned_disp_1d.cols(),
+                                                   masked_aligned_disp_1d.rows());
+    for (int row = 0; row < aligned_disp_2d.rows(); row++) {
+      for (int col = 0; col < aligned_disp_2d.cols(); col++) {
+        PixelMask<float> d = masked_aligned_disp_1d(col, row);
+        aligned_disp_2d(col, row) = PixelMask<Vector2f>(Vector2f(d.child(), 0.0f));
+        if (!is_valid(d))
+          aligned_disp_2d(col, row).invalidate();
+      }
     }
-  
+
+    unalign_disparity_rows(aligned_disp_2d, left_crop_win, right_crop_win,
+                           left_align_mat, right_align_mat, unaligned_disp_2d);
   }
 
   // Go from 2D disparity of images with affine epipolar alignment to the 2D
@@ -889,53 +1074,11 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<vw::Vector2f>> & unaligned_disp_2d) {
     
-    vw::HomographyTransform left_align_trans (left_align_mat);
-    vw::HomographyTransform right_align_trans(right_align_mat);
-
-    PixelMask<vw::Vector2f> nodata_pix;
-    nodata_pix.invalidate();
-    
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<vw::PixelMask<vw::Vector2f>> interp_aligned_disp_2d
-      = interpolate(aligned_disp_2d, BilinearInterpolation(),
-                    ValueEdgeExtension<PixelMask<vw::Vector2f>>(nodata_pix));
-    
-    unaligned_disp_2d.set_size(left_crop_win.width(), left_crop_win.height());
-
-    for (int col = 0; col < unaligned_disp_2d.cols(); col++) {
-      for (int row = 0; row < unaligned_disp_2d.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
-        PixelMask<vw::Vector2f> interp_disp
-          = interp_aligned_disp_2d(left_trans_pix.x(), left_trans_pix.y());
-        
-        if (!is_valid(interp_disp)) {
-          unaligned_disp_2d(col, row) = PixelMask<Vector2f>();
-          unaligned_disp_2d(col, row).invalidate();
-          continue;
-        }
-
-        // Do the math with doubles rather than with floats, so cast
-        // Vector2f to Vector2.
-        Vector2 right_trans_pix = left_trans_pix + Vector2(interp_disp.child());
-
-        // Undo the transform
-        Vector2 right_pix = right_align_trans.reverse(right_trans_pix);
-
-        // Un-transformed disparity
-        Vector2 disp_pix = right_pix - left_pix;
-
-        // Adjust for the fact that the two tiles before alignment
-        // were crops from larger images
-        disp_pix += (right_crop_win.min() - left_crop_win.min());
-      
-        unaligned_disp_2d(col, row).child() = Vector2f(disp_pix.x(), disp_pix.y());
-        unaligned_disp_2d(col, row).validate();
-      }   
-    }
-    
+    unalign_disparity_rows(aligned_disp_2d, left_crop_win, right_crop_win,
+                           left_align_mat, right_align_mat, unaligned_disp_2d);
   }
   
   // Given an image in one-to-one correspondence with an aligned left image,
@@ -948,28 +1091,16 @@ namespace asp {
                             // Output
                             vw::ImageView<vw::PixelMask<float>> & unaligned_image) {
     
-    vw::HomographyTransform left_align_trans(left_align_mat);
-
-    PixelMask<float> nodata_pix;
-    nodata_pix.invalidate();
-    
     // TODO(oalexan1): Here bilinear interpolation is used. This will
     // make the holes a little bigger where there is no data. Need
     // to figure out if it is desired to fill holes.
-    ImageViewRef<vw::PixelMask<float>> interp_aligned_image
-      = interpolate(aligned_image, BilinearInterpolation(),
-                    ValueEdgeExtension<PixelMask<float>>(nodata_pix));
-    
-    unaligned_image.set_size(left_crop_win.width(), left_crop_win.height());
-    for (int col = 0; col < unaligned_image.cols(); col++) {
-      for (int row = 0; row < unaligned_image.rows(); row++) {
-        Vector2 left_pix(col, row);
-        Vector2 left_trans_pix = left_align_trans.forward(left_pix);
-        PixelMask<float> interp_val
-          = interp_aligned_image(left_trans_pix.x(), left_trans_pix.y());
-        
-        unaligned_image(col, row) = interp_val;
-      }
+    int cols = left_crop_win.width(), rows = left_crop_win.height();
+    unaligned_image.set_size(cols, rows);
+    std::vector<Vector2> left_trans_pix;
+    for (int row = 0; row < rows; row++) {
+      align_row(left_align_mat, row, cols, left_trans_pix);
+      for (int col = 0; col < cols; col++)
+        unaligned_image(col, row) = interp_masked(aligned_image, left_trans_pix[col]);
     }
   }
   
@@ -1377,16 +1508,18 @@ namespace asp {
       }
     }
 
-    // Write the disparity to disk
-    vw::cartography::GeoReference georef;
-    bool   has_georef = false;
-    bool   has_nodata = true;
-    vw_out() << "Writing: " << disparity_file << "\n";
-    vw::cartography::block_write_gdal_image(disparity_file, asp_disp,
-                                            has_georef, georef,
-                                            has_nodata, nan, opt,
-                                            TerminalProgressCallback
-                                            ("asp", "\t--> Disparity :"));
+    // Write the disparity to disk only for debugging, as it is kept in memory
+    if (stereo_settings().local_alignment_debug) {
+      vw::cartography::GeoReference georef;
+      bool   has_georef = false;
+      bool   has_nodata = true;
+      vw_out() << "Writing: " << disparity_file << "\n";
+      vw::cartography::block_write_gdal_image(disparity_file, asp_disp,
+                                              has_georef, georef,
+                                              has_nodata, nan, opt,
+                                              TerminalProgressCallback
+                                              ("asp", "\t--> Disparity :"));
+    }
 
 
     // Assign the disparity to the output variable (this should not do a copy).
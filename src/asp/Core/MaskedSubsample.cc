@@ -0,0 +1,105 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/MaskedSubsample.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/Algorithms.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  SubsampleAccumulator::SubsampleAccumulator(int full_cols, int full_rows, double scale):
+    m_scale(scale) {
+
+    if (scale <= 0.0 || scale > 1.0)
+      vw::vw_throw(vw::ArgumentErr() << "The subsampling scale must be in (0, 1].\n");
+
+    int cols = std::max(1, int(std::round(full_cols * scale)));
+    int rows = std::max(1, int(std::round(full_rows * scale)));
+    m_sum.set_size(cols, rows);
+    m_weight.set_size(cols, rows);
+    vw::fill(m_sum, 0.0);
+    vw::fill(m_weight, 0.0);
+  }
+
+  void SubsampleAccumulator::add(vw::BBox2i const& bbox,
+                                 vw::ImageView<vw::PixelGray<float>> const& image,
+                                 vw::ImageView<vw::PixelMask<vw::uint8>> const& mask) {
+
+    if (bbox.empty())
+      return;
+
+    // The range of subsampled pixels this tile contributes to
+    int cols = m_sum.cols(), rows = m_sum.rows();
+    auto sub_col = [&](int x) {
+      return std::max(0, std::min(cols - 1, int(std::floor(x * m_scale + 0.5))));
+    };
+    auto sub_row = [&](int y) {
+      return std::max(0, std::min(rows - 1, int(std::floor(y * m_scale + 0.5))));
+    };
+    int c0 = sub_col(bbox.min().x()), c1 = sub_col(bbox.max().x() - 1);
+    int r0 = sub_row(bbox.min().y()), r1 = sub_row(bbox.max().y() - 1);
+
+    // Sum up locally, without holding the lock
+    int local_cols = c1 - c0 + 1, local_rows = r1 - r0 + 1;
+    std::vector<double> sum(size_t(local_cols) * local_rows, 0.0);
+    std::vector<double> weight(sum.size(), 0.0);
+    std::vector<int> col_index(bbox.width());
+    for (int x = 0; x < bbox.width(); x++)
+      col_index[x] = sub_col(x + bbox.min().x()) - c0;
+    for (int y = 0; y < bbox.height(); y++) {
+      size_t row_start = size_t(sub_row(y + bbox.min().y()) - r0) * local_cols;
+      for (int x = 0; x < bbox.width(); x++) {
+        if (!is_valid(mask(x, y)))
+          continue;
+        size_t pos = row_start + col_index[x];
+        sum[pos]    += image(x, y).v();
+        weight[pos] += 1.0;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_added.insert(std::make_pair(bbox.min().x(), bbox.min().y())).second)
+      return;
+    for (int r = 0; r < local_rows; r++) {
+      for (int c = 0; c < local_cols; c++) {
+        size_t pos = size_t(r) * local_cols + c;
+        m_sum   (c0 + c, r0 + r) += sum[pos];
+        m_weight(c0 + c, r0 + r) += weight[pos];
+      }
+    }
+  }
+
+  vw::ImageView<vw::PixelMask<vw::PixelGray<float>>> SubsampleAccumulator::result() const {
+    vw::ImageView<vw::PixelMask<vw::PixelGray<float>>> out(m_sum.cols(), m_sum.rows());
+    for (int r = 0; r < out.rows(); r++) {
+      for (int c = 0; c < out.cols(); c++) {
+        if (m_weight(c, r) > 0)
+          out(c, r) = vw::PixelMask<vw::PixelGray<float>>
+            (vw::PixelGray<float>(m_sum(c, r) / m_weight(c, r)));
+        else
+          out(c, r).invalidate();
+      }
+    }
+    return out;
+  }
+
+} // end namespace asp
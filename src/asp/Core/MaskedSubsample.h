@@ -0,0 +1,122 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file MaskedSubsample.h
+///
+/// Find a subsampled version of an image, averaging its valid pixels,
+/// from the same tiles that are rendered while writing its mask, so
+/// the image is read only once.
+
+#ifndef __ASP_CORE_MASKED_SUBSAMPLE_H__
+#define __ASP_CORE_MASKED_SUBSAMPLE_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <mutex>
+#include <set>
+#include <utility>
+
+namespace asp {
+
+  /// Accumulate the valid pixels of the tiles of an image into the
+  /// pixels of an image subsampled by the given scale. Pixel (x, y)
+  /// of the full image goes to the subsampled pixel nearest to
+  /// (x, y) * scale, so the center of a subsampled pixel is where
+  /// vw::resample() would sample it. Tiles may be added from several
+  /// threads. A tile added a second time is ignored.
+  class SubsampleAccumulator {
+  public:
+    SubsampleAccumulator(int full_cols, int full_rows, double scale);
+
+    void add(vw::BBox2i const& bbox,
+             vw::ImageView<vw::PixelGray<float>> const& image,
+             vw::ImageView<vw::PixelMask<vw::uint8>> const& mask);
+
+    /// The average of the valid pixels going to each subsampled pixel.
+    /// Invalid if there are none.
+    vw::ImageView<vw::PixelMask<vw::PixelGray<float>>> result() const;
+
+  private:
+    double m_scale;
+    std::mutex m_mutex;
+    vw::ImageView<double> m_sum, m_weight;
+    std::set<std::pair<int, int>> m_added; // corners of the tiles added so far
+  };
+
+  /// A view returning the given mask, which, when a tile of it is
+  /// rendered, adds the image pixels in that tile to the accumulator.
+  /// Hence writing the mask to disk also finds the subsampled image.
+  template <class ImageT, class MaskT>
+  class AccumulateSubsampleView:
+    public vw::ImageViewBase<AccumulateSubsampleView<ImageT, MaskT>> {
+    ImageT m_image;
+    MaskT  m_mask;
+    boost::shared_ptr<SubsampleAccumulator> m_acc;
+
+  public:
+    typedef vw::PixelMask<vw::uint8> pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<AccumulateSubsampleView> pixel_accessor;
+
+    AccumulateSubsampleView(ImageT const& image, MaskT const& mask,
+                            boost::shared_ptr<SubsampleAccumulator> acc):
+      m_image(image), m_mask(mask), m_acc(acc) {}
+
+    inline vw::int32 cols  () const { return m_mask.cols(); }
+    inline vw::int32 rows  () const { return m_mask.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    // Single pixels are not accumulated
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p = 0) const {
+      return m_mask(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> mask_tile = crop(m_mask, bbox);
+      vw::ImageView<vw::PixelGray<float>> image_tile = crop(m_image, bbox);
+      m_acc->add(bbox, image_tile, mask_tile);
+      return prerasterize_type(mask_tile, -bbox.min().x(), -bbox.min().y(),
+                               cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT, class MaskT>
+  AccumulateSubsampleView<ImageT, MaskT>
+  accumulate_subsample(vw::ImageViewBase<ImageT> const& image,
+                       vw::ImageViewBase<MaskT> const& mask,
+                       boost::shared_ptr<SubsampleAccumulator> acc) {
+    return AccumulateSubsampleView<ImageT, MaskT>(image.impl(), mask.impl(), acc);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MASKED_SUBSAMPLE_H__
@@ -0,0 +1,228 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/MatchDatabase.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/FileUtils.h>
+#include <vw/InterestPoint/Matcher.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // Written at the start of each database. Change this if the format changes.
+  const std::string MATCH_DATABASE_MAGIC = "ASP match database 1";
+
+  namespace {
+
+  // The fields of an interest point, as in a match file
+  void write_ip(std::ofstream & ofs, vw::ip::InterestPoint const& ip) {
+    float   fvals[5] = {ip.x, ip.y, ip.orientation, ip.scale, ip.interest};
+    int32_t ivals[2] = {ip.ix, ip.iy};
+    uint32_t uvals[4] = {uint32_t(ip.polarity), ip.octave, ip.scale_lvl,
+                         uint32_t(ip.descriptor.size())};
+    ofs.write((char const*)fvals, sizeof(fvals));
+    ofs.write((char const*)ivals, sizeof(ivals));
+    ofs.write((char const*)uvals, sizeof(uvals));
+    for (size_t it = 0; it < ip.descriptor.size(); it++) {
+      float val = ip.descriptor[it];
+      ofs.write((char const*)&val, sizeof(val));
+    }
+  }
+
+  bool read_ip(std::ifstream & ifs, vw::ip::InterestPoint & ip) {
+    float   fvals[5];
+    int32_t ivals[2];
+    uint32_t uvals[4];
+    ifs.read((char*)fvals, sizeof(fvals));
+    ifs.read((char*)ivals, sizeof(ivals));
+    ifs.read((char*)uvals, sizeof(uvals));
+    if (!ifs.good())
+      return false;
+
+    ip.x           = fvals[0];
+    ip.y           = fvals[1];
+    ip.orientation = fvals[2];
+    ip.scale       = fvals[3];
+    ip.interest    = fvals[4];
+    ip.ix          = ivals[0];
+    ip.iy          = ivals[1];
+    ip.polarity    = (uvals[0] != 0);
+    ip.octave      = uvals[1];
+    ip.scale_lvl   = uvals[2];
+    ip.descriptor.set_size(uvals[3]);
+    for (size_t it = 0; it < ip.descriptor.size(); it++) {
+      float val = 0;
+      ifs.read((char*)&val, sizeof(val));
+      ip.descriptor[it] = val;
+    }
+    return ifs.good();
+  }
+
+  void write_string(std::ofstream & ofs, std::string const& str) {
+    std::int64_t len = str.size();
+    ofs.write((char const*)&len, sizeof(len));
+    ofs.write(str.data(), len);
+  }
+
+  bool read_string(std::ifstream & ifs, std::string & str) {
+    std::int64_t len = 0;
+    ifs.read((char*)&len, sizeof(len));
+    if (!ifs.good() || len < 0)
+      return false;
+    str.resize(len);
+    ifs.read(&str[0], len);
+    return ifs.good();
+  }
+
+  } // end anonymous namespace
+
+  void MatchDatabase::write(std::string const& file,
+                            std::vector<std::string> const& image_files,
+                            std::map<std::pair<int, int>, std::string> const& match_files) {
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial database.
+    std::string tmp_file = file + ".tmp";
+    vw::create_out_dir(file);
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+      ofs << MATCH_DATABASE_MAGIC << "\n";
+
+      std::vector<std::pair<std::string, std::string>> names;
+      std::vector<Entry> entries;
+      for (auto it = match_files.begin(); it != match_files.end(); it++) {
+        if (!fs::exists(it->second))
+          continue;
+
+        std::vector<vw::ip::InterestPoint> ip1, ip2;
+        vw::ip::read_binary_match_file(it->second, ip1, ip2);
+        if (ip1.size() != ip2.size())
+          vw::vw_throw(vw::IOErr() << "Inconsistent match file: " << it->second << "\n");
+
+        Entry entry;
+        entry.offset      = ofs.tellp();
+        entry.num_matches = ip1.size();
+        for (size_t ip_it = 0; ip_it < ip1.size(); ip_it++)
+          write_ip(ofs, ip1[ip_it]);
+        for (size_t ip_it = 0; ip_it < ip2.size(); ip_it++)
+          write_ip(ofs, ip2[ip_it]);
+
+        names.push_back(std::make_pair(image_files[it->first.first],
+                                       image_files[it->first.second]));
+        entries.push_back(entry);
+      }
+
+      // The index, and where it starts, at the end
+      std::int64_t index_offset = ofs.tellp();
+      std::int64_t num_pairs = entries.size();
+      ofs.write((char const*)&num_pairs, sizeof(num_pairs));
+      for (size_t it = 0; it < entries.size(); it++) {
+        write_string(ofs, names[it].first);
+        write_string(ofs, names[it].second);
+        ofs.write((char const*)&entries[it].offset, sizeof(entries[it].offset));
+        ofs.write((char const*)&entries[it].num_matches, sizeof(entries[it].num_matches));
+      }
+      ofs.write((char const*)&index_offset, sizeof(index_offset));
+
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+      vw::vw_out() << "Packed " << num_pairs << " match files in: " << file << "\n";
+    }
+    fs::rename(tmp_file, file);
+  }
+
+  bool MatchDatabase::open(std::string const& file) {
+
+    m_file = "";
+    m_index.clear();
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic;
+    std::getline(ifs, magic);
+    if (magic != MATCH_DATABASE_MAGIC)
+      return false;
+
+    std::int64_t index_offset = 0, num_pairs = 0;
+    ifs.seekg(-std::int64_t(sizeof(index_offset)), std::ios::end);
+    ifs.read((char*)&index_offset, sizeof(index_offset));
+    if (!ifs.good() || index_offset <= 0)
+      return false;
+    ifs.seekg(index_offset);
+    ifs.read((char*)&num_pairs, sizeof(num_pairs));
+    if (!ifs.good() || num_pairs < 0)
+      return false;
+
+    std::map<std::pair<std::string, std::string>, Entry> index;
+    for (std::int64_t it = 0; it < num_pairs; it++) {
+      std::string image1, image2;
+      Entry entry;
+      if (!read_string(ifs, image1) || !read_string(ifs, image2))
+        return false;
+      ifs.read((char*)&entry.offset, sizeof(entry.offset));
+      ifs.read((char*)&entry.num_matches, sizeof(entry.num_matches));
+      if (!ifs.good())
+        return false;
+      index[std::make_pair(image1, image2)] = entry;
+    }
+
+    m_file  = file;
+    m_index = index;
+    return true;
+  }
+
+  bool MatchDatabase::has_pair(std::string const& image1, std::string const& image2) const {
+    return m_index.find(std::make_pair(image1, image2)) != m_index.end();
+  }
+
+  bool MatchDatabase::read(std::string const& image1, std::string const& image2,
+                           std::vector<vw::ip::InterestPoint> & ip1,
+                           std::vector<vw::ip::InterestPoint> & ip2) const {
+
+    ip1.clear();
+    ip2.clear();
+    auto it = m_index.find(std::make_pair(image1, image2));
+    if (it == m_index.end())
+      return false;
+
+    std::ifstream ifs(m_file.c_str(), std::ios::binary);
+    ifs.seekg(it->second.offset);
+    ip1.resize(it->second.num_matches);
+    ip2.resize(it->second.num_matches);
+    for (size_t ip_it = 0; ip_it < ip1.size(); ip_it++) {
+      if (!read_ip(ifs, ip1[ip_it]))
+        vw::vw_throw(vw::IOErr() << "Failed reading: " << m_file << "\n");
+    }
+    for (size_t ip_it = 0; ip_it < ip2.size(); ip_it++) {
+      if (!read_ip(ifs, ip2[ip_it]))
+        vw::vw_throw(vw::IOErr() << "Failed reading: " << m_file << "\n");
+    }
+    return true;
+  }
+
+} // end namespace asp
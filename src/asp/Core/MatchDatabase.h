@@ -0,0 +1,79 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file MatchDatabase.h
+///
+/// Many match files packed into one file, indexed by image pair. Reading
+/// the matches of a pair needs one seek in an open file, rather than
+/// opening one of thousands of small files.
+
+#ifndef __ASP_CORE_MATCH_DATABASE_H__
+#define __ASP_CORE_MATCH_DATABASE_H__
+
+#include <vw/InterestPoint/InterestData.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The matches of all pairs are stored one after another, followed
+  /// by the index, which has for each pair the image names, the number
+  /// of matches, and where they start. Only the index is kept in memory.
+  /// The index is not modified after it is read, and each read opens
+  /// the file anew, so the matches can be read from several threads.
+  class MatchDatabase {
+
+  public:
+    MatchDatabase() {}
+
+    /// Pack the match files for the given pairs of images. Files which
+    /// do not exist are skipped.
+    static void write(std::string const& file,
+                      std::vector<std::string> const& image_files,
+                      std::map<std::pair<int, int>, std::string> const& match_files);
+
+    /// Read the index of a database saved with write(). Return false if
+    /// the file does not exist or cannot be parsed.
+    bool open(std::string const& file);
+
+    bool is_open() const { return m_file != ""; }
+
+    bool has_pair(std::string const& image1, std::string const& image2) const;
+
+    /// Read the matches between two images. Return false if the pair is
+    /// not in the database.
+    bool read(std::string const& image1, std::string const& image2,
+              std::vector<vw::ip::InterestPoint> & ip1,
+              std::vector<vw::ip::InterestPoint> & ip2) const;
+
+    int num_pairs() const { return m_index.size(); }
+
+  private:
+    struct Entry {
+      std::int64_t offset, num_matches;
+    };
+
+    std::string m_file;
+    std::map<std::pair<std::string, std::string>, Entry> m_index;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MATCH_DATABASE_H__
@@ -17,8 +17,19 @@
 
 
 #include <asp/Core/MedianFilter.h>
+#include <asp/Core/TileArena.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Math/Vector.h>
 
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
 using namespace vw;
 
 uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
@@ -39,3 +50,234 @@ uint8 find_median_in_histogram(Vector<int, CALC_PIXEL_NUM_VALS> histogram,
 
   return i;
 }
+
+namespace asp {
+
+  // Filter the rows in [m_row_beg, m_row_end) of the input. The bin of
+  // each pixel is -1 if invalid.
+  class MedianFilterTask: public vw::Task, private boost::noncopyable {
+    ImageView<PixelMask<float>> const& m_input;
+    int                         const* m_bins;
+    int m_half, m_row_beg, m_row_end;
+    ImageView<PixelMask<float>>      & m_output;
+
+  public:
+    MedianFilterTask(ImageView<PixelMask<float>> const& input, int const* bins,
+                     int half, int row_beg, int row_end, ImageView<PixelMask<float>> & output):
+      m_input(input), m_bins(bins), m_half(half), m_row_beg(row_beg), m_row_end(row_end),
+      m_output(output) {}
+
+    void operator()() {
+
+      const int NC = MEDIAN_COARSE_BINS, NF = MEDIAN_FINE_BINS, NB = MEDIAN_NUM_BINS;
+      int cols = m_input.cols(), rows = m_input.rows();
+
+      // The histograms of the column pixels in the rows [top, bot), by
+      // coarse and by fine bin, and the sums of the values in each fine
+      // bin. These are large, so are taken from the arena of this thread.
+      TileArenaScope scope;
+      TileArena & arena = TileArena::local();
+      int    * col_coarse = arena.alloc<int>   (size_t(cols) * NC);
+      int    * col_fine   = arena.alloc<int>   (size_t(cols) * NB);
+      double * col_sum    = arena.alloc<double>(size_t(cols) * NB);
+      std::fill(col_coarse, col_coarse + size_t(cols) * NC, 0);
+      std::fill(col_fine,   col_fine   + size_t(cols) * NB, 0);
+      std::fill(col_sum,    col_sum    + size_t(cols) * NB, 0.0);
+      int top = std::max(0, m_row_beg - m_half), bot = top;
+
+      // The kernel histogram by coarse bin, and, for each coarse bin, by
+      // fine bin, covering the columns in [fine_beg[c], fine_end[c])
+      std::vector<int>    coarse(NC), fine(NB), fine_beg(NC), fine_end(NC);
+      std::vector<double> sum(NB);
+
+      for (int row = m_row_beg; row < m_row_end; row++) {
+
+        // Update the column histograms
+        int want_bot = std::min(rows, row + m_half + 1), want_top = std::max(0, row - m_half);
+        for (; bot < want_bot; bot++) {
+          for (int col = 0; col < cols; col++) {
+            int b = m_bins[size_t(bot) * cols + col];
+            if (b < 0)
+              continue;
+            col_coarse[size_t(col) * NC + b / NF]++;
+            col_fine  [size_t(col) * NB + b]++;
+            col_sum   [size_t(col) * NB + b] += m_input(col, bot).child();
+          }
+        }
+        for (; top < want_top; top++) {
+          for (int col = 0; col < cols; col++) {
+            int b = m_bins[size_t(top) * cols + col];
+            if (b < 0)
+              continue;
+            col_coarse[size_t(col) * NC + b / NF]--;
+            col_fine  [size_t(col) * NB + b]--;
+            col_sum   [size_t(col) * NB + b] -= m_input(col, top).child();
+          }
+        }
+
+        std::fill(coarse.begin(), coarse.end(), 0);
+        std::fill(fine_beg.begin(), fine_beg.end(), 0);
+        std::fill(fine_end.begin(), fine_end.end(), 0);
+        std::fill(fine.begin(), fine.end(), 0);
+        std::fill(sum.begin(), sum.end(), 0.0);
+        int beg = 0, end = 0, num = 0;
+
+        for (int col = 0; col < cols; col++) {
+
+          // Slide the kernel
+          int want_end = std::min(cols, col + m_half + 1), want_beg = std::max(0, col - m_half);
+          for (; end < want_end; end++) {
+            for (int c = 0; c < NC; c++) {
+              coarse[c] += col_coarse[size_t(end) * NC + c];
+              num       += col_coarse[size_t(end) * NC + c];
+            }
+          }
+          for (; beg < want_beg; beg++) {
+            for (int c = 0; c < NC; c++) {
+              coarse[c] -= col_coarse[size_t(beg) * NC + c];
+              num       -= col_coarse[size_t(beg) * NC + c];
+            }
+          }
+
+          PixelMask<float> pix = m_input(col, row);
+          if (!is_valid(pix) || num <= 0) {
+            m_output(col, row) = pix;
+            continue;
+          }
+
+          // The coarse bin of the median, the one with index num/2
+          int k = num / 2, c = 0;
+          while (k >= coarse[c]) {
+            k -= coarse[c];
+            c++;
+          }
+
+          // Bring the fine histogram of that coarse bin to the kernel
+          // columns. It is started over if it is too far behind.
+          int * f = &fine[size_t(c) * NF];
+          double * s = &sum[size_t(c) * NF];
+          if (fine_end[c] <= beg) {
+            std::fill(f, f + NF, 0);
+            std::fill(s, s + NF, 0.0);
+            fine_beg[c] = fine_end[c] = beg;
+          }
+          for (; fine_end[c] < end; fine_end[c]++) {
+            size_t start = size_t(fine_end[c]) * NB + size_t(c) * NF;
+            for (int i = 0; i < NF; i++) {
+              f[i] += col_fine[start + i];
+              s[i] += col_sum [start + i];
+            }
+          }
+          for (; fine_beg[c] < beg; fine_beg[c]++) {
+            size_t start = size_t(fine_beg[c]) * NB + size_t(c) * NF;
+            for (int i = 0; i < NF; i++) {
+              f[i] -= col_fine[start + i];
+              s[i] -= col_sum [start + i];
+            }
+          }
+
+          int i = 0;
+          while (k >= f[i]) {
+            k -= f[i];
+            i++;
+          }
+          m_output(col, row) = PixelMask<float>(s[i] / f[i]);
+        }
+      }
+    }
+  };
+
+  void median_filter(ImageView<PixelMask<float>> const& input,
+                     int kernel_size, int num_threads,
+                     ImageView<PixelMask<float>> & output) {
+
+    output.set_size(input.cols(), input.rows());
+    int half = kernel_size / 2;
+    if (half <= 0) {
+      for (int row = 0; row < input.rows(); row++)
+        for (int col = 0; col < input.cols(); col++)
+          output(col, row) = input(col, row);
+      return;
+    }
+
+    // Quantize the valid values
+    float min_val = std::numeric_limits<float>::max(), max_val = -min_val;
+    for (int row = 0; row < input.rows(); row++) {
+      for (int col = 0; col < input.cols(); col++) {
+        if (!is_valid(input(col, row)))
+          continue;
+        min_val = std::min(min_val, input(col, row).child());
+        max_val = std::max(max_val, input(col, row).child());
+      }
+    }
+    double scale = 0.0;
+    if (max_val > min_val)
+      scale = (MEDIAN_NUM_BINS - 1) / (double(max_val) - double(min_val));
+    TileArenaScope scope;
+    int * bins = TileArena::local().alloc<int>(size_t(input.cols()) * input.rows());
+    for (int row = 0; row < input.rows(); row++) {
+      for (int col = 0; col < input.cols(); col++) {
+        PixelMask<float> pix = input(col, row);
+        int & bin = bins[size_t(row) * input.cols() + col];
+        bin = -1;
+        if (is_valid(pix))
+          bin = std::max(0, std::min(MEDIAN_NUM_BINS - 1,
+                                     int(std::floor((pix.child() - min_val) * scale + 0.5))));
+      }
+    }
+
+    // Each strip of rows starts its column histograms over, so the
+    // strips should be much taller than the kernel
+    num_threads = std::max(1, std::min(num_threads, input.rows() / (2 * half + 1)));
+    int strip = (input.rows() + num_threads - 1) / num_threads;
+
+    // With one thread, as when filtering each tile, filter in this
+    // thread, so its arena is reused from tile to tile
+    if (num_threads == 1) {
+      MedianFilterTask task(input, bins, half, 0, input.rows(), output);
+      task();
+      return;
+    }
+
+    vw::FifoWorkQueue queue(num_threads);
+    for (int row = 0; row < input.rows(); row += strip) {
+      boost::shared_ptr<MedianFilterTask>
+        task(new MedianFilterTask(input, bins, half, row,
+                                  std::min(input.rows(), row + strip), output));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+
+  void disparity_median_filter(ImageView<PixelMask<Vector2f>> const& input,
+                               int kernel_size, int num_threads,
+                               ImageView<PixelMask<Vector2f>> & output) {
+
+    ImageView<PixelMask<float>> in_x(input.cols(), input.rows()), in_y(input.cols(), input.rows());
+    for (int row = 0; row < input.rows(); row++) {
+      for (int col = 0; col < input.cols(); col++) {
+        PixelMask<Vector2f> pix = input(col, row);
+        in_x(col, row) = PixelMask<float>(pix.child()[0]);
+        in_y(col, row) = PixelMask<float>(pix.child()[1]);
+        if (!is_valid(pix)) {
+          in_x(col, row).invalidate();
+          in_y(col, row).invalidate();
+        }
+      }
+    }
+
+    ImageView<PixelMask<float>> out_x, out_y;
+    median_filter(in_x, kernel_size, num_threads, out_x);
+    median_filter(in_y, kernel_size, num_threads, out_y);
+
+    output.set_size(input.cols(), input.rows());
+    for (int row = 0; row < input.rows(); row++) {
+      for (int col = 0; col < input.cols(); col++) {
+        output(col, row) = input(col, row);
+        if (is_valid(input(col, row)))
+          output(col, row).child() = Vector2f(out_x(col, row).child(), out_y(col, row).child());
+      }
+    }
+  }
+
+} // end namespace asp
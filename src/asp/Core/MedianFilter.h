@@ -31,6 +31,7 @@
 #include <vw/Image/ImageView.h>
 #include <vw/Image/EdgeExtension.h>
 #include <vw/Image/PerPixelAccessorViews.h>
+#include <vw/Image/PixelMask.h>
 
 namespace vw {
 
@@ -142,4 +143,34 @@ namespace vw {
 
 }
 
+namespace asp {
+
+  /// The number of bins the values are quantized to in median_filter(),
+  /// as coarse bins, each split into fine bins.
+  const int MEDIAN_COARSE_BINS = 32;
+  const int MEDIAN_FINE_BINS   = 32;
+  const int MEDIAN_NUM_BINS    = MEDIAN_COARSE_BINS * MEDIAN_FINE_BINS;
+
+  /// Median filter with a square kernel of given size, in time not
+  /// depending on the kernel size (Perreault and Hebert, 2007). The
+  /// valid values are quantized to MEDIAN_NUM_BINS bins spanning their
+  /// range, and there is a histogram for each image column, updated
+  /// one row at a time, with the kernel histogram updated one column
+  /// at a time from those. Each output pixel is the mean of the values
+  /// in the bin of the median of the valid pixels in the kernel, which
+  /// is the median itself if the values in that bin are equal, and is
+  /// off by at most the bin width otherwise. The kernel is clipped at
+  /// the image boundary. Invalid pixels are not changed. The rows are
+  /// split into strips done in parallel with the given number of threads.
+  void median_filter(vw::ImageView<vw::PixelMask<float>> const& input,
+                     int kernel_size, int num_threads,
+                     vw::ImageView<vw::PixelMask<float>> & output);
+
+  /// Apply median_filter() to each channel of a disparity.
+  void disparity_median_filter(vw::ImageView<vw::PixelMask<vw::Vector2f>> const& input,
+                               int kernel_size, int num_threads,
+                               vw::ImageView<vw::PixelMask<vw::Vector2f>> & output);
+
+} // end namespace asp
+
 #endif // __MEDIAN_FILTER_H__
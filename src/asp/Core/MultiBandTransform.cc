@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MultiBandTransform.cc
+///
+
+#include <asp/Core/MultiBandTransform.h>
+
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  void cubic_weights(double frac, double weights[4]) {
+    double t = frac, t2 = t * t, t3 = t2 * t;
+    weights[0] = -0.5 * t3 + t2 - 0.5 * t;
+    weights[1] =  1.5 * t3 - 2.5 * t2 + 1.0;
+    weights[2] = -1.5 * t3 + 2.0 * t2 + 0.5 * t;
+    weights[3] =  0.5 * t3 - 0.5 * t2;
+  }
+
+  void interp_bands(float const* buf, int cols, int rows, int num_bands,
+                    Vector2 const& pos, bool nearest, float * out) {
+
+    for (int b = 0; b < num_bands; b++)
+      out[b] = std::numeric_limits<float>::quiet_NaN();
+
+    if (nearest) {
+      int col = int(std::floor(pos.x() + 0.5)), row = int(std::floor(pos.y() + 0.5));
+      if (col < 0 || row < 0 || col >= cols || row >= rows)
+        return;
+      float const* src = buf + (size_t(row) * cols + col) * num_bands;
+      for (int b = 0; b < num_bands; b++)
+        out[b] = src[b];
+      return;
+    }
+
+    int col = int(std::floor(pos.x())), row = int(std::floor(pos.y()));
+    if (col - 1 < 0 || row - 1 < 0 || col + 2 >= cols || row + 2 >= rows)
+      return;
+
+    // The same weights for all bands. A NaN sample makes its band NaN.
+    double wx[4], wy[4];
+    cubic_weights(pos.x() - col, wx);
+    cubic_weights(pos.y() - row, wy);
+    for (int b = 0; b < num_bands; b++)
+      out[b] = 0.0f;
+    for (int j = 0; j < 4; j++) {
+      for (int i = 0; i < 4; i++) {
+        float w = wx[i] * wy[j];
+        float const* src = buf + (size_t(row - 1 + j) * cols + (col - 1 + i)) * num_bands;
+        for (int b = 0; b < num_bands; b++)
+          out[b] += w * src[b];
+      }
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,166 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MultiBandTransform.h
+///
+/// Transform all bands of a multi-band image, such as an 8-band
+/// multispectral image, together. For each tile, the reverse
+/// transform, which for a mapprojected image means projecting into
+/// the camera, is found once per pixel, the input pixels needed are
+/// read for all bands at once, and the interpolation weights are found
+/// once and applied to every band. The bands are interleaved in memory,
+/// so the loop over bands is over consecutive values.
+
+#ifndef __ASP_CORE_MULTI_BAND_TRANSFORM_H__
+#define __ASP_CORE_MULTI_BAND_TRANSFORM_H__
+
+#include <asp/Core/FootprintMask.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace asp {
+
+  /// The weights of the four nearest samples in bicubic (Catmull-Rom)
+  /// interpolation at the given fraction past the second sample
+  void cubic_weights(double frac, double weights[4]);
+
+  /// Interpolate all bands at a position in a buffer whose bands are
+  /// interleaved, so the value of band b at pixel (col, row) is at
+  /// buf[(row * cols + col) * num_bands + b]. Invalid values must be
+  /// NaN. A band is NaN in the result if any sample it uses is NaN or
+  /// outside the buffer. Use the nearest pixel or bicubic interpolation.
+  void interp_bands(float const* buf, int cols, int rows, int num_bands,
+                    vw::Vector2 const& pos, bool nearest, float * out);
+
+  /// Transform each band of an image of floats with the given number
+  /// of planes. Invalid input pixels are those equal to the nodata
+  /// value or NaN, and invalid output pixels are set to it. Tiles not
+  /// intersecting the footprint, grown by the margin, are not computed,
+  /// as with FootprintMaskView. As with vw::TransformView, each tile
+  /// uses its own copy of the transform, after calling reverse_bbox().
+  template <class ImageT, class TransT>
+  class MultiBandTransformView:
+    public vw::ImageViewBase<MultiBandTransformView<ImageT, TransT>> {
+  public:
+    typedef float pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<MultiBandTransformView<ImageT, TransT>> pixel_accessor;
+
+    MultiBandTransformView(ImageT const& image, TransT const& trans, int cols, int rows,
+                           float nodata_val, bool nearest,
+                           std::vector<vw::Vector2> const& footprint, double margin):
+      m_image(image), m_trans(trans), m_cols(cols), m_rows(rows), m_nodata(nodata_val),
+      m_nearest(nearest), m_footprint(footprint), m_margin(margin) {}
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return m_image.planes(); }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 /*i*/, vw::int32 /*j*/, vw::int32 /*p*/ = 0) const {
+      vw_throw(vw::NoImplErr() << "MultiBandTransformView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      int num_bands = planes();
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height(), num_bands);
+      vw::fill(tile, m_nodata);
+      prerasterize_type result(tile, vw::BBox2i(-bbox.min().x(), -bbox.min().y(),
+                                                cols(), rows()));
+      vw::BBox2 grown = bbox;
+      grown.expand(m_margin);
+      if (!m_footprint.empty() && !convex_polygon_intersects_box(m_footprint, grown))
+        return result;
+
+      // The input pixels needed, with room for the bicubic samples
+      TransT trans = m_trans;
+      vw::BBox2i in_box = trans.reverse_bbox(bbox);
+      if (in_box.empty())
+        return result;
+      in_box.expand(3);
+      in_box.crop(vw::bounding_box(m_image));
+      if (in_box.empty())
+        return result;
+
+      // Read all bands at once and interleave them, with NaN for nodata
+      vw::ImageView<pixel_type> in = vw::crop(m_image, in_box);
+      int in_cols = in.cols(), in_rows = in.rows();
+      std::vector<float> buf(size_t(in_cols) * in_rows * num_bands);
+      for (int b = 0; b < num_bands; b++) {
+        for (int row = 0; row < in_rows; row++) {
+          for (int col = 0; col < in_cols; col++) {
+            float v = in(col, row, b);
+            if (v == m_nodata)
+              v = std::numeric_limits<float>::quiet_NaN();
+            buf[(size_t(row) * in_cols + col) * num_bands + b] = v;
+          }
+        }
+      }
+
+      vw::Vector2 offset(in_box.min());
+      std::vector<float> vals(num_bands);
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++) {
+          vw::Vector2 pos = trans.reverse(vw::Vector2(bbox.min().x() + col,
+                                                      bbox.min().y() + row));
+          if (std::isnan(pos.x()) || std::isnan(pos.y()))
+            continue;
+          interp_bands(&buf[0], in_cols, in_rows, num_bands, pos - offset, m_nearest,
+                       &vals[0]);
+          for (int b = 0; b < num_bands; b++) {
+            if (!std::isnan(vals[b]))
+              tile(col, row, b) = vals[b];
+          }
+        }
+      }
+
+      return result;
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+
+  private:
+    ImageT                   m_image;
+    TransT                   m_trans;
+    int                      m_cols, m_rows;
+    float                    m_nodata;
+    bool                     m_nearest;
+    std::vector<vw::Vector2> m_footprint;
+    double                   m_margin;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MULTI_BAND_TRANSFORM_H__
@@ -0,0 +1,164 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MultiRayIntersect.cc
+///
+
+#include <asp/Core/MultiRayIntersect.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+void RayBundles::reset(int num_rays, int num_bundles) {
+  m_num_rays    = num_rays;
+  m_num_bundles = num_bundles;
+  int len = num_rays * num_bundles;
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  m_cx.assign(len, nan); m_cy.assign(len, nan); m_cz.assign(len, nan);
+  m_dx.assign(len, 0.0); m_dy.assign(len, 0.0); m_dz.assign(len, 0.0);
+}
+
+void RayBundles::set_ray(int ray, int bundle, Vector3 const& ctr, Vector3 const& dir) {
+  double len = norm_2(dir);
+  if (!(len > 0) || ctr != ctr || dir != dir) // also catches NaN
+    return;
+  int k = ray * m_num_bundles + bundle;
+  m_cx[k] = ctr[0];     m_cy[k] = ctr[1];     m_cz[k] = ctr[2];
+  m_dx[k] = dir[0]/len; m_dy[k] = dir[1]/len; m_dz[k] = dir[2]/len;
+}
+
+void RayBundles::intersect(double angle_tol,
+                           std::vector<Vector3> & xyz,
+                           std::vector<Vector3> & err) const {
+
+  int nb = m_num_bundles;
+  xyz.assign(nb, Vector3());
+  err.assign(nb, Vector3());
+
+  for (int b = 0; b < nb; b++) {
+
+    // Accumulate the normal equations sum_r (I - d d^T) X = sum_r (I - d d^T) c.
+    // The matrix is symmetric, so only six entries are kept.
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    int num_valid = 0, first = -1;
+    for (int r = 0; r < m_num_rays; r++) {
+      int k = r * nb + b;
+      double cx = m_cx[k], cy = m_cy[k], cz = m_cz[k];
+      if (cx != cx)
+        continue;
+      double dx = m_dx[k], dy = m_dy[k], dz = m_dz[k];
+      double m00 = 1.0 - dx*dx, m01 = -dx*dy, m02 = -dx*dz;
+      double m11 = 1.0 - dy*dy, m12 = -dy*dz, m22 = 1.0 - dz*dz;
+      a00 += m00; a01 += m01; a02 += m02;
+      a11 += m11; a12 += m12; a22 += m22;
+      b0 += m00*cx + m01*cy + m02*cz;
+      b1 += m01*cx + m11*cy + m12*cz;
+      b2 += m02*cx + m12*cy + m22*cz;
+      if (first < 0)
+        first = k;
+      num_valid++;
+    }
+    if (num_valid < 2)
+      continue;
+
+    // The system is well-posed as soon as two of the rays are not
+    // parallel. With unit directions, 1 - cos of the angle between
+    // them is half the squared distance between the directions, which
+    // is accurate also for small angles.
+    bool good_angle = false;
+    for (int r = 0; r < m_num_rays && !good_angle; r++) {
+      int k = r * nb + b;
+      if (m_cx[k] != m_cx[k])
+        continue;
+      for (int q = r + 1; q < m_num_rays; q++) {
+        int l = q * nb + b;
+        if (m_cx[l] != m_cx[l])
+          continue;
+        double ex = m_dx[k] - m_dx[l], ey = m_dy[k] - m_dy[l], ez = m_dz[k] - m_dz[l];
+        if (0.5 * (ex*ex + ey*ey + ez*ez) >= angle_tol) {
+          good_angle = true;
+          break;
+        }
+      }
+    }
+    if (!good_angle)
+      continue;
+
+    // Solve with Cramer's rule
+    double c00 = a11*a22 - a12*a12, c01 = a02*a12 - a01*a22, c02 = a01*a12 - a02*a11;
+    double det = a00*c00 + a01*c01 + a02*c02;
+    if (!(std::abs(det) > 1e-14 * num_valid * num_valid * num_valid))
+      continue;
+    double c11 = a00*a22 - a02*a02, c12 = a01*a02 - a00*a12, c22 = a00*a11 - a01*a01;
+    Vector3 X((c00*b0 + c01*b1 + c02*b2) / det,
+              (c01*b0 + c11*b1 + c12*b2) / det,
+              (c02*b0 + c12*b1 + c22*b2) / det);
+
+    // Reflect a point that is behind one of the cameras
+    bool reflect = false;
+    for (int r = 0; r < m_num_rays; r++) {
+      int k = r * nb + b;
+      if (m_cx[k] != m_cx[k])
+        continue;
+      if ((X[0] - m_cx[k])*m_dx[k] + (X[1] - m_cy[k])*m_dy[k] + (X[2] - m_cz[k])*m_dz[k] < 0)
+        reflect = true;
+    }
+    if (reflect)
+      X = -X + 2.0 * Vector3(m_cx[first], m_cy[first], m_cz[first]);
+
+    // The offsets from the point to its projections onto the rays. For
+    // two rays these are opposite and their difference is the vector
+    // between the rays. With more rays only the norm of the error is
+    // meaningful, and it is put along the offset to the first ray.
+    double sum_dist = 0;
+    Vector3 first_offset, second_offset;
+    int count = 0;
+    for (int r = 0; r < m_num_rays; r++) {
+      int k = r * nb + b;
+      if (m_cx[k] != m_cx[k])
+        continue;
+      Vector3 d(m_dx[k], m_dy[k], m_dz[k]);
+      Vector3 v = Vector3(m_cx[k], m_cy[k], m_cz[k]) - X;
+      Vector3 offset = v - dot_prod(v, d) * d;
+      sum_dist += norm_2(offset);
+      if (count == 0)
+        first_offset = offset;
+      else if (count == 1)
+        second_offset = offset;
+      count++;
+    }
+
+    xyz[b] = X;
+    if (num_valid == 2) {
+      err[b] = first_offset - second_offset;
+    } else {
+      double len = norm_2(first_offset), mean_err = 2.0 * sum_dist / num_valid;
+      if (len > 0)
+        err[b] = (mean_err / len) * first_offset;
+      else
+        err[b] = Vector3(mean_err, 0, 0);
+    }
+  }
+}
+
+} // end namespace asp
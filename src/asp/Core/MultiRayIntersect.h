@@ -0,0 +1,75 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MultiRayIntersect.h
+///
+/// Intersect many bundles of rays at once, as for multiview
+/// triangulation of a row of pixels. The ray centers and directions
+/// are kept in separate arrays for each coordinate, and each bundle is
+/// intersected in closed form, as the point minimizing the sum of
+/// squared distances to its rays. That needs only accumulating a 3x3
+/// symmetric matrix and a right-hand side, and solving with Cramer's
+/// rule, so the inner loops have no allocations or branches on the
+/// number of rays.
+
+#ifndef __ASP_CORE_MULTI_RAY_INTERSECT_H__
+#define __ASP_CORE_MULTI_RAY_INTERSECT_H__
+
+#include <vw/Math/Vector.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// The rays of num_bundles bundles with num_rays rays each. Ray r of
+  /// bundle b is at index r * num_bundles + b. A ray with a NaN
+  /// center is invalid and is ignored.
+  class RayBundles {
+  public:
+    RayBundles(): m_num_rays(0), m_num_bundles(0) {}
+
+    /// All rays start invalid
+    void reset(int num_rays, int num_bundles);
+
+    int num_rays()    const { return m_num_rays;    }
+    int num_bundles() const { return m_num_bundles; }
+
+    /// The direction need not be normalized
+    void set_ray(int ray, int bundle, vw::Vector3 const& ctr, vw::Vector3 const& dir);
+
+    /// Find the point closest to the valid rays of each bundle. The
+    /// error is a vector whose norm is twice the mean distance from
+    /// the point to the rays, which for two rays is the distance
+    /// between them. Bundles with fewer than two valid rays, or with
+    /// all rays at less than the minimum angle from each other, get
+    /// the zero point and error. The angle tolerance is in the units
+    /// of vw::stereo::StereoModel::robust_1_minus_cos(). A point behind
+    /// any of the cameras is reflected through the first camera center,
+    /// as is done for two rays.
+    void intersect(double angle_tol,
+                   std::vector<vw::Vector3> & xyz,
+                   std::vector<vw::Vector3> & err) const;
+
+  private:
+    int m_num_rays, m_num_bundles;
+    std::vector<double> m_cx, m_cy, m_cz, m_dx, m_dy, m_dz;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MULTI_RAY_INTERSECT_H__
@@ -16,65 +16,195 @@
 // __END_LICENSE__
 
 #include <asp/Core/Nvm.h>
+#include <asp/Core/BinaryIO.h>
 #include <vw/Core/Exception.h>
 #include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/FileUtils.h>
 
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+
+namespace fs = boost::filesystem;
 
 namespace asp {
 
-// A wrapper to carry fewer things around
-void ReadNVM(std::string const& input_filename, nvmData & nvm) {
-  ReadNVM(input_filename,
-          &nvm.cid_to_keypoint_map,
-          &nvm.cid_to_filename,
-          &nvm.pid_to_cid_fid,
-          &nvm.pid_to_xyz,
-          &nvm.cid_to_cam_t_global);
-}
-  
-// Reads the NVM control network format. The interest points may or may not
-// be shifted relative to optical center. The user is responsible for knowing that.
-void ReadNVM(std::string const& input_filename,
-             std::vector<Eigen::Matrix2Xd> * cid_to_keypoint_map,
-             std::vector<std::string> * cid_to_filename,
-             std::vector<std::map<int, int>> * pid_to_cid_fid,
-             std::vector<Eigen::Vector3d> * pid_to_xyz,
-             std::vector<Eigen::Affine3d> * cid_to_cam_t_global) {
+// Binary nvm files start with this
+const char BNVM_MAGIC[] = "ASP_BNVM";
+const boost::uint64_t BNVM_VERSION = 1;
 
-  std::ifstream f(input_filename, std::ios::in);
-  std::string token;
-  std::getline(f, token);
+// Points per task when reading and writing text nvm files
+const size_t NVM_CHUNK_SIZE = 100000;
+
+// Read whitespace-separated values from a buffer in memory, which must
+// end with a null character, as strtod() needs.
+struct NvmTokenizer {
+  const char * m_pos;
+  const char * m_end;
+
+  NvmTokenizer(const char * beg, const char * end): m_pos(beg), m_end(end) {}
+
+  void skip_space() {
+    while (m_pos < m_end && std::isspace((unsigned char)*m_pos))
+      m_pos++;
+  }
+  bool next_token(std::string & token) {
+    skip_space();
+    const char * beg = m_pos;
+    while (m_pos < m_end && !std::isspace((unsigned char)*m_pos))
+      m_pos++;
+    token.assign(beg, m_pos);
+    return m_pos > beg;
+  }
+  bool next_double(double & val) {
+    skip_space();
+    char * after = NULL;
+    val = std::strtod(m_pos, &after);
+    if (after == m_pos || after > m_end)
+      return false;
+    m_pos = after;
+    return true;
+  }
+  bool next_int(ptrdiff_t & val) {
+    skip_space();
+    char * after = NULL;
+    val = std::strtoll(m_pos, &after, 10);
+    if (after == m_pos || after > m_end)
+      return false;
+    m_pos = after;
+    return true;
+  }
+};
+
+// A measurement of a point in a camera
+struct NvmMeasure {
+  int cid, fid;
+  double x, y;
+};
+
+// Parse the text lines of a range of points. Errors are saved, to be
+// raised in the main thread.
+class NvmParseTask: public vw::Task, private boost::noncopyable {
+  std::string const& m_text;
+  std::vector<std::pair<size_t, size_t>> const& m_lines;
+  size_t m_beg, m_end;
+  std::vector<std::map<int, int>> & m_pid_to_cid_fid;
+  std::vector<Eigen::Vector3d>    & m_pid_to_xyz;
+  std::vector<NvmMeasure>         & m_measures;
+  std::mutex  & m_mutex;
+  std::string & m_error;
+public:
+  NvmParseTask(std::string const& text,
+               std::vector<std::pair<size_t, size_t>> const& lines,
+               size_t beg, size_t end,
+               std::vector<std::map<int, int>> & pid_to_cid_fid,
+               std::vector<Eigen::Vector3d> & pid_to_xyz,
+               std::vector<NvmMeasure> & measures,
+               std::mutex & mutex, std::string & error):
+    m_text(text), m_lines(lines), m_beg(beg), m_end(end),
+    m_pid_to_cid_fid(pid_to_cid_fid), m_pid_to_xyz(pid_to_xyz),
+    m_measures(measures), m_mutex(mutex), m_error(error) {}
+
+  void operator()() {
+    for (size_t pid = m_beg; pid < m_end; pid++) {
+      NvmTokenizer tok(m_text.c_str() + m_lines[pid].first,
+                       m_text.c_str() + m_lines[pid].second);
+      Eigen::Vector3d xyz;
+      ptrdiff_t color, number_of_measures = 0;
+      bool good = tok.next_double(xyz[0]) && tok.next_double(xyz[1]) &&
+        tok.next_double(xyz[2]) && tok.next_int(color) && tok.next_int(color) &&
+        tok.next_int(color) && tok.next_int(number_of_measures);
+      m_pid_to_xyz[pid] = xyz;
+      m_pid_to_cid_fid[pid].clear();
+      for (ptrdiff_t m = 0; m < number_of_measures && good; m++) {
+        ptrdiff_t cid, fid;
+        NvmMeasure meas;
+        good = tok.next_int(cid) && tok.next_int(fid) &&
+          tok.next_double(meas.x) && tok.next_double(meas.y) && cid >= 0 && fid >= 0;
+        meas.cid = cid;
+        meas.fid = fid;
+        m_pid_to_cid_fid[pid][cid] = fid;
+        m_measures.push_back(meas);
+      }
+
+      if (!good) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_error == "")
+          m_error = "Unable to correctly read PID: " + std::to_string(pid);
+        return;
+      }
+    }
+  }
+};
+
+// Reads the text NVM control network format. The lines of the points
+// are parsed in parallel.
+void ReadTextNVM(std::string const& input_filename,
+                 std::vector<Eigen::Matrix2Xd> * cid_to_keypoint_map,
+                 std::vector<std::string> * cid_to_filename,
+                 std::vector<double> * focal_lengths,
+                 std::vector<std::map<int, int>> * pid_to_cid_fid,
+                 std::vector<Eigen::Vector3d> * pid_to_xyz,
+                 std::vector<Eigen::Affine3d> * cid_to_cam_t_global) {
+
+  // Read the whole file in memory
+  std::string text;
+  {
+    std::ifstream f(input_filename, std::ios::in | std::ios::binary);
+    if (!f.good())
+      vw::vw_throw(vw::ArgumentErr() << "Cannot read: " << input_filename << "\n");
+    f.seekg(0, std::ios::end);
+    text.resize(f.tellg());
+    f.seekg(0, std::ios::beg);
+    if (!text.empty())
+      f.read(&text[0], text.size());
+  }
+  const char * beg = text.c_str();
+  const char * end = beg + text.size();
+  NvmTokenizer tok(beg, end);
   
   // Assert that we start with our NVM token
-  if (token.compare(0, 6, "NVM_V3") != 0) {
+  std::string token;
+  if (!tok.next_token(token) || token.compare(0, 6, "NVM_V3") != 0) {
     vw::vw_throw(vw::ArgumentErr() << "File doesn't start with NVM token.");
   }
+  // Skip the rest of the first line
+  while (tok.m_pos < end && *tok.m_pos != '\n')
+    tok.m_pos++;
 
   // Read the number of cameras
-  ptrdiff_t number_of_cid;
-  f >> number_of_cid;
-  if (number_of_cid < 1) {
+  ptrdiff_t number_of_cid = 0;
+  if (!tok.next_int(number_of_cid) || number_of_cid < 1) {
     vw::vw_throw(vw::ArgumentErr() << "NVM file is missing cameras.");
   }
 
   // Resize all our structures to support the number of cameras we now expect
   cid_to_keypoint_map->resize(number_of_cid);
   cid_to_filename->resize(number_of_cid);
+  focal_lengths->resize(number_of_cid);
   cid_to_cam_t_global->resize(number_of_cid);
   for (ptrdiff_t cid = 0; cid < number_of_cid; cid++) {
-    // Clear keypoints from map. We'll read these in shortly
-    cid_to_keypoint_map->at(cid).resize(Eigen::NoChange_t(), 2);
 
     // Read the line that contains camera information
-    double focal, dist1, dist2;
+    double dist1, dist2;
     Eigen::Quaterniond q;
     Eigen::Vector3d c;
-    f >> token >> focal;
-    f >> q.w() >> q.x() >> q.y() >> q.z();
-    f >> c[0] >> c[1] >> c[2] >> dist1 >> dist2;
+    bool good = tok.next_token(token) && tok.next_double(focal_lengths->at(cid)) &&
+      tok.next_double(q.w()) && tok.next_double(q.x()) &&
+      tok.next_double(q.y()) && tok.next_double(q.z()) &&
+      tok.next_double(c[0]) && tok.next_double(c[1]) && tok.next_double(c[2]) &&
+      tok.next_double(dist1) && tok.next_double(dist2);
+    if (!good)
+      vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read CID: " << cid);
     cid_to_filename->at(cid) = token;
 
     // Solve for t, which is part of the affine transform
@@ -84,67 +214,240 @@ void ReadNVM(std::string const& input_filename,
   }
 
   // Read the number of points
-  ptrdiff_t number_of_pid;
-  f >> number_of_pid;
+  ptrdiff_t number_of_pid = 0;
+  tok.next_int(number_of_pid);
   if (number_of_pid < 1)
     vw::vw_throw(vw::ArgumentErr() << "The NVM file has no triangulated points.");
 
-  // Read the point
+  // Find the line of each point, skipping empty lines
+  std::vector<std::pair<size_t, size_t>> lines(number_of_pid);
+  const char * pos = tok.m_pos;
+  for (ptrdiff_t pid = 0; pid < number_of_pid; pid++) {
+    while (pos < end && std::isspace((unsigned char)*pos))
+      pos++;
+    if (pos >= end)
+      vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+    const char * line_end = (const char*)memchr(pos, '\n', end - pos);
+    if (line_end == NULL)
+      line_end = end;
+    lines[pid] = std::make_pair(size_t(pos - beg), size_t(line_end - beg));
+    pos = line_end;
+  }
+
+  // Parse the points in parallel
   pid_to_cid_fid->resize(number_of_pid);
   pid_to_xyz->resize(number_of_pid);
-  Eigen::Vector3d xyz;
-  Eigen::Vector3i color;
-  Eigen::Vector2d pt;
-  ptrdiff_t cid, fid;
-  for (ptrdiff_t pid = 0; pid < number_of_pid; pid++) {
-    pid_to_cid_fid->at(pid).clear();
+  size_t num_chunks = (number_of_pid + NVM_CHUNK_SIZE - 1) / NVM_CHUNK_SIZE;
+  std::vector<std::vector<NvmMeasure>> measures(num_chunks);
+  std::mutex mutex;
+  std::string error;
+  {
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      size_t chunk_beg = chunk * NVM_CHUNK_SIZE;
+      size_t chunk_end = std::min(chunk_beg + NVM_CHUNK_SIZE, size_t(number_of_pid));
+      queue.add_task(boost::shared_ptr<NvmParseTask>
+                     (new NvmParseTask(text, lines, chunk_beg, chunk_end,
+                                       *pid_to_cid_fid, *pid_to_xyz, measures[chunk],
+                                       mutex, error)));
+    }
+    queue.join_all();
+  }
+  if (error != "")
+    vw::vw_throw(vw::ArgumentErr() << error);
 
-    ptrdiff_t number_of_measures;
-    f >> xyz[0] >> xyz[1] >> xyz[2] >>
-      color[0] >> color[1] >> color[2] >> number_of_measures;
-    pid_to_xyz->at(pid) = xyz;
-    for (ptrdiff_t m = 0; m < number_of_measures; m++) {
-      f >> cid >> fid >> pt[0] >> pt[1];
+  // Put the keypoints in their cameras, sizing each camera once
+  std::vector<ptrdiff_t> num_keypoints(number_of_cid, 0);
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    for (size_t it = 0; it < measures[chunk].size(); it++) {
+      NvmMeasure const& meas = measures[chunk][it];
+      if (meas.cid >= number_of_cid)
+        vw::vw_throw(vw::ArgumentErr() << "Out of range CID: " << meas.cid);
+      num_keypoints[meas.cid] = std::max(num_keypoints[meas.cid], ptrdiff_t(meas.fid) + 1);
+    }
+  }
+  for (ptrdiff_t cid = 0; cid < number_of_cid; cid++)
+    cid_to_keypoint_map->at(cid) = Eigen::Matrix2Xd::Zero(2, num_keypoints[cid]);
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    for (size_t it = 0; it < measures[chunk].size(); it++) {
+      NvmMeasure const& meas = measures[chunk][it];
+      cid_to_keypoint_map->at(meas.cid).col(meas.fid) = Eigen::Vector2d(meas.x, meas.y);
+    }
+  }
+}
 
-      pid_to_cid_fid->at(pid)[cid] = fid;
+// Reads the binary nvm format. The arrays are read in bulk.
+void ReadBinaryNVM(std::string const& input_filename,
+                   std::vector<Eigen::Matrix2Xd> * cid_to_keypoint_map,
+                   std::vector<std::string> * cid_to_filename,
+                   std::vector<double> * focal_lengths,
+                   std::vector<std::map<int, int>> * pid_to_cid_fid,
+                   std::vector<Eigen::Vector3d> * pid_to_xyz,
+                   std::vector<Eigen::Affine3d> * cid_to_cam_t_global) {
 
-      if (cid_to_keypoint_map->at(cid).cols() <= fid) {
-        cid_to_keypoint_map->at(cid).conservativeResize(Eigen::NoChange_t(), fid + 1);
-      }
-      cid_to_keypoint_map->at(cid).col(fid) = pt;
-    }
+  std::ifstream f(input_filename, std::ios::in | std::ios::binary);
+  std::string magic(sizeof(BNVM_MAGIC) - 1, ' ');
+  f.read(&magic[0], magic.size());
+  boost::uint64_t version = 0;
+  read_binary(f, version);
+  if (!f.good() || magic != BNVM_MAGIC || version != BNVM_VERSION)
+    vw::vw_throw(vw::ArgumentErr() << "Not a binary nvm file: " << input_filename << "\n");
 
-    if (!f.good())
-      vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+  // The cameras
+  size_t number_of_cid = read_size(f);
+  cid_to_keypoint_map->resize(number_of_cid);
+  cid_to_filename->resize(number_of_cid);
+  focal_lengths->resize(number_of_cid);
+  cid_to_cam_t_global->resize(number_of_cid);
+  for (size_t cid = 0; cid < number_of_cid && f.good(); cid++) {
+    Eigen::Quaterniond q;
+    Eigen::Vector3d c;
+    read_binary(f, cid_to_filename->at(cid));
+    read_binary(f, focal_lengths->at(cid));
+    read_binary(f, q.w()); read_binary(f, q.x()); read_binary(f, q.y()); read_binary(f, q.z());
+    read_binary(f, c[0]);  read_binary(f, c[1]);  read_binary(f, c[2]);
+    Eigen::Matrix3d r = q.matrix();
+    cid_to_cam_t_global->at(cid).linear() = r;
+    cid_to_cam_t_global->at(cid).translation() = -r * c;
+  }
+
+  // The keypoints of each camera are contiguous, starting at the given offsets
+  std::vector<boost::uint64_t> kp_offsets(number_of_cid + 1, 0);
+  if (f.good())
+    f.read(reinterpret_cast<char*>(kp_offsets.data()),
+           kp_offsets.size() * sizeof(boost::uint64_t));
+  for (size_t cid = 0; cid < number_of_cid && f.good(); cid++) {
+    if (kp_offsets[cid + 1] < kp_offsets[cid])
+      vw::vw_throw(vw::ArgumentErr() << "Invalid binary nvm file: " << input_filename << "\n");
+    size_t num = kp_offsets[cid + 1] - kp_offsets[cid];
+    cid_to_keypoint_map->at(cid).resize(2, num);
+    f.read(reinterpret_cast<char*>(cid_to_keypoint_map->at(cid).data()),
+           2 * num * sizeof(double));
+  }
+
+  // The points, and the measurements of each point, starting at the given offsets
+  size_t number_of_pid = read_size(f);
+  pid_to_xyz->resize(number_of_pid);
+  for (size_t pid = 0; pid < number_of_pid && f.good(); pid++)
+    f.read(reinterpret_cast<char*>(pid_to_xyz->at(pid).data()), 3 * sizeof(double));
+  std::vector<boost::uint64_t> meas_offsets(number_of_pid + 1, 0);
+  if (f.good())
+    f.read(reinterpret_cast<char*>(meas_offsets.data()),
+           meas_offsets.size() * sizeof(boost::uint64_t));
+  std::vector<boost::int32_t> cid_fid;
+  if (f.good() && meas_offsets.back() <= (1ULL << 40)) {
+    cid_fid.resize(2 * meas_offsets.back());
+    f.read(reinterpret_cast<char*>(cid_fid.data()), cid_fid.size() * sizeof(boost::int32_t));
+  }
+
+  if (!f.good())
+    vw::vw_throw(vw::ArgumentErr() << "Truncated binary nvm file: " << input_filename << "\n");
+
+  pid_to_cid_fid->resize(number_of_pid);
+  for (size_t pid = 0; pid < number_of_pid; pid++) {
+    pid_to_cid_fid->at(pid).clear();
+    if (meas_offsets[pid + 1] < meas_offsets[pid] || meas_offsets[pid + 1] > meas_offsets.back())
+      vw::vw_throw(vw::ArgumentErr() << "Invalid binary nvm file: " << input_filename << "\n");
+    for (size_t m = meas_offsets[pid]; m < meas_offsets[pid + 1]; m++) {
+      int cid = cid_fid[2 * m], fid = cid_fid[2 * m + 1];
+      if (cid < 0 || size_t(cid) >= number_of_cid || fid < 0 ||
+          fid >= cid_to_keypoint_map->at(cid).cols())
+        vw::vw_throw(vw::ArgumentErr() << "Unable to correctly read PID: " << pid);
+      pid_to_cid_fid->at(pid)[cid] = fid;
+    }
   }
 }
 
-// Write an nvm file. Note that a single focal length is assumed and no distortion.
-// Those are ignored, and only camera poses, matches, and keypoints are used.
-void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
-              std::vector<std::string> const& cid_to_filename,
-              std::vector<double> const& focal_lengths,
-              std::vector<std::map<int, int>> const& pid_to_cid_fid,
-              std::vector<Eigen::Vector3d> const& pid_to_xyz,
-              std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
-              std::string const& output_filename) {
+// Check if a file is in the binary nvm format
+bool is_binary_nvm(std::string const& filename) {
+  std::ifstream f(filename, std::ios::in | std::ios::binary);
+  std::string magic(sizeof(BNVM_MAGIC) - 1, ' ');
+  f.read(&magic[0], magic.size());
+  return f.good() && magic == BNVM_MAGIC;
+}
 
-  // Ensure that the output directory having this file exists
-  vw::create_out_dir(output_filename);
+void ReadNVM(std::string const& input_filename, nvmData & nvm,
+             std::vector<double> & focal_lengths) {
+  if (is_binary_nvm(input_filename))
+    ReadBinaryNVM(input_filename, &nvm.cid_to_keypoint_map, &nvm.cid_to_filename,
+                  &focal_lengths, &nvm.pid_to_cid_fid, &nvm.pid_to_xyz,
+                  &nvm.cid_to_cam_t_global);
+  else
+    ReadTextNVM(input_filename, &nvm.cid_to_keypoint_map, &nvm.cid_to_filename,
+                &focal_lengths, &nvm.pid_to_cid_fid, &nvm.pid_to_xyz,
+                &nvm.cid_to_cam_t_global);
+}
 
-  vw::vw_out() << "Writing: " << output_filename << std::endl;
+// A wrapper to carry fewer things around
+void ReadNVM(std::string const& input_filename, nvmData & nvm) {
+  std::vector<double> focal_lengths;
+  ReadNVM(input_filename, nvm, focal_lengths);
+}
   
+// Reads the NVM control network format, as text or binary. The
+// interest points may or may not be shifted relative to optical
+// center. The user is responsible for knowing that.
+void ReadNVM(std::string const& input_filename,
+             std::vector<Eigen::Matrix2Xd> * cid_to_keypoint_map,
+             std::vector<std::string> * cid_to_filename,
+             std::vector<std::map<int, int>> * pid_to_cid_fid,
+             std::vector<Eigen::Vector3d> * pid_to_xyz,
+             std::vector<Eigen::Affine3d> * cid_to_cam_t_global) {
+  std::vector<double> focal_lengths;
+  if (is_binary_nvm(input_filename))
+    ReadBinaryNVM(input_filename, cid_to_keypoint_map, cid_to_filename, &focal_lengths,
+                  pid_to_cid_fid, pid_to_xyz, cid_to_cam_t_global);
+  else
+    ReadTextNVM(input_filename, cid_to_keypoint_map, cid_to_filename, &focal_lengths,
+                pid_to_cid_fid, pid_to_xyz, cid_to_cam_t_global);
+}
+
+// Format the lines of a range of points in a buffer
+class NvmFormatTask: public vw::Task, private boost::noncopyable {
+  std::vector<Eigen::Matrix2Xd>   const& m_cid_to_keypoint_map;
+  std::vector<std::map<int, int>> const& m_pid_to_cid_fid;
+  std::vector<Eigen::Vector3d>    const& m_pid_to_xyz;
+  size_t m_beg, m_end;
+  std::string & m_buf;
+public:
+  NvmFormatTask(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
+                std::vector<std::map<int, int>> const& pid_to_cid_fid,
+                std::vector<Eigen::Vector3d> const& pid_to_xyz,
+                size_t beg, size_t end, std::string & buf):
+    m_cid_to_keypoint_map(cid_to_keypoint_map), m_pid_to_cid_fid(pid_to_cid_fid),
+    m_pid_to_xyz(pid_to_xyz), m_beg(beg), m_end(end), m_buf(buf) {}
+
+  void operator()() {
+    // Use 17 digits, for double precision
+    char tmp[128];
+    for (size_t pid = m_beg; pid < m_end; pid++) {
+      snprintf(tmp, sizeof(tmp), "%.17g %.17g %.17g 0 0 0 %d", m_pid_to_xyz[pid][0],
+               m_pid_to_xyz[pid][1], m_pid_to_xyz[pid][2], int(m_pid_to_cid_fid[pid].size()));
+      m_buf += tmp;
+      for (auto it = m_pid_to_cid_fid[pid].begin(); it != m_pid_to_cid_fid[pid].end(); it++) {
+        Eigen::Vector2d pt = m_cid_to_keypoint_map[it->first].col(it->second);
+        snprintf(tmp, sizeof(tmp), " %d %d %.17g %.17g", it->first, it->second,
+                 pt[0], pt[1]);
+        m_buf += tmp;
+      }
+      m_buf += "\n";
+    }
+  }
+};
+
+// Write a text nvm file. The lines of the points are formatted in parallel.
+void WriteTextNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
+                  std::vector<std::string> const& cid_to_filename,
+                  std::vector<double> const& focal_lengths,
+                  std::vector<std::map<int, int>> const& pid_to_cid_fid,
+                  std::vector<Eigen::Vector3d> const& pid_to_xyz,
+                  std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
+                  std::string const& output_filename) {
+
   std::fstream f(output_filename, std::ios::out);
   f.precision(17); // double precision
   f << "NVM_V3\n";
 
-  if (cid_to_filename.size() != cid_to_keypoint_map.size())
-    vw::vw_throw(vw::ArgumentErr() << "Unequal number of filenames and keypoints.");
-  if (pid_to_cid_fid.size() != pid_to_xyz.size())
-    vw::vw_throw(vw::ArgumentErr() << "Unequal number of pid_to_cid_fid and xyz measurements.");
-  if (cid_to_filename.size() != cid_to_cam_t_global.size())
-    vw::vw_throw(vw::ArgumentErr() << "Unequal number of filename and camera transforms.");
-  
   // Write camera information
   f << cid_to_filename.size() << std::endl;
   for (size_t cid = 0; cid < cid_to_filename.size(); cid++) {
@@ -166,22 +469,24 @@ void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
   // Write the number of points
   f << pid_to_cid_fid.size() << std::endl;
 
-  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
-    f << pid_to_xyz[pid][0] << " " << pid_to_xyz[pid][1] << " "
-      << pid_to_xyz[pid][2] << " 0 0 0 "
-      << pid_to_cid_fid[pid].size();
-
-    if (pid_to_cid_fid[pid].size() <= 1)
-      vw::vw_throw(vw::ArgumentErr() << "PID " << pid << " has "
-                   << pid_to_cid_fid[pid].size() << " measurements.");
-    
-    for (std::map<int, int>::const_iterator it = pid_to_cid_fid[pid].begin();
-         it != pid_to_cid_fid[pid].end(); it++) {
-      f << " " << it->first << " " << it->second << " "
-        << cid_to_keypoint_map[it->first].col(it->second)[0] << " "
-        << cid_to_keypoint_map[it->first].col(it->second)[1];
+  // Format the points in chunks in parallel, and write them in order
+  size_t num_pid = pid_to_cid_fid.size();
+  size_t num_chunks = (num_pid + NVM_CHUNK_SIZE - 1) / NVM_CHUNK_SIZE;
+  std::vector<std::string> bufs(num_chunks);
+  {
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      size_t chunk_beg = chunk * NVM_CHUNK_SIZE;
+      size_t chunk_end = std::min(chunk_beg + NVM_CHUNK_SIZE, num_pid);
+      queue.add_task(boost::shared_ptr<NvmFormatTask>
+                     (new NvmFormatTask(cid_to_keypoint_map, pid_to_cid_fid, pid_to_xyz,
+                                        chunk_beg, chunk_end, bufs[chunk])));
     }
-    f << std::endl;
+    queue.join_all();
+  }
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    f.write(bufs[chunk].data(), bufs[chunk].size());
+    std::string().swap(bufs[chunk]); // release the memory
   }
 
   // Close the file
@@ -189,4 +494,119 @@ void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
   f.close();
 }
 
+// Write a binary nvm file. The keypoints of each camera, the points, and
+// the measurements are each in one array, which can be read in bulk or
+// memory-mapped. The keypoints and measurements start at the given
+// offsets for each camera and point.
+void WriteBinaryNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
+                    std::vector<std::string> const& cid_to_filename,
+                    std::vector<double> const& focal_lengths,
+                    std::vector<std::map<int, int>> const& pid_to_cid_fid,
+                    std::vector<Eigen::Vector3d> const& pid_to_xyz,
+                    std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
+                    std::string const& output_filename) {
+
+  std::ofstream f(output_filename, std::ios::out | std::ios::binary);
+  f.write(BNVM_MAGIC, sizeof(BNVM_MAGIC) - 1);
+  write_binary(f, BNVM_VERSION);
+
+  // The cameras
+  write_size(f, cid_to_filename.size());
+  for (size_t cid = 0; cid < cid_to_filename.size(); cid++) {
+    Eigen::Quaterniond q(cid_to_cam_t_global[cid].rotation());
+    Eigen::Vector3d t(cid_to_cam_t_global[cid].translation());
+    Eigen::Vector3d c = - cid_to_cam_t_global[cid].rotation().inverse() * t;
+    write_binary(f, cid_to_filename[cid]);
+    write_binary(f, focal_lengths[cid]);
+    write_binary(f, q.w()); write_binary(f, q.x()); write_binary(f, q.y()); write_binary(f, q.z());
+    write_binary(f, c[0]);  write_binary(f, c[1]);  write_binary(f, c[2]);
+  }
+
+  // The keypoints
+  std::vector<boost::uint64_t> kp_offsets(cid_to_keypoint_map.size() + 1, 0);
+  for (size_t cid = 0; cid < cid_to_keypoint_map.size(); cid++)
+    kp_offsets[cid + 1] = kp_offsets[cid] + cid_to_keypoint_map[cid].cols();
+  f.write(reinterpret_cast<const char*>(kp_offsets.data()),
+          kp_offsets.size() * sizeof(boost::uint64_t));
+  for (size_t cid = 0; cid < cid_to_keypoint_map.size(); cid++)
+    f.write(reinterpret_cast<const char*>(cid_to_keypoint_map[cid].data()),
+            2 * cid_to_keypoint_map[cid].cols() * sizeof(double));
+
+  // The points and their measurements
+  size_t num_pid = pid_to_xyz.size();
+  write_size(f, num_pid);
+  std::vector<double> xyz(3 * num_pid);
+  std::vector<boost::uint64_t> meas_offsets(num_pid + 1, 0);
+  for (size_t pid = 0; pid < num_pid; pid++) {
+    for (int c = 0; c < 3; c++)
+      xyz[3 * pid + c] = pid_to_xyz[pid][c];
+    meas_offsets[pid + 1] = meas_offsets[pid] + pid_to_cid_fid[pid].size();
+  }
+  f.write(reinterpret_cast<const char*>(xyz.data()), xyz.size() * sizeof(double));
+  std::vector<double>().swap(xyz);
+  f.write(reinterpret_cast<const char*>(meas_offsets.data()),
+          meas_offsets.size() * sizeof(boost::uint64_t));
+  std::vector<boost::int32_t> cid_fid;
+  cid_fid.reserve(2 * meas_offsets.back());
+  for (size_t pid = 0; pid < num_pid; pid++) {
+    for (auto it = pid_to_cid_fid[pid].begin(); it != pid_to_cid_fid[pid].end(); it++) {
+      cid_fid.push_back(it->first);
+      cid_fid.push_back(it->second);
+    }
+  }
+  f.write(reinterpret_cast<const char*>(cid_fid.data()),
+          cid_fid.size() * sizeof(boost::int32_t));
+
+  if (!f.good())
+    vw::vw_throw(vw::ArgumentErr() << "Failed to write: " << output_filename << "\n");
+  f.close();
+}
+
+// Write an nvm file. Note that a single focal length is assumed and no distortion.
+// Those are ignored, and only camera poses, matches, and keypoints are used.
+// A file with the .bnvm extension is written in binary.
+void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
+              std::vector<std::string> const& cid_to_filename,
+              std::vector<double> const& focal_lengths,
+              std::vector<std::map<int, int>> const& pid_to_cid_fid,
+              std::vector<Eigen::Vector3d> const& pid_to_xyz,
+              std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
+              std::string const& output_filename) {
+
+  // Ensure that the output directory having this file exists
+  vw::create_out_dir(output_filename);
+
+  vw::vw_out() << "Writing: " << output_filename << std::endl;
+  
+  if (cid_to_filename.size() != cid_to_keypoint_map.size())
+    vw::vw_throw(vw::ArgumentErr() << "Unequal number of filenames and keypoints.");
+  if (pid_to_cid_fid.size() != pid_to_xyz.size())
+    vw::vw_throw(vw::ArgumentErr() << "Unequal number of pid_to_cid_fid and xyz measurements.");
+  if (cid_to_filename.size() != cid_to_cam_t_global.size())
+    vw::vw_throw(vw::ArgumentErr() << "Unequal number of filename and camera transforms.");
+  for (size_t pid = 0; pid < pid_to_cid_fid.size(); pid++) {
+    if (pid_to_cid_fid[pid].size() <= 1)
+      vw::vw_throw(vw::ArgumentErr() << "PID " << pid << " has "
+                   << pid_to_cid_fid[pid].size() << " measurements.");
+  }
+
+  if (fs::path(output_filename).extension() == ".bnvm")
+    WriteBinaryNVM(cid_to_keypoint_map, cid_to_filename, focal_lengths, pid_to_cid_fid,
+                   pid_to_xyz, cid_to_cam_t_global, output_filename);
+  else
+    WriteTextNVM(cid_to_keypoint_map, cid_to_filename, focal_lengths, pid_to_cid_fid,
+                 pid_to_xyz, cid_to_cam_t_global, output_filename);
+}
+
+// Convert between the text and binary nvm formats, based on the
+// extension of the output file
+void ConvertNVM(std::string const& input_filename, std::string const& output_filename) {
+  nvmData nvm;
+  std::vector<double> focal_lengths;
+  ReadNVM(input_filename, nvm, focal_lengths);
+  WriteNVM(nvm.cid_to_keypoint_map, nvm.cid_to_filename, focal_lengths,
+           nvm.pid_to_cid_fid, nvm.pid_to_xyz, nvm.cid_to_cam_t_global,
+           output_filename);
+}
+
 } // end namespace asp
@@ -17,6 +17,12 @@
 
 
 /// \file Nvm.h
+///
+/// Read and write control networks in the NVM format, as text, or in a
+/// binary equivalent with the .bnvm extension. The binary format keeps
+/// the keypoints of each camera, the points, and the measurements of
+/// the points in arrays, with the offsets of each camera and point in
+/// them, so it is read in bulk.
 
 #ifndef __ASP_CORE_NVM_H__
 #define __ASP_CORE_NVM_H__
@@ -40,9 +46,14 @@ struct nvmData {
 
 // A wrapper to carry fewer things around
 void ReadNVM(std::string const& input_filename, nvmData & nvm);
+
+// Same as above, also returning the focal lengths
+void ReadNVM(std::string const& input_filename, nvmData & nvm,
+             std::vector<double> & focal_lengths);
   
-// Reads the NVM control network format. The interest points may or may not
-// be shifted relative to optical center. The user is responsible for knowing that.
+// Reads the NVM control network format, as text or binary. The interest
+// points may or may not be shifted relative to optical center. The user
+// is responsible for knowing that.
 void ReadNVM(std::string const& input_filename,
              std::vector<Eigen::Matrix2Xd> * cid_to_keypoint_map,
              std::vector<std::string> * cid_to_filename,
@@ -57,6 +68,10 @@ void WriteNVM(std::vector<Eigen::Matrix2Xd> const& cid_to_keypoint_map,
               std::vector<Eigen::Vector3d> const& pid_to_xyz,
               std::vector<Eigen::Affine3d> const& cid_to_cam_t_global,
               std::string const& output_filename);
+
+// Convert between the text and binary nvm formats, based on the
+// extension of the output file
+void ConvertNVM(std::string const& input_filename, std::string const& output_filename);
   
 } // end namespace asp
 
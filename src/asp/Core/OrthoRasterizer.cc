@@ -419,25 +419,12 @@ namespace asp{
     m_median_filter_params(median_filter_params), m_erode_len(erode_len),
     m_default_grid_size_multiplier(default_grid_size_multiplier),
     m_num_invalid_pixels(num_invalid_pixels),
-    m_count_mutex(count_mutex){
+    m_count_mutex(count_mutex), m_index_unit(1.0){
 
     *m_num_invalid_pixels = 0; // Init counter
     set_texture(texture.impl());
 
-    // Convert the filter from string to enum, to speed up checking against it later
-    m_percentile = -1; // ensure it is initialized
-    if (filter      == "weighted_average") m_filter = asp::f_weighted_average;
-    else if (filter == "min"             ) m_filter = asp::f_min;
-    else if (filter == "max"             ) m_filter = asp::f_max;
-    else if (filter == "mean"            ) m_filter = asp::f_mean;
-    else if (filter == "median"          ) m_filter = asp::f_median;
-    else if (filter == "stddev"          ) m_filter = asp::f_stddev;
-    else if (filter == "count"           ) m_filter = asp::f_count;
-    else if (filter == "nmad"            ) m_filter = asp::f_nmad;
-    else if (sscanf (filter.c_str(), "%lf-pct", &m_percentile) == 1)
-      m_filter = asp::f_percentile;
-    else
-    vw_throw( ArgumentErr() << "OrthoRasterize: unknown filter: " << filter << ".\n" );
+    set_filter(filter);
     
     //dump_image("img", BBox2(0, 0, 3000, 3000), point_image);
 
@@ -488,6 +475,21 @@ namespace asp{
     if ( m_bbox.empty() )
       vw_throw( ArgumentErr() << "OrthoRasterize: Input point cloud is empty!\n" );
 
+    // Index the boundaries. Let the index grid have about as many
+    // cells as there are boundaries, so each cell has few of them.
+    {
+      int num_cells = (int)ceil(sqrt(double(m_point_image_boundaries.size())));
+      num_cells = std::min(std::max(num_cells, 16), 4096);
+      m_index_origin = subvector(m_bbox.min(), 0, 2);
+      m_index_unit = std::max(m_bbox.width(), m_bbox.height()) / num_cells;
+      if (!(m_index_unit > 0))
+        m_index_unit = 1.0; // a degenerate cloud, all boxes then fall in one cell
+      std::vector<BBox2i> index_boxes(m_point_image_boundaries.size());
+      for (size_t it = 0; it < m_point_image_boundaries.size(); it++)
+        index_boxes[it] = index_bbox(m_point_image_boundaries[it].first);
+      m_boundaries_index = asp::BBoxIndex(index_boxes, 1);
+    }
+
     // Override with user's projwin, if specified
     if (m_projwin != BBox2()){
       subvector(m_bbox.min(), 0, 2) = m_projwin.min();
@@ -579,6 +581,23 @@ namespace asp{
   } // End OrthoRasterizerView Constructor
 
 
+  // Convert the filter from string to enum, to speed up checking against it later
+  void OrthoRasterizerView::set_filter(std::string const& filter) {
+    m_percentile = -1; // ensure it is initialized
+    if (filter      == "weighted_average") m_filter = asp::f_weighted_average;
+    else if (filter == "min"             ) m_filter = asp::f_min;
+    else if (filter == "max"             ) m_filter = asp::f_max;
+    else if (filter == "mean"            ) m_filter = asp::f_mean;
+    else if (filter == "median"          ) m_filter = asp::f_median;
+    else if (filter == "stddev"          ) m_filter = asp::f_stddev;
+    else if (filter == "count"           ) m_filter = asp::f_count;
+    else if (filter == "nmad"            ) m_filter = asp::f_nmad;
+    else if (sscanf (filter.c_str(), "%lf-pct", &m_percentile) == 1)
+      m_filter = asp::f_percentile;
+    else
+    vw_throw( ArgumentErr() << "OrthoRasterize: unknown filter: " << filter << ".\n" );
+  }
+
   // This is kind of like part 2 of the constructor
   // - This function finalizes the spacing and generates a spacing-snapped BBox.
   void OrthoRasterizerView::initialize_spacing(const double spacing) {
@@ -641,6 +660,159 @@ namespace asp{
     return outbox;
   }
 
+  BBox2i OrthoRasterizerView::index_bbox( BBox3 const& box ) const {
+    // A box which was never grown. A box with a single point is not empty here.
+    if (box.min().x() > box.max().x() || box.min().y() > box.max().y())
+      return BBox2i();
+
+    // Clamp before casting to int, for points far from the cloud
+    double big = 1.0e+8;
+    Vector2 beg = floor((subvector(box.min(), 0, 2) - m_index_origin) / m_index_unit);
+    Vector2 end = floor((subvector(box.max(), 0, 2) - m_index_origin) / m_index_unit);
+    for (int i = 0; i < 2; i++) {
+      beg[i] = std::max(-big, std::min(big, beg[i]));
+      end[i] = std::max(-big, std::min(big, end[i]));
+    }
+
+    // Grow by one unit so that boxes on the boundary of a unit are found
+    return BBox2i(Vector2i(int(beg[0]) - 1, int(beg[1]) - 1),
+                  Vector2i(int(end[0]) + 2, int(end[1]) + 2));
+  }
+
+  // Given a DEM grid point, search for cloud points within the
+  // circular region of radius equal to grid size. As such, a
+  // given cloud point may contribute to multiple DEM points, but
+  // with different weights (set by Gaussian). We make this radius
+  // no smaller than the default DEM spacing. Search radius can be
+  // over-ridden by user.
+  double OrthoRasterizerView::search_radius() const {
+    if (m_search_radius_factor <= 0.0)
+      return std::max(m_spacing, m_default_spacing);
+    return m_spacing*m_search_radius_factor;
+  }
+
+  std::vector<BBox2i> OrthoRasterizerView::point_blocks(BBox3 const& local_3d_bbox) const {
+
+    // For each block in the DEM space intersecting local_3d_bbox,
+    // find the corresponding blocks in the point cloud space.  We
+    // use here a map since we'd like to group together the point
+    // cloud blocks which fall within the same 256 x 256 tile, to do
+    // their union instead of them individually, for reasons of speed.
+    typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
+    typedef BlockMapType::iterator MapIterType;
+    BlockMapType blocks_map;
+    std::vector<int> boundary_ids;
+    m_boundaries_index.query(index_bbox(local_3d_bbox), boundary_ids);
+    for (size_t id_iter = 0; id_iter < boundary_ids.size(); id_iter++) {
+      BBoxPair const& boundary = m_point_image_boundaries[boundary_ids[id_iter]];
+      if (! local_3d_bbox.intersects(boundary.first) )
+        continue;
+
+      BBox2i pc_block = boundary.second;
+
+      BBox2i snapped_block;
+      snapped_block.min() = m_block_size*floor(pc_block.min()/double(m_block_size));
+      snapped_block.max() = m_block_size*ceil( pc_block.max()/double(m_block_size));
+      MapIterType it = blocks_map.find(snapped_block);
+      if (it != blocks_map.end() ){
+        (it->second).grow(pc_block);
+      }else{
+        blocks_map.insert(std::pair<BBox2, BBox2>(snapped_block, pc_block));
+      }
+
+    }
+
+    std::vector<BBox2i> blocks;
+    for (MapIterType it = blocks_map.begin(); it != blocks_map.end(); it++)
+      blocks.push_back(it->second);
+    return blocks;
+  }
+
+  void OrthoRasterizerView::read_point_block(BBox2i const& pc_block,
+                                             ImageView<Vector3> & point_copy,
+                                             ImageView<float> & texture_copy) const {
+
+    // When doing surface sampling, for each pixel we need to see its
+    // next up and right neighbors.
+    int d = (int)m_use_surface_sampling;
+    BBox2i block = pc_block;
+    block.max() += Vector2i(d, d);
+    block.crop(vw::bounding_box(m_point_image));
+
+    // Pull a copy of the input image in memory.  Expand the image
+    // to be able to see a bit beyond when filling holes.
+    BBox2i biased_block = block;
+    int bias = m_median_filter_params[0]/2 + m_erode_len;
+    biased_block.expand(bias);
+    biased_block.crop(vw::bounding_box(m_point_image));
+    point_copy = crop(m_point_image, biased_block);
+
+    remove_outliers(point_copy, m_error_image, m_error_cutoff, biased_block);
+    filter_by_median(point_copy, m_median_filter_params);
+    erode_image(point_copy, m_erode_len);
+
+    // Crop back to the area of interest
+    point_copy = crop(point_copy, block - biased_block.min());
+
+    texture_copy = crop(m_texture, block);
+  }
+
+  bool OrthoRasterizerView::can_accumulate() const {
+    return !m_use_surface_sampling &&
+      (m_filter == asp::f_weighted_average || m_filter == asp::f_mean);
+  }
+
+  OrthoRasterizerView::accumulation_type
+  OrthoRasterizerView::accumulate(BBox2i const& bbox) const {
+
+    VW_ASSERT(can_accumulate(),
+              ArgumentErr() << "Only the weighted average and mean of the heights "
+              << "can be accumulated.");
+
+    // Same as in prerasterize()
+    BBox2i bbox_1 = bbox;
+    bbox_1.expand((int)ceil(std::max(m_search_radius_factor, 5.0)));
+    BBox3 local_3d_bbox = pixel_to_point_bbox(bbox_1);
+
+    ImageView<double> d_buffer, weights;
+    asp::Point2Grid point2grid(bbox_1.width(),
+                               bbox_1.height(),
+                               d_buffer, weights,
+                               local_3d_bbox.min().x(),
+                               local_3d_bbox.min().y(),
+                               m_spacing, m_default_spacing,
+                               search_radius(), m_sigma_factor,
+                               m_filter, m_percentile);
+    point2grid.Clear(0.0);
+
+    std::vector<BBox2i> blocks = point_blocks(local_3d_bbox);
+    for (size_t block_it = 0; block_it < blocks.size(); block_it++) {
+      ImageView<Vector3> point_copy;
+      ImageView<float> texture_copy;
+      read_point_block(blocks[block_it], point_copy, texture_copy);
+      for (int32 row = 0; row < point_copy.rows(); row++) {
+        for (int32 col = 0; col < point_copy.cols(); col++) {
+          Vector3 const& pt = point_copy(col, row);
+          if (!boost::math::isnan(pt.z()) && local_3d_bbox.contains(pt))
+            point2grid.AddPoint(pt.x(), pt.y(), texture_copy(col, row));
+        }
+      }
+    }
+
+    // Do not divide by the weights, and flip as in prerasterize()
+    int num_rows = d_buffer.rows();
+    ImageView<Vector2> result(d_buffer.cols(), num_rows);
+    for (int r = 0; r < num_rows; r++) {
+      for (int c = 0; c < d_buffer.cols(); c++) {
+        double wt = weights(c, num_rows - 1 - r);
+        result(c, r) = Vector2(wt > 0 ? d_buffer(c, num_rows - 1 - r) : 0.0, wt);
+      }
+    }
+
+    return accumulation_type(result,
+                             BBox2i(-bbox_1.min().x(), -bbox_1.min().y(), cols(), rows()));
+  }
+
   /// \cond INTERNAL
   OrthoRasterizerView::prerasterize_type
   OrthoRasterizerView::prerasterize(BBox2i const& bbox) const {
@@ -665,24 +837,13 @@ namespace asp{
     renderer.Ortho2D(local_3d_bbox.min().x(), local_3d_bbox.max().x(),
                      local_3d_bbox.min().y(), local_3d_bbox.max().y());
 
-    // Given a DEM grid point, search for cloud points within the
-    // circular region of radius equal to grid size. As such, a
-    // given cloud point may contribute to multiple DEM points, but
-    // with different weights (set by Gaussian). We make this radius
-    // no smaller than the default DEM spacing. Search radius can be
-    // over-ridden by user.
-    double search_radius;
-    if (m_search_radius_factor <= 0.0)
-      search_radius = std::max(m_spacing, m_default_spacing);
-    else
-      search_radius = m_spacing*m_search_radius_factor;
     asp::Point2Grid point2grid(bbox_1.width(),
                                bbox_1.height(),
                                d_buffer, weights,
                                local_3d_bbox.min().x(),
                                local_3d_bbox.min().y(),
                                m_spacing, m_default_spacing,
-                               search_radius, m_sigma_factor,
+                               search_radius(), m_sigma_factor,
                                m_filter, m_percentile);
     
     // Set up the default color value
@@ -708,33 +869,8 @@ namespace asp{
       point2grid.Clear(min_val);
     }
 
-    // For each block in the DEM space intersecting local_3d_bbox,
-    // find the corresponding blocks in the point cloud space.  We
-    // use here a map since we'd like to group together the point
-    // cloud blocks which fall within the same 256 x 256 tile, to do
-    // their union instead of them individually, for reasons of speed.
-    typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
-    typedef BlockMapType::iterator MapIterType;
-    BlockMapType blocks_map;
-    BOOST_FOREACH( BBoxPair const& boundary, m_point_image_boundaries ) {
-      if (! local_3d_bbox.intersects(boundary.first) )
-        continue;
-
-      BBox2i pc_block = boundary.second;
-
-      BBox2i snapped_block;
-      snapped_block.min() = m_block_size*floor(pc_block.min()/double(m_block_size));
-      snapped_block.max() = m_block_size*ceil( pc_block.max()/double(m_block_size));
-      MapIterType it = blocks_map.find(snapped_block);
-      if (it != blocks_map.end() ){
-        (it->second).grow(pc_block);
-      }else{
-        blocks_map.insert(std::pair<BBox2, BBox2>(snapped_block, pc_block));
-      }
-
-    }
-
-    if ( blocks_map.empty() ){
+    std::vector<BBox2i> blocks = point_blocks(local_3d_bbox);
+    if ( blocks.empty() ){
       // TODO: Don't include these pixels in the total?
       { // Lock and update the total number of invalid pixels in this tile.
         vw::Mutex::Lock lock(*m_count_mutex);
@@ -756,29 +892,11 @@ namespace asp{
     // pixel we need to see its next up and right neighbors.
     int d = (int)m_use_surface_sampling;
 
-    for (MapIterType it = blocks_map.begin(); it != blocks_map.end(); it++){
-
-      BBox2i block = it->second;
-
-      block.max() += Vector2i(d, d);
-      block.crop(vw::bounding_box(m_point_image));
-
-      // Pull a copy of the input image in memory.  Expand the image
-      // to be able to see a bit beyond when filling holes.
-      BBox2i biased_block = block;
-      int bias = m_median_filter_params[0]/2 + m_erode_len;
-      biased_block.expand(bias);
-      biased_block.crop(vw::bounding_box(m_point_image));
-      ImageView<Vector3> point_copy = crop(m_point_image, biased_block);
-
-      remove_outliers(point_copy, m_error_image, m_error_cutoff, biased_block);
-      filter_by_median(point_copy, m_median_filter_params);
-      erode_image(point_copy, m_erode_len);
-
-      // Crop back to the area of interest
-      point_copy = crop(point_copy, block - biased_block.min());
+    for (size_t block_it = 0; block_it < blocks.size(); block_it++){
 
-      ImageView<float> texture_copy = crop(m_texture, block );
+      ImageView<Vector3> point_copy;
+      ImageView<float> texture_copy;
+      read_point_block(blocks[block_it], point_copy, texture_copy);
 
       typedef ImageView<Vector3>::pixel_accessor PointAcc;
       PointAcc row_acc = point_copy.origin();
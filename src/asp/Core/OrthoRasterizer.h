@@ -28,9 +28,11 @@
 #include <vw/Core/Thread.h>
 #include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewRef.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/BBox.h>
 #include <asp/Core/Point2Grid.h>
+#include <asp/Core/BBoxIndex.h>
 
 namespace asp{
 
@@ -72,17 +74,35 @@ namespace asp{
     std::int64_t * m_num_invalid_pixels; ///< Keep a count of nodata output pixels, needs to be pointer due to VW weirdness.
     vw::Mutex  *m_count_mutex;        ///< A lock for m_num_invalid_pixels, needs to be pointer due to C++ weirdness.
 
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     std::vector<BBoxPair> m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
     // their location in the the point cloud image. These boxes are
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // An index of the x-y extents of the boundaries above, to find
+    // quickly those intersecting a tile. The extents are converted to
+    // integer units of an index grid with given origin and unit length.
+    asp::BBoxIndex m_boundaries_index;
+    Vector2        m_index_origin;
+    double         m_index_unit;
+
     // Function to convert pixel coordinates to the point domain
     BBox3 pixel_to_point_bbox( BBox2 const& px ) const;
 
+    // The smallest box in index grid units containing the x-y extent of a box
+    BBox2i index_bbox( BBox3 const& box ) const;
+
+    // How far from a grid point to look for cloud points
+    double search_radius() const;
+
+    // The blocks of the point cloud with points in the given box
+    std::vector<BBox2i> point_blocks( BBox3 const& local_3d_bbox ) const;
+
+    // Read a block of the point cloud, with outliers removed, and its texture
+    void read_point_block( BBox2i const& pc_block, ImageView<Vector3> & point_copy,
+                           ImageView<float> & texture_copy ) const;
+
   public:
     typedef PixelGray<float> pixel_type;
     typedef const PixelGray<float> result_type;
@@ -118,13 +138,17 @@ namespace asp{
     /// initialized.  The texture image must have the same dimensions
     /// as the point image, and texture pixels must correspond exactly
     /// to point image pixels.
+    /// The texture is cached in blocks of the point cloud, converted
+    /// to float. The same blocks are read for neighboring output tiles,
+    /// so each is made only once.
     template <class TextureViewT>
     void set_texture(TextureViewT texture) {
       VW_ASSERT(texture.impl().cols() == m_point_image.cols() &&
                 texture.impl().rows() == m_point_image.rows(),
       ArgumentErr() << "Orthorasterizer: set_texture() failed."
                     << " Texture dimensions must match point image dimensions.");
-      m_texture = channel_cast<float>(channels_to_planes(texture.impl()));
+      m_texture = block_cache(channel_cast<float>(channels_to_planes(texture.impl())),
+                              Vector2i(m_block_size, m_block_size), 0);
     }
 
     inline int32 cols() const {return (int)round((fabs(m_snapped_bbox.max().x() - m_snapped_bbox.min().x()) / m_spacing)) + 1;}
@@ -148,9 +172,24 @@ namespace asp{
     }
     /// \endcond
 
+    /// If the grid values are sums divided by weights, so that the
+    /// sums and weights can be added up to a coarser grid
+    bool can_accumulate() const;
+
+    /// The sums of texture values and of weights at the grid points in
+    /// the box, before they are divided. The sum is zero where the
+    /// weight is zero. Needs can_accumulate().
+    typedef CropView<ImageView<Vector2> > accumulation_type;
+    accumulation_type accumulate( BBox2i const& bbox ) const;
+
     void set_use_alpha          (bool   val) { m_use_alpha       = val; }
     void set_use_minz_as_default(bool   val) { m_minz_as_default = val; }
     void set_default_value      (double val) { m_default_value   = val; }
+
+    /// The filter to apply to the heights near each grid point, as in
+    /// point2dem's --filter. A copy of the rasterizer can use another
+    /// filter without going through the point cloud again.
+    void set_filter(std::string const& filter);
     double default_value() {
       if (m_minz_as_default) return m_bbox.min().z();
       else return m_default_value;
@@ -193,6 +232,39 @@ namespace asp{
     
   };
 
+  /// The sums and weights of OrthoRasterizerView::accumulate() as an
+  /// image. It keeps a copy of the rasterizer, so its spacing does not
+  /// change if the original is later set to another spacing.
+  class OrthoAccumulationView: public ImageViewBase<OrthoAccumulationView> {
+    OrthoRasterizerView m_rasterizer;
+  public:
+    typedef Vector2 pixel_type;
+    typedef const Vector2 result_type;
+    typedef ProceduralPixelAccessor<OrthoAccumulationView> pixel_accessor;
+
+    OrthoAccumulationView(OrthoRasterizerView const& rasterizer): m_rasterizer(rasterizer) {}
+
+    inline int32 cols  () const { return m_rasterizer.cols(); }
+    inline int32 rows  () const { return m_rasterizer.rows(); }
+    inline int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+    inline result_type operator()( int /*i*/, int /*j*/, int /*p*/=0 ) const {
+      vw_throw(NoImplErr() << "OrthoAccumulationView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    typedef OrthoRasterizerView::accumulation_type prerasterize_type;
+    prerasterize_type prerasterize( BBox2i const& bbox ) const {
+      return m_rasterizer.accumulate(bbox);
+    }
+
+    template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
+      vw::rasterize( prerasterize(bbox), dest, bbox );
+    }
+  };
+
   /// Snaps the coordinates of a BBox to a grid spacing
   template <size_t N>
   void snap_bbox(const double spacing, BBox<double, N> &bbox ) {
@@ -20,6 +20,14 @@
 #include <vw/Image/Statistics.h>
 #include <vw/Math/Statistics.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
 
 using namespace vw;
 
@@ -56,36 +64,178 @@ void estimate_inliers_bbox(double pct_factor_x, double pct_factor_y, double pct_
   inliers_bbox.grow(Vector3(ex, ey, ez));
 }
 
-// Get a generous estimate of the bounding box of the current set
-// while excluding outliers
-void estimate_points_bdbox(vw::ImageViewRef<vw::Vector3> const& proj_points,
-                           vw::ImageViewRef<double> const& error_image,
-                           vw::Vector2 const& remove_outliers_params,
-                           double estim_max_error,
+// Estimate a bounding box without outliers from sketches of the point
+// coordinates. Same as above, but with quantiles from the sketches.
+void estimate_inliers_bbox(double pct_factor_x, double pct_factor_y, double pct_factor_z,
+                           double outlier_factor,
+                           QuantileSketch const& x_vals,
+                           QuantileSketch const& y_vals,
+                           QuantileSketch const& z_vals,
                            vw::BBox3 & inliers_bbox) {
-
-  // TODO(oalexan1): Here it may help to do several passes. First throw out the worst
-  // outliers, then estimate the box from the remaining points, etc.
   
-  std::vector<double> x_vals, y_vals, z_vals;
-  for (int col = 0; col < proj_points.cols(); col++){
-    for (int row = 0; row < proj_points.rows(); row++){
+  // Initialize the output
+  inliers_bbox = BBox3();
 
-      // Avoid points marked as not valid
-      Vector3 P = proj_points(col, row);
-      if (boost::math::isnan(P.z()))
-        continue;
+  double bx, ex, by, ey, bz, ez;
+  if (!asp::find_outlier_brackets(x_vals, pct_factor_x, outlier_factor, bx, ex))
+    return;
+  if (!asp::find_outlier_brackets(y_vals, pct_factor_y, outlier_factor, by, ey))
+    return;
+  if (!asp::find_outlier_brackets(z_vals, pct_factor_z, outlier_factor, bz, ez))
+    return;
+
+  // Need to compute the next double because the VW bounding box is
+  // exclusive at the top.
+  ex = boost::math::nextafter(ex, std::numeric_limits<double>::max());
+  ey = boost::math::nextafter(ey, std::numeric_limits<double>::max());
+  ez = boost::math::nextafter(ez, std::numeric_limits<double>::max());
+
+  inliers_bbox.grow(Vector3(bx, by, bz));
+  inliers_bbox.grow(Vector3(ex, ey, ez));
+}
+
+// Sketches of the triangulation errors and of the points. The points
+// are binned by the power of 2 of their error, so the points with
+// error above a threshold found later can be left out. Points with
+// zero error, most likely from invalid pixels, are in their own bin.
+struct ErrorAndPointSketches {
+
+  struct PointSketches {
+    QuantileSketch x, y, z;
+  };
+
+  QuantileSketch error;
+  std::map<int, PointSketches> points;
+
+  static int error_bin(double err) {
+    if (!(err > 0)) 
+      return std::numeric_limits<int>::min();
+    return std::ilogb(err);
+  }
+
+  void add(Vector3 const& P, double err) {
+    // Don't add zero errors, those most likely came from invalid points
+    if (err > 0)
+      error.add(err);
+    PointSketches & ps = points[error_bin(err)];
+    ps.x.add(P.x());
+    ps.y.add(P.y());
+    ps.z.add(P.z());
+  }
+
+  void merge(ErrorAndPointSketches const& other) {
+    error.merge(other.error);
+    for (auto it = other.points.begin(); it != other.points.end(); it++) {
+      PointSketches & ps = points[it->first];
+      ps.x.merge(it->second.x);
+      ps.y.merge(it->second.y);
+      ps.z.merge(it->second.z);
+    }
+  }
 
-      // Make use of the estimated error, if available
-      if (estim_max_error > 0 && error_image(col, row) > estim_max_error) 
+  // The sketches of the points with error no more than max_error, and
+  // some with error up to twice that, as the bins are powers of 2
+  void inlier_points(double max_error, QuantileSketch & x, QuantileSketch & y,
+                     QuantileSketch & z) const {
+    for (auto it = points.begin(); it != points.end(); it++) {
+      if (max_error > 0 && it->first != std::numeric_limits<int>::min() &&
+          std::ldexp(1.0, it->first) > max_error)
         continue;
+      x.merge(it->second.x);
+      y.merge(it->second.y);
+      z.merge(it->second.z);
+    }
+  }
+};
+
+// Add the samples in a block of the subsampled images to the sketches.
+// The sketches of the blocks are merged in the order of the blocks, as
+// they are done, so the result does not depend on the thread timing.
+class SketchBlockTask: public vw::Task, private boost::noncopyable {
+  vw::ImageViewRef<vw::Vector3> m_proj_points;
+  vw::ImageViewRef<double>      m_error_image;
+  BBox2i m_block;
+  int    m_block_index;
+  std::map<int, ErrorAndPointSketches> & m_pending;
+  int                    & m_next_block;
+  ErrorAndPointSketches  & m_sketches;
+  std::mutex             & m_mutex;
+  vw::TerminalProgressCallback & m_tpc;
+  double                   m_inc_amount;
+public:
+  SketchBlockTask(vw::ImageViewRef<vw::Vector3> const& proj_points,
+                  vw::ImageViewRef<double> const& error_image,
+                  BBox2i const& block, int block_index,
+                  std::map<int, ErrorAndPointSketches> & pending,
+                  int & next_block, ErrorAndPointSketches & sketches,
+                  std::mutex & mutex, vw::TerminalProgressCallback & tpc,
+                  double inc_amount):
+    m_proj_points(proj_points), m_error_image(error_image),
+    m_block(block), m_block_index(block_index), m_pending(pending),
+    m_next_block(next_block), m_sketches(sketches), m_mutex(mutex),
+    m_tpc(tpc), m_inc_amount(inc_amount) {}
 
-      x_vals.push_back(P.x());
-      y_vals.push_back(P.y());
-      z_vals.push_back(P.z());
+  void operator()() {
+    ImageView<Vector3> points = crop(m_proj_points, m_block);
+    ImageView<double>  errors = crop(m_error_image, m_block);
+
+    ErrorAndPointSketches sketches;
+    for (int row = 0; row < points.rows(); row++) {
+      for (int col = 0; col < points.cols(); col++) {
+        // Avoid points marked as not valid
+        Vector3 const& P = points(col, row);
+        if (boost::math::isnan(P.z()))
+          continue;
+        sketches.add(P, errors(col, row));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending[m_block_index] = sketches;
+    while (m_pending.find(m_next_block) != m_pending.end()) {
+      m_sketches.merge(m_pending[m_next_block]);
+      m_pending.erase(m_next_block);
+      m_next_block++;
     }
+    m_tpc.report_incremental_progress(m_inc_amount);
+  }
+};
+
+// Sketch the errors and points of the subsampled images, in blocks in parallel
+void sketch_errors_and_points(vw::ImageViewRef<vw::Vector3> const& proj_points,
+                              vw::ImageViewRef<double> const& error_image,
+                              ErrorAndPointSketches & sketches) {
+
+  std::vector<BBox2i> blocks = subdivide_bbox(error_image, 256, 256);
+  std::map<int, ErrorAndPointSketches> pending;
+  int next_block = 0;
+  std::mutex mutex;
+  vw::TerminalProgressCallback tpc("asp", "Bounding box and triangulation error range estimation: ");
+  double inc_amount = 1.0 / std::max(double(blocks.size()), 1.0);
+  tpc.report_progress(0);
+  {
+    vw::FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (size_t it = 0; it < blocks.size(); it++)
+      queue.add_task(boost::shared_ptr<SketchBlockTask>
+                     (new SketchBlockTask(proj_points, error_image, blocks[it], it,
+                                          pending, next_block, sketches, mutex,
+                                          tpc, inc_amount)));
+    queue.join_all();
   }
+  tpc.report_finished();
+}
 
+// Get a generous estimate of the bounding box of the given points
+// while excluding outliers
+void estimate_points_bdbox(QuantileSketch const& x_vals,
+                           QuantileSketch const& y_vals,
+                           QuantileSketch const& z_vals,
+                           vw::Vector2 const& remove_outliers_params,
+                           vw::BBox3 & inliers_bbox) {
+
+  // TODO(oalexan1): Here it may help to do several passes. First throw out the worst
+  // outliers, then estimate the box from the remaining points, etc.
+  
   double pct_factor     = remove_outliers_params[0]/100.0; // e.g., 0.75
   double outlier_factor = remove_outliers_params[1];       // e.g., 3.0.
 
@@ -108,56 +258,28 @@ void estimate_points_bdbox(vw::ImageViewRef<vw::Vector3> const& proj_points,
   return;
 }
 
-// A class to pick some samples to estimate the range of values
-// of a given dataset
-class ErrorRangeEstimAccum: public ReturnFixedType<void> {
-  typedef double accum_type;
-  std::vector<accum_type> m_vals;
-public:
-  typedef accum_type value_type;
-  
-  ErrorRangeEstimAccum() { m_vals.clear(); }
-  
-  void operator()( accum_type const& value ) {
-    // Don't add zero errors, those most likely came from invalid points
-    if (value > 0)
-      m_vals.push_back(value);
-  }
-  
-  int size(){
-    return m_vals.size();
-  }
-  
-  value_type value(Vector2 const& remove_outliers_params){
-    VW_ASSERT(!m_vals.empty(), ArgumentErr() << "ErrorRangeEstimAccum: no valid samples");
-    
-    // How to pick a representative value for maximum error?  The
-    // maximum error itself may be no good, as it could be very
-    // huge, and then sampling the range of errors will be distorted
-    // by that.  The solution adopted here: Find a percentile of the
-    // range of errors, mulitply it by the outlier factor, and
-    // multiply by another factor to ensure we don't underestimate
-    // the maximum. This value may end up being larger than the
-    // largest error, but at least it is is not grossly huge
-    // if just a few of the errors are very large.
-    std::sort(m_vals.begin(), m_vals.end());
-    int    len    = m_vals.size();
-    double pct    = remove_outliers_params[0]/100.0; // e.g., 0.75
-    double factor = remove_outliers_params[1];
-    int    k      = std::min(len - 1, (int)(pct*len));
-    
-    // Care here with empty sets
-      if (k >= 0) 
-        return m_vals[k]*factor*4.0;
-      
-      return 0;
-  }
-  
-};
+// How to pick a representative value for maximum error?  The
+// maximum error itself may be no good, as it could be very
+// huge, and then sampling the range of errors will be distorted
+// by that.  The solution adopted here: Find a percentile of the
+// range of errors, mulitply it by the outlier factor, and
+// multiply by another factor to ensure we don't underestimate
+// the maximum. This value may end up being larger than the
+// largest error, but at least it is is not grossly huge
+// if just a few of the errors are very large.
+double estim_max_error_from_sketch(QuantileSketch const& errors,
+                                   vw::Vector2 const& remove_outliers_params) {
+  VW_ASSERT(!errors.empty(), ArgumentErr() << "estim_max_error_from_sketch: no valid samples");
+  double pct    = remove_outliers_params[0]/100.0; // e.g., 0.75
+  double factor = remove_outliers_params[1];
+  return errors.quantile(pct)*factor*4.0;
+}
   
 // Sample the image and get generous estimates (but without outliers)
 // of the maximum triangulation error and of the 3D box containing the
-// projected points. These will be tightened later.
+// projected points. These will be tightened later. The errors and
+// points are read in one pass, in blocks in parallel, into sketches of
+// bounded size, so many samples can be used.
 double estim_max_tri_error_and_proj_box(vw::ImageViewRef<vw::Vector3> const& proj_points,
                                         vw::ImageViewRef<double> const& error_image,
                                         vw::Vector2 const& remove_outliers_params,
@@ -167,9 +289,10 @@ double estim_max_tri_error_and_proj_box(vw::ImageViewRef<vw::Vector3> const& pro
   double estim_max_error = 0.0;
   estim_proj_box = BBox3();
 
-  // Start with a 256 (2^8) by 256 sampling of the cloud
+  // Start with a 2048 (2^11) by 2048 sampling of the cloud. The memory
+  // use does not depend on the number of samples.
   bool success = false;
-  for (int attempt = 8; attempt <= 18; attempt++){
+  for (int attempt = 11; attempt <= 18; attempt++){
     
     double sample = (1 << attempt);
     int32 subsample_amt = int32(norm_2(Vector2(error_image.cols(), error_image.rows()))/sample);
@@ -178,21 +301,21 @@ double estim_max_tri_error_and_proj_box(vw::ImageViewRef<vw::Vector3> const& pro
     
     Stopwatch sw2;
     sw2.start();
-    PixelAccumulator<asp::ErrorRangeEstimAccum> error_accum;
-    for_each_pixel(subsample(error_image, subsample_amt),
-                   error_accum,
-                   TerminalProgressCallback
-                   ("asp","Bounding box and triangulation error range estimation: ") );
-    if (error_accum.size() > 0){
+    ErrorAndPointSketches sketches;
+    sketch_errors_and_points(subsample(proj_points, subsample_amt),
+                             subsample(error_image, subsample_amt),
+                             sketches);
+    if (!sketches.error.empty()) {
       success = true;
-      estim_max_error = error_accum.value(remove_outliers_params);
+      estim_max_error = asp::estim_max_error_from_sketch(sketches.error, remove_outliers_params);
     }
-    sw2.stop();
 
-    asp::estimate_points_bdbox(subsample(proj_points, subsample_amt),
-                               subsample(error_image, subsample_amt),
-                               remove_outliers_params,  estim_max_error,
+    // Make use of the estimated error, if available
+    QuantileSketch x_vals, y_vals, z_vals;
+    sketches.inlier_points(estim_max_error, x_vals, y_vals, z_vals);
+    asp::estimate_points_bdbox(x_vals, y_vals, z_vals, remove_outliers_params,
                                estim_proj_box);
+    sw2.stop();
     
     if (estim_proj_box.empty()) 
       success = false;
@@ -21,6 +21,7 @@
 // Utilities for handling outliers
 
 #include <vw/Image/ImageViewRef.h>
+#include <asp/Core/QuantileSketch.h>
 
 #include <vector>
 
@@ -35,10 +36,19 @@ void estimate_inliers_bbox(double pct_factor_x, double pct_factor_y, double pct_
                           std::vector<double> const& y_vals,
                           std::vector<double> const& z_vals,
                           vw::BBox3 & inliers_bbox);
+
+// Same as above, with the values in streaming sketches
+void estimate_inliers_bbox(double pct_factor_x, double pct_factor_y, double pct_factor_z,
+                          double outlier_factor,
+                          QuantileSketch const& x_vals,
+                          QuantileSketch const& y_vals,
+                          QuantileSketch const& z_vals,
+                          vw::BBox3 & inliers_bbox);
   
 // Sample the image and get generous estimates (but without outliers)
 // of the maximum triangulation error and of the 3D box containing the
-// projected points. These will be tightened later.
+// projected points. These will be tightened later. The samples are
+// read in parallel, in one pass, into sketches of bounded size.
 double estim_max_tri_error_and_proj_box(vw::ImageViewRef<vw::Vector3> const& proj_points,
                                         vw::ImageViewRef<double> const& error_image,
                                         vw::Vector2 const& remove_outliers_params,
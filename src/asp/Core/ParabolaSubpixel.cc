@@ -0,0 +1,195 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/ParabolaSubpixel.h>
+
+#include <algorithm>
+
+namespace asp {
+
+  // The costs are at the disparity offsets (ox, oy) in [-1, 1] x [-1, 1],
+  // indexed by 3 * (oy + 1) + (ox + 1).
+  const int NUM_OFFSETS = 9;
+
+  // Fit a quadratic surface by least squares to the costs and find
+  // its minimum. Along a direction that is not refined the offset is
+  // zero. Return false if there is no minimum within a pixel.
+  bool fit_cost_minimum(double const* C, bool do_h, bool do_v, vw::Vector2f & offset) {
+
+    // The coefficients of a x^2 + b y^2 + c xy + d x + e y + f. The
+    // basis is orthogonal on the 3 x 3 grid, which gives these sums.
+    double a = ((C[0] + C[3] + C[6]) + (C[2] + C[5] + C[8])
+                - 2.0 * (C[1] + C[4] + C[7])) / 6.0;
+    double b = ((C[0] + C[1] + C[2]) + (C[6] + C[7] + C[8])
+                - 2.0 * (C[3] + C[4] + C[5])) / 6.0;
+    double c = (C[8] - C[6] - C[2] + C[0]) / 4.0;
+    double d = ((C[2] + C[5] + C[8]) - (C[0] + C[3] + C[6])) / 6.0;
+    double e = ((C[6] + C[7] + C[8]) - (C[0] + C[1] + C[2])) / 6.0;
+
+    double sx = 0.0, sy = 0.0;
+    if (do_h && do_v) {
+      double det = 4.0 * a * b - c * c;
+      if (!(a > 0.0 && det > 0.0))
+        return false;
+      sx = (c * e - 2.0 * b * d) / det;
+      sy = (c * d - 2.0 * a * e) / det;
+    } else if (do_h) {
+      if (!(a > 0.0))
+        return false;
+      sx = -d / (2.0 * a);
+    } else if (do_v) {
+      if (!(b > 0.0))
+        return false;
+      sy = -e / (2.0 * b);
+    }
+
+    if (!(std::abs(sx) <= 1.0 && std::abs(sy) <= 1.0))
+      return false;
+
+    offset = vw::Vector2f(sx, sy);
+    return true;
+  }
+
+  // How much lower the cost at the center is than the mean of the others
+  float cost_confidence(double const* C) {
+    double mean = 0.0;
+    for (int k = 0; k < NUM_OFFSETS; k++) {
+      if (k != NUM_OFFSETS / 2)
+        mean += C[k];
+    }
+    mean /= (NUM_OFFSETS - 1);
+    if (!(mean > 0.0))
+      return 0.0;
+    return std::max(0.0, std::min(1.0, 1.0 - C[NUM_OFFSETS / 2] / mean));
+  }
+
+  void parabola_subpixel_tile(vw::ImageView<float> const& left,
+                              vw::ImageView<float> const& right,
+                              vw::Vector2i const& right_origin,
+                              vw::ImageView<vw::PixelMask<vw::Vector2f>> const& disp,
+                              vw::Vector2i const& kernel_size,
+                              bool do_h, bool do_v,
+                              vw::ImageView<vw::PixelMask<vw::Vector2f>> & refined,
+                              vw::ImageView<float> & confidence) {
+    parabola_subpixel_patches(left.data(), left.cols(), left.rows(),
+                              right.data(), right.cols(), right.rows(),
+                              right_origin, disp, kernel_size, do_h, do_v,
+                              refined, confidence);
+  }
+
+  void parabola_subpixel_patches(float const* left, int left_cols, int left_rows,
+                                 float const* right, int right_cols, int right_rows,
+                                 vw::Vector2i const& right_origin,
+                                 vw::ImageView<vw::PixelMask<vw::Vector2f>> const& disp,
+                                 vw::Vector2i const& kernel_size,
+                                 bool do_h, bool do_v,
+                                 vw::ImageView<vw::PixelMask<vw::Vector2f>> & refined,
+                                 vw::ImageView<float> & confidence) {
+
+    if (kernel_size.x() < 1 || kernel_size.y() < 1 ||
+        kernel_size.x() % 2 == 0 || kernel_size.y() % 2 == 0)
+      vw::vw_throw(vw::ArgumentErr() << "parabola_subpixel_tile: The kernel size "
+                   << "must be positive and odd.\n");
+
+    int hx = kernel_size.x() / 2, hy = kernel_size.y() / 2;
+    int cols = disp.cols(), rows = disp.rows();
+    if (left_cols != cols + 2 * hx || left_rows != rows + 2 * hy)
+      vw::vw_throw(vw::ArgumentErr() << "parabola_subpixel_tile: The left patch "
+                   << "must extend half a kernel beyond the tile.\n");
+
+    refined.set_size(cols, rows);
+    confidence.set_size(cols, rows);
+    std::fill(refined.data(), refined.data() + size_t(cols) * rows,
+              vw::PixelMask<vw::Vector2f>());
+    std::fill(confidence.data(), confidence.data() + size_t(cols) * rows, 0.0f);
+
+    // The column sums and costs of a run, which is at most a row
+    TileArenaScope scope;
+    float  * col_sums = TileArena::local().alloc<float>(cols + 2 * hx);
+    double * costs    = TileArena::local().alloc<double>(size_t(NUM_OFFSETS) * cols);
+
+    for (int row = 0; row < rows; row++) {
+      int col = 0;
+      while (col < cols) {
+
+        if (!is_valid(disp(col, row))) {
+          col++;
+          continue;
+        }
+
+        // The run of pixels with the same integer disparity
+        vw::Vector2i d = round_disparity(disp(col, row).child());
+        int end = col + 1;
+        while (end < cols && is_valid(disp(end, row)) &&
+               round_disparity(disp(end, row).child()) == d)
+          end++;
+        int len = end - col;
+
+        // The first right patch column and row used by the run
+        int rx = col - hx + d.x() - 1 - right_origin.x();
+        int ry = row - hy + d.y() - 1 - right_origin.y();
+        if (rx < 0 || ry < 0 ||
+            rx + len + 2 * hx + 2 > right_cols || ry + 2 * hy + 3 > right_rows) {
+          for (int it = col; it < end; it++)
+            refined(it, row) = vw::PixelMask<vw::Vector2f>(vw::Vector2f(d.x(), d.y()));
+          col = end;
+          continue;
+        }
+
+        // For each offset, sum the absolute differences over each window
+        // column, then slide the window along the run.
+        int num_sums = len + 2 * hx;
+        for (int k = 0; k < NUM_OFFSETS; k++) {
+          int ox = k % 3 - 1, oy = k / 3 - 1;
+          float * sums = col_sums;
+          std::fill(sums, sums + num_sums, 0.0f);
+          for (int qy = 0; qy < kernel_size.y(); qy++) {
+            float const* l = left + size_t(row + qy) * left_cols + col;
+            float const* r = right + size_t(ry + 1 + oy + qy) * right_cols + (rx + 1 + ox);
+            for (int it = 0; it < num_sums; it++)
+              sums[it] += std::abs(l[it] - r[it]);
+          }
+
+          double * cost = costs + size_t(k) * cols;
+          double sum = 0.0;
+          for (int it = 0; it < kernel_size.x(); it++)
+            sum += sums[it];
+          cost[0] = sum;
+          for (int it = 1; it < len; it++) {
+            sum += sums[it + kernel_size.x() - 1] - sums[it - 1];
+            cost[it] = sum;
+          }
+        }
+
+        for (int it = 0; it < len; it++) {
+          double C[NUM_OFFSETS];
+          for (int k = 0; k < NUM_OFFSETS; k++)
+            C[k] = costs[size_t(k) * cols + it];
+          vw::Vector2f offset;
+          if (!fit_cost_minimum(C, do_h, do_v, offset))
+            offset = vw::Vector2f();
+          refined(col + it, row)
+            = vw::PixelMask<vw::Vector2f>(vw::Vector2f(d.x(), d.y()) + offset);
+          confidence(col + it, row) = cost_confidence(C);
+        }
+
+        col = end;
+      }
+    }
+  }
+
+} // end namespace asp
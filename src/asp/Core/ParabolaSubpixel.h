@@ -0,0 +1,152 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ParabolaSubpixel.h
+///
+/// Refine integer disparities to subpixel precision by fitting a
+/// quadratic surface to the matching costs at each integer disparity
+/// and its 8 neighbors. Consecutive pixels in a row with the same
+/// integer disparity share their image patches, as their windows
+/// differ by one column, so the costs are found with running column
+/// sums, in loops the compiler can vectorize.
+
+#ifndef __ASP_CORE_PARABOLA_SUBPIXEL_H__
+#define __ASP_CORE_PARABOLA_SUBPIXEL_H__
+
+#include <asp/Core/TileArena.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+  /// Round a disparity to the nearest integer one
+  inline vw::Vector2i round_disparity(vw::Vector2f const& d) {
+    return vw::Vector2i((int)std::floor(d.x() + 0.5), (int)std::floor(d.y() + 0.5));
+  }
+
+  /// Refine the disparities of a tile. The left patch must start half
+  /// a kernel before the tile and end half a kernel past it. The
+  /// right patch starts at right_origin, relative to the tile
+  /// origin. The disparities are rounded before refinement. Also
+  /// return, for each pixel, a confidence between 0 and 1, which is
+  /// how much lower the cost at the integer disparity is than the mean
+  /// of the costs at its neighbors. Pixels whose fitted surface has no
+  /// minimum within a pixel, or whose costs need pixels outside the
+  /// right patch, keep the rounded disparity. Invalid pixels stay
+  /// invalid, with zero confidence.
+  void parabola_subpixel_tile(vw::ImageView<float> const& left,
+                              vw::ImageView<float> const& right,
+                              vw::Vector2i const& right_origin,
+                              vw::ImageView<vw::PixelMask<vw::Vector2f>> const& disp,
+                              vw::Vector2i const& kernel_size,
+                              bool do_h, bool do_v,
+                              vw::ImageView<vw::PixelMask<vw::Vector2f>> & refined,
+                              vw::ImageView<float> & confidence);
+
+  /// As parabola_subpixel_tile(), with the patches given by their
+  /// pixels, stored row after row
+  void parabola_subpixel_patches(float const* left, int left_cols, int left_rows,
+                                 float const* right, int right_cols, int right_rows,
+                                 vw::Vector2i const& right_origin,
+                                 vw::ImageView<vw::PixelMask<vw::Vector2f>> const& disp,
+                                 vw::Vector2i const& kernel_size,
+                                 bool do_h, bool do_v,
+                                 vw::ImageView<vw::PixelMask<vw::Vector2f>> & refined,
+                                 vw::ImageView<float> & confidence);
+
+  /// Refine the disparities in a box of the left image, given the
+  /// disparities in that box. Only the needed parts of the images are
+  /// rasterized, into the arena of this thread. Pixels beyond the
+  /// images are zero.
+  template <class Image1T, class Image2T>
+  void parabola_subpixel(vw::ImageViewBase<Image1T> const& left,
+                         vw::ImageViewBase<Image2T> const& right,
+                         vw::ImageView<vw::PixelMask<vw::Vector2f>> const& disp,
+                         vw::BBox2i const& box, vw::Vector2i const& kernel_size,
+                         bool do_h, bool do_v,
+                         vw::ImageView<vw::PixelMask<vw::Vector2f>> & refined,
+                         vw::ImageView<float> & confidence) {
+
+    if (disp.cols() != box.width() || disp.rows() != box.height())
+      vw::vw_throw(vw::ArgumentErr() << "parabola_subpixel: The disparity "
+                   << "must have the size of the box.\n");
+
+    TileArenaScope scope;
+
+    vw::Vector2i half = kernel_size / 2;
+    vw::BBox2i left_box = box;
+    left_box.min() -= half;
+    left_box.max() += half;
+    ArenaImage<float> left_patch
+      = arena_copy(crop(edge_extend(left.impl(), vw::ZeroEdgeExtension()), left_box));
+
+    // The range of the integer disparities
+    bool found = false;
+    vw::Vector2i dmin, dmax;
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+        if (!is_valid(disp(col, row)))
+          continue;
+        vw::Vector2i d = round_disparity(disp(col, row).child());
+        if (!found) {
+          dmin = d;
+          dmax = d;
+          found = true;
+        }
+        for (int it = 0; it < 2; it++) {
+          dmin[it] = std::min(dmin[it], d[it]);
+          dmax[it] = std::max(dmax[it], d[it]);
+        }
+      }
+    }
+
+    // The right patch covers the windows at all disparities and their
+    // neighbors, but not what is farther than a window from the image.
+    vw::BBox2i right_box;
+    if (found) {
+      right_box.min() = left_box.min() + dmin - vw::Vector2i(1, 1);
+      right_box.max() = left_box.max() + dmax + vw::Vector2i(1, 1);
+      vw::BBox2i bounds = bounding_box(right.impl());
+      bounds.expand(std::max(half.x(), half.y()) + 1);
+      right_box.crop(bounds);
+    }
+    ArenaImage<float> right_patch;
+    vw::Vector2i right_origin;
+    if (found && !right_box.empty()) {
+      right_patch
+        = arena_copy(crop(edge_extend(right.impl(), vw::ZeroEdgeExtension()), right_box));
+      right_origin = right_box.min() - box.min();
+    }
+
+    parabola_subpixel_patches(left_patch.data(), left_patch.cols(), left_patch.rows(),
+                              right_patch.data(), right_patch.cols(), right_patch.rows(),
+                              right_origin, disp, kernel_size, do_h, do_v,
+                              refined, confidence);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PARABOLA_SUBPIXEL_H__
@@ -23,6 +23,7 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/PhotometricOutlier.h>
+#include <asp/Core/ImageAlignment.h>
 
 #include <vw/Image/AlgorithmFunctions.h>
 #include <vw/Image/Algorithms.h>
@@ -31,60 +32,148 @@
 #include <vw/Image/EdgeExtension.h>
 #include <vw/Image/Manipulation.h>
 #include <vw/Image/MaskViews.h>
-#include <vw/Image/Transform.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Stereo/DisparityMap.h>
 
-namespace fs = boost::filesystem;
-
 using namespace vw;
 using namespace asp;
 
+namespace asp {
+
+/// The absolute difference between the left image and the right image
+/// projected to the left through the disparity, with bilinear
+/// interpolation and zero outside the right image. The projected right
+/// pixels that are zero are masked. Each tile reads the disparity and
+/// the images once, and only the part of the right image it needs.
+class ProjectedDiffView: public ImageViewBase<ProjectedDiffView> {
+  ImageViewRef<float>                 m_left, m_right;
+  DiskImageView<PixelMask<Vector2f>>  m_disp;
+
+public:
+  ProjectedDiffView(ImageViewRef<float> const& left, ImageViewRef<float> const& right,
+                    DiskImageView<PixelMask<Vector2f>> const& disp):
+    m_left(left), m_right(right), m_disp(disp) {}
+
+  typedef PixelMask<PixelGray<float>> pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<ProjectedDiffView> pixel_accessor;
+
+  inline int32 cols  () const { return m_disp.cols(); }
+  inline int32 rows  () const { return m_disp.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline pixel_type operator()(double /*i*/, double /*j*/, int32 /*p*/ = 0) const {
+    vw_throw(NoImplErr() << "ProjectedDiffView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    ImageView<PixelMask<Vector2f>> disp_tile = crop(m_disp, bbox);
+
+    // The region of the right image seen through the disparity
+    BBox2 right_box;
+    for (int row = 0; row < disp_tile.rows(); row++) {
+      for (int col = 0; col < disp_tile.cols(); col++) {
+        if (!is_valid(disp_tile(col, row)))
+          continue;
+        right_box.grow(Vector2(col + bbox.min().x(), row + bbox.min().y())
+                       + disp_tile(col, row).child());
+      }
+    }
+    BBox2i right_ibox;
+    if (!right_box.empty()) {
+      right_ibox = BBox2i(floor(right_box.min()), floor(right_box.max()) + Vector2i(2, 2));
+      right_ibox.crop(bounding_box(m_right));
+    }
+    ImageView<float> right_tile;
+    if (!right_ibox.empty())
+      right_tile = crop(m_right, right_ibox);
+    ImageView<float> left_tile = crop(m_left, bbox);
+
+    ImageView<pixel_type> diff_tile(bbox.width(), bbox.height());
+    for (int row = 0; row < diff_tile.rows(); row++) {
+      for (int col = 0; col < diff_tile.cols(); col++) {
+
+        // Bilinear interpolation, with zero outside the right image
+        float val = 0.0;
+        PixelMask<Vector2f> const& d = disp_tile(col, row);
+        if (is_valid(d) && !right_ibox.empty()) {
+          double x = col + bbox.min().x() + d.child()[0] - right_ibox.min().x();
+          double y = row + bbox.min().y() + d.child()[1] - right_ibox.min().y();
+          int x0 = floor(x), y0 = floor(y);
+          double wx = x - x0, wy = y - y0;
+          for (int dy = 0; dy <= 1; dy++) {
+            int yi = y0 + dy;
+            if (yi < 0 || yi >= right_tile.rows()) continue;
+            double w = (dy == 0) ? (1.0 - wy) : wy;
+            for (int dx = 0; dx <= 1; dx++) {
+              int xi = x0 + dx;
+              if (xi < 0 || xi >= right_tile.cols()) continue;
+              val += w * ((dx == 0) ? (1.0 - wx) : wx) * right_tile(xi, yi);
+            }
+          }
+        }
+
+        if (val == 0.0) {
+          diff_tile(col, row) = pixel_type(0.0);
+          diff_tile(col, row).invalidate();
+        } else {
+          diff_tile(col, row) = pixel_type(std::abs(left_tile(col, row) - val));
+        }
+      }
+    }
+
+    return prerasterize_type(diff_tile, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+} // end namespace asp
+
 void asp::photometric_outlier_rejection(vw::GdalWriteOptions const& opt,
                                         std::string const& prefix,
                                         std::string const& input_disparity,
                                         std::string & output_disparity,
                                         int kernel_size) {
-  // Projecting right into perspective of left
-  DiskImageView<PixelGray<float>> right_disk_image(prefix+"-R.tif");
-  DiskImageView<PixelMask<Vector2f>> disparity_disk_image( input_disparity );
-  stereo::DisparityTransform trans( disparity_disk_image );
-
-  std::string cache_dir = "/tmp"; // modify here to use a different cache dir if needed
-  if (!fs::is_directory(cache_dir)) {
-    vw_out() << "\nCreating cache directory: " << cache_dir << std::endl;
-    fs::create_directories(cache_dir);
-  }
 
-  DiskCacheImageView<PixelGray<float>>
-    right_proj( transform( right_disk_image, trans, ZeroEdgeExtension()),
-                "tif", TerminalProgressCallback("asp","Projecting R:"), cache_dir);
-
-  // Differencing Left and Projected Right
-  ImageViewRef<PixelMask<PixelGray<float32>>> right_mask =
-    create_mask(right_proj);
-  DiskImageView<PixelGray<float32>> left_image(prefix+"-L.tif");
-  DiskCacheImageView<PixelGray<float>>
-    diff( abs(apply_mask(copy_mask(left_image,right_mask))-right_proj),
-          "tif", TerminalProgressCallback("asp","\tDifference:"),
-          cache_dir);
+  // Difference the left image and the right image projected into the
+  // perspective of the left. This is done in tiles in parallel, in
+  // memory, as the dust mask below needs the whole image anyway.
+  DiskImageView<PixelMask<Vector2f>> disparity_disk_image(input_disparity);
+  ImageViewRef<float> left_image  = asp::read_aligned_image(prefix, true);
+  ImageViewRef<float> right_image = asp::read_aligned_image(prefix, false);
+  vw_out() << "\tDifferencing left and projected right.\n";
+  ImageView<PixelMask<PixelGray<float>>> diff
+    = block_rasterize(ProjectedDiffView(left_image, right_image, disparity_disk_image),
+                      Vector2i(opt.raster_tile_size), vw_settings().default_num_threads());
+
+  // The masked pixels have a difference of zero
   ChannelAccumulator<math::CDFAccumulator<float32>> cdf;
   cdf.resize(8000,2001);
-  for_each_pixel(diff, cdf);
+  for_each_pixel(apply_mask(diff), cdf);
   float thresh = cdf.quantile(0.99985); // Pulling out last bin of CDF
   vw_out() << "\t  Using threshold: " << thresh << "\n";
 
   // Thresholding image and dilating
-  ImageView<PixelGray<float>> dust =
-    threshold(apply_mask(copy_mask(diff,right_mask)),thresh,1.0,0.0);
+  ImageView<PixelGray<float>> dust = threshold(apply_mask(diff),thresh,1.0,0.0);
   ImageView<PixelGray<float>> grass;
   grassfire(dust,grass);
   dust = gaussian_filter(grass,kernel_size/3);
 
   ImageViewRef<PixelMask<Vector2f>> cleaned_disparity =
     intersect_mask(disparity_disk_image,
-                   intersect_mask(create_mask(threshold(dust,kernel_size,0.0,1.0)),right_mask));
+                   intersect_mask(create_mask(threshold(dust,kernel_size,0.0,1.0)),diff));
 
   vw::cartography::block_write_gdal_image(prefix + "-FDust.tif",
                           cleaned_disparity, opt,
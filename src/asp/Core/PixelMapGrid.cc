@@ -0,0 +1,249 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/PixelMapGrid.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Camera/CameraModel.h>
+#include <vw/Cartography/Map2CamTrans.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace asp {
+
+  // The map values at the nodes of a uniform grid. Beyond the grid the
+  // values are extrapolated linearly, so that linear maps are
+  // interpolated exactly also next to the grid boundary.
+  struct NodeGrid {
+    int nx, ny;
+    std::vector<vw::Vector2> nodes;
+
+    vw::Vector2 at(int i, int j) const {
+      if (i < 0)   return 2.0 * at(0, j)      - at(1, j);
+      if (i >= nx) return 2.0 * at(nx - 1, j) - at(nx - 2, j);
+      if (j < 0)   return 2.0 * at(i, 0)      - at(i, 1);
+      if (j >= ny) return 2.0 * at(i, ny - 1) - at(i, ny - 2);
+      return nodes[size_t(j) * nx + i];
+    }
+
+    // Interpolate with Catmull-Rom cubics at the given position in grid units
+    vw::Vector2 interp(double u, double v) const {
+      int i = std::max(0, std::min(nx - 2, int(std::floor(u))));
+      int j = std::max(0, std::min(ny - 2, int(std::floor(v))));
+      double wx[4], wy[4];
+      weights(u - i, wx);
+      weights(v - j, wy);
+      vw::Vector2 val;
+      for (int b = 0; b < 4; b++) {
+        vw::Vector2 row;
+        for (int a = 0; a < 4; a++)
+          row += wx[a] * at(i + a - 1, j + b - 1);
+        val += wy[b] * row;
+      }
+      return val;
+    }
+
+    static void weights(double t, double w[4]) {
+      double t2 = t * t, t3 = t2 * t;
+      w[0] = 0.5 * (-t3 + 2.0 * t2 - t);
+      w[1] = 0.5 * (3.0 * t3 - 5.0 * t2 + 2.0);
+      w[2] = 0.5 * (-3.0 * t3 + 4.0 * t2 + t);
+      w[3] = 0.5 * (t3 - t2);
+    }
+  };
+
+  // Fill the values for a part of the full box
+  void interp_pixel_map_part(PixelMap const& map, vw::BBox2i const& full_box,
+                             vw::BBox2i const& box, int spacing, double tol,
+                             std::vector<vw::Vector2> & values, int & num_exact) {
+
+    int w = box.width(), h = box.height();
+    if (w <= 0 || h <= 0)
+      return;
+
+    // Too small to be worth interpolating
+    if (spacing <= 1 || w <= 2 || h <= 2) {
+      for (int y = box.min().y(); y < box.max().y(); y++) {
+        for (int x = box.min().x(); x < box.max().x(); x++) {
+          size_t pos = size_t(y - full_box.min().y()) * full_box.width()
+            + (x - full_box.min().x());
+          values[pos] = map(vw::Vector2(x, y));
+          num_exact++;
+        }
+      }
+      return;
+    }
+
+    // Uniform nodes spanning the box, no farther apart than the spacing.
+    // The last node is at the last pixel.
+    NodeGrid grid;
+    grid.nx = (w - 1 + spacing - 1) / spacing + 1;
+    grid.ny = (h - 1 + spacing - 1) / spacing + 1;
+    double hx = (w - 1.0) / (grid.nx - 1), hy = (h - 1.0) / (grid.ny - 1);
+    vw::Vector2 origin = box.min();
+    grid.nodes.resize(size_t(grid.nx) * grid.ny);
+    for (int j = 0; j < grid.ny; j++) {
+      for (int i = 0; i < grid.nx; i++) {
+        grid.nodes[size_t(j) * grid.nx + i] = map(origin + vw::Vector2(i * hx, j * hy));
+        num_exact++;
+      }
+    }
+
+    // Check the error at the cell centers. The error elsewhere in a cell
+    // can be somewhat larger, so there it must be under half the
+    // tolerance. A NaN error is too large.
+    bool good = true;
+    for (int j = 0; j < grid.ny - 1 && good; j++) {
+      for (int i = 0; i < grid.nx - 1 && good; i++) {
+        double u = i + 0.5, v = j + 0.5;
+        vw::Vector2 exact = map(origin + vw::Vector2(u * hx, v * hy));
+        num_exact++;
+        double err = norm_2(exact - grid.interp(u, v));
+        if (!(2.0 * err <= tol))
+          good = false;
+      }
+    }
+
+    if (!good) {
+      int mid_x = box.min().x() + w / 2, mid_y = box.min().y() + h / 2;
+      int half = spacing / 2;
+      interp_pixel_map_part(map, full_box,
+                            vw::BBox2i(box.min().x(), box.min().y(),
+                                       mid_x - box.min().x(), mid_y - box.min().y()),
+                            half, tol, values, num_exact);
+      interp_pixel_map_part(map, full_box,
+                            vw::BBox2i(mid_x, box.min().y(),
+                                       box.max().x() - mid_x, mid_y - box.min().y()),
+                            half, tol, values, num_exact);
+      interp_pixel_map_part(map, full_box,
+                            vw::BBox2i(box.min().x(), mid_y,
+                                       mid_x - box.min().x(), box.max().y() - mid_y),
+                            half, tol, values, num_exact);
+      interp_pixel_map_part(map, full_box,
+                            vw::BBox2i(mid_x, mid_y,
+                                       box.max().x() - mid_x, box.max().y() - mid_y),
+                            half, tol, values, num_exact);
+      return;
+    }
+
+    for (int y = box.min().y(); y < box.max().y(); y++) {
+      size_t pos = size_t(y - full_box.min().y()) * full_box.width()
+        + (box.min().x() - full_box.min().x());
+      double v = (y - origin.y()) / hy;
+      for (int x = box.min().x(); x < box.max().x(); x++)
+        values[pos++] = grid.interp((x - origin.x()) / hx, v);
+    }
+  }
+
+  int interp_pixel_map(PixelMap const& map, vw::BBox2i const& box,
+                       int spacing, double tol, std::vector<vw::Vector2> & values) {
+
+    if (tol < 0.0)
+      vw::vw_throw(vw::ArgumentErr() << "The interpolation tolerance must be non-negative.\n");
+
+    values.clear();
+    if (box.empty())
+      return 0;
+    values.resize(size_t(box.width()) * box.height());
+
+    // Start with blocks of several grid cells, so that where the map
+    // is not smooth only small regions get refined
+    int block_size = std::max(4 * spacing, 1);
+    int num_exact = 0;
+    for (int y = box.min().y(); y < box.max().y(); y += block_size) {
+      for (int x = box.min().x(); x < box.max().x(); x += block_size) {
+        vw::BBox2i block(x, y, block_size, block_size);
+        block.crop(box);
+        interp_pixel_map_part(map, box, block, spacing, tol, values, num_exact);
+      }
+    }
+
+    return num_exact;
+  }
+
+  // The exact reverse transform, with NaN where it fails
+  class ReverseTransformMap: public PixelMap {
+    vw::TransformPtr m_trans;
+  public:
+    ReverseTransformMap(vw::TransformPtr trans): m_trans(trans) {}
+    virtual vw::Vector2 operator()(vw::Vector2 const& pix) const {
+      try {
+        vw::Vector2 val = m_trans->reverse(pix);
+        if (val != vw::camera::CameraModel::invalid_pixel())
+          return val;
+      } catch (...) {}
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      return vw::Vector2(nan, nan);
+    }
+  };
+
+  vw::Vector2 GridInterpTransform::forward(vw::Vector2 const& p) const {
+    return m_trans->forward(p);
+  }
+
+  vw::BBox2i GridInterpTransform::forward_bbox(vw::BBox2i const& bbox) const {
+    return m_trans->forward_bbox(bbox);
+  }
+
+  vw::Vector2 GridInterpTransform::reverse(vw::Vector2 const& p) const {
+
+    if (m_box.empty() || !(p.x() >= m_box.min().x() && p.y() >= m_box.min().y() &&
+                           p.x() <= m_box.max().x() - 1 && p.y() <= m_box.max().y() - 1))
+      return m_trans->reverse(p); // also when p is NaN
+
+    double fx = std::floor(p.x()), fy = std::floor(p.y());
+    double ax = p.x() - fx, ay = p.y() - fy;
+    int x0 = int(fx) - m_box.min().x(), y0 = int(fy) - m_box.min().y();
+    int x1 = std::min(x0 + 1, m_box.width()  - 1);
+    int y1 = std::min(y0 + 1, m_box.height() - 1);
+    size_t w = m_box.width();
+    vw::Vector2 const& v00 = m_values[y0 * w + x0];
+    vw::Vector2 const& v10 = m_values[y0 * w + x1];
+    vw::Vector2 const& v01 = m_values[y1 * w + x0];
+    vw::Vector2 const& v11 = m_values[y1 * w + x1];
+    vw::Vector2 val = (1.0 - ay) * ((1.0 - ax) * v00 + ax * v10)
+      + ay * ((1.0 - ax) * v01 + ax * v11);
+    if (val != val)
+      return m_trans->reverse(p);
+
+    return val;
+  }
+
+  vw::BBox2i GridInterpTransform::reverse_bbox(vw::BBox2i const& bbox) const {
+    // This also makes the wrapped transform cache what it needs
+    vw::BBox2i in_box = m_trans->reverse_bbox(bbox);
+    m_box = vw::BBox2i();
+    interp_pixel_map(ReverseTransformMap(m_trans), bbox, m_spacing, m_tol, m_values);
+    m_box = bbox;
+    // The interpolated values can be off by up to the tolerance
+    if (!in_box.empty())
+      in_box.expand(int(std::ceil(m_tol)) + 1);
+    return in_box;
+  }
+
+  vw::TransformPtr grid_interp_trans_copy(vw::TransformPtr trans) {
+    GridInterpTransform * grid_trans = dynamic_cast<GridInterpTransform*>(trans.get());
+    if (grid_trans == NULL)
+      return vw::cartography::mapproj_trans_copy(trans);
+    return vw::TransformPtr
+      (new GridInterpTransform(vw::cartography::mapproj_trans_copy(grid_trans->trans()),
+                               grid_trans->spacing(), grid_trans->tol()));
+  }
+
+} // end namespace asp
@@ -0,0 +1,142 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file PixelMapGrid.h
+///
+/// Approximate an expensive map from pixels to pixels, such as
+/// projecting map-projected pixels into a camera, by computing it
+/// exactly on a sparse grid and interpolating in between.
+
+#ifndef __ASP_CORE_PIXEL_MAP_GRID_H__
+#define __ASP_CORE_PIXEL_MAP_GRID_H__
+
+#include <vw/Image/Transform.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  /// A map from pixels to pixels
+  class PixelMap {
+  public:
+    virtual ~PixelMap() {}
+    virtual vw::Vector2 operator()(vw::Vector2 const& pix) const = 0;
+  };
+
+  /// Find the values of the map at all the pixels of the box, stored
+  /// row by row. The map is computed exactly on a grid with the given
+  /// spacing, and elsewhere with bicubic interpolation. The
+  /// interpolation error is checked at the center of each grid
+  /// cell. If it exceeds half the tolerance anywhere, the box is split in
+  /// four, and each part is done with half the spacing, down to
+  /// computing each pixel exactly. Return the number of exact
+  /// evaluations of the map.
+  int interp_pixel_map(PixelMap const& map, vw::BBox2i const& box,
+                       int spacing, double tol, std::vector<vw::Vector2> & values);
+
+  /// Wrap a transform, such as Map2CamTrans, so that reverse_bbox(),
+  /// which is invoked for each tile before projecting its pixels,
+  /// computes the reverse transform for all pixels of the tile with
+  /// interp_pixel_map(). The reverse transform of those pixels then
+  /// uses these values. As with Map2CamTrans, which caches the DEM in
+  /// reverse_bbox(), each thread must have its own copy.
+  template <class TransT>
+  class GridInterpTrans: public vw::TransformBase<GridInterpTrans<TransT>> {
+
+    // The exact reverse transform
+    class ReverseMap: public PixelMap {
+      TransT const& m_trans;
+    public:
+      ReverseMap(TransT const& trans): m_trans(trans) {}
+      virtual vw::Vector2 operator()(vw::Vector2 const& pix) const {
+        return m_trans.reverse(pix);
+      }
+    };
+
+    TransT m_trans;
+    int    m_spacing;
+    double m_tol;
+    mutable vw::BBox2i               m_box;
+    mutable std::vector<vw::Vector2> m_values;
+
+  public:
+    GridInterpTrans(TransT const& trans, int spacing, double tol):
+      m_trans(trans), m_spacing(spacing), m_tol(tol) {}
+
+    vw::Vector2 forward(vw::Vector2 const& p) const {
+      return m_trans.forward(p);
+    }
+
+    vw::Vector2 reverse(vw::Vector2 const& p) const {
+      int x = int(p.x()), y = int(p.y());
+      if (x == p.x() && y == p.y() && m_box.contains(vw::Vector2i(x, y)))
+        return m_values[size_t(y - m_box.min().y()) * m_box.width() + (x - m_box.min().x())];
+      return m_trans.reverse(p);
+    }
+
+    vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const {
+      // This also makes the wrapped transform cache what it needs
+      vw::BBox2i in_box = m_trans.reverse_bbox(bbox);
+      m_box = vw::BBox2i();
+      interp_pixel_map(ReverseMap(m_trans), bbox, m_spacing, m_tol, m_values);
+      m_box = bbox;
+      // The interpolated values can be off by up to the tolerance
+      if (!in_box.empty())
+        in_box.expand(int(std::ceil(m_tol)) + 1);
+      return in_box;
+    }
+  };
+
+  /// The same as GridInterpTrans, for a transform known only through a
+  /// pointer, such as the map-projected pixel to camera pixel transform
+  /// of a stereo session. The reverse transform at a non-integer pixel
+  /// is interpolated bilinearly from the values at the four nearest
+  /// pixels, as is needed for the right image in triangulation. Where
+  /// any of these is not valid, the exact transform is used.
+  class GridInterpTransform: public vw::Transform {
+    vw::TransformPtr m_trans;
+    int              m_spacing;
+    double           m_tol;
+    mutable vw::BBox2i               m_box;
+    mutable std::vector<vw::Vector2> m_values; // NaN where the transform failed
+
+  public:
+    GridInterpTransform(vw::TransformPtr trans, int spacing, double tol):
+      m_trans(trans), m_spacing(spacing), m_tol(tol) {}
+
+    vw::TransformPtr trans() const { return m_trans; }
+    int    spacing() const { return m_spacing; }
+    double tol()     const { return m_tol; }
+
+    virtual vw::Vector2 forward(vw::Vector2 const& p) const;
+    virtual vw::Vector2 reverse(vw::Vector2 const& p) const;
+    virtual vw::BBox2i forward_bbox(vw::BBox2i const& bbox) const;
+    virtual vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const;
+  };
+
+  /// Copy a transform so that the copy can be used in a different
+  /// thread. A GridInterpTransform gets its own table and a copy of the
+  /// wrapped transform. Otherwise this is the same as
+  /// vw::cartography::mapproj_trans_copy().
+  vw::TransformPtr grid_interp_trans_copy(vw::TransformPtr trans);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PIXEL_MAP_GRID_H__
@@ -82,8 +82,8 @@ Point2Grid::Point2Grid(int width, int height,
 void Point2Grid::Clear(const float value) {
   m_buffer.set_size (m_width, m_height);
   m_weights.set_size (m_width, m_height);
-  for (int c = 0; c < m_buffer.cols(); c++){
-    for (int r = 0; r < m_buffer.rows(); r++){
+  for (int r = 0; r < m_buffer.rows(); r++){
+    for (int c = 0; c < m_buffer.cols(); c++){
       m_buffer (c, r) = value; // usually this is the no-data value
       m_weights(c, r) = 0.0;
     }
@@ -106,13 +106,18 @@ void Point2Grid::AddPoint(double x, double y, double z){
   int maxx = std::min( (int)floor( (x + m_radius - m_x0)/m_grid_size ), m_buffer.cols() - 1 );
   int maxy = std::min( (int)floor( (y + m_radius - m_y0)/m_grid_size ), m_buffer.rows() - 1 );
 
-  // Add the contribution of current point to all grid points within radius
-  for (int ix = minx; ix <= maxx; ix++){
-    for (int iy = miny; iy <= maxy; iy++){
+  // Add the contribution of current point to all grid points within
+  // radius. Visit the grid points row by row, as they are stored.
+  for (int iy = miny; iy <= maxy; iy++){
+
+    double gy  = m_y0 + iy*m_grid_size;
+    double dy2 = (y-gy)*(y-gy);
+    if ( sqrt(dy2) > m_radius ) continue; // the whole row is out of range
+    
+    for (int ix = minx; ix <= maxx; ix++){
       
       double gx   = m_x0 + ix*m_grid_size;
-      double gy   = m_y0 + iy*m_grid_size;
-      double dist = sqrt( (x-gx)*(x-gx) + (y-gy)*(y-gy) );
+      double dist = sqrt( (x-gx)*(x-gx) + dy2 );
       if ( dist > m_radius ) continue;
 
       if (m_filter == f_weighted_average) {
@@ -161,8 +166,8 @@ void Point2Grid::AddPoint(double x, double y, double z){
 }
 
 void Point2Grid::normalize(){
-  for (int c = 0; c < m_buffer.cols(); c++){
-    for (int r = 0; r < m_buffer.rows(); r++){
+  for (int r = 0; r < m_buffer.rows(); r++){
+    for (int c = 0; c < m_buffer.cols(); c++){
 
       if (m_filter == f_weighted_average || m_filter == f_mean) {
         if (m_weights(c, r) > 0)
@@ -0,0 +1,299 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/PointCache.h>
+#include <asp/Core/FileUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  // Written at the start of each cache file. Change this if the format changes.
+  const std::string POINT_CACHE_MAGIC = "ASP point cache 1";
+
+  // The tiles are made to have this many points on average, but
+  // there are no more than this many tiles along each axis.
+  const double POINT_CACHE_TILE_POINTS = 100000.0;
+  const int    POINT_CACHE_MAX_TILES   = 64;
+
+  // The fraction of a tile's lon-lat box which is inside the given box,
+  // allowing for the longitudes to differ by 360 degrees. Return -1 if
+  // they do not overlap. A tile whose points have the same longitude or
+  // latitude has an empty box, so the overlap is measured along each axis.
+  static double tile_overlap(vw::BBox2 const& tile_box, vw::BBox2 const& box) {
+    double best = -1.0;
+    for (int k = -1; k <= 1; k++) {
+      vw::Vector2 beg = tile_box.min() + vw::Vector2(360.0*k, 0.0);
+      vw::Vector2 end = tile_box.max() + vw::Vector2(360.0*k, 0.0);
+      double fraction = 1.0;
+      bool overlaps = true;
+      for (int c = 0; c < 2; c++) {
+        double b = std::max(beg[c], box.min()[c]), e = std::min(end[c], box.max()[c]);
+        if (b > e) {
+          overlaps = false;
+          break;
+        }
+        if (end[c] > beg[c])
+          fraction *= (e - b) / (end[c] - beg[c]);
+      }
+      if (overlaps)
+        best = std::max(best, fraction);
+    }
+    return best;
+  }
+
+  static bool lonlat_box_contains(vw::BBox2 const& box, vw::Vector2 const& lonlat) {
+    return box.contains(lonlat) ||
+      box.contains(lonlat + vw::Vector2(360.0, 0.0)) ||
+      box.contains(lonlat - vw::Vector2(360.0, 0.0));
+  }
+
+  PointCache::PointCache(): m_num_points(0), m_is_lola_rdr_format(false) {}
+
+  void PointCache::write(std::string const& file, std::string const& key,
+                         DoubleMatrix const& data, vw::cartography::Datum const& datum,
+                         bool is_lola_rdr_format) {
+
+    std::int64_t num_points = data.cols();
+    std::vector<vw::Vector2> lonlat(num_points);
+    vw::BBox2 extent;
+    for (std::int64_t it = 0; it < num_points; it++) {
+      vw::Vector3 xyz(data(0, it), data(1, it), data(2, it));
+      vw::Vector3 llh = datum.cartesian_to_geodetic(xyz);
+      lonlat[it] = vw::Vector2(llh[0], llh[1]);
+      extent.grow(lonlat[it]);
+    }
+
+    int num_side = std::ceil(std::sqrt(num_points / POINT_CACHE_TILE_POINTS));
+    num_side = std::max(1, std::min(num_side, POINT_CACHE_MAX_TILES));
+
+    // Sort the points by tile, keeping their order within each tile
+    std::vector<int> tile_ids(num_points);
+    std::vector<std::int64_t> counts(num_side * num_side, 0);
+    std::vector<vw::BBox2> boxes(num_side * num_side);
+    for (std::int64_t it = 0; it < num_points; it++) {
+      int tile_xy[2] = {0, 0};
+      for (int c = 0; c < 2; c++) {
+        double len = extent.max()[c] - extent.min()[c];
+        if (len > 0)
+          tile_xy[c] = std::min(num_side - 1,
+                                int(num_side * (lonlat[it][c] - extent.min()[c]) / len));
+      }
+      tile_ids[it] = tile_xy[1] * num_side + tile_xy[0];
+      counts[tile_ids[it]]++;
+      boxes[tile_ids[it]].grow(lonlat[it]);
+    }
+    std::vector<std::int64_t> starts(counts.size(), 0), order(num_points);
+    for (size_t tile = 1; tile < counts.size(); tile++)
+      starts[tile] = starts[tile - 1] + counts[tile - 1];
+    for (std::int64_t it = 0; it < num_points; it++)
+      order[starts[tile_ids[it]]++] = it;
+
+    std::int64_t num_tiles = 0;
+    for (size_t tile = 0; tile < counts.size(); tile++)
+      num_tiles += (counts[tile] > 0);
+
+    // Write to a temporary file first, then rename it, so that a
+    // concurrent or interrupted run never sees a partial cache.
+    std::string tmp_file = file + ".tmp";
+    vw::create_out_dir(file);
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+
+      ofs << POINT_CACHE_MAGIC << "\n" << key << "\n";
+      std::int64_t header[3] = {num_points, num_tiles, std::int64_t(is_lola_rdr_format)};
+      ofs.write((char const*)header, sizeof(header));
+      for (size_t tile = 0; tile < counts.size(); tile++) {
+        if (counts[tile] == 0)
+          continue;
+        double box[4] = {boxes[tile].min().x(), boxes[tile].min().y(),
+                         boxes[tile].max().x(), boxes[tile].max().y()};
+        ofs.write((char const*)box, sizeof(box));
+        ofs.write((char const*)&counts[tile], sizeof(counts[tile]));
+      }
+      for (std::int64_t it = 0; it < num_points; it++) {
+        double xyz[3] = {data(0, order[it]), data(1, order[it]), data(2, order[it])};
+        ofs.write((char const*)xyz, sizeof(xyz));
+      }
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    fs::rename(tmp_file, file);
+  }
+
+  bool PointCache::open(std::string const& file, std::string const& key) {
+
+    *this = PointCache();
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic, file_key;
+    std::getline(ifs, magic);
+    std::getline(ifs, file_key);
+    if (magic != POINT_CACHE_MAGIC || file_key != key)
+      return false;
+
+    std::int64_t header[3] = {0, 0, 0};
+    ifs.read((char*)header, sizeof(header));
+    if (!ifs.good() || header[0] < 0 || header[1] < 0 || header[1] > header[0] + 1)
+      return false;
+
+    std::vector<vw::BBox2> boxes(header[1]);
+    std::vector<std::int64_t> counts(header[1]), offsets(header[1]);
+    std::int64_t total = 0;
+    for (std::int64_t tile = 0; tile < header[1]; tile++) {
+      double box[4];
+      ifs.read((char*)box, sizeof(box));
+      ifs.read((char*)&counts[tile], sizeof(counts[tile]));
+      if (!ifs.good() || counts[tile] < 0)
+        return false;
+      boxes[tile] = vw::BBox2(vw::Vector2(box[0], box[1]), vw::Vector2(box[2], box[3]));
+      total += counts[tile];
+    }
+    if (total != header[0])
+      return false;
+
+    // The points follow the tile index. Check that they are all there.
+    std::int64_t start = ifs.tellg();
+    for (std::int64_t tile = 0; tile < header[1]; tile++) {
+      offsets[tile] = start;
+      start += counts[tile] * 3 * sizeof(double);
+    }
+    if (std::int64_t(fs::file_size(file)) != start)
+      return false;
+
+    m_file               = file;
+    m_num_points         = header[0];
+    m_is_lola_rdr_format = (header[2] != 0);
+    m_tile_boxes         = boxes;
+    m_tile_counts        = counts;
+    m_tile_offsets       = offsets;
+    return true;
+  }
+
+  void PointCache::load(std::int64_t num_points_to_load, vw::BBox2 const& lonlat_box,
+                        bool calc_shift, vw::Vector3 & shift,
+                        vw::cartography::Datum const& datum,
+                        double & median_longitude, DoubleMatrix & data) const {
+
+    // Find the tiles to read, and estimate from the overlap of their
+    // boxes with the given box how many of their points are in it, to
+    // decide with what probability to pick each point.
+    std::vector<int> tiles;
+    double num_expected = 0.0;
+    std::int64_t num_in_tiles = 0;
+    for (int tile = 0; tile < num_tiles(); tile++) {
+      double fraction = 1.0;
+      if (!lonlat_box.empty())
+        fraction = tile_overlap(m_tile_boxes[tile], lonlat_box);
+      if (fraction < 0)
+        continue;
+      tiles.push_back(tile);
+      num_expected += fraction * m_tile_counts[tile];
+      num_in_tiles += m_tile_counts[tile];
+    }
+    double load_ratio = (double)num_points_to_load / std::max(1.0, num_expected);
+
+    data.conservativeResize(DIM + 1, std::min(num_points_to_load, num_in_tiles));
+
+    std::ifstream ifs(m_file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      vw::vw_throw(vw::IOErr() << "Cannot read: " << m_file << "\n");
+
+    bool shift_was_calc = false;
+    std::int64_t points_count = 0;
+    std::vector<double> longitudes, buf;
+    for (size_t it = 0; it < tiles.size() && points_count < num_points_to_load; it++) {
+
+      int tile = tiles[it];
+      buf.resize(3 * m_tile_counts[tile]);
+      ifs.seekg(m_tile_offsets[tile]);
+      ifs.read((char*)&buf[0], buf.size() * sizeof(double));
+      if (!ifs.good())
+        vw::vw_throw(vw::IOErr() << "Failed reading: " << m_file << "\n");
+
+      for (std::int64_t pt = 0; pt < m_tile_counts[tile]; pt++) {
+
+        if (points_count >= num_points_to_load)
+          break;
+
+        double r = (double)std::rand()/(double)RAND_MAX;
+        if (r > load_ratio)
+          continue;
+
+        vw::Vector3 xyz(buf[3*pt], buf[3*pt + 1], buf[3*pt + 2]);
+        vw::Vector3 llh = datum.cartesian_to_geodetic(xyz);
+        if (!lonlat_box.empty() && !lonlat_box_contains(lonlat_box, vw::Vector2(llh[0], llh[1])))
+          continue;
+
+        if (calc_shift && !shift_was_calc) {
+          shift = xyz;
+          shift_was_calc = true;
+        }
+
+        for (int row = 0; row < DIM; row++)
+          data(row, points_count) = xyz[row] - shift[row];
+        data(DIM, points_count) = 1;
+
+        longitudes.push_back(llh[0]);
+        points_count++;
+      }
+    }
+    data.conservativeResize(Eigen::NoChange, points_count);
+
+    median_longitude = 0.0;
+    std::sort(longitudes.begin(), longitudes.end());
+    if (longitudes.size() > 0)
+      median_longitude = longitudes[longitudes.size()/2];
+  }
+
+  std::string point_cache_key(std::string const& cloud_file,
+                              std::string const& csv_format_str,
+                              std::string const& csv_proj4_str,
+                              vw::cartography::GeoReference const& geo) {
+    std::ostringstream os;
+    os << std::setprecision(17);
+    os << "cloud: " << cloud_file << " " << asp::file_timestamp(cloud_file) << " "
+       << "csv-format: " << csv_format_str << " "
+       << "csv-proj4: " << csv_proj4_str << " "
+       << "georef: " << geo.overall_proj4_str() << " "
+       << geo.datum().semi_major_axis() << " " << geo.datum().semi_minor_axis();
+    return os.str();
+  }
+
+  std::string point_cache_file(std::string const& dir, std::string const& key) {
+    return asp::cache_file_name(dir, "point-cache-", key, ".bin");
+  }
+
+} // end namespace asp
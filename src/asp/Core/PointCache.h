@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PointCache.h
+///
+/// A binary cache of all points of a CSV or LAS cloud, as Cartesian
+/// coordinates grouped in lon-lat tiles. Making it parses the cloud
+/// once. Later runs, for example aligning many clouds to the same
+/// reference, read only the tiles which overlap the region they need.
+
+#ifndef __ASP_CORE_POINT_CACHE_H__
+#define __ASP_CORE_POINT_CACHE_H__
+
+#include <asp/Core/EigenUtils.h>
+
+#include <vw/Cartography/Datum.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Math/BBox.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The points of a tile are stored together. For each tile the
+  /// lon-lat box of its points, its number of points, and where they
+  /// start in the file are kept in memory. The points are read from
+  /// disk only when loaded.
+  class PointCache {
+
+  public:
+    PointCache();
+
+    /// Save the points, which are the first DIM rows of the columns of
+    /// data, in Cartesian coordinates and not shifted. The datum is
+    /// used to find their lon-lat. The key describes what the points
+    /// were made from, as produced by point_cache_key().
+    static void write(std::string const& file, std::string const& key,
+                      DoubleMatrix const& data, vw::cartography::Datum const& datum,
+                      bool is_lola_rdr_format);
+
+    /// Read the tile index of a cache saved with write(). Return false
+    /// if the file does not exist, cannot be parsed, or was saved with a
+    /// different key.
+    bool open(std::string const& file, std::string const& key);
+
+    bool is_open() const { return m_file != ""; }
+
+    /// Load at most this many randomly picked points, in the format of
+    /// load_csv(), from the tiles overlapping the lon-lat box. If the box
+    /// is not empty, only the points in it are kept.
+    void load(std::int64_t num_points_to_load, vw::BBox2 const& lonlat_box,
+              bool calc_shift, vw::Vector3 & shift,
+              vw::cartography::Datum const& datum,
+              double & median_longitude, DoubleMatrix & data) const;
+
+    std::int64_t num_points()         const { return m_num_points; }
+    int          num_tiles()          const { return m_tile_boxes.size(); }
+    bool         is_lola_rdr_format() const { return m_is_lola_rdr_format; }
+
+  private:
+    std::string               m_file;
+    std::int64_t              m_num_points;
+    bool                      m_is_lola_rdr_format;
+    std::vector<vw::BBox2>    m_tile_boxes;   // lon-lat box of the points in each tile
+    std::vector<std::int64_t> m_tile_counts;  // number of points in each tile
+    std::vector<std::int64_t> m_tile_offsets; // where each tile starts in the file
+  };
+
+  /// A string which identifies a cache. It has the cloud file and its
+  /// modification time, the CSV format and projection, and the
+  /// georeference used to interpret the points. A cache saved with a
+  /// different key is not reused.
+  std::string point_cache_key(std::string const& cloud_file,
+                              std::string const& csv_format_str,
+                              std::string const& csv_proj4_str,
+                              vw::cartography::GeoReference const& geo);
+
+  /// The file in the given directory in which a cache with this key is saved
+  std::string point_cache_file(std::string const& dir, std::string const& key);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_POINT_CACHE_H__
@@ -35,6 +35,9 @@
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/math/special_functions/next.hpp>
 
+#include <cstring>
+#include <cstdlib>
+
 using namespace vw;
 using namespace vw::cartography;
 using namespace pdal::filters;
@@ -548,12 +551,12 @@ asp::CsvConv::CsvRecord asp::CsvConv::parse_csv_line(bool & is_first_line, bool
   // Parse a CSV file line in given format
   success = true;
 
-  // Copy the input line into a temporary buffer
-  const int bufSize = 2048;
-  char temp[bufSize];
-  strncpy(temp, line.c_str(), bufSize);
-
+  // Walk through the line in place, rather than copying it to a
+  // buffer and splitting that with strtok, as this is called for
+  // every point of a large cloud. As before, consecutive separators
+  // count as one.
   std::string sep = asp::csv_separator();
+  const char* ptr = line.c_str();
 
   int col_index = -1; // The current column we are reading
   int num_floats_read = 0;
@@ -569,26 +572,30 @@ asp::CsvConv::CsvRecord asp::CsvConv::parse_csv_line(bool & is_first_line, bool
     return values;
   }
 
-  char * ptr = temp;
   while(1){
 
+    ptr += strspn(ptr, sep.c_str()); // skip to the start of the next token
+    if (*ptr == '\0') break; // no more tokens
+    size_t len = strcspn(ptr, sep.c_str());
+    const char* token = ptr;
+    ptr += len;
+
     col_index++; // Increment the column counter
-    const char* token = strtok(ptr, sep.c_str());  // Split line on seperator char
-    ptr = NULL; // After the first call, strtok expects a null pointer as input.
-    if (token == NULL) break; // no more tokens
     if (num_values_read >= this->num_targets) break; // read enough values
 
     // Check if this is one of the columns we need to read
-    if (this->col2name.find(col_index) == this->col2name.end())
+    std::map<int, std::string>::const_iterator it = this->col2name.find(col_index);
+    if (it == this->col2name.end())
       continue;
 
-    if (this->col2name.at(col_index) == "file") // This is a string input
-      values.file = token;
+    if (it->second == "file") // This is a string input
+      values.file = std::string(token, len);
     else {
-      // Parse the floating point value from the token
-      double val;
-      int flag = sscanf(token, "%lg", &val);
-      if (flag == 0){ // Handle parsing failure
+      // Parse the floating point value from the token. The end of the
+      // parsed value must not go past the token.
+      char* end = NULL;
+      double val = strtod(token, &end);
+      if (end == token || end > token + len){ // Handle parsing failure
         success = false;
         break;
       }
@@ -641,6 +648,17 @@ size_t asp::CsvConv::read_csv_file(std::string    const & file_path,
 }
 
 
+asp::PointAffineTransFunc::PointAffineTransFunc(vw::Matrix<double> const& trans) {
+  if (trans.rows() != 4 || trans.cols() != 4)
+    vw_throw(ArgumentErr() << "Expecting a 4x4 transform, got a "
+             << trans.rows() << "x" << trans.cols() << " matrix.\n");
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++)
+      m_linear(row, col) = trans(row, col);
+    m_translation[row] = trans(row, 3);
+  }
+}
+
 vw::Vector3 asp::CsvConv::sort_parsed_vector3(CsvRecord const& csv) const {
   Vector3 ordered_csv;
   int count = 0;
@@ -783,6 +801,37 @@ vw::Vector3 asp::CsvConv::csv_to_geodetic(CsvRecord const& csv,
 }
 
 
+vw::Vector3 asp::CsvConv::csv_to_cartesian_and_lonlat(CsvRecord const& csv,
+                                                      vw::cartography::GeoReference const& geo,
+                                                      vw::Vector2 & lonlat) const {
+  Vector3 ordered_csv = sort_parsed_vector3(csv);
+
+  if (this->format == XYZ){
+    Vector3 llh = geo.datum().cartesian_to_geodetic(ordered_csv);
+    lonlat = Vector2(llh[0], llh[1]);
+    return ordered_csv; // already as xyz
+
+  }else if (this->format == EASTING_HEIGHT_NORTHING){
+    lonlat = geo.point_to_lonlat(Vector2(ordered_csv[0], ordered_csv[1]));
+    return geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], ordered_csv[2]));
+
+  }else if (this->format == HEIGHT_LAT_LON){
+    lonlat = Vector2(ordered_csv[0], ordered_csv[1]);
+    return geo.datum().geodetic_to_cartesian(ordered_csv);
+  }
+
+  // Handle asp::LAT_LON_RADIUS_M and asp::LAT_LON_RADIUS_KM
+  lonlat = Vector2(ordered_csv[0], ordered_csv[1]);
+  if (this->format == LAT_LON_RADIUS_KM)
+    ordered_csv[2] *= 1000.0; // now lon, lat, radius_m
+
+  Vector3 tmp = ordered_csv; tmp[2] = 0; // now lon, lat, 0
+  Vector3 xyz = geo.datum().geodetic_to_cartesian(tmp);
+
+  // Update the radius
+  return ordered_csv[2]*(xyz/norm_2(xyz));
+}
+
 vw::Vector2 asp::CsvConv::csv_to_lonlat(CsvRecord const& csv,
                                         vw::cartography::GeoReference const& geo) const {
   Vector3 ordered_csv = sort_parsed_vector3(csv);
@@ -25,6 +25,7 @@
 
 #include <string>
 #include <vw/Core/Functors.h>
+#include <vw/Image/ImageMath.h>
 #include <vw/Image/PerPixelViews.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/Matrix.h>
@@ -116,6 +117,14 @@ namespace asp {
     vw::Vector3 csv_to_geodetic(CsvRecord const& csv,
                                 vw::cartography::GeoReference const& geo) const;
 
+    /// Convert values read from a csv file using parse_csv_line to a
+    /// Cartesian point, and also find its lon/lat. This is faster than
+    /// calling csv_to_cartesian and csv_to_lonlat, as the projection is
+    /// applied only once.
+    vw::Vector3 csv_to_cartesian_and_lonlat(CsvRecord const& csv,
+                                            vw::cartography::GeoReference const& geo,
+                                            vw::Vector2 & lonlat) const;
+
     /// Convert values read from a csv file using parse_csv_line to a lon/lat point.
     vw::Vector2 csv_to_lonlat(CsvRecord const& csv,
                               vw::cartography::GeoReference const& geo) const;
@@ -314,6 +323,29 @@ namespace asp {
                                                          PointTransFunc(t));
   }
 
+  /// Imageview operation that applies a 4x4 transform in homogeneous
+  /// coordinates, such as produced by pc_align, to every point in the
+  /// image. The zero point, which signifies no-data, is kept as it is.
+  class PointAffineTransFunc : public vw::ReturnFixedType<vw::Vector3> {
+    vw::Matrix3x3 m_linear;
+    vw::Vector3   m_translation;
+  public:
+    PointAffineTransFunc(vw::Matrix<double> const& trans);
+    vw::Vector3 operator() (vw::Vector3 const& pt) const {
+      if (pt == vw::Vector3())
+        return pt;
+      return m_linear*pt + m_translation;
+    }
+  };
+
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, PointAffineTransFunc>
+  inline point_affine_transform( vw::ImageViewBase<ImageT> const& image,
+                                 vw::Matrix<double> const& t ) {
+    return vw::UnaryPerPixelView<ImageT, PointAffineTransFunc>(image.impl(),
+                                                               PointAffineTransFunc(t));
+  }
+
   /// Compute bounding box of the given cloud. If is_geodetic is false,
   /// that means a cloud of raw xyz cartesian values, then Vector3()
   /// signifies no-data. If is_geodetic is true, no-data is suggested
@@ -368,7 +400,7 @@ template<int m>
 vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename){
 
   vw::Vector3 shift;
-  std::string shift_str;
+  std::string shift_str, scale_str;
   boost::shared_ptr<vw::DiskImageResource> rsrc
     ( new vw::DiskImageResourceGDAL(filename) );
   if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str)){
@@ -379,6 +411,13 @@ vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const
   vw::ImageViewRef< vw::Vector<double, m> > out_image
     = vw::read_channels<m, double>(filename, 0);
 
+  // A cloud saved as integers must be scaled first. Zero stays zero.
+  if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_SCALE_TAG_STR, scale_str)){
+    double scale = atof(scale_str.c_str());
+    if (scale > 0.0)
+      out_image = out_image * scale;
+  }
+
   // Add the shift back to the first several channels.
   if (shift != vw::Vector3())
     out_image = subtract_shift(out_image, -shift);
@@ -0,0 +1,371 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PrefetchView.h
+///
+/// A view which reads its input ahead of when it is needed. The input
+/// is read in blocks that are kept in a bounded cache. When a region of
+/// the input is requested, it predicts the regions that the next tiles
+/// will request, assuming that block_write_gdal_image() rasterizes the
+/// output tiles row by row, and reads their blocks in background
+/// threads. The reads then overlap with processing the current tiles,
+/// which helps when the input is on a slow or network disk.
+
+#ifndef __ASP_CORE_PREFETCH_VIEW_H__
+#define __ASP_CORE_PREFETCH_VIEW_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace asp {
+
+  /// The input is read and cached in blocks of this size
+  const int PREFETCH_BLOCK_SIZE = 256;
+
+  namespace detail {
+
+    /// Orders block indices by row, then by column
+    struct BlockLess {
+      bool operator()(vw::Vector2i const& a, vw::Vector2i const& b) const {
+        if (a[1] != b[1]) return a[1] < b[1];
+        return a[0] < b[0];
+      }
+    };
+
+    /// The blocks of an image, read by the threads requesting them, or
+    /// ahead of time by a few background threads. Shared by all copies
+    /// of a PrefetchView.
+    template <class ImageT>
+    class PrefetchCache {
+    public:
+      typedef typename ImageT::pixel_type        PixelT;
+      typedef boost::shared_ptr<vw::ImageView<PixelT>> BlockPtr;
+
+      PrefetchCache(ImageT const& image, size_t max_blocks, int num_threads):
+        m_image(image), m_max_blocks(std::max(max_blocks, size_t(1))),
+        m_use_count(0), m_stop(false) {
+        for (int it = 0; it < std::max(num_threads, 1); it++)
+          m_threads.push_back(std::thread(&PrefetchCache::work, this));
+      }
+
+      ~PrefetchCache() {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_stop = true;
+          m_queue.clear();
+        }
+        m_cond.notify_all();
+        for (size_t it = 0; it < m_threads.size(); it++)
+          m_threads[it].join();
+      }
+
+      size_t max_blocks() const { return m_max_blocks; }
+
+      /// The pixels of a block. Wait if it is being read in the
+      /// background, and read it here if it is not cached.
+      BlockPtr get(vw::Vector2i const& block) {
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cond.wait(lock, [&]{ return m_in_progress.find(block) == m_in_progress.end(); });
+          auto it = m_blocks.find(block);
+          if (it != m_blocks.end()) {
+            it->second.last_use = m_use_count++;
+            return it->second.data;
+          }
+          m_in_progress.insert(block);
+        }
+
+        BlockPtr data;
+        try {
+          data = read_block(block);
+        } catch (...) {
+          finish(block, BlockPtr());
+          throw;
+        }
+        finish(block, data);
+        return data;
+      }
+
+      /// Read these blocks in the background, in this order, unless
+      /// already cached or being read. Older requests which were not
+      /// started yet are dropped, as the tiles which needed them are
+      /// being processed by now.
+      void prefetch(std::vector<vw::Vector2i> const& blocks) {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_queue.clear();
+          for (size_t it = 0; it < blocks.size(); it++) {
+            if (m_blocks.find(blocks[it]) == m_blocks.end() &&
+                m_in_progress.find(blocks[it]) == m_in_progress.end())
+              m_queue.push_back(blocks[it]);
+          }
+        }
+        m_cond.notify_all();
+      }
+
+    private:
+      BlockPtr read_block(vw::Vector2i const& block) {
+        vw::BBox2i box(block[0] * PREFETCH_BLOCK_SIZE, block[1] * PREFETCH_BLOCK_SIZE,
+                       PREFETCH_BLOCK_SIZE, PREFETCH_BLOCK_SIZE);
+        box.crop(vw::bounding_box(m_image));
+        BlockPtr data(new vw::ImageView<PixelT>(box.width(), box.height()));
+        *data = vw::crop(m_image, box);
+        return data;
+      }
+
+      // Cache a block which was read, or only forget that it is being
+      // read, if that failed
+      void finish(vw::Vector2i const& block, BlockPtr const& data) {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_in_progress.erase(block);
+          if (data) {
+            CachedBlock c;
+            c.data     = data;
+            c.last_use = m_use_count++;
+            m_blocks[block] = c;
+            evict();
+          }
+        }
+        m_cond.notify_all();
+      }
+
+      // Must hold the lock. Blocks still used by a tile are kept alive
+      // by their pointers.
+      void evict() {
+        while (m_blocks.size() > m_max_blocks) {
+          auto oldest = m_blocks.begin();
+          for (auto it = m_blocks.begin(); it != m_blocks.end(); it++) {
+            if (it->second.last_use < oldest->second.last_use)
+              oldest = it;
+          }
+          m_blocks.erase(oldest);
+        }
+      }
+
+      void work() {
+        while (1) {
+          vw::Vector2i block;
+          {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+            if (m_stop)
+              return;
+            block = m_queue.front();
+            m_queue.pop_front();
+            if (m_blocks.find(block) != m_blocks.end() ||
+                m_in_progress.find(block) != m_in_progress.end())
+              continue;
+            m_in_progress.insert(block);
+          }
+
+          // A failed read is only reported when the block is needed
+          BlockPtr data;
+          try {
+            data = read_block(block);
+          } catch (std::exception const& e) {
+            VW_OUT(vw::DebugMessage, "asp") << "Could not prefetch a block: "
+                                            << e.what() << "\n";
+          } catch (...) {
+            data.reset();
+          }
+          finish(block, data);
+        }
+      }
+
+      struct CachedBlock {
+        BlockPtr  data;
+        long long last_use;
+      };
+
+      ImageT                                            m_image;
+      size_t                                            m_max_blocks;
+      std::mutex                                        m_mutex;
+      std::condition_variable                           m_cond; // a request, a block, or stop
+      std::map<vw::Vector2i, CachedBlock, BlockLess>    m_blocks;
+      std::set<vw::Vector2i, BlockLess>                 m_in_progress;
+      std::deque<vw::Vector2i>                          m_queue;
+      long long                                         m_use_count;
+      bool                                              m_stop;
+      std::vector<std::thread>                          m_threads;
+    };
+
+  } // end namespace detail
+
+  /// Read the input ahead of the tiles of an output being written with
+  /// block_write_gdal_image(). The output has tiles of size tile_size
+  /// covering the region, in the pixel coordinates of this input.
+  /// When a region is requested, the same region shifted to each of the
+  /// next num_ahead output tiles is read in the background. Regions
+  /// which are larger than the cache are read directly.
+  template <class ImageT>
+  class PrefetchView: public vw::ImageViewBase<PrefetchView<ImageT>> {
+    typedef detail::PrefetchCache<ImageT> CacheT;
+
+    ImageT                     m_image;
+    vw::Vector2i               m_tile_size;
+    vw::BBox2i                 m_region;
+    int                        m_num_ahead;
+    boost::shared_ptr<CacheT>  m_cache;
+
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<PrefetchView> pixel_accessor;
+
+    PrefetchView(ImageT const& image, vw::Vector2i const& tile_size,
+                 vw::BBox2i const& region, int num_ahead, int num_threads):
+      m_image(image), m_tile_size(tile_size), m_region(region), m_num_ahead(num_ahead) {
+      if (m_tile_size[0] <= 0 || m_tile_size[1] <= 0 || m_region.empty())
+        vw::vw_throw(vw::ArgumentErr() << "Prefetching needs a positive tile size "
+                     << "and a non-empty region.\n");
+
+      // Keep the tiles being processed by each thread, and the tiles
+      // being read ahead, with a margin
+      int blocks_per_tile
+        = (m_tile_size[0] / PREFETCH_BLOCK_SIZE + 3) * (m_tile_size[1] / PREFETCH_BLOCK_SIZE + 3);
+      size_t max_blocks = size_t(blocks_per_tile) * (num_threads + num_ahead + 1);
+      m_cache.reset(new CacheT(image, max_blocks, 2));
+    }
+
+    inline vw::int32 cols  () const { return m_image.cols(); }
+    inline vw::int32 rows  () const { return m_image.rows(); }
+    inline vw::int32 planes() const { return m_image.planes(); }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p = 0) const {
+      return m_image(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+
+      std::vector<vw::Vector2i> blocks = blocks_of(bbox);
+      if (!vw::bounding_box(m_image).contains(bbox) ||
+          2 * blocks.size() > m_cache->max_blocks()) {
+        tile = vw::crop(m_image, bbox);
+        return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+      }
+
+      // Ask for the blocks of the next tiles before waiting for these
+      std::vector<vw::Vector2i> ahead;
+      std::set<vw::Vector2i, detail::BlockLess> seen(blocks.begin(), blocks.end());
+      std::vector<vw::BBox2i> next = predicted_regions(bbox);
+      for (size_t it = 0; it < next.size(); it++) {
+        std::vector<vw::Vector2i> next_blocks = blocks_of(next[it]);
+        for (size_t b = 0; b < next_blocks.size(); b++) {
+          if (seen.insert(next_blocks[b]).second)
+            ahead.push_back(next_blocks[b]);
+        }
+      }
+      m_cache->prefetch(ahead);
+
+      for (size_t it = 0; it < blocks.size(); it++) {
+        typename CacheT::BlockPtr data = m_cache->get(blocks[it]);
+        vw::BBox2i block_box(blocks[it][0] * PREFETCH_BLOCK_SIZE,
+                             blocks[it][1] * PREFETCH_BLOCK_SIZE,
+                             data->cols(), data->rows());
+        vw::BBox2i box = block_box;
+        box.crop(bbox);
+        vw::crop(tile, box - bbox.min()) = vw::crop(*data, box - block_box.min());
+      }
+
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+
+  private:
+    std::vector<vw::Vector2i> blocks_of(vw::BBox2i const& bbox) const {
+      std::vector<vw::Vector2i> blocks;
+      if (bbox.empty())
+        return blocks;
+      for (int r = bbox.min().y() / PREFETCH_BLOCK_SIZE;
+           r <= (bbox.max().y() - 1) / PREFETCH_BLOCK_SIZE; r++) {
+        for (int c = bbox.min().x() / PREFETCH_BLOCK_SIZE;
+             c <= (bbox.max().x() - 1) / PREFETCH_BLOCK_SIZE; c++)
+          blocks.push_back(vw::Vector2i(c, r));
+      }
+      return blocks;
+    }
+
+    // Find the output tile whose region this likely is, from its
+    // center, as the region may be the tile with a margin, or shifted
+    // by the disparity. Shift the region to the tiles coming after it.
+    std::vector<vw::BBox2i> predicted_regions(vw::BBox2i const& bbox) const {
+      int num_cols = (m_region.width()  + m_tile_size[0] - 1) / m_tile_size[0];
+      int num_rows = (m_region.height() + m_tile_size[1] - 1) / m_tile_size[1];
+      double cx = 0.5 * (bbox.min().x() + bbox.max().x()) - m_region.min().x();
+      double cy = 0.5 * (bbox.min().y() + bbox.max().y()) - m_region.min().y();
+      int i = std::min(std::max(int(floor(cx / m_tile_size[0])), 0), num_cols - 1);
+      int j = std::min(std::max(int(floor(cy / m_tile_size[1])), 0), num_rows - 1);
+
+      std::vector<vw::BBox2i> regions;
+      for (int k = 1; k <= m_num_ahead; k++) {
+        long long index = (long long)j * num_cols + i + k;
+        if (index >= (long long)num_cols * num_rows)
+          break;
+        int ni = int(index % num_cols), nj = int(index / num_cols);
+        vw::BBox2i next = bbox + vw::Vector2i((ni - i) * m_tile_size[0],
+                                              (nj - j) * m_tile_size[1]);
+        next.crop(vw::bounding_box(m_image));
+        if (!next.empty())
+          regions.push_back(next);
+      }
+      return regions;
+    }
+  };
+
+  /// Read the image ahead of the tiles of an output, as in PrefetchView.
+  /// With num_ahead of zero or less, the image is returned as is.
+  template <class ImageT>
+  vw::ImageViewRef<typename ImageT::pixel_type>
+  prefetch_view(ImageT const& image, vw::Vector2i const& tile_size,
+                vw::BBox2i const& region, int num_ahead, int num_threads) {
+    if (num_ahead <= 0)
+      return image;
+    return PrefetchView<ImageT>(image, tile_size, region, num_ahead, num_threads);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PREFETCH_VIEW_H__
@@ -0,0 +1,295 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/StageTiming.h>
+
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Exception.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace asp {
+
+  namespace {
+
+    // Label values must have backslashes, quotes, and newlines escaped
+    std::string escape_label(std::string const& val) {
+      std::string out;
+      for (char c: val) {
+        if (c == '\\')
+          out += "\\\\";
+        else if (c == '"')
+          out += "\\\"";
+        else if (c == '\n')
+          out += "\\n";
+        else
+          out += c;
+      }
+      return out;
+    }
+
+    std::string host_name() {
+      char host[256];
+      if (gethostname(host, sizeof(host)) != 0)
+        return "";
+      host[sizeof(host) - 1] = '\0';
+      return host;
+    }
+
+    // Resident memory in bytes, from /proc/self/statm, or -1 if unknown
+    double resident_bytes() {
+      std::ifstream ifs("/proc/self/statm");
+      double size = 0, resident = 0;
+      if (!(ifs >> size >> resident))
+        return -1.0;
+      return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    // Print a metric with its help and type lines, once per value
+    void add_metric(std::ostringstream & os, std::string const& name,
+                    std::string const& type, std::string const& help,
+                    std::string const& labels,
+                    std::map<std::string, double> const& values) {
+      if (values.empty())
+        return;
+      os << "# HELP " << name << " " << help << "\n";
+      os << "# TYPE " << name << " " << type << "\n";
+      for (auto const& it: values) {
+        os << name << "{" << labels;
+        if (!it.first.empty())
+          os << ",task=\"" << escape_label(it.first) << "\"";
+        os << "} " << it.second << "\n";
+      }
+    }
+
+    void add_metric(std::ostringstream & os, std::string const& name,
+                    std::string const& type, std::string const& help,
+                    std::string const& labels, double value) {
+      std::map<std::string, double> values;
+      values[""] = value;
+      add_metric(os, name, type, help, labels, values);
+    }
+  }
+
+  ProcessMetrics::ProcessMetrics(): m_enabled(false), m_pid(0), m_period(15.0),
+                                    m_start_time(vw::Stopwatch::microtime()),
+                                    m_finished(false), m_have_solver(false),
+                                    m_iteration(0), m_cost(0.0), m_stop(false) {}
+
+  ProcessMetrics::~ProcessMetrics() {
+    stop();
+  }
+
+  void ProcessMetrics::start(std::string const& file, std::string const& tool,
+                             double period) {
+    if (m_enabled)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_file   = file;
+      m_tool   = tool;
+      m_host   = host_name();
+      m_pid    = getpid();
+      m_start_time = vw::Stopwatch::microtime();
+      m_period = std::max(period, 0.1);
+    }
+
+    vw::create_out_dir(file);
+    m_stop = false;
+    m_enabled = true;
+    m_thread = std::thread(&ProcessMetrics::run, this);
+  }
+
+  void ProcessMetrics::run() {
+    std::unique_lock<std::mutex> lock(m_thread_mutex);
+    while (!m_stop) {
+      m_cond.wait_for(lock, std::chrono::duration<double>(m_period),
+                      [this] { return m_stop; });
+      if (m_stop)
+        break;
+      lock.unlock();
+      try {
+        write();
+      } catch (...) {
+        // Failing to save the metrics must not end the run
+      }
+      lock.lock();
+    }
+  }
+
+  void ProcessMetrics::stop() {
+    if (!m_enabled)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(m_thread_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+      m_thread.join();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_finished = true;
+    }
+    try {
+      write();
+    } catch (...) {}
+    m_enabled = false;
+  }
+
+  void ProcessMetrics::set_progress(std::string const& task, double ratio,
+                                    double pixels_per_second) {
+    if (!m_enabled)
+      return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_progress[task] = ratio;
+    if (pixels_per_second > 0)
+      m_pixel_rate[task] = pixels_per_second;
+  }
+
+  void ProcessMetrics::add_tiles(std::string const& task, int num_tiles) {
+    if (!m_enabled)
+      return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tiles[task] += num_tiles;
+  }
+
+  void ProcessMetrics::set_solver_state(int iteration, double cost) {
+    if (!m_enabled)
+      return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_have_solver = true;
+    m_iteration = iteration;
+    m_cost = cost;
+  }
+
+  std::string ProcessMetrics::text() const {
+
+    double bytes_read = -1, bytes_written = -1;
+    bool have_io = process_io_bytes(bytes_read, bytes_written);
+    double resident = resident_bytes();
+    double peak = peak_rss_mb();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::ostringstream labels;
+    labels << "tool=\"" << escape_label(m_tool) << "\",host=\"" << escape_label(m_host)
+           << "\",pid=\"" << m_pid << "\"";
+    std::string l = labels.str();
+
+    std::ostringstream os;
+    os << std::setprecision(12);
+    add_metric(os, "asp_up", "gauge", "1 while the tool runs, 0 once it exited.",
+               l, m_finished ? 0 : 1);
+    add_metric(os, "asp_uptime_seconds", "gauge", "Time since the tool started.",
+               l, (vw::Stopwatch::microtime() - m_start_time) / 1.0e+6);
+    if (resident >= 0)
+      add_metric(os, "asp_resident_memory_bytes", "gauge", "Resident memory.", l, resident);
+    if (peak >= 0)
+      add_metric(os, "asp_peak_resident_memory_bytes", "gauge", "Peak resident memory.",
+                 l, peak * 1024.0 * 1024.0);
+    if (have_io) {
+      add_metric(os, "asp_read_bytes_total", "counter", "Bytes read from storage.",
+                 l, bytes_read);
+      add_metric(os, "asp_written_bytes_total", "counter", "Bytes written to storage.",
+                 l, bytes_written);
+    }
+    add_metric(os, "asp_progress_ratio", "gauge", "Fraction done of a task.",
+               l, m_progress);
+    add_metric(os, "asp_pixels_per_second", "gauge", "Pixels processed per second by a task.",
+               l, m_pixel_rate);
+    add_metric(os, "asp_tiles_done_total", "counter", "Tiles done by a task.",
+               l, m_tiles);
+    if (m_have_solver) {
+      add_metric(os, "asp_solver_iteration", "gauge", "Iteration of the solver.",
+                 l, m_iteration);
+      add_metric(os, "asp_solver_cost", "gauge", "Cost function at that iteration.",
+                 l, m_cost);
+    }
+    return os.str();
+  }
+
+  void ProcessMetrics::write() const {
+    std::string file;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      file = m_file;
+    }
+    if (file.empty())
+      return;
+
+    std::string tmp_file = file + ".tmp";
+    {
+      std::ofstream ofs(tmp_file.c_str());
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Cannot write: " << tmp_file << "\n");
+      ofs << text();
+    }
+    if (std::rename(tmp_file.c_str(), file.c_str()) != 0)
+      vw::vw_throw(vw::IOErr() << "Cannot rename " << tmp_file << " to: " << file << "\n");
+  }
+
+  ProcessMetrics & process_metrics() {
+    static ProcessMetrics metrics;
+    return metrics;
+  }
+
+  void start_metrics_from_env(std::string const& tool) {
+    char * dir = getenv("ASP_METRICS_DIR");
+    if (dir == NULL || std::string(dir).empty())
+      return;
+
+    double period = 15.0;
+    char * period_str = getenv("ASP_METRICS_PERIOD");
+    if (period_str != NULL && atof(period_str) > 0)
+      period = atof(period_str);
+
+    std::ostringstream file;
+    file << dir << "/" << tool << "-" << host_name() << "-" << getpid() << ".prom";
+    process_metrics().start(file.str(), tool, period);
+  }
+
+  MetricsProgressCallback::MetricsProgressCallback(std::string const& task, double num_pixels,
+                                                   std::string const& pre_progress_text):
+    vw::TerminalProgressCallback("asp", pre_progress_text),
+    m_task(task), m_num_pixels(num_pixels), m_start_time(vw::Stopwatch::microtime()) {}
+
+  void MetricsProgressCallback::report_progress(double progress) const {
+    vw::TerminalProgressCallback::report_progress(progress);
+
+    if (!process_metrics().enabled())
+      return;
+    double elapsed = (vw::Stopwatch::microtime() - m_start_time) / 1.0e+6;
+    double rate = 0.0;
+    if (elapsed > 0 && m_num_pixels > 0)
+      rate = progress * m_num_pixels / elapsed;
+    process_metrics().set_progress(m_task, progress, rate);
+  }
+
+} // end namespace asp
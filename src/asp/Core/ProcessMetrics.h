@@ -0,0 +1,113 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file ProcessMetrics.h
+///
+/// Progress and throughput of a long-running tool, saved periodically
+/// in the Prometheus text format, so that runs on a cluster can be
+/// watched with node_exporter's textfile collector or any scraper
+/// reading such files. Enabled by setting the environment variable
+/// ASP_METRICS_DIR. Then <dir>/<tool>-<host>-<pid>.prom is rewritten
+/// every ASP_METRICS_PERIOD seconds (default 15), and once more when
+/// the tool exits.
+
+#ifndef __ASP_CORE_PROCESS_METRICS_H__
+#define __ASP_CORE_PROCESS_METRICS_H__
+
+#include <vw/Core/ProgressCallback.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace asp {
+
+  class ProcessMetrics {
+  public:
+    ProcessMetrics();
+    ~ProcessMetrics();
+
+    // Rewrite the metrics file every 'period' seconds in a background
+    // thread. Does nothing if already started.
+    void start(std::string const& file, std::string const& tool, double period);
+
+    // Stop the background thread and write the file a last time
+    void stop();
+
+    // Updates are ignored unless started
+    bool enabled() const { return m_enabled; }
+
+    // The fraction done of a task, and the pixels processed per second
+    void set_progress(std::string const& task, double ratio, double pixels_per_second);
+
+    // Add to the number of tiles done for a task
+    void add_tiles(std::string const& task, int num_tiles);
+
+    // The iteration and cost of the solver
+    void set_solver_state(int iteration, double cost);
+
+    // The metrics in the Prometheus text format
+    std::string text() const;
+
+    // Write the metrics file, via a temporary file, so a reader never
+    // sees a partial file
+    void write() const;
+
+  private:
+    void run();
+
+    std::atomic<bool> m_enabled;
+    std::string m_file, m_tool, m_host;
+    int m_pid;
+    double m_period, m_start_time;
+    bool m_finished, m_have_solver;
+    int m_iteration;
+    double m_cost;
+    std::map<std::string, double> m_progress, m_pixel_rate, m_tiles;
+    mutable std::mutex m_mutex;
+
+    std::thread m_thread;
+    std::mutex m_thread_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+  };
+
+  /// The metrics of this process
+  ProcessMetrics & process_metrics();
+
+  /// Start the metrics of this process if ASP_METRICS_DIR is set
+  void start_metrics_from_env(std::string const& tool);
+
+  /// A terminal progress callback which also reports to the metrics
+  /// of this process the progress of the given task, and, given the
+  /// number of pixels to process, the pixels per second.
+  class MetricsProgressCallback: public vw::TerminalProgressCallback {
+  public:
+    MetricsProgressCallback(std::string const& task, double num_pixels,
+                            std::string const& pre_progress_text);
+    virtual void report_progress(double progress) const;
+  private:
+    std::string m_task;
+    double m_num_pixels, m_start_time;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_PROCESS_METRICS_H__
@@ -0,0 +1,153 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file QuantileSketch.cc
+///
+
+#include <asp/Core/QuantileSketch.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace asp {
+
+QuantileSketch::QuantileSketch(int level_size):
+  m_level_size(std::max(level_size, 2)), m_count(0),
+  m_min(std::numeric_limits<double>::max()),
+  m_max(-std::numeric_limits<double>::max()) {}
+
+void QuantileSketch::add(double val) {
+  if (std::isnan(val))
+    return;
+
+  m_count++;
+  m_min = std::min(m_min, val);
+  m_max = std::max(m_max, val);
+
+  if (m_levels.empty()) {
+    m_levels.resize(1);
+    m_offsets.resize(1, 0);
+  }
+  m_levels[0].push_back(val);
+  if (int(m_levels[0].size()) >= m_level_size)
+    compress(0);
+}
+
+void QuantileSketch::merge(QuantileSketch const& other) {
+  if (other.m_count == 0)
+    return;
+
+  m_count += other.m_count;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+
+  if (m_levels.size() < other.m_levels.size()) {
+    m_levels.resize(other.m_levels.size());
+    m_offsets.resize(other.m_levels.size(), 0);
+  }
+  for (size_t level = 0; level < other.m_levels.size(); level++)
+    m_levels[level].insert(m_levels[level].end(),
+                           other.m_levels[level].begin(), other.m_levels[level].end());
+
+  // Compress from the bottom up, as that adds values to the levels above
+  for (size_t level = 0; level < m_levels.size(); level++) {
+    if (int(m_levels[level].size()) >= m_level_size)
+      compress(level);
+  }
+}
+
+// Sort the values at this level and move every other one up a level.
+// With an odd number of values, the largest one stays.
+void QuantileSketch::compress(int level) {
+
+  if (int(m_levels.size()) <= level + 1) {
+    m_levels.resize(level + 2);
+    m_offsets.resize(level + 2, 0);
+  }
+
+  std::vector<double> & vals = m_levels[level];
+  std::sort(vals.begin(), vals.end());
+  int num_pairs = vals.size() / 2;
+  int offset = m_offsets[level];
+  m_offsets[level] = 1 - offset;
+  for (int it = 0; it < num_pairs; it++)
+    m_levels[level + 1].push_back(vals[2 * it + offset]);
+
+  if (vals.size() % 2 == 1) {
+    double last = vals.back();
+    vals.clear();
+    vals.push_back(last);
+  } else {
+    vals.clear();
+  }
+
+  if (int(m_levels[level + 1].size()) >= m_level_size)
+    compress(level + 1);
+}
+
+double QuantileSketch::quantile(double q) const {
+  if (m_count == 0)
+    vw::vw_throw(vw::ArgumentErr() << "QuantileSketch: no values.\n");
+
+  if (q <= 0.0) return m_min;
+  if (q >= 1.0) return m_max;
+
+  // The values with their weights, sorted
+  std::vector<std::pair<double, double>> vals;
+  double total = 0.0;
+  for (size_t level = 0; level < m_levels.size(); level++) {
+    double weight = std::ldexp(1.0, level);
+    for (size_t it = 0; it < m_levels[level].size(); it++) {
+      vals.push_back(std::make_pair(m_levels[level][it], weight));
+      total += weight;
+    }
+  }
+  std::sort(vals.begin(), vals.end());
+
+  // Find the first value with more than q * total weight up to and
+  // including it
+  double target = q * total, sum = 0.0;
+  for (size_t it = 0; it < vals.size(); it++) {
+    sum += vals[it].second;
+    if (sum > target)
+      return std::min(std::max(vals[it].first, m_min), m_max);
+  }
+
+  return m_max;
+}
+
+bool find_outlier_brackets(QuantileSketch const& sketch,
+                           double pct, double outlier_factor,
+                           double & b, double & e) {
+  b = 0.0; e = 0.0;
+  if (sketch.empty())
+    return false;
+
+  b = sketch.quantile(1.0 - pct);
+  e = sketch.quantile(pct);
+  double d = std::max(e - b, 0.0);
+  b = std::max(b - outlier_factor * d, sketch.min_val());
+  e = std::min(e + outlier_factor * d, sketch.max_val());
+
+  return true;
+}
+
+} // end namespace asp
@@ -0,0 +1,82 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file QuantileSketch.h
+///
+/// A streaming quantile sketch, as in Karnin, Lang, and Liberty (2016),
+/// in bounded memory. Values are kept in levels, with the values at
+/// level i standing for 2^i values each. When a level is full, it is
+/// sorted and every other value moves up a level. Sketches of parts of
+/// a dataset can be merged. The rank of a returned quantile is off by
+/// about n * log2(n/k) / k at most, for n values and k values per level,
+/// and much less in practice. The values are compacted in a fixed
+/// pattern, so adding and merging in the same order gives the same
+/// result.
+
+#ifndef __ASP_CORE_QUANTILE_SKETCH_H__
+#define __ASP_CORE_QUANTILE_SKETCH_H__
+
+#include <cstdint>
+#include <vector>
+
+namespace asp {
+
+  class QuantileSketch {
+  public:
+
+    /// Keep up to this many values at each level
+    QuantileSketch(int level_size = 256);
+
+    /// Add a value. NaN values are ignored.
+    void add(double val);
+
+    /// Add the values of another sketch
+    void merge(QuantileSketch const& other);
+
+    /// The number of values added
+    std::uint64_t count() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    /// The exact smallest and largest values added
+    double min_val() const { return m_min; }
+    double max_val() const { return m_max; }
+
+    /// The value with about q * count() values below it, for q in [0, 1].
+    /// Must not be empty.
+    double quantile(double q) const;
+
+  private:
+    void compress(int level);
+
+    int m_level_size;
+    std::uint64_t m_count;
+    double m_min, m_max;
+    std::vector<std::vector<double>> m_levels;
+    std::vector<int> m_offsets; // alternates the values kept at each level
+  };
+
+  /// Find the range of values without outliers. It is between the
+  /// quantiles at 1 - pct and pct (pct is such as 0.75), extended on each
+  /// side by outlier_factor (such as 3.0) times its length, and clamped
+  /// to the range of the values. Return false if the sketch is empty.
+  bool find_outlier_brackets(QuantileSketch const& sketch,
+                             double pct, double outlier_factor,
+                             double & b, double & e);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_QUANTILE_SKETCH_H__
@@ -46,6 +46,7 @@
 #include <vw/Core/FundamentalTypes.h>
 #include <asp/Core/SoftwareRenderer.h>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -516,6 +517,23 @@ FillSubTriangle(GraphicsState *gc,  int iyBottom, int iyTop)
   gc->rasterInfo.ixRightFrac = ixRightFrac;
 }
 
+// Whether the triangle is certainly outside the clip box. The spans
+// of a triangle stay within a pixel of its bounding box, so this does
+// not change what is drawn. The rasterizer walks all the rows of a
+// triangle even where they are clipped, and the triangles of the
+// point cloud blocks rendered for a tile are mostly outside of it, so
+// rejecting them upfront saves most of the time.
+static bool OutsideClip(const GraphicsState *gc,
+                        const Vertex *a, const Vertex *b, const Vertex *c) {
+  const RealT margin = 2.0;
+  RealT minX = std::min(a->window.x, std::min(b->window.x, c->window.x));
+  RealT maxX = std::max(a->window.x, std::max(b->window.x, c->window.x));
+  RealT minY = std::min(a->window.y, std::min(b->window.y, c->window.y));
+  RealT maxY = std::max(a->window.y, std::max(b->window.y, c->window.y));
+  return (maxX + margin < gc->clipX0 || minX - margin > gc->clipX1 ||
+          maxY + margin < gc->clipY0 || minY - margin > gc->clipY1);
+}
+
 static void FillTriangle(GraphicsState *gc, Vertex *a, Vertex *b, Vertex *c) {
   RealT area, oneOverArea, t1, t2, t3, t4;
   RealT dxAC, dxBC, dyAC, dyBC;
@@ -526,6 +544,9 @@ static void FillTriangle(GraphicsState *gc, Vertex *a, Vertex *b, Vertex *c) {
   unsigned int modeFlags;
   bool ccw;                             // was a float for some reason
 
+  if (OutsideClip(gc, a, b, c))
+    return;
+
   // Sort vertices in y.
   SortVertices(a, b, c);
 
@@ -0,0 +1,273 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SparseDisparity.cc
+///
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/SparseDisparity.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace vw;
+
+namespace asp {
+
+  // Find a template in a search region with normalized cross-correlation.
+  // OpenCV does this in the frequency domain when the region is large.
+  // Return the position of the template in the region, or false if the
+  // template has no texture or the best score is too low.
+  bool match_template(ImageView<float> & templ, ImageView<float> & region,
+                      double min_sigma, double min_score, Vector2i & loc) {
+
+    if (templ.cols() > region.cols() || templ.rows() > region.rows())
+      return false;
+
+    cv::Mat cv_templ(templ.rows(), templ.cols(), CV_32F, templ.data());
+    cv::Mat cv_region(region.rows(), region.cols(), CV_32F, region.data());
+
+    cv::Scalar mean, sigma;
+    cv::meanStdDev(cv_templ, mean, sigma);
+    if (sigma[0] <= min_sigma)
+      return false;
+
+    cv::Mat score;
+    cv::matchTemplate(cv_region, cv_templ, score, cv::TM_CCOEFF_NORMED);
+
+    double max_score = 0.0;
+    cv::Point max_loc;
+    cv::minMaxLoc(score, NULL, &max_score, NULL, &max_loc);
+    if (!(max_score >= min_score)) // also catches NaN
+      return false;
+
+    loc = Vector2i(max_loc.x, max_loc.y);
+    return true;
+  }
+
+  /// Low-resolution disparity from sparse template matching. Each tile
+  /// reads only the parts of the images it needs, so the full images
+  /// never have to be in memory, and tiles are processed in parallel.
+  class SparseDisparityView: public ImageViewBase<SparseDisparityView> {
+    DiskImageView<float> m_left_sub, m_right_sub;
+    ImageViewRef<float>  m_left, m_right;
+    DiskImageView<uint8> m_left_mask_sub;
+    Vector2   m_downsample_scale;
+    BBox2i    m_search_range_sub;
+    int       m_pixel_sample;
+    int       m_half_template;
+    ImageView<PixelMask<Vector2i>> & m_disparity_spread;
+
+  public:
+    SparseDisparityView(DiskImageView<float> const& left_sub,
+                        DiskImageView<float> const& right_sub,
+                        ImageViewRef<float>  const& left,
+                        ImageViewRef<float>  const& right,
+                        DiskImageView<uint8> const& left_mask_sub,
+                        Vector2 const& downsample_scale,
+                        BBox2i const& search_range_sub,
+                        int pixel_sample, int half_template,
+                        ImageView<PixelMask<Vector2i>> & disparity_spread):
+      m_left_sub(left_sub), m_right_sub(right_sub),
+      m_left(left), m_right(right), m_left_mask_sub(left_mask_sub),
+      m_downsample_scale(downsample_scale),
+      m_search_range_sub(search_range_sub),
+      m_pixel_sample(pixel_sample), m_half_template(half_template),
+      m_disparity_spread(disparity_spread) {}
+
+    // Image View interface
+    typedef PixelMask<Vector2f> pixel_type;
+    typedef pixel_type result_type;
+    typedef ProceduralPixelAccessor<SparseDisparityView> pixel_accessor;
+
+    inline int32 cols  () const { return m_left_sub.cols(); }
+    inline int32 rows  () const { return m_left_sub.rows(); }
+    inline int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline pixel_type operator()(double /*i*/, double /*j*/, int32 /*p*/ = 0) const {
+      vw_throw(NoImplErr() << "SparseDisparityView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef CropView<ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+      prerasterize_type lowres_disparity
+        = prerasterize_type(ImageView<pixel_type>(bbox.width(), bbox.height()),
+                            -bbox.min().x(), -bbox.min().y(), cols(), rows());
+
+      for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+        for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
+          lowres_disparity(col, row).invalidate();
+          m_disparity_spread(col, row).invalidate();
+        }
+      }
+
+      const double min_sigma = 1e-4; // skip templates with no texture
+      const double min_score = 0.5;  // minimum normalized correlation
+
+      // The template in the subsampled images covers about the same
+      // ground as the one at full resolution.
+      double mean_scale = (m_downsample_scale[0] + m_downsample_scale[1]) / 2.0;
+      int half_sub = std::max(3, int(round(m_half_template * mean_scale)));
+
+      // How far the full-resolution refinement searches around the
+      // upsampled coarse match. Recorded as the spread of the result.
+      Vector2i refine_pad(int(ceil(1.0/m_downsample_scale[0])) + 1,
+                          int(ceil(1.0/m_downsample_scale[1])) + 1);
+      Vector2i coarse_spread(ceil(m_downsample_scale[0] * refine_pad[0]),
+                             ceil(m_downsample_scale[1] * refine_pad[1]));
+
+      // Read in memory the parts of the subsampled images for this tile
+      BBox2i left_box = bbox;
+      left_box.expand(half_sub);
+      left_box.crop(bounding_box(m_left_sub));
+      BBox2i right_box(left_box.min() + m_search_range_sub.min(),
+                       left_box.max() + m_search_range_sub.max());
+      right_box.crop(bounding_box(m_right_sub));
+      if (left_box.empty() || right_box.empty())
+        return lowres_disparity;
+
+      ImageView<float> left_tile  = crop(m_left_sub,  left_box);
+      ImageView<float> right_tile = crop(m_right_sub, right_box);
+      ImageView<uint8> mask_tile  = crop(m_left_mask_sub, bbox);
+
+      for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+        if (row % m_pixel_sample != 0) continue;
+
+        for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
+          if (col % m_pixel_sample != 0) continue;
+
+          if (mask_tile(col - bbox.min().x(), row - bbox.min().y()) == 0)
+            continue;
+
+          // Coarse match in the subsampled images
+          BBox2i templ_box(Vector2i(col - half_sub, row - half_sub),
+                           Vector2i(col + half_sub + 1, row + half_sub + 1));
+          if (!left_box.contains(templ_box))
+            continue;
+          BBox2i region_box(templ_box.min() + m_search_range_sub.min(),
+                            templ_box.max() + m_search_range_sub.max());
+          region_box.crop(right_box);
+          if (region_box.empty())
+            continue;
+
+          ImageView<float> templ  = crop(left_tile,  templ_box  - left_box.min());
+          ImageView<float> region = crop(right_tile, region_box - right_box.min());
+          Vector2i loc;
+          if (!match_template(templ, region, min_sigma, min_score, loc))
+            continue;
+
+          Vector2 disp_sub(region_box.min() + loc - templ_box.min());
+          lowres_disparity(col, row) = pixel_type(Vector2f(disp_sub));
+          m_disparity_spread(col, row) = PixelMask<Vector2i>(coarse_spread);
+
+          // Refine at full resolution, where the texture was not
+          // smoothed away by subsampling.
+          Vector2i left_pix(round(elem_quot(Vector2(col, row), m_downsample_scale)));
+          Vector2i right_pix(left_pix + round(elem_quot(disp_sub, m_downsample_scale)));
+          Vector2i half(m_half_template, m_half_template);
+          BBox2i full_templ_box(left_pix - half, left_pix + half + Vector2i(1, 1));
+          BBox2i full_region_box(right_pix - half - refine_pad,
+                                 right_pix + half + refine_pad + Vector2i(1, 1));
+          if (!bounding_box(m_left).contains(full_templ_box) ||
+              !bounding_box(m_right).contains(full_region_box))
+            continue;
+
+          ImageView<float> full_templ  = crop(m_left,  full_templ_box);
+          ImageView<float> full_region = crop(m_right, full_region_box);
+          if (!match_template(full_templ, full_region, min_sigma, min_score, loc))
+            continue;
+
+          Vector2 disp(full_region_box.min() + loc - full_templ_box.min());
+          lowres_disparity(col, row) = pixel_type(Vector2f(elem_prod(disp, m_downsample_scale)));
+          m_disparity_spread(col, row) = PixelMask<Vector2i>(Vector2i(1, 1));
+        }
+      }
+
+      return lowres_disparity;
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  void produce_sparse_disparity(ASPGlobalOptions & opt,
+                                BBox2 const& search_range_sub) {
+
+    DiskImageView<float> left_sub (opt.out_prefix + "-L_sub.tif"),
+      right_sub(opt.out_prefix + "-R_sub.tif");
+    // These may be produced on the fly with --skip-aligned-image-files
+    ImageViewRef<float> left  = asp::read_aligned_image(opt.out_prefix, true);
+    ImageViewRef<float> right = asp::read_aligned_image(opt.out_prefix, false);
+    DiskImageView<uint8> left_mask_sub(opt.out_prefix + "-lMask_sub.tif");
+
+    Vector2 downsample_scale(double(left_sub.cols()) / double(left.cols()),
+                             double(left_sub.rows()) / double(left.rows()));
+
+    BBox2i search_range(floor(search_range_sub.min()), ceil(search_range_sub.max()));
+    vw_out() << "D_sub search range: " << search_range << " px\n";
+
+    // Skip pixels to speed things up, as for the DEM-based disparity.
+    // The template size is the same as the default in sparse_disp.
+    int pixel_sample = 2;
+    int half_template = 28;
+
+    // Small tiles keep the search region read for each tile small
+    Vector2 orig_tile_size = opt.raster_tile_size;
+    opt.raster_tile_size = Vector2i(64, 64);
+
+    // This image is small enough that we can keep it in memory
+    ImageView<PixelMask<Vector2i>> disparity_spread(left_sub.cols(), left_sub.rows());
+
+    SparseDisparityView lowres_disparity(left_sub, right_sub, left, right, left_mask_sub,
+                                         downsample_scale, search_range,
+                                         pixel_sample, half_template, disparity_spread);
+
+    std::string disparity_file = opt.out_prefix + "-D_sub.tif";
+    vw_out() << "Writing low-resolution disparity: " << disparity_file << "\n";
+    vw::cartography::block_write_gdal_image(disparity_file,
+                                            lowres_disparity,
+                                            opt,
+                                            TerminalProgressCallback
+                                            ("asp", "\t--> Low-resolution disparity:"));
+
+    std::string disp_spread_file = opt.out_prefix + "-D_sub_spread.tif";
+    vw_out() << "Writing low-resolution disparity spread: " << disp_spread_file << "\n";
+    vw::cartography::block_write_gdal_image(disp_spread_file,
+                                            disparity_spread,
+                                            opt,
+                                            TerminalProgressCallback
+                                            ("asp", "\t--> Low-resolution disparity spread:"));
+
+    // Go back to the original tile size
+    opt.raster_tile_size = orig_tile_size;
+  }
+
+}
@@ -0,0 +1,44 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SparseDisparity.h
+///
+/// In-process replacement for the sparse_disp tool (corr-seed-mode 3).
+/// Templates on a sparse grid are matched with normalized cross-correlation,
+/// first in the subsampled images and then refined at full resolution.
+
+#ifndef __ASP_CORE_SPARSE_DISPARITY_H__
+#define __ASP_CORE_SPARSE_DISPARITY_H__
+
+#include <vw/Math/BBox.h>
+
+// Forward declaration
+namespace asp {
+  struct ASPGlobalOptions;
+}
+
+namespace asp {
+
+  /// Produce D_sub and D_sub_spread by sparse template matching. The
+  /// search range is in the subsampled image pixels.
+  void produce_sparse_disparity(ASPGlobalOptions & opt,
+                                vw::BBox2 const& search_range_sub);
+
+}
+
+#endif // __ASP_CORE_SPARSE_DISPARITY_H__
@@ -0,0 +1,159 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/StageTiming.h>
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Exception.h>
+#include <vw/FileIO/FileUtils.h>
+
+#include <sys/resource.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace asp {
+
+  StageTiming::StageTiming(): m_stage("stereo"), m_init_time(vw::Stopwatch::microtime()) {}
+
+  void StageTiming::set_stage(std::string const& stage) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stage = stage;
+  }
+
+  void StageTiming::start(std::string const& span) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_spans.find(span);
+    if (it == m_spans.end()) {
+      m_names.push_back(span);
+      Span s;
+      s.total = 0.0; s.count = 0; s.running = false;
+      it = m_spans.insert(std::make_pair(span, s)).first;
+    }
+    // Starting a running span again, as with nested scopes of the
+    // same name, is a no-op, so that time is not counted twice.
+    if (it->second.running)
+      return;
+    it->second.running = true;
+    it->second.start = vw::Stopwatch::microtime();
+  }
+
+  void StageTiming::stop(std::string const& span) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_spans.find(span);
+    if (it == m_spans.end() || !it->second.running)
+      return;
+    it->second.running = false;
+    it->second.total += (vw::Stopwatch::microtime() - it->second.start) / 1.0e+6;
+    it->second.count++;
+  }
+
+  void StageTiming::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_names.clear();
+    m_spans.clear();
+    m_init_time = vw::Stopwatch::microtime();
+  }
+
+  double StageTiming::elapsed(std::string const& span) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_spans.find(span);
+    if (it == m_spans.end())
+      return 0.0;
+    return it->second.total;
+  }
+
+  std::string StageTiming::timing_file(std::string const& out_prefix) const {
+    return out_prefix + "-" + m_stage + "-timing.json";
+  }
+
+  void StageTiming::write(std::string const& out_prefix) const {
+
+    std::string file = timing_file(out_prefix);
+
+    double bytes_read = -1, bytes_written = -1;
+    process_io_bytes(bytes_read, bytes_written);
+
+    std::ostringstream os;
+    os << std::setprecision(10);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      double now = vw::Stopwatch::microtime();
+      os << "{\n";
+      os << "  \"stage\": \"" << m_stage << "\",\n";
+      os << "  \"wall_seconds\": " << (now - m_init_time) / 1.0e+6 << ",\n";
+      os << "  \"peak_rss_mb\": " << peak_rss_mb() << ",\n";
+      os << "  \"bytes_read\": " << bytes_read << ",\n";
+      os << "  \"bytes_written\": " << bytes_written << ",\n";
+      os << "  \"spans\": [";
+      for (size_t it = 0; it < m_names.size(); it++) {
+        Span const& s = m_spans.find(m_names[it])->second;
+        double total = s.total;
+        if (s.running) // if stopped by an exception, count up to now
+          total += (now - s.start) / 1.0e+6;
+        os << (it == 0 ? "\n" : ",\n")
+           << "    {\"name\": \"" << m_names[it] << "\", \"seconds\": " << total
+           << ", \"count\": " << s.count << "}";
+      }
+      os << "\n  ]\n";
+      os << "}\n";
+    }
+
+    vw::create_out_dir(file);
+    std::ofstream ofs(file.c_str());
+    if (!ofs.good())
+      vw::vw_throw(vw::IOErr() << "Cannot write: " << file << "\n");
+    ofs << os.str();
+    vw::vw_out() << "Writing: " << file << "\n";
+  }
+
+  StageTiming & stage_timing() {
+    static StageTiming timing;
+    return timing;
+  }
+
+  double peak_rss_mb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return -1.0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+  }
+
+  bool process_io_bytes(double & bytes_read, double & bytes_written) {
+    bytes_read = -1;
+    bytes_written = -1;
+    std::ifstream ifs("/proc/self/io");
+    if (!ifs.good())
+      return false;
+    std::string key;
+    double val = 0;
+    while (ifs >> key >> val) {
+      // Use the counts for the data that actually hit the storage layer
+      if (key == "read_bytes:")
+        bytes_read = val;
+      else if (key == "write_bytes:")
+        bytes_written = val;
+    }
+    return (bytes_read >= 0 && bytes_written >= 0);
+  }
+
+} // end namespace asp
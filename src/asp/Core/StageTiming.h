@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StageTiming.h
+///
+/// Record how long each step of a stereo stage takes, and save that,
+/// together with the peak memory use and the bytes read and written
+/// by the process, as JSON next to the output prefix.
+
+#ifndef __ASP_CORE_STAGE_TIMING_H__
+#define __ASP_CORE_STAGE_TIMING_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  class StageTiming {
+  public:
+    StageTiming();
+
+    // The name of the stage, such as "corr". Used in the output file name.
+    void set_stage(std::string const& stage);
+    std::string const& stage() const { return m_stage; }
+
+    // Start and stop a named span. A span can be started and stopped
+    // several times, and then the times add up.
+    void start(std::string const& span);
+    void stop (std::string const& span);
+
+    // Forget all spans and restart the wall clock, keeping the stage name
+    void reset();
+
+    // The accumulated time in seconds for a span, or 0 if not recorded
+    double elapsed(std::string const& span) const;
+
+    // The file this timing will be saved to: <out_prefix>-<stage>-timing.json
+    std::string timing_file(std::string const& out_prefix) const;
+
+    // Save the spans, total wall time, peak memory, and I/O counters
+    void write(std::string const& out_prefix) const;
+
+  private:
+    struct Span {
+      double total, start;
+      int count;
+      bool running;
+    };
+
+    std::string m_stage;
+    double m_init_time;
+    std::vector<std::string> m_names; // in the order they were first started
+    std::map<std::string, Span> m_spans;
+    mutable std::mutex m_mutex;
+  };
+
+  /// The timing record for this process
+  StageTiming & stage_timing();
+
+  /// Start a span of the process timing record on construction and stop
+  /// it when going out of scope, including when an exception is thrown.
+  class TimingSpan {
+  public:
+    TimingSpan(std::string const& name): m_name(name) { stage_timing().start(m_name); }
+    ~TimingSpan() { stage_timing().stop(m_name); }
+  private:
+    std::string m_name;
+  };
+
+  /// Peak resident memory of this process so far, in MB, or -1 if unknown
+  double peak_rss_mb();
+
+  /// Bytes read and written by this process so far, from /proc/self/io.
+  /// Return false if not available on this platform.
+  bool process_io_bytes(double & bytes_read, double & bytes_written);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_STAGE_TIMING_H__
@@ -0,0 +1,143 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/StereoPlugin.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/dll/shared_library.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace asp {
+
+  // A loaded plugin library and its functions
+  struct StereoPluginLib {
+    boost::dll::shared_library    lib;
+    AspStereoPluginCorrelateFun   correlate;
+    int                           num_threads;
+  };
+
+  // Load a plugin library the first time it is needed
+  StereoPluginLib & load_stereo_plugin(std::string const& plugin_path) {
+
+    static std::mutex mutex;
+    static std::map<std::string, boost::shared_ptr<StereoPluginLib>> libs;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = libs.find(plugin_path);
+    if (it != libs.end())
+      return *it->second;
+
+    boost::shared_ptr<StereoPluginLib> plugin(new StereoPluginLib);
+    try {
+      plugin->lib.load(plugin_path);
+    } catch (std::exception const& e) {
+      vw::vw_throw(vw::ArgumentErr() << "Could not load the stereo plugin: "
+                   << plugin_path << ". " << e.what() << "\n");
+    }
+
+    if (!plugin->lib.has("asp_stereo_plugin_version") ||
+        !plugin->lib.has("asp_stereo_plugin_correlate"))
+      vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << plugin_path
+                   << " does not export the functions of the plugin interface.\n");
+
+    int version = plugin->lib.get<int()>("asp_stereo_plugin_version")();
+    if (version != ASP_STEREO_PLUGIN_VERSION)
+      vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << plugin_path
+                   << " has interface version " << version << ", but version "
+                   << ASP_STEREO_PLUGIN_VERSION << " is expected.\n");
+
+    plugin->correlate = &plugin->lib.get<int(AspStereoPluginInput const*, float*, char*, int)>
+      ("asp_stereo_plugin_correlate");
+
+    // Let the plugin use the threads ASP would use
+    int offered = vw::vw_settings().default_num_threads();
+    plugin->num_threads = 1;
+    if (plugin->lib.has("asp_stereo_plugin_threads"))
+      plugin->num_threads = std::max(1, plugin->lib.get<int(int)>("asp_stereo_plugin_threads")
+                                     (offered));
+    vw::vw_out() << "Loaded stereo plugin: " << plugin_path << ", using "
+                 << plugin->num_threads << " thread(s).\n";
+
+    libs[plugin_path] = plugin;
+    return *plugin;
+  }
+
+  bool is_shared_library_plugin(std::string const& plugin_path) {
+    return boost::algorithm::ends_with(plugin_path, ".so") ||
+      boost::algorithm::ends_with(plugin_path, ".dylib");
+  }
+
+  void call_stereo_plugin(std::string const& plugin_path,
+                          std::string const& options,
+                          std::map<std::string, std::string> const& env_vars,
+                          int min_disp, int max_disp,
+                          vw::ImageView<float> const& left,
+                          vw::ImageView<float> const& right,
+                          vw::ImageView<float> & disparity) {
+
+    StereoPluginLib & plugin = load_stereo_plugin(plugin_path);
+
+    std::vector<std::string> opts;
+    std::istringstream iss(options);
+    std::string opt;
+    while (iss >> opt)
+      opts.push_back(opt);
+
+    std::vector<char const*> opt_ptrs, env_names, env_values;
+    for (size_t it = 0; it < opts.size(); it++)
+      opt_ptrs.push_back(opts[it].c_str());
+    for (auto it = env_vars.begin(); it != env_vars.end(); it++) {
+      env_names.push_back(it->first.c_str());
+      env_values.push_back(it->second.c_str());
+    }
+
+    AspStereoPluginInput input;
+    input.left_cols    = left.cols();
+    input.left_rows    = left.rows();
+    input.left         = left.data();
+    input.right_cols   = right.cols();
+    input.right_rows   = right.rows();
+    input.right        = right.data();
+    input.min_disp     = min_disp;
+    input.max_disp     = max_disp;
+    input.num_opts     = opt_ptrs.size();
+    input.opts         = opt_ptrs.empty()   ? NULL : &opt_ptrs[0];
+    input.num_env_vars = env_names.size();
+    input.env_names    = env_names.empty()  ? NULL : &env_names[0];
+    input.env_values   = env_values.empty() ? NULL : &env_values[0];
+    input.num_threads  = plugin.num_threads;
+
+    disparity.set_size(left.cols(), left.rows());
+    const int err_size = 1024;
+    char err[err_size] = "";
+    int ans = plugin.correlate(&input, disparity.data(), err, err_size);
+    err[err_size - 1] = '\0';
+    if (ans != 0)
+      vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << plugin_path
+                   << " failed: " << err << "\n");
+  }
+
+} // end namespace asp
@@ -0,0 +1,102 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StereoPlugin.h
+///
+/// The interface of stereo correlation plugins which are shared
+/// libraries, loaded in-process, rather than programs run for each
+/// tile. The images and the disparity are passed in memory, so there
+/// is no process launch and no writing and reading of files.
+///
+/// A plugin library exports the C functions declared below. Only
+/// asp_stereo_plugin_threads() is optional. A plugin is loaded this
+/// way when its path in plugin_list.txt ends with .so or .dylib.
+
+#ifndef __ASP_CORE_STEREO_PLUGIN_H__
+#define __ASP_CORE_STEREO_PLUGIN_H__
+
+#define ASP_STEREO_PLUGIN_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /// The input to a plugin. The images are stored row by row, with
+  /// NaN for no-data. The options are as they would be passed on the
+  /// command line to the program version of the plugin. The
+  /// environment variables given with the options are passed as name
+  /// and value pairs, rather than set in the environment.
+  typedef struct {
+    int           left_cols, left_rows;
+    float const * left;
+    int           right_cols, right_rows;
+    float const * right;
+    int           min_disp, max_disp;   // the horizontal search range
+    int           num_opts;
+    char const * const * opts;
+    int           num_env_vars;
+    char const * const * env_names;
+    char const * const * env_values;
+    int           num_threads;          // as returned by asp_stereo_plugin_threads()
+  } AspStereoPluginInput;
+
+  /// Must return ASP_STEREO_PLUGIN_VERSION
+  int asp_stereo_plugin_version();
+
+  /// Given how many threads ASP would like the plugin to use, return
+  /// how many it will use. Without this function, ASP assumes one.
+  int asp_stereo_plugin_threads(int offered_threads);
+
+  /// Find the horizontal disparity from the left to the right image,
+  /// of the size of the left image, stored row by row, with NaN where
+  /// there is no match. Return 0 on success. Otherwise, write a
+  /// message of at most the given size, including the null character,
+  /// to err.
+  int asp_stereo_plugin_correlate(AspStereoPluginInput const * input,
+                                  float * disparity, char * err, int err_size);
+
+  typedef int (*AspStereoPluginCorrelateFun)(AspStereoPluginInput const *, float *, char *, int);
+
+#ifdef __cplusplus
+}
+
+#include <vw/Image/ImageView.h>
+
+#include <map>
+#include <string>
+
+namespace asp {
+
+  /// If the plugin with this path is a shared library rather than a program
+  bool is_shared_library_plugin(std::string const& plugin_path);
+
+  /// Find the 1D disparity between two images with a shared library
+  /// plugin. The library is loaded once per process, and kept loaded.
+  /// Throw an exception on failure.
+  void call_stereo_plugin(std::string const& plugin_path,
+                          std::string const& options,
+                          std::map<std::string, std::string> const& env_vars,
+                          int min_disp, int max_disp,
+                          vw::ImageView<float> const& left,
+                          vw::ImageView<float> const& right,
+                          vw::ImageView<float> & disparity);
+
+} // end namespace asp
+
+#endif // __cplusplus
+
+#endif // __ASP_CORE_STEREO_PLUGIN_H__
@@ -134,6 +134,12 @@ namespace asp {
        " A higher factor will result in more interest points, but perhaps also more outliers.")
       ("ip-uniqueness-threshold",          po::value(&global.ip_uniqueness_thresh)->default_value(0.8),
        "Min percentage distance between closest and second closest IP descriptors, a larger value allows more IP matches.")
+      ("ip-cache-dir",          po::value(&global.ip_cache_dir)->default_value(""),
+       "Save the interest points and statistics of each image in this directory, and reuse them for any pair the image is in, as long as the image and the interest point settings are the same. For multi-view stereo this is set by default to <output prefix>-cache.")
+      ("camera-cache-dir",      po::value(&global.camera_cache_dir)->default_value(""),
+       "Save in this directory, in binary, what is parsed from DigitalGlobe, Pleiades, and SPOT5 XML camera files, and reuse it in later stages, tiles, and runs, as long as the camera file contents are the same.")
+      ("ip-nn-method",          po::value(&global.ip_nn_method)->default_value("brute-force"),
+       "How to find the nearest interest point descriptors when matching without epipolar constraints. Options: brute-force (exact), flann (approximate, faster for many interest points).")
       ("ip-nodata-radius",          po::value(&global.ip_nodata_radius)->default_value(4),
        "Remove IP near nodata with this radius, in pixels.")
       ("ip-triangulation-max-error", po::value(&global.ip_triangulation_max_error)->default_value(-1),
@@ -160,10 +166,14 @@ namespace asp {
        "Do not assume a reliable datum exists, such as for potato-shaped bodies.")
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
        "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images. This is a speedup option which helps (and works mostly with) mapprojected input images with no alignment.")
+      ("skip-aligned-image-files", po::bool_switch(&global.skip_aligned_image_files)->default_value(false)->implicit_value(true),
+       "Do not write the aligned images L.tif and R.tif. Save instead how they are found from the input images, and let the later stages resample from the input images the tiles they need. Not for epipolar alignment or ISIS images.")
       ("force-reuse-match-files", po::bool_switch(&global.force_reuse_match_files)->default_value(false)->implicit_value(true),
        "Force reusing the match files even if older than the images or cameras.")
       ("part-of-multiview-run", po::bool_switch(&global.part_of_multiview_run)->default_value(false)->implicit_value(true),
        "If the current run is part of a larger multiview run.")
+      ("resolved-settings", po::value(&global.resolved_settings)->default_value(""),
+       "Read the stereo session and alignment method from this file, as resolved by an earlier run with the same inputs, rather than guessing the session, and skip the camera sanity checks and saving a copy of stereo.default. This option is invoked from parallel_stereo for each tile.")
       ("global-alignment-threshold",       po::value(&global.global_alignment_threshold)->default_value(10),
        "Maximum distance from inlier interest point matches to the epipolar line when calculating the global affine epipolar alignment.")
       ("local-alignment-threshold",       po::value(&global.local_alignment_threshold)->default_value(2),
@@ -214,7 +224,7 @@ namespace asp {
       ("prefilter-kernel-width", po::value(&global.slogW)->default_value(1.5),
        "Sigma value for Gaussian kernel used with prefilter modes 1 and 2.")
       ("corr-seed-mode",         po::value(&global.seed_mode)->default_value(1),
-                     "Correlation seed strategy. [0 None, 1 Use low-res disparity from stereo, 2 Use low-res disparity from provided DEM (see disparity-estimation-dem), 3 Use low-res disparity produced by sparse_disp (in development)]")
+                     "Correlation seed strategy. [0 None, 1 Use low-res disparity from stereo, 2 Use low-res disparity from provided DEM (see disparity-estimation-dem), 3 Use low-res disparity from sparse template matching, or from the sparse_disp tool if sparse-disp-options is set]")
       ("min-num-ip",             po::value(&global.min_num_ip)->default_value(30),
                      "The minimum number of interest points which must be found to estimate the search range.")
       ("corr-sub-seed-percent",  po::value(&global.seed_percent_pad)->default_value(0.25),
@@ -263,6 +273,8 @@ namespace asp {
                      "DEM to use in estimating the low-resolution disparity (when corr-seed-mode is 2).")
       ("disparity-estimation-dem-error", po::value(&global.disparity_estimation_dem_error)->default_value(0.0),
                      "Error (in meters) of the disparity estimation DEM.")
+      ("disparity-estimation-dem-cache-dir", po::value(&global.disparity_estimation_dem_cache_dir)->default_value(""),
+                     "Save in this directory the low-resolution disparity found from the disparity estimation DEM, and reuse it in later runs with the same DEM, images, cameras, and alignment.")
       ("corr-timeout",           po::value(&global.corr_timeout)->default_value(global.default_corr_timeout),
                      "Correlation timeout for an image tile, in seconds.")
       ("stereo-algorithm",       po::value(&global.stereo_algorithm)->default_value("asp_bm"),
@@ -277,11 +289,21 @@ namespace asp {
                      "Search range expansion for SGM down stereo pyramid levels.  Smaller values are faster, but greater change of blunders.")
       ("corr-memory-limit-mb",     po::value(&global.corr_memory_limit_mb)->default_value(4*1024),
        "Keep correlation memory usage (per tile) close to this limit.  Important for SGM/MGM.")
+      ("sgm-memory-budget-mb",     po::value(&global.sgm_memory_budget_mb)->default_value(0),
+       "If positive, and with asp_sgm or asp_mgm, subdivide the region to correlate into blocks, each with its own search range from D_sub, so that the estimated memory use per block fits in this budget. The blocks are processed in parallel, using --threads. Otherwise process the region as one block.")
       ("correlator-mode", po::bool_switch(&global.correlator_mode)->default_value(false)->implicit_value(true),
        "Function as an image correlator only (including with subpixel refinement). Assume no cameras, aligned input images, and stop before triangulation, so at filtered disparity.")
 
+      ("uncompressed-intermediates", po::bool_switch(&global.uncompressed_intermediates)->default_value(false)->implicit_value(true),
+       "Write the disparities (D.tif, RD.tif, F.tif) and the point cloud (PC.tif) without compression, so that later steps read them without decoding, memory-mapped if there is enough RAM. These files can be several times larger. Suggested for a fast local disk.")
+      ("compact-disparity", po::bool_switch(&global.compact_disparity)->default_value(false)->implicit_value(true),
+       "Write the disparities D.tif and RD.tif as 16-bit integer differences from the upsampled low-resolution disparity D_sub, which makes them several times smaller. They are read back transparently, to within 1/64 of a pixel for RD.tif. Needs D_sub, so it has no effect with --corr-seed-mode 0 or local epipolar alignment.")
+      ("prefetch-tiles", po::value(&global.prefetch_tiles)->default_value(0),
+       "In correlation and filtering, read the inputs of this many of the next tiles in the background, while the current tiles are processed. This helps when the inputs are on a slow or network disk. Set to 0 to not read ahead.")
       ("stereo-debug",   po::bool_switch(&global.stereo_debug)->default_value(false)->implicit_value(true),
                      "Write stereo debug images and output.")
+      ("save-timing-log", po::bool_switch(&global.save_timing_log)->default_value(false)->implicit_value(true),
+       "Save the time spent in each step of this stage, the peak memory usage, and the bytes read and written, to <output prefix>-<stage>-timing.json. With parallel_stereo, these are also combined over all tiles.")
     ("local-alignment-debug",   po::bool_switch(&global.local_alignment_debug)->default_value(false)->implicit_value(true),
      "Save the results of more intermediate steps when doing local alignment.");
 
@@ -314,7 +336,9 @@ namespace asp {
       ("subpixel-max-levels", po::value(&global.subpixel_max_levels)->default_value(2),
                               "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).")
       ("phase-subpixel-accuracy", po::value(&global.phase_subpixel_accuracy)->default_value(20),
-                              "Accuracy to use for mode 4 phase subpixel.  Resolution is 1/this.  Larger values take more time.");
+                              "Accuracy to use for mode 4 phase subpixel.  Resolution is 1/this.  Larger values take more time.")
+      ("subpixel-min-confidence", po::value(&global.subpixel_min_confidence)->default_value(0.0),
+                              "With subpixel modes 2-5, refine with the selected mode only the pixels whose matching confidence, between 0 and 1, is at least this, and use parabola fitting for the rest. The default is to refine all pixels with the selected mode.");
 
     po::options_description experimental_subpixel_options("Experimental subpixel options");
     experimental_subpixel_options.add_options()
@@ -369,7 +393,9 @@ namespace asp {
       ("casp-go-param-file", po::value(&global.casp_go_param_file)->default_value(""),
        "The parameter file to use with Gotcha (and in the future other CASP-GO functionality) when invoking the 'gotcha-disparity-refinement' option. The default is to use the file 'share/CASP-GO_params.xml' shipped with ASP.")
       ("mask-flatfield",      po::bool_switch(&global.mask_flatfield)->default_value(false)->implicit_value(true),
-                              "Mask dust found on the sensor or film. (For use with Apollo Metric Cameras only.)");
+                              "Mask dust found on the sensor or film. (For use with Apollo Metric Cameras only.)")
+      ("stream-filtering",    po::bool_switch(&global.stream_filtering)->default_value(false)->implicit_value(true),
+                              "Do not write F.tif. Instead, filter the refined disparity on the fly, tile by tile, during triangulation. Cannot be used with filtering options which need the whole disparity, such as hole filling and blob removal.");
 
     po::options_description backwards_compat_options("Aliased backwards compatibility options");
     // Do not add default values here. They may override the values set
@@ -408,10 +434,22 @@ namespace asp {
                                             "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
                                             "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
+      ("save-quantized-point-cloud",        po::bool_switch(&global.save_quantized_point_cloud)->default_value(false)->implicit_value(true),
+                                            "Save the final point cloud as 32-bit integer multiples of the point cloud rounding error, relative to the cloud center, rather than as float. This is as precise and compresses better. Points must be within 2^31 times the rounding error from the center (about 2000 km for Earth).")
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
                                             "Only compute the center of triangulated point cloud and exit.")
       ("skip-point-cloud-center-comp", po::bool_switch(&global.skip_point_cloud_center_comp)->default_value(false)->implicit_value(true),
        "Skip the computation of the point cloud center. This option is invoked from parallel_stereo.")
+      ("write-dem", po::bool_switch(&global.write_dem)->default_value(false)->implicit_value(true),
+       "Grid the triangulated points into <output prefix>-DEM.tif, and also write the triangulation error as -IntersectionErr.tif and the number of points per DEM grid point as -count-DEM.tif, as point2dem does with its default filter. See also --no-point-cloud.")
+      ("dem-spacing", po::value(&global.dem_spacing)->default_value(0.0),
+       "With --write-dem, the DEM grid spacing, in the units of the projection. If not positive, it is found from the point cloud, as in point2dem. Must be set with parallel_stereo, so that the DEMs of all tiles are on the same grid.")
+      ("dem-t-srs", po::value(&global.dem_t_srs)->default_value(""),
+       "With --write-dem, the projection of the DEM, as a PROJ.4 string, WKT, or EPSG code. The default is the georeference of the left image.")
+      ("dem-collar-size", po::value(&global.dem_collar_size)->default_value(16),
+       "With --write-dem, also grid the points this many pixels beyond the region being triangulated, so that the DEMs of neighboring parallel_stereo tiles agree where they overlap.")
+      ("no-point-cloud", po::bool_switch(&global.no_point_cloud)->default_value(false)->implicit_value(true),
+       "With --write-dem, do not write the point cloud.")
       ("compute-error-vector",              po::bool_switch(&global.compute_error_vector)->default_value(false)->implicit_value(true),
                                             "Compute the triangulation error vector, not just its length.")
       ("compute-piecewise-adjustments-only", po::bool_switch(&global.compute_piecewise_adjustments_only)->default_value(false)->implicit_value(true),
@@ -420,6 +458,14 @@ namespace asp {
        "Skip computing the piecewise adjustments for jitter, they should have been done by now.")
       ("use-least-squares",                 po::bool_switch(&global.use_least_squares)->default_value(false)->implicit_value(true),
        "Use rigorous least squares triangulation process. This is slow for ISIS processes.")      
+      ("ray-table-spacing", po::value(&global.ray_table_spacing)->default_value(0),
+       "If positive, triangulate using camera centers and ray directions interpolated from a table sampled from each camera at this spacing in pixels, rather than the exact camera for each pixel. This is much faster for linescan, CSM, and ISIS cameras. Not used with map-projected images.")
+      ("ray-table-max-error", po::value(&global.ray_table_max_error)->default_value(0.01),
+       "With --ray-table-spacing, use the exact camera in any part of the image where the interpolated rays differ from the exact ones by more than this, in pixels.")
+      ("unproject-grid-spacing", po::value(&global.unproject_grid_spacing)->default_value(0),
+       "With map-projected images, if positive, project the map-projected pixels into the cameras exactly only on a grid with this spacing, refined where the interpolation error is too large, and interpolate in between. This is much faster than projecting each pixel through the DEM. See also --unproject-tolerance.")
+      ("unproject-tolerance", po::value(&global.unproject_tolerance)->default_value(0.01),
+       "With --unproject-grid-spacing, refine the grid until the interpolated camera pixels differ from the exact ones by no more than this, in pixels.")
       ;
   }
 
@@ -455,10 +501,14 @@ namespace asp {
        "Delete any subsampled and other files created by the GUI when exiting.")
       ("create-image-pyramids-only",   po::bool_switch(&global.create_image_pyramids_only)->default_value(false)->implicit_value(true),
        "Without starting the GUI, build multi-resolution pyramids for the inputs, to be able to load them fast later.")
+      ("pyramid-cache-dir", po::value(&global.pyramid_cache_dir)->default_value(""),
+       "Save the multi-resolution pyramids of the images in this directory, named by the image path, modification time, and size, to reuse them in later sessions, also by other users sharing the directory.")
+      ("pyramid-cache-size-mb", po::value(&global.pyramid_cache_size_mb)->default_value(0),
+       "If positive, remove the least recently used pyramids in --pyramid-cache-dir, on startup, until the cache takes at most this much space.")
       ("pairwise-matches",   po::bool_switch(&global.pairwise_matches)->default_value(false)->implicit_value(true), "Show images side-by-side. If just two of them are selected, load their corresponding match file, determined by the output prefix. Also accessible from the menu.")
       ("pairwise-clean-matches",   po::bool_switch(&global.pairwise_clean_matches)->default_value(false)->implicit_value(true), "Same as --pairwise-matches, but use *-clean.match files.")
       ("nvm", po::value(&global.nvm)->default_value(""),
-       "Load this .nvm file having interest point matches. It is assumed it was saved with no shift of the interest points relative to the optical center. The rig_calibrator program can create such files. This option implies --pairwise-matches.")
+       "Load this .nvm file having interest point matches, or its binary equivalent with the .bnvm extension. It is assumed it was saved with no shift of the interest points relative to the optical center. The rig_calibrator program can create such files. This option implies --pairwise-matches.")
       ("zoom-proj-win", po::value(&global.zoom_proj_win)->default_value(BBox2(0,0,0,0), ""),
        "Zoom to this proj win on startup. It is assumed that the images are georeferenced. Also accessible from the View menu.")
       ("csv-format",     po::value(&global.csv_format_str)->default_value(""), asp::csv_opt_caption().c_str())
@@ -480,7 +530,9 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("tile-at-location", po::value(&global.tile_at_loc)->default_value(""),
-       "Find the tile in the current parallel_stereo run which generated the DEM portion having this lon-lat-height location. Specify as a string in quotes: 'lon lat height'. Use this option with stereo_parse and the rest of options used in parallel_stereo, including cameras, output prefix, etc. (except for those needed for tiling and parallelization). This does not work with mapprojected images.");
+       "Find the tile in the current parallel_stereo run which generated the DEM portion having this lon-lat-height location. Specify as a string in quotes: 'lon lat height'. Use this option with stereo_parse and the rest of options used in parallel_stereo, including cameras, output prefix, etc. (except for those needed for tiling and parallelization). This does not work with mapprojected images.")
+      ("estimate-tile-costs", po::bool_switch(&global.estimate_tile_costs)->default_value(false)->implicit_value(true),
+       "For each tile in the current parallel_stereo run, estimate the relative cost of correlation based on D_sub, and save these to <output prefix>-tileCosts.txt. Used by parallel_stereo to schedule the most expensive tiles first.");
   }
 
   // Options for parallel_stereo. These are not used by the stereo
@@ -513,6 +565,8 @@ namespace asp {
        "Options to pass directly to sparse_disp. Use quotes around this string.")
       ("prev-run-prefix", po::value(&global.prev_run_prefix)->default_value(""),
        "Start at the triangulation stage while reusing the data from this prefix.")
+      ("stage-cache-dir", po::value(&global.stage_cache_dir)->default_value(""),
+       "Save the results of preprocessing and filtering in this directory, and reuse them in later runs with the same inputs and options.")
       ("parallel-options", po::value(&global.parallel_options)->default_value(""),
        "Options to pass directly to GNU Parallel. Use quotes around this string.");
   }
@@ -522,7 +576,9 @@ namespace asp {
     (*this).add_options()
       ("trans-crop-win", po::value(&global.trans_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Left image crop window in respect to L.tif. This is an internal option. [default: use the entire image].")
       ("attach-georeference-to-lowres-disparity", po::bool_switch(&global.attach_georeference_to_lowres_disparity)->default_value(false)->implicit_value(true),
-       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.");
+       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.")
+      ("corr-worker-mode", po::bool_switch(&global.corr_worker_mode)->default_value(false)->implicit_value(true),
+       "Run stereo_corr on many tiles, reading from standard input one line per tile, with the output prefix for the tile and its crop window in L.tif (xoff yoff xsize ysize). The inputs are loaded only once. This is an internal option.");
   }
 
   // This handles options which are not in stereo_settings(), but
@@ -113,6 +113,9 @@ namespace asp {
     double epipolar_threshold;              /// Max distance from epipolar line to search for IP matches.
     double ip_inlier_factor;                /// General scaling factor for IP finding, a larger value allows more IPs to match.
     double ip_uniqueness_thresh;            /// Min percentage distance between closest and second closest IP descriptors.
+    std::string ip_nn_method;               ///< How to find the nearest IP descriptors: brute-force or flann.
+    std::string ip_cache_dir;               ///< Save and reuse the IP of each image in this directory.
+    std::string camera_cache_dir;           ///< Save and reuse the parsed XML cameras in this directory.
     double ip_nodata_radius;                /// Remove IP near nodata with this radius, in pixels.
     double ip_triangulation_max_error;      ///< Remove IP matches with triangulation error higher than this.
     int    ip_num_ransac_iterations;        ///< How many ransac iterations to do in ip matching.
@@ -132,8 +135,11 @@ namespace asp {
     bool   skip_rough_homography;           ///< Use this if datum-based rough homography fails. 
     bool   no_datum;                        ///< Do not assume a reliable datum exists
     bool   skip_image_normalization;        ///< Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
+    bool   skip_aligned_image_files;        ///< Do not write L.tif and R.tif, resample tiles as needed
     bool   force_reuse_match_files;         ///< Force reusing the match files even if older than the images or cameras
     bool   part_of_multiview_run;           ///< If this run is part of a larger multiview run
+    std::string resolved_settings;          ///< Session and alignment resolved by parallel_stereo
+    std::string resolved_datum_wkt;         ///< The datum in the resolved settings, if any, as WKT
     std::string datum;                      ///< The datum to use with RPC camera models
     std::string match_files_prefix, clean_match_files_prefix; // Load matches from here
     std::string left_image_clip, right_image_clip;
@@ -188,6 +194,7 @@ namespace asp {
     bool skip_low_res_disparity_comp;
     std::string disparity_estimation_dem;     // DEM to use in estimating the low-resolution disparity
     double disparity_estimation_dem_error; // Error (in meters) of the disparity estimation DEM
+    std::string disparity_estimation_dem_cache_dir; // Save and reuse the disparity from the DEM
     int    corr_timeout;              // Correlation timeout for a tile, in seconds
     int default_corr_timeout;         // Will be used to adjust corr_timeout
     std::string stereo_algorithm;     // See StereoSettings.cc for the possible values.
@@ -196,8 +203,13 @@ namespace asp {
     int    sgm_collar_size;           // Extra tile padding used for SGM calculation.
     vw::Vector2i sgm_search_buffer;   // Search padding in SGM around previous pyramid level disparity value.
     size_t corr_memory_limit_mb;      // Correlation memory limit, only important for SGM/MGM.
+    double sgm_memory_budget_mb;      // If positive, subdivide SGM/MGM tiles to fit in this budget
     bool   correlator_mode;           // Use the correlation logic only (including subpixel rfne). 
+    bool   uncompressed_intermediates; // Write D, RD, F, and PC without compression
+    bool   compact_disparity;         // Write D and RD as 16-bit differences from D_sub
+    int    prefetch_tiles;            // Read the inputs of this many next tiles in the background
     bool   stereo_debug;              // Write stereo debug images and messages
+    bool   save_timing_log;           // Save per-step timing and memory use as JSON
     bool   local_alignment_debug;     // Debug local alignment
 
     // Subpixel options
@@ -214,6 +226,7 @@ namespace asp {
     bool disable_h_subpixel, disable_v_subpixel;
     vw::uint16 subpixel_max_levels;   // Max pyramid levels to process. 0 hits only once.
     vw::uint16 phase_subpixel_accuracy;  // Phase subpixel is accurate to 1/this pixels
+    double subpixel_min_confidence;   // Use parabola fitting for pixels with less confidence
 
 
     // Experimental Subpixel options (mode 3 only)
@@ -242,6 +255,7 @@ namespace asp {
     int   disp_smooth_size;           // Adaptive disparity smoothing size
     float disp_smooth_texture;        // Adaptive disparity smoothing max texture value    
     bool  gotcha_disparity_refinement;
+    bool  stream_filtering;           // Filter the disparity in triangulation, skip F.tif
     std::string casp_go_param_file;
 
     // Triangulation options
@@ -267,10 +281,20 @@ namespace asp {
     double min_triangulation_angle;           // min angle for valid triangulation
     double max_valid_triangulation_error;
     bool   use_least_squares;                 // Use a more rigorous triangulation
+    int    ray_table_spacing;                 // Triangulate with rays interpolated from a table
+    double ray_table_max_error;               // Max ray table error in pixels
+    int    unproject_grid_spacing;            // Interpolate the map-projected to camera pixel map
+    double unproject_tolerance;               // Max unprojection interpolation error in pixels
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    bool   save_quantized_point_cloud;        // Save the point cloud as integer multiples of the rounding error
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
+    bool   write_dem;                         // Grid the triangulated points into a DEM
+    double dem_spacing;                       // The spacing of that DEM
+    std::string dem_t_srs;                    // The projection of that DEM
+    int    dem_collar_size;                   // Grid also the points this far from the crop window
+    bool   no_point_cloud;                    // Do not write the point cloud
     bool   unalign_disparity;                 // Compute disparity between unaligned images
     
     // stereo_gui options
@@ -284,6 +308,8 @@ namespace asp {
     std::string match_file, gcp_file, dem_file, csv_datum, csv_format_str, csv_proj4, nvm;
     bool delete_temporary_files_on_exit;
     bool create_image_pyramids_only, hide_all;
+    std::string pyramid_cache_dir;
+    double pyramid_cache_size_mb;
     bool pairwise_matches, pairwise_clean_matches;
     std::vector<std::string> vwip_files;
     vw::BBox2 zoom_proj_win;
@@ -292,16 +318,19 @@ namespace asp {
     
     // stereo_parse options
     std::string tile_at_loc;
+    bool estimate_tile_costs;
 
     // Options for parallel_stereo. These are not used, but accept
     // them quietly so that when stereo_gui or stereo_parse is invoked
     // with a parallel_stereo command it would not fail.
-    std::string nodes_list, ssh, sparse_disp_options, parallel_options, prev_run_prefix;
+    std::string nodes_list, ssh, sparse_disp_options, parallel_options, prev_run_prefix,
+      stage_cache_dir;
     int threads_multi, threads_single, processes, entry_point, stop_point, job_size_h, job_size_w;
     
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
     bool attach_georeference_to_lowres_disparity;
+    bool corr_worker_mode;            // Correlate tiles read from standard input
 
     // Internal variable, to ensure we always initialize this class before using it
     bool initialized_stereo_settings;
@@ -15,239 +15,190 @@
 //  limitations under the License.
 // __END_LICENSE__
 
-#include <vw/Core/System.h>
-#include <vw/Core/ThreadPool.h>
+#include <vw/Core/Settings.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
 #include <vw/Image/MaskViews.h>
-#include <boost/foreach.hpp>
+#include <vw/Image/PixelMask.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
 
 #ifndef __ASP_CORE_THREADEDEDGEMASK_H__
 #define __ASP_CORE_THREADEDEDGEMASK_H__
 
 namespace asp {
 
-  /// Quick way to check which pixels are inside the valid input mask??
+  /// Mask the pixels outside of the valid area of an image. A pixel is
+  /// valid if, in both its row and its column, there are pixels not
+  /// equal to the mask value on both sides of it, or at it. The valid
+  /// area can be eroded by a buffer.
+  ///
+  /// The row and column extents of the valid area are found only when
+  /// first needed, for bands of block_size rows or columns, by scanning
+  /// in blocks inward from the image boundary until the first valid
+  /// pixel. Hence only the no-data margins of the image are read, and
+  /// rendering a tile does not wait for the entire image to be
+  /// scanned. Tiles in different bands can be done in parallel.
   template <class ViewT>
   class ThreadedEdgeMaskView : public vw::ImageViewBase<ThreadedEdgeMaskView<ViewT> > {
 
-    ViewT m_view;
-
-    typedef boost::shared_array<vw::int32> SharedArray;
-    SharedArray m_left, m_right, m_top, m_bottom;
-
-    // Determines if a single pixel is valid.
-    inline bool valid(vw::int32 i, vw::int32 j) const {
-      if ( i > m_left[j] && i < m_right[j] && j > m_top[i] && j < m_bottom[i] )
-        return true;
-      else
-        return false;
-    }
+  public:
 
-    // Task that checks individual blocks for edges
-    class EdgeMaskTask : public vw::Task, private boost::noncopyable {
-      ViewT m_view;
-      typename ViewT::pixel_type m_mask_value;
-      vw::BBox2i m_bbox;   // Region of image we're working in
-      typedef std::vector<vw::int32> Array;
-      typedef boost::shared_array<vw::int32> SharedArray;
-      SharedArray g_left, g_right, g_top, g_bottom;
-      Array       m_left, m_right, m_top, m_bottom;
-      // This how much we increment after we test a pixel. Set to 1 if
-      // you wish to test every pixel.
-      const vw::int32 STEP_SIZE;
-    public:
-      EdgeMaskTask(ViewT const& view,
-                   typename ViewT::pixel_type mask_value,
-                   vw::int32 search_step,
-                   vw::BBox2i bbox, SharedArray left, SharedArray right,
-                   SharedArray top, SharedArray bottom ) :
-        m_view(view), m_mask_value(mask_value), m_bbox(bbox), 
-        g_left(left), g_right(right), g_top(top), g_bottom(bottom), 
-        m_left( m_bbox.height() ), m_right( m_bbox.height() ), 
-        m_top( m_bbox.width() ), m_bottom( m_bbox.width() ), STEP_SIZE(search_step) {
+    typedef typename ViewT::pixel_type orig_pixel_type;
+    typedef typename boost::remove_cv<typename boost::remove_reference<orig_pixel_type>::type>::type unmasked_pixel_type;
+    typedef vw::PixelMask<unmasked_pixel_type> pixel_type;
+    typedef vw::PixelMask<unmasked_pixel_type> result_type;
+    typedef vw::ProceduralPixelAccessor<ThreadedEdgeMaskView> pixel_accessor;
 
-        std::fill( m_left.begin  (), m_left.end  (), -1 );
-        std::fill( m_right.begin (), m_right.end (), -1 );
-        std::fill( m_top.begin   (), m_top.end   (), -1 );
-        std::fill( m_bottom.begin(), m_bottom.end(), -1 );
+  private:
+
+    // The extents of the valid area, shared among the copies of this
+    // view. In row j the valid pixels are those with left[j] < i <
+    // right[j], and in column i those with top[i] < j < bottom[i].
+    struct Edges {
+      ViewT               view;
+      unmasked_pixel_type mask_value;
+      vw::int32           mask_buffer, block_size;
+      std::vector<vw::int32> left, right, top, bottom;
+      std::vector<std::once_flag> row_bands, col_bands;
+
+      Edges(ViewT const& view_in, unmasked_pixel_type const& mask_value_in,
+            vw::int32 mask_buffer_in, vw::int32 block_size_in):
+        view(view_in), mask_value(mask_value_in), mask_buffer(mask_buffer_in),
+        block_size(std::max(block_size_in, 1)),
+        left(view_in.rows(), view_in.cols()), right(view_in.rows(), 0),
+        top(view_in.cols(), view_in.rows()), bottom(view_in.cols(), 0),
+        row_bands((view_in.rows() + block_size - 1) / block_size),
+        col_bands((view_in.cols() + block_size - 1) / block_size) {}
+
+      bool is_data(unmasked_pixel_type const& pix) const {
+        return !(pix == mask_value);
       }
 
-      void operator()() {
-        using namespace vw;
-
-        // Rasterizing local tile
-        ImageView<typename ViewT::pixel_type> copy( crop(m_view, m_bbox ) );
-
-        { // Detecting Edges
-          // Search left and right side
-          for ( int32 j = 0; j < copy.rows(); ++j ) { // Loop up through the rows in the local tile
-            int32 i = 0;
-            while ( i < copy.cols() && copy(i,j) == m_mask_value ) // Move from left to right in row by STEP_SIZE
-              i += STEP_SIZE;                                      //    until we hit an invalid pixel
-            if ( i > 0 ) i -= STEP_SIZE;                           // Walk back one step if we are not at col 0
-            while ( i < copy.cols() && copy(i,j) == m_mask_value ) // Now do the same thing but in steps of 1
-              ++i;
-            if ( i > 0 ) --i;
-            // Early exit condition if entire row was nodata
-            if ( i == copy.cols() -1 )
-              continue; // We're keeping left and right as -1
-            m_left[j] = i;                                         // Now we have the left-most valid column in the row
-
-            i = copy.cols() - 1;                                   // Do the same thing going right to left
-            while ( i >= 0 && copy(i,j) == m_mask_value )
-              i -= STEP_SIZE;
-            if ( i < copy.cols() - 1 )
-              i += STEP_SIZE;
-            while ( i >= 0 && copy(i,j) == m_mask_value )
-              --i;
-            if ( i < copy.cols() - 1 )
-              ++i;
-            m_right[j] = i;
+      // Find the left and right extents of the rows in the band
+      void find_row_band(vw::int32 band) {
+        vw::int32 y0 = band * block_size;
+        vw::int32 h  = std::min(block_size, vw::int32(view.rows()) - y0);
+        vw::int32 cols = view.cols();
+        std::vector<bool> found(h, false);
+        vw::int32 num_left = h;
+        for (vw::int32 x0 = 0; x0 < cols && num_left > 0; x0 += block_size) {
+          vw::int32 w = std::min(block_size, cols - x0);
+          vw::ImageView<unmasked_pixel_type> copy = vw::crop(view, vw::BBox2i(x0, y0, w, h));
+          for (vw::int32 r = 0; r < h; r++) {
+            if (found[r])
+              continue;
+            for (vw::int32 c = 0; c < w; c++) {
+              if (is_data(copy(c, r))) {
+                left[y0 + r] = x0 + c - 1 + mask_buffer;
+                found[r] = true;
+                num_left--;
+                break;
+              }
+            }
           }
-                                                                   // Now find the first valid rows from the bottom
-          for ( int32 i = 0; i < copy.cols(); ++i ) {
-            int32 j = 0;
-            while ( j < copy.rows() && copy(i,j) == m_mask_value )
-              j += STEP_SIZE;
-            if ( j > 0 )
-              j -= STEP_SIZE;
-            while ( j < copy.rows() && copy(i,j) == m_mask_value )
-              ++j;
-            if ( j > 0 )
-              --j;
-            // Early exit condition if entire column was nodata
-            if ( j == copy.rows() - 1 )
-              continue; // We're keeping top and bottom as -1
-            m_top[i] = j;
+        }
 
-            j = copy.rows()-1;                                     // And the first valid rows from the top
-            while ( j >= 0 && copy(i,j) == m_mask_value )
-              j -= STEP_SIZE;
-            if ( j < copy.rows()-1 )
-              j += STEP_SIZE;
-            while ( j >= 0 && copy(i,j) == m_mask_value )
-              --j;
-            if ( j < copy.rows()-1 )
-              ++j;
-            m_bottom[i] = j;
+        // Rows with no data stay fully invalid
+        std::vector<bool> done(found.size());
+        for (vw::int32 r = 0; r < h; r++)
+          done[r] = !found[r];
+        num_left = std::count(found.begin(), found.end(), true);
+        for (vw::int32 x1 = cols; x1 > 0 && num_left > 0; x1 -= block_size) {
+          vw::int32 w = std::min(block_size, x1);
+          vw::ImageView<unmasked_pixel_type> copy = vw::crop(view, vw::BBox2i(x1 - w, y0, w, h));
+          for (vw::int32 r = 0; r < h; r++) {
+            if (done[r])
+              continue;
+            for (vw::int32 c = w - 1; c >= 0; c--) {
+              if (is_data(copy(c, r))) {
+                right[y0 + r] = x1 - w + c + 1 - mask_buffer;
+                done[r] = true;
+                num_left--;
+                break;
+              }
+            }
           }
         }
+      }
 
-        { // Merging result back into global perspective
-          int32 l = 0;
-          for ( int32 j = m_bbox.min()[1];                      // Loop through rows
-                j < m_bbox.max()[1]; j++ ) {
-            if ( m_left[l] == -1 ) {                            // Skip rows with no pixels
-              l++; continue;
+      // Find the top and bottom extents of the columns in the band
+      void find_col_band(vw::int32 band) {
+        vw::int32 x0 = band * block_size;
+        vw::int32 w  = std::min(block_size, vw::int32(view.cols()) - x0);
+        vw::int32 rows = view.rows();
+        std::vector<bool> found(w, false);
+        vw::int32 num_left = w;
+        for (vw::int32 y0 = 0; y0 < rows && num_left > 0; y0 += block_size) {
+          vw::int32 h = std::min(block_size, rows - y0);
+          vw::ImageView<unmasked_pixel_type> copy = vw::crop(view, vw::BBox2i(x0, y0, w, h));
+          for (vw::int32 c = 0; c < w; c++) {
+            if (found[c])
+              continue;
+            for (vw::int32 r = 0; r < h; r++) {
+              if (is_data(copy(c, r))) {
+                top[x0 + c] = y0 + r - 1 + mask_buffer;
+                found[c] = true;
+                num_left--;
+                break;
+              }
             }
-            g_left[j] = std::min( m_left[l] + m_bbox.min()[0],  // Add in the bounding box column
-                                  g_left[j] );
-            g_right[j] = std::max( m_right[l] + m_bbox.min()[0],
-                                   g_right[j] );
-            l++;
           }
+        }
 
-          l = 0;
-          for ( int32 i = m_bbox.min()[0];                       // Loop through columns
-                i < m_bbox.max()[0]; i++ ) {
-            if ( m_top[l] == -1 ) {                              // Skip columns with no pixels
-              l++; continue;
+        std::vector<bool> done(found.size());
+        for (vw::int32 c = 0; c < w; c++)
+          done[c] = !found[c];
+        num_left = std::count(found.begin(), found.end(), true);
+        for (vw::int32 y1 = rows; y1 > 0 && num_left > 0; y1 -= block_size) {
+          vw::int32 h = std::min(block_size, y1);
+          vw::ImageView<unmasked_pixel_type> copy = vw::crop(view, vw::BBox2i(x0, y1 - h, w, h));
+          for (vw::int32 c = 0; c < w; c++) {
+            if (done[c])
+              continue;
+            for (vw::int32 r = h - 1; r >= 0; r--) {
+              if (is_data(copy(c, r))) {
+                bottom[x0 + c] = y1 - h + r + 1 - mask_buffer;
+                done[c] = true;
+                num_left--;
+                break;
+              }
             }
-            g_top[i] = std::min( m_top[l] + m_bbox.min()[1],     // Add in the bounding box row
-                                 g_top[i] );
-            g_bottom[i] = std::max( m_bottom[l] + m_bbox.min()[1],
-                                    g_bottom[i] );
-            l++;
           }
         }
       }
-    };
 
-    // Specialized deep copy constructor (private)
-    template <class OViewT>
-    ThreadedEdgeMaskView( ViewT const& view,
-                          ThreadedEdgeMaskView<OViewT> const& other,
-                          vw::BBox2i const& box ) :
-      m_view( view ), m_left(new vw::int32[box.height()]), m_right(new vw::int32[box.height()]),
-      m_top(new vw::int32[box.width()]), m_bottom(new vw::int32[box.width()]) {
-      using namespace vw;
+      // Make sure the extents are known for the rows and columns of the box
+      void find(vw::BBox2i const& box) {
+        if (box.empty())
+          return;
+        for (vw::int32 b = box.min().y() / block_size; b <= (box.max().y() - 1) / block_size; b++)
+          std::call_once(row_bands[b], &Edges::find_row_band, this, b);
+        for (vw::int32 b = box.min().x() / block_size; b <= (box.max().x() - 1) / block_size; b++)
+          std::call_once(col_bands[b], &Edges::find_col_band, this, b);
+      }
 
-      // Copy only sections that we need
-      std::copy( other.m_left.get()+box.min()[1],
-                 other.m_left.get()+box.max()[1], m_left.get() );
-      std::copy( other.m_right.get()+box.min()[1],
-                 other.m_right.get()+box.max()[1], m_right.get() );
-      std::copy( other.m_top.get()+box.min()[0],
-                 other.m_top.get()+box.max()[0], m_top.get() );
-      std::copy( other.m_bottom.get()+box.min()[0],
-                 other.m_bottom.get()+box.max()[0], m_bottom.get() );
+      bool valid(vw::int32 i, vw::int32 j) const {
+        return i > left[j] && i < right[j] && j > top[i] && j < bottom[i];
+      }
+    };
 
-      // Modify to new coordinate system
-      std::for_each( m_left.get(), m_left.get()+box.height(),
-                     ArgValInPlaceSumFunctor<int32>( -box.min()[0] ) );
-      std::for_each( m_right.get(), m_right.get()+box.height(),
-                     ArgValInPlaceSumFunctor<int32>( -box.min()[0] ) );
-      std::for_each( m_top.get(), m_top.get()+box.width(),
-                     ArgValInPlaceSumFunctor<int32>( -box.min()[1] ) );
-      std::for_each( m_bottom.get(), m_bottom.get()+box.width(),
-                     ArgValInPlaceSumFunctor<int32>( -box.min()[1] ) );
-    }
+    ViewT m_view;
+    boost::shared_ptr<Edges> m_edges;
 
   public:
 
-    typedef typename ViewT::pixel_type orig_pixel_type;
-    typedef typename boost::remove_cv<typename boost::remove_reference<orig_pixel_type>::type>::type unmasked_pixel_type;
-    typedef vw::PixelMask<unmasked_pixel_type> pixel_type;
-    typedef vw::PixelMask<unmasked_pixel_type> result_type;
-    typedef vw::ProceduralPixelAccessor<ThreadedEdgeMaskView> pixel_accessor;
-
     ThreadedEdgeMaskView( ViewT const& view,
                           unmasked_pixel_type const& mask_value,
                           vw::int32 mask_buffer = 0,
                           vw::int32 block_size = vw::vw_settings().default_tile_size()) :
-      m_view(view), m_left( new vw::int32[view.rows()]), m_right( new vw::int32[view.rows()] ),
-      m_top( new vw::int32[view.cols()] ), m_bottom( new vw::int32[view.cols()] ) {
-      using namespace vw;
-
-      std::fill( m_left.get(),   m_left.get  ()+view.rows(), view.cols() );
-      std::fill( m_right.get(),  m_right.get ()+view.rows(), 0           );
-      std::fill( m_top.get(),    m_top.get   ()+view.cols(), view.rows() );
-      std::fill( m_bottom.get(), m_bottom.get()+view.cols(), 0           );
-
-      // Calculating edges in parallel
-      FifoWorkQueue queue( vw_settings().default_num_threads() );
-
-      std::vector<BBox2i> bboxes = subdivide_bbox( m_view, block_size, block_size );
-
-      // Figure out an ideal search step size. Smaller means we're
-      // more likely to catch small features. Bigger step size means
-      // will move a lot faster.
-      int32 search_step = norm_2(Vector2i(m_view.cols(),m_view.rows())) / 500;
-      if (search_step < 1 )
-        search_step = 1;
-      if ( search_step > 10 ) 
-        search_step = 10;
-      VW_OUT(DebugMessage, "threadededgemask") << "Setting search step to "
-                                               << search_step << std::endl;
-
-      // Find the outermost valid pixel coming in from each line/direction.
-      BOOST_FOREACH( BBox2i const& box, bboxes ) {
-        VW_OUT(DebugMessage, "threadededgemask") << "Created EdgeMaskTask for " << box << std::endl;
-        boost::shared_ptr<EdgeMaskTask> task(new EdgeMaskTask(m_view, mask_value, search_step, box, 
-                                                              m_left, m_right, m_top, m_bottom ) );
-        queue.add_task(task);
-      }
-      queue.join_all(); // Wait for all tasks to complete
-
-      // Erode the valid area by mask_buffer size on each side.
-      std::for_each( m_left.get(), m_left.get()+view.rows(),
-                     vw::ArgValInPlaceSumFunctor<vw::int32>( mask_buffer ) );
-      std::for_each( m_right.get(), m_right.get()+view.rows(),
-                     vw::ArgValInPlaceDifferenceFunctor<vw::int32>( mask_buffer ) );
-      std::for_each( m_top.get(), m_top.get()+view.cols(),
-                     vw::ArgValInPlaceSumFunctor<vw::int32>( mask_buffer ) );
-      std::for_each( m_bottom.get(), m_bottom.get()+view.cols(),
-                     vw::ArgValInPlaceDifferenceFunctor<vw::int32>( mask_buffer ) );
-    }
+      m_view(view), m_edges(new Edges(view, mask_value, mask_buffer, block_size)) {}
 
     inline vw::int32 cols  () const { return m_view.cols  (); }
     inline vw::int32 rows  () const { return m_view.rows  (); }
@@ -256,37 +207,41 @@ namespace asp {
     inline pixel_accessor origin() const { return pixel_accessor(*this); }
 
     inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p=0 ) const {
-      if ( this->valid(i,j) )
+      m_edges->find(vw::BBox2i(i, j, 1, 1));
+      if ( m_edges->valid(i,j) )
         return pixel_type(m_view(i,j,p));
       else
         return pixel_type();
     }
 
+    /// The bounding box of the valid pixels. This scans the whole
+    /// image boundary, unlike rendering a tile.
     vw::BBox2i active_area() const {
-      return vw::BBox2i( vw::Vector2i(*std::min_element(&m_left  [0], &m_left  [rows()])+1,
-                                      *std::min_element(&m_top   [0], &m_top   [cols()])+1),
-                         vw::Vector2i(*std::max_element(&m_right [0], &m_right [rows()]),
-                                      *std::max_element(&m_bottom[0], &m_bottom[cols()])) );
+      m_edges->find(vw::BBox2i(0, 0, cols(), rows()));
+      return vw::BBox2i( vw::Vector2i(*std::min_element(m_edges->left.begin(),   m_edges->left.end())+1,
+                                      *std::min_element(m_edges->top.begin(),    m_edges->top.end())+1),
+                         vw::Vector2i(*std::max_element(m_edges->right.begin(),  m_edges->right.end()),
+                                      *std::max_element(m_edges->bottom.begin(), m_edges->bottom.end())) );
     }
 
-    typedef vw::CropView<ThreadedEdgeMaskView<vw::CropView<typename ViewT::prerasterize_type> > > prerasterize_type;
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
     inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const {
-      // We are deep copying a small section of ThreadedEdgeMaskView
-      // and then uncropping back to original coordinates.
-      typedef ThreadedEdgeMaskView<vw::CropView<typename ViewT::prerasterize_type> > inner_type;
-      return vw::crop(inner_type( vw::crop(m_view.prerasterize(bbox),bbox),
-                                  *this, bbox ),
-                      -bbox.min()[0], -bbox.min()[1],
-                      this->cols(), this->rows() );
+      m_edges->find(bbox);
+      vw::ImageView<unmasked_pixel_type> copy = vw::crop(m_view, bbox);
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      for (vw::int32 r = 0; r < bbox.height(); r++) {
+        for (vw::int32 c = 0; c < bbox.width(); c++) {
+          if (m_edges->valid(c + bbox.min().x(), r + bbox.min().y()))
+            tile(c, r) = pixel_type(copy(c, r));
+        }
+      }
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                               cols(), rows());
     }
 
     template <class DestT> inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
       vw::rasterize( prerasterize(bbox), dest, bbox );
     }
-
-    // Friend other types of threaded edge mask
-    template <class OViewT>
-    friend class ThreadedEdgeMaskView;
   };
 
   template <class ViewT>
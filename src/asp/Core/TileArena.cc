@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileArena.cc
+///
+
+#include <asp/Core/TileArena.h>
+
+#include <cstdint>
+
+namespace asp {
+
+  // Buffers start at multiples of this, for vector instructions
+  const size_t ARENA_ALIGNMENT = 64;
+
+  TileArena::TileArena(): m_capacity(0), m_pos(0), m_depth(0), m_overflow_bytes(0) {}
+
+  TileArena & TileArena::local() {
+    thread_local TileArena arena;
+    return arena;
+  }
+
+  void * TileArena::alloc_bytes(size_t num_bytes) {
+
+    // Start each buffer at an aligned address, also when the block
+    // itself is not aligned
+    if (m_block) {
+      uintptr_t base = reinterpret_cast<uintptr_t>(m_block.get());
+      size_t pos = ((base + m_pos + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT
+        - base;
+      if (pos + num_bytes <= m_capacity) {
+        m_pos = pos + num_bytes;
+        return m_block.get() + pos;
+      }
+    }
+
+    // The block is full. Take this buffer from the heap, and remember
+    // how much more is needed, to grow the block later.
+    std::unique_ptr<char[]> buf(new char[num_bytes + ARENA_ALIGNMENT]);
+    uintptr_t base = reinterpret_cast<uintptr_t>(buf.get());
+    char * ptr = buf.get() + (ARENA_ALIGNMENT - base % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    m_overflow.push_back(std::move(buf));
+    m_overflow_bytes += num_bytes + ARENA_ALIGNMENT;
+    return ptr;
+  }
+
+  void TileArena::release(size_t mark) {
+    m_pos = mark;
+
+    // Buffers from the heap may be used until the outermost scope ends.
+    // Then grow the block, so that the next tile fits in it.
+    if (m_depth > 0 || mark != 0 || m_overflow.empty())
+      return;
+    size_t capacity = m_capacity + m_overflow_bytes + ARENA_ALIGNMENT;
+    m_overflow.clear();
+    m_overflow_bytes = 0;
+    m_block.reset(new char[capacity]);
+    m_capacity = capacity;
+    m_pos = 0;
+  }
+
+} // end namespace asp
@@ -0,0 +1,147 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileArena.h
+///
+/// A per-thread arena for the temporary buffers used while processing
+/// a tile. Buffers are taken from one block of memory by moving a
+/// pointer forward, and are all given back at once when the scope in
+/// which they were taken ends. The block is kept for the next tile of
+/// the same thread, so processing many tiles does not allocate and
+/// free on the heap for each one. If a tile needs more than the block
+/// holds, the extra buffers come from the heap, and the block is grown
+/// to fit once the outermost scope ends.
+
+#ifndef __ASP_CORE_TILE_ARENA_H__
+#define __ASP_CORE_TILE_ARENA_H__
+
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace asp {
+
+  class TileArena: private boost::noncopyable {
+  public:
+    TileArena();
+
+    /// The arena of the calling thread
+    static TileArena & local();
+
+    /// Uninitialized space for n values, aligned for vectorized loops.
+    /// It is valid until the innermost TileArenaScope ends.
+    template <class T>
+    T * alloc(size_t n) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "Arena buffers are never destroyed.");
+      return static_cast<T*>(alloc_bytes(n * sizeof(T)));
+    }
+
+    /// The size of the block reused across tiles
+    size_t capacity() const { return m_capacity; }
+
+  private:
+    friend class TileArenaScope;
+
+    void * alloc_bytes(size_t num_bytes);
+    size_t mark() const { return m_pos; }
+    void release(size_t mark);
+
+    std::unique_ptr<char[]>              m_block;
+    size_t                               m_capacity, m_pos;
+    int                                  m_depth;         // the number of open scopes
+    std::vector<std::unique_ptr<char[]>> m_overflow;      // from the heap, when the block is full
+    size_t                               m_overflow_bytes;
+  };
+
+  /// The buffers taken from the arena of this thread while this exists
+  /// are given back when it is destroyed
+  class TileArenaScope: private boost::noncopyable {
+  public:
+    TileArenaScope(): m_arena(TileArena::local()), m_mark(m_arena.mark()) {
+      m_arena.m_depth++;
+    }
+    ~TileArenaScope() {
+      m_arena.m_depth--;
+      m_arena.release(m_mark);
+    }
+  private:
+    TileArena & m_arena;
+    size_t      m_mark;
+  };
+
+  /// An image whose pixels are in the arena of this thread. It is a
+  /// handle, so copies share the pixels, which are valid only in the
+  /// scope in which the image was made.
+  template <class PixelT>
+  class ArenaImage: public vw::ImageViewBase<ArenaImage<PixelT>> {
+    PixelT * m_data;
+    int      m_cols, m_rows;
+
+  public:
+    typedef PixelT                                  pixel_type;
+    typedef PixelT &                                result_type;
+    typedef vw::MemoryStridingPixelAccessor<PixelT> pixel_accessor;
+
+    ArenaImage(): m_data(0), m_cols(0), m_rows(0) {}
+    ArenaImage(int cols, int rows):
+      m_data(TileArena::local().alloc<PixelT>(size_t(cols) * rows)),
+      m_cols(cols), m_rows(rows) {}
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const {
+      return pixel_accessor(m_data, 1, m_cols, ptrdiff_t(m_cols) * m_rows);
+    }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 /*p*/ = 0) const {
+      return m_data[ptrdiff_t(j) * m_cols + i];
+    }
+
+    PixelT * data() const { return m_data; }
+
+    typedef ArenaImage prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& /*bbox*/) const { return *this; }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(vw::crop(*this, bbox), dest);
+    }
+  };
+
+  /// Rasterize a view into an image in the arena of this thread
+  template <class ViewT>
+  ArenaImage<typename ViewT::pixel_type> arena_copy(vw::ImageViewBase<ViewT> const& view) {
+    ArenaImage<typename ViewT::pixel_type> image(view.impl().cols(), view.impl().rows());
+    vw::rasterize(view.impl(), image);
+    return image;
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TILE_ARENA_H__
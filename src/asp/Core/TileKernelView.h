@@ -0,0 +1,196 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file TileKernelView.h
+///
+/// A view which, for each tile, reads each of its input images once
+/// into memory and applies a kernel to them one row at a time. This
+/// is shared by tools doing per-pixel math on several images, such as
+/// image_calc, pansharp, and hsv_merge. Inputs on different grids are
+/// to be resampled with views, such as geo_transform(), before being
+/// passed in. The tiles are made in parallel when the view is written
+/// with block_write_gdal_image().
+
+#ifndef __ASP_CORE_TILE_KERNEL_VIEW_H__
+#define __ASP_CORE_TILE_KERNEL_VIEW_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Math/BBox.h>
+
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace asp {
+
+  namespace detail {
+
+    /// How an input is read for a tile and passed to the kernel. An
+    /// image is passed as a pointer to the start of a row.
+    template <class ImageT>
+    struct TileInput {
+      typedef typename ImageT::pixel_type PixelT;
+      typedef vw::ImageView<PixelT>       tile_type;
+      typedef PixelT const*               row_type;
+
+      static vw::Vector2i size(ImageT const& image) {
+        return vw::Vector2i(image.cols(), image.rows());
+      }
+      static tile_type fetch(ImageT const& image, vw::BBox2i const& bbox) {
+        return crop(image, bbox);
+      }
+      static row_type row(tile_type const& tile, int r) {
+        return &tile(0, r);
+      }
+    };
+
+    /// A list of images of the same type, whose number is known only
+    /// at run time, is passed as a list of row pointers.
+    template <class ImageT>
+    struct TileInput<std::vector<ImageT>> {
+      typedef typename ImageT::pixel_type PixelT;
+      typedef std::vector<vw::ImageView<PixelT>> tile_type;
+      typedef std::vector<PixelT const*>         row_type;
+
+      static vw::Vector2i size(std::vector<ImageT> const& images) {
+        if (images.empty())
+          vw::vw_throw(vw::ArgumentErr() << "One or more images required.\n");
+        vw::Vector2i size(images[0].cols(), images[0].rows());
+        for (size_t i = 1; i < images.size(); i++) {
+          if (images[i].cols() != size[0] || images[i].rows() != size[1])
+            vw::vw_throw(vw::ArgumentErr() << "Input images must all have the same size.\n");
+        }
+        return size;
+      }
+      static tile_type fetch(std::vector<ImageT> const& images, vw::BBox2i const& bbox) {
+        tile_type tiles(images.size());
+        for (size_t i = 0; i < images.size(); i++)
+          tiles[i] = crop(images[i], bbox);
+        return tiles;
+      }
+      static row_type row(tile_type const& tiles, int r) {
+        row_type rows(tiles.size());
+        for (size_t i = 0; i < tiles.size(); i++)
+          rows[i] = &tiles[i](0, r);
+        return rows;
+      }
+    };
+
+  } // end namespace detail
+
+  /// Apply a kernel to tiles of the input images, which must all have
+  /// the same size. The kernel has a result_type, and is invoked as
+  /// kernel(len, out, rows...) for each row of a tile, where out points
+  /// to the output pixels of the row, and there is a row argument for
+  /// each input, as given by detail::TileInput. The kernel is invoked
+  /// from several threads at once.
+  template <class KernelT, class... ImageTs>
+  class TileKernelView: public vw::ImageViewBase<TileKernelView<KernelT, ImageTs...>> {
+    KernelT                m_kernel;
+    std::tuple<ImageTs...> m_inputs;
+    int                    m_cols, m_rows;
+
+  public:
+    typedef typename KernelT::result_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<TileKernelView> pixel_accessor;
+
+    TileKernelView(KernelT const& kernel, ImageTs const&... inputs):
+      m_kernel(kernel), m_inputs(inputs...) {
+      std::vector<vw::Vector2i> sizes = {detail::TileInput<ImageTs>::size(inputs)...};
+      if (sizes.empty())
+        vw::vw_throw(vw::ArgumentErr() << "One or more images required.\n");
+      for (size_t i = 1; i < sizes.size(); i++) {
+        if (sizes[i][0] != sizes[0][0] || sizes[i][1] != sizes[0][1])
+          vw::vw_throw(vw::ArgumentErr() << "Input images must all have the same size.\n");
+      }
+      m_cols = sizes[0][0];
+      m_rows = sizes[0][1];
+    }
+
+    inline vw::int32 cols  () const { return m_cols; }
+    inline vw::int32 rows  () const { return m_rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 /*i*/, vw::int32 /*j*/, vw::int32 /*p*/ = 0) const {
+      vw::vw_throw(vw::NoImplErr() << "TileKernelView::operator()(...) is not implemented.\n");
+      return result_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      return prerasterize_impl(bbox, std::index_sequence_for<ImageTs...>());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+
+  private:
+    template <size_t... I>
+    prerasterize_type prerasterize_impl(vw::BBox2i const& bbox,
+                                        std::index_sequence<I...>) const {
+      // Read each input for the whole tile before doing any math
+      std::tuple<typename detail::TileInput<ImageTs>::tile_type...> tiles
+        (detail::TileInput<ImageTs>::fetch(std::get<I>(m_inputs), bbox)...);
+
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      for (int r = 0; r < bbox.height(); r++)
+        m_kernel(bbox.width(), &tile(0, r),
+                 detail::TileInput<ImageTs>::row(std::get<I>(tiles), r)...);
+
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+  };
+
+  template <class KernelT, class... ImageTs>
+  TileKernelView<KernelT, ImageTs...>
+  tile_kernel_view(KernelT const& kernel, ImageTs const&... inputs) {
+    return TileKernelView<KernelT, ImageTs...>(kernel, inputs...);
+  }
+
+  /// Make a row kernel out of a functor taking one pixel from each
+  /// input and returning the output pixel.
+  template <class FuncT>
+  class PerPixelKernel {
+    FuncT m_func;
+  public:
+    typedef typename FuncT::result_type result_type;
+
+    PerPixelKernel(FuncT const& func): m_func(func) {}
+
+    template <class... RowTs>
+    void operator()(int len, result_type * out, RowTs const&... rows) const {
+      for (int c = 0; c < len; c++)
+        out[c] = m_func(rows[c]...);
+    }
+  };
+
+  template <class FuncT>
+  PerPixelKernel<FuncT> per_pixel_kernel(FuncT const& func) {
+    return PerPixelKernel<FuncT>(func);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TILE_KERNEL_VIEW_H__
@@ -0,0 +1,273 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/TiledComponents.h>
+
+#include <vw/Core/Exception.h>
+
+#include <algorithm>
+
+namespace asp {
+
+  namespace {
+    vw::int32 find_label_root(std::vector<vw::int32> & parent, vw::int32 label) {
+      while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+      }
+      return label;
+    }
+  }
+
+  void label_components(vw::ImageView<vw::uint8> const& valid,
+                        vw::ImageView<vw::int32> & labels,
+                        std::vector<vw::int64> & sizes) {
+    std::vector<vw::BBox2i> boxes;
+    label_components(valid, labels, sizes, boxes);
+  }
+
+  void label_components(vw::ImageView<vw::uint8> const& valid,
+                        vw::ImageView<vw::int32> & labels,
+                        std::vector<vw::int64> & sizes,
+                        std::vector<vw::BBox2i> & boxes) {
+
+    int cols = valid.cols(), rows = valid.rows();
+    labels.set_size(cols, rows);
+
+    // First pass: provisional labels, with equivalences from the
+    // neighbors above and to the left
+    std::vector<vw::int32> parent;
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        labels(col, row) = -1;
+        if (!valid(col, row))
+          continue;
+        vw::int32 label = -1;
+        const int dc[4] = {-1, -1, 0, 1}, dr[4] = {0, -1, -1, -1};
+        for (int n = 0; n < 4; n++) {
+          int c = col + dc[n], r = row + dr[n];
+          if (c < 0 || c >= cols || r < 0 || labels(c, r) < 0)
+            continue;
+          vw::int32 other = find_label_root(parent, labels(c, r));
+          if (label < 0)
+            label = other;
+          else if (other != label)
+            parent[std::max(label, other)] = std::min(label, other);
+          label = std::min(label, other);
+        }
+        if (label < 0) {
+          label = parent.size();
+          parent.push_back(label);
+        }
+        labels(col, row) = label;
+      }
+    }
+
+    // Second pass: consecutive final labels, in order of first appearance.
+    // The root of a set is its smallest label, so it appears first.
+    std::vector<vw::int32> final_label(parent.size(), -1);
+    sizes.clear();
+    boxes.clear();
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        if (labels(col, row) < 0)
+          continue;
+        vw::int32 root = find_label_root(parent, labels(col, row));
+        if (final_label[root] < 0) {
+          final_label[root] = sizes.size();
+          sizes.push_back(0);
+          boxes.push_back(vw::BBox2i());
+        }
+        labels(col, row) = final_label[root];
+        sizes[final_label[root]]++;
+        boxes[final_label[root]].grow(vw::BBox2i(col, row, 1, 1));
+      }
+    }
+  }
+
+  void TiledComponents::split(int cols, int rows, int tile_size) {
+    if (tile_size <= 0)
+      vw::vw_throw(vw::ArgumentErr() << "The tile size must be positive.\n");
+    m_tile_size = tile_size;
+    m_tiles_x = (cols + tile_size - 1) / tile_size;
+    m_tiles_y = (rows + tile_size - 1) / tile_size;
+    for (int ty = 0; ty < m_tiles_y; ty++) {
+      for (int tx = 0; tx < m_tiles_x; tx++) {
+        vw::BBox2i box(tx * tile_size, ty * tile_size, tile_size, tile_size);
+        box.crop(vw::BBox2i(0, 0, cols, rows));
+        m_tiles.push_back(box);
+      }
+    }
+    m_info.resize(m_tiles.size());
+  }
+
+  std::vector<int> TiledComponents::tiles_in_box(vw::BBox2i const& box) const {
+    std::vector<int> out;
+    if (box.empty())
+      return out;
+    int tx0 = std::max(0, box.min().x() / m_tile_size);
+    int ty0 = std::max(0, box.min().y() / m_tile_size);
+    int tx1 = std::min(m_tiles_x - 1, (box.max().x() - 1) / m_tile_size);
+    int ty1 = std::min(m_tiles_y - 1, (box.max().y() - 1) / m_tile_size);
+    for (int ty = ty0; ty <= ty1; ty++)
+      for (int tx = tx0; tx <= tx1; tx++)
+        out.push_back(ty * m_tiles_x + tx);
+    return out;
+  }
+
+  void TiledComponents::add_tile(int tile, vw::ImageView<vw::uint8> const& valid) {
+
+    vw::ImageView<vw::int32> labels;
+    std::vector<vw::int64> sizes;
+    std::vector<vw::BBox2i> boxes;
+    label_components(valid, labels, sizes, boxes);
+
+    // The components touching the border, and where they touch it
+    int cols = labels.cols(), rows = labels.rows();
+    TileInfo & info = m_info[tile];
+    std::vector<vw::int32> index(sizes.size(), -1);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        if (row > 0 && row < rows - 1 && col > 0 && col < cols - 1)
+          col = cols - 1; // skip the interior
+        vw::int32 label = labels(col, row);
+        if (label >= 0)
+          index[label] = 0;
+      }
+    }
+    for (size_t label = 0; label < sizes.size(); label++) {
+      if (index[label] < 0)
+        continue;
+      index[label] = info.border_labels.size();
+      info.border_labels.push_back(label);
+      info.border_sizes.push_back(sizes[label]);
+      info.border_boxes.push_back(boxes[label] + m_tiles[tile].min());
+    }
+
+    auto border_index = [&](int col, int row) {
+      vw::int32 label = labels(col, row);
+      return label < 0 ? -1 : index[label];
+    };
+    info.top.resize(cols);
+    info.bottom.resize(cols);
+    for (int col = 0; col < cols; col++) {
+      info.top[col]    = border_index(col, 0);
+      info.bottom[col] = border_index(col, rows - 1);
+    }
+    info.left.resize(rows);
+    info.right.resize(rows);
+    for (int row = 0; row < rows; row++) {
+      info.left[row]  = border_index(0, row);
+      info.right[row] = border_index(cols - 1, row);
+    }
+  }
+
+  vw::int64 TiledComponents::find_root(vw::int64 id) {
+    while (m_parent[id] != id) {
+      m_parent[id] = m_parent[m_parent[id]];
+      id = m_parent[id];
+    }
+    return id;
+  }
+
+  void TiledComponents::join(vw::int64 id1, vw::int64 id2) {
+    id1 = find_root(id1);
+    id2 = find_root(id2);
+    if (id1 == id2)
+      return;
+    if (m_size[id1] < m_size[id2])
+      std::swap(id1, id2);
+    m_parent[id2] = id1;
+    m_size[id1] += m_size[id2];
+    m_box[id1].grow(m_box[id2]);
+  }
+
+  // Join the components along two facing borders of adjacent tiles.
+  // Pixel i of one border touches pixels i-1, i, i+1 of the other.
+  void TiledComponents::join_borders(int tile1, std::vector<vw::int32> const& border1,
+                                     int tile2, std::vector<vw::int32> const& border2) {
+    int len = std::min(border1.size(), border2.size());
+    for (int i = 0; i < len; i++) {
+      if (border1[i] < 0)
+        continue;
+      for (int j = std::max(0, i - 1); j <= std::min(len - 1, i + 1); j++) {
+        if (border2[j] >= 0)
+          join(m_info[tile1].first_id + border1[i], m_info[tile2].first_id + border2[j]);
+      }
+    }
+  }
+
+  void TiledComponents::merge() {
+
+    vw::int64 num = 0;
+    for (size_t t = 0; t < m_info.size(); t++) {
+      m_info[t].first_id = num;
+      num += m_info[t].border_labels.size();
+    }
+    m_parent.resize(num);
+    m_size.resize(num);
+    m_box.resize(num);
+    for (size_t t = 0; t < m_info.size(); t++) {
+      for (size_t i = 0; i < m_info[t].border_sizes.size(); i++) {
+        vw::int64 id = m_info[t].first_id + i;
+        m_parent[id] = id;
+        m_size[id]   = m_info[t].border_sizes[i];
+        m_box[id]    = m_info[t].border_boxes[i];
+      }
+    }
+
+    for (int ty = 0; ty < m_tiles_y; ty++) {
+      for (int tx = 0; tx < m_tiles_x; tx++) {
+        int t = ty * m_tiles_x + tx;
+        if (tx + 1 < m_tiles_x)
+          join_borders(t, m_info[t].right, t + 1, m_info[t + 1].left);
+        if (ty + 1 < m_tiles_y) {
+          int b = t + m_tiles_x;
+          join_borders(t, m_info[t].bottom, b, m_info[b].top);
+
+          // The corners touching diagonally
+          if (tx + 1 < m_tiles_x && m_info[t].bottom.back() >= 0 &&
+              m_info[b + 1].top.front() >= 0)
+            join(m_info[t].first_id + m_info[t].bottom.back(),
+                 m_info[b + 1].first_id + m_info[b + 1].top.front());
+          if (tx > 0 && m_info[t].bottom.front() >= 0 && m_info[b - 1].top.back() >= 0)
+            join(m_info[t].first_id + m_info[t].bottom.front(),
+                 m_info[b - 1].first_id + m_info[b - 1].top.back());
+        }
+      }
+    }
+
+    // Point each component to its root, so lookups are read-only
+    for (vw::int64 id = 0; id < num; id++)
+      m_parent[id] = find_root(id);
+  }
+
+  void TiledComponents::global_sizes(int tile, std::vector<vw::int64> & sizes) const {
+    TileInfo const& info = m_info[tile];
+    for (size_t i = 0; i < info.border_labels.size(); i++)
+      sizes[info.border_labels[i]] = m_size[m_parent[info.first_id + i]];
+  }
+
+  void TiledComponents::global_boxes(int tile, std::vector<vw::BBox2i> & boxes) const {
+    for (size_t label = 0; label < boxes.size(); label++)
+      boxes[label] += m_tiles[tile].min();
+    TileInfo const& info = m_info[tile];
+    for (size_t i = 0; i < info.border_labels.size(); i++)
+      boxes[info.border_labels[i]] = m_box[m_parent[info.first_id + i]];
+  }
+
+} // end namespace asp
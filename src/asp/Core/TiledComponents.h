@@ -0,0 +1,227 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file TiledComponents.h
+///
+/// Find the sizes and bounding boxes of the connected components of
+/// the valid pixels of an image too large for memory. Each tile is labeled on its own, in
+/// parallel, and the components touching tile borders are merged
+/// across tiles with a union-find. Then each tile can be labeled
+/// again on its own with the global sizes known, with no collar.
+
+#ifndef __ASP_CORE_TILED_COMPONENTS_H__
+#define __ASP_CORE_TILED_COMPONENTS_H__
+
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace asp {
+
+  /// Label the 8-connected components of the nonzero pixels of an
+  /// image, in the order their first pixels appear row by row. Set
+  /// the label of zero pixels to -1. Return the number of pixels in
+  /// each component.
+  void label_components(vw::ImageView<vw::uint8> const& valid,
+                        vw::ImageView<vw::int32> & labels,
+                        std::vector<vw::int64> & sizes);
+
+  /// As above, and also return the bounding box of each component
+  void label_components(vw::ImageView<vw::uint8> const& valid,
+                        vw::ImageView<vw::int32> & labels,
+                        std::vector<vw::int64> & sizes,
+                        std::vector<vw::BBox2i> & boxes);
+
+  /// The sizes of the connected components of the valid pixels of an
+  /// image, with the image split into tiles for the work.
+  class TiledComponents {
+  public:
+
+    /// Label the tiles in parallel, then merge the components across
+    /// tile borders. The image is rendered once, by tiles.
+    template <class ImageT>
+    TiledComponents(vw::ImageViewBase<ImageT> const& img, int tile_size, int num_threads);
+
+    /// The tiles, row by row
+    std::vector<vw::BBox2i> const& tiles() const { return m_tiles; }
+
+    /// The indices of the tiles intersecting the box
+    std::vector<int> tiles_in_box(vw::BBox2i const& box) const;
+
+    /// The number of pixels in each component of the given tile,
+    /// given the labels of its pixels and the sizes of its components
+    /// within the tile, as found by label_components(). The tile must
+    /// be rendered the same way as for the constructor.
+    void global_sizes(int tile, std::vector<vw::int64> & sizes) const;
+
+    /// The bounding box of each component of the given tile, in pixels
+    /// of the whole image, given the boxes of its components within the
+    /// tile, in pixels of the tile, as found by label_components().
+    void global_boxes(int tile, std::vector<vw::BBox2i> & boxes) const;
+
+  private:
+
+    // A tile gets this from labeling. Only the components touching the
+    // tile border are recorded. The border pixels store their index
+    // in border_labels, or -1 if invalid.
+    struct TileInfo {
+      std::vector<vw::int32> border_labels; // sorted local labels
+      std::vector<vw::int64> border_sizes;
+      std::vector<vw::BBox2i> border_boxes; // in image pixels
+      std::vector<vw::int32> top, bottom, left, right;
+      vw::int64 first_id;
+    };
+
+    template <class ImageT>
+    class LabelTask: public vw::Task, private boost::noncopyable {
+      ImageT const& m_img;
+      TiledComponents & m_comp;
+      int m_tile;
+    public:
+      LabelTask(ImageT const& img, TiledComponents & comp, int tile):
+        m_img(img), m_comp(comp), m_tile(tile) {}
+      void operator()() {
+        vw::BBox2i box = m_comp.m_tiles[m_tile];
+        vw::ImageView<typename ImageT::pixel_type> tile_img = vw::crop(m_img, box);
+        vw::ImageView<vw::uint8> valid(tile_img.cols(), tile_img.rows());
+        for (int row = 0; row < valid.rows(); row++)
+          for (int col = 0; col < valid.cols(); col++)
+            valid(col, row) = is_valid(tile_img(col, row));
+        m_comp.add_tile(m_tile, valid);
+      }
+    };
+
+    void split(int cols, int rows, int tile_size);
+    void add_tile(int tile, vw::ImageView<vw::uint8> const& valid);
+    void merge();
+    vw::int64 find_root(vw::int64 id);
+    void join(vw::int64 id1, vw::int64 id2);
+    void join_borders(int tile1, std::vector<vw::int32> const& border1,
+                      int tile2, std::vector<vw::int32> const& border2);
+
+    int m_tile_size, m_tiles_x, m_tiles_y;
+    std::vector<vw::BBox2i> m_tiles;
+    std::vector<TileInfo>   m_info;
+
+    // The union-find of the components touching tile borders. After
+    // merging, each one points to its root.
+    std::vector<vw::int64> m_parent;
+    std::vector<vw::int64> m_size; // for the roots
+    std::vector<vw::BBox2i> m_box; // for the roots
+  };
+
+  template <class ImageT>
+  TiledComponents::TiledComponents(vw::ImageViewBase<ImageT> const& img,
+                                   int tile_size, int num_threads) {
+    split(img.impl().cols(), img.impl().rows(), tile_size);
+    vw::FifoWorkQueue queue(num_threads);
+    for (size_t it = 0; it < m_tiles.size(); it++) {
+      boost::shared_ptr<LabelTask<ImageT>> task(new LabelTask<ImageT>(img.impl(), *this, it));
+      queue.add_task(task);
+    }
+    queue.join_all();
+    merge();
+  }
+
+  /// Invalidate the pixels of the image in components with no more
+  /// than the given number of pixels. Each tile of the components is
+  /// rendered and labeled in full when a rendered box intersects it,
+  /// so the boxes should be aligned with those tiles.
+  template <class ImageT>
+  class RemoveSmallComponentsView:
+    public vw::ImageViewBase<RemoveSmallComponentsView<ImageT>> {
+    ImageT m_img;
+    boost::shared_ptr<TiledComponents> m_comp;
+    vw::int64 m_max_size;
+
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<RemoveSmallComponentsView> pixel_accessor;
+
+    RemoveSmallComponentsView(ImageT const& img, boost::shared_ptr<TiledComponents> comp,
+                              vw::int64 max_size):
+      m_img(img), m_comp(comp), m_max_size(max_size) {}
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p = 0) const {
+      return prerasterize(vw::BBox2i(i, j, 1, 1))(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> out(bbox.width(), bbox.height());
+      std::vector<vw::BBox2i> const& tiles = m_comp->tiles();
+      for (int t: m_comp->tiles_in_box(bbox)) {
+        vw::BBox2i common = tiles[t];
+        common.crop(bbox);
+        if (common.empty())
+          continue;
+
+        vw::ImageView<pixel_type> tile_img = vw::crop(m_img, tiles[t]);
+        vw::ImageView<vw::uint8> valid(tile_img.cols(), tile_img.rows());
+        for (int row = 0; row < valid.rows(); row++)
+          for (int col = 0; col < valid.cols(); col++)
+            valid(col, row) = is_valid(tile_img(col, row));
+        vw::ImageView<vw::int32> labels;
+        std::vector<vw::int64> sizes;
+        label_components(valid, labels, sizes);
+        m_comp->global_sizes(t, sizes);
+
+        for (int row = common.min().y(); row < common.max().y(); row++) {
+          for (int col = common.min().x(); col < common.max().x(); col++) {
+            int tc = col - tiles[t].min().x(), tr = row - tiles[t].min().y();
+            pixel_type pix = tile_img(tc, tr);
+            int label = labels(tc, tr);
+            if (label >= 0 && sizes[label] <= m_max_size)
+              pix.invalidate();
+            out(col - bbox.min().x(), row - bbox.min().y()) = pix;
+          }
+        }
+      }
+      return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  RemoveSmallComponentsView<ImageT>
+  remove_small_components(vw::ImageViewBase<ImageT> const& img,
+                          boost::shared_ptr<TiledComponents> comp, vw::int64 max_size) {
+    return RemoveSmallComponentsView<ImageT>(img.impl(), comp, max_size);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TILED_COMPONENTS_H__
@@ -0,0 +1,205 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TiledHoleFill.h
+///
+/// Fill the small holes of an image too large for memory. A hole is a
+/// connected component of invalid pixels not touching the image
+/// border. The holes are found once for the whole image, with the
+/// tiles labeled in parallel and merged as in TiledComponents. Then
+/// each tile fills the holes it has whose bounding box is small
+/// enough, reading only the region around those holes, so no tile
+/// needs a collar as large as the biggest hole to fill.
+
+#ifndef __ASP_CORE_TILED_HOLE_FILL_H__
+#define __ASP_CORE_TILED_HOLE_FILL_H__
+
+#include <asp/Core/TiledComponents.h>
+
+#include <vw/Core/Functors.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  /// Valid where the input pixel is invalid, so that the holes are the
+  /// components to find
+  struct HoleMaskFunctor: public vw::ReturnFixedType<vw::PixelMask<vw::uint8>> {
+    template <class PixelT>
+    vw::PixelMask<vw::uint8> operator()(PixelT const& pix) const {
+      vw::PixelMask<vw::uint8> hole(1);
+      if (is_valid(pix))
+        hole.invalidate();
+      return hole;
+    }
+  };
+
+  /// If a hole with this bounding box is to be filled. It must not
+  /// touch the image border, so it is enclosed by valid pixels.
+  inline bool is_fillable_hole(vw::BBox2i const& hole_box, int cols, int rows, int max_len) {
+    return hole_box.width() <= max_len && hole_box.height() <= max_len &&
+      hole_box.min().x() > 0 && hole_box.min().y() > 0 &&
+      hole_box.max().x() < cols && hole_box.max().y() < rows;
+  }
+
+  /// The value at a pixel of a hole, the inverse distance weighted
+  /// average of the nearest valid pixels along the 8 directions from
+  /// it. Any invalid pixel next to a hole is in the hole, so each ray
+  /// stays in the hole until it reaches a valid pixel, within the
+  /// bounding box of the hole grown by one pixel.
+  template <class PixelT>
+  PixelT inpaint_pixel(vw::ImageView<PixelT> const& img, int col, int row) {
+    typedef typename PixelT::child_type ChildT;
+    const int dc[8] = {1, 1, 0, -1, -1, -1, 0, 1}, dr[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    ChildT sum = ChildT();
+    double wt_sum = 0.0;
+    for (int n = 0; n < 8; n++) {
+      int c = col + dc[n], r = row + dr[n];
+      for (int step = 1; c >= 0 && c < img.cols() && r >= 0 && r < img.rows(); step++) {
+        if (is_valid(img(c, r))) {
+          double dist = step * ((dc[n] != 0 && dr[n] != 0) ? std::sqrt(2.0) : 1.0);
+          sum    += img(c, r).child() * float(1.0 / dist);
+          wt_sum += 1.0 / dist;
+          break;
+        }
+        c += dc[n];
+        r += dr[n];
+      }
+    }
+    PixelT out = img(col, row);
+    if (wt_sum > 0)
+      out = PixelT(sum / float(wt_sum));
+    return out;
+  }
+
+  /// Fill the holes of the image whose bounding box is no larger than
+  /// the given length along each axis. Only the pixels of the holes
+  /// change. As with RemoveSmallComponentsView, each tile of the
+  /// components is rendered and labeled in full when a rendered box
+  /// intersects it, so the boxes should be aligned with those tiles.
+  template <class ImageT>
+  class FillSmallHolesView: public vw::ImageViewBase<FillSmallHolesView<ImageT>> {
+    ImageT m_img;
+    boost::shared_ptr<TiledComponents> m_holes;
+    int m_max_len;
+
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<FillSmallHolesView> pixel_accessor;
+
+    FillSmallHolesView(ImageT const& img, boost::shared_ptr<TiledComponents> holes,
+                       int max_len):
+      m_img(img), m_holes(holes), m_max_len(max_len) {}
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    inline result_type operator()(vw::int32 i, vw::int32 j, vw::int32 p = 0) const {
+      return prerasterize(vw::BBox2i(i, j, 1, 1))(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> out(bbox.width(), bbox.height());
+      std::vector<vw::BBox2i> const& tiles = m_holes->tiles();
+      for (int t: m_holes->tiles_in_box(bbox)) {
+        vw::BBox2i tile = tiles[t];
+        vw::BBox2i common = tile;
+        common.crop(bbox);
+        if (common.empty())
+          continue;
+
+        vw::ImageView<pixel_type> tile_img = vw::crop(m_img, tile);
+        vw::ImageView<vw::uint8> hole(tile_img.cols(), tile_img.rows());
+        for (int row = 0; row < hole.rows(); row++)
+          for (int col = 0; col < hole.cols(); col++)
+            hole(col, row) = !is_valid(tile_img(col, row));
+        vw::ImageView<vw::int32> labels;
+        std::vector<vw::int64> sizes;
+        std::vector<vw::BBox2i> boxes;
+        label_components(hole, labels, sizes, boxes);
+        m_holes->global_boxes(t, boxes);
+
+        // The region to read is the tile and the holes to fill in it,
+        // with the valid pixels around them
+        std::vector<bool> fill(boxes.size(), false);
+        vw::BBox2i region = tile;
+        for (size_t label = 0; label < boxes.size(); label++) {
+          fill[label] = is_fillable_hole(boxes[label], cols(), rows(), m_max_len);
+          if (!fill[label])
+            continue;
+          vw::BBox2i grown = boxes[label];
+          grown.expand(1);
+          region.grow(grown);
+        }
+        vw::ImageView<pixel_type> region_img;
+        if (region == tile)
+          region_img = tile_img;
+        else
+          region_img = vw::crop(m_img, region);
+
+        for (int row = common.min().y(); row < common.max().y(); row++) {
+          for (int col = common.min().x(); col < common.max().x(); col++) {
+            int tc = col - tile.min().x(), tr = row - tile.min().y();
+            pixel_type pix = tile_img(tc, tr);
+            int label = labels(tc, tr);
+            if (label >= 0 && fill[label])
+              pix = inpaint_pixel(region_img, col - region.min().x(), row - region.min().y());
+            out(col - bbox.min().x(), row - bbox.min().y()) = pix;
+          }
+        }
+      }
+      return prerasterize_type(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Find the holes of the image, as the first pass over it, and
+  /// return the view filling the small ones. The image should be cached
+  /// or cheap to render, as it is rendered again for the second pass.
+  template <class ImageT>
+  FillSmallHolesView<ImageT>
+  fill_small_holes(vw::ImageViewBase<ImageT> const& img, int max_len,
+                   int tile_size, int num_threads) {
+    boost::shared_ptr<TiledComponents>
+      holes(new TiledComponents(vw::per_pixel_filter(img.impl(), HoleMaskFunctor()),
+                                tile_size, num_threads));
+    return FillSmallHolesView<ImageT>(img.impl(), holes, max_len);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TILED_HOLE_FILL_H__
@@ -0,0 +1,64 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/BundleAdjustUtils.h>
+
+#include <vw/BundleAdjustment/ControlNetwork.h>
+
+using namespace vw;
+using namespace vw::ba;
+using namespace asp;
+
+TEST( BAObservations, FromControlNetwork ) {
+
+  // Three points seen in two of three cameras, in varying order
+  ControlNetwork cnet("test");
+  int cams[3][2] = {{1, 0}, {0, 2}, {2, 1}};
+  for (int ipt = 0; ipt < 3; ipt++) {
+    ControlPoint cp;
+    for (int it = 0; it < 2; it++)
+      cp.add_measure(ControlMeasure(100.25 * ipt + it, 50.5 * ipt, 1.0 + it, 1.0 + it,
+                                    cams[ipt][it]));
+    cnet.add_control_point(cp);
+  }
+
+  BAObservations obs(cnet, 3);
+  ASSERT_EQ(obs.num_cameras(), 3);
+  ASSERT_EQ(obs.size(), 6u);
+
+  // Each camera has its observations in the order of the points
+  int expected_points[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+  for (int icam = 0; icam < 3; icam++) {
+    ASSERT_EQ(obs.end(icam) - obs.begin(icam), 2u);
+    for (size_t it = 0; it < 2; it++)
+      EXPECT_EQ(obs.point_id(obs.begin(icam) + it), expected_points[icam][it]);
+  }
+
+  // Point 2 is the first measure in camera 2
+  size_t iobs = obs.begin(2) + 1;
+  EXPECT_EQ(obs.pixel(iobs), Vector2(200.5, 101.0));
+  EXPECT_EQ(obs.sigma(iobs), Vector2(1.0, 1.0));
+
+  std::vector<int> counts;
+  obs.count_point_observations(3, counts);
+  EXPECT_EQ(counts, std::vector<int>(3, 2));
+
+  // Out of range cameras are an error
+  EXPECT_THROW(BAObservations(cnet, 2), ArgumentErr);
+}
@@ -0,0 +1,97 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/BBoxIndex.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( BBoxIndex, MatchesBruteForce ) {
+
+  // A 4 x 3 layout of overlapping boxes, plus an empty one
+  std::vector<BBox2i> boxes;
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 4; col++)
+      boxes.push_back(BBox2i(col*90, row*70, 120, 100));
+  boxes.push_back(BBox2i());
+
+  BBoxIndex index(boxes, 64);
+  EXPECT_EQ(int(boxes.size()), index.size());
+
+  for (int y = -50; y < 350; y += 37) {
+    for (int x = -50; x < 450; x += 41) {
+      BBox2i query(x, y, 30, 20);
+      std::vector<int> ids;
+      index.query(query, ids);
+
+      std::vector<int> expected;
+      for (size_t it = 0; it < boxes.size(); it++) {
+        if (!boxes[it].empty() && boxes[it].intersects(query))
+          expected.push_back(it);
+      }
+      EXPECT_EQ(expected, ids);
+    }
+  }
+}
+
+TEST( BBoxIndex, EmptyAndInvalid ) {
+
+  std::vector<BBox2i> boxes;
+  BBoxIndex index(boxes, 16);
+  std::vector<int> ids(1, 5);
+  index.query(BBox2i(0, 0, 10, 10), ids);
+  EXPECT_TRUE(ids.empty());
+
+  boxes.push_back(BBox2i(0, 0, 10, 10));
+  EXPECT_THROW(BBoxIndex(boxes, 0), ArgumentErr);
+}
+
+TEST( BBoxIndex, OverlappingPairs ) {
+
+  // Footprints of various sizes, some far apart, an empty one, and a point
+  std::vector<BBox2> boxes;
+  for (int it = 0; it < 200; it++) {
+    double x = -120.0 + 0.037 * it + ((it % 7) == 0 ? 30.0 : 0.0);
+    double y = 35.0 + 0.011 * (it % 13);
+    double w = 0.01 + 0.002 * (it % 5), h = 0.02 + 0.003 * (it % 3);
+    boxes.push_back(BBox2(x, y, w, h));
+  }
+  boxes.push_back(BBox2());
+  boxes.push_back(BBox2(boxes[10].min(), boxes[10].min()));
+
+  std::vector<std::pair<int, int>> pairs;
+  overlapping_box_pairs(boxes, pairs);
+
+  std::vector<std::pair<int, int>> expected;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    for (size_t j = i + 1; j < boxes.size(); j++) {
+      if (boxes[i].empty() || boxes[j].empty())
+        continue;
+      BBox2 box = boxes[i];
+      box.crop(boxes[j]);
+      if (!box.empty())
+        expected.push_back(std::make_pair(int(i), int(j)));
+    }
+  }
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(expected, pairs);
+
+  overlapping_box_pairs(std::vector<BBox2>(3), pairs);
+  EXPECT_TRUE(pairs.empty());
+}
@@ -0,0 +1,65 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/BackgroundWriter.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace asp;
+
+TEST( BackgroundWriter, Coalesce ) {
+
+  std::mutex gate;
+  std::vector<int> written;
+  std::atomic<bool> started(false);
+  {
+    BackgroundWriter writer;
+
+    // Hold the first job, while more are submitted
+    gate.lock();
+    writer.submit([&] { started = true; std::lock_guard<std::mutex> lock(gate);
+                        written.push_back(0); });
+    while (!started)
+      std::this_thread::yield();
+    for (int it = 1; it <= 3; it++)
+      writer.submit([&written, it] { written.push_back(it); });
+    gate.unlock();
+
+    // Only the first and the last job run
+    writer.wait();
+    EXPECT_EQ(written, std::vector<int>({0, 3}));
+    EXPECT_EQ(writer.num_skipped(), 2);
+
+    // A job submitted before the writer goes away is still done
+    writer.submit([&written] { written.push_back(4); });
+  }
+  EXPECT_EQ(written.back(), 4);
+}
+
+TEST( BackgroundWriter, Failure ) {
+  BackgroundWriter writer;
+  bool done = false;
+  writer.submit([] { throw std::runtime_error("cannot write"); });
+  writer.wait();
+  writer.submit([&done] { done = true; });
+  writer.wait();
+  EXPECT_TRUE(done);
+}
@@ -59,3 +59,29 @@ TEST(Bathymetry, BathyStereoModel) {
   EXPECT_NEAR(sin(theta1), water_refraction_index * sin(theta2), 1e-12);
 }
 
+
+// The cached water surface projection must agree with the exact one
+TEST(Bathymetry, WaterSurfaceProjCache) {
+
+  vw::cartography::GeoReference projection;
+  projection.set_datum(vw::cartography::Datum("WGS_1984"));
+  projection.set_stereographic(24.6, -81.4, 1.0);
+
+  Vector3 center = projection.datum().geodetic_to_cartesian(Vector3(-81.38, 24.61, -5.0));
+  WaterSurfaceProjCache cache;
+  for (int i = -3; i <= 3; i++) {
+    for (int j = -3; j <= 3; j++) {
+      Vector3 xyz = center + Vector3(400.0 * i, -300.0 * j, 250.0 * (i + j));
+      Vector3 exact = projection.geodetic_to_point
+        (projection.datum().cartesian_to_geodetic(xyz));
+      Vector3 proj_pt = cache.proj(projection, xyz);
+      EXPECT_VECTOR_NEAR(proj_pt, exact, 1e-3);
+      EXPECT_VECTOR_NEAR(cache.unproj(projection, exact), xyz, 1e-3);
+    }
+  }
+
+  // Points far away, which are converted exactly
+  Vector3 far = center + Vector3(20000.0, 0.0, 0.0);
+  Vector3 exact = projection.geodetic_to_point(projection.datum().cartesian_to_geodetic(far));
+  EXPECT_VECTOR_NEAR(cache.proj(projection, far), exact, 1e-6);
+}
@@ -0,0 +1,137 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/CameraFootprint.h>
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+using namespace vw;
+using namespace asp;
+
+// A flat DEM at 100 m above WGS84 around lon = lat = 0, seen by a
+// nadir-looking pinhole camera 10 km above it.
+class CameraFootprintTest: public ::testing::Test {
+protected:
+  void SetUp() {
+    cartography::GeoReference georef;
+    georef.set_well_known_geogcs("WGS84");
+    Matrix3x3 affine;
+    affine(0,0) = 0.001;
+    affine(1,1) = -0.001;
+    affine(2,2) = 1;
+    affine(0,2) = -0.1;
+    affine(1,2) = 0.1;
+    georef.set_transform(affine);
+
+    ImageView<float> dem(200, 200);
+    fill(dem, 100.0);
+    double nodata = -1000;
+    bool has_nodata = true, has_georef = true;
+    TerminalProgressCallback tpc("asp", ": ");
+    vw::GdalWriteOptions opt;
+    dem_file = "camera_footprint_test_dem.tif";
+    vw::cartography::block_write_gdal_image(dem_file, dem, has_georef, georef,
+                                            has_nodata, nodata, opt, tpc);
+
+    datum = georef.datum();
+    ctr = datum.geodetic_to_cartesian(Vector3(0, 0, 10000));
+
+    // The camera z axis points down, x points east, and y south
+    rot.set_zero();
+    rot(1, 0) = 1;
+    rot(2, 1) = -1;
+    rot(0, 2) = -1;
+  }
+
+  std::string dem_file;
+  cartography::Datum datum;
+  Vector3 ctr;
+  Matrix3x3 rot;
+};
+
+TEST_F(CameraFootprintTest, InsideDem) {
+
+  // Exercise both the low-resolution and the full-resolution DEM
+  int lowres_size = 50;
+  FootprintDem dem(dem_file, lowres_size);
+  camera::PinholeModel cam(ctr, rot, 1000, 1000, 100, 100);
+  Vector2i image_size(200, 200);
+
+  double mean_gsd = 0.0;
+  std::vector<Vector3> boundary;
+  BBox2 box = camera_footprint(dem, cam, image_size, mean_gsd, &boundary);
+  EXPECT_EQ(4 * 100, boundary.size());
+
+  // The footprint corners are where the corner rays meet the flat DEM
+  double h = 100.0;
+  double a = datum.semi_major_axis() + h, b = datum.semi_minor_axis() + h;
+  Vector3 ul = cartography::datum_intersection(a, b, cam.camera_center(Vector2(0, 0)),
+                                               cam.pixel_to_vector(Vector2(0, 0)));
+  Vector3 lr = cartography::datum_intersection(a, b, cam.camera_center(Vector2(199, 199)),
+                                               cam.pixel_to_vector(Vector2(199, 199)));
+  Vector3 ul_llh = datum.cartesian_to_geodetic(ul);
+  Vector3 lr_llh = datum.cartesian_to_geodetic(lr);
+  EXPECT_NEAR(ul_llh[0], box.min().x(), 1e-6);
+  EXPECT_NEAR(lr_llh[1], box.min().y(), 1e-6);
+  EXPECT_NEAR(lr_llh[0], box.max().x(), 1e-6);
+  EXPECT_NEAR(ul_llh[1], box.max().y(), 1e-6);
+
+  // The ground sample distance, in degrees, is about 9.9 m
+  EXPECT_NEAR(9.9 / 111319.5, mean_gsd, 3e-6);
+
+  // The same in parallel, for several cameras
+  std::vector<boost::shared_ptr<camera::CameraModel>> cams;
+  std::vector<Vector2i> image_sizes;
+  for (int it = 0; it < 3; it++) {
+    cams.push_back(boost::shared_ptr<camera::CameraModel>
+                   (new camera::PinholeModel(ctr, rot, 1000, 1000, 100, 100)));
+    image_sizes.push_back(image_size);
+  }
+  std::vector<BBox2> boxes;
+  int num_threads = 2;
+  camera_footprints(dem, cams, image_sizes, num_threads, boxes);
+  ASSERT_EQ(3, boxes.size());
+  for (int it = 0; it < 3; it++) {
+    EXPECT_VECTOR_NEAR(box.min(), boxes[it].min(), 1e-10);
+    EXPECT_VECTOR_NEAR(box.max(), boxes[it].max(), 1e-10);
+  }
+}
+
+TEST_F(CameraFootprintTest, BeyondDem) {
+
+  // A wide-angle camera sees past the DEM on all sides, so the
+  // footprint is the DEM extent, to within an image pixel.
+  FootprintDem dem(dem_file);
+  camera::PinholeModel cam(ctr, rot, 50, 50, 100, 100);
+  double mean_gsd = 0.0;
+  BBox2 box = camera_footprint(dem, cam, Vector2i(200, 200), mean_gsd);
+
+  double tol = 0.003; // an image pixel is about 0.0018 degrees
+  EXPECT_NEAR(-0.1, box.min().x(), tol);
+  EXPECT_NEAR(-0.1, box.min().y(), tol);
+  EXPECT_NEAR( 0.1, box.max().x(), tol);
+  EXPECT_NEAR( 0.1, box.max().y(), tol);
+
+  // A camera far from the DEM has no footprint
+  Vector3 far_ctr = datum.geodetic_to_cartesian(Vector3(10, 10, 10000));
+  camera::PinholeModel far_cam(far_ctr, rot, 1000, 1000, 100, 100);
+  EXPECT_THROW(camera_footprint(dem, far_cam, Vector2i(200, 200), mean_gsd),
+               vw::ArgumentErr);
+}
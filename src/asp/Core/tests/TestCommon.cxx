@@ -18,6 +18,7 @@
 
 #include <test/Helpers.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/FileUtils.h>
 
 using namespace vw;
 using namespace asp;
@@ -143,3 +144,39 @@ TEST( Common, StereoMultiCmdCheck ) {
   EXPECT_EQ("dem.tif" , dem_path);
 
 } // End test StereoMultiCmdCheck
+
+TEST( Common, cache_file_name ) {
+
+  // The name depends only on the key, and is the same for all builds
+  std::string file1 = cache_file_name("dir", "stats-", "key one", ".txt");
+  std::string file2 = cache_file_name("dir", "stats-", "key two", ".txt");
+  EXPECT_EQ(file1, cache_file_name("dir", "stats-", "key one", ".txt"));
+  EXPECT_NE(file1, file2);
+  EXPECT_EQ("dir/stats-cbf29ce484222325.txt", cache_file_name("dir", "stats-", "", ".txt"));
+
+  // A missing file has no time stamp
+  EXPECT_EQ("0", file_timestamp("no_such_file_for_cache_test.txt"));
+}
+
+TEST( Common, QuantizeImagePixels ) {
+
+  QuantizeImagePixels<Vector4> quantize(0.25);
+
+  // Invalid points stay invalid
+  EXPECT_EQ(Vector4i(), quantize(Vector4()));
+
+  Vector4i q = quantize(Vector4(1.0, -2.6, 0.3, 0.1));
+  EXPECT_EQ(4,  q[0]);
+  EXPECT_EQ(-10, q[1]);
+  EXPECT_EQ(1,  q[2]);
+  EXPECT_EQ(0,  q[3]);
+
+  // A valid point next to the center stays valid
+  q = quantize(Vector4(-0.01, 0.02, 0.0, 5.0));
+  EXPECT_EQ(-1, q[0]);
+  EXPECT_EQ(0,  q[1]);
+  EXPECT_EQ(20, q[3]);
+
+  // Out of range becomes invalid
+  EXPECT_EQ(Vector4i(), quantize(Vector4(1e10, 0.0, 0.0, 0.0)));
+}
@@ -0,0 +1,160 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/CorrEval.h>
+#include <vw/Image/BlockRasterize.h>
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  ImageView<PixelMask<float>> random_image(int cols, int rows) {
+    ImageView<PixelMask<float>> img(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        img(col, row) = PixelMask<float>(rand() % 1000 / 10.0);
+        if (rand() % 13 == 0)
+          img(col, row).invalidate();
+      }
+    }
+    return img;
+  }
+
+  // The metric at one pixel, summing over the patch directly
+  PixelMask<float> brute_force_eval(ImageView<PixelMask<float>> const& left,
+                                    ImageView<PixelMask<float>> const& right,
+                                    PixelMask<Vector2f> const& d,
+                                    int col, int row, Vector2i const& half,
+                                    bool use_ncc, bool round_to_int) {
+    PixelMask<float> result;
+    result.invalidate();
+    if (!is_valid(d))
+      return result;
+
+    Vector2i D;
+    double w[4] = {1.0, 0.0, 0.0, 0.0};
+    int num_shifts = 1;
+    if (round_to_int) {
+      D = Vector2i(round(d.child()[0]), round(d.child()[1]));
+    } else {
+      D = Vector2i(floor(d.child()[0]), floor(d.child()[1]));
+      double fx = d.child()[0] - D[0], fy = d.child()[1] - D[1];
+      w[0] = (1 - fx) * (1 - fy);
+      w[1] = fx * (1 - fy);
+      w[2] = (1 - fx) * fy;
+      w[3] = fx * fy;
+      num_shifts = 4;
+    }
+    Vector2i shifts[4] = {Vector2i(0, 0), Vector2i(1, 0), Vector2i(0, 1), Vector2i(1, 1)};
+
+    double n = 0, sl = 0, sll = 0, sr = 0, slr = 0, srr = 0;
+    for (int y = row - half[1]; y <= row + half[1]; y++) {
+      for (int x = col - half[0]; x <= col + half[0]; x++) {
+        if (x < 0 || y < 0 || x >= left.cols() || y >= left.rows() || !is_valid(left(x, y)))
+          continue;
+        bool valid = true;
+        double r = 0.0;
+        for (int s = 0; s < num_shifts; s++) {
+          Vector2i p = Vector2i(x, y) + D + shifts[s];
+          if (p[0] < 0 || p[1] < 0 || p[0] >= right.cols() || p[1] >= right.rows() ||
+              !is_valid(right(p[0], p[1]))) {
+            valid = false;
+            break;
+          }
+          r += w[s] * right(p[0], p[1]).child();
+        }
+        if (!valid)
+          continue;
+        double l = left(x, y).child();
+        n++;
+        sl += l; sll += l * l; sr += r; slr += l * r; srr += r * r;
+      }
+    }
+
+    if (n == 0)
+      return result;
+    if (use_ncc) {
+      if (sll * srr <= 0)
+        return result;
+      return PixelMask<float>(slr / sqrt(sll * srr));
+    }
+    double lvar = std::max(sll / n - (sl / n) * (sl / n), 0.0);
+    double rvar = std::max(srr / n - (sr / n) * (sr / n), 0.0);
+    return PixelMask<float>((sqrt(lvar) + sqrt(rvar)) / 2.0);
+  }
+}
+
+TEST( CorrEval, MatchesBruteForce ) {
+
+  srand(5);
+  int cols = 61, rows = 47;
+  ImageView<PixelMask<float>> left  = random_image(cols, rows);
+  ImageView<PixelMask<float>> right = random_image(cols + 5, rows + 3);
+
+  // A smoothly varying disparity, with some invalid pixels and outliers
+  ImageView<PixelMask<Vector2f>> disp(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      disp(col, row) = PixelMask<Vector2f>(Vector2f(2.3 + 0.05 * col, -1.6 + 0.04 * row));
+      if (rand() % 11 == 0)
+        disp(col, row).invalidate();
+      if (rand() % 97 == 0)
+        disp(col, row) = PixelMask<Vector2f>(Vector2f(500, -300));
+    }
+  }
+
+  Vector2i kernel_size(7, 5);
+  Vector2i half = kernel_size / 2;
+  for (int metric_it = 0; metric_it < 2; metric_it++) {
+    for (int round_it = 0; round_it < 2; round_it++) {
+      for (int sample_rate = 1; sample_rate <= 2; sample_rate++) {
+
+        bool use_ncc = (metric_it == 0), round_to_int = (round_it == 1);
+        std::string metric = use_ncc ? "ncc" : "stddev";
+
+        // Small tiles, so patches cross tile boundaries
+        ImageView<PixelMask<float>> eval
+          = block_rasterize(corr_eval(left, right, disp, kernel_size, metric,
+                                      sample_rate, round_to_int),
+                            Vector2i(16, 16), 2);
+
+        for (int row = 0; row < rows; row++) {
+          for (int col = 0; col < cols; col++) {
+            PixelMask<float> expected;
+            expected.invalidate();
+            if (col % sample_rate == 0 && row % sample_rate == 0)
+              expected = brute_force_eval(left, right, disp(col, row), col, row, half,
+                                          use_ncc, round_to_int);
+            ASSERT_EQ(is_valid(expected), is_valid(eval(col, row)));
+            if (is_valid(expected))
+              EXPECT_NEAR(expected.child(), eval(col, row).child(), 1e-4);
+          }
+        }
+      }
+    }
+  }
+
+  // The kernel size must be odd
+  EXPECT_THROW(corr_eval(left, right, disp, Vector2i(4, 5), "ncc", 1, false),
+               vw::ArgumentErr);
+}
@@ -0,0 +1,71 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/CostProfile.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+using namespace asp;
+
+TEST( CostProfile, Counters ) {
+
+  CostProfile profile;
+  EXPECT_FALSE(profile.enabled());
+  EXPECT_EQ("run/out-cost-profile.json", profile.profile_file("run/out"));
+
+  // The same name gives the same counters
+  CostProfile::Stats * s = profile.stats("XYZError");
+  EXPECT_EQ(s, profile.stats("XYZError"));
+  EXPECT_NE(s, profile.stats("CamError"));
+  s->num_calls += 4;
+  s->num_jacobian_calls += 1;
+  s->nanoseconds += 2000;
+
+  profile.add_solver_stat("iterations", 3);
+  profile.add_solver_stat("iterations", 5);
+
+  std::string text = profile.json();
+  EXPECT_NE(std::string::npos, text.find("\"name\": \"XYZError\", \"evaluations\": 4, "
+                                         "\"jacobian_evaluations\": 1"));
+  EXPECT_NE(std::string::npos, text.find("\"microseconds_per_evaluation\": 0.5"));
+  EXPECT_NE(std::string::npos, text.find("\"iterations\": 8"));
+  // In the order first seen
+  EXPECT_LT(text.find("XYZError"), text.find("CamError"));
+
+  profile.reset();
+  EXPECT_EQ(std::string::npos, profile.json().find("XYZError"));
+}
+
+TEST( CostProfile, Write ) {
+
+  CostProfile profile;
+  profile.stats("SmoothnessError")->num_calls++;
+
+  std::string out_prefix = "cost_profile_test/run";
+  std::string file = profile.profile_file(out_prefix);
+  EXPECT_NO_THROW(profile.write(out_prefix));
+  EXPECT_TRUE(boost::filesystem::exists(file));
+
+  std::ifstream ifs(file.c_str());
+  std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_NE(std::string::npos, text.find("\"name\": \"SmoothnessError\""));
+
+  boost::filesystem::remove_all("cost_profile_test");
+}
@@ -0,0 +1,116 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemAggregation.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // The affine transform of a grid with given spacing and upper-left corner
+  Matrix3x3 grid_transform(double spacing, double x0, double y0) {
+    Matrix3x3 T;
+    T.set_identity();
+    T(0, 0) = spacing;
+    T(1, 1) = -spacing;
+    T(0, 2) = x0;
+    T(1, 2) = y0;
+    return T;
+  }
+}
+
+TEST( DemAggregation, Overlaps ) {
+  std::vector<std::pair<int, double>> overlaps;
+
+  // The same grid
+  grid_overlaps(3.0, 0.5, overlaps);
+  ASSERT_EQ(overlaps.size(), 1u);
+  EXPECT_EQ(overlaps[0].first, 3);
+  EXPECT_NEAR(overlaps[0].second, 1.0, 1e-12);
+
+  // Three times coarser, centered on a fine cell
+  grid_overlaps(6.0, 1.5, overlaps);
+  ASSERT_EQ(overlaps.size(), 3u);
+  EXPECT_EQ(overlaps[0].first, 5);
+  EXPECT_EQ(overlaps[2].first, 7);
+  for (size_t k = 0; k < overlaps.size(); k++)
+    EXPECT_NEAR(overlaps[k].second, 1.0, 1e-12);
+
+  // Twice coarser, the end cells are split in half
+  grid_overlaps(4.0, 1.0, overlaps);
+  ASSERT_EQ(overlaps.size(), 3u);
+  EXPECT_NEAR(overlaps[0].second, 0.5, 1e-12);
+  EXPECT_NEAR(overlaps[1].second, 1.0, 1e-12);
+  EXPECT_NEAR(overlaps[2].second, 0.5, 1e-12);
+
+  // Not a multiple. The overlaps add up to the width.
+  grid_overlaps(2.2, 0.75, overlaps);
+  double total = 0;
+  for (size_t k = 0; k < overlaps.size(); k++)
+    total += overlaps[k].second;
+  EXPECT_NEAR(total, 1.5, 1e-12);
+}
+
+TEST( DemAggregation, Dem ) {
+  // Fine grid with unit spacing, and the height equal to x + 10 * y.
+  // The weights vary, and there is a hole.
+  int nc = 20, nr = 16;
+  ImageView<Vector2> accum(nc, nr);
+  for (int r = 0; r < nr; r++) {
+    for (int c = 0; c < nc; c++) {
+      double x = 100.0 + c, y = 50.0 - r;
+      double wt = 1.0 + (c + r) % 3;
+      accum(c, r) = Vector2(wt * (x + 10 * y), wt);
+    }
+  }
+  accum(4, 4) = Vector2(0, 0);
+  Matrix3x3 fine = grid_transform(1.0, 100.0, 50.0);
+  std::int64_t num_invalid = 0;
+  vw::Mutex count_mutex;
+  float nodata = -1e+6;
+
+  // On the same grid the DEM is the quotient
+  ImageView<PixelGray<float>> same
+    = AggregatedDemView(accum, fine, fine, nc, nr, nodata, &num_invalid, &count_mutex);
+  EXPECT_NEAR(same(3, 2), 103.0 + 10 * 48.0, 1e-3);
+  EXPECT_EQ(same(4, 4), nodata);
+  EXPECT_EQ(num_invalid, 1);
+
+  // On a grid three times coarser, the heights are averaged over whole
+  // fine cells. Since the height is linear, the average is the height
+  // at the center.
+  Matrix3x3 coarse = grid_transform(3.0, 102.0, 48.0);
+  ImageView<PixelGray<float>> dem
+    = AggregatedDemView(accum, fine, coarse, 5, 4, nodata, &num_invalid, &count_mutex);
+  EXPECT_NEAR(dem(3, 1), (102.0 + 9) + 10 * (48.0 - 3), 1e-3);
+  EXPECT_NEAR(dem(2, 2), (102.0 + 6) + 10 * (48.0 - 6), 1e-3);
+
+  // Not a multiple
+  Matrix3x3 other = grid_transform(2.5, 102.5, 47.5);
+  ImageView<PixelGray<float>> dem2
+    = AggregatedDemView(accum, fine, other, 6, 5, nodata, &num_invalid, &count_mutex);
+  double val = dem2(2, 2);
+  EXPECT_NEAR(val, (102.5 + 5) + 10 * (47.5 - 5), 1.0);
+
+  // Beyond the fine grid there is no data
+  Matrix3x3 far = grid_transform(3.0, 500.0, 48.0);
+  ImageView<PixelGray<float>> dem3
+    = AggregatedDemView(accum, fine, far, 2, 2, nodata, &num_invalid, &count_mutex);
+  EXPECT_EQ(dem3(0, 0), nodata);
+}
@@ -0,0 +1,64 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemHillshade.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( DemHillshade, SubsampleFactor ) {
+  EXPECT_EQ(1, subsample_factor(4000, 4000, 16.0e+6));
+  EXPECT_EQ(2, subsample_factor(4001, 4000, 16.0e+6));
+  EXPECT_EQ(3, subsample_factor(10000, 10000, 16.0e+6));
+}
+
+TEST( DemHillshade, Slopes ) {
+
+  // A flat DEM is lit by the sine of the light elevation
+  ImageView<PixelMask<float>> dem(8, 6);
+  for (int row = 0; row < dem.rows(); row++)
+    for (int col = 0; col < dem.cols(); col++)
+      dem(col, row) = PixelMask<float>(100.0);
+  invalidate(dem(3, 2));
+
+  float nodata = -1.0;
+  double elevation = 30.0;
+  ImageView<float> shade;
+  hillshade(dem, Vector2(2, 2), 45, elevation, nodata, shade);
+  EXPECT_EQ(nodata, shade(3, 2));
+  for (int row = 0; row < dem.rows(); row++) {
+    for (int col = 0; col < dem.cols(); col++) {
+      if (col != 3 || row != 2)
+        EXPECT_NEAR(0.5, shade(col, row), 1e-6);
+    }
+  }
+
+  // A slope going up to the east, at 45 degrees, faces a light from
+  // the west at an elevation of 45 degrees, and is away from a light
+  // from the east at the same elevation. The rows are not used.
+  for (int row = 0; row < dem.rows(); row++)
+    for (int col = 0; col < dem.cols(); col++)
+      dem(col, row) = PixelMask<float>(2.0 * col);
+  hillshade(dem, Vector2(2, 3), 270, 45, nodata, shade);
+  EXPECT_NEAR(1.0, shade(0, 0), 1e-6);
+  EXPECT_NEAR(1.0, shade(4, 3), 1e-6);
+  EXPECT_NEAR(1.0, shade(7, 5), 1e-6);
+  hillshade(dem, Vector2(2, 3), 90, 45, nodata, shade);
+  EXPECT_NEAR(0.0, shade(4, 3), 1e-6);
+}
@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemIndex.h>
+#include <asp/Core/Common.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+
+TEST( DemIndex, WriteAndRead ) {
+
+  cartography::GeoReference georef;
+  georef.set_well_known_geogcs("D_MARS");
+  Matrix3x3 affine;
+  affine(0,0) = 0.01;
+  affine(1,1) = -0.01;
+  affine(2,2) = 1;
+  affine(0,2) = 30;
+  affine(1,2) = -35;
+  georef.set_transform(affine);
+
+  ImageView<float> dem(40, 30);
+  double nodata = -1000;
+  bool has_nodata = true, has_georef = true;
+  TerminalProgressCallback tpc("asp", ": ");
+  vw::GdalWriteOptions opt;
+  std::string dem_file = "dem_index_test_dem.tif", index_file = "dem_index_test.txt";
+  vw::cartography::block_write_gdal_image(dem_file, dem, has_georef, georef,
+                                          has_nodata, nodata, opt, tpc);
+
+  // The first time the DEM is opened and the index created
+  std::vector<std::string> files(1, dem_file);
+  std::vector<DemInfo> infos;
+  boost::filesystem::remove(index_file);
+  load_dem_infos(files, index_file, infos);
+  ASSERT_EQ(1, infos.size());
+  EXPECT_EQ(BBox2i(0, 0, 40, 30), infos[0].pixel_box);
+  EXPECT_TRUE(infos[0].has_nodata);
+  EXPECT_EQ(nodata, infos[0].nodata);
+  EXPECT_TRUE(boost::filesystem::exists(index_file));
+
+  // Then the same information is read from the index
+  std::vector<DemInfo> index_infos;
+  ASSERT_TRUE(read_dem_index(index_file, index_infos));
+  ASSERT_EQ(1, index_infos.size());
+  EXPECT_EQ(dem_file, index_infos[0].file);
+  EXPECT_EQ(infos[0].timestamp, index_infos[0].timestamp);
+  EXPECT_EQ(infos[0].pixel_box, index_infos[0].pixel_box);
+  EXPECT_VECTOR_NEAR(infos[0].lonlat_box.min(), index_infos[0].lonlat_box.min(), 1e-12);
+  EXPECT_VECTOR_NEAR(infos[0].lonlat_box.max(), index_infos[0].lonlat_box.max(), 1e-12);
+  Vector2 pix(12.5, 7.25);
+  EXPECT_VECTOR_NEAR(infos[0].georef.pixel_to_lonlat(pix),
+                     index_infos[0].georef.pixel_to_lonlat(pix), 1e-12);
+  EXPECT_NEAR(infos[0].georef.datum().semi_major_axis(),
+              index_infos[0].georef.datum().semi_major_axis(), 1e-6);
+
+  // The footprint lookup
+  std::vector<int> ids;
+  dems_in_lonlat_box(index_infos, BBox2(30.1, -35.1, 0.05, 0.05), ids);
+  EXPECT_EQ(1, ids.size());
+  dems_in_lonlat_box(index_infos, BBox2(50, 10, 1, 1), ids);
+  EXPECT_EQ(0, ids.size());
+
+  boost::filesystem::remove(dem_file);
+  boost::filesystem::remove(index_file);
+}
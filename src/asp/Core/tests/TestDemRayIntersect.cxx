@@ -0,0 +1,141 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemRayIntersect.h>
+#include <vw/Cartography/Datum.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A geographic georeference around lon = lat = 0, with pixels of
+  // about 111 m
+  cartography::GeoReference test_georef() {
+    cartography::GeoReference georef;
+    georef.set_well_known_geogcs("WGS84");
+    Matrix3x3 affine;
+    affine(0,0) = 0.001;
+    affine(1,1) = -0.001;
+    affine(2,2) = 1;
+    affine(0,2) = -0.15;
+    affine(1,2) = 0.1;
+    georef.set_transform(affine);
+    return georef;
+  }
+
+  Vector3 ground_point(DemRayIntersector const& dem, Vector2 const& pix) {
+    double h = 0;
+    EXPECT_TRUE(dem.height(pix, h));
+    Vector2 ll = dem.georef().pixel_to_lonlat(pix);
+    return dem.georef().datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], h));
+  }
+}
+
+TEST( DemRayIntersect, RollingTerrain ) {
+
+  // Hills, with a hole of no-data
+  int cols = 300, rows = 200;
+  ImageView<PixelMask<double>> img(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      img(col, row) = PixelMask<double>(1000.0 + 300.0 * sin(col / 20.0) * cos(row / 15.0));
+      if (col >= 200 && col < 220 && row >= 50 && row < 70)
+        img(col, row).invalidate();
+    }
+  }
+  cartography::GeoReference georef = test_georef();
+  DemRayIntersector dem(img, georef);
+  EXPECT_NEAR(700.0,  dem.min_height(), 1.0);
+  EXPECT_NEAR(1300.0, dem.max_height(), 1.0);
+
+  // Rays from 500 km away, at most 20 degrees off the vertical, meet
+  // the hills where they were aimed
+  srand(3);
+  std::vector<Vector3> ctrs, dirs, targets;
+  for (int it = 0; it < 200; it++) {
+    Vector2 pix(1 + (rand() % 1000) * (cols - 3) / 1000.0,
+                1 + (rand() % 1000) * (rows - 3) / 1000.0);
+    if (pix[0] > 198 && pix[0] < 222 && pix[1] > 48 && pix[1] < 72)
+      continue;
+    Vector3 target = ground_point(dem, pix);
+    Vector3 up = target / norm_2(target);
+    Vector3 side = normalize(cross_prod(up, Vector3(0, 0, 1)));
+    double angle = (rand() % 1000) / 1000.0 * 20.0 * M_PI / 180.0;
+    Vector3 dir = -cos(angle) * up + sin(angle) * side;
+    Vector3 ctr = target - 5e5 * dir;
+
+    Vector3 xyz;
+    ASSERT_TRUE(dem.intersect(ctr, dir, xyz));
+    EXPECT_LT(norm_2(xyz - target), 0.01);
+    ctrs.push_back(ctr);
+    dirs.push_back(dir);
+    targets.push_back(target);
+  }
+
+  // The same in parallel
+  std::vector<Vector3> xyz;
+  int num_threads = 3;
+  dem.intersect(ctrs, dirs, num_threads, xyz);
+  ASSERT_EQ(ctrs.size(), xyz.size());
+  for (size_t it = 0; it < xyz.size(); it++)
+    EXPECT_LT(norm_2(xyz[it] - targets[it]), 0.01);
+
+  // A vertical ray through the hole, and one away from the DEM, miss
+  Vector2 ll = georef.pixel_to_lonlat(Vector2(210, 60));
+  Vector3 top = georef.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], 5e5));
+  Vector3 down = -top / norm_2(top);
+  Vector3 out;
+  EXPECT_FALSE(dem.intersect(top, down, out));
+  EXPECT_FALSE(dem.intersect(top, -down, out));
+}
+
+TEST( DemRayIntersect, FirstHit ) {
+
+  // Flat ground with a ridge. A low ray from the west meets the west
+  // face of the ridge, not the ground behind it.
+  int cols = 400, rows = 50;
+  ImageView<PixelMask<double>> img(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double h = (col >= 200 && col <= 210) ? 500.0 : 0.0;
+      img(col, row) = PixelMask<double>(h);
+    }
+  }
+  cartography::GeoReference georef = test_georef();
+  DemRayIntersector dem(img, georef);
+
+  // From above pixel 20 at 300 m to pixel 380 on the ground
+  Vector2 ll0 = georef.pixel_to_lonlat(Vector2(20, 25));
+  Vector2 ll1 = georef.pixel_to_lonlat(Vector2(380, 25));
+  Vector3 beg = georef.datum().geodetic_to_cartesian(Vector3(ll0[0], ll0[1], 300));
+  Vector3 end = georef.datum().geodetic_to_cartesian(Vector3(ll1[0], ll1[1], 0));
+  Vector3 xyz;
+  ASSERT_TRUE(dem.intersect(beg, end - beg, xyz));
+  Vector3 llh = georef.datum().cartesian_to_geodetic(xyz);
+  Vector2 pix = georef.lonlat_to_pixel(subvector(llh, 0, 2));
+  EXPECT_NEAR(199.5, pix[0], 0.5);
+  EXPECT_GT(llh[2], 100.0);
+
+  // An empty DEM is never met
+  DemRayIntersector empty;
+  EXPECT_FALSE(empty.intersect(beg, end - beg, xyz));
+}
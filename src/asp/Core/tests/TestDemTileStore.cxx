@@ -0,0 +1,172 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemTileStore.h>
+
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Interpolation.h>
+
+#include <cmath>
+#include <set>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // A DEM spanning three by three tiles, with a hole of no-data
+  ImageView<PixelMask<float>> test_dem() {
+    ImageView<PixelMask<float>> dem(600, 530);
+    for (int row = 0; row < dem.rows(); row++)
+      for (int col = 0; col < dem.cols(); col++)
+        dem(col, row) = PixelMask<float>(100.0 + 0.5 * col - 0.25 * row
+                                         + 10.0 * sin(col / 7.0) * cos(row / 9.0));
+    for (int row = 250; row < 260; row++)
+      for (int col = 300; col < 305; col++)
+        dem(col, row).invalidate();
+    return dem;
+  }
+}
+
+TEST( DemTileStore, MortonCode ) {
+  EXPECT_EQ(0u, morton_code(0, 0));
+  EXPECT_EQ(1u, morton_code(1, 0));
+  EXPECT_EQ(2u, morton_code(0, 1));
+  EXPECT_EQ(3u, morton_code(1, 1));
+  EXPECT_EQ(10u, morton_code(0, 3));
+  EXPECT_EQ(0xFFFFFFFFFFFFFFFFULL, morton_code(0xFFFFFFFF, 0xFFFFFFFF));
+}
+
+TEST( DemTileStore, BlockedGridOrder ) {
+  std::vector<Vector2i> points;
+  blocked_grid_order(BBox2i(1, 2, 5, 3), 2, points);
+  ASSERT_EQ(15u, points.size());
+
+  // The first block, row by row, then the block to its right, then
+  // the one below it
+  EXPECT_EQ(Vector2i(1, 2), points[0]);
+  EXPECT_EQ(Vector2i(2, 2), points[1]);
+  EXPECT_EQ(Vector2i(1, 3), points[2]);
+  EXPECT_EQ(Vector2i(2, 3), points[3]);
+  EXPECT_EQ(Vector2i(3, 2), points[4]);
+  EXPECT_EQ(Vector2i(1, 4), points[8]);
+  EXPECT_EQ(Vector2i(5, 4), points[14]);
+
+  // Each point once
+  std::set<std::pair<int, int>> seen;
+  for (size_t it = 0; it < points.size(); it++)
+    seen.insert(std::make_pair(points[it].x(), points[it].y()));
+  EXPECT_EQ(15u, seen.size());
+
+  blocked_grid_order(BBox2i(0, 0, 0, 4), 2, points);
+  EXPECT_TRUE(points.empty());
+}
+
+TEST( DemTileStore, Heights ) {
+
+  ImageView<PixelMask<float>> dem = test_dem();
+  DemTileStore store(dem);
+  EXPECT_EQ(dem.cols(), store.cols());
+  EXPECT_EQ(dem.rows(), store.rows());
+
+  // The pixels, including at the tile borders
+  int samples[] = {0, 1, 253, 254, 255, 256, 509, 510, 511, 528, 529};
+  for (int r: samples) {
+    for (int c: samples) {
+      EXPECT_EQ(is_valid(dem(c, r)), is_valid(store.pixel(c, r)));
+      if (is_valid(dem(c, r)))
+        EXPECT_EQ(dem(c, r).child(), store.pixel(c, r).child());
+    }
+  }
+
+  // Agrees with interpolating the image, and the batch query with
+  // the single ones
+  InterpolationView<EdgeExtensionView<ImageView<PixelMask<float>>, ConstantEdgeExtension>,
+                    BilinearInterpolation> interp_dem = interpolate(dem);
+  std::vector<Vector2> pixels;
+  for (double y = -1.5; y < dem.rows() + 1; y += 6.37)
+    for (double x = -1.5; x < dem.cols() + 1; x += 4.91)
+      pixels.push_back(Vector2(x, y));
+  pixels.push_back(Vector2(254.5, 254.5));
+  pixels.push_back(Vector2(302.0, 255.0)); // in the hole
+  pixels.push_back(Vector2(dem.cols() - 1, 3.0)); // on the last column
+
+  std::vector<double> heights;
+  store.heights(pixels, heights);
+  ASSERT_EQ(pixels.size(), heights.size());
+  int num_valid = 0;
+  for (size_t it = 0; it < pixels.size(); it++) {
+    Vector2 pix = pixels[it];
+    double h = 0;
+    bool ans = store.height(pix, h);
+    bool in_dem = (pix[0] >= 0 && pix[0] < dem.cols() - 1 &&
+                   pix[1] >= 0 && pix[1] < dem.rows() - 1);
+    PixelMask<float> expected = interp_dem(pix[0], pix[1]);
+    EXPECT_EQ(in_dem && is_valid(expected), ans);
+    EXPECT_EQ(ans, !std::isnan(heights[it]));
+    if (!ans)
+      continue;
+    num_valid++;
+    EXPECT_NEAR(expected.child(), h, 1e-4);
+    EXPECT_EQ(h, heights[it]);
+  }
+  EXPECT_GT(num_valid, 1000);
+
+  // Each tile is read once
+  EXPECT_EQ(9, store.num_tile_reads());
+}
+
+TEST( DemTileStore, CacheAndRead ) {
+
+  ImageView<PixelMask<float>> dem = test_dem();
+
+  // Room for one tile only, so going back and forth reads tiles again
+  DemTileStore store(dem, 0.0);
+  double h = 0;
+  EXPECT_TRUE(store.height(Vector2(10.5, 10.5), h));
+  EXPECT_TRUE(store.height(Vector2(400.5, 10.5), h));
+  EXPECT_TRUE(store.height(Vector2(10.5, 10.5), h));
+  EXPECT_EQ(3, store.num_tile_reads());
+
+  // A region across tiles, and partly outside the DEM
+  BBox2i box(240, 500, 300, 40);
+  ImageView<PixelMask<float>> region;
+  store.read(box, region);
+  ASSERT_EQ(box.width(),  region.cols());
+  ASSERT_EQ(box.height(), region.rows());
+  for (int row = 0; row < region.rows(); row++) {
+    for (int col = 0; col < region.cols(); col++) {
+      int c = col + box.min().x(), r = row + box.min().y();
+      if (r >= dem.rows()) {
+        EXPECT_FALSE(is_valid(region(col, row)));
+        continue;
+      }
+      ASSERT_TRUE(is_valid(region(col, row)));
+      EXPECT_EQ(dem(c, r).child(), region(col, row).child());
+    }
+  }
+
+  // The same through the image view
+  ImageView<PixelMask<float>> view_region = crop(DemTileView(store), BBox2i(240, 500, 300, 30));
+  EXPECT_EQ(dem(241, 501).child(), view_region(1, 1).child());
+  EXPECT_EQ(dem(539, 529).child(), view_region(299, 29).child());
+
+  // An empty DEM has no heights
+  DemTileStore empty;
+  EXPECT_FALSE(empty.height(Vector2(0, 0), h));
+}
@@ -0,0 +1,118 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DescriptorMatcher.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+// Random interest points with descriptors of the given length. For binary
+// descriptors each value is a byte.
+std::vector<ip::InterestPoint> random_ip(int num, int len, bool binary) {
+  std::vector<ip::InterestPoint> ip(num);
+  for (int it = 0; it < num; it++) {
+    ip[it].descriptor.set_size(len);
+    for (int c = 0; c < len; c++) {
+      if (binary)
+        ip[it].descriptor[c] = rand() % 256;
+      else
+        ip[it].descriptor[c] = rand() / double(RAND_MAX);
+    }
+  }
+  return ip;
+}
+
+// The distances the matchers are expected to use
+double dist_l2(ip::InterestPoint const& a, ip::InterestPoint const& b) {
+  double dist = 0.0;
+  for (size_t c = 0; c < a.descriptor.size(); c++)
+    dist += (a.descriptor[c] - b.descriptor[c]) * (a.descriptor[c] - b.descriptor[c]);
+  return dist;
+}
+
+double dist_hamming(ip::InterestPoint const& a, ip::InterestPoint const& b) {
+  int dist = 0;
+  for (size_t c = 0; c < a.descriptor.size(); c++) {
+    unsigned char diff = (unsigned char)(a.descriptor[c]) ^ (unsigned char)(b.descriptor[c]);
+    for (int bit = 0; bit < 8; bit++)
+      dist += (diff >> bit) & 1;
+  }
+  return dist;
+}
+
+TEST(DescriptorMatcher, BruteForceIsExact) {
+
+  srand(7);
+  for (int binary = 0; binary < 2; binary++) {
+
+    // A length which is not a multiple of 8 tests the padding
+    int len = binary ? 29 : 64;
+    std::vector<ip::InterestPoint> ip1 = random_ip(50, len, binary);
+    std::vector<ip::InterestPoint> ip2 = random_ip(200, len, binary);
+    boost::shared_ptr<DescriptorMatcher> matcher
+      = make_descriptor_matcher(ip2, "brute-force", binary);
+    ASSERT_EQ(200, matcher->size());
+
+    for (size_t i = 0; i < ip1.size(); i++) {
+      int nearest = -1;
+      double dist1 = 0, dist2 = 0;
+      ASSERT_TRUE(matcher->find_two_nearest(ip1[i].descriptor, nearest, dist1, dist2));
+
+      // Find the two nearest the slow way
+      std::vector<double> dists;
+      for (size_t j = 0; j < ip2.size(); j++)
+        dists.push_back(binary ? dist_hamming(ip1[i], ip2[j]) : dist_l2(ip1[i], ip2[j]));
+      std::vector<double> sorted = dists;
+      std::sort(sorted.begin(), sorted.end());
+      EXPECT_NEAR(sorted[0], dist1, 1e-4);
+      EXPECT_NEAR(sorted[1], dist2, 1e-4);
+      EXPECT_NEAR(sorted[0], dists[nearest], 1e-4);
+    }
+  }
+}
+
+TEST(DescriptorMatcher, UniquenessThreshold) {
+
+  srand(11);
+  std::vector<ip::InterestPoint> ip2 = random_ip(100, 32, true);
+
+  // Each query is a copy of a point, so it is at distance 0 from it,
+  // and is kept with any threshold. A point equally far from two others
+  // is not kept.
+  std::vector<ip::InterestPoint> ip1;
+  ip1.push_back(ip2[10]);
+  ip1.push_back(ip2[42]);
+  std::vector<ip::InterestPoint> ip3 = ip2;
+  ip3.push_back(ip2[5]);
+  ip1.push_back(ip2[5]);
+
+  std::vector<int> match_index;
+  boost::shared_ptr<DescriptorMatcher> matcher
+    = make_descriptor_matcher(ip3, "brute-force", true);
+  match_descriptors(ip1, *matcher, 0.8, 4, match_index);
+  ASSERT_EQ(3u, match_index.size());
+  EXPECT_EQ(10, match_index[0]);
+  EXPECT_EQ(42, match_index[1]);
+  EXPECT_EQ(-1, match_index[2]);
+
+  EXPECT_THROW(make_descriptor_matcher(ip2, "no-such-method", true), ArgumentErr);
+}
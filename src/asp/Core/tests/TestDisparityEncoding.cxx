@@ -0,0 +1,110 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DisparityEncoding.h>
+
+#include <vw/Image/Manipulation.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // A low-resolution disparity with large values and a hole
+  ImageView<PixelMask<Vector2f>> make_sub_disp() {
+    ImageView<PixelMask<Vector2f>> sub_disp(10, 8);
+    for (int r = 0; r < sub_disp.rows(); r++)
+      for (int c = 0; c < sub_disp.cols(); c++)
+        sub_disp(c, r) = PixelMask<Vector2f>(Vector2f(1500.0 + 3.25 * c, -40.5 + r));
+    invalidate(sub_disp(4, 3));
+    return sub_disp;
+  }
+}
+
+TEST( DisparityEncoding, RoundTrip ) {
+  ImageView<PixelMask<Vector2f>> sub_disp = make_sub_disp();
+  Vector2 seed_scale(4.0, 4.0);
+
+  // A tile of the full-resolution disparity, not at the image origin
+  Vector2i origin(8, 5);
+  ImageView<PixelMask<Vector2f>> disp(25, 20);
+  for (int r = 0; r < disp.rows(); r++)
+    for (int c = 0; c < disp.cols(); c++)
+      disp(c, r) = PixelMask<Vector2f>(Vector2f(6010.3 + 13.0 * (c + origin[0]) / 4.0,
+                                                -160.77 + r * 0.1));
+  invalidate(disp(3, 2));
+  disp(7, 7) = PixelMask<Vector2f>(Vector2f(1e+6, 0.0)); // too far from the seed
+
+  DisparitySeedView seed(sub_disp, seed_scale, origin, disp.cols(), disp.rows());
+  ImageView<DispCodeT> codes = per_pixel_view(disp, seed, EncodeDisparity(RD_DISP_QUANTUM));
+  ImageView<PixelMask<Vector2f>> out
+    = per_pixel_view(codes, seed, DecodeDisparity(RD_DISP_QUANTUM));
+
+  for (int r = 0; r < disp.rows(); r++) {
+    for (int c = 0; c < disp.cols(); c++) {
+      if ((c == 3 && r == 2) || (c == 7 && r == 7)) {
+        EXPECT_FALSE(is_valid(out(c, r)));
+        continue;
+      }
+      ASSERT_TRUE(is_valid(out(c, r)));
+      EXPECT_NEAR(out(c, r).child()[0], disp(c, r).child()[0], RD_DISP_QUANTUM/2 + 1e-3);
+      EXPECT_NEAR(out(c, r).child()[1], disp(c, r).child()[1], RD_DISP_QUANTUM/2 + 1e-3);
+    }
+  }
+
+  // The seed is the mean where D_sub is invalid, and an integer
+  // everywhere
+  Vector2f fill = seed(4 * 4 - origin[0], 3 * 4 - origin[1]);
+  EXPECT_EQ(fill, Vector2f(round(fill[0]), round(fill[1])));
+  EXPECT_NEAR(fill[0], 4 * (1500.0 + 3.25 * 4.5), 1.0);
+  EXPECT_EQ(seed(0, 0), Vector2f(round(4 * (1500.0 + 3.25 * 2)), round(4 * (-40.5 + 1))));
+
+  // Integer disparities are kept exactly
+  ImageView<PixelMask<Vector2f>> int_disp = copy(disp);
+  for (int r = 0; r < int_disp.rows(); r++)
+    for (int c = 0; c < int_disp.cols(); c++)
+      int_disp(c, r).child() = Vector2f(round(disp(c, r).child()[0]),
+                                        round(disp(c, r).child()[1]));
+  ImageView<PixelMask<Vector2f>> int_out
+    = per_pixel_view(per_pixel_view(int_disp, seed, EncodeDisparity(D_DISP_QUANTUM)),
+                     seed, DecodeDisparity(D_DISP_QUANTUM));
+  EXPECT_EQ(int_out(10, 11).child(), int_disp(10, 11).child());
+}
+
+TEST( DisparityEncoding, SeedHash ) {
+  ImageView<PixelMask<Vector2f>> sub_disp = make_sub_disp();
+  std::string hash = disparity_seed_hash(sub_disp);
+  EXPECT_EQ(hash.size(), 16u);
+  EXPECT_EQ(hash, disparity_seed_hash(make_sub_disp()));
+
+  sub_disp(1, 1).child()[0] += 1.0;
+  EXPECT_NE(hash, disparity_seed_hash(sub_disp));
+
+  std::map<std::string, std::string> keywords
+    = compact_disparity_keywords(sub_disp, Vector2(4, 4), Vector2i(512, 0), RD_DISP_QUANTUM);
+  EXPECT_EQ(keywords[ASP_DISP_ENCODING_TAG_STR], DISP_ENCODING_SEED_RESIDUAL);
+  EXPECT_EQ(keywords[ASP_DISP_ORIGIN_TAG_STR], "512 0");
+  EXPECT_EQ(keywords[ASP_DISP_SCALE_TAG_STR], "0.03125");
+}
+
+TEST( DisparityEncoding, SeedFile ) {
+  EXPECT_EQ(disparity_seed_file("run/out-RD.tif"), "run/out-D_sub.tif");
+  EXPECT_EQ(disparity_seed_file("run/my-out-D.tif"), "run/my-out-D_sub.tif");
+  EXPECT_EQ(disparity_seed_file("run/out-0_0_512_512/0_0_512_512-RD.tif"),
+            "run/out-0_0_512_512/0_0_512_512-D_sub.tif");
+}
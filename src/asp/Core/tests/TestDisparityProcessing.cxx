@@ -0,0 +1,53 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DisparityProcessing.h>
+#include <vw/Image/Transform.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST(DisparityProcessing, UnalignHomography) {
+
+  Matrix3x3 align;
+  align(0,0) = 1.02;  align(0,1) = 0.03;  align(0,2) = -12.5;
+  align(1,0) = -0.01; align(1,1) = 0.98;  align(1,2) = 7.25;
+  align(2,0) = 1e-5;  align(2,1) = -2e-5; align(2,2) = 1.0;
+  vw::TransformPtr tx(new HomographyTransform(align));
+
+  Matrix3x3 H;
+  BBox2i box(0, 0, 500, 400);
+  ASSERT_TRUE(unalign_homography(tx, box, H));
+
+  for (int row = 0; row < box.height(); row += 37) {
+    for (int col = 0; col < box.width(); col += 41) {
+      Vector2 pix(col, row);
+      Vector2 expected = tx->reverse(pix);
+      EXPECT_VECTOR_NEAR(apply_homography(H, pix), expected, 1e-6);
+    }
+  }
+}
+
+TEST(DisparityProcessing, UnalignHomographyOtherTransform) {
+
+  // Not a homography, so the transform must be applied as is
+  vw::TransformPtr tx(new TranslateTransform(3.0, 4.0));
+  Matrix3x3 H;
+  EXPECT_FALSE(unalign_homography(tx, BBox2i(0, 0, 100, 100), H));
+}
@@ -0,0 +1,76 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DisparityTileCache.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // A disparity linear in the pixel, with a hole
+  ImageView<DisparityTileCache::pixel_type> make_disp() {
+    ImageView<DisparityTileCache::pixel_type> disp(100, 60);
+    for (int r = 0; r < disp.rows(); r++)
+      for (int c = 0; c < disp.cols(); c++)
+        disp(c, r) = DisparityTileCache::pixel_type(Vector2f(10.0 + 0.5 * c, -3.0 + 0.25 * r));
+    disp(40, 30).invalidate();
+    return disp;
+  }
+}
+
+TEST(DisparityTileCache, Interpolate) {
+  ImageView<DisparityTileCache::pixel_type> disp = make_disp();
+
+  // Only the tiles around the pixels are read
+  std::vector<Vector2> pixels;
+  pixels.push_back(Vector2(5.0, 5.0));
+  pixels.push_back(Vector2(45.5, 28.0));
+  DisparityTileCache cache;
+  cache.load(disp, pixels, 2.0, 1, 16);
+  EXPECT_EQ(3, cache.num_tiles());
+
+  Vector2 d;
+  ASSERT_TRUE(cache.interpolate(Vector2(5.25, 6.5), d));
+  EXPECT_NEAR(10.0 + 0.5 * 5.25, d[0], 1e-5);
+  EXPECT_NEAR(-3.0 + 0.25 * 6.5, d[1], 1e-5);
+  ASSERT_TRUE(cache.interpolate(Vector2(47.0, 30.0), d));
+  EXPECT_NEAR(10.0 + 0.5 * 47.0, d[0], 1e-5);
+
+  // Next to an invalid pixel, not read, and out of bounds
+  EXPECT_FALSE(cache.interpolate(Vector2(39.5, 29.5), d));
+  EXPECT_FALSE(cache.interpolate(Vector2(90.0, 50.0), d));
+  EXPECT_FALSE(cache.interpolate(Vector2(-0.5, 5.0), d));
+
+  // With subsampling the linear disparity is unchanged away from the
+  // hole and the edges
+  DisparityTileCache sub_cache;
+  sub_cache.load(disp, pixels, 2.0, 4, 16);
+  ASSERT_TRUE(sub_cache.interpolate(Vector2(6.0, 5.0), d));
+  EXPECT_NEAR(10.0 + 0.5 * 6.0, d[0], 1e-5);
+  EXPECT_NEAR(-3.0 + 0.25 * 5.0, d[1], 1e-5);
+
+  // The average skips the invalid pixel
+  ASSERT_TRUE(sub_cache.interpolate(Vector2(41.5, 29.5), d));
+
+  // An empty disparity
+  DisparityTileCache empty;
+  empty.load(ImageView<DisparityTileCache::pixel_type>(), pixels, 2.0, 1);
+  EXPECT_FALSE(empty.interpolate(Vector2(5.0, 5.0), d));
+  EXPECT_EQ(0, empty.num_tiles());
+}
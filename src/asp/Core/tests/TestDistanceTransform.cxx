@@ -0,0 +1,78 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DistanceTransform.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+// The distance to the nearest pixel with zero mask, by checking all of them
+double brute_force_distance(ImageView<double> const& mask, bool ignore_borders,
+                            int col, int row) {
+  double best = -1.0;
+  for (int r = -1; r <= mask.rows(); r++) {
+    for (int c = -1; c <= mask.cols(); c++) {
+      bool inside = (c >= 0 && r >= 0 && c < mask.cols() && r < mask.rows());
+      if (inside && mask(c, r) > 0)
+        continue;
+      if (!inside && ignore_borders)
+        continue;
+      double d = std::sqrt(double(c - col)*(c - col) + double(r - row)*(r - row));
+      if (best < 0 || d < best)
+        best = d;
+    }
+  }
+  return best;
+}
+
+TEST( DistanceTransform, MatchesBruteForce ) {
+
+  ImageView<double> mask(23, 17);
+  for (int row = 0; row < mask.rows(); row++)
+    for (int col = 0; col < mask.cols(); col++)
+      mask(col, row) = ((col*7 + row*13) % 11 == 0) ? 0.0 : 1.0;
+
+  for (int ignore_borders = 0; ignore_borders < 2; ignore_borders++) {
+    ImageView<double> dist;
+    euclidean_distance(mask, ignore_borders, dist);
+    ASSERT_EQ(mask.cols(), dist.cols());
+    ASSERT_EQ(mask.rows(), dist.rows());
+    for (int row = 0; row < mask.rows(); row++)
+      for (int col = 0; col < mask.cols(); col++)
+        EXPECT_NEAR(brute_force_distance(mask, ignore_borders, col, row),
+                    dist(col, row), 1e-10);
+  }
+}
+
+TEST( DistanceTransform, Borders ) {
+
+  // All pixels valid. The distance is to the first pixel outside.
+  ImageView<double> mask(9, 5), dist;
+  fill(mask, 1.0);
+  euclidean_distance(mask, false, dist);
+  EXPECT_EQ(1.0, dist(0, 0));
+  EXPECT_EQ(3.0, dist(4, 2));
+  EXPECT_EQ(2.0, dist(7, 3));
+
+  // With the borders ignored, the distances are larger than the image size
+  euclidean_distance(mask, true, dist);
+  EXPECT_GT(dist(4, 2), 9.0 + 5.0);
+}
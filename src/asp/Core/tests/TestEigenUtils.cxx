@@ -0,0 +1,102 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/EigenUtils.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <fstream>
+
+using namespace asp;
+
+TEST(EigenUtils, BestFitPlaneOfArray) {
+
+  // A noisy 3x3 neighborhood far from the origin, as for ECEF points
+  Eigen::Vector3d points[9];
+  int num_points = 0;
+  for (int i = -1; i <= 1; i++) {
+    for (int j = -1; j <= 1; j++) {
+      double noise = 0.01 * std::sin(7.0 * i + 3.0 * j);
+      points[num_points] = Eigen::Vector3d(6.4e6 + i, 1.0e5 + j, 2.0e5 + 0.3*i + noise);
+      num_points++;
+    }
+  }
+
+  std::vector<Eigen::Vector3d> point_vec(points, points + num_points);
+  Eigen::Vector3d centroid1, normal1, centroid2, normal2;
+  bestFitPlane(point_vec, centroid1, normal1);
+  bestFitPlane(points, num_points, centroid2, normal2);
+
+  // The two agree, up to the sign of the normal
+  EXPECT_NEAR((centroid1 - centroid2).norm(), 0.0, 1e-6);
+  EXPECT_NEAR(std::abs(normal1.dot(normal2)), 1.0, 1e-9);
+  EXPECT_NEAR(normal2.norm(), 1.0, 1e-12);
+
+  // The plane is z = 0.3*x, up to the noise
+  Eigen::Vector3d expected = Eigen::Vector3d(-0.3, 0.0, 1.0).normalized();
+  EXPECT_NEAR(std::abs(normal2.dot(expected)), 1.0, 1e-3);
+
+  EXPECT_THROW(bestFitPlane(points, 2, centroid2, normal2), vw::ArgumentErr);
+}
+
+TEST(EigenUtils, LoadCsvSample) {
+
+  vw::cartography::GeoReference geo;
+  geo.set_well_known_geogcs("WGS84");
+
+  // A lat,lon,height file with a header
+  std::string file = "eigen_utils_test.csv";
+  int num_lines = 2000;
+  {
+    std::ofstream ofs(file.c_str());
+    ofs << "lat,lon,height\n";
+    for (int i = 0; i < num_lines; i++)
+      ofs << 30.0 + 0.001*i << "," << 10.0 + 0.001*i << "," << 100.0 << "\n";
+  }
+
+  vw::Vector3 shift;
+  bool is_lola_rdr_format = false;
+  double median_lon = 0.0;
+  DoubleMatrix data;
+
+  // All points
+  load_csv(file, 10 * num_lines, vw::BBox2(), true, shift, geo, CsvConv(),
+           is_lola_rdr_format, median_lon, false, data);
+  EXPECT_EQ(num_lines, data.cols());
+  EXPECT_FALSE(is_lola_rdr_format);
+  EXPECT_NEAR(11.0, median_lon, 0.002);
+
+  // A sample, which is the same each time
+  load_csv(file, 100, vw::BBox2(), true, shift, geo, CsvConv(), is_lola_rdr_format,
+           median_lon, false, data);
+  EXPECT_EQ(100, data.cols());
+  DoubleMatrix data2;
+  load_csv(file, 100, vw::BBox2(), true, shift, geo, CsvConv(), is_lola_rdr_format,
+           median_lon, false, data2);
+  EXPECT_TRUE(data == data2);
+  for (int col = 0; col < data.cols(); col++) {
+    vw::Vector3 xyz(data(0, col), data(1, col), data(2, col));
+    vw::Vector3 llh = geo.datum().cartesian_to_geodetic(xyz + shift);
+    EXPECT_NEAR(100.0, llh[2], 1e-3);
+    EXPECT_EQ(1.0, data(DIM, col));
+  }
+
+  boost::filesystem::remove(file);
+}
@@ -0,0 +1,75 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/FootprintMask.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( FootprintMask, ConvexHull ) {
+  // A square with points inside and on an edge
+  std::vector<Vector2> points = {Vector2(0, 0), Vector2(2, 1), Vector2(4, 0), Vector2(4, 4),
+                                 Vector2(1, 3), Vector2(0, 4), Vector2(2, 0), Vector2(4, 4)};
+  std::vector<Vector2> hull;
+  convex_hull(points, hull);
+  ASSERT_EQ(hull.size(), 4u);
+  EXPECT_EQ(hull[0], Vector2(0, 0));
+  EXPECT_EQ(hull[1], Vector2(4, 0));
+  EXPECT_EQ(hull[2], Vector2(4, 4));
+  EXPECT_EQ(hull[3], Vector2(0, 4));
+}
+
+TEST( FootprintMask, PolygonIntersectsBox ) {
+  // A diamond centered at (10, 10)
+  std::vector<Vector2> hull;
+  convex_hull({Vector2(10, 0), Vector2(20, 10), Vector2(10, 20), Vector2(0, 10)}, hull);
+
+  EXPECT_TRUE (convex_polygon_intersects_box(hull, BBox2(8, 8, 4, 4)));   // inside
+  EXPECT_TRUE (convex_polygon_intersects_box(hull, BBox2(-5, -5, 30, 30))); // contains it
+  EXPECT_TRUE (convex_polygon_intersects_box(hull, BBox2(14, 14, 5, 5)));  // crosses an edge
+  EXPECT_FALSE(convex_polygon_intersects_box(hull, BBox2(16, 16, 4, 4)));  // corner region
+  EXPECT_FALSE(convex_polygon_intersects_box(hull, BBox2(0, 0, 3, 3)));
+  EXPECT_FALSE(convex_polygon_intersects_box(hull, BBox2(30, 0, 5, 5)));   // far away
+  EXPECT_FALSE(convex_polygon_intersects_box(std::vector<Vector2>(), BBox2(0, 0, 5, 5)));
+}
+
+TEST( FootprintMask, SkipTiles ) {
+  ImageView<float> image(40, 40);
+  for (int row = 0; row < image.rows(); row++)
+    for (int col = 0; col < image.cols(); col++)
+      image(col, row) = col + 100 * row;
+
+  std::vector<Vector2> hull;
+  convex_hull({Vector2(0, 0), Vector2(15, 0), Vector2(15, 15), Vector2(0, 15)}, hull);
+  FootprintMaskView<ImageView<float>> masked(image, hull, 2.0, -1.0f);
+
+  EXPECT_TRUE (masked.in_footprint(BBox2i(10, 10, 10, 10)));
+  EXPECT_TRUE (masked.in_footprint(BBox2i(16, 0, 10, 10))); // within the margin
+  EXPECT_FALSE(masked.in_footprint(BBox2i(20, 20, 10, 10)));
+
+  ImageView<float> inside = crop(masked, BBox2i(10, 10, 10, 10));
+  EXPECT_EQ(inside(3, 4), image(13, 14));
+  ImageView<float> outside = crop(masked, BBox2i(20, 20, 10, 10));
+  EXPECT_EQ(outside(3, 4), -1.0f);
+
+  // With no footprint all tiles are evaluated
+  FootprintMaskView<ImageView<float>> all(image, std::vector<Vector2>(), 0.0, -1.0f);
+  ImageView<float> tile = crop(all, BBox2i(20, 20, 10, 10));
+  EXPECT_EQ(tile(3, 4), image(23, 24));
+}
@@ -0,0 +1,152 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/Common.h>
+
+#include <vw/Image/Transform.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Write a small image with a ramp and a no-data corner
+  void write_test_image(std::string const& file, float nodata) {
+    ImageView<float> img(30, 20);
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        img(col, row) = 10.0 + col + 2.0 * row;
+    img(0, 0) = nodata;
+    bool has_nodata = true, has_georef = false;
+    cartography::GeoReference georef;
+    vw::GdalWriteOptions opt;
+    TerminalProgressCallback tpc("asp", ": ");
+    vw::cartography::block_write_gdal_image(file, img, has_georef, georef,
+                                            has_nodata, nodata, opt, tpc);
+  }
+}
+
+TEST( ImageAlignment, WriteAndRead ) {
+
+  std::string left_file = "image_alignment_test_L_in.tif";
+  std::string right_file = "image_alignment_test_R_in.tif";
+  write_test_image(left_file, -5.0);
+  write_test_image(right_file, -5.0);
+
+  ImageAlignment align;
+  align.method          = "affineepipolar";
+  align.left_image      = left_file;
+  align.right_image     = right_file;
+  align.left_timestamp  = asp::file_timestamp(left_file);
+  align.right_timestamp = asp::file_timestamp(right_file);
+  align.left_nodata     = -5.0;
+  align.right_nodata    = std::numeric_limits<float>::quiet_NaN();
+  align.right_matrix(0, 2) = 2.5;
+  align.right_matrix(1, 2) = -1.0;
+  align.left_size  = Vector2i(28, 18);
+  align.right_size = Vector2i(28, 18);
+  align.left_lo = 10.0; align.left_hi = 60.0; align.right_lo = 5.0; align.right_hi = 80.0;
+
+  std::string align_file = "image_alignment_test.txt";
+  write_image_alignment(align_file, align);
+
+  ImageAlignment align2;
+  ASSERT_TRUE(read_image_alignment(align_file, align2));
+  EXPECT_EQ(align.method, align2.method);
+  EXPECT_EQ(align.interp, align2.interp);
+  EXPECT_EQ(right_file, align2.right_image);
+  EXPECT_EQ(align.left_nodata, align2.left_nodata);
+  EXPECT_TRUE(std::isnan(align2.right_nodata));
+  EXPECT_EQ(align.right_size, align2.right_size);
+  EXPECT_EQ(align.right_hi, align2.right_hi);
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 3; col++)
+      EXPECT_EQ(align.right_matrix(row, col), align2.right_matrix(row, col));
+
+  // A changed input image makes the alignment stale
+  align.left_timestamp = "1";
+  write_image_alignment(align_file, align);
+  EXPECT_FALSE(read_image_alignment(align_file, align2));
+  EXPECT_FALSE(read_image_alignment("image_alignment_test_missing.txt", align2));
+
+  boost::filesystem::remove(align_file);
+  boost::filesystem::remove(left_file);
+  boost::filesystem::remove(right_file);
+}
+
+TEST( ImageAlignment, OnTheFly ) {
+
+  std::string prefix = "image_alignment_test_run";
+  std::string left_file = prefix + "-L_in.tif", right_file = prefix + "-R_in.tif";
+  write_test_image(left_file, -5.0);
+  write_test_image(right_file, -5.0);
+  boost::filesystem::remove(prefix + "-L.tif");
+  boost::filesystem::remove(prefix + "-R.tif");
+
+  ImageAlignment align;
+  align.method          = "homography";
+  align.left_image      = left_file;
+  align.right_image     = right_file;
+  align.left_timestamp  = asp::file_timestamp(left_file);
+  align.right_timestamp = asp::file_timestamp(right_file);
+  align.left_nodata     = -5.0;
+  align.right_nodata    = -5.0;
+  align.right_matrix(0, 2) = -3.0;
+  align.right_matrix(1, 2) = 1.0;
+  align.left_size  = Vector2i(30, 20);
+  align.right_size = Vector2i(30, 20);
+  align.left_lo  = 10.0; align.left_hi  = 60.0;
+  align.right_lo = 10.0; align.right_hi = 60.0;
+  write_image_alignment(image_alignment_file(prefix), align);
+
+  EXPECT_TRUE(aligned_image_exists(prefix, false));
+  EXPECT_EQ(Vector2i(30, 20), aligned_image_size(prefix, false));
+  cartography::GeoReference georef;
+  EXPECT_FALSE(read_aligned_georef(prefix, true, georef));
+
+  float nodata = 0.0;
+  ImageView<float> left  = read_aligned_image(prefix, true, nodata);
+  EXPECT_EQ(ALIGNED_IMAGE_NODATA, nodata);
+  ImageView<float> right = read_aligned_image(prefix, false);
+  ASSERT_EQ(30, right.cols());
+  ASSERT_EQ(20, right.rows());
+
+  // The no-data pixel, and a normalized value
+  EXPECT_EQ(ALIGNED_IMAGE_NODATA, left(0, 0));
+  EXPECT_NEAR((10.0 + 5 + 2.0 * 4 - 10.0) / 50.0, left(5, 4), 1e-6);
+
+  // The right image is shifted. Pixels from outside it are no-data.
+  EXPECT_NEAR((10.0 + 5 + 2.0 * 4 - 10.0) / 50.0, right(2, 5), 1e-6);
+  EXPECT_EQ(ALIGNED_IMAGE_NODATA, right(29, 10));
+  EXPECT_EQ(ALIGNED_IMAGE_NODATA, right(10, 0));
+
+  boost::filesystem::remove(image_alignment_file(prefix));
+  EXPECT_FALSE(aligned_image_exists(prefix, true));
+  EXPECT_THROW(aligned_image_size(prefix, true), vw::ArgumentErr);
+
+  boost::filesystem::remove(left_file);
+  boost::filesystem::remove(right_file);
+}
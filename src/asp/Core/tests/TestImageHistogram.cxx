@@ -0,0 +1,134 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ImageHistogram.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+TEST( ImageHistogram, PercentilesAndOtsu ) {
+
+  // Two groups of values, around 10 and 50, with some invalid pixels
+  srand(7);
+  int cols = 157, rows = 93;
+  ImageView<PixelMask<double>> img(cols, rows);
+  std::vector<double> vals;
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double val = (col < 60 ? 10.0 : 50.0) + (rand() % 1000) / 200.0;
+      img(col, row) = PixelMask<double>(val);
+      if (rand() % 17 == 0) {
+        img(col, row).invalidate();
+        continue;
+      }
+      vals.push_back(val);
+    }
+  }
+  std::sort(vals.begin(), vals.end());
+
+  // Small tiles, so that many are merged
+  ImageHistogram hist;
+  int num_bins = fine_histogram_bins(256), num_threads = 3, tile_size = 32;
+  hist.compute(img, num_bins, num_threads, tile_size);
+  EXPECT_EQ(16384, num_bins);
+  EXPECT_EQ(num_bins, hist.num_bins());
+  EXPECT_EQ(std::int64_t(vals.size()), hist.num_valid());
+  EXPECT_EQ(vals.front(), hist.min_val());
+  EXPECT_EQ(vals.back(),  hist.max_val());
+
+  double sum = 0.0, sum2 = 0.0;
+  for (size_t it = 0; it < vals.size(); it++) {
+    sum  += vals[it];
+    sum2 += vals[it] * vals[it];
+  }
+  double mean = sum / vals.size();
+  EXPECT_NEAR(mean, hist.mean(), 1e-10);
+  EXPECT_NEAR(sqrt(sum2 / vals.size() - mean * mean), hist.stddev(), 1e-8);
+
+  // The values are 0.005 apart, and a bin is narrower than that
+  double bin_width = (hist.max_val() - hist.min_val()) / num_bins;
+  EXPECT_LT(bin_width, 0.005);
+  double qs[] = {0.0, 0.1, 0.37, 0.5, 0.9, 1.0};
+  for (double q: qs) {
+    double expected = vals[std::min(size_t(q * vals.size()), vals.size() - 1)];
+    EXPECT_NEAR(expected, hist.percentile(q), 0.005 + bin_width);
+  }
+
+  std::vector<std::int64_t> coarse = hist.coarse_counts(256);
+  std::int64_t total = 0;
+  for (size_t bin = 0; bin < coarse.size(); bin++)
+    total += coarse[bin];
+  EXPECT_EQ(hist.num_valid(), total);
+  EXPECT_THROW(hist.coarse_counts(100), vw::ArgumentErr);
+
+  // The threshold separates the two groups
+  double threshold = hist.otsu_threshold(256);
+  EXPECT_GT(threshold, 15.0);
+  EXPECT_LT(threshold, 50.0);
+
+  double b = 0, e = 0;
+  EXPECT_TRUE(hist.outlier_brackets(0.75, 3.0, b, e));
+  EXPECT_EQ(hist.min_val(), b);
+  EXPECT_EQ(hist.max_val(), e);
+}
+
+TEST( ImageHistogram, Cache ) {
+
+  ImageView<PixelMask<double>> img(40, 30);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = PixelMask<double>(col + 0.5 * row);
+  img(0, 0).invalidate();
+
+  std::string file = "image_histogram_test.hist";
+  std::string key = "test image";
+  int num_bins = 128, num_threads = 2;
+  ImageHistogram hist = cached_image_histogram(img, file, key, num_bins, num_threads);
+
+  // Read back what was saved
+  ImageHistogram saved;
+  ASSERT_TRUE(saved.read(file, key));
+  EXPECT_EQ(hist.num_valid(), saved.num_valid());
+  EXPECT_EQ(hist.min_val(),   saved.min_val());
+  EXPECT_EQ(hist.max_val(),   saved.max_val());
+  EXPECT_EQ(hist.mean(),      saved.mean());
+  EXPECT_EQ(hist.stddev(),    saved.stddev());
+  EXPECT_TRUE(hist.counts() == saved.counts());
+  EXPECT_FALSE(saved.read(file, "another image"));
+
+  // A cached histogram is used even if the image changed
+  ImageView<PixelMask<double>> empty_img(40, 30);
+  for (int row = 0; row < empty_img.rows(); row++)
+    for (int col = 0; col < empty_img.cols(); col++)
+      empty_img(col, row).invalidate();
+  ImageHistogram cached = cached_image_histogram(empty_img, file, key, num_bins,
+                                                 num_threads);
+  EXPECT_EQ(hist.num_valid(), cached.num_valid());
+
+  // With another key it is computed again
+  ImageHistogram empty_hist = cached_image_histogram(empty_img, file, "empty", num_bins,
+                                                     num_threads);
+  EXPECT_TRUE(empty_hist.empty());
+  double b = 0, e = 0;
+  EXPECT_FALSE(empty_hist.outlier_brackets(0.75, 3.0, b, e));
+}
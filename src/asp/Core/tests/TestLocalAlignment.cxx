@@ -0,0 +1,152 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/LocalAlignment.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Interpolation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/Transform.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  void make_transforms(Matrix<double> & left_mat, Matrix<double> & right_mat) {
+    left_mat = math::identity_matrix<3>();
+    left_mat(0, 0) = 0.98; left_mat(0, 1) = 0.05;  left_mat(0, 2) = 2.5;
+    left_mat(1, 0) = -0.04; left_mat(1, 1) = 1.01; left_mat(1, 2) = -1.25;
+    right_mat = math::identity_matrix<3>();
+    right_mat(0, 0) = 1.02; right_mat(0, 1) = -0.03; right_mat(0, 2) = -3.0;
+    right_mat(1, 0) = 0.02; right_mat(1, 1) = 0.99;  right_mat(1, 2) = 1.5;
+    right_mat(2, 0) = 1e-5;
+  }
+
+  // The disparity as found before, one pixel at a time
+  PixelMask<Vector2f> unalign_pixel(ImageView<PixelMask<Vector2f>> const& aligned_disp,
+                                    BBox2i const& left_win, BBox2i const& right_win,
+                                    Matrix<double> const& left_mat,
+                                    Matrix<double> const& right_mat,
+                                    int col, int row) {
+    HomographyTransform left_trans(left_mat), right_trans(right_mat);
+    PixelMask<Vector2f> nodata_pix;
+    nodata_pix.invalidate();
+    ImageViewRef<PixelMask<Vector2f>> interp
+      = interpolate(aligned_disp, BilinearInterpolation(),
+                    ValueEdgeExtension<PixelMask<Vector2f>>(nodata_pix));
+    Vector2 left_pix(col, row);
+    Vector2 left_trans_pix = left_trans.forward(left_pix);
+    PixelMask<Vector2f> d = interp(left_trans_pix.x(), left_trans_pix.y());
+    if (!is_valid(d))
+      return nodata_pix;
+    Vector2 right_pix = right_trans.reverse(left_trans_pix + Vector2(d.child()));
+    Vector2 disp = right_pix - left_pix + (right_win.min() - left_win.min());
+    return PixelMask<Vector2f>(Vector2f(disp.x(), disp.y()));
+  }
+}
+
+TEST( LocalAlignment, UnalignDisparity ) {
+  Matrix<double> left_mat, right_mat;
+  make_transforms(left_mat, right_mat);
+  BBox2i left_win(100, 200, 40, 30), right_win(90, 205, 45, 35);
+
+  ImageView<PixelMask<Vector2f>> aligned(45, 36);
+  for (int row = 0; row < aligned.rows(); row++)
+    for (int col = 0; col < aligned.cols(); col++)
+      aligned(col, row) = PixelMask<Vector2f>(Vector2f(3.0 + 0.1 * col, -0.5 + 0.05 * row));
+  invalidate(aligned(20, 15));
+
+  ImageView<PixelMask<Vector2f>> unaligned;
+  unalign_2d_disparity(aligned, left_win, right_win, left_mat, right_mat, unaligned);
+  ASSERT_EQ(left_win.width(), unaligned.cols());
+  ASSERT_EQ(left_win.height(), unaligned.rows());
+
+  int num_invalid = 0;
+  for (int row = 0; row < unaligned.rows(); row++) {
+    for (int col = 0; col < unaligned.cols(); col++) {
+      PixelMask<Vector2f> expected = unalign_pixel(aligned, left_win, right_win,
+                                                   left_mat, right_mat, col, row);
+      ASSERT_EQ(is_valid(expected), is_valid(unaligned(col, row)));
+      if (!is_valid(expected)) {
+        num_invalid++;
+        continue;
+      }
+      EXPECT_NEAR(expected.child().x(), unaligned(col, row).child().x(), 1e-3);
+      EXPECT_NEAR(expected.child().y(), unaligned(col, row).child().y(), 1e-3);
+    }
+  }
+  // Around the invalid pixel, and beyond the aligned disparity
+  EXPECT_GT(num_invalid, 0);
+  EXPECT_LT(num_invalid, unaligned.cols() * unaligned.rows() / 4);
+
+  // A 1D disparity is a 2D one with no vertical component
+  ImageView<float> aligned_1d(aligned.cols(), aligned.rows());
+  ImageView<PixelMask<Vector2f>> aligned_2d(aligned.cols(), aligned.rows());
+  for (int row = 0; row < aligned.rows(); row++) {
+    for (int col = 0; col < aligned.cols(); col++) {
+      aligned_1d(col, row) = aligned(col, row).child().x();
+      aligned_2d(col, row) = PixelMask<Vector2f>(Vector2f(aligned_1d(col, row), 0));
+    }
+  }
+  aligned_1d(20, 15) = std::numeric_limits<float>::quiet_NaN();
+  invalidate(aligned_2d(20, 15));
+  ImageView<PixelMask<Vector2f>> from_1d, from_2d;
+  unalign_1d_disparity(aligned_1d, left_win, right_win, left_mat, right_mat, from_1d);
+  unalign_2d_disparity(aligned_2d, left_win, right_win, left_mat, right_mat, from_2d);
+  for (int row = 0; row < from_1d.rows(); row++) {
+    for (int col = 0; col < from_1d.cols(); col++) {
+      ASSERT_EQ(is_valid(from_2d(col, row)), is_valid(from_1d(col, row)));
+      if (is_valid(from_1d(col, row)))
+        EXPECT_VECTOR_NEAR(from_2d(col, row).child(), from_1d(col, row).child(), 1e-5);
+    }
+  }
+}
+
+TEST( LocalAlignment, UnalignMaskedImage ) {
+  Matrix<double> left_mat, right_mat;
+  make_transforms(left_mat, right_mat);
+  BBox2i left_win(0, 0, 25, 20);
+
+  ImageView<PixelMask<float>> aligned(30, 25);
+  for (int row = 0; row < aligned.rows(); row++)
+    for (int col = 0; col < aligned.cols(); col++)
+      aligned(col, row) = PixelMask<float>(col * 0.5 + row * row * 0.01);
+
+  ImageView<PixelMask<float>> unaligned;
+  unalign_masked_image(aligned, left_win, left_mat, unaligned);
+
+  HomographyTransform left_trans(left_mat);
+  PixelMask<float> nodata_pix;
+  nodata_pix.invalidate();
+  ImageViewRef<PixelMask<float>> interp
+    = interpolate(aligned, BilinearInterpolation(),
+                  ValueEdgeExtension<PixelMask<float>>(nodata_pix));
+  for (int row = 0; row < unaligned.rows(); row++) {
+    for (int col = 0; col < unaligned.cols(); col++) {
+      Vector2 p = left_trans.forward(Vector2(col, row));
+      PixelMask<float> expected = interp(p.x(), p.y());
+      ASSERT_EQ(is_valid(expected), is_valid(unaligned(col, row)));
+      if (is_valid(expected))
+        EXPECT_NEAR(expected.child(), unaligned(col, row).child(), 1e-4);
+    }
+  }
+}
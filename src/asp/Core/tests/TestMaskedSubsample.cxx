@@ -0,0 +1,117 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/Image/BlockRasterize.h>
+#include <asp/Core/MaskedSubsample.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  void make_image(int cols, int rows, ImageView<PixelGray<float>> & image,
+                  ImageView<PixelMask<uint8>> & mask) {
+    image.set_size(cols, rows);
+    mask.set_size(cols, rows);
+    for (int r = 0; r < rows; r++) {
+      for (int c = 0; c < cols; c++) {
+        image(c, r) = PixelGray<float>(c + 100.0 * r);
+        // The left columns are invalid
+        if (c < 10)
+          mask(c, r).invalidate();
+        else
+          mask(c, r) = PixelMask<uint8>(255);
+      }
+    }
+  }
+}
+
+TEST( MaskedSubsample, AverageOfValid ) {
+
+  ImageView<PixelGray<float>> image;
+  ImageView<PixelMask<uint8>> mask;
+  make_image(40, 20, image, mask);
+
+  boost::shared_ptr<SubsampleAccumulator> acc(new SubsampleAccumulator(40, 20, 0.25));
+
+  // Rendering the view returns the mask and fills the accumulator
+  ImageView<PixelMask<uint8>> out_mask
+    = block_rasterize(accumulate_subsample(image, mask, acc), Vector2i(16, 8), 3);
+  for (int r = 0; r < 20; r++)
+    for (int c = 0; c < 40; c++)
+      EXPECT_EQ(is_valid(mask(c, r)), is_valid(out_mask(c, r)));
+
+  ImageView<PixelMask<PixelGray<float>>> sub = acc->result();
+  ASSERT_EQ(10, sub.cols());
+  ASSERT_EQ(5,  sub.rows());
+
+  // Sub pixel (c, r) averages the valid full pixels nearest to it
+  ImageView<double> sum(10, 5), count(10, 5);
+  fill(sum, 0.0);
+  fill(count, 0.0);
+  for (int y = 0; y < 20; y++) {
+    for (int x = 0; x < 40; x++) {
+      if (!is_valid(mask(x, y)))
+        continue;
+      int c = std::min(9, (x + 2) / 4), r = std::min(4, (y + 2) / 4);
+      sum(c, r) += image(x, y).v();
+      count(c, r)++;
+    }
+  }
+  for (int r = 0; r < sub.rows(); r++) {
+    for (int c = 0; c < sub.cols(); c++) {
+      if (count(c, r) == 0) {
+        EXPECT_FALSE(is_valid(sub(c, r)));
+      } else {
+        ASSERT_TRUE(is_valid(sub(c, r)));
+        EXPECT_NEAR(sum(c, r) / count(c, r), sub(c, r).child().v(), 1e-3);
+      }
+    }
+  }
+
+  // Full columns 0 to 9 are invalid
+  EXPECT_FALSE(is_valid(sub(2, 0)));
+  EXPECT_TRUE(is_valid(sub(3, 0)));
+  EXPECT_NEAR(61.5, sub(3, 0).child().v(), 1e-4);
+}
+
+TEST( MaskedSubsample, TileAddedOnce ) {
+
+  ImageView<PixelGray<float>> image;
+  ImageView<PixelMask<uint8>> mask;
+  make_image(40, 20, image, mask);
+  SubsampleAccumulator acc(40, 20, 0.5);
+
+  BBox2i box(10, 0, 30, 20);
+  ImageView<PixelGray<float>> image_tile = crop(image, box);
+  ImageView<PixelMask<uint8>> mask_tile  = crop(mask, box);
+  acc.add(box, image_tile, mask_tile);
+  ImageView<PixelMask<PixelGray<float>>> sub1 = acc.result();
+  acc.add(box, image_tile, mask_tile);
+  ImageView<PixelMask<PixelGray<float>>> sub2 = acc.result();
+  for (int r = 0; r < sub1.rows(); r++) {
+    for (int c = 0; c < sub1.cols(); c++) {
+      EXPECT_EQ(is_valid(sub1(c, r)), is_valid(sub2(c, r)));
+      if (is_valid(sub1(c, r)))
+        EXPECT_EQ(sub1(c, r).child().v(), sub2(c, r).child().v());
+    }
+  }
+}
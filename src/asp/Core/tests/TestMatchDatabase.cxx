@@ -0,0 +1,105 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/MatchDatabase.h>
+
+#include <vw/InterestPoint/Matcher.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+
+// A match file with n matches, with a descriptor for the first point
+std::string make_match_file(std::string const& file, int n,
+                            std::vector<ip::InterestPoint> & ip1,
+                            std::vector<ip::InterestPoint> & ip2) {
+  ip1.clear();
+  ip2.clear();
+  for (int it = 0; it < n; it++) {
+    ip::InterestPoint p1(10.5 + it, 20.25 + 2*it), p2(30.5 - it, 40.75 + it);
+    p1.scale = 1.5; p1.polarity = true; p1.octave = 2; p1.scale_lvl = 3;
+    p2.scale = 2.5;
+    ip1.push_back(p1);
+    ip2.push_back(p2);
+  }
+  if (n > 0) {
+    ip1[0].descriptor.set_size(3);
+    ip1[0].descriptor[0] = 1; ip1[0].descriptor[1] = 2; ip1[0].descriptor[2] = 3;
+  }
+  ip::write_binary_match_file(file, ip1, ip2);
+  return file;
+}
+
+TEST(MatchDatabase, WriteAndRead) {
+
+  std::string dir = "match_database_test";
+  boost::filesystem::create_directories(dir);
+
+  std::vector<std::string> images;
+  images.push_back("a.tif");
+  images.push_back("b.tif");
+  images.push_back("c.tif");
+
+  std::vector<ip::InterestPoint> ab1, ab2, bc1, bc2;
+  std::map<std::pair<int, int>, std::string> match_files;
+  match_files[std::make_pair(0, 1)] = make_match_file(dir + "/a__b.match", 5, ab1, ab2);
+  match_files[std::make_pair(1, 2)] = make_match_file(dir + "/b__c.match", 3, bc1, bc2);
+  match_files[std::make_pair(0, 2)] = dir + "/a__c.match"; // does not exist
+
+  std::string db_file = dir + "/matches.db";
+  MatchDatabase::write(db_file, images, match_files);
+
+  MatchDatabase db;
+  ASSERT_TRUE(db.open(db_file));
+  EXPECT_EQ(2, db.num_pairs());
+  EXPECT_TRUE(db.has_pair("a.tif", "b.tif"));
+  EXPECT_FALSE(db.has_pair("b.tif", "a.tif"));
+  EXPECT_FALSE(db.has_pair("a.tif", "c.tif"));
+
+  std::vector<ip::InterestPoint> ip1, ip2;
+  ASSERT_TRUE(db.read("b.tif", "c.tif", ip1, ip2));
+  ASSERT_EQ(bc1.size(), ip1.size());
+  ASSERT_EQ(bc2.size(), ip2.size());
+
+  ASSERT_TRUE(db.read("a.tif", "b.tif", ip1, ip2));
+  ASSERT_EQ(ab1.size(), ip1.size());
+  for (size_t it = 0; it < ip1.size(); it++) {
+    EXPECT_EQ(ab1[it].x,         ip1[it].x);
+    EXPECT_EQ(ab1[it].y,         ip1[it].y);
+    EXPECT_EQ(ab1[it].scale,     ip1[it].scale);
+    EXPECT_EQ(ab1[it].polarity,  ip1[it].polarity);
+    EXPECT_EQ(ab1[it].octave,    ip1[it].octave);
+    EXPECT_EQ(ab1[it].scale_lvl, ip1[it].scale_lvl);
+    EXPECT_EQ(ab2[it].x,         ip2[it].x);
+    EXPECT_EQ(ab2[it].y,         ip2[it].y);
+    EXPECT_EQ(ab1[it].descriptor.size(), ip1[it].descriptor.size());
+  }
+  EXPECT_EQ(2.0, ip1[0].descriptor[1]);
+
+  EXPECT_FALSE(db.read("a.tif", "c.tif", ip1, ip2));
+  EXPECT_TRUE(ip1.empty());
+
+  // Not a database
+  MatchDatabase db2;
+  EXPECT_FALSE(db2.open(dir + "/a__b.match"));
+  EXPECT_FALSE(db2.is_open());
+
+  boost::filesystem::remove_all(dir);
+}
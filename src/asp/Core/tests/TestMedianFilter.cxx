@@ -0,0 +1,115 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/MedianFilter.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // The median of the valid pixels in the kernel, the one with index n/2
+  PixelMask<float> brute_force_median(ImageView<PixelMask<float>> const& img,
+                                      int col, int row, int half) {
+    if (!is_valid(img(col, row)))
+      return img(col, row);
+    std::vector<float> vals;
+    for (int r = std::max(0, row - half); r <= std::min(img.rows() - 1, row + half); r++)
+      for (int c = std::max(0, col - half); c <= std::min(img.cols() - 1, col + half); c++)
+        if (is_valid(img(c, r)))
+          vals.push_back(img(c, r).child());
+    std::nth_element(vals.begin(), vals.begin() + vals.size()/2, vals.end());
+    return PixelMask<float>(vals[vals.size()/2]);
+  }
+
+  ImageView<PixelMask<float>> random_image(int cols, int rows) {
+    srand(17);
+    ImageView<PixelMask<float>> img(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        // Integers in [0, 1000) fall in distinct bins
+        img(col, row) = PixelMask<float>(rand() % 1000);
+        if (rand() % 7 == 0)
+          img(col, row).invalidate();
+      }
+    }
+    return img;
+  }
+}
+
+TEST( MedianFilter, MatchesBruteForce ) {
+
+  ImageView<PixelMask<float>> img = random_image(53, 71);
+  for (int kernel_size = 1; kernel_size <= 15; kernel_size += 2) {
+    for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+      ImageView<PixelMask<float>> out;
+      median_filter(img, kernel_size, num_threads, out);
+      ASSERT_EQ(img.cols(), out.cols());
+      ASSERT_EQ(img.rows(), out.rows());
+      for (int row = 0; row < img.rows(); row++) {
+        for (int col = 0; col < img.cols(); col++) {
+          PixelMask<float> expected = brute_force_median(img, col, row, kernel_size/2);
+          ASSERT_EQ(is_valid(expected), is_valid(out(col, row)));
+          if (is_valid(expected))
+            EXPECT_NEAR(expected.child(), out(col, row).child(), 1e-3);
+        }
+      }
+    }
+  }
+}
+
+TEST( MedianFilter, QuantizedWithinBin ) {
+
+  // Many distinct values, so the bins have several each
+  ImageView<PixelMask<float>> img(40, 40);
+  srand(3);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = PixelMask<float>(100.0 * rand() / double(RAND_MAX));
+
+  ImageView<PixelMask<float>> out;
+  int kernel_size = 9;
+  median_filter(img, kernel_size, 2, out);
+  double bin_width = 100.0 / (MEDIAN_NUM_BINS - 1);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      EXPECT_NEAR(brute_force_median(img, col, row, kernel_size/2).child(),
+                  out(col, row).child(), bin_width);
+}
+
+TEST( MedianFilter, Disparity ) {
+
+  ImageView<PixelMask<Vector2f>> disp(20, 10);
+  for (int row = 0; row < disp.rows(); row++)
+    for (int col = 0; col < disp.cols(); col++)
+      disp(col, row) = PixelMask<Vector2f>(Vector2f(5.0, -2.5));
+  disp(7, 4) = PixelMask<Vector2f>(Vector2f(50.0, 30.0)); // an outlier
+  disp(3, 3).invalidate();
+
+  ImageView<PixelMask<Vector2f>> out;
+  disparity_median_filter(disp, 3, 1, out);
+  EXPECT_FALSE(is_valid(out(3, 3)));
+  ASSERT_TRUE(is_valid(out(7, 4)));
+  EXPECT_NEAR(5.0,  out(7, 4).child()[0], 1e-6);
+  EXPECT_NEAR(-2.5, out(7, 4).child()[1], 1e-6);
+}
@@ -0,0 +1,112 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/MultiBandTransform.h>
+
+#include <vw/Image/Transform.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+TEST( MultiBandTransform, CubicWeights ) {
+  double w[4];
+  cubic_weights(0.0, w);
+  EXPECT_EQ(w[0], 0.0);
+  EXPECT_EQ(w[1], 1.0);
+  EXPECT_EQ(w[2], 0.0);
+  EXPECT_EQ(w[3], 0.0);
+
+  cubic_weights(0.3, w);
+  EXPECT_NEAR(w[0] + w[1] + w[2] + w[3], 1.0, 1e-12);
+  EXPECT_NEAR(-w[0] + w[2] + 2 * w[3], 0.3, 1e-12); // linear functions are exact
+}
+
+TEST( MultiBandTransform, InterpBands ) {
+  // Three bands, each a multiple of the same linear function
+  int cols = 6, rows = 5, num_bands = 3;
+  std::vector<float> buf(cols * rows * num_bands);
+  for (int row = 0; row < rows; row++)
+    for (int col = 0; col < cols; col++)
+      for (int b = 0; b < num_bands; b++)
+        buf[(row * cols + col) * num_bands + b] = (b + 1) * (2 * col + 3 * row);
+
+  float out[3];
+  interp_bands(&buf[0], cols, rows, num_bands, Vector2(2.25, 1.5), false, out);
+  for (int b = 0; b < num_bands; b++)
+    EXPECT_NEAR(out[b], (b + 1) * (2 * 2.25 + 3 * 1.5), 1e-4);
+
+  interp_bands(&buf[0], cols, rows, num_bands, Vector2(3.6, 0.2), true, out);
+  EXPECT_EQ(out[1], 2 * (2 * 4 + 3 * 0));
+
+  // Nodata in one band affects only that band
+  buf[(1 * cols + 2) * num_bands + 1] = std::numeric_limits<float>::quiet_NaN();
+  interp_bands(&buf[0], cols, rows, num_bands, Vector2(2.25, 1.5), false, out);
+  EXPECT_FALSE(std::isnan(out[0]));
+  EXPECT_TRUE (std::isnan(out[1]));
+  EXPECT_FALSE(std::isnan(out[2]));
+
+  // Too close to the edge for bicubic interpolation
+  interp_bands(&buf[0], cols, rows, num_bands, Vector2(0.5, 1.5), false, out);
+  EXPECT_TRUE(std::isnan(out[0]));
+}
+
+TEST( MultiBandTransform, View ) {
+  ImageView<float> image(30, 20, 4);
+  for (int b = 0; b < image.planes(); b++)
+    for (int row = 0; row < image.rows(); row++)
+      for (int col = 0; col < image.cols(); col++)
+        image(col, row, b) = 100 * b + col + 0.5 * row;
+  float nodata = -1.0f;
+  image(12, 9, 3) = nodata;
+
+  // Output pixel (col, row) is at input pixel (col + 5, row + 2)
+  TranslateTransform trans(-5, -2);
+  MultiBandTransformView<ImageView<float>, TranslateTransform>
+    view(image, trans, 25, 18, nodata, true, std::vector<Vector2>(), 0.0);
+  ImageView<float> out = crop(view, BBox2i(0, 0, 25, 18));
+  ASSERT_EQ(out.planes(), 4);
+  EXPECT_EQ(out(3, 4, 0), image(8, 6, 0));
+  EXPECT_EQ(out(3, 4, 2), image(8, 6, 2));
+  EXPECT_EQ(out(7, 7, 3), nodata);
+  EXPECT_EQ(out(7, 7, 2), image(12, 9, 2));
+  EXPECT_EQ(out(24, 17, 0), image(29, 19, 0));
+  EXPECT_EQ(out(24, 0, 1), image(29, 2, 1));
+
+  // Bicubic, with nodata past the edge and around the nodata pixel
+  MultiBandTransformView<ImageView<float>, TranslateTransform>
+    cubic(image, TranslateTransform(-5.5, -2), 25, 18, nodata, false,
+          std::vector<Vector2>(), 0.0);
+  out = crop(cubic, BBox2i(0, 0, 25, 18));
+  EXPECT_NEAR(out(3, 4, 1), 100 + 8.5 + 0.5 * 6, 1e-4);
+  EXPECT_EQ(out(24, 4, 1), nodata);
+  EXPECT_EQ(out(6, 7, 3), nodata);
+  EXPECT_NEAR(out(6, 7, 0), 11.5 + 0.5 * 9, 1e-4);
+
+  // Outside the footprint nothing is computed
+  std::vector<Vector2> hull;
+  convex_hull({Vector2(0, 0), Vector2(5, 0), Vector2(5, 5), Vector2(0, 5)}, hull);
+  MultiBandTransformView<ImageView<float>, TranslateTransform>
+    masked(image, trans, 25, 18, nodata, true, hull, 1.0);
+  out = crop(masked, BBox2i(10, 10, 5, 5));
+  EXPECT_EQ(out(1, 1, 0), nodata);
+  out = crop(masked, BBox2i(0, 0, 5, 5));
+  EXPECT_EQ(out(1, 1, 0), image(6, 3, 0));
+}
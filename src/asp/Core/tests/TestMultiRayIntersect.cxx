@@ -0,0 +1,67 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/MultiRayIntersect.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( MultiRayIntersect, Bundles ) {
+
+  // Five cameras looking at three points. Bundle 0 sees all, bundle 1
+  // has two of its rays invalid, and bundle 2 has a single ray.
+  std::vector<Vector3> ctrs;
+  for (int c = 0; c < 5; c++)
+    ctrs.push_back(Vector3(-200.0 + 100.0 * c, 30.0 * c, 1000.0));
+  std::vector<Vector3> pts;
+  pts.push_back(Vector3(10, 20, 5));
+  pts.push_back(Vector3(-40, 7, 50));
+  pts.push_back(Vector3(3, 3, 3));
+
+  RayBundles rays;
+  rays.reset(5, 3);
+  for (int c = 0; c < 5; c++) {
+    rays.set_ray(c, 0, ctrs[c], 2.0 * (pts[0] - ctrs[c]));
+    if (c % 2 == 0)
+      rays.set_ray(c, 1, ctrs[c], pts[1] - ctrs[c]);
+  }
+  rays.set_ray(3, 2, ctrs[3], pts[2] - ctrs[3]);
+
+  std::vector<Vector3> xyz, err;
+  rays.intersect(0.0, xyz, err);
+  ASSERT_EQ(3u, xyz.size());
+  EXPECT_VECTOR_NEAR(pts[0], xyz[0], 1e-8);
+  EXPECT_VECTOR_NEAR(pts[1], xyz[1], 1e-8);
+  EXPECT_NEAR(0.0, norm_2(err[0]), 1e-8);
+  EXPECT_EQ(Vector3(), xyz[2]);
+
+  // Two skew rays. The point is midway and the error is the vector
+  // between them.
+  rays.reset(2, 1);
+  rays.set_ray(0, 0, Vector3(0, 0, 100), Vector3(1, 0, -1));
+  rays.set_ray(1, 0, Vector3(100, 2, 100), Vector3(-1, 0, -1));
+  rays.intersect(0.0, xyz, err);
+  EXPECT_VECTOR_NEAR(Vector3(50, 1, 50), xyz[0], 1e-8);
+  EXPECT_NEAR(2.0, norm_2(err[0]), 1e-8);
+
+  // The same rays, with a minimum angle larger than the 90 degrees
+  // between them, give no point
+  rays.intersect(1.5, xyz, err);
+  EXPECT_EQ(Vector3(), xyz[0]);
+}
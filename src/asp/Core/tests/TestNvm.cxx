@@ -0,0 +1,96 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/Nvm.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace asp;
+
+namespace {
+
+  // A small network with three cameras, with points seen by two or three
+  void make_nvm(nvmData & nvm, std::vector<double> & focal_lengths) {
+    int num_cid = 3, num_pid = 50;
+    nvm.cid_to_filename = {"a.tif", "b.tif", "c.tif"};
+    focal_lengths = {1.5, 2.5, 3.5};
+    nvm.cid_to_keypoint_map.resize(num_cid);
+    nvm.cid_to_cam_t_global.resize(num_cid);
+    for (int cid = 0; cid < num_cid; cid++) {
+      nvm.cid_to_keypoint_map[cid] = Eigen::Matrix2Xd::Random(2, num_pid);
+      nvm.cid_to_cam_t_global[cid]
+        = Eigen::Affine3d(Eigen::AngleAxisd(0.3 * cid, Eigen::Vector3d(1, 2, 3).normalized()));
+      nvm.cid_to_cam_t_global[cid].translation() = Eigen::Vector3d(cid, -cid, 10.0);
+    }
+    for (int pid = 0; pid < num_pid; pid++) {
+      std::map<int, int> cid_fid;
+      cid_fid[0] = pid;
+      cid_fid[1] = num_pid - 1 - pid;
+      if (pid % 3 == 0)
+        cid_fid[2] = pid;
+      nvm.pid_to_cid_fid.push_back(cid_fid);
+      nvm.pid_to_xyz.push_back(Eigen::Vector3d(pid, 1e6 + 0.125 * pid, -3.0));
+    }
+  }
+
+  void check_same(nvmData const& a, nvmData const& b) {
+    ASSERT_EQ(a.cid_to_filename, b.cid_to_filename);
+    ASSERT_EQ(a.pid_to_cid_fid, b.pid_to_cid_fid);
+    for (size_t cid = 0; cid < a.cid_to_cam_t_global.size(); cid++)
+      EXPECT_LT((a.cid_to_cam_t_global[cid].matrix() -
+                 b.cid_to_cam_t_global[cid].matrix()).norm(), 1e-12);
+    for (size_t pid = 0; pid < a.pid_to_xyz.size(); pid++) {
+      EXPECT_LT((a.pid_to_xyz[pid] - b.pid_to_xyz[pid]).norm(), 1e-8);
+      for (auto it = a.pid_to_cid_fid[pid].begin(); it != a.pid_to_cid_fid[pid].end(); it++)
+        EXPECT_LT((a.cid_to_keypoint_map[it->first].col(it->second) -
+                   b.cid_to_keypoint_map[it->first].col(it->second)).norm(), 1e-12);
+    }
+  }
+}
+
+TEST(Nvm, TextAndBinary) {
+
+  nvmData nvm;
+  std::vector<double> focal_lengths;
+  make_nvm(nvm, focal_lengths);
+
+  std::string dir = "nvm_test";
+  std::string text_file = dir + "/run.nvm", bin_file = dir + "/run.bnvm",
+    conv_file = dir + "/run_conv.nvm";
+  WriteNVM(nvm.cid_to_keypoint_map, nvm.cid_to_filename, focal_lengths,
+           nvm.pid_to_cid_fid, nvm.pid_to_xyz, nvm.cid_to_cam_t_global, text_file);
+  WriteNVM(nvm.cid_to_keypoint_map, nvm.cid_to_filename, focal_lengths,
+           nvm.pid_to_cid_fid, nvm.pid_to_xyz, nvm.cid_to_cam_t_global, bin_file);
+
+  nvmData text_nvm, bin_nvm;
+  ReadNVM(text_file, text_nvm);
+  ReadNVM(bin_file, bin_nvm);
+  check_same(nvm, text_nvm);
+  check_same(nvm, bin_nvm);
+
+  // Convert the binary file back to text
+  ConvertNVM(bin_file, conv_file);
+  nvmData conv_nvm;
+  std::vector<double> conv_focal_lengths;
+  ReadNVM(conv_file, conv_nvm, conv_focal_lengths);
+  check_same(nvm, conv_nvm);
+  EXPECT_EQ(conv_focal_lengths, focal_lengths);
+
+  boost::filesystem::remove_all(dir);
+}
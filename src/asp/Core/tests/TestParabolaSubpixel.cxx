@@ -0,0 +1,145 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ParabolaSubpixel.h>
+#include <vw/Image/Algorithms.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A smooth texture
+  float texture(double x, double y) {
+    return std::sin(0.7 * x) + std::cos(0.45 * y) + 0.5 * std::sin(0.31 * x + 0.53 * y)
+      + 0.3 * std::cos(1.1 * x - 0.2 * y);
+  }
+
+  // The right image is the left one shifted by the given disparity
+  void make_images(int cols, int rows, Vector2 const& shift,
+                   ImageView<float> & left, ImageView<float> & right) {
+    left.set_size(cols, rows);
+    right.set_size(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        left(col, row)  = texture(col, row);
+        right(col, row) = texture(col - shift.x(), row - shift.y());
+      }
+    }
+  }
+}
+
+TEST( ParabolaSubpixel, RecoversShift ) {
+  Vector2 shift(1.3, 0.4);
+  ImageView<float> left, right;
+  make_images(60, 50, shift, left, right);
+
+  BBox2i box(10, 10, 40, 30);
+  ImageView<PixelMask<Vector2f>> disp(box.width(), box.height());
+  for (int row = 0; row < disp.rows(); row++)
+    for (int col = 0; col < disp.cols(); col++)
+      disp(col, row) = PixelMask<Vector2f>(Vector2f(1, 0));
+  invalidate(disp(3, 4));
+
+  ImageView<PixelMask<Vector2f>> refined;
+  ImageView<float> confidence;
+  parabola_subpixel(left, right, disp, box, Vector2i(7, 7), true, true,
+                    refined, confidence);
+  ASSERT_EQ(disp.cols(), refined.cols());
+  ASSERT_EQ(disp.rows(), refined.rows());
+
+  EXPECT_FALSE(is_valid(refined(3, 4)));
+  EXPECT_EQ(0.0, confidence(3, 4));
+
+  // The integer disparity is off by 0.3 and 0.4
+  double err_x = 0.0, err_y = 0.0;
+  int count = 0;
+  for (int row = 0; row < refined.rows(); row++) {
+    for (int col = 0; col < refined.cols(); col++) {
+      if (!is_valid(disp(col, row)))
+        continue;
+      ASSERT_TRUE(is_valid(refined(col, row)));
+      err_x += std::abs(refined(col, row).child().x() - shift.x());
+      err_y += std::abs(refined(col, row).child().y() - shift.y());
+      EXPECT_GT(confidence(col, row), 0.0);
+      EXPECT_LE(confidence(col, row), 1.0);
+      count++;
+    }
+  }
+  EXPECT_LT(err_x / count, 0.15);
+  EXPECT_LT(err_y / count, 0.15);
+
+  // Refine only vertically
+  parabola_subpixel(left, right, disp, box, Vector2i(7, 7), false, true,
+                    refined, confidence);
+  EXPECT_EQ(1.0, refined(5, 5).child().x());
+  EXPECT_NE(0.0, refined(5, 5).child().y());
+}
+
+TEST( ParabolaSubpixel, RunsMatchSinglePixels ) {
+  ImageView<float> left, right;
+  make_images(50, 40, Vector2(-0.6, 0.8), left, right);
+
+  // Runs of varying lengths and disparities
+  BBox2i box(5, 6, 30, 20);
+  ImageView<PixelMask<Vector2f>> disp(box.width(), box.height());
+  for (int row = 0; row < disp.rows(); row++)
+    for (int col = 0; col < disp.cols(); col++)
+      disp(col, row) = PixelMask<Vector2f>(Vector2f((col / 7) % 2 - 1, (row + col / 5) % 3 - 1));
+
+  ImageView<PixelMask<Vector2f>> refined;
+  ImageView<float> confidence;
+  Vector2i kernel(5, 9);
+  parabola_subpixel(left, right, disp, box, kernel, true, true, refined, confidence);
+
+  // Refine each pixel on its own
+  for (int row = 0; row < disp.rows(); row += 3) {
+    for (int col = 0; col < disp.cols(); col += 2) {
+      ImageView<PixelMask<Vector2f>> one(1, 1), one_refined;
+      ImageView<float> one_confidence;
+      one(0, 0) = disp(col, row);
+      parabola_subpixel(left, right, one, BBox2i(box.min().x() + col, box.min().y() + row, 1, 1),
+                        kernel, true, true, one_refined, one_confidence);
+      EXPECT_NEAR(one_refined(0, 0).child().x(), refined(col, row).child().x(), 1e-4);
+      EXPECT_NEAR(one_refined(0, 0).child().y(), refined(col, row).child().y(), 1e-4);
+      EXPECT_NEAR(one_confidence(0, 0), confidence(col, row), 1e-4);
+    }
+  }
+}
+
+TEST( ParabolaSubpixel, FlatImages ) {
+  ImageView<float> left(20, 20), right(20, 20);
+  fill(left, 3.0f);
+  fill(right, 3.0f);
+
+  BBox2i box(0, 0, 20, 20);
+  ImageView<PixelMask<Vector2f>> disp(20, 20);
+  fill(disp, PixelMask<Vector2f>(Vector2f(2.2, -0.9)));
+
+  ImageView<PixelMask<Vector2f>> refined;
+  ImageView<float> confidence;
+  parabola_subpixel(left, right, disp, box, Vector2i(5, 5), true, true, refined, confidence);
+
+  // Pixels beyond the images are zero, so only the middle has no match
+  EXPECT_TRUE(is_valid(refined(10, 10)));
+  EXPECT_EQ(Vector2f(2, -1), refined(10, 10).child());
+  EXPECT_EQ(0.0, confidence(10, 10));
+}
@@ -0,0 +1,126 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PixelMapGrid.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  struct LinearMap: public PixelMap {
+    virtual Vector2 operator()(Vector2 const& p) const {
+      return Vector2(2.0 * p.x() - p.y() + 3.0, 0.5 * p.x() + p.y());
+    }
+  };
+
+  struct SmoothMap: public PixelMap {
+    virtual Vector2 operator()(Vector2 const& p) const {
+      return Vector2(1.5 * p.x() + 0.2 * p.y() + 0.0005 * p.x() * p.y() + 10.0,
+                     3.0 * std::sin(p.x() / 40.0) + std::cos(p.y() / 35.0) + 0.9 * p.y());
+    }
+  };
+
+  // Jumps along a vertical and a horizontal line
+  struct StepMap: public PixelMap {
+    virtual Vector2 operator()(Vector2 const& p) const {
+      return Vector2(p.x() + (p.x() >= 150 ? 100.0 : 0.0),
+                     p.y() - (p.y() >= 77  ? 50.0  : 0.0));
+    }
+  };
+
+  double max_error(PixelMap const& map, BBox2i const& box,
+                   std::vector<Vector2> const& values) {
+    double err = 0.0;
+    size_t pos = 0;
+    for (int y = box.min().y(); y < box.max().y(); y++)
+      for (int x = box.min().x(); x < box.max().x(); x++)
+        err = std::max(err, norm_2(values[pos++] - map(Vector2(x, y))));
+    return err;
+  }
+}
+
+TEST( PixelMapGrid, LinearIsExact ) {
+  LinearMap map;
+  BBox2i box(7, -3, 301, 203);
+  std::vector<Vector2> values;
+  int num_exact = interp_pixel_map(map, box, 16, 1e-6, values);
+  ASSERT_EQ(size_t(box.width()) * box.height(), values.size());
+  EXPECT_LT(max_error(map, box, values), 1e-8);
+  EXPECT_LT(num_exact, box.width() * box.height() / 50);
+}
+
+TEST( PixelMapGrid, SmoothWithinTolerance ) {
+  SmoothMap map;
+  BBox2i box(7, -3, 300, 200);
+  std::vector<Vector2> values;
+  double tol = 0.01;
+  int num_exact = interp_pixel_map(map, box, 16, tol, values);
+  EXPECT_LT(max_error(map, box, values), tol);
+  EXPECT_LT(num_exact, box.width() * box.height() / 4);
+}
+
+TEST( PixelMapGrid, RefinesAtSteps ) {
+  StepMap map;
+  BBox2i box(0, 0, 256, 256);
+  std::vector<Vector2> values;
+  double tol = 0.1;
+  int num_exact = interp_pixel_map(map, box, 8, tol, values);
+  EXPECT_LT(max_error(map, box, values), tol);
+  EXPECT_LT(num_exact, box.width() * box.height() / 4);
+}
+
+TEST( PixelMapGrid, NoInterpolation ) {
+  SmoothMap map;
+  BBox2i box(0, 0, 20, 10);
+  std::vector<Vector2> values;
+  int num_exact = interp_pixel_map(map, box, 1, 0.1, values);
+  EXPECT_EQ(box.width() * box.height(), num_exact);
+  EXPECT_LT(max_error(map, box, values), 1e-12);
+
+  std::vector<Vector2> empty;
+  EXPECT_EQ(0, interp_pixel_map(map, BBox2i(), 16, 0.1, empty));
+  EXPECT_TRUE(empty.empty());
+}
+
+TEST( PixelMapGrid, InterpTransform ) {
+  Matrix3x3 H;
+  H(0,0) = 1.1;  H(0,1) = 0.05; H(0,2) = 12.0;
+  H(1,0) = -0.1; H(1,1) = 0.95; H(1,2) = -4.0;
+  H(2,0) = 1e-5; H(2,1) = 2e-5; H(2,2) = 1.0;
+  TransformPtr exact(new HomographyTransform(H));
+  TransformPtr interp = grid_interp_trans_copy
+    (TransformPtr(new GridInterpTransform(exact, 16, 0.001)));
+
+  // Integer and fractional pixels in the box are interpolated, and
+  // those outside are exact
+  BBox2i box(10, 20, 200, 150);
+  interp->reverse_bbox(box);
+  for (double y = 5.0; y < 190.0; y += 3.7) {
+    for (double x = 0.0; x < 230.0; x += 4.3) {
+      Vector2 p(x, y);
+      EXPECT_VECTOR_NEAR(exact->reverse(p), interp->reverse(p), 0.002);
+      EXPECT_VECTOR_NEAR(exact->reverse(Vector2(int(x), int(y))),
+                         interp->reverse(Vector2(int(x), int(y))), 0.001);
+    }
+  }
+  EXPECT_VECTOR_NEAR(exact->forward(Vector2(3, 4)), interp->forward(Vector2(3, 4)), 1e-12);
+}
@@ -0,0 +1,90 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <vw/Cartography/GeoReference.h>
+#include <test/Helpers.h>
+#include <asp/Core/PointCache.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace vw::cartography;
+using namespace asp;
+
+TEST(PointCache, WriteAndLoad) {
+
+  GeoReference geo;
+  geo.set_well_known_geogcs("D_MOON");
+
+  // Points on a lon-lat grid, enough to be split into several tiles
+  int num_lon = 600, num_lat = 200;
+  DoubleMatrix data(DIM + 1, num_lon * num_lat);
+  for (int i = 0; i < num_lon; i++) {
+    for (int j = 0; j < num_lat; j++) {
+      Vector3 xyz = geo.datum().geodetic_to_cartesian(Vector3(10.0 + 0.01*i,
+                                                              -1.0 + 0.01*j, 5.0));
+      int col = i * num_lat + j;
+      for (int row = 0; row < DIM; row++)
+        data(row, col) = xyz[row];
+      data(DIM, col) = 1;
+    }
+  }
+
+  std::string key = point_cache_key("ref.csv", "1:lon 2:lat 3:height_above_datum", "", geo);
+  std::string file = point_cache_file("point_cache_test", key);
+  EXPECT_NO_THROW(PointCache::write(file, key, data, geo.datum(), false));
+
+  PointCache cache;
+  ASSERT_TRUE(cache.open(file, key));
+  EXPECT_EQ(data.cols(), cache.num_points());
+  EXPECT_GT(cache.num_tiles(), 1);
+
+  // Without a box all points are loaded
+  Vector3 shift;
+  double median_lon = 0.0;
+  DoubleMatrix loaded;
+  cache.load(data.cols(), BBox2(), false, shift, geo.datum(), median_lon, loaded);
+  EXPECT_EQ(data.cols(), loaded.cols());
+  EXPECT_NEAR(13.0, median_lon, 0.02);
+
+  // With a box only the points in it are loaded, even if the box is
+  // given with longitudes in a different range
+  BBox2 box(Vector2(11.005 - 360.0, -0.505), Vector2(11.505 - 360.0, 0.495));
+  cache.load(data.cols(), box, true, shift, geo.datum(), median_lon, loaded);
+  EXPECT_EQ(50 * 100, loaded.cols());
+  for (int col = 0; col < loaded.cols(); col++) {
+    Vector3 xyz(loaded(0, col), loaded(1, col), loaded(2, col));
+    Vector3 llh = geo.datum().cartesian_to_geodetic(xyz + shift);
+    EXPECT_TRUE(box.contains(Vector2(llh[0] - 360.0, llh[1])));
+  }
+
+  // The number of points is capped
+  cache.load(1000, BBox2(), false, shift, geo.datum(), median_lon, loaded);
+  EXPECT_LE(loaded.cols(), 1000);
+  EXPECT_GT(loaded.cols(), 0);
+
+  // A cache made with another CSV format is not reused
+  std::string key2 = point_cache_key("ref.csv", "1:lat 2:lon 3:height_above_datum", "", geo);
+  EXPECT_NE(file, point_cache_file("point_cache_test", key2));
+  PointCache cache2;
+  EXPECT_FALSE(cache2.open(file, key2));
+  EXPECT_FALSE(cache2.is_open());
+
+  boost::filesystem::remove_all("point_cache_test");
+}
@@ -127,6 +127,57 @@ TEST( PointUtils, CsvConv ) {
   
 }
 
+TEST( PointUtils, CsvConvFast ) {
+
+  vw::cartography::GeoReference geo;
+  geo.set_well_known_geogcs("D_MOON");
+  bool is_first_line = false, success = false;
+
+  // A line longer than any fixed buffer, and a value which cannot be parsed
+  CsvConv conv;
+  conv.parse_csv_format("1:lon 2:lat 3:height_above_datum", "");
+  std::string line = "3.5,, 27.25\t-100.5 " + std::string(5000, 'a');
+  CsvConv::CsvRecord vals = conv.parse_csv_line(is_first_line, success, line);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(3.5,    vals.point_data[0]);
+  EXPECT_EQ(27.25,  vals.point_data[1]);
+  EXPECT_EQ(-100.5, vals.point_data[2]);
+  vals = conv.parse_csv_line(is_first_line, success, "3.5, abc, 1");
+  EXPECT_FALSE(success);
+
+  // Finding the point and its lon-lat together agrees with finding them separately
+  std::string formats[] = {"1:lon 2:lat 3:height_above_datum", "1:lat 2:lon 3:radius_km",
+                           "1:x 2:y 3:z"};
+  std::string lines[] = {"3.5, 27.25, -100.5", "27.25, 3.5, 1737.4", "1.7e+6, 1.0e+5, 8.0e+5"};
+  for (int it = 0; it < 3; it++) {
+    conv.parse_csv_format(formats[it], "");
+    vals = conv.parse_csv_line(is_first_line, success, lines[it]);
+    ASSERT_TRUE(success);
+    Vector2 lonlat;
+    Vector3 xyz = conv.csv_to_cartesian_and_lonlat(vals, geo, lonlat);
+    EXPECT_VECTOR_NEAR(conv.csv_to_cartesian(vals, geo), xyz, 1e-8);
+    EXPECT_VECTOR_NEAR(conv.csv_to_lonlat(vals, geo), lonlat, 1e-12);
+  }
+}
+
+TEST( PointUtils, PointAffineTransFunc ) {
+
+  // A rotation by 90 degrees around the z axis, a scale, and a translation
+  Matrix<double> T(4, 4);
+  for (int row = 0; row < 4; row++)
+    for (int col = 0; col < 4; col++)
+      T(row, col) = 0;
+  T(0, 1) = -2; T(1, 0) = 2; T(2, 2) = 2; T(3, 3) = 1;
+  T(0, 3) = 10; T(1, 3) = 20; T(2, 3) = 30;
+  PointAffineTransFunc func(T);
+  EXPECT_VECTOR_NEAR(Vector3(6, 22, 36), func(Vector3(1, 2, 3)), 1e-12);
+
+  // No-data points are kept
+  EXPECT_EQ(Vector3(), func(Vector3()));
+
+  EXPECT_THROW(PointAffineTransFunc(Matrix<double>(3, 3)), vw::ArgumentErr);
+}
+
 // Open up an ascii style PCD file and make sure we can read all of the values from it.
 TEST( PointUtils, PcdReader ) {
 
@@ -0,0 +1,77 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PrefetchView.h>
+
+#include <vw/Image/BlockRasterize.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  ImageView<float> ramp(int cols, int rows) {
+    ImageView<float> image(cols, rows);
+    for (int r = 0; r < rows; r++)
+      for (int c = 0; c < cols; c++)
+        image(c, r) = c + 1000.0 * r;
+    return image;
+  }
+}
+
+TEST( PrefetchView, SameAsInput ) {
+  ImageView<float> image = ramp(1100, 700);
+  BBox2i region(5, 3, 1000, 650);
+  PrefetchView<ImageView<float>> view(image, Vector2i(300, 200), region, 3, 4);
+
+  // Tiles with a margin, in the order they are written, then again
+  // out of order, and a region partly outside the tiles
+  for (int pass = 0; pass < 2; pass++) {
+    for (int j = 0; j < 4; j++) {
+      for (int i = 0; i < 4; i++) {
+        int ti = (pass == 0) ? i : 3 - i;
+        BBox2i tile(region.min() + Vector2i(300 * ti, 200 * j),
+                    region.min() + Vector2i(300 * (ti + 1), 200 * (j + 1)));
+        tile.crop(region);
+        tile.expand(2);
+        tile.crop(bounding_box(image));
+        ImageView<float> out = crop(view, tile);
+        ImageView<float> expected = crop(image, tile);
+        ASSERT_EQ(out.cols(), expected.cols());
+        ASSERT_EQ(out.rows(), expected.rows());
+        for (int r = 0; r < out.rows(); r++)
+          for (int c = 0; c < out.cols(); c++)
+            ASSERT_EQ(out(c, r), expected(c, r));
+      }
+    }
+  }
+
+  // The whole image is more than the cache holds, and is read directly
+  ImageView<float> whole = view;
+  EXPECT_EQ(whole(1099, 699), image(1099, 699));
+}
+
+TEST( PrefetchView, InParallel ) {
+  ImageView<float> image = ramp(900, 900);
+  ImageViewRef<float> view
+    = prefetch_view(image, Vector2i(128, 128), bounding_box(image), 4, 4);
+  ImageView<float> out = block_rasterize(view, Vector2i(128, 128), 4);
+  for (int r = 0; r < out.rows(); r++)
+    for (int c = 0; c < out.cols(); c++)
+      ASSERT_EQ(out(c, r), image(c, r));
+}
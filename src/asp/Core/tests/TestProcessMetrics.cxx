@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ProcessMetrics.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+using namespace asp;
+
+TEST( ProcessMetrics, Write ) {
+
+  ProcessMetrics metrics;
+
+  // Updates before starting are ignored
+  metrics.add_tiles("correlation", 5);
+  EXPECT_FALSE(metrics.enabled());
+
+  std::string file = "process_metrics_test/stereo_corr.prom";
+  metrics.start(file, "stereo_corr", 1000.0);
+  EXPECT_TRUE(metrics.enabled());
+  metrics.add_tiles("correlation", 2);
+  metrics.add_tiles("correlation", 1);
+  metrics.set_progress("correlation", 0.5, 2000.0);
+  metrics.set_solver_state(3, 1.5);
+
+  std::string text = metrics.text();
+  EXPECT_NE(std::string::npos, text.find("# TYPE asp_tiles_done_total counter"));
+  EXPECT_NE(std::string::npos, text.find("asp_tiles_done_total{tool=\"stereo_corr\""));
+  EXPECT_NE(std::string::npos, text.find(",task=\"correlation\"} 3\n"));
+  EXPECT_NE(std::string::npos, text.find(",task=\"correlation\"} 0.5\n"));
+  EXPECT_NE(std::string::npos, text.find(",task=\"correlation\"} 2000\n"));
+  EXPECT_NE(std::string::npos, text.find("\"} 1.5\n"));
+  EXPECT_NE(std::string::npos, text.find("asp_up{"));
+
+  // On stopping, the file is written a last time
+  metrics.stop();
+  EXPECT_FALSE(metrics.enabled());
+  EXPECT_TRUE(boost::filesystem::exists(file));
+  EXPECT_FALSE(boost::filesystem::exists(file + ".tmp"));
+
+  std::ifstream ifs(file.c_str());
+  std::string saved((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_NE(std::string::npos, saved.find("asp_solver_iteration{"));
+  size_t pos = saved.find("asp_up{");
+  ASSERT_NE(std::string::npos, pos);
+  EXPECT_EQ("} 0", saved.substr(saved.find("}", pos), 3));
+
+  boost::filesystem::remove_all("process_metrics_test");
+}
@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/QuantileSketch.h>
+#include <asp/Core/OutlierProcessing.h>
+
+#include <algorithm>
+#include <random>
+
+using namespace vw;
+using namespace asp;
+
+TEST(QuantileSketch, Quantiles) {
+
+  std::mt19937 gen(42);
+  std::normal_distribution<double> dist(5.0, 2.0);
+  std::vector<double> vals;
+  QuantileSketch sketch;
+  for (int it = 0; it < 500000; it++) {
+    double val = dist(gen);
+    vals.push_back(val);
+    sketch.add(val);
+  }
+  std::sort(vals.begin(), vals.end());
+
+  EXPECT_EQ(sketch.count(), vals.size());
+  EXPECT_EQ(sketch.min_val(), vals.front());
+  EXPECT_EQ(sketch.max_val(), vals.back());
+
+  // The rank of each quantile is within 1% of the expected one
+  double qs[] = {0.05, 0.25, 0.5, 0.75, 0.875, 0.95};
+  for (double q: qs) {
+    double val = sketch.quantile(q);
+    double rank = double(std::lower_bound(vals.begin(), vals.end(), val) - vals.begin())
+      / vals.size();
+    EXPECT_NEAR(rank, q, 0.01);
+  }
+}
+
+TEST(QuantileSketch, Merge) {
+
+  // Merging sketches of parts gives about the same as one sketch
+  QuantileSketch whole, part1, part2;
+  for (int it = 0; it < 200000; it++) {
+    double val = (it * 7919) % 200000;
+    whole.add(val);
+    if (it % 3 == 0)
+      part1.add(val);
+    else
+      part2.add(val);
+  }
+  part1.merge(part2);
+  EXPECT_EQ(part1.count(), whole.count());
+  EXPECT_EQ(part1.min_val(), 0.0);
+  EXPECT_EQ(part1.max_val(), 199999.0);
+  EXPECT_NEAR(part1.quantile(0.5), 100000.0, 2000.0);
+  EXPECT_NEAR(whole.quantile(0.5), 100000.0, 2000.0);
+
+  // NaN values are ignored
+  QuantileSketch other;
+  other.add(std::numeric_limits<double>::quiet_NaN());
+  EXPECT_TRUE(other.empty());
+}
+
+TEST(QuantileSketch, InliersBox) {
+
+  // A few outliers far away do not change the box much
+  QuantileSketch x, y, z;
+  for (int it = 0; it < 10000; it++) {
+    x.add(it % 100);
+    y.add(it / 100);
+    z.add(1.0);
+  }
+  x.add(1e6);
+  y.add(-1e6);
+
+  BBox3 box;
+  estimate_inliers_bbox(0.75, 0.75, 0.75, 3.0, x, y, z, box);
+  EXPECT_FALSE(box.empty());
+  EXPECT_LT(box.max().x(), 1000.0);
+  EXPECT_GT(box.min().y(), -1000.0);
+  EXPECT_LE(box.min().x(), 0.0);
+  EXPECT_GE(box.max().y(), 99.0);
+}
@@ -0,0 +1,71 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/StageTiming.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+using namespace asp;
+
+TEST( StageTiming, Spans ) {
+
+  StageTiming timing;
+  timing.set_stage("corr");
+  EXPECT_EQ("corr", timing.stage());
+  EXPECT_EQ("run/out-corr-timing.json", timing.timing_file("run/out"));
+
+  // A span that was never recorded has no time
+  EXPECT_EQ(0.0, timing.elapsed("correlation"));
+
+  // Repeated spans add up, and restarting a running span is a no-op
+  timing.start("correlation");
+  timing.start("correlation");
+  timing.stop("correlation");
+  timing.start("correlation");
+  timing.stop("correlation");
+  timing.stop("correlation");
+  EXPECT_GE(timing.elapsed("correlation"), 0.0);
+
+  timing.reset();
+  EXPECT_EQ(0.0, timing.elapsed("correlation"));
+}
+
+TEST( StageTiming, Write ) {
+
+  StageTiming timing;
+  timing.set_stage("rfne");
+  timing.start("subpixel refinement");
+  timing.stop("subpixel refinement");
+
+  std::string out_prefix = "stage_timing_test/run";
+  std::string file = timing.timing_file(out_prefix);
+  EXPECT_NO_THROW(timing.write(out_prefix));
+  EXPECT_TRUE(boost::filesystem::exists(file));
+
+  std::ifstream ifs(file.c_str());
+  std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_NE(std::string::npos, text.find("\"stage\": \"rfne\""));
+  EXPECT_NE(std::string::npos, text.find("\"name\": \"subpixel refinement\""));
+  EXPECT_NE(std::string::npos, text.find("\"peak_rss_mb\""));
+
+  EXPECT_GT(peak_rss_mb(), 0.0);
+
+  boost::filesystem::remove_all("stage_timing_test");
+}
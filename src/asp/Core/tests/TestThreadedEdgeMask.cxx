@@ -19,6 +19,7 @@
 #include <test/Helpers.h>
 #include <vw/Math/BBox.h>
 #include <vw/Image/AlgorithmFunctions.h>
+#include <vw/Image/BlockRasterize.h>
 #include <vw/Image/ImageView.h>
 #include <vw/Image/Manipulation.h>
 #include <asp/Core/ThreadedEdgeMask.h>
@@ -54,3 +55,31 @@ TEST( ThreadedEdgeMask, active_area ) {
   output = threaded_edge_mask(input,0);
   EXPECT_EQ( input, output );
 }
+
+TEST( ThreadedEdgeMask, tiles ) {
+  // A valid region touching the image boundary, with a hole in a row
+  // and a column which also have valid pixels on both sides
+  ImageView<uint8> input(37,23);
+  fill(input,0);
+  fill(crop(input,0,4,30,19),255);
+  input(12,10) = 0;
+
+  ImageView<uint8> output = threaded_edge_mask(input,0,0,8);
+  EXPECT_EQ( BBox2i(0,4,30,19), threaded_edge_mask(input,0,0,8).active_area() );
+  EXPECT_EQ( input, output );
+
+  // Rendering by tiles gives the same as all at once
+  ImageView<uint8> tiled
+    = block_rasterize(threaded_edge_mask(input,0,0,8), Vector2i(5,7), 3);
+  EXPECT_EQ( input, tiled );
+
+  // Individual pixels, before anything else was found
+  EXPECT_TRUE ( is_valid(threaded_edge_mask(input,0,0,8)(0,22)) );
+  EXPECT_FALSE( is_valid(threaded_edge_mask(input,0,0,8)(30,22)) );
+  EXPECT_FALSE( is_valid(threaded_edge_mask(input,0,0,8)(5,3)) );
+
+  // Erode by a buffer
+  EXPECT_EQ( BBox2i(2,6,26,15), threaded_edge_mask(input,0,2,8).active_area() );
+  EXPECT_FALSE( is_valid(threaded_edge_mask(input,0,2,8)(1,10)) );
+  EXPECT_TRUE ( is_valid(threaded_edge_mask(input,0,2,8)(2,10)) );
+}
@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TileArena.h>
+
+#include <vw/Image/ImageView.h>
+
+#include <cstdint>
+#include <thread>
+
+using namespace vw;
+using namespace asp;
+
+TEST( TileArena, ReusedAcrossTiles ) {
+
+  // The first tile does not fit, so it comes from the heap, and the
+  // block grows to fit it
+  {
+    TileArenaScope scope;
+    double * a = TileArena::local().alloc<double>(1000);
+    float  * b = TileArena::local().alloc<float>(333);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % 64, 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % 64, 0u);
+    a[999] = 1.0;
+    b[332] = 2.0f;
+  }
+  size_t capacity = TileArena::local().capacity();
+  EXPECT_GE(capacity, 1000 * sizeof(double) + 333 * sizeof(float));
+
+  // Later tiles of that size fit, and get the same buffers
+  double * first = NULL;
+  for (int tile = 0; tile < 3; tile++) {
+    TileArenaScope scope;
+    double * a = TileArena::local().alloc<double>(1000);
+    if (tile == 0)
+      first = a;
+    EXPECT_EQ(a, first);
+    {
+      // A nested scope gives back only its own buffers
+      TileArenaScope inner;
+      float * b = TileArena::local().alloc<float>(333);
+      EXPECT_TRUE(reinterpret_cast<char*>(b) >= reinterpret_cast<char*>(a + 1000));
+    }
+    float * c = TileArena::local().alloc<float>(333);
+    EXPECT_TRUE(reinterpret_cast<char*>(c) >= reinterpret_cast<char*>(a + 1000));
+  }
+  EXPECT_EQ(TileArena::local().capacity(), capacity);
+}
+
+TEST( TileArena, Image ) {
+  ImageView<float> image(37, 23);
+  for (int r = 0; r < image.rows(); r++)
+    for (int c = 0; c < image.cols(); c++)
+      image(c, r) = c + 100 * r;
+
+  TileArenaScope scope;
+  BBox2i box(3, 4, 20, 11);
+  ArenaImage<float> copy = arena_copy(crop(image, box));
+  ASSERT_EQ(copy.cols(), box.width());
+  ASSERT_EQ(copy.rows(), box.height());
+  for (int r = 0; r < copy.rows(); r++)
+    for (int c = 0; c < copy.cols(); c++)
+      EXPECT_EQ(copy(c, r), image(c + box.min().x(), r + box.min().y()));
+
+  // The arena image can itself be rasterized
+  ImageView<float> sub = crop(copy, BBox2i(2, 1, 5, 5));
+  EXPECT_EQ(sub(0, 0), image(box.min().x() + 2, box.min().y() + 1));
+}
+
+TEST( TileArena, PerThread ) {
+  TileArena * main_arena = &TileArena::local();
+  TileArena * other_arena = NULL;
+  std::thread t([&]{ other_arena = &TileArena::local(); });
+  t.join();
+  EXPECT_TRUE(other_arena != main_arena);
+}
@@ -0,0 +1,100 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TileKernelView.h>
+
+#include <vw/Core/Functors.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  struct WeightedSum: public ReturnFixedType<double> {
+    double operator()(float a, int b) const { return a + 10.0 * b; }
+  };
+
+  // Sum any number of images, plus the column within the row
+  struct RowSum {
+    typedef double result_type;
+    void operator()(int len, double * out, std::vector<float const*> const& rows) const {
+      for (int c = 0; c < len; c++) {
+        out[c] = c;
+        for (size_t i = 0; i < rows.size(); i++)
+          out[c] += rows[i][c];
+      }
+    }
+  };
+
+  ImageView<float> ramp(int cols, int rows, float scale) {
+    ImageView<float> image(cols, rows);
+    for (int r = 0; r < rows; r++)
+      for (int c = 0; c < cols; c++)
+        image(c, r) = scale * (c + 100 * r);
+    return image;
+  }
+}
+
+TEST( TileKernelView, PerPixel ) {
+  ImageView<float> a = ramp(37, 23, 0.5);
+  ImageView<int> b(37, 23);
+  for (int r = 0; r < b.rows(); r++)
+    for (int c = 0; c < b.cols(); c++)
+      b(c, r) = c - r;
+
+  ImageView<double> full = tile_kernel_view(per_pixel_kernel(WeightedSum()), a, b);
+  ASSERT_EQ(a.cols(), full.cols());
+  ASSERT_EQ(a.rows(), full.rows());
+  for (int r = 0; r < a.rows(); r++)
+    for (int c = 0; c < a.cols(); c++)
+      EXPECT_EQ(a(c, r) + 10.0 * b(c, r), full(c, r));
+
+  // A tile not at the origin
+  BBox2i box(5, 7, 20, 11);
+  ImageView<double> part = crop(tile_kernel_view(per_pixel_kernel(WeightedSum()), a, b), box);
+  for (int r = 0; r < box.height(); r++)
+    for (int c = 0; c < box.width(); c++)
+      EXPECT_EQ(full(c + box.min().x(), r + box.min().y()), part(c, r));
+}
+
+TEST( TileKernelView, ImageList ) {
+  std::vector<ImageView<float>> images;
+  for (int i = 0; i < 3; i++)
+    images.push_back(ramp(16, 9, i + 1.0));
+
+  BBox2i box(3, 2, 10, 5);
+  ImageView<double> part = crop(tile_kernel_view(RowSum(), images), box);
+  for (int r = 0; r < box.height(); r++) {
+    for (int c = 0; c < box.width(); c++) {
+      int col = c + box.min().x(), row = r + box.min().y();
+      EXPECT_EQ(c + 6.0 * (col + 100 * row), part(c, r));
+    }
+  }
+}
+
+TEST( TileKernelView, SizeMismatch ) {
+  ImageView<float> a(10, 5);
+  ImageView<int> b(10, 6);
+  EXPECT_THROW(tile_kernel_view(per_pixel_kernel(WeightedSum()), a, b), ArgumentErr);
+
+  std::vector<ImageView<float>> images(2);
+  images[0].set_size(4, 4);
+  images[1].set_size(4, 3);
+  EXPECT_THROW(tile_kernel_view(RowSum(), images), ArgumentErr);
+}
@@ -0,0 +1,128 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/BlockRasterize.h>
+#include <asp/Core/TiledComponents.h>
+
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  ImageView<PixelMask<float>> random_image(int cols, int rows, int percent_valid) {
+    srand(5);
+    ImageView<PixelMask<float>> img(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        img(col, row) = PixelMask<float>(col + row);
+        if (rand() % 100 >= percent_valid)
+          img(col, row).invalidate();
+      }
+    }
+    return img;
+  }
+
+  ImageView<uint8> valid_pixels(ImageView<PixelMask<float>> const& img) {
+    ImageView<uint8> valid(img.cols(), img.rows());
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        valid(col, row) = is_valid(img(col, row));
+    return valid;
+  }
+}
+
+TEST( TiledComponents, LabelComponents ) {
+  ImageView<uint8> valid(6, 4);
+  fill(valid, 0);
+  // A diagonal line, a U shape, and a single pixel
+  valid(0, 0) = valid(1, 1) = valid(2, 2) = 1;
+  valid(3, 0) = valid(3, 1) = valid(4, 1) = valid(5, 1) = valid(5, 0) = 1;
+  valid(0, 3) = 1;
+
+  ImageView<int32> labels;
+  std::vector<int64> sizes;
+  label_components(valid, labels, sizes);
+  ASSERT_EQ(3u, sizes.size());
+  EXPECT_EQ(0, labels(0, 0));
+  EXPECT_EQ(0, labels(2, 2));
+  EXPECT_EQ(1, labels(3, 0));
+  EXPECT_EQ(1, labels(5, 0));
+  EXPECT_EQ(2, labels(0, 3));
+  EXPECT_EQ(-1, labels(1, 0));
+  EXPECT_EQ(3, sizes[0]);
+  EXPECT_EQ(5, sizes[1]);
+  EXPECT_EQ(1, sizes[2]);
+}
+
+TEST( TiledComponents, SizesMatchWholeImage ) {
+
+  for (int percent_valid = 40; percent_valid <= 70; percent_valid += 30) {
+    ImageView<PixelMask<float>> img = random_image(83, 61, percent_valid);
+    ImageView<int32> labels;
+    std::vector<int64> sizes;
+    label_components(valid_pixels(img), labels, sizes);
+
+    for (int tile_size = 4; tile_size <= 64; tile_size *= 4) {
+      boost::shared_ptr<TiledComponents> comp(new TiledComponents(img, tile_size, 3));
+
+      // Remove the blobs with at most this many pixels
+      int max_size = 5;
+      ImageView<PixelMask<float>> out
+        = block_rasterize(remove_small_components(img, comp, max_size), Vector2i(16, 16), 2);
+      for (int row = 0; row < img.rows(); row++) {
+        for (int col = 0; col < img.cols(); col++) {
+          bool keep = labels(col, row) >= 0 && sizes[labels(col, row)] > max_size;
+          EXPECT_EQ(keep, is_valid(out(col, row)));
+          if (keep)
+            EXPECT_EQ(img(col, row).child(), out(col, row).child());
+        }
+      }
+    }
+  }
+}
+
+TEST( TiledComponents, BoxesMatchWholeImage ) {
+
+  ImageView<PixelMask<float>> img = random_image(83, 61, 55);
+  ImageView<int32> labels;
+  std::vector<int64> sizes;
+  std::vector<BBox2i> boxes;
+  label_components(valid_pixels(img), labels, sizes, boxes);
+
+  for (int tile_size = 4; tile_size <= 64; tile_size *= 4) {
+    TiledComponents comp(img, tile_size, 3);
+    for (size_t t = 0; t < comp.tiles().size(); t++) {
+      BBox2i tile = comp.tiles()[t];
+      ImageView<int32> tile_labels;
+      std::vector<int64> tile_sizes;
+      std::vector<BBox2i> tile_boxes;
+      label_components(valid_pixels(crop(img, tile)), tile_labels, tile_sizes, tile_boxes);
+      comp.global_boxes(t, tile_boxes);
+      for (int row = 0; row < tile.height(); row++) {
+        for (int col = 0; col < tile.width(); col++) {
+          int label = tile_labels(col, row);
+          if (label >= 0)
+            EXPECT_EQ(boxes[labels(col + tile.min().x(), row + tile.min().y())],
+                      tile_boxes[label]);
+        }
+      }
+    }
+  }
+}
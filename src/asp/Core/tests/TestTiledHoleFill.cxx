@@ -0,0 +1,90 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/BlockRasterize.h>
+#include <asp/Core/TiledHoleFill.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // A smooth image with a hole of 5 x 4 pixels, one of 12 x 3 pixels,
+  // and one at the left border
+  ImageView<PixelMask<float>> image_with_holes() {
+    ImageView<PixelMask<float>> img(40, 30);
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        img(col, row) = PixelMask<float>(col + 2.0 * row);
+    for (int row = 6; row < 10; row++)
+      for (int col = 6; col < 11; col++)
+        img(col, row).invalidate();
+    for (int row = 20; row < 23; row++)
+      for (int col = 14; col < 26; col++)
+        img(col, row).invalidate();
+    for (int row = 12; row < 15; row++)
+      for (int col = 0; col < 2; col++)
+        img(col, row).invalidate();
+    return img;
+  }
+}
+
+TEST( TiledHoleFill, FillableHole ) {
+  EXPECT_TRUE (is_fillable_hole(BBox2i(6, 6, 5, 4), 40, 30, 5));
+  EXPECT_FALSE(is_fillable_hole(BBox2i(6, 6, 5, 4), 40, 30, 4));
+  EXPECT_FALSE(is_fillable_hole(BBox2i(0, 12, 2, 3), 40, 30, 5));
+  EXPECT_FALSE(is_fillable_hole(BBox2i(35, 12, 5, 3), 40, 30, 5));
+}
+
+TEST( TiledHoleFill, SameForAnyTiles ) {
+
+  ImageView<PixelMask<float>> img = image_with_holes();
+  int max_len = 6;
+
+  // With one tile for the whole image
+  ImageView<PixelMask<float>> whole = fill_small_holes(img, max_len, 64, 1);
+
+  for (int row = 0; row < img.rows(); row++) {
+    for (int col = 0; col < img.cols(); col++) {
+      bool small_hole = (col >= 6 && col < 11 && row >= 6 && row < 10);
+      if (is_valid(img(col, row))) {
+        EXPECT_EQ(img(col, row).child(), whole(col, row).child());
+      } else if (small_hole) {
+        ASSERT_TRUE(is_valid(whole(col, row)));
+        EXPECT_GE(whole(col, row).child(), 5 + 2.0 * 5);
+        EXPECT_LE(whole(col, row).child(), 11 + 2.0 * 10);
+      } else {
+        EXPECT_FALSE(is_valid(whole(col, row)));
+      }
+    }
+  }
+
+  // The small hole crosses the borders of these tiles
+  for (int tile_size = 4; tile_size <= 16; tile_size *= 2) {
+    ImageView<PixelMask<float>> out
+      = block_rasterize(fill_small_holes(img, max_len, tile_size, 3),
+                        Vector2i(tile_size, tile_size), 2);
+    for (int row = 0; row < img.rows(); row++) {
+      for (int col = 0; col < img.cols(); col++) {
+        EXPECT_EQ(is_valid(whole(col, row)), is_valid(out(col, row)));
+        if (is_valid(whole(col, row)))
+          EXPECT_NEAR(whole(col, row).child(), out(col, row).child(), 1e-5);
+      }
+    }
+  }
+}
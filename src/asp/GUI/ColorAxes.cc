@@ -140,45 +140,11 @@ class ColorAxesData: public QwtMatrixRasterData {
 
 private:
   
+  // The range of values of the lowest-resolution version of the
+  // image, without outliers, found from its histogram
   void calcLowResMinMax(double& min_val, double& max_val) const {
-    
-    // TODO(oalexan1): How about removing a small percentile of intensity from ends?
-
-    // Get the lowest-resolution image version from the pyramid
-    ImageView<double> lowres_img = m_image.img.m_img_ch1_double.pyramid().back();
-
-    min_val = std::numeric_limits<double>::max();
-    max_val = -min_val;
-    for (int col = 0; col < lowres_img.cols(); col++) {
-      for (int row = 0; row < lowres_img.rows(); row++) {
-        
-        double val = lowres_img(col, row);
-        if (val == m_nodata_val) 
-          continue;
-        
-        min_val = std::min(min_val, val);
-        max_val = std::max(max_val, val);
-      }
-    }
-
-    if (min_val > max_val) {
-      // If the image turned out to be empty
-      min_val = m_nodata_val;
-      max_val = m_nodata_val;
-    }
-    
-    Vector2 approx_bounds = m_image.img.m_img_ch1_double.get_approx_bounds();
-    // The approx_bounds are computed on the lowest resolution level
-    // of the pyramid and are likely exaggerated, but were computed
-    // with outlier removal.  Use them to adjust the existing bounds
-    // which may have outliers.
-    // TODO(oalexan1): Integrate this with formQimage logic.
-    if (approx_bounds[0] < approx_bounds[1]) {
-      min_val = std::max(min_val, approx_bounds[0]);
-      max_val = std::min(max_val, approx_bounds[1]);
-    }
-    
-    return;
+    min_val = m_image.img.m_stretch_bounds[0];
+    max_val = m_image.img.m_stretch_bounds[1];
   }
   
 public:
@@ -16,15 +16,24 @@
 // __END_LICENSE__
 
 #include <asp/GUI/DiskImagePyramidMultiChannel.h>
+#include <asp/Core/FileUtils.h>
+#include <asp/Core/ImageHistogram.h>
+#include <asp/Core/StereoSettings.h>
 
 #include <QtWidgets>
 
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <map>
 #include <string>
 #include <vector>
 
 using namespace vw;
 using namespace vw::gui;
 
+namespace fs = boost::filesystem;
+
 namespace vw { namespace gui {
 
 vw::RunOnce temporary_files_once = VW_RUNONCE_INIT;
@@ -37,14 +46,149 @@ TemporaryFiles& temporary_files() {
   temporary_files_once.run( init_temporary_files);
   return *temporary_files_ptr;
 }
+
+// The files of a cached pyramid start with this and a hash
+const std::string PYRAMID_CACHE_PREFIX = "pyramid-";
+
+// When this session started using the pyramid cache. Pyramids used
+// since then are not removed.
+std::time_t g_pyramid_cache_start = std::time(0);
+
+// The file whose modification time records when a cached pyramid was
+// last used
+std::string pyramid_cache_stamp(std::string const& link) {
+  return fs::path(link).replace_extension(".used").string();
+}
+
+std::string pyramid_cache_link(std::string const& image_file, std::string const& cache_dir) {
+
+  if (cache_dir == "")
+    return image_file;
+
+  try {
+    std::string abs_file = fs::absolute(image_file).string();
+    std::ostringstream key;
+    key << abs_file << " " << asp::file_timestamp(abs_file) << " "
+        << fs::file_size(abs_file);
+
+    // Keep the extension, as it may determine how the image is read
+    std::string link = asp::cache_file_name(cache_dir, PYRAMID_CACHE_PREFIX, key.str(),
+                                            fs::path(abs_file).extension().string());
+    fs::create_directories(cache_dir);
+    if (!fs::is_symlink(fs::symlink_status(link))) {
+      try {
+        fs::create_symlink(abs_file, link);
+      } catch (...) {
+        // Another session may have made it meanwhile. That is checked below.
+      }
+    }
+
+    // Different images may have the same hash
+    if (!fs::is_symlink(fs::symlink_status(link)) || fs::read_symlink(link) != abs_file)
+      return image_file;
+
+    // Mark the pyramid as used now
+    std::string stamp = pyramid_cache_stamp(link);
+    {
+      std::ofstream ofs(stamp.c_str(), std::ios::app);
+    }
+    fs::last_write_time(stamp, std::time(0));
+
+    return link;
+  } catch (std::exception const& e) {
+    vw_out(WarningMessage) << "Cannot use the pyramid cache in " << cache_dir
+                           << " for " << image_file << ": " << e.what() << "\n";
+  }
+
+  return image_file;
+}
+
+void shrink_pyramid_cache(std::string const& cache_dir, double max_size_mb) {
+
+  if (cache_dir == "" || max_size_mb <= 0 || !fs::is_directory(cache_dir))
+    return;
+
+  // Group the files by pyramid. The files of each start with the same
+  // prefix and hash, followed by the extension, or by '_' then the level.
+  struct CachedPyramid {
+    double num_bytes;
+    std::time_t last_use;
+    std::vector<fs::path> files;
+    CachedPyramid(): num_bytes(0), last_use(0) {}
+  };
+  std::map<std::string, CachedPyramid> pyramids;
+  double total_bytes = 0;
+  try {
+    for (fs::directory_iterator it(cache_dir); it != fs::directory_iterator(); it++) {
+      std::string name = it->path().filename().string();
+      if (name.find(PYRAMID_CACHE_PREFIX) != 0)
+        continue;
+      CachedPyramid & p = pyramids[name.substr(0, name.find_first_of("_.",
+                                                    PYRAMID_CACHE_PREFIX.size()))];
+      p.files.push_back(it->path());
+      if (!fs::is_regular_file(fs::symlink_status(it->path())))
+        continue; // the link to the image, which is not in the cache
+      double num_bytes = fs::file_size(it->path());
+      p.num_bytes += num_bytes;
+      total_bytes += num_bytes;
+      if (it->path().extension() == ".used")
+        p.last_use = fs::last_write_time(it->path());
+    }
+  } catch (std::exception const& e) {
+    vw_out(WarningMessage) << "Cannot list the pyramid cache in " << cache_dir
+                           << ": " << e.what() << "\n";
+    return;
+  }
+
+  std::vector<std::pair<std::time_t, std::string>> by_use;
+  for (auto it = pyramids.begin(); it != pyramids.end(); it++)
+    by_use.push_back(std::make_pair(it->second.last_use, it->first));
+  std::sort(by_use.begin(), by_use.end());
+
+  double max_bytes = max_size_mb * 1024.0 * 1024.0;
+  for (size_t it = 0; it < by_use.size() && total_bytes > max_bytes; it++) {
+    CachedPyramid const& p = pyramids[by_use[it].second];
+    if (p.last_use >= g_pyramid_cache_start)
+      break; // this and the ones after it are in use
+    vw_out() << "Removing from the pyramid cache: " << by_use[it].second << "\n";
+    for (size_t f = 0; f < p.files.size(); f++) {
+      boost::system::error_code ec;
+      fs::remove(p.files[f], ec); // another session may have removed it
+    }
+    total_bytes -= p.num_bytes;
+  }
+}
   
+// The range of values of the lowest-resolution level of a pyramid,
+// without outliers, found from its histogram.
+vw::Vector2 lowres_stretch_bounds(vw::mosaic::DiskImagePyramid<double> & img) {
+
+  double nodata_val = img.get_nodata_val();
+  ImageView<double> lowres_img = img.pyramid().back();
+  asp::ImageHistogram hist;
+  hist.compute(create_mask(lowres_img, nodata_val), asp::fine_histogram_bins(256),
+               vw_settings().default_num_threads());
+
+  vw::Vector2 bounds;
+  double pct = 0.75, outlier_factor = 3.0;
+  if (!hist.outlier_brackets(pct, outlier_factor, bounds[0], bounds[1]))
+    bounds = vw::Vector2(nodata_val, nodata_val);
+  return bounds;
+}
+
 DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& image_file,
                              vw::GdalWriteOptions const& opt,
                              int top_image_max_pix, int subsample):
-  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT) {
+  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT),
+  m_stretch_bounds(0, 0) {
   
   if (image_file == "") return;
 
+  // The cached pyramids are kept, rather than being temporary files
+  std::string cache_dir = asp::stereo_settings().pyramid_cache_dir;
+  std::string pyramid_file = pyramid_cache_link(image_file, cache_dir);
+  bool use_cache = (pyramid_file != image_file);
+
   boost::shared_ptr<DiskImageResource> image_rsrc = vw::DiskImageResourcePtr(image_file);
   ImageFormat image_fmt = image_rsrc->format();
   
@@ -63,39 +207,44 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& im
     
     if (m_num_channels == 1 || image_fmt.channel_type != VW_CHANNEL_UINT8) {
       // Single channel image with float pixels.
-      m_img_ch1_double = vw::mosaic::DiskImagePyramid<double>(image_file, m_opt);
+      m_img_ch1_double = vw::mosaic::DiskImagePyramid<double>(pyramid_file, m_opt);
       m_rows = m_img_ch1_double.rows();
       m_cols = m_img_ch1_double.cols();
       m_type = CH1_DOUBLE;
-      temporary_files().files.insert(m_img_ch1_double.get_temporary_files().begin(), 
-                                     m_img_ch1_double.get_temporary_files().end());
+      m_stretch_bounds = lowres_stretch_bounds(m_img_ch1_double);
+      if (!use_cache)
+        temporary_files().files.insert(m_img_ch1_double.get_temporary_files().begin(), 
+                                       m_img_ch1_double.get_temporary_files().end());
     }else if (m_num_channels == 2){
       // uint8 image with an alpha channel.
-      m_img_ch2_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 2>>(image_file, m_opt);
+      m_img_ch2_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 2>>(pyramid_file, m_opt);
       m_num_channels = 2; // we read only 1 channel
       m_rows = m_img_ch2_uint8.rows();
       m_cols = m_img_ch2_uint8.cols();
       m_type = CH2_UINT8;
-      temporary_files().files.insert(m_img_ch2_uint8.get_temporary_files().begin(), 
-                                     m_img_ch2_uint8.get_temporary_files().end());
+      if (!use_cache)
+        temporary_files().files.insert(m_img_ch2_uint8.get_temporary_files().begin(), 
+                                       m_img_ch2_uint8.get_temporary_files().end());
     } else if (m_num_channels == 3){
       // RGB image with three uint8 channels.
-      m_img_ch3_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 3>>(image_file, m_opt);
+      m_img_ch3_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 3>>(pyramid_file, m_opt);
       m_num_channels = 3;
       m_rows = m_img_ch3_uint8.rows();
       m_cols = m_img_ch3_uint8.cols();
       m_type = CH3_UINT8;
-      temporary_files().files.insert(m_img_ch3_uint8.get_temporary_files().begin(), 
-                                     m_img_ch3_uint8.get_temporary_files().end());
+      if (!use_cache)
+        temporary_files().files.insert(m_img_ch3_uint8.get_temporary_files().begin(), 
+                                       m_img_ch3_uint8.get_temporary_files().end());
     } else if (m_num_channels == 4){
       // RGB image with three uint8 channels and an alpha channel
-      m_img_ch4_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 4>>(image_file, m_opt);
+      m_img_ch4_uint8 = vw::mosaic::DiskImagePyramid<Vector<vw::uint8, 4>>(pyramid_file, m_opt);
       m_num_channels = 4;
       m_rows = m_img_ch4_uint8.rows();
       m_cols = m_img_ch4_uint8.cols();
       m_type = CH4_UINT8;
-      temporary_files().files.insert(m_img_ch4_uint8.get_temporary_files().begin(), 
-                                     m_img_ch4_uint8.get_temporary_files().end());
+      if (!use_cache)
+        temporary_files().files.insert(m_img_ch4_uint8.get_temporary_files().begin(), 
+                                       m_img_ch4_uint8.get_temporary_files().end());
     }else{
       vw_throw(ArgumentErr() << "Unsupported image with " << m_num_channels << " bands.\n");
     }
@@ -123,7 +272,8 @@ double DiskImagePyramidMultiChannel::get_nodata_val() const {
   
 void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i region_in,
                   bool highlight_nodata,
-                  QImage & qimg, double & scale_out, vw::BBox2i & region_out) const{
+                  QImage & qimg, double & scale_out, vw::BBox2i & region_out,
+                  double threshold) const{
 
   bool scale_pixels = (m_type == CH1_DOUBLE);
   vw::Vector2 approx_bounds;
@@ -131,11 +281,7 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
   // Extract the clip, then convert it from VW format to QImage format.
   if (m_type == CH1_DOUBLE) {
 
-    //Stopwatch sw0;
-    //sw0.start();
-    approx_bounds = m_img_ch1_double.get_approx_bounds();
-    //sw0.stop();
-    //vw_out() << "Render time sw0 (seconds): " << sw0.elapsed_seconds() << std::endl;
+    approx_bounds = m_stretch_bounds;
     
     ImageView<double> clip;
     //Stopwatch sw1;
@@ -144,10 +290,25 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
     //sw1.stop();
     //vw_out() << "Render time sw1 (seconds): " << sw1.elapsed_seconds() << std::endl;
 
+    // Threshold the clip here, rather than writing a thresholded copy
+    // of the image, so that a new threshold shows right away. The
+    // values to stretch start at the threshold.
+    double nodata_val = m_img_ch1_double.get_nodata_val();
+    if (threshold > -std::numeric_limits<double>::max()) {
+#pragma omp parallel for
+      for (int row = 0; row < clip.rows(); row++) {
+        double * vals = &clip(0, row);
+        for (int col = 0; col < clip.cols(); col++) {
+          if (vals[col] <= threshold)
+            vals[col] = nodata_val;
+        }
+      }
+      approx_bounds[0] = std::max(approx_bounds[0], threshold);
+    }
+
     //Stopwatch sw2;
     //sw2.start();
-    formQimage(highlight_nodata, scale_pixels, m_img_ch1_double.get_nodata_val(), approx_bounds,
-               clip, qimg);
+    formQimage(highlight_nodata, scale_pixels, nodata_val, approx_bounds, clip, qimg);
     //sw2.stop();
     //vw_out() << "Render time sw2 (seconds): " << sw2.elapsed_seconds() << std::endl;
   } else if (m_type == CH2_UINT8) {
@@ -203,6 +364,96 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
   }
 }
 
+void DiskImagePyramidMultiChannel::get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                                                       HillshadeParams const& params,
+                                                       QImage & qimg, double & scale_out,
+                                                       vw::BBox2i & region_out) const {
+  if (m_type != CH1_DOUBLE)
+    vw_throw(ArgumentErr() << "Hill-shading makes sense only for single-channel images.\n");
+
+  // Read one more pixel on each side, at the resolution of the level
+  // to be used, which is at most as coarse as scale_in.
+  vw::BBox2i grown = region_in;
+  grown.expand(std::max(1, int(ceil(2*scale_in))));
+  grown.crop(vw::BBox2i(0, 0, m_cols, m_rows));
+  ImageView<double> clip;
+  vw::BBox2i grown_out;
+  m_img_ch1_double.get_image_clip(scale_in, grown, clip, scale_out, grown_out);
+
+  // The pixels of the clip at this level that were asked for
+  region_out = vw::BBox2i(vw::Vector2i(floor(region_in.min().x()/scale_out),
+                                       floor(region_in.min().y()/scale_out)),
+                          vw::Vector2i(ceil(region_in.max().x()/scale_out),
+                                       ceil(region_in.max().y()/scale_out)));
+  region_out.crop(grown_out);
+  qimg = QImage(std::max(region_out.width(), 0), std::max(region_out.height(), 0),
+                QImage::Format_ARGB32_Premultiplied);
+  if (region_out.empty())
+    return;
+
+  // The pixel size in meters, at the center of the clip. Using the
+  // lon-lat works for both projected and geographic images.
+  vw::Vector2 pix = (vw::Vector2(region_out.min()) + vw::Vector2(region_out.max()))/2.0;
+  pix *= scale_out;
+  vw::Vector2 ll = params.georef.pixel_to_lonlat(pix);
+  vw::Vector2 llx = params.georef.pixel_to_lonlat(pix + vw::Vector2(scale_out, 0));
+  vw::Vector2 lly = params.georef.pixel_to_lonlat(pix + vw::Vector2(0, scale_out));
+  double meters_per_deg = params.georef.datum().semi_major_axis() * M_PI / 180.0;
+  double cos_lat = cos(ll[1] * M_PI / 180.0);
+  double dx = meters_per_deg * norm_2(vw::Vector2((llx[0] - ll[0])*cos_lat, llx[1] - ll[1]));
+  double dy = meters_per_deg * norm_2(vw::Vector2((lly[0] - ll[0])*cos_lat, lly[1] - ll[1]));
+  if (!(dx > 0) || !(dy > 0))
+    dx = dy = 1.0; // cannot find the pixel size, so any will do
+
+  // The light direction, with x to the right and y up. The azimuth is
+  // counter-clockwise from the right.
+  double az = params.azimuth * M_PI / 180.0, el = params.elevation * M_PI / 180.0;
+  vw::Vector3 light(cos(el)*cos(az), cos(el)*sin(az), sin(el));
+
+  double nodata_val = m_img_ch1_double.get_nodata_val();
+  int cols = clip.cols(), rows = clip.rows();
+  int col_off = region_out.min().x() - grown_out.min().x();
+  int row_off = region_out.min().y() - grown_out.min().y();
+#pragma omp parallel for
+  for (int row = 0; row < qimg.height(); row++) {
+    QRgb * line = reinterpret_cast<QRgb*>(qimg.scanLine(row));
+    int r = row + row_off;
+    for (int col = 0; col < qimg.width(); col++) {
+      int c = col + col_off;
+      double v = clip(c, r);
+      if (v == nodata_val || std::isnan(v)) {
+        line[col] = qRgba(0, 0, 0, 0); // transparent
+        continue;
+      }
+
+      // Central differences, or one-sided ones at the clip edges or
+      // next to nodata
+      double grad[2] = {0.0, 0.0};
+      int lo[2] = {c - 1, r - 1}, hi[2] = {c + 1, r + 1};
+      for (int d = 0; d < 2; d++) {
+        double vlo = v, vhi = v;
+        int ilo = d == 0 ? c : r, ihi = ilo;
+        if (lo[d] >= 0) {
+          double w = (d == 0) ? clip(lo[d], r) : clip(c, lo[d]);
+          if (w != nodata_val && !std::isnan(w)) { vlo = w; ilo = lo[d]; }
+        }
+        if (hi[d] < (d == 0 ? cols : rows)) {
+          double w = (d == 0) ? clip(hi[d], r) : clip(c, hi[d]);
+          if (w != nodata_val && !std::isnan(w)) { vhi = w; ihi = hi[d]; }
+        }
+        if (ihi > ilo)
+          grad[d] = (vhi - vlo) / (ihi - ilo);
+      }
+
+      // The rows go down, so the y gradient changes sign
+      vw::Vector3 normal(-grad[0]/dx, grad[1]/dy, 1.0);
+      double shade = std::max(0.0, dot_prod(normal, light) / norm_2(normal));
+      int g = round(255.0 * shade);
+      line[col] = qRgba(g, g, g, 255);
+    }
+  }
+}
+
 std::string DiskImagePyramidMultiChannel::get_value_as_str(int32 x, int32 y) const {
 
   // Below we cast from Vector<uint8> to Vector<double>, as the former
@@ -44,8 +44,10 @@
 #include <vw/Math/BBox.h>
 #include <vw/Math/Vector.h>
 #include <vw/Mosaic/DiskImagePyramid.h>
+#include <vw/Cartography/GeoReference.h>
 #include <vw/Core/RunOnce.h>
 
+#include <limits>
 #include <string>
 #include <vector>
 #include <list>
@@ -62,11 +64,27 @@ namespace vw { namespace gui {
   };
   /// Access the global list of temporary files
   TemporaryFiles& temporary_files();
+
+  /// With a pyramid cache directory, return a link in it to the image,
+  /// named by a hash of the image path, modification time, and size.
+  /// The pyramid levels are made next to the link, so they persist,
+  /// and are found by later sessions while the image is unchanged.
+  /// Without a cache directory, or on failure, return the image itself.
+  std::string pyramid_cache_link(std::string const& image_file, std::string const& cache_dir);
+
+  /// Remove the least recently used pyramids in the cache directory,
+  /// other than those used in this session, until the cache takes at
+  /// most this much space. Nothing is done if the size is not positive.
+  void shrink_pyramid_cache(std::string const& cache_dir, double max_size_mb);
   
   // Form a QImage to show on screen. For scalar images, we scale them
   // and handle the nodata val. For two channel images, interpret the
   // second channel as mask. If there are 3 or more channels,
   // interpret those as RGB.
+  // The pixels are written to each row of the QImage directly, as
+  // setPixel() per pixel is slow, and rows are done in parallel.
+  // The values written are the same as with setPixel(), which stores
+  // them as they are for this format.
   
   template<class PixelT>
   typename boost::enable_if<boost::is_same<PixelT,double>, void>::type
@@ -74,21 +92,25 @@ namespace vw { namespace gui {
              vw::Vector2 const& approx_bounds,
              ImageView<PixelT> const& clip, QImage & qimg){
 
+    int cols = clip.cols(), rows = clip.rows();
     double min_val = std::numeric_limits<double>::max();
     double max_val = -std::numeric_limits<double>::max();
     if (scale_pixels) {
-      // No multi-threading here since we modify shared values
-      for (int col = 0; col < clip.cols(); col++){
-        for (int row = 0; row < clip.rows(); row++){
-          if (clip(col, row) == nodata_val) continue;
-          if (clip(col, row) < min_val) min_val = clip(col, row);
-          if (clip(col, row) > max_val) max_val = clip(col, row);
+#pragma omp parallel for reduction(min:min_val) reduction(max:max_val)
+      for (int row = 0; row < rows; row++){
+        double const* vals = &clip(0, row);
+        for (int col = 0; col < cols; col++){
+          double v = vals[col];
+          if (v == nodata_val) continue;
+          // A NaN fails both comparisons
+          if (v < min_val) min_val = v;
+          if (v > max_val) max_val = v;
         }
       }
     
       // The approx_bounds are computed on the lowest resolution level
       // of the pyramid and are likely exaggerated, but were computed
-      // with outlier removal.  Use them to adjust the existing bounds
+      // with outlier removal. Use them to adjust the existing bounds
       // which may have outliers.
       if (approx_bounds[0] < approx_bounds[1]) {
         min_val = std::max(min_val, approx_bounds[0]);
@@ -100,31 +122,23 @@ namespace vw { namespace gui {
         max_val = min_val + 1.0;
     }
 
-    qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    double factor = 255.0/(max_val - min_val);
+    QRgb nodata_color = highlight_nodata ? qRgb(255, 0, 0) : qRgba(0, 0, 0, 0);
+    qimg = QImage(cols, rows, QImage::Format_ARGB32_Premultiplied);
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
-
-        double v = clip(col, row);
-        if (scale_pixels) 
-          v = round(255*(std::max(v, min_val) - min_val)/(max_val-min_val));
-     
-        v = std::min(std::max(0.0, v), 255.0);
-      
-        if (clip(col, row) == nodata_val || std::isnan(clip(col, row)) ){
-        
-          if (!highlight_nodata){
-            // transparent
-            qimg.setPixel(col, row, Qt::transparent);
-          }else{
-            // highlight in red
-            qimg.setPixel(col, row, qRgb(255, 0, 0));
-          }
-        
-        }else{
-          // opaque
-          qimg.setPixel(col, row, QColor(v, v, v, 255).rgba());
+    for (int row = 0; row < rows; row++){
+      double const* vals = &clip(0, row);
+      QRgb * line = reinterpret_cast<QRgb*>(qimg.scanLine(row));
+      for (int col = 0; col < cols; col++){
+        double v = vals[col];
+        if (v == nodata_val || std::isnan(v)) {
+          line[col] = nodata_color; // transparent, or highlighted in red
+          continue;
         }
+        if (scale_pixels) 
+          v = round((std::max(v, min_val) - min_val)*factor);
+        int c = std::min(std::max(0.0, v), 255.0);
+        line[col] = qRgba(c, c, c, 255); // opaque
       }
     }
   }
@@ -135,18 +149,18 @@ namespace vw { namespace gui {
              vw::Vector2 const& approx_bounds,
              ImageView<PixelT> const& clip, QImage & qimg){
 
-    qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    int cols = clip.cols(), rows = clip.rows();
+    qimg = QImage(cols, rows, QImage::Format_ARGB32_Premultiplied);
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
-        Vector<vw::uint8, 2> v = clip(col, row);
-        if ( v[1] > 0 && v == v){ // need the latter for NaN
-          // opaque grayscale
-          qimg.setPixel(col, row, QColor(v[0], v[0], v[0], 255).rgba());
-        }else{
-          // transparent
-          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
-        }
+    for (int row = 0; row < rows; row++){
+      PixelT const* vals = &clip(0, row);
+      QRgb * line = reinterpret_cast<QRgb*>(qimg.scanLine(row));
+      for (int col = 0; col < cols; col++){
+        PixelT const& v = vals[col];
+        if (v[1] > 0) // opaque grayscale
+          line[col] = qRgba(v[0], v[0], v[0], 255);
+        else // transparent
+          line[col] = qRgba(0, 0, 0, 0);
       }
     }
   }
@@ -158,23 +172,32 @@ namespace vw { namespace gui {
              vw::Vector2 const& approx_bounds,
              ImageView<PixelT> const& clip, QImage & qimg){
 
-    qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+    int cols = clip.cols(), rows = clip.rows();
+    qimg = QImage(cols, rows, QImage::Format_ARGB32_Premultiplied);
 #pragma omp parallel for
-    for (int col = 0; col < clip.cols(); col++){
-      for (int row = 0; row < clip.rows(); row++){
-        PixelT v = clip(col, row);
+    for (int row = 0; row < rows; row++){
+      PixelT const* vals = &clip(0, row);
+      QRgb * line = reinterpret_cast<QRgb*>(qimg.scanLine(row));
+      for (int col = 0; col < cols; col++){
+        PixelT const& v = vals[col];
         if (v != v) // NaN, set to transparent
-          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
+          line[col] = qRgba(0, 0, 0, 0);
         else if (v.size() == 3) // color
-          qimg.setPixel(col, row, QColor(v[0], v[1], v[2], 255).rgba());
+          line[col] = qRgba(v[0], v[1], v[2], 255);
         else if (v.size() > 3) // color or transparent
-          qimg.setPixel(col, row, QColor(v[0], v[1], v[2], 255*(v[3] > 0)).rgba());
+          line[col] = qRgba(v[0], v[1], v[2], 255*(v[3] > 0));
         else // grayscale 
-          qimg.setPixel(col, row, QColor(v[0], v[0], v[0], 255).rgba());
+          line[col] = qRgba(v[0], v[0], v[0], 255);
       }
     }
   }
 
+  /// How to hillshade an elevation image on the fly
+  struct HillshadeParams {
+    vw::cartography::GeoReference georef; // to find the pixel size in meters
+    double azimuth, elevation;            // of the light, in degrees
+  };
+
   // An image class that supports 1 to 3 channels.  We use
   // DiskImagePyramid<double> to be able to use some of the
   // pre-defined member functions for an image class. This class
@@ -191,6 +214,12 @@ namespace vw { namespace gui {
     int m_rows, m_cols;
     ImgType m_type; // keeps track of which of the above images we use
 
+    // The range of values of a single-channel image to stretch to the
+    // display, without outliers. It is found from the histogram of the
+    // lowest-resolution level of the pyramid. If there are no valid
+    // values, both ends are the nodata value.
+    vw::Vector2 m_stretch_bounds;
+
     // Constructor
     DiskImagePyramidMultiChannel(std::string const& image_file = "",
                                  vw::GdalWriteOptions const&
@@ -200,8 +229,19 @@ namespace vw { namespace gui {
 
     // This function will return a QImage to be shown on screen.
     // How we create it, depends on the type of image we want to display.
+    // Pixels of a single-channel image at or below the threshold are
+    // shown as nodata.
     void get_image_clip(double scale_in, vw::BBox2i region_in, bool highlight_nodata,
-                        QImage & qimg, double & scale_out, vw::BBox2i & region_out) const;
+                        QImage & qimg, double & scale_out, vw::BBox2i & region_out,
+                        double threshold = -std::numeric_limits<double>::max()) const;
+
+    /// Same as get_image_clip(), but hillshade the clip, which must be of
+    /// elevations, as is done by the hillshade tool. A clip one pixel
+    /// wider on each side is read, so that adjacent clips agree at their
+    /// edges. The shading does not depend on the values of other clips.
+    void get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                             HillshadeParams const& params,
+                             QImage & qimg, double & scale_out, vw::BBox2i & region_out) const;
     double get_nodata_val() const;
     
     int32 cols  () const { return m_cols;  }
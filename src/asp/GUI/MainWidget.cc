@@ -33,6 +33,7 @@
 #include <vw/Cartography/GeoTransform.h>
 #include <vw/Cartography/shapeFile.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/Settings.h>
 #include <vw/Image/Manipulation.h>
 #include <vw/Image/Statistics.h>
 #include <vw/Image/Colormap.h> // colormaps supported by ASP
@@ -243,11 +244,16 @@ namespace vw { namespace gui {
 
     installEventFilter(this);
 
+    // A few threads suffice to keep up with the disk
+    int num_tile_threads = std::min(4, std::max(1, int(vw_settings().default_num_threads())));
+    m_tile_loader.reset(new TileLoader(this, "tileLoaded", num_tile_threads));
+
     // setTitle("Intensity");
     // setBorderDist(20,20);
     // setAlignment(QwtScaleDraw::BottomScale);
 
     m_firstPaintEvent = true;
+    m_tile_refresh_pending = false;
     m_emptyRubberBand = QRect(0, 0, 0, 0);
     m_rubberBand      = m_emptyRubberBand;
     m_cropWinMode     = false;
@@ -415,6 +421,8 @@ namespace vw { namespace gui {
   } // End constructor
 
   MainWidget::~MainWidget() {
+    // Stop the tile rendering threads before the widget goes away
+    m_tile_loader.reset();
   }
 
   bool MainWidget::eventFilter(QObject *obj, QEvent *E){
@@ -721,19 +729,13 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
       return;
     }
 
-    // Create the thresholded images and save them to disk. We have to do it each
-    // time as perhaps the image threshold changed.
+    // The threshold is applied to each tile when it is drawn, so
+    // nothing is written to disk.
     for (int image_iter = m_beg_image_id; image_iter < m_end_image_id; image_iter++) {
-      std::string input_file = m_images[image_iter].name;
 
       if (m_images[image_iter].isPoly() || m_images[image_iter].isCsv())
         continue;
       
-      double nodata_val = -std::numeric_limits<double>::max();
-      vw::read_nodata_val(input_file, nodata_val);
-      // Do not use max(nodata_val, thresh) as sometimes nodata_val can be larger than data
-      nodata_val = m_thresh;
-
       int num_channels = m_images[image_iter].img.planes();
       
       if (num_channels != 1) {
@@ -743,25 +745,8 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
       }
 
       m_images[image_iter].m_display_mode = THRESHOLDED_VIEW;
-      
-      ImageViewRef<double> thresh_image
-        = apply_mask(create_mask_less_or_equal(DiskImageView<double>(input_file),
-                                               nodata_val), nodata_val);
-
-      // TODO(oalexan1): Need to do something like in write_hillshade()
-      // so that we don't have to always re-write the thresholded image.
-      std::string suffix = "_thresh.tif";
-      bool has_nodata = true;
-      std::string thresholded_file
-        = write_in_orig_or_curr_dir(m_opt,
-                                    thresh_image, input_file, suffix,
-                                    m_images[image_iter].has_georef, m_images[image_iter].georef,
-                                    has_nodata, nodata_val);
-
-      // Read it back right away
-      m_images[image_iter].read(thresholded_file, m_opt, THRESHOLDED_VIEW);
-      temporary_files().files.insert(thresholded_file);
     }
+    m_tile_loader->clear(); // the tiles for the previous threshold are stale
 
     // We may not want to refresh the pixmap right away if we are going to
     // update the GUI anyway in proper time
@@ -773,8 +758,8 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
 
     int num_images = m_images.size();
 
-    // Create the hillshaded images and save them to disk. We have to do
-    // it each time as perhaps the hillshade parameters changed.
+    // Check which images can be hillshaded. The hillshading itself is
+    // done when drawing.
     for (int image_iter = m_beg_image_id; image_iter < m_end_image_id; image_iter++) {
 
       if (m_images[image_iter].m_display_mode != HILLSHADED_VIEW)
@@ -797,7 +782,6 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
         return;
       }
 
-      std::string input_file = m_images[image_iter].name;
       int num_channels = m_images[image_iter].img.planes();
       if (num_channels != 1) {
         // Turn off hillshade mode for all images which don't support it,
@@ -815,24 +799,6 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
         popUp("Hill-shading makes sense only for single-channel images.");
         continue;
       }
-
-      // Save the hillshaded images to disk (unless it already exists)
-      std::string hillshaded_file;
-      bool have_gui = true;
-      bool success = write_hillshade(m_opt,
-                                     have_gui,
-                                     m_hillshade_azimuth,
-                                     m_hillshade_elevation,
-                                     input_file, hillshaded_file);
-
-      if (!success) {
-        m_images[image_iter].m_display_mode = REGULAR_VIEW;
-        return;
-      }
-
-      vw_out() << "Reading: " << hillshaded_file << std::endl;
-      m_images[image_iter].read(hillshaded_file, m_opt, HILLSHADED_VIEW);
-      temporary_files().files.insert(hillshaded_file);
     }
   }
 
@@ -1079,10 +1045,74 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
   //             MainWidget Private Methods
   // --------------------------------------------------------------
 
-  // TODO: Rewrite this to draw only the pixels that end up being seen!
-  // It should greatly improve the performance!
-  // Also, the buffer to be rendered can be split into tiles,
-  // with each tile being rendered in its own thread.
+  // The size of an image tile rendered in the background, in pixels
+  // at its pyramid level
+  const int TILE_SIZE = 256;
+
+  // The image of this size which a tile at this level covers. The
+  // pyramid levels are factors of 2 apart.
+  double tileSpan(int level) {
+    return TILE_SIZE * pow(2.0, level);
+  }
+
+  // The range of tiles at this level intersecting a box of image pixels
+  BBox2i tileRange(int level, BBox2i const& image_box, int cols, int rows) {
+    BBox2i box = image_box;
+    box.crop(BBox2i(0, 0, cols, rows));
+    if (box.empty())
+      return BBox2i();
+    double span = tileSpan(level);
+    Vector2i beg(floor(box.min().x()/span), floor(box.min().y()/span));
+    Vector2i end(floor((box.max().x() - 1)/span) + 1, floor((box.max().y() - 1)/span) + 1);
+    return BBox2i(beg, end);
+  }
+
+  // The image pixels covered by a tile
+  BBox2i tileRegion(int level, int col, int row, int cols, int rows) {
+    double span = tileSpan(level);
+    BBox2i region(Vector2i(round(col*span), round(row*span)),
+                  Vector2i(round((col + 1)*span), round((row + 1)*span)));
+    region.crop(BBox2i(0, 0, cols, rows));
+    return region;
+  }
+
+  // The rendered tiles of an image at one level, over a range of tiles.
+  // A level of -1 is for the overview of the whole image.
+  struct TileSet {
+    int level;
+    BBox2i range;
+    std::vector<boost::shared_ptr<ImageTile const>> tiles; // row-major over the range
+
+    // The tile having this image pixel, if it was rendered
+    boost::shared_ptr<ImageTile const> find(Vector2 const& pix) const {
+      if (level < 0)
+        return tiles[0];
+      double span = tileSpan(level);
+      Vector2i tile(floor(pix.x()/span), floor(pix.y()/span));
+      if (!range.contains(tile))
+        return boost::shared_ptr<ImageTile const>();
+      return tiles[(tile.y() - range.min().y()) * range.width() + tile.x() - range.min().x()];
+    }
+  };
+
+  void MainWidget::tileLoaded() {
+    // Tiles arrive in bursts. Redraw once for all of them that arrive
+    // in a short time.
+    if (m_tile_refresh_pending)
+      return;
+    m_tile_refresh_pending = true;
+    QTimer::singleShot(50, this, SLOT(refreshAfterTileLoad()));
+  }
+
+  void MainWidget::refreshAfterTileLoad() {
+    m_tile_refresh_pending = false;
+    refreshPixmap();
+  }
+
+  // The images are split into tiles, which are rendered in the
+  // background, so that panning and zooming do not wait for the disk.
+  // Whatever is ready is drawn, with coarser tiles instead of the ones
+  // not ready yet, and the drawing is refined as more tiles arrive.
   void MainWidget::drawImage(QPainter* paint) {
 
     // Sometimes we arrive here prematurely, before the window geometry was
@@ -1093,6 +1123,10 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
     Stopwatch sw1;
     sw1.start();
 
+    // The requests from the previous drawing are no longer needed,
+    // unless made again below.
+    m_tile_loader->begin_requests();
+
     // Loop through input images
     // - These images get drawn in the same
     for (int j = m_beg_image_id; j < m_end_image_id; j++) {
@@ -1143,7 +1177,6 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
         continue; // there is no image, so no point going on
       }
 
-      QImage qimg;
       // Since the image portion contained in image_box could be huge,
       // but the screen area small, render a sub-sampled version of
       // the image for speed.
@@ -1151,58 +1184,121 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
       // when multiplying large integers.
       double scale = sqrt((1.0*image_box.width()) * image_box.height())/
         std::max(1.0, sqrt((1.0*screen_box.width()) * screen_box.height()));
-      double scale_out;
-      BBox2i region_out;
       bool   highlight_nodata = (m_images[i].m_display_mode == THRESHOLDED_VIEW);
       if (!std::isnan(asp::stereo_settings().nodata_value)) {
         // When the user specifies --nodata-value, we will show
         // nodata pixels as transparent.
         highlight_nodata = false;
       }
-      
-      //sw2.stop();
-      //vw_out() << "Render time 2 (seconds): " << sw2.elapsed_seconds() << std::endl;
 
-      //Stopwatch sw3;
-      //sw3.start();
-      
+      // Hillshading is done on the fly from the original images, so that
+      // changing the light direction only needs the visible tiles again.
+      // So is thresholding, so that a new threshold shows right away.
+      DiskImagePyramidMultiChannel const* img = &m_images[i].img; // original images
+      boost::shared_ptr<HillshadeParams const> hillshade;
+      double threshold = -std::numeric_limits<double>::max();
       if (m_images[i].m_display_mode == THRESHOLDED_VIEW) {
-        m_images[i].thresholded_img.get_image_clip(scale, image_box,
-                                                   highlight_nodata,
-                                                   qimg, scale_out, region_out);
-      }else if (m_images[i].m_display_mode == HILLSHADED_VIEW){
-        m_images[i].hillshaded_img.get_image_clip(scale, image_box,
-                                                  highlight_nodata,
-                                                  qimg, scale_out, region_out);
-      }else{
-        // Original images
-        m_images[i].img.get_image_clip(scale, image_box,
-                                       highlight_nodata,
-                                       qimg, scale_out, region_out);
+        threshold = m_thresh;
+      } else if (m_images[i].m_display_mode == HILLSHADED_VIEW) {
+        boost::shared_ptr<HillshadeParams> params(new HillshadeParams);
+        params->georef    = m_images[i].georef;
+        params->azimuth   = m_hillshade_azimuth;
+        params->elevation = m_hillshade_elevation;
+        hillshade = params;
+      }
+      int mode = m_images[i].m_display_mode;
+      int cols = img->cols(), rows = img->rows();
+
+      // The finest level to draw, and the coarsest one worth having, past
+      // which a tile would be bigger than the image.
+      int max_level = std::max(0, int(ceil(log2(std::max(cols, rows)/double(TILE_SIZE)))));
+      int level = std::max(0, int(floor(log2(std::max(scale, 1.0)))));
+      level = std::min(level, max_level);
+
+      // Request first the overview of the whole image, to have something
+      // to show, then the visible tiles, the closest to the center of the
+      // view first, then their neighbors, then the tiles for the next
+      // zoom level in and out.
+      BBox2i whole_image(0, 0, cols, rows);
+      m_tile_loader->request(TileKey(i, mode, -1, 0, 0), 0.0, *img,
+                             std::max(cols, rows), whole_image, highlight_nodata, hillshade,
+                             threshold);
+      BBox2i image_pix_box(Vector2i(image_box.min()), Vector2i(image_box.max()));
+      BBox2i visible = tileRange(level, image_pix_box, cols, rows);
+      Vector2 center = (Vector2(visible.min()) + Vector2(visible.max()))/2.0;
+      BBox2i around = visible;
+      around.expand(1);
+      around.crop(tileRange(level, whole_image, cols, rows));
+      for (int row = around.min().y(); row < around.max().y(); row++) {
+        for (int col = around.min().x(); col < around.max().x(); col++) {
+          double dist = norm_2(Vector2(col + 0.5, row + 0.5) - center)
+            / (1.0 + norm_2(Vector2(around.size())));
+          double priority = (visible.contains(Vector2i(col, row)) ? 1.0 : 2.0) + dist;
+          m_tile_loader->request(TileKey(i, mode, level, col, row), priority, *img,
+                                 tileSpan(level)/TILE_SIZE,
+                                 tileRegion(level, col, row, cols, rows), highlight_nodata,
+                                 hillshade, threshold);
+        }
+      }
+      for (int next = level - 1; next <= level + 1; next += 2) {
+        if (next < 0 || next > max_level)
+          continue;
+        BBox2i range = tileRange(next, image_pix_box, cols, rows);
+        for (int row = range.min().y(); row < range.max().y(); row++)
+          for (int col = range.min().x(); col < range.max().x(); col++)
+            m_tile_loader->request(TileKey(i, mode, next, col, row), 3.0, *img,
+                                   tileSpan(next)/TILE_SIZE,
+                                   tileRegion(next, col, row, cols, rows), highlight_nodata,
+                                   hillshade, threshold);
       }
 
-      //sw3.stop();
-      //vw_out() << "Render time 3 (seconds): " << sw3.elapsed_seconds() << std::endl;
+      // Collect the rendered tiles, from the overview to the finest
+      // level. Tiles from a few coarser levels, rendered earlier when
+      // zooming in, can fill in while finer ones are not ready.
+      std::vector<TileSet> tile_sets;
+      TileSet overview;
+      overview.level = -1;
+      overview.tiles.push_back(m_tile_loader->find(TileKey(i, mode, -1, 0, 0)));
+      if (overview.tiles[0])
+        tile_sets.push_back(overview);
+      for (int lev = std::min(level + 3, max_level); lev >= level; lev--) {
+        TileSet set;
+        set.level = lev;
+        set.range = tileRange(lev, image_pix_box, cols, rows);
+        bool found = false;
+        for (int row = set.range.min().y(); row < set.range.max().y(); row++) {
+          for (int col = set.range.min().x(); col < set.range.max().x(); col++) {
+            set.tiles.push_back(m_tile_loader->find(TileKey(i, mode, lev, col, row)));
+            found = found || bool(set.tiles.back());
+          }
+        }
+        if (found)
+          tile_sets.push_back(set);
+      }
 
       // Draw on image screen
       if (!m_use_georef){
-        //Stopwatch sw4;
-        //sw4.start();
-        // This is a regular image, no georeference, just pass it to the QT painter
-        QRect rect(screen_box.min().x(), screen_box.min().y(),
-                   screen_box.width(), screen_box.height());
-        paint->drawImage(rect, qimg);
-        //sw4.stop();
-        //vw_out() << "Render time 4 (seconds): " << sw4.elapsed_seconds() << std::endl;
+        // This is a regular image, no georeference, just pass the
+        // tiles to the QT painter, the finer ones on top.
+        for (size_t s = 0; s < tile_sets.size(); s++) {
+          for (size_t t = 0; t < tile_sets[s].tiles.size(); t++) {
+            boost::shared_ptr<ImageTile const> tile = tile_sets[s].tiles[t];
+            if (!tile)
+              continue;
+            BBox2 tile_box(Vector2(tile->region.min())*tile->scale,
+                           Vector2(tile->region.max())*tile->scale);
+            BBox2 tile_screen_box = world2screen(MainWidget::image2world(tile_box, i));
+            QRectF rect(tile_screen_box.min().x(), tile_screen_box.min().y(),
+                        tile_screen_box.width(), tile_screen_box.height());
+            paint->drawImage(rect, tile->qimg);
+          }
+        }
         
       }else{
 
         // Overlay georeferenced images
         
-        //Stopwatch sw5;
-        //sw5.start();
-        
-        // We fetched a bunch of pixels at some scale.
+        // We fetched tiles at some scale.
         // Need to place them on the screen at given projected position.
         // - To do that we will fill up this QImage object with interpolated data, then paint it.
         QImage qimg2 = QImage(screen_box.width(), screen_box.height(),
@@ -1215,12 +1311,6 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
           }
         }
 
-        //sw5.stop();
-        //vw_out() << "Render time 5 (seconds): " << sw5.elapsed_seconds() << std::endl;
-        
-        //Stopwatch sw6;
-        //sw6.start();
-    
 #pragma omp parallel for
         for (int x = screen_box.min().x(); x < screen_box.max().x(); x++){
           for (int y = screen_box.min().y(); y < screen_box.max().y(); y++){
@@ -1239,38 +1329,33 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
               continue;
             }
 
-            // Convert to scaled image pixels and snap to integer value
-            // TODO(oalexan1): This may introduce subpixel artifacts.
-            p = round(p/scale_out);
-
-            if (!region_out.contains(p)) continue; // out of range again
-
-            int px = p.x() - region_out.min().x();
-            int py = p.y() - region_out.min().y();
-            if (px < 0 || py < 0 || px >= qimg.width() || py >= qimg.height() ){
-              vw_out() << "Book-keeping failure!";
-              vw_throw(ArgumentErr() << "Book-keeping failure.\n");
+            // Use the finest rendered tile having this pixel
+            for (int s = int(tile_sets.size()) - 1; s >= 0; s--) {
+              boost::shared_ptr<ImageTile const> tile = tile_sets[s].find(p);
+              if (!tile)
+                continue;
+
+              // Convert to scaled image pixels and snap to integer value
+              // TODO(oalexan1): This may introduce subpixel artifacts.
+              Vector2 q = round(p/tile->scale);
+              if (!tile->region.contains(q)) continue; // out of range again
+
+              int px = q.x() - tile->region.min().x();
+              int py = q.y() - tile->region.min().y();
+              if (px < 0 || py < 0 || px >= tile->qimg.width() || py >= tile->qimg.height())
+                continue;
+              qimg2.setPixel(x-screen_box.min().x(), // Fill the temp QImage object
+                             y-screen_box.min().y(),
+                             tile->qimg.pixel(px, py));
+              break;
             }
-            qimg2.setPixel(x-screen_box.min().x(), // Fill the temp QImage object
-                           y-screen_box.min().y(),
-                           qimg.pixel(px, py));
           }
         } // End loop through pixels
 
-        //sw6.stop();
-        //vw_out() << "Render time 6 (seconds): " << sw6.elapsed_seconds() << std::endl;
-
-        //Stopwatch sw7;
-        //sw7.start();
-        
         // Send the temp QImage object to the painter
         QRect rect(screen_box.min().x(), screen_box.min().y(),
                    screen_box.width(), screen_box.height());
         paint->drawImage(rect, qimg2);
-
-        //sw7.stop();
-        //vw_out() << "Render time 7 (seconds): " << sw7.elapsed_seconds() << std::endl;
-        
       }
 
     } // End loop through input images
@@ -1333,10 +1418,34 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
       }
     }
 
+    // The region of the image in view, grown a little, as with a
+    // georeference it is found by sampling the view boundary. The
+    // points outside of it are skipped before the costlier conversion
+    // to screen coordinates. If this region cannot be found, all
+    // points are converted.
+    BBox2 image_box = world2image(screen2world(BBox2(0, 0, m_window_width, m_window_height)),
+                                  m_base_image_id);
+    if (!image_box.empty())
+      image_box.expand(0.1 * std::max(image_box.width(), image_box.height()) + 2.0);
+
+    // With many points, draw only one in each small cell of the
+    // screen, as more would not be told apart. The points with a
+    // highlight color are always drawn.
+    const int CELL_SIZE = 4;
+    int num_cells_x = m_window_width / CELL_SIZE + 1, num_cells_y = m_window_height / CELL_SIZE + 1;
+    std::vector<char> occupied(num_cells_x * num_cells_y, 0);
+
+    // The points to draw with each color, drawn together
+    std::vector<QColor> colors = {ipColor, ipInvalidColor, ipAddHighlightColor,
+                                  ipMoveHighlightColor};
+    std::vector<std::vector<QPoint>> points(colors.size());
+
     // Iterate over interest points
     for (size_t ip_iter = 0; ip_iter < ip_vec.size(); ip_iter++) {
       // Generate the pixel coord of the point
-      Vector2 pt    = ip_vec[ip_iter];
+      Vector2 pt = ip_vec[ip_iter];
+      if (!image_box.empty() && !image_box.contains(pt))
+        continue;
       Vector2 world = MainWidget::image2world(pt, m_base_image_id);
       Vector2 P     = world2screen(world);
 
@@ -1346,24 +1455,48 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
         continue;
       }
       
-      paint->setPen(ipColor); // The default IP color
+      int color_id = 0; // The default IP color
 
       if (asp::stereo_settings().view_matches) {
         if (!m_matchlist.isPointValid(m_beg_image_id, ip_iter))
-          paint->setPen(ipInvalidColor);
+          color_id = 1;
 
         // Highlighting the last point
         if (highlight_last && (ip_iter == m_matchlist.getNumPoints(m_beg_image_id)-1)) 
-          paint->setPen(ipAddHighlightColor);
+          color_id = 2;
         
         if (static_cast<int>(ip_iter) == m_editMatchPointVecIndex)
-          paint->setPen(ipMoveHighlightColor);
+          color_id = 3;
+      }
+
+      if (color_id < 2) {
+        int cell = int(P.y() / CELL_SIZE) * num_cells_x + int(P.x() / CELL_SIZE);
+        if (occupied[cell])
+          continue;
+        occupied[cell] = 1;
       }
       
-      QPoint Q(P.x(), P.y());
-      paint->drawEllipse(Q, 2, 2); // Draw the point
+      points[color_id].push_back(QPoint(P.x(), P.y()));
 
     } // End loop through points
+
+    // Draw each point as a small circle. If there are very many, as
+    // can be for a zoomed-out view, draw them as dots in one call.
+    const size_t MAX_NUM_CIRCLES = 20000;
+    for (size_t color_id = 0; color_id < colors.size(); color_id++) {
+      std::vector<QPoint> const& color_points = points[color_id]; // alias
+      if (color_points.size() <= MAX_NUM_CIRCLES) {
+        paint->setPen(colors[color_id]);
+        for (size_t it = 0; it < color_points.size(); it++)
+          paint->drawEllipse(color_points[it], 2, 2); // Draw the point
+      } else {
+        QPen pen(colors[color_id]);
+        pen.setWidth(4);
+        pen.setCapStyle(Qt::RoundCap);
+        paint->setPen(pen);
+        paint->drawPoints(color_points.data(), color_points.size());
+      }
+    }
   } // End function drawInterestPoints
   
   // Draw irregular xyz data to be plotted at (x, y) location with z giving
@@ -3487,6 +3620,12 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
     m_thresh = thresh;
     vw_out() << "Image threshold for " << m_images[non_poly_image].name
 	     << ": " << m_thresh << std::endl;
+
+    // Show the new threshold right away if viewing thresholded images
+    if (m_images[non_poly_image].m_display_mode == THRESHOLDED_VIEW) {
+      m_tile_loader->clear();
+      refreshPixmap();
+    }
   }
 
   // TODO(oalexan1): Each image must know its threshold
@@ -3538,6 +3677,7 @@ void MainWidget::showFilesChosenByUser(int rowClicked, int columnClicked){
     }
     m_hillshade_azimuth = a;
     m_hillshade_elevation = e;
+    m_tile_loader->clear(); // the hillshaded tiles are for the old light
 
     MainWidget::maybeGenHillshade();
     refreshPixmap();
@@ -63,6 +63,7 @@
 // ASP
 #include <asp/Core/Common.h>
 #include <asp/GUI/GuiUtilities.h>
+#include <asp/GUI/TileLoader.h>
 
 class QMouseEvent;
 class QWheelEvent;
@@ -200,6 +201,8 @@ public slots:
     void insertVertex           (); ///< Insert an intermediate vertex at right-click
     void mergePolys             (); ///< Merge existing polygons
     void saveScreenshot         (); ///< Save a screenshot of the current imagery
+    void tileLoaded             (); ///< An image tile was rendered in the background
+    void refreshAfterTileLoad   (); ///< Redraw with the tiles rendered so far
 
   protected:
 
@@ -296,6 +299,11 @@ public slots:
     // if really necessary, and display it when paintEvent is called.
     QPixmap m_pixmap;
 
+    // Render image tiles in the background. Redraw once after several
+    // tiles arrive rather than once per tile.
+    boost::shared_ptr<TileLoader> m_tile_loader;
+    bool m_tile_refresh_pending;
+
     std::string m_polyColor;
     std::map<int, std::string> m_perImagePolyColor;
     int m_lineWidth;
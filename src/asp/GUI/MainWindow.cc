@@ -275,6 +275,8 @@ MainWindow::MainWindow(vw::GdalWriteOptions const& opt,
     m_images[i].m_display_mode = m_display_mode;
     has_georef = has_georef && m_images[i].has_georef;
   }
+  shrink_pyramid_cache(asp::stereo_settings().pyramid_cache_dir,
+                       asp::stereo_settings().pyramid_cache_size_mb);
   if (has_georef)
     m_use_georef = true; // use georef if all images have it
 
@@ -0,0 +1,186 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/GUI/TileLoader.h>
+
+#include <vw/Core/Log.h>
+
+#include <QMetaObject>
+#include <QObject>
+
+#include <algorithm>
+#include <exception>
+
+namespace vw { namespace gui {
+
+  // Stop keeping tiles past this much memory. That is about 2000 tiles
+  // of 256 x 256 pixels.
+  const size_t MAX_TILE_CACHE_BYTES = size_t(512) * 1024 * 1024;
+
+  bool TileKey::operator<(TileKey const& other) const {
+    if (image != other.image) return image < other.image;
+    if (mode  != other.mode)  return mode  < other.mode;
+    if (level != other.level) return level < other.level;
+    if (col   != other.col)   return col   < other.col;
+    return row < other.row;
+  }
+
+  TileLoader::TileLoader(QObject * receiver, const char * slot, int num_threads):
+    m_receiver(receiver), m_slot(slot), m_generation(0), m_use_count(0),
+    m_num_bytes(0), m_stop(false) {
+    num_threads = std::max(num_threads, 1);
+    for (int it = 0; it < num_threads; it++)
+      m_threads.push_back(std::thread(&TileLoader::work, this));
+  }
+
+  TileLoader::~TileLoader() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+      m_requests.clear();
+    }
+    m_cond.notify_all();
+    for (size_t it = 0; it < m_threads.size(); it++)
+      m_threads[it].join();
+  }
+
+  boost::shared_ptr<ImageTile const> TileLoader::find(TileKey const& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tiles.find(key);
+    if (it == m_tiles.end())
+      return boost::shared_ptr<ImageTile const>();
+    it->second.last_use = m_use_count++;
+    return it->second.tile;
+  }
+
+  void TileLoader::begin_requests() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.clear();
+  }
+
+  void TileLoader::request(TileKey const& key, double priority,
+                           DiskImagePyramidMultiChannel const& img,
+                           double scale, vw::BBox2i const& region, bool highlight_nodata,
+                           boost::shared_ptr<HillshadeParams const> const& hillshade,
+                           double threshold) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_tiles.find(key) != m_tiles.end() ||
+          m_in_progress.find(key) != m_in_progress.end())
+        return;
+
+      auto it = m_requests.find(key);
+      if (it != m_requests.end()) {
+        it->second.priority = std::min(it->second.priority, priority);
+        return;
+      }
+
+      Request r;
+      r.priority         = priority;
+      r.img              = img;
+      r.scale            = scale;
+      r.region           = region;
+      r.highlight_nodata = highlight_nodata;
+      r.hillshade        = hillshade;
+      r.threshold        = threshold;
+      m_requests[key] = r;
+    }
+    m_cond.notify_one();
+  }
+
+  void TileLoader::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.clear();
+    m_tiles.clear();
+    m_num_bytes = 0;
+    m_generation++; // a tile being rendered now will not be kept
+  }
+
+  void TileLoader::evict() {
+    while (m_num_bytes > MAX_TILE_CACHE_BYTES && !m_tiles.empty()) {
+      auto oldest = m_tiles.begin();
+      for (auto it = m_tiles.begin(); it != m_tiles.end(); it++) {
+        if (it->second.last_use < oldest->second.last_use)
+          oldest = it;
+      }
+      m_num_bytes -= oldest->second.num_bytes;
+      m_tiles.erase(oldest);
+    }
+  }
+
+  void TileLoader::work() {
+
+    while (1) {
+
+      TileKey key;
+      Request r;
+      int generation = 0;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_stop || !m_requests.empty(); });
+        if (m_stop)
+          return;
+
+        // Take the most urgent request. There are at most a few hundred.
+        auto best = m_requests.begin();
+        for (auto it = m_requests.begin(); it != m_requests.end(); it++) {
+          if (it->second.priority < best->second.priority)
+            best = it;
+        }
+        key = best->first;
+        r   = best->second;
+        m_requests.erase(best);
+        generation = m_generation;
+        m_in_progress.insert(key);
+      }
+
+      boost::shared_ptr<ImageTile> tile(new ImageTile);
+      bool success = true;
+      try {
+        if (r.hillshade)
+          r.img.get_hillshaded_clip(r.scale, r.region, *r.hillshade,
+                                    tile->qimg, tile->scale, tile->region);
+        else
+          r.img.get_image_clip(r.scale, r.region, r.highlight_nodata,
+                               tile->qimg, tile->scale, tile->region, r.threshold);
+      } catch (std::exception const& e) {
+        vw_out() << "Could not render image tile: " << e.what() << "\n";
+        success = false;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_in_progress.erase(key);
+        if (success && generation == m_generation) {
+          CachedTile c;
+          c.tile      = tile;
+          c.last_use  = m_use_count++;
+          c.num_bytes = size_t(tile->qimg.bytesPerLine()) * tile->qimg.height();
+          m_tiles[key] = c;
+          m_num_bytes += c.num_bytes;
+          evict();
+        }
+      }
+
+      // If the tile was not kept, this still makes the widget request
+      // it again for the current images.
+      if (success)
+        QMetaObject::invokeMethod(m_receiver, m_slot, Qt::QueuedConnection);
+    }
+  }
+
+}} // namespace vw::gui
@@ -0,0 +1,129 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileLoader.h
+///
+/// Render image tiles in background threads, so that the GUI does
+/// not wait for the disk while panning and zooming.
+///
+#ifndef __STEREO_GUI_TILE_LOADER_H__
+#define __STEREO_GUI_TILE_LOADER_H__
+
+#include <asp/GUI/DiskImagePyramidMultiChannel.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <QImage>
+
+class QObject;
+
+namespace vw { namespace gui {
+
+  /// A tile of an image as fetched from its pyramid
+  struct ImageTile {
+    QImage     qimg;
+    double     scale;  // the scale of the pyramid level used
+    vw::BBox2i region; // the tile pixels, at that scale
+  };
+
+  /// Identifies a tile. A level of -1 is for the whole image at the
+  /// coarsest pyramid level.
+  struct TileKey {
+    int image, mode, level, col, row;
+    TileKey(int image_in = 0, int mode_in = 0, int level_in = 0, int col_in = 0, int row_in = 0):
+      image(image_in), mode(mode_in), level(level_in), col(col_in), row(row_in) {}
+    bool operator<(TileKey const& other) const;
+  };
+
+  /// A pool of threads rendering the requested tiles, the ones with the
+  /// lowest priority value first, and a cache of the rendered tiles.
+  /// When a tile is ready, the given slot of the receiver is invoked
+  /// in the thread of the receiver.
+  class TileLoader {
+  public:
+    TileLoader(QObject * receiver, const char * slot, int num_threads);
+    ~TileLoader();
+
+    /// The tile, if it was rendered, or an empty pointer.
+    boost::shared_ptr<ImageTile const> find(TileKey const& key);
+
+    /// Forget the pending requests. Those still needed are expected to
+    /// be made again right after, with the current priorities.
+    void begin_requests();
+
+    /// Request to render the region, at the given scale, of an
+    /// image. Nothing is done if the tile was rendered or is being
+    /// rendered. The image is copied, which only copies handles to its
+    /// data on disk. If hillshade parameters are given, the tile is
+    /// hillshaded. Otherwise pixels at or below the threshold are
+    /// shown as nodata.
+    void request(TileKey const& key, double priority,
+                 DiskImagePyramidMultiChannel const& img,
+                 double scale, vw::BBox2i const& region, bool highlight_nodata,
+                 boost::shared_ptr<HillshadeParams const> const& hillshade
+                 = boost::shared_ptr<HillshadeParams const>(),
+                 double threshold = -std::numeric_limits<double>::max());
+
+    /// Forget all tiles and requests, such as when the images changed.
+    void clear();
+
+  private:
+    struct Request {
+      double priority;
+      DiskImagePyramidMultiChannel img;
+      double scale;
+      vw::BBox2i region;
+      bool highlight_nodata;
+      boost::shared_ptr<HillshadeParams const> hillshade;
+      double threshold;
+    };
+
+    struct CachedTile {
+      boost::shared_ptr<ImageTile const> tile;
+      long long last_use;
+      size_t num_bytes;
+    };
+
+    void work();
+    void evict(); // must hold the lock
+
+    QObject                        * m_receiver;
+    const char                     * m_slot;
+    std::mutex                       m_mutex;
+    std::condition_variable          m_cond; // a request was made, or stop
+    std::map<TileKey, Request>       m_requests;
+    std::map<TileKey, CachedTile>    m_tiles;
+    std::set<TileKey>                m_in_progress;
+    int                              m_generation;  // incremented on clear()
+    long long                        m_use_count;
+    size_t                           m_num_bytes;
+    bool                             m_stop;
+    std::vector<std::thread>         m_threads;
+  };
+
+}} // namespace vw::gui
+
+#endif  // __STEREO_GUI_TILE_LOADER_H__
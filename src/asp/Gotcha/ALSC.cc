@@ -52,15 +52,20 @@ ALSC::ALSC(Mat imgL, Mat imgR, CALSCParam paramALSC){
     nSystemMatrixRows = nRowPatch*nColPatch; //4 * nRadius * nRadius + 1 + 4 * nRadius;
     emA = Eigen::MatrixXf(nSystemMatrixRows,nParam);
     emB = Eigen::VectorXf(nSystemMatrixRows);
+    emErrors = Eigen::VectorXf(nSystemMatrixRows);
+    if (nParam == 7)
+        emA.col(6).setOnes(); // the intensity offset
 
-    pfGx.resize(nRowPatch);
-    for (int i = 0; i < nRowPatch; i++) {
-        pfGx[i].resize(nColPatch);
-    }
+    matGx = Eigen::MatrixXf::Zero(nRowPatch, nColPatch);
+    matGy = Eigen::MatrixXf::Zero(nRowPatch, nColPatch);
 
-    pfGy.resize(nRowPatch);
-    for (int i = 0; i < nRowPatch; i++) {
-        pfGy[i].resize(nColPatch);
+    vecXOffset = Eigen::VectorXf(nSystemMatrixRows);
+    vecYOffset = Eigen::VectorXf(nSystemMatrixRows);
+    for (int x = 0; x < nColPatch; x++) {
+        for (int y = 0; y < nRowPatch; y++) {
+            vecXOffset(x * nRowPatch + y) = x - nPatchRadius;
+            vecYOffset(x * nRowPatch + y) = y - nPatchRadius;
+        }
     }
 
 }
@@ -144,50 +149,31 @@ bool ALSC::doMatching(Point2f ptStartL, Point2f ptStartR, CTiePt& tp, const floa
         getGradientX(matPatchR);
         getGradientY(matPatchR);
 
-        // make a system matrix A for LMS
-        int count = 0;
-        for (int y = 0; y < nRowPatch; y++) {
-
-            int yOffset = y - nPatchRadius;
+        // make a system matrix A for LMS, a column at a time
+        Eigen::Map<const Eigen::VectorXf> vecGx(matGx.data(), nSystemMatrixRows);
+        Eigen::Map<const Eigen::VectorXf> vecGy(matGy.data(), nSystemMatrixRows);
+        emA.col(0) = vecGx;
+        emA.col(1) = vecGx.cwiseProduct(vecXOffset);
+        emA.col(2) = vecGx.cwiseProduct(vecYOffset);
+        emA.col(3) = vecGy;
+        emA.col(4) = vecGy.cwiseProduct(vecXOffset);
+        emA.col(5) = vecGy.cwiseProduct(vecYOffset);
 
-            for (int x = 0; x < nColPatch; x++) {
-
-                int xOffset = x - nPatchRadius;
-
-                float fVal = pfGx[y][x];
-                emA(count,0) = fVal;
-                emA(count,1) = fVal * xOffset;
-                emA(count,2) = fVal * yOffset;
-
-                fVal = pfGy[y][x];
-                emA(count,3) = fVal;
-                emA(count,4) = fVal * xOffset;
-                emA(count,5) = fVal * yOffset;
-
-                if (nParam == 7) {
-                    emA(count,6)  = 1;
-                }
-
-                emB(count) = matPatchL(y, x) - matPatchR(y, x);
-                count++;
-            }
-        }
+        emB = Eigen::Map<const Eigen::VectorXf>(matPatchL.data(), nSystemMatrixRows)
+            - Eigen::Map<const Eigen::VectorXf>(matPatchR.data(), nSystemMatrixRows);
 
         // get LMS solution
-        Eigen::VectorXf emS(nParam);
-        Eigen::MatrixXf emAS(nParam,nParam);
-
         /* Don't explicitly calculate the inverse!  Use Cholesky decomposition instead. */
-        Eigen::MatrixXf emAT = emA.transpose();
-        emAS = (emAT*emA);
-        emS = emAS.llt().solve(emAT*emB);
+        emAS.noalias()  = emA.transpose() * emA;
+        emATB.noalias() = emA.transpose() * emB;
+        emS = emAS.llt().solve(emATB);
 
         if (m_paramALSC.m_bIntOffset)
             fIntOffNew = emS(6);
 
         // error computation
-        Eigen::VectorXf emErrors(nSystemMatrixRows);
-        emErrors = (emA * emS) - emB;
+        emErrors.noalias() = emA * emS;
+        emErrors -= emB;
 
         // Compute the standard deviation of residual errors
         double dTotElelement = nSystemMatrixRows; //nRowPatch *nColPatch; //2 * nRadius + 1; //dTotElelement *= dTotElelement;
@@ -307,11 +293,9 @@ void ALSC::getGradientX(Eigen::Ref<Eigen::MatrixXf> matSrc) {
     int nW = matSrc.cols();
     int nH = matSrc.rows();
 
-    for (int y = 1; y < nH - 1; y++) {
-        for (int x = 1; x < nW - 1; x++) {
-            pfGx.at(y).at(x) = matSrc(y, x+1) - matSrc(y, x);
-        }
-    }
+    if (nW > 2 && nH > 2)
+        matGx.block(1, 1, nH - 2, nW - 2) = matSrc.block(1, 2, nH - 2, nW - 2)
+                                          - matSrc.block(1, 1, nH - 2, nW - 2);
 
     return;
 }
@@ -321,11 +305,9 @@ void ALSC::getGradientY(Eigen::Ref<Eigen::MatrixXf> matSrc) {
     int nW = matSrc.cols();
     int nH = matSrc.rows();
 
-    for (int y = 1; y < nH - 1; y++) {
-        for (int x = 1; x < nW - 1; x++) {
-            pfGy.at(y).at(x) = matSrc(y+1, x) - matSrc(y, x);
-        }
-    }
+    if (nW > 2 && nH > 2)
+        matGy.block(1, 1, nH - 2, nW - 2) = matSrc.block(2, 1, nH - 2, nW - 2)
+                                          - matSrc.block(1, 1, nH - 2, nW - 2);
 
     return;
 }
@@ -342,7 +324,61 @@ void ALSC::affineTransform(double x, double y, const Point2f ptCentre, const flo
     return;
 }
 
-void ALSC::distortPatch(const Mat& matImg, const Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, Point2f* pptUpdated) {
+template <class PixelT>
+float ALSC::interpolate(double dNewX, double dNewY, const Mat &matImg){
+    int x1, x2, y2, y1;
+    float val1, val2, val3, val4;
+    float fPixelVal = 0.0;
+    double x,y;
+
+    val1 = val2 = val3 = val4 = 0.0;
+
+    x1 = (int) floor(dNewX);
+    x2 = (int) ceil(dNewX);
+    y2 = (int) ceil(dNewY);
+    y1 = (int) floor(dNewY);
+
+    if(x1 < 0 || y1 < 0 || x2 >= matImg.cols || y2 >= matImg.rows)
+        return 0.0;
+
+    // Where a coordinate is not an integer, its floor and ceiling differ by 1
+    if (x1 == x2 && y1 == y2){ // when dNewX and dNewY are both integer -> happy case no interpolation is required
+        fPixelVal = matImg.at<PixelT>(y1, x1);
+    }
+    else if (x1 == x2 && y1 != y2){ // dNewX is integer but dNewY is not. 1D interpolation is required (not bidirectional interpolation)
+        val1 = matImg.at<PixelT>(y1, x1);
+        val2 = matImg.at<PixelT>(y2, x1);
+
+        fPixelVal = (val2 - val1) * (dNewY - y1) + val1;
+    }
+    else if (x1 != x2 && y1 == y2){
+        val1 = matImg.at<PixelT>(y1, x1);
+        val2 = matImg.at<PixelT>(y1, x2);
+
+        fPixelVal = (val2 - val1) * (dNewX - x1) + val1;
+    }
+    else{ // bidirectional interpolation
+        x = dNewX;
+        y = dNewY;
+
+        const PixelT* pRow1 = matImg.ptr<PixelT>(y1);
+        const PixelT* pRow2 = matImg.ptr<PixelT>(y2);
+        val1 = pRow1[x1];
+        val2 = pRow1[x2];
+        val3 = pRow2[x1];
+        val4 = pRow2[x2];
+
+        fPixelVal = (val1 * (x2 - x) * (y2 - y)
+                     + val2 * (x - x1) * (y2 - y)
+                     + val3 * (x2 - x) * (y - y1)
+                     + val4 * (x - x1) * (y - y1));
+    }
+
+    return fPixelVal;
+}
+
+template <class PixelT>
+void ALSC::distortPatchT(const Mat& matImg, const Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, Point2f* pptUpdated) {
 
     double dNewX = 0, dNewY = 0;
 
@@ -363,14 +399,17 @@ void ALSC::distortPatch(const Mat& matImg, const Point2f ptCentre, const float*
     /* Case when we're just cropping an image, don't waste time doing interpolation */
     if(pfAff[0] == 0 && pfAff[1] == 0 && pfAff[2] == 0 && pfAff[3] == 0){
         for (j = 0; j < nH; j++) {
+                dNewY = ptCentre.y + initY + j;
+                const PixelT* pRow = NULL;
+                if (dNewY >= 0 && dNewY < matImg.rows)
+                    pRow = matImg.ptr<PixelT>((int)dNewY);
                 for (i = 0; i < nW; i++) {
                     dNewX = ptCentre.x + initX + i;
-                    dNewY = ptCentre.y + initY + j;
 
-                    if(dNewX < 0 || dNewY < 0 || dNewX > matImg.cols || dNewY > matImg.rows)
+                    if(pRow == NULL || dNewX < 0 || dNewX >= matImg.cols)
                         matImgPatch(j,i) = 0.0;
                     else{
-                        matImgPatch(j,i) = matImg.at<unsigned char>(dNewY, dNewX);
+                        matImgPatch(j,i) = pRow[(int)dNewX];
                     }
                 }
         }
@@ -389,7 +428,7 @@ void ALSC::distortPatch(const Mat& matImg, const Point2f ptCentre, const float*
                     affineTransform(initX+i, initY+j, ptCentre, pfAff, &dNewX, &dNewY);
 
                     /* Interpolate from the image */
-                    matImgPatch(j,i) = interpolate(dNewX, dNewY, matImg);
+                    matImgPatch(j,i) = interpolate<PixelT>(dNewX, dNewY, matImg);
 
                     /* Check if we're at one of the patch corners and store into the boundary array if needed */
                     if(i == 0){
@@ -409,151 +448,20 @@ void ALSC::distortPatch(const Mat& matImg, const Point2f ptCentre, const float*
     return;
 }
 
-float ALSC::interpolate(double dNewX, double dNewY, const Mat &matImg){
-    int x1, x2, y2, y1;
-    float val1, val2, val3, val4;
-    float fPixelVal = 0.0;
-    double x,y;
-
-    val1 = val2 = val3 = val4 = 0.0;
-
-    x1 = (int) floor(dNewX);
-    x2 = (int) ceil(dNewX);
-    y2 = (int) ceil(dNewY);
-    y1 = (int) floor(dNewY);
-
-    if(x1 < 0 || y1 < 0 || x2 >= matImg.cols || y2 >= matImg.rows)
-        return 0.0;
-
-    if (x1 == x2 && y1 == y2){ // when dNewX and dNewY are both integer -> happy case no interpolation is required
-        fPixelVal = matImg.at<unsigned char>(y1, x1);
-    }
-    else if (x1 == x2 && y1 != y2){ // dNewX is integer but dNewY is not. 1D interpolation is required (not bidirectional interpolation)
-        val1 = matImg.at<unsigned char>(y1, x1);
-        val2 = matImg.at<unsigned char>(y2, x1);
-
-        fPixelVal = (val2 - val1) * (dNewY - y1) + val1;
-    }
-    else if (x1 != x2 && y1 == y2){
-        val1 = matImg.at<unsigned char>(y1, x1);
-        val2 = matImg.at<unsigned char>(y1, x2);
-
-        fPixelVal = (val2 - val1) * (dNewX - x1) + val1;
-    }
-    else{ // bidirectional interpolation
-            x = dNewX;
-            y = dNewY;
-
-            val1 = matImg.at<unsigned char>(y1, x1);
-            val2 = matImg.at<unsigned char>(y1, x2);
-            val3 = matImg.at<unsigned char>(y2, x1);
-            val4 = matImg.at<unsigned char>(y2, x2);
-
-            fPixelVal = (val1 * (x2 - x) * (y2 - y)
-                         + val2 * (x - x1) * (y2 - y)
-                         + val3 * (x2 - x) * (y - y1)
-                         + val4 * (x - x1) * (y - y1));
-    }
-
-    return fPixelVal;
-}
-
-float ALSCU16::interpolate(double dNewX, double dNewY, const Mat &matImg){
-    int x1, x2, y2, y1;
-    float val1, val2, val3, val4;
-    float fPixelVal = 0.0;
-    double x,y;
-
-    val1 = val2 = val3 = val4 = 0.0;
-
-    x1 = (int) floor(dNewX);
-    x2 = (int) ceil(dNewX);
-    y2 = (int) ceil(dNewY);
-    y1 = (int) floor(dNewY);
-
-    if(x1 < 0 || y1 < 0 || x2 >= matImg.cols || y2 >= matImg.rows)
-        return 0.0;
-
-    if (x1 == x2 && y1 == y2){ // when dNewX and dNewY are both integer -> happy case no interpolation is required
-        fPixelVal = matImg.at<unsigned short>(y1, x1);
-    }
-    else if (x1 == x2 && y1 != y2){ // dNewX is integer but dNewY is not. 1D interpolation is required (not bidirectional interpolation)
-        val1 = matImg.at<unsigned short>(y1, x1);
-        val2 = matImg.at<unsigned short>(y2, x1);
-
-        fPixelVal = (val2 - val1) * (dNewY - y1) / (y2 - y1) + val1;
-    }
-    else if (x1 != x2 && y1 == y2){
-        val1 = matImg.at<unsigned short>(y1, x1);
-        val2 = matImg.at<unsigned short>(y1, x2);
-
-        fPixelVal = (val2 - val1) * (dNewX - x1) / (x2 - x1) + val1;
-    }
-    else{ // bidirectional interpolation
-        x = dNewX;
-        y = dNewY;
-
-        val1 = matImg.at<unsigned short>(y1, x1);
-        val2 = matImg.at<unsigned short>(y1, x2);
-        val3 = matImg.at<unsigned short>(y2, x1);
-        val4 = matImg.at<unsigned short>(y2, x2);
-
-        fPixelVal = (val1 * (x2 - x) * (y2 - y) / (x2 - x1) / (y2 - y1)
-                     + val2 * (x - x1) * (y2 - y) / (x2 - x1) / (y2 - y1)
-                     + val3 * (x2 - x) * (y - y1) / (x2 - x1) / (y2 - y1)
-                     + val4 * (x - x1) * (y - y1) / (x2 - x1) / (y2 - y1));
-    }
-
-    return fPixelVal;
-}
-
-float ALSCF32::interpolate(double dNewX, double dNewY, const Mat &matImg){
-    int x1, x2, y2, y1;
-    float val1, val2, val3, val4;
-    float fPixelVal = 0.0;
-    double x,y;
-
-    val1 = val2 = val3 = val4 = 0.0;
-
-    x1 = (int) floor(dNewX);
-    x2 = (int) ceil(dNewX);
-    y2 = (int) ceil(dNewY);
-    y1 = (int) floor(dNewY);
-
-    if(x1 < 0 || y1 < 0 || x2 >= matImg.cols || y2 >= matImg.rows)
-        return 0.0;
-
-    if (x1 == x2 && y1 == y2){ // when dNewX and dNewY are both integer -> happy case no interpolation is required
-        fPixelVal = matImg.at<float>(y1, x1);
-    }
-    else if (x1 == x2 && y1 != y2){ // dNewX is integer but dNewY is not. 1D interpolation is required (not bidirectional interpolation)
-        val1 = matImg.at<float>(y1, x1);
-        val2 = matImg.at<float>(y2, x1);
-
-        fPixelVal = (val2 - val1) * (dNewY - y1) / (y2 - y1) + val1;
-    }
-    else if (x1 != x2 && y1 == y2){
-        val1 = matImg.at<float>(y1, x1);
-        val2 = matImg.at<float>(y1, x2);
-
-        fPixelVal = (val2 - val1) * (dNewX - x1) / (x2 - x1) + val1;
-    }
-    else{ // bidirectional interpolation
-        x = dNewX;
-        y = dNewY;
-
-        val1 = matImg.at<float>(y1, x1);
-        val2 = matImg.at<float>(y1, x2);
-        val3 = matImg.at<float>(y2, x1);
-        val4 = matImg.at<float>(y2, x2);
-
-        fPixelVal = (val1 * (x2 - x) * (y2 - y) / (x2 - x1) / (y2 - y1)
-                     + val2 * (x - x1) * (y2 - y) / (x2 - x1) / (y2 - y1)
-                     + val3 * (x2 - x) * (y - y1) / (x2 - x1) / (y2 - y1)
-                     + val4 * (x - x1) * (y - y1) / (x2 - x1) / (y2 - y1));
+void ALSC::distortPatch(const Mat& matImg, const Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, Point2f* pptUpdated) {
+    switch (matImg.depth()) {
+    case CV_8U:
+        distortPatchT<unsigned char>(matImg, ptCentre, pfAff, matImgPatch, pptUpdated);
+        break;
+    case CV_16U:
+        distortPatchT<unsigned short>(matImg, ptCentre, pfAff, matImgPatch, pptUpdated);
+        break;
+    case CV_32F:
+        distortPatchT<float>(matImg, ptCentre, pfAff, matImgPatch, pptUpdated);
+        break;
+    default:
+        CV_Error(cv::Error::StsUnsupportedFormat, "ALSC supports only 8-bit, 16-bit, and float images.");
     }
-
-    return fPixelVal;
 }
 
 // this function for the feature refinement
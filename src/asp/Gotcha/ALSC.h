@@ -48,12 +48,21 @@ public:
     enum{NO_ERR, OB_ERR};
 
 private:
+    // The normal equations have at most 7 parameters, so they need no
+    // heap allocation
+    typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, 0, 7, 7> NormalMatrix;
+    typedef Eigen::Matrix<float, Eigen::Dynamic, 1, 0, 7, 1> ParamVector;
+
     bool isIntersecting(cv::Rect rectA, cv::Rect rectB);
     void getGradientX(Eigen::Ref<Eigen::MatrixXf> matSrc);
     void getGradientY(Eigen::Ref<Eigen::MatrixXf> matSrc);
+    // Dispatches on the pixel type of the image to distortPatchT()
     void distortPatch(const cv::Mat& matImg, const cv::Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, cv::Point2f* pptUpdated = NULL);
+    template <class PixelT>
+    void distortPatchT(const cv::Mat& matImg, const cv::Point2f ptCentre, const float* pfAff, Eigen::Ref<Eigen::MatrixXf> matImgPatch, cv::Point2f* pptUpdated);
     bool doMatching(cv::Point2f ptStartL, cv::Point2f ptStartR, CTiePt& tp, const float* pfAffInt = NULL);
     void affineTransform(double x, double y, const cv::Point2f ptCentre, const float *pfAff, double *dNewX, double *dNewY);
+    template <class PixelT>
     float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
 
 private:
@@ -74,8 +83,12 @@ private:
     int nColPatch;
     int nSystemMatrixRows;
 
-    std::vector<std::vector<float> > pfGx;
-    std::vector<std::vector<float> > pfGy;
+    // The buffers below are allocated once, in the constructor. The
+    // rows of the system matrix are for the patch pixels in column-major order.
+    Eigen::MatrixXf matGx; // the gradients of the right patch, zero at the patch border
+    Eigen::MatrixXf matGy;
+    Eigen::VectorXf vecXOffset; // the pixel offsets from the patch center
+    Eigen::VectorXf vecYOffset;
 
     Eigen::MatrixXf matPatchL;
     Eigen::MatrixXf matPatchR;
@@ -84,6 +97,10 @@ private:
 
     Eigen::MatrixXf emA;
     Eigen::VectorXf emB;
+    Eigen::VectorXf emErrors;
+    NormalMatrix emAS;
+    ParamVector emATB;
+    ParamVector emS;
 
     int nParam;
 
@@ -92,16 +109,6 @@ private:
     std::vector<int> m_vecPassList; // index list which passes ALSC test
 };
 
-class ALSCU16 : public ALSC
-{
-    float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
-};
-
-class ALSCF32 : public ALSC
-{
-    float interpolate(double dNewX, double dNewY, const cv::Mat &matImg);
-};
-
 } // end namespace gotcha
 
 #endif // ASP_GOTCHA_ALSC_H
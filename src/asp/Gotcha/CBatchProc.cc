@@ -19,6 +19,8 @@
 #include <asp/Gotcha/CDensifyParam.h>
 #include <asp/Gotcha/CDensify.h>
 
+#include <vw/Core/Settings.h>
+
 #include <boost/filesystem.hpp>
 
 namespace fs = boost::filesystem;
@@ -28,27 +30,13 @@ using namespace std;
 
 namespace gotcha {
   
-// Convert a float image from ASP format to an OpenCV float image
-// and vice-versa. Note that ASP stores an image as col, row.
-  
-void aspMatToCvMat(vw::ImageView<float> const& in, cv::Mat & out) {
-  out = cv::Mat::zeros(in.rows(), in.cols(), CV_32F);
-  for (int row = 0; row < out.rows; row++) {
-    for (int col = 0; col < out.cols; col++) {
-      out.at<float>(row, col) = in(col, row);
-    }
-  }
+// Wrap an ASP float image as an OpenCV float image sharing its
+// data. Both store the pixels row after row. Note that ASP indexes an
+// image as col, row.
+cv::Mat aspMatAsCvMat(vw::ImageView<float> const& in) {
+  return cv::Mat(in.rows(), in.cols(), CV_32F, const_cast<float*>(in.data()));
 }
 
-void cvMatToAspMat(cv::Mat const& in, vw::ImageView<float> & out) {
-  out.set_size(in.cols, in.rows); 
-  for (int row = 0; row < in.rows; row++) {
-    for (int col = 0; col < in.cols; col++) {
-      out(col, row) = in.at<float>(row, col);
-    }
-  }
-}
-  
 CBatchProc::CBatchProc(std::string          const & strMetaFile,
                        vw::ImageView<float> const & imgL,
                        vw::ImageView<float> const & imgR, 
@@ -72,11 +60,16 @@ CBatchProc::CBatchProc(std::string          const & strMetaFile,
   m_strOutPath = strOutputPrefix;
 #endif
   
-  // Convert the inputs to cv::Mat, which is what Gotcha prefers
-  aspMatToCvMat(imgL, m_imgL);
-  aspMatToCvMat(imgR, m_imgR);
-  aspMatToCvMat(input_dispX, m_input_dispX);
-  aspMatToCvMat(input_dispY, m_input_dispY);
+  // Keep the inputs, and wrap them as cv::Mat, which is what Gotcha
+  // prefers, without copying them
+  m_aspImgL   = imgL;
+  m_aspImgR   = imgR;
+  m_aspDispX  = input_dispX;
+  m_aspDispY  = input_dispY;
+  m_imgL        = aspMatAsCvMat(m_aspImgL);
+  m_imgR        = aspMatAsCvMat(m_aspImgR);
+  m_input_dispX = aspMatAsCvMat(m_aspDispX);
+  m_input_dispY = aspMatAsCvMat(m_aspDispY);
   
   if (!validateProjParam()){
     std::cerr << "ERROR: The project input files cannot be validated" << std::endl;
@@ -126,24 +119,16 @@ bool CBatchProc::validateProjInputs() {
 
   //m_input_dispX = imread(m_strDispX, CV_LOAD_IMAGE_ANYDEPTH);
   //m_input_dispY = imread(m_strDispY, CV_LOAD_IMAGE_ANYDEPTH);
-  if ((m_input_dispX.depth()!=2 && m_input_dispX.depth()!=5)|| (m_input_dispY.depth()!=2 && m_input_dispY.depth()!=5)){
+  if (m_input_dispX.depth()!=CV_32F || m_input_dispY.depth()!=CV_32F){
     bRes = false;
-    std::cerr << "Gotcha on given disparity map. ERROR: Input x/y disparity map not in 16bit unsigned integer or 32bit floating point" << std::endl;
+    std::cerr << "Gotcha on given disparity map. ERROR: Input x/y disparity map not in 32bit floating point" << std::endl;
   }
   if (m_input_dispX.channels()!=1 || m_input_dispY.channels()!=1){
     bRes = false;
     std::cerr << "Gotcha on given disparity map. ERROR: Please take single channel image as input x/y disparity map" << std::endl;
   }
 
-  //std::cout << "Generating bad pixel/gap mask file." << std::endl;
-  generateMask();
-
-  //std::cout << "Reading mask: " << m_strMask << std::endl;
-  //Mat Mask = imread(m_strMask, CV_LOAD_IMAGE_ANYDEPTH);
-  if (m_Mask.depth()!=0 || m_Mask.channels()!=1){
-    bRes = false;
-    std::cerr << "ERROR: Input mask file not in 8 bit single channel unsigned int format" << std::endl;
-  }
+  // The gap mask is made with the tie points
   return bRes;
 }
 
@@ -154,320 +139,114 @@ void CBatchProc::doBatchProcessing(vw::ImageView<float> & output_dispX,
   //     << "================================" << std::endl << std::endl;
 
   std::vector<CTiePt> vecTPs;
-  generateTPFile(vecTPs);
-  refinement(vecTPs, output_dispX, output_dispY);
+  generateMaskAndTPs(vecTPs);
+
+  // The refined disparities are written directly to the outputs
+  output_dispX.set_size(m_imgL.cols, m_imgL.rows);
+  output_dispY.set_size(m_imgL.cols, m_imgL.rows);
+  cv::Mat cv_output_dispX = aspMatAsCvMat(output_dispX);
+  cv::Mat cv_output_dispY = aspMatAsCvMat(output_dispY);
+  refinement(vecTPs, cv_output_dispX, cv_output_dispY);
 
   //std::cout << "Process completed" << std::endl;
   //std::cout << std::endl;
   //std::cout << "================================" << std::endl << std::endl;
 }
 
-void CBatchProc::generateMask() {
-  // These are kept in memory now, no need to read them from disk
-#if 0
-  string strMask = "-GM.tif";
-  m_strMask = m_strOutPath + strMask;
-  m_input_dispX = imread(m_strDispX, CV_LOAD_IMAGE_ANYDEPTH);
-  m_input_dispY = imread(m_strDispY, CV_LOAD_IMAGE_ANYDEPTH);
-#endif
-  
-  m_Mask = Mat::zeros(m_input_dispX.size(), CV_8UC1);
-
-  if (m_input_dispX.depth()==2 && m_input_dispY.depth()==2){
-    for (int i=0; i<m_Mask.rows; i++){
-      for (int j=0; j<m_Mask.cols; j++){
-        if (m_input_dispX.at<ushort>(i,j)==65535 || m_input_dispY.at<ushort>(i,j)==65535)
-          m_Mask.at<uchar>(i,j)=1;
-      }
-    }
-
-    //std::cout << "Writing mask: " << m_strMask << std::endl;
-    //imwrite(m_strMask, Mask);
-  }
-
-  else if (m_input_dispX.depth()==5 && m_input_dispY.depth()==5){
-    int numBadpixel = 0;
-    for (int i=0; i<m_Mask.rows; i++){
-      for (int j=0; j<m_Mask.cols; j++){
-        if (m_input_dispX.at<float>(i,j)==0.0) { //Nodata value of ASP disparity is 0.
-          m_Mask.at<uchar>(i,j)=1;
-          numBadpixel+=1;
-        }
-      }
-    }
-    //std::cout << "GAP Pixels masked: " << numBadpixel << std::endl;
-    //std::cout << "Writing mask: " << m_strMask << std::endl;
-    //imwrite(m_strMask, Mask);
-  }
-
-}
-
-void CBatchProc::generateTPFile(std::vector<CTiePt> & vecTPs) {
+void CBatchProc::generateMaskAndTPs(std::vector<CTiePt> & vecTPs) {
 
   // Wipe the output
   vecTPs.clear();
 
-  cv::Mat dispX, dispY;
-
-  m_input_dispX.copyTo(dispX);
-  m_input_dispY.copyTo(dispY);
-
-  // Turn this logic off, as the data is kept in memory
-#if 0
-  dispX = imread(m_strDispX, CV_LOAD_IMAGE_ANYDEPTH);
-  dispY = imread(m_strDispY, CV_LOAD_IMAGE_ANYDEPTH);
-  std::cout << "Reading mask: " << m_strMask << std::endl;
-  Mat Mask = imread(m_strMask, CV_LOAD_IMAGE_ANYDEPTH);
-  Mask.convertTo(Mask, CV_8UC1);
-#endif
-  
-  //string strTPFile = "-TP.txt";
-  //m_strTPFile = m_strOutPath + strTPFile;
-
-  if (dispX.depth()==2 && dispY.depth()==2){
-    dispX.convertTo(dispX, CV_16UC1);
-    dispY.convertTo(dispY, CV_16UC1);
-    for (int i=0; i<dispX.rows; i++){
-      for (int j=0; j<dispX.cols; j++){
-        if (m_Mask.at<uchar>(i,j)==1){
-          dispX.at<ushort>(i,j)=65535;
-          dispY.at<ushort>(i,j)=65535;
-        }
-      }
-    }
-  }
-
-  else if (dispX.depth()==5 && dispY.depth()==5){
-    dispX.convertTo(dispX, CV_32FC1);
-    dispY.convertTo(dispY, CV_32FC1);
-    for (int i=0; i<dispX.rows; i++){
-      for (int j=0; j<dispX.cols; j++){
-        if (m_Mask.at<uchar>(i,j)==1){
-          dispX.at<float>(i,j)= 0.0;
-          dispY.at<float>(i,j)= 0.0;
-        }
-      }
+  // The pixels with no disparity are in the gap mask. Only the valid
+  // pixels having an invalid neighbour, or on the tile border, and
+  // the valid pixels next to those, become tie points, to speed up
+  // the process. The disparities are now kept in memory, as are the
+  // mask and the tie points, and the sweeps below share one byte
+  // buffer rather than copies of the disparities.
+  // Nodata should be -3.40282346639e+038, but ASP disparity map uses 0 as nodata.
+  int nRows = m_input_dispX.rows, nCols = m_input_dispX.cols;
+  m_Mask = Mat::zeros(nRows, nCols, CV_8UC1);
+  for (int i=0; i<nRows; i++){
+    const float* pX = m_input_dispX.ptr<float>(i);
+    uchar* pMask = m_Mask.ptr<uchar>(i);
+    for (int j=0; j<nCols; j++){
+      if (pX[j] == 0.0)
+        pMask[j] = 1;
     }
   }
 
-
-  if (dispX.depth()==2 && dispY.depth()==2){
-    Mat dispX_tmp(dispX.size(),CV_16UC1);
-    Mat dispY_tmp(dispY.size(),CV_16UC1);
-    dispX.copyTo(dispX_tmp);
-    dispY.copyTo(dispY_tmp);
-    for (int i=1; i<dispX.rows-1; i++){
-      for (int j=1; j<dispX.cols-1; j++){
-        if (dispX.at<ushort>(i-1,j-1)!=65535 && dispX.at<ushort>(i-1,j)!=65535 && dispX.at<ushort>(i-1,j+1)!=65535 && dispX.at<ushort>(i,j-1)!=65535 &&
-            dispX.at<ushort>(i,j+1)!=65535 && dispX.at<ushort>(i+1,j-1)!=65535 && dispX.at<ushort>(i+1,j)!=65535 && dispX.at<ushort>(i+1,j+1)!=65535 &&
-            dispY.at<ushort>(i-1,j-1)!=65535 && dispY.at<ushort>(i-1,j)!=65535 && dispY.at<ushort>(i-1,j+1)!=65535 && dispY.at<ushort>(i,j-1)!=65535 &&
-            dispY.at<ushort>(i,j+1)!=65535 && dispY.at<ushort>(i+1,j-1)!=65535 && dispY.at<ushort>(i+1,j)!=65535 && dispY.at<ushort>(i+1,j+1)!=65535){
-          dispX_tmp.at<ushort>(i,j)=65535;
-          dispY_tmp.at<ushort>(i,j)=65535;
-        }
-      }
-    }
-    dispX_tmp.copyTo(dispX);
-    dispY_tmp.copyTo(dispY);
+  // Valid pixels, with the gap applied to the y disparity too
+  Mat matValid = Mat::zeros(nRows, nCols, CV_8UC1);
+  for (int i=0; i<nRows; i++){
+    const float* pY = m_input_dispY.ptr<float>(i);
+    const uchar* pMask = m_Mask.ptr<uchar>(i);
+    uchar* pValid = matValid.ptr<uchar>(i);
+    for (int j=0; j<nCols; j++)
+      pValid[j] = (pMask[j] == 0 && pY[j] != 0.0);
   }
 
-  else if (dispX.depth()==5 && dispY.depth()==5){
-    Mat dispX_tmp(dispX.size(),CV_32FC1);
-    Mat dispY_tmp(dispY.size(),CV_32FC1);
-    Mat dispX_tmp2(dispX.size(),CV_32FC1);
-    Mat dispY_tmp2(dispY.size(),CV_32FC1);
-
-    // Only leave the gap border pixels to speed-up the process.
-    // Should be cancelled if use sGotcha
-
-    dispX.copyTo(dispX_tmp);
-    dispY.copyTo(dispY_tmp);
-    for (int i=1; i<dispX.rows-1; i++){
-      for (int j=1; j<dispX.cols-1; j++){
-        if (dispX.at<float>(i-1,j-1)!=0.0 && dispX.at<float>(i-1,j)!=0.0 && dispX.at<float>(i-1,j+1)!=0.0 && dispX.at<float>(i,j-1)!=0.0 &&
-            dispX.at<float>(i,j+1)!=0.0 && dispX.at<float>(i+1,j-1)!=0.0 && dispX.at<float>(i+1,j)!=0.0 && dispX.at<float>(i+1,j+1)!=0.0 &&
-            dispY.at<float>(i-1,j-1)!=0.0 && dispY.at<float>(i-1,j)!=0.0 && dispY.at<float>(i-1,j+1)!=0.0 && dispY.at<float>(i,j-1)!=0.0 &&
-            dispY.at<float>(i,j+1)!=0.0 && dispY.at<float>(i+1,j-1)!=0.0 && dispY.at<float>(i+1,j)!=0.0 && dispY.at<float>(i+1,j+1)!=0.0){
-          dispX_tmp.at<float>(i,j)= 0.0;
-          dispY_tmp.at<float>(i,j)= 0.0;
+  // The pixels with a nonzero x disparity which are on the tile border
+  // or have an invalid neighbour
+  enum {NEAR_GAP_X = 2};
+  for (int i=0; i<nRows; i++){
+    const uchar* pMask = m_Mask.ptr<uchar>(i);
+    uchar* pValid = matValid.ptr<uchar>(i);
+    for (int j=0; j<nCols; j++){
+      if (pMask[j] == 1)
+        continue;
+      bool bAllValid = (i > 0 && i < nRows-1 && j > 0 && j < nCols-1);
+      for (int di = -1; di <= 1 && bAllValid; di++){
+        const uchar* pNei = matValid.ptr<uchar>(i+di);
+        for (int dj = -1; dj <= 1; dj++){
+          if ((di != 0 || dj != 0) && !(pNei[j+dj] & 1)){
+            bAllValid = false;
+            break;
+          }
         }
       }
+      if (!bAllValid)
+        pValid[j] |= NEAR_GAP_X;
     }
-
-    dispX_tmp.copyTo(dispX_tmp2);
-    dispY_tmp.copyTo(dispY_tmp2);
-
-    for (int i=1; i<dispX.rows-1; i++){
-      for (int j=1; j<dispX.cols-1; j++){
-        if (dispX.at<float>(i,j)!=0.0 && dispX_tmp.at<float>(i,j) ==0.0 &&
-            (dispX_tmp.at<float>(i-1,j-1)!=0.0 || dispX_tmp.at<float>(i-1,j)!=0.0 ||
-             dispX_tmp.at<float>(i-1,j+1)!=0.0 || dispX_tmp.at<float>(i,j-1)!=0.0 ||
-             dispX_tmp.at<float>(i,j+1)!=0.0 || dispX_tmp.at<float>(i+1,j-1)!=0.0 ||
-             dispX_tmp.at<float>(i+1,j)!=0.0 || dispX_tmp.at<float>(i+1,j+1)!=0.0 ) ){
-
-          dispX_tmp2.at<float>(i,j) = dispX.at<float>(i,j);
-          dispY_tmp2.at<float>(i,j) = dispY.at<float>(i,j);
-        }
-
-      }
-    }
-
-    //double the TPs
-    dispX_tmp2.copyTo(dispX);
-    dispY_tmp2.copyTo(dispY);
   }
 
-
-  if (dispX.depth()==2 && dispY.depth()==2){
-    dispX.convertTo(dispX, CV_16UC1);
-    dispY.convertTo(dispY, CV_16UC1);
-    vector<ushort> Lx, Ly;
-    vector<float> Rx, Ry;
-    for (int i=0; i<dispX.rows; i++){
-      for (int j=0; j<dispX.cols; j++){
-        if(dispX.at<ushort>(i,j)!=65535 && dispY.at<ushort>(i,j)!=65535){
-          unsigned short lx, ly;
-          float rx, ry;
-          lx = j;
-          ly = i;
-          rx = j + (dispX.at<ushort>(i,j)-16384)/16.;
-          ry = i + (dispY.at<ushort>(i,j)-16384)/16.;
-          Lx.push_back(lx);
-          Ly.push_back(ly);
-          Rx.push_back(rx);
-          Ry.push_back(ry);
+  for (int i=0; i<nRows; i++){
+    const float* pX = m_input_dispX.ptr<float>(i);
+    const float* pY = m_input_dispY.ptr<float>(i);
+    const uchar* pValid = matValid.ptr<uchar>(i);
+    for (int j=0; j<nCols; j++){
+      if (!(pValid[j] & 1))
+        continue;
+      bool bKeep = (pValid[j] & NEAR_GAP_X) != 0;
+      // double the TPs
+      if (!bKeep && i > 0 && i < nRows-1 && j > 0 && j < nCols-1){
+        for (int di = -1; di <= 1 && !bKeep; di++){
+          const uchar* pNei = matValid.ptr<uchar>(i+di);
+          for (int dj = -1; dj <= 1; dj++){
+            if ((di != 0 || dj != 0) && (pNei[j+dj] & NEAR_GAP_X)){
+              bKeep = true;
+              break;
+            }
+          }
         }
       }
-    }
+      if (!bKeep)
+        continue;
 
-#if 1
-    // Keep the TP in memory, not on disk, this way one can run multiple threads
-    // doing Gotcha.
-    int nLen = Lx.size();
-    vecTPs.resize(nLen);
-    for (int i = 0 ; i < nLen; i++){
-      unsigned short lx, ly;
-      float rx, ry;
-      lx = Lx.at(i);
-      ly = Ly.at(i);
-      rx = Rx.at(i);
-      ry = Ry.at(i);
-      
       CTiePt tp;
-      tp.m_ptL.x = lx;
-      tp.m_ptL.y = ly;
-      tp.m_ptR.x = rx;
-      tp.m_ptR.y = ry;
+      tp.m_ptL.x = (unsigned short)j;
+      tp.m_ptL.y = (unsigned short)i;
+      tp.m_ptR.x = j + pX[j];
+      tp.m_ptR.y = i + pY[j];
       tp.m_fSimVal = 0.5;
-      vecTPs[i] = tp;
-    }
-#else
-    ofstream sfTP;
-    std::cout << "Writing: " << m_strTPFile << std::endl;
-    sfTP.open(m_strTPFile.c_str());
-    sfTP.precision(10);
-    int nLen = Lx.size();
-    int nEle = 5;
-    if (sfTP.is_open()){
-      sfTP << nLen << " " << nEle << std::endl;
-      for (int i = 0 ; i < nLen ;i++){
-        unsigned short lx, ly;
-        float rx, ry;
-        lx = Lx.at(i);
-        ly = Ly.at(i);
-        rx = Rx.at(i);
-        ry = Ry.at(i);
-        sfTP << lx << " " << ly << " "
-             << rx << " " << ry << " "
-             << 0.5 << " " << std::endl;
-      }
-      sfTP.close();
+      vecTPs.push_back(tp);
     }
-    else {
-      std::cout << "ERROR: Can not convert X/Y disparity map to TP file. "
-           << "Please check the directory for storing Gotcha results is writable."
-           << std::endl;
-    }
-#endif
-    
-  } else if (dispX.depth()==5 && dispY.depth()==5){
-    dispX.convertTo(dispX, CV_32FC1);
-    dispY.convertTo(dispY, CV_32FC1);
-    vector<ushort> Lx, Ly;
-    vector<float> Rx, Ry;
-    for (int i=0; i<dispX.rows; i++){
-      for (int j=0; j<dispX.cols; j++){
-        if(dispX.at<float>(i,j)!= 0.0 && dispY.at<float>(i,j)!=0.0){
-
-          //nodata should be -3.40282346639e+038, but ASP disparity map uses 0 as nodata
-          unsigned short lx, ly;
-          float rx, ry;
-          lx = j;
-          ly = i;
-          rx = j + dispX.at<float>(i,j);
-          ry = i + dispY.at<float>(i,j);
-          Lx.push_back(lx);
-          Ly.push_back(ly);
-          Rx.push_back(rx);
-          Ry.push_back(ry);
-        }
-      }
-    }
-
-#if 1
-    // Keep the TP in memory, not on disk, this way one can run multiple threads
-    // doing Gotcha.
-    int nLen = Lx.size();
-    vecTPs.resize(nLen);
-    for (int i = 0 ; i < nLen; i++){
-      unsigned short lx, ly;
-      float rx, ry;
-      lx = Lx.at(i);
-      ly = Ly.at(i);
-      rx = Rx.at(i);
-      ry = Ry.at(i);
-      
-      CTiePt tp;
-      tp.m_ptL.x = lx;
-      tp.m_ptL.y = ly;
-      tp.m_ptR.x = rx;
-      tp.m_ptR.y = ry;
-      tp.m_fSimVal = 0.5;
-      vecTPs[i] = tp;
-    }
-#else
-    ofstream sfTP;
-    sfTP.open(m_strTPFile.c_str());
-    std::cout << "Writing: " << m_strTPFile << std::endl;
-    sfTP.precision(10);
-    int nLen = Lx.size();
-    int nEle = 5;
-    if (sfTP.is_open()){
-      sfTP << nLen << " " << nEle << std::endl;
-      for (int i = 0 ; i < nLen ;i++){
-        unsigned short lx, ly;
-        float rx, ry;
-        lx = Lx.at(i);
-        ly = Ly.at(i);
-        rx = Rx.at(i);
-        ry = Ry.at(i);
-        sfTP << lx << " " << ly << " "
-             << rx << " " << ry << " "
-             << 0.5 << " " << std::endl;
-      }
-      sfTP.close();
-    } else {
-      std::cout << "ERROR: Can not convert X/Y disparity map to TP file. "
-           << "Please check the directory for storing Gotcha results is writable." << std::endl;
-    }
-#endif
   }
-  
 }
 
 void CBatchProc::refinement(std::vector<CTiePt> const& vecTPs,
-                            vw::ImageView<float> & output_dispX,
-                            vw::ImageView<float> & output_dispY) {
+                            cv::Mat & output_dispX,
+                            cv::Mat & output_dispY) {
   //std::cout << "Gotcha densification based on existing disparity map:" << std::endl;
   FileStorage fs(m_strMetaFile, FileStorage::READ);
   FileNode tl = fs["sGotchaParam"];
@@ -482,6 +261,7 @@ void CBatchProc::refinement(std::vector<CTiePt> const& vecTPs,
   //Mat matDummy = imread(m_strImgL, CV_LOAD_IMAGE_ANYDEPTH);
   paramDense.m_paramGotcha.m_nMinTile = m_imgL.cols + m_imgL.rows;
   paramDense.m_paramGotcha.m_nNeiType = (int)tl["nNeiType"];
+  paramDense.m_paramGotcha.m_nNumThreads = vw::vw_settings().default_num_threads();
 
   paramDense.m_paramGotcha.m_paramALSC.m_bIntOffset = (int)tl["bIntOffset"];
   paramDense.m_paramGotcha.m_paramALSC.m_bWeighting = (int)tl["bWeight"];
@@ -514,15 +294,10 @@ void CBatchProc::refinement(std::vector<CTiePt> const& vecTPs,
   CDensify densify(paramDense, vecTPs, m_imgL, m_imgR, m_input_dispX, m_input_dispY, m_Mask);
   //std::cout << "CASP-GO INFO: performing Gotcha densification" << std::endl;
 
-  cv::Mat cv_output_dispX, cv_output_dispY;
-  int nErrCode = densify.performDensitification(cv_output_dispX, cv_output_dispY);
+  int nErrCode = densify.performDensitification(output_dispX, output_dispY);
   if (nErrCode != CDensifyParam::NO_ERR){
     std::cerr << "Warning: Processing error on densifying operation (ERROR CODE: " << nErrCode << " )" << std::endl;
   }
-
-  // Export the data to ASP
-  cvMatToAspMat(cv_output_dispX, output_dispX);
-  cvMatToAspMat(cv_output_dispY, output_dispY);
 }
 
 Point3f CBatchProc::rotate(Point3f ptIn, Mat matQ, bool bInverse){
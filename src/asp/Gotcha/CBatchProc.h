@@ -52,8 +52,7 @@ private:
     void setProjParameter();
     bool validateProjParam();
     bool validateProjInputs();
-    void generateMask();
-    void generateTPFile(std::vector<CTiePt> & vecTPs);
+    void generateMaskAndTPs(std::vector<CTiePt> & vecTPs);
 
     cv::Point3f rotate(cv::Point3f ptIn, cv::Mat matQ, bool bInverse);
     void quaternionMultiplication(const float* p, const float* q, float* pfOut);
@@ -61,8 +60,8 @@ private:
 protected:
     // processing
   void refinement(std::vector<CTiePt> const& vecTPs,
-                  vw::ImageView<float> & output_dispX,
-                  vw::ImageView<float> & output_dispY);
+                  cv::Mat & output_dispX,
+                  cv::Mat & output_dispY);
 
 protected:
   std::string m_strMetaFile;   // file path to the Metadata file
@@ -76,6 +75,10 @@ protected:
   std::string m_strOutPath;    // a user-supplied file path for the output directory
 #endif
   
+  // The inputs, whose data the OpenCV images below share
+  vw::ImageView<float> m_aspImgL, m_aspImgR;
+  vw::ImageView<float> m_aspDispX, m_aspDispY;
+
   cv::Mat m_imgL, m_imgR;
   cv::Mat m_input_dispX, m_input_dispY;
   cv::Mat m_Mask;
@@ -18,6 +18,11 @@
 #include <asp/Gotcha/CDensify.h>
 #include <asp/Gotcha/ALSC.h>
 
+#include <vw/Core/ThreadPool.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <cmath>
@@ -27,6 +32,41 @@ using namespace cv;
 
 namespace gotcha {
 
+// Grow the regions in one bucket of a tile
+class GrowBucketTask: public vw::Task, private boost::noncopyable {
+  CDensify                    & m_densify;
+  const Mat                   & m_matImgL;
+  const Mat                   & m_matImgR;
+  const CGOTCHAParam          & m_paramGotcha;
+  Rect_<float>                  m_rectTileL;
+  const CDensify::BucketGrid  & m_grid;
+  CDensify::GrowBucket        & m_bucket;
+  Mat                         & m_matSimMap;
+  vector<unsigned char>       & m_pLUT;
+
+public:
+  GrowBucketTask(CDensify & densify, const Mat& matImgL, const Mat& matImgR,
+                 const CGOTCHAParam& paramGotcha, Rect_<float> rectTileL,
+                 const CDensify::BucketGrid& grid, CDensify::GrowBucket& bucket,
+                 Mat& matSimMap, vector<unsigned char>& pLUT):
+    m_densify(densify), m_matImgL(matImgL), m_matImgR(matImgR), m_paramGotcha(paramGotcha),
+    m_rectTileL(rectTileL), m_grid(grid), m_bucket(bucket), m_matSimMap(matSimMap),
+    m_pLUT(pLUT) {}
+
+  void operator()() {
+    m_densify.growBucket(m_matImgL, m_matImgR, m_paramGotcha, m_rectTileL, m_grid,
+                         m_bucket, m_matSimMap, m_pLUT);
+  }
+};
+
+int CDensify::BucketGrid::index(const Point2f& pt) const {
+    int nX = ((int)floor(pt.x) - nX0) / nSize;
+    int nY = ((int)floor(pt.y) - nY0) / nSize;
+    if (pt.x < nX0 || pt.y < nY0 || nX >= nNumX || nY >= nNumY)
+        return -1;
+    return nY * nNumX + nX;
+}
+
 CDensify::CDensify(){}
 
 CDensify::CDensify(CDensifyParam paramDense, std::vector<CTiePt> const& vecTPs,
@@ -357,8 +397,12 @@ bool CDensify::saveResult(cv::Mat & output_dispX, cv::Mat & output_dispY){
     
     //cout << "Writing results..." << endl;
 
-    output_dispX = Mat::ones(m_matDisMapX.size(), CV_32FC1)*0.0;
-    output_dispY = Mat::ones(m_matDisMapY.size(), CV_32FC1)*0.0;
+    // This keeps the data of outputs of the right size, which may be
+    // shared with the caller
+    output_dispX.create(m_matDisMapX.size(), CV_32FC1);
+    output_dispY.create(m_matDisMapY.size(), CV_32FC1);
+    output_dispX.setTo(0.0);
+    output_dispY.setTo(0.0);
 
     for (int i =0; i<output_dispX.rows; i++){
         for (int j=0; j<output_dispX.cols; j++){
@@ -671,7 +715,7 @@ void CDensify::removeOutsideImage(vector<CTiePt>& vecNeiTp, const Rect_<float> r
 
 }
 
-void CDensify::removePtInLUT(vector<CTiePt>& vecNeiTp, const vector<bool>& pLUT, const int nWidth){
+void CDensify::removePtInLUT(vector<CTiePt>& vecNeiTp, const vector<unsigned char>& pLUT, const int nWidth){
     vector<CTiePt>::iterator iter;
 
     for (iter = vecNeiTp.begin(); iter < vecNeiTp.end(); ){        
@@ -751,13 +795,8 @@ bool CDensify::doGotcha(const Mat& matImgL, const Mat& matImgR, vector<CTiePt>&
     // cout << "CASP-GO INFO: initialising pixel LUT" << endl;
 
     // IMARS bool pLUT[szImgL.area()]; // if true it indicates the pixel has already processed
-    vector<bool> pLUT; //IMARS
-
-    // initialise
-    for (int i = 0; i< szImgL.area(); i++){
-        bool bpLUT = false; //IMARS
-        pLUT.push_back(bpLUT); //IMARS
-    } //IMARS
+    // Not a vector<bool>, as threads set neighbouring entries.
+    vector<unsigned char> pLUT(szImgL.area(), false); //IMARS
 
     vector< Rect_<float> > vecRectTiles;
     vecRectTiles.push_back(Rect(0., 0., matImgL.cols, matImgL.rows));
@@ -821,61 +860,143 @@ bool CDensify::doGotcha(const Mat& matImgL, const Mat& matImgR, vector<CTiePt>&
 bool CDensify::doTileGotcha(const Mat& matImgL, const Mat& matImgR, const
                             vector<CTiePt>& vectpSeeds,
                             const CGOTCHAParam& paramGotcha, vector<CTiePt>& vectpAdded,
-                            const Rect_<float> rectTileL, Mat& matSimMap, vector<bool>& pLUT){
-
-    vector<CTiePt> vectpSeedTPs; //= vectpSeeds;                // need this hard copy for sorting
+                            const Rect_<float> rectTileL, Mat& matSimMap, vector<unsigned char>& pLUT){
 
-    Size szImgL(matImgL.cols, matImgL.rows);
-    Rect_<float> rectImgR (0, 0, matImgR.cols, matImgR.rows);
     vectpAdded.clear(); //clear output tp list
 
-    // set indicator buffer
+    /////////////////////////////////////////////////////////////////////
+    // Partition the tile into buckets. Each point grows only the pixels
+    // of its bucket, and is handed over to the neighbouring buckets for
+    // the rest. A bucket reads the similarity map up to twice the patch
+    // radius beyond its pixels, so with buckets larger than that, the
+    // buckets in each of the four classes by the parity of their column
+    // and row can grow at the same time. The result does not depend on
+    // the number of threads.
+    BucketGrid grid;
+    grid.nX0   = (int)floor(rectTileL.x);
+    grid.nY0   = (int)floor(rectTileL.y);
+    grid.nSize = std::max(256, 4 * (paramGotcha.m_paramALSC.m_nPatch + 1));
+    int nX1 = (int)ceil(rectTileL.x + rectTileL.width);
+    int nY1 = (int)ceil(rectTileL.y + rectTileL.height);
+    grid.nNumX = std::max(1, (nX1 - grid.nX0 + grid.nSize - 1) / grid.nSize);
+    grid.nNumY = std::max(1, (nY1 - grid.nY0 + grid.nSize - 1) / grid.nSize);
+
+    vector<GrowBucket> vecBuckets(grid.nNumX * grid.nNumY);
+    for (int by = 0; by < grid.nNumY; by++){
+        for (int bx = 0; bx < grid.nNumX; bx++){
+            vecBuckets[by * grid.nNumX + bx].rect = Rect(grid.nX0 + bx * grid.nSize,
+                                                         grid.nY0 + by * grid.nSize,
+                                                         grid.nSize, grid.nSize);
+        }
+    }
+
     for (int i = 0 ; i < (int)vectpSeeds.size(); i++){
         CTiePt tp = vectpSeeds.at(i);
-
         if (rectTileL.contains(tp.m_ptL)){
-            vectpSeedTPs.push_back(tp);
+            int nIdx = grid.index(tp.m_ptL);
+            if (nIdx >= 0)
+                vecBuckets[nIdx].frontier.push_back(tp);
         }
-
     }
-    //std::cout << "Reading mask: " << paramGotcha.m_strMask << std::endl;
-    //Mat Mask = imread(paramGotcha.m_strMask, CV_LOAD_IMAGE_ANYDEPTH);
-    Mat imgL = matImgL;
-    Mat imgR = matImgR;
-    imgL.convertTo(imgL, CV_8UC1);
-    imgR.convertTo(imgR, CV_8UC1);
 
-    unsigned int nGapSize = 0;
-    for (int i=0; i<m_Mask.rows; i++){
-        for (int j=0; j< m_Mask.cols; j++){
-          if (m_Mask.at<uchar>(i,j)==1 &&
-              imgL.at<uchar>(i,j)!=0 &&imgR.at<uchar>(i,j)!=0)
-                nGapSize+=1;
+    /////////////////////////////////////////////////////////////////////
+    // stereo region growing
+    int nNumThreads = std::max(1, paramGotcha.m_nNumThreads);
+    bool bGrowing = true;
+    while (bGrowing) {
+        bGrowing = false;
+        for (int nClass = 0; nClass < 4; nClass++){
+
+            vector<int> vecActive;
+            for (int by = nClass / 2; by < grid.nNumY; by += 2){
+                for (int bx = nClass % 2; bx < grid.nNumX; bx += 2){
+                    if (!vecBuckets[by * grid.nNumX + bx].frontier.empty())
+                        vecActive.push_back(by * grid.nNumX + bx);
+                }
+            }
+            if (vecActive.empty())
+                continue;
+            bGrowing = true;
+
+            if (nNumThreads == 1 || vecActive.size() == 1){
+                for (size_t i = 0; i < vecActive.size(); i++)
+                    growBucket(matImgL, matImgR, paramGotcha, rectTileL, grid,
+                               vecBuckets[vecActive[i]], matSimMap, pLUT);
+            }else{
+                vw::FifoWorkQueue queue(std::min(nNumThreads, (int)vecActive.size()));
+                for (size_t i = 0; i < vecActive.size(); i++){
+                    boost::shared_ptr<GrowBucketTask>
+                      task(new GrowBucketTask(*this, matImgL, matImgR, paramGotcha, rectTileL, grid,
+                                              vecBuckets[vecActive[i]], matSimMap, pLUT));
+                    queue.add_task(task);
+                }
+                queue.join_all();
+            }
+
+            // Hand over the points at the bucket borders, in a fixed order
+            for (size_t i = 0; i < vecActive.size(); i++){
+                vector< pair<int, CTiePt> > & outbox = vecBuckets[vecActive[i]].outbox;
+                for (size_t j = 0; j < outbox.size(); j++)
+                    vecBuckets[outbox[j].first].frontier.push_back(outbox[j].second);
+                outbox.clear();
+            }
         }
     }
 
-    //sort(vectpSeedTPs.begin(), vectpSeedTPs.end(), compareTP); // sorted in ascending order
-    /////////////////////////////////////////////////////////////////////
-    // stereo region growing
-    //int nCount = 0; // for debug
-#if 0
-      // Hide the verbose messages
-      cout << "[--------------------]  0% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-#endif
-      
-    while (vectpSeedTPs.size() > 0) {
+    for (size_t i = 0; i < vecBuckets.size(); i++)
+        vectpAdded.insert(vectpAdded.end(), vecBuckets[i].added.begin(), vecBuckets[i].added.end());
+
+    return true;
+}
+
+void CDensify::growBucket(const Mat& matImgL, const Mat& matImgR, const CGOTCHAParam& paramGotcha,
+                          const Rect_<float> rectTileL, const BucketGrid& grid, GrowBucket& bucket,
+                          Mat& matSimMap, vector<unsigned char>& pLUT){
+
+    Size szImgL(matImgL.cols, matImgL.rows);
+    Rect_<float> rectImgR (0, 0, matImgR.cols, matImgR.rows);
+    Rect_<float> rectBucket(bucket.rect.x, bucket.rect.y, bucket.rect.width, bucket.rect.height);
+
+    // The workspace for all the matching in this bucket
+    ALSC alsc(matImgL, matImgR, paramGotcha.m_paramALSC);
+
+    while (!bucket.frontier.empty()) {
         // get a point from seed
-        CTiePt tp = vectpSeedTPs.at(0);
+        CTiePt tp = bucket.frontier.front();
+        bucket.frontier.pop_front();
+        // Only the points grown in this bucket are handed over, which
+        // ensures the growing stops.
+        bool bOwnPoint = rectBucket.contains(tp.m_ptL);
+
+        vector<CTiePt> vecAllNeiTp;
+        getNeighbour(tp, vecAllNeiTp, paramGotcha.m_nNeiType, matSimMap);
+        removeOutsideImage(vecAllNeiTp, rectTileL, rectImgR);
+
+        // Keep the neighbours in this bucket, and find the buckets having
+        // the others
+        vector<CTiePt> vecNeiTp;
+        vector<int> vecTargets;
+        for (size_t i = 0; i < vecAllNeiTp.size(); i++){
+            if (rectBucket.contains(vecAllNeiTp[i].m_ptL)){
+                vecNeiTp.push_back(vecAllNeiTp[i]);
+                continue;
+            }
+            if (!bOwnPoint)
+                continue;
+            int nX = (int)floor(vecAllNeiTp[i].m_ptL.x);
+            int nY = (int)floor(vecAllNeiTp[i].m_ptL.y);
+            int nTarget = grid.index(vecAllNeiTp[i].m_ptL);
+            if (nTarget >= 0 && !pLUT[nY * szImgL.width + nX] &&
+                std::find(vecTargets.begin(), vecTargets.end(), nTarget) == vecTargets.end())
+                vecTargets.push_back(nTarget);
+        }
+        for (size_t i = 0; i < vecTargets.size(); i++)
+            bucket.outbox.push_back(make_pair(vecTargets[i], tp));
 
-//        mvectpAdded.push_back(tp);
-        vectpSeedTPs.erase(vectpSeedTPs.begin());
-        vector<CTiePt> vecNeiTp;        
-        getNeighbour(tp, vecNeiTp, paramGotcha.m_nNeiType, matSimMap);
-        removeOutsideImage(vecNeiTp, rectTileL, rectImgR);
         removePtInLUT(vecNeiTp, pLUT, matImgL.cols);
 
         //ALSC
-        if ((int)vecNeiTp.size() > 0){            
+        if ((int)vecNeiTp.size() > 0){
             // get affine data from a seed
             float pfData[6] = {0, 0, 0, 0, 0, 0};
             for (int k = 0; k < 4; k++)
@@ -883,83 +1004,26 @@ bool CDensify::doTileGotcha(const Mat& matImgL, const Mat& matImgR, const
             pfData[4] = tp.m_ptOffset.x;
             pfData[5] = tp.m_ptOffset.y;
 
-            ALSC alsc(matImgL, matImgR, paramGotcha.m_paramALSC);
-
             alsc.performALSC(&vecNeiTp, (float*) pfData);
             const vector<CTiePt>* pvecRefTPtemp = alsc.getRefinedTps();
 
             int nLen = pvecRefTPtemp->size();
-            if( nLen > 0){
-                // append survived neighbours to the seed point list and the seed LUT
-                // vector<CRefinedTP>::iterator iterNei;
-                for (int i = 0 ; i < nLen; i++){
-                    CTiePt tpNei = pvecRefTPtemp->at(i);
+            // append survived neighbours to the seed point list and the seed LUT
+            for (int i = 0 ; i < nLen; i++){
+                CTiePt tpNei = pvecRefTPtemp->at(i);
 
-                    int nXnei = (int)floor(tpNei.m_ptL.x);
-                    int nYnei = (int)floor(tpNei.m_ptL.y);
-                    int nIdxNei = nYnei*szImgL.width + nXnei;
+                int nXnei = (int)floor(tpNei.m_ptL.x);
+                int nYnei = (int)floor(tpNei.m_ptL.y);
+                int nIdxNei = nYnei*szImgL.width + nXnei;
 
-                    matSimMap.at<float>(nYnei,nXnei) = tpNei.m_fSimVal;                    
-                    pLUT[nIdxNei] = true;
+                matSimMap.at<float>(nYnei,nXnei) = tpNei.m_fSimVal;
+                pLUT[nIdxNei] = true;
 
-                    vectpSeedTPs.push_back(tpNei);
-                    vectpAdded.push_back(tpNei);
-                }
-
-                //sort(vectpSeedTPs.begin(), vectpSeedTPs.end(), compareTP);
-            } 
-        }
-#if 0
-        // Hide the verbose messages
-        if (vectpAdded.size()>0){
-        if (vectpAdded.size() >= (nGapSize)/20 && vectpAdded.size() < 2*(nGapSize)/20)
-            cout << "[*-------------------]  5% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 2*(nGapSize)/20 && vectpAdded.size() < 3*(nGapSize)/20)
-            cout << "[**------------------] 10% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 3*(nGapSize)/20 && vectpAdded.size() < 4*(nGapSize)/20)
-            cout << "[***-----------------] 15% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 4*(nGapSize)/20 && vectpAdded.size() < 5*(nGapSize)/20)
-            cout << "[****----------------] 20% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 5*(nGapSize)/20 && vectpAdded.size() < 6*(nGapSize)/20)
-            cout << "[*****---------------] 25% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 6*(nGapSize)/20 && vectpAdded.size() < 7*(nGapSize)/20)
-            cout << "[******--------------] 30% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 7*(nGapSize)/20 && vectpAdded.size() < 8*(nGapSize)/20)
-            cout << "[*******-------------] 35% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 8*(nGapSize)/20 && vectpAdded.size() < 9*(nGapSize)/20)
-            cout << "[********------------] 40% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 9*(nGapSize)/20 && vectpAdded.size() < 10*(nGapSize)/20)
-            cout << "[*********-----------] 45% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 10*(nGapSize)/20 && vectpAdded.size() < 11*(nGapSize)/20)
-            cout << "[**********----------] 50% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 11*(nGapSize)/20 && vectpAdded.size() < 12*(nGapSize)/20)
-            cout << "[***********---------] 55% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 12*(nGapSize)/20 && vectpAdded.size() < 13*(nGapSize)/20)
-            cout << "[************--------] 60% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 13*(nGapSize)/20 && vectpAdded.size() < 14*(nGapSize)/20)
-            cout << "[*************-------] 65% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 14*(nGapSize)/20 && vectpAdded.size() < 15*(nGapSize)/20)
-            cout << "[**************------] 70% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 15*(nGapSize)/20 && vectpAdded.size() < 16*(nGapSize)/20)
-            cout << "[***************-----] 75% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 16*(nGapSize)/20 && vectpAdded.size() < 17*(nGapSize)/20)
-            cout << "[****************----] 80% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 17*(nGapSize)/20 && vectpAdded.size() < 18*(nGapSize)/20)
-            cout << "[*****************---] 85% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 18*(nGapSize)/20 && vectpAdded.size() < 19*(nGapSize)/20)
-            cout << "[******************--] 90% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() >= 19*(nGapSize)/20 && vectpAdded.size() < 20*(nGapSize)/20)
-            cout << "[*******************-] 95% OF THE GAP AREA HAS BEEN DENSIFIED\r" << std::flush;
-        else if (vectpAdded.size() == nGapSize)
-          cout << "[********************]100% OF THE GAP AREA HAS BEEN DENSIFIED";
+                bucket.frontier.push_back(tpNei);
+                bucket.added.push_back(tpNei);
+            }
         }
-#endif
     }
-#if 0
-    cout << endl;
-#endif
-    
-    return true;
 }
 
 bool CDensify::doPGotcha(int nNeiType){
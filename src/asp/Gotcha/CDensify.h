@@ -26,6 +26,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <ostream>
@@ -35,6 +36,8 @@
 
 namespace gotcha {
 
+class GrowBucketTask;
+
 class CDensify: public CProcBlock {
 public:
   CDensify();
@@ -56,14 +59,32 @@ public:
         return "GOTCHA_FROM_DISP";
     }
 private:
+    friend class GrowBucketTask;
+
+    // The region growing in a tile is split among square buckets of pixels.
+    // Each bucket has its own frontier of points to grow from.
+    struct BucketGrid {
+      int nX0, nY0, nSize, nNumX, nNumY;
+      int index(const cv::Point2f& pt) const; // -1 if outside
+    };
+    struct GrowBucket {
+      cv::Rect rect;               // the pixels owned by this bucket
+      std::deque<CTiePt> frontier; // the points to grow from
+      std::vector<CTiePt> added;   // the points added by this bucket
+      std::vector< std::pair<int, CTiePt> > outbox; // points to grow from in other buckets
+    };
+
     //void loadImages();
     std::vector<CTiePt> getIntToFloatSeed(std::vector<CTiePt>& vecTPSrc); // get integer Seed point pairs from a float seed point pair
     bool doGotcha(const cv::Mat& matImgL, const cv::Mat& matImgR, std::vector<CTiePt>& vectpSeeds,
                   const CGOTCHAParam& paramGotcha, std::vector<CTiePt>& vectpAdded);
     bool doTileGotcha(const cv::Mat& matImgL, const cv::Mat& matImgR, const std::vector<CTiePt>& vectpSeeds,
                       const CGOTCHAParam& paramGotcha, std::vector<CTiePt>& mvectpAdded,
-                      const cv::Rect_<float> rectTileL, cv::Mat& matSimMap, std::vector<bool>& pLUT); //IMARS
-    void removePtInLUT(std::vector<CTiePt>& vecNeiTp, const std::vector<bool>& pLUT, const int nWidth); //IMARS
+                      const cv::Rect_<float> rectTileL, cv::Mat& matSimMap, std::vector<unsigned char>& pLUT); //IMARS
+    void growBucket(const cv::Mat& matImgL, const cv::Mat& matImgR, const CGOTCHAParam& paramGotcha,
+                    const cv::Rect_<float> rectTileL, const BucketGrid& grid, GrowBucket& bucket,
+                    cv::Mat& matSimMap, std::vector<unsigned char>& pLUT);
+    void removePtInLUT(std::vector<CTiePt>& vecNeiTp, const std::vector<unsigned char>& pLUT, const int nWidth); //IMARS
     void removeOutsideImage(std::vector<CTiePt>& vecNeiTp, const cv::Rect_<float> rectTileL, const cv::Rect_<float> rectImgR);
     void getNeighbour(const CTiePt tp, std::vector<CTiePt>& vecNeiTp, const int nNeiType, const cv::Mat& matSim);
     void getDisffusedNei(std::vector<CTiePt>& vecNeiTp, const CTiePt tp, const cv::Mat& matSim);
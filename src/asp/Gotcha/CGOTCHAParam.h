@@ -26,7 +26,7 @@ namespace gotcha {
 class CGOTCHAParam {
 
 public:
-    CGOTCHAParam():m_nNeiType(NEI_4),m_fDiffCoef(0.05),m_fDiffThr(0.1),m_nDiffIter(5), m_bNeedInitALSC(true){ m_nMinTile = 1000000000;}
+    CGOTCHAParam():m_nNeiType(NEI_4),m_fDiffCoef(0.05),m_fDiffThr(0.1),m_nDiffIter(5), m_bNeedInitALSC(true), m_nNumThreads(1){ m_nMinTile = 1000000000;}
 
     std::string getNeiType(){if (m_nNeiType == NEI_X) return "NEI_X";
                         else if (m_nNeiType == NEI_Y) return "NEI_Y";
@@ -45,6 +45,7 @@ public:
 
     CALSCParam m_paramALSC;
     bool m_bNeedInitALSC; // set true if initial alsc on seed points are required
+    int m_nNumThreads;    // the number of threads growing regions in a tile
 
     enum {NEI_X, NEI_Y, NEI_4, NEI_8, NEI_DIFF};
 };
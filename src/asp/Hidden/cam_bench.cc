@@ -0,0 +1,352 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file cam_bench.cc
+
+// Benchmark the camera models. For each given image and camera, sample
+// a grid of pixels, find the ground points they see on the datum, then
+// time point_to_pixel(), pixel_to_vector(), and camera_center(). A
+// single call is timed by repeating it at one pixel, and batches by
+// running over all samples split among several threads, each with its
+// own copy of the camera, as not all camera models are thread-safe.
+// Any camera model a stereo session can load can be benchmarked, such
+// as linescan DG, Pleiades, SPOT, ASTER, PeruSat, RPC, CSM, and ISIS.
+// This gives a baseline before changing the camera code.
+
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <asp/Core/Common.h>
+#include <asp/Core/Macros.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Sessions/StereoSession.h>
+#include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Camera/CsmModel.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <iomanip>
+
+namespace po = boost::program_options;
+
+using namespace vw;
+
+typedef boost::shared_ptr<vw::camera::CameraModel> CamPtr;
+
+struct Options : vw::GdalWriteOptions {
+  std::vector<std::string> image_cam_files, images, cameras, sessions;
+  std::string sessions_str, threads_str, output_file;
+  int num_samples, num_trials;
+  double height_above_datum;
+  std::vector<int> threads;
+};
+
+// Split a comma-separated list of positive integers
+std::vector<int> parse_int_list(std::string const& str, std::string const& opt_name) {
+  std::vector<std::string> tokens;
+  boost::split(tokens, str, boost::is_any_of(", "), boost::token_compress_on);
+  std::vector<int> vals;
+  for (size_t it = 0; it < tokens.size(); it++) {
+    if (tokens[it].empty())
+      continue;
+    int val = atoi(tokens[it].c_str());
+    if (val <= 0)
+      vw_throw(ArgumentErr() << "Invalid value in --" << opt_name << ": "
+               << tokens[it] << ".\n");
+    vals.push_back(val);
+  }
+  if (vals.empty())
+    vw_throw(ArgumentErr() << "No values were specified for --" << opt_name << ".\n");
+  return vals;
+}
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+
+  po::options_description general_options("");
+  general_options.add_options()
+    ("sessions", po::value(&opt.sessions_str)->default_value(""),
+     "Comma-separated list of sessions to load the cameras with, one for all cameras "
+     "or one per camera, such as dg, pleiades, spot5, aster, perusat, rpc, csm, isis. "
+     "If not set, they are guessed.")
+    ("num-samples", po::value(&opt.num_samples)->default_value(10000),
+     "Sample about this many pixels on a grid over each image.")
+    ("threads-list", po::value(&opt.threads_str)->default_value("1,4"),
+     "Comma-separated list of thread counts for the batches.")
+    ("num-trials", po::value(&opt.num_trials)->default_value(3),
+     "Run each configuration this many times and report the fastest run.")
+    ("height-above-datum", po::value(&opt.height_above_datum)->default_value(0.0),
+     "Find the ground points on the datum with this height added to its radii, "
+     "in meters.")
+    ("output-file", po::value(&opt.output_file)->default_value(""),
+     "If set, also save the results to this file, in CSV format.");
+
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+
+  po::options_description positional("");
+  positional.add_options()
+    ("input-files", po::value(&opt.image_cam_files));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("input-files", -1);
+
+  std::string usage("[options] <image 1> <camera 1> [<image 2> <camera 2> ...]");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (opt.image_cam_files.empty() || opt.image_cam_files.size() % 2 != 0)
+    vw_throw(ArgumentErr() << "Expecting pairs of images and cameras.\n\n"
+             << usage << general_options);
+  for (size_t it = 0; it < opt.image_cam_files.size(); it += 2) {
+    opt.images.push_back(opt.image_cam_files[it]);
+    opt.cameras.push_back(opt.image_cam_files[it + 1]);
+  }
+
+  boost::split(opt.sessions, opt.sessions_str, boost::is_any_of(", "),
+               boost::token_compress_on);
+  if (opt.sessions.size() == 1)
+    opt.sessions.resize(opt.cameras.size(), opt.sessions[0]);
+  if (opt.sessions.size() != opt.cameras.size())
+    vw_throw(ArgumentErr() << "Expecting as many sessions as cameras, or one session.\n");
+
+  if (opt.num_samples <= 0 || opt.num_trials <= 0)
+    vw_throw(ArgumentErr() << "The number of samples and of trials must be positive.\n");
+
+  opt.threads = parse_int_list(opt.threads_str, "threads-list");
+}
+
+enum BenchOp {OP_POINT_TO_PIXEL, OP_PIXEL_TO_VECTOR, OP_CAMERA_CENTER};
+
+std::string op_name(BenchOp op) {
+  if (op == OP_POINT_TO_PIXEL)  return "point_to_pixel";
+  if (op == OP_PIXEL_TO_VECTOR) return "pixel_to_vector";
+  return "camera_center";
+}
+
+// Call an operation on a range of samples, a given number of times
+// for each. Accumulate the results, so that they are used.
+class BenchTask: public vw::Task, private boost::noncopyable {
+  vw::camera::CameraModel const& m_camera;
+  BenchOp m_op;
+  std::vector<Vector2> const& m_pixels;
+  std::vector<Vector3> const& m_points;
+  size_t m_beg, m_end;
+  int m_repeat;
+  double & m_checksum;
+
+public:
+  BenchTask(vw::camera::CameraModel const& camera, BenchOp op,
+            std::vector<Vector2> const& pixels, std::vector<Vector3> const& points,
+            size_t beg, size_t end, int repeat, double & checksum):
+    m_camera(camera), m_op(op), m_pixels(pixels), m_points(points),
+    m_beg(beg), m_end(end), m_repeat(repeat), m_checksum(checksum) {}
+
+  virtual void operator()() {
+    double sum = 0.0;
+    for (size_t it = m_beg; it < m_end; it++) {
+      for (int rep = 0; rep < m_repeat; rep++) {
+        if (m_op == OP_POINT_TO_PIXEL)
+          sum += m_camera.point_to_pixel(m_points[it])[0];
+        else if (m_op == OP_PIXEL_TO_VECTOR)
+          sum += m_camera.pixel_to_vector(m_pixels[it])[0];
+        else
+          sum += m_camera.camera_center(m_pixels[it])[0];
+      }
+    }
+    m_checksum = sum;
+  }
+};
+
+struct BenchResult {
+  std::string camera, type, op, mode;
+  int threads;
+  double num_calls, seconds, calls_per_sec;
+};
+
+// Time an operation. With one pixel, that call is repeated as many
+// times as there are samples. Otherwise the samples are split among
+// the threads. Report the fastest trial.
+BenchResult run_one(Options const& opt, std::string const& camera_file,
+                    std::string const& type, BenchOp op, bool single,
+                    std::vector<CamPtr> const& cams,
+                    std::vector<Vector2> const& pixels,
+                    std::vector<Vector3> const& points) {
+
+  int num_threads = single ? 1 : cams.size();
+  size_t num = pixels.size();
+
+  BenchResult res;
+  res.camera    = camera_file;
+  res.type      = type;
+  res.op        = op_name(op);
+  res.mode      = single ? "single" : "batch";
+  res.threads   = num_threads;
+  res.num_calls = num;
+  res.seconds   = std::numeric_limits<double>::max();
+
+  std::vector<double> checksums(num_threads, 0.0);
+  for (int trial = 0; trial < opt.num_trials; trial++) {
+    Stopwatch sw;
+    sw.start();
+    {
+      FifoWorkQueue queue(num_threads);
+      for (int ith = 0; ith < num_threads; ith++) {
+        size_t beg = single ? 0 : (num * ith) / num_threads;
+        size_t end = single ? 1 : (num * (ith + 1)) / num_threads;
+        int repeat = single ? num : 1;
+        queue.add_task(boost::shared_ptr<BenchTask>
+                       (new BenchTask(*cams[ith], op, pixels, points, beg, end, repeat,
+                                      checksums[ith])));
+      }
+      queue.join_all();
+    }
+    sw.stop();
+    res.seconds = std::min(res.seconds, sw.elapsed_seconds());
+  }
+
+  res.calls_per_sec = num / std::max(res.seconds, 1e-9);
+  return res;
+}
+
+// Sample pixels on a grid over the image, and find where they see the
+// datum. Keep only the pixels whose ground points project back into
+// the camera, so that no call throws while being timed.
+void sample_pixels(Options const& opt, std::string const& image,
+                   vw::camera::CameraModel const& cam, vw::cartography::Datum const& datum,
+                   std::vector<Vector2> & pixels, std::vector<Vector3> & points) {
+
+  pixels.clear();
+  points.clear();
+
+  int cols = 0, rows = 0;
+  try {
+    DiskImageView<float> img(image);
+    cols = img.cols();
+    rows = img.rows();
+  } catch(const std::exception& e) {
+    // A CSM camera has the dimensions if the image is missing
+    asp::CsmModel const* csm_model
+      = dynamic_cast<asp::CsmModel const*>(vw::camera::unadjusted_model(&cam));
+    if (csm_model == NULL)
+      vw_throw(ArgumentErr() << e.what());
+    cols = csm_model->get_image_size()[0];
+    rows = csm_model->get_image_size()[1];
+  }
+
+  double spacing = std::max(1.0, sqrt(double(cols) * rows / opt.num_samples));
+  double major_axis = datum.semi_major_axis() + opt.height_above_datum;
+  double minor_axis = datum.semi_minor_axis() + opt.height_above_datum;
+  for (double row = 0.5 * spacing; row < rows; row += spacing) {
+    for (double col = 0.5 * spacing; col < cols; col += spacing) {
+      Vector2 pix(col, row);
+      try {
+        Vector3 xyz = vw::cartography::datum_intersection(major_axis, minor_axis,
+                                                          cam.camera_center(pix),
+                                                          cam.pixel_to_vector(pix));
+        if (xyz == Vector3())
+          continue;
+        cam.point_to_pixel(xyz);
+        pixels.push_back(pix);
+        points.push_back(xyz);
+      } catch(...) {}
+    }
+  }
+
+  if (pixels.empty())
+    vw_throw(ArgumentErr() << "No pixel of " << image << " sees the datum.\n");
+}
+
+int main(int argc, char *argv[]) {
+
+  Options opt;
+  try {
+    handle_arguments(argc, argv, opt);
+
+    int max_threads = *std::max_element(opt.threads.begin(), opt.threads.end());
+
+    std::vector<BenchResult> results;
+    for (size_t icam = 0; icam < opt.cameras.size(); icam++) {
+
+      std::string session_name = opt.sessions[icam]; // may change
+      std::string out_prefix;
+      boost::scoped_ptr<asp::StereoSession>
+        session(asp::StereoSessionFactory::create(session_name, opt,
+                                                  opt.images[icam], opt.images[icam],
+                                                  opt.cameras[icam], opt.cameras[icam],
+                                                  out_prefix));
+
+      // A camera for each thread, loaded before anything is timed. Each
+      // call makes a new camera object.
+      std::vector<CamPtr> cams;
+      for (int ith = 0; ith < max_threads; ith++)
+        cams.push_back(session->camera_model(opt.images[icam], opt.cameras[icam]));
+
+      bool use_sphere_for_non_earth = true;
+      vw::cartography::Datum datum = session->get_datum(cams[0].get(),
+                                                        use_sphere_for_non_earth);
+
+      std::vector<Vector2> pixels;
+      std::vector<Vector3> points;
+      sample_pixels(opt, opt.images[icam], *cams[0], datum, pixels, points);
+
+      std::string type = vw::camera::unadjusted_model(cams[0].get())->type();
+      vw_out() << "Camera: " << opt.cameras[icam] << ", session: " << session_name
+               << ", model: " << type << ", samples: " << pixels.size() << "\n";
+
+      BenchOp ops[] = {OP_POINT_TO_PIXEL, OP_PIXEL_TO_VECTOR, OP_CAMERA_CENTER};
+      for (BenchOp op: ops) {
+        results.push_back(run_one(opt, opt.cameras[icam], type, op, true,
+                                  cams, pixels, points));
+        for (size_t h = 0; h < opt.threads.size(); h++) {
+          std::vector<CamPtr> thread_cams(cams.begin(), cams.begin() + opt.threads[h]);
+          results.push_back(run_one(opt, opt.cameras[icam], type, op, false,
+                                    thread_cams, pixels, points));
+        }
+      }
+    }
+
+    // Print the results, and save them in CSV format if asked
+    std::ostringstream os;
+    os << "# camera,model,operation,mode,threads,calls,seconds,calls_per_second\n";
+    for (size_t it = 0; it < results.size(); it++) {
+      BenchResult const& r = results[it];
+      os << r.camera << "," << r.type << "," << r.op << "," << r.mode << ","
+         << r.threads << "," << std::setprecision(6) << r.num_calls << ","
+         << r.seconds << "," << r.calls_per_sec << "\n";
+    }
+    vw_out() << os.str();
+
+    if (!opt.output_file.empty()) {
+      vw::create_out_dir(opt.output_file);
+      vw_out() << "Writing: " << opt.output_file << "\n";
+      std::ofstream ofs(opt.output_file.c_str());
+      ofs << os.str();
+    }
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
@@ -0,0 +1,334 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file corr_bench.cc
+
+// Benchmark the correlation stage. Feed a fixed stereo pair, either
+// synthetic (generated from a fixed random seed) or read from disk,
+// through the same pyramid_correlate() call that stereo_corr uses,
+// for several algorithms, tile sizes, and thread counts. Report the
+// load and correlation times, pixels per second, and peak memory
+// usage, so that performance regressions can be caught before
+// upgrading a production build.
+
+#include <vw/Core/Stopwatch.h>
+#include <vw/Image/BlockRasterize.h>
+#include <vw/Image/Filter.h>
+#include <vw/Image/UtilityViews.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/FileIO/DiskImageUtils.h>
+#include <vw/Stereo/CorrelationView.h>
+#include <vw/Stereo/Correlation.h>
+#include <asp/Core/Common.h>
+#include <asp/Core/Macros.h>
+#include <asp/Core/StageTiming.h>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <fstream>
+#include <limits>
+#include <iomanip>
+
+namespace po = boost::program_options;
+
+using namespace vw;
+
+struct Options : vw::GdalWriteOptions {
+  std::string left_image, right_image, algorithms_str, tile_sizes_str,
+    threads_str, output_file;
+  vw::BBox2 search_range;
+  vw::Vector2i synthetic_disp;
+  int synthetic_size, num_trials, corr_max_levels, collar_size;
+  std::vector<std::string> algorithms;
+  std::vector<int> tile_sizes, threads;
+};
+
+// Split a comma-separated list of positive integers
+std::vector<int> parse_int_list(std::string const& str, std::string const& opt_name) {
+  std::vector<std::string> tokens;
+  boost::split(tokens, str, boost::is_any_of(", "), boost::token_compress_on);
+  std::vector<int> vals;
+  for (size_t it = 0; it < tokens.size(); it++) {
+    if (tokens[it].empty())
+      continue;
+    int val = atoi(tokens[it].c_str());
+    if (val <= 0)
+      vw_throw(ArgumentErr() << "Invalid value in --" << opt_name << ": "
+               << tokens[it] << ".\n");
+    vals.push_back(val);
+  }
+  if (vals.empty())
+    vw_throw(ArgumentErr() << "No values were specified for --" << opt_name << ".\n");
+  return vals;
+}
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+
+  po::options_description general_options("");
+  general_options.add_options()
+    ("stereo-algorithms", po::value(&opt.algorithms_str)->default_value("asp_bm,asp_sgm,asp_mgm"),
+     "Comma-separated list of correlation algorithms to benchmark. Options: asp_bm, "
+     "asp_sgm, asp_mgm, asp_final_mgm.")
+    ("tile-sizes", po::value(&opt.tile_sizes_str)->default_value("256,512,1024"),
+     "Comma-separated list of tile sizes to use when rasterizing the disparity.")
+    ("threads-list", po::value(&opt.threads_str)->default_value("1,4"),
+     "Comma-separated list of thread counts.")
+    ("num-trials", po::value(&opt.num_trials)->default_value(1),
+     "Run each configuration this many times and report the fastest run.")
+    ("corr-search", po::value(&opt.search_range)->default_value(BBox2(0,0,0,0), "auto"),
+     "Disparity search range, as min_x min_y max_x max_y. Required for real images. "
+     "For the synthetic pair it is set to a buffer around the known disparity.")
+    ("corr-max-levels", po::value(&opt.corr_max_levels)->default_value(5),
+     "Max pyramid levels to process.")
+    ("sgm-collar-size", po::value(&opt.collar_size)->default_value(512),
+     "Extend the SGM/MGM calculation to this distance around each tile.")
+    ("synthetic-size", po::value(&opt.synthetic_size)->default_value(1024),
+     "If no input images are given, create a synthetic pair of this width and height.")
+    ("synthetic-disparity", po::value(&opt.synthetic_disp)->default_value(Vector2i(7, 2), "7 2"),
+     "The integer disparity by which the right synthetic image is shifted.")
+    ("output-file", po::value(&opt.output_file)->default_value(""),
+     "If set, also save the results to this file, in CSV format.");
+
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+
+  po::options_description positional("");
+  positional.add_options()
+    ("left-image",  po::value(&opt.left_image))
+    ("right-image", po::value(&opt.right_image));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("left-image", 1);
+  positional_desc.add("right-image", 1);
+
+  std::string usage("[options] [<L.tif> <R.tif>]");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (opt.left_image.empty() != opt.right_image.empty())
+    vw_throw(ArgumentErr() << "Either both or none of the input images must be set.\n\n"
+             << usage << general_options);
+
+  if (!opt.left_image.empty() && opt.search_range == BBox2(0, 0, 0, 0))
+    vw_throw(ArgumentErr() << "The option --corr-search must be set for real images.\n\n"
+             << usage << general_options);
+
+  if (opt.synthetic_size <= 0 || opt.num_trials <= 0)
+    vw_throw(ArgumentErr() << "The synthetic image size and the number of trials "
+             << "must be positive.\n");
+
+  boost::split(opt.algorithms, opt.algorithms_str, boost::is_any_of(", "),
+               boost::token_compress_on);
+  opt.tile_sizes = parse_int_list(opt.tile_sizes_str, "tile-sizes");
+  opt.threads    = parse_int_list(opt.threads_str, "threads-list");
+}
+
+vw::stereo::CorrelationAlgorithm bench_alg_to_num(std::string const& alg) {
+  if (alg == "asp_bm")        return vw::stereo::VW_CORRELATION_BM;
+  if (alg == "asp_sgm")       return vw::stereo::VW_CORRELATION_SGM;
+  if (alg == "asp_mgm")       return vw::stereo::VW_CORRELATION_MGM;
+  if (alg == "asp_final_mgm") return vw::stereo::VW_CORRELATION_FINAL_MGM;
+  vw_throw(ArgumentErr() << "Unsupported algorithm: " << alg << ".\n");
+  return vw::stereo::VW_CORRELATION_BM;
+}
+
+// Create a textured image from a fixed seed, so that each run sees
+// the same pixels. The right image is the left image shifted by the
+// given disparity, so that left(x) matches right(x + disp).
+void make_synthetic_pair(int size, Vector2i const& disp,
+                         ImageView<PixelGray<float>> & left,
+                         ImageView<PixelGray<float>> & right) {
+
+  int pad = std::max(std::abs(disp.x()), std::abs(disp.y()));
+  ImageView<float> noise(size + 2*pad, size + 2*pad);
+  boost::random::mt19937 gen(0);
+  boost::random::uniform_real_distribution<float> dist(0.0, 1.0);
+  for (int row = 0; row < noise.rows(); row++) {
+    for (int col = 0; col < noise.cols(); col++)
+      noise(col, row) = dist(gen);
+  }
+
+  // Smooth the noise a little so that it looks more like terrain texture
+  ImageView<float> texture = gaussian_filter(noise, 1.5);
+
+  left.set_size(size, size);
+  right.set_size(size, size);
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size; col++) {
+      left(col, row)  = texture(col + pad, row + pad);
+      right(col, row) = texture(col + pad - disp.x(), row + pad - disp.y());
+    }
+  }
+}
+
+struct BenchResult {
+  std::string algorithm;
+  int tile_size, threads;
+  double load_time, corr_time, pixels_per_sec, peak_rss, valid_frac, accurate_frac;
+};
+
+BenchResult run_one(Options const& opt, std::string const& alg_name,
+                    int tile_size, int num_threads, double load_time,
+                    ImageViewRef<PixelGray<float>> const& left,
+                    ImageViewRef<PixelGray<float>> const& right,
+                    bool is_synthetic) {
+
+  vw::stereo::CorrelationAlgorithm stereo_alg = bench_alg_to_num(alg_name);
+  bool is_sgm = (stereo_alg != vw::stereo::VW_CORRELATION_BM);
+
+  // The same defaults as stereo_corr uses for each algorithm
+  Vector2i kernel_size = is_sgm ? Vector2i(5, 5) : Vector2i(21, 21);
+  vw::stereo::CostFunctionType cost_mode
+    = is_sgm ? vw::stereo::TERNARY_CENSUS_TRANSFORM : vw::stereo::CROSS_CORRELATION;
+  vw::stereo::SemiGlobalMatcher::SgmSubpixelMode sgm_subpixel_mode
+    = vw::stereo::SemiGlobalMatcher::SUBPIXEL_LC_BLEND;
+  vw::stereo::PrefilterModeType prefilter_mode = vw::stereo::PREFILTER_LOG;
+  const double prefilter_width = 1.5, xcorr_threshold = 2.0;
+  const int    corr_timeout = 0, min_xcorr_level = 0, rm_half_kernel = 5,
+    blob_filter_area = 0;
+  const double seconds_per_op = 0.0;
+  const size_t memory_limit_mb = 4*1024;
+  Vector2i sgm_search_buffer(4, 4);
+
+  Vector2 truth(opt.synthetic_disp.x(), opt.synthetic_disp.y());
+  BBox2 search_range = opt.search_range;
+  if (search_range == BBox2(0, 0, 0, 0)) {
+    search_range = BBox2(truth, truth);
+    search_range.expand(8);
+  }
+
+  ImageViewRef<uint8> left_mask  = constant_view(uint8(255), left.cols(),  left.rows());
+  ImageViewRef<uint8> right_mask = constant_view(uint8(255), right.cols(), right.rows());
+
+  BenchResult res;
+  res.algorithm = alg_name;
+  res.tile_size = tile_size;
+  res.threads   = num_threads;
+  res.load_time = load_time;
+  res.corr_time = std::numeric_limits<double>::max();
+
+  ImageView<PixelMask<Vector2f>> disp;
+  for (int trial = 0; trial < opt.num_trials; trial++) {
+    Stopwatch sw;
+    sw.start();
+    ImageViewRef<PixelMask<Vector2f>> disp_view
+      = vw::stereo::pyramid_correlate(left, right, left_mask, right_mask,
+                                      prefilter_mode, prefilter_width,
+                                      search_range, kernel_size, cost_mode,
+                                      corr_timeout, seconds_per_op,
+                                      xcorr_threshold, min_xcorr_level,
+                                      rm_half_kernel, opt.corr_max_levels,
+                                      stereo_alg, opt.collar_size,
+                                      sgm_subpixel_mode, sgm_search_buffer,
+                                      memory_limit_mb, blob_filter_area,
+                                      NULL, Vector2i(0, 0), false);
+    disp = block_rasterize(disp_view, Vector2i(tile_size, tile_size), num_threads);
+    sw.stop();
+    res.corr_time = std::min(res.corr_time, sw.elapsed_seconds());
+  }
+
+  double num_pixels = double(left.cols()) * left.rows();
+  res.pixels_per_sec = num_pixels / std::max(res.corr_time, 1e-6);
+  // This never decreases, so it is for the most expensive configuration so far
+  res.peak_rss = asp::peak_rss_mb();
+
+  // Fraction of valid pixels, and for the synthetic pair, the fraction
+  // within one pixel of the known disparity.
+  double num_valid = 0, num_accurate = 0;
+  for (int row = 0; row < disp.rows(); row++) {
+    for (int col = 0; col < disp.cols(); col++) {
+      if (!is_valid(disp(col, row)))
+        continue;
+      num_valid++;
+      if (is_synthetic &&
+          norm_2(Vector2(disp(col, row).child()) - truth) <= 1.0)
+        num_accurate++;
+    }
+  }
+  res.valid_frac    = num_valid / std::max(num_pixels, 1.0);
+  res.accurate_frac = is_synthetic ? num_accurate / std::max(num_valid, 1.0) : -1.0;
+
+  return res;
+}
+
+int main(int argc, char *argv[]) {
+
+  Options opt;
+  try {
+    handle_arguments(argc, argv, opt);
+
+    // Load or create the inputs. Bring them in memory, so that only
+    // correlation is timed below.
+    Stopwatch sw;
+    sw.start();
+    bool is_synthetic = opt.left_image.empty();
+    ImageView<PixelGray<float>> left, right;
+    if (is_synthetic) {
+      make_synthetic_pair(opt.synthetic_size, opt.synthetic_disp, left, right);
+    } else {
+      left  = DiskImageView<PixelGray<float>>(opt.left_image);
+      right = DiskImageView<PixelGray<float>>(opt.right_image);
+    }
+    sw.stop();
+    double load_time = sw.elapsed_seconds();
+    vw_out() << "Image size: " << left.cols() << " x " << left.rows() << "\n";
+    vw_out() << "Load time (seconds): " << load_time << "\n";
+
+    std::vector<BenchResult> results;
+    for (size_t a = 0; a < opt.algorithms.size(); a++) {
+      if (opt.algorithms[a].empty())
+        continue;
+      for (size_t t = 0; t < opt.tile_sizes.size(); t++) {
+        for (size_t h = 0; h < opt.threads.size(); h++) {
+          vw_out() << "Running " << opt.algorithms[a] << " with tile size "
+                   << opt.tile_sizes[t] << " and " << opt.threads[h] << " threads.\n";
+          results.push_back(run_one(opt, opt.algorithms[a], opt.tile_sizes[t],
+                                    opt.threads[h], load_time, left, right,
+                                    is_synthetic));
+        }
+      }
+    }
+
+    // Print the results, and save them in CSV format if asked
+    std::ostringstream os;
+    os << "# algorithm,tile_size,threads,load_seconds,corr_seconds,pixels_per_second,"
+       << "peak_rss_mb,valid_fraction,accurate_fraction\n";
+    for (size_t it = 0; it < results.size(); it++) {
+      BenchResult const& r = results[it];
+      os << r.algorithm << "," << r.tile_size << "," << r.threads << ","
+         << std::setprecision(6) << r.load_time << "," << r.corr_time << ","
+         << r.pixels_per_sec << "," << r.peak_rss << "," << r.valid_frac << ","
+         << r.accurate_frac << "\n";
+    }
+    vw_out() << os.str();
+
+    if (!opt.output_file.empty()) {
+      vw::create_out_dir(opt.output_file);
+      vw_out() << "Writing: " << opt.output_file << "\n";
+      std::ofstream ofs(opt.output_file.c_str());
+      ofs << os.str();
+    }
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
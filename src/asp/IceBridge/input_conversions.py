@@ -270,14 +270,19 @@ def correctFireballDems(fireballFolder, corrFireballFolder, startFrame, stopFram
 
     return (not badFiles)
             
-def getCalibrationFileForFrame(cameraLoopkupFile, inputCalFolder, frame, yyyymmdd, site, logger):
-    '''Return the camera model file to be used with a given input frame.'''
+# The entries of the camera lookup files for each site and date, so
+# that each file is parsed once rather than once per frame.
+cameraLookupCache = {}
 
-    # To manually force a certain camera file, use this spot!
-    #name = 'IODCC0_2015_GR_NASA_DMS20.tsai'
-    #return os.path.join(inputCalFolder, name)
+def readCameraLookupEntries(cameraLoopkupFile, yyyymmdd, site):
+    '''Return the list of (startRange, stopRange, camera) from the lookup file for
+       this site and date, in file order. The range is None for the default camera.'''
 
-    camera = ''
+    key = (os.path.abspath(cameraLoopkupFile), yyyymmdd, site)
+    if key in cameraLookupCache:
+        return cameraLookupCache[key]
+
+    entries = []
     
     # Iterate through lines in lookup file
     with open(cameraLoopkupFile, "r") as cf:
@@ -301,17 +306,30 @@ def getCalibrationFileForFrame(cameraLoopkupFile, inputCalFolder, frame, yyyymmd
             m = re.match("^.*?frames\s+(\d+)-(\d+)", line)
             if not m:
                 # The default camera, it is always before the backup one in the list.
-                # So this map must not be populated yet with this key.
-                camera = curr_camera
+                entries.append((None, None, curr_camera))
             else:
                 # The backup camera for a range
-                startRange = int(m.group(1))
-                stopRange  = int(m.group(2))
-                if (frame >= startRange) and (frame <= stopRange):
-                    camera = curr_camera
+                entries.append((int(m.group(1)), int(m.group(2)), curr_camera))
 
             # TODO: Modify file format so each flight has all info on a single line!
-            #break # Each frame will match only one line
+
+    cameraLookupCache[key] = entries
+    return entries
+
+def getCalibrationFileForFrame(cameraLoopkupFile, inputCalFolder, frame, yyyymmdd, site, logger):
+    '''Return the camera model file to be used with a given input frame.'''
+
+    # To manually force a certain camera file, use this spot!
+    #name = 'IODCC0_2015_GR_NASA_DMS20.tsai'
+    #return os.path.join(inputCalFolder, name)
+
+    camera = ''
+    for (startRange, stopRange, curr_camera) in \
+            readCameraLookupEntries(cameraLoopkupFile, yyyymmdd, site):
+        if startRange is None:
+            camera = curr_camera
+        elif (frame >= startRange) and (frame <= stopRange):
+            camera = curr_camera
 
     if camera == "":
         logger.error('Failed to parse the camera.')
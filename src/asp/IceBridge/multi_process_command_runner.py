@@ -16,7 +16,9 @@
 #  limitations under the License.
 # __END_LICENSE__
 
-import os, sys, argparse, multiprocessing
+import os, sys, argparse, multiprocessing, threading, time
+import multiprocessing.pool
+import psutil
 
 # The path to the ASP python files
 basepath    = os.path.abspath(sys.path[0])
@@ -43,12 +45,43 @@ os.environ["PATH"] = toolspath   + os.pathsep + os.environ["PATH"]
    First argument is the input file containing the commands to run.
    Second argument is the number of parallel processes to use.
    Third argument (optional) is the starting line.
-   Fourth argument (optional) is the stopping line (not processed).'''
-
-def runCommand(command):
+   Fourth argument (optional) is the stopping line (not processed).
+
+   The commands are run from a pool of threads, as each one runs in
+   its own process anyway. A command is not started while the memory
+   in use is above the given limit. With a checkpoint file, the
+   commands which succeeded are recorded there, and are skipped
+   when the runner is started again.'''
+
+# Serializes the writes to the checkpoint file
+checkpointLock = threading.Lock()
+
+def readCheckpoint(checkpointPath):
+    '''Return the set of commands recorded as done.'''
+    done = set()
+    if checkpointPath is not None and os.path.exists(checkpointPath):
+        with open(checkpointPath, 'r') as f:
+            for line in f:
+                line = line.strip()
+                if line != "":
+                    done.add(line)
+    return done
+
+def runCommand(command, maxMemoryPercent, checkpointPath):
     '''Run one of the commands from the file'''
+
+    # Wait until starting one more command would likely not run out of memory
+    SLEEP_TIME = 10
+    while psutil.virtual_memory().percent > maxMemoryPercent:
+        time.sleep(SLEEP_TIME)
+    
     print(command)
-    os.system(command)  
+    status = os.system(command)
+
+    if status == 0 and checkpointPath is not None:
+        with checkpointLock:
+            with open(checkpointPath, 'a') as f:
+                f.write(command.strip() + '\n')
 
 def main(argsIn):
 
@@ -77,6 +110,15 @@ def main(argsIn):
         parser.add_argument("--force-redo-these-frames",  dest="redoFrameList", default="",
                           help="For each frame in this file (stored one per line) within the current frame range, delete the batch folder and redo the batch.")
 
+        parser.add_argument("--max-memory-percent", dest="maxMemoryPercent", type=float,
+                            default=90.0,
+                            help="Do not start a command while more than this percent " + \
+                            "of the memory is in use.")
+
+        parser.add_argument("--checkpoint-file", dest="checkpointPath", default=None,
+                            help="Record in this file the commands that succeeded, " + \
+                            "and skip those when run again.")
+
         options = parser.parse_args(argsIn)
         
     except argparse.ArgumentError as msg:
@@ -93,10 +135,19 @@ def main(argsIn):
 
     # TODO: Write to a log?
 
-    print('Starting processing pool with ' + str(options.numProcesses) +' processes.')
-    pool = multiprocessing.Pool(options.numProcesses)
+    numThreads = options.numProcesses
+    if numThreads <= 0:
+        numThreads = multiprocessing.cpu_count()
+    print('Starting processing pool with ' + str(numThreads) +' threads.')
+    pool = multiprocessing.pool.ThreadPool(numThreads)
     taskHandles = []
 
+    doneCommands = readCheckpoint(options.checkpointPath)
+    if len(doneCommands) > 0:
+        print('Will skip ' + str(len(doneCommands)) + ' commands recorded as done in ' +
+              options.checkpointPath)
+    taskArgs = (options.maxMemoryPercent, options.checkpointPath)
+
     framesToDo = set()
     if options.redoFrameList != "" and os.path.exists(options.redoFrameList):
         with open(options.redoFrameList, 'r') as f:
@@ -121,8 +172,10 @@ def main(argsIn):
 
         # If the frame range is turned off, just run the commands as-is.
         if (options.startFrame < 0 and options.stopFrame < 0):
+            if line.strip() in doneCommands:
+                continue
             # Add the command to the task pool
-            taskHandles.append(pool.apply_async(runCommand, (line,)))
+            taskHandles.append(pool.apply_async(runCommand, (line,) + taskArgs))
             continue
         
         (begFrame, endFrame) = icebridge_common.getFrameRangeFromBatchFolder(line)
@@ -146,9 +199,12 @@ def main(argsIn):
                 else:
                     print("Will skip frame: " + str(begFrame))
                     continue
+            elif line.strip() in doneCommands:
+                # Done before, and not asked to be redone
+                continue
 
             # Add the command to the task pool
-            taskHandles.append(pool.apply_async(runCommand, (line,)))
+            taskHandles.append(pool.apply_async(runCommand, (line,) + taskArgs))
 
     # Wait for all the tasks to complete
     print('Finished adding ' + str(len(taskHandles)) + ' tasks to the pool.')
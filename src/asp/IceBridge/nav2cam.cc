@@ -50,6 +50,7 @@
 #include <vw/Math/Matrix.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
+#include <vw/Core/ThreadPool.h>
 #include <ctime>
 #include <stdlib.h>
 
@@ -483,14 +484,32 @@ void print_matrix(Matrix3x3 const& m) {
 }
 
 
+/// Write a camera model in the background
+class WriteCameraTask : public vw::Task, private boost::noncopyable {
+  PinholeModel m_camera_model;
+  std::string  m_output_camera;
+public:
+  WriteCameraTask(PinholeModel const& camera_model, std::string const& output_camera):
+    m_camera_model(camera_model), m_output_camera(output_camera) {}
+  void operator()() {
+    try {
+      m_camera_model.write(m_output_camera);
+    } catch (std::exception const& e) {
+      vw_out() << "Failed to write " << m_output_camera << ": " << e.what() << "\n";
+    }
+  }
+};
+
 /// Helper function to write out the camera model once we have the position and pose.
 /// - This also adds the important row-direction flip from the camera to the image.
+/// - The camera is written by the queue.
 void write_output_camera(Vector3 const& center, Matrix3x3 const& pose,
-                         std::string const& input_cam, 
-                         std::string const& output_camera) {
+                         PinholeModel const& input_model, 
+                         std::string const& output_camera,
+                         FifoWorkQueue & queue) {
                          
-  // Load the reference pinhole model, update it, and write it out to disk.
-  PinholeModel camera_model(input_cam);
+  // Update a copy of the reference pinhole model, and write it out to disk.
+  PinholeModel camera_model(input_model);
   camera_model.set_camera_center(center);
   camera_model.set_camera_pose(pose);
   //vw_out() << "Writing: " << output_camera << std::endl;
@@ -510,7 +529,8 @@ void write_output_camera(Vector3 const& center, Matrix3x3 const& pose,
   pose_flip(2,1) *= -1;
   camera_model.set_camera_pose(pose_flip);
   */
-  camera_model.write(output_camera);
+  queue.add_task(boost::shared_ptr<WriteCameraTask>
+                 (new WriteCameraTask(camera_model, output_camera)));
 }
 
 // ================================================================================
@@ -537,6 +557,10 @@ int main(int argc, char* argv[]) {
   
     const boost::filesystem::path output_dir(opt.output_folder);
   
+    // The intrinsics of all cameras. The cameras are written in parallel.
+    PinholeModel input_model(opt.input_cam);
+    FifoWorkQueue write_queue(vw_settings().default_num_threads());
+
     // Initialize the nav interpolator
     std::cout << "Opening input stream: " << opt.nav_file << std::endl;
     ScrollingNavInterpolator interpLoader(opt.nav_file, datum_wgs84);
@@ -769,7 +793,7 @@ int main(int argc, char* argv[]) {
         //write_output_camera(gcc_interp, M4, opt.input_cam, var_path + "batch_06420_06421_2M4.tsai");
 
         write_output_camera(gcc_interp, M3,
-                            opt.input_cam, output_camera_path.string());
+                            input_model, output_camera_path.string(), write_queue);
 
         //std::cout << std::endl << "NED matrix " << std::endl;
         //print_matrix(ned_matrix);
@@ -843,6 +867,7 @@ int main(int argc, char* argv[]) {
       } // End loop through ortho files
     
     } // End loop through nav batches
+    write_queue.join_all();
   
     vw_out() << "Finished looping through the nav file.\n";
     /*
@@ -25,6 +25,12 @@
 // opt.reference_dem, we assume for now that the image is mapprojected
 // onto the datum. Save on output a gcp file, that may be used to further
 // refine the camera using bundle_adjust.
+//
+// With --frame-list, many frames are solved in one run. The reference
+// DEM is then opened once for all of them. Interest points are found
+// for one frame at a time, as that uses all threads and the global
+// stereo settings, while the cameras of the frames whose interest
+// points were found are solved for in a pool of threads.
 #include <asp/Core/Macros.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -33,8 +39,12 @@
 #include <asp/Core/InterestPointMatching.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Cartography/GeoTransform.h>
+#include <vw/Core/ThreadPool.h>
 #include <boost/core/null_deleter.hpp>
 
+#include <mutex>
+#include <sstream>
+
 
 // Turn off warnings from eigen
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -70,7 +80,8 @@ typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
 
 
 struct Options : public vw::GdalWriteOptions {
-  std::string raw_image, ortho_image, input_cam, output_cam, reference_dem, camera_estimate;
+  std::string raw_image, ortho_image, input_cam, output_cam, reference_dem, camera_estimate,
+    frame_list;
   double camera_height, orthoimage_height, ip_inlier_factor, max_translation;
   int    ip_per_tile, ip_detect_method, min_ip;
   bool   individually_normalize, keep_match_file, write_gcp_file, skip_image_normalization, 
@@ -82,6 +93,24 @@ struct Options : public vw::GdalWriteOptions {
              ip_detect_method(0), individually_normalize(false), keep_match_file(false){}
 };
 
+/// The reference DEM, opened once and shared by all frames
+struct ReferenceDem {
+  ImageViewRef< PixelMask<float> > dem;
+  vw::cartography::GeoReference    georef;
+};
+
+/// A frame whose interest points were found, with what is needed to
+/// solve for its camera.
+struct Frame {
+  Options opt;
+  vw::cartography::GeoReference ortho_georef, dem_georef;
+  ImageViewRef< PixelMask<float> > dem;
+  bool has_ref_dem;
+  double cam_height;
+  std::string match_filename;
+  boost::shared_ptr<CameraModel> cam;
+};
+
 /// Record a set of IP results as ground control points
 void write_gcp_file(Options const& opt, 
                     std::vector<Vector3> const& llh_pts,
@@ -280,27 +309,34 @@ int solve_for_cam_adjust(boost::shared_ptr<PinholeModel> camera_model,
 
    
 /// Load the DEM and adjust some options depending on DEM statistics.
-void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const& rsrc_ortho,
-                        vw::cartography::GeoReference const& ortho_georef,
-                        ImageViewRef< PixelMask<float> > &dem,
-                        vw::cartography::GeoReference &dem_georef,
-                        bool &elevation_change_present) {
+void open_reference_dem(std::string const& reference_dem, ReferenceDem & ref_dem) {
 
   // Set up the DEM if it was provided.
   float dem_nodata = -std::numeric_limits<float>::max();
 
-  bool is_good = vw::cartography::read_georeference(dem_georef, opt.reference_dem);
+  bool is_good = vw::cartography::read_georeference(ref_dem.georef, reference_dem);
   if (!is_good) {
     vw_throw(ArgumentErr() << "Error: Cannot read georeference from: "
-                           << opt.reference_dem << ".\n");
+                           << reference_dem << ".\n");
   }
 
   {
     // Read the no-data
-    DiskImageResourceGDAL rsrc(opt.reference_dem);
+    DiskImageResourceGDAL rsrc(reference_dem);
     if (rsrc.has_nodata_read()) dem_nodata = rsrc.nodata_read();
   }
 
+  ref_dem.dem = create_mask(DiskImageView<float>(reference_dem), dem_nodata);
+}
+
+void load_reference_dem(Options &opt, ReferenceDem const& ref_dem,
+                        boost::shared_ptr<DiskImageResource> const& rsrc_ortho,
+                        vw::cartography::GeoReference const& ortho_georef,
+                        ImageViewRef< PixelMask<float> > &dem,
+                        vw::cartography::GeoReference &dem_georef,
+                        bool &elevation_change_present) {
+
+  dem_georef = ref_dem.georef;
 
   bool crop_is_success = false;
   if (opt.crop_reference_dem){
@@ -310,8 +346,7 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
     DiskImageView<float> tmp_ortho(rsrc_ortho);
     BBox2 ortho_bbox = bounding_box(tmp_ortho);
 
-    DiskImageView<float> tmp_dem(opt.reference_dem);
-    BBox2 dem_bbox = bounding_box(tmp_dem);
+    BBox2 dem_bbox = bounding_box(ref_dem.dem);
     
     // The GeoTransform will hide the messy details of conversions
     vw::cartography::GeoTransform geotrans(dem_georef, ortho_georef, dem_bbox, ortho_bbox);
@@ -331,8 +366,8 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
       crop_box.crop(dem_bbox);
       
       if (!crop_box.empty()) {
-        ImageView<float> cropped_dem = crop(DiskImageView<float>(opt.reference_dem), crop_box);
-        dem = create_mask(cropped_dem, dem_nodata);
+        ImageView< PixelMask<float> > cropped_dem = crop(ref_dem.dem, crop_box);
+        dem = cropped_dem;
         dem_georef = crop(dem_georef, crop_box);
         crop_is_success = true;
       }
@@ -343,7 +378,7 @@ void load_reference_dem(Options &opt, boost::shared_ptr<DiskImageResource> const
   
   // Default behavior  
   if (!crop_is_success)
-    dem = create_mask(DiskImageView<float>(opt.reference_dem), dem_nodata);
+    dem = ref_dem.dem;
 
   
   // Get an estimate of the elevation range in the input image
@@ -636,8 +671,14 @@ double refine_camera_with_dem_pts(Options const& opt,
 } // End function refine_camera_with_dem_pts
 
 
-// Primary task-solving function.
-void ortho2pinhole(Options & opt){
+// Find the interest points between the raw image and the ortho image
+// of a frame. This changes the global stereo settings.
+void prepare_frame(ReferenceDem const& ref_dem, Frame & frame) {
+
+  Options & opt = frame.opt;
+  vw::cartography::GeoReference & ortho_georef = frame.ortho_georef;
+  vw::cartography::GeoReference & dem_georef   = frame.dem_georef;
+  ImageViewRef< PixelMask<float> > & dem       = frame.dem;
 
   // Input image handles
   boost::shared_ptr<DiskImageResource>
@@ -647,7 +688,6 @@ void ortho2pinhole(Options & opt){
     vw_throw(ArgumentErr() << "Error: Input images can only have a single channel!\n\n");
 
   // Load GeoRef from the ortho image
-  vw::cartography::GeoReference ortho_georef;
   bool is_good = vw::cartography::read_georeference(ortho_georef, opt.ortho_image);
   if (!is_good) {
     vw_throw(ArgumentErr() << "Error: Cannot read georeference from: "
@@ -655,12 +695,11 @@ void ortho2pinhole(Options & opt){
   }
 
   // Set up the DEM if it was provided.
-  ImageViewRef< PixelMask<float> > dem;
-  vw::cartography::GeoReference dem_georef;
-  bool has_ref_dem = (opt.reference_dem != "");
+  frame.has_ref_dem = (opt.reference_dem != "");
   bool elevation_change_present = false;
-  if (has_ref_dem) {
-    load_reference_dem(opt, rsrc_ortho, ortho_georef, dem, dem_georef, elevation_change_present);
+  if (frame.has_ref_dem) {
+    load_reference_dem(opt, ref_dem, rsrc_ortho, ortho_georef, dem, dem_georef,
+                       elevation_change_present);
   }
   
 
@@ -677,14 +716,27 @@ void ortho2pinhole(Options & opt){
   }
 
   // Load camera and find IP
-  std::string match_filename = opt.output_cam + ".match";
-  boost::shared_ptr<CameraModel> cam;
-  load_camera_and_find_ip(opt, rsrc_raw, rsrc_ortho, match_filename, cam);
+  frame.match_filename = opt.output_cam + ".match";
+  load_camera_and_find_ip(opt, rsrc_raw, rsrc_ortho, frame.match_filename, frame.cam);
 
   // The ortho image file must have the height of the camera above the ground.
   // This can be over-written from the command line.
-  double cam_height = get_cam_height_estimate(opt);
-  vw_out() << "Using estimated cam height: " << cam_height << std::endl;
+  frame.cam_height = get_cam_height_estimate(opt);
+  vw_out() << "Using estimated cam height: " << frame.cam_height << std::endl;
+}
+
+// Solve for the camera of a frame whose interest points were
+// found. Frames can be solved for in parallel.
+void solve_frame(Frame & frame) {
+
+  Options & opt = frame.opt;
+  vw::cartography::GeoReference const& ortho_georef = frame.ortho_georef;
+  vw::cartography::GeoReference const& dem_georef   = frame.dem_georef;
+  ImageViewRef< PixelMask<float> > const& dem       = frame.dem;
+  bool has_ref_dem                    = frame.has_ref_dem;
+  double cam_height                   = frame.cam_height;
+  std::string const& match_filename   = frame.match_filename;
+  boost::shared_ptr<CameraModel> cam  = frame.cam;
 
   std::vector<vw::ip::InterestPoint> raw_ip, ortho_ip;
   ip::read_binary_match_file(match_filename, raw_ip, ortho_ip);
@@ -878,6 +930,46 @@ void ortho2pinhole(Options & opt){
   }
 }  
 
+/// Solve for the camera of a frame in the background
+class SolveFrameTask : public vw::Task, private boost::noncopyable {
+  boost::shared_ptr<Frame> m_frame;
+  std::mutex             & m_mutex;
+  int                    & m_num_failed;
+public:
+  SolveFrameTask(boost::shared_ptr<Frame> frame, std::mutex & mutex, int & num_failed):
+    m_frame(frame), m_mutex(mutex), m_num_failed(num_failed) {}
+  void operator()() {
+    try {
+      solve_frame(*m_frame);
+    } catch (std::exception const& e) {
+      vw_out() << "Failed to create camera " << m_frame->opt.output_cam << ": "
+               << e.what() << "\n";
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_num_failed++;
+    }
+  }
+};
+
+/// Copy the camera position and pose from the estimate camera to the
+/// input camera, rather than using the ortho image.
+void short_circuit_camera(Options const& opt) {
+  vw_out() << "Creating camera without using ortho image.\n";
+
+  // Load input camera files
+  vw_out() << "Loading: " << opt.input_cam << std::endl;
+  PinholeModel input_cam(opt.input_cam);
+  vw_out() << "Loading: " << opt.camera_estimate << std::endl;
+  PinholeModel est_cam(opt.camera_estimate);
+
+  // Copy camera position and pose from estimate camera to input camera
+  input_cam.set_camera_center(est_cam.camera_center());
+  input_cam.set_camera_pose  (est_cam.camera_pose  ());
+
+  // Write to output camera
+  vw_out() << "Writing: " << opt.output_cam << std::endl;
+  input_cam.write(opt.output_cam);
+}
+
 /// If an rgb input image was passed in, convert to a temporary grayscale
 ///  image and work on that instead.
 /// - This is useful for the Icebridge case.
@@ -908,6 +1000,91 @@ std::string handle_rgb_input(std::string const& input_path, Options const& opt)
 
 }
 
+/// Read the frames from the list. Each line has the raw image, the
+/// ortho image, the input camera, the output camera, and optionally
+/// the camera estimate.
+void read_frame_list(Options const& opt, std::vector<Options> & frames) {
+  std::ifstream ifs(opt.frame_list.c_str());
+  if (!ifs.good())
+    vw_throw( ArgumentErr() << "Could not read the frame list: " << opt.frame_list << "\n" );
+
+  std::string line;
+  while (std::getline(ifs, line)) {
+    std::vector<std::string> tokens;
+    std::istringstream is(line);
+    std::string token;
+    while (is >> token)
+      tokens.push_back(token);
+    if (tokens.empty())
+      continue;
+    if (tokens.size() != 4 && tokens.size() != 5)
+      vw_throw( ArgumentErr() << "Expecting 4 or 5 values in line: " << line << "\n" );
+
+    Options frame = opt;
+    frame.raw_image   = tokens[0];
+    frame.ortho_image = tokens[1];
+    frame.input_cam   = tokens[2];
+    frame.output_cam  = tokens[3];
+    if (tokens.size() == 5) {
+      frame.camera_estimate = tokens[4];
+      if (!boost::filesystem::exists(frame.camera_estimate))
+        vw_throw( ArgumentErr() << "Estimated camera file " << frame.camera_estimate
+                  << " does not exist!\n");
+    }
+    if (frame.short_circuit && frame.camera_estimate == "")
+      vw_throw( ArgumentErr() << "Estimated camera file is required with the "
+                << "short-circuit option, in line: " << line << "\n");
+    frames.push_back(frame);
+  }
+}
+
+/// Create the cameras for all frames in the list. A frame that fails
+/// does not stop the others.
+void ortho2pinhole_frames(Options const& opt) {
+
+  std::vector<Options> frames;
+  read_frame_list(opt, frames);
+  vw_out() << "Read " << frames.size() << " frames from " << opt.frame_list << std::endl;
+
+  ReferenceDem ref_dem;
+  if (opt.reference_dem != "")
+    open_reference_dem(opt.reference_dem, ref_dem);
+
+  // Finding the interest points for a frame may change this
+  double epipolar_threshold = asp::stereo_settings().epipolar_threshold;
+
+  std::mutex mutex;
+  int num_failed = 0;
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (size_t it = 0; it < frames.size(); it++) {
+    boost::shared_ptr<Frame> frame(new Frame);
+    frame->opt = frames[it];
+    try {
+      vw::create_out_dir(frame->opt.output_cam);
+      if (frame->opt.short_circuit) {
+        short_circuit_camera(frame->opt);
+        continue;
+      }
+      frame->opt.raw_image   = handle_rgb_input(frame->opt.raw_image,   frame->opt);
+      frame->opt.ortho_image = handle_rgb_input(frame->opt.ortho_image, frame->opt);
+      asp::stereo_settings().epipolar_threshold = epipolar_threshold;
+      prepare_frame(ref_dem, *frame);
+    } catch (std::exception const& e) {
+      vw_out() << "Failed to create camera " << frame->opt.output_cam << ": "
+               << e.what() << "\n";
+      std::lock_guard<std::mutex> lock(mutex);
+      num_failed++;
+      continue;
+    }
+    queue.add_task(boost::shared_ptr<SolveFrameTask>
+                   (new SolveFrameTask(frame, mutex, num_failed)));
+  }
+  queue.join_all();
+
+  vw_out() << "Created " << int(frames.size()) - num_failed << " of "
+           << frames.size() << " cameras.\n";
+}
+
 void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description general_options("");
   general_options.add_options()
@@ -942,7 +1119,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("reference-dem",             po::value(&opt.reference_dem)->default_value(""),
      "If provided, extract from this DEM the heights above the ground rather than assuming the value in --orthoimage-height.")
     ("crop-reference-dem", po::bool_switch(&opt.crop_reference_dem)->default_value(false)->implicit_value(true),
-     "Crop the reference DEM to a generous area to make it faster to load.");
+     "Crop the reference DEM to a generous area to make it faster to load.")
+    ("frame-list", po::value(&opt.frame_list)->default_value(""),
+     "Create the cameras for the frames in this file, instead of for the images on the command line. Each line has the raw image, ortho image, input camera, output camera, and optionally the camera estimate. The cameras are solved for in parallel with --threads threads, and the reference DEM is loaded once.");
 
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
   
@@ -959,7 +1138,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   positional_desc.add("input-cam",  1);
   positional_desc.add("output-cam", 1);
 
-  std::string usage("<raw image> <ortho image> <input pinhole cam> <output pinhole cam> [options]");
+  std::string usage("<raw image> <ortho image> <input pinhole cam> <output pinhole cam> [options]\n"
+                    "  or: --frame-list <frames.txt> [options]");
   bool allow_unregistered = false;
   std::vector<std::string> unregistered;
   po::variables_map vm =
@@ -972,6 +1152,17 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   asp::stereo_settings().individually_normalize   = opt.individually_normalize;
   asp::stereo_settings().skip_image_normalization = opt.skip_image_normalization;
   asp::stereo_settings().ip_inlier_factor         = opt.ip_inlier_factor;
+
+  if (!opt.frame_list.empty()) {
+    // The images and cameras are read from the list
+    if (!opt.raw_image.empty())
+      vw_throw( ArgumentErr() << "The images and cameras cannot be set both on the "
+                << "command line and with --frame-list.\n" );
+    if (opt.camera_estimate != "")
+      vw_throw( ArgumentErr() << "With --frame-list, the camera estimates must be in the list.\n" );
+    asp::log_to_file(argc, argv, "", opt.frame_list);
+    return;
+  }
   
   if ( opt.raw_image.empty() )
     vw_throw( ArgumentErr() << "Missing input raw image.\n" << usage << general_options );
@@ -1009,30 +1200,28 @@ int main(int argc, char* argv[]) {
   Options opt;
   try {
     handle_arguments( argc, argv, opt );
+
+    if (!opt.frame_list.empty()) {
+      ortho2pinhole_frames(opt);
+      return 0;
+    }
    
     if (opt.short_circuit) {
-      vw_out() << "Creating camera without using ortho image.\n";
-  
-      // Load input camera files
-      vw_out() << "Loading: " << opt.input_cam << std::endl;
-      PinholeModel input_cam(opt.input_cam);
-      vw_out() << "Loading: " << opt.camera_estimate << std::endl;
-      PinholeModel est_cam(opt.camera_estimate);
-    
-      // Copy camera position and pose from estimate camera to input camera
-      input_cam.set_camera_center(est_cam.camera_center());
-      input_cam.set_camera_pose  (est_cam.camera_pose  ());
-    
-      // Write to output camera
-      vw_out() << "Writing: " << opt.output_cam << std::endl;
-      input_cam.write(opt.output_cam);
+      short_circuit_camera(opt);
       return 0;
     }
   
     opt.raw_image   = handle_rgb_input(opt.raw_image,   opt);
     opt.ortho_image = handle_rgb_input(opt.ortho_image, opt);
-  
-    ortho2pinhole(opt);
+
+    ReferenceDem ref_dem;
+    if (opt.reference_dem != "")
+      open_reference_dem(opt.reference_dem, ref_dem);
+
+    Frame frame;
+    frame.opt = opt;
+    prepare_frame(ref_dem, frame);
+    solve_frame(frame);
   } ASP_STANDARD_CATCHES;
   return 0;
 }
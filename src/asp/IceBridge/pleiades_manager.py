@@ -607,6 +607,10 @@ def submitBatchJobs(run, options, batchListPath, logger):
             args += ' --force-redo-these-frames ' + options.redoFrameList
         
         logPrefix = os.path.join(pbsLogFolder, 'batch_' + jobName)
+
+        # If the job is resubmitted, do not launch again the batches which succeeded
+        args += ' --checkpoint-file ' + logPrefix + '_done.txt'
+
         logger.info('Submitting DEM creation job: ' + scriptPath + ' ' + args)
         pythonPath = asp_system_utils.which('python')
         jobID = pbs_functions.submitJob(jobName, BATCH_PBS_QUEUE, maxHours, logger,
@@ -31,10 +31,18 @@
 #include <vw/Image/PixelTypeInfo.h>
 #include <asp/IsisIO/DiskImageResourceIsis.h>
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <Cube.h>
+#include <IString.h>
 #include <Portal.h>
+#include <Pvl.h>
+#include <PvlObject.h>
 #include <SpecialPixel.h>
 
 using namespace std;
@@ -42,12 +50,93 @@ using namespace boost;
 
 namespace vw {
 
-  // We use a fixed tile size of 2048x2048 pixels here.  Although this
-  // may not be the native tile size of the ISIS cube, it seems to be
-  // much faster to let the ISIS driver aggregate smaller blocks by
-  // making a larger request rather than caching those blocks ourselves.
+  namespace {
+
+    // The blocks read from ISIS cubes, as raw pixels stored row by
+    // row. These are shared by all resources in the process, so
+    // several views of the same cube, as made by stereo_pprc and
+    // mapproject, read each block from disk once. The least recently
+    // used blocks are dropped past this much memory.
+    const size_t MAX_ISIS_CACHE_BYTES = size_t(256) * 1024 * 1024;
+
+    // The aggregated blocks have about this many pixels on a side
+    const int ISIS_READ_BLOCK_SIZE = 2048;
+
+    struct BlockKey {
+      std::string filename;
+      int col, row;
+      bool operator<(BlockKey const& other) const {
+        if (filename != other.filename) return filename < other.filename;
+        if (col      != other.col)      return col      < other.col;
+        return row < other.row;
+      }
+    };
+
+    typedef boost::shared_ptr<std::vector<uint8> const> BlockPtr;
+
+    class IsisBlockCache {
+    public:
+      IsisBlockCache(): m_use_count(0), m_num_bytes(0) {}
+
+      BlockPtr find(BlockKey const& key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_blocks.find(key);
+        if (it == m_blocks.end())
+          return BlockPtr();
+        it->second.last_use = m_use_count++;
+        return it->second.data;
+      }
+
+      void insert(BlockKey const& key, BlockPtr const& data) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        CachedBlock & c = m_blocks[key];
+        if (c.data)
+          m_num_bytes -= c.data->size(); // read twice by different threads
+        c.data     = data;
+        c.last_use = m_use_count++;
+        m_num_bytes += data->size();
+        // There are at most a few dozen blocks
+        while (m_num_bytes > MAX_ISIS_CACHE_BYTES && m_blocks.size() > 1) {
+          auto oldest = m_blocks.begin();
+          for (auto it = m_blocks.begin(); it != m_blocks.end(); it++) {
+            if (it->second.last_use < oldest->second.last_use)
+              oldest = it;
+          }
+          m_num_bytes -= oldest->second.data->size();
+          m_blocks.erase(oldest);
+        }
+      }
+
+    private:
+      struct CachedBlock {
+        BlockPtr  data;
+        long long last_use;
+      };
+      std::mutex                       m_mutex;
+      std::map<BlockKey, CachedBlock>  m_blocks;
+      long long                        m_use_count;
+      size_t                           m_num_bytes;
+    };
+
+    IsisBlockCache & isis_block_cache() {
+      static IsisBlockCache cache;
+      return cache;
+    }
+  }
+
+  // Reading ISIS cubes in blocks that do not match their tiles makes
+  // the ISIS driver read the same tiles many times, so the blocks are
+  // made of whole tiles. A band-sequential cube is read in strips of
+  // whole lines, which are contiguous on disk.
   Vector2i DiskImageResourceIsis::block_read_size() const {
-    return Vector2i(2048,2048);
+    Vector2i tile = m_native_block_size;
+    int cols = tile.x();
+    if (cols < ISIS_READ_BLOCK_SIZE)
+      cols *= ISIS_READ_BLOCK_SIZE / cols;
+    cols = std::max(std::min(cols, m_format.cols), 1);
+    int rows = (ISIS_READ_BLOCK_SIZE * ISIS_READ_BLOCK_SIZE / cols) / tile.y() * tile.y();
+    rows = std::max(std::min(std::max(rows, tile.y()), m_format.rows), 1);
+    return Vector2i(cols, rows);
   }
 
   /// Bind the resource to a file for writing.
@@ -102,25 +191,76 @@ namespace vw {
       default:
         vw_throw(IOErr() << "DiskImageResourceIsis: Unknown pixel type.");
     }
+
+    // The tiles in which the cube is stored
+    m_native_block_size = Vector2i(m_format.cols, 1);
+    if (m_cube->format() == Isis::Cube::Tile) {
+      Isis::PvlObject & core
+        = m_cube->label()->findObject("IsisCube").findObject("Core");
+      if (core.hasKeyword("TileSamples") && core.hasKeyword("TileLines"))
+        m_native_block_size = Vector2i(Isis::toInt(core["TileSamples"][0]),
+                                       Isis::toInt(core["TileLines"][0]));
+    }
+    if (m_native_block_size.x() <= 0 || m_native_block_size.y() <= 0)
+      m_native_block_size = Vector2i(m_format.cols, 1);
   }
 
   /// Read the disk image into the given buffer.
   void DiskImageResourceIsis::read(ImageBuffer const& dest, BBox2i const& bbox) const {
-    VW_ASSERT(bbox.max().x() <= m_cube->sampleCount() ||
-              bbox.max().y() <= m_cube->lineCount(),
+    BBox2i image_box(0, 0, m_cube->sampleCount(), m_cube->lineCount());
+    VW_ASSERT(image_box.contains(bbox),
               IOErr() << "DiskImageResourceIsis: requested bbox " << bbox
               << " exceeds image dimensions [" << m_cube->sampleCount()
               << " " << m_cube->lineCount() << "]");
+    if (bbox.empty())
+      return;
 
-    // Read in the requested tile from the cube file.  Note that ISIS
-    // cube pixel indices appear to be 1-based.
-    Isis::Portal buffer(bbox.width(), bbox.height(), m_cube->pixelType());
-    buffer.SetPosition(bbox.min().x()+1, bbox.min().y()+1, 1);
-    m_cube->read(buffer);
+    // Assemble the requested region from the blocks overlapping it,
+    // reading from the cube those not in the cache.
+    Vector2i block_size = block_read_size();
+    std::vector<uint8> data(size_t(bbox.width()) * bbox.height() * m_bytes_per_pixel);
+    for (int row = bbox.min().y() / block_size.y();
+         row * block_size.y() < bbox.max().y(); row++) {
+      for (int col = bbox.min().x() / block_size.x();
+           col * block_size.x() < bbox.max().x(); col++) {
+
+        BBox2i block_box(col * block_size.x(), row * block_size.y(),
+                         block_size.x(), block_size.y());
+        block_box.crop(image_box);
+
+        BlockKey key;
+        key.filename = m_filename;
+        key.col      = col;
+        key.row      = row;
+        BlockPtr block = isis_block_cache().find(key);
+        if (!block) {
+          // Note that ISIS cube pixel indices appear to be 1-based.
+          Isis::Portal buffer(block_box.width(), block_box.height(), m_cube->pixelType());
+          buffer.SetPosition(block_box.min().x()+1, block_box.min().y()+1, 1);
+          m_cube->read(buffer);
+          uint8 const* raw = static_cast<uint8 const*>(buffer.RawBuffer());
+          block = BlockPtr(new std::vector<uint8>
+                           (raw, raw + size_t(block_box.width()) * block_box.height()
+                            * m_bytes_per_pixel));
+          isis_block_cache().insert(key, block);
+        }
+
+        BBox2i common = block_box;
+        common.crop(bbox);
+        size_t row_bytes = size_t(common.width()) * m_bytes_per_pixel;
+        for (int y = common.min().y(); y < common.max().y(); y++) {
+          size_t src_pos = (size_t(y - block_box.min().y()) * block_box.width()
+                            + (common.min().x() - block_box.min().x())) * m_bytes_per_pixel;
+          size_t dst_pos = (size_t(y - bbox.min().y()) * bbox.width()
+                            + (common.min().x() - bbox.min().x())) * m_bytes_per_pixel;
+          std::memcpy(&data[dst_pos], &(*block)[src_pos], row_bytes);
+        }
+      }
+    }
 
     // Create generic image buffer from the Isis data.
     ImageBuffer src;
-    src.data = buffer.RawBuffer();
+    src.data = &data[0];
     src.format = m_format;
     src.format.cols = bbox.width();
     src.format.rows = bbox.height();
@@ -56,8 +56,17 @@ namespace vw {
     virtual bool has_block_read  () const {return true; }
     virtual bool has_nodata_read () const {return true; }
 
+    /// Whole native tiles of the cube, or whole lines if the cube is
+    /// not tiled, aggregated to blocks of about 2048 x 2048 pixels.
     virtual Vector2i block_read_size() const;
 
+    /// The size of the tiles in which the cube is stored. For a
+    /// band-sequential cube this is one line.
+    Vector2i native_block_size() const { return m_native_block_size; }
+
+    /// Read the disk image into the given buffer. The blocks of
+    /// block_read_size() that are read are kept in a cache shared with
+    /// all resources for the same cube.
     virtual void read (ImageBuffer const& dest, BBox2i const& bbox) const;
     virtual void write(ImageBuffer const& dest, BBox2i const& bbox);
     virtual void flush() {}
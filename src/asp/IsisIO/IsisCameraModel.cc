@@ -0,0 +1,90 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/IsisIO/IsisCameraModel.h>
+
+using namespace vw;
+using namespace vw::camera;
+
+IsisCameraModel::IsisCameraModel(std::string cube_filename):
+  m_interface(asp::isis::IsisInterface::open(cube_filename)),
+  m_cube_filename(cube_filename) {
+  m_thread_safe = m_interface->is_cached();
+  m_free.push_back(m_interface.get());
+}
+
+IsisCameraModel::~IsisCameraModel() {}
+
+int IsisCameraModel::num_interfaces() const {
+  std::lock_guard<std::mutex> lock(m_pool_mutex);
+  return m_pool.size() + 1;
+}
+
+IsisCameraModel::InterfaceLease::InterfaceLease(IsisCameraModel const& cam):
+  m_cam(cam), m_interface(NULL) {
+
+  if (!m_cam.m_thread_safe) {
+    m_serial_lock = std::unique_lock<std::mutex>(m_cam.m_serial_mutex);
+    m_interface = m_cam.m_interface.get();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_cam.m_pool_mutex);
+    if (!m_cam.m_free.empty()) {
+      m_interface = m_cam.m_free.back();
+      m_cam.m_free.pop_back();
+      return;
+    }
+  }
+
+  // All interfaces are in use. Open one more, without holding the
+  // pool lock, as this is slow.
+  boost::shared_ptr<asp::isis::IsisInterface>
+    new_interface(asp::isis::IsisInterface::open(m_cam.m_cube_filename));
+  m_interface = new_interface.get();
+  std::lock_guard<std::mutex> lock(m_cam.m_pool_mutex);
+  m_cam.m_pool.push_back(new_interface);
+}
+
+IsisCameraModel::InterfaceLease::~InterfaceLease() {
+  if (!m_cam.m_thread_safe)
+    return; // the serial lock is released on its own
+
+  std::lock_guard<std::mutex> lock(m_cam.m_pool_mutex);
+  m_cam.m_free.push_back(m_interface);
+}
+
+Vector2 IsisCameraModel::point_to_pixel(Vector3 const& point) const {
+  InterfaceLease lease(*this);
+  return lease->point_to_pixel(point);
+}
+
+Vector3 IsisCameraModel::pixel_to_vector(Vector2 const& pix) const {
+  InterfaceLease lease(*this);
+  return lease->pixel_to_vector(pix);
+}
+
+Vector3 IsisCameraModel::camera_center(Vector2 const& pix) const {
+  InterfaceLease lease(*this);
+  return lease->camera_center(pix);
+}
+
+Quat IsisCameraModel::camera_pose(Vector2 const& pix) const {
+  InterfaceLease lease(*this);
+  return lease->camera_pose(pix);
+}
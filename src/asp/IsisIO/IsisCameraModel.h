@@ -31,19 +31,31 @@
 // ASP
 #include <asp/IsisIO/IsisInterface.h>
 
+#include <mutex>
+#include <vector>
+
 namespace vw {
 namespace camera {
 
   // This is largely just a shortened reimplementation of ISIS's
   // Camera.cpp.
+
+  // An ISIS camera keeps the state of its last computation, so it
+  // cannot be shared among threads. This model keeps a pool of
+  // interfaces to the same cube, and each call to point_to_pixel(),
+  // pixel_to_vector(), camera_center(), and camera_pose() borrows one
+  // which is not in use, opening a new one if needed. Then these
+  // calls can run in parallel. This is done only if the SPICE data
+  // is cached in the camera, as NAIF is not thread-safe. Otherwise
+  // the calls are serialized.
   class IsisCameraModel : public CameraModel {
 
   public:
     //------------------------------------------------------------------
     // Constructors / Destructors
     //------------------------------------------------------------------
-    IsisCameraModel(std::string cube_filename) :
-      m_interface(asp::isis::IsisInterface::open( cube_filename )) {}
+    IsisCameraModel(std::string cube_filename);
+    virtual ~IsisCameraModel();
     virtual std::string type() const { return "Isis"; }
 
     //------------------------------------------------------------------
@@ -53,23 +65,26 @@ namespace camera {
     //  Computes the image of the point 'point' in 3D space on the
     //  image plane.  Returns a pixel location (col, row) where the
     //  point appears in the image.
-    virtual Vector2 point_to_pixel(Vector3 const& point) const {
-      return m_interface->point_to_pixel( point ); }
+    virtual Vector2 point_to_pixel(Vector3 const& point) const;
 
     // Returns a (normalized) pointing vector from the camera center
     //  through the position of the pixel 'pix' on the image plane.
-    virtual Vector3 pixel_to_vector (Vector2 const& pix) const {
-      return m_interface->pixel_to_vector( pix ); }
-
+    virtual Vector3 pixel_to_vector (Vector2 const& pix) const;
 
     // Returns the position of the focal point of the camera
-    virtual Vector3 camera_center(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_center( pix ); }
+    virtual Vector3 camera_center(Vector2 const& pix = Vector2() ) const;
 
     // Pose is a rotation which moves a vector in camera coordinates
     // into world coordinates.
-    virtual Quat camera_pose(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_pose( pix ); }
+    virtual Quat camera_pose(Vector2 const& pix = Vector2() ) const;
+
+    // If the camera can be used from several threads at once
+    bool is_thread_safe() const { return m_thread_safe; }
+
+    // How many interfaces to the cube were opened, including the
+    // initial one. This grows up to the number of threads using the
+    // camera at the same time.
+    int num_interfaces() const;
 
     // Returns the number of lines is the ISIS cube
     int lines() const { return m_interface->lines(); }
@@ -83,12 +98,14 @@ namespace camera {
 
     // Returns the ephemeris time for a pixel
     double ephemeris_time( Vector2 const& pix = Vector2() ) const {
-      return m_interface->ephemeris_time( pix );
+      InterfaceLease lease(*this);
+      return lease->ephemeris_time( pix );
     }
 
     // Sun position in the target frame's inertial frame
     Vector3 sun_position( Vector2 const& pix = Vector2() ) const {
-      return m_interface->sun_position( pix );
+      InterfaceLease lease(*this);
+      return lease->sun_position( pix );
     }
 
     // The three main radii that make up the spheroid. Z is out the polar region
@@ -109,6 +126,28 @@ namespace camera {
   protected:
     boost::shared_ptr<asp::isis::IsisInterface> m_interface;
 
+  private:
+
+    // Borrow an interface which is not in use, and give it back
+    // when going out of scope. If the camera is not thread-safe,
+    // this holds a lock and gives out the initial interface.
+    class InterfaceLease {
+    public:
+      InterfaceLease(IsisCameraModel const& cam);
+      ~InterfaceLease();
+      asp::isis::IsisInterface* operator->() const { return m_interface; }
+    private:
+      IsisCameraModel const& m_cam;
+      asp::isis::IsisInterface* m_interface;
+      std::unique_lock<std::mutex> m_serial_lock;
+    };
+
+    std::string m_cube_filename;
+    bool m_thread_safe;
+    mutable std::mutex m_pool_mutex, m_serial_mutex;
+    mutable std::vector<boost::shared_ptr<asp::isis::IsisInterface>> m_pool; // all but the first
+    mutable std::vector<asp::isis::IsisInterface*> m_free;
+
     friend std::ostream& operator<<( std::ostream&, IsisCameraModel const& );
   };
 
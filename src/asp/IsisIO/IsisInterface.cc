@@ -63,6 +63,8 @@ IsisInterface::IsisInterface(std::string const& file) {
 IsisInterface::~IsisInterface() {}
 
 IsisInterface* IsisInterface::open(std::string const& filename) {
+  std::lock_guard<std::mutex> lock(isis_create_mutex());
+
   // Opening Labels (This should be done somehow though labels)
   Isis::FileName ifilename(QString::fromStdString(filename));
   Isis::Pvl label;
@@ -143,6 +145,10 @@ std::string IsisInterface::target_name() const {
   return m_camera->target()->name().toStdString();
 }
 
+bool IsisInterface::is_cached() const {
+  return m_camera->isCached();
+}
+
 // Manufacture a datum
 vw::cartography::Datum IsisInterface::get_datum(bool use_sphere_for_non_earth) const {
       
@@ -181,3 +187,8 @@ bool asp::isis::IsisEnv() {
     return false;
   return true;
 }
+
+std::mutex & asp::isis::isis_create_mutex() {
+  static std::mutex create_mutex;
+  return create_mutex;
+}
@@ -35,6 +35,7 @@
 // Isis include
 #include <Cube.h>
 
+#include <mutex>
 #include <string>
 
 namespace Isis {
@@ -82,6 +83,10 @@ namespace isis {
     std::string target_name   () const;
     vw::cartography::Datum get_datum(bool use_sphere_for_non_earth) const;
 
+    // If the SPICE data is cached in the camera, so NAIF is not called
+    // when the camera is used, only when it is created.
+    bool        is_cached     () const;
+
   protected:
     // Standard Variables
     //------------------------------------------------------
@@ -99,6 +104,10 @@ namespace isis {
   std::ostream& operator<<( std::ostream& os, IsisInterface* i );
 
   bool IsisEnv();
+
+  // ISIS calls NAIF, which is not thread-safe, when creating a camera.
+  // Hold this lock when doing that.
+  std::mutex & isis_create_mutex();
 }}
 
 #endif//__ASP_ISIS_INTERFACE_H__
@@ -69,19 +69,30 @@ PolyEquation::PolyEquation( int order_x,
 
 // Update
 //-----------------------------------------------
+double PolyEquation::horner( Vector<double> const& coeff, double t ) {
+  double value = 0;
+  for ( size_t i = coeff.size(); i > 0; i-- )
+    value = value*t + coeff[i-1];
+  return value;
+}
+
 void PolyEquation::update( double t ) {
   m_cached_time = t;
   double delta_t = t-m_time_offset;
-  Vector<double> powers( m_max_length );
-  powers[0] = 1;
-  for ( uint8 i = 1; i < m_max_length; i++ )
-    powers[i] = powers[i-1]*delta_t;
-  m_cached_output[0] = sum( elem_prod(m_x_coeff,
-                                      subvector(powers,0,m_x_coeff.size())) );
-  m_cached_output[1] = sum( elem_prod(m_y_coeff,
-                                      subvector(powers,0,m_y_coeff.size())) );
-  m_cached_output[2] = sum( elem_prod(m_z_coeff,
-                                      subvector(powers,0,m_z_coeff.size())) );
+  m_cached_output[0] = horner( m_x_coeff, delta_t );
+  m_cached_output[1] = horner( m_y_coeff, delta_t );
+  m_cached_output[2] = horner( m_z_coeff, delta_t );
+}
+
+void PolyEquation::evaluate( std::vector<double> const& times,
+                             std::vector<Vector3> & values ) {
+  values.resize( times.size() );
+  for ( size_t i = 0; i < times.size(); i++ ) {
+    double delta_t = times[i]-m_time_offset;
+    values[i] = Vector3( horner( m_x_coeff, delta_t ),
+                         horner( m_y_coeff, delta_t ),
+                         horner( m_z_coeff, delta_t ) );
+  }
 }
 
 // FileIO
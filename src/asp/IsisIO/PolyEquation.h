@@ -32,7 +32,9 @@ namespace asp {
     vw::uint8 m_max_length; // Maximum order + 1
 
     void update ( double t );
+    static double horner( vw::Vector<double> const& coeff, double t );
   public:
+    using BaseEquation::evaluate;
     PolyEquation( int order = 0 );
     PolyEquation( int, int, int );
     PolyEquation(vw::Vector<double> const& x, vw::Vector<double> const& y,
@@ -47,6 +49,9 @@ namespace asp {
     }
     std::string type() const {  return "PolyEquation"; }
 
+    void evaluate( std::vector<double> const& times,
+                   std::vector<vw::Vector3> & values );
+
     size_t size() const { return m_x_coeff.size()+m_y_coeff.size()+m_z_coeff.size(); }
     double& operator[]( size_t n );
 
@@ -19,8 +19,9 @@
 #include <vw/Math/Vector.h>
 #include <asp/IsisIO/RPNEquation.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
-#include <stack>
 #include <vector>
 
 #include <boost/algorithm/string/classification.hpp>
@@ -56,127 +57,141 @@ RPNEquation::RPNEquation( std::string const& x_eq,
 void RPNEquation::update( double t ) {
   m_cached_time = t;
   double delta_t = t - m_time_offset;
-  m_cached_output[0] = evaluate( m_x_eq,
-                                 m_x_consts,
-                                 delta_t );
-  m_cached_output[1] = evaluate( m_y_eq,
-                                 m_y_consts,
-                                 delta_t );
-  m_cached_output[2] = evaluate( m_z_eq,
-                                 m_z_consts,
-                                 delta_t );
+  m_cached_output[0] = run( m_x_eq, m_x_consts, delta_t );
+  m_cached_output[1] = run( m_y_eq, m_y_consts, delta_t );
+  m_cached_output[2] = run( m_z_eq, m_z_consts, delta_t );
 }
+namespace {
+  // The RPN name of an operation
+  const char* op_name( RPNEquation::Op op ) {
+    switch ( op ) {
+    case RPNEquation::TIME: return "t";
+    case RPNEquation::SIN:  return "sin";
+    case RPNEquation::COS:  return "cos";
+    case RPNEquation::TAN:  return "tan";
+    case RPNEquation::ABS:  return "abs";
+    case RPNEquation::MUL:  return "*";
+    case RPNEquation::DIV:  return "/";
+    case RPNEquation::SUB:  return "-";
+    case RPNEquation::ADD:  return "+";
+    case RPNEquation::POW:  return "^";
+    default:                return "c";
+    }
+  }
+}
+
 void RPNEquation::string_to_eqn( std::string const& str,
-                                 std::vector<std::string>& commands,
+                                 std::vector<Op>& commands,
                                  std::vector<double>& consts ) {
   // Breaks a string into the equation format used internally
   commands.clear();
   consts.clear();
-  boost::split( commands, str, boost::is_any_of(" ="));
-
-  // Cleaning out any tokens that are just ""
-  for(std::vector<std::string>::iterator iter = commands.begin();
-      iter != commands.end(); ++iter ) {
-    if ( (*iter) == "" ) {
-      iter = commands.erase(iter);
-      iter--;
-    }
-  }
-
-  // Pulling out the numbers
-  for(std::vector<std::string>::iterator iter = commands.begin();
-      iter != commands.end(); ++iter ) {
+  std::vector<std::string> tokens;
+  boost::split( tokens, str, boost::is_any_of(" ="));
+
+  // Compile the tokens, checking that each operator has its
+  // arguments, and find how deep the stack gets
+  size_t depth = 0, max_depth = 0;
+  for(std::vector<std::string>::iterator iter = tokens.begin();
+      iter != tokens.end(); ++iter ) {
+    if ( (*iter) == "" )
+      continue;
+
+    Op op;
     if ( isdigit( (*iter)[(*iter).size()-1] ) ) {
       consts.push_back( atof( iter->c_str() ) );
-      *iter = "c";
-    }
-  }
-}
-
-double RPNEquation::evaluate( std::vector<std::string> const& commands,
-                              std::vector<double>& consts,
-                              double t ) {
-  // Evaluates an equation in the internal format
-  if ( commands.empty() )
-    return 0;
-  int consts_index = 0;
-  std::stack<double> rpn_stack;
-  double buffer;
-  for ( std::vector<std::string>::const_iterator iter = commands.begin();
-        iter != commands.end(); ++iter ) {
-    if ( *iter == "c" ) {
-      rpn_stack.push( consts[consts_index] );
-      consts_index++;
+      op = CONST;
     } else if ( *iter == "t" ) {
-      rpn_stack.push( t );
-    } else if ( rpn_stack.size() < 1 ) {
-      vw_throw( IOErr() << "Insufficient arguments for RPN command: "
-                << *iter << "\n" );
+      op = TIME;
     } else if ( *iter == "sin" ) {
-      buffer = sin( rpn_stack.top() );
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = SIN;
     } else if ( *iter == "cos" ) {
-      buffer = cos( rpn_stack.top() );
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = COS;
     } else if ( *iter == "tan" ) {
-      buffer = tan( rpn_stack.top() );
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = TAN;
     } else if ( *iter == "abs" ) {
-      buffer = fabs( rpn_stack.top() );
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
-    } else if ( rpn_stack.size() < 2 ) {
-      vw_throw( IOErr() << "Insufficient arguments for command: "
-                << *iter << "\n" );
+      op = ABS;
     } else if ( *iter == "*" ) {
-      buffer = rpn_stack.top();
-      rpn_stack.pop();
-      buffer *= rpn_stack.top();
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = MUL;
     } else if ( *iter == "/" ) {
-      buffer = rpn_stack.top();
-      rpn_stack.pop();
-      buffer = rpn_stack.top() / buffer;
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = DIV;
     } else if ( *iter == "-" ) {
-      buffer = rpn_stack.top();
-      rpn_stack.pop();
-      buffer = rpn_stack.top() - buffer;
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = SUB;
     } else if ( *iter == "+" ) {
-      buffer = rpn_stack.top();
-      rpn_stack.pop();
-      buffer += rpn_stack.top();
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = ADD;
     } else if ( *iter == "^" ) {
-      buffer = rpn_stack.top();
-      rpn_stack.pop();
-      buffer = pow( rpn_stack.top(), buffer );
-      rpn_stack.pop();
-      rpn_stack.push( buffer );
+      op = POW;
     } else {
       vw_throw( IOErr() << "Unknown RPN operator: " << *iter << "\n" );
     }
-  } // End of calculator
 
-  if ( rpn_stack.size() != 1 )
+    if ( op == CONST || op == TIME ) {
+      depth++;
+    } else if ( depth < 1 ) {
+      vw_throw( IOErr() << "Insufficient arguments for RPN command: "
+                << *iter << "\n" );
+    } else if ( op >= MUL ) {
+      if ( depth < 2 )
+        vw_throw( IOErr() << "Insufficient arguments for command: "
+                  << *iter << "\n" );
+      depth--;
+    }
+    max_depth = std::max( max_depth, depth );
+    commands.push_back( op );
+  }
+
+  if ( !commands.empty() && depth != 1 )
     vw_throw( IOErr() << "Unbalanced RPN equation! More constants than need by operators.\n" );
 
-  return rpn_stack.top();
+  if ( m_stack.size() < max_depth )
+    m_stack.resize( max_depth );
+}
+
+double RPNEquation::run( std::vector<Op> const& commands,
+                         std::vector<double> const& consts,
+                         double t ) {
+  // Evaluates an equation in the internal format. The equation was
+  // checked when compiled, so the stack has what each operation needs.
+  if ( commands.empty() )
+    return 0;
+  double* stack = &m_stack[0];
+  size_t top = 0; // the number of values on the stack
+  size_t consts_index = 0;
+  for ( size_t i = 0; i < commands.size(); i++ ) {
+    switch ( commands[i] ) {
+    case CONST: stack[top++] = consts[consts_index++];              break;
+    case TIME:  stack[top++] = t;                                   break;
+    case SIN:   stack[top-1] = sin( stack[top-1] );                 break;
+    case COS:   stack[top-1] = cos( stack[top-1] );                 break;
+    case TAN:   stack[top-1] = tan( stack[top-1] );                 break;
+    case ABS:   stack[top-1] = fabs( stack[top-1] );                break;
+    case MUL:   top--; stack[top-1] *= stack[top];                  break;
+    case DIV:   top--; stack[top-1] /= stack[top];                  break;
+    case SUB:   top--; stack[top-1] -= stack[top];                  break;
+    case ADD:   top--; stack[top-1] += stack[top];                  break;
+    case POW:   top--; stack[top-1] = pow( stack[top-1], stack[top] ); break;
+    }
+  } // End of calculator
+
+  return stack[0];
+}
+
+void RPNEquation::evaluate( std::vector<double> const& times,
+                            std::vector<Vector3> & values ) {
+  values.resize( times.size() );
+  for ( size_t i = 0; i < times.size(); i++ ) {
+    double delta_t = times[i] - m_time_offset;
+    values[i] = Vector3( run( m_x_eq, m_x_consts, delta_t ),
+                         run( m_y_eq, m_y_consts, delta_t ),
+                         run( m_z_eq, m_z_consts, delta_t ) );
+  }
 }
 
 // FileIO
 //-----------------------------------------------------
 void RPNEquation::write( std::ofstream &f ) {
   for ( int i = 0; i < 3; i++ ) {
-    std::vector<std::string>* eq_ptr = NULL;
+    std::vector<Op>* eq_ptr = NULL;
     std::vector<double>* cs_ptr = NULL;
     switch(i) {
     case 0:
@@ -196,11 +211,11 @@ void RPNEquation::write( std::ofstream &f ) {
     f << std::setprecision( 15 );
     int cs_idx = 0;
     for ( unsigned j = 0; j < eq_ptr->size(); j++ ) {
-      if ( (*eq_ptr)[j] == "c" ) {
+      if ( (*eq_ptr)[j] == CONST ) {
         f << (*cs_ptr)[cs_idx] << " ";
         cs_idx++;
       } else {
-        f << (*eq_ptr)[j] << " ";
+        f << op_name( (*eq_ptr)[j] ) << " ";
       }
     }
     f << "\n";
@@ -37,29 +37,41 @@ namespace asp {
   //  *, /, -, +, ^
   //
   // Remember: Have your equation space delimited
-  // Also: 'c' is an internal place holder for RPNEquation
+  //
+  // The equations are compiled, when read, to a list of operations
+  // which are checked to be balanced, so evaluating them does not
+  // parse anything.
   class RPNEquation : public BaseEquation {
-    std::vector<std::string> m_x_eq;
+  public:
+    enum Op { CONST, TIME, SIN, COS, TAN, ABS, MUL, DIV, SUB, ADD, POW };
+
+  private:
+    std::vector<Op> m_x_eq;
     std::vector<double> m_x_consts;
-    std::vector<std::string> m_y_eq;
+    std::vector<Op> m_y_eq;
     std::vector<double> m_y_consts;
-    std::vector<std::string> m_z_eq;
+    std::vector<Op> m_z_eq;
     std::vector<double> m_z_consts;
+    std::vector<double> m_stack; // large enough for all equations
 
     void update( double t );
     void string_to_eqn( std::string const& str,
-                        std::vector<std::string>& commands,
+                        std::vector<Op>& commands,
                         std::vector<double>& consts );
-    double evaluate( std::vector<std::string> const& commands,
-                     std::vector<double>& consts,
-                     double t );
+    double run( std::vector<Op> const& commands,
+                std::vector<double> const& consts,
+                double t );
   public:
+    using BaseEquation::evaluate;
     RPNEquation();
     RPNEquation( std::string const& x_eq,
                  std::string const& y_eq,
                  std::string const& z_eq );
     std::string type() const { return "RPNEquation"; }
 
+    void evaluate( std::vector<double> const& times,
+                   std::vector<vw::Vector3> & values );
+
     size_t size() const { return m_x_consts.size() +
         m_y_consts.size() + m_z_consts.size(); }
     double& operator[]( size_t n );
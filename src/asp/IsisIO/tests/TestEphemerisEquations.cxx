@@ -126,3 +126,39 @@ TEST(EphemerisEquations, reversepolish) {
   EXPECT_NEAR( 15.4176744337735, test[1], DELTA );
   EXPECT_NEAR( 2737.72972972973, test[2], DELTA );
 }
+
+TEST(EphemerisEquations, batch_evaluate) {
+  PolyEquation poly(0,2,1);
+  poly[0] = 11;
+  poly[1] = -5; poly[2] = 0.6; poly[3] = .1;
+  poly[4] = -4; poly[5] = 2.5;
+  RPNEquation rpn( "3 t t * * 1 +", "t sin 4 * t +",
+                   "t t 2 * * 5 t / - abs" );
+  rpn.set_time_offset( -20 );
+
+  std::vector<double> times;
+  times.push_back( -1.5 );
+  times.push_back( 0.25 );
+  times.push_back( 3 );
+
+  Vector3 cached = poly(7);
+  std::vector<Vector3> values;
+  poly.evaluate( times, values );
+  ASSERT_EQ( times.size(), values.size() );
+  for ( size_t i = 0; i < times.size(); i++ )
+    EXPECT_VECTOR_NEAR( poly(times[i]), values[i], DELTA );
+  EXPECT_VECTOR_NEAR( cached, poly(7), DELTA );
+
+  rpn.evaluate( times, values );
+  ASSERT_EQ( times.size(), values.size() );
+  for ( size_t i = 0; i < times.size(); i++ )
+    EXPECT_VECTOR_NEAR( rpn(times[i]), values[i], DELTA );
+}
+
+TEST(EphemerisEquations, reversepolish_invalid) {
+  EXPECT_THROW( RPNEquation( "t +", "t", "t" ), IOErr );
+  EXPECT_THROW( RPNEquation( "t 2", "t", "t" ), IOErr );
+  EXPECT_THROW( RPNEquation( "t log", "t", "t" ), IOErr );
+  RPNEquation empty( "", "t", "t" );
+  EXPECT_EQ( 0, empty(3)[0] );
+}
@@ -38,6 +38,7 @@
 #include <Distance.h>
 
 #include <boost/foreach.hpp>
+#include <thread>
 
 using namespace vw;
 using namespace vw::camera;
@@ -271,3 +272,50 @@ TEST(IsisCameraModel, camera_model) {
     EXPECT_LT( angle_from_z, 0.5 );
   }
 }
+
+TEST(IsisCameraModel, threads) {
+  if (!asp::isis::IsisEnv()) {
+    vw_out() << "ISISROOT or ISISDATA was not set. ISIS unit tests won't be run."
+	     << std::endl;
+    return;
+  }
+
+  // Calls from several threads at once must give the same results
+  // as calls from one thread.
+  IsisCameraModel cam("E1701676.reduce.cub");
+
+  srand( 42 );
+  std::vector<Vector2> pixels;
+  for ( size_t i = 0; i < 200; i++ )
+    pixels.push_back( generate_random( cam.samples(), cam.lines() ) );
+
+  std::vector<Vector3> dirs(pixels.size()), ctrs(pixels.size());
+  for ( size_t i = 0; i < pixels.size(); i++ ) {
+    dirs[i] = cam.pixel_to_vector( pixels[i] );
+    ctrs[i] = cam.camera_center( pixels[i] );
+  }
+
+  const int num_threads = 4;
+  std::vector<Vector3> tdirs(pixels.size()), tctrs(pixels.size());
+  std::vector<std::thread> threads;
+  for ( int t = 0; t < num_threads; t++ ) {
+    threads.push_back( std::thread( [&, t]() {
+      for ( size_t i = t; i < pixels.size(); i += num_threads ) {
+        tdirs[i] = cam.pixel_to_vector( pixels[i] );
+        tctrs[i] = cam.camera_center( pixels[i] );
+      }
+    }));
+  }
+  for ( size_t t = 0; t < threads.size(); t++ )
+    threads[t].join();
+
+  for ( size_t i = 0; i < pixels.size(); i++ ) {
+    EXPECT_VECTOR_NEAR( dirs[i], tdirs[i], 1e-10 );
+    EXPECT_VECTOR_NEAR( ctrs[i], tctrs[i], 1e-6 );
+  }
+
+  if ( cam.is_thread_safe() )
+    EXPECT_LE( cam.num_interfaces(), num_threads + 1 );
+  else
+    EXPECT_EQ( 1, cam.num_interfaces() );
+}
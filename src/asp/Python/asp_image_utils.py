@@ -22,7 +22,7 @@ Basic functions for working with images on disk.
 """
 from __future__ import print_function
 import sys, os, re, subprocess, string, time, errno
-import asp_string_utils
+import asp_string_utils, asp_system_utils
 
 def stripRgbImageAlphaChannel(inputPath, outputPath):
     """Makes an RGB copy of an RBGA image"""
@@ -35,25 +35,24 @@ def stripRgbImageAlphaChannel(inputPath, outputPath):
 def getImageSize(imagePath):
     """Returns the size [samples, lines] in an image"""
 
-    # Make sure the input file exists
-    if not os.path.exists(imagePath):
-        raise Exception('Image file ' + imagePath + ' not found!')
-       
-    # Use subprocess to suppress the command output
-    cmd = ['gdalinfo', imagePath]
-    p = subprocess.Popen(cmd, stdout=subprocess.PIPE, universal_newlines=True)
-    textOutput, err = p.communicate()
+    return getImageSizes([imagePath])[0]
 
-    # Extract the size from the text
-    sizePos    = textOutput.find('Size is')
-    endPos     = textOutput.find('\n', sizePos+7)
-    sizeStr    = textOutput[sizePos+7:endPos]
-    sizeStrs   = sizeStr.strip().split(',')
-    numSamples = int(sizeStrs[0])
-    numLines   = int(sizeStrs[1])
-    
-    size = [numSamples, numLines]
-    return size
+def getImageSizes(imagePaths):
+    """Returns the size [samples, lines] of each image. All images are
+    read with one call, rather than starting a process for each."""
+
+    # Make sure the input files exist
+    for imagePath in imagePaths:
+        if not os.path.exists(imagePath):
+            raise Exception('Image file ' + imagePath + ' not found!')
+
+    sizes = []
+    for info in asp_system_utils.query_images(imagePaths):
+        if not info['valid']:
+            raise Exception('Cannot read image: ' + info['image'])
+        sizes.append(info['size'])
+
+    return sizes
 
 def isIsisFile(filePath):
     """Returns True if the file is an ISIS file, False otherwise."""
@@ -336,18 +336,64 @@ def run_with_return_code(cmd, verbose=False):
 
     return p.returncode
 
-def is_valid_image(filename):
-    """See if the current image file exists and is valid."""
+def query_images(filenames, verbose = False):
+    """Read the size, number of bands, channel type, nodata value, and
+    georeference of many images with one call to image_query. Return a
+    list with a dictionary for each image. An image which cannot be read
+    has 'valid' set to False and no other values."""
+
+    if len(filenames) == 0:
+        return []
+
+    output = run_and_parse_output("image_query", filenames, ",", verbose,
+                                  return_full_lines = True)
+
+    # Each image starts with a line having its name
+    infos = []
+    for count in sorted(output.keys()):
+        line = output[count]
+        if ',' not in line:
+            continue
+        key, val = line.split(',', 1)
+        if key == 'image':
+            infos.append({'image': val})
+        elif len(infos) == 0:
+            continue
+        elif key in ['valid', 'georef']:
+            infos[-1][key] = (val == '1')
+        elif key in ['size', 'transform']:
+            infos[-1][key] = [float(v) for v in val.split(',')]
+        elif key == 'bands':
+            infos[-1][key] = int(val)
+        elif key == 'nodata':
+            infos[-1][key] = float(val)
+        else:
+            infos[-1][key] = val # keep the commas in a proj4 string
 
-    if not os.path.exists(filename):
-        return False
-    
-    verbose = False
-    ans = run_with_return_code(['gdalinfo', filename], verbose) 
-    if ans == 0:
-        return True
+    for info in infos:
+        if 'size' in info:
+            info['size'] = [int(v) for v in info['size']]
+
+    if len(infos) != len(filenames):
+        raise Exception('Expecting information for ' + str(len(filenames)) + \
+                        ' images from image_query, got ' + str(len(infos)) + '.')
 
-    return False
+    return infos
+
+def valid_images(filenames):
+    """For each image file, see if it exists and can be read. All
+    files are checked with one call."""
+
+    existing = [f for f in filenames if os.path.exists(f)]
+    valid = {}
+    for f, info in zip(existing, query_images(existing)):
+        valid[f] = info['valid']
+
+    return [valid.get(f, False) for f in filenames]
+
+def is_valid_image(filename):
+    """See if the current image file exists and is valid."""
+    return valid_images([filename])[0]
     
 # For timeout
 def timeout_alarm_handler(signum, frame):
@@ -29,6 +29,7 @@
 #include <vw/Camera/OpticalBarModel.h>
 
 #include <asp/Core/Common.h>
+#include <asp/Core/FileUtils.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/IsisIO/Equation.h>
 #include <asp/IsisIO/IsisCameraModel.h>
@@ -37,6 +38,8 @@
 #include <asp/Camera/LinescanSpotModel.h>
 #include <asp/Camera/LinescanPeruSatModel.h>
 #include <asp/Camera/LinescanPleiadesModel.h>
+#include <asp/Camera/PleiadesXML.h>
+#include <asp/Camera/SPOT_XML.h>
 #include <asp/Camera/LinescanASTERModel.h>
 #include <asp/Sessions/CameraModelLoader.h>
 #include <asp/Camera/RPCModel.h>
@@ -44,7 +47,9 @@
 
 #include <xercesc/util/PlatformUtils.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
 
+#include <fstream>
 #include <map>
 #include <utility>
 #include <string>
@@ -53,6 +58,73 @@
 
 namespace asp {
 
+// What is saved in --camera-cache-dir for a camera is what was parsed
+// from its XML file, in binary. Change the version when that changes.
+const std::string CAMERA_CACHE_MAGIC = "ASP parsed camera cache, version 1";
+
+// The file in --camera-cache-dir for a camera file, or an empty string
+// if not caching. The key has a hash of the contents of the camera
+// file, rather than its name and time, so that the cache is reused
+// for copies of it as well. Camera adjustments are applied later, so
+// they are not part of the key.
+std::string camera_cache_file(std::string const& path, std::string const& type,
+                              std::string & key) {
+  key = "";
+  if (stereo_settings().camera_cache_dir == "")
+    return "";
+  std::string hash = asp::file_content_hash(path);
+  if (hash == "0")
+    return ""; // The file cannot be read. Parsing it will give the error.
+  key = "camera: " + type + " " + hash;
+  return asp::cache_file_name(stereo_settings().camera_cache_dir, "camera-", key, ".bin");
+}
+
+// Read the parsed camera file from the cache, if it is there
+template <class StateT>
+bool read_camera_cache(std::string const& cache_file, std::string const& key,
+                       StateT & state) {
+  if (cache_file == "")
+    return false;
+  std::ifstream ifs(cache_file.c_str(), std::ios::binary);
+  std::string magic, file_key;
+  if (!std::getline(ifs, magic) || magic != CAMERA_CACHE_MAGIC ||
+      !std::getline(ifs, file_key) || file_key != key)
+    return false;
+  try {
+    state.read_state(ifs);
+  } catch (...) {
+    return false;
+  }
+  return ifs.good();
+}
+
+// Save the parsed camera file. Write to a file unique to this process
+// first, then rename it, as many parallel_stereo processes may be
+// doing this at the same time, and none must read a partial file.
+// Failing to write the cache is not an error.
+template <class StateT>
+void write_camera_cache(std::string const& cache_file, std::string const& key,
+                        StateT const& state) {
+  if (cache_file == "")
+    return;
+  try {
+    vw::create_out_dir(cache_file);
+    std::string tmp_file
+      = boost::filesystem::unique_path(cache_file + ".%%%%-%%%%-%%%%.tmp").string();
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      ofs << CAMERA_CACHE_MAGIC << "\n" << key << "\n";
+      state.write_state(ofs);
+      if (!ofs.good())
+        vw::vw_throw(vw::IOErr() << "Failed writing: " << tmp_file << "\n");
+    }
+    boost::filesystem::rename(tmp_file, cache_file);
+  } catch (std::exception const& e) {
+    vw::vw_out(vw::WarningMessage) << "Could not cache the camera in: "
+                                   << cache_file << ". " << e.what() << "\n";
+  }
+}
+
 CameraModelLoader::CameraModelLoader() {
   xercesc::XMLPlatformUtils::Initialize();
 }
@@ -90,14 +162,26 @@ CameraModelLoader::load_rpc_camera_model(std::string const& path) const {
 // Load a DG camera file
 boost::shared_ptr<vw::camera::CameraModel>
 CameraModelLoader::load_dg_camera_model(std::string const& path) const {
-  // Redirect to the call from LinescanDGModel.h file
-  return CameraModelPtr(load_dg_camera_model_from_xml(path));
+  std::string key, cache_file = camera_cache_file(path, "dg", key);
+  DGCameraState state;
+  if (!read_camera_cache(cache_file, key, state)) {
+    read_dg_camera_state(path, state);
+    write_camera_cache(cache_file, key, state);
+  }
+  return asp::load_dg_camera_model(state);
 }
 
 // Load a spot5 camera file
 boost::shared_ptr<vw::camera::CameraModel>
 CameraModelLoader::load_spot5_camera_model(std::string const& path) const {
-  return CameraModelPtr(load_spot5_camera_model_from_xml(path));
+  std::string key, cache_file = camera_cache_file(path, "spot5", key);
+  SpotXML xml_reader;
+  if (!read_camera_cache(cache_file, key, xml_reader)) {
+    vw::vw_out(vw::DebugMessage, "asp") << "Loading SPOT5 camera file: " << path << "\n";
+    xml_reader.read_xml(path);
+    write_camera_cache(cache_file, key, xml_reader);
+  }
+  return CameraModelPtr(asp::load_spot5_camera_model(xml_reader));
 }
 
 // Load a PeruSat linescan camera file
@@ -109,7 +193,13 @@ CameraModelLoader::load_perusat_camera_model(std::string const& path) const {
 // Load a Pleiades linescan camera file
 boost::shared_ptr<vw::camera::CameraModel>
 CameraModelLoader::load_pleiades_camera_model(std::string const& path) const {
-  return CameraModelPtr(load_pleiades_camera_model_from_xml(path));
+  std::string key, cache_file = camera_cache_file(path, "pleiades", key);
+  PleiadesXML xml_reader;
+  if (!read_camera_cache(cache_file, key, xml_reader)) {
+    xml_reader.read_xml(path);
+    write_camera_cache(cache_file, key, xml_reader);
+  }
+  return CameraModelPtr(asp::load_pleiades_camera_model(xml_reader));
 }
 
 // Load a ASTER camera file
@@ -24,10 +24,13 @@
 #include <asp/Camera/CsmModel.h>
 
 #include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/InterestPoint/InterestData.h>
 
+#include <mutex>
 #include <string>
 #include <iostream>
 
@@ -35,9 +38,71 @@ typedef boost::shared_ptr<asp::StereoSession> SessionPtr;
 
 using namespace vw;
 
+namespace {
+
+// Load a camera with the given session
+boost::shared_ptr<vw::camera::CameraModel>
+load_one_camera(asp::StereoSession & session,
+                std::string const& image_file, std::string const& camera_file,
+                bool approximate_pinhole_intrinsics) {
+
+  vw_out(DebugMessage,"asp") << "Loading: " << image_file << ' ' << camera_file << "\n";
+  
+  boost::shared_ptr<vw::camera::CameraModel> camera
+    = session.camera_model(image_file, camera_file);
+  
+  if (approximate_pinhole_intrinsics) {
+    boost::shared_ptr<vw::camera::PinholeModel> pinhole_ptr = 
+      boost::dynamic_pointer_cast<vw::camera::PinholeModel>(camera);
+    // Replace lens distortion with fast approximation
+    vw::camera::update_pinhole_for_fast_point2pixel<vw::camera::TsaiLensDistortion>
+      (*(pinhole_ptr.get()), file_image_size(image_file));
+  }
+
+  return camera;
+}
+
+// Load a camera in a thread. The session is made beforehand, as making
+// sessions is not thread-safe. The first error is kept.
+class LoadCameraTask: public vw::Task, private boost::noncopyable {
+  asp::StereoSession & m_session;
+  std::string const& m_image_file;
+  std::string const& m_camera_file;
+  bool m_approximate_pinhole_intrinsics;
+  boost::shared_ptr<vw::camera::CameraModel> & m_camera;
+  std::mutex & m_mutex;
+  std::string & m_error;
+
+public:
+  LoadCameraTask(asp::StereoSession & session,
+                 std::string const& image_file, std::string const& camera_file,
+                 bool approximate_pinhole_intrinsics,
+                 boost::shared_ptr<vw::camera::CameraModel> & camera,
+                 std::mutex & mutex, std::string & error):
+    m_session(session), m_image_file(image_file), m_camera_file(camera_file),
+    m_approximate_pinhole_intrinsics(approximate_pinhole_intrinsics),
+    m_camera(camera), m_mutex(mutex), m_error(error) {}
+
+  virtual void operator()() {
+    try {
+      m_camera = load_one_camera(m_session, m_image_file, m_camera_file,
+                                 m_approximate_pinhole_intrinsics);
+    } catch (std::exception const& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_error.empty())
+        m_error = m_camera_file + ": " + e.what();
+    }
+  }
+};
+
+} // end anonymous namespace
+
 namespace asp {
 
-// Load cameras from given image and camera files
+// Load cameras from given image and camera files. The first camera is
+// loaded on its own, as that also finds the session name. If the
+// session supports multi-threading, the rest are loaded in parallel,
+// as parsing thousands of camera files one at a time can take long.
 void load_cameras(std::vector<std::string> const& image_files,
                   std::vector<std::string> const& camera_files,
                   std::string const& out_prefix, 
@@ -55,34 +120,52 @@ void load_cameras(std::vector<std::string> const& image_files,
   if (image_files.size() != camera_files.size()) 
     vw_throw(ArgumentErr() << "Expecting as many images as cameras.\n");  
   
-  for (size_t i = 0; i < image_files.size(); i++) {
-    vw_out(DebugMessage,"asp") << "Loading: " << image_files [i] << ' '
-                               << camera_files[i] << "\n";
-    
-    // The same camera is double-loaded into the same session instance.
-    // TODO: One day replace this with a simpler camera model loader class.
-    // But note that this call also refines the stereo session name.
-    SessionPtr session
-      (asp::StereoSessionFactory::create(stereo_session, opt,
-                                         image_files [i], image_files [i],
-                                         camera_files[i], camera_files[i],
-                                         out_prefix));
-    
-    camera_models.push_back(session->camera_model(image_files [i],
-                                                  camera_files[i]));
+  int num_cams = image_files.size();
+  camera_models.resize(num_cams);
+  if (num_cams == 0)
+    return;
+
+  // The same camera is double-loaded into the same session instance.
+  // TODO: One day replace this with a simpler camera model loader class.
+  // But note that making a session also refines the stereo session name.
+  // Making the sessions also initializes the XML parser, which must be
+  // done from one thread.
+  std::vector<SessionPtr> sessions(num_cams);
+  for (int i = 0; i < num_cams; i++) {
+    sessions[i].reset(asp::StereoSessionFactory::create(stereo_session, opt,
+                                                        image_files [i], image_files [i],
+                                                        camera_files[i], camera_files[i],
+                                                        out_prefix));
     
-    // This is necessary to avoid a crash with ISIS cameras which is single-threaded
-    if (!session->supports_multi_threading())
+    // This is necessary to avoid a crash with cameras which are single-threaded
+    if (!sessions[i]->has_thread_safe_cameras())
       single_threaded_cameras = true;
-    
-    if (approximate_pinhole_intrinsics) {
-      boost::shared_ptr<vw::camera::PinholeModel> pinhole_ptr = 
-        boost::dynamic_pointer_cast<vw::camera::PinholeModel>(camera_models.back());
-      // Replace lens distortion with fast approximation
-      vw::camera::update_pinhole_for_fast_point2pixel<vw::camera::TsaiLensDistortion>
-        (*(pinhole_ptr.get()), file_image_size(image_files[i]));
-    }
-    
+
+    if (i == 0)
+      camera_models[i] = load_one_camera(*sessions[i], image_files[i], camera_files[i],
+                                         approximate_pinhole_intrinsics);
+  }
+
+  if (sessions[0]->supports_multi_threading()) {
+    std::mutex mutex;
+    std::string error;
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    for (int i = 1; i < num_cams; i++)
+      queue.add_task(boost::shared_ptr<LoadCameraTask>
+                     (new LoadCameraTask(*sessions[i], image_files[i], camera_files[i],
+                                         approximate_pinhole_intrinsics, camera_models[i],
+                                         mutex, error)));
+    queue.join_all();
+    if (!error.empty())
+      vw_throw(ArgumentErr() << "Failed to load camera " << error << "\n");
+  } else {
+    // Such as ISIS, whose cubes must be opened one at a time
+    for (int i = 1; i < num_cams; i++)
+      camera_models[i] = load_one_camera(*sessions[i], image_files[i], camera_files[i],
+                                         approximate_pinhole_intrinsics);
+  }
+
+  for (int i = 0; i < num_cams; i++) {
     // Since CERES does numerical differences, it needs high precision in the inputs.
     // Inform about that the CSM cameras, which normally settle for less.
     // TODO(oalexan1): Need to examine other cameras too.
@@ -95,7 +178,7 @@ void load_cameras(std::vector<std::string> const& image_files,
       // 1e-8. CSM can give junk results if this is too low.
       //csm_cam->setDesiredPrecision(asp::DEFAULT_CSM_DESIRED_PRECISISON); 
     }
-  } // End loop through images loading all the camera models
+  } // End loop through the camera models
   
   return;
 }
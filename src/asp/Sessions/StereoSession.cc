@@ -29,16 +29,20 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Cartography/Map2CamTrans.h>
 #include <vw/FileIO/MatrixIO.h>
+#include <vw/FileIO/FileUtils.h>
 
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/ImageAlignment.h>
 #include <asp/Camera/AdjustedLinescanDGModel.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Sessions/StereoSessionASTER.h>
 
 #include <boost/filesystem/operations.hpp>
 
+#include <fstream>
 #include <map>
+#include <sstream>
 #include <utility>
 #include <string>
 #include <ostream>
@@ -165,7 +169,13 @@ namespace asp {
 
       georef.set_geographic();
 
-      if (!stereo_settings().correlator_mode) {
+      if (!stereo_settings().correlator_mode &&
+          !stereo_settings().resolved_datum_wkt.empty()) {
+        // The datum was found before, so no need to load the camera
+        vw::cartography::GeoReference resolved_georef;
+        resolved_georef.set_wkt(stereo_settings().resolved_datum_wkt);
+        georef.set_datum(resolved_georef.datum());
+      } else if (!stereo_settings().correlator_mode) {
         boost::shared_ptr<vw::camera::CameraModel> cam = this->camera_model(m_left_image_file,
                                                                             m_left_camera_file);
         // Spherical datum for non-Earth, as done usually. Used
@@ -338,11 +348,15 @@ void StereoSession::preprocessing_hook(bool adjust_left_image_size,
   bool do_not_exceed_min_max = (this->name() == "isis" ||
                                 this->name() == "isismapisis");
   // TODO(oalexan1): Should one add above "csm" and "csmmapcsm"?
-  asp::normalize_images(stereo_settings().force_use_entire_range,
-                        stereo_settings().individually_normalize,
-                        use_percentile_stretch, 
-                        do_not_exceed_min_max,
-                        left_stats, right_stats, Limg, Rimg);
+  double left_lo = 0.0, left_hi = 1.0, right_lo = 0.0, right_hi = 1.0;
+  asp::normalization_bounds(stereo_settings().force_use_entire_range,
+                            stereo_settings().individually_normalize,
+                            use_percentile_stretch, 
+                            do_not_exceed_min_max,
+                            left_stats, right_stats,
+                            left_lo, left_hi, right_lo, right_hi);
+  Limg = normalize(Limg, left_lo,  left_hi,  0.0, 1.0);
+  Rimg = normalize(Rimg, right_lo, right_hi, 0.0, 1.0);
 
   if (stereo_settings().alignment_method == "local_epipolar") {
     // Save these stats for local epipolar alignment, as they will be used
@@ -356,9 +370,46 @@ void StereoSession::preprocessing_hook(bool adjust_left_image_size,
     write_vector(right_stats_file, right_stats2);
   }
   
+  // Save how the aligned images are found from the cropped input
+  // images, so that the later stages can produce on the fly the tiles
+  // they need. This is not possible for epipolar alignment. The right
+  // aligned image, as written below, has the size of the left one,
+  // unless there is no alignment.
+  if (stereo_settings().alignment_method != "epipolar") {
+    asp::ImageAlignment align;
+    align.method          = stereo_settings().alignment_method;
+    align.interp          = "bilinear";
+    align.left_image      = left_cropped_file;
+    align.right_image     = right_cropped_file;
+    align.left_timestamp  = asp::file_timestamp(left_cropped_file);
+    align.right_timestamp = asp::file_timestamp(right_cropped_file);
+    align.left_nodata     = left_nodata_value;
+    align.right_nodata    = right_nodata_value;
+    align.left_matrix     = align_left_matrix;
+    align.right_matrix    = align_right_matrix;
+    align.left_size       = left_size;
+    align.right_size      = right_size;
+    align.left_lo  = left_lo;  align.left_hi  = left_hi;
+    align.right_lo = right_lo; align.right_hi = right_hi;
+    std::string align_file = asp::image_alignment_file(this->m_out_prefix);
+    vw_out() << "\t--> Writing: " << align_file << ".\n";
+    asp::write_image_alignment(align_file, align);
+  }
+
+  if (stereo_settings().skip_aligned_image_files) {
+    // Wipe any older images, as these would be read instead
+    vw_out() << "\t--> Not writing the aligned images. "
+             << "Their tiles will be produced as needed.\n";
+    boost::filesystem::remove(left_output_file);
+    boost::filesystem::remove(right_output_file);
+    if (this->do_bathymetry())
+      this->align_bathy_masks(options);
+    return;
+  }
+  
   // The output no-data value must be < 0 as we scale the images to [0, 1].
   bool has_nodata = true;
-  float output_nodata = -32768.0;
+  float output_nodata = asp::ALIGNED_IMAGE_NODATA;
   vw_out() << "\t--> Writing pre-aligned images.\n";
   vw_out() << "\t--> Writing: " << left_output_file << ".\n";
   block_write_gdal_image(left_output_file, apply_mask(Limg, output_nodata),
@@ -395,6 +446,50 @@ void StereoSession::preprocessing_hook(bool adjust_left_image_size,
 
 } // End function preprocessing_hook
   
+std::string StereoSession::shared_stats_file(std::string const& image_path,
+                                             std::string & key) {
+  std::ostringstream os;
+  os.precision(17);
+  os << "image: " << image_path << " " << asp::file_timestamp(image_path) << " "
+     << "nodata: " << stereo_settings().nodata_value;
+  key = os.str();
+  return asp::cache_file_name(stereo_settings().ip_cache_dir, "stats-", key, ".txt");
+}
+
+bool StereoSession::read_shared_stats(std::string const& stats_file, std::string const& key,
+                                      Vector6f & stats) {
+  std::ifstream ifs(stats_file.c_str());
+  std::string file_key;
+  if (!ifs || !std::getline(ifs, file_key) || file_key != key)
+    return false;
+  for (int it = 0; it < 6; it++) {
+    if (!(ifs >> stats[it]))
+      return false;
+  }
+  return true;
+}
+
+// Write to a temporary file first, then move it in place, as several
+// stereo pairs may be preprocessed at the same time.
+void StereoSession::write_shared_stats(std::string const& stats_file, std::string const& key,
+                                       Vector6f const& stats) {
+  vw::create_out_dir(stats_file);
+  std::string tmp_file
+    = boost::filesystem::unique_path(stats_file + ".%%%%-%%%%-%%%%.tmp").string();
+  {
+    std::ofstream ofs(tmp_file.c_str());
+    ofs.precision(17);
+    ofs << key << "\n";
+    for (int it = 0; it < 6; it++)
+      ofs << stats[it] << (it < 5 ? " " : "\n");
+    if (!ofs) {
+      vw_out(WarningMessage) << "Could not write: " << tmp_file << "\n";
+      return;
+    }
+  }
+  boost::filesystem::rename(tmp_file, stats_file);
+}
+
 void StereoSession::pre_filtering_hook(std::string const& input_file,
                                        std::string      & output_file) {
   output_file = input_file;
@@ -501,8 +596,15 @@ shared_preprocessing_hook(vw::GdalWriteOptions & options,
   check_files.push_back(right_input_file);
   check_files.push_back(m_left_camera_file);
   check_files.push_back(m_right_camera_file);
-  bool rebuild = (!is_latest_timestamp(left_output_file, check_files) ||
-                  !is_latest_timestamp(right_output_file, check_files));
+  // Without L.tif and R.tif, the alignment file is what is cached
+  bool skip_aligned = stereo_settings().skip_aligned_image_files;
+  std::string align_file = asp::image_alignment_file(this->m_out_prefix);
+  bool rebuild = false;
+  if (skip_aligned)
+    rebuild = !is_latest_timestamp(align_file, check_files);
+  else
+    rebuild = (!is_latest_timestamp(left_output_file, check_files) ||
+               !is_latest_timestamp(right_output_file, check_files));
 
   if (do_bathy) {
     rebuild = (rebuild ||
@@ -513,8 +615,14 @@ shared_preprocessing_hook(vw::GdalWriteOptions & options,
   if (!rebuild && !crop_left && !crop_right) {
     try {
       vw_log().console_log().rule_set().add_rule(-1, "fileio");
-      DiskImageView<PixelGray<float32> > out_left (left_output_file );
-      DiskImageView<PixelGray<float32> > out_right(right_output_file);
+      if (skip_aligned) {
+        asp::ImageAlignment align;
+        if (!asp::read_image_alignment(align_file, align))
+          vw_throw(IOErr() << "Invalid alignment file: " << align_file);
+      } else {
+        DiskImageView<PixelGray<float32> > out_left (left_output_file );
+        DiskImageView<PixelGray<float32> > out_right(right_output_file);
+      }
 
       if (do_bathy) {
         DiskImageView<float> left_bathy_mask (left_aligned_bathy_mask());
@@ -740,12 +848,7 @@ void StereoSession::align_bathy_masks(vw::GdalWriteOptions const& options) {
   ValueEdgeExtension<PixelMask<float>> bathy_ext_nodata(bathy_nodata_pix); 
 
   // Get the aligned size from the images already aligned
-  Vector2i left_size;
-  std::string left_aligned_file = this->m_out_prefix + "-L.tif";
-  if (boost::filesystem::exists(left_aligned_file))
-    left_size = file_image_size(left_aligned_file);
-  else
-    vw_throw(NoImplErr() << "Could not read: " << left_aligned_file);
+  Vector2i left_size = asp::aligned_image_size(this->m_out_prefix, true);
 
   // Read alignment matrices
   Matrix<double> align_left_matrix = math::identity_matrix<3>();
@@ -1121,12 +1224,13 @@ StereoSession::load_adjusted_model(boost::shared_ptr<vw::camera::CameraModel> ca
 
       if ( session == "dg" || session == "dgmaprpc") {
 
-        // Create the adjusted DG model
+        // Create the adjusted DG model. The adjustments are fixed here,
+        // so apply them once to the positions and poses of the camera.
         boost::shared_ptr<camera::CameraModel> adj_dg_cam
-          (new AdjustedLinescanDGModel(cam,
-                                       stereo_settings().piecewise_adjustment_interp_type,
-                                       adjustment_bounds, position_correction,
-                                       pose_correction, image_size));
+          = bake_piecewise_dg_adjustments(cam,
+                                          stereo_settings().piecewise_adjustment_interp_type,
+                                          adjustment_bounds, position_correction,
+                                          pose_correction);
 
         // Apply the pixel offset and pose corrections. So this a second adjustment
         // on top of the first.
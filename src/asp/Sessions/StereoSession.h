@@ -22,6 +22,7 @@
 #ifndef __STEREO_SESSION_H__
 #define __STEREO_SESSION_H__
 
+#include <vw/Core/Settings.h>
 #include <vw/Image/ImageViewBase.h>
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Image/Transform.h>
@@ -78,6 +79,11 @@ namespace asp {
     virtual bool supports_multi_threading () const {
       return true;
     }
+    // If the camera models can be used from several threads at once.
+    // The above also covers reading the input images.
+    virtual bool has_thread_safe_cameras  () const {
+      return supports_multi_threading();
+    }
 
     /// Helper function that retrieves both cameras.
     virtual void camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
@@ -114,10 +120,20 @@ namespace asp {
     /// Compute the min, max, mean, and standard deviation of an image object and write them to a log.
     /// - "tag" is only used to make the log messages more descriptive.
     /// - If prefix and image_path is set, will cache the results to a file.
+    /// - With --ip-cache-dir, that file is in that directory, so it is shared
+    ///   among all stereo pairs having this image.
     template <class ViewT> static inline
     Vector6f gather_stats( vw::ImageViewBase<ViewT> const& view_base, std::string const& tag,
                            std::string const& prefix="", std::string const& image_path="");
 
+    /// The file in --ip-cache-dir with the statistics of this image, and the
+    /// key it is made from, which is saved in the file and checked on reading.
+    static std::string shared_stats_file(std::string const& image_path, std::string & key);
+    static bool read_shared_stats(std::string const& stats_file, std::string const& key,
+                                  Vector6f & stats);
+    static void write_shared_stats(std::string const& stats_file, std::string const& key,
+                                   Vector6f const& stats);
+
     // If both left-image-crop-win and right-image-crop win are specified,
     // we crop the images to these boxes, and hence the need to keep
     // the upper-left corners of the crop windows to handle the cameras correctly.
@@ -321,6 +337,19 @@ Vector6f StereoSession::gather_stats(vw::ImageViewBase<ViewT> const& view_base,
   ViewT image = view_base.impl();
 
   const bool use_cache = ((prefix != "") && (image_path != ""));
+
+  // The statistics shared among the stereo pairs
+  std::string shared_key, shared_path;
+  if (use_cache && stereo_settings().ip_cache_dir != "") {
+    shared_path = shared_stats_file(image_path, shared_key);
+    if (read_shared_stats(shared_path, shared_key, result)) {
+      vw_out(InfoMessage) << "\t--> Reading statistics from file " + shared_path << std::endl;
+      vw_out(InfoMessage) << "\t    " << tag << ": [ lo: " << result[0] << " hi: " << result[1]
+                          << " mean: " << result[2] << " std_dev: "  << result[3] << " ]\n";
+      return result;
+    }
+  }
+
   std::string cache_path = "";
   if (use_cache) {
     if (image_path.find(prefix) == 0) {
@@ -351,24 +380,9 @@ Vector6f StereoSession::gather_stats(vw::ImageViewBase<ViewT> const& view_base,
 
     vw_out(InfoMessage) << "Using downsample scale: " << stat_scale << std::endl;
 
-    ChannelAccumulator<vw::math::CDFAccumulator<float> > accumulator;
-    for_each_pixel( subsample( edge_extend(image, ConstantEdgeExtension()),
-                              stat_scale ),
-                    accumulator );
-
-    // Compute the CDF in parallel.
-    // -> Turned off because it makes the unit tests non-deterministic.
-    //Vector2i block_size(256,256);
-    //int buffer_size = 100000; // TODO: If this gets too large the CDFAccumulator class fails!
-    //vw::math::CDFAccumulator<float> accumulator(buffer_size);
-    //block_cdf_computation(image, accumulator, stat_scale, block_size);
-
-    result[0] = accumulator.quantile(0); // Min
-    result[1] = accumulator.quantile(1); // Max
-    result[2] = accumulator.approximate_mean();
-    result[3] = accumulator.approximate_stddev();
-    result[4] = accumulator.quantile(0.02); // Percentile values
-    result[5] = accumulator.quantile(0.98);
+    // Scan the image in tiles in parallel. The result does not depend
+    // on the order in which the tiles are done.
+    result = asp::image_stats(image, stat_scale, vw_settings().default_num_threads());
 
     // Cache the results to disk
     if (use_cache) {
@@ -379,6 +393,9 @@ Vector6f StereoSession::gather_stats(vw::ImageViewBase<ViewT> const& view_base,
 
   } // Done computing the results
 
+  if (shared_path != "")
+    write_shared_stats(shared_path, shared_key, result);
+
   vw_out(InfoMessage) << "\t    " << tag << ": [ lo: " << result[0] << " hi: " << result[1]
                       << " mean: " << result[2] << " std_dev: "  << result[3] << " ]\n";
 
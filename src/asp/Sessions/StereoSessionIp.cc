@@ -43,6 +43,7 @@
 #include <utility>
 #include <string>
 #include <ostream>
+#include <sstream>
 #include <limits>
 
 using namespace vw;
@@ -50,6 +51,39 @@ using namespace vw::cartography;
 
 namespace asp {
 
+// The file in --ip-cache-dir having the interest points of an image. Its
+// name is made from the image, its modification time, and all the
+// settings which affect the interest points, so it is reused by all
+// pairs the image is in as long as these are the same. The normalization
+// depends on the other image too, unless the images are normalized
+// individually, or not at all, as for the integral detector.
+std::string ip_cache_file(std::string const& image_file,
+                          Vector6f const& stats, Vector6f const& other_stats,
+                          float nodata, int ip_per_tile) {
+
+  std::ostringstream os;
+  os.precision(17);
+  os << "image: " << image_file << " " << asp::file_timestamp(image_file) << " "
+     << "detector: " << stereo_settings().ip_matching_method << " "
+     << stereo_settings().num_scales << " " << ip_per_tile << " "
+     << stereo_settings().ip_per_image << " "
+     << stereo_settings().ip_normalize_tiles << " "
+     << stereo_settings().skip_image_normalization << " "
+     << "nodata: " << nodata << " " << stereo_settings().ip_nodata_radius << " ";
+
+  // Imitate the logic in ip_matching()
+  bool normalized = (stereo_settings().ip_matching_method != DETECT_IP_METHOD_INTEGRAL &&
+                     stats[0] != stats[1]);
+  if (normalized) {
+    os << "normalization: " << stereo_settings().force_use_entire_range << " "
+       << stereo_settings().individually_normalize << " " << stats << " ";
+    if (!stereo_settings().individually_normalize)
+      os << other_stats;
+  }
+
+  return asp::cache_file_name(stereo_settings().ip_cache_dir, "ip-", os.str(), ".vwip");
+}
+
 // A default IP matching implementation that derived classes can use
 bool StereoSession::ip_matching(std::string const& input_file1,
                                 std::string const& input_file2,
@@ -87,11 +121,20 @@ bool StereoSession::ip_matching(std::string const& input_file1,
     return true;
   }
 
-  // If having to rebuild then wipe the old data
-  if (boost::filesystem::exists(left_ip_file)) 
-    boost::filesystem::remove(left_ip_file);
-  if (boost::filesystem::exists(right_ip_file)) 
-    boost::filesystem::remove(right_ip_file);
+  // With --ip-cache-dir, use the interest points of each image found
+  // before for any pair, if any. These must not be wiped.
+  std::string ip_file1 = left_ip_file, ip_file2 = right_ip_file;
+  if (stereo_settings().ip_cache_dir != "" && !crop_left && !crop_right) {
+    ip_file1 = ip_cache_file(input_file1, stats1, stats2, nodata1, ip_per_tile);
+    ip_file2 = ip_cache_file(input_file2, stats2, stats1, nodata2, ip_per_tile);
+    vw::create_out_dir(ip_file1);
+  } else {
+    // If having to rebuild then wipe the old data
+    if (boost::filesystem::exists(left_ip_file)) 
+      boost::filesystem::remove(left_ip_file);
+    if (boost::filesystem::exists(right_ip_file)) 
+      boost::filesystem::remove(right_ip_file);
+  }
   if (boost::filesystem::exists(match_filename)) {
     vw_out() << "Removing old match file: " << match_filename << "\n";
     // It is hoped the logic before here was such that we will not
@@ -188,21 +231,21 @@ bool StereoSession::ip_matching(std::string const& input_file1,
     vw_out() << "\t    Datum:                     " << datum << std::endl;
     if (stereo_settings().skip_rough_homography) {
       vw_out() << "\t    Skipping rough homography.\n";
-      inlier = ip_matching_no_align(!supports_multi_threading(), cam1, cam2,
+      inlier = ip_matching_no_align(!has_thread_safe_cameras(), cam1, cam2,
                                     image1_norm, image2_norm,
                                     ip_per_tile, datum,
                                     epipolar_threshold, ip_uniqueness_thresh,
                                     match_filename,
-                                    left_ip_file, right_ip_file,
+                                    ip_file1, ip_file2,
                                     nodata1, nodata2);
     } else {
       vw_out() << "\t    Using rough homography.\n";
-      inlier = ip_matching_w_alignment(!supports_multi_threading(), cam1, cam2,
+      inlier = ip_matching_w_alignment(!has_thread_safe_cameras(), cam1, cam2,
                                        image1_norm, image2_norm,
                                        ip_per_tile,
                                        datum, match_filename,
                                        epipolar_threshold, ip_uniqueness_thresh,
-                                       left_ip_file, nodata1, nodata2);
+                                       ip_file1, nodata1, nodata2);
     }
   } else { // Not nadir facing
     // Run a simpler purely image-based matching function
@@ -219,7 +262,7 @@ bool StereoSession::ip_matching(std::string const& input_file1,
                                     ip_per_tile,
                                     inlier_threshold,
                                     match_filename,
-                                    left_ip_file, right_ip_file,
+                                    ip_file1, ip_file2,
                                     nodata1, nodata2);
   }
   if (!inlier) {
@@ -21,6 +21,7 @@
 // Stereo Pipeline
 #include <asp/Core/AffineEpipolar.h>
 #include <asp/Core/PhotometricOutlier.h>
+#include <asp/Core/DisparityEncoding.h>
 #include <asp/Camera/CsmModel.h>
 #include <asp/IsisIO/IsisCameraModel.h>
 #include <asp/IsisIO/DiskImageResourceIsis.h>
@@ -528,7 +529,7 @@ void StereoSessionIsis::pre_filtering_hook(std::string const& input_file,
     DiskImageView<uint8> shadowLmask(shadowLmask_name);
     DiskImageView<uint8> shadowRmask(shadowRmask_name);
 
-    DiskImageView<PixelMask<Vector2f> > disparity_disk_image(input_file);
+    ImageViewRef<PixelMask<Vector2f> > disparity_disk_image = asp::read_disparity(input_file);
     ImageViewRef <PixelMask<Vector2f> > disparity_map
       = stereo::disparity_mask(disparity_disk_image, shadowLmask, shadowRmask);
 
@@ -38,6 +38,9 @@ namespace asp {
     virtual std::string name() const { return "isis"; }
     
     virtual bool supports_multi_threading() const;
+
+    // The ISIS camera model keeps an interface to the cube per thread
+    virtual bool has_thread_safe_cameras() const { return true; }
     
     /// Returns the target datum to use for a given camera model
     virtual vw::cartography::Datum get_datum(const vw::camera::CameraModel* cam,
@@ -112,6 +112,9 @@ namespace asp {
     virtual bool supports_multi_threading() const {
       return false;
     }
+    virtual bool has_thread_safe_cameras() const {
+      return true;
+    }
 
     static StereoSession* construct() { return new StereoSessionIsisMapIsis; }
     
@@ -27,10 +27,12 @@
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <map>
 #include <string>
 
 #include <vw/Core/Exception.h>
 #include <vw/Core/Debugging.h>
+#include <vw/Core/Thread.h>
 
 #include <string.h>
 
@@ -117,17 +119,39 @@ namespace spice {
   template void kernel_param<3>(std::string const& key, Vector<double, 3> &value);
   template void kernel_param<4>(std::string const& key, Vector<double, 4> &value);
 
-  // Load the state of a camera for a given time.
-  void body_state(double time_,
-                  Vector3 &position,
-                  Vector3 &velocity,
-                  Quat &pose,
-                  std::string const& spacecraft,
-                  std::string const& reference_frame,
-                  std::string const& planet,
-                  std::string const& instrument) {
-
-    SpiceDouble time = time_;
+  // SPICE is not thread-safe, and the cache of states on time grids
+  // is shared, so both are used under this lock.
+  Mutex g_spice_mutex;
+
+  // A uniform time grid of states of a body
+  struct StateGridKey {
+    std::string spacecraft, reference_frame, planet, instrument;
+    double begin_time, interval;
+    bool operator<(StateGridKey const& other) const {
+      if (spacecraft      != other.spacecraft)      return spacecraft      < other.spacecraft;
+      if (reference_frame != other.reference_frame) return reference_frame < other.reference_frame;
+      if (planet          != other.planet)          return planet          < other.planet;
+      if (instrument      != other.instrument)      return instrument      < other.instrument;
+      if (begin_time      != other.begin_time)      return begin_time      < other.begin_time;
+      return interval < other.interval;
+    }
+  };
+  struct StateGrid {
+    std::vector<Vector3> position, velocity;
+    std::vector<Quat>    pose;
+  };
+  std::map<StateGridKey, StateGrid> g_state_grids;
+
+  // The state of a body at one time. This does not check for SPICE
+  // errors, so that a batch of queries is checked once.
+  void body_state_no_check(SpiceDouble time,
+                           Vector3 &position,
+                           Vector3 &velocity,
+                           Quat &pose,
+                           std::string const& spacecraft,
+                           std::string const& reference_frame,
+                           std::string const& planet,
+                           std::string const& instrument) {
 
     // Obtain the state vector of the spacecraft at the given
     // ephemeris time.
@@ -164,10 +188,44 @@ namespace spice {
     SpiceDouble quaternion[4];
     m2q_c( rotation_matrix, quaternion );
     pose = Quat(quaternion[0],quaternion[1],quaternion[2],quaternion[3]);
+  }
 
+  // Load the state of a camera for a given time.
+  void body_state(double time,
+                  Vector3 &position,
+                  Vector3 &velocity,
+                  Quat &pose,
+                  std::string const& spacecraft,
+                  std::string const& reference_frame,
+                  std::string const& planet,
+                  std::string const& instrument) {
+
+    Mutex::Lock lock(g_spice_mutex);
+    body_state_no_check(time, position, velocity, pose,
+                        spacecraft, reference_frame, planet, instrument);
     CHECK_SPICE_ERROR();
   }
 
+  // Load the state of a camera for each of the given times
+  void body_state(std::vector<double> const& times,
+                  std::vector<Vector3> &position,
+                  std::vector<Vector3> &velocity,
+                  std::vector<Quat > &pose,
+                  std::string const& spacecraft,
+                  std::string const& reference_frame,
+                  std::string const& planet,
+                  std::string const& instrument) {
+
+    position.resize(times.size());
+    velocity.resize(times.size());
+    pose.resize(times.size());
+
+    Mutex::Lock lock(g_spice_mutex);
+    for (size_t it = 0; it < times.size(); it++)
+      body_state_no_check(times[it], position[it], velocity[it], pose[it],
+                          spacecraft, reference_frame, planet, instrument);
+    CHECK_SPICE_ERROR();
+  }
 
   // Load the state of the MOC camera for a given time range, returning
   // observations of the state for the given time interval.
@@ -180,55 +238,46 @@ namespace spice {
                   std::string const& planet,
                   std::string const& instrument) {
 
-    unsigned int number_of_samples = (unsigned int)ceil((end_time - begin_time) / interval);
-
-    position.resize(number_of_samples);
-    velocity.resize(number_of_samples);
-    pose.resize(number_of_samples);
-
-    unsigned int interval_count = 0;
-    for( SpiceDouble time = begin_time;
-         time < end_time;
-         time += interval ) {
-      // Obtain the state vector of the spacecraft at the given
-      // ephemeris time.
-      //
-      // The position and velocity of the spacecraft will be reported
-      // relative to the MARS IAU2000 coordinate frame.  No light time
-      // correction is made here since the spacecraft and the planet
-      // surface (where the light originated) are very close.  (Normally
-      // light time correction is computed between the origins of the
-      // two coordinate frames.)
-      SpiceDouble state[6];
-      SpiceDouble light_time;
-
-      spkezr_c( spacecraft.c_str(),  time,  reference_frame.c_str(), "NONE", planet.c_str(), state, &light_time );
-
-      // Output is in km and km/s, so we must convert the state array to
-      // units of m and m/s.
-      position[interval_count](0) = state[0] * 1000.0;
-      position[interval_count](1) = state[1] * 1000.0;
-      position[interval_count](2) = state[2] * 1000.0;
-      velocity[interval_count](0) = state[3] * 1000.0;
-      velocity[interval_count](1) = state[4] * 1000.0;
-      velocity[interval_count](2) = state[5] * 1000.0;
-
-      // Get pose data from the spacecraft CK kernel
-      //
-      // Here, we explicity get the pose of the camera relative to the
-      // Mars frame.  This incorporates the additional, slight rotation
-      // from the spacecraft frame to the camera frame.
-      SpiceDouble rotation_matrix[3][3];
-      pxform_c( reference_frame.c_str(), instrument.c_str(), time, rotation_matrix);
-
-      // Convert that matrix into a quaternion.
-      SpiceDouble quaternion[4];
-      m2q_c( rotation_matrix, quaternion );
-      pose[interval_count] = Quat(quaternion[0],quaternion[1],quaternion[2],quaternion[3]);
-      interval_count++;
+    if (!(interval > 0))
+      vw_throw(ArgumentErr() << "spice::body_state(): The time interval must be positive.");
+
+    size_t number_of_samples = 0;
+    if (end_time > begin_time)
+      number_of_samples = (size_t)ceil((end_time - begin_time) / interval);
+
+    StateGridKey key;
+    key.spacecraft      = spacecraft;
+    key.reference_frame = reference_frame;
+    key.planet          = planet;
+    key.instrument      = instrument;
+    key.begin_time      = begin_time;
+    key.interval        = interval;
+
+    Mutex::Lock lock(g_spice_mutex);
+
+    // Find only the samples not found before
+    StateGrid & grid = g_state_grids[key];
+    size_t num_cached = grid.position.size();
+    if (num_cached < number_of_samples) {
+      grid.position.resize(number_of_samples);
+      grid.velocity.resize(number_of_samples);
+      grid.pose.resize(number_of_samples);
+      for (size_t it = num_cached; it < number_of_samples; it++)
+        body_state_no_check(begin_time + it * interval,
+                            grid.position[it], grid.velocity[it], grid.pose[it],
+                            spacecraft, reference_frame, planet, instrument);
+      if (failed_c()) {
+        // Do not keep samples that may be wrong
+        grid.position.resize(num_cached);
+        grid.velocity.resize(num_cached);
+        grid.pose.resize(num_cached);
+      }
+      CHECK_SPICE_ERROR();
     }
 
-    CHECK_SPICE_ERROR();
+    position.assign(grid.position.begin(), grid.position.begin() + number_of_samples);
+    velocity.assign(grid.velocity.begin(), grid.velocity.begin() + number_of_samples);
+    pose.assign    (grid.pose.begin(),     grid.pose.begin()     + number_of_samples);
   }
 
   // Load all relevent SPICE kernels.
@@ -244,6 +293,11 @@ namespace spice {
     char set[] = "SET", ret[] = "RETURN";
     erract_c (  set, lenout, ret  );
 
+    Mutex::Lock lock(g_spice_mutex);
+
+    // States found with the kernels loaded before may change
+    g_state_grids.clear();
+
     // Load the kernels
     list<string>::iterator iter;
     for (iter = kernels.begin(); iter != kernels.end(); iter++)
@@ -51,6 +51,11 @@ namespace spice {
   void kernel_param(std::string const& key, vw::Vector<double, ElemN> &value);
   void kernel_param(std::string const& key, double &value);
 
+  /// The states at the times begin_time + k * interval before
+  /// end_time. The states on such a grid are cached for the lifetime
+  /// of the process, or until more kernels are loaded, so asking
+  /// again for the same grid, or for a longer one, does not make
+  /// SPICE calls for the samples already found.
   void body_state(double begin_time, double end_time, double interval,
                   std::vector<vw::Vector3> &position,
                   std::vector<vw::Vector3> &velocity,
@@ -60,6 +65,17 @@ namespace spice {
                   std::string const& planet,
                   std::string const& instrument);
 
+  /// The states at each of the given times, found with a single pass
+  /// through SPICE.
+  void body_state(std::vector<double> const& times,
+                  std::vector<vw::Vector3> &position,
+                  std::vector<vw::Vector3> &velocity,
+                  std::vector<vw::Quaternion<double> > &pose,
+                  std::string const& spacecraft,
+                  std::string const& reference_frame,
+                  std::string const& planet,
+                  std::string const& instrument);
+
   void body_state(double time,
                   vw::Vector3 &position,
                   vw::Vector3 &velocity,
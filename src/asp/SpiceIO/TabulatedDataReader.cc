@@ -25,8 +25,6 @@
 
 using namespace std;
 
-#define LINE_MAXSIZE 4096
-
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /*               TabulatedDataReader Class Methods               */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -43,26 +41,33 @@ namespace spice {
     if ( !m_file.is_open() ) {
       throw vw::IOErr() << "Failed to open tabulated data record: " << filename << ".";
     }
+
+    std::string line;
+    while ( std::getline(m_file, line) )
+      m_lines.push_back(line);
+    close();
   }
 
 
   // Returns 1 on success, 0 on failure
   int TabulatedDataReader::find_line_with_text(std::string query,
                                                std::vector<std::string> &result) {
-    // Reset file pointer to the top of the file
-    m_file.seekg(0);
+    std::map<std::string, std::vector<std::string> >::const_iterator cached
+      = m_found.find(query);
+    if (cached != m_found.end()) {
+      result = cached->second;
+      return 1;
+    }
 
     int found = 0;
-    char line[LINE_MAXSIZE];
 
-    // Read through the lines until the search returns a match
-    while ( !found && !m_file.eof() ) {
-      m_file.getline(line, LINE_MAXSIZE);
+    // Search through the lines until the search returns a match
+    for (size_t line_it = 0; !found && line_it < m_lines.size(); line_it++) {
+      string const& str_line = m_lines[line_it];
 
       // If the text is found, cut up this line using the delimeters
       // and return true.
-      if(boost::find_first(line, query)) {
-        string str_line(line);
+      if(boost::find_first(str_line, query)) {
         cout << str_line << endl;
         boost::split( result, str_line, boost::is_any_of(m_delimeters) );
         vector<string>::iterator iter = result.begin();
@@ -74,6 +79,7 @@ namespace spice {
           //      c++;
         }
         found = 1;
+        m_found[query] = result;
       }
     }
 
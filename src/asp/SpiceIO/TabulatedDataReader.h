@@ -19,6 +19,7 @@
 /// \file TabulatedDataReader.h
 ///
 
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -40,6 +41,10 @@ namespace spice {
     }
 
     /* Accessors */
+
+    /// The fields of the first line containing the text. The lines are
+    /// read once, when the file is opened, and the fields found for a
+    /// query are kept, so asking again does not parse the table again.
     int find_line_with_text(std::string query,
                             std::vector<std::string> &result);
 
@@ -47,6 +52,8 @@ namespace spice {
     std::string m_delimeters;
 
     std::ifstream m_file;
+    std::vector<std::string> m_lines;
+    std::map<std::string, std::vector<std::string> > m_found;
   };
 
 }} // end namespace asp::spice
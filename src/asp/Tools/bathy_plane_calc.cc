@@ -100,41 +100,20 @@ void find_projection(// Inputs
   }
 }
 
-// This is not used for now, it could be used to make the logic
-// of processing mask boundary points multi-threaded.
+// Find the pixels at the mask boundary in a block of the mask. Only
+// the block and a one-pixel margin around it are read, so the mask is
+// never fully in memory.
 class MaskBoundaryTask : public vw::Task, private boost::noncopyable {
-  vw::BBox2i m_bbox; // Region of image we're working in
+  vw::BBox2i              m_bbox; // Region of image we're working in
+  ImageViewRef<float>     m_mask;
+  float                   m_mask_nodata_val;
+  std::vector<Vector2i> & m_boundary_pixels; // only for this task
 
-  ImageViewRef<float>                   m_mask;
-  float                                 m_mask_nodata_val;
-  boost::shared_ptr<CameraModel>        m_camera_model;
-  vw::cartography::GeoReference         m_shape_georef;
-  vw::cartography::GeoReference         m_dem_georef;
-  ImageViewRef<PixelMask<float>>        m_masked_dem;
-  
-  // Note how all of these are aliases
-  Mutex                        & m_mutex;
-  std::vector<Eigen::Vector3d> & m_point_vec;
-  std::vector<vw::Vector3>     & m_llh_vec;
-  std::vector<vw::Vector2>     & m_used_vertices;
-  
 public:
-  MaskBoundaryTask(vw::BBox2i                            bbox,
-                   ImageViewRef<float>                   mask,
-                   float                                 mask_nodata_val,
-                   boost::shared_ptr<CameraModel>        camera_model,
-                   vw::cartography::GeoReference const & shape_georef,
-                   vw::cartography::GeoReference const & dem_georef,
-                   ImageViewRef<PixelMask<float>>        masked_dem,
-                   Mutex                               & mutex,
-                   std::vector<Eigen::Vector3d>        & point_vec,
-                   std::vector<vw::Vector3>            & llh_vec,
-                   std::vector<vw::Vector2>            & used_vertices):
+  MaskBoundaryTask(vw::BBox2i const& bbox, ImageViewRef<float> mask,
+                   float mask_nodata_val, std::vector<Vector2i> & boundary_pixels):
     m_bbox(bbox), m_mask(mask), m_mask_nodata_val(mask_nodata_val),
-    m_camera_model(camera_model), m_shape_georef(shape_georef),
-    m_dem_georef(dem_georef), m_masked_dem(masked_dem),
-    m_mutex(mutex), m_point_vec(point_vec),
-    m_llh_vec(llh_vec), m_used_vertices(used_vertices) {}
+    m_boundary_pixels(boundary_pixels) {}
   
   void operator()() {
 
@@ -146,11 +125,16 @@ public:
     // Make a local copy of the tile
     ImageView<float> mask_tile = crop(m_mask, extra_box);
 
-    for (int col = 0; col < mask_tile.cols(); col++) {
-      for (int row = 0; row < mask_tile.rows(); row++) {
+    // Let the mask boundary be the mask pixels whose value is above
+    // threshold and which border pixels whose values is not above
+    // threshold. Go row by row, as the tile is stored.
+    for (int row = m_bbox.min().y(); row < m_bbox.max().y(); row++) {
+      for (int col = m_bbox.min().x(); col < m_bbox.max().x(); col++) {
 
+        int tcol = col - extra_box.min().x(), trow = row - extra_box.min().y();
+        
         // Look at pixels above threshold which have neighbors <= threshold
-        if (mask_tile(col, row) <= m_mask_nodata_val) 
+        if (mask_tile(tcol, trow) <= m_mask_nodata_val) 
           continue;
 
         // The four neighbors
@@ -160,8 +144,8 @@ public:
         bool border_pix = false;
         for (int it = 0; it < 4; it++) {
             
-          int icol = col + col_vals[it];
-          int irow = row + row_vals[it];
+          int icol = tcol + col_vals[it];
+          int irow = trow + row_vals[it];
 
           if (icol < 0 || irow < 0 || icol >= mask_tile.cols() || irow >= mask_tile.rows()) 
             continue;
@@ -172,75 +156,81 @@ public:
           }
         }
           
-        if (!border_pix) 
-          continue;
-
-        // Create the pixel in the full image coordinates
-        Vector2 pix = Vector2(col, row) + extra_box.min();
+        if (border_pix) 
+          m_boundary_pixels.push_back(Vector2i(col, row));
+      }
+    }
+  }
+};
 
-        // Only work on pixels in the current box (earlier had a
-        // bigger box to be able to examine neighbors).
-        if (!m_bbox.contains(pix))
-          continue;
-        
-        // The ray going to the ground
-        // Here we assume that the camera model is thread-safe, which is
-        // true for all cameras except ISIS, and this code will be used
-        // on Earth only.
-        Vector3 cam_ctr = m_camera_model->camera_center(pix);
-        Vector3 cam_dir = m_camera_model->pixel_to_vector(pix);
-
-        // Intersect the ray going from the given camera pixel with a DEM.
-        bool treat_nodata_as_zero = false;
-        bool has_intersection = false;
-        double height_error_tol = 0.001; // in meters
-        double max_abs_tol = 1e-14;
-        double max_rel_tol = 1e-14;
-        int num_max_iter = 100;
-        Vector3 xyz_guess(0, 0, 0);
-        Vector3 xyz = vw::cartography::camera_pixel_to_dem_xyz
-          (cam_ctr, cam_dir, m_masked_dem,
-           m_dem_georef, treat_nodata_as_zero,
-           has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
-           num_max_iter, xyz_guess);
-          
-        if (!has_intersection) 
-          continue;
+// Shoot rays from some of the mask boundary pixels onto the DEM. Each
+// task opens the DEM on its own.
+class BoundaryRaysTask : public vw::Task, private boost::noncopyable {
+  std::vector<Vector2i>          const& m_pixels;
+  std::vector<size_t>            const& m_indices; // which pixels to use
+  size_t                                m_start, m_end;
+  boost::shared_ptr<CameraModel>        m_camera_model;
+  vw::cartography::GeoReference         m_dem_georef;
+  std::string                           m_dem_file;
+  float                                 m_dem_nodata_val;
+  std::vector<char>                   & m_valid;
+  std::vector<Vector3>                & m_xyz;
 
-        Vector3 llh = m_dem_georef.datum().cartesian_to_geodetic(xyz);
+public:
+  BoundaryRaysTask(std::vector<Vector2i> const& pixels, std::vector<size_t> const& indices,
+                   size_t start, size_t end,
+                   boost::shared_ptr<CameraModel> camera_model,
+                   vw::cartography::GeoReference const& dem_georef,
+                   std::string const& dem_file, float dem_nodata_val,
+                   std::vector<char> & valid, std::vector<Vector3> & xyz):
+    m_pixels(pixels), m_indices(indices), m_start(start), m_end(end),
+    m_camera_model(camera_model), m_dem_georef(dem_georef),
+    m_dem_file(dem_file), m_dem_nodata_val(dem_nodata_val),
+    m_valid(valid), m_xyz(xyz) {}
 
-        Eigen::Vector3d eigen_xyz;
-        for (size_t coord = 0; coord < 3; coord++) 
-          eigen_xyz[coord] = xyz[coord];
+  void operator()() {
 
-        // TODO(oalexan1): This is fragile due to the 360 degree
-        // uncertainty in latitude
-        Vector2 proj_pt = m_shape_georef.lonlat_to_point(Vector2(llh[0], llh[1]));
+    ImageViewRef<PixelMask<float>> masked_dem
+      = create_mask(DiskImageView<float>(m_dem_file), m_dem_nodata_val);
 
-        {
-          // Need to make sure to lock the shared resource
-          Mutex::Lock lock(m_mutex);
-          m_point_vec.push_back(eigen_xyz);
-          m_used_vertices.push_back(proj_pt);
-          m_llh_vec.push_back(llh);
-        }
-      }
+    for (size_t it = m_start; it < m_end; it++) {
       
+      // The ray going to the ground
+      Vector2 pix = m_pixels[m_indices[it]];
+      Vector3 cam_ctr = m_camera_model->camera_center(pix);
+      Vector3 cam_dir = m_camera_model->pixel_to_vector(pix);
+
+      // Intersect the ray going from the given camera pixel with a DEM.
+      bool treat_nodata_as_zero = false;
+      bool has_intersection = false;
+      double height_error_tol = 0.001; // in meters
+      double max_abs_tol = 1e-14;
+      double max_rel_tol = 1e-14;
+      int num_max_iter = 100;
+      Vector3 xyz_guess(0, 0, 0);
+      m_xyz[it] = vw::cartography::camera_pixel_to_dem_xyz
+        (cam_ctr, cam_dir, masked_dem,
+         m_dem_georef, treat_nodata_as_zero,
+         has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
+         num_max_iter, xyz_guess);
+      m_valid[it] = has_intersection;
     }
-    
   }
-  
 };
 
 // Find the mask boundary (points where the points in the mask have
 // neighbors not in the mask), shoot points from there onto the DEM,
-// and return the obtained points.
+// and return the obtained points. The mask is processed in blocks in
+// parallel. If there are more boundary pixels than samples desired,
+// rays are shot only from a random subset of them.
 void find_points_at_mask_boundary(ImageViewRef<float> mask,
                                   float mask_nodata_val,
                                   boost::shared_ptr<CameraModel> camera_model,
+                                  int num_camera_threads,
                                   vw::cartography::GeoReference const& shape_georef,
                                   vw::cartography::GeoReference const& dem_georef,
-                                  ImageViewRef<PixelMask<float>> masked_dem,
+                                  std::string const& dem_file,
+                                  float dem_nodata_val,
                                   int num_samples,
                                   std::vector<Eigen::Vector3d> & point_vec,
                                   std::vector<vw::Vector3> & llh_vec,
@@ -251,135 +241,113 @@ void find_points_at_mask_boundary(ImageViewRef<float> mask,
   llh_vec.clear();
   used_vertices.clear();
 
-#if 0
+  vw_out() << "Processing points at mask boundary.\n";
+  vw::Stopwatch sw;
+  sw.start();
 
-  // For some reason parallel processing is slower than serial processing.
-  // Likely it is because the DEM is shared. Need extra heuristics to cut
-  // that one as appropriate for each task.
-  
-  // Subdivide the box for parallel processing
+  // Subdivide the box for parallel processing. The boundary pixels
+  // are kept in the order of the blocks.
   int block_size = vw::vw_settings().default_tile_size();
-  FifoWorkQueue queue(vw_settings().default_num_threads());
   std::vector<BBox2i> bboxes = subdivide_bbox(mask, block_size, block_size);
-  
-  for (size_t it = 0; it < bboxes.size(); it++) {
-    std::cout << "Box is " << bboxes[it] << std::endl;
+  std::vector<std::vector<Vector2i>> block_pixels(bboxes.size());
+  {
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (size_t it = 0; it < bboxes.size(); it++) {
+      boost::shared_ptr<MaskBoundaryTask>
+        task(new MaskBoundaryTask(bboxes[it], mask, mask_nodata_val, block_pixels[it]));
+      queue.add_task(task);
+    }
+    queue.join_all();
   }
 
-  Mutex mutex;
-  for (size_t it = 0; it < bboxes.size(); it++) {
-    boost::shared_ptr<MaskBoundaryTask>
-      task(new MaskBoundaryTask(bboxes[it],  mask, mask_nodata_val, camera_model,
-                                shape_georef, dem_georef, masked_dem, mutex,
-                                point_vec, llh_vec, used_vertices));
-    queue.add_task(task);
+  std::vector<Vector2i> boundary_pixels;
+  for (size_t it = 0; it < block_pixels.size(); it++) {
+    boundary_pixels.insert(boundary_pixels.end(), block_pixels[it].begin(),
+                           block_pixels[it].end());
+    std::vector<Vector2i>().swap(block_pixels[it]); // free the memory
   }
-  
-  queue.join_all();
-  
-#else
-
-  // Let the mask boundary be the mask pixels whose value
-  // is above threshold and which border pixels whose values
-  // is not above threshold.
-
-  vw_out() << "Processing points at mask boundary.\n";
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / mask.cols();
-  tpc.report_progress(0);
-
-  for (int col = 0; col < mask.cols(); col++) {
-    for (int row = 0; row < mask.rows(); row++) {
 
-      // Look at pixels above threshold which have neighbors <= threshold
-      if (mask(col, row) <= mask_nodata_val) 
-        continue;
+  size_t num_pix = boundary_pixels.size();
+  vw_out() << "Found " << num_pix << " pixels at mask boundary.\n";
 
-      // The four neighbors
-      int col_vals[4] = {-1, 0, 0, 1};
-      int row_vals[4] = {0, -1, 1, 0};
-          
-      bool border_pix = false;
-      for (int it = 0; it < 4; it++) {
-            
-        int icol = col + col_vals[it];
-        int irow = row + row_vals[it];
-
-        if (icol < 0 || irow < 0 || icol >= mask.cols() || irow >= mask.rows()) 
-          continue;
-            
-        if (mask(icol, irow) <= mask_nodata_val) {
-          border_pix = true;
-          break;
-        }
+  // The pixels not tried yet
+  std::vector<size_t> untried(num_pix);
+  for (size_t it = 0; it < num_pix; it++)
+    untried[it] = it;
+  
+  if (num_pix > size_t(num_samples))
+    vw_out() << "Only " << num_samples << " samples are desired. Picking "
+             << "a random subset of this size.\n";
+
+  // Shoot rays from random pixels not tried yet, till there are
+  // enough samples. Some rays may miss the DEM, so this may take more
+  // than one pass.
+  std::vector<Vector3> xyz_vec;
+  while (int(xyz_vec.size()) < num_samples && !untried.empty()) {
+
+    size_t num_needed = num_samples - xyz_vec.size();
+    std::vector<size_t> indices;
+    if (untried.size() <= num_needed) {
+      indices.swap(untried);
+    } else {
+      std::vector<int> w;
+      vw::math::pick_random_indices_in_range(untried.size(), num_needed, w);
+      std::sort(w.begin(), w.end());
+      std::vector<char> picked(untried.size(), 0);
+      for (size_t it = 0; it < w.size(); it++) {
+        indices.push_back(untried[w[it]]);
+        picked[w[it]] = 1;
       }
-          
-      if (!border_pix) 
-        continue;
+      std::vector<size_t> remaining;
+      for (size_t it = 0; it < untried.size(); it++) {
+        if (!picked[it])
+          remaining.push_back(untried[it]);
+      }
+      untried.swap(remaining);
+    }
 
-      // The ray going to the ground
-      Vector2 pix(col, row);
-      Vector3 cam_ctr = camera_model->camera_center(pix);
-      Vector3 cam_dir = camera_model->pixel_to_vector(pix);
+    // Shoot the rays in parallel, in chunks
+    size_t num = indices.size();
+    std::vector<char> valid(num, 0);
+    std::vector<Vector3> xyz(num);
+    size_t chunk = std::max(size_t(1), num / (4 * num_camera_threads) + 1);
+    FifoWorkQueue queue(num_camera_threads);
+    for (size_t start = 0; start < num; start += chunk) {
+      boost::shared_ptr<BoundaryRaysTask>
+        task(new BoundaryRaysTask(boundary_pixels, indices, start,
+                                  std::min(num, start + chunk), camera_model,
+                                  dem_georef, dem_file, dem_nodata_val, valid, xyz));
+      queue.add_task(task);
+    }
+    queue.join_all();
 
-      // Intersect the ray going from the given camera pixel with a DEM.
-      bool treat_nodata_as_zero = false;
-      bool has_intersection = false;
-      double height_error_tol = 0.001; // in meters
-      double max_abs_tol = 1e-14;
-      double max_rel_tol = 1e-14;
-      int num_max_iter = 100;
-      Vector3 xyz_guess(0, 0, 0);
-      Vector3 xyz = vw::cartography::camera_pixel_to_dem_xyz
-        (cam_ctr, cam_dir, masked_dem,
-         dem_georef, treat_nodata_as_zero,
-         has_intersection, height_error_tol, max_abs_tol, max_rel_tol, 
-         num_max_iter, xyz_guess);
-          
-      if (!has_intersection) 
-        continue;
+    for (size_t it = 0; it < num; it++) {
+      if (valid[it])
+        xyz_vec.push_back(xyz[it]);
+    }
+  }
 
-      Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz);
+  for (size_t it = 0; it < xyz_vec.size(); it++) {
 
-      Eigen::Vector3d eigen_xyz;
-      for (size_t coord = 0; coord < 3; coord++) 
-        eigen_xyz[coord] = xyz[coord];
+    Vector3 const& xyz = xyz_vec[it];
+    Vector3 llh = dem_georef.datum().cartesian_to_geodetic(xyz);
 
-      // TODO(oalexan1): This is fragile due to the 360 degree
-      // uncertainty in latitude
-      Vector2 proj_pt = shape_georef.lonlat_to_point(Vector2(llh[0], llh[1]));
-          
-      point_vec.push_back(eigen_xyz);
-      used_vertices.push_back(proj_pt);
-      llh_vec.push_back(llh);
-    }
+    Eigen::Vector3d eigen_xyz;
+    for (size_t coord = 0; coord < 3; coord++) 
+      eigen_xyz[coord] = xyz[coord];
 
-    tpc.report_incremental_progress(inc_amount);
+    // TODO(oalexan1): This is fragile due to the 360 degree
+    // uncertainty in latitude
+    Vector2 proj_pt = shape_georef.lonlat_to_point(Vector2(llh[0], llh[1]));
+          
+    point_vec.push_back(eigen_xyz);
+    used_vertices.push_back(proj_pt);
+    llh_vec.push_back(llh);
   }
 
-  tpc.report_finished();
-  
-#endif
-  
-  int num_pts = point_vec.size();
-  if (num_pts > num_samples) {
-    vw_out() << "Found " << num_pts << " samples at mask boundary, points but only "
-             << num_samples << " samples are desired. Picking a random subset "
-             << "of this size.\n";
-
-    // Select a subset
-    std::vector<int> w;
-    vw::math::pick_random_indices_in_range(num_pts, num_samples, w);
-    std::vector<Eigen::Vector3d> big_point_vec     = point_vec;     point_vec.clear();
-    std::vector<vw::Vector3>     big_llh_vec       = llh_vec;       llh_vec.clear();
-    std::vector<vw::Vector2>     big_used_vertices = used_vertices; used_vertices.clear();
-    for (size_t it = 0; it < w.size(); it++) {
-      int random_index = w[it];
-      point_vec.push_back(big_point_vec[random_index]);
-      llh_vec.push_back(big_llh_vec[random_index]);
-      used_vertices.push_back(big_used_vertices[random_index]);
-    }
-  }
+  sw.stop();
+  vw_out() << "Found " << point_vec.size() << " samples at mask boundary in "
+           << sw.elapsed_seconds() << " seconds.\n";
   
   return;
 }
@@ -623,14 +591,130 @@ double dist_to_plane(vw::Matrix<double, 1, 4> const& plane, Vec3 const& point) {
   return std::abs(ans);
 }
 
-// The value p2 is needed by the interface but we don't use it
-struct BestFitPlaneErrorMetric {
-  template <class RelationT, class ContainerT>
-  double operator() (RelationT const& plane, ContainerT const& p1, ContainerT const& p2) const {
-    return dist_to_plane(plane, p1);
+
+// Pick three distinct random points for a RANSAC hypothesis. They
+// depend only on the hypothesis index, so the result of RANSAC does
+// not depend on the number of threads.
+void plane_hypothesis_points(std::vector<Eigen::Vector3d> const& points, int hypothesis,
+                             std::vector<Eigen::Vector3d> & sample) {
+  std::mt19937 gen(hypothesis);
+  std::uniform_int_distribution<size_t> dist(0, points.size() - 1);
+  size_t ids[3];
+  for (int it = 0; it < 3; it++) {
+    bool is_new = false;
+    while (!is_new) {
+      ids[it] = dist(gen);
+      is_new = true;
+      for (int prev = 0; prev < it; prev++)
+        if (ids[prev] == ids[it])
+          is_new = false;
+    }
+  }
+  sample.resize(3);
+  for (int it = 0; it < 3; it++)
+    sample[it] = points[ids[it]];
+}
+
+// Count the inliers of a range of RANSAC hypotheses
+class PlaneHypothesesTask: public vw::Task, private boost::noncopyable {
+  std::vector<Eigen::Vector3d> const& m_points;
+  BestFitPlaneFunctor          const& m_func;
+  double                              m_threshold;
+  int                                 m_start, m_end;
+  std::vector<int>                  & m_num_inliers; // for each hypothesis
+
+public:
+  PlaneHypothesesTask(std::vector<Eigen::Vector3d> const& points,
+                      BestFitPlaneFunctor const& func, double threshold,
+                      int start, int end, std::vector<int> & num_inliers):
+    m_points(points), m_func(func), m_threshold(threshold),
+    m_start(start), m_end(end), m_num_inliers(num_inliers) {}
+
+  void operator()() {
+    std::vector<Eigen::Vector3d> sample;
+    for (int it = m_start; it < m_end; it++) {
+      plane_hypothesis_points(m_points, it, sample);
+      vw::Matrix<double, 1, 4> plane = m_func(sample, sample);
+      int count = 0;
+      for (size_t p = 0; p < m_points.size(); p++) {
+        if (dist_to_plane(plane, m_points[p]) < m_threshold)
+          count++;
+      }
+      m_num_inliers[it] = count;
+    }
   }
 };
 
+// Find the plane through the most points with RANSAC. The hypotheses
+// are evaluated in parallel, in batches. After each batch, stop if,
+// given the largest fraction of inliers found so far, a hypothesis
+// made only of inliers was picked with high probability. Then fit the
+// plane to the inliers of the best hypothesis.
+void ransac_plane(std::vector<Eigen::Vector3d> const& points,
+                  BestFitPlaneFunctor const& func,
+                  double inlier_threshold, int max_iterations,
+                  vw::Matrix<double> & plane,
+                  std::vector<size_t> & inlier_indices) {
+
+  inlier_indices.clear();
+  if (points.size() < 3)
+    vw::vw_throw(vw::math::RANSACErr() << "Need at least 3 points to fit a plane.\n");
+
+  const double confidence = 0.999;
+  int num_threads = vw_settings().default_num_threads();
+  int batch_size = std::max(64, 8 * num_threads);
+  std::vector<int> num_inliers(std::max(max_iterations, 1), 0);
+  int num_done = 0, num_needed = std::max(max_iterations, 1);
+  int best = 0;
+  while (num_done < num_needed) {
+
+    int end = std::min(num_needed, num_done + batch_size);
+    int chunk = (end - num_done + num_threads - 1) / num_threads;
+    FifoWorkQueue queue(num_threads);
+    for (int start = num_done; start < end; start += chunk) {
+      boost::shared_ptr<PlaneHypothesesTask>
+        task(new PlaneHypothesesTask(points, func, inlier_threshold,
+                                     start, std::min(end, start + chunk), num_inliers));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    for (int it = num_done; it < end; it++) {
+      if (num_inliers[it] > num_inliers[best])
+        best = it;
+    }
+    num_done = end;
+
+    double w = double(num_inliers[best]) / points.size();
+    if (w >= 1.0) 
+      break;
+    if (w > 0.0) {
+      double n = std::ceil(log(1.0 - confidence) / log(1.0 - w * w * w));
+      if (n < num_needed)
+        num_needed = std::max(num_done, int(n));
+    }
+  }
+  vw_out() << "Evaluated " << num_done << " RANSAC hypotheses.\n";
+
+  // Refit to the inliers of the best hypothesis
+  std::vector<Eigen::Vector3d> sample;
+  plane_hypothesis_points(points, best, sample);
+  vw::Matrix<double, 1, 4> best_plane = func(sample, sample);
+  std::vector<Eigen::Vector3d> inliers;
+  for (size_t p = 0; p < points.size(); p++) {
+    if (dist_to_plane(best_plane, points[p]) < inlier_threshold)
+      inliers.push_back(points[p]);
+  }
+  if (inliers.size() < 3)
+    vw::vw_throw(vw::math::RANSACErr() << "Could not find enough inliers to fit a plane.\n");
+
+  plane = func(inliers, inliers);
+  for (size_t p = 0; p < points.size(); p++) {
+    if (dist_to_plane(vw::Matrix<double, 1, 4>(plane), points[p]) < inlier_threshold)
+      inlier_indices.push_back(p);
+  }
+}
+
 void calc_plane_properties(bool use_proj_water_surface,
                            std::vector<Eigen::Vector3d> const& point_vec,
                            std::vector<size_t> const& inlier_indices,
@@ -888,7 +972,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "vertical uncertainty of the DEM.")
     ("num-ransac-iterations", 
      po::value(&opt.num_ransac_iterations)->default_value(1000),
-     "Number of RANSAC iterations to use to find the best-fitting plane.")
+     "The maximum number of RANSAC iterations to use to find the best-fitting plane. "
+     "Fewer are done if the fraction of inliers found makes more unnecessary.")
     ("output-inlier-shapefile", po::value(&opt.output_inlier_shapefile)->default_value(""),
      "If specified, save at this location the shape file with the inlier vertices.")
     ("output-outlier-shapefile", po::value(&opt.output_outlier_shapefile)->default_value(""),
@@ -997,6 +1082,7 @@ int main( int argc, char *argv[] ) {
     bool use_meas      = !opt.water_height_measurements.empty();
 
     boost::shared_ptr<CameraModel> camera_model;
+    int num_camera_threads = vw_settings().default_num_threads();
     if (use_mask) {
       std::string out_prefix;
       SessionPtr session(asp::StereoSessionFactory::create(opt.stereo_session, // may change
@@ -1005,6 +1091,8 @@ int main( int argc, char *argv[] ) {
                                                            opt.camera, opt.camera,
                                                            out_prefix));
       camera_model = session->camera_model(opt.mask, opt.camera);
+      if (!session->has_thread_safe_cameras())
+        num_camera_threads = 1;
     }
 
     // Only WGS84 is supported. Note that dem_georef and shape_georef
@@ -1070,8 +1158,8 @@ int main( int argc, char *argv[] ) {
       
       shape_georef = dem_georef;
       find_points_at_mask_boundary(mask, mask_nodata_val,  
-                                   camera_model, shape_georef,  
-                                   dem_georef, masked_dem,
+                                   camera_model, num_camera_threads, shape_georef,  
+                                   dem_georef, opt.dem, dem_nodata_val,
                                    opt.num_samples,
                                    point_vec, llh_vec,  
                                    used_vertices);
@@ -1112,27 +1200,14 @@ int main( int argc, char *argv[] ) {
                       point_vec);
 
     // Compute the water surface using RANSAC
-    std::vector<Eigen::Vector3d> dummy_vec(point_vec.size()); // Required by the interface
     std::vector<size_t> inlier_indices;
     double inlier_threshold = opt.outlier_threshold;
-    int    min_num_output_inliers = std::max(point_vec.size()/2, size_t(3));
-    bool   reduce_min_num_output_inliers_if_no_fit = true;
     vw::Matrix<double> plane;
     vw_out() << "Starting RANSAC.\n";
     try {
-      // Must first create the functor and metric, then pass these to ransac. If
-      // created as inline arguments to ransac, these may go go out
-      // of scope prematurely, which will result in incorrect behavior.
       BestFitPlaneFunctor func(use_proj_water_surface);
-      BestFitPlaneErrorMetric error_metric;
-      math::RandomSampleConsensus<BestFitPlaneFunctor, BestFitPlaneErrorMetric> 
-        ransac(func, error_metric,
-               opt.num_ransac_iterations, inlier_threshold,
-               min_num_output_inliers, reduce_min_num_output_inliers_if_no_fit);
-    
-      plane = ransac(point_vec, dummy_vec);
-      
-      inlier_indices = ransac.inlier_indices(plane, point_vec, dummy_vec);
+      ransac_plane(point_vec, func, inlier_threshold, opt.num_ransac_iterations,
+                   plane, inlier_indices);
     } catch (const vw::math::RANSACErr& e ) {
       vw_out() << "RANSAC failed: " << e.what() << "\n";
     }
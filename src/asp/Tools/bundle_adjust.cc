@@ -22,6 +22,7 @@
 // BundleAdjustUtils.cc.
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Core/CmdUtils.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/MatrixIO.h>
 #include <asp/Core/Macros.h>
 #include <asp/Sessions/StereoSession.h>
@@ -30,10 +31,14 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/IpMatchingAlgs.h> // Lightweight header for ip matching
+#include <asp/Core/MatchDatabase.h>
 #include <asp/Tools/bundle_adjust.h>
 #include <asp/Camera/CsmModel.h>
 #include <asp/Core/OutlierProcessing.h>
 #include <asp/Core/DataLoader.h>
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/BackgroundWriter.h>
+#include <asp/Tools/profiled_cost_function.h>
 
 #include <vw/InterestPoint/Matcher.h>
 
@@ -47,7 +52,6 @@ using namespace vw::camera;
 using namespace vw::ba;
 
 typedef boost::shared_ptr<asp::StereoSession> SessionPtr;
-typedef CameraRelationNetwork<JFeature> CRNJ;
 
 /// Write a csm camera state file to disk.
 void write_csm_output_file(Options const& opt, int icam,
@@ -168,6 +172,12 @@ void saveResults(Options const& opt, asp::BAParams const& param_storage) {
 
   for (int icam = 0; icam < num_cameras; icam++){
 
+    // When optimizing a block, the other cameras are taken from the
+    // blocks they belong to.
+    if (!opt.block_image_list.empty() &&
+        opt.incremental_indices.find(icam) == opt.incremental_indices.end())
+      continue;
+
     switch(opt.camera_type) {
     case BaCameraType_Pinhole:
       write_pinhole_output_file(opt, icam, param_storage);
@@ -195,22 +205,36 @@ void saveResults(Options const& opt, asp::BAParams const& param_storage) {
   
 }
 
-// A callback to invoke at each iteration if desiring to save the cameras
-// at that time.
+// A callback to invoke at each iteration, to report the solver state to
+// the metrics of this process, and if desiring to save the cameras at
+// that time. The cameras and intrinsics are copied, and written in the
+// background, so the solver does not wait for that.
 class BaCallback: public ceres::IterationCallback {
 public:
   
-  BaCallback(Options const& opt, asp::BAParams const& param_storage):
-    m_opt(opt), m_param_storage(param_storage){}
+  BaCallback(Options const& opt, asp::BAParams const& param_storage, bool save_cameras):
+    m_opt(opt), m_param_storage(param_storage), m_save_cameras(save_cameras){}
 
   virtual ceres::CallbackReturnType operator() (const ceres::IterationSummary& summary) {
-    saveResults(m_opt, m_param_storage);
+    asp::process_metrics().set_solver_state(summary.iteration, summary.cost);
+    if (m_save_cameras) {
+      bool copy_points = false;
+      boost::shared_ptr<asp::BAParams> snapshot(new asp::BAParams(m_param_storage,
+                                                                  copy_points));
+      Options const& opt = m_opt;
+      m_writer.submit([&opt, snapshot]() { saveResults(opt, *snapshot); });
+    }
     return ceres::SOLVER_CONTINUE;
   }
+
+  // Wait until the cameras are written
+  void wait() { m_writer.wait(); }
   
 private:
   Options const& m_opt;
   asp::BAParams const& m_param_storage;
+  bool m_save_cameras;
+  asp::BackgroundWriter m_writer;
 };
 
 /// Add error source for projecting a 3D point into the camera.
@@ -218,6 +242,8 @@ void add_reprojection_residual_block(Vector2 const& observation, Vector2 const&
                                      int point_index, int camera_index, 
                                      asp::BAParams & param_storage,
                                      Options const& opt,
+                                     boost::shared_ptr<asp::DistortionTableCache>
+                                     distortion_tables,
                                      ceres::Problem & problem){
 
   ceres::LossFunction* loss_function;
@@ -230,10 +256,11 @@ void add_reprojection_residual_block(Vector2 const& observation, Vector2 const&
 
   if (opt.camera_type == BaCameraType_Other) {
     // The generic camera case
-    boost::shared_ptr<CeresBundleModelBase> wrapper(new AdjustedCameraBundleModel(camera_model));
-      ceres::CostFunction* cost_function =
-        BaReprojectionError::Create(observation, pixel_sigma, wrapper);
-      problem.AddResidualBlock(cost_function, loss_function, point, camera);
+    ceres::CostFunction* cost_function =
+      asp::profile_cost(BaAdjustedReprojectionError::Create(observation, pixel_sigma,
+                                                            camera_model),
+                        "BaAdjustedReprojectionError");
+    problem.AddResidualBlock(cost_function, loss_function, point, camera);
 
   } else { // Pinhole and optical bar
 
@@ -249,7 +276,7 @@ void add_reprojection_residual_block(Vector2 const& observation, Vector2 const&
         boost::dynamic_pointer_cast<PinholeModel>(camera_model);
       if (pinhole_model.get() == 0)
         vw::vw_throw(vw::ArgumentErr() << "Tried to add pinhole block with non-pinhole camera.");
-      wrapper.reset(new PinholeBundleModel(pinhole_model));
+      wrapper.reset(new PinholeBundleModel(pinhole_model, distortion_tables));
 
     } else { // Optical bar
 
@@ -262,7 +289,8 @@ void add_reprojection_residual_block(Vector2 const& observation, Vector2 const&
     }
 
     ceres::CostFunction* cost_function =
-      BaReprojectionError::Create(observation, pixel_sigma, wrapper);
+      asp::profile_cost(BaReprojectionError::Create(observation, pixel_sigma, wrapper),
+                        "BaReprojectionError");
     problem.AddResidualBlock(cost_function, loss_function, point, camera, 
                             center, focus, distortion);
 
@@ -309,7 +337,7 @@ void add_reprojection_residual_block(Vector2 const& observation, Vector2 const&
 
 /// Add residual block for the error using reference xyz.
 void add_disparity_residual_block(Vector3 const& reference_xyz,
-                                  ImageViewRef<DispPixelT> const& interp_disp, 
+                                  asp::DisparityTileCache const& interp_disp,
                                   int left_cam_index, int right_cam_index,
                                   asp::BAParams & param_storage,
                                   Options const& opt,
@@ -333,8 +361,10 @@ void add_disparity_residual_block(Vector3 const& reference_xyz,
     boost::shared_ptr<CeresBundleModelBase> left_wrapper (new AdjustedCameraBundleModel(left_camera_model ));
     boost::shared_ptr<CeresBundleModelBase> right_wrapper(new AdjustedCameraBundleModel(right_camera_model));
     ceres::CostFunction* cost_function =
-      BaDispXyzError::Create(reference_xyz, interp_disp, left_wrapper, right_wrapper,
-                             inline_adjustments, opt.intrinisc_options);
+      asp::profile_cost(BaDispXyzError::Create(reference_xyz, interp_disp,
+                                               left_wrapper, right_wrapper,
+                                               inline_adjustments, opt.intrinisc_options),
+                        "BaDispXyzError");
 
     problem.AddResidualBlock(cost_function, loss_function, residual_ptrs);
 
@@ -362,8 +392,10 @@ void add_disparity_residual_block(Vector3 const& reference_xyz,
     }
 
     ceres::CostFunction* cost_function =
-      BaDispXyzError::Create(reference_xyz, interp_disp, left_wrapper, right_wrapper,
-                             inline_adjustments, opt.intrinisc_options);
+      asp::profile_cost(BaDispXyzError::Create(reference_xyz, interp_disp,
+                                               left_wrapper, right_wrapper,
+                                               inline_adjustments, opt.intrinisc_options),
+                        "BaDispXyzError");
     problem.AddResidualBlock(cost_function, loss_function, residual_ptrs);
 
   }
@@ -374,6 +406,177 @@ void add_disparity_residual_block(Vector3 const& reference_xyz,
 //----------------------------------------------------------------
 // Residuals functions
 
+/// Format the given range of lines of a report into a string. The
+/// formatter is called as format(line_index, stream) and may write
+/// nothing for some lines.
+template <class FormatT>
+class FormatLinesTask: public vw::Task, private boost::noncopyable {
+  FormatT const& m_format;
+  size_t         m_beg, m_end;
+  std::string  & m_text;
+
+public:
+  FormatLinesTask(FormatT const& format, size_t beg, size_t end, std::string & text):
+    m_format(format), m_beg(beg), m_end(end), m_text(text) {}
+
+  virtual void operator()() {
+    std::ostringstream os;
+    os.precision(18); // TODO(oalexan1): Replace here with 17
+    for (size_t it = m_beg; it < m_end; it++)
+      m_format(it, os);
+    m_text = os.str();
+  }
+};
+
+/// Format the lines of a report in parallel and write them in order.
+/// This is done in batches, so that not all the text is kept in memory.
+template <class FormatT>
+void write_lines_in_parallel(std::ofstream & ofs, size_t num_lines, size_t lines_per_task,
+                             FormatT const& format) {
+
+  int num_threads = vw_settings().default_num_threads();
+  size_t num_tasks = (num_lines + lines_per_task - 1) / lines_per_task;
+  size_t batch_size = 4 * std::max(num_threads, 1);
+  for (size_t batch_beg = 0; batch_beg < num_tasks; batch_beg += batch_size) {
+    size_t batch_end = std::min(batch_beg + batch_size, num_tasks);
+    std::vector<std::string> texts(batch_end - batch_beg);
+    FifoWorkQueue queue(num_threads);
+    for (size_t task = batch_beg; task < batch_end; task++) {
+      size_t beg = task * lines_per_task;
+      size_t end = std::min(beg + lines_per_task, num_lines);
+      queue.add_task(boost::shared_ptr<FormatLinesTask<FormatT>>
+                     (new FormatLinesTask<FormatT>(format, beg, end,
+                                                   texts[task - batch_beg])));
+    }
+    queue.join_all();
+    for (size_t it = 0; it < texts.size(); it++)
+      ofs.write(texts[it].data(), texts[it].size());
+  }
+}
+
+/// A line of the residual map for each point
+class ResidualMapFormat {
+  std::vector<double> const& m_mean_residuals;
+  std::vector<int>    const& m_num_point_observations;
+  asp::BAParams       const& m_param_storage;
+  ControlNetwork      const& m_cnet;
+  vw::cartography::Datum const& m_datum;
+
+public:
+  ResidualMapFormat(std::vector<double> const& mean_residuals,
+                    std::vector<int> const& num_point_observations,
+                    asp::BAParams const& param_storage, ControlNetwork const& cnet,
+                    vw::cartography::Datum const& datum):
+    m_mean_residuals(mean_residuals), m_num_point_observations(num_point_observations),
+    m_param_storage(param_storage), m_cnet(cnet), m_datum(datum) {}
+
+  void operator()(size_t i, std::ostream & os) const {
+
+    if (m_param_storage.get_point_outlier(i))
+      return; // skip outliers
+
+    // The final GCC coordinate of this point
+    const double * point = m_param_storage.get_point_ptr(i);
+    Vector3 xyz(point[0], point[1], point[2]);
+    Vector3 llh = m_datum.cartesian_to_geodetic(xyz);
+
+    std::string comment = "";
+    if (m_cnet[i].type() == ControlPoint::GroundControlPoint)
+      comment = " # GCP";
+    else if (m_cnet[i].type() == ControlPoint::PointFromDem)
+      comment = " # from DEM";
+
+    os << llh[0] <<", "<< llh[1] <<", "<< llh[2] <<", "<< m_mean_residuals[i] <<", "
+       << m_num_point_observations[i] << comment << "\n";
+  }
+};
+
+/// The raw pixel residuals of each camera, preceded by the camera name
+/// and residual count. Along the way, find the mean and median
+/// residual norm for each camera.
+class RawPixelsFormat {
+  Options const& m_opt;
+  std::vector<double> const& m_residuals;
+  std::vector<size_t> const& m_cam_residual_counts;
+  std::vector<size_t> const& m_cam_residual_starts;
+  std::vector<double> & m_mean_residuals;
+  std::vector<double> & m_median_residuals;
+
+public:
+  RawPixelsFormat(Options const& opt, std::vector<double> const& residuals,
+                  std::vector<size_t> const& cam_residual_counts,
+                  std::vector<size_t> const& cam_residual_starts,
+                  std::vector<double> & mean_residuals,
+                  std::vector<double> & median_residuals):
+    m_opt(opt), m_residuals(residuals), m_cam_residual_counts(cam_residual_counts),
+    m_cam_residual_starts(cam_residual_starts), m_mean_residuals(mean_residuals),
+    m_median_residuals(median_residuals) {}
+
+  // Each camera is handled by one task, so the outputs do not need a lock
+  void operator()(size_t c, std::ostream & os) const {
+    size_t num_this_cam_residuals = m_cam_residual_counts[c];
+
+    std::string name = m_opt.camera_files[c];
+    if (name == "")
+      name = m_opt.image_files[c];
+    os << name << ", " << num_this_cam_residuals << "\n";
+
+    // All residuals are for inliers, as we do not even add a residual
+    // for an outlier
+    double mean_residual = 0; // Take average of all pixel coord errors
+    std::vector<double> residual_norms(num_this_cam_residuals);
+    size_t index = m_cam_residual_starts[c];
+    for (size_t i = 0; i < num_this_cam_residuals; i++) {
+      double ex = m_residuals[index];
+      ++index;
+      double ey = m_residuals[index];
+      ++index;
+      double residual_norm = std::sqrt(ex * ex + ey * ey);
+      mean_residual += residual_norm;
+      residual_norms[i] = residual_norm;
+      os << ex << ", " << ey << "\n"; // Write ex, ey on raw file
+    }
+
+    m_mean_residuals[c] = mean_residual / static_cast<double>(num_this_cam_residuals);
+    m_median_residuals[c] = std::numeric_limits<double>::quiet_NaN();
+    if (residual_norms.size() > 0) {
+      std::nth_element(residual_norms.begin(),
+                       residual_norms.begin() + residual_norms.size()/2,
+                       residual_norms.end());
+      m_median_residuals[c] = residual_norms[residual_norms.size()/2];
+    }
+  }
+};
+
+/// The residual of each reference terrain point
+class ReferenceTerrainFormat {
+  Options const& m_opt;
+  std::vector<double> const& m_residuals;
+  std::vector<vw::Vector3> const& m_reference_vec;
+  size_t m_start;
+  std::vector<double> & m_errors;
+
+public:
+  ReferenceTerrainFormat(Options const& opt, std::vector<double> const& residuals,
+                         std::vector<vw::Vector3> const& reference_vec, size_t start,
+                         std::vector<double> & errors):
+    m_opt(opt), m_residuals(residuals), m_reference_vec(reference_vec),
+    m_start(start), m_errors(errors) {}
+
+  void operator()(size_t i, std::ostream & os) const {
+    Vector3 llh = m_opt.datum.cartesian_to_geodetic(m_reference_vec[i]);
+    size_t index = m_start + PIXEL_SIZE * i;
+    double err = norm_2(Vector2(m_residuals[index], m_residuals[index + 1]));
+
+    // Divide back the residual by the multiplier weight
+    if (m_opt.reference_terrain_weight > 0)
+      err /= m_opt.reference_terrain_weight;
+
+    m_errors[i] = err;
+    os << llh[0] << ", " << llh[1] << ", " << llh[2] << ", " << err << "\n";
+  }
+};
+
 /// Compute the residuals
 void compute_residuals(bool apply_loss_function,
                        Options const& opt,
@@ -416,7 +619,7 @@ void compute_residuals(bool apply_loss_function,
 }
 
 /// Compute residual map by averaging all the reprojection error at a given point
-void compute_mean_residuals_at_xyz(CRNJ & crn,
+void compute_mean_residuals_at_xyz(asp::BAObservations const& obs,
                                   std::vector<double> const& residuals,
                                   asp::BAParams const& param_storage,
                                   // outputs
@@ -430,13 +633,12 @@ void compute_mean_residuals_at_xyz(CRNJ & crn,
   //  same order they were originally added to Ceres.
   
   size_t residual_index = 0;
-  // Double loop through cameras and crn entries will give us the correct order
+  // Double loop through cameras and observations will give us the correct order
   for ( size_t icam = 0; icam < param_storage.num_cameras(); icam++ ) {
-    typedef CameraNode<JFeature>::const_iterator crn_iter;
-    for (crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++){
+    for (size_t iobs = obs.begin(icam); iobs < obs.end(icam); iobs++) {
 
       // The index of the 3D point
-      int ipt = (**fiter).m_point_id;
+      int ipt = obs.point_id(iobs);
 
       if (param_storage.get_point_outlier(ipt))
         continue; // skip outliers
@@ -505,27 +707,11 @@ void write_residual_map(std::string const& output_prefix,
   // do not modify the line below.
   file << "# " << opt.datum << std::endl;
   
-  // Now write all the points to the file
-  for (size_t i = 0; i < param_storage.num_points(); i++) {
-
-    if (param_storage.get_point_outlier(i))
-      continue; // skip outliers
-    
-      // The final GCC coordinate of this point
-      const double * point = param_storage.get_point_ptr(i);
-      Vector3 xyz(point[0], point[1], point[2]);
-
-      Vector3 llh = opt.datum.cartesian_to_geodetic(xyz);
-
-      std::string comment = "";
-      if (cnet[i].type() == ControlPoint::GroundControlPoint)
-        comment = " # GCP";
-      else if (cnet[i].type() == ControlPoint::PointFromDem)
-        comment = " # from DEM";
-      
-      file << llh[0] <<", "<< llh[1] <<", "<< llh[2] <<", "<< mean_residuals[i] <<", "
-           << num_point_observations[i] << comment << std::endl;
-  }
+  // Now write all the points to the file. The conversion to lon-lat
+  // and the formatting are done in parallel.
+  ResidualMapFormat format(mean_residuals, num_point_observations, param_storage,
+                           cnet, opt.datum);
+  write_lines_in_parallel(file, param_storage.num_points(), 10000, format);
   file.close();
 
 } // End function write_residual_map
@@ -540,7 +726,7 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
                          size_t num_gcp_or_dem_residuals,
                          size_t num_tri_residuals,
                          std::vector<vw::Vector3> const& reference_vec,
-                         ControlNetwork const& cnet, CRNJ & crn, 
+                         ControlNetwork const& cnet, asp::BAObservations const& obs, 
                          ceres::Problem &problem) {
   
   std::vector<double> residuals;
@@ -579,46 +765,31 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
     residual_file_reference_xyz.precision(18); // TODO(oalexan1): Replace here with 17
   }
   
+  // The pixel residuals of each camera are stored contiguously
+  size_t num_cameras = param_storage.num_cameras();
+  std::vector<size_t> cam_residual_starts(num_cameras);
   size_t index = 0;
-  // For each camera, average together all the point observation residuals
+  for (size_t c = 0; c < num_cameras; c++) {
+    cam_residual_starts[c] = index;
+    index += PIXEL_SIZE * cam_residual_counts[c];
+  }
+
+  // For each camera, average together all the point observation
+  // residuals. The cameras are processed in parallel.
+  std::vector<double> mean_cam_residuals(num_cameras), median_cam_residuals(num_cameras);
+  RawPixelsFormat raw_pixels_format(opt, residuals, cam_residual_counts, cam_residual_starts,
+                                    mean_cam_residuals, median_cam_residuals);
+  write_lines_in_parallel(residual_file_raw_pixels, num_cameras, 1, raw_pixels_format);
+
   residual_file << "Mean and median norm of residual error and point count for cameras:\n";
-  for (size_t c = 0; c < param_storage.num_cameras(); c++) {
-    size_t num_this_cam_residuals = cam_residual_counts[c];
-    
-    // Write header for the raw file
+  for (size_t c = 0; c < num_cameras; c++) {
     std::string name = opt.camera_files[c];
     if (name == "")
       name = opt.image_files[c];
-    
-    residual_file_raw_pixels << name << ", " << num_this_cam_residuals << std::endl;
-
-    // All residuals are for inliers, as we do not even add a residual
-    // for an outlier
-    
-    double mean_residual = 0; // Take average of all pixel coord errors
-    std::vector<double> residual_norms;
-    for (size_t i = 0; i < num_this_cam_residuals; i++) {
-      double ex = residuals[index];
-      ++index;
-      double ey = residuals[index];
-      ++index;
-      double residual_norm = std::sqrt(ex * ex + ey * ey);
-      mean_residual += residual_norm;
-      residual_norms.push_back(residual_norm);
-      residual_file_raw_pixels << ex << ", " << ey << std::endl; // Write ex, ey on raw file
-    }
-    // Write line for the summary file
-    mean_residual /= static_cast<double>(num_this_cam_residuals);
-    double median_residual = std::numeric_limits<double>::quiet_NaN();
-    if (residual_norms.size() > 0) {
-      std::sort(residual_norms.begin(), residual_norms.end());
-      median_residual = residual_norms[residual_norms.size()/2];
-    }
-    
-    residual_file << name                   << ", "
-                  << mean_residual          << ", "
-                  << median_residual        << ", "
-                  << num_this_cam_residuals << std::endl;
+    residual_file << name                    << ", "
+                  << mean_cam_residuals[c]   << ", "
+                  << median_cam_residuals[c] << ", "
+                  << cam_residual_counts[c]  << "\n";
   }
   
   residual_file_raw_pixels.close();
@@ -637,8 +808,8 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
         ++index;
       }
       mean_residual /= static_cast<double>(param_storage.params_per_point());
-      residual_file << i << ", " << mean_residual << std::endl;
-      residual_file_raw_gcp << std::endl;
+      residual_file << i << ", " << mean_residual << "\n";
+      residual_file_raw_gcp << "\n";
     }
     residual_file_raw_gcp.close();
   }
@@ -667,8 +838,8 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
       mean_residual_rot /= static_cast<double>(part_size);
     
       residual_file << opt.camera_files[c] << ", " << mean_residual_pos << ", "
-                    << mean_residual_rot << std::endl;
-      residual_file_raw_cams << std::endl;
+                    << mean_residual_rot << "\n";
+      residual_file_raw_cams << "\n";
     }
   }
   residual_file_raw_cams.close();
@@ -678,21 +849,13 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
   if (reference_vec.size() > 0) {
     residual_file << "reference terrain residual errors:\n";
     residual_file_reference_xyz << "# lon, lat, height_above_datum, pixel_error_norm\n";
-    for (size_t i = 0; i < reference_vec.size(); i++) {
-
-      Vector3 llh = opt.datum.cartesian_to_geodetic(reference_vec[i]);
-      double err = norm_2(Vector2(residuals[index], residuals[index + 1]));
-
-      // Divide back the residual by the multiplier weight
-      if (opt.reference_terrain_weight > 0) 
-        err /= opt.reference_terrain_weight;
-      
-      index += PIXEL_SIZE;
-      residual_file_reference_xyz << llh[0] << ", " << llh[1] << ", " << llh[2] << ", "
-                                  << err << "\n";
-      residual_file << i << ", " << err << "\n";
-      
-    }
+    std::vector<double> errors(reference_vec.size());
+    ReferenceTerrainFormat reference_format(opt, residuals, reference_vec, index, errors);
+    write_lines_in_parallel(residual_file_reference_xyz, reference_vec.size(), 10000,
+                            reference_format);
+    index += PIXEL_SIZE * reference_vec.size();
+    for (size_t i = 0; i < reference_vec.size(); i++)
+      residual_file << i << ", " << errors[i] << "\n";
     residual_file_reference_xyz.close();
   }
 
@@ -707,7 +870,7 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
   std::string map_prefix = residual_prefix + "_pointmap";
   std::vector<double> mean_residuals;
   std::vector<int> num_point_observations;
-  compute_mean_residuals_at_xyz(crn,  residuals,  param_storage,
+  compute_mean_residuals_at_xyz(obs,  residuals,  param_storage,
                                 mean_residuals, num_point_observations);
 
   write_residual_map(map_prefix, mean_residuals, num_point_observations,
@@ -722,9 +885,51 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
 // ----------------------------------------------------------------
 // Start outlier functions
 
+/// Flag the points in a range which are not GCP or outliers, and are
+/// outside the elevation or lon-lat limits.
+class OutOfRangePointsTask: public vw::Task, private boost::noncopyable {
+  Options const& m_opt;
+  ControlNetwork const& m_cnet;
+  asp::BAParams const& m_param_storage;
+  size_t m_beg, m_end;
+  std::vector<char> & m_out_of_range;
+
+public:
+  OutOfRangePointsTask(Options const& opt, ControlNetwork const& cnet,
+                       asp::BAParams const& param_storage, size_t beg, size_t end,
+                       std::vector<char> & out_of_range):
+    m_opt(opt), m_cnet(cnet), m_param_storage(param_storage), m_beg(beg), m_end(end),
+    m_out_of_range(out_of_range) {}
+
+  virtual void operator()() {
+    for (size_t ipt = m_beg; ipt < m_end; ipt++) {
+
+      if (m_cnet[ipt].type() == ControlPoint::GroundControlPoint)
+        continue; // don't filter out GCP
+      if (m_param_storage.get_point_outlier(ipt))
+        continue; // skip outliers
+
+      // The GCC coordinate of this point
+      const double * point = m_param_storage.get_point_ptr(ipt);
+      Vector3 xyz(point[0], point[1], point[2]);
+      Vector3 llh = m_opt.datum.cartesian_to_geodetic(xyz);
+      if (m_opt.elevation_limit[0] < m_opt.elevation_limit[1] &&
+          (llh[2] < m_opt.elevation_limit[0] ||
+           llh[2] > m_opt.elevation_limit[1])) {
+        m_out_of_range[ipt] = 1;
+        continue;
+      }
+
+      Vector2 lon_lat = subvector(llh, 0, 2);
+      if (!m_opt.lon_lat_limit.empty() && !m_opt.lon_lat_limit.contains(lon_lat))
+        m_out_of_range[ipt] = 1;
+    }
+  }
+};
+
 /// Add to the outliers based on the large residuals
 int add_to_outliers(ControlNetwork & cnet,
-                    CRNJ & crn,
+                    asp::BAObservations const& obs,
                     asp::BAParams & param_storage,
                     Options const& opt,
                     std::vector<size_t> const& cam_residual_counts,
@@ -736,7 +941,6 @@ int add_to_outliers(ControlNetwork & cnet,
   vw_out() << "Removing pixel outliers in preparation for another solver attempt.\n";
 
   const size_t num_points  = param_storage.num_points();
-  const size_t num_cameras = param_storage.num_cameras();
   
   // Compute the reprojection error. Hence we should not add the contribution
   // of the loss function.
@@ -751,40 +955,22 @@ int add_to_outliers(ControlNetwork & cnet,
   // Compute the mean residual at each xyz, and how many times that residual is seen
   std::vector<double> mean_residuals;
   std::vector<int   > num_point_observations;
-  compute_mean_residuals_at_xyz(crn,  residuals,  param_storage,
+  compute_mean_residuals_at_xyz(obs,  residuals,  param_storage,
                                 // outputs
                                 mean_residuals, num_point_observations);
 
   // The number of mean residuals is the same as the number of points,
   // of which some are outliers. Hence need to collect only the
-  // non-outliers so far to be able to remove new outliers.  Need to
-  // follow the same logic as when residuals were formed. And also ignore GCP.
+  // non-outliers so far, which are seen in some camera, to be able to
+  // remove new outliers. And also ignore GCP, those are never outliers
+  // no matter what. The order does not matter for the statistics.
   std::vector<double> actual_residuals;
-  std::set<int> was_added;
-  for ( size_t icam = 0; icam < num_cameras; icam++ ) {
-    typedef CameraNode<JFeature>::const_iterator crn_iter;
-    for ( crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++ ){
-
-      // The index of the 3D point
-      int ipt = (**fiter).m_point_id;
-
-      // skip existing outliers
-      if (param_storage.get_point_outlier(ipt))
-        continue; 
-
-      // Skip gcp, those are never outliers no matter what.
-      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
-        continue;
-
-      // We already encountered this residual in the previous camera
-      if (was_added.find(ipt) != was_added.end()) 
-        continue;
-      
-      was_added.insert(ipt);
-      actual_residuals.push_back(mean_residuals[ipt]);
-      //vw_out() << "XYZ residual " << ipt << " = " << mean_residuals[ipt] << std::endl;
-    }
-  } // End double loop through all the observations
+  for (size_t ipt = 0; ipt < num_points; ipt++) {
+    if (param_storage.get_point_outlier(ipt) || num_point_observations[ipt] == 0 ||
+        cnet[ipt].type() == ControlPoint::GroundControlPoint)
+      continue;
+    actual_residuals.push_back(mean_residuals[ipt]);
+  }
 
   double pct      = 1.0 - opt.remove_outliers_params[0]/100.0;
   double factor   = opt.remove_outliers_params[1];
@@ -807,30 +993,16 @@ int add_to_outliers(ControlNetwork & cnet,
   // TODO(oalexan1): This removes a 3D point altogether if any reprojection
   // errors for it are big. Need to only remove bad reprojection errors
   // and keep a 3D point if it is left with at least two reprojection residuals.
-  int num_outliers_by_reprojection = 0, total = 0;
-  for ( size_t icam = 0; icam < num_cameras; icam++ ) {
-    typedef CameraNode<JFeature>::const_iterator crn_iter;
-    for ( crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++ ){
-
-      // The index of the 3D point
-      int ipt = (**fiter).m_point_id;
-
-      total++;
-      
-      // skip existing outliers
-      if (param_storage.get_point_outlier(ipt))
-        continue; 
-
-      // Skip gcp
-      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
-        continue;
-
-      if (mean_residuals[ipt] > e) {
-        param_storage.set_point_outlier(ipt, true);
-        num_outliers_by_reprojection++;
-      }
+  int num_outliers_by_reprojection = 0, total = obs.size();
+  for (size_t ipt = 0; ipt < num_points; ipt++) {
+    if (param_storage.get_point_outlier(ipt) || num_point_observations[ipt] == 0 ||
+        cnet[ipt].type() == ControlPoint::GroundControlPoint)
+      continue;
+    if (mean_residuals[ipt] > e) {
+      param_storage.set_point_outlier(ipt, true);
+      num_outliers_by_reprojection++;
     }
-  } // End double loop through all the observations
+  }
   vw_out() << "Removed " << num_outliers_by_reprojection << " outliers out of "
            << total << " by reprojection error. Ratio: "
            << double(num_outliers_by_reprojection) / double(total) <<".\n";
@@ -839,32 +1011,25 @@ int add_to_outliers(ControlNetwork & cnet,
   int num_outliers_by_elev_or_lonlat = 0;
   if (opt.elevation_limit[0] < opt.elevation_limit[1] || !opt.lon_lat_limit.empty()) {
 
-    for (size_t ipt = 0; ipt < param_storage.num_points(); ipt++) {
+    // Convert the points to lon-lat-height in parallel. The outlier
+    // flags are bits, so they are set after that, in one thread.
+    std::vector<char> out_of_range(num_points, 0);
+    size_t points_per_task = 100000;
+    {
+      FifoWorkQueue queue(vw_settings().default_num_threads());
+      for (size_t beg = 0; beg < num_points; beg += points_per_task)
+        queue.add_task(boost::shared_ptr<OutOfRangePointsTask>
+                       (new OutOfRangePointsTask(opt, cnet, param_storage, beg,
+                                                 std::min(beg + points_per_task, num_points),
+                                                 out_of_range)));
+      queue.join_all();
+    }
 
-      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
-        continue; // don't filter out GCP
-      if (param_storage.get_point_outlier(ipt))
-        continue; // skip outliers
-      
-      // The GCC coordinate of this point
-      const double * point = param_storage.get_point_ptr(ipt);
-      Vector3 xyz(point[0], point[1], point[2]);
-      Vector3 llh = opt.datum.cartesian_to_geodetic(xyz);
-      if (opt.elevation_limit[0] < opt.elevation_limit[1] && 
-          (llh[2] < opt.elevation_limit[0] ||
-           llh[2] > opt.elevation_limit[1])) {
-        param_storage.set_point_outlier(ipt, true);
-        num_outliers_by_elev_or_lonlat++;
-        continue;
-      }
-      
-      Vector2 lon_lat = subvector(llh, 0, 2);
-      if ( !opt.lon_lat_limit.empty() && !opt.lon_lat_limit.contains(lon_lat) ) {
+    for (size_t ipt = 0; ipt < num_points; ipt++) {
+      if (out_of_range[ipt]) {
         param_storage.set_point_outlier(ipt, true);
         num_outliers_by_elev_or_lonlat++;
-        continue;
       }
-      
     }
     vw_out() << "Removed " << num_outliers_by_elev_or_lonlat
              << " outliers by elevation range and/or lon-lat range.\n";
@@ -1005,8 +1170,62 @@ void initial_filter_by_proj_win(Options             & opt,
   }
 }
 
+/// Choose the Ceres linear solver, per the recommendations in the
+/// Ceres solving FAQs. What matters is the number of cameras being
+/// optimized, as the fixed ones do not enter the reduced camera system.
+void set_linear_solver(std::string const& solver, int num_floating_cameras,
+                       ceres::Solver::Options & options) {
+
+  if (solver == "dense-schur") {
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (solver == "sparse-schur") {
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+  } else if (solver == "iterative-schur") {
+    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+  } else if (solver == "auto") {
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+    if (num_floating_cameras < 100)
+      options.linear_solver_type = ceres::DENSE_SCHUR;
+    if (num_floating_cameras > 3500) {
+      // This is supposed to help with speed in a certain size range
+      options.use_explicit_schur_complement = true;
+      options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+      options.preconditioner_type = ceres::SCHUR_JACOBI;
+    }
+    if (num_floating_cameras > 7000)
+      options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+  } else {
+    vw_throw(ArgumentErr() << "Unknown linear solver: " << solver << ".\n");
+  }
+}
+
+/// Make the Schur solvers eliminate the triangulated points first,
+/// and solve for the cameras and intrinsics after that. No two points
+/// share a residual, so they form an independent set.
+void set_point_elimination_ordering(asp::BAParams & param_storage,
+                                    ceres::Problem & problem,
+                                    ceres::Solver::Options & options) {
+
+  ceres::ParameterBlockOrdering * ordering = new ceres::ParameterBlockOrdering;
+  for (size_t ipt = 0; ipt < param_storage.num_points(); ipt++) {
+    double * point = param_storage.get_point_ptr(ipt);
+    if (problem.HasParameterBlock(point))
+      ordering->AddElementToGroup(point, 0);
+  }
+
+  std::vector<double*> blocks;
+  problem.GetParameterBlocks(&blocks);
+  for (size_t it = 0; it < blocks.size(); it++) {
+    if (!ordering->IsMember(blocks[it]))
+      ordering->AddElementToGroup(blocks[it], 1);
+  }
+
+  options.linear_solver_ordering.reset(ordering);
+}
+
 int do_ba_ceres_one_pass(Options             & opt,
-                         CRNJ                & crn,
+                         asp::BAObservations const& obs,
                          bool                  first_pass,
                          asp::BAParams      & param_storage, 
                          asp::BAParams const& orig_parameters,
@@ -1019,8 +1238,8 @@ int do_ba_ceres_one_pass(Options             & opt,
   const int num_cameras = param_storage.num_cameras();
   const int num_points  = param_storage.num_points();
 
-  if ((int)crn.size() != num_cameras) 
-    vw_throw(ArgumentErr() << "Book-keeping error, the size of CameraRelationNetwork "
+  if (obs.num_cameras() != num_cameras) 
+    vw_throw(ArgumentErr() << "Book-keeping error, the number of cameras with observations "
              << "must equal the number of images.\n");
  
   convergence_reached = true;
@@ -1029,12 +1248,11 @@ int do_ba_ceres_one_pass(Options             & opt,
     initial_filter_by_proj_win(opt, param_storage, cnet);
   
   // How many times an xyz point shows up in the problem
-  std::vector<int> count_map(num_points);
+  std::vector<int> count_map;
+  obs.count_point_observations(num_points, count_map);
   for (int i = 0; i < num_points; i++) {
     if (param_storage.get_point_outlier(i))
       count_map[i] = 0; // skip outliers
-    else
-      count_map[i] = cnet[i].size(); // Get number of observations of this point.
   }
 
   // We will optimize multipliers of the intrinsics. This way
@@ -1066,7 +1284,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   }
   if (opt.ref_dem != "") {
     asp::create_interp_dem(opt.ref_dem, dem_georef, interp_dem);
-    asp::calc_avg_intersection_with_dem(cnet, crn, outliers, opt.camera_models,
+    asp::calc_avg_intersection_with_dem(cnet, obs, outliers, opt.camera_models,
                                         dem_georef, interp_dem,
                                         // Output
                                         dem_xyz_vec);
@@ -1075,15 +1293,25 @@ int do_ba_ceres_one_pass(Options             & opt,
   // Add the cost function component for difference of pixel observations
   // - Reduce error by making pixel projection consistent with observations.
   
+  // The tables of the lens distortion of each camera, shared by its
+  // observations. They are made anew for each pass.
+  std::vector<boost::shared_ptr<asp::DistortionTableCache>> distortion_tables(num_cameras);
+  if (opt.camera_type == BaCameraType_Pinhole && opt.distortion_table_spacing > 0) {
+    for (int icam = 0; icam < num_cameras; icam++)
+      distortion_tables[icam].reset
+        (new asp::DistortionTableCache(vw::file_image_size(opt.image_files[icam]),
+                                       opt.distortion_table_spacing,
+                                       opt.distortion_table_max_error));
+  }
+
   // Add the various cost functions the solver will optimize over.
   std::vector<size_t> cam_residual_counts(num_cameras);
-  typedef CameraNode<JFeature>::iterator crn_iter;
   for (int icam = 0; icam < num_cameras; icam++) { // Camera loop
     cam_residual_counts[icam] = 0;
-    for (crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) { // IP loop
+    for (size_t iobs = obs.begin(icam); iobs < obs.end(icam); iobs++) { // IP loop
 
       // The index of the 3D point this IP is for.
-      int ipt = (**fiter).m_point_id;
+      int ipt = obs.point_id(iobs);
       if (param_storage.get_point_outlier(ipt))
         continue; // skip outliers
 
@@ -1132,8 +1360,8 @@ int do_ba_ceres_one_pass(Options             & opt,
 
       // The observed value for the projection of point with index ipt into
       // the camera with index icam.
-      Vector2 observation = (**fiter).m_location;
-      Vector2 pixel_sigma = (**fiter).m_scale;
+      Vector2 observation = obs.pixel(iobs);
+      Vector2 pixel_sigma = obs.sigma(iobs);
 
       // This is a bugfix
       if (pixel_sigma != pixel_sigma) // nan check
@@ -1149,7 +1377,8 @@ int do_ba_ceres_one_pass(Options             & opt,
 
       // Call function to add the appropriate Ceres residual block.
       add_reprojection_residual_block(observation, pixel_sigma, ipt, icam,
-                                      param_storage, opt, problem);
+                                      param_storage, opt, distortion_tables[icam],
+                                      problem);
       cam_residual_counts[icam] += 1; // Track the number of residual blocks for each camera
       
     } // end iterating over points
@@ -1174,12 +1403,14 @@ int do_ba_ceres_one_pass(Options             & opt,
 
     ceres::CostFunction* cost_function;
     if (!opt.use_llh_error) 
-      cost_function = XYZError::Create(observation, xyz_sigma);
+      cost_function = asp::profile_cost(XYZError::Create(observation, xyz_sigma),
+                                        "XYZError");
     else{
       Vector3 llh_sigma = xyz_sigma;
       // make lat,lon into lon,lat
       std::swap(llh_sigma[0], llh_sigma[1]);
-      cost_function = LLHError::Create(observation, llh_sigma, opt.datum);
+      cost_function = asp::profile_cost(LLHError::Create(observation, llh_sigma, opt.datum),
+                                        "LLHError");
     }
 
     // Don't use the same loss function as for pixels since that one
@@ -1212,7 +1443,8 @@ int do_ba_ceres_one_pass(Options             & opt,
   if (opt.camera_weight > 0){
     for (int icam = 0; icam < num_cameras; icam++){
       double const* orig_cam_ptr = orig_parameters.get_camera_ptr(icam);
-      ceres::CostFunction* cost_function = CamError::Create(orig_cam_ptr, opt.camera_weight);
+      ceres::CostFunction* cost_function
+        = asp::profile_cost(CamError::Create(orig_cam_ptr, opt.camera_weight), "CamError");
 
       // Don't use the same loss function as for pixels since that one discounts
       //  outliers and the cameras should never be discounted.
@@ -1231,7 +1463,9 @@ int do_ba_ceres_one_pass(Options             & opt,
     for (int icam = 0; icam < num_cameras; icam++){
       double const* orig_cam_ptr = orig_parameters.get_camera_ptr(icam);
       ceres::CostFunction* cost_function
-        = RotTransError::Create(orig_cam_ptr, opt.rotation_weight, opt.translation_weight);
+        = asp::profile_cost(RotTransError::Create(orig_cam_ptr, opt.rotation_weight,
+                                                  opt.translation_weight),
+                            "RotTransError");
       ceres::LossFunction* loss_function = new ceres::TrivialLoss();
       double * camera  = param_storage.get_camera_ptr(icam);
       problem.AddResidualBlock(cost_function, loss_function, camera);
@@ -1248,8 +1482,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   // option --unalign-disparity. If there are n images,
   // there must be n-1 disparities, from each image to the next.
   // The doc has more info in the bundle_adjust chapter.
-  std::vector<ImageView<DispPixelT>> disp_vec;
-  std::vector<ImageViewRef<DispPixelT>> interp_disp; 
+  std::vector<asp::DisparityTileCache> interp_disp;
   std::vector<vw::Vector3> reference_vec;
   if (opt.reference_terrain != "") {
     // TODO: Pass these properly
@@ -1267,7 +1500,8 @@ int do_ba_ceres_one_pass(Options             & opt,
                          geo,       // may change
                          input_reference_vec); // output
 
-    if (load_reference_disparities(opt.disparity_list, disp_vec, interp_disp) != num_cameras-1)
+    std::vector<std::string> disp_files;
+    if (read_reference_disparity_list(opt.disparity_list, disp_files) != num_cameras-1)
       vw_throw(ArgumentErr() << "Expecting one less disparity than there are cameras.\n");
     
     std::vector<vw::BBox2i> image_boxes;
@@ -1282,7 +1516,15 @@ int do_ba_ceres_one_pass(Options             & opt,
     tpc.report_progress(0);
     double inc_amount = 1.0/double(input_reference_vec.size());
 
-    reference_vec.clear();
+    // Find where the points project in each camera pair, to know which
+    // parts of the disparities to read
+    struct DispCandidate {
+      vw::Vector3 xyz;
+      int icam;
+      Vector2 left_pred, right_pred;
+    };
+    std::vector<DispCandidate> candidates;
+    std::vector<std::vector<Vector2>> left_pixels(num_cameras - 1);
     for (size_t data_col = 0; data_col < input_reference_vec.size(); data_col++) {
 
       vw::Vector3 reference_xyz = input_reference_vec[data_col];
@@ -1301,7 +1543,7 @@ int do_ba_ceres_one_pass(Options             & opt,
 
       Vector2 left_pred, right_pred;
 
-      // Iterate over the cameras, add a residual for each point and each camera pair.
+      // Iterate over the camera pairs
       for (int icam = 0; icam < num_cameras - 1; icam++) {
 
         boost::shared_ptr<CameraModel> left_camera  = opt.camera_models[icam  ];
@@ -1317,39 +1559,60 @@ int do_ba_ceres_one_pass(Options             & opt,
         if ( (left_pred != left_pred) || (right_pred != right_pred) )
           continue; // nan check
 
-        if (!interp_disp[icam].pixel_in_bounds(left_pred))
-          continue; // Interp check
-
-        DispPixelT dispPix = interp_disp[icam](left_pred[0], left_pred[1]);
-        if (!is_valid(dispPix))
-          continue;
-
         // Check if the current point projects in the cameras
         if ( !image_boxes[icam  ].contains(left_pred ) || 
              !image_boxes[icam+1].contains(right_pred)   ) {
           continue;
         }
 
-        Vector2 right_pix = left_pred + dispPix.child();
-        if (!image_boxes[icam+1].contains(right_pix)) 
-          continue; // Check offset location too
+        DispCandidate candidate = {reference_xyz, icam, left_pred, right_pred};
+        candidates.push_back(candidate);
+        left_pixels[icam].push_back(left_pred);
+      }
+      tpc.report_incremental_progress(inc_amount);
+    }
+    tpc.report_finished();
 
-        if (right_pix != right_pix || norm_2(right_pix - right_pred) > opt.max_disp_error) {
-          // Ignore pixels which are too far from where they should be before optimization
-          continue;
-        }
+    // Read only the disparity tiles around these pixels. The margin
+    // allows the left camera to move during optimization by about as
+    // much as the disparity is trusted.
+    double disp_margin = std::max(64.0, 2.0 * opt.max_disp_error);
+    interp_disp.resize(num_cameras - 1);
+    for (int icam = 0; icam < num_cameras - 1; icam++) {
+      if (disp_files[icam] == "none")
+        continue; // Leave the disparity empty
+      vw_out() << "Reading: " << disp_files[icam] << std::endl;
+      interp_disp[icam].load(DiskImageView<DispPixelT>(disp_files[icam]), left_pixels[icam],
+                             disp_margin, opt.reference_disparity_subsample);
+    }
+
+    reference_vec.clear();
+    for (size_t it = 0; it < candidates.size(); it++) {
 
-        reference_vec.push_back(reference_xyz); // only the used reference points are stored here
+      DispCandidate const& c = candidates[it];
+      int icam = c.icam;
 
-        // Call function to select the appropriate Ceres residual block to add.
-        add_disparity_residual_block(reference_xyz, interp_disp[icam],
-                                     icam, icam+1, // left icam and right icam
-                                     param_storage, opt, problem);
+      Vector2 disp;
+      if (!interp_disp[icam].interpolate(c.left_pred, disp))
+        continue;
+
+      Vector2 right_pix = c.left_pred + disp;
+      if (!image_boxes[icam+1].contains(right_pix)) 
+        continue; // Check offset location too
+
+      if (right_pix != right_pix || norm_2(right_pix - c.right_pred) > opt.max_disp_error) {
+        // Ignore pixels which are too far from where they should be before optimization
+        continue;
       }
-      tpc.report_incremental_progress(inc_amount);
+
+      reference_vec.push_back(c.xyz); // only the used reference points are stored here
+
+      // Call function to select the appropriate Ceres residual block to add.
+      add_disparity_residual_block(c.xyz, interp_disp[icam],
+                                   icam, icam+1, // left icam and right icam
+                                   param_storage, opt, problem);
     }
     
-    tpc.report_finished();
     vw_out() << "Found " << reference_vec.size() << " reference points in range.\n";
   } // End of reference terrain block
 
@@ -1371,7 +1634,8 @@ int do_ba_ceres_one_pass(Options             & opt,
       double s = 1.0/opt.tri_weight;
       Vector3 xyz_sigma(s, s, s);
 
-      ceres::CostFunction* cost_function = XYZError::Create(observation, xyz_sigma);
+      ceres::CostFunction* cost_function
+        = asp::profile_cost(XYZError::Create(observation, xyz_sigma), "XYZError");
       ceres::LossFunction* loss_function = get_loss_function(opt, opt.tri_robust_threshold);
       problem.AddResidualBlock(cost_function, loss_function, point);
 
@@ -1402,7 +1666,7 @@ int do_ba_ceres_one_pass(Options             & opt,
     bool apply_loss_function = false;
     write_residual_logs(residual_prefix, apply_loss_function, opt, param_storage, 
                         cam_residual_counts, num_gcp_or_dem_residuals, num_tri_residuals,
-                        reference_vec, cnet, crn, problem);
+                        reference_vec, cnet, obs, problem);
     
     param_storage.record_points_to_kml(point_kml_path, opt.datum, 
                          kmlPointSkip, "initial_points",
@@ -1424,27 +1688,32 @@ int do_ba_ceres_one_pass(Options             & opt,
   else
     options.num_threads = opt.num_threads;
 
-  // Use a callback function at every iteration, if desired to save the intermediate results
-  BaCallback callback(opt, param_storage);
-  if (opt.save_intermediate_cameras) {
+  // Use a callback function at every iteration, if desired to save the
+  // intermediate results, or to report the progress
+  BaCallback callback(opt, param_storage, opt.save_intermediate_cameras);
+  if (opt.save_intermediate_cameras || asp::process_metrics().enabled())
     options.callbacks.push_back(&callback);
+  if (opt.save_intermediate_cameras)
     options.update_state_every_iteration = true;
-  }
 
-  // Set solver options according to the recommendations in the Ceres solving FAQs
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  if (num_cameras < 100)
-    options.linear_solver_type = ceres::DENSE_SCHUR;
-  if (num_cameras > 3500) {
-    // This is supposed to help with speed in a certain size range
-    options.use_explicit_schur_complement = true; 
-    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
-    options.preconditioner_type = ceres::SCHUR_JACOBI;
+  // Set the linear solver based on how many cameras are being optimized
+  int num_floating_cameras = 0;
+  for (int icam = 0; icam < num_cameras; icam++) {
+    if (problem.HasParameterBlock(param_storage.get_camera_ptr(icam)) &&
+        opt.fixed_cameras_indices.find(icam) == opt.fixed_cameras_indices.end())
+      num_floating_cameras++;
   }
-  if (num_cameras > 7000)
-    options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+  set_linear_solver(opt.linear_solver, num_floating_cameras, options);
+  set_point_elimination_ordering(param_storage, problem, options);
+  vw_out() << "Optimizing " << num_floating_cameras << " of " << num_cameras
+           << " cameras with the " << ceres::LinearSolverTypeToString(options.linear_solver_type)
+           << " linear solver";
+  if (options.linear_solver_type == ceres::ITERATIVE_SCHUR)
+    vw_out() << " and the "
+             << ceres::PreconditionerTypeToString(options.preconditioner_type)
+             << " preconditioner";
+  vw_out() << "." << std::endl;
 
-  //options.ordering_type = ceres::SCHUR;
   //options.eta = 1e-3; // FLAGS_eta;
   //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
   //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
@@ -1455,8 +1724,14 @@ int do_ba_ceres_one_pass(Options             & opt,
   vw_out() << "Starting the Ceres optimizer." << std::endl;
   ceres::Solver::Summary summary;
   ceres::Solve(options, &problem, &summary);
+  asp::profile_solver_summary(summary);
+  callback.wait();
   final_cost = summary.final_cost;
   vw_out() << summary.FullReport() << "\n";
+  if (!summary.iterations.empty())
+    vw_out() << "Mean time per iteration: "
+             << summary.minimizer_time_in_seconds / summary.iterations.size()
+             << " seconds." << std::endl;
   if (summary.termination_type == ceres::NO_CONVERGENCE){
     // Print a clarifying message, so the user does not think that the algorithm failed.
     vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
@@ -1470,7 +1745,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   bool apply_loss_function = false;
   write_residual_logs(residual_prefix, apply_loss_function, opt, param_storage, cam_residual_counts,
                       num_gcp_or_dem_residuals, num_tri_residuals,
-                      reference_vec, cnet, crn, problem);
+                      reference_vec, cnet, obs, problem);
   
   std::string point_kml_path = opt.out_prefix + "-final_points.kml";
   std::string url = "http://maps.google.com/mapfiles/kml/shapes/placemark_circle_highlight.png";
@@ -1485,7 +1760,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   // Outlier filtering
   bool remove_outliers = (opt.num_ba_passes > 1);
   if (remove_outliers)
-      add_to_outliers(cnet, crn,
+      add_to_outliers(cnet, obs,
                       param_storage,   // in-out
                       opt, cam_residual_counts, num_gcp_or_dem_residuals,
                       num_tri_residuals, reference_vec, problem);
@@ -1507,7 +1782,7 @@ int do_ba_ceres_one_pass(Options             & opt,
   for (int i = 0; i < param_storage.num_points(); i++)
     if (param_storage.get_point_outlier(i))
       outliers.insert(i); // update this based on param_storage
-  asp::matchFilesProcessing(cnet,
+  asp::matchFilesProcessing(cnet, obs,
                             asp::BaBaseOptions(opt), // note the slicing
                             optimized_cams, remove_outliers, outliers,
                             convAngles, 
@@ -1684,7 +1959,7 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     
     // Must update the number of points after the control network is recomputed
     num_points = cnet.size();
-    param_storage.get_point_vector().resize(num_points*asp::BAParams::PARAMS_PER_POINT);
+    param_storage.resize_points(num_points);
   }
 
   // Fill in the point vector with the starting values.
@@ -1693,16 +1968,17 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
 
   // The camera positions and orientations before we float them
   // - This includes modifications from any initial transforms that were specified.
-  asp::BAParams orig_parameters(param_storage);
+  // - Only the cameras are kept to them, so the points are not copied.
+  bool copy_points = false;
+  asp::BAParams orig_parameters(param_storage, copy_points);
 
   bool has_datum = (opt.datum.name() != asp::UNSPECIFIED_DATUM);
   if (has_datum && (opt.stereo_session == "pinhole") || 
       (opt.stereo_session == "nadirpinhole")) 
     saveCameraReport(opt, param_storage,  opt.datum, "initial");
     
-  // TODO(oalexan1): Is it possible to avoid using CRNs?
-  CRNJ crn;
-  crn.from_cnet(cnet);
+  // The pixel observations, in compact form, grouped by camera
+  asp::BAObservations obs(cnet, num_cameras);
 
   if (opt.num_ba_passes <= 0)
     vw_throw(ArgumentErr() << "Error: Expecting at least one bundle adjust pass.\n");
@@ -1717,7 +1993,7 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
 
     bool first_pass = (pass == 0);
     bool convergence_reached = true; // will change
-    do_ba_ceres_one_pass(opt, crn, first_pass,
+    do_ba_ceres_one_pass(opt, obs, first_pass,
                          param_storage, orig_parameters,
                          convergence_reached, final_cost);
     
@@ -1729,8 +2005,12 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     }
   } // End loop through passes
 
+  // The best parameters are copied only if there are random passes, and
+  // then into the same memory each time
   double best_cost = final_cost;
-  boost::shared_ptr<asp::BAParams> best_params_ptr(new asp::BAParams(param_storage));
+  boost::shared_ptr<asp::BAParams> best_params_ptr;
+  if (opt.num_random_passes > 0 && !opt.apply_initial_transform_only)
+    best_params_ptr.reset(new asp::BAParams(param_storage));
 
   // This flow is only kicked in if opt.num_random_passes is positive, which
   // is not the default.
@@ -1754,7 +2034,7 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     // Do another pass of bundle adjustment.
     bool first_pass = true; // this needs more thinking
     bool convergence_reached = true;
-    do_ba_ceres_one_pass(opt, crn, first_pass,
+    do_ba_ceres_one_pass(opt, obs, first_pass,
                          param_storage, orig_parameters,
                          convergence_reached, final_cost);
     
@@ -1762,7 +2042,7 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     if (final_cost < best_cost) {
       vw_out() << "  --> Found a better solution!\n\n";
       best_cost = final_cost;
-      best_params_ptr.reset(new asp::BAParams(param_storage));
+      *best_params_ptr = param_storage;
 
       // Get a list of all the files that were generated in the random step.
       std::vector<std::string> rand_files;
@@ -1785,11 +2065,12 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   opt.out_prefix = orig_out_prefix; // So the cameras are written to the expected paths.
 
   // Write the results to disk.
-  saveResults(opt, *best_params_ptr);
+  asp::BAParams const& best_params = best_params_ptr ? *best_params_ptr : param_storage;
+  saveResults(opt, best_params);
 
   if (has_datum && (opt.stereo_session == "pinhole") || 
       (opt.stereo_session == "nadirpinhole")) 
-    saveCameraReport(opt, *best_params_ptr, opt.datum, "final");
+    saveCameraReport(opt, best_params, opt.datum, "final");
   
 } // end do_ba_ceres
 
@@ -1845,6 +2126,63 @@ int load_estimated_camera_positions(Options &opt,
   return num_matches_found;  
 }
 
+/// Find the indices in the list of input images of the images in a list file
+void read_image_indices(std::string const& list_file, std::string const& option_name,
+                        std::vector<std::string> const& image_files,
+                        std::set<int> & indices) {
+
+  indices.clear();
+  
+  std::vector<std::string> images;
+  asp::read_list(list_file, images);
+
+  // Find the indices of all images
+  std::map<std::string, int> all_indices;
+  for (size_t image_it = 0; image_it < image_files.size(); image_it++) 
+    all_indices[image_files[image_it]] = image_it;
+
+  for (size_t image_it = 0; image_it < images.size(); image_it++) {
+    auto map_it = all_indices.find(images[image_it]);
+    if (map_it == all_indices.end())
+      vw_throw(ArgumentErr() << "Could not find image " << images[image_it]
+               << " read via " << option_name << " among the input images.\n");
+    indices.insert(map_it->second);
+  }
+}
+
+/// In incremental mode, optimize only the new images and the ones
+/// paired with them, and keep the rest fixed. Pairs of two fixed
+/// images are removed, as they do not constrain the optimized cameras
+/// much, and most of the time in a large block would go to them.
+void select_incremental_pairs(Options & opt, std::vector<std::pair<int,int>> & pairs) {
+
+  std::set<int> floated = opt.incremental_indices;
+  for (size_t it = 0; it < pairs.size(); it++) {
+    int i = pairs[it].first, j = pairs[it].second;
+    if (opt.incremental_indices.count(i) > 0 || opt.incremental_indices.count(j) > 0) {
+      floated.insert(i);
+      floated.insert(j);
+    }
+  }
+
+  std::vector<std::pair<int,int>> kept_pairs;
+  for (size_t it = 0; it < pairs.size(); it++) {
+    if (floated.count(pairs[it].first) > 0 || floated.count(pairs[it].second) > 0)
+      kept_pairs.push_back(pairs[it]);
+  }
+
+  int num_images = opt.image_files.size();
+  for (int icam = 0; icam < num_images; icam++) {
+    if (floated.count(icam) == 0)
+      opt.fixed_cameras_indices.insert(icam);
+  }
+
+  vw_out() << "Incremental mode: optimizing " << num_images - opt.fixed_cameras_indices.size()
+           << " of " << num_images << " cameras, using " << kept_pairs.size()
+           << " of " << pairs.size() << " image pairs.\n";
+  pairs = kept_pairs;
+}
+
 void handle_arguments(int argc, char *argv[], Options& opt) {
   const double nan = std::numeric_limits<double>::quiet_NaN();
   std::string intrinsics_to_float_str, intrinsics_to_share_str,
@@ -1862,6 +2200,16 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "If this is set, and the input cameras are of the pinhole or panoramic type, apply the adjustments directly to the cameras, rather than saving them separately as .adjust files.")
     ("approximate-pinhole-intrinsics", po::bool_switch(&opt.approximate_pinhole_intrinsics)->default_value(false),
      "If it reduces computation time, approximate the lens distortion model.")
+    ("distortion-table-spacing", po::value(&opt.distortion_table_spacing)->default_value(0),
+     "If positive, with pinhole cameras, find the distorted pixels by interpolating in a "
+     "table of the lens distortion sampled at this spacing in pixels, rather than with "
+     "the exact model for each observation. This is much faster for distortion models "
+     "which need an iterative solver. The table is remade when the intrinsics change. "
+     "See also --distortion-table-max-error.")
+    ("distortion-table-max-error", po::value(&opt.distortion_table_max_error)->default_value(0.01),
+     "With --distortion-table-spacing, use the exact lens distortion in any part of the "
+     "image where the interpolated pixels differ from the exact ones by more than this, "
+     "in pixels.")
     ("solve-intrinsics",    po::bool_switch(&opt.solve_intrinsics)->default_value(false)->implicit_value(true),
      "Optimize intrinsic camera parameters.  Only used for pinhole cameras.")
     ("intrinsics-to-float", po::value(&intrinsics_to_float_str)->default_value(""),
@@ -1893,6 +2241,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "A list of indices, in quotes and starting from 0, with space as separator, corresponding to cameras to keep fixed during the optimization process.")
     ("fixed-image-list",    po::value(&opt.fixed_image_list)->default_value(""),
      "A file having a list of images (separated by spaces or newlines) whose cameras should be fixed during optimization.")
+    ("incremental-image-list", po::value(&opt.incremental_image_list)->default_value(""),
+     "A file having a list of images (separated by spaces or newlines) which were added since a previous run, whose adjustments are read with --input-adjustments-prefix. Only these images and the ones they have matches with are optimized, and the other cameras are kept fixed. Matches between two fixed cameras are not used.")
+    ("block-image-list", po::value(&opt.block_image_list)->default_value(""),
+     "Optimize only the images in this list and the ones they have matches with, keeping the other cameras fixed, and save the adjustments only for the images in the list. Images with no adjustment in --input-adjustments-prefix start with none. This is used by parallel_bundle_adjust --num-blocks.")
     ("fix-gcp-xyz",       po::bool_switch(&opt.fix_gcp_xyz)->default_value(false)->implicit_value(true),
      "If the GCP are highly accurate, use this option to not float them during the optimization.")
 
@@ -1909,6 +2261,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "When using a reference terrain as an external control, ignore as outliers xyz points which projected in the left image and transported by disparity to the right image differ by the projection of xyz in the right image by more than this value in pixels.")
     ("reference-terrain-weight", po::value(&opt.reference_terrain_weight)->default_value(1.0),
      "How much weight to give to the cost function terms involving the reference terrain.")
+    ("reference-disparity-subsample", po::value(&opt.reference_disparity_subsample)->default_value(1),
+     "Subsample the disparities from --disparity-list by this factor when reading them, averaging the valid disparities in each block. Only the parts of the disparities around the reference terrain points are read.")
     ("heights-from-dem",   po::value(&opt.heights_from_dem)->default_value(""),
      "If the cameras have already been bundle-adjusted and aligned to a known high-quality DEM, "
      "in the triangulated xyz points replace the heights with the ones from this DEM, and "
@@ -1960,6 +2314,18 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "A higher factor will result in more interest points, but perhaps also more outliers. This is used only with homography alignment, such as for the pinhole session.")
     ("ip-uniqueness-threshold", po::value(&opt.ip_uniqueness_thresh)->default_value(0.8),
      "A higher threshold will result in more interest points, but perhaps less unique ones.")
+    ("ip-cache-dir", po::value(&opt.ip_cache_dir)->default_value(""),
+     "Save the interest points of each image in this directory, and reuse them "
+     "for all pairs the image is in, as long as the image and the interest point "
+     "settings are the same. This can be shared by parallel_bundle_adjust jobs.")
+    ("camera-cache-dir", po::value(&opt.camera_cache_dir)->default_value(""),
+     "Save in this directory, in binary, what is parsed from DigitalGlobe, Pleiades, "
+     "and SPOT5 XML camera files, and reuse it in later runs, as long as the camera "
+     "file contents are the same. This can be shared by parallel_bundle_adjust jobs.")
+    ("ip-nn-method", po::value(&opt.ip_nn_method)->default_value("brute-force"),
+     "How to find the nearest interest point descriptors when matching without "
+     "epipolar constraints. Options: brute-force (exact), flann (approximate, "
+     "faster for many interest points).")
     ("ip-side-filter-percent",  po::value(&opt.ip_edge_buffer_percent)->default_value(-1),
      "Remove matched IPs this percentage from the image left/right sides.")
     ("normalize-ip-tiles", 
@@ -1975,6 +2341,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Set the maximum number of iterations.") // alias for num-iterations
     ("parameter-tolerance",  po::value(&opt.parameter_tolerance)->default_value(1e-8),
      "Stop when the relative error in the variables being optimized is less than this.")
+    ("linear-solver",        po::value(&opt.linear_solver)->default_value("auto"),
+     "The Ceres linear solver to use. Options: auto, dense-schur, sparse-schur, iterative-schur (with the Schur-Jacobi preconditioner). With 'auto', the choice is made by the number of cameras being optimized.")
     ("overlap-limit",        po::value(&opt.overlap_limit)->default_value(0),
      "Limit the number of subsequent images to search for matches to the current image to this value. By default match all images.")
     ("overlap-list",         po::value(&opt.overlap_list_file)->default_value(""),
@@ -2042,6 +2410,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Use the match files from this prefix instead of the current output prefix. This implies --skip-matching.")
     ("clean-match-files-prefix",  po::value(&opt.clean_match_files_prefix)->default_value(""),
      "Use as input match files the *-clean.match files from this prefix. This implies --skip-matching.")
+    ("match-database",  po::value(&opt.match_database)->default_value(""),
+     "Pack the match files into this single file, after matching, if it does not exist. Read the matches from it, rather than from each match file, when processing them after the optimization. Remove this file if the match files change.")
     ("enable-rough-homography",
      po::bool_switch(&opt.enable_rough_homography)->default_value(false)->implicit_value(true),
      "Enable the step of performing datum-based rough homography for interest point matching. This is best used with reasonably reliable input cameras and a wide footprint on the ground.")
@@ -2104,6 +2474,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Only use image matches which can be loaded from disk. This implies --force-reuse-match-files.")
     ("save-intermediate-cameras", po::value(&opt.save_intermediate_cameras)->default_value(false)->implicit_value(true),
      "Save the values for the cameras at each iteration.")
+    ("profile-cost-functions", po::bool_switch(&opt.profile_cost_functions)->default_value(false)->implicit_value(true),
+     "Count the evaluations of each type of cost function and their run time, and save that, with the solver timings, to <output prefix>-cost-profile.json.")
     ("apply-initial-transform-only", po::value(&opt.apply_initial_transform_only)->default_value(false)->implicit_value(true),
      "Apply to the cameras the transform given by --initial-transform. No iterations, GCP loading, or image matching takes place.")
     ("proj-win", po::value(&opt.proj_win)->default_value(BBox2(0,0,0,0), "auto"),
@@ -2323,6 +2695,12 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   if (opt.approximate_pinhole_intrinsics && opt.solve_intrinsics)
     vw_throw( ArgumentErr() << "Cannot approximate intrinsics while solving for them.\n");
 
+  if (opt.distortion_table_spacing < 0 || opt.distortion_table_max_error <= 0)
+    vw_throw( ArgumentErr() << "The distortion table spacing must be non-negative "
+              << "and its maximum error must be positive.\n");
+  if (opt.camera_type != BaCameraType_Pinhole && opt.distortion_table_spacing > 0)
+    vw_throw( ArgumentErr() << "A distortion table can be used only with pinhole cameras.\n");
+
   if (opt.camera_type != BaCameraType_Other &&
       opt.camera_type != BaCameraType_Pinhole &&
       opt.input_prefix != "")
@@ -2524,26 +2902,36 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   if (!opt.fixed_cameras_indices.empty() && !opt.fixed_image_list.empty())
     vw_throw(ArgumentErr() << "Cannot specify both --fixed-camera-indices and "
              << "--fixed-image-list.\n");
-  if (!opt.fixed_image_list.empty()) {
+  if (!opt.fixed_image_list.empty())
+    read_image_indices(opt.fixed_image_list, "--fixed-image-list", opt.image_files,
+                       opt.fixed_cameras_indices);
+
+  if (opt.linear_solver != "auto" && opt.linear_solver != "dense-schur" &&
+      opt.linear_solver != "sparse-schur" && opt.linear_solver != "iterative-schur")
+    vw_throw(ArgumentErr() << "Unknown value for --linear-solver: "
+             << opt.linear_solver << ".\n");
+
+  if (!opt.incremental_image_list.empty()) {
+    if (opt.input_prefix.empty())
+      vw_throw(ArgumentErr() << "The option --incremental-image-list requires "
+               << "--input-adjustments-prefix, with the adjustments of the previous run.\n");
+    read_image_indices(opt.incremental_image_list, "--incremental-image-list",
+                       opt.image_files, opt.incremental_indices);
+    if (opt.incremental_indices.empty())
+      vw_throw(ArgumentErr() << "No images were read via --incremental-image-list.\n");
+  }
 
-    opt.fixed_cameras_indices.clear();
-    
-    std::vector<std::string> fixed_images;
-    asp::read_list(opt.fixed_image_list, fixed_images);
-
-    // Find the indices of all images
-    std::map<std::string, int> all_indices;
-    for (size_t image_it = 0; image_it < opt.image_files.size(); image_it++) 
-      all_indices[opt.image_files[image_it]] = image_it;
-
-    // Find the indices of images to fix
-    for (size_t image_it = 0; image_it < fixed_images.size(); image_it++) {
-      auto map_it = all_indices.find(fixed_images[image_it]);
-      if (map_it == all_indices.end())
-        vw_throw(ArgumentErr() << "Could not find image " << fixed_images[image_it]
-                 << " read via --fixed-image-list among the input images.\n");
-      opt.fixed_cameras_indices.insert(map_it->second);
-    }
+  // A block is optimized as the images added in incremental mode, but
+  // the input adjustments are optional, and only those of the block
+  // are saved.
+  if (!opt.block_image_list.empty()) {
+    if (!opt.incremental_image_list.empty())
+      vw_throw(ArgumentErr() << "Cannot specify both --incremental-image-list and "
+               << "--block-image-list.\n");
+    read_image_indices(opt.block_image_list, "--block-image-list",
+                       opt.image_files, opt.incremental_indices);
+    if (opt.incremental_indices.empty())
+      vw_throw(ArgumentErr() << "No images were read via --block-image-list.\n");
   }
   
   if (opt.reference_terrain != "") {
@@ -2560,6 +2948,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
       vw_throw( ArgumentErr() << "Must specify --max-disp-error in pixels as a positive value.\n");
     if (opt.reference_terrain_weight < 0) 
       vw_throw( ArgumentErr() << "The value of --reference-terrain-weight must be non-negative.\n");
+    if (opt.reference_disparity_subsample < 1) 
+      vw_throw( ArgumentErr() << "The value of --reference-disparity-subsample must be positive.\n");
   }
 
   if (opt.match_files_prefix != "" && opt.clean_match_files_prefix != "") 
@@ -2642,34 +3032,21 @@ void ba_match_ip(Options & opt, SessionPtr session,
 /// perspective or illumination conditions are too different, and
 /// automated matching fails), first create matches among the
 /// mapprojected images (or use any such matches created beforehand
-/// manually by the user), and project those matches into the cameras,
-/// creating matches between the raw images that then bundle_adjust
-/// can use. Both matches between mapprojected images and between
-/// original images are saved to files.
-void matches_from_mapproj_images(int i, int j,
+/// manually by the user). Return true if these must be projected into
+/// the cameras by unproject_mapproj_matches(), which creates matches
+/// between the raw images that then bundle_adjust can use.
+bool matches_from_mapproj_images(int i, int j,
                                  Options& opt, SessionPtr session,
                                  std::vector<std::string> const& map_files,
-                                 vw::cartography::GeoReference const& dem_georef,
-                                 ImageViewRef<PixelMask<double>> & interp_dem,
                                  std::string const& match_filename){
   
-  vw::cartography::GeoReference georef1, georef2;
-  vw_out() << "Reading georef from " << map_files[i] << ' ' << map_files[j] << std::endl;
-  bool is_good1 = vw::cartography::read_georeference(georef1, map_files[i]);
-  bool is_good2 = vw::cartography::read_georeference(georef2, map_files[j]);
-  if (!is_good1 || !is_good2) {
-    vw_throw(ArgumentErr() << "Error: Cannot read georeference.\n");
-  }
-  
-  std::string image1_path  = opt.image_files[i];
-  std::string image2_path  = opt.image_files[j];
   if (boost::filesystem::exists(match_filename)) {
     vw_out() << "Using cached match file: " << match_filename << "\n";
-    return;
+    return false;
   }
 
   if (opt.skip_matching)
-    return;
+    return false;
 
   // If the match file does not exist, create it. The user can create this manually
   // too. 
@@ -2685,39 +3062,69 @@ void matches_from_mapproj_images(int i, int j,
     vw_out() << "Could not find interest points between images "
              << map_files[i] << " and " << map_files[j] << std::endl;
     vw_out(WarningMessage) << e.what() << std::endl;
-    return;
+    return false;
   } //End try/catch
   
   if (!boost::filesystem::exists(map_match_file)) {
     vw_out() << "Missing: " << map_match_file << "\n";
-    return;
+    return false;
+  }
+
+  return true;
+} // End function matches_from_mapproj_images()
+
+/// Project the matches among mapprojected images into the cameras, for
+/// all the given pairs at once, and save the matches between the raw
+/// images. Both matches between mapprojected images and between
+/// original images are saved to files.
+void unproject_mapproj_matches(Options const& opt,
+                               std::vector<std::pair<int, int>> const& pairs,
+                               std::vector<std::string> const& match_files,
+                               std::vector<std::string> const& map_files,
+                               std::vector<vw::cartography::GeoReference> const& map_georefs,
+                               asp::DemRayIntersector const& dem) {
+
+  // Each pair gives a set of interest points for each of its cameras
+  std::vector<std::vector<ip::InterestPoint>> ips(2 * pairs.size());
+  std::vector<int> cam_indices(2 * pairs.size());
+  for (size_t k = 0; k < pairs.size(); k++) {
+    int i = pairs[k].first, j = pairs[k].second;
+    std::string map_match_file = ip::match_filename(opt.out_prefix,
+                                                    map_files[i], map_files[j]);
+    vw_out() << "Reading: " << map_match_file << std::endl;
+    ip::read_binary_match_file(map_match_file, ips[2*k], ips[2*k+1]);
+    cam_indices[2*k]   = i;
+    cam_indices[2*k+1] = j;
   }
 
-  vw_out() << "Reading: " << map_match_file << std::endl;
-  std::vector<ip::InterestPoint> ip1,     ip2;
-  std::vector<ip::InterestPoint> ip1_cam, ip2_cam;
-  ip::read_binary_match_file(map_match_file, ip1, ip2);
-  
   // Undo the map-projection
-  for (size_t ip_iter = 0; ip_iter < ip1.size(); ip_iter++) {
-    
-    vw::ip::InterestPoint P1 = ip1[ip_iter];
-    vw::ip::InterestPoint P2 = ip2[ip_iter];
-    if (!asp::projected_ip_to_raw_ip(P1, interp_dem, opt.camera_models[i], georef1, dem_georef))
-      continue;
-    if (!asp::projected_ip_to_raw_ip(P2, interp_dem, opt.camera_models[j], georef2, dem_georef))
-      continue;
-    
-    ip1_cam.push_back(P1);
-    ip2_cam.push_back(P2);
+  std::vector<std::vector<bool>> good;
+  asp::projected_ips_to_raw_ips(ips, cam_indices, dem, opt.camera_models, map_georefs,
+                                vw_settings().default_num_threads(), good);
+
+  for (size_t k = 0; k < pairs.size(); k++) {
+    std::vector<ip::InterestPoint> ip1_cam, ip2_cam;
+    for (size_t ip_iter = 0; ip_iter < ips[2*k].size(); ip_iter++) {
+      if (!good[2*k][ip_iter] || !good[2*k+1][ip_iter])
+        continue;
+      ip1_cam.push_back(ips[2*k][ip_iter]);
+      ip2_cam.push_back(ips[2*k+1][ip_iter]);
+    }
+
+    vw_out() << "Saving " << ip1_cam.size() << " matches.\n";
+    vw_out() << "Writing: " << match_files[k] << std::endl;
+    ip::write_binary_match_file(match_files[k], ip1_cam, ip2_cam);
+
+    // Compute the coverage fraction
+    Vector2i image_size = vw::file_image_size(opt.image_files[pairs[k].first]);
+    int right_ip_width = image_size[0] *
+                          static_cast<double>(100-opt.ip_edge_buffer_percent)/100.0;
+    Vector2i ip_size(right_ip_width, image_size[1]);
+    double ip_coverage = asp::calc_ip_coverage_fraction(ip2_cam, ip_size);
+    vw_out() << "IP coverage fraction = " << ip_coverage << std::endl;
   }
-  
-  vw_out() << "Saving " << ip1_cam.size() << " matches.\n";
-  
-  vw_out() << "Writing: " << match_filename << std::endl;
-  ip::write_binary_match_file(match_filename, ip1_cam, ip2_cam);
 
-} // End function matches_from_mapproj_images()
+} // End function unproject_mapproj_matches()
 
 /// If the user map-projected the images and created matches by hand
 /// from each map-projected image to the DEM it was map-projected onto,
@@ -2735,9 +3142,12 @@ void create_gcp_from_mapprojected_images(Options const& opt){
   std::string dem_file = image_files.back();
   image_files.erase(image_files.end() - 1); // wipe the dem from the list
 
+  // Only the part of the DEM under the images is kept in memory
+  asp::DemRayIntersector dem = asp::load_mapproj_dem(dem_file, image_files);
   vw::cartography::GeoReference dem_georef;
-  ImageViewRef<PixelMask<double>> interp_dem;
-  asp::create_interp_dem(dem_file, dem_georef, interp_dem);
+  if (!vw::cartography::read_georeference(dem_georef, dem_file))
+    vw_throw(ArgumentErr() << "Error: Cannot read a georeference from DEM: "
+             << dem_file << ".\n");
 
   int num_images = image_files.size();
   std::vector<std::vector<vw::ip::InterestPoint> > matches;
@@ -2771,7 +3181,16 @@ void create_gcp_from_mapprojected_images(Options const& opt){
     matches[num_images] = ip2;
   }
 
+  // Take the ip in each map-projected image, and back-project it into
+  // the camera. The images are done in parallel.
   std::vector<std::vector<vw::ip::InterestPoint> > cam_matches = matches;
+  cam_matches.resize(num_images);
+  std::vector<int> cam_indices(num_images);
+  for (int i = 0; i < num_images; i++)
+    cam_indices[i] = i;
+  std::vector<std::vector<bool>> good;
+  asp::projected_ips_to_raw_ips(cam_matches, cam_indices, dem, opt.camera_models, img_georefs,
+                                vw_settings().default_num_threads(), good);
 
   std::string gcp_file;
   for (int i = 0; i < num_images; i++) {
@@ -2793,35 +3212,36 @@ void create_gcp_from_mapprojected_images(Options const& opt){
     Vector2 dem_pixel(dem_ip.x, dem_ip.y);
     Vector2 lonlat = dem_georef.pixel_to_lonlat(dem_pixel);
 
-    if (!interp_dem.pixel_in_bounds(dem_pixel)) {
+    // The DEM in memory may be cropped
+    double height = 0.0;
+    Vector2 crop_pixel = dem.georef().lonlat_to_pixel(lonlat);
+    if (crop_pixel[0] < 0 || crop_pixel[1] < 0 ||
+        crop_pixel[0] > dem.cols() - 1 || crop_pixel[1] > dem.rows() - 1) {
       vw_out() << "Skipping pixel outside of DEM: " << dem_pixel << std::endl;
       continue;
     }
+    if (!dem.height(crop_pixel, height))
+      continue;
 
-    PixelMask<float> mask_height = interp_dem(dem_pixel[0], dem_pixel[1])[0];
-    if (!is_valid(mask_height)) continue;
-
-    Vector3 llh(lonlat[0], lonlat[1], mask_height.child());
+    Vector3 llh(lonlat[0], lonlat[1], height);
     //Vector3 dem_xyz = dem_georef.datum().geodetic_to_cartesian(llh);
 
     // The ground control point ID
     output_handle << pts_count;
     // Lat, lon, height
-    output_handle << ", " << lonlat[1] << ", " << lonlat[0] << ", " << mask_height.child();
+    output_handle << ", " << lonlat[1] << ", " << lonlat[0] << ", " << height;
     // Sigma values
     output_handle << ", " << 1 << ", " << 1 << ", " << 1;
 
     // Write the per-image information
     for (int i = 0; i < num_images; i++) {
 
-      // Take the ip in the map-projected image, and back-project it into the camera
-      ip::InterestPoint ip = matches[i][p];
-      if (!asp::projected_ip_to_raw_ip(ip, interp_dem, opt.camera_models[i],
-                                  img_georefs[i], dem_georef))
-          continue;
-
       // TODO: Here we can have a book-keeping problem!
-      cam_matches[i][p] = ip;
+      if (!good[i][p]) {
+        cam_matches[i][p] = matches[i][p];
+        continue;
+      }
+      ip::InterestPoint const& ip = cam_matches[i][p];
 
       output_handle << ", " << opt.image_files[i];
       output_handle << ", " << ip.x << ", " << ip.y; // IP location in image
@@ -2856,6 +3276,7 @@ int main(int argc, char* argv[]) {
     xercesc::XMLPlatformUtils::Initialize();
 
     handle_arguments(argc, argv, opt);
+    asp::cost_profile().set_enabled(opt.profile_cost_functions);
 
     asp::load_cameras(opt.image_files, opt.camera_files, opt.out_prefix, opt,  
                       opt.approximate_pinhole_intrinsics,  
@@ -2876,8 +3297,8 @@ int main(int argc, char* argv[]) {
     // For when we make matches based on mapprojected images. Read mapprojected
     // images and a DEM from either command line or a list.
     std::vector<std::string> map_files;
-    vw::cartography::GeoReference dem_georef;
-    ImageViewRef<PixelMask<double>> interp_dem;
+    std::vector<vw::cartography::GeoReference> map_georefs;
+    asp::DemRayIntersector mapproj_dem;
     if (!opt.apply_initial_transform_only) {
       
       if (!opt.mapprojected_data_list.empty()) {
@@ -2897,8 +3318,16 @@ int main(int argc, char* argv[]) {
         
         std::string dem_file = map_files.back();
         map_files.erase(map_files.end() - 1);
+
+        map_georefs.resize(map_files.size());
+        for (size_t it = 0; it < map_files.size(); it++) {
+          vw_out() << "Reading georef from " << map_files[it] << std::endl;
+          if (!vw::cartography::read_georeference(map_georefs[it], map_files[it]))
+            vw_throw(ArgumentErr() << "Error: Cannot read georeference.\n");
+        }
         
-        asp::create_interp_dem(dem_file, dem_georef, interp_dem);
+        // Only the part of the DEM under the images is kept in memory
+        mapproj_dem = asp::load_mapproj_dem(dem_file, map_files);
       }
     }
     
@@ -2912,6 +3341,8 @@ int main(int argc, char* argv[]) {
     // Compute statistics for the designated images (or mapprojected
     // images), and perhaps the footprints
     // TODO(oalexan1): Make this into a function
+    std::vector<std::string> footprint_images;
+    std::vector<boost::shared_ptr<CameraModel>> footprint_cams;
     for (size_t i = 0; i < image_stats_indices.size(); i++) {
 
       if (opt.apply_initial_transform_only)
@@ -2943,12 +3374,22 @@ int main(int argc, char* argv[]) {
       // Use caching function call to compute the image statistics.
       asp::StereoSession::gather_stats(masked_image, image_path, opt.out_prefix, image_path);
 
-      // Compute and cache the camera footprint bbox
-      if (opt.auto_overlap_params != "")
-        asp::camera_bbox_with_cache(dem_file_for_overlap,
-                                    opt.image_files[index], // use the original image
-                                    opt.camera_models[index],  
-                                    opt.out_prefix);
+      // The camera footprint bbox will be computed below
+      if (opt.auto_overlap_params != "") {
+        footprint_images.push_back(opt.image_files[index]); // use the original image
+        footprint_cams.push_back(opt.camera_models[index]);
+      }
+    }
+
+    // Compute and cache the camera footprint bboxes. The DEM is loaded
+    // once, and the footprints are found in parallel.
+    if (!footprint_images.empty()) {
+      int num_threads = vw_settings().default_num_threads();
+      if (opt.single_threaded_cameras)
+        num_threads = 1; // ISIS must be single threaded!
+      std::vector<BBox2> footprint_boxes;
+      asp::camera_bboxes_with_cache(dem_file_for_overlap, footprint_images, footprint_cams,
+                                    opt.out_prefix, num_threads, footprint_boxes);
     }
     
     // Done computing image statistics.
@@ -2993,6 +3434,9 @@ int main(int argc, char* argv[]) {
                                  // Output
                                  all_pairs);
 
+    if (!opt.incremental_indices.empty())
+      select_incremental_pairs(opt, all_pairs);
+
     // Create GCP from mapprojection
     if (opt.gcp_from_mapprojected != "" && !opt.apply_initial_transform_only) {
       create_gcp_from_mapprojected_images(opt);
@@ -3032,7 +3476,10 @@ int main(int argc, char* argv[]) {
       asp::listExistingMatchFiles(prefix, existing_files);
     }
     
-    // Process the selected pairs
+    // Process the selected pairs. The matches among mapprojected images
+    // are projected into the cameras at the end, for all pairs at once.
+    std::vector<std::pair<int, int>> mapproj_pairs;
+    std::vector<std::string> mapproj_match_files;
     for (size_t k = 0; k < this_instance_pairs.size(); k++) {
 
       if (opt.apply_initial_transform_only)
@@ -3103,9 +3550,11 @@ int main(int argc, char* argv[]) {
                       opt.camera_models[j].get(),
                       match_file);
 
-        else
-          matches_from_mapproj_images(i, j, opt, session, map_files, dem_georef, interp_dem,  
-                                      match_file);
+        else if (matches_from_mapproj_images(i, j, opt, session, map_files, match_file)) {
+          mapproj_pairs.push_back(std::make_pair(i, j));
+          mapproj_match_files.push_back(match_file);
+          continue;
+        }
 
         // Compute the coverage fraction
         std::vector<ip::InterestPoint> ip1, ip2;
@@ -3122,13 +3571,26 @@ int main(int argc, char* argv[]) {
       } //End try/catch
     } // End loop through all input image pairs
 
+    if (!mapproj_pairs.empty())
+      unproject_mapproj_matches(opt, mapproj_pairs, mapproj_match_files,
+                                map_files, map_georefs, mapproj_dem);
+
     if (opt.stop_after_matching){
       vw_out() << "Quitting after matches computation.\n";
       return 0;
     }
 
+    // Pack the matches, if asked to, unless done before. Parallel
+    // instances only make their part of the matches, so there is no
+    // point in doing this then.
+    if (!opt.match_database.empty() && opt.instance_count == 1 &&
+        opt.block_image_list.empty() && !boost::filesystem::exists(opt.match_database))
+      asp::MatchDatabase::write(opt.match_database, opt.image_files, opt.match_files);
+
     // All the work happens here! It also writes out the results.
     do_ba_ceres(opt, estimated_camera_gcc);
+    if (opt.profile_cost_functions)
+      asp::cost_profile().write(opt.out_prefix);
 
     xercesc::XMLPlatformUtils::Terminate();
 
@@ -35,6 +35,7 @@
 #include <vw/Camera/OpticalBarModel.h>
 
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/BBoxIndex.h>
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Sessions/CameraUtils.h>
 #include <asp/Camera/BundleAdjustCamera.h>
@@ -57,10 +58,12 @@ struct Options: public asp::BaBaseOptions {
   std::string cnet_file, vwip_prefix,
     cost_function, mapprojected_data, gcp_from_mapprojected,
     image_list, camera_list, mapprojected_data_list,
-    fixed_image_list;
+    fixed_image_list, incremental_image_list, block_image_list;
   int ip_per_tile, ip_per_image, ip_edge_buffer_percent;
   double forced_triangulation_distance, overlap_exponent, ip_triangulation_max_error;
-  int    instance_count, instance_index, num_random_passes, ip_num_ransac_iterations;
+  int    instance_count, instance_index, num_random_passes, ip_num_ransac_iterations,
+    distortion_table_spacing;
+  double distortion_table_max_error;
   bool   save_intermediate_cameras, approximate_pinhole_intrinsics,
     init_camera_using_gcp, disable_pinhole_gcp_init,
     transform_cameras_with_shared_gcp, transform_cameras_using_gcp,
@@ -72,8 +75,8 @@ struct Options: public asp::BaBaseOptions {
     csv_format_str, csv_proj4_str, reference_terrain, disparity_list,
     proj_str;
   double semi_major, semi_minor, position_filter_dist;
-  int    num_ba_passes, max_num_reference_points;
-  std::string remove_outliers_params_str;
+  int    num_ba_passes, max_num_reference_points, reference_disparity_subsample;
+  std::string remove_outliers_params_str, linear_solver, ip_nn_method, ip_cache_dir;
   std::vector<double> intrinsics_limits;
   boost::shared_ptr<vw::ba::ControlNetwork> cnet;
   std::vector<boost::shared_ptr<vw::camera::CameraModel>> camera_models;
@@ -95,6 +98,7 @@ struct Options: public asp::BaBaseOptions {
   vw::Matrix<double> initial_transform;
   std::string   fixed_cameras_indices_str;
   std::set<int> fixed_cameras_indices;
+  std::set<int> incremental_indices; // the new images in incremental mode, or the block
   IntrinsicOptions intrinisc_options;
   
   // Make sure all values are initialized, even though they will be
@@ -116,6 +120,9 @@ struct Options: public asp::BaBaseOptions {
     asp::stereo_settings().epipolar_threshold         = epipolar_threshold;
     asp::stereo_settings().ip_inlier_factor           = ip_inlier_factor;
     asp::stereo_settings().ip_uniqueness_thresh       = ip_uniqueness_thresh;
+    asp::stereo_settings().ip_nn_method               = ip_nn_method;
+    asp::stereo_settings().ip_cache_dir               = ip_cache_dir;
+    asp::stereo_settings().camera_cache_dir           = camera_cache_dir;
     asp::stereo_settings().num_scales                 = num_scales;
     asp::stereo_settings().nodata_value               = nodata_value;
     asp::stereo_settings().enable_correct_atmospheric_refraction
@@ -238,6 +245,19 @@ struct Options: public asp::BaBaseOptions {
 
 }; // End class Options
 
+/// In incremental mode, a new image may have no adjustment from the
+/// previous run. Then it starts with no adjustment. When optimizing a
+/// block, before the first outer iteration no image has one.
+inline bool skip_missing_incremental_adjustment(Options const& opt, int icam,
+                                                std::string const& adjust_file) {
+  bool may_be_missing = !opt.block_image_list.empty() ||
+    opt.incremental_indices.find(icam) != opt.incremental_indices.end();
+  if (!may_be_missing || boost::filesystem::exists(adjust_file))
+    return false;
+  vw_out() << "No input adjustment for image: " << opt.image_files[icam] << "\n";
+  return true;
+}
+
 /// This is for the BundleAdjustmentModel class where the camera parameters
 /// are a rotation/offset that is applied on top of the existing camera model.
 /// First read initial adjustments, if any, and apply perhaps a pc_align transform.
@@ -256,6 +276,8 @@ bool init_cams(Options & opt, asp::BAParams & param_storage,
       std::string adjust_file
         = asp::bundle_adjust_file_name(opt.input_prefix, opt.image_files[icam],
                                        opt.camera_files[icam]);
+      if (skip_missing_incremental_adjustment(opt, icam, adjust_file))
+        continue;
       vw_out() << "Reading input adjustment: " << adjust_file << std::endl;
       double * cam_ptr = param_storage.get_camera_ptr(icam);
       CameraAdjustment adjustment;
@@ -321,10 +343,11 @@ bool init_cams_pinhole(Options & opt, asp::BAParams & param_storage,
     PinholeModel pin_cam = *pin_ptr;
     
     // Read the adjustments from a previous run, if present
-    if (opt.input_prefix != "") {
-      std::string adjust_file
-        = asp::bundle_adjust_file_name(opt.input_prefix, opt.image_files[icam],
-                                       opt.camera_files[icam]);
+    std::string adjust_file;
+    if (opt.input_prefix != "")
+      adjust_file = asp::bundle_adjust_file_name(opt.input_prefix, opt.image_files[icam],
+                                                 opt.camera_files[icam]);
+    if (adjust_file != "" && !skip_missing_incremental_adjustment(opt, icam, adjust_file)) {
       vw_out() << "Reading input adjustment: " << adjust_file << std::endl;
       CameraAdjustment adjustment;
       adjustment.read_from_adjust_file(adjust_file);
@@ -516,14 +539,14 @@ void auto_build_overlap_list(Options &opt, double lonlat_buffer) {
   int  num_overlaps = 0;
   bool read_success = false;
 
-  // Loop through all image pairs
-  for (size_t i=0; i<num_images-1; ++i) {
+  // Read the lonlat bounds of each image once
+  std::vector<vw::BBox2> bboxes(num_images);
+  for (size_t i=0; i<num_images; ++i) {
 
-    // Try to get the lonlat bounds for this image
-    std::vector<vw::Vector2> pixel_corners_i, lonlat_corners_i;
+    std::vector<vw::Vector2> pixel_corners, lonlat_corners;
     try {
-      read_success = asp::read_WV_XML_corners(opt.camera_files[i], pixel_corners_i,
-                                              lonlat_corners_i);
+      read_success = asp::read_WV_XML_corners(opt.camera_files[i], pixel_corners,
+                                              lonlat_corners);
     } catch(...) {
       read_success = false;
     }
@@ -532,40 +555,27 @@ void auto_build_overlap_list(Options &opt, double lonlat_buffer) {
                               << opt.camera_files[i] << ".\n" );
     }
 
-    vw::BBox2 bbox_i; // Convert to BBox
-    for (size_t p=0; p<lonlat_corners_i.size(); ++p)
-      bbox_i.grow(lonlat_corners_i[p]);
-    bbox_i.expand(lonlat_buffer); // Only expand this bounding box by the buffer.
-
-    for (size_t j=i+1; j<num_images; ++j) {
+    for (size_t p=0; p<lonlat_corners.size(); ++p) // Convert to BBox
+      bboxes[i].grow(lonlat_corners[p]);
 
-      std::vector<vw::Vector2> pixel_corners_j, lonlat_corners_j;
-      try {
-        read_success = asp::read_WV_XML_corners(opt.camera_files[j], pixel_corners_j,
-                                                lonlat_corners_j);
-      } catch(...) {
-        read_success = false;
-      }
-      if (!read_success) {
-        vw_throw( ArgumentErr() << "Unable to get corner estimate from file: "
-                                << opt.camera_files[j] << ".\n" );
-      }
+    // Two boxes expanded by half the buffer intersect if one box
+    // expanded by the buffer intersects the other.
+    bboxes[i].expand(0.5 * lonlat_buffer);
+  }
 
-      vw::BBox2 bbox_j; // Convert to BBox
-      for (size_t p=0; p<lonlat_corners_j.size(); ++p)
-        bbox_j.grow(lonlat_corners_j[p]);
-
-      // Record the files if the bboxes overlap
-      // - TODO: Use polygon intersection instead of bounding boxes!
-      if (bbox_i.intersects(bbox_j)) {
-        vw_out() << "Predicted overlap between images " << opt.image_files[i]
-                 << " and " << opt.image_files[j] << std::endl;
-        opt.overlap_list.insert(StringPair(opt.image_files[i], opt.image_files[j]));
-        opt.overlap_list.insert(StringPair(opt.image_files[j], opt.image_files[i]));
-        ++num_overlaps;
-      }
-    } // End inner loop through cameras
-  } // End outer loop through cameras
+  // Record the files if the bboxes overlap. A spatial index is used, so
+  // not all pairs are compared.
+  // - TODO: Use polygon intersection instead of bounding boxes!
+  std::vector<std::pair<int, int>> pairs;
+  asp::overlapping_box_pairs(bboxes, pairs);
+  for (size_t it=0; it<pairs.size(); ++it) {
+    int i = pairs[it].first, j = pairs[it].second;
+    vw_out() << "Predicted overlap between images " << opt.image_files[i]
+             << " and " << opt.image_files[j] << std::endl;
+    opt.overlap_list.insert(StringPair(opt.image_files[i], opt.image_files[j]));
+    opt.overlap_list.insert(StringPair(opt.image_files[j], opt.image_files[i]));
+    ++num_overlaps;
+  }
 
   if (num_overlaps == 0)
     vw_throw( ArgumentErr() << "Failed to automatically detect any overlapping images!" );
@@ -26,6 +26,8 @@
 #include <vw/Camera/CameraUtilities.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/DisparityTileCache.h>
+#include <asp/Camera/DistortionTable.h>
 #include <vw/Camera/OpticalBarModel.h>
 
 
@@ -167,8 +169,12 @@ private:
 class PinholeBundleModel: public CeresBundleModelBase {
 public:
 
-  PinholeBundleModel(boost::shared_ptr<vw::camera::PinholeModel> cam)
-    : m_underlying_camera(cam) {}
+  /// If the distortion tables are given, the distorted pixels are
+  /// interpolated in the table for the current intrinsics.
+  PinholeBundleModel(boost::shared_ptr<vw::camera::PinholeModel> cam,
+                     boost::shared_ptr<asp::DistortionTableCache> distortion_tables
+                     = boost::shared_ptr<asp::DistortionTableCache>())
+    : m_underlying_camera(cam), m_distortion_tables(distortion_tables) {}
 
   /// The number of lens distortion parametrs.
   int num_distortion_params() const {
@@ -232,6 +238,8 @@ public:
 
     try {
       // Project the point into the camera.
+      if (m_distortion_tables)
+        return asp::point_to_pixel_with_table(cam, *m_distortion_tables->table(cam), point);
       Vector2 pixel = cam.point_to_pixel_no_check(point);
       return pixel;
     } catch(...){
@@ -249,6 +257,10 @@ private:
   /// This camera is used for all of the intrinsic values.
   boost::shared_ptr<vw::camera::PinholeModel> m_underlying_camera;
 
+  /// The tables of the distortion of this camera, if used. Shared by
+  /// all observations in the camera.
+  boost::shared_ptr<asp::DistortionTableCache> m_distortion_tables;
+
 }; // End class PinholeBundleModel
 
 
@@ -434,6 +446,121 @@ private:
 
 }; // End class BaReprojectionError
 
+/// The reprojection error for the generic camera case, where only the
+/// six adjustment parameters and the point are floated. The adjusted
+/// camera projects a point as the underlying camera projects the
+/// adjusted point, and the latter is cheap to find. So, the Jacobian
+/// is found by the chain rule, differentiating numerically the
+/// underlying camera only with respect to the three coordinates of the
+/// adjusted point. That takes 7 projections rather than the 19 with
+/// numeric differentiation with respect to all 9 parameters. This is
+/// what matters for linescan and CSM cameras, whose projection is slow.
+class BaAdjustedReprojectionError: public ceres::SizedCostFunction<2, 3, 6> {
+public:
+  BaAdjustedReprojectionError(Vector2 const& observation, Vector2 const& pixel_sigma,
+                              boost::shared_ptr<vw::camera::CameraModel> cam):
+    m_observation(observation), m_pixel_sigma(pixel_sigma), m_underlying_camera(cam) {}
+
+  virtual bool Evaluate(double const * const * parameters, double * residuals,
+                        double ** jacobians) const {
+
+    Vector3 point(parameters[0][0], parameters[0][1], parameters[0][2]);
+    CameraAdjustment correction(parameters[1]);
+    vw::camera::AdjustedCameraModel adj_cam(m_underlying_camera, correction.position(),
+                                            correction.pose());
+
+    // The point as seen by the underlying camera
+    Vector3 adj_point = adj_cam.adjusted_point(point);
+
+    Vector2 prediction;
+    Matrix<double, 2, 3> proj_jac;
+    bool success = true;
+    try {
+      prediction = m_underlying_camera->point_to_pixel(adj_point);
+      if (jacobians != NULL) {
+        for (int c = 0; c < 3; c++) {
+          double step = 1e-6 * std::max(std::abs(adj_point[c]), 1.0);
+          Vector3 plus = adj_point, minus = adj_point;
+          plus[c] += step;
+          minus[c] -= step;
+          Vector2 diff = m_underlying_camera->point_to_pixel(plus)
+            - m_underlying_camera->point_to_pixel(minus);
+          for (int r = 0; r < 2; r++)
+            proj_jac(r, c) = diff[r] / (2.0 * step);
+        }
+      }
+    } catch (std::exception const& e) {
+      success = false;
+    }
+
+    if (!success) {
+      // We must not allow one bad point to ruin the optimization
+      prediction = Vector2(g_big_pixel_value, g_big_pixel_value);
+      proj_jac.set_zero();
+    }
+
+    for (int r = 0; r < 2; r++)
+      residuals[r] = (prediction[r] - m_observation[r])/m_pixel_sigma[r];
+
+    if (jacobians == NULL)
+      return true;
+
+    // The adjusted point is an affine function of the point and of the
+    // translation, so one-sided differences with a unit step are exact.
+    // The rotation, as an axis-angle, enters nonlinearly.
+    Matrix<double, 3, 3> point_jac;
+    Matrix<double, 3, 6> pose_jac;
+    vw::camera::AdjustedCameraModel pert_cam = adj_cam;
+    Vector3 translation = correction.position();
+    Vector3 axis_angle(parameters[1][3], parameters[1][4], parameters[1][5]);
+    for (int c = 0; c < 3; c++) {
+      Vector3 unit;
+      unit[c] = 1.0;
+      select_col(point_jac, c) = adj_cam.adjusted_point(point + unit) - adj_point;
+
+      pert_cam.set_translation(translation + unit);
+      select_col(pose_jac, c) = pert_cam.adjusted_point(point) - adj_point;
+      pert_cam.set_translation(translation);
+
+      double step = 1e-6;
+      pert_cam.set_axis_angle_rotation(axis_angle + step * unit);
+      Vector3 plus = pert_cam.adjusted_point(point);
+      pert_cam.set_axis_angle_rotation(axis_angle - step * unit);
+      Vector3 minus = pert_cam.adjusted_point(point);
+      pert_cam.set_axis_angle_rotation(axis_angle);
+      select_col(pose_jac, c + 3) = (plus - minus) / (2.0 * step);
+    }
+
+    Matrix<double, 2, 3> point_res_jac = proj_jac * point_jac;
+    Matrix<double, 2, 6> pose_res_jac  = proj_jac * pose_jac;
+    for (int r = 0; r < 2; r++) {
+      if (jacobians[0] != NULL) {
+        for (int c = 0; c < 3; c++)
+          jacobians[0][3*r + c] = point_res_jac(r, c) / m_pixel_sigma[r];
+      }
+      if (jacobians[1] != NULL) {
+        for (int c = 0; c < 6; c++)
+          jacobians[1][6*r + c] = pose_res_jac(r, c) / m_pixel_sigma[r];
+      }
+    }
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from the client code.
+  static ceres::CostFunction* Create(Vector2 const& observation,
+                                     Vector2 const& pixel_sigma,
+                                     boost::shared_ptr<vw::camera::CameraModel> cam) {
+    return new BaAdjustedReprojectionError(observation, pixel_sigma, cam);
+  }
+
+private:
+  Vector2 m_observation;
+  Vector2 m_pixel_sigma;
+  boost::shared_ptr<vw::camera::CameraModel> m_underlying_camera;
+
+}; // End class BaAdjustedReprojectionError
+
 /// A ceres cost function. Here we float two pinhole camera's
 /// intrinsic and extrinsic parameters. We take as input a reference
 /// xyz point and a disparity from left to right image. The
@@ -444,7 +571,7 @@ private:
 /// straight into the right image.
 struct BaDispXyzError {
   BaDispXyzError(Vector3 const& reference_xyz,
-                 ImageViewRef<DispPixelT> const& interp_disp,
+                 asp::DisparityTileCache const& interp_disp,
                  boost::shared_ptr<CeresBundleModelBase> left_camera_wrapper,
                  boost::shared_ptr<CeresBundleModelBase> right_camera_wrapper,
                  bool is_pinhole, // Would like to remove these!
@@ -471,20 +598,14 @@ struct BaDispXyzError {
       Vector2 right_prediction = m_right_camera_wrapper->evaluate(right_param_blocks);
 
       // See how consistent that is with the observed disparity.
-      bool good_ans = true;
-      if (!m_interp_disp.pixel_in_bounds(left_prediction)) {
-        good_ans = false;
-      }else{
-        DispPixelT dispPix = m_interp_disp(left_prediction[0], left_prediction[1]);
-        if (!is_valid(dispPix)) {
-          good_ans = false;
-        }else{
-          Vector2 right_prediction_from_disp = left_prediction + dispPix.child();
-          residuals[0] = right_prediction_from_disp[0] - right_prediction[0];
-          residuals[1] = right_prediction_from_disp[1] - right_prediction[1];
-          for (size_t it = 0; it < 2; it++) 
-            residuals[it] *= g_reference_terrain_weight;
-        }
+      Vector2 disp;
+      bool good_ans = m_interp_disp.interpolate(left_prediction, disp);
+      if (good_ans) {
+        Vector2 right_prediction_from_disp = left_prediction + disp;
+        residuals[0] = right_prediction_from_disp[0] - right_prediction[0];
+        residuals[1] = right_prediction_from_disp[1] - right_prediction[1];
+        for (size_t it = 0; it < 2; it++) 
+          residuals[it] *= g_reference_terrain_weight;
       }
 
       // TODO: Think more of what to do below. The hope is that the robust cost
@@ -592,7 +713,7 @@ struct BaDispXyzError {
   // Factory to hide the construction of the CostFunction object from
   // the client code.
   static ceres::CostFunction* Create(
-      Vector3 const& reference_xyz, ImageViewRef<DispPixelT> const& interp_disp,
+      Vector3 const& reference_xyz, asp::DisparityTileCache const& interp_disp,
       boost::shared_ptr<CeresBundleModelBase> left_camera_wrapper,
       boost::shared_ptr<CeresBundleModelBase> right_camera_wrapper,
       bool is_pinhole, IntrinsicOptions intrin_opt = IntrinsicOptions()) {
@@ -631,7 +752,7 @@ struct BaDispXyzError {
   }  // End function Create
 
   Vector3 m_reference_xyz;
-  ImageViewRef<DispPixelT> const& m_interp_disp;
+  asp::DisparityTileCache const& m_interp_disp;
   size_t m_num_left_param_blocks, m_num_right_param_blocks;
   // TODO: Make constant!
   boost::shared_ptr<CeresBundleModelBase> m_left_camera_wrapper;
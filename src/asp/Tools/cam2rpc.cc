@@ -32,9 +32,14 @@
 #include <asp/Core/FileUtils.h>
 #include <asp/Camera/RPCModelGen.h>
 #include <asp/Core/PointUtils.h>
+#include <vw/Core/ThreadPool.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <limits>
 #include <cstring>
+#include <set>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -59,11 +64,12 @@ struct Options : public vw::GdalWriteOptions {
   float input_nodata_value, output_nodata_value;
   double semi_major, semi_minor;
   double gsd;
-  int num_samples;
+  int num_samples, refine_passes;
+  double refine_fraction;
   Datum datum;
   Options(): penalty_weight(-1.0), no_crop(false),
              skip_computing_rpc(false), save_tif(false), has_output_nodata(false),
-             gsd(-1.0), num_samples(-1) {}
+             gsd(-1.0), num_samples(-1), refine_passes(0), refine_fraction(0.0) {}
 };
 
 void handle_arguments(int argc, char *argv[], Options& opt) {
@@ -85,6 +91,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "How many samples to use in each direction in the longitude-latitude-height range.")
     ("penalty-weight",     po::value(&opt.penalty_weight)->default_value(0.03), // check here!
      "A higher penalty weight will result in smaller higher-order RPC coefficients.")
+    ("refine-passes",     po::value(&opt.refine_passes)->default_value(0),
+     "After fitting the RPC model, add samples around the ones where the fit error is largest, and fit again. Do this many times, each time with samples twice as close.")
+    ("refine-fraction",   po::value(&opt.refine_fraction)->default_value(0.05),
+     "The fraction of the samples, with the largest fit error, around which to add samples on each refinement pass.")
     ("save-tif-image", po::bool_switch(&opt.save_tif)->default_value(false),
      "Save a TIF version of the input image that approximately corresponds to the input longitude-latitude-height range and which can be used for stereo together with the RPC model.")
     ("input-nodata-value", po::value(&opt.input_nodata_value)->default_value(nan),
@@ -174,6 +184,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   vw_out() << "Lon-lat range is " << opt.lon_lat_range.min() << ' ' << opt.lon_lat_range.max()
            << std::endl;
 
+  if (opt.refine_passes < 0)
+    vw_throw( ArgumentErr() << "The number of refinement passes must be non-negative.\n");
+  if (opt.refine_fraction <= 0.0 || opt.refine_fraction > 1.0)
+    vw_throw( ArgumentErr() << "The refinement fraction must be in (0, 1].\n");
+
   if (!opt.dem_file.empty()) {
     opt.num_samples *= 5;
     vw_out() << "Since an input DEM was specified, increasing the number of samples "
@@ -187,6 +202,233 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   }
 }
 
+// Find the lon-lat-height of a sample and its pixel in the camera.
+// When sampling a lon-lat-height box, the sample position is the lon,
+// lat, and height. When sampling a DEM, it is the DEM column and row.
+bool sample_point(Options const& opt, CameraModel const* cam, BBox2 const& image_box,
+                  ImageViewRef< PixelMask<float> > const& input_img,
+                  ImageView< PixelMask<double> > const& dem, GeoReference const& dem_geo,
+                  Vector3 const& pos, Vector3 & llh, Vector2 & cam_pix) {
+
+  if (opt.dem_file.empty()) {
+    llh = pos;
+  } else {
+    int col = pos[0], row = pos[1]; // cast to int
+    if (col < 0 || row < 0 || col >= dem.cols() || row >= dem.rows() ||
+        !is_valid(dem(col, row)))
+      return false;
+
+    Vector2 lonlat = dem_geo.pixel_to_lonlat(Vector2(col, row));
+    llh = Vector3(lonlat[0], lonlat[1], dem(col, row).child());
+  }
+
+  Vector3 xyz = opt.datum.geodetic_to_cartesian(llh);
+
+  // Go back to llh. This is a bugfix for the 360 deg offset problem.
+  llh = opt.datum.cartesian_to_geodetic(xyz);
+
+  try {
+    // the point_to_pixel function can be capricious
+    cam_pix = cam->point_to_pixel(xyz);
+  }catch(...){
+    return false;
+  }
+
+  if (!image_box.contains(cam_pix))
+    return false;
+
+  // When sampling a DEM, skip the pixels which are nodata in the image
+  if (!opt.dem_file.empty() && !is_valid(input_img(cam_pix[0], cam_pix[1])))
+    return false;
+
+  return true;
+}
+
+// Sample every num_tasks-th position, starting with the given
+// one. Each task has its own camera and image, and writes only its own
+// entries of the outputs.
+class SampleTask: public vw::Task, private boost::noncopyable {
+  Options                        const& m_opt;
+  boost::shared_ptr<CameraModel>        m_cam;
+  BBox2                                 m_image_box;
+  ImageView< PixelMask<double> > const& m_dem;
+  GeoReference                          m_dem_geo;
+  std::vector<Vector3>           const& m_positions;
+  int                                   m_start, m_num_tasks;
+  vw::ProgressCallback           const* m_tpc; // may be NULL
+  std::vector<char>                   & m_valid;
+  std::vector<Vector3>                & m_llh;
+  std::vector<Vector2>                & m_pixels;
+
+public:
+  SampleTask(Options const& opt, boost::shared_ptr<CameraModel> cam,
+             BBox2 const& image_box,
+             ImageView< PixelMask<double> > const& dem, GeoReference const& dem_geo,
+             std::vector<Vector3> const& positions, int start, int num_tasks,
+             vw::ProgressCallback const* tpc,
+             std::vector<char> & valid, std::vector<Vector3> & llh,
+             std::vector<Vector2> & pixels):
+    m_opt(opt), m_cam(cam), m_image_box(image_box), m_dem(dem), m_dem_geo(dem_geo),
+    m_positions(positions), m_start(start), m_num_tasks(num_tasks), m_tpc(tpc),
+    m_valid(valid), m_llh(llh), m_pixels(pixels) {}
+
+  void operator()() {
+    DiskImageView<float> disk_view(m_opt.image_file);
+    ImageViewRef< PixelMask<float> > input_img
+      = create_mask_less_or_equal(disk_view, m_opt.input_nodata_value);
+
+    size_t num = m_positions.size();
+    for (size_t i = m_start; i < num; i += m_num_tasks) {
+      m_valid[i] = sample_point(m_opt, m_cam.get(), m_image_box, input_img,
+                                m_dem, m_dem_geo, m_positions[i], m_llh[i], m_pixels[i]);
+      // Only the first task reports progress, which is about the same for all
+      if (m_tpc != NULL && m_start == 0 && i % 1000 == 0)
+        m_tpc->report_progress(double(i) / num);
+    }
+  }
+};
+
+// Sample the camera at the given positions in parallel, with one
+// camera per thread. Append the valid samples, in the order of the
+// positions, so that the result does not depend on the number of
+// threads.
+void sample_camera(Options const& opt,
+                   std::vector< boost::shared_ptr<CameraModel> > const& cams,
+                   BBox2 const& image_box,
+                   ImageView< PixelMask<double> > const& dem, GeoReference const& dem_geo,
+                   std::vector<Vector3> const& positions,
+                   vw::ProgressCallback const* tpc,
+                   std::vector<Vector3> & all_positions,
+                   std::vector<Vector3> & all_llh,
+                   std::vector<Vector2> & all_pixels) {
+
+  size_t num = positions.size();
+  std::vector<char>    valid(num, 0);
+  std::vector<Vector3> llh(num);
+  std::vector<Vector2> pixels(num);
+
+  int num_tasks = cams.size();
+  FifoWorkQueue queue(num_tasks);
+  for (int task = 0; task < num_tasks; task++) {
+    boost::shared_ptr<SampleTask> sample_task
+      (new SampleTask(opt, cams[task], image_box, dem, dem_geo, positions,
+                      task, num_tasks, tpc, valid, llh, pixels));
+    queue.add_task(sample_task);
+  }
+  queue.join_all();
+
+  for (size_t i = 0; i < num; i++) {
+    if (!valid[i])
+      continue;
+    all_positions.push_back(positions[i]);
+    all_llh.push_back(llh[i]);
+    all_pixels.push_back(pixels[i]);
+  }
+}
+
+// Fit the RPC model to the samples, and find the error of the fit, in
+// pixels, at each sample.
+void fit_rpc(Options const& opt,
+             std::vector<Vector3> const& all_llh, std::vector<Vector2> const& all_pixels,
+             Vector3 const& llh_scale, Vector3 const& llh_offset,
+             Vector2 const& pixel_scale, Vector2 const& pixel_offset,
+             asp::RPCModel::CoeffVec & line_num, asp::RPCModel::CoeffVec & line_den,
+             asp::RPCModel::CoeffVec & samp_num, asp::RPCModel::CoeffVec & samp_den,
+             std::vector<double> & errors) {
+
+  Vector<double> normalized_llh;
+  Vector<double> normalized_pixels;
+  int num_total_pts = all_llh.size();
+  normalized_llh.set_size(asp::RPCModel::GEODETIC_COORD_SIZE*num_total_pts);
+  normalized_pixels.set_size(asp::RPCModel::IMAGE_COORD_SIZE*num_total_pts
+                             + asp::RpcSolveLMA::NUM_PENALTY_TERMS);
+  for (size_t i = 0; i < normalized_pixels.size(); i++) {
+    // Important: The extra penalty terms are all set to zero here.
+    normalized_pixels[i] = 0.0; 
+  }
+
+  // Form the arrays of normalized pixels and normalized llh
+  for (int pt = 0; pt < num_total_pts; pt++) {
+    // Normalize the pixel to -1 <> 1 range
+    Vector3 llh_n   = elem_quot(all_llh[pt]    - llh_offset,   llh_scale);
+    Vector2 pixel_n = elem_quot(all_pixels[pt] - pixel_offset, pixel_scale);
+    subvector(normalized_llh, asp::RPCModel::GEODETIC_COORD_SIZE*pt,
+              asp::RPCModel::GEODETIC_COORD_SIZE) = llh_n;
+    subvector(normalized_pixels, asp::RPCModel::IMAGE_COORD_SIZE*pt,
+              asp::RPCModel::IMAGE_COORD_SIZE   ) = pixel_n;
+  }
+
+  // Find the RPC coefficients
+  std::string output_prefix = "";
+  vw_out() << "Generating the RPC approximation using " << num_total_pts << " point pairs.\n";
+  asp::gen_rpc(// Inputs
+               opt.penalty_weight, output_prefix,
+               normalized_llh, normalized_pixels,
+               llh_scale, llh_offset, pixel_scale, pixel_offset,
+               // Outputs
+               line_num, line_den, samp_num, samp_den);
+
+  errors.resize(num_total_pts);
+  double max_err = 0.0, mean_err = 0.0;
+  for (int pt = 0; pt < num_total_pts; pt++) {
+    Vector3 llh_n = subvector(normalized_llh, asp::RPCModel::GEODETIC_COORD_SIZE*pt,
+                              asp::RPCModel::GEODETIC_COORD_SIZE);
+    Vector2 pixel_n = asp::RPCModel::normalized_geodetic_to_normalized_pixel
+      (llh_n, line_num, line_den, samp_num, samp_den);
+    errors[pt] = norm_2(elem_prod(pixel_n, pixel_scale) + pixel_offset - all_pixels[pt]);
+    max_err = std::max(max_err, errors[pt]);
+    mean_err += errors[pt];
+  }
+  if (num_total_pts > 0)
+    mean_err /= num_total_pts;
+  vw_out() << "RPC fit error in pixels: mean " << mean_err << ", max " << max_err << ".\n";
+}
+
+// Positions halfway, at the given pass, between the samples having
+// the largest fit errors and their neighbors. When sampling a DEM,
+// positions closer than a DEM pixel are not used.
+void refinement_positions(Options const& opt, Vector3 const& delta, int pass,
+                          std::vector<Vector3> const& all_positions,
+                          std::vector<double> const& errors,
+                          std::vector<Vector3> & positions) {
+
+  positions.clear();
+  size_t num = errors.size();
+  size_t num_worst = std::min(num, size_t(std::ceil(opt.refine_fraction * num)));
+  std::vector<size_t> order(num);
+  for (size_t i = 0; i < num; i++)
+    order[i] = i;
+  std::partial_sort(order.begin(), order.begin() + num_worst, order.end(),
+                    [&errors](size_t a, size_t b) { return errors[a] > errors[b]; });
+
+  Vector3 step = delta / std::pow(2.0, pass + 1); // half the spacing of the previous pass
+  bool use_dem = !opt.dem_file.empty();
+  std::set< std::array<double, 3> > seen; // neighboring samples can share new positions
+  for (size_t it = 0; it < num_worst; it++) {
+    Vector3 const& pos = all_positions[order[it]];
+    for (int coord = 0; coord < 3; coord++) {
+      if (step[coord] <= 0.0 || (use_dem && step[coord] < 1.0))
+        continue;
+      for (int sign = -1; sign <= 1; sign += 2) {
+        Vector3 p = pos;
+        p[coord] += sign * step[coord];
+        // Stay in the lon-lat-height box. The DEM extent is checked when sampling.
+        if (!use_dem) {
+          BBox2 const& ll = opt.lon_lat_range;
+          if ((coord == 0 && (p[0] < ll.min()[0] || p[0] > ll.max()[0])) ||
+              (coord == 1 && (p[1] < ll.min()[1] || p[1] > ll.max()[1])) ||
+              (coord == 2 && (p[2] < opt.height_range[0] || p[2] > opt.height_range[1])))
+            continue;
+        }
+        std::array<double, 3> key = {{p[0], p[1], p[2]}};
+        if (!seen.insert(key).second)
+          continue;
+        positions.push_back(p);
+      }
+    }
+  }
+}
+
 int main( int argc, char *argv[] ) {
 
   Options opt;
@@ -258,20 +500,31 @@ int main( int argc, char *argv[] ) {
     if (!opt.image_crop_box.empty()) 
       image_box.crop(opt.image_crop_box);
 
+    // Load a camera for each thread. Cameras which cannot be used from
+    // several threads at once are used from only one.
+    int num_threads = vw_settings().default_num_threads();
+    if (!session->has_thread_safe_cameras())
+      num_threads = 1;
+    std::vector< boost::shared_ptr<CameraModel> > cams(1, cam);
+    for (int thread = 1; thread < num_threads; thread++)
+      cams.push_back(session->camera_model(opt.image_file, opt.camera_file));
+
     // TODO: Merge this code with what is in sfs.cc!
-    // Generate point pairs
+    // Generate point pairs. Keep the position each pair was sampled at,
+    // for refinement.
+    std::vector<Vector3> positions, all_positions;
     std::vector<Vector3> all_llh;
     std::vector<Vector2> all_pixels;
 
-    vw_out() << "Projecting pixels into the camera to generate the RPC model.\n";
-    vw::TerminalProgressCallback tpc("asp", "\t--> ");
-    double inc_amount = 1.0 / double(opt.num_samples);
-
+    // The spacing of the samples
+    Vector3 delta;
 
     // Mask the input image
     ImageViewRef< PixelMask<float> > input_img
       = create_mask_less_or_equal(disk_view, opt.input_nodata_value);
 
+    ImageView< PixelMask<double> > dem;
+    GeoReference dem_geo;
     if (opt.dem_file.empty()) {
 
       vw_out() << "Using datum: " << opt.datum << std::endl;
@@ -281,26 +534,13 @@ int main( int argc, char *argv[] ) {
       double delta_lon = (ll.max()[0] - ll.min()[0])/double(opt.num_samples);
       double delta_lat = (ll.max()[1] - ll.min()[1])/double(opt.num_samples);
       double delta_ht  = (H[1] - H[0])/double(opt.num_samples);
-      tpc.report_progress(0);
+      delta = Vector3(delta_lon, delta_lat, delta_ht);
       for (double lon = ll.min()[0]; lon <= ll.max()[0]; lon += delta_lon) {
         for (double lat = ll.min()[1]; lat <= ll.max()[1]; lat += delta_lat) {
           for (double ht = H[0]; ht <= H[1]; ht += delta_ht) {
-
-            Vector3 llh(lon, lat, ht);
-            Vector3 xyz = opt.datum.geodetic_to_cartesian(llh);
-
-            // Go back to llh. This is a bugfix for the 360 deg offset problem.
-            llh = opt.datum.cartesian_to_geodetic(xyz);
-
-            Vector2 cam_pix = cam->point_to_pixel(xyz);
-            if (image_box.contains(cam_pix)) {
-              all_llh.push_back(llh);
-              all_pixels.push_back(cam_pix);
-            }
-
+            positions.push_back(Vector3(lon, lat, ht));
           }
         }
-        tpc.report_incremental_progress(inc_amount);
       }
 
     }else{
@@ -308,10 +548,9 @@ int main( int argc, char *argv[] ) {
 
       float dem_nodata_val = -std::numeric_limits<float>::max(); 
       vw::read_nodata_val(opt.dem_file, dem_nodata_val);
-      ImageView< PixelMask<double> > dem = create_mask
+      dem = create_mask
         (channel_cast<double>(DiskImageView<float>(opt.dem_file)), dem_nodata_val);
 
-      GeoReference dem_geo;
       if (!read_georeference(dem_geo, opt.dem_file))
         vw_throw( ArgumentErr() << "Missing georef.\n");
 
@@ -323,41 +562,19 @@ int main( int argc, char *argv[] ) {
       // coefficients.
       double delta_col = std::max(1.0, dem.cols()/double(opt.num_samples));
       double delta_row = std::max(1.0, dem.rows()/double(opt.num_samples));
-      tpc.report_progress(0);
+      delta = Vector3(delta_col, delta_row, 0);
       for (double dcol = 0; dcol < dem.cols(); dcol += delta_col) {
         for (double drow = 0; drow < dem.rows(); drow += delta_row) {
-          int col = dcol, row = drow; // cast to int
-
-          if (!is_valid(dem(col, row))) continue;
-
-          Vector2 pix(col, row);
-          Vector2 lonlat = dem_geo.pixel_to_lonlat(pix);
-
-          // Lon lat height
-          Vector3 llh;
-          llh[0] = lonlat[0]; llh[1] = lonlat[1]; llh[2] = dem(col, row).child();
-          Vector3 xyz = opt.datum.geodetic_to_cartesian(llh);
-
-          // Go back to llh. This is a bugfix for the 360 deg offset problem.
-          llh = opt.datum.cartesian_to_geodetic(xyz);
-
-          Vector2 cam_pix;
-          try {
-            // the point_to_pixel function can be capricious
-            cam_pix = cam->point_to_pixel(xyz);
-          }catch(...){
-            continue;
-          }
-
-          if (image_box.contains(cam_pix) && is_valid(input_img(cam_pix[0], cam_pix[1]))) {
-            all_llh.push_back(llh);
-            all_pixels.push_back(cam_pix);
-          }
-
+          positions.push_back(Vector3(dcol, drow, 0));
         }
-        tpc.report_incremental_progress(inc_amount);
       }
     }
+
+    vw_out() << "Projecting pixels into the camera to generate the RPC model.\n";
+    vw::TerminalProgressCallback tpc("asp", "\t--> ");
+    tpc.report_progress(0);
+    sample_camera(opt, cams, image_box, dem, dem_geo, positions, &tpc,
+                  all_positions, all_llh, all_pixels);
     tpc.report_finished();
 
     // The pixel box
@@ -372,6 +589,7 @@ int main( int argc, char *argv[] ) {
 
     // If cropping, adjust the pixels
     BBox2 crop_box;
+    Vector2 pixel_shift;
     if (!opt.no_crop) {
       // Cast to int so that we can crop properly
       pixel_box.min() = floor(pixel_box.min());
@@ -385,8 +603,8 @@ int main( int argc, char *argv[] ) {
         all_pixels[i] -= pixel_box.min();
 
       // Need to first save the corner before subtracting it, otherwise get wrong result
-      Vector2 shift = pixel_box.min(); 
-      pixel_box -= shift;
+      pixel_shift = pixel_box.min(); 
+      pixel_box -= pixel_shift;
     }
 
     // We need this line for other tools
@@ -426,38 +644,29 @@ int main( int argc, char *argv[] ) {
     vw_out() << "Lon-lat-height box for the RPC approx: " << llh_box   << std::endl;
     vw_out() << "Camera pixel box for the RPC approx:   " << pixel_box << std::endl;
 
-    Vector<double> normalized_llh;
-    Vector<double> normalized_pixels;
-    int num_total_pts = all_llh.size();
-    normalized_llh.set_size(asp::RPCModel::GEODETIC_COORD_SIZE*num_total_pts);
-    normalized_pixels.set_size(asp::RPCModel::IMAGE_COORD_SIZE*num_total_pts
-                               + asp::RpcSolveLMA::NUM_PENALTY_TERMS);
-    for (size_t i = 0; i < normalized_pixels.size(); i++) {
-      // Important: The extra penalty terms are all set to zero here.
-      normalized_pixels[i] = 0.0; 
-    }
-
-    // Form the arrays of normalized pixels and normalized llh
-    for (int pt = 0; pt < num_total_pts; pt++) {
-      // Normalize the pixel to -1 <> 1 range
-      Vector3 llh_n   = elem_quot(all_llh[pt]    - llh_offset,   llh_scale);
-      Vector2 pixel_n = elem_quot(all_pixels[pt] - pixel_offset, pixel_scale);
-      subvector(normalized_llh, asp::RPCModel::GEODETIC_COORD_SIZE*pt,
-                asp::RPCModel::GEODETIC_COORD_SIZE) = llh_n;
-      subvector(normalized_pixels, asp::RPCModel::IMAGE_COORD_SIZE*pt,
-                asp::RPCModel::IMAGE_COORD_SIZE   ) = pixel_n;
-    }
-
     // Find the RPC coefficients
     asp::RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
-    std::string output_prefix = "";
-    vw_out() << "Generating the RPC approximation using " << num_total_pts << " point pairs.\n";
-    asp::gen_rpc(// Inputs
-                 opt.penalty_weight, output_prefix,
-                 normalized_llh, normalized_pixels,
-                 llh_scale, llh_offset, pixel_scale, pixel_offset,
-                 // Outputs
-                 line_num, line_den, samp_num, samp_den);
+    std::vector<double> errors;
+    fit_rpc(opt, all_llh, all_pixels, llh_scale, llh_offset, pixel_scale, pixel_offset,
+            line_num, line_den, samp_num, samp_den, errors);
+
+    // Add samples where the fit is worst, and fit again. The
+    // normalization stays the same, as the new samples are within the
+    // box of the initial ones, or very near it.
+    for (int pass = 0; pass < opt.refine_passes; pass++) {
+      refinement_positions(opt, delta, pass, all_positions, errors, positions);
+      size_t num_before = all_pixels.size();
+      sample_camera(opt, cams, image_box, dem, dem_geo, positions, NULL,
+                    all_positions, all_llh, all_pixels);
+      for (size_t i = num_before; i < all_pixels.size(); i++)
+        all_pixels[i] -= pixel_shift;
+      vw_out() << "Refinement pass " << pass + 1 << ": added "
+               << all_pixels.size() - num_before << " samples.\n";
+      if (all_pixels.size() == num_before)
+        break;
+      fit_rpc(opt, all_llh, all_pixels, llh_scale, llh_offset, pixel_scale, pixel_offset,
+              line_num, line_den, samp_num, samp_den, errors);
+    }
 
     // TODO: Integrate this with aster2asp existing functionality!
     // Have a generic function for saving WV RPC files. 
@@ -20,6 +20,7 @@
 
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Core/StringUtils.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Cartography/Datum.h>
@@ -40,6 +41,7 @@
 
 #include <limits>
 #include <cstring>
+#include <mutex>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -301,141 +303,44 @@ void parse_values(std::string list, std::vector<T> & values){
 struct Options : public vw::GdalWriteOptions {
   std::string image_file, camera_file, lon_lat_values_str, pixel_values_str, datum_str,
     reference_dem, frame_index, gcp_file, camera_type, sample_file, input_camera,
-    stereo_session, bundle_adjust_prefix, parsed_cam_ctr_str, parsed_cam_quat_str;
+    stereo_session, bundle_adjust_prefix, parsed_cam_ctr_str, parsed_cam_quat_str,
+    image_list, camera_list;
   double focal_length, pixel_pitch, gcp_std, height_above_datum,
     cam_height, cam_weight, cam_ctr_weight;
   Vector2 optical_center;
   std::vector<double> lon_lat_values, pixel_values;
+  std::vector<std::string> image_files, camera_files; // with --image-list
   bool refine_camera, parse_eci, parse_ecef, input_pinhole; 
   Options(): focal_length(-1), pixel_pitch(-1), gcp_std(1), height_above_datum(0), refine_camera(false), cam_height(0), cam_weight(0), cam_ctr_weight(0), input_pinhole(false) {}
 };
 
-void handle_arguments(int argc, char *argv[], Options& opt) {
-
-  double nan = std::numeric_limits<double>::quiet_NaN();
-  po::options_description general_options("");
-  general_options.add_options()
-    ("output-camera-file,o", po::value(&opt.camera_file), "Specify the output camera file with a .tsai extension.")
-    ("camera-type", po::value(&opt.camera_type)->default_value("pinhole"), "Specify the camera type. Options are: pinhole (default) and opticalbar.")
-    ("lon-lat-values", po::value(&opt.lon_lat_values_str)->default_value(""),
-    "A (quoted) string listing numbers, separated by commas or spaces, "
-    "having the longitude and latitude (alternating and in this "
-    "order) of each image corner or some other list of pixels given "
-    "by ``--pixel-values``. If the corners are used, they are traversed "
-    "in the order (0, 0) (w, 0) (w, h), (0, h) where w and h are the "
-     "image width and height.")
-    ("pixel-values", po::value(&opt.pixel_values_str)->default_value(""), "A (quoted) string listing numbers, separated by commas or spaces, having the column and row (alternating and in this order) of each pixel in the raw image at which the longitude and latitude is known and given by --lon-lat-values. By default this is empty, and will be populated by the image corners traversed as mentioned at the earlier option.")
-    ("reference-dem", po::value(&opt.reference_dem)->default_value(""),
-     "Use this DEM to infer the heights above datum of the image corners.")
-    ("datum", po::value(&opt.datum_str)->default_value(""),
-     "Use this datum to interpret the longitude and latitude, unless a DEM is given. Options: WGS_1984, D_MOON (1,737,400 meters), D_MARS (3,396,190 meters), MOLA (3,396,000 meters), NAD83, WGS72, and NAD27. Also accepted: Earth (=WGS_1984), Mars (=D_MARS), Moon (=D_MOON).")
-    ("height-above-datum", po::value(&opt.height_above_datum)->default_value(0),
-     "Assume this height above datum in meters for the image corners unless read from the DEM.")
-    ("sample-file", po::value(&opt.sample_file)->default_value(""), 
-     "Read in the camera parameters from the example camera file.  Required for opticalbar type.")
-    ("focal-length", po::value(&opt.focal_length)->default_value(0),
-     "The camera focal length.")
-    ("optical-center", po::value(&opt.optical_center)->default_value(Vector2(nan, nan),"NaN NaN"),
-     "The camera optical center. If not specified for pinhole cameras, it will be set to image center (half of image dimensions) times the pixel pitch. The optical bar camera always uses the image center.")
-    ("pixel-pitch", po::value(&opt.pixel_pitch)->default_value(0),
-     "The pixel pitch.")
-    ("refine-camera", po::bool_switch(&opt.refine_camera)->default_value(false),
-     "After a rough initial camera is obtained, refine it using least squares.")
-    ("frame-index", po::value(&opt.frame_index)->default_value(""),
-     "A file used to look up the longitude and latitude of image corners based on the image name, in the format provided by the SkySat video product.")
-    ("gcp-file", po::value(&opt.gcp_file)->default_value(""),
-     "If provided, save the image corner coordinates and heights in the GCP format to this file.")
-    ("gcp-std", po::value(&opt.gcp_std)->default_value(1),
-     "The standard deviation for each GCP pixel, if saving a GCP file. A smaller value suggests a more reliable measurement, hence will be given more weight.")
-    ("cam-height", po::value(&opt.cam_height)->default_value(0),
-     "If both this and --cam-weight are positive, enforce that the output camera is at this height above datum. For SkySat, if not set, read this from the frame index. Highly experimental.")
-    ("cam-weight", po::value(&opt.cam_weight)->default_value(0),
-     "If positive, try to enforce the option --cam-height with this weight (bigger weight means try harder to enforce).")
-    ("cam-ctr-weight", po::value(&opt.cam_ctr_weight)->default_value(0),
-     "If positive, try to enforce that during camera refinement the camera center stays close to the initial value (bigger weight means try harder to enforce this; a value like 1000.0 is good enough).")
-    ("parse-eci", po::bool_switch(&opt.parse_eci)->default_value(false),
-     "Create cameras based on ECI positions and orientations (not working).")
-    ("parse-ecef", po::bool_switch(&opt.parse_ecef)->default_value(false),
-     "Create cameras based on ECEF position (but not orientation).")
-    ("input-camera", po::value(&opt.input_camera)->default_value(""),
-     "Create the output pinhole camera approximating this camera. If with a "
-     "_pinhole.json suffix, read it verbatim, with no refinements or "
-     "taking into account other input options.")
-    ("session-type,t",   po::value(&opt.stereo_session)->default_value(""),
-     "Select the input camera model type. Normally this is auto-detected, but may need to be specified if the input camera model is in XML format. See the doc for options.")
-    ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
-     "Use the camera adjustment obtained by previously running bundle_adjust "
-     "when providing an input camera.");
-  
-  general_options.add(vw::GdalWriteOptionsDescription(opt));
-
-  po::options_description positional("");
-  positional.add_options()
-    ("image-file", po::value(&opt.image_file));
-
-  po::positional_options_description positional_desc;
-  positional_desc.add("image-file",1);
-
-  std::string usage("[options] <image-file> -o <camera-file>");
-  bool allow_unregistered = false;
-  std::vector<std::string> unregistered;
-  po::variables_map vm =
-    asp::check_command_line(argc, argv, opt, general_options, general_options,
-                            positional, positional_desc, usage,
-                            allow_unregistered, unregistered);
-
-  if (opt.image_file.empty())
-    vw_throw( ArgumentErr() << "Missing the input image.\n"
-              << usage << general_options );
-
-  if (opt.camera_file.empty())
-    vw_throw( ArgumentErr() << "Missing the output camera file name.\n"
-              << usage << general_options );
-
-  boost::to_lower(opt.camera_type);
-  
-  if (opt.camera_type != "pinhole" && opt.camera_type != "opticalbar")
-    vw_throw( ArgumentErr() << "Only pinhole and opticalbar cameras are supported.\n");
-  
-  if ((opt.camera_type == "opticalbar") && (opt.sample_file == ""))
-    vw_throw( ArgumentErr() << "opticalbar type must use a sample camera file.\n"
-              << usage << general_options );
-
-  std::string ext = get_extension(opt.camera_file);
-  if (ext != ".tsai") 
-    vw_throw( ArgumentErr() << "The output camera file must end with .tsai.\n"
-              << usage << general_options );
-
-  opt.input_pinhole = boost::algorithm::ends_with(opt.input_camera, "_pinhole.json");
-  
-  // If we cannot read the data from a DEM, must specify a lot of things.
-  if (!opt.input_pinhole && opt.reference_dem.empty() && opt.datum_str.empty())
-    vw_throw( ArgumentErr() << "Must provide either a reference DEM or a datum.\n"
-              << usage << general_options );
-
-  if (opt.gcp_std <= 0) 
-    vw_throw( ArgumentErr() << "The GCP standard deviation must be positive.\n"
-              << usage << general_options );
-
-  if (!opt.input_pinhole && opt.frame_index != "" && opt.lon_lat_values_str != "") 
-    vw_throw( ArgumentErr() << "Cannot specify both the frame index file "
-	      << "and the lon-lat corners.\n"
-              << usage << general_options );
+// Read the lines of the frame index, to be searched for each image
+void read_frame_index(std::string const& frame_index,
+                      std::vector<std::string> & frame_index_lines) {
+  frame_index_lines.clear();
+  std::ifstream file(frame_index.c_str());
+  if (!file.is_open())
+    vw_throw( ArgumentErr() << "Could not open: " << frame_index << ".\n");
+  std::string line;
+  while (getline(file, line, '\n'))
+    frame_index_lines.push_back(line);
+}
 
-  if (opt.cam_weight > 0 && opt.cam_ctr_weight > 0)
-    vw::vw_throw(vw::ArgumentErr() << "Cannot enforce the camera center constraint and camera height constraint at the same time.\n");
+// Find the pixels and their longitude and latitude for the current image,
+// from the frame index or from the command line.
+void prepare_frame(Options & opt, std::vector<std::string> const& frame_index_lines,
+                   bool verbose) {
 
   if (!opt.input_pinhole && opt.frame_index != "") {
     // Parse the frame index to extract opt.lon_lat_values_str.
     // Look for a line having this image, and search for "POLYGON" followed by spaces and "((".
     boost::filesystem::path p(opt.image_file); 
     std::string image_base = p.stem().string(); // strip the directory name and suffix
-    std::ifstream file( opt.frame_index.c_str() );
-    std::string line;
     std::string beg1 = "POLYGON";
     std::string beg2 = "((";
     std::string end = "))";
-    while (getline(file, line, '\n')) {
+    for (size_t line_it = 0; line_it < frame_index_lines.size(); line_it++) {
+      std::string const& line = frame_index_lines[line_it];
       if (line.find(image_base) != std::string::npos) {
         // Find POLYGON first.
         int beg_pos = line.find(beg1);
@@ -454,8 +359,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
         if (end_pos == std::string::npos)
           vw_throw( ArgumentErr() << "Cannot find " << end << " in line: " << line << ".\n");
         opt.lon_lat_values_str = line.substr(beg_pos, end_pos - beg_pos);
-        vw_out() << "Parsed the lon-lat corner values: " << opt.lon_lat_values_str
-		 << std::endl;
+        if (verbose)
+          vw_out() << "Parsed the lon-lat corner values: " << opt.lon_lat_values_str
+                   << std::endl;
 
 	if (opt.parse_eci && opt.parse_ecef)
 	  vw_throw( ArgumentErr() << "Cannot parse both ECI end ECEF at the same time.\n");
@@ -477,16 +383,18 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 	    std::string y = vals[6];
 	    std::string z = vals[7];
 	    opt.parsed_cam_ctr_str = x + " " + y + " " + z;
-	    vw_out() << "Parsed the ECI camera center in km: "
-		     << opt.parsed_cam_ctr_str <<".\n";
+	    if (verbose)
+	      vw_out() << "Parsed the ECI camera center in km: "
+		       << opt.parsed_cam_ctr_str <<".\n";
 	    
 	    std::string q0 = vals[8];
 	    std::string q1 = vals[9];
 	    std::string q2 = vals[10];
 	    std::string q3 = vals[11];
 	    opt.parsed_cam_quat_str = q0 + " " + q1 + " " + q2 + " " + q3;
-	    vw_out() << "Parsed the ECI quaternion: "
-		     << opt.parsed_cam_quat_str <<".\n";
+	    if (verbose)
+	      vw_out() << "Parsed the ECI quaternion: "
+		       << opt.parsed_cam_quat_str <<".\n";
 	  }
 	  
 	  if (opt.parse_ecef) {
@@ -497,16 +405,18 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 	    std::string y = vals[13];
 	    std::string z = vals[14];
 	    opt.parsed_cam_ctr_str = x + " " + y + " " + z;
-	    vw_out() << "Parsed the ECEF camera center in km: "
-		     << opt.parsed_cam_ctr_str <<".\n";
+	    if (verbose)
+	      vw_out() << "Parsed the ECEF camera center in km: "
+		       << opt.parsed_cam_ctr_str <<".\n";
 	    
 	    std::string q0 = vals[15];
 	    std::string q1 = vals[16];
 	    std::string q2 = vals[17];
 	    std::string q3 = vals[18];
 	    opt.parsed_cam_quat_str = q0 + " " + q1 + " " + q2 + " " + q3;
-	    vw_out() << "Parsed the ECEF quaternion: "
-		     << opt.parsed_cam_quat_str <<".\n";
+	    if (verbose)
+	      vw_out() << "Parsed the ECEF quaternion: "
+		       << opt.parsed_cam_quat_str <<".\n";
 	  }
 	  
 	}
@@ -557,7 +467,164 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
       opt.lon_lat_values.pop_back();
     }
   }
+
+} // End function prepare_frame
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  po::options_description general_options("");
+  general_options.add_options()
+    ("output-camera-file,o", po::value(&opt.camera_file), "Specify the output camera file with a .tsai extension.")
+    ("camera-type", po::value(&opt.camera_type)->default_value("pinhole"), "Specify the camera type. Options are: pinhole (default) and opticalbar.")
+    ("lon-lat-values", po::value(&opt.lon_lat_values_str)->default_value(""),
+    "A (quoted) string listing numbers, separated by commas or spaces, "
+    "having the longitude and latitude (alternating and in this "
+    "order) of each image corner or some other list of pixels given "
+    "by ``--pixel-values``. If the corners are used, they are traversed "
+    "in the order (0, 0) (w, 0) (w, h), (0, h) where w and h are the "
+     "image width and height.")
+    ("pixel-values", po::value(&opt.pixel_values_str)->default_value(""), "A (quoted) string listing numbers, separated by commas or spaces, having the column and row (alternating and in this order) of each pixel in the raw image at which the longitude and latitude is known and given by --lon-lat-values. By default this is empty, and will be populated by the image corners traversed as mentioned at the earlier option.")
+    ("reference-dem", po::value(&opt.reference_dem)->default_value(""),
+     "Use this DEM to infer the heights above datum of the image corners.")
+    ("datum", po::value(&opt.datum_str)->default_value(""),
+     "Use this datum to interpret the longitude and latitude, unless a DEM is given. Options: WGS_1984, D_MOON (1,737,400 meters), D_MARS (3,396,190 meters), MOLA (3,396,000 meters), NAD83, WGS72, and NAD27. Also accepted: Earth (=WGS_1984), Mars (=D_MARS), Moon (=D_MOON).")
+    ("height-above-datum", po::value(&opt.height_above_datum)->default_value(0),
+     "Assume this height above datum in meters for the image corners unless read from the DEM.")
+    ("sample-file", po::value(&opt.sample_file)->default_value(""), 
+     "Read in the camera parameters from the example camera file.  Required for opticalbar type.")
+    ("focal-length", po::value(&opt.focal_length)->default_value(0),
+     "The camera focal length.")
+    ("optical-center", po::value(&opt.optical_center)->default_value(Vector2(nan, nan),"NaN NaN"),
+     "The camera optical center. If not specified for pinhole cameras, it will be set to image center (half of image dimensions) times the pixel pitch. The optical bar camera always uses the image center.")
+    ("pixel-pitch", po::value(&opt.pixel_pitch)->default_value(0),
+     "The pixel pitch.")
+    ("refine-camera", po::bool_switch(&opt.refine_camera)->default_value(false),
+     "After a rough initial camera is obtained, refine it using least squares.")
+    ("frame-index", po::value(&opt.frame_index)->default_value(""),
+     "A file used to look up the longitude and latitude of image corners based on the image name, in the format provided by the SkySat video product.")
+    ("gcp-file", po::value(&opt.gcp_file)->default_value(""),
+     "If provided, save the image corner coordinates and heights in the GCP format to this file.")
+    ("gcp-std", po::value(&opt.gcp_std)->default_value(1),
+     "The standard deviation for each GCP pixel, if saving a GCP file. A smaller value suggests a more reliable measurement, hence will be given more weight.")
+    ("cam-height", po::value(&opt.cam_height)->default_value(0),
+     "If both this and --cam-weight are positive, enforce that the output camera is at this height above datum. For SkySat, if not set, read this from the frame index. Highly experimental.")
+    ("cam-weight", po::value(&opt.cam_weight)->default_value(0),
+     "If positive, try to enforce the option --cam-height with this weight (bigger weight means try harder to enforce).")
+    ("cam-ctr-weight", po::value(&opt.cam_ctr_weight)->default_value(0),
+     "If positive, try to enforce that during camera refinement the camera center stays close to the initial value (bigger weight means try harder to enforce this; a value like 1000.0 is good enough).")
+    ("parse-eci", po::bool_switch(&opt.parse_eci)->default_value(false),
+     "Create cameras based on ECI positions and orientations (not working).")
+    ("parse-ecef", po::bool_switch(&opt.parse_ecef)->default_value(false),
+     "Create cameras based on ECEF position (but not orientation).")
+    ("input-camera", po::value(&opt.input_camera)->default_value(""),
+     "Create the output pinhole camera approximating this camera. If with a "
+     "_pinhole.json suffix, read it verbatim, with no refinements or "
+     "taking into account other input options.")
+    ("session-type,t",   po::value(&opt.stereo_session)->default_value(""),
+     "Select the input camera model type. Normally this is auto-detected, but may need to be specified if the input camera model is in XML format. See the doc for options.")
+    ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
+     "Use the camera adjustment obtained by previously running bundle_adjust "
+     "when providing an input camera.")
+    ("image-list", po::value(&opt.image_list)->default_value(""),
+     "A file having a list of images, one per line, for which to create cameras. "
+     "Must be used with --camera-list and --frame-index. The reference DEM is "
+     "loaded once and the cameras are created in parallel.")
+    ("camera-list", po::value(&opt.camera_list)->default_value(""),
+     "A file having the output camera files, with a .tsai extension, one per "
+     "line, in the same order as the images in --image-list.");
+  
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+
+  po::options_description positional("");
+  positional.add_options()
+    ("image-file", po::value(&opt.image_file));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("image-file",1);
+
+  std::string usage("[options] <image-file> -o <camera-file>");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (opt.image_list != "" || opt.camera_list != "") {
+    if (opt.image_list == "" || opt.camera_list == "")
+      vw_throw( ArgumentErr() << "The options --image-list and --camera-list "
+                << "must be used together.\n" << usage << general_options );
+    if (!opt.image_file.empty() || !opt.camera_file.empty())
+      vw_throw( ArgumentErr() << "Cannot specify an input image or output camera "
+                << "together with --image-list.\n" << usage << general_options );
+    if (opt.frame_index == "")
+      vw_throw( ArgumentErr() << "The option --image-list requires --frame-index.\n"
+                << usage << general_options );
+    if (opt.input_camera != "" || opt.gcp_file != "")
+      vw_throw( ArgumentErr() << "The options --input-camera and --gcp-file cannot "
+                << "be used with --image-list.\n" << usage << general_options );
+
+    asp::read_list(opt.image_list, opt.image_files);
+    asp::read_list(opt.camera_list, opt.camera_files);
+    if (opt.image_files.empty())
+      vw_throw( ArgumentErr() << "No images were read from: " << opt.image_list << ".\n");
+    if (opt.image_files.size() != opt.camera_files.size())
+      vw_throw( ArgumentErr() << "The number of images in " << opt.image_list
+                << " does not match the number of cameras in " << opt.camera_list
+                << ".\n");
+
+    // Use the first image and camera for the checks below
+    opt.image_file  = opt.image_files[0];
+    opt.camera_file = opt.camera_files[0];
+  }
+
+  if (opt.image_file.empty())
+    vw_throw( ArgumentErr() << "Missing the input image.\n"
+              << usage << general_options );
+
+  if (opt.camera_file.empty())
+    vw_throw( ArgumentErr() << "Missing the output camera file name.\n"
+              << usage << general_options );
+
+  boost::to_lower(opt.camera_type);
+  
+  if (opt.camera_type != "pinhole" && opt.camera_type != "opticalbar")
+    vw_throw( ArgumentErr() << "Only pinhole and opticalbar cameras are supported.\n");
+  
+  if ((opt.camera_type == "opticalbar") && (opt.sample_file == ""))
+    vw_throw( ArgumentErr() << "opticalbar type must use a sample camera file.\n"
+              << usage << general_options );
+
+  for (size_t it = 0; it < opt.camera_files.size(); it++) {
+    if (get_extension(opt.camera_files[it]) != ".tsai")
+      vw_throw( ArgumentErr() << "The output camera file must end with .tsai: "
+                << opt.camera_files[it] << ".\n");
+  }
+  std::string ext = get_extension(opt.camera_file);
+  if (ext != ".tsai") 
+    vw_throw( ArgumentErr() << "The output camera file must end with .tsai.\n"
+              << usage << general_options );
+
+  opt.input_pinhole = boost::algorithm::ends_with(opt.input_camera, "_pinhole.json");
   
+  // If we cannot read the data from a DEM, must specify a lot of things.
+  if (!opt.input_pinhole && opt.reference_dem.empty() && opt.datum_str.empty())
+    vw_throw( ArgumentErr() << "Must provide either a reference DEM or a datum.\n"
+              << usage << general_options );
+
+  if (opt.gcp_std <= 0) 
+    vw_throw( ArgumentErr() << "The GCP standard deviation must be positive.\n"
+              << usage << general_options );
+
+  if (!opt.input_pinhole && opt.frame_index != "" && opt.lon_lat_values_str != "") 
+    vw_throw( ArgumentErr() << "Cannot specify both the frame index file "
+	      << "and the lon-lat corners.\n"
+              << usage << general_options );
+
+  if (opt.cam_weight > 0 && opt.cam_ctr_weight > 0)
+    vw::vw_throw(vw::ArgumentErr() << "Cannot enforce the camera center constraint and camera height constraint at the same time.\n");
+
   // Note that optical center can be negative (for some SkySat products).
   if (!opt.input_pinhole &&
       opt.sample_file == "" &&
@@ -568,8 +635,20 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   if ((opt.parse_eci || opt.parse_ecef) && opt.camera_type == "opticalbar") 
     vw_throw( ArgumentErr() << "Cannot parse ECI/ECEF data for an optical bar camera.\n");
   
-  // Create the output directory
-  vw::create_out_dir(opt.camera_file);
+  if (opt.image_files.empty()) {
+    // A single image. With a list, each frame is prepared when its camera is made.
+    std::vector<std::string> frame_index_lines;
+    if (!opt.input_pinhole && opt.frame_index != "")
+      read_frame_index(opt.frame_index, frame_index_lines);
+    bool verbose = true;
+    prepare_frame(opt, frame_index_lines, verbose);
+  }
+
+  // Create the output directories
+  if (opt.camera_files.empty())
+    vw::create_out_dir(opt.camera_file);
+  for (size_t it = 0; it < opt.camera_files.size(); it++)
+    vw::create_out_dir(opt.camera_files[it]);
 
 } // End function handle_arguments
 
@@ -1009,31 +1088,46 @@ vw::Matrix<double> json_mat(json const& j, int rows, int cols) {
   return M;
 }
 
-// Create a pinhole camera using user-specified options.
-void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
-                         boost::shared_ptr<CameraModel> & out_cam) {
-
+// The reference DEM, if provided. It is loaded once and shared by all frames.
+struct RefDem {
   GeoReference geo;
   ImageView<float> dem;
-  float nodata_value = -std::numeric_limits<float>::max(); 
-  bool has_dem = false;
+  float nodata_value;
+  bool has_dem;
+  RefDem(): nodata_value(-std::numeric_limits<float>::max()), has_dem(false) {}
+};
+
+// Load the reference DEM, if provided, and find the datum
+void load_ref_dem(Options const& opt, vw::cartography::Datum & datum, RefDem & ref_dem) {
+
   if (opt.reference_dem != "") {
-    dem = DiskImageView<float>(opt.reference_dem);
-    bool ans = read_georeference(geo, opt.reference_dem);
+    ref_dem.dem = DiskImageView<float>(opt.reference_dem);
+    bool ans = read_georeference(ref_dem.geo, opt.reference_dem);
     if (!ans) 
       vw_throw( ArgumentErr() << "Could not read the georeference from dem: "
                 << opt.reference_dem << ".\n");
 
-    datum = geo.datum(); // Read this in for completeness
-    has_dem = true;
-    vw::read_nodata_val(opt.reference_dem, nodata_value);
-    vw_out() << "Using nodata value: " << nodata_value << std::endl;
+    datum = ref_dem.geo.datum(); // Read this in for completeness
+    ref_dem.has_dem = true;
+    vw::read_nodata_val(opt.reference_dem, ref_dem.nodata_value);
+    vw_out() << "Using nodata value: " << ref_dem.nodata_value << std::endl;
   }else{
     datum = vw::cartography::Datum(opt.datum_str); 
     vw_out() << "No reference DEM provided. Will use a height of "
              << opt.height_above_datum << " above the datum:\n" 
              << datum << std::endl;
   }
+}
+
+// Create a pinhole camera using user-specified options.
+void form_pinhole_camera(Options & opt, vw::cartography::Datum const& datum,
+                         RefDem const& ref_dem, bool verbose,
+                         boost::shared_ptr<CameraModel> & out_cam) {
+
+  GeoReference const& geo = ref_dem.geo;
+  ImageView<float> const& dem = ref_dem.dem;
+  float nodata_value = ref_dem.nodata_value;
+  bool has_dem = ref_dem.has_dem;
 
   // Prepare the DEM for interpolation
   ImageViewRef<PixelMask<float>> interp_dem
@@ -1052,7 +1146,8 @@ void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
 
     parsed_cam_ctr = Vector3(vals[0], vals[1], vals[2]);
     parsed_cam_ctr *= 1000.0;  // convert to meters
-    vw_out() << "Parsed camera center (meters): " << parsed_cam_ctr << "\n";
+    if (verbose)
+      vw_out() << "Parsed camera center (meters): " << parsed_cam_ctr << "\n";
 
     Vector3 llh = datum.cartesian_to_geodetic(parsed_cam_ctr);
       
@@ -1071,15 +1166,16 @@ void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
                 << opt.parsed_cam_quat_str << ".\n");
 
     parsed_cam_quat = vw::Quat(vals[0], vals[1], vals[2], vals[3]);
-    vw_out() << "Parsed camera quaternion: " << parsed_cam_quat << "\n";
+    if (verbose)
+      vw_out() << "Parsed camera quaternion: " << parsed_cam_quat << "\n";
   }
     
-  if (opt.cam_weight > 0) {
+  if (verbose && opt.cam_weight > 0) {
     vw_out() << "Will attempt to find a camera center height above datum of "
              << opt.cam_height
              << " meters with a weight strength of " << opt.cam_weight << ".\n";
   }
-  if (opt.cam_ctr_weight > 0 && opt.refine_camera)  
+  if (verbose && opt.cam_ctr_weight > 0 && opt.refine_camera)  
     vw_out() << "Will try to have the camera center change little during camera refinement.\n"; 
 
   Vector3 input_cam_ctr(0, 0, 0); // estimated camera center from input camera
@@ -1142,7 +1238,7 @@ void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
             success = true;
           }
         }
-        if (!success) 
+        if (!success && verbose) 
           vw_out() << "Could not determine a valid height value at lon-lat: "
                    << llh[0] << ' ' << llh[1] << ". Will use a height of " << height << ".\n";
       }
@@ -1180,7 +1276,6 @@ void form_pinhole_camera(Options & opt, vw::cartography::Datum & datum,
   manufacture_cam(opt, wid, hgt, out_cam);
 
   // Transform it and optionally refine it
-  bool verbose = true;
   fit_camera_to_xyz_ht(opt.parse_ecef, parsed_cam_ctr, input_cam_ctr,
                        opt.camera_type, opt.refine_camera,  
                        xyz_vec, opt.pixel_values, 
@@ -1240,6 +1335,103 @@ void read_pinhole_from_json(Options const& opt, vw::cartography::Datum & datum,
   pin.set_camera_pose(submatrix(cam2world, 0, 0, 3, 3));
 }
 
+// Save the camera in the format for its type
+void write_camera(Options const& opt, boost::shared_ptr<CameraModel> const& out_cam) {
+  if (opt.camera_type == "opticalbar")
+    ((vw::camera::OpticalBarModel*)out_cam.get())->write(opt.camera_file);
+  else 
+    ((vw::camera::PinholeModel*)out_cam.get())->write(opt.camera_file);
+}
+
+// Create and save the camera for one image in the list. Each task has its
+// own copy of the options. The DEM and the frame index are shared.
+class CamGenTask: public vw::Task, private boost::noncopyable {
+  Options m_opt;
+  vw::cartography::Datum const& m_datum;
+  RefDem const& m_ref_dem;
+  std::vector<std::string> const& m_frame_index_lines;
+  std::mutex & m_mutex;
+  std::string & m_error;
+  vw::TerminalProgressCallback & m_tpc;
+  double m_inc_amount;
+public:
+  CamGenTask(Options const& opt, vw::cartography::Datum const& datum,
+             RefDem const& ref_dem, std::vector<std::string> const& frame_index_lines,
+             std::mutex & mutex, std::string & error,
+             vw::TerminalProgressCallback & tpc, double inc_amount):
+    m_opt(opt), m_datum(datum), m_ref_dem(ref_dem),
+    m_frame_index_lines(frame_index_lines), m_mutex(mutex), m_error(error),
+    m_tpc(tpc), m_inc_amount(inc_amount) {}
+  void operator()() {
+    try {
+      bool verbose = false;
+      prepare_frame(m_opt, m_frame_index_lines, verbose);
+      boost::shared_ptr<CameraModel> out_cam;
+      form_pinhole_camera(m_opt, m_datum, m_ref_dem, verbose, out_cam);
+      write_camera(m_opt, out_cam);
+    } catch (std::exception const& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_error = m_opt.image_file + ": " + e.what();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tpc.report_incremental_progress(m_inc_amount);
+  }
+};
+
+// Create the cameras for all images in the list. The DEM and frame index
+// are read once, and the frames are solved for in parallel.
+void gen_cameras_from_list(Options const& opt) {
+
+  vw::cartography::Datum datum;
+  RefDem ref_dem;
+  load_ref_dem(opt, datum, ref_dem);
+
+  std::vector<std::string> frame_index_lines;
+  read_frame_index(opt.frame_index, frame_index_lines);
+
+  if (opt.cam_weight > 0)
+    vw_out() << "Will attempt to enforce the camera center height above datum "
+             << "with a weight strength of " << opt.cam_weight << ".\n";
+  if (opt.cam_ctr_weight > 0 && opt.refine_camera)  
+    vw_out() << "Will try to have the camera center change little during camera refinement.\n"; 
+
+  int num = opt.image_files.size();
+  vw_out() << "Creating " << num << " cameras.\n";
+
+  // Each task records its error, if any, in its own slot
+  std::vector<std::string> errors(num);
+  std::mutex mutex;
+  vw::TerminalProgressCallback tpc("asp", "\t--> ");
+  double inc_amount = 1.0 / double(num);
+  tpc.report_progress(0);
+  {
+    vw::FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (int it = 0; it < num; it++) {
+      Options local_opt = opt;
+      local_opt.image_file  = opt.image_files[it];
+      local_opt.camera_file = opt.camera_files[it];
+      local_opt.image_files.clear();
+      local_opt.camera_files.clear();
+      queue.add_task(boost::shared_ptr<CamGenTask>
+                     (new CamGenTask(local_opt, datum, ref_dem, frame_index_lines,
+                                     mutex, errors[it], tpc, inc_amount)));
+    }
+    queue.join_all();
+  }
+  tpc.report_finished();
+
+  int num_failed = 0;
+  for (int it = 0; it < num; it++) {
+    if (errors[it] == "")
+      continue;
+    vw_out(WarningMessage) << errors[it] << "\n";
+    num_failed++;
+  }
+  if (num_failed > 0)
+    vw_throw( ArgumentErr() << "Failed to create " << num_failed << " out of "
+              << num << " cameras.\n");
+}
+
 int main(int argc, char * argv[]){
   
   Options opt;
@@ -1252,10 +1444,18 @@ int main(int argc, char * argv[]){
 
     // Some of the numbers we print need high precision
     vw_out().precision(17);
+
+    if (!opt.image_files.empty()) {
+      gen_cameras_from_list(opt);
+      return 0;
+    }
     
     if (!opt.input_pinhole) {
       // Create a pinhole camera using user-specified options.
-      form_pinhole_camera(opt, datum, out_cam);
+      RefDem ref_dem;
+      load_ref_dem(opt, datum, ref_dem);
+      bool verbose = true;
+      form_pinhole_camera(opt, datum, ref_dem, verbose, out_cam);
     } else {
       // Read a pinhole camera from Planet's json file format (*_pinhole.json). Then
       // the WGS84 datum is assumed. Ignore all other input options.
@@ -1265,10 +1465,7 @@ int main(int argc, char * argv[]){
     vw::Vector3 llh = datum.cartesian_to_geodetic(out_cam->camera_center(Vector2()));
     vw_out() << "Output camera center lon, lat, and height above datum: " << llh << std::endl;
     vw_out() << "Writing: " << opt.camera_file << std::endl;
-    if (opt.camera_type == "opticalbar")
-      ((vw::camera::OpticalBarModel*)out_cam.get())->write(opt.camera_file);
-    else 
-      ((vw::camera::PinholeModel*)out_cam.get())->write(opt.camera_file);
+    write_camera(opt, out_cam);
     
   } ASP_STANDARD_CATCHES;
   
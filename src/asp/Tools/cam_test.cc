@@ -195,6 +195,10 @@ int main(int argc, char *argv[]) {
 
     Stopwatch sw;
     sw.start();
+
+    // Time separately the ground-to-image calls, which are the slowest
+    // for linescan cameras.
+    Stopwatch sw1, sw2;
     
     double major_axis = datum.semi_major_axis() + opt.height_above_datum;
     double minor_axis = datum.semi_minor_axis() + opt.height_above_datum;
@@ -231,7 +235,9 @@ int main(int argc, char *argv[]) {
         Vector3 xyz = vw::cartography::datum_intersection(major_axis, minor_axis,
                                                           cam1_ctr, cam1_dir);
 
+        sw2.start();
         Vector2 cam2_pix = cam2_model->point_to_pixel(xyz);
+        sw2.stop();
         cam1_to_cam2_diff.push_back(norm_2(image_pix - cam2_pix));
         
         if (opt.print_per_pixel_results)
@@ -249,7 +255,9 @@ int main(int argc, char *argv[]) {
         // cam1 camera.
         xyz = vw::cartography::datum_intersection(major_axis, minor_axis,
                                                   cam2_ctr, cam2_dir);
+        sw1.start();
         Vector2 cam1_pix = cam1_model->point_to_pixel(xyz);
+        sw1.stop();
         cam2_to_cam1_diff.push_back(norm_2(image_pix - cam1_pix));
         
         if (opt.print_per_pixel_results)
@@ -284,6 +292,12 @@ int main(int argc, char *argv[]) {
     vw_out() << "\nElapsed time per sample: " << 1e+6 * elapsed_sec/ctr_diff.size()
              << " milliseconds.\n";
 
+    // Ground-to-image throughput, per thread
+    if (sw1.elapsed_seconds() > 0 && sw2.elapsed_seconds() > 0)
+      vw_out() << "Ground-to-image projections per second: "
+               << "cam1: " << ctr_diff.size() / sw1.elapsed_seconds() << ", "
+               << "cam2: " << ctr_diff.size() / sw2.elapsed_seconds() << ".\n";
+
     if (elapsed_sec < 5)
       vw_out() << "It is suggested to adjust the sample rate to produce more samples "
                << "if desired to evaluate more accurately the elapsed time per sample.\n";
@@ -30,6 +30,7 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/FileUtils.h>
+#include <asp/Core/CameraFootprint.h>
 
 #include <limits>
 #include <cstring>
@@ -180,21 +181,19 @@ int main( int argc, char *argv[] ) {
       
     } else { // DEM provided, intersect with it.
 
-      // Load the DEM
-      float dem_nodata_val = -std::numeric_limits<float>::max(); 
-      vw::read_nodata_val(opt.dem_file, dem_nodata_val);
-      ImageViewRef< PixelMask<double> > dem = create_mask
-        (channel_cast<double>(DiskImageView<float>(opt.dem_file)), dem_nodata_val);
-      
-      GeoReference dem_georef;
-      if (!read_georeference(dem_georef, opt.dem_file))
-        vw_throw( ArgumentErr() << "Missing georef.\n");
-
-      target_georef = dem_georef; // return box in this projection
+      // Load the DEM. Only the rays through the image boundary are
+      // intersected with it, first at low resolution.
+      asp::FootprintDem dem(opt.dem_file);
+      target_georef = dem.georef(); // return box in this projection
       vw_out() << "Using georef: " << target_georef << std::endl;
-      
-      footprint_bbox = camera_bbox(dem, dem_georef, target_georef, cam,
-                                   image_size[0], image_size[1], mean_gsd, opt.quick, &coords);
+
+      int num_samples = 100;
+      if (opt.quick)
+        num_samples = 10;
+      double gsd = 0.0;
+      footprint_bbox = asp::camera_footprint(dem, *cam, image_size, gsd, &coords,
+                                             num_samples);
+      mean_gsd = gsd;
       for (size_t i=0; i<coords.size(); ++i)
         coords[i] = target_georef.datum().cartesian_to_geodetic(coords[i]);
     }
@@ -21,7 +21,7 @@
 // See CorrEval.h and this tool's manual for more info.
 
 #include <vw/Stereo/PreFilter.h>
-#include <vw/Stereo/CorrEval.h>
+#include <asp/Core/CorrEval.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
@@ -173,7 +173,7 @@ int main(int argc, char *argv[]) {
     vw_out() << "Writing: " << output_image << "\n";
     vw::cartography::block_write_gdal_image
       (output_image,
-       apply_mask(vw::stereo::corr_eval(masked_left, masked_right,
+       apply_mask(asp::corr_eval(masked_left, masked_right,
                                         disp, opt.kernel_size, opt.metric,
                                         opt.sample_rate, opt.round_to_int),
                   left_nodata),
@@ -31,6 +31,7 @@ extern "C" {
 #include <vw/Image/Interpolation.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/PixelMapGrid.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/dll.hpp>
@@ -41,79 +42,55 @@ using namespace vw;
 using namespace vw::cartography;
 using namespace std;
 
-/// Image view which adds or subtracts the ellipsoid/geoid difference
-///  from elevations in a DEM image.
-template <class ImageT>
-class DemGeoidView : public ImageViewBase<DemGeoidView<ImageT> >
-{
-  ImageT                m_img; ///< The DEM
+/// Wrap a longitude-latitude pair to the [0, 360) x [-90, 90] box.
+/// Note that lon = 25, lat = 91 is the same as lon = 180 + 25, lat = 89
+/// as we go through the North pole and show up on the other side.
+Vector2 wrap_lonlat(Vector2 lonlat) {
+  while ( fabs(lonlat[1]) > 90.0 ){
+    if ( lonlat[1] > 90.0 ){
+      lonlat[1] = 180.0 - lonlat[1];
+      lonlat[0] += 180.0;
+    }
+    if ( lonlat[1] < -90.0 ){
+      lonlat[1] = -180.0 - lonlat[1];
+      lonlat[0] += 180.0;
+    }
+  }
+  while( lonlat[0] <   0.0  ) lonlat[0] += 360.0;
+  while( lonlat[0] >= 360.0 ) lonlat[0] -= 360.0;
+  return lonlat;
+}
+
+/// The geoid height, plus the datum correction, at a DEM pixel. It is
+/// stored as the first coordinate of the returned vector, so that
+/// it can be interpolated with asp::interp_pixel_map(). It is NaN
+/// where the geoid is invalid.
+class GeoidHeightMap: public asp::PixelMap {
   GeoReference   const& m_georef;
   bool                  m_is_egm2008;
   vector<double>                   const& m_egm2008_grid; ///< Special variable storing EGM2008 data
   ImageViewRef<PixelMask<double> > const& m_geoid; ///< Interpolation view of the geoid
   GeoReference                     const& m_geoid_georef;
-  bool     m_reverse_adjustment; ///< If true, convert from orthometric height to geoid height
   double   m_correction;
-  double   m_nodata_val;
 
 public:
+  GeoidHeightMap(GeoReference const& georef,
+                 bool is_egm2008, vector<double> const& egm2008_grid,
+                 ImageViewRef<PixelMask<double> > const& geoid,
+                 GeoReference const& geoid_georef, double correction):
+    m_georef(georef), m_is_egm2008(is_egm2008), m_egm2008_grid(egm2008_grid),
+    m_geoid(geoid), m_geoid_georef(geoid_georef), m_correction(correction) {}
 
-  typedef double pixel_type;
-  typedef double result_type;
-  typedef ProceduralPixelAccessor<DemGeoidView> pixel_accessor;
-
-
-  DemGeoidView(ImageT const& img, GeoReference const& georef,
-               bool is_egm2008, vector<double> const& egm2008_grid,
-               ImageViewRef<PixelMask<double> > const& geoid,
-               GeoReference const& geoid_georef, bool reverse_adjustment,
-               double correction, double nodata_val):
-    m_img(img), m_georef(georef),
-    m_is_egm2008(is_egm2008), m_egm2008_grid(egm2008_grid),
-    m_geoid(geoid), m_geoid_georef(geoid_georef),
-    m_reverse_adjustment(reverse_adjustment),
-    m_correction(correction),
-    m_nodata_val(nodata_val){}
-
-  inline int32 cols  () const { return m_img.cols(); }
-  inline int32 rows  () const { return m_img.rows(); }
-  inline int32 planes() const { return 1; }
-
-  inline pixel_accessor origin() const { return pixel_accessor(*this); }
+  double height(Vector2 const& pix) const {
 
-  inline result_type operator()( size_t col, size_t row, size_t p=0 ) const {
-
-    if ( m_img(col, row, p) == m_nodata_val )
-      return m_nodata_val; // Skip invalid pixels
-
-    Vector2 lonlat = m_georef.pixel_to_lonlat(Vector2(col, row));
+    Vector2 lonlat = wrap_lonlat(m_georef.pixel_to_lonlat(pix));
 
     // For testing (see the link to the reference web form belows).
     //lonlat[0] = -121;   lonlat[1] = 37;   // mainland US
     //lonlat[0] = -152;   lonlat[1] = 66;   // Alaska
     //lonlat[0] = -155.5; lonlat[1] = 19.5; // Hawaii
 
-    // TODO: Does the GeoRef class handle this now?
-
-    // Need to carefully wrap lonlat to the [0, 360) x [-90, 90) box.
-    // Note that lon = 25, lat = 91 is the same as lon = 180 + 25, lat = 89
-    // as we go through the North pole and show up on the other side.
-    while ( fabs(lonlat[1]) > 90.0 ){
-      if ( lonlat[1] > 90.0 ){
-        lonlat[1] = 180.0 - lonlat[1];
-        lonlat[0] += 180.0;
-      }
-      if ( lonlat[1] < -90.0 ){
-        lonlat[1] = -180.0 - lonlat[1];
-        lonlat[0] += 180.0;
-      }
-    }
-    while( lonlat[0] <   0.0  ) lonlat[0] += 360.0;
-    while( lonlat[0] >= 360.0 ) lonlat[0] -= 360.0;
-
-
-
-    result_type geoid_height = 0.0;
+    double geoid_height = 0.0;
     if (m_is_egm2008){
       int nr = m_geoid.rows(), 
           nc = m_geoid.cols();
@@ -122,16 +99,38 @@ public:
                            &lonlat[0], &lonlat[1], &geoid_height);
     }else{
       // Use our own interpolation into the geoid image
-      Vector2  pix = m_geoid_georef.lonlat_to_pixel(lonlat);
-      PixelMask<double> interp_val = m_geoid(pix[0], pix[1]);
+      Vector2  geoid_pix = m_geoid_georef.lonlat_to_pixel(lonlat);
+      PixelMask<double> interp_val = m_geoid(geoid_pix[0], geoid_pix[1]);
       if (!is_valid(interp_val))
-        return m_nodata_val;
+        return numeric_limits<double>::quiet_NaN();
       geoid_height = interp_val.child();
     }
 
-    geoid_height += m_correction;
+    return geoid_height + m_correction;
+  }
+
+  virtual Vector2 operator()(Vector2 const& pix) const {
+    return Vector2(height(pix), 0.0);
+  }
+};
+
+/// Image view which adds or subtracts the ellipsoid/geoid difference
+///  from elevations in a DEM image. For each tile, the geoid height is
+///  found exactly only on a grid with the given spacing, unless the
+///  spacing is 0, and interpolated in between.
+template <class ImageT>
+class DemGeoidView : public ImageViewBase<DemGeoidView<ImageT> >
+{
+  ImageT                m_img; ///< The DEM
+  GeoidHeightMap const& m_geoid_height;
+  bool     m_reverse_adjustment; ///< If true, convert from orthometric height to geoid height
+  double   m_nodata_val;
+  int      m_approx_grid_spacing;
+  double   m_approx_tol;
 
-    result_type height_above_ellipsoid = m_img(col, row, p);
+  double adjust(double height_above_ellipsoid, double geoid_height) const {
+    if (height_above_ellipsoid == m_nodata_val || geoid_height != geoid_height)
+      return m_nodata_val;
 
     // Compute height above the geoid
     // - See the note in the main program about the formula below
@@ -141,13 +140,65 @@ public:
       return height_above_ellipsoid - geoid_height;
   }
 
+public:
+
+  typedef double pixel_type;
+  typedef double result_type;
+  typedef ProceduralPixelAccessor<DemGeoidView> pixel_accessor;
+
+
+  DemGeoidView(ImageT const& img, GeoidHeightMap const& geoid_height,
+               bool reverse_adjustment, double nodata_val,
+               int approx_grid_spacing, double approx_tol):
+    m_img(img), m_geoid_height(geoid_height),
+    m_reverse_adjustment(reverse_adjustment),
+    m_nodata_val(nodata_val), m_approx_grid_spacing(approx_grid_spacing),
+    m_approx_tol(approx_tol) {}
+
+  inline int32 cols  () const { return m_img.cols(); }
+  inline int32 rows  () const { return m_img.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+  inline result_type operator()( size_t col, size_t row, size_t p=0 ) const {
+    double height_above_ellipsoid = m_img(col, row, p);
+    if ( height_above_ellipsoid == m_nodata_val )
+      return m_nodata_val; // Skip invalid pixels
+    return adjust(height_above_ellipsoid, m_geoid_height.height(Vector2(col, row)));
+  }
+
   /// \cond INTERNAL
-  typedef DemGeoidView<typename ImageT::prerasterize_type> prerasterize_type;
+  typedef CropView<ImageView<result_type> > prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return prerasterize_type( m_img.prerasterize(bbox), m_georef,
-                              m_is_egm2008, m_egm2008_grid,
-                              m_geoid, m_geoid_georef, m_reverse_adjustment,
-                              m_correction, m_nodata_val );
+
+    ImageView<double> dem_tile = crop(m_img, bbox);
+
+    // Interpolate the geoid heights for the whole tile, unless they
+    // are to be found exactly, and then only for valid pixels.
+    vector<Vector2> geoid_heights;
+    if (m_approx_grid_spacing > 0)
+      asp::interp_pixel_map(m_geoid_height, bbox, m_approx_grid_spacing, m_approx_tol,
+                            geoid_heights);
+
+    ImageView<result_type> tile(bbox.width(), bbox.height());
+    size_t pos = 0;
+    for (int row = 0; row < bbox.height(); row++) {
+      for (int col = 0; col < bbox.width(); col++) {
+        double height_above_ellipsoid = dem_tile(col, row);
+        if (height_above_ellipsoid == m_nodata_val) {
+          tile(col, row) = m_nodata_val;
+        } else if (m_approx_grid_spacing > 0) {
+          tile(col, row) = adjust(height_above_ellipsoid, geoid_heights[pos][0]);
+        } else {
+          Vector2 pix(bbox.min().x() + col, bbox.min().y() + row);
+          tile(col, row) = adjust(height_above_ellipsoid, m_geoid_height.height(pix));
+        }
+        pos++;
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
   template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
     vw::rasterize( prerasterize(bbox), dest, bbox );
@@ -158,21 +209,41 @@ public:
 // Helper function which uses the class above.
 template <class ImageT>
 DemGeoidView<ImageT>
-dem_geoid( ImageViewBase<ImageT> const& img, GeoReference const& georef,
-           bool is_egm2008, vector<double> & egm2008_grid,
-           ImageViewRef<PixelMask<double> > const& geoid,
-           GeoReference const& geoid_georef, bool reverse_adjustment,
-           double correction, double nodata_val) {
-  return DemGeoidView<ImageT>( img.impl(), georef,
-                               is_egm2008, egm2008_grid,
-                               geoid, geoid_georef,
-                               reverse_adjustment, correction, nodata_val );
+dem_geoid( ImageViewBase<ImageT> const& img, GeoidHeightMap const& geoid_height,
+           bool reverse_adjustment, double nodata_val,
+           int approx_grid_spacing, double approx_tol) {
+  return DemGeoidView<ImageT>( img.impl(), geoid_height, reverse_adjustment, nodata_val,
+                               approx_grid_spacing, approx_tol );
+}
+
+/// The bounding box of the geoid pixels at which the geoid is
+/// interpolated for the DEM, found by sampling the DEM on a grid,
+/// expanded by the given margin, and cropped to the geoid.
+BBox2i geoid_pixel_box(GeoReference const& dem_georef, Vector2i const& dem_size,
+                       GeoReference const& geoid_georef, Vector2i const& geoid_size,
+                       int margin) {
+  const int num_samples = 256;
+  int step_x = std::max(1, dem_size[0] / num_samples);
+  int step_y = std::max(1, dem_size[1] / num_samples);
+  BBox2 box;
+  for (int row = 0; row < dem_size[1] + step_y - 1; row += step_y) {
+    for (int col = 0; col < dem_size[0] + step_x - 1; col += step_x) {
+      // Make sure the last row and column are sampled
+      Vector2 pix(std::min(col, dem_size[0] - 1), std::min(row, dem_size[1] - 1));
+      Vector2 lonlat = wrap_lonlat(dem_georef.pixel_to_lonlat(pix));
+      box.grow(geoid_georef.lonlat_to_pixel(lonlat));
+    }
+  }
+  BBox2i int_box(floor(box.min().x()) - margin, floor(box.min().y()) - margin,
+                 ceil(box.width()) + 2 * margin + 1, ceil(box.height()) + 2 * margin + 1);
+  int_box.crop(BBox2i(0, 0, geoid_size[0], geoid_size[1]));
+  return int_box;
 }
 
-/// Parameters for this tool
 struct Options : vw::GdalWriteOptions {
   string dem_path, geoid, out_prefix;
-  double nodata_value;
+  double nodata_value, approx_tol;
+  int    approx_grid_spacing;
   bool   use_double; // Otherwise use float
   bool   reverse_adjustment;
 };
@@ -214,7 +285,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ){
          "Output using double precision (64 bit) instead of float (32 bit).")
     ("reverse-adjustment",
                         po::bool_switch(&opt.reverse_adjustment)->default_value(false)->implicit_value(true),
-        "Go from DEM relative to the geoid to DEM relative to the ellipsoid.");
+        "Go from DEM relative to the geoid to DEM relative to the ellipsoid.")
+    ("approx-grid-spacing", po::value(&opt.approx_grid_spacing)->default_value(16),
+        "If positive, compute the geoid height exactly only for DEM pixels on a grid with this spacing, refined where the interpolation error is too large, and interpolate it in between. Set to 0 to compute it for each pixel. See also --approx-tolerance.")
+    ("approx-tolerance", po::value(&opt.approx_tol)->default_value(0.001),
+        "The largest allowed error, in meters, in the interpolated geoid height, with --approx-grid-spacing.");
 
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
@@ -374,16 +449,30 @@ int main( int argc, char *argv[] ) {
     geoid_file = get_geoid_full_path(prog_name, geoid_file);
     vw_out() << "Adjusting the DEM using the geoid: " << geoid_file << endl;
 
-    // Read the geoid containing the adjustments. Read it in memory
-    // entirely to dramatically speed up the computations.
+    // Read the geoid containing the adjustments. Read it in memory to
+    // dramatically speed up the computations. Only the part covering
+    // the DEM is read, with a margin for interpolation, except for
+    // EGM2008, as the routine interpolating it needs the full grid.
     double geoid_nodata_val = numeric_limits<float>::quiet_NaN();
     DiskImageResourceGDAL geoid_rsrc(geoid_file);
     if ( geoid_rsrc.has_nodata_read() ) {
       geoid_nodata_val = geoid_rsrc.nodata_read();
     }
-    ImageView<float> geoid_img = DiskImageView<float>(geoid_rsrc);
+    DiskImageView<float> geoid_disk_img(geoid_rsrc);
     GeoReference geoid_georef;
     read_georeference(geoid_georef, geoid_rsrc);
+    BBox2i geoid_box = bounding_box(geoid_disk_img);
+    if (!is_egm2008) {
+      int margin = BicubicInterpolation::pixel_buffer + 2;
+      geoid_box = geoid_pixel_box(dem_georef, Vector2i(dem_img.cols(), dem_img.rows()),
+                                  geoid_georef,
+                                  Vector2i(geoid_disk_img.cols(), geoid_disk_img.rows()),
+                                  margin);
+      if (geoid_box.empty())
+        geoid_box = bounding_box(geoid_disk_img);
+      geoid_georef = crop(geoid_georef, geoid_box);
+    }
+    ImageView<float> geoid_img = crop(geoid_disk_img, geoid_box);
 
     if (is_wgs84 && !is_egm2008){
       // Convert the egm96 int16 JPEG2000-encoded geoid to float.
@@ -449,10 +538,11 @@ int main( int argc, char *argv[] ) {
     //vw_out() << "Geoid georef: " << geoid_georef << std::endl;
 
     // Set up conversion image view
-    ImageViewRef<double> adj_dem = dem_geoid(dem_img, dem_georef,
-                                             is_egm2008, egm2008_grid,
-                                             geoid, geoid_georef,
-                                             reverse_adjustment, major_correction, dem_nodata_val);
+    GeoidHeightMap geoid_height(dem_georef, is_egm2008, egm2008_grid,
+                                geoid, geoid_georef, major_correction);
+    ImageViewRef<double> adj_dem = dem_geoid(dem_img, geoid_height,
+                                             reverse_adjustment, dem_nodata_val,
+                                             opt.approx_grid_spacing, opt.approx_tol);
 
     string adj_dem_file = opt.out_prefix + "-adj.tif";
     vw_out() << "Writing adjusted DEM: " << adj_dem_file << endl;
@@ -42,12 +42,19 @@
 #include <algorithm>
 
 #include <vw/FileIO/DiskImageManager.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/MaskViews.h>
 #include <vw/Image/InpaintView.h>
 #include <vw/Image/Algorithms2.h>
 #include <vw/Image/Filter.h>
 #include <vw/Cartography/GeoTransform.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/BBoxIndex.h>
+#include <asp/Core/DemIndex.h>
+#include <asp/Core/DistanceTransform.h>
+#include <asp/Core/FileUtils.h>
+#include <asp/Core/TiledHoleFill.h>
 
 
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -202,6 +209,36 @@ inline notnodata(ImageViewBase<ImageT> const& image, NoDataT nodata) {
   return UnaryPerPixelView<ImageT,func_type>(image.impl(), func);
 }
 
+// The valid values of a tile, in row-major order, with a bit per
+// pixel marking which pixels are valid. For the median and nmad, the
+// tiles from all DEMs overlapping with an output tile must be kept
+// until the end, and when the DEMs cover only part of it, this takes
+// much less memory than a full tile for each of them.
+class PackedTile {
+  int m_cols, m_rows;
+  std::vector<bool>   m_valid;
+  std::vector<double> m_vals;
+public:
+  PackedTile(ImageView<double> const& tile, double nodata):
+    m_cols(tile.cols()), m_rows(tile.rows()), m_valid(m_cols*m_rows, false) {
+
+    for (int row = 0; row < m_rows; row++) {
+      for (int col = 0; col < m_cols; col++) {
+        if (tile(col, row) == nodata)
+          continue;
+        m_valid[row*m_cols + col] = true;
+        m_vals.push_back(tile(col, row));
+      }
+    }
+    std::vector<double>(m_vals).swap(m_vals); // free the unused capacity
+  }
+
+  // Pixels are indexed as row*cols + col. The values are visited with a
+  // cursor, which advances at every valid pixel.
+  bool   is_valid(int pix)       const { return m_valid[pix];  }
+  double value   (size_t cursor) const { return m_vals[cursor]; }
+};
+
 // Set nodata pixels to 0 and valid data pixels to something big.
 template<class PixelT>
 struct BigOrZero: public ReturnFixedType<PixelT> {
@@ -294,15 +331,6 @@ BBox2 custom_point_to_pixel_bbox(GeoReference const& georef, BBox2 const& ptbox)
   return pix_box;
 }
 
-GeoReference read_georef(std::string const& file){
-  // Read a georef, and check for success
-  GeoReference geo;
-  bool is_good = read_georeference(geo, file);
-  if (!is_good)
-    vw_throw(ArgumentErr() << "No georeference found in " << file << ".\n");
-  return geo;
-}
-
 std::string processed_proj4(std::string const& srs){
   // Apparently functionally identical proj4 strings can differ in
   // subtle ways, such as an extra space, etc. For that reason, must
@@ -317,18 +345,18 @@ std::string processed_proj4(std::string const& srs){
 
 struct Options: vw::GdalWriteOptions {
   string dem_list_file, out_prefix, target_srs_string,
-    output_type, tile_list_str, this_dem_as_reference;
+    output_type, tile_list_str, this_dem_as_reference, dem_index_file;
   vector<string> dem_files;
   double tr, geo_tile_size;
-  bool   has_out_nodata, force_projwin;
+  bool   has_out_nodata, force_projwin, cog;
   double out_nodata_value;
   int    tile_size, tile_index, erode_len, priority_blending_len,
          extra_crop_len, hole_fill_len, block_size, save_dem_weight;
   double weights_exp, weights_blur_sigma, dem_blur_sigma;
   double nodata_threshold;
   bool   first, last, min, max, block_max, mean, stddev, median, nmad,
-    count, tap, save_index_map, use_centerline_weights,
-         first_dem_as_reference, propagate_nodata, no_border_blend;
+    count, tap, save_index_map, use_centerline_weights, use_euclidean_weights,
+         first_dem_as_reference, propagate_nodata, no_border_blend, incremental;
   std::set<int> tile_list;
   BBox2 projwin;
   Options(): tr(0), geo_tile_size(0), has_out_nodata(false), force_projwin(false), tile_index(-1),
@@ -339,9 +367,26 @@ struct Options: vw::GdalWriteOptions {
              first(false), last(false), min(false), max(false), block_max(false),
              mean(false), stddev(false), median(false), nmad(false),
              count(false), save_index_map(false), tap(false),
-             use_centerline_weights(false), first_dem_as_reference(false), projwin(BBox2()) {}
+             use_centerline_weights(false), use_euclidean_weights(false),
+             first_dem_as_reference(false), incremental(false), projwin(BBox2()) {}
 };
 
+// The weights which grow linearly with the distance from the DEM
+// boundary, before they are limited, eroded, and blurred.
+template<class ImageT>
+ImageView<double> boundary_weights(ImageT const& valid, Options const& opt) {
+
+  ImageView<double> weights;
+  if (!opt.use_euclidean_weights) {
+    weights = grassfire(valid, opt.no_border_blend);
+    return weights;
+  }
+
+  ImageView<double> mask = valid;
+  asp::euclidean_distance(mask, opt.no_border_blend, weights);
+  return weights;
+}
+
 /// Return the number of no-blending options selected.
 int no_blend(Options const& opt){
   return int(opt.first) + int(opt.last) + int(opt.min) + int(opt.max)
@@ -367,6 +412,77 @@ std::string tile_suffix(Options const& opt){
   return ans;
 }
 
+// The options which affect every output tile, for the tile manifests
+// written with --incremental. The DEMs are listed per tile.
+std::string mosaic_settings(Options const& opt, GeoReference const& mosaic_georef,
+                            int cols, int rows, bool fill_holes) {
+  std::ostringstream os;
+  os.precision(17);
+  os << "georef " << mosaic_georef.overall_proj4_str() << " "
+     << mosaic_georef.transform() << "\n";
+  os << "size " << cols << " " << rows << " " << opt.tile_size << "\n";
+  os << "output " << opt.output_type << " " << opt.out_nodata_value
+     << " " << tile_suffix(opt) << " " << opt.cog << "\n";
+  os << "lengths " << opt.erode_len << " " << opt.priority_blending_len << " "
+     << opt.extra_crop_len << " " << opt.hole_fill_len << " " << fill_holes << "\n";
+  os << "weights " << opt.weights_exp << " " << opt.weights_blur_sigma << " "
+     << opt.dem_blur_sigma << " " << opt.use_centerline_weights << " "
+     << opt.use_euclidean_weights << " " << opt.no_border_blend << "\n";
+  os << "nodata " << opt.nodata_threshold << " " << opt.propagate_nodata << " "
+     << opt.first_dem_as_reference << "\n";
+  for (auto const& gdal_opt: opt.gdal_options)
+    os << "gdal " << gdal_opt.first << " " << gdal_opt.second << "\n";
+  return os.str();
+}
+
+// The manifest saved next to a tile with --incremental
+std::string tile_manifest_file(std::string const& dem_tile) {
+  return boost::filesystem::path(dem_tile).replace_extension("").string()
+    + "-manifest.txt";
+}
+
+// What a tile is made from: the common settings, and the DEMs which
+// may overlap with it, with their modification times, in the order
+// they are blended. The index of a DEM among the loaded ones is
+// recorded only if it is saved in the tile.
+std::string tile_manifest(Options const& opt, std::string const& settings,
+                          std::vector<int> const& dem_ids,
+                          std::vector<std::string> const& loaded_dems,
+                          std::vector<std::string> const& timestamps) {
+  bool with_index = (opt.save_index_map || opt.save_dem_weight >= 0 ||
+                     opt.first_dem_as_reference);
+  std::ostringstream os;
+  os << settings;
+  for (size_t it = 0; it < dem_ids.size(); it++) {
+    int dem_iter = dem_ids[it];
+    os << "dem ";
+    if (with_index)
+      os << dem_iter << " ";
+    os << loaded_dems[dem_iter] << " " << timestamps[dem_iter] << "\n";
+  }
+  return os.str();
+}
+
+// If a tile from an earlier run was made from the same inputs. The
+// manifest ends with the number of valid pixels, as a tile with none
+// is not kept.
+bool tile_is_current(std::string const& dem_tile, std::string const& manifest) {
+  std::ifstream ifs(tile_manifest_file(dem_tile).c_str());
+  if (!ifs.good())
+    return false;
+  std::ostringstream prev;
+  prev << ifs.rdbuf();
+  std::string prev_str = prev.str();
+  std::string tag = "valid pixels ";
+  if (prev_str.size() <= manifest.size() + tag.size() ||
+      prev_str.compare(0, manifest.size(), manifest) != 0 ||
+      prev_str.compare(manifest.size(), tag.size(), tag) != 0)
+    return false;
+  long long int num_valid_pixels
+    = atoll(prev_str.substr(manifest.size() + tag.size()).c_str());
+  return num_valid_pixels == 0 || boost::filesystem::exists(dem_tile);
+}
+
 /// Class that does the actual image processing work
 class DemMosaicView: public ImageViewBase<DemMosaicView>{
   int m_cols, m_rows, m_bias;
@@ -376,8 +492,10 @@ class DemMosaicView: public ImageViewBase<DemMosaicView>{
   GeoReference                   m_out_georef;
   vector<double>          const& m_nodata_values;    // alias
   vector<BBox2i>          const& m_dem_pixel_bboxes; // alias
+  asp::BBoxIndex          const& m_dem_index;        // alias, DEM boxes in output pixels
   long long int                & m_num_valid_pixels; // alias, to populate on output
   vw::Mutex                    & m_count_mutex;      // alias, a lock for m_num_valid_pixels
+  ImageViewRef<PixelMask<RealT>> m_filled_dem;       // the input DEM with holes filled
 
 public:
   DemMosaicView(int cols, int rows, int bias,
@@ -387,20 +505,24 @@ public:
                 GeoReference           const& out_georef,
                 vector<double>         const& nodata_values,
                 vector<BBox2i>         const& dem_pixel_bboxes,
+                asp::BBoxIndex         const& dem_index,
                 long long int               & num_valid_pixels,
-                vw::Mutex                   & count_mutex):
+                vw::Mutex                   & count_mutex,
+                ImageViewRef<PixelMask<RealT>> const& filled_dem):
     m_cols(cols), m_rows(rows), m_bias(bias), m_opt(opt),
     m_imgMgr(imgMgr), m_georefs(georefs),
     m_out_georef(out_georef), m_nodata_values(nodata_values),
-    m_dem_pixel_bboxes(dem_pixel_bboxes), m_num_valid_pixels(num_valid_pixels),
-    m_count_mutex(count_mutex) {
+    m_dem_pixel_bboxes(dem_pixel_bboxes), m_dem_index(dem_index),
+    m_num_valid_pixels(num_valid_pixels),
+    m_count_mutex(count_mutex), m_filled_dem(filled_dem) {
 
     // How many valid pixels we will have
     m_num_valid_pixels = 0;
     
     if (imgMgr.size() != georefs.size()       ||
         imgMgr.size() != nodata_values.size() ||
-        imgMgr.size() != dem_pixel_bboxes.size())
+        imgMgr.size() != dem_pixel_bboxes.size() ||
+        (int)imgMgr.size() != dem_index.size())
       vw_throw(ArgumentErr() << "Inputs expected to have the same size do not.\n");
 
     // Sanity check, see if datums differ, then the tool won't work
@@ -444,6 +566,28 @@ public:
     return pixel_type();
   }
 
+  // If the DEMs processed so far leave nothing for one whose
+  // footprint in output pixels is 'dem_box' to change in the tile
+  // 'bbox'. That is, all pixels have values, or, with priority
+  // blending, the weights left for later DEMs are zero.
+  bool is_tile_covered(BBox2i dem_box, BBox2i const& bbox, bool use_priority_blend,
+                       ImageView<double> const& tile,
+                       ImageView<double> const& weight_modifier) const {
+    dem_box.crop(bbox);
+    for (int c = dem_box.min().x(); c < dem_box.max().x(); c++) {
+      for (int r = dem_box.min().y(); r < dem_box.max().y(); r++) {
+        int i = c - bbox.min().x(), j = r - bbox.min().y();
+        if (use_priority_blend) {
+          if (weight_modifier(i, j) > 0)
+            return false;
+        } else if (tile(i, j) == m_opt.out_nodata_value) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i bbox) const {
 
@@ -474,8 +618,7 @@ public:
     // - Used for median, nmad, and stddev calculation.
     std::vector< ImageView<double> > tile_vec, weight_vec;
     std::vector< std::string > dem_vec;
-    if (m_opt.median || m_opt.nmad) // Store each input separately
-      tile_vec.reserve(m_imgMgr.size());
+    std::vector< PackedTile > packed_vec; // for median and nmad, store each input separately
     if (m_opt.stddev) { // Need one working image
       tile_vec.push_back(ImageView<double>(bbox.width(), bbox.height()));
       // Each pixel starts at zero, nodata is handled later
@@ -523,8 +666,32 @@ public:
     ImageView<double> first_dem;
     ImageView<double> local_wts_orig;
 
-    // Loop through all input DEMs
-    for (int dem_iter = 0; dem_iter < (int)m_imgMgr.size(); dem_iter++) {
+    // Find the DEMs which may overlap with this tile, in their
+    // original order. With many input DEMs, this is much faster than
+    // checking each of them below. The DEM footprints in the index
+    // already account for the blending and erosion length.
+    std::vector<int> dem_ids;
+    m_dem_index.query(bbox, dem_ids);
+
+    // With --first and --last, once the output pixels a DEM may
+    // overlap all have values, that DEM cannot change them, so it is
+    // not read. The DEMs are visited in reverse order for --last, so
+    // that it works as --first. With priority blending, the same holds
+    // once the earlier DEMs leave no weight for later ones there.
+    bool skip_covered = (m_opt.first || m_opt.last || use_priority_blend) &&
+      !m_opt.propagate_nodata && !m_opt.first_dem_as_reference;
+    bool reverse_order = (m_opt.last && skip_covered);
+    if (reverse_order)
+      std::reverse(dem_ids.begin(), dem_ids.end());
+
+    // Loop through the input DEMs
+    for (size_t id_iter = 0; id_iter < dem_ids.size(); id_iter++) {
+
+      int dem_iter = dem_ids[id_iter];
+
+      if (skip_covered && is_tile_covered(m_dem_index.box(dem_iter), bbox,
+                                          use_priority_blend, tile, weight_modifier))
+        continue;
 
       // Load the information for this DEM
       GeoReference georef        = m_georefs         [dem_iter];
@@ -596,15 +763,11 @@ public:
         }
       }
 
-      // Fill holes. This happens here, in the expanded tile, to
-      // ensure we catch holes which are partially outside the tile
-      // being processed.
-      if (m_opt.hole_fill_len > 0){
-        dem = apply_mask(vw::fill_holes_grass
-                         (create_mask(select_channel(dem, 0), nodata_value),
-                          m_opt.hole_fill_len),
-                         nodata_value);
-      }
+      // Fill holes. There is only one input DEM then, and its holes
+      // were found before the tiles were made, so holes partially
+      // outside the tile being processed are caught without a collar.
+      if (m_opt.hole_fill_len > 0)
+        dem = apply_mask(crop(m_filled_dem, in_box), nodata_value);
 
       // Fill-in no-data values a bit and blur. If just the blurring is used,
       // it will choke on no-data values, leaving large holes around each,
@@ -629,8 +792,8 @@ public:
       }
 
       // Compute linear weights
-      ImageView<double> local_wts = grassfire(notnodata(select_channel(dem, 0), nodata_value),
-                                              m_opt.no_border_blend);
+      ImageView<double> local_wts
+        = boundary_weights(notnodata(select_channel(dem, 0), nodata_value), m_opt);
       local_wts_orig = local_wts;
       if (m_opt.use_centerline_weights) {
         // Erode based on grassfire weights, and then overwrite the grassfire
@@ -809,7 +972,7 @@ public:
 
           // Update the output value according to the commanded mode
           if ((m_opt.first && is_nodata)                      ||
-               m_opt.last                                     ||
+              (m_opt.last && (is_nodata || !reverse_order))   ||
                (m_opt.min && (val < tile(c, r) || is_nodata)) ||
                (m_opt.max && (val > tile(c, r) || is_nodata)) ||
                m_opt.median || m_opt.nmad || 
@@ -858,10 +1021,13 @@ public:
         } // End col loop
       } // End row loop
 
-      // For the median option, keep a copy of the output tile for each input DEM!
-      // Also do it for max per block.
+      // For the median option, keep the valid values of the output
+      // tile for each input DEM. For max per block, keep a copy of
+      // the output tile.
       // - This will be memory intensive. 
-      if (m_opt.median || m_opt.nmad || m_opt.block_max) {
+      if (m_opt.median || m_opt.nmad)
+        packed_vec.push_back(PackedTile(tile, m_opt.out_nodata_value));
+      if (m_opt.block_max) {
         tile_vec.push_back(copy(tile));
         dem_vec.push_back(dem_name);
       }
@@ -910,18 +1076,20 @@ public:
     if (m_opt.median || m_opt.nmad){
       // Init output pixels to nodata
       fill(tile, m_opt.out_nodata_value);
-      vector<double> vals, vals_all(tile_vec.size());
-      // Iterate through all pixels
-      for (int c = 0; c < bbox.width(); c++){
-        for (int r = 0; r < bbox.height(); r++){
+      vector<double> vals, vals_all(packed_vec.size());
+      vector<size_t> cursors(packed_vec.size(), 0);
+      // Iterate through all pixels, in the order the values were packed
+      for (int r = 0; r < bbox.height(); r++){
+        for (int c = 0; c < bbox.width(); c++){
           // Compute the median for this pixel
           vals.clear();
-          for (int i = 0; i < (int)tile_vec.size(); i++){
-            ImageView<double> & tile_ref = tile_vec[i];
-            double this_val = tile_ref(c, r);
-            vals_all[i] = this_val; // Record the original order.
-            if (this_val == m_opt.out_nodata_value)
+          int pix = r*bbox.width() + c;
+          for (int i = 0; i < (int)packed_vec.size(); i++){
+            vals_all[i] = m_opt.out_nodata_value; // Record the original order.
+            if (!packed_vec[i].is_valid(pix))
               continue;
+            double this_val = packed_vec[i].value(cursors[i]++);
+            vals_all[i] = this_val;
             vals.push_back(this_val);
           }
           if (vals.empty())
@@ -950,8 +1118,8 @@ public:
             }
           }
 
-        }// End row loop
-      } // End col loop
+        }// End col loop
+      } // End row loop
     } // End median/nmad case
 
     // For max per block, find the sum of values in each DEM
@@ -1000,9 +1168,9 @@ public:
           }
         }
 
-        weight_vec[clip_iter] = grassfire(notnodata(tile_vec[clip_iter],
-                                                    m_opt.out_nodata_value),
-                                          m_opt.no_border_blend);
+        weight_vec[clip_iter] = boundary_weights(notnodata(tile_vec[clip_iter],
+                                                           m_opt.out_nodata_value),
+                                                 m_opt);
       }
 
       // Don't allow the weights to grow too fast, for uniqueness.
@@ -1157,6 +1325,7 @@ public:
 /// - dem_proj_bboxes and dem_pixel_bboxes are the locations of
 ///   each input DEM in the output DEM in projected and pixel coordinates.
 void load_dem_bounding_boxes(Options       const& opt,
+                             std::vector<asp::DemInfo> const& dem_infos,
                              GeoReference  const& mosaic_georef,
                              BBox2              & mosaic_bbox, // Projected coordinates
                              std::vector<BBox2> & dem_proj_bboxes,
@@ -1178,16 +1347,14 @@ void load_dem_bounding_boxes(Options       const& opt,
   // Loop through all DEMs
   for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++){ 
 
-    // Open a handle to this DEM file
-    DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-    DiskImageView<RealT>  img(opt.dem_files[dem_iter]);
-    GeoReference          georef = read_georef(opt.dem_files[dem_iter]);
-    BBox2i                pixel_box = bounding_box(img);
+    // These were found without opening the DEM, if it is in the index
+    GeoReference const& georef    = dem_infos[dem_iter].georef;
+    BBox2i              pixel_box = dem_infos[dem_iter].pixel_box;
 
     dem_pixel_bboxes.push_back(pixel_box);
 
     if (dem_iter == 0) 
-      first_dem_proj_box = georef.bounding_box(img);
+      first_dem_proj_box = georef.pixel_to_point_bbox(pixel_box);
     
     bool has_lonat = (georef.proj4_str().find("+proj=longlat") != std::string::npos ||
                       mosaic_georef.proj4_str().find("+proj=longlat") != std::string::npos);
@@ -1196,7 +1363,7 @@ void load_dem_bounding_boxes(Options       const& opt,
     // the same projection, and it is not longlat, as then we need to worry about
     // a 360 degree shift.
     if ((!has_lonat) && mosaic_georef.overall_proj4_str() == georef.overall_proj4_str()){
-      BBox2 proj_box = georef.bounding_box(img);
+      BBox2 proj_box = georef.pixel_to_point_bbox(pixel_box);
       mosaic_bbox.grow(proj_box);
       dem_proj_bboxes.push_back(proj_box);
     }else{
@@ -1205,7 +1372,7 @@ void load_dem_bounding_boxes(Options       const& opt,
       // lonlat of the mosaic so far and of the current DEM will be
       // offset by 360 degrees. Try to deal with that.
       BBox2 proj_box;
-      BBox2 imgbox = bounding_box(img);
+      BBox2 imgbox = pixel_box;
       BBox2 mosaic_pixel_box;
       
       // Get the bbox of current mosaic in pixels.
@@ -1306,12 +1473,16 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("output-nodata-value", po::value<double>(&opt.out_nodata_value),
      "No-data value to use on output. Default: use the one from the first DEM to be mosaicked.")
     ("ot",  po::value(&opt.output_type)->default_value("Float32"), "Output data type. Supported types: Byte, UInt16, Int16, UInt32, Int32, Float32. If the output type is a kind of integer, values are rounded and then clamped to the limits of that type.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Write cloud-optimized GeoTIFF files, with internal overviews.")
     ("weights-blur-sigma", po::value<double>(&opt.weights_blur_sigma)->default_value(5.0),
      "The standard deviation of the Gaussian used to blur the weights. Higher value results in smoother weights and blending. Set to 0 to not use blurring.")
     ("weights-exponent",   po::value<double>(&opt.weights_exp)->default_value(2.0),
      "The weights used to blend the DEMs should increase away from the boundary as a power with this exponent. Higher values will result in smoother but faster-growing weights.")
     ("use-centerline-weights",   po::bool_switch(&opt.use_centerline_weights)->default_value(false),
      "Compute weights based on a DEM centerline algorithm. Produces smoother weights if the input DEMs don't have holes or complicated boundary.")
+    ("use-euclidean-weights",   po::bool_switch(&opt.use_euclidean_weights)->default_value(false),
+     "Let the weights grow with the Euclidean distance from the DEM boundary, rather than with the number of pixels along rows and columns. This makes them grow at the same rate in all directions.")
     ("dem-blur-sigma", po::value<double>(&opt.dem_blur_sigma)->default_value(0.0),
      "Blur the DEM using a Gaussian with this value of sigma. A larger value will blur more. Default: No blur.")
     ("nodata-threshold", po::value(&opt.nodata_threshold)->default_value(std::numeric_limits<double>::quiet_NaN()),
@@ -1321,6 +1492,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("extra-crop-length", po::value<int>(&opt.extra_crop_len)->default_value(200),
      "Crop the DEMs this far from the current tile (measured in pixels) before blending them (a small value may result in artifacts).")
     ("block-size",      po::value<int>(&opt.block_size)->default_value(0), "A large value can result in increased memory usage.")
+    ("dem-index", po::value(&opt.dem_index_file)->default_value(""),
+     "Keep in this file the size, georeference, no-data value, and footprint of each input DEM. In later runs, the DEMs in this file which did not change are not opened to find these, which is much faster for many DEMs. The file is created if missing, and updated with the new or changed DEMs.")
     ("save-dem-weight",      po::value<int>(&opt.save_dem_weight),
      "Save the weight image that tracks how much the input DEM with given index contributed to the output mosaic at each pixel (smallest index is 0).")
     ("first-dem-as-reference", po::bool_switch(&opt.first_dem_as_reference)->default_value(false),
@@ -1329,6 +1502,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "The output DEM will have the same size, grid, and georeference as this one, but it will not be used in the mosaic.")
     ("force-projwin", po::bool_switch(&opt.force_projwin)->default_value(false),
      "Make the output mosaic fill precisely the specified projwin, by padding it if necessary and aligning the output grid to the region.")
+    ("incremental", po::bool_switch(&opt.incremental)->default_value(false),
+     "Skip the output tiles which an earlier run with the same options made from the same input DEMs, unmodified since then. Only the tiles whose inputs changed are made again. A manifest of what each tile was made from is saved next to it.")
     ("save-index-map",   po::bool_switch(&opt.save_index_map)->default_value(false),
      "For each output pixel, save the index of the input DEM it came from (applicable only for --first, --last, --min, --max, --median, and --nmad). A text file with the index assigned to each input DEM is saved as well.");
 
@@ -1534,16 +1709,20 @@ int main(int argc, char *argv[]) {
 
     handle_arguments(argc, argv, opt);
 
+    // The sizes, georefs, and nodata values of all DEMs, read from the
+    // DEM index, if specified, for the DEMs which did not change
+    std::vector<asp::DemInfo> dem_infos;
+    asp::load_dem_infos(opt.dem_files, opt.dem_index_file, dem_infos);
+
     // TODO: Fix here. If the DEM is double, read the nodata as double,
     // without casting to float. If it is float, cast to float.
     
     // Read nodata from first DEM, unless the user chooses to specify it.
     if (!opt.has_out_nodata){
-      DiskImageResourceGDAL in_rsrc(opt.dem_files[0]);
       // Since the DEMs have float pixels, we must read the no-data as
       // float as well. (this is a bug fix). Yet we store it in a
       // double, as we will cast the DEM pixels to double as well.
-      if (in_rsrc.has_nodata_read()) opt.out_nodata_value = RealT(in_rsrc.nodata_read());
+      if (dem_infos[0].has_nodata) opt.out_nodata_value = RealT(dem_infos[0].nodata);
     }
 
     // Watch for underflow, if mixing doubles and float. Particularly problematic
@@ -1563,7 +1742,7 @@ int main(int argc, char *argv[]) {
       opt.target_srs_string = processed_proj4(opt.target_srs_string);
 
     // By default the output georef is equal to the first input georef
-    GeoReference mosaic_georef = read_georef(opt.dem_files[0]);
+    GeoReference mosaic_georef = dem_infos[0].georef;
 
     if (opt.first_dem_as_reference) {
       if (opt.target_srs_string != "" || opt.tr > 0 || opt.projwin != BBox2()) 
@@ -1601,7 +1780,7 @@ int main(int argc, char *argv[]) {
     // Steal the datum and its name from the input, if the output
     // datum name is unknown.
     if (mosaic_georef.datum().name() == "unknown"){
-      GeoReference georef = read_georef(opt.dem_files[0]);
+      GeoReference const& georef = dem_infos[0].georef;
       if (mosaic_georef.datum().semi_major_axis() == georef.datum().semi_major_axis() &&
     	  mosaic_georef.datum().semi_minor_axis() == georef.datum().semi_minor_axis()){
           vw_out() << "Using the datum: " << georef.datum() << std::endl;
@@ -1612,8 +1791,7 @@ int main(int argc, char *argv[]) {
     // Use desired spacing if user-specified
     if (spacing > 0.0){
       // Get lonlat bounding box of the first DEM.
-      DiskImageView<RealT> dem0(opt.dem_files[0]);
-      BBox2 llbox0 = mosaic_georef.pixel_to_lonlat_bbox(bounding_box(dem0));
+      BBox2 llbox0 = mosaic_georef.pixel_to_lonlat_bbox(dem_infos[0].pixel_box);
       
       // Reset transform with user provided spacing.
       Matrix<double,3,3> transform = mosaic_georef.transform();
@@ -1644,8 +1822,8 @@ int main(int argc, char *argv[]) {
     // Load the bounding boxes from all of the DEMs
     BBox2 mosaic_bbox;
     vector<BBox2> dem_proj_bboxes;
-    vector<BBox2i> dem_pixel_bboxes, loaded_dem_pixel_bboxes;
-    load_dem_bounding_boxes(opt, mosaic_georef, mosaic_bbox,
+    vector<BBox2i> dem_pixel_bboxes, loaded_dem_pixel_bboxes, loaded_dem_out_bboxes;
+    load_dem_bounding_boxes(opt, dem_infos, mosaic_georef, mosaic_bbox,
                             dem_proj_bboxes, dem_pixel_bboxes);
 
 
@@ -1690,8 +1868,9 @@ int main(int argc, char *argv[]) {
 
     // This bias is very important. This is how much we should read from
     // the images beyond the current boundary to avoid tiling artifacts.
-    // The +1 is to ensure extra pixels beyond the hole fill length.
-    int bias = opt.erode_len + opt.extra_crop_len + opt.hole_fill_len
+    // The +1 is to ensure extra pixels beyond the erode length. Holes
+    // are filled without a collar.
+    int bias = opt.erode_len + opt.extra_crop_len
       + 2*std::max(vw::compute_kernel_size(opt.weights_blur_sigma),
                    vw::compute_kernel_size(opt.dem_blur_sigma))
                    + 1;
@@ -1790,7 +1969,7 @@ int main(int argc, char *argv[]) {
 
       // The GeoTransform will hide the messy details of conversions
       // from pixels to points and lon-lat.
-      GeoReference georef  = read_georef(opt.dem_files[dem_iter]);
+      GeoReference georef  = dem_infos[dem_iter].georef;
       BBox2i dem_pixel_box = dem_pixel_bboxes[dem_iter];
       GeoTransform geotrans(georef, mosaic_georef, dem_pixel_box, output_dem_box);
 
@@ -1804,19 +1983,8 @@ int main(int argc, char *argv[]) {
       imgMgr.add_file_handle_not_thread_safe(opt.dem_files[dem_iter], curr_box);
       
       double curr_nodata_value = opt.out_nodata_value;
-      try {
-        // Get the nodata-value. Need a try block, in case we can't
-        // open more handles.
-        DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-        if (in_rsrc.has_nodata_read())
-          curr_nodata_value = RealT(in_rsrc.nodata_read());
-      }catch(std::exception const& e){
-        // Try again
-        imgMgr.freeup_handles_not_thread_safe();
-        DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-        if (in_rsrc.has_nodata_read())
-          curr_nodata_value = RealT(in_rsrc.nodata_read());
-      }
+      if (dem_infos[dem_iter].has_nodata)
+        curr_nodata_value = RealT(dem_infos[dem_iter].nodata);
       
       loaded_dems.push_back(opt.dem_files[dem_iter]);
 
@@ -1827,8 +1995,49 @@ int main(int argc, char *argv[]) {
       nodata_values.push_back(curr_nodata_value);
       georefs.push_back(georef);
       loaded_dem_pixel_bboxes.push_back(dem_pixel_box);
+
+      // The region of the output mosaic this DEM can affect. It is
+      // grown by as much as a tile is grown when it is brought
+      // into the DEM frame in DemMosaicView, and by a pixel more, as
+      // it is found by sampling the DEM boundary.
+      BBox2i grown_dem_box = dem_pixel_box;
+      grown_dem_box.expand(bias + BilinearInterpolation::pixel_buffer + 1);
+      BBox2i out_box = grow_bbox_to_int(geotrans.forward_bbox(grown_dem_box));
+      out_box.expand(1);
+      out_box.crop(output_dem_box);
+      loaded_dem_out_bboxes.push_back(out_box);
     } // End loop through DEM files
 
+    // Used to find quickly the DEMs which overlap with a given output block
+    asp::BBoxIndex dem_index(loaded_dem_out_bboxes, block_size);
+
+    // Hole filling is for a single input DEM. Find its holes in one
+    // pass, then each tile fills the small ones it has.
+    ImageViewRef<PixelMask<RealT>> filled_dem;
+    if (opt.hole_fill_len > 0 && loaded_dems.size() == 1) {
+      vw_out() << "Finding the holes in: " << loaded_dems[0] << "\n";
+      ImageViewRef<PixelMask<RealT>> masked_dem;
+      if (!boost::math::isnan(opt.nodata_threshold))
+        masked_dem = create_mask_less_or_equal(DiskImageView<RealT>(loaded_dems[0]),
+                                               nodata_values[0]);
+      else
+        masked_dem = create_mask(DiskImageView<RealT>(loaded_dems[0]), nodata_values[0]);
+      filled_dem = asp::fill_small_holes(masked_dem, opt.hole_fill_len,
+                                         vw_settings().default_tile_size(),
+                                         opt.num_threads);
+    }
+
+    // With --incremental, each tile records what it was made from,
+    // so that a later run can skip it if none of that changed.
+    std::string settings;
+    std::vector<std::string> timestamps;
+    if (opt.incremental) {
+      settings = mosaic_settings(opt, mosaic_georef, cols, rows,
+                                 filled_dem.cols() > 0);
+      for (size_t dem_iter = 0; dem_iter < loaded_dems.size(); dem_iter++)
+        timestamps.push_back(asp::file_timestamp(loaded_dems[dem_iter]));
+    }
+
     // If there are 17 tiles, let them be tile-00, ..., tile-16.
     int num_digits = 1;
     int tens = 10;
@@ -1855,6 +2064,19 @@ int main(int argc, char *argv[]) {
 	dem_tile = os.str();
       }else
 	dem_tile = opt.out_prefix; // the file name was set by user
+
+      std::string manifest;
+      if (opt.incremental) {
+        std::vector<int> dem_ids;
+        dem_index.query(tile_box, dem_ids);
+        manifest = tile_manifest(opt, settings, dem_ids, loaded_dems, timestamps);
+        if (tile_is_current(dem_tile, manifest)) {
+          vw_out() << "Tile is up to date: " << dem_tile << std::endl;
+          continue;
+        }
+        // The tile is about to change, so its old manifest is stale
+        boost::filesystem::remove(tile_manifest_file(dem_tile));
+      }
       
       // Set up tile image and metadata
       long long int num_valid_pixels; // Will be populated when saving to disk
@@ -1864,8 +2086,8 @@ int main(int argc, char *argv[]) {
         = crop(DemMosaicView(cols, rows, bias, opt,
                              imgMgr, georefs,
                              mosaic_georef, nodata_values,
-                             loaded_dem_pixel_bboxes,
-                             num_valid_pixels, count_mutex),
+                             loaded_dem_pixel_bboxes, dem_index,
+                             num_valid_pixels, count_mutex, filled_dem),
                tile_box);
       GeoReference crop_georef = crop(mosaic_georef, tile_box.min().x(),
 				      tile_box.min().y());
@@ -1917,6 +2139,14 @@ int main(int argc, char *argv[]) {
       if (num_valid_pixels == 0) {
         vw_out() << "Removing tile with no valid pixels: " << dem_tile << std::endl;
         boost::filesystem::remove(dem_tile);
+      } else if (opt.cog) {
+        asp::write_cog(dem_tile, opt, "AVERAGE");
+      }
+
+      if (opt.incremental) {
+        std::string manifest_file = tile_manifest_file(dem_tile);
+        std::ofstream ofs(manifest_file.c_str());
+        ofs << manifest << "valid pixels " << num_valid_pixels << "\n";
       }
       
     } // End loop through tiles
@@ -34,6 +34,11 @@
 #include <vw/Image/Filter.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/DisparityEncoding.h>
+#include <asp/Core/ImageHistogram.h>
+
+#include <limits>
+
 using namespace vw;
 using namespace vw::stereo;
 
@@ -56,6 +61,20 @@ class DisparityNorm: public ReturnFixedType<double> {
   }
 };
 
+// One band of a disparity, with or without a mask, as a masked double
+template <class PixelT>
+class DisparityBand: public ReturnFixedType<PixelMask<double>> {
+  int m_band;
+public:
+  DisparityBand(int band): m_band(band) {}
+  PixelMask<double> operator()(PixelT const& pix) const {
+    PixelMask<double> result(remove_mask(pix)[m_band]);
+    if (!is_valid(pix))
+      result.invalidate();
+    return result;
+  }
+};
+
 // Find the maximum of the norms of differences between a disparity
 // at a pixel and its four left, right, top, and bottom neighbors.
 // For the disparity to result in a nice transform from left to
@@ -202,6 +221,17 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
              << "time.\n" << usage << general_options);
 }
 
+// Read the disparity as is. Only a float disparity with a mask can be
+// in the compact format, which is then decoded.
+template <class PixelT>
+ImageViewRef<PixelT> read_input_disparity(std::string const& file) {
+  return DiskImageView<PixelT>(file);
+}
+template <>
+ImageViewRef<PixelMask<Vector2f>> read_input_disparity(std::string const& file) {
+  return asp::read_disparity(file);
+}
+
 template <class PixelT>
 void process_disparity(Options& opt) {
 
@@ -211,7 +241,7 @@ void process_disparity(Options& opt) {
   float output_nodata = -32768.0;
 
   if (opt.save_norm) {
-    DiskImageView<PixelMask<Vector2f>> disk_disparity_map(opt.input_file_name);
+    ImageViewRef<PixelMask<Vector2f>> disk_disparity_map = asp::read_disparity(opt.input_file_name);
 
     std::string norm_file = opt.output_prefix + "-norm." + opt.output_file_type;
     vw_out() << "\t--> Writing disparity norm: " << norm_file << "\n";
@@ -224,7 +254,7 @@ void process_disparity(Options& opt) {
   }
   
   if (opt.save_norm_diff) {
-    DiskImageView<PixelMask<Vector2f>> disk_disparity_map(opt.input_file_name);
+    ImageViewRef<PixelMask<Vector2f>> disk_disparity_map = asp::read_disparity(opt.input_file_name);
 
     std::string norm_file = opt.output_prefix + "-norm-diff." + opt.output_file_type;
     vw_out() << "\t--> Writing norm of disparity diff: " << norm_file << "\n";
@@ -236,7 +266,7 @@ void process_disparity(Options& opt) {
     return;
   }
 
-  DiskImageView<PixelT> disk_disparity_map(opt.input_file_name);
+  ImageViewRef<PixelT> disk_disparity_map = read_input_disparity<PixelT>(opt.input_file_name);
 
   // If no ROI passed in, use the full image
   BBox2 roiToUse(opt.roi);
@@ -253,8 +283,28 @@ void process_disparity(Options& opt) {
     float subsample_amt =
       float(roiToUse.height())*float(roiToUse.width()) / (1000.f * 1000.f);
     subsample_amt = std::max(subsample_amt, 1.0f);
-    opt.normalization_range
-      = get_disparity_range(subsample(crop(disk_disparity_map, roiToUse), subsample_amt));
+
+    // The range of each band is found from its histogram, which is
+    // saved next to the disparity, so later runs need not read it again.
+    int subsample_int = subsample_amt;
+    double nodata = std::numeric_limits<double>::quiet_NaN();
+    int num_bins = 256;
+    for (int band = 0; band < 2; band++) {
+      std::string hist_file = asp::image_histogram_file(opt.input_file_name, band);
+      std::string hist_key = asp::image_histogram_key(opt.input_file_name, band, nodata,
+                                                      subsample_int, BBox2i(opt.roi));
+      asp::ImageHistogram hist
+        = asp::cached_image_histogram(per_pixel_filter(subsample(crop(disk_disparity_map,
+                                                                      roiToUse),
+                                                                 subsample_int),
+                                                       DisparityBand<PixelT>(band)),
+                                      hist_file, hist_key, num_bins,
+                                      vw_settings().default_num_threads());
+      if (hist.empty())
+        continue;
+      opt.normalization_range.min()[band] = hist.min_val();
+      opt.normalization_range.max()[band] = hist.max_val();
+    }
   }
   
   vw_out() << "\t    Horizontal: [" << opt.normalization_range.min().x()
@@ -309,6 +359,12 @@ int main(int argc, char *argv[]) {
     vw_out() << "Opening " << opt.input_file_name << "\n";
     ImageFormat fmt = vw::image_format(opt.input_file_name);
 
+    // A disparity saved with --compact-disparity is decoded to floats
+    if (asp::is_compact_disparity(opt.input_file_name)) {
+      process_disparity<PixelMask<Vector2f>>(opt);
+      return 0;
+    }
+
     switch(fmt.pixel_format) {
     case VW_PIXEL_GENERIC_2_CHANNEL:
       switch (fmt.channel_type) {
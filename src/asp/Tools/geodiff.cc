@@ -17,10 +17,16 @@
 
 
 #include <asp/Core/PointUtils.h>
+#include <asp/Core/PixelMapGrid.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/GeoTransform.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
+#include <map>
+#include <mutex>
+#include <set>
+
 
 using std::endl;
 using std::string;
@@ -55,9 +61,162 @@ public:
   }
 };
 
+// Statistics of the differences, accumulated from the tiles of the
+// difference image as they are written, from several threads. The
+// median is found from a histogram of the differences.
+class DiffStats {
+public:
+  DiffStats(double bin_size): m_bin_size(bin_size), m_count(0), m_sum(0.0), m_sum2(0.0),
+                              m_min(std::numeric_limits<double>::max()),
+                              m_max(-std::numeric_limits<double>::max()) {}
+
+  // A tile added a second time is ignored
+  void add(BBox2i const& bbox, ImageView<PixelMask<double>> const& tile) {
+
+    long long count = 0;
+    double sum = 0.0, sum2 = 0.0;
+    double min_val = std::numeric_limits<double>::max(), max_val = -min_val;
+    std::map<long long, long long> hist;
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        PixelMask<double> const& pix = tile(col, row);
+        if (!is_valid(pix))
+          continue;
+        double diff = pix.child();
+        count++;
+        sum  += diff;
+        sum2 += diff * diff;
+        min_val = std::min(min_val, diff);
+        max_val = std::max(max_val, diff);
+        hist[(long long)floor(diff / m_bin_size)]++;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_added.insert(std::make_pair(bbox.min().x(), bbox.min().y())).second)
+      return;
+    m_count += count;
+    m_sum   += sum;
+    m_sum2  += sum2;
+    m_min    = std::min(m_min, min_val);
+    m_max    = std::max(m_max, max_val);
+    for (auto it = hist.begin(); it != hist.end(); it++)
+      m_hist[it->first] += it->second;
+  }
+
+  void print() const {
+    double diff_mean = 0.0, diff_std = 0.0, diff_median = 0.0;
+    if (m_count > 0) {
+      diff_mean = m_sum / m_count;
+      diff_std = m_sum2 / m_count - diff_mean * diff_mean;
+      if (diff_std < 0)
+        diff_std = 0; // just in case, for numerical noise
+      diff_std = std::sqrt(diff_std);
+
+      // The center of the bin having the middle difference in sorted order
+      long long pos = m_count / 2, cum = 0;
+      for (auto it = m_hist.begin(); it != m_hist.end(); it++) {
+        cum += it->second;
+        if (cum > pos) {
+          diff_median = (it->first + 0.5) * m_bin_size;
+          break;
+        }
+      }
+    }
+
+    vw_out() << "Number of valid differences: " << m_count << std::endl;
+    if (m_count == 0)
+      return;
+    vw_out() << "Max difference:       " << m_max       << " meters" << std::endl;
+    vw_out() << "Min difference:       " << m_min       << " meters" << std::endl;
+    vw_out() << "Mean difference:      " << diff_mean   << " meters" << std::endl;
+    vw_out() << "StdDev of difference: " << diff_std    << " meters" << std::endl;
+    vw_out() << "Median difference:    " << diff_median << " meters" << " (to within "
+             << m_bin_size / 2.0 << " meters)" << std::endl;
+  }
+
+private:
+  double m_bin_size;
+  std::mutex m_mutex;
+  long long m_count;
+  double m_sum, m_sum2, m_min, m_max;
+  std::map<long long, long long> m_hist; // the number of differences in each bin
+  std::set<std::pair<int, int>> m_added; // corners of the tiles added so far
+};
+
+// A view returning the given difference image, which, when a tile of it
+// is rendered, adds the differences in that tile to the statistics.
+class DiffStatsView: public ImageViewBase<DiffStatsView> {
+  ImageViewRef<PixelMask<double>> m_diff;
+  boost::shared_ptr<DiffStats>    m_stats;
+
+public:
+  typedef PixelMask<double> pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<DiffStatsView> pixel_accessor;
+
+  DiffStatsView(ImageViewRef<PixelMask<double>> const& diff,
+                boost::shared_ptr<DiffStats> stats):
+    m_diff(diff), m_stats(stats) {}
+
+  inline int32 cols  () const { return m_diff.cols(); }
+  inline int32 rows  () const { return m_diff.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  // Single pixels are not accumulated
+  inline result_type operator()(int32 i, int32 j, int32 p = 0) const {
+    return m_diff(i, j, p);
+  }
+
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    ImageView<pixel_type> tile = crop(m_diff, bbox);
+    m_stats->add(bbox, tile);
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+// Interpolate the DEM at the points falling in one block of it. The
+// block, with a margin for interpolation, is read once.
+class DemLookupTask: public vw::Task, private boost::noncopyable {
+  ImageViewRef<PixelMask<double>>  m_dem;
+  BBox2i                           m_box;
+  std::vector<size_t>              m_ids;     // the points in this block
+  std::vector<Vector2>      const& m_pix;     // alias, for all points
+  std::vector<PixelMask<double>> & m_heights; // alias, for all points
+
+public:
+  DemLookupTask(ImageViewRef<PixelMask<double>> const& dem, BBox2i const& box,
+                std::vector<size_t> const& ids, std::vector<Vector2> const& pix,
+                std::vector<PixelMask<double>> & heights):
+    m_dem(dem), m_box(box), m_ids(ids), m_pix(pix), m_heights(heights) {}
+
+  void operator()() {
+    BBox2i ext = m_box;
+    ext.expand(BilinearInterpolation::pixel_buffer);
+    ext.crop(bounding_box(m_dem));
+    ImageView<PixelMask<double>> tile = crop(m_dem, ext);
+    InterpolationView<EdgeExtensionView<ImageView<PixelMask<double>>, ConstantEdgeExtension>,
+                      BilinearInterpolation> interp_tile
+      = interpolate(tile, BilinearInterpolation(), ConstantEdgeExtension());
+    for (size_t it = 0; it < m_ids.size(); it++) {
+      Vector2 pix = m_pix[m_ids[it]] - ext.min();
+      m_heights[m_ids[it]] = interp_tile(pix[0], pix[1]);
+    }
+  }
+};
+
 struct Options : vw::GdalWriteOptions {
   string dem1_file, dem2_file, output_prefix, csv_format_str, csv_proj4_str;
-  double nodata_value;
+  double nodata_value, approx_tol;
+  int approx_grid_spacing;
 
   bool use_float, use_absolute;
 };
@@ -75,7 +234,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Output the absolute difference as opposed to just the difference.")
     ("csv-format",     po::value(&opt.csv_format_str)->default_value(""),
      asp::csv_opt_caption().c_str())
-    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.");
+    ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV file. If not specified, it will be borrowed from the DEM.")
+    ("approx-grid-spacing", po::value(&opt.approx_grid_spacing)->default_value(16),
+     "If positive, find exactly where the pixels of the first DEM are in the second DEM only on a grid with this spacing, refined where the interpolation error is too large, and interpolate in between. Set to 0 to compute this for each pixel. See also --approx-tolerance.")
+    ("approx-tolerance", po::value(&opt.approx_tol)->default_value(0.01),
+     "The largest allowed interpolation error, in pixels of the second DEM, with --approx-grid-spacing.");
   general_options.add(vw::GdalWriteOptionsDescription(opt));
 
   po::options_description positional("");
@@ -165,33 +328,45 @@ void dem2dem_diff(Options& opt){
 
   if (crop_box.empty()) 
     vw_throw(ArgumentErr() << "The two DEMs do not have a common area.\n");
-    
-  ImageViewRef<PixelMask<double>> dem2_trans =
-    per_pixel_filter(crop(geo_transform
-                          (per_pixel_filter(dem_to_geodetic
-                                            (create_mask(dem2_disk_image_view, dem2_nodata),
-                                             dem2_georef),
-                                            MGeodeticToMAltitude()),
-                           dem2_georef, dem1_georef,
-                           ValueEdgeExtension<PixelMask<double>>(PixelMask<double>())),
-                          crop_box), MaskNaN());
+
+  // The second DEM heights, in the pixels of the first DEM. The
+  // positions in the second DEM of the pixels of the first DEM can be
+  // found exactly only on a grid, then interpolated.
+  ImageViewRef<PixelMask<double>> dem2_heights
+    = per_pixel_filter(dem_to_geodetic(create_mask(dem2_disk_image_view, dem2_nodata),
+                                       dem2_georef),
+                       MGeodeticToMAltitude());
+  ValueEdgeExtension<PixelMask<double>> edge_ext((PixelMask<double>()));
+  ImageViewRef<PixelMask<double>> dem2_trans;
+  if (opt.approx_grid_spacing > 0)
+    dem2_trans = transform(dem2_heights,
+                           asp::GridInterpTrans<GeoTransform>(gt, opt.approx_grid_spacing,
+                                                              opt.approx_tol),
+                           dem1_disk_image_view.cols(), dem1_disk_image_view.rows(),
+                           edge_ext, BilinearInterpolation());
+  else
+    dem2_trans = transform(dem2_heights, gt,
+                           dem1_disk_image_view.cols(), dem1_disk_image_view.rows(),
+                           edge_ext, BilinearInterpolation());
+  dem2_trans = per_pixel_filter(crop(dem2_trans, crop_box), MaskNaN());
   
-  ImageViewRef<double> difference;
-  if (opt.use_absolute) {
-    difference =
-      apply_mask(abs(crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans),
-                 opt.nodata_value);
-  } else {
-    difference =
-      apply_mask(crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans,
-                 opt.nodata_value);
-  }
-    
+  ImageViewRef<PixelMask<double>> masked_diff;
+  if (opt.use_absolute) 
+    masked_diff = abs(crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans);
+  else
+    masked_diff = crop(create_mask(dem1_disk_image_view, dem1_nodata), crop_box) - dem2_trans;
+
+  // Accumulate the statistics while writing the differences
+  const double stats_bin_size = 0.001; // in meters
+  boost::shared_ptr<DiffStats> stats(new DiffStats(stats_bin_size));
+  ImageViewRef<double> difference
+    = apply_mask(DiffStatsView(masked_diff, stats), opt.nodata_value);
+
   GeoReference crop_georef = crop(dem1_georef, crop_box);
-    
+
   std::string output_file = opt.output_prefix + "-diff.tif";
   vw_out() << "Writing difference file: " << output_file << "\n";
-    
+
   if (opt.use_float) {
     ImageViewRef<float> difference_float = channel_cast<float>(difference);
     boost::scoped_ptr<DiskImageResourceGDAL>
@@ -210,6 +385,8 @@ void dem2dem_diff(Options& opt){
     block_write_image(*rsrc, difference,
                       TerminalProgressCallback("asp", "\t--> Differencing: "));
   }
+
+  stats->print();
 }
 
 // From a DEM, subtract a csv file. Reverse the sign is 'reverse' is true.
@@ -233,7 +410,7 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
       opt.nodata_value = dem_nodata;
       vw_out() << "\tFound input nodata value for DEM: " << dem_nodata << endl;
     }
-    
+
     if (dem_rsrc.channels() != 1)
       vw_throw(ArgumentErr() << "The input DEM must have a single channel.\n");
   }
@@ -272,10 +449,39 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
     csv_llh.push_back(llh);
   }
 
-  // We will interpolate into the DEM to find the difference
-  ImageViewRef<PixelMask<double>> interp_dem
-    = interpolate(create_mask(dem, dem_nodata),
-		  BilinearInterpolation(), ConstantEdgeExtension());
+  // The pixels of the points in the DEM. Those out of range are
+  // skipped.
+  std::vector<Vector2> csv_pix(csv_llh.size());
+  std::vector<bool> in_range(csv_llh.size(), false);
+  for (size_t it = 0; it < csv_llh.size(); it++) {
+    Vector2 pix = dem_georef.lonlat_to_pixel(subvector(csv_llh[it], 0, 2));
+    csv_pix[it] = pix;
+    in_range[it] = (pix[0] >= 0 && pix[0] <= dem.cols() - 1 &&
+                    pix[1] >= 0 && pix[1] <= dem.rows() - 1);
+  }
+
+  // Group the points by the DEM block they are in, and interpolate
+  // into the DEM in parallel, one block at a time, reading each block once.
+  const int block_size = 256;
+  std::map<std::pair<int, int>, std::vector<size_t>> block_ids;
+  for (size_t it = 0; it < csv_pix.size(); it++) {
+    if (in_range[it])
+      block_ids[std::make_pair(int(csv_pix[it][0]) / block_size,
+                               int(csv_pix[it][1]) / block_size)].push_back(it);
+  }
+  std::vector<PixelMask<double>> dem_heights(csv_llh.size()); // invalid by default
+  {
+    ImageViewRef<PixelMask<double>> masked_dem = create_mask(dem, dem_nodata);
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (auto it = block_ids.begin(); it != block_ids.end(); it++) {
+      BBox2i box(it->first.first * block_size, it->first.second * block_size,
+                 block_size, block_size);
+      boost::shared_ptr<DemLookupTask>
+        task(new DemLookupTask(masked_dem, box, it->second, csv_pix, dem_heights));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
 
   // Save the diffs
   int    count     = 0;
@@ -290,13 +496,8 @@ void dem2csv_diff(Options & opt, std::string const& dem_file,
 
     Vector3 llh = csv_llh[it];
     Vector2 ll  = subvector(llh, 0, 2);
-    Vector2 pix = dem_georef.lonlat_to_pixel(ll);
-    
-    // Check for out of range
-    if (pix[0] < 0 || pix[0] > dem.cols() - 1) continue;
-    if (pix[1] < 0 || pix[1] > dem.rows() - 1) continue;
-    PixelMask<double> dem_ht = interp_dem(pix[0], pix[1]);
-    if (!is_valid(dem_ht))
+    PixelMask<double> dem_ht = dem_heights[it];
+    if (!in_range[it] || !is_valid(dem_ht))
       continue;
 
     double diff = dem_ht.child() - llh[2];
@@ -365,7 +566,7 @@ int main(int argc, char *argv[]) {
       vw_throw(ArgumentErr()
                << "Cannot do the diff of two csv files. One of them "
                << "can be converted to a DEM using point2dem fist.\n");
-    
+
     bool reverse = false; // true if first DEM is a csv
     if (is_dem1_csv) {
       reverse = true;
@@ -18,6 +18,7 @@
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/TileKernelView.h>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -29,30 +30,19 @@ namespace fs = boost::filesystem;
 using namespace vw;
 
 // Functors
-template <class Arg1T, class Arg2T>
-struct ReplaceChannelFunc: public ReturnFixedType<Arg1T> {
-private:
-  int m_channel;
-public:
-  ReplaceChannelFunc( int const& channel ) : m_channel(channel) {}
-
-  inline Arg1T operator()( Arg1T const& arg1,
-                           Arg2T const& arg2 ) const {
-    Arg1T t( arg1 );
-    t[m_channel] = arg2;
-    return t;
+
+// Replace the value channel of an RGB pixel, in the HSV color space,
+// with a gray pixel
+template <class ChannelT>
+struct ReplaceValueFunc: public ReturnFixedType<PixelRGB<ChannelT>> {
+  inline PixelRGB<ChannelT> operator()( PixelRGB<ChannelT>  const& rgb,
+                                        PixelGray<ChannelT> const& gray ) const {
+    PixelHSV<ChannelT> hsv( rgb );
+    hsv[2] = gray[0];
+    return PixelRGB<ChannelT>( hsv );
   }
 };
 
-template <class Image1T, class Image2T>
-inline BinaryPerPixelView<Image1T, Image2T, ReplaceChannelFunc<typename Image1T::pixel_type, typename Image2T::pixel_type> >
-replace_channel( ImageViewBase<Image1T> const& image1,
-                 int const& channel,
-                 ImageViewBase<Image2T> const& image2 ) {
-  typedef ReplaceChannelFunc<typename Image1T::pixel_type, typename Image2T::pixel_type> func_type;
-  return BinaryPerPixelView<Image1T, Image2T, func_type >( image1.impl(), image2.impl(), func_type(channel));
-}
-
 // Standard Arguments
 struct Options : public vw::GdalWriteOptions {
   std::string input_rgb, input_gray;
@@ -67,8 +57,10 @@ void do_merge(Options const& opt) {
   cartography::GeoReference georef;
   cartography::read_georeference(georef, opt.input_rgb);
 
+  // Each tile of both images is read once, then merged
   ImageViewRef<PixelRGB<ChannelT> > result =
-    pixel_cast<PixelRGB<ChannelT> >(replace_channel(pixel_cast<PixelHSV<ChannelT> >(rgb_image),2,shaded_image));
+    asp::tile_kernel_view(asp::per_pixel_kernel(ReplaceValueFunc<ChannelT>()),
+                          rgb_image, shaded_image);
 
   bool has_georef = true;
   bool has_nodata = false;
@@ -38,7 +38,9 @@
 
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
+#include <asp/Core/TileKernelView.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/program_options.hpp>
@@ -123,26 +125,6 @@ void tab(int indent) {
     std::cout << ' ';
 }
 
-// TODO: Are there pixel functions for these?
-template <typename T>
-T manual_min(const std::vector<T> &vec) {
-
-  T minVal = vec[0];
-  for (size_t i=1; i<vec.size(); ++i)
-    if (vec[i] < minVal)
-      minVal = vec[i];
-  return minVal;
-}
-template <typename T>
-T manual_max(const std::vector<T> &vec) {
-
-  T maxVal = vec[0];
-  for (size_t i=1; i<vec.size(); ++i)
-    if (vec[i] > maxVal)
-      maxVal = vec[i];
-  return maxVal;
-}
-
 
 // This type represents an operation performed on one or more inputs.
 struct calc_operation {
@@ -207,55 +189,6 @@ struct calc_operation {
       std::vector<calc_operation> temp = inputs[0].inputs;
       inputs = temp;
     }
-
-
-    /// Apply the operation tree to the input parameters and return a result
-    template <typename T>
-    T applyOperation(const std::vector<T> &params) const {
-      // Get the results from each input node.
-      // - This is a recursive call.
-      const size_t numInputs = inputs.size();
-      std::vector<T> inputResults(numInputs);
-      for (size_t i=0; i<numInputs; ++i)
-        inputResults[i] = inputs[i].applyOperation(params);
-
-      // Now perform the operation for this node
-      switch(opType) {
-        // Unary
-        case OP_number:   return T(value);
-        case OP_variable: if (varName >= static_cast<int>(params.size()))
-          vw_throw(ArgumentErr()
-                   << "Unrecognized variable input. Note that the first variable is var_0.\n");
-          return params[varName];
-        if (numInputs < 1)
-          vw_throw(LogicErr() << "Insufficient inputs for this operation.\n");
-        case OP_negate:   return T(-1 * inputResults[0]);
-        case OP_abs:      return T(std::abs(inputResults[0])); // regular abs casts to integer.
-        case OP_sign:     return T(boost::math::sign(inputResults[0]));
-
-        // Binary
-        if (numInputs < 2)
-          vw_throw(LogicErr() << "Insufficient inputs for this operation.\n");
-        case OP_add:      return (inputResults[0] + inputResults[1]);
-        case OP_subtract: return (inputResults[0] - inputResults[1]);
-        case OP_divide:   return (inputResults[0] / inputResults[1]);
-        case OP_multiply: return (inputResults[0] * inputResults[1]);
-        case OP_power:    return (pow(inputResults[0], inputResults[1]));
-
-        // Multi
-        case OP_min:      return manual_min(inputResults); // TODO: Do these functions exist?
-        case OP_max:      return manual_max(inputResults);
-
-        case OP_lt:   return (inputResults[0] <  inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_gt:   return (inputResults[0] >  inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_lte:  return (inputResults[0] <= inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_gte:  return (inputResults[0] >= inputResults[1]) ? inputResults[2] : inputResults[3];
-        case OP_eq:   return (inputResults[0] == inputResults[1]) ? inputResults[2] : inputResults[3];
-
-        default:
-          vw_throw(LogicErr() << "Unexpected operation type.\n");
-      }
-    }
 };
 
 
@@ -269,6 +202,144 @@ BOOST_FUSION_ADAPT_STRUCT(
     (std::vector<calc_operation>, inputs)
 )
 
+/// The operation tree flattened into a sequence of instructions in
+/// postfix order, which is evaluated for a whole row of pixels at a
+/// time. Each instruction reads its inputs from the top of a stack of
+/// rows and replaces them with its result, so the loops over the
+/// pixels are short and simple, and the tree is walked only once,
+/// when compiling.
+class calc_program {
+public:
+
+  /// Flatten the given tree. The number of variables is used to
+  /// validate the variable names.
+  calc_program(calc_operation const& tree, int num_vars): m_max_depth(0) {
+    int depth = 0;
+    compile(tree, num_vars, depth);
+  }
+
+  /// Evaluate the program for a row of pixels. There must be a row of
+  /// values for each variable. The workspace is resized as needed.
+  void evaluate(std::vector<double const*> const& vars, int len,
+                std::vector<double> & workspace, double * result) const {
+
+    if (len <= 0)
+      return;
+    
+    workspace.resize(size_t(std::max(m_max_depth, 1)) * len);
+    int sp = 0; // the number of rows on the stack
+    for (size_t it = 0; it < m_code.size(); it++) {
+      instruction const& ins = m_code[it];
+      double * a = &workspace[0] + size_t(sp - ins.num_args) * len; // output, first argument
+      switch (ins.op) {
+        case OP_number:
+          for (int i = 0; i < len; i++) a[i] = ins.value;
+          break;
+        case OP_variable:
+          std::copy(vars[ins.var], vars[ins.var] + len, a);
+          break;
+        case OP_negate: for (int i = 0; i < len; i++) a[i] = -1 * a[i];           break;
+        case OP_abs:    for (int i = 0; i < len; i++) a[i] = std::abs(a[i]);      break;
+        case OP_sign:
+          for (int i = 0; i < len; i++) a[i] = boost::math::sign(a[i]);
+          break;
+        default: {
+          double const* b = a + len;
+          double const* c = b + len;
+          double const* d = c + len;
+          switch (ins.op) {
+            case OP_add:      for (int i = 0; i < len; i++) a[i] = a[i] + b[i];      break;
+            case OP_subtract: for (int i = 0; i < len; i++) a[i] = a[i] - b[i];      break;
+            case OP_divide:   for (int i = 0; i < len; i++) a[i] = a[i] / b[i];      break;
+            case OP_multiply: for (int i = 0; i < len; i++) a[i] = a[i] * b[i];      break;
+            case OP_power:    for (int i = 0; i < len; i++) a[i] = pow(a[i], b[i]);  break;
+            case OP_min:
+              for (int arg = 1; arg < ins.num_args; arg++) {
+                double const* v = a + size_t(arg) * len;
+                for (int i = 0; i < len; i++) a[i] = (v[i] < a[i]) ? v[i] : a[i];
+              }
+              break;
+            case OP_max:
+              for (int arg = 1; arg < ins.num_args; arg++) {
+                double const* v = a + size_t(arg) * len;
+                for (int i = 0; i < len; i++) a[i] = (v[i] > a[i]) ? v[i] : a[i];
+              }
+              break;
+            case OP_lt:  for (int i = 0; i < len; i++) a[i] = (a[i] <  b[i]) ? c[i] : d[i]; break;
+            case OP_gt:  for (int i = 0; i < len; i++) a[i] = (a[i] >  b[i]) ? c[i] : d[i]; break;
+            case OP_lte: for (int i = 0; i < len; i++) a[i] = (a[i] <= b[i]) ? c[i] : d[i]; break;
+            case OP_gte: for (int i = 0; i < len; i++) a[i] = (a[i] >= b[i]) ? c[i] : d[i]; break;
+            case OP_eq:  for (int i = 0; i < len; i++) a[i] = (a[i] == b[i]) ? c[i] : d[i]; break;
+            default:
+              vw_throw(LogicErr() << "Unexpected operation type.\n");
+          }
+        }
+      }
+      sp += 1 - ins.num_args;
+    }
+
+    std::copy(&workspace[0], &workspace[0] + len, result);
+  }
+
+private:
+
+  struct instruction {
+    OperationType op;
+    double        value;
+    int           var;
+    int           num_args;
+  };
+
+  // Append the instructions for the given node, after those for its inputs
+  void compile(calc_operation const& node, int num_vars, int & depth) {
+
+    if (node.opType == OP_pass && node.inputs.size() == 1) {
+      compile(node.inputs[0], num_vars, depth);
+      return;
+    }
+
+    instruction ins;
+    ins.op       = node.opType;
+    ins.value    = node.value;
+    ins.var      = node.varName;
+    ins.num_args = node.inputs.size();
+
+    size_t min_args = 0;
+    switch (node.opType) {
+      case OP_number:   break;
+      case OP_variable:
+        if (node.varName < 0 || node.varName >= num_vars)
+          vw_throw(ArgumentErr()
+                   << "Unrecognized variable input. Note that the first variable is var_0.\n");
+        break;
+      case OP_negate: case OP_abs: case OP_sign: min_args = 1; break;
+      case OP_add: case OP_subtract: case OP_divide: case OP_multiply: case OP_power:
+        min_args = 2; break;
+      case OP_min: case OP_max: min_args = 1; break;
+      case OP_lt: case OP_gt: case OP_lte: case OP_gte: case OP_eq: min_args = 4; break;
+      default:
+        vw_throw(LogicErr() << "Unexpected operation type.\n");
+    }
+    if (node.inputs.size() < min_args)
+      vw_throw(LogicErr() << "Insufficient inputs for this operation.\n");
+
+    for (size_t i = 0; i < node.inputs.size(); i++)
+      compile(node.inputs[i], num_vars, depth);
+
+    if (node.opType == OP_number || node.opType == OP_variable) {
+      ins.num_args = 0;
+      depth++;
+    } else {
+      depth -= ins.num_args - 1;
+    }
+    m_max_depth = std::max(m_max_depth, depth);
+    m_code.push_back(ins);
+  }
+
+  std::vector<instruction> m_code;
+  int m_max_depth; // the largest number of rows on the stack
+};
+
 //================================================================================
 // - Boost::Spirit equation parsing
 
@@ -367,138 +438,87 @@ struct calc_grammar : b_s::qi::grammar<ITER, calc_operation(), b_s::ascii::space
 
 }; // End struct calc_grammar
 
-/// Image view class which applies the calc_operation tree to each pixel location.
-template <class ImageT, typename OutputPixelT>
-class ImageCalcView : public ImageViewBase<ImageCalcView<ImageT, OutputPixelT> > {
+/// Kernel applying the calc_operation tree to rows of pixels. This is
+/// used with asp::TileKernelView, which reads the input images.
+template <typename InputPixelT, typename OutputPixelT>
+class ImageCalcKernel {
 
 public: // Definitions
-  typedef typename ImageT::pixel_type  input_pixel_type;
-  typedef OutputPixelT pixel_type;  // This is what controls the type of image that is written to disk.
-  typedef OutputPixelT result_type;
+  typedef OutputPixelT result_type; // This is what controls the type of image that is written to disk.
 
 private: // Variables
-  std::vector<ImageT> m_image_vec;
-  std::vector<bool> m_has_nodata_vec;
+  std::vector<bool>   m_has_nodata_vec;
   std::vector<double> m_nodata_vec; // nodata is always double
   double              m_output_nodata;
-  calc_operation m_operation_tree;
-  int m_num_rows;
-  int m_num_cols;
-  int m_num_channels;
+  calc_program        m_program;
+  int                 m_num_channels;
 
 public: // Functions
 
   // Constructor
-  ImageCalcView(std::vector<ImageT>      & imageVec,
-                std::vector<bool  > const& has_nodata_vec,
-                std::vector<double> const& nodata_vec,
-                double outputNodata,
-                calc_operation const& operation_tree):
-    m_image_vec(imageVec),   m_has_nodata_vec(has_nodata_vec),
+  ImageCalcKernel(std::vector<bool  > const& has_nodata_vec,
+                  std::vector<double> const& nodata_vec,
+                  double outputNodata,
+                  calc_operation const& operation_tree,
+                  int num_channels):
+    m_has_nodata_vec(has_nodata_vec),
     m_nodata_vec(nodata_vec), m_output_nodata(outputNodata),
-    m_operation_tree(operation_tree) {
-    const size_t numImages = imageVec.size();
-    VW_ASSERT((numImages > 0), ArgumentErr()
-              << "ImageCalcView: One or more images required.");
-    VW_ASSERT((has_nodata_vec.size() == numImages),
-              LogicErr() << "ImageCalcView: Incorrect hasNodata count passed in.");
-    VW_ASSERT((nodata_vec.size() == numImages),
-              LogicErr() << "ImageCalcView: Incorrect nodata count passed in.");
-
-    // Make sure all images are the same size
-    m_num_rows     = imageVec[0].rows();
-    m_num_cols     = imageVec[0].cols();
-    m_num_channels = imageVec[0].planes();
-    for (size_t i=1; i<numImages; ++i) {
-      if ( (imageVec[i].rows()   != m_num_rows    ) ||
-           (imageVec[i].cols()   != m_num_cols    ) ||
-           (imageVec[i].planes() != m_num_channels))
-        vw_throw(ArgumentErr()
-                 << "Error: Input images must all have the same size and number of channels.");
-    }
-  }
-
-  inline int32 cols  () const { return m_num_cols; }
-  inline int32 rows  () const { return m_num_rows; }
-  inline int32 planes() const { return m_num_channels; }
-
-  inline result_type operator()( int32 i, int32 j, int32 p=0 ) const
-  {
-    return 0; // NOT IMPLEMENTED.
+    m_program(operation_tree, has_nodata_vec.size()),
+    m_num_channels(num_channels) {
+    VW_ASSERT((nodata_vec.size() == has_nodata_vec.size()),
+              LogicErr() << "ImageCalcKernel: Incorrect nodata count passed in.");
   }
 
-  typedef ProceduralPixelAccessor<ImageCalcView<ImageT, OutputPixelT> > pixel_accessor;
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
-  typedef CropView<ImageView<result_type> > prerasterize_type;
-  inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    //typedef typename PixelChannelType<typename input_pixel_type>::type output_channel_type; // TODO: Why does this not compile?
-    typedef typename ImageChannelType<ImageView<result_type> >::type output_channel_type;
-
-    // Set up the output image tile
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-
-    // TODO: Left to right processing.
-
-    // Set up for pixel calculations
-    const size_t num_images = m_image_vec.size();
-    std::vector<input_pixel_type> input_pixels(num_images);
-    std::vector<double>           input_doubles(num_images);
-
-    // Rasterize all the input images at this particular tile
-    std::vector<ImageView<input_pixel_type> > input_tiles(num_images);
-    for (size_t i=0; i<num_images; ++i)
-      input_tiles[i] = crop(m_image_vec[i], bbox);
-
-    // Loop through each output pixel and compute each output value
-    for (int c = 0; c < bbox.width(); c++) {
-      for (int r = 0; r < bbox.height(); r++) {
-        // Fetch all the input pixels for this location
-        bool isNodata = false;
-        for (size_t i=0; i<num_images; ++i) {
-          input_pixels[i] = (input_tiles[i])(c,r);
-
-          // If any of the input pixels are nodata, the output is nodata.
-          if (m_has_nodata_vec[i] && (m_nodata_vec[i] == input_pixels[i])) {
-            isNodata = true;
-            break;
-          }
-        } // End image loop
-
-        if (isNodata) { // Output is nodata, move on to the next pixel
-          tile(c, r) = m_output_nodata;
-          continue;
+  void operator()(int len, result_type * out,
+                  std::vector<InputPixelT const*> const& rows) const {
+    typedef typename PixelChannelType<result_type>::type output_channel_type;
+
+    const size_t num_images = rows.size();
+    VW_ASSERT((num_images == m_nodata_vec.size()),
+              LogicErr() << "ImageCalcKernel: Incorrect image count passed in.");
+
+    // If any of the input pixels are nodata, the output is nodata.
+    std::vector<char> valid(len);
+    for (int c = 0; c < len; c++) {
+      valid[c] = 1;
+      for (size_t i=0; i<num_images; ++i) {
+        if (m_has_nodata_vec[i] && (m_nodata_vec[i] == rows[i][c])) {
+          valid[c] = 0;
+          break;
         }
+      }
+    }
 
-        for (int chan=0; chan<m_num_channels; ++chan) {
-          for (size_t i=0; i<num_images; ++i) {
-            input_doubles[i] = input_pixels[i][chan];
-          } // End image loop
-
-          // Apply the operation tree to this pixel and store in the output pixel
-          // TODO(oalexan1): Should we round too, if output is int?
-          double newVal = m_operation_tree.applyOperation<double>(input_doubles);
-          tile(c, r, chan) = clamp_and_cast<output_channel_type>(newVal);
-
-        } // End channel loop
-
-      } // End row loop
-    } // End column loop
-
-  // Return the tile we created with fake borders to make it look the
-  // size of the entire output image
-  return prerasterize_type(tile,
-                           -bbox.min().x(), -bbox.min().y(),
-                           cols(), rows() );
+    // Per channel, gather the values of all inputs in the row, and
+    // evaluate the expression for all of them.
+    std::vector<std::vector<double>> input_rows(num_images, std::vector<double>(len));
+    std::vector<double const*> vars(num_images);
+    for (size_t i=0; i<num_images; ++i)
+      vars[i] = &input_rows[i][0];
+    std::vector<double> output_row(len), workspace;
+    for (int chan=0; chan<m_num_channels; ++chan) {
+      for (size_t i=0; i<num_images; ++i) {
+        double * row = &input_rows[i][0];
+        for (int c = 0; c < len; c++)
+          row[c] = rows[i][c][chan];
+      }
 
-  } // End prerasterize function
+      // Apply the operation tree to the row and store in the output pixels
+      // TODO(oalexan1): Should we round too, if output is int?
+      m_program.evaluate(vars, len, workspace, &output_row[0]);
+      for (int c = 0; c < len; c++) {
+        if (valid[c])
+          out[c][chan] = clamp_and_cast<output_channel_type>(output_row[c]);
+      }
+    } // End channel loop
 
- template <class DestT>
- inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
-   vw::rasterize( prerasterize(bbox), dest, bbox );
- }
+    for (int c = 0; c < len; c++) {
+      if (!valid[c]) // Output is nodata
+        out[c] = m_output_nodata;
+    }
+  }
 
-}; // End class ImageCalcView
+}; // End class ImageCalcKernel
 
 struct Options : vw::GdalWriteOptions {
   Options() : out_nodata_value(-1) {}
@@ -622,14 +642,21 @@ void generate_output(const std::string                         & output_file,
   std::map<std::string, std::string> keywords;
   asp::parse_append_metadata(opt.metadata, keywords);
   
+  if (input_images.empty())
+    vw_throw(ArgumentErr() << "Error: One or more images required.");
+  for (size_t i=1; i<input_images.size(); ++i) {
+    if (input_images[i].planes() != input_images[0].planes())
+      vw_throw(ArgumentErr()
+               << "Error: Input images must all have the same size and number of channels.");
+  }
+  ImageCalcKernel<PixelT, OutputT> kernel(has_nodata_vec, nodata_vec,
+                                          opt.out_nodata_value, calc_tree,
+                                          input_images[0].planes());
+  
   vw_out() << "Writing: " << output_file << std::endl;
   vw::cartography::block_write_gdal_image
     (output_file,
-     ImageCalcView<ImageViewRef<PixelT>, OutputT>(input_images,
-                                                  has_nodata_vec,
-                                                  nodata_vec,
-                                                  opt.out_nodata_value,
-                                                  calc_tree),
+     asp::tile_kernel_view(kernel, input_images),
      have_georef, georef,
      opt.has_out_nodata, opt.out_nodata_value,
      opt,
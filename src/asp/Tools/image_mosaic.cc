@@ -32,6 +32,7 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/BBoxIndex.h>
 
 using namespace vw;
 namespace po = boost::program_options;
@@ -211,12 +212,28 @@ Matrix<double> compute_ip_matching(std::string const& image_file1,
   return tf;
 }
 
+/// The bounding box of an image of given size after applying
+///  a 3x3 homogeneous transform to it.
+BBox2i transformed_image_box(Matrix<double> const& tf, Vector2i const& size) {
+  BBox2 box;
+  for (int corner = 0; corner < 4; corner++) {
+    Vector3 p = tf * Vector3((corner % 2) * size[0], (corner / 2) * size[1], 1.0);
+    box.grow(subvector(p, 0, 2) / p[2]);
+  }
+  return grow_bbox_to_int(box);
+}
+
 // TODO: Pass in image ref instead of paths?
 /// Compute the transform from image1 to image2
 ///  (the top left corner of image1 is (0,0))
+/// If a predicted transform is given, such as the one for the previous
+///  pair, look for IP only where the images are then expected to overlap,
+///  with some margin.
 Matrix<double> compute_relative_transform(std::string const& image1,
                                           std::string const& image2,
-                                          Options const& opt) {
+                                          Options const& opt,
+                                          Matrix<double> const& predicted_transform
+                                          = Matrix<double>()) {
 
   Vector2i size1 = file_image_size(image1);
   Vector2i size2 = file_image_size(image2);
@@ -234,6 +251,24 @@ Matrix<double> compute_relative_transform(std::string const& image1,
   if (roi1.empty() || roi2.empty())
     vw_throw( ArgumentErr() << "Unrecognized image orientation!");
 
+  // How much the actual overlap may differ from the predicted one
+  const int PREDICTION_MARGIN = 200;
+  if (predicted_transform.rows() == 3 && predicted_transform.cols() == 3) {
+    // The transform takes pixels in image2 to image1
+    BBox2i pred1 = transformed_image_box(predicted_transform, size2);
+    BBox2i pred2 = transformed_image_box(inverse(predicted_transform), size1);
+    pred1.expand(PREDICTION_MARGIN);
+    pred2.expand(PREDICTION_MARGIN);
+    pred1.crop(roi1);
+    pred2.crop(roi2);
+    if (!pred1.empty() && !pred2.empty()) {
+      roi1 = pred1;
+      roi2 = pred2;
+      vw_out() << "Searching for interest points in the predicted overlap regions "
+               << roi1 << " and " << roi2 << ".\n";
+    }
+  }
+
   Matrix<double> tf = compute_ip_matching(image1, image2, roi1, roi2, opt);
   return tf;
 
@@ -273,11 +308,18 @@ void compute_all_image_positions(Options const& opt,
   // This approach only works for serial pairs, if we add another type of
   //  orientation it will need to be changed.
   Matrix<double> last_transform = identity_matrix(3);
+
+  // Consecutive images are expected to be placed similarly relative
+  // to each other, so the previous relative transform predicts where
+  // the next pair overlaps.
+  Matrix<double> last_relative_transform;
   
   for (size_t i=1; i<num_images; ++i) {
 
     Matrix<double> relative_transform = 
-        compute_relative_transform(opt.image_files[i-1], opt.image_files[i], opt);
+      compute_relative_transform(opt.image_files[i-1], opt.image_files[i], opt,
+                                 last_relative_transform);
+    last_relative_transform = relative_transform;
 
     image_size = file_image_size(opt.image_files[i]);
 
@@ -342,25 +384,30 @@ void compute_all_image_positions(Options const& opt,
 
 
 /// A class to mosaic and rescale images using bilinear interpolation.
+/// Each tile opens only the input images whose boxes, found with
+/// the spatial index, intersect it, so the memory use and the number
+/// of open files do not grow with the number of images.
 template <class T>
 class ImageMosaicView: public ImageViewBase<ImageMosaicView<T> >{
 private:
-  std::vector<ImageViewRef<T> > const& m_images;
+  Options                              const& m_opt;
   std::vector<boost::shared_ptr<vw::Transform> > const& m_transforms;
-  std::vector<BBox2i>          const& m_bboxes;
+  std::vector<BBox2i>                  const& m_bboxes;
+  asp::BBoxIndex                       const& m_index; // of m_bboxes
   int            m_blend_radius;
   Vector2i const m_output_image_size;
   double         m_output_nodata_value;
 
 public:
-  ImageMosaicView(std::vector<ImageViewRef<T> > const& images,
+  ImageMosaicView(Options const& opt,
                   std::vector<boost::shared_ptr<vw::Transform> > const& transforms,
                   std::vector<BBox2i>          const& bboxes,
+                  asp::BBoxIndex               const& index,
                   int      blend_radius,
                   Vector2i output_image_size, 
                   double   output_nodata_value):
-    m_images(images), m_transforms(transforms),
-    m_bboxes(bboxes), m_blend_radius(blend_radius),
+    m_opt(opt), m_transforms(transforms),
+    m_bboxes(bboxes), m_index(index), m_blend_radius(blend_radius),
     m_output_image_size(output_image_size),
     m_output_nodata_value(output_nodata_value){}
 
@@ -390,20 +437,22 @@ public:
 
     // Loop through the intersecting input images and paste them in
     //  to the output image.
-    for (size_t i=0; i<m_images.size(); ++i) {
+    std::vector<int> image_ids;
+    m_index.query(bbox, image_ids);
+    for (size_t id_iter = 0; id_iter < image_ids.size(); id_iter++) {
 
-      //std::cout << "i = " << i << std::endl;
-      //std::cout << "bbox = " << bbox << std::endl;
-      //std::cout << "m_bboxes[i] = " << m_bboxes[i] << std::endl;
-
-      // Get the intersection (if any) of this image with the current bbox.
-      if (!m_bboxes[i].intersects(bbox)) {
-        //std::cout << "Skipping\n";
-        continue;
-      }
+      int i = image_ids[id_iter];
+      
+      // Get the intersection of this image with the current bbox.
       BBox2i intersect = m_bboxes[i];
       intersect.crop(bbox);
 
+      // Open the image, applying a nodata mask
+      ImageViewRef<float> disk_image;
+      double nodata;
+      get_input_image(m_opt.image_files[i], m_opt, disk_image, nodata);
+      ImageViewRef<T> image = create_mask_less_or_equal(disk_image, nodata);
+
       typedef ImageView<T> ImageT;
       typedef InterpolationView<ImageT, BilinearInterpolation> InterpT;
       
@@ -412,7 +461,7 @@ public:
       BBox2i temp_bbox = m_transforms[i]->reverse_bbox(intersect);
       temp_bbox.expand(BilinearInterpolation::pixel_buffer);
       BBox2i input_bbox = temp_bbox;
-      input_bbox.crop(bounding_box(m_images[i]));
+      input_bbox.crop(bounding_box(image));
       
       BBox2i tile_bbox = intersect - bbox.min(); // ROI of this input in the output tile
 
@@ -432,7 +481,7 @@ public:
       expanded_intersect.expand(m_blend_radius);
       
       // Get the cropped piece of the transformed input image that we need
-      ImageView<T> trans_input = crop(transform(m_images[i], *temp,
+      ImageView<T> trans_input = crop(transform(image, *temp,
                                                 ZeroEdgeExtension(),
                                                 BilinearInterpolation()),
                                       expanded_intersect);
@@ -680,17 +729,15 @@ int main( int argc, char *argv[] ) {
     Vector2i                     output_image_size;
     compute_all_image_positions(opt, transforms, bboxes, output_image_size);
 
+    // The images are opened only when the output tiles that need them
+    // are made. Index their boxes in the output image for that.
+    int cell_size = std::max(1024, 2*opt.blend_radius);
+    asp::BBoxIndex index(bboxes, cell_size);
+
     // TODO: Handle nodata!
-    // Get handles to all of the input images.
-    size_t num_images = opt.image_files.size();
-    std::vector<ImageViewRef<PixelMask<float> > > images(num_images);
+    ImageViewRef<float> temp;
     double nodata;
-    for (size_t i=0; i<num_images; ++i) {
-      // Apply a nodata mask here.
-      ImageViewRef<float> temp;
-      get_input_image(opt.image_files[i], opt, temp, nodata);
-      images[i] = create_mask_less_or_equal(temp, nodata);
-    }
+    get_input_image(opt.image_files.back(), opt, temp, nodata);
 
     // If nodata was not provided, take one from the input images.
     double output_nodata_value = nodata;
@@ -701,7 +748,7 @@ int main( int argc, char *argv[] ) {
     vw_out() << "Writing: " << opt.output_image << std::endl;
     TerminalProgressCallback tpc("asp", "\t    Mosaic:");
     ImageViewRef<float> out_img = 
-        ImageMosaicView< PixelMask<float> >(images, transforms, bboxes,
+        ImageMosaicView< PixelMask<float> >(opt, transforms, bboxes, index,
                                            opt.blend_radius, output_image_size,
                                            opt.output_nodata_value);
 
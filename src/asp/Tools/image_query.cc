@@ -0,0 +1,123 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file image_query.cc
+///
+/// Print the size, bands, data type, nodata value, and georeference of
+/// many images in one call. Used by the Python tools, which otherwise
+/// would start gdalinfo for each image. For each image the output is:
+///
+///   image,<file>
+///   valid,<0 or 1>
+///   size,<cols>,<rows>
+///   bands,<number of bands>
+///   channel_type,<type>
+///   nodata,<value>               (if present)
+///   georef,<0 or 1>
+///   proj4,<string>               (if georeferenced)
+///   transform,<6 values>         (if georeferenced, row by row)
+///
+/// An image which cannot be read is printed with valid set to 0 and no
+/// other values, and the tool still succeeds.
+
+#include <asp/Core/Common.h>
+#include <asp/Core/Macros.h>
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/Image/PixelTypeInfo.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <iostream>
+#include <sstream>
+
+namespace po = boost::program_options;
+
+using namespace vw;
+
+struct Options: vw::GdalWriteOptions {
+  std::vector<std::string> image_files;
+};
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+  po::options_description general_options("");
+
+  po::options_description positional("");
+  positional.add_options()
+    ("image-files", po::value(&opt.image_files));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("image-files", -1);
+
+  std::string usage("<images>");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (opt.image_files.empty())
+    vw_throw(ArgumentErr() << "No input images were specified.\n" << usage << general_options);
+}
+
+// Print what is known about one image. Collect the output first, so
+// that nothing but the valid flag is printed for an image which fails
+// to be read part way.
+void query_image(std::string const& image_file) {
+
+  std::ostringstream os;
+  os.precision(17);
+  try {
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(image_file));
+    os << "size," << rsrc->cols() << "," << rsrc->rows() << "\n";
+    os << "bands," << rsrc->planes() * rsrc->channels() << "\n";
+    os << "channel_type," << channel_type_name(rsrc->channel_type()) << "\n";
+    if (rsrc->has_nodata_read())
+      os << "nodata," << rsrc->nodata_read() << "\n";
+
+    cartography::GeoReference georef;
+    bool has_georef = cartography::read_georeference(georef, image_file);
+    os << "georef," << has_georef << "\n";
+    if (has_georef) {
+      os << "proj4," << georef.overall_proj4_str() << "\n";
+      Matrix3x3 T = georef.transform();
+      os << "transform," << T(0, 0) << "," << T(0, 1) << "," << T(0, 2) << ","
+         << T(1, 0) << "," << T(1, 1) << "," << T(1, 2) << "\n";
+    }
+  } catch (...) {
+    std::cout << "image," << image_file << "\n" << "valid,0\n";
+    return;
+  }
+
+  std::cout << "image," << image_file << "\n" << "valid,1\n" << os.str();
+}
+
+int main(int argc, char *argv[]) {
+
+  Options opt;
+  try {
+    handle_arguments(argc, argv, opt);
+    for (size_t it = 0; it < opt.image_files.size(); it++)
+      query_image(opt.image_files[it]);
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
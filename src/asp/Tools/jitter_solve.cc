@@ -34,6 +34,7 @@
 #include <vw/BundleAdjustment/ControlNetwork.h>
 #include <vw/BundleAdjustment/ControlNetworkLoader.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Cartography/CameraBBox.h>
 
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -44,6 +45,7 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Core/IpMatchingAlgs.h> // Lightweight header for matching algorithms
+#include <asp/Tools/profiled_cost_function.h>
 
 #include <usgscsm/UsgsAstroLsSensorModel.h>
 #include <usgscsm/Utilities.h>
@@ -53,6 +55,10 @@
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
 
+#include <atomic>
+#include <map>
+#include <sstream>
+
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
@@ -68,6 +74,30 @@ const int PIXEL_SIZE      = 2;
 
 const double g_big_pixel_value = 1000.0;  // don't make this too big
 
+// The cost function below changes some quaternions and positions of a
+// linescan model. Instead of copying the model for each evaluation,
+// each thread copies each model once, and puts back the original
+// values after use. This counter must be bumped when the models are
+// changed outside the cost functions, such as by the solver, so that
+// the copies are made again.
+std::atomic<int> g_ls_model_generation(0);
+
+UsgsAstroLsSensorModel & thread_ls_model(UsgsAstroLsSensorModel const* ls_model) {
+  struct ModelCopy {
+    int generation;
+    boost::shared_ptr<UsgsAstroLsSensorModel> model;
+  };
+  thread_local std::map<UsgsAstroLsSensorModel const*, ModelCopy> copies;
+
+  ModelCopy & copy = copies[ls_model];
+  int generation = g_ls_model_generation;
+  if (copy.model.get() == NULL || copy.generation != generation) {
+    copy.model.reset(new UsgsAstroLsSensorModel(*ls_model));
+    copy.generation = generation;
+  }
+  return *copy.model;
+}
+
 // An error function minimizing the error of projecting an xyz point
 // into a given camera pixel. The variables of optimization are a
 // portion of the position and quaternion variables affected by this.
@@ -84,10 +114,11 @@ struct pixelReprojectionError {
   // Call to work with ceres::DynamicCostFunction.
   bool operator()(double const * const * parameters, double * residuals) const {
 
+    // This thread's copy of the model, as we will update quaternion and position
+    // values that are being modified now
+    UsgsAstroLsSensorModel & cam = thread_ls_model(m_ls_model);
+
     try {
-      // Make a copy of the model, as we will update quaternion and position values
-      // that are being modified now. This may be expensive.
-      UsgsAstroLsSensorModel cam = *m_ls_model;
 
       // Update the relevant quaternions in the local copy
       int shift = 0;
@@ -131,8 +162,15 @@ struct pixelReprojectionError {
     } catch (std::exception const& e) {
       residuals[0] = g_big_pixel_value;
       residuals[1] = g_big_pixel_value;
-      return true; // accept the solution anyway
+      // accept the solution anyway
     }
+
+    // Put back the original values, so the copy can be used by the next evaluation
+    for (int qi = NUM_QUAT_PARAMS * m_begQuatIndex; qi < NUM_QUAT_PARAMS * m_endQuatIndex; qi++)
+      cam.m_quaternions[qi] = m_ls_model->m_quaternions[qi];
+    for (int pi = NUM_XYZ_PARAMS * m_begPosIndex; pi < NUM_XYZ_PARAMS * m_endPosIndex; pi++)
+      cam.m_positions[pi] = m_ls_model->m_positions[pi];
+    
     return true;
   }
 
@@ -294,6 +332,8 @@ struct Options: public asp::BaBaseOptions {
   double quat_norm_weight, anchor_weight;
   std::string anchor_dem;
   int num_anchor_points_extra_lines;
+  int num_windows;
+  double window_overlap, solver_memory_budget_mb;
 };
     
 void handle_arguments(int argc, char *argv[], Options& opt) {
@@ -347,6 +387,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Stop when the relative error in the variables being optimized is less than this.")
     ("num-iterations",       po::value(&opt.num_iterations)->default_value(500),
      "Set the maximum number of iterations.")
+    ("profile-cost-functions", po::bool_switch(&opt.profile_cost_functions)->default_value(false)->implicit_value(true),
+     "Count the evaluations of each type of cost function and their run time, and save that, with the solver timings, to <output prefix>-cost-profile.json.")
     ("tri-weight", po::value(&opt.tri_weight)->default_value(0.0),
      "The weight to give to the constraint that optimized triangulated "
      "points stay close to original triangulated points. A positive "
@@ -410,7 +452,21 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("quat-norm-weight", po::value(&opt.quat_norm_weight)->default_value(1.0),
      "How much weight to give to the constraint that the norm of each quaternion must be 1.")
     ("ip-side-filter-percent",  po::value(&opt.ip_edge_buffer_percent)->default_value(-1.0),
-     "Remove matched IPs this percentage from the image left/right sides.");
+     "Remove matched IPs this percentage from the image left/right sides.")
+    ("num-windows", po::value(&opt.num_windows)->default_value(1),
+     "Split the lines of each image into this many overlapping windows, optimize "
+     "each window on its own, and blend the results. This uses much less memory "
+     "for very long images. The default is to optimize all at once.")
+    ("window-overlap", po::value(&opt.window_overlap)->default_value(0.25),
+     "With --num-windows, extend each window on each side by this fraction of its "
+     "length. The results are blended in the overlap.")
+    ("solver-memory-budget-mb", po::value(&opt.solver_memory_budget_mb)->default_value(0.0),
+     "If positive, use as many windows as needed so that the solver is estimated "
+     "to use no more than this much memory, in MB. The estimate is rough.")
+    ("camera-cache-dir", po::value(&opt.camera_cache_dir)->default_value(""),
+     "Save in this directory, in binary, what is parsed from Pleiades and SPOT5 XML "
+     "camera files, and reuse it in later runs, as long as the camera file contents "
+     "are the same.");
   
     general_options.add(vw::GdalWriteOptionsDescription(opt));
 
@@ -443,6 +499,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   // Set this before loading cameras, as jitter for DG can be modeled only with CSM
   // cameras.
   asp::stereo_settings().dg_use_csm = true;
+  asp::stereo_settings().camera_cache_dir = opt.camera_cache_dir;
   
   std::vector<std::string> inputs = opt.image_files;
   bool ensure_equal_sizes = true;
@@ -516,6 +573,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 
   if (opt.anchor_weight > 0 && opt.anchor_dem.empty()) 
     vw::vw_throw(vw::ArgumentErr() << "If --anchor-weight is positive, set --anchor-dem.\n");
+
+  if (opt.num_windows < 1)
+    vw::vw_throw(vw::ArgumentErr() << "The number of windows must be positive.\n");
+
+  if (opt.window_overlap < 0 || opt.window_overlap > 1.0)
+    vw::vw_throw(vw::ArgumentErr() << "The window overlap must be between 0 and 1.\n");
+
+  if (opt.solver_memory_budget_mb < 0)
+    vw::vw_throw(vw::ArgumentErr() << "The solver memory budget must be non-negative.\n");
   
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
@@ -875,14 +941,15 @@ void calcFirstLastOrientationLines(UsgsAstroLsSensorModel const* ls_model,
 
 // The provided tabulated positions, velocities and quaternions may be too few,
 // so resample them with --num-lines-per-position and --num-lines-per-orientation,
-// if those are set.
-void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
+// if those are set. The messages go to the given stream, so that several
+// models can be resampled in parallel without mixing them up.
+void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model, std::ostream & os) {
   
   // The positions and quaternions can go way beyond the valid range of image lines,
   // so need to estimate how many of them are within the range.
   
   int numLines = ls_model->m_nLines;
-  vw_out() << "Number of lines: " << numLines << "\n";
+  os << "Number of lines: " << numLines << "\n";
 
   double first_line_time = -1.0, last_line_time = -1.0, elapsed_time = -1.0, dt_per_line = -1.0;
   calcTimes(ls_model, first_line_time, last_line_time, elapsed_time,  
@@ -891,20 +958,20 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
   // Line index of first and last tabulated position
   double beg_position_line = -1.0, end_position_line = -1.0;
   calcFirstLastPositionLines(ls_model, beg_position_line, end_position_line);
-  vw_out() << std::setprecision (17) << "Line of first and last tabulated position: "
+  os << std::setprecision (17) << "Line of first and last tabulated position: "
            << beg_position_line << ' ' << end_position_line << "\n";
 
   // Line index of first and last tabulated orientation
   double beg_orientation_line = -1.0, end_orientation_line = -1.0;
   calcFirstLastOrientationLines(ls_model, beg_orientation_line, end_orientation_line);
-  vw_out() << std::setprecision (17) << "Line of first and last tabulated orientation: "
+  os << std::setprecision (17) << "Line of first and last tabulated orientation: "
            << beg_orientation_line << ' ' << end_orientation_line << "\n";
 
   double numInputLinesPerPosition = (numLines - 1) * ls_model->m_dtEphem / elapsed_time;
   double numInputLinesPerOrientation = (numLines - 1) * ls_model->m_dtQuat / elapsed_time;
-  vw_out() << "Number of image lines per input position: "
+  os << "Number of image lines per input position: "
            << round(numInputLinesPerPosition) << "\n";
-  vw_out() << "Number of image lines per input orientation: "
+  os << "Number of image lines per input orientation: "
            << round(numInputLinesPerOrientation) << "\n";
 
   if (opt.num_lines_per_position > 0) {
@@ -920,7 +987,7 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
     posFactor = double(numNewMeas - 1.0) / double(numOldMeas - 1.0);
     double currDtEphem = ls_model->m_dtEphem / posFactor;
     double numLinesPerPosition = (numLines - 1.0) * currDtEphem / elapsed_time;
-    vw_out() << "Resampled number of lines per position: "
+    os << "Resampled number of lines per position: "
              << numLinesPerPosition << "\n";
     std::vector<double> positions(NUM_XYZ_PARAMS * numNewMeas, 0);
     std::vector<double> velocities(NUM_XYZ_PARAMS * numNewMeas, 0);
@@ -958,7 +1025,7 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
     posFactor = double(numNewMeas - 1.0) / double(numOldMeas - 1.0);
     double currDtQuat = ls_model->m_dtQuat / posFactor;
     double numLinesPerOrientation = (numLines - 1.0) * currDtQuat / elapsed_time;
-    vw_out() << "Resampled number of lines per orientation: "
+    os << "Resampled number of lines per orientation: "
              << numLinesPerOrientation << "\n";
     std::vector<double> quaternions(NUM_QUAT_PARAMS * numNewMeas, 0);
     for (int ipos = 0; ipos < numNewMeas; ipos++) {
@@ -983,6 +1050,31 @@ void resampleModel(Options const& opt, UsgsAstroLsSensorModel * ls_model) {
   return;
 }
 
+// Normalize the quaternions and resample a model. Each model is
+// changed only by its own task.
+class PrepareModelTask: public vw::Task, private boost::noncopyable {
+  Options const& m_opt;
+  UsgsAstroLsSensorModel * m_ls_model;
+  std::ostringstream & m_os;
+public:
+  PrepareModelTask(Options const& opt, UsgsAstroLsSensorModel * ls_model,
+                   std::ostringstream & os):
+    m_opt(opt), m_ls_model(ls_model), m_os(os) {}
+
+  void operator()() {
+    // Normalize quaternions. Later, the quaternions being optimized will
+    // be kept close to being normalized.  This makes it easy to ensure
+    // that quaternion interpolation gives good results, especially that
+    // some quaternions may get optimized and some not.
+    normalizeQuaternions(m_ls_model);
+
+    // The provided tabulated positions, velocities and quaternions may be too few,
+    // so resample them with --num-lines-per-position and --num-lines-per-orientation,
+    // if those are set.
+    resampleModel(m_opt, m_ls_model, m_os);
+  }
+};
+
 // Calculate a set of anchor points uniformly distributed over the image
 // Will use opt.num_anchor_points_extra_lines.
 void calcAnchorPoints(Options                              const & opt,
@@ -1071,6 +1163,16 @@ void calcAnchorPoints(Options                              const & opt,
   }   
 }
 
+// The fraction of the way from the first to the last image line. Clamp it
+// to [0, 1], so that what is just outside the image is in the first or last window.
+double lineFraction(double line, int numLines) {
+  if (numLines <= 1)
+    return 0.0;
+  return std::min(1.0, std::max(0.0, line / (numLines - 1.0)));
+}
+
+// Add the reprojection errors for the pixels whose line fraction is in
+// [beg_frac, end_frac]. Use beg_frac = 0 and end_frac = 1 for all pixels.
 void addReprojectionErrors
 (Options                                              const & opt,
  vw::ba::CameraRelationNetwork<vw::ba::JFeature>      const & crn,
@@ -1080,6 +1182,7 @@ void addReprojectionErrors
  std::vector<std::vector<double>>                     const & weight_vec,
  std::vector<std::vector<int>>                        const & isAnchor_vec,
  std::vector<UsgsAstroLsSensorModel*>                 const & ls_models,
+ double beg_frac, double end_frac,
  // Outputs
  std::vector<double>                                        & weight_per_residual, // append
  ceres::Problem                                             & problem) {
@@ -1099,6 +1202,10 @@ void addReprojectionErrors
         // Pass 0 is without anchor points, while pass 1 uses them
         if ((int)isAnchor != pass) 
           continue;
+
+        double frac = lineFraction(observation.y(), ls_models[icam]->m_nLines);
+        if (frac < beg_frac || frac > end_frac)
+          continue;
         
         // Must grow the number of quaternions and positions a bit
         // because during optimization the 3D point and corresponding
@@ -1160,7 +1267,8 @@ void addReprojectionErrors
         for (int it = begPosIndex; it < endPosIndex; it++)
           vars.push_back(&ls_models[icam]->m_positions[it * NUM_XYZ_PARAMS]);
         vars.push_back(tri_point);
-        problem.AddResidualBlock(pixel_cost_function, pixel_loss_function, vars);
+        problem.AddResidualBlock(asp::profile_cost(pixel_cost_function, "pixelReprojectionError"),
+                                 pixel_loss_function, vars);
 
         for (int c = 0; c < PIXEL_SIZE; c++)
           weight_per_residual.push_back(weight);
@@ -1174,7 +1282,8 @@ void addReprojectionErrors
   }
 }
 
-// Add the constraint based on DEM
+// Add the constraint based on DEM. With skip_unused, add it only for
+// points already in the problem.
 void addDemConstraint
 (Options                                              const& opt,
  std::vector<std::vector<boost::shared_ptr<Vector3>>> const& xyz_vec,
@@ -1182,6 +1291,7 @@ void addDemConstraint
  std::vector<vw::Vector3>                             const& dem_xyz_vec,
  std::set<int>                                        const& outliers,
  vw::ba::ControlNetwork                               const& cnet,
+ bool                                                        skip_unused,
  // Outputs
  std::vector<double>                                       & tri_points_vec,
  std::vector<double>                                       & weight_per_residual, // append
@@ -1219,9 +1329,12 @@ void addDemConstraint
     ceres::CostFunction* xyz_cost_function = weightedXyzError::Create(observation, xyz_weight);
     ceres::LossFunction* xyz_loss_function = new ceres::CauchyLoss(xyz_threshold);
     double * tri_point = &tri_points_vec[0] + ipt * NUM_XYZ_PARAMS;
+    if (skip_unused && !problem.HasParameterBlock(tri_point))
+      continue; // not seen in this window
 
     // Add cost function
-    problem.AddResidualBlock(xyz_cost_function, xyz_loss_function, tri_point);
+    problem.AddResidualBlock(asp::profile_cost(xyz_cost_function, "weightedXyzError"),
+                             xyz_loss_function, tri_point);
 
     for (int c = 0; c < NUM_XYZ_PARAMS; c++)
       weight_per_residual.push_back(xyz_weight);
@@ -1229,11 +1342,13 @@ void addDemConstraint
 }
 
 // Add the constraint to keep triangulated points close to initial values
-// This does not need a DEM or alignment
+// This does not need a DEM or alignment. With skip_unused, add it only for
+// points already in the problem.
 void addTriConstraint
 (Options                                              const& opt,
  std::set<int>                                        const& outliers,
  vw::ba::ControlNetwork                               const& cnet,
+ bool                                                        skip_unused,
  // Outputs
  std::vector<double>                                       & tri_points_vec,
  std::vector<double>                                       & weight_per_residual, // append
@@ -1249,13 +1364,16 @@ void addTriConstraint
       continue; // skip outliers
       
     double * tri_point = &tri_points_vec[0] + ipt * NUM_XYZ_PARAMS;
+    if (skip_unused && !problem.HasParameterBlock(tri_point))
+      continue; // not seen in this window
       
     // Use as constraint the initially triangulated point
     vw::Vector3 observation(tri_point[0], tri_point[1], tri_point[2]);
 
     ceres::CostFunction* cost_function = weightedXyzError::Create(observation, opt.tri_weight);
     ceres::LossFunction* loss_function = new ceres::CauchyLoss(opt.tri_robust_threshold);
-    problem.AddResidualBlock(cost_function, loss_function, tri_point);
+    problem.AddResidualBlock(asp::profile_cost(cost_function, "weightedXyzError"),
+                             loss_function, tri_point);
     
     for (int c = 0; c < NUM_XYZ_PARAMS; c++)
       weight_per_residual.push_back(opt.tri_weight);
@@ -1263,11 +1381,14 @@ void addTriConstraint
   } // End loop through xyz
 }
 
+// With skip_unused, constrain only the quaternions and positions already in
+// the problem.
 void addQuatNormRotationTranslationConstraints
 (Options                                              const& opt,
  std::set<int>                                        const& outliers,
  vw::ba::CameraRelationNetwork<vw::ba::JFeature>      const & crn,
  std::vector<UsgsAstroLsSensorModel*>                 const & ls_models,
+ bool                                                        skip_unused,
  // Outputs
  std::vector<double>                                       & tri_points_vec,
  std::vector<double>                                       & weight_per_residual, // append
@@ -1278,12 +1399,17 @@ void addQuatNormRotationTranslationConstraints
     for (int icam = 0; icam < (int)crn.size(); icam++) {
       int numQuat = ls_models[icam]->m_quaternions.size() / NUM_QUAT_PARAMS;
       for (int iq = 0; iq < numQuat; iq++) {
+        if (skip_unused &&
+            !problem.HasParameterBlock(&ls_models[icam]->m_quaternions[iq * NUM_QUAT_PARAMS]))
+          continue;
         ceres::CostFunction* rotation_cost_function
           = weightedRotationError::Create(&ls_models[icam]->m_quaternions[iq * NUM_QUAT_PARAMS],
                                           opt.rotation_weight);
         // We use no loss function, as the quaternions have no outliers
         ceres::LossFunction* rotation_loss_function = NULL;
-        problem.AddResidualBlock(rotation_cost_function, rotation_loss_function,
+        problem.AddResidualBlock(asp::profile_cost(rotation_cost_function,
+                                                   "weightedRotationError"),
+                                 rotation_loss_function,
                                  &ls_models[icam]->m_quaternions[iq * NUM_QUAT_PARAMS]);
         
         for (int c = 0; c < NUM_QUAT_PARAMS; c++)
@@ -1297,12 +1423,17 @@ void addQuatNormRotationTranslationConstraints
     for (int icam = 0; icam < (int)crn.size(); icam++) {
       int numPos = ls_models[icam]->m_positions.size() / NUM_XYZ_PARAMS;
       for (int ip = 0; ip < numPos; ip++) {
+        if (skip_unused &&
+            !problem.HasParameterBlock(&ls_models[icam]->m_positions[ip * NUM_XYZ_PARAMS]))
+          continue;
         ceres::CostFunction* translation_cost_function
           = weightedTranslationError::Create(&ls_models[icam]->m_positions[ip * NUM_XYZ_PARAMS],
                                           opt.translation_weight);
         // We use no loss function, as the positions have no outliers
         ceres::LossFunction* translation_loss_function = NULL;
-        problem.AddResidualBlock(translation_cost_function, translation_loss_function,
+        problem.AddResidualBlock(asp::profile_cost(translation_cost_function,
+                                                   "weightedTranslationError"),
+                                 translation_loss_function,
                                  &ls_models[icam]->m_positions[ip * NUM_XYZ_PARAMS]);
         
         for (int c = 0; c < NUM_XYZ_PARAMS; c++)
@@ -1316,11 +1447,16 @@ void addQuatNormRotationTranslationConstraints
     for (int icam = 0; icam < (int)crn.size(); icam++) {
       int numQuat = ls_models[icam]->m_quaternions.size() / NUM_QUAT_PARAMS;
       for (int iq = 0; iq < numQuat; iq++) {
+        if (skip_unused &&
+            !problem.HasParameterBlock(&ls_models[icam]->m_quaternions[iq * NUM_QUAT_PARAMS]))
+          continue;
         ceres::CostFunction* quat_norm_cost_function
           = weightedQuatNormError::Create(opt.quat_norm_weight);
         // We use no loss function, as the quaternions have no outliers
         ceres::LossFunction* quat_norm_loss_function = NULL;
-        problem.AddResidualBlock(quat_norm_cost_function, quat_norm_loss_function,
+        problem.AddResidualBlock(asp::profile_cost(quat_norm_cost_function,
+                                                   "weightedQuatNormError"),
+                                 quat_norm_loss_function,
                                  &ls_models[icam]->m_quaternions[iq * NUM_QUAT_PARAMS]);
         
         weight_per_residual.push_back(opt.quat_norm_weight); // 1 single residual
@@ -1328,12 +1464,301 @@ void addQuatNormRotationTranslationConstraints
     }
   }
 }
+
+// Add all the residuals. Only the reprojection errors for the pixels with
+// the line fraction in [beg_frac, end_frac] are added, and the other
+// constraints are added only for the variables these reprojection errors
+// use, unless the range is [0, 1].
+void buildProblem(Options                                              const & opt,
+                  vw::ba::CameraRelationNetwork<vw::ba::JFeature>      const & crn,
+                  std::vector<std::vector<Vector2>>                    const & pixel_vec,
+                  std::vector<std::vector<boost::shared_ptr<Vector3>>> const & xyz_vec,
+                  std::vector<std::vector<double*>>                    const & xyz_vec_ptr,
+                  std::vector<std::vector<double>>                     const & weight_vec,
+                  std::vector<std::vector<int>>                        const & isAnchor_vec,
+                  std::vector<UsgsAstroLsSensorModel*>                 const & ls_models,
+                  std::vector<vw::Vector3>                             const & dem_xyz_vec,
+                  std::set<int>                                        const & outliers,
+                  vw::ba::ControlNetwork                               const & cnet,
+                  bool have_dem, double beg_frac, double end_frac,
+                  // Outputs
+                  std::vector<double>                                        & tri_points_vec,
+                  std::vector<double>                                        & weight_per_residual,
+                  ceres::Problem                                             & problem) {
+
+  bool skip_unused = (beg_frac > 0.0 || end_frac < 1.0);
+  
+  // Add reprojection errors
+  addReprojectionErrors(opt, crn, pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec,
+                        isAnchor_vec, ls_models, beg_frac, end_frac,
+                        // Outputs
+                        weight_per_residual, problem);
+ 
+  // Add the DEM constraint. We check earlier that only one
+  // of the two options below can be set at a time.
+  if (have_dem)
+    addDemConstraint(opt, xyz_vec, xyz_vec_ptr, dem_xyz_vec, outliers, cnet, skip_unused,
+                     // Outputs
+                     tri_points_vec, weight_per_residual,  // append
+                     problem);
+
+  // Add the constraint to keep triangulated points close to initial values
+  // This does not need a DEM or alignment.
+  // This must happen after any DEM-based constraint is set, and won't
+  // apply to tri points already constrained by the DEM (so it will
+  // work only where the DEM is missing).
+  if (opt.tri_weight > 0) 
+    addTriConstraint(opt, outliers, cnet, skip_unused,
+                     // Outputs
+                     tri_points_vec,  
+                     weight_per_residual,  // append
+                     problem);
+
+  // Add constraints to keep quat norm close to 1, and make rotations and translations
+  // not change too much
+  addQuatNormRotationTranslationConstraints(opt, outliers, crn, ls_models, skip_unused,
+                                            // Outputs
+                                            tri_points_vec,  
+                                            weight_per_residual,  // append
+                                            problem);
+}
+
+void setSolverOptions(Options const& opt, ceres::Solver::Options & options) {
+  options.gradient_tolerance  = 1e-16;
+  options.function_tolerance  = 1e-16;
+  options.parameter_tolerance = opt.parameter_tolerance; // default is 1e-12
+  options.max_num_iterations                = opt.num_iterations;
+  options.max_num_consecutive_invalid_steps = std::max(20, opt.num_iterations/5); // try hard
+  options.minimizer_progress_to_stdout      = true;
+  if (opt.single_threaded_cameras)
+    options.num_threads = 1;
+  else
+    options.num_threads = opt.num_threads;
+  // This is supposed to help with speed in a certain size range
+  options.linear_solver_type = ceres::SPARSE_SCHUR;
+  options.use_explicit_schur_complement = true; 
+  options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+  options.preconditioner_type = ceres::SCHUR_JACOBI;
+  options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+}
+
+// A rough estimate of the solver memory per reprojection error. Each has
+// up to 8 quaternions, 8 positions, and a point as variables, so its
+// jacobian has 2 x 59 values. Add to that the solver workspace.
+const double g_solver_bytes_per_pixel_residual = 3000.0;
+
+// The number of windows to use, based on the options and the number of
+// reprojection errors.
+int calcNumWindows(Options const& opt, std::vector<std::vector<Vector2>> const& pixel_vec) {
+
+  int num_windows = opt.num_windows;
+  if (opt.solver_memory_budget_mb <= 0)
+    return num_windows;
+
+  double num_pixels = 0;
+  for (size_t icam = 0; icam < pixel_vec.size(); icam++)
+    num_pixels += pixel_vec[icam].size();
+
+  double est_mb = num_pixels * g_solver_bytes_per_pixel_residual / (1024.0 * 1024.0);
+  int budget_windows = static_cast<int>(ceil(est_mb / opt.solver_memory_budget_mb));
+  vw_out() << "Estimated solver memory without windows: " << est_mb << " MB.\n";
+  return std::max(num_windows, budget_windows);
+}
+
+// The weight with which a value at the given line fraction is blended
+// from a window spanning [lo, hi], which includes the overlap of size
+// 'extra' on each side. The weight ramps up from 0 to 1 over the
+// overlap, so the weights of two neighboring windows add up to 1 there.
+double windowWeight(double frac, double lo, double hi, double extra) {
+  if (frac < lo || frac > hi)
+    return 0.0;
+  if (extra <= 0.0)
+    return 1.0;
+  return std::min(1.0, std::min(frac - lo, hi - frac) / (2.0 * extra));
+}
+
+// Accumulate a blended variable. The weighted mean is used where the
+// weights are positive, and the plain mean of the values from windows
+// which optimized the variable otherwise. If no window optimized it, it
+// is left unchanged.
+struct BlendSum {
+  std::vector<double> wsum, sum, wt;
+  std::vector<int> count;
+  int block_size;
+
+  BlendSum(int num_blocks, int block_size_in):
+    wsum(num_blocks * block_size_in, 0.0), sum(num_blocks * block_size_in, 0.0),
+    wt(num_blocks, 0.0), count(num_blocks, 0), block_size(block_size_in) {}
+
+  void add(int block, double const* vals, double weight) {
+    for (int c = 0; c < block_size; c++) {
+      wsum[block * block_size + c] += weight * vals[c];
+      sum[block * block_size + c]  += vals[c];
+    }
+    wt[block] += weight;
+    count[block]++;
+  }
+
+  void get(int block, double * vals) const {
+    for (int c = 0; c < block_size; c++) {
+      if (wt[block] > 0)
+        vals[c] = wsum[block * block_size + c] / wt[block];
+      else if (count[block] > 0)
+        vals[c] = sum[block * block_size + c] / count[block];
+    }
+  }
+};
+
+// Optimize the cameras and points in overlapping windows of image lines,
+// one at a time, so that only the memory for one window is needed. Each
+// window is optimized starting from the initial values, and the results
+// are blended in the overlaps. The rotation, translation, and other
+// constraints are kept for the variables in each window.
+void solveInWindows(Options                                              const & opt,
+                    int num_windows,
+                    vw::ba::CameraRelationNetwork<vw::ba::JFeature>      const & crn,
+                    std::vector<std::vector<Vector2>>                    const & pixel_vec,
+                    std::vector<std::vector<boost::shared_ptr<Vector3>>> const & xyz_vec,
+                    std::vector<std::vector<double*>>                    const & xyz_vec_ptr,
+                    std::vector<std::vector<double>>                     const & weight_vec,
+                    std::vector<std::vector<int>>                        const & isAnchor_vec,
+                    std::vector<UsgsAstroLsSensorModel*>                 const & ls_models,
+                    std::vector<vw::Vector3>                             const & dem_xyz_vec,
+                    std::set<int>                                        const & outliers,
+                    vw::ba::ControlNetwork                               const & cnet,
+                    bool have_dem,
+                    // Outputs
+                    std::vector<double>                                        & tri_points_vec) {
+
+  int num_cams = ls_models.size();
+  int num_tri_points = tri_points_vec.size() / NUM_XYZ_PARAMS;
+
+  // The line fraction of each point is the one of its first observation
+  std::vector<double> point_frac(num_tri_points, 0.0);
+  std::vector<bool> have_frac(num_tri_points, false);
+  for (int icam = 0; icam < (int)crn.size(); icam++) {
+    for (auto fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
+      int ipt = (**fiter).m_point_id;
+      if (have_frac[ipt] || outliers.find(ipt) != outliers.end())
+        continue;
+      point_frac[ipt] = lineFraction((**fiter).m_location.y(), ls_models[icam]->m_nLines);
+      have_frac[ipt] = true;
+    }
+  }
+
+  // Keep the initial values, as each window starts from them
+  std::vector<std::vector<double>> init_quats(num_cams), init_positions(num_cams);
+  for (int icam = 0; icam < num_cams; icam++) {
+    init_quats[icam]     = ls_models[icam]->m_quaternions;
+    init_positions[icam] = ls_models[icam]->m_positions;
+  }
+  std::vector<double> init_tri_points = tri_points_vec;
+
+  std::vector<BlendSum> quat_sums, pos_sums;
+  for (int icam = 0; icam < num_cams; icam++) {
+    quat_sums.push_back(BlendSum(init_quats[icam].size() / NUM_QUAT_PARAMS, NUM_QUAT_PARAMS));
+    pos_sums.push_back(BlendSum(init_positions[icam].size() / NUM_XYZ_PARAMS, NUM_XYZ_PARAMS));
+  }
+  BlendSum tri_sum(num_tri_points, NUM_XYZ_PARAMS);
+
+  double len = 1.0 / num_windows;
+  double extra = opt.window_overlap * len;
+  for (int iwin = 0; iwin < num_windows; iwin++) {
+
+    double lo = iwin * len - extra, hi = (iwin + 1) * len + extra;
+
+    std::vector<double> weight_per_residual; // not used
+    ceres::Problem problem;
+    buildProblem(opt, crn, pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec, isAnchor_vec,
+                 ls_models, dem_xyz_vec, outliers, cnet, have_dem, lo, hi,
+                 // Outputs
+                 tri_points_vec, weight_per_residual, problem);
+    if (problem.NumResidualBlocks() == 0) {
+      vw_out() << "No residuals in window " << iwin + 1 << " of " << num_windows << ".\n";
+      continue;
+    }
+
+    ceres::Solver::Options options;
+    setSolverOptions(opt, options);
+    vw_out() << "Optimizing window " << iwin + 1 << " of " << num_windows << ".\n";
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    asp::profile_solver_summary(summary);
+    g_ls_model_generation++; // the solver changed the models
+    vw_out() << summary.BriefReport() << "\n";
+    if (summary.termination_type == ceres::NO_CONVERGENCE) 
+      vw_out() << "Found a valid solution, but did not reach the actual minimum.\n";
+
+    // Accumulate the variables optimized in this window
+    for (int icam = 0; icam < num_cams; icam++) {
+
+      double first_line_time = 0, last_line_time = 0, elapsed_time = 0, dt_per_line = 0;
+      calcTimes(ls_models[icam], first_line_time, last_line_time, elapsed_time, dt_per_line);
+
+      std::vector<double> & quats = ls_models[icam]->m_quaternions;
+      int numQuat = quats.size() / NUM_QUAT_PARAMS;
+      for (int iq = 0; iq < numQuat; iq++) {
+        double * q = &quats[iq * NUM_QUAT_PARAMS];
+        if (!problem.HasParameterBlock(q))
+          continue;
+        double t = ls_models[icam]->m_t0Quat + iq * ls_models[icam]->m_dtQuat;
+        double frac = std::min(1.0, std::max(0.0, (t - first_line_time) / elapsed_time));
+        quat_sums[icam].add(iq, q, windowWeight(frac, lo, hi, extra));
+      }
+
+      std::vector<double> & positions = ls_models[icam]->m_positions;
+      int numPos = positions.size() / NUM_XYZ_PARAMS;
+      for (int ip = 0; ip < numPos; ip++) {
+        double * p = &positions[ip * NUM_XYZ_PARAMS];
+        if (!problem.HasParameterBlock(p))
+          continue;
+        double t = ls_models[icam]->m_t0Ephem + ip * ls_models[icam]->m_dtEphem;
+        double frac = std::min(1.0, std::max(0.0, (t - first_line_time) / elapsed_time));
+        pos_sums[icam].add(ip, p, windowWeight(frac, lo, hi, extra));
+      }
+    }
+    for (int ipt = 0; ipt < num_tri_points; ipt++) {
+      double * tri_point = &tri_points_vec[ipt * NUM_XYZ_PARAMS];
+      if (!problem.HasParameterBlock(tri_point) || !have_frac[ipt])
+        continue;
+      tri_sum.add(ipt, tri_point, windowWeight(point_frac[ipt], lo, hi, extra));
+    }
+
+    // Put back the initial values for the next window. Copy in place, as
+    // the full problem has pointers into these vectors.
+    for (int icam = 0; icam < num_cams; icam++) {
+      std::copy(init_quats[icam].begin(), init_quats[icam].end(),
+                ls_models[icam]->m_quaternions.begin());
+      std::copy(init_positions[icam].begin(), init_positions[icam].end(),
+                ls_models[icam]->m_positions.begin());
+    }
+    std::copy(init_tri_points.begin(), init_tri_points.end(), tri_points_vec.begin());
+    g_ls_model_generation++;
+  }
+
+  // Set the blended values
+  for (int icam = 0; icam < num_cams; icam++) {
+    std::vector<double> & quats = ls_models[icam]->m_quaternions;
+    for (int iq = 0; iq < int(quats.size()) / NUM_QUAT_PARAMS; iq++)
+      quat_sums[icam].get(iq, &quats[iq * NUM_QUAT_PARAMS]);
+    std::vector<double> & positions = ls_models[icam]->m_positions;
+    for (int ip = 0; ip < int(positions.size()) / NUM_XYZ_PARAMS; ip++)
+      pos_sums[icam].get(ip, &positions[ip * NUM_XYZ_PARAMS]);
+
+    // Blending quaternions does not keep their norm
+    normalizeQuaternions(ls_models[icam]);
+  }
+  for (int ipt = 0; ipt < num_tri_points; ipt++)
+    tri_sum.get(ipt, &tri_points_vec[ipt * NUM_XYZ_PARAMS]);
+  g_ls_model_generation++;
+}
   
 void run_jitter_solve(int argc, char* argv[]) {
 
   // Parse arguments and perform validation
   Options opt;
   handle_arguments(argc, argv, opt);
+  asp::cost_profile().set_enabled(opt.profile_cost_functions);
 
   bool approximate_pinhole_intrinsics = false;
   asp::load_cameras(opt.image_files, opt.camera_files, opt.out_prefix, opt,  
@@ -1377,19 +1802,21 @@ void run_jitter_solve(int argc, char* argv[]) {
     if (ls_model == NULL)
       vw_throw(ArgumentErr() << "Expecting the cameras to be of CSM linescan type.\n");
 
-    // Normalize quaternions. Later, the quaternions being optimized will
-    // be kept close to being normalized.  This makes it easy to ensure
-    // that quaternion interpolation gives good results, especially that
-    // some quaternions may get optimized and some not.
-    normalizeQuaternions(ls_model);
-
-    // The provided tabulated positions, velocities and quaternions may be too few,
-    // so resample them with --num-lines-per-position and --num-lines-per-orientation,
-    // if those are set.
-    resampleModel(opt, ls_model);
-    
     ls_models.push_back(ls_model);
   }
+
+  // Normalize and resample the models in parallel, one task per model.
+  // Print the messages in order after that.
+  {
+    std::vector<std::ostringstream> messages(ls_models.size());
+    vw::FifoWorkQueue queue(opt.num_threads);
+    for (size_t icam = 0; icam < ls_models.size(); icam++)
+      queue.add_task(boost::shared_ptr<PrepareModelTask>
+                     (new PrepareModelTask(opt, ls_models[icam], messages[icam])));
+    queue.join_all();
+    for (size_t icam = 0; icam < ls_models.size(); icam++)
+      vw_out() << messages[icam].str();
+  }
   
   // Quantities that are not needed but are part of the API below
   bool got_est_cam_positions = false;
@@ -1467,7 +1894,11 @@ void run_jitter_solve(int argc, char* argv[]) {
   // Flag as outliers points with initial reprojection error bigger than
   // a certain amount. This assumes that the input cameras are very accurate.
   std::set<int> outliers;
-  flag_initial_outliers(cnet, crn, opt.camera_models, opt.max_init_reproj_error,  
+  int num_threads = opt.num_threads;
+  if (opt.single_threaded_cameras)
+    num_threads = 1; // ISIS must be single threaded!
+  flag_initial_outliers(cnet, crn, opt.camera_models, opt.max_init_reproj_error,
+                        num_threads,
                         // Output
                         outliers);
   vw_out() << "Removed " << outliers.size() << " outliers based on initial reprojection error.\n";
@@ -1488,7 +1919,8 @@ void run_jitter_solve(int argc, char* argv[]) {
                                       dem_xyz_vec);
   } else if (opt.ref_dem != "") {
     asp::create_interp_dem(opt.ref_dem, dem_georef, interp_dem);
-    asp::calc_avg_intersection_with_dem(cnet, crn, outliers, opt.camera_models,
+    asp::BAObservations obs(cnet, opt.camera_models.size());
+    asp::calc_avg_intersection_with_dem(cnet, obs, outliers, opt.camera_models,
                                         dem_georef, interp_dem,
                                         // Output
                                         dem_xyz_vec);
@@ -1572,43 +2004,13 @@ void run_jitter_solve(int argc, char* argv[]) {
   // Need this in order to undo the multiplication by weight before saving the residuals
   std::vector<double> weight_per_residual;
 
-  // The problem to solve
+  // The problem with all residuals. It is optimized as a whole, unless
+  // using windows, but in either case it is used for the residual reports.
   ceres::Problem problem;
-  
-  // Add reprojection errors
-  addReprojectionErrors(opt, crn, pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec,
-                        isAnchor_vec, ls_models,
-                        // Outputs
-                        weight_per_residual, problem);
- 
-  // Add the DEM constraint. We check earlier that only one
-  // of the two options below can be set at a time.
-  // TODO(oalexan1): Make this into a function.
-  if (have_dem)
-    addDemConstraint(opt, xyz_vec, xyz_vec_ptr, dem_xyz_vec, outliers, cnet,  
-                     // Outputs
-                     tri_points_vec, weight_per_residual,  // append
-                     problem);
-
-  // Add the constraint to keep triangulated points close to initial values
-  // This does not need a DEM or alignment.
-  // This must happen after any DEM-based constraint is set, and won't
-  // apply to tri points already constrained by the DEM (so it will
-  // work only where the DEM is missing).
-  if (opt.tri_weight > 0) 
-    addTriConstraint(opt, outliers, cnet,  
-                     // Outputs
-                     tri_points_vec,  
-                     weight_per_residual,  // append
-                     problem);
-
-  // Add constraints to keep quat norm close to 1, and make rotations and translations
-  // not change too much
-  addQuatNormRotationTranslationConstraints(opt, outliers, crn, ls_models,  
-                                            // Outputs
-                                            tri_points_vec,  
-                                            weight_per_residual,  // append
-                                            problem);
+  buildProblem(opt, crn, pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec, isAnchor_vec,
+               ls_models, dem_xyz_vec, outliers, cnet, have_dem, 0.0, 1.0,
+               // Outputs
+               tri_points_vec, weight_per_residual, problem);
 
   // Save residuals before optimization
   std::string residual_prefix = opt.out_prefix + "-initial_residuals";
@@ -1616,33 +2018,28 @@ void run_jitter_solve(int argc, char* argv[]) {
                  tri_points_vec, dem_xyz_vec, outliers, weight_per_residual,
                  // These are needed for anchor points
                  pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec, isAnchor_vec);
+
+  int num_windows = calcNumWindows(opt, pixel_vec);
+  if (num_windows > 1) {
+    solveInWindows(opt, num_windows, crn, pixel_vec, xyz_vec, xyz_vec_ptr, weight_vec,
+                   isAnchor_vec, ls_models, dem_xyz_vec, outliers, cnet, have_dem,
+                   // Outputs
+                   tri_points_vec);
+  } else {
+    // Set up the problem
+    ceres::Solver::Options options;
+    setSolverOptions(opt, options);
   
-  // Set up the problem
-  ceres::Solver::Options options;
-  options.gradient_tolerance  = 1e-16;
-  options.function_tolerance  = 1e-16;
-  options.parameter_tolerance = opt.parameter_tolerance; // default is 1e-12
-  options.max_num_iterations                = opt.num_iterations;
-  options.max_num_consecutive_invalid_steps = std::max(20, opt.num_iterations/5); // try hard
-  options.minimizer_progress_to_stdout      = true;
-  if (opt.single_threaded_cameras)
-    options.num_threads = 1;
-  else
-    options.num_threads = opt.num_threads;
-  // This is supposed to help with speed in a certain size range
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  options.use_explicit_schur_complement = true; 
-  options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
-  options.preconditioner_type = ceres::SCHUR_JACOBI;
-  options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
-  
-  // Solve the problem
-  vw_out() << "Starting the Ceres optimizer." << std::endl;
-  ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem, &summary);
-  vw_out() << summary.FullReport() << "\n";
-  if (summary.termination_type == ceres::NO_CONVERGENCE) 
-    vw_out() << "Found a valid solution, but did not reach the actual minimum.\n";
+    // Solve the problem
+    vw_out() << "Starting the Ceres optimizer." << std::endl;
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    asp::profile_solver_summary(summary);
+    g_ls_model_generation++; // the solver changed the models
+    vw_out() << summary.FullReport() << "\n";
+    if (summary.termination_type == ceres::NO_CONVERGENCE) 
+      vw_out() << "Found a valid solution, but did not reach the actual minimum.\n";
+  }
 
   // Save residuals after optimization
   // TODO(oalexan1): Add here the anchor residuals
@@ -1664,6 +2061,9 @@ void run_jitter_solve(int argc, char* argv[]) {
     asp::CsmModel * csm_cam = asp::csm_model(opt.camera_models[icam], opt.stereo_session);
     csm_cam->saveState(csmFile);
   }
+
+  if (opt.profile_cost_functions)
+    asp::cost_profile().write(opt.out_prefix);
   
   return;
 }
@@ -32,6 +32,10 @@
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/PixelMapGrid.h>
+#include <asp/Core/CameraFootprint.h>
+#include <asp/Core/FootprintMask.h>
+#include <asp/Core/MultiBandTransform.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/Core/StereoSettings.h>
 
@@ -47,7 +51,7 @@ struct Options : vw::GdalWriteOptions {
   // Input
   std::string dem_file, image_file, camera_file, output_file, stereo_session,
     bundle_adjust_prefix;
-  bool isQuery, noGeoHeaderInfo, nearest_neighbor, parseOptions, dg_use_csm;
+  bool isQuery, noGeoHeaderInfo, nearest_neighbor, parseOptions, dg_use_csm, cog;
   bool multithreaded_model; // This is set based on the session type.
   bool enable_correct_velocity_aberration, enable_correct_atmospheric_refraction;
   
@@ -56,8 +60,14 @@ struct Options : vw::GdalWriteOptions {
   
   // Settings
   std::string target_srs_string, output_type, metadata;
-  double nodata_value, tr, mpp, ppd, datum_offset;
+  double nodata_value, tr, mpp, ppd, datum_offset, approx_tol;
+  int approx_grid_spacing;
   BBox2 target_projwin, target_pixelwin;
+
+  // The convex hull of the camera footprint in output pixels, and by
+  // how much to grow the output tiles when checking against it
+  std::vector<Vector2> footprint;
+  double footprint_margin;
 };
 
 void handle_arguments( int argc, char *argv[], Options& opt ) {
@@ -102,6 +112,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Turn on atmospheric refraction correction for Optical Bar and non-ISIS linescan cameras. This option impairs the convergence of bundle adjustment.")
     ("dg-use-csm", po::bool_switch(&opt.dg_use_csm)->default_value(false)->implicit_value(true),
      "Use the CSM model with DigitalGlobe linescan cameras (-t dg). No corrections are done for velocity aberration or atmospheric refraction.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false)->implicit_value(true),
+     "Write a cloud-optimized GeoTIFF, with internal overviews.")
+    ("approx-grid-spacing", po::value(&opt.approx_grid_spacing)->default_value(0),
+     "If positive, project into the camera exactly only the output pixels on a grid with this spacing, refined where the interpolation error is too large, and find the rest of the projections with bicubic interpolation. This is much faster for smooth terrain. DEM holes much smaller than the grid may be filled in. See also --approx-tolerance.")
+    ("approx-tolerance", po::value(&opt.approx_tol)->default_value(0.1),
+     "The largest allowed interpolation error, in input image pixels, with --approx-grid-spacing.")
     ("parse-options", po::bool_switch(&opt.parseOptions)->default_value(false),
      "Parse the options and print the results. Used by the mapproject script.")
     ;
@@ -142,6 +158,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if (asp::has_cam_extension(opt.output_file))
     vw_throw(ArgumentErr() << "The output file is a camera. Check your inputs.\n");
 
+  if (opt.approx_grid_spacing < 0 || opt.approx_tol < 0)
+    vw_throw(ArgumentErr() << "The values of --approx-grid-spacing and "
+             << "--approx-tolerance must be non-negative.\n");
+
   if (opt.parseOptions) {
     // For the benefit of mapproject
     vw_out() << "dem," << opt.dem_file << std::endl;
@@ -304,6 +324,9 @@ void write_parallel_cond(std::string              const& filename,
                           has_nodata, nodata_val, opt, tpc, keywords);
   }
 
+  if (opt.cog)
+    asp::write_cog(filename, opt, opt.nearest_neighbor ? "NEAREST" : "AVERAGE");
+
 }
 
 /// Compute which camera pixel observes a DEM pixel.
@@ -367,6 +390,48 @@ void expandBboxToContainCornerIntersections(boost::shared_ptr<camera::CameraMode
 
 }
 
+/// Find the convex hull of the camera footprint on the DEM, in output
+/// pixels. Output tiles which do not meet it are filled with no-data
+/// without camera calls. It is left empty, so all tiles are computed,
+/// with a datum rather than a DEM, with a geographic output
+/// projection, where the hull may straddle the longitude seam, and if
+/// the footprint cannot be found.
+void calc_footprint(Vector2i const& image_size, GeoReference const& target_georef,
+                    Options & opt) {
+
+  opt.footprint.clear();
+  opt.footprint_margin = 0.0;
+  if (fs::path(opt.dem_file).extension() == "" || !target_georef.is_projected())
+    return;
+
+  std::vector<Vector2> pixels;
+  try {
+    asp::FootprintDem dem(opt.dem_file);
+    double mean_gsd = 0.0;
+    int num_samples = 100;
+    std::vector<Vector3> edge_points;
+    asp::camera_footprint(dem, *opt.camera_model, image_size, mean_gsd, NULL,
+                          num_samples, &edge_points);
+    for (size_t it = 0; it < edge_points.size(); it++) {
+      Vector3 llh = target_georef.datum().cartesian_to_geodetic(edge_points[it]);
+      pixels.push_back(target_georef.lonlat_to_pixel(subvector(llh, 0, 2)));
+    }
+  } catch (std::exception const& e) {
+    vw_out() << "Could not find the camera footprint: " << e.what()
+             << "All output tiles will be computed.\n";
+    return;
+  }
+
+  asp::convex_hull(pixels, opt.footprint);
+
+  // The footprint edge between the samples may bulge out of the hull
+  BBox2 box;
+  for (size_t it = 0; it < opt.footprint.size(); it++)
+    box.grow(opt.footprint[it]);
+  if (!box.empty())
+    opt.footprint_margin = 2.0 + 0.05 * std::max(box.width(), box.height());
+}
+
 /// Compute output georeference to use
 void calc_target_geom(// Inputs
                       bool calc_target_res,
@@ -503,7 +568,7 @@ void project_image_nodata(Options & opt,
         crop( // Apply crop (only happens if --t_pixelwin was specified)
               apply_mask
               ( // Handle nodata
-              transform_nodata( // Apply the output from Map2CamTrans
+              asp::footprint_mask(transform_nodata( // Apply the output from Map2CamTrans
                                 create_mask(DiskImageView<ImagePixelT>(img_rsrc),
                                             opt.nodata_value), // Handle nodata
                                 transform,
@@ -512,6 +577,7 @@ void project_image_nodata(Options & opt,
                                 ValueEdgeExtension<ImageMaskPixelT>(nodata_mask),
                                 NearestPixelInterpolation(), nodata_mask
                                 ),
+                                opt.footprint, opt.footprint_margin, nodata_mask),
               opt.nodata_value
               ),
               croppedImageBB
@@ -526,7 +592,7 @@ void project_image_nodata(Options & opt,
         crop( // Apply crop (only happens if --t_pixelwin was specified)
               apply_mask
               ( // Handle nodata
-              transform_nodata( // Apply the output from Map2CamTrans
+              asp::footprint_mask(transform_nodata( // Apply the output from Map2CamTrans
                                 create_mask(DiskImageView<ImagePixelT>(img_rsrc),
                                             opt.nodata_value), // Handle nodata
                                 transform,
@@ -535,6 +601,7 @@ void project_image_nodata(Options & opt,
                                 ValueEdgeExtension<ImageMaskPixelT>(nodata_mask),
                                 BicubicInterpolation(), nodata_mask
                                 ),
+                                opt.footprint, opt.footprint_margin, nodata_mask),
               opt.nodata_value
               ),
               croppedImageBB
@@ -569,7 +636,7 @@ void project_image_alpha(Options & opt,
         opt.output_file,
         crop( // Apply crop (only happens if --t_pixelwin was specified)
               // Transparent pixels are inserted for nodata
-              transform_nodata( // Apply the output from Map2CamTrans
+              asp::footprint_mask(transform_nodata( // Apply the output from Map2CamTrans
                                 DiskImageView<ImagePixelT>(img_rsrc),
                                 transform,
                                 virtual_image_size[0],
@@ -577,6 +644,7 @@ void project_image_alpha(Options & opt,
                                 ConstantEdgeExtension(),
                                 NearestPixelInterpolation(), transparent_pixel
                                 ),
+                                opt.footprint, opt.footprint_margin, transparent_pixel),
               croppedImageBB
             ),
         croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
@@ -588,7 +656,7 @@ void project_image_alpha(Options & opt,
         opt.output_file,
         crop( // Apply crop (only happens if --t_pixelwin was specified)
               // Transparent pixels are inserted for nodata
-              transform_nodata( // Apply the output from Map2CamTrans
+              asp::footprint_mask(transform_nodata( // Apply the output from Map2CamTrans
                                 DiskImageView<ImagePixelT>(img_rsrc),
                                 transform,
                                 virtual_image_size[0],
@@ -596,6 +664,7 @@ void project_image_alpha(Options & opt,
                                 ConstantEdgeExtension(),
                                 BicubicInterpolation(), transparent_pixel
                                 ),
+                                opt.footprint, opt.footprint_margin, transparent_pixel),
               croppedImageBB
             ),
         croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
@@ -605,7 +674,89 @@ void project_image_alpha(Options & opt,
 
 }
 
-// The two "pick" functions below select between the Map2CamTrans and Datum2CamTrans
+/// Map project all bands of a multi-band image, such as a multispectral
+/// one, with a nodata value. The camera pixel of each output pixel is
+/// found once, and used for all bands.
+template <class Map2CamTransT>
+void project_image_bands(Options & opt,
+                         GeoReference const& croppedGeoRef,
+                         Vector2i     const& virtual_image_size,
+                         BBox2i       const& croppedImageBB,
+                         Map2CamTransT const& transform) {
+
+    // Create handle to input image to be projected on to the map
+    boost::shared_ptr<DiskImageResource> img_rsrc = 
+          vw::DiskImageResourcePtr(opt.image_file);   
+
+    // Update the nodata value from the input file if it is present.
+    if (img_rsrc->has_nodata_read()) 
+      opt.nodata_value = img_rsrc->nodata_read();
+
+    bool has_img_nodata = true;
+    write_parallel_type
+      ( // Write to the output file
+      opt.output_file,
+      crop( // Apply crop (only happens if --t_pixelwin was specified)
+            asp::MultiBandTransformView<DiskImageView<float>, Map2CamTransT>
+            (DiskImageView<float>(img_rsrc), transform,
+             virtual_image_size[0], virtual_image_size[1],
+             opt.nodata_value, opt.nearest_neighbor,
+             opt.footprint, opt.footprint_margin),
+            croppedImageBB
+            ),
+      croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
+      TerminalProgressCallback("","")
+      );
+}
+
+// If the user asked for it, interpolate the transform into the camera
+template <class ImagePixelT, class Map2CamTransT>
+void project_image_nodata_maybe_approx(Options & opt,
+                                       GeoReference const& croppedGeoRef,
+                                       Vector2i     const& virtual_image_size,
+                                       BBox2i       const& croppedImageBB,
+                                       Map2CamTransT const& transform) {
+  if (opt.approx_grid_spacing > 0)
+    project_image_nodata<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                      asp::GridInterpTrans<Map2CamTransT>
+                                      (transform, opt.approx_grid_spacing, opt.approx_tol));
+  else
+    project_image_nodata<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                      transform);
+}
+
+template <class ImagePixelT, class Map2CamTransT>
+void project_image_alpha_maybe_approx(Options & opt,
+                                      GeoReference const& croppedGeoRef,
+                                      Vector2i     const& virtual_image_size,
+                                      BBox2i       const& croppedImageBB,
+                                      boost::shared_ptr<camera::CameraModel> const& camera_model,
+                                      Map2CamTransT const& transform) {
+  if (opt.approx_grid_spacing > 0)
+    project_image_alpha<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                     camera_model,
+                                     asp::GridInterpTrans<Map2CamTransT>
+                                     (transform, opt.approx_grid_spacing, opt.approx_tol));
+  else
+    project_image_alpha<ImagePixelT>(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                                     camera_model, transform);
+}
+
+template <class Map2CamTransT>
+void project_image_bands_maybe_approx(Options & opt,
+                                      GeoReference const& croppedGeoRef,
+                                      Vector2i     const& virtual_image_size,
+                                      BBox2i       const& croppedImageBB,
+                                      Map2CamTransT const& transform) {
+  if (opt.approx_grid_spacing > 0)
+    project_image_bands(opt, croppedGeoRef, virtual_image_size, croppedImageBB,
+                        asp::GridInterpTrans<Map2CamTransT>
+                        (transform, opt.approx_grid_spacing, opt.approx_tol));
+  else
+    project_image_bands(opt, croppedGeoRef, virtual_image_size, croppedImageBB, transform);
+}
+
+// The "pick" functions below select between the Map2CamTrans and Datum2CamTrans
 // transform classes which will be passed to the image projection function.
 // - TODO: Is there a good reason for the transform classes to be CRTP instead of virtual?
 
@@ -621,7 +772,7 @@ void project_image_nodata_pick_transform(Options & opt,
   const bool        call_from_mapproject = true;
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
-    return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
+    return project_image_nodata_maybe_approx<ImagePixelT>(opt, croppedGeoRef,
                                              virtual_image_size, croppedImageBB,
                                              Map2CamTrans(// Converts coordinates in DEM
                                                           // georeference to camera pixels
@@ -631,7 +782,7 @@ void project_image_nodata_pick_transform(Options & opt,
                                                           opt.nearest_neighbor));
   } else {
     // A constant datum elevation was provided
-    return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
+    return project_image_nodata_maybe_approx<ImagePixelT>(opt, croppedGeoRef,
                                              virtual_image_size, croppedImageBB,
                                              Datum2CamTrans
                                              (// Converts coordinates in DEM
@@ -657,7 +808,7 @@ void project_image_alpha_pick_transform(Options & opt,
   const bool        call_from_mapproject = true;
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
-    return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
+    return project_image_alpha_maybe_approx<ImagePixelT>(opt, croppedGeoRef,
                                             virtual_image_size, croppedImageBB, camera_model, 
                                             Map2CamTrans(// Converts coordinates in DEM
                                                          // georeference to camera pixels
@@ -668,7 +819,7 @@ void project_image_alpha_pick_transform(Options & opt,
                                             );
   } else {
     // A constant datum elevation was provided
-    return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
+    return project_image_alpha_maybe_approx<ImagePixelT>(opt, croppedGeoRef,
                                             virtual_image_size, croppedImageBB, camera_model, 
                                             Datum2CamTrans(// Converts coordinates in DEM
                                                            // georeference to camera pixels
@@ -680,6 +831,40 @@ void project_image_alpha_pick_transform(Options & opt,
   }
 }
 
+void project_image_bands_pick_transform(Options & opt,
+                                        GeoReference const& dem_georef,
+                                        GeoReference const& target_georef,
+                                        GeoReference const& croppedGeoRef,
+                                        Vector2i     const& image_size,
+                                        Vector2i     const& virtual_image_size,
+                                        BBox2i       const& croppedImageBB,
+                                        boost::shared_ptr<camera::CameraModel> const&
+                                        camera_model) {
+  const bool        call_from_mapproject = true;
+  if (fs::path(opt.dem_file).extension() != "") {
+    // A DEM file was provided
+    return project_image_bands_maybe_approx(opt, croppedGeoRef,
+                                            virtual_image_size, croppedImageBB,
+                                            Map2CamTrans(// Converts coordinates in DEM
+                                                         // georeference to camera pixels
+                                                         camera_model.get(), target_georef,
+                                                         dem_georef, opt.dem_file, image_size,
+                                                         call_from_mapproject,
+                                                         opt.nearest_neighbor));
+  } else {
+    // A constant datum elevation was provided
+    return project_image_bands_maybe_approx(opt, croppedGeoRef,
+                                            virtual_image_size, croppedImageBB,
+                                            Datum2CamTrans(// Converts coordinates in DEM
+                                                           // georeference to camera pixels
+                                                           camera_model.get(), target_georef,
+                                                           dem_georef, opt.datum_offset,
+                                                           image_size,
+                                                           call_from_mapproject,
+                                                           opt.nearest_neighbor));
+  }
+}
+
 int main(int argc, char* argv[]) {
 
   Options opt;
@@ -867,6 +1052,9 @@ int main(int argc, char* argv[]) {
       return 0;
     }
 
+    // Output tiles outside the camera footprint will not be computed
+    calc_footprint(image_size, target_georef, opt);
+
     // For certain pinhole camera models the reverse check can make map projection very slow,
     // so we disable it here.  The check is very important for computing the bounding box safely
     // but we don't really need it when projecting the pixels back in to the camera.
@@ -921,6 +1109,16 @@ int main(int argc, char* argv[]) {
         break;
       };
       
+    } else if (num_input_channels == 1 && image_fmt.planes > 1) {
+      // A multi-band image, such as a multispectral one. All bands are
+      // projected together, as float.
+      vw_out() << "Detected an image with " << image_fmt.planes << " bands. "
+               << "All bands will be mapprojected. The pixels will be "
+               << "interpreted as float.\n";
+      project_image_bands_pick_transform(opt, dem_georef, target_georef, croppedGeoRef,
+                                         image_size, 
+                                         Vector2i(virtual_image_width, virtual_image_height),
+                                         croppedImageBB, opt.camera_model);
     } else {
       // If the input image is not RGB, only single channel images are supported.
       if (num_input_channels != 1 || image_fmt.planes != 1)
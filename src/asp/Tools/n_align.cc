@@ -76,7 +76,7 @@ struct Options : public vw::GdalWriteOptions {
   // Input
   string in_prefix, in_transforms, datum, csv_format_str, csv_proj4_str; 
   int    num_iter, max_num_points;
-  double semi_major_axis, semi_minor_axis, rel_error_tol;
+  double semi_major_axis, semi_minor_axis, rel_error_tol, max_pair_distance;
   bool   save_transformed_clouds, align_to_first_cloud, verbose;
   std::vector<std::string> cloud_files;
   // Output
@@ -111,6 +111,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Specify the initial transforms as a list of files separated by spaces and in quotes, that is, as 'trans1.txt ... trans_n.txt'.")
     ("relative-error-tolerance", po::value(&opt.rel_error_tol)->default_value(1e-10),
      "Stop when the change in the error divided by the error itself is less than this.")
+    ("max-pair-distance", po::value(&opt.max_pair_distance)->default_value(-1.0),
+     "Find correspondences only between clouds whose bounding boxes are within this distance, in meters. This is much faster for many clouds of which only some overlap. Set to a negative value to use all pairs of clouds.")
     ("align-to-first-cloud", po::bool_switch(&opt.align_to_first_cloud)->default_value(false)->implicit_value(true),
      "Align the other clouds to the first one, rather than to their common centroid.")
     ("verbose", po::bool_switch(&opt.verbose)->default_value(false)->implicit_value(true),
@@ -279,24 +281,29 @@ void BuildKDTree_double(std::vector<vw::Vector3> const& cloud, KDTree_double* tr
   *tree = temp_tree;
 }
 
-void SearchKDTree_double(KDTree_double* tree, const vw::Vector3& input, 
-                         std::vector<int>& indices,
-                         std::vector<double>& dists, int nn){
-  int rows_t = 1;
-  int dim = input.size();
-  
-  std::vector<double> query;
-  query.resize(rows_t*dim);
-  for (int i = 0; i < dim; i++)
-    query[i] = input[i];
-  flann::Matrix<double> query_mat(&query[0], rows_t, dim);
-  
-  indices.resize(rows_t*nn);
-  dists.resize(rows_t*nn);
-  flann::Matrix<int> indices_mat(&indices[0], rows_t, nn);
-  flann::Matrix<double> dists_mat(&dists[0], rows_t, nn);
-  
-  tree->knnSearch(query_mat, indices_mat, dists_mat, nn, flann::SearchParams(ONE_TWO_EIGHT));
+/// Find the index of the nearest neighbor in the tree of each point in
+/// the cloud. All queries are done in one call, which flann spreads
+/// over several threads.
+void FindNearestNeighbors(KDTree_double* tree, std::vector<vw::Vector3> const& cloud,
+                          std::vector<int>& indices){
+  int rows = cloud.size();
+  int dim = vw::Vector3().size();
+  indices.resize(rows);
+  if (rows == 0)
+    return;
+
+  std::vector<double> query(rows * dim), dists(rows);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < dim; j++)
+      query[i * dim + j] = cloud[i][j];
+  }
+  flann::Matrix<double> query_mat(&query[0], rows, dim);
+  flann::Matrix<int> indices_mat(&indices[0], rows, 1);
+  flann::Matrix<double> dists_mat(&dists[0], rows, 1);
+
+  flann::SearchParams params(ONE_TWO_EIGHT);
+  params.cores = vw_settings().default_num_threads();
+  tree->knnSearch(query_mat, indices_mat, dists_mat, 1, params);
 }
 
 std::string transform_file(std::string const& out_prefix, int index){
@@ -466,6 +473,13 @@ int main(int argc, char *argv[]){
       }
       modelSpan[numClouds] = numOfPoints;
 
+      // The current bounding box of each cloud, to skip pairs of clouds which are far
+      std::vector<vw::BBox3> boxes(numClouds);
+      for (int it = 0; it < numClouds; it++) {
+        for (size_t pointIter = 0; pointIter < clouds[it].size(); pointIter++)
+          boxes[it].grow(clouds[it][pointIter]);
+      }
+
       // This will record for each point in each cloud which point in
       // every other cloud is closest to it. This matrix will store the
       // indices of these points.
@@ -496,25 +510,31 @@ int main(int argc, char *argv[]){
           int beg = modelSpan[j], end = modelSpan[j+1] - 1;
           for (int it = beg; it <= end; it++) spanJ.push_back(it);
         
-          std::vector<int> match, match2;
-          std::vector<double> dist;
+          if (opt.max_pair_distance >= 0) {
+            vw::BBox3 box_i = boxes[i];
+            box_i.expand(opt.max_pair_distance);
+            if (!box_i.intersects(boxes[j]))
+              continue;
+          }
+
+          std::vector<int> match;
           typedef std::set<std::pair<int, int>, CustomCompare> PairType;
 
           // For each point in cloud i, find a match in cloud j
           PairType Corr1;
+          FindNearestNeighbors(Trees[j].get(), clouds[i], match);
           for (size_t index_i = 0; index_i < clouds[i].size(); index_i++){
-            SearchKDTree_double(Trees[j].get(), clouds[i][index_i], match, dist, 1);
-            if (match.empty()) continue; // should not happen
-            int index_j = match[0];
+            int index_j = match[index_i];
+            if (index_j < 0) continue; // should not happen
             Corr1.insert(std::pair<int, int>(index_j, index_i));
           }
 
           // Now do it in reverse
           PairType Corr2;
+          FindNearestNeighbors(Trees[i].get(), clouds[j], match);
           for (size_t index_j = 0; index_j < clouds[j].size(); index_j++){
-            SearchKDTree_double(Trees[i].get(), clouds[j][index_j], match, dist, 1);
-            if (match.empty()) continue; // should not happen
-            int index_i = match[0];
+            int index_i = match[index_j];
+            if (index_i < 0) continue; // should not happen
             Corr2.insert(std::pair<int, int>(index_j, index_i));
           }
 
@@ -602,7 +622,11 @@ int main(int argc, char *argv[]){
 
 	  numErrors++;
         }
-	
+
+        // A cloud far from all others has no correspondences
+        if (src.size() < 3)
+          continue;
+
         computeRigidTransform(src, dst, rot, trans);
 
         // Update the output transforms
@@ -628,8 +652,8 @@ int main(int argc, char *argv[]){
 
       }
 
-      errBefore /= numErrors;
-      errAfter /= numErrors;
+      errBefore /= std::max(numErrors, 1);
+      errAfter /= std::max(numErrors, 1);
 
       if (firstStep) {
         initError = errBefore;
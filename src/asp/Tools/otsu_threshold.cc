@@ -22,10 +22,14 @@
 
 #include <limits>
 
+#include <vw/Core/Settings.h>
 #include <vw/FileIO/DiskImageUtils.h>
-#include <vw/Image/Statistics.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMath.h>
 
 #include <asp/Core/Common.h>
+#include <asp/Core/ImageHistogram.h>
 #include <asp/Core/Macros.h>
 
 namespace po = boost::program_options;
@@ -118,33 +122,32 @@ int main( int argc, char *argv[] ) {
       double samp_ratio = 1.0;
       if (opt.num_samples > 0) 
         samp_ratio = sqrt(double(num_vals) / double(opt.num_samples));
-      samp_ratio = std::max(samp_ratio, 1.0);
+      int subsample_amt = std::max((int)round(samp_ratio), 1);
 
-      std::int64_t num_sample_rows = round(num_rows / samp_ratio);
-      num_sample_rows = std::max(std::int64_t(1), num_sample_rows);
-      num_sample_rows = std::min(num_rows, num_sample_rows);
-      
-      std::int64_t num_sample_cols = round(num_cols / samp_ratio);
-      num_sample_cols = std::max(std::int64_t(1), num_sample_cols);
-      num_sample_cols = std::min(num_cols, num_sample_cols);
-      
       std::cout << "Number of image rows and columns: "
                 << num_rows << ", " << num_cols << "\n";
-      std::cout << "Picking a uniform sample of dimensions "
-                << num_sample_rows << ", " << num_sample_cols << "\n";
+      std::cout << "Picking one out of every " << subsample_amt
+                << " image rows and columns.\n";
       std::cout << "Number of bins in the histogram: " << opt.num_bins << std::endl;
-      std::cout << "It may take several minutes to find the answer.\n";
 
-      // The mask creation can handle a NaN for the opt.nodata_value.
-      double threshold = vw::otsu_threshold(create_mask(image, opt.nodata_value),
-                                               num_sample_rows, num_sample_cols,
-                                               opt.num_bins);
+      // The histogram is saved next to the image, so that later runs
+      // need not read the image again. The mask creation can handle a
+      // NaN for the opt.nodata_value.
+      int band = 0;
+      std::string hist_file = asp::image_histogram_file(image_file, band);
+      std::string hist_key = asp::image_histogram_key(image_file, band, opt.nodata_value,
+                                                      subsample_amt, BBox2i());
+      asp::ImageHistogram hist
+        = asp::cached_image_histogram(subsample(create_mask(pixel_cast<double>(image),
+                                                            opt.nodata_value),
+                                                subsample_amt),
+                                      hist_file, hist_key, opt.num_bins,
+                                      vw_settings().default_num_threads());
+      if (hist.empty())
+        vw_throw(ArgumentErr() << "Found no valid pixels in image: " << image_file << "\n");
+
+      double threshold = hist.otsu_threshold(opt.num_bins);
 
-
-      // A different implementation, which gives the same result
-      // if above the full image is sampled and 256 bins are used.
-      //double threshold2 = vw::otsu_threshold(create_mask(image, opt.nodata_value));
-      
       vw_out() << std::setprecision(16)
         << "Otsu threshold for image " << image_file << ": " << threshold << "\n";
     }
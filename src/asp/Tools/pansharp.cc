@@ -28,6 +28,7 @@ using namespace vw::cartography;
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/TileKernelView.h>
 #include <asp/Camera/RPC_XML.h>
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
@@ -83,65 +84,42 @@ T ycbcrToRgb(T const& ycbcr, double min_val, double max_val) {
 
 
 
-/// Image view class which applies a pan sharp algorithm.
-/// - This takes a gray and an RGB image as input and generates an RGB image as output.
+/// Functor which applies a pan sharp algorithm to a pair of pixels.
+/// - This takes a gray and an RGB pixel as input and generates an RGB pixel as output.
 /// - This operation is not particularly useful unless the gray image is higher
 ///   resolution than the RGB image.
-template <class ImageGrayT, class ImageColorT, typename DataTypeT>
-class PanSharpView : public ImageViewBase<PanSharpView<ImageGrayT, ImageColorT, DataTypeT> > {
+template <typename DataTypeT>
+class PanSharpFunc {
 
 public: // Definitions
 
-  typedef PixelRGB<DataTypeT> pixel_type;  // This is what controls the type of image that is written to disk.
-  typedef pixel_type          result_type;
+  typedef PixelRGB<DataTypeT> result_type; // This is what controls the type of image that is written to disk.
 
 private: // Variables
 
-  // TODO: These should be Ref views and masked?
-  ImageGrayT  const& m_gray_image;
-  ImageColorT const& m_color_image;
-
   DataTypeT m_output_nodata;
   DataTypeT m_min_val;
   DataTypeT m_max_val;
 
-  int m_num_rows;
-  int m_num_cols;
-
 public: // Functions
 
   // Constructor
-  PanSharpView( ImageGrayT  const& gray_image,
-                ImageColorT const& color_image,
-                DataTypeT          outputNodata,
-                DataTypeT          min_value,
-                DataTypeT          max_value)
-                  : m_gray_image(gray_image), m_color_image(color_image),
-                    m_output_nodata(outputNodata),
+  PanSharpFunc(DataTypeT outputNodata,
+               DataTypeT min_value,
+               DataTypeT max_value)
+                  : m_output_nodata(outputNodata),
                     m_min_val(min_value),
-                    m_max_val(max_value) {
-    // The images are assumed to be the same size (possibly due to transforms)
-    m_num_rows     = m_gray_image.rows();
-    m_num_cols     = m_gray_image.cols();
-  }
-
-  inline int32 cols  () const { return m_num_cols; }
-  inline int32 rows  () const { return m_num_rows; }
-  inline int32 planes() const { return 1; }
-
-  inline result_type operator()( int32 i, int32 j, int32 p=0 ) const
-  {
-    return 0; // NOT IMPLEMENTED!
-  }
-
-  typedef ProceduralPixelAccessor<PanSharpView<ImageGrayT, ImageColorT, DataTypeT> > pixel_accessor;
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
+                    m_max_val(max_value) {}
 
   /// Apply pansharp algorithm to a single pair of pixels.
   /// - Any required interpolation etc. will have already happened by now.
   template <class P1, class P2>
-  result_type convert_pixel(P1 const& gray_pixel, P2 const& color_pixel) const {
+  result_type operator()(P1 const& gray_pixel, P2 const& color_pixel) const {
+
+    // Check for a masked pixel
+    if (!is_valid(gray_pixel) || !is_valid(color_pixel))
+      return result_type(m_output_nodata);
+
     // Convert RGB to YCbCr
     P2 temp = rgbToYCbCr(color_pixel, m_min_val, m_max_val);
     result_type ycbcr_pixel(temp[0], temp[1], temp[2]); // Extra step breaks any type dependency from the inputs
@@ -153,59 +131,21 @@ public: // Functions
     return ycbcrToRgb(ycbcr_pixel, m_min_val, m_max_val);
   }
 
-
-  typedef CropView<ImageView<result_type> > prerasterize_type;
-  inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-
-    // Set up the output image tile
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-
-    // Loop through each output pixels and compute each output value
-    for (int c = 0; c < bbox.width(); c++) {
-      int source_c = c + bbox.min()[0];
-      for (int r = 0; r < bbox.height(); r++) {
-        int source_r = r + bbox.min()[1];
-
-        // Check for a masked pixel
-        if ( !is_valid(m_gray_image (source_c, source_r)) ||
-             !is_valid(m_color_image(source_c, source_r))  ) {
-          tile(c, r) = m_output_nodata;
-          continue;
-        }
-
-        // Pass the two input pixels into the conversion function
-        //result_type output_pixel = convert_pixel(m_gray_image(source_c, r), m_color_image(source_c, r));
-        tile(c,r) = convert_pixel(m_gray_image (source_c, source_r),
-                                  m_color_image(source_c, source_r));
-
-      } // End row loop
-    } // End column loop
-
-    // Return the tile we created with fake borders to make it look the size of the entire output image
-    return prerasterize_type(tile,
-                             -bbox.min().x(), -bbox.min().y(),
-                             cols(), rows() );
-
-  } // End prerasterize function
-
- template <class DestT>
- inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
-   vw::rasterize( prerasterize(bbox), dest, bbox );
- }
-
-}; // End class PanSharpView
+}; // End class PanSharpFunc
 
 
-/// Convenience function
+/// Convenience function. The images are assumed to be the same size
+/// (possibly due to transforms). Each tile of each is read once.
 template <class ImageGrayT, class ImageColorT, typename DataTypeT>
-PanSharpView<ImageGrayT, ImageColorT, DataTypeT>
+asp::TileKernelView<asp::PerPixelKernel<PanSharpFunc<DataTypeT>>, ImageGrayT, ImageColorT>
 inline pansharp_view( ImageGrayT  const& gray_image,
                       ImageColorT const& color_image,
                       DataTypeT          output_nodata,
                       DataTypeT          min_value,
                       DataTypeT          max_value ) {
-  return PanSharpView<ImageGrayT, ImageColorT, DataTypeT>
-    (gray_image, color_image, output_nodata, min_value, max_value);
+  return asp::tile_kernel_view
+    (asp::per_pixel_kernel(PanSharpFunc<DataTypeT>(output_nodata, min_value, max_value)),
+     gray_image, color_image);
 }
 
 
@@ -53,6 +53,7 @@
 #include <FastGlobalRegistration/app.h>
 
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Math/EulerAngles.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Cartography/Datum.h>
@@ -64,10 +65,12 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/DemHillshade.h>
 #include <asp/Tools/pc_align_utils.h>
 
 #include <limits>
 #include <cstring>
+#include <sstream>
 #include <thread>
 #include <omp.h>
 
@@ -93,10 +96,11 @@ struct Options : public vw::GdalWriteOptions {
   // Input
   string reference, source, init_transform_file, alignment_method, config_file,
     datum, csv_format_str, csv_proj4_str, match_file, hillshade_options,
-    ipfind_options, ipmatch_options, fgr_options;
+    ipfind_options, ipmatch_options, fgr_options, reference_cache_dir;
   Vector2 initial_transform_ransac_params;
   PointMatcher<RealT>::Matrix init_transform;
   int    num_iter,
+         hillshade_subsample,
          max_num_reference_points,
          max_num_source_points;
   double diff_translation_err,
@@ -169,9 +173,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                                  "Initialize the alignment transform as the rotation with this angle (in degrees) around the axis going from the planet center to the centroid of the point cloud. If --initial-ned-translation is also specified, the translation gets applied after the rotation.")
 
     ("initial-transform-from-hillshading", po::value(&opt.hillshading_transform)->default_value(""), "If both input clouds are DEMs, find interest point matches among their hillshaded versions, and use them to compute an initial transform to apply to the source cloud before proceeding with alignment. Specify here the type of transform, as one of: 'similarity' (rotation + translation + scale), 'rigid' (rotation + translation) or 'translation'. See the options further down for tuning this.")
-    ("hillshade-options", po::value(&opt.hillshade_options)->default_value("--azimuth 300 --elevation 20 --align-to-georef"), "Options to pass to the hillshade program when computing the transform from hillshading.")
-    ("ipfind-options", po::value(&opt.ipfind_options)->default_value("--ip-per-image 1000000 --interest-operator sift --descriptor-generator sift"), "Options to pass to the ipfind program when computing the transform from hillshading.")
-    ("ipmatch-options", po::value(&opt.ipmatch_options)->default_value("--inlier-threshold 100 --ransac-iterations 10000 --ransac-constraint similarity"), "Options to pass to the ipmatch program when computing the transform from hillshading.")
+    ("hillshade-options", po::value(&opt.hillshade_options)->default_value("--azimuth 300 --elevation 20 --align-to-georef"), "Hillshading options when computing the transform from hillshading, as for the hillshade program. Only --azimuth and --elevation are used.")
+    ("ipfind-options", po::value(&opt.ipfind_options)->default_value("--ip-per-image 1000000 --interest-operator sift --descriptor-generator sift"), "Interest point options when computing the transform from hillshading, as for the ipfind program. Only --ip-per-image and --interest-operator (sift, orb, or obalog) are used.")
+    ("ipmatch-options", po::value(&opt.ipmatch_options)->default_value("--inlier-threshold 100 --ransac-iterations 10000 --ransac-constraint similarity"), "Kept for compatibility. The matches from hillshading are filtered with the RANSAC of --initial-transform-ransac-params.")
+    ("hillshade-subsample", po::value(&opt.hillshade_subsample)->default_value(0), "Hillshade the DEMs at this factor coarser than their grid when computing the transform from hillshading. If 0, choose it for each DEM so that it has at most 16 million pixels.")
     ("match-file", po::value(&opt.match_file)->default_value(""), "Compute a translation + rotation + scale transform from the source to the reference point cloud using manually selected point correspondences from the reference to the source (obtained for example using stereo_gui). It may be desired to change --initial-transform-ransac-params if it rejects as outliers some manual matches.")
     ("initial-transform-ransac-params", po::value(&opt.initial_transform_ransac_params)->default_value(Vector2(10000, 1.0), "num_iter factor"),
      "When computing an initial transform based on hillshading, use "
@@ -182,6 +187,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("no-dem-distances",         po::bool_switch(&opt.dont_use_dem_distances)->default_value(false)->implicit_value(true),
                                  "For reference point clouds that are DEMs, don't take advantage of the fact that it is possible to interpolate into this DEM when finding the closest distance to it from a point in the source cloud and hence the error metrics.")
 
+    ("reference-cache-dir",      po::value(&opt.reference_cache_dir)->default_value(""),
+     "If the reference cloud is a CSV or LAS file, save all its points in this directory in a binary format grouped by location, and reuse them in later runs with the same reference, rather than parsing it again. Only the parts overlapping the source cloud are read.")
+
     ("config-file",              po::value(&opt.config_file)->default_value(""),
      "This is an advanced option. Read the alignment parameters from a configuration file, in the format expected by libpointmatcher, over-riding the command-line options.");
 
@@ -246,6 +254,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
               << "Cannot specify an initial transform both from a file "
               << "and as a NED vector or rotation angle.\n");
 
+  if (opt.hillshade_subsample < 0)
+    vw_throw(ArgumentErr() << "The value of --hillshade-subsample must be non-negative.\n");
+
   if ( (opt.hillshading_transform != "" || opt.match_file != "") &&
        (opt.initial_ned_translation != "" || opt.init_transform_file != "" ||
         opt.initial_rotation_angle != 0)) {
@@ -464,40 +475,89 @@ void save_errors(DP const& point_cloud,
   outfile.close();
 }
 
+/// Compute the errors to a DEM for a range of points, as done by calcErrorsWithDem().
+/// - Each task has its own copy of the georeference, so that the
+///   projections do not share state. The DEM heights for the range
+///   are looked up together, tile by tile.
+class DemErrorTask: public vw::Task, private boost::noncopyable {
+  DP                                   const& m_point_cloud;
+  vw::Vector3                                 m_point_cloud_shift;
+  vw::cartography::GeoReference               m_georef;
+  asp::DemTileStore                           m_dem;
+  std::int64_t                                m_beg, m_end;
+  std::vector<double>                       & m_errors; // alias, each task writes its range
+
+public:
+  DemErrorTask(DP                                   const& point_cloud,
+               vw::Vector3                          const& point_cloud_shift,
+               vw::cartography::GeoReference        const& georef,
+               asp::DemTileStore                    const& dem,
+               std::int64_t beg, std::int64_t end,
+               std::vector<double> & errors):
+    m_point_cloud(point_cloud), m_point_cloud_shift(point_cloud_shift),
+    m_georef(georef), m_dem(dem), m_beg(beg), m_end(end), m_errors(errors) {}
+
+  void operator()() {
+    std::vector<Vector2> pixels(m_end - m_beg);
+    std::vector<double> point_heights(m_end - m_beg), dem_heights;
+    for (std::int64_t i = m_beg; i < m_end; i++){
+      // Extract and un-shift the point to get the real GCC coordinate
+      Vector3 gcc_coord = get_cloud_gcc_coord(m_point_cloud, m_point_cloud_shift, i);
+
+      // Convert from GDC to GCC
+      Vector3 llh = m_georef.datum().cartesian_to_geodetic(gcc_coord); // lon-lat-height
+      point_heights[i - m_beg] = llh[2];
+
+      // Convert the lon/lat location into a pixel in the DEM. A pixel
+      // which cannot be found is outside the DEM.
+      try {
+        pixels[i - m_beg] = m_georef.lonlat_to_pixel(subvector(llh, 0, 2));
+      } catch(...) {
+        pixels[i - m_beg] = Vector2(-1, -1);
+      }
+    }
+
+    // Interpolate the DEM at these locations
+    m_dem.heights(pixels, dem_heights);
+
+    for (std::int64_t i = m_beg; i < m_end; i++){
+      double dem_height_here = dem_heights[i - m_beg];
+      if (std::isnan(dem_height_here)) {
+        // If we did not intersect the DEM, record a flag error value here.
+        m_errors[i] = BIG_NUMBER;
+      }
+      else { // Success, the error is the absolute height difference
+        m_errors[i] = std::abs(point_heights[i - m_beg] - dem_height_here);
+      }
+    }
+  }
+};
+
 /// Like PM::ICP::filterGrossOutliersAndCalcErrors, except comparing to a DEM instead.
 /// - The point cloud is in GCC coordinates with point_cloud_shift subtracted from each point.
 /// - The output is put in the "errors" vector for each point.
 /// - If there is a problem computing the point error, a very large number is used as a flag.
+/// - The points are split into ranges which are processed in parallel.
 void calcErrorsWithDem(DP          const& point_cloud,
                        vw::Vector3 const& point_cloud_shift,
                        vw::cartography::GeoReference        const& georef,
-                       vw::ImageViewRef< PixelMask<float> > const& dem,
+                       asp::DemTileStore                    const& dem,
                        std::vector<double> &errors) {
 
   // Initialize output error storage
   const std::int64_t num_pts = point_cloud.features.cols();
   errors.resize(num_pts);
 
-  // Loop through every point in the point cloud
-  double dem_height_here;
-  for (std::int64_t i = 0; i < num_pts; i++){
-    // Extract and un-shift the point to get the real GCC coordinate
-    Vector3 gcc_coord = get_cloud_gcc_coord(point_cloud, point_cloud_shift, i);
-
-    // Convert from GDC to GCC
-    Vector3 llh = georef.datum().cartesian_to_geodetic(gcc_coord); // lon-lat-height
-
-    // Interpolate the point at this location
-    if (!interp_dem_height(dem, georef, llh, dem_height_here)) {
-      // If we did not intersect the DEM, record a flag error value here.
-      errors[i] = BIG_NUMBER;
-    }
-    else { // Success, the error is the absolute height difference
-      errors[i] = std::abs(llh[2] - dem_height_here);
-    }
-
-  } // End loop through all points
-
+  // Large enough ranges that the task overhead does not matter
+  const std::int64_t range_size = 100000;
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (std::int64_t beg = 0; beg < num_pts; beg += range_size) {
+    std::int64_t end = std::min(num_pts, beg + range_size);
+    boost::shared_ptr<DemErrorTask>
+      task(new DemErrorTask(point_cloud, point_cloud_shift, georef, dem, beg, end, errors));
+    queue.add_task(task);
+  }
+  queue.join_all();
 }
 
 template<class F>
@@ -629,7 +689,7 @@ fgr_alignment(DP const & source_point_cloud, DP const & ref_point_cloud, Options
 // clouds.
 struct PointToDemError {
   PointToDemError(Vector3 const& point,
-		 ImageViewRef< PixelMask<float> > const& dem,
+		 asp::DemTileStore const& dem,
 		 cartography::GeoReference const& geo):
     m_point(point), m_dem(dem), m_geo(geo){}
 
@@ -664,7 +724,7 @@ struct PointToDemError {
   // Factory to hide the construction of the CostFunction object from
   // the client code.
   static ceres::CostFunction* Create(Vector3 const& point,
-				     ImageViewRef< PixelMask<float> > const& dem,
+				     asp::DemTileStore const& dem,
 				     vw::cartography::GeoReference const& geo){
     return (new ceres::NumericDiffCostFunction<PointToDemError,
 	    ceres::CENTRAL, 1, 6, 1>
@@ -672,7 +732,7 @@ struct PointToDemError {
   }
 
   Vector3                                  m_point;
-  ImageViewRef< PixelMask<float> > const & m_dem;    // alias
+  asp::DemTileStore                const & m_dem;    // alias
   cartography::GeoReference        const & m_geo;    // alias
 };
 
@@ -681,7 +741,7 @@ PointMatcher<RealT>::Matrix
 least_squares_alignment(DP const& source_point_cloud, // Should not be modified
 			vw::Vector3 const& point_cloud_shift,
 			vw::cartography::GeoReference        const& dem_georef,
-			vw::ImageViewRef< PixelMask<float> > const& dem_ref,
+			asp::DemTileStore                    const& dem_ref,
 			Options const& opt) {
 
   ceres::Problem problem;
@@ -811,7 +871,7 @@ double compute_registration_error(DP          const& ref_point_cloud,
                                   PM::ICP          & pm_icp_object, // Must already be initialized
                                   vw::Vector3 const& shift,
                                   vw::cartography::GeoReference        const& dem_georef,
-                                  vw::ImageViewRef< PixelMask<float> > const& dem_ref,
+                                  asp::DemTileStore                    const& dem_ref,
                                   Options const& opt,
                                   PointMatcher<RealT>::Matrix &error_matrix) {
   Stopwatch sw;
@@ -845,7 +905,7 @@ void filter_source_cloud(DP          const& ref_point_cloud,
                          PM::ICP          & pm_icp_object, // Must already be initialized
                          vw::Vector3 const& shift,
                          vw::cartography::GeoReference        const& dem_georef,
-                         vw::ImageViewRef< PixelMask<float> > const& dem_ref,
+                         asp::DemTileStore                    const& dem_ref,
                          Options const& opt) {
 
   // Filter gross outliers
@@ -905,10 +965,28 @@ std::string alignment_method_fallback(std::string const& alignment_method){
   return alignment_method;
 }
 
-// Hillshade the reference and source DEMs, and use them to find
-// interest point matches among the hillshaded images.  These will be
-// used later to find a rotation + translation + scale transform.
-std::string find_matches_from_hillshading(Options & opt, std::string const& curr_exec_path){
+// The value following the given flag in a string of options, as passed
+// to one of the programs hillshade, ipfind, or ipmatch, or the default
+// if the flag is absent.
+std::string option_value(std::string const& options, std::string const& flag,
+                         std::string const& default_val) {
+  std::istringstream is(options);
+  std::string token, val;
+  while (is >> token) {
+    if (token == flag && is >> val)
+      return val;
+  }
+  return default_val;
+}
+
+// Hillshade the reference and source DEMs in memory, and find
+// interest point matches among the hillshaded images. These will be
+// used later to find a rotation + translation + scale transform. The
+// matches are in full-resolution DEM pixels. They are also saved to a
+// match file, which can be passed later with --match-file.
+void find_matches_from_hillshading(Options const& opt,
+                                   std::vector<vw::ip::InterestPoint> & ref_ip,
+                                   std::vector<vw::ip::InterestPoint> & source_ip) {
 
   // First, this works only for DEMs
   if (asp::get_cloud_type(opt.reference) != "DEM" ||
@@ -918,66 +996,77 @@ std::string find_matches_from_hillshading(Options & opt, std::string const& curr
               << "DEMs from the input point clouds. Then this transform can be used "
               << "with the original clouds.\n" );
 
-  // Find the needed executables
-  std::string hillshade_path = vw::program_path("hillshade", curr_exec_path);
-  std::string ipfind_path    = vw::program_path("ipfind",    curr_exec_path);
-  std::string ipmatch_path   = vw::program_path("ipmatch",   curr_exec_path);
-
-  // Hillshade the reference
-  std::string ref_hillshade = opt.out_prefix + "-reference_hillshade.tif";
-  std::string cmd = hillshade_path + " " + opt.hillshade_options + " "
-    + opt.reference + " -o " + ref_hillshade;
-  vw_out() << cmd << std::endl;
-  std::string ans = vw::exec_cmd(cmd.c_str());
-  vw_out() << ans << std::endl;
-  
-  // Hillshade the source
-  std::string source_hillshade = opt.out_prefix + "-source_hillshade.tif";
-  cmd = hillshade_path + " " + opt.hillshade_options + " "
-    + opt.source + " -o " + source_hillshade;
-  vw_out() << cmd << std::endl;
-  ans = vw::exec_cmd(cmd.c_str());
-  vw_out() << ans << std::endl;
-
-  // IP find
-  cmd = ipfind_path + " " + opt.ipfind_options + " " + ref_hillshade + " " + source_hillshade;
-  vw_out() << cmd << std::endl;
-  ans = vw::exec_cmd(cmd.c_str());
-  vw_out() << ans << std::endl;
-
-  // IP match
-  std::string ref_ip    = fs::path(ref_hillshade).replace_extension(".vwip").string();
-  std::string source_ip = fs::path(source_hillshade).replace_extension(".vwip").string();
-
-  cmd = ipmatch_path + " " + opt.ipmatch_options + " "
-    + ref_hillshade + " " + ref_ip + " " + source_hillshade + " " + source_ip + " -o "
-    + opt.out_prefix;
-  vw_out() << cmd << std::endl;
-  ans = vw::exec_cmd(cmd.c_str());
-  vw_out() << ans << std::endl;
-
-  // The name of the file where the matches are written to
-  std::string match_file = vw::ip::match_filename(opt.out_prefix, ref_hillshade, source_hillshade);
-  
-  return match_file;
+  double azimuth   = atof(option_value(opt.hillshade_options, "--azimuth",   "300").c_str());
+  double elevation = atof(option_value(opt.hillshade_options, "--elevation", "20").c_str());
+  std::string op   = option_value(opt.ipfind_options, "--interest-operator", "sift");
+  boost::algorithm::to_lower(op);
+  if (op == "sift")
+    asp::stereo_settings().ip_matching_method = asp::DETECT_IP_METHOD_SIFT;
+  else if (op == "orb")
+    asp::stereo_settings().ip_matching_method = asp::DETECT_IP_METHOD_ORB;
+  else if (op == "obalog")
+    asp::stereo_settings().ip_matching_method = asp::DETECT_IP_METHOD_INTEGRAL;
+  else
+    vw_throw(ArgumentErr() << "Unsupported interest operator in --ipfind-options: "
+             << op << ".\n");
+  asp::stereo_settings().ip_per_image
+    = atoi(option_value(opt.ipfind_options, "--ip-per-image", "0").c_str());
+
+  // Hillshade each DEM at a resolution where it has a manageable size.
+  // The shade is between 0 and 1, as the detectors expect.
+  const double max_pixels = 16.0e+6;
+  const float shade_nodata = -1.0;
+  std::string files[2] = {opt.reference, opt.source};
+  std::string names[2] = {"reference", "source"};
+  vw::ImageView<float> shade[2];
+  int factor[2];
+  for (int it = 0; it < 2; it++) {
+    factor[it] = opt.hillshade_subsample;
+    if (factor[it] == 0) {
+      DiskImageView<float> dem(files[it]);
+      factor[it] = asp::subsample_factor(dem.cols(), dem.rows(), max_pixels);
+    }
+    vw_out() << "Hillshading the " << names[it] << " DEM at a subsample factor of "
+             << factor[it] << ".\n";
+    asp::hillshade_dem_file(files[it], factor[it], azimuth, elevation, shade_nodata,
+                            shade[it]);
+  }
+
+  int ip_per_tile = 0; // use ip per image
+  asp::detect_match_ip(ref_ip, source_ip, shade[0], shade[1], ip_per_tile,
+                       "", "", // Do not read ip from disk
+                       shade_nodata, shade_nodata);
+
+  // Go to full-resolution pixels
+  for (size_t it = 0; it < ref_ip.size(); it++) {
+    ref_ip[it].x    *= factor[0];
+    ref_ip[it].y    *= factor[0];
+    ref_ip[it].ix   *= factor[0];
+    ref_ip[it].iy   *= factor[0];
+    source_ip[it].x  *= factor[1];
+    source_ip[it].y  *= factor[1];
+    source_ip[it].ix *= factor[1];
+    source_ip[it].iy *= factor[1];
+  }
+
+  std::string match_file = vw::ip::match_filename(opt.out_prefix, opt.reference, opt.source);
+  vw_out() << "Writing: " << match_file << "\n";
+  vw::ip::write_binary_match_file(match_file, ref_ip, source_ip);
 }
 
 // Compute an initial source to reference transform based on tie points (interest point matches).
 PointMatcher<RealT>::Matrix
-initial_transform_from_match_file(std::string const& ref_file,
-                                  std::string const& source_file,
-                                  std::string const& match_file,
-                                  std::string const& hillshading_transform,
-                                  Vector2 initial_transform_ransac_params){
+initial_transform_from_matches(std::string const& ref_file,
+                               std::string const& source_file,
+                               std::vector<vw::ip::InterestPoint> const& ref_ip,
+                               std::vector<vw::ip::InterestPoint> const& source_ip,
+                               std::string const& hillshading_transform,
+                               Vector2 initial_transform_ransac_params){
   
   if (asp::get_cloud_type(ref_file) != "DEM" ||
       asp::get_cloud_type(source_file) != "DEM" )
     vw_throw( ArgumentErr() << "The alignment transform computation based on manually chosen point matches only works for DEMs. Use point2dem to first create DEMs from the input point clouds.\n" );
 
-  vector<vw::ip::InterestPoint> ref_ip, source_ip;
-  vw_out() << "Reading match file: " << match_file << "\n";
-  vw::ip::read_binary_match_file(match_file, ref_ip, source_ip);
-
   DiskImageView<float> ref(ref_file);
   vw::cartography::GeoReference ref_geo;
   bool has_ref_geo = vw::cartography::read_georeference(ref_geo, ref_file);
@@ -1056,7 +1145,7 @@ initial_transform_from_match_file(std::string const& ref_file,
   globalT.block(0, 0, DIM, DIM) = vw_matrix3_to_eigen(rotation*scale);
   globalT.block(0, DIM, DIM, 1) = vw_vector3_to_eigen(translation);
 
-  vw_out() << "Transform computed from source to reference using a match file:\n"
+  vw_out() << "Transform computed from source to reference using interest point matches:\n"
            << globalT << std::endl;
 
   return globalT;
@@ -1094,7 +1183,8 @@ PointMatcher<RealT>::Matrix ned_to_caresian_transform(vw::cartography::Datum con
 // Estimate the centroid of the reference points
 vw::Vector3 estimate_ref_cloud_centroid(vw::cartography::GeoReference const& geo,
                                         CsvConv const& csv_conv,
-                                        std::string const& file_name){
+                                        std::string const& file_name,
+                                        asp::PointCache const& cache){
   Stopwatch sw;
   sw.start();
   
@@ -1110,9 +1200,9 @@ vw::Vector3 estimate_ref_cloud_centroid(vw::cartography::GeoReference const& geo
   // Load a sample of points, hopefully enough to estimate the centroid
   // reliably.
   int num_sample_pts = 1000000;
-  load_cloud(file_name, num_sample_pts, dummy_box,
-	     calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-	     median_longitude, verbose, points);
+  load_cloud_or_cache(cache, file_name, num_sample_pts, dummy_box,
+                      calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
+                      median_longitude, verbose, points);
 
 
   int numRefPts = points.features.cols();
@@ -1186,19 +1276,28 @@ int main( int argc, char *argv[] ) {
                 opt.semi_major_axis, opt.semi_minor_axis,  
                 opt.csv_format_str,  csv_conv, geo);
 
-    // Use hillshading to create a match file
-    if (opt.hillshading_transform != "" && opt.match_file == "")
-      opt.match_file = find_matches_from_hillshading(opt, argv[0]);
-    
-    // Create a transform based on a match file, either automatically generated, or
-    // user-made (normally with stereo_gui).
-    if (opt.match_file != "") {
+    // The reference is often the same for many runs, so its points
+    // may be cached. This does nothing if caching is not enabled.
+    asp::PointCache ref_cache;
+    open_point_cache(opt.reference_cache_dir, opt.reference, opt.csv_format_str,
+                     opt.csv_proj4_str, geo, csv_conv, opt.verbose, ref_cache);
+
+    // Create a transform based on interest point matches, either found
+    // from hillshading, or user-made (normally with stereo_gui).
+    if (opt.hillshading_transform != "" || opt.match_file != "") {
+      vector<vw::ip::InterestPoint> ref_ip, source_ip;
+      if (opt.match_file == "") {
+        find_matches_from_hillshading(opt, ref_ip, source_ip);
+      } else {
+        vw_out() << "Reading match file: " << opt.match_file << "\n";
+        vw::ip::read_binary_match_file(opt.match_file, ref_ip, source_ip);
+      }
       if (opt.hillshading_transform == "") 
         opt.hillshading_transform = "similarity";
-      opt.init_transform = initial_transform_from_match_file(opt.reference, opt.source,
-                                                             opt.match_file,
-                                                             opt.hillshading_transform,
-                                                             opt.initial_transform_ransac_params);
+      opt.init_transform = initial_transform_from_matches(opt.reference, opt.source,
+                                                          ref_ip, source_ip,
+                                                          opt.hillshading_transform,
+                                                          opt.initial_transform_ransac_params);
     }
 
     // See if to apply an initial north-east-down translation relative
@@ -1207,7 +1306,7 @@ int main( int argc, char *argv[] ) {
     // happens first.
     if (opt.initial_rotation_angle != 0 || opt.initial_ned_translation != "") {
 
-      vw::Vector3 centroid = estimate_ref_cloud_centroid(geo, csv_conv, opt.reference);
+      vw::Vector3 centroid = estimate_ref_cloud_centroid(geo, csv_conv, opt.reference, ref_cache);
 
       // Ignore any other initializations so far
       opt.init_transform = PointMatcher<RealT>::Matrix::Identity(DIM + 1, DIM + 1);
@@ -1243,10 +1342,10 @@ int main( int argc, char *argv[] ) {
 
     PointMatcher<RealT>::Matrix inv_init_trans = opt.init_transform.inverse();
     calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                              opt.reference, opt.max_disp, inv_init_trans,
+                              opt.reference, ref_cache, opt.max_disp, inv_init_trans,
                               ref_box, trans_ref_box);
     calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                              opt.source, opt.max_disp, opt.init_transform,
+                              opt.source, asp::PointCache(), opt.max_disp, opt.init_transform,
                               source_box, trans_source_box);
 
     // When boxes are huge, it is hard to do the optimization of intersecting
@@ -1289,9 +1388,9 @@ int main( int argc, char *argv[] ) {
     Stopwatch sw1;
     sw1.start();
     DP ref_point_cloud;
-    load_cloud(opt.reference, opt.max_num_reference_points, ref_box,
-               calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-               mean_ref_longitude, opt.verbose, ref_point_cloud);
+    load_cloud_or_cache(ref_cache, opt.reference, opt.max_num_reference_points, ref_box,
+                        calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
+                        mean_ref_longitude, opt.verbose, ref_point_cloud);
     sw1.stop();
     if (opt.verbose)
       vw_out() << "Loading the reference point cloud took "
@@ -1337,13 +1436,10 @@ int main( int argc, char *argv[] ) {
 
     // If the reference point cloud came from a DEM, also load the data in DEM format.
     cartography::GeoReference dem_georef;
-    vw::ImageViewRef< PixelMask<float> > reference_dem_ref;
+    asp::DemTileStore reference_dem_ref;
     if (opt.use_dem_distances()) {
       vw_out() << "Loading reference as DEM." << endl;
-      // Load the dem, then wrap it inside an ImageViewRef object.
-      // - This is done because the actual DEM type cannot be created without being initialized.
-      InterpolationReadyDem reference_dem(load_interpolation_ready_dem(opt.reference, dem_georef));
-      reference_dem_ref.reset(reference_dem);
+      reference_dem_ref = load_interpolation_ready_dem(opt.reference, dem_georef);
     }
 
     // Now all of the input data is loaded.
@@ -58,6 +58,8 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/EigenUtils.h>
+#include <asp/Core/PointCache.h>
+#include <asp/Core/DemTileStore.h>
 
 // Turn off warnings about things we can't control
 #pragma GCC diagnostic push
@@ -119,6 +121,32 @@ void load_cloud(std::string const& file_name,
 		bool verbose,
 		typename PointMatcher<RealT>::DataPoints & data);
 
+/// If the cache directory is not empty and the file is a CSV or LAS
+/// file, open the cache of its points, first making it if missing or
+/// out of date. Otherwise leave the cache closed.
+void open_point_cache(std::string const& cache_dir,
+                      std::string const& file_name,
+                      std::string const& csv_format_str,
+                      std::string const& csv_proj4_str,
+                      vw::cartography::GeoReference const& geo,
+                      CsvConv const& csv_conv,
+                      bool verbose,
+                      asp::PointCache & cache);
+
+/// Same as load_cloud(), but read the points from the cache if it is open
+void load_cloud_or_cache(asp::PointCache const& cache,
+                         std::string const& file_name,
+                         std::int64_t num_points_to_load,
+                         vw::BBox2 const& lonlat_box,
+                         bool calc_shift,
+                         vw::Vector3 & shift,
+                         vw::cartography::GeoReference const& geo,
+                         CsvConv const& csv_conv,
+                         bool   & is_lola_rdr_format,
+                         double & median_longitude,
+                         bool verbose,
+                         typename PointMatcher<RealT>::DataPoints & data);
+
 /// Calculate the lon-lat bounding box of the points and bias it based
 /// on max displacement (which is in meters). This is used to throw
 /// away points in the other cloud which are not within this box.
@@ -127,6 +155,7 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
                                int num_sample_pts,
                                CsvConv const& csv_conv,
                                std::string const& file_name,
+                               asp::PointCache const& cache,
                                double max_disp,
                                PointMatcher<RealT>::Matrix const transform,
                                vw::BBox2 & out_box, 
@@ -229,18 +258,14 @@ void save_trans_point_cloud_n(vw::GdalWriteOptions const& opt,
 // Stuff pulled up from point_to_dem_dist in the Tools repository.
 
 
-/// A type for interpolation from a masked DEM object.
-typedef vw::InterpolationView< vw::EdgeExtensionView< vw::ImageViewRef< vw::PixelMask<float> >,
-                                                      vw::ConstantEdgeExtension>,
-                               vw::BilinearInterpolation> InterpolationReadyDem;
-
-/// Get ready to interpolate points on a DEM existing on disk.
-InterpolationReadyDem load_interpolation_ready_dem(std::string                  const& dem_path,
-                                                   vw::cartography::GeoReference     & georef);
+/// Get ready to interpolate points on a DEM existing on disk. The
+/// DEM is read in tiles when first needed, which are kept in memory.
+asp::DemTileStore load_interpolation_ready_dem(std::string                  const& dem_path,
+                                               vw::cartography::GeoReference     & georef);
 
 /// Interpolates the DEM height at the input coordinate.
 /// - Returns false if the coordinate falls outside the valid DEM area.
-bool interp_dem_height(vw::ImageViewRef< vw::PixelMask<float> > const& dem,
+bool interp_dem_height(asp::DemTileStore             const & dem,
                        vw::cartography::GeoReference const & georef,
                        vw::Vector3                   const & lonlat,
                        double                              & dem_height);
@@ -87,11 +87,43 @@ std::int64_t load_las_aux(std::string const& file_name,
   ifs.open(file_name.c_str(), std::ios::in | std::ios::binary);
   liblas::ReaderFactory f;
   liblas::Reader reader = f.CreateWithStream(ifs);
+  liblas::Header const& header = reader.GetHeader();
+  std::int64_t num_total_points = header.GetPointRecordsCount();
+
+  // If only the points in a region are needed, estimate how many
+  // there are from the extent of the points stored in the header.
+  // Then the points can be picked with a larger probability below,
+  // rather than having to read the file again if too few are found.
+  // If the region does not overlap with the file, nothing is read.
+  double overlap_ratio = 1.0;
+  if (!lonlat_box.empty()) {
+    vw::BBox2 las_box(vw::Vector2(header.GetMinX(), header.GetMinY()),
+                      vw::Vector2(header.GetMaxX(), header.GetMaxY()));
+    vw::BBox2 las_lonlat_box = las_georef.point_to_lonlat_bbox(las_box);
+    double las_area = las_lonlat_box.width() * las_lonlat_box.height();
+    if (las_area > 0) {
+      // The longitudes may differ by a multiple of 360 degrees
+      double overlap_area = 0.0;
+      for (int k = -1; k <= 1; k++) {
+        vw::BBox2 shifted_box = las_lonlat_box + vw::Vector2(360.0*k, 0.0);
+        shifted_box.crop(lonlat_box);
+        if (!shifted_box.empty())
+          overlap_area = std::max(overlap_area, shifted_box.width()*shifted_box.height());
+      }
+      overlap_ratio = overlap_area / las_area;
+    }
+  }
+  if (overlap_ratio <= 0) {
+    if (verbose)
+      vw::vw_out() << "The points in " << file_name << " are outside the region of interest."
+                   << std::endl;
+    data.conservativeResize(Eigen::NoChange, 0);
+    return 0; // so that the caller does not try again
+  }
 
   // We will randomly pick or not a point with probability load_ratio
-  std::int64_t num_total_points = las_file_size(file_name);
   double load_ratio
-    = (double)num_points_to_load/std::max(1.0, (double)num_total_points);
+    = (double)num_points_to_load/std::max(1.0, overlap_ratio*(double)num_total_points);
 
   bool shift_was_calc = false;
   std::int64_t points_count = 0;
@@ -243,6 +275,84 @@ void load_cloud(std::string const& file_name,
   
 }
 
+void open_point_cache(std::string const& cache_dir,
+                      std::string const& file_name,
+                      std::string const& csv_format_str,
+                      std::string const& csv_proj4_str,
+                      vw::cartography::GeoReference const& geo,
+                      CsvConv const& csv_conv,
+                      bool verbose,
+                      asp::PointCache & cache){
+
+  cache = asp::PointCache();
+  std::string file_type = get_cloud_type(file_name);
+  if (cache_dir == "" || (file_type != "CSV" && file_type != "LAS"))
+    return;
+
+  std::string key = asp::point_cache_key(file_name, csv_format_str, csv_proj4_str, geo);
+  std::string cache_file = asp::point_cache_file(cache_dir, key);
+  if (cache.open(cache_file, key)) {
+    if (verbose)
+      vw::vw_out() << "Using the cached points of " << file_name << " in: "
+                   << cache_file << std::endl;
+    return;
+  }
+
+  // Parse all points, not shifted, and save them
+  vw::vw_out() << "Writing the cached points of " << file_name << " to: "
+               << cache_file << std::endl;
+  std::int64_t num_total_points = (file_type == "LAS") ?
+    las_file_size(file_name) : csv_file_size(file_name);
+  vw::Vector3 shift = vw::Vector3(0, 0, 0);
+  bool calc_shift = false, is_lola_rdr_format = false;
+  double median_longitude = 0.0;
+  DoubleMatrix data;
+  load_cloud(file_name, num_total_points, vw::BBox2(), calc_shift, shift, geo,
+             csv_conv, is_lola_rdr_format, median_longitude, verbose, data);
+  asp::PointCache::write(cache_file, key, data, geo.datum(), is_lola_rdr_format);
+
+  if (!cache.open(cache_file, key))
+    vw::vw_throw(vw::IOErr() << "Failed to read back: " << cache_file << "\n");
+}
+
+void load_cloud_or_cache(asp::PointCache const& cache,
+                         std::string const& file_name,
+                         std::int64_t num_points_to_load,
+                         vw::BBox2 const& lonlat_box,
+                         bool calc_shift,
+                         vw::Vector3 & shift,
+                         vw::cartography::GeoReference const& geo,
+                         CsvConv const& csv_conv,
+                         bool   & is_lola_rdr_format,
+                         double & median_longitude,
+                         bool verbose,
+                         typename PointMatcher<RealT>::DataPoints & data){
+
+  if (!cache.is_open()) {
+    load_cloud(file_name, num_points_to_load, lonlat_box, calc_shift, shift, geo,
+               csv_conv, is_lola_rdr_format, median_longitude, verbose, data);
+    return;
+  }
+
+  if (verbose)
+    vw::vw_out() << "Reading the cached points of: " << file_name << std::endl;
+
+  data.featureLabels = form_labels<RealT>(DIM);
+  cache.load(num_points_to_load, lonlat_box, calc_shift, shift, geo.datum(),
+             median_longitude, data.features);
+  is_lola_rdr_format = cache.is_lola_rdr_format();
+
+  // As in load_cloud(), only CSV files have a median longitude
+  if (get_cloud_type(file_name) != "CSV")
+    median_longitude = 0.0;
+
+  if (data.features.cols() == 0)
+    vw::vw_throw(vw::ArgumentErr() << "File: " << file_name << " has 0 valid points.\n");
+
+  if (verbose)
+    vw::vw_out() << "Loaded points: " << data.features.cols() << std::endl;
+}
+
 // Apply a rotation + translation transform to a vector3
 vw::Vector3 apply_transform_to_vec(PointMatcher<RealT>::Matrix const transform,
                                    vw::Vector3 const& p){
@@ -264,6 +374,7 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
                                int num_sample_pts,
                                CsvConv const& csv_conv,
                                std::string const& file_name,
+                               asp::PointCache const& cache,
                                double max_disp,
                                PointMatcher<RealT>::Matrix const transform,
                                vw::BBox2 & out_box, 
@@ -289,9 +400,9 @@ void calc_extended_lonlat_bbox(vw::cartography::GeoReference const& geo,
   vw::BBox2   dummy_box;
   bool        is_lola_rdr_format;
   // Load a sample of points, hopefully enough to estimate the box reliably.
-  load_cloud(file_name, num_sample_pts, dummy_box,
-             calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-             median_longitude, verbose, points);
+  load_cloud_or_cache(cache, file_name, num_sample_pts, dummy_box,
+                      calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
+                      median_longitude, verbose, points);
 
   bool has_transform = (transform != PointMatcher<RealT>::Matrix::Identity(DIM + 1, DIM + 1));
 
@@ -708,8 +819,8 @@ void save_trans_point_cloud(vw::GdalWriteOptions const& opt,
 
 
 
-InterpolationReadyDem load_interpolation_ready_dem(std::string                  const& dem_path,
-                                                   vw::cartography::GeoReference     & georef) {
+asp::DemTileStore load_interpolation_ready_dem(std::string                  const& dem_path,
+                                               vw::cartography::GeoReference     & georef) {
   // Load the georeference from the DEM
   bool has_georef = vw::cartography::read_georeference( georef, dem_path );
   if (!has_georef)
@@ -724,13 +835,15 @@ InterpolationReadyDem load_interpolation_ready_dem(std::string
       nodata = dem_rsrc->nodata_read();
   }
   
-  // Set up interpolation + mask view of the DEM
-  vw::ImageViewRef< vw::PixelMask<float> > masked_dem = create_mask(dem, nodata);
-  return InterpolationReadyDem(interpolate(masked_dem));
+  // The DEM is interpolated at each source point for each error
+  // evaluation, from several threads. Doing that through the block
+  // cache of the disk image is slow, so keep the DEM tiles in memory.
+  // A DEM that fits in the tile cache is read only once.
+  return asp::DemTileStore(create_mask(dem, nodata));
 }
 
 
-bool interp_dem_height(vw::ImageViewRef< vw::PixelMask<float> > const& dem,
+bool interp_dem_height(asp::DemTileStore             const & dem,
                        vw::cartography::GeoReference const & georef,
                        vw::Vector3                   const & lonlat,
                        double                              & dem_height) {
@@ -741,21 +854,10 @@ bool interp_dem_height(vw::ImageViewRef< vw::PixelMask<float> > const& dem,
   }catch(...){
     return false;
   }
-  
-  double c = pix[0], r = pix[1];
-
-  // Quit if the pixel falls outside the DEM.
-  if (c < 0 || c >= dem.cols()-1 || // TODO: This ought to be an image class function
-      r < 0 || r >= dem.rows()-1 )
-    return false;
-
-  // Interpolate the DEM height at the pixel location
-  vw::PixelMask<float> v = dem(c, r);
-  if (!is_valid(v))
-    return false;
 
-  dem_height = v.child();
-  return true;
+  // Interpolate the DEM height at the pixel location. This fails if
+  // the pixel is outside the DEM or next to no-data.
+  return dem.height(pix, dem_height);
 }
 
 /// Try to read the georef/datum info, need it to read CSV files.
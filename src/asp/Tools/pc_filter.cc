@@ -41,6 +41,7 @@
 #include <vw/Image/DistanceFunction.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Cartography/GeoReference.h>
+#include <vw/Core/ThreadPool.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -166,8 +167,10 @@ bool surfaceNormal(ImageView<Vector<double, 4>> const& point_image,
   // Initialize the output
   N = Vector3();
 
-  // Find the nearby points
-  std::vector<Eigen::Vector3d> near_points;
+  // Find the nearby points. These are the neighbors in the image, as
+  // the cloud is organized by pixel.
+  Eigen::Vector3d near_points[9];
+  int num_points = 0;
   for (int c = col - 1; c <= col + 1; c++) {
     for (int r = row - 1; r <= row + 1; r++) {
       if (c < 0 || c >= point_image.cols()) 
@@ -179,15 +182,16 @@ bool surfaceNormal(ImageView<Vector<double, 4>> const& point_image,
       if (Q == Vector<double, 4>()) 
         continue; // outlier
 
-      near_points.push_back(Eigen::Vector3d(Q[0], Q[1], Q[2]));
+      near_points[num_points] = Eigen::Vector3d(Q[0], Q[1], Q[2]);
+      num_points++;
     }
   }
   
-  if (near_points.size() < 5) 
+  if (num_points < 5) 
     return false;
   
   Eigen::Vector3d plane_normal, centroid;
-  asp::bestFitPlane(near_points, centroid, plane_normal);
+  asp::bestFitPlane(near_points, num_points, centroid, plane_normal);
   N = Vector3(plane_normal[0], plane_normal[1], plane_normal[2]);
 
   if (N != N) 
@@ -196,51 +200,195 @@ bool surfaceNormal(ImageView<Vector<double, 4>> const& point_image,
   return true;
 }
 
+// Apply an operation to the pixels in a range of rows
+template <class PixelOpT>
+class PixelRowsTask: public vw::Task, private boost::noncopyable {
+  PixelOpT const& m_op;
+  int m_cols, m_beg_row, m_end_row;
+
+public:
+  PixelRowsTask(PixelOpT const& op, int cols, int beg_row, int end_row):
+    m_op(op), m_cols(cols), m_beg_row(beg_row), m_end_row(end_row) {}
+
+  void operator()() {
+    // Go along rows, as that is how the pixels are stored
+    for (int row = m_beg_row; row < m_end_row; row++) {
+      for (int col = 0; col < m_cols; col++)
+        m_op(col, row);
+    }
+  }
+};
+
+// Apply an operation to each pixel, with blocks of rows processed in
+// parallel. The operation must write only to the given pixel of its
+// outputs.
+template <class PixelOpT>
+void for_each_pixel_in_parallel(int cols, int rows, PixelOpT const& op) {
+
+  const int rows_per_task = 64;
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (int beg_row = 0; beg_row < rows; beg_row += rows_per_task) {
+    int end_row = std::min(beg_row + rows_per_task, rows);
+    boost::shared_ptr< PixelRowsTask<PixelOpT> >
+      task(new PixelRowsTask<PixelOpT>(op, cols, beg_row, end_row));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
 // Estimate surface resolution by looking at four immediate neighbors. 
 // Return 0 if at least 2 neighbors are missing or the current point.
-void estimate_surface_res(ImageView<Vector<double, 4>> const& point_image,
-                          ImageView<float> & surface_res) {
+class SurfaceResOp {
+  ImageView<Vector<double, 4>> const& m_point_image;
+  ImageView<float> & m_surface_res;
 
-  int offset_x[] = {-1, 0, 0, 1};
-  int offset_y[] = {0, -1, 1, 0};
-  
-  surface_res = ImageView<float>(point_image.cols(), point_image.rows());
-  for (int col = 0; col < surface_res.cols(); col++) {
-    for (int row = 0; row < surface_res.rows(); row++) {
+public:
+  SurfaceResOp(ImageView<Vector<double, 4>> const& point_image,
+               ImageView<float> & surface_res):
+    m_point_image(point_image), m_surface_res(surface_res) {}
 
-      surface_res(col, row) = 0.0;
+  void operator()(int col, int row) const {
 
-      Vector<double, 4> const& P = point_image(col, row); // alias
-      if (P == Vector<double, 4>()) 
-        continue; // outlier
+    int offset_x[] = {-1, 0, 0, 1};
+    int offset_y[] = {0, -1, 1, 0};
 
-      int count = 0;
-      double dist = 0.0;
-      for (int it = 0; it < 4; it++) {
-        int c = col + offset_x[it];
-        int r = row + offset_y[it];
+    m_surface_res(col, row) = 0.0;
 
-        if (c < 0 || c >= point_image.cols()) 
-          continue;
-        if (r < 0 || r >= point_image.rows()) 
-          continue;
+    Vector<double, 4> const& P = m_point_image(col, row); // alias
+    if (P == Vector<double, 4>()) 
+      return; // outlier
 
-        Vector<double, 4> const& Q = point_image(c, r); // alias
-        if (Q == Vector<double, 4>()) 
-          continue; // outlier
+    int count = 0;
+    double dist = 0.0;
+    for (int it = 0; it < 4; it++) {
+      int c = col + offset_x[it];
+      int r = row + offset_y[it];
 
-        dist = std::max(dist, norm_2(subvector(P, 0, 3) - subvector(Q, 0, 3)));
-        count++;
-      }
+      if (c < 0 || c >= m_point_image.cols()) 
+        continue;
+      if (r < 0 || r >= m_point_image.rows()) 
+        continue;
 
-      if (count < 3)
-        continue; // too few neighbors
+      Vector<double, 4> const& Q = m_point_image(c, r); // alias
+      if (Q == Vector<double, 4>()) 
+        continue; // outlier
 
-      surface_res(col, row) = dist;
+      dist = std::max(dist, norm_2(subvector(P, 0, 3) - subvector(Q, 0, 3)));
+      count++;
     }
+
+    if (count < 3)
+      return; // too few neighbors
+
+    m_surface_res(col, row) = dist;
   }
+};
+
+void estimate_surface_res(ImageView<Vector<double, 4>> const& point_image,
+                          ImageView<float> & surface_res) {
+  surface_res = ImageView<float>(point_image.cols(), point_image.rows());
+  for_each_pixel_in_parallel(point_image.cols(), point_image.rows(),
+                             SurfaceResOp(point_image, surface_res));
 }
 
+// Filter a point and find its weight and texture. The point and
+// weight are left as zero for outliers.
+class FilterOp {
+  Options                      const& m_opt;
+  ImageView<Vector<double, 4>> const& m_point_image;
+  ImageView<float>             const& m_texture;
+  bool  m_has_texture_nodata;
+  float m_texture_nodata;
+  Vector3 m_cam_dir; // camera direction, in camera's coordinate system
+  ImageView<Vector<double, 4>> & m_clean_points;
+  ImageView<float>             & m_out_texture;
+  ImageView<float>             & m_weight;
+
+public:
+  FilterOp(Options const& opt, ImageView<Vector<double, 4>> const& point_image,
+           ImageView<float> const& texture, bool has_texture_nodata, float texture_nodata,
+           Vector3 const& cam_dir, ImageView<Vector<double, 4>> & clean_points,
+           ImageView<float> & out_texture, ImageView<float> & weight):
+    m_opt(opt), m_point_image(point_image), m_texture(texture),
+    m_has_texture_nodata(has_texture_nodata), m_texture_nodata(texture_nodata),
+    m_cam_dir(cam_dir), m_clean_points(clean_points), m_out_texture(out_texture),
+    m_weight(weight) {}
+
+  void operator()(int col, int row) const {
+    
+    Vector<double, 4> const& P = m_point_image(col, row); // alias
+    if (subvector(P, 0, 3) == Vector3() ||
+        (m_has_texture_nodata && m_texture(col, row) == m_texture_nodata) ||
+        (m_opt.max_valid_triangulation_error > 0 && P[3] > m_opt.max_valid_triangulation_error)) {
+      return; // outlier
+    }
+
+    // The first 3 coordinates of P
+    Vector3 Q = subvector(P, 0, 3);
+
+    if (m_opt.max_distance_from_camera > 0 &&
+        norm_2(Q) > m_opt.max_distance_from_camera) {
+      return; // outlier
+    }
+    
+    // All points are given equal weight for now
+    double wt = 1.0;
+    if (m_opt.distance_from_camera_weight_power > 0) {
+      double dist = norm_2(Q);
+      if (dist == 0.0) 
+        return; // outlier
+      
+      wt = 1.0 / pow(dist, m_opt.distance_from_camera_weight_power);
+    }
+
+    if (m_opt.max_camera_ray_to_surface_normal_angle > 0 ||
+        m_opt.max_camera_dir_to_surface_normal_angle > 0) {
+
+      // Find the surface normal
+      Vector3 N;
+      if (!surfaceNormal(m_point_image, col, row, N))
+        return; // outlier
+        
+      if (m_opt.max_camera_ray_to_surface_normal_angle > 0) {
+        // Use abs as the normal can point in either direction
+        double prod = std::abs(dot_prod(Q, N) / norm_2(Q) / norm_2(N));
+        double angle = acos(prod) * (180.0 / M_PI);
+        if (std::isnan(angle) || std::isinf(angle) ||
+            angle > m_opt.max_camera_ray_to_surface_normal_angle)
+          return; // something went wrong
+        
+      } else if (m_opt.max_camera_dir_to_surface_normal_angle > 0) {
+        double prod = std::abs(dot_prod(m_cam_dir, N) / norm_2(m_cam_dir) / norm_2(N));
+        double angle = acos(prod) * (180.0 / M_PI);
+        if (std::isnan(angle) || std::isinf(angle) ||
+            angle > m_opt.max_camera_dir_to_surface_normal_angle)
+          return; // something went wrong
+      }
+    }
+    
+    if (m_opt.max_camera_dir_to_camera_ray_angle > 0) {
+
+      double prod = std::abs(dot_prod(Q, m_cam_dir)/ norm_2(Q) / norm_2(m_cam_dir));
+      double angle = acos(prod) * (180.0 / M_PI);
+      if (std::isnan(angle) || std::isinf(angle))
+        return; // something went wrong
+      
+      if (angle > m_opt.max_camera_dir_to_camera_ray_angle) 
+        return; // outlier
+    }
+    
+    // The input texture is usually between 0 and 1.
+    // TODO(oalexan1): What is the max color?
+    double t = 255.0 * m_texture(col, row);
+    if (t <= 0.0) t = 1.0;  // Ensure a positive value for the color
+
+    // Note how we add back the triangulation error
+    m_clean_points(col, row) = Vector<double, 4>(Q[0], Q[1], Q[2], P[3]);
+    m_out_texture(col, row) = t;
+    m_weight(col, row) = wt;
+  }
+};
+
 int main(int argc, char *argv[]) {
   Options opt;
   try {
@@ -319,81 +467,10 @@ int main(int argc, char *argv[]) {
     // Camera direction, in camera's coordinate system
     Vector3 cam_dir(0.0, 0.0, 1.0);
 
-    for (int col = 0; col < point_image.cols(); col++) {
-      for (int row = 0; row < point_image.rows(); row++) {
-        
-        Vector<double, 4> const& P = point_image(col, row); // alias
-        if (subvector(P, 0, 3) == Vector3() ||
-            (has_texture_nodata && texture(col, row) == texture_nodata) ||
-            (opt.max_valid_triangulation_error > 0 && P[3] > opt.max_valid_triangulation_error)) {
-          continue; // outlier
-        }
-
-        // The first 3 coordinates of P
-        Vector3 Q = subvector(P, 0, 3);
-
-        if (opt.max_distance_from_camera > 0 &&
-            norm_2(Q) > opt.max_distance_from_camera) {
-          continue; // outlier
-        }
-        
-        // All points are given equal weight for now
-        double wt = 1.0;
-        if (opt.distance_from_camera_weight_power > 0) {
-          double dist = norm_2(Q);
-          if (dist == 0.0) 
-            continue; // outlier
-          
-          wt = 1.0 / pow(dist, opt.distance_from_camera_weight_power);
-        }
-
-        if (opt.max_camera_ray_to_surface_normal_angle > 0 ||
-            opt.max_camera_dir_to_surface_normal_angle > 0) {
-
-          // Find the surface normal
-          Vector3 N;
-          if (!surfaceNormal(point_image, col, row, N))
-            continue; // outlier
-            
-          if (opt.max_camera_ray_to_surface_normal_angle > 0) {
-            // Use abs as the normal can point in either direction
-            double prod = std::abs(dot_prod(Q, N) / norm_2(Q) / norm_2(N));
-            double angle = acos(prod) * (180.0 / M_PI);
-            if (std::isnan(angle) || std::isinf(angle) ||
-                angle > opt.max_camera_ray_to_surface_normal_angle)
-              continue; // something went wrong
-            
-          } else if (opt.max_camera_dir_to_surface_normal_angle > 0) {
-            double prod = std::abs(dot_prod(cam_dir, N) / norm_2(cam_dir) / norm_2(N));
-            double angle = acos(prod) * (180.0 / M_PI);
-            if (std::isnan(angle) || std::isinf(angle) ||
-                angle > opt.max_camera_dir_to_surface_normal_angle)
-              continue; // something went wrong
-          }
-        }
-        
-        if (opt.max_camera_dir_to_camera_ray_angle > 0) {
-
-          double prod = std::abs(dot_prod(Q, cam_dir)/ norm_2(Q) / norm_2(cam_dir));
-          double angle = acos(prod) * (180.0 / M_PI);
-          if (std::isnan(angle) || std::isinf(angle))
-            continue; // something went wrong
-          
-          if (angle > opt.max_camera_dir_to_camera_ray_angle) 
-            continue; // outlier
-        }
-        
-        // The input texture is usually between 0 and 1.
-        // TODO(oalexan1): What is the max color?
-        double t = 255.0 * texture(col, row);
-        if (t <= 0.0) t = 1.0;  // Ensure a positive value for the color
-
-        // Note how we add back the triangulation error
-        clean_points(col, row) = Vector<double, 4>(Q[0], Q[1], Q[2], P[3]);
-        out_texture(col, row) = t;
-        weight(col, row) = wt;
-      }
-    }
+    for_each_pixel_in_parallel(point_image.cols(), point_image.rows(),
+                               FilterOp(opt, point_image, texture, has_texture_nodata,
+                                        texture_nodata, cam_dir, clean_points,
+                                        out_texture, weight));
 
     if (opt.blending_dist > 0 && opt.blending_power > 0) {
       ImageView<int> mask(clean_points.cols(), clean_points.rows());
@@ -27,10 +27,10 @@
 #include <asp/Core/OrthoRasterizer.h>
 
 #include <vw/Core/Stopwatch.h>
-#include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
+#include <algorithm>
 #include <limits>
 
 using namespace vw;
@@ -90,61 +90,180 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 }
 
 
+/// What is known about an input cloud from its header alone
+struct CloudInfo {
+  int  cols, rows, num_channels;
+  bool has_shift;
+  Vector3 shift;
+};
+
+/// Read the size, number of channels, and shift of each input cloud.
+/// Each file is opened once here, rather than once per check below.
+std::vector<CloudInfo> read_cloud_info(std::vector<std::string> const& pc_files) {
+
+  std::vector<CloudInfo> info(pc_files.size());
+  for (size_t i = 0; i < pc_files.size(); i++) {
+    vw::DiskImageResourceGDAL rsrc(pc_files[i]);
+    info[i].cols         = rsrc.cols();
+    info[i].rows         = rsrc.rows();
+    info[i].num_channels = rsrc.channels() * rsrc.planes();
+    std::string shift_str;
+    info[i].has_shift
+      = vw::cartography::read_header_string(rsrc, asp::ASP_POINT_OFFSET_TAG_STR, shift_str);
+    if (info[i].has_shift)
+      info[i].shift = asp::str_to_vec<vw::Vector3>(shift_str);
+  }
+  return info;
+}
+
 /// Throws if the input point clouds do not have the same number of channels.
 /// - Returns the number of channels.
-int check_num_channels(std::vector<std::string> const& pc_files){
-  VW_ASSERT(pc_files.size() >= 1,
+int check_num_channels(std::vector<CloudInfo> const& info){
+  VW_ASSERT(info.size() >= 1,
             ArgumentErr() << "Expecting at least one file.\n");
 
-  int target_num = get_num_channels(pc_files[0]);
-  for (int i = 1; i < (int)pc_files.size(); ++i){
-    int num_channels = get_num_channels(pc_files[i]);
-    if (num_channels != target_num)
+  int target_num = info[0].num_channels;
+  for (int i = 1; i < (int)info.size(); ++i){
+    if (info[i].num_channels != target_num)
       vw_throw( ArgumentErr() << "Input point clouds must all have the same number of channels!.\n" );
   }
   return target_num;
 }
 
 /// Determine the common shift value to use for the output files
-Vector3 determine_output_shift(std::vector<std::string> const& pc_files, Options const& opt){
+Vector3 determine_output_shift(std::vector<CloudInfo> const& info, Options const& opt){
 
   // If writing to double format, no shift is needed.
   if (opt.write_double)
     return Vector3(0,0,0);
 
-  // As an approximation, compute the mean shift vector of the input files.
+  // The clouds are not scanned. Each one is represented by the shift
+  // in its header, which is near the center of its points, weighted by
+  // its number of pixels, so that many small tiles do not pull the
+  // shift away from a few large ones.
   // - If none of the input files have a shift, the output file will be written as a double.
-  vw::Vector3 shift(0,0,0), shiftIn;
-  double shift_count = 0;
-  for (size_t i=0; i<pc_files.size(); ++i) {
-    // Read in the shift from each cloud and accumulate them
-    std::string shift_str;
-    boost::shared_ptr<vw::DiskImageResource> rsrc( new vw::DiskImageResourceGDAL(pc_files[i]) );
-    if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str)){
-      //std::cout << "shift string = " << shift_str << std::endl;
-      shift += asp::str_to_vec<vw::Vector3>(shift_str);
-      shift_count += 1.0;
-    }
+  vw::Vector3 shift(0,0,0);
+  double weight_sum = 0;
+  for (size_t i = 0; i < info.size(); ++i) {
+    if (!info[i].has_shift)
+      continue;
+    double weight = std::max(1.0, double(info[i].cols) * double(info[i].rows));
+    shift      += weight * info[i].shift;
+    weight_sum += weight;
   }
-  if (shift_count < 0.9) // If no shifts read, don't use a shift.
+  if (weight_sum <= 0) // If no shifts read, don't use a shift.
     return Vector3(0,0,0);
 
-  // Compute the mean shift
-  // - It would be more accurate to weight the shift according to the number of input points
-  shift /= shift_count;
-  return shift;
+  return shift / weight_sum;
 }
 
+/// The clouds placed side by side, each starting at a multiple of the
+/// spacing, and transposed if wider than tall. This is the same layout
+/// as made by asp::form_point_cloud_composite(), but a tile is made by
+/// copying directly from the few inputs it overlaps, which are opened
+/// only then. No per-pixel lookups through a composite of all the
+/// inputs are done, and not all inputs are kept open, which matters
+/// when there are thousands of them. Tiles are independent, so they
+/// are copied in parallel by the block writer.
+template <class PixelT>
+class PointCloudConcatView: public ImageViewBase<PointCloudConcatView<PixelT> >{
+  std::vector<std::string> m_files;
+  std::vector<int>  m_starts;     // first column of each input in the output
+  std::vector<BBox2i> m_boxes;    // extent of each input in the output
+  std::vector<bool> m_transposed;
+  int m_cols, m_rows;
+
+public:
+  PointCloudConcatView(std::vector<std::string> const& files,
+                       std::vector<CloudInfo> const& info, int spacing):
+    m_files(files), m_cols(0), m_rows(0) {
+
+    VW_ASSERT(files.size() >= 1 && files.size() == info.size(),
+              ArgumentErr() << "Expecting at least one file.\n");
+
+    for (size_t i = 0; i < info.size(); i++) {
+      int cols = info[i].cols, rows = info[i].rows;
+      bool transposed = (rows < cols);
+      if (transposed)
+        std::swap(cols, rows);
+
+      int start = m_cols;
+      if (i > 0) // Insert the spacing
+        start = spacing*(int)ceil(double(start)/spacing) + spacing;
+
+      m_starts.push_back(start);
+      m_boxes.push_back(BBox2i(start, 0, cols, rows));
+      m_transposed.push_back(transposed);
+      m_cols = std::max(m_cols, start + cols);
+      m_rows = std::max(m_rows, rows);
+    }
+  }
+
+  typedef PixelT pixel_type;
+  typedef PixelT result_type;
+  typedef ProceduralPixelAccessor<PointCloudConcatView> pixel_accessor;
+
+  inline int32 cols  () const { return m_cols; }
+  inline int32 rows  () const { return m_rows; }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline result_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "PointCloudConcatView::operator()(...) is not implemented");
+    return result_type();
+  }
+
+  typedef CropView<ImageView<result_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    // Areas not covered by any input, such as the spacing, are zero,
+    // which is an invalid point.
+    ImageView<result_type> tile(bbox.width(), bbox.height());
+    fill(tile, result_type());
+
+    // The starts are increasing, so skip the inputs which end before the tile
+    int beg = std::upper_bound(m_starts.begin(), m_starts.end(), bbox.min().x())
+      - m_starts.begin() - 1;
+    for (int i = std::max(beg, 0); i < (int)m_starts.size(); i++) {
+      if (m_starts[i] >= bbox.max().x())
+        break;
+      BBox2i intersect = m_boxes[i];
+      intersect.crop(bbox);
+      if (intersect.empty())
+        continue;
+
+      ImageViewRef<PixelT> input
+        = asp::point_utils_private::read_point_cloud_compatible_file<PixelT>(m_files[i]);
+      if (m_transposed[i])
+        input = transpose(input);
+
+      ImageView<result_type> piece = crop(input, intersect - m_boxes[i].min());
+      int dx = intersect.min().x() - bbox.min().x(), dy = intersect.min().y() - bbox.min().y();
+      for (int row = 0; row < piece.rows(); row++)
+        for (int col = 0; col < piece.cols(); col++)
+          tile(col + dx, row + dy) = piece(col, row);
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
 
 // Do the actual work of loading, merging, and saving the point clouds
 
 // Case 1: Single-channel cloud.
 template <class PixelT>
 typename boost::enable_if<boost::is_same<PixelT, vw::PixelGray<float> >, void >::type
-do_work(Vector3 const& shift, Options const& opt) {
+do_work(Vector3 const& shift, std::vector<CloudInfo> const& info, Options const& opt) {
   // The spacing is selected to be compatible with the point2dem convention.
   const int spacing = ASP_MAX_SUBBLOCK_SIZE;
-  ImageViewRef<PixelT> merged_cloud = asp::form_point_cloud_composite<PixelT>(opt.pointcloud_files, spacing);
+  ImageViewRef<PixelT> merged_cloud
+    = PointCloudConcatView<PixelT>(opt.pointcloud_files, info, spacing);
 
   vw_out() << "Writing image: " << opt.out_file << "\n";
 
@@ -160,22 +279,21 @@ do_work(Vector3 const& shift, Options const& opt) {
 // Case 2: Multi-channel cloud.
 template <class PixelT>
 typename boost::disable_if<boost::is_same<PixelT, vw::PixelGray<float> >, void >::type
-do_work(Vector3 const& shift, Options const& opt) {
+do_work(Vector3 const& shift, std::vector<CloudInfo> const& info, Options const& opt) {
   // The spacing is selected to be compatible with the point2dem convention.
   const int spacing = ASP_MAX_SUBBLOCK_SIZE;
-  ImageViewRef<PixelT> merged_cloud = asp::form_point_cloud_composite<PixelT>(opt.pointcloud_files, spacing);
+  ImageViewRef<PixelT> merged_cloud
+    = PointCloudConcatView<PixelT>(opt.pointcloud_files, info, spacing);
 
   // See if we can pull a georeference from somewhere. Of course it will be wrong
   // when applied to the merged cloud, but it will at least have the correct datum
-  // and projection.
+  // and projection. All inputs should have the same one, so stop at the first.
   bool has_georef = false;
   cartography::GeoReference georef;
   for (size_t i = 0; i < opt.pointcloud_files.size(); i++){
-    cartography::GeoReference local_georef;
-
-    if (read_georeference(local_georef, opt.pointcloud_files[i])){
-      georef = local_georef;
+    if (read_georeference(georef, opt.pointcloud_files[i])){
       has_georef = true;
+      break;
     }
   }
 
@@ -203,21 +321,23 @@ int main( int argc, char *argv[] ) {
   try {
     handle_arguments( argc, argv, opt );
 
+    std::vector<CloudInfo> info = read_cloud_info(opt.pointcloud_files);
+
     // Determine the number of channels
-    int num_channels = check_num_channels(opt.pointcloud_files);
+    int num_channels = check_num_channels(info);
 
     // Determine the output shift (if any)
-    Vector3 shift = determine_output_shift(opt.pointcloud_files, opt);
+    Vector3 shift = determine_output_shift(info, opt);
 
     // The code has to branch here depending on the number of channels
     switch (num_channels)
     {
       // The input point clouds have their shift incorporated and are stored as doubles.
       // If the output file is stored as float, it needs to have a single shift value applied.
-      case 1:  do_work< vw::PixelGray<float> >(shift, opt); break;
-      case 3:  do_work<Vector3>(shift, opt); break;
-      case 4:  do_work<Vector4>(shift, opt); break;
-      case 6:  do_work<Vector6>(shift, opt); break;
+      case 1:  do_work< vw::PixelGray<float> >(shift, info, opt); break;
+      case 3:  do_work<Vector3>(shift, info, opt); break;
+      case 4:  do_work<Vector4>(shift, info, opt); break;
+      case 6:  do_work<Vector6>(shift, info, opt); break;
       default: vw_throw( ArgumentErr() << "Unsupported number of channels!.\n" );
     }
 
@@ -21,6 +21,8 @@
 
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/OrthoRasterizer.h>
+#include <asp/Core/DemAggregation.h>
+#include <asp/Core/TiledHoleFill.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
@@ -34,6 +36,7 @@
 #include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
 #include <vw/Math/EulerAngles.h>
+#include <vw/FileIO/MatrixIO.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -69,7 +72,7 @@ struct Options : vw::GdalWriteOptions {
   double      semi_major, semi_minor;
   std::string reference_spheroid, datum;
   double      phi_rot, omega_rot, kappa_rot;
-  std::string rot_order;
+  std::string rot_order, transform_file;
   double      proj_lat, proj_lon, proj_scale, false_easting, false_northing;
   double      lon_offset, lat_offset, height_offset;
   size_t      utm_zone;
@@ -87,7 +90,7 @@ struct Options : vw::GdalWriteOptions {
   std::string csv_format_str, csv_proj4_str, filter;
   double      search_radius_factor, sigma_factor, default_grid_size_multiplier;
   bool        use_surface_sampling;
-  bool        has_las_or_csv_or_pcd;
+  bool        has_las_or_csv_or_pcd, cog;
   Vector2i    max_output_size;
 
   // Output
@@ -332,6 +335,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("x-offset",       po::value(&opt.lon_offset)->default_value(0),    "Add a longitude offset (in degrees) to the DEM.")
     ("y-offset",       po::value(&opt.lat_offset)->default_value(0),    "Add a latitude offset (in degrees) to the DEM.")
     ("z-offset",       po::value(&opt.height_offset)->default_value(0),    "Add a vertical offset (in meters) to the DEM.")
+    ("transform",      po::value(&opt.transform_file)->default_value(""),
+     "Apply the 4x4 transform in this file, such as produced by pc_align, to the 3D points prior to DEM rasterization, and before any Euler angle rotation. This avoids writing a transformed point cloud with pc_align first.")
     ("rotation-order", po::value(&opt.rot_order)->default_value("xyz"),
          "Set the order of an Euler angle rotation applied to the 3D points prior to DEM rasterization.")
     ("phi-rotation",   po::value(&opt.phi_rot )->default_value(0),"Set a rotation angle phi.")
@@ -414,7 +419,9 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("use-surface-sampling", po::bool_switch(&opt.use_surface_sampling)->default_value(false),
      "Use the older algorithm, interpret the point cloud as a surface made up of triangles and interpolate into it (prone to aliasing).")
     ("fsaa",   po::value<int>(&opt.fsaa)->default_value(1),            "Oversampling amount to perform antialiasing (obsolete).")
-    ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.");
+    ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.")
+    ("cog", po::bool_switch(&opt.cog)->default_value(false),
+     "Write cloud-optimized GeoTIFF files, with internal overviews.");
   
   general_options.add(manipulation_options);
   general_options.add(projection_options);
@@ -714,6 +721,8 @@ namespace asp{
       asp::save_with_temp_big_blocks(block_size, output_file, img,
                                      has_georef, georef,
                                      has_nodata, opt.nodata_value, opt, tpc);
+      if (opt.cog)
+        asp::write_cog(output_file, opt, "AVERAGE");
     }
     else
       vw::cartography::write_gdal_image(output_file, img, georef, opt, tpc);
@@ -830,12 +839,15 @@ namespace asp{
 
 } // end namespace asp
 
+// If dem_image is set, the DEM is taken from it, rather than rasterized
+// here. It must be on the grid of the rasterizer.
 void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
                                Options& opt,
                                cartography::GeoReference& georef,
                                ImageViewRef<double> const& error_image,
                                double estim_max_error,
-                               std::int64_t * num_invalid_pixels) {
+                               std::int64_t * num_invalid_pixels,
+                               ImageViewRef<PixelGray<float>> const* dem_image = NULL) {
 
   vw_out() << "\t-- Starting DEM rasterization --\n";
   vw_out() << "\t--> DEM spacing: " <<     rasterizer.spacing() << " pt/px\n";
@@ -890,18 +902,20 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
     Stopwatch sw2;
     sw2.start();
     ImageViewRef< PixelGray<float> > dem
-      = asp::round_image_pixels_skip_nodata(rasterizer_fsaa, opt.rounding_error,
-                                            opt.nodata_value);
+      = asp::round_image_pixels_skip_nodata((dem_image != NULL) ? *dem_image : rasterizer_fsaa,
+                                            opt.rounding_error, opt.nodata_value);
 
     int hole_fill_len = opt.dem_hole_fill_len;
     if (hole_fill_len > 0){
-      // Note that we first cache the tiles of the rasterized DEM, and
-      // fill holes later. This greatly improves the performance.
+      // Note that we first cache the tiles of the rasterized DEM. The
+      // holes are found in one pass over them, then the small ones
+      // are filled tile by tile, with no need for a collar.
       dem = apply_mask
-        (vw::fill_holes_grass(create_mask
+        (asp::fill_small_holes(create_mask
                                (block_cache(dem, tile_size, opt.num_threads),
                                 opt.nodata_value),
-                               hole_fill_len),
+                               hole_fill_len, tile_size[0],
+                               vw_settings().default_num_threads()),
          opt.nodata_value);
     }
 
@@ -913,7 +927,9 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
                 << "Requested DEM size is too large, max allowed output size is "
                 << opt.max_output_size << " pixels.\n");
 
-    asp::save_image(opt, dem, georef, hole_fill_len, "DEM");
+    asp::save_image(opt, dem, georef,
+                    0, // no need for a buffer, the holes are filled by tiles
+                    "DEM");
     sw2.stop();
     vw_out(DebugMessage,"asp") << "DEM render time: " << sw2.elapsed_seconds() << ".\n";
 
@@ -1042,23 +1058,20 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
                                        opt.num_threads);
       }
 
-      // Fill the holes
-      point_image_mask =vw::fill_holes_grass(point_image_mask, hole_fill_len);
+      // Fill the holes. They are found in one pass over the cloud,
+      // then the small ones are filled tile by tile.
+      point_image_mask = asp::fill_small_holes(point_image_mask, hole_fill_len,
+                                               tile_size[0],
+                                               vw_settings().default_num_threads());
 
       // back to NaNs
       point_image = per_pixel_filter(point_image_mask, asp::Mask2NaN<Vector3>());
 
-      // When filling holes, use big tiles, to reduce the overhead
-      // of expanding each tile by hole size. 
-      int big_block_size = nextpow2(2.0*hole_fill_len);
-      big_block_size = std::max(256, big_block_size);
-
       // Cache each hole-filled point cloud tile as likely we will
       // need it again in the future when rasterizing a different
-      // portion of the output ortho image.
-      point_image = block_cache(point_image, 
-                                vw::Vector2(big_block_size, big_block_size),
-                                opt.num_threads);
+      // portion of the output ortho image. The tiles are those
+      // the holes were filled by.
+      point_image = block_cache(point_image, tile_size, opt.num_threads);
 
       // Pass to the rasterizer the point image with the holes filled
       rasterizer.set_point_image(point_image);
@@ -1120,6 +1133,35 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
 
   std::string base_out_prefix = opt.out_prefix;
 
+  // With several spacings, go through the point cloud only once, at
+  // the finest spacing, and save the weighted sums of heights and the
+  // sums of weights. The DEM at each spacing adds these up over its
+  // grid cells. Other filters than the weighted average and mean
+  // cannot be added up this way, so then each DEM is rasterized on
+  // its own.
+  bool aggregate = (opt.dem_spacing.size() > 1 && !opt.no_dem && !opt.has_alpha &&
+                    rasterizer.can_accumulate());
+  std::string accum_file = base_out_prefix + "-DEM-accum-tmp.tif";
+  Matrix3x3 fine_transform;
+  ImageViewRef<Vector2> accum;
+  if (aggregate) {
+    size_t fine_index = 0;
+    double fine_spacing = 0.0;
+    for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
+      rasterizer.initialize_spacing(opt.dem_spacing[i]);
+      if (i == 0 || rasterizer.spacing() < fine_spacing) {
+        fine_index = i;
+        fine_spacing = rasterizer.spacing();
+      }
+    }
+    rasterizer.initialize_spacing(opt.dem_spacing[fine_index]);
+    fine_transform = rasterizer.geo_transform();
+    vw_out() << "Accumulating the heights at the finest spacing: " << fine_spacing << "\n";
+    vw::cartography::block_write_gdal_image(accum_file, asp::OrthoAccumulationView(rasterizer),
+                                            opt, TerminalProgressCallback("asp", "\t--> Heights: "));
+    accum = DiskImageView<Vector2>(accum_file);
+  }
+
   // Call the function for each dem spacing
   for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
     double this_spacing = opt.dem_spacing[i];
@@ -1132,11 +1174,27 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
       opt.out_prefix = base_out_prefix;
     else // Write later iterations to a different path.
       opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
-    do_software_rasterization(rasterizer, opt, georef, error_image,
-                              estim_max_error, &num_invalid_pixels);
+
+    if (aggregate) {
+      ImageViewRef<PixelGray<float>> dem
+        = asp::AggregatedDemView(accum, fine_transform, rasterizer.geo_transform(),
+                                 rasterizer.cols(), rasterizer.rows(), opt.nodata_value,
+                                 &num_invalid_pixels, &count_mutex);
+      do_software_rasterization(rasterizer, opt, georef, error_image,
+                                estim_max_error, &num_invalid_pixels, &dem);
+    } else {
+      do_software_rasterization(rasterizer, opt, georef, error_image,
+                                estim_max_error, &num_invalid_pixels);
+    }
   } // End loop through spacings
 
   opt.out_prefix = base_out_prefix; // Restore the original value
+
+  if (aggregate) {
+    accum = ImageViewRef<Vector2>(); // close the file before removing it
+    if (fs::exists(accum_file))
+      fs::remove(accum_file);
+  }
 }
 
 int main(int argc, char *argv[]) {
@@ -1212,6 +1270,14 @@ int main(int argc, char *argv[]) {
       = asp::form_point_cloud_composite<Vector3>(opt.pointcloud_files,
                                                  ASP_MAX_SUBBLOCK_SIZE);
     
+    // Apply an (optional) transform, such as from pc_align, to the 3D points.
+    if (opt.transform_file != "") {
+      vw::Matrix<double> transform;
+      vw::read_matrix_as_txt(opt.transform_file, transform);
+      vw_out() << "\t--> Applying the transform: " << opt.transform_file << "\n";
+      point_image = asp::point_affine_transform(point_image, transform);
+    }
+
     // Apply an (optional) rotation to the 3D points before building the mesh.
     if (opt.phi_rot != 0 || opt.omega_rot != 0 || opt.kappa_rot != 0) {
       vw_out() << "\t--> Applying rotation sequence: " << opt.rot_order
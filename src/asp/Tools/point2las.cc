@@ -36,6 +36,7 @@
 
 #include <vw/Cartography/PointImageManipulation.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/Math/Statistics.h>
 
 using namespace vw;
@@ -205,65 +206,170 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   asp::log_to_file(argc, argv, "", opt.out_prefix);
 }
 
-void find_error_image_and_do_stats(Options& opt, ImageViewRef<double> & error_image) {
-      
+// Find the triangulation error image, if the cloud has one. If there
+// is no error image, or the outlier cutoff is set, return false, as
+// then the cutoff need not be estimated.
+bool find_error_image(Options& opt, ImageViewRef<double> & error_image) {
+
   std::vector<std::string> pointcloud_files;
   pointcloud_files.push_back(opt.pointcloud_file);
   error_image = asp::point_cloud_error_image(pointcloud_files);
-  
+
   if (error_image.rows() == 0 || error_image.cols() == 0) {
     vw_out() << "The point cloud files must have an equal number of channels which "
              << "must be 4 or 6 to be able to remove outliers.\n";
     opt.max_valid_triangulation_error = 0.0;
-    return;
+    return false;
   }
 
   if (opt.max_valid_triangulation_error > 0.0) {
     vw_out() << "Using the set maximum valid triangulation error as outlier cutoff: "
              << opt.max_valid_triangulation_error << "." << std::endl;
-    return;
+    return false;
   }
-    
-  vw_out() << "Estimating the maximum valid triangulation error (outlier cutoff).\n";
-    
-  int num_err_cols = error_image.cols();
-  int num_err_rows = error_image.rows();
-    
-  double area = std::max(num_err_cols * num_err_rows, 1);
-  int sample_rate = round(sqrt(double(area) / double(opt.num_samples)));
-  if (sample_rate < 1) 
-    sample_rate = 1;
-    
+
+  return true;
+}
+
+// A block of the cloud, read in memory
+struct CloudBlock {
+  BBox2i              box;
+  ImageView<Vector3>  points;
+  ImageView<double>   errors; // empty if there is no error image
+};
+
+// Read a block of the points, and of the errors if present. The
+// conversions to geodetic and projected coordinates are done here too.
+class ReadBlockTask: public vw::Task, private boost::noncopyable {
+  ImageViewRef<Vector3> m_point_image;
+  ImageViewRef<double>  m_error_image;
+  CloudBlock          & m_block; // alias, each task reads its own block
+
+public:
+  ReadBlockTask(ImageViewRef<Vector3> const& point_image,
+                ImageViewRef<double>  const& error_image,
+                CloudBlock & block):
+    m_point_image(point_image), m_error_image(error_image), m_block(block) {}
+
+  void operator()() {
+    m_block.points = crop(m_point_image, m_block.box);
+    if (m_error_image.cols() > 0)
+      m_block.errors = crop(m_error_image, m_block.box);
+  }
+};
+
+// Read the given blocks in parallel
+void read_blocks(ImageViewRef<Vector3> const& point_image,
+                 ImageViewRef<double>  const& error_image,
+                 std::vector<CloudBlock> & blocks) {
+
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (size_t it = 0; it < blocks.size(); it++) {
+    boost::shared_ptr<ReadBlockTask>
+      task(new ReadBlockTask(point_image, error_image, blocks[it]));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
+// The blocks are read in batches, so that a few blocks per thread are
+// in memory at one time.
+void form_block_batches(ImageViewRef<Vector3> const& point_image,
+                        Options const& opt,
+                        std::vector< std::vector<BBox2i> > & batches) {
+
+  std::vector<BBox2i> boxes = subdivide_bbox(point_image, opt.raster_tile_size[0],
+                                             opt.raster_tile_size[1]);
+  int batch_size = std::max(4 * int(vw_settings().default_num_threads()), 1);
+  batches.clear();
+  for (size_t it = 0; it < boxes.size(); it += batch_size) {
+    size_t end = std::min(boxes.size(), it + batch_size);
+    batches.push_back(std::vector<BBox2i>(boxes.begin() + it, boxes.begin() + end));
+  }
+}
+
+inline bool is_valid_point(Vector3 const& point, bool is_geodetic) {
+  return ( (!is_geodetic && point != vw::Vector3()) ||
+           (is_geodetic  && !boost::math::isnan(point.z())) );
+}
+
+// Find the bounding box of the cloud. If the outlier cutoff must be
+// estimated, collect the sample of triangulation errors in the same
+// pass, rather than reading the cloud once more for that.
+BBox3 find_bbox_and_do_stats(Options & opt,
+                             ImageViewRef<Vector3> const& point_image,
+                             ImageViewRef<double>  const& error_image,
+                             bool is_geodetic, bool estimate_cutoff) {
+
+  int sample_rate = 1;
+  if (estimate_cutoff) {
+    vw_out() << "Estimating the maximum valid triangulation error (outlier cutoff).\n";
+    double area = std::max(double(error_image.cols()) * double(error_image.rows()), 1.0);
+    sample_rate = round(sqrt(area / double(opt.num_samples)));
+    if (sample_rate < 1)
+      sample_rate = 1;
+  }
+
+  vw_out() << "Computing the point cloud bounding box.\n";
   Stopwatch sw;
   sw.start();
-  PixelAccumulator<PercentileErrorAccum> error_accum;
-  for_each_pixel(subsample(error_image, sample_rate),
-                 error_accum,
-                 TerminalProgressCallback
-                 ("asp","Error estim : ") );
-
-  opt.max_valid_triangulation_error = error_accum.value(opt.outlier_removal_params,
-                                                        opt.use_tukey_outlier_removal);
-  
+
+  BBox3 cloud_bbox;
+  PercentileErrorAccum error_accum;
+  std::vector< std::vector<BBox2i> > batches;
+  form_block_batches(point_image, opt, batches);
+  TerminalProgressCallback tpc("asp", "\t--> ");
+  for (size_t batch = 0; batch < batches.size(); batch++) {
+    tpc.report_fractional_progress(batch, batches.size());
+
+    std::vector<CloudBlock> blocks(batches[batch].size());
+    for (size_t it = 0; it < blocks.size(); it++)
+      blocks[it].box = batches[batch][it];
+    read_blocks(point_image, estimate_cutoff ? error_image : ImageViewRef<double>(),
+                blocks);
+
+    for (size_t it = 0; it < blocks.size(); it++) {
+      CloudBlock const& block = blocks[it];
+      for (int row = 0; row < block.points.rows(); row++) {
+        for (int col = 0; col < block.points.cols(); col++) {
+          if (is_valid_point(block.points(col, row), is_geodetic))
+            cloud_bbox.grow(block.points(col, row));
+
+          // Sample the errors on the same grid as the full cloud would be
+          // subsampled
+          if (estimate_cutoff &&
+              (block.box.min().x() + col) % sample_rate == 0 &&
+              (block.box.min().y() + row) % sample_rate == 0)
+            error_accum(block.errors(col, row));
+        }
+      }
+    }
+  }
+  tpc.report_finished();
+
+  if (estimate_cutoff) {
+    opt.max_valid_triangulation_error = error_accum.value(opt.outlier_removal_params,
+                                                          opt.use_tukey_outlier_removal);
+    vw_out() << "Found the maximum valid triangulation error (outlier cutoff): "
+             << opt.max_valid_triangulation_error << "." << std::endl;
+  }
+
   sw.stop();
   vw_out(DebugMessage, "asp") << "Elapsed time: " << sw.elapsed_seconds() << std::endl;
-  vw_out() << "Found the maximum valid triangulation error (outlier cutoff): "
-           << opt.max_valid_triangulation_error << "." << std::endl;
+
+  return cloud_bbox;
 }
 
 int main( int argc, char *argv[] ) {
   
-  // TODO(oalexan1): need to understand what is the optimal strategy
-  // for traversing the input point cloud file to minimize the reading
-  // time.
-
   Options opt;
   try {
     handle_arguments(argc, argv, opt);
 
     ImageViewRef<double> error_image;
+    bool estimate_cutoff = false;
     if (opt.outlier_removal_params[0] < 100.0 || opt.max_valid_triangulation_error > 0.0)
-      find_error_image_and_do_stats(opt, error_image);
+      estimate_cutoff = find_error_image(opt, error_image);
 
     // Save the las file in respect to a reference spheroid if provided
     // by the user.
@@ -303,7 +409,8 @@ int main( int argc, char *argv[] ) {
       point_image = geodetic_to_point(asp::recenter_longitude(point_image, avg_lon), georef);
     }
 
-    BBox3 cloud_bbox = asp::pointcloud_bbox(point_image, is_geodetic);
+    BBox3 cloud_bbox = find_bbox_and_do_stats(opt, point_image, error_image,
+                                              is_geodetic, estimate_cutoff);
 
     // The las format stores the values as 32 bit integers. So, for a
     // given point, we store round((point-offset)/scale), as well as
@@ -339,51 +446,69 @@ int main( int argc, char *argv[] ) {
     ofs.open(lasFile.c_str(), std::ios::out | std::ios::binary);
     liblas::Writer writer(ofs, header);
 
+    // The blocks are read and converted in parallel, then written in
+    // order, as the LAS writer can be used only from one thread.
+    bool use_errors = (opt.max_valid_triangulation_error > 0.0 ||
+                       opt.triangulation_error_factor > 0.0);
+    if (use_errors && error_image.cols() == 0) {
+      std::vector<std::string> pointcloud_files;
+      pointcloud_files.push_back(opt.pointcloud_file);
+      error_image = asp::point_cloud_error_image(pointcloud_files);
+    }
+    std::vector< std::vector<BBox2i> > batches;
+    form_block_batches(point_image, opt, batches);
+
     TerminalProgressCallback tpc("asp", "\t--> ");
     long long int num_total_points = 0;
     long long int num_kept_points = 0;
-    
-    for (int row = 0; row < point_image.rows(); row++){
-      tpc.report_fractional_progress(row, point_image.rows());
-      for (int col = 0; col < point_image.cols(); col++){
-
-        Vector3 point = point_image(col, row);
-
-        // Skip no-data points
-        bool is_good = ( (!is_geodetic && point != vw::Vector3()) ||
-                         (is_geodetic  && !boost::math::isnan(point.z())) );
-        if (!is_good) continue;
-
-        num_total_points++;
-        
-        if (opt.max_valid_triangulation_error > 0.0 &&
-            error_image(col, row) > opt.max_valid_triangulation_error) 
-          continue;
-
-        num_kept_points++;
-#if 0
-        // For comparison later with las2txt.
-        std::cout.precision(16);
-        std::cout << "\npoint " << point[0] << ' ' << point[1] << ' '
-                  << point[2] << std::endl;
-#endif
-
-        liblas::Point las_point(&header);
-        las_point.SetCoordinates(point[0], point[1], point[2]);
-
-        if (opt.triangulation_error_factor > 0.0) {
-          // Scale the triangulation error, clamp it, and save it as
-          // uint16.  The LAS 1.2 format has no fields (apart from the
-          // taken already x, y, and z) with 32-bit values, so uint16
-          // is all one can do.
-          double scaled_error = opt.triangulation_error_factor * error_image(col, row);
-          scaled_error = round(scaled_error);
-          scaled_error = std::max(scaled_error, 0.0); // should not be necessary
-          scaled_error = std::min(scaled_error, double(std::numeric_limits<std::uint16_t>::max()));
-          las_point.SetIntensity(std::uint16_t(scaled_error));
+
+    for (size_t batch = 0; batch < batches.size(); batch++) {
+      tpc.report_fractional_progress(batch, batches.size());
+
+      std::vector<CloudBlock> blocks(batches[batch].size());
+      for (size_t it = 0; it < blocks.size(); it++)
+        blocks[it].box = batches[batch][it];
+      read_blocks(point_image, use_errors ? error_image : ImageViewRef<double>(), blocks);
+
+      for (size_t it = 0; it < blocks.size(); it++) {
+        CloudBlock const& block = blocks[it];
+        bool has_errors = (block.errors.cols() > 0);
+        for (int row = 0; row < block.points.rows(); row++) {
+          for (int col = 0; col < block.points.cols(); col++) {
+
+            Vector3 point = block.points(col, row);
+
+            // Skip no-data points
+            if (!is_valid_point(point, is_geodetic)) continue;
+
+            num_total_points++;
+
+            double error = has_errors ? block.errors(col, row) : 0.0;
+            if (opt.max_valid_triangulation_error > 0.0 &&
+                error > opt.max_valid_triangulation_error)
+              continue;
+
+            num_kept_points++;
+
+            liblas::Point las_point(&header);
+            las_point.SetCoordinates(point[0], point[1], point[2]);
+
+            if (opt.triangulation_error_factor > 0.0) {
+              // Scale the triangulation error, clamp it, and save it as
+              // uint16.  The LAS 1.2 format has no fields (apart from the
+              // taken already x, y, and z) with 32-bit values, so uint16
+              // is all one can do.
+              double scaled_error = opt.triangulation_error_factor * error;
+              scaled_error = round(scaled_error);
+              scaled_error = std::max(scaled_error, 0.0); // should not be necessary
+              scaled_error = std::min(scaled_error,
+                                      double(std::numeric_limits<std::uint16_t>::max()));
+              las_point.SetIntensity(std::uint16_t(scaled_error));
+            }
+
+            writer.WritePoint(las_point);
+          }
         }
-          
-        writer.WritePoint(las_point);
       }
     }
     tpc.report_finished();
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <math.h>
+#include <sstream>
 #include <boost/filesystem.hpp>
 
 #include <vw/Image/Transform.h>
@@ -45,7 +46,7 @@ struct Options : vw::GdalWriteOptions {
   std::string pointcloud_filename, texture_file_name;
 
   // Settings
-  int point_cloud_step_size, texture_step_size, precision;
+  int point_cloud_step_size, texture_step_size, precision, num_lod_levels;
   bool center;
 
   // Output
@@ -61,10 +62,12 @@ public:
 };
 
 // Form the mtl file having the given png texture
-void save_mtl(std::string const& output_prefix, std::string const& output_prefix_no_dir) {
+void save_mtl(std::string const& output_prefix, std::string const& output_prefix_no_dir,
+              bool verbose = true) {
   
   std::string mtl_file = output_prefix + ".mtl";
-  std::cout << "Writing: " << mtl_file << std::endl;
+  if (verbose)
+    std::cout << "Writing: " << mtl_file << std::endl;
 
   std::ofstream ofs(mtl_file.c_str());
   ofs << "newmtl material0000\n";
@@ -78,9 +81,11 @@ void save_mtl(std::string const& output_prefix, std::string const& output_prefix
   ofs.close();
 }
 
-void save_texture(std::string const& output_prefix, ImageViewRef<float> texture_image) {
+void save_texture(std::string const& output_prefix, ImageViewRef<float> texture_image,
+                  bool verbose = true) {
   std::string texture_file = output_prefix + ".png";
-  std::cout << "Writing: " << texture_file << std::endl;
+  if (verbose)
+    std::cout << "Writing: " << texture_file << std::endl;
   //DiskImageView<PixelGray<uint8> > new_texture(tex_file+".tif");
 
   double image_min = 0.0, image_max = 1.0;
@@ -97,16 +102,16 @@ inline bool is_valid_pt(Vector3 const& P) {
   return true;
 }
 
-// Add a given vertex to the .obj file unless already present
-inline void add_vertex(Vector3 const& V, std::pair<int, int> const& pix,
-                       int cloud_cols, int cloud_rows,
-                       std::ofstream & ofs,
-                       std::map<std::pair<int, int>, int> & pix_to_vertex,
-                       int & vertex_count) {
-  if (pix_to_vertex.find(pix) == pix_to_vertex.end()) {
+// Add a given vertex to the .obj file unless already present. The
+// vertex id is 0 until the vertex is written. The texture coordinates
+// are relative to the box of the cloud being meshed.
+inline void add_vertex(Vector3 const& V, int col, int row, BBox2i const& box,
+                       std::ofstream & ofs, int & vertex_id, int & vertex_count,
+                       BBox3 & mesh_bbox) {
+  if (vertex_id == 0) {
     ofs << "v " << V[0] << " " << V[1] << " " << V[2] << '\n';
 
-    double u = double(pix.first)/cloud_cols;
+    double u = double(col - box.min().x())/box.width();
     
     // TODO(oalexan1). Study this. The second option looks more accurate.
     // In the second option the lower-left pixel (0, cloud_rows - 1)
@@ -115,95 +120,187 @@ inline void add_vertex(Vector3 const& V, std::pair<int, int> const& pix,
     // In some places on the net I even saw a subpixel shift of (0.5, 0.5)
     // which makes things even more complicated.
 #if 0
-    double v = double(pix.second)/cloud_rows;
+    double v = double(row - box.min().y())/box.height();
     ofs << "vt " << u  << ' ' << 1.0 - v << std::endl;
 #else
-    double v = double(cloud_rows - 1 - pix.second)/cloud_rows;
+    double v = double(box.max().y() - 1 - row)/box.height();
     ofs << "vt " << u  << ' ' << v << std::endl;
 #endif
     
-    pix_to_vertex[pix] = vertex_count;
+    vertex_id = vertex_count;
     vertex_count++;
+    mesh_bbox.grow(V);
   }
 }
 
-void save_mesh(std::string const& output_prefix,
-               std::string const& output_prefix_no_dir,
-               ImageViewRef<Vector3> point_cloud,
-               Vector3 C, int precision) {
+inline void add_face(std::ofstream & ofs, int a, int b, int c) {
+  ofs << "f " << a << "/" << a << " " << b << "/" << b << " " << c << "/" << c << '\n';
+}
+
+// Mesh the given box of the cloud. Each face is written right after
+// its vertices, and only the vertex ids of the current and next
+// columns are kept, so the memory use does not grow with the size of
+// the cloud. Return the number of faces. Their bounding box is
+// returned as well.
+int save_mesh(std::string const& output_prefix,
+              std::string const& output_prefix_no_dir,
+              ImageViewRef<Vector3> point_cloud, BBox2i const& box,
+              Vector3 C, int precision, bool show_progress, BBox3 & mesh_bbox) {
 
   std::string mesh_file = output_prefix + ".obj";
-  std::cout << "Writing: " << mesh_file << std::endl;
+  if (show_progress)
+    std::cout << "Writing: " << mesh_file << std::endl;
   std::ofstream ofs(mesh_file.c_str());
   ofs.precision(precision);
   ofs << "mtllib " << output_prefix_no_dir << ".mtl\n";
 
-  // Some constants for the calculation in here
-  int cloud_cols = point_cloud.cols();
-  int cloud_rows = point_cloud.rows();
+  mesh_bbox = BBox3();
+  int num_cols = box.width(), num_rows = box.height();
   
   TerminalProgressCallback vertex_progress("asp", "\tVertices:   ");
-  double vertex_progress_mult = 1.0/double(std::max(cloud_cols - 1, 1));
+  double vertex_progress_mult = 1.0/double(std::max(num_cols - 1, 1));
 
   // Make sure we we save a vertex only once even if we encounter it
   // multiple times.
-  std::map<std::pair<int, int>, int> pix_to_vertex;
-    
-  std::vector<Vector3i> faces;
+  std::vector<int> curr_ids(num_rows, 0), next_ids(num_rows, 0);
+
+  int num_faces = 0;
   int vertex_count = 1; // The obj spec calls for the starting vertex to have index 1.
-  for (int col = 0; col < cloud_cols - 1; col++) {
-    vertex_progress.report_progress(col*vertex_progress_mult);
+  for (int col = box.min().x(); col < box.max().x() - 1; col++) {
+    if (show_progress)
+      vertex_progress.report_progress((col - box.min().x())*vertex_progress_mult);
     
-    for (int row = 0; row < cloud_rows - 1; row++) {
+    for (int row = box.min().y(); row < box.max().y() - 1; row++) {
       // We have a square that needs to be split into two triangles.
       // Here the image is viewed as having the origin on the upper-left,
       // the column axis going right, and the row axis going down.
-      std::pair<int, int> pix_ul = std::make_pair(col,     row);
-      std::pair<int, int> pix_ur = std::make_pair(col + 1, row);
-      std::pair<int, int> pix_ll = std::make_pair(col,     row + 1);
-      std::pair<int, int> pix_lr = std::make_pair(col + 1, row + 1);
-      Vector3 UL = point_cloud(pix_ul.first, pix_ul.second);
-      Vector3 UR = point_cloud(pix_ur.first, pix_ur.second);
-      Vector3 LL = point_cloud(pix_ll.first, pix_ll.second);
-      Vector3 LR = point_cloud(pix_lr.first, pix_lr.second);
+      int r = row - box.min().y();
+      Vector3 UL = point_cloud(col,     row);
+      Vector3 UR = point_cloud(col + 1, row);
+      Vector3 LL = point_cloud(col,     row + 1);
+      Vector3 LR = point_cloud(col + 1, row + 1);
 
       if (is_valid_pt(UL) && is_valid_pt(LL) && is_valid_pt(UR)) {
 
-        add_vertex(UL - C, pix_ul, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
-        add_vertex(LL - C, pix_ll, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
-        add_vertex(UR - C, pix_ur, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
+        add_vertex(UL - C, col,     row,     box, ofs, curr_ids[r],     vertex_count, mesh_bbox);
+        add_vertex(LL - C, col,     row + 1, box, ofs, curr_ids[r + 1], vertex_count, mesh_bbox);
+        add_vertex(UR - C, col + 1, row,     box, ofs, next_ids[r],     vertex_count, mesh_bbox);
 
-        Vector3 face(pix_to_vertex[pix_ul], pix_to_vertex[pix_ll], pix_to_vertex[pix_ur]);
-        faces.push_back(face);
+        add_face(ofs, curr_ids[r], curr_ids[r + 1], next_ids[r]);
+        num_faces++;
       }
       
       if (is_valid_pt(UR) && is_valid_pt(LL) && is_valid_pt(LR)) {
 
-        add_vertex(UR - C, pix_ur, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
-        add_vertex(LL - C, pix_ll, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
-        add_vertex(LR - C, pix_lr, cloud_cols, cloud_rows, ofs, pix_to_vertex, vertex_count);
+        add_vertex(UR - C, col + 1, row,     box, ofs, next_ids[r],     vertex_count, mesh_bbox);
+        add_vertex(LL - C, col,     row + 1, box, ofs, curr_ids[r + 1], vertex_count, mesh_bbox);
+        add_vertex(LR - C, col + 1, row + 1, box, ofs, next_ids[r + 1], vertex_count, mesh_bbox);
 
-        Vector3 face(pix_to_vertex[pix_ur], pix_to_vertex[pix_ll], pix_to_vertex[pix_lr]);
-        faces.push_back(face);
+        add_face(ofs, next_ids[r], curr_ids[r + 1], next_ids[r + 1]);
+        num_faces++;
       }
       
     }
+
+    // The next column becomes the current one
+    curr_ids.swap(next_ids);
+    std::fill(next_ids.begin(), next_ids.end(), 0);
   }
-  vertex_progress.report_finished();
-
-  TerminalProgressCallback face_progress("asp", "\tFaces:   ");
-  double face_progress_mult = 1.0/double(std::max(faces.size(), size_t(1)));
-  for (size_t face_iter = 0; face_iter < faces.size(); face_iter++) {
-    face_progress.report_progress(face_iter*face_progress_mult);
-
-    Vector3 const& F = faces[face_iter]; // alias
-    ofs << "f "
-        << F[0] << "/" << F[0] << " "
-        << F[1] << "/" << F[1] << " "
-        << F[2] << "/" << F[2]
-        << std::endl;
+  if (show_progress)
+    vertex_progress.report_finished();
+
+  return num_faces;
+}
+
+// Write a quadtree of meshes. At level 0 the whole cloud is one tile.
+// Each tile at a level is split into four at the next one, at twice
+// the resolution, so each tile has about as many vertices as the
+// others. The finest level is sampled with the given step sizes.
+// Each tile has its own mesh, material, and texture, which are
+// written before the next tile is read, and is listed in an index
+// file with its level, position, and bounding box.
+void save_lod_meshes(Options const& opt, std::string const& output_prefix_no_dir,
+                     ImageViewRef<Vector3> full_cloud,
+                     ImageViewRef<float> full_texture, Vector3 C) {
+
+  int num_levels = opt.num_lod_levels;
+  int finest_cols = (full_cloud.cols() + opt.point_cloud_step_size - 1)
+    / opt.point_cloud_step_size;
+  int finest_rows = (full_cloud.rows() + opt.point_cloud_step_size - 1)
+    / opt.point_cloud_step_size;
+  int num_finest = 1 << (num_levels - 1); // number of tiles per side at the finest level
+
+  // The tile size, in cloud samples, which is the same at all levels
+  int tile_cols = std::max((finest_cols + num_finest - 1) / num_finest, 2);
+  int tile_rows = std::max((finest_rows + num_finest - 1) / num_finest, 2);
+  int tex_ratio = opt.point_cloud_step_size / opt.texture_step_size;
+
+  std::string index_file = opt.output_prefix + "-lod-index.txt";
+  vw_out() << "Writing: " << index_file << std::endl;
+  std::ofstream index(index_file.c_str());
+  index.precision(opt.precision);
+  index << "# level tile_row tile_col mesh_file min_x min_y min_z max_x max_y max_z\n";
+
+  for (int level = 0; level < num_levels; level++) {
+
+    int factor        = 1 << (num_levels - 1 - level);
+    int cloud_step    = opt.point_cloud_step_size * factor;
+    int texture_step  = opt.texture_step_size * factor;
+    ImageViewRef<Vector3> level_cloud   = subsample(full_cloud,   cloud_step);
+    ImageViewRef<float>   level_texture = subsample(full_texture, texture_step);
+
+    int num_tile_cols = (level_cloud.cols() + tile_cols - 1) / tile_cols;
+    int num_tile_rows = (level_cloud.rows() + tile_rows - 1) / tile_rows;
+    vw_out() << "Level " << level << ": " << num_tile_cols << " x " << num_tile_rows
+             << " tiles.\n";
+
+    TerminalProgressCallback tpc("asp", "\t--> ");
+    for (int tile_row = 0; tile_row < num_tile_rows; tile_row++) {
+      tpc.report_fractional_progress(tile_row, num_tile_rows);
+      for (int tile_col = 0; tile_col < num_tile_cols; tile_col++) {
+
+        // Include the first row and column of the next tiles, so that
+        // adjacent tiles meet with no gap
+        BBox2i box(tile_col*tile_cols, tile_row*tile_rows, tile_cols + 1, tile_rows + 1);
+        box.crop(bounding_box(level_cloud));
+        if (box.width() < 2 || box.height() < 2)
+          continue;
+
+        // Read the tile in memory, as each point is used several times
+        ImageViewRef<Vector3> tile_ref
+          = crop(ImageView<Vector3>(crop(level_cloud, box)),
+                 -box.min().x(), -box.min().y(), level_cloud.cols(), level_cloud.rows());
+
+        std::ostringstream os;
+        os << "-lod" << level << "-" << tile_row << "-" << tile_col;
+        std::string tile_prefix = opt.output_prefix + os.str();
+        std::string tile_prefix_no_dir = output_prefix_no_dir + os.str();
+
+        BBox3 mesh_bbox;
+        bool show_progress = false;
+        int num_faces = save_mesh(tile_prefix, tile_prefix_no_dir, tile_ref, box, C,
+                                  opt.precision, show_progress, mesh_bbox);
+        if (num_faces == 0) {
+          boost::filesystem::remove(tile_prefix + ".obj");
+          continue;
+        }
+
+        BBox2i tex_box(box.min().x() * tex_ratio, box.min().y() * tex_ratio,
+                       box.width() * tex_ratio, box.height() * tex_ratio);
+        tex_box.crop(bounding_box(level_texture));
+        bool verbose = false;
+        save_texture(tile_prefix, crop(level_texture, tex_box), verbose);
+        save_mtl(tile_prefix, tile_prefix_no_dir, verbose);
+
+        index << level << " " << tile_row << " " << tile_col << " "
+              << tile_prefix_no_dir << ".obj "
+              << mesh_bbox.min()[0] << " " << mesh_bbox.min()[1] << " "
+              << mesh_bbox.min()[2] << " " << mesh_bbox.max()[0] << " "
+              << mesh_bbox.max()[1] << " " << mesh_bbox.max()[2] << "\n";
+      }
+    }
+    tpc.report_finished();
   }
-  face_progress.report_finished();
 }
 
 void handle_arguments( int argc, char *argv[], Options& opt ) {
@@ -218,7 +315,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("center", po::bool_switch(&opt.center)->default_value(false),
      "Let the origin be the midpoint of the bounding box of the cloud. Use this option if you are experiencing numerical precision issues.")
     ("precision", po::value(&opt.precision)->default_value(17),
-     "How many digits of precision to save.");
+     "How many digits of precision to save.")
+    ("num-lod-levels", po::value(&opt.num_lod_levels)->default_value(0),
+     "If positive, write a quadtree of tiled meshes with this many levels of detail, rather than one mesh. The finest level is sampled with the given step sizes, and each coarser one at half the resolution of the next.");
   
   general_options.add( vw::GdalWriteOptionsDescription(opt) );
 
@@ -256,6 +355,15 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw(ArgumentErr() << "Precision must be positive.\n"
              << usage << general_options);
 
+  if (opt.texture_step_size <= 0)
+    vw_throw(ArgumentErr() << "The texture step size must be positive.\n"
+             << usage << general_options);
+
+  // To keep the number of tiles and the step sizes in range
+  if (opt.num_lod_levels < 0 || opt.num_lod_levels > 16)
+    vw_throw(ArgumentErr() << "The number of levels of detail must be between 0 and 16.\n"
+             << usage << general_options);
+
   // It is useful to have this to make the p
   if (opt.point_cloud_step_size % opt.texture_step_size != 0) 
     vw_throw(ArgumentErr() << "--point-cloud-step-size must be a multiple "
@@ -288,21 +396,20 @@ int main(int argc, char *argv[]){
              << image_size[0] << " x " << image_size[1] << "\n";
     
     // Loading point cloud
-    ImageViewRef<Vector3> point_cloud;
+    ImageViewRef<Vector3> full_cloud;
     if (num_channels == 1 && has_georef) {
       // The input is a DEM. Convert it to a point cloud.
       DiskImageView<double> dem(input_file);
-      point_cloud = vw::subsample(geodetic_to_cartesian(dem_to_geodetic
-                                                        (create_mask(dem, nodata_val), georef),
-                                                        georef.datum()),
-                                  opt.point_cloud_step_size);
+      full_cloud = geodetic_to_cartesian(dem_to_geodetic
+                                         (create_mask(dem, nodata_val), georef),
+                                         georef.datum());
     }else if (num_channels >= 3){
       // The input DEM is a point cloud
-      point_cloud = vw::subsample(asp::read_asp_point_cloud<3>(input_file),
-                                  opt.point_cloud_step_size);
+      full_cloud = asp::read_asp_point_cloud<3>(input_file);
     }else{
       vw_throw( ArgumentErr() << "The input must be a point cloud or a DEM.\n");
     }
+    ImageViewRef<Vector3> point_cloud = vw::subsample(full_cloud, opt.point_cloud_step_size);
 
     vw_out() << "\t--> Subsampled cloud size:   "
              << point_cloud.cols() << " x " << point_cloud.rows() << "\n";
@@ -318,22 +425,34 @@ int main(int argc, char *argv[]){
       vw_out() << std::setprecision(17) << "\t    Midpoint: " << C << "\n";
     }
     
-    ImageViewRef<float> texture_image;
-    
-    // Resample the image if it is too fine.
-    if ( !opt.texture_file_name.empty() ) {
-      texture_image = vw::subsample(DiskImageView<float>(opt.texture_file_name),
-                                    opt.texture_step_size);
-    } else {
-      // Use a blank texture image with each pixel being white
-      texture_image = per_pixel_filter(point_cloud, BlankImage());
-    }
+    // Use a blank texture image with each pixel being white if none is given
+    bool have_texture = !opt.texture_file_name.empty();
+    ImageViewRef<float> full_texture;
+    if (have_texture)
+      full_texture = DiskImageView<float>(opt.texture_file_name);
+    else
+      full_texture = per_pixel_filter(full_cloud, BlankImage());
     
     boost::filesystem::path p(opt.output_prefix);
     std::string output_prefix_no_dir = p.filename().string();
-  
+
+    if (opt.num_lod_levels > 0) {
+      save_lod_meshes(opt, output_prefix_no_dir, full_cloud, full_texture, C);
+      return 0;
+    }
+
+    // Resample the image if it is too fine.
+    ImageViewRef<float> texture_image;
+    if (have_texture)
+      texture_image = vw::subsample(full_texture, opt.texture_step_size);
+    else
+      texture_image = per_pixel_filter(point_cloud, BlankImage());
+
+    BBox3 mesh_bbox;
+    bool show_progress = true;
     save_mesh(opt.output_prefix, output_prefix_no_dir,
-              point_cloud, C, opt.precision);
+              point_cloud, bounding_box(point_cloud), C, opt.precision,
+              show_progress, mesh_bbox);
     
     save_texture(opt.output_prefix, texture_image);
     
@@ -0,0 +1,96 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#ifndef __ASP_TOOLS_PROFILED_COST_FUNCTION_H__
+#define __ASP_TOOLS_PROFILED_COST_FUNCTION_H__
+
+/**
+  A wrapper around a Ceres cost function which counts its evaluations
+  and their wall time, for --profile-cost-functions in bundle_adjust,
+  jitter_solve, and sfs.
+*/
+
+#include <asp/Core/CostProfile.h>
+
+#include <ceres/ceres.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace asp {
+
+  class ProfiledCostFunction: public ceres::CostFunction {
+  public:
+    // Takes ownership of the cost function
+    ProfiledCostFunction(ceres::CostFunction * cost_function, CostProfile::Stats * stats):
+      m_cost_function(cost_function), m_stats(stats) {
+      set_num_residuals(m_cost_function->num_residuals());
+      *mutable_parameter_block_sizes() = m_cost_function->parameter_block_sizes();
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals,
+                          double** jacobians) const {
+      auto beg = std::chrono::steady_clock::now();
+      bool ans = m_cost_function->Evaluate(parameters, residuals, jacobians);
+      auto end = std::chrono::steady_clock::now();
+      m_stats->num_calls++;
+      if (jacobians != NULL)
+        m_stats->num_jacobian_calls++;
+      m_stats->nanoseconds
+        += std::chrono::duration_cast<std::chrono::nanoseconds>(end - beg).count();
+      return ans;
+    }
+
+  private:
+    std::unique_ptr<ceres::CostFunction> m_cost_function;
+    CostProfile::Stats * m_stats;
+  };
+
+  /// Wrap the cost function for profiling if that is enabled, and
+  /// otherwise return it as is. Call this once for each residual
+  /// block, or once for a cost function shared among residual blocks.
+  inline ceres::CostFunction * profile_cost(ceres::CostFunction * cost_function,
+                                            std::string const& name) {
+    if (!cost_profile().enabled())
+      return cost_function;
+    return new ProfiledCostFunction(cost_function, cost_profile().stats(name));
+  }
+
+  /// Add the timings of a solve to the profile, if enabled
+  inline void profile_solver_summary(ceres::Solver::Summary const& summary) {
+    CostProfile & profile = cost_profile();
+    if (!profile.enabled())
+      return;
+    profile.add_solver_stat("solves", 1);
+    profile.add_solver_stat("iterations", summary.iterations.size());
+    profile.add_solver_stat("residual_blocks", summary.num_residual_blocks);
+    profile.add_solver_stat("preprocessor_seconds", summary.preprocessor_time_in_seconds);
+    profile.add_solver_stat("minimizer_seconds", summary.minimizer_time_in_seconds);
+    profile.add_solver_stat("residual_evaluation_seconds",
+                            summary.residual_evaluation_time_in_seconds);
+    profile.add_solver_stat("jacobian_evaluation_seconds",
+                            summary.jacobian_evaluation_time_in_seconds);
+    profile.add_solver_stat("linear_solver_seconds", summary.linear_solver_time_in_seconds);
+    profile.add_solver_stat("postprocessor_seconds", summary.postprocessor_time_in_seconds);
+    profile.add_solver_stat("total_seconds", summary.total_time_in_seconds);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_TOOLS_PROFILED_COST_FUNCTION_H__
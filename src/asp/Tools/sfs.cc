@@ -83,15 +83,22 @@
 #include <vw/Image/DistanceFunction.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/FileUtils.h>
 #include <vw/Core/CmdUtils.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Sessions/CameraUtils.h>
 #include <asp/IsisIO/IsisCameraModel.h>
 #include <asp/Camera/CsmModel.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/BackgroundWriter.h>
+#include <asp/Tools/profiled_cost_function.h>
 #include <asp/Camera/RPCModelGen.h>
+#include <asp/Camera/ApproxCameraTable.h>
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
 #include <iostream>
@@ -122,6 +129,9 @@ using namespace vw::cartography;
 typedef ImageViewRef< PixelMask<float> > MaskedImgT;
 typedef ImageViewRef<double> DoubleImgT;
 
+// The residuals are added over the DEM in square blocks of this size
+const int SFS_GRID_BLOCK_SIZE = 64;
+
 
 namespace vw { namespace camera {
 
@@ -171,18 +181,10 @@ namespace vw { namespace camera {
   // works by tabulation of point_to_pixel and pixel_to_vector values
   // at the mean dem height.
   class ApproxCameraModel: public ApproxBaseCameraModel {
-    mutable Vector3 m_mean_dir; // mean vector from camera to ground
     GeoReference m_geo;
-    double m_mean_ht;
-    mutable ImageView< PixelMask<Vector3> > m_pixel_to_vec_mat;
-    mutable ImageView< PixelMask<Vector2> > m_point_to_pix_mat;
-    double m_approx_table_gridx, m_approx_table_gridy;
+    asp::ApproxCameraTable m_table;
     bool m_use_rpc_approximation, m_use_semi_approx;
     vw::Mutex& m_camera_mutex;
-    Vector2 m_uncompValue;
-    mutable int m_begX, m_endX, m_begY, m_endY;
-    mutable bool m_compute_mean, m_stop_growing_range;
-    mutable int m_count;
     boost::shared_ptr<asp::RPCModel> m_rpc_model;
     
     bool comp_rpc_approx_table(AdjustedCameraModel const& adj_camera,
@@ -392,53 +394,6 @@ namespace vw { namespace camera {
       return true;
     }
     
-    void comp_entries_in_table() const{
-      for (int x = m_begX; x <= m_endX; x++) {
-        for (int y = m_begY; y <= m_endY; y++) {
-      
-          // This will be useful when we invoke this function repeatedly
-          if (m_point_to_pix_mat(x, y).child() != m_uncompValue) {
-            continue;
-          }
-      
-          Vector2 pt(m_point_box.min().x() + x*m_approx_table_gridx,
-                     m_point_box.min().y() + y*m_approx_table_gridy);
-          Vector2 lonlat = m_geo.point_to_lonlat(pt);
-          Vector3 xyz = m_geo.datum().geodetic_to_cartesian
-            (Vector3(lonlat[0], lonlat[1], m_mean_ht));
-          bool success = true;
-          Vector2 pix;
-          Vector3 vec;
-          try {
-            pix = m_exact_unadjusted_camera->point_to_pixel(xyz);
-            //if (true || m_img_bbox.contains(pix))  // Need to think more here
-            vec = m_exact_unadjusted_camera->pixel_to_vector(pix);
-            //else
-            // success = false;
-            
-          }catch(...){
-            success = false;
-          }
-          if (success) {
-            m_pixel_to_vec_mat(x, y) = vec;
-            m_point_to_pix_mat(x, y) = pix;
-            m_pixel_to_vec_mat(x, y).validate();
-            m_point_to_pix_mat(x, y).validate();
-            if (m_compute_mean) {
-              m_mean_dir += vec; // only when the point projects inside the camera?
-              if (m_img_bbox.contains(pix)) 
-                m_crop_box.grow(pix);
-              m_count++;
-            }
-          }else{
-            m_pixel_to_vec_mat(x, y).invalidate();
-            m_point_to_pix_mat(x, y).invalidate();
-          }
-        }
-      }
-      
-    }
-    
   public:
 
     ApproxCameraModel(AdjustedCameraModel const& exact_adjusted_camera,
@@ -459,37 +414,32 @@ namespace vw { namespace camera {
       // Initialize members of the base class
       m_model_is_valid = true;
       
-      int big = 1e+8;
-      m_uncompValue = Vector2(-big, -big);
-      m_compute_mean = true; // We'll set this to false when we finish estimating the mean
-      m_stop_growing_range = false; // stop when it does not help
-      
       if (dynamic_cast<IsisCameraModel*>(exact_unadjusted_camera.get()) == NULL)
         vw_throw( ArgumentErr()
                   << "ApproxCameraModel: Expecting an unadjusted camera model.\n");
 
       // Compute the mean DEM height.
       // We expect all DEM entries to be valid.
-      m_mean_ht = 0;
+      double mean_ht = 0;
       double num = 0.0;
       for (int col = 0; col < dem.cols(); col++) {
         for (int row = 0; row < dem.rows(); row++) {
           if (dem(col, row) == nodata_val)
             vw_throw( ArgumentErr()
                       << "ApproxCameraModel: Expecting a DEM without nodata values.\n");
-          m_mean_ht += dem(col, row);
+          mean_ht += dem(col, row);
           num += 1.0;
         }
       }
-      if (num > 0) m_mean_ht /= num;
+      if (num > 0) mean_ht /= num;
 
       // The area we're supposed to work around
       m_point_box = m_geo.pixel_to_point_bbox(bounding_box(dem));
       double wx = m_point_box.width(), wy = m_point_box.height();
-      m_approx_table_gridx = wx/std::max(dem.cols(), 1);
-      m_approx_table_gridy = wy/std::max(dem.rows(), 1);
+      double gridx = wx/std::max(dem.cols(), 1);
+      double gridy = wy/std::max(dem.rows(), 1);
 
-      if (m_approx_table_gridx == 0 || m_approx_table_gridy == 0) {
+      if (gridx == 0 || gridy == 0) {
         vw_throw( ArgumentErr()
                   << "ApproxCameraModel: Expecting a positive grid size.\n");
       }
@@ -534,42 +484,23 @@ namespace vw { namespace camera {
       
       // We will tabulate the point_to_pixel function at a multiple of
       // the grid, and we'll use interpolation for anything in
-      // between.
-      //m_approx_table_gridx /= 2.0; m_approx_table_gridy /= 2.0; // fine
-      m_approx_table_gridx *= 2.0; m_approx_table_gridy *= 2.0; // coarse. good enough.
-
-      int numx = wx/m_approx_table_gridx;
-      int numy = wy/m_approx_table_gridy;
-
-      vw_out() << "Lookup table dimensions: " << numx << ' ' << numy << std::endl;
-
-      // Choose f so that the width from m_begX to m_endX is 2 x original wx
-      double f = 0; // (extra-0.5)/(2.0*extra+1.0);
-      m_begX = f*numx; m_endX = std::min((1.0-f)*numx, numx-1.0);
-      m_begY = f*numy; m_endY = std::min((1.0-f)*numy, numy-1.0);
-      
-      //vw_out() << "Size of actually pre-computed table: "
-      //           << m_endX - m_begX << ' ' << m_endY - m_begY << std::endl;
-      
-      // Mark all values as uncomputed and invalid
-      m_pixel_to_vec_mat.set_size(numx, numy);
-      m_point_to_pix_mat.set_size(numx, numy);
-      for (int x = 0; x < numx; x++) {
-        for (int y = 0; y < numy; y++) {
-          m_point_to_pix_mat(x, y) = m_uncompValue;
-          m_point_to_pix_mat(x, y).invalidate();
+      // between. The whole table is computed here, before any
+      // threads use it, and it does not change after that, so that
+      // point_to_pixel() can read it without a lock.
+      gridx *= 2.0; gridy *= 2.0; // coarse. good enough.
+      m_table.build(*m_exact_unadjusted_camera, m_geo, m_point_box, gridx, gridy, mean_ht);
+
+      vw_out() << "Lookup table dimensions: " << m_table.cols() << ' '
+               << m_table.rows() << std::endl;
+
+      for (int x = 0; x < m_table.cols(); x++) {
+        for (int y = 0; y < m_table.rows(); y++) {
+          PixelMask<Vector2> const& pix = m_table.pixel(x, y);
+          if (is_valid(pix) && m_img_bbox.contains(pix.child())) 
+            m_crop_box.grow(pix.child());
         }
       }
       
-      // Fill in the table. Find along the way the mean direction from
-      // the camera to the ground. Invalid values will be masked.
-      m_count = 0;
-      m_mean_dir = Vector3();
-      comp_entries_in_table();
-      m_mean_dir /= std::max(1, m_count);
-      m_mean_dir = m_mean_dir/norm_2(m_mean_dir);
-      m_compute_mean = false; // done computing the mean
-      
       // Ensure the box is valid
       //if (m_crop_box.empty()) m_crop_box = BBox2(0, 0, 2, 2);
 
@@ -608,128 +539,20 @@ namespace vw { namespace camera {
       
       if (m_use_rpc_approximation) 
         return m_rpc_model->point_to_pixel(xyz);
-      
-      // TODO: What happens if we use bicubic interpolation?
-      InterpolationView<EdgeExtensionView< ImageView< PixelMask<Vector3> >, ConstantEdgeExtension >, BilinearInterpolation> pixel_to_vec_interp
-        = interpolate(m_pixel_to_vec_mat, BilinearInterpolation(),
-                      ConstantEdgeExtension());
 
-      InterpolationView<EdgeExtensionView< ImageView< PixelMask<Vector2> >, ConstantEdgeExtension >, BilinearInterpolation> point_to_pix_interp
-        = interpolate(m_point_to_pix_mat, BilinearInterpolation(),
-                      ConstantEdgeExtension());
-
-      Vector3 dir = m_mean_dir;
       Vector2 pix;
-      double major_radius = m_geo.datum().semi_major_axis() + m_mean_ht;
-      double minor_radius = m_geo.datum().semi_minor_axis() + m_mean_ht;
-      for (size_t i = 0; i < 10; i++) {
-
-        Vector3 S = xyz - 1.1*major_radius*dir; // push the point outside the sphere
-        if (norm_2(S) <= major_radius) {
-          // should not happen. Return the exact solution.
-          {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "3D point is inside the planet.\n";
-            }
-            return m_exact_unadjusted_camera->point_to_pixel(xyz);
-          }
-        }
-
-        Vector3 datum_pt = datum_intersection(major_radius, minor_radius, S, dir);
-        Vector3 llh = m_geo.datum().cartesian_to_geodetic(datum_pt);
-        Vector2 pt = m_geo.lonlat_to_point(subvector(llh, 0, 2));
-
-        // Indices
-        double x = (pt.x() - m_point_box.min().x())/m_approx_table_gridx;
-        double y = (pt.y() - m_point_box.min().y())/m_approx_table_gridy;
-
-        bool out_of_range = ( x < 0 || x >= m_pixel_to_vec_mat.cols()-1 ||
-                              y < 0 || y >= m_pixel_to_vec_mat.rows()-1 );
-
-        bool out_of_comp_range = (x < m_begX || x >= m_endX-1 ||
-                                  y < m_begY || y >= m_endY-1);
-
-        // If we are not out of range, but we need to expand the computed table, do that
-        if (!m_stop_growing_range && !out_of_range && out_of_comp_range) {
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of computed range. "
-                                   << "Growing the computed table." << std::endl;
-            vw_out(WarningMessage) << "Start table: " << m_begX << ' ' << m_begY << ' '
-                                   << m_endX << ' ' << m_endY << std::endl;
-          }
-          
-          // If we have to expand, do it by a lot
-          int extrax = std::max(10, int(0.1*(m_endX - m_begX)));
-          int extray = std::max(10, int(0.1*(m_endY - m_begY)));
-
-          int old_begX = m_begX, old_begY = m_begY;
-          int old_endX = m_endX, old_endY = m_endY;
-
-          m_begX = std::min(m_begX, int(floor(x))) - extrax; m_begX = std::max(0, m_begX);
-          m_begY = std::min(m_begY, int(floor(y))) - extray; m_begY = std::max(0, m_begY);
-      
-          m_endX = std::max(m_endX, int(ceil(x))) + extrax;
-          m_endX = std::min(m_pixel_to_vec_mat.cols()-1, m_endX);
-
-          m_endY = std::max(m_endY, int(ceil(y))) + extray;
-          m_endY = std::min(m_pixel_to_vec_mat.rows()-1, m_endY);
-      
-          if (g_warning_count < g_max_warning_count) {
-            vw_out(WarningMessage) << "Updated table: " << m_begX << ' ' << m_begY << ' '
-                                   << m_endX << ' ' << m_endY << std::endl;
-          }
-          comp_entries_in_table();
+      if (m_table.point_to_pixel(xyz, pix))
+        return pix;
 
-          // Update this
-          out_of_comp_range = (x < m_begX || x >= m_endX-1 ||
-                               y < m_begY || y >= m_endY-1);
-
-          // Avoid an infinite loop if we can't grow the table
-          if (old_begX == m_begX && old_begY == m_begY &&
-              old_endX == m_endX && old_endY == m_endY ) {
-            m_stop_growing_range = true;
-          }
-        }
-
-        if (out_of_range || out_of_comp_range){
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
-                                   << x << ' ' << y << ' '
-                                   << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
-                                   << std::endl;
-          }
-          return m_exact_unadjusted_camera->point_to_pixel(xyz);
-        }
-        PixelMask<Vector3> masked_dir = pixel_to_vec_interp(x, y);
-        PixelMask<Vector2> masked_pix = point_to_pix_interp(x, y);
-
-        if (is_valid(masked_dir) && is_valid(masked_pix)) {
-          dir = masked_dir.child();
-          pix = masked_pix.child();
-        }else{
-          {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "Invalid ground to camera direction: "
-                                     << masked_dir << ' ' << masked_pix << std::endl;
-            }
-            return m_exact_unadjusted_camera->point_to_pixel(xyz);
-          }
-        }
+      // Outside the table. Return the exact solution.
+      vw::Mutex::Lock lock(m_camera_mutex);
+      g_num_locks++;
+      if (g_warning_count < g_max_warning_count) {
+        g_warning_count++;
+        vw_out(WarningMessage) << "Using the exact camera to project point: "
+                               << xyz << std::endl;
       }
-
-      return pix;
+      return m_exact_unadjusted_camera->point_to_pixel(xyz);
     }
 
     virtual ~ApproxCameraModel(){}
@@ -822,106 +645,56 @@ namespace vw { namespace camera {
   // algorithm works by tabulation of point_to_pixel and
   // pixel_to_vector values at the mean dem height.
   class ApproxAdjustedCameraModel: public ApproxBaseCameraModel {
-    mutable Vector3 m_mean_dir; // mean vector from camera to ground
-    GeoReference m_geo;
-    double m_mean_ht;
-    mutable ImageView< PixelMask<Vector3> > m_pixel_to_vec_mat;
-    mutable ImageView< PixelMask<Vector2> > m_point_to_pix_mat;
-    double m_approx_table_gridx, m_approx_table_gridy;
+    asp::ApproxCameraTable m_table;
     vw::Mutex& m_camera_mutex;
-    Vector2 m_uncompValue;
-    mutable int m_begX, m_endX, m_begY, m_endY;
-    mutable int m_count;
-    
-    void comp_entries_in_table() const{
-      for (int x = m_begX; x <= m_endX; x++) {
-        for (int y = m_begY; y <= m_endY; y++) {
-      
-          // This will be useful when we invoke this function repeatedly
-          if (m_point_to_pix_mat(x, y).child() != m_uncompValue) {
-            continue;
-          }
-      
-          Vector2 pt(m_point_box.min().x() + x*m_approx_table_gridx,
-                     m_point_box.min().y() + y*m_approx_table_gridy);
-          Vector2 lonlat = m_geo.point_to_lonlat(pt);
-          Vector3 xyz = m_geo.datum().geodetic_to_cartesian
-            (Vector3(lonlat[0], lonlat[1], m_mean_ht));
-          bool success = true;
-          Vector2 pix;
-          Vector3 vec;
-          try {
-            pix = m_exact_adjusted_camera.point_to_pixel(xyz);
-            //if (true || m_img_bbox.contains(pix))  // Need to think more here
-            vec = m_exact_adjusted_camera.pixel_to_vector(pix);
-            //else
-            // success = false;
-            
-          }catch(...){
-            success = false;
-          }
-          if (success) {
-            m_pixel_to_vec_mat(x, y) = vec;
-            m_point_to_pix_mat(x, y) = pix;
-            m_pixel_to_vec_mat(x, y).validate();
-            m_point_to_pix_mat(x, y).validate();
-            m_mean_dir += vec; // only when the point projects inside the camera?
-            if (m_img_bbox.contains(pix)) 
-              m_crop_box.grow(pix);
-            m_count++;
-          }else{
-            m_pixel_to_vec_mat(x, y).invalidate();
-            m_point_to_pix_mat(x, y).invalidate();
-          }
-        }
-      }
-      
-    }
+    double m_scale; // pixels are divided by this, as with AdjustedCameraModel
     
   public:
 
+    // If table_dir is not empty, look there first for a table saved
+    // by an earlier run with the same camera, adjustment, and DEM
+    // clip, and save the table there if it had to be computed.
     ApproxAdjustedCameraModel(AdjustedCameraModel const& exact_adjusted_camera,
                               boost::shared_ptr<CameraModel> exact_unadjusted_camera,
                               BBox2i img_bbox, 
                               ImageView<double> const& dem,
                               GeoReference const& geo,
                               double nodata_val,
+                              std::string const& camera_file,
+                              std::string const& table_dir,
                               vw::Mutex &camera_mutex):
       ApproxBaseCameraModel(exact_adjusted_camera, exact_unadjusted_camera, img_bbox),
-      m_geo(geo), m_camera_mutex(camera_mutex) {
+      m_camera_mutex(camera_mutex), m_scale(1.0) {
 
       // Initialize members of the base class
       m_model_is_valid = true;
 
-      int big = 1e+8;
-      m_uncompValue = Vector2(-big, -big);
-      
       if (dynamic_cast<AdjustedCameraModel*>(exact_unadjusted_camera.get()) != NULL)
         vw_throw( ArgumentErr()
                   << "ApproxAdjustedCameraModel: Expecting an unadjusted camera model.\n");
 
       // Compute the mean DEM height.
       // We expect all DEM entries to be valid.
-      m_mean_ht = 0;
+      double mean_ht = 0;
       double num = 0.0;
       for (int col = 0; col < dem.cols(); col++) {
         for (int row = 0; row < dem.rows(); row++) {
           if (dem(col, row) == nodata_val)
             vw_throw( ArgumentErr()
                       << "ApproxAdjustedCameraModel: Expecting a DEM without nodata values.\n");
-          m_mean_ht += dem(col, row);
+          mean_ht += dem(col, row);
           num += 1.0;
         }
       }
-      if (num > 0) m_mean_ht /= num;
+      if (num > 0) mean_ht /= num;
 
       // The area we're supposed to work around
-      m_point_box = m_geo.pixel_to_point_bbox(bounding_box(dem));
+      m_point_box = geo.pixel_to_point_bbox(bounding_box(dem));
       double wx = m_point_box.width(), wy = m_point_box.height();
-      m_approx_table_gridx = wx/std::max(dem.cols(), 1);
-      m_approx_table_gridy = wy/std::max(dem.rows(), 1);
+      double gridx = wx/std::max(dem.cols(), 1);
+      double gridy = wy/std::max(dem.rows(), 1);
 
-      if (m_approx_table_gridx == 0 || m_approx_table_gridy == 0) {
+      if (gridx == 0 || gridy == 0) {
         vw_throw( ArgumentErr()
                   << "ApproxAdjustedCameraModel: Expecting a positive grid size.\n");
       }
@@ -930,135 +703,72 @@ namespace vw { namespace camera {
       double extra = 0.5;
       m_point_box.min().x() -= extra*wx; m_point_box.max().x() += extra*wx;
       m_point_box.min().y() -= extra*wy; m_point_box.max().y() += extra*wy;
-      wx = m_point_box.width();
-      wy = m_point_box.height();
 
       vw_out() << "Approximation proj box: " << m_point_box << std::endl;
 
       // We will tabulate the point_to_pixel function at a multiple of
       // the grid, and we'll use interpolation for anything in
       // between.
-      //m_approx_table_gridx /= 2.0; m_approx_table_gridy /= 2.0; // fine
-      m_approx_table_gridx *= 2.0; m_approx_table_gridy *= 2.0; // Coarse. Good enough.
-
-      int numx = wx/m_approx_table_gridx;
-      int numy = wy/m_approx_table_gridy;
-
-      vw_out() << "Lookup table dimensions: " << numx << ' ' << numy << std::endl;
+      gridx *= 2.0; gridy *= 2.0; // Coarse. Good enough.
+
+      std::string key, table_file;
+      bool loaded = false;
+      if (table_dir != "") {
+        key = asp::approx_camera_table_key(camera_file, exact_adjusted_camera, geo,
+                                           m_point_box, gridx, gridy, mean_ht);
+        table_file = asp::approx_camera_table_file(table_dir, key);
+        loaded = m_table.read(table_file, key, geo);
+        if (loaded)
+          vw_out() << "Read approximate camera table: " << table_file << std::endl;
+      }
 
-      m_begX = 0; m_endX = numx-1;
-      m_begY = 0; m_endY = numy-1;
-      
-      //vw_out() << "Size of actually pre-computed table: "
-      //           << m_endX - m_begX << ' ' << m_endY - m_begY << std::endl;
-      
-      // Mark all values as uncomputed and invalid
-      m_pixel_to_vec_mat.set_size(numx, numy);
-      m_point_to_pix_mat.set_size(numx, numy);
-      for (int x = 0; x < numx; x++) {
-        for (int y = 0; y < numy; y++) {
-          m_point_to_pix_mat(x, y) = m_uncompValue;
-          m_point_to_pix_mat(x, y).invalidate();
+      if (!loaded) {
+        m_table.build(m_exact_adjusted_camera, geo, m_point_box, gridx, gridy, mean_ht);
+        if (table_dir != "") {
+          vw_out() << "Writing approximate camera table: " << table_file << std::endl;
+          m_table.write(table_file, key);
         }
       }
       
-      // Fill in the table. Find along the way the mean direction from
-      // the camera to the ground. Invalid values will be masked.
-      m_count = 0;
-      m_mean_dir = Vector3();
-      comp_entries_in_table();
-      m_mean_dir /= std::max(1, m_count);
-      m_mean_dir = m_mean_dir/norm_2(m_mean_dir);
-      
+      vw_out() << "Lookup table dimensions: " << m_table.cols() << ' '
+               << m_table.rows() << std::endl;
+
+      for (int x = 0; x < m_table.cols(); x++) {
+        for (int y = 0; y < m_table.rows(); y++) {
+          PixelMask<Vector2> const& pix = m_table.pixel(x, y);
+          if (is_valid(pix) && m_img_bbox.contains(pix.child())) 
+            m_crop_box.grow(pix.child());
+        }
+      }
       m_crop_box.crop(m_img_bbox);
 
       return;
     }
 
-    // We have tabulated point_to_pixel at the mean dem height.
-    // Look-up point_to_pixel for the current point by first
-    // intersecting the ray from the current point to the camera
-    // with the datum at that height. We don't know that ray,
-    // so we iterate to find it.
+    // We have tabulated point_to_pixel at the mean dem height. The
+    // table is not changed after it is built, so it can be used
+    // without a lock. If the lookup fails, use the exact camera.
     virtual Vector2 point_to_pixel(Vector3 const& xyz) const{
 
-      // TODO: What happens if we use bicubic interpolation?
-      InterpolationView<EdgeExtensionView< ImageView< PixelMask<Vector3> >, ConstantEdgeExtension >, BilinearInterpolation> pixel_to_vec_interp
-        = interpolate(m_pixel_to_vec_mat, BilinearInterpolation(),
-                      ConstantEdgeExtension());
-
-      InterpolationView<EdgeExtensionView< ImageView< PixelMask<Vector2> >, ConstantEdgeExtension >, BilinearInterpolation> point_to_pix_interp
-        = interpolate(m_point_to_pix_mat, BilinearInterpolation(),
-                      ConstantEdgeExtension());
-
-      Vector3 dir = m_mean_dir;
       Vector2 pix;
-      double major_radius = m_geo.datum().semi_major_axis() + m_mean_ht;
-      double minor_radius = m_geo.datum().semi_minor_axis() + m_mean_ht;
-      for (size_t i = 0; i < 10; i++) {
-
-        Vector3 S = xyz - 1.1*major_radius*dir; // push the point outside the sphere
-        if (norm_2(S) <= major_radius) {
-          // should not happen. Return the exact solution.
-          {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "3D point is inside the planet.\n";
-            }
-            return m_exact_adjusted_camera.point_to_pixel(xyz);
-          }
-        }
-
-        Vector3 datum_pt = datum_intersection(major_radius, minor_radius, S, dir);
-        Vector3 llh = m_geo.datum().cartesian_to_geodetic(datum_pt);
-        Vector2 pt = m_geo.lonlat_to_point(subvector(llh, 0, 2));
-
-        // Indices
-        double x = (pt.x() - m_point_box.min().x())/m_approx_table_gridx;
-        double y = (pt.y() - m_point_box.min().y())/m_approx_table_gridy;
-
-        bool out_of_range = (x < m_begX || x >= m_endX-1 ||
-                             y < m_begY || y >= m_endY-1);
-
-        // If out of range, return the exact result. This should be very slow.
-        // The hope is that it will be very rare.
-        if (out_of_range){
-          vw::Mutex::Lock lock(m_camera_mutex);
-          g_num_locks++;
-          if (g_warning_count < g_max_warning_count) {
-            g_warning_count++;
-            vw_out(WarningMessage) << "Pixel outside of range. Current values and range: "  << ' '
-                                   << x << ' ' << y << ' '
-                                   << m_pixel_to_vec_mat.cols() << ' ' << m_pixel_to_vec_mat.rows()
-                                   << std::endl;
-          }
-          return m_exact_adjusted_camera.point_to_pixel(xyz);
-        }
-        
-        PixelMask<Vector3> masked_dir = pixel_to_vec_interp(x, y);
-        PixelMask<Vector2> masked_pix = point_to_pix_interp(x, y);
-        if (is_valid(masked_dir) && is_valid(masked_pix)) {
-          dir = masked_dir.child();
-          pix = masked_pix.child();
-        }else{
-          {
-            vw::Mutex::Lock lock(m_camera_mutex);
-            g_num_locks++;
-            if (g_warning_count < g_max_warning_count) {
-              g_warning_count++;
-              vw_out(WarningMessage) << "Invalid ground to camera direction: "
-                                     << masked_dir << ' ' << masked_pix << std::endl;
-            }
-            return m_exact_adjusted_camera.point_to_pixel(xyz);
-          }
-        }
+      if (m_table.point_to_pixel(xyz, pix))
+        return pix/m_scale;
+      
+      // This should be very slow. The hope is that it will be very rare.
+      vw::Mutex::Lock lock(m_camera_mutex);
+      g_num_locks++;
+      if (g_warning_count < g_max_warning_count) {
+        g_warning_count++;
+        vw_out(WarningMessage) << "Using the exact camera to project point: "
+                               << xyz << std::endl;
       }
-
-      return pix;
+      return m_exact_adjusted_camera.point_to_pixel(xyz)/m_scale;
     }
 
+    // The adjustments are baked into the table, but the pixels must
+    // still be scaled when solving on a coarser grid.
+    void set_scale(double scale) { m_scale = scale; }
+
     virtual ~ApproxAdjustedCameraModel(){}
     virtual std::string type() const{ return "ApproxAdjustedIsis"; }
 
@@ -1072,7 +782,7 @@ namespace vw { namespace camera {
                                << pix << std::endl;
       }
       // TODO(oalexan1): Put here the exact adjusted camera!
-      return this->exact_unadjusted_camera()->pixel_to_vector(pix);
+      return this->exact_unadjusted_camera()->pixel_to_vector(pix*m_scale);
     }
 
     virtual Vector3 camera_center(Vector2 const& pix) const{
@@ -1081,7 +791,7 @@ namespace vw { namespace camera {
       vw::Mutex::Lock lock(m_camera_mutex);
       g_num_locks++;
       // TODO(oalexan1): Put here the exact adjusted camera!
-      return this->exact_unadjusted_camera()->camera_center(pix);
+      return this->exact_unadjusted_camera()->camera_center(pix*m_scale);
     }
 
     virtual Quat camera_pose(Vector2 const& pix) const{
@@ -1094,7 +804,7 @@ namespace vw { namespace camera {
                                << pix << std::endl;
       }
       // TODO(oalexan1): Put here the exact adjusted camera!
-      return this->exact_unadjusted_camera()->camera_pose(pix);
+      return this->exact_unadjusted_camera()->camera_pose(pix*m_scale);
     }
 
   };
@@ -1236,9 +946,10 @@ void areInShadow(Vector3 & sunPos, ImageView<double> const& dem,
 }
 
 struct Options : public vw::GdalWriteOptions {
-  std::string input_dems_str, out_prefix, stereo_session, bundle_adjust_prefix;
+  std::string input_dems_str, out_prefix, stereo_session, bundle_adjust_prefix,
+    camera_cache_dir;
   std::vector<std::string> input_dems, input_images, input_cameras;
-  std::string shadow_thresholds, custom_shadow_threshold_list, max_valid_image_vals, skip_images_str, image_exposure_prefix, model_coeffs_prefix, model_coeffs, image_haze_prefix, sun_positions_list;
+  std::string shadow_thresholds, custom_shadow_threshold_list, max_valid_image_vals, skip_images_str, image_exposure_prefix, model_coeffs_prefix, model_coeffs, image_haze_prefix, sun_positions_list, approx_camera_table_dir, image_stats_cache_dir;
   std::vector<float> shadow_threshold_vec, max_valid_image_vals_vec;
   std::vector<double> image_exposures_vec;
   std::vector<std::vector<double>> image_haze_vec;
@@ -1252,7 +963,8 @@ struct Options : public vw::GdalWriteOptions {
     save_dem_with_nodata, use_approx_camera_models, use_approx_adjusted_camera_models,
     use_rpc_approximation, use_semi_approx,
     crop_input_images, float_dem_at_boundary, boundary_fix, fix_dem, 
-    float_reflectance_model, float_sun_position, query, save_sparingly, float_haze;
+    float_reflectance_model, float_sun_position, query, save_sparingly, float_haze,
+    profile_cost_functions;
   double smoothness_weight, steepness_factor, curvature_in_shadow, curvature_in_shadow_weight,
     lit_curvature_dist, shadow_curvature_dist, gradient_weight,
     integrability_weight, smoothness_weight_pq, init_dem_height, nodata_val,
@@ -1281,6 +993,7 @@ struct Options : public vw::GdalWriteOptions {
             float_dem_at_boundary(false), boundary_fix(false), fix_dem(false),
             float_reflectance_model(false), float_sun_position(false),
             query(false), save_sparingly(false), float_haze(false),
+            profile_cost_functions(false),
             smoothness_weight(0), steepness_factor(1.0),
             curvature_in_shadow(0), curvature_in_shadow_weight(0.0),
             lit_curvature_dist(0.0), shadow_curvature_dist(0.0),
@@ -1306,6 +1019,93 @@ struct ModelParams {
   ~ModelParams(){}
 };
 
+// A string identifying what the statistics of the measured and
+// computed intensity of an image over a DEM clip depend on. These
+// statistics are used to find the initial exposures.
+std::string image_stats_key(Options const& opt, int dem_iter, int image_iter,
+                            GlobalParams const& global_params, Vector3 const& sun_pos,
+                            BBox2i const& crop_box, int sample_col_rate, int sample_row_rate) {
+
+  std::ostringstream os;
+  os.precision(17);
+  
+  std::string dem_file    = opt.input_dems[dem_iter];
+  std::string image_file  = opt.input_images[image_iter];
+  std::string camera_file = opt.input_cameras[image_iter];
+  os << "dem: "    << dem_file    << " " << asp::file_timestamp(dem_file)    << " "
+     << "image: "  << image_file  << " " << asp::file_timestamp(image_file)  << " "
+     << "camera: " << camera_file << " " << asp::file_timestamp(camera_file) << " ";
+  if (opt.bundle_adjust_prefix != "") {
+    std::string adjust_file = asp::bundle_adjust_file_name(opt.bundle_adjust_prefix,
+                                                           image_file, camera_file);
+    os << "adjustment: " << adjust_file << " " << asp::file_timestamp(adjust_file) << " ";
+  }
+
+  os << "sun: " << sun_pos[0] << " " << sun_pos[1] << " " << sun_pos[2] << " ";
+  os << "crop: " << crop_box.min().x() << " " << crop_box.min().y() << " "
+     << crop_box.max().x() << " " << crop_box.max().y() << " "
+     << opt.crop_win.min().x() << " " << opt.crop_win.min().y() << " "
+     << opt.crop_win.max().x() << " " << opt.crop_win.max().y() << " ";
+  os << "sampling: " << sample_col_rate << " " << sample_row_rate << " ";
+  
+  os << "reflectance: " << global_params.reflectanceType << " "
+     << global_params.phaseCoeffC1 << " " << global_params.phaseCoeffC2;
+  for (size_t it = 0; it < opt.model_coeffs_vec.size(); it++)
+    os << " " << opt.model_coeffs_vec[it];
+  os << " ";
+  
+  os << "options: " << opt.model_shadows << " "
+     << opt.shadow_threshold_vec[image_iter] << " "
+     << opt.max_valid_image_vals_vec[image_iter] << " "
+     << opt.blending_dist << " " << opt.blending_power << " " << opt.min_blend_size << " "
+     << opt.init_dem_height << " " << opt.nodata_val << " "
+     << opt.use_approx_camera_models << " " << opt.use_approx_adjusted_camera_models;
+
+  return os.str();
+}
+
+// The first line in a file with image statistics. Change this if the format changes.
+const std::string IMAGE_STATS_MAGIC = "ASP sfs image stats 1";
+
+// Read the statistics saved by write_image_stats(). Return false if the
+// file does not exist or was saved with a different key.
+bool read_image_stats(std::string const& file, std::string const& key,
+                      double & imgmean, double & imgstdev,
+                      double & refmean, double & refstdev) {
+  std::ifstream ifs(file.c_str());
+  std::string magic, file_key;
+  if (!std::getline(ifs, magic) || !std::getline(ifs, file_key))
+    return false;
+  if (magic != IMAGE_STATS_MAGIC || file_key != key)
+    return false;
+  
+  double a, b, c, d;
+  if (!(ifs >> a >> b >> c >> d))
+    return false;
+  
+  imgmean = a; imgstdev = b; refmean = c; refstdev = d;
+  return true;
+}
+
+void write_image_stats(std::string const& file, std::string const& key,
+                       double imgmean, double imgstdev,
+                       double refmean, double refstdev) {
+  
+  // Write to a temporary file and rename it, so that a concurrent
+  // run never reads a partially written file.
+  std::string tmp_file = file + ".tmp";
+  vw::create_out_dir(file);
+  {
+    std::ofstream ofs(tmp_file.c_str());
+    if (!ofs.good())
+      vw_throw(IOErr() << "Cannot write: " << tmp_file << "\n");
+    ofs.precision(17);
+    ofs << IMAGE_STATS_MAGIC << "\n" << key << "\n"
+        << imgmean << " " << imgstdev << " " << refmean << " " << refstdev << "\n";
+  }
+  fs::rename(tmp_file, file);
+}
+
 // Make the reflectance nonlinear using a rational function
 double nonlin_reflectance(double reflectance, double exposure,
                           double steepness_factor,
@@ -2042,6 +1842,49 @@ void estimateHeightError(ImageView<double> const& dem,
   }
 }
 
+// Find the lon-lat of a DEM grid point and of its left, right, bottom,
+// and top neighbors, in this order. The numerical differentiation of
+// the intensity error computes the reflectance many times in a row at
+// the same grid point, with only the heights, exposures, and the like
+// perturbed, so the last result is remembered in each thread. With the
+// polar stereographic projections often used with sfs, pixel_to_lonlat
+// is costly.
+void gridPointLonLat(cartography::GeoReference const& geo, int col, int row,
+                     Vector2 lonlat[5]) {
+
+  struct LonLatMemo {
+    LonLatMemo(): geo(NULL), col(0), row(0) {}
+    cartography::GeoReference const* geo;
+    Matrix3x3 transform;
+    int col, row;
+    Vector2 lonlat[5];
+  };
+  thread_local LonLatMemo memo;
+
+  // Compare the transform too, in case a different georeference was
+  // later made at the same address.
+  bool same = (memo.geo == &geo && memo.col == col && memo.row == row);
+  Matrix3x3 const& transform = geo.transform();
+  for (int r = 0; r < 3 && same; r++)
+    for (int c = 0; c < 3 && same; c++)
+      same = (memo.transform(r, c) == transform(r, c));
+
+  if (!same) {
+    memo.geo       = &geo;
+    memo.col       = col;
+    memo.row       = row;
+    memo.transform = transform;
+    memo.lonlat[0] = geo.pixel_to_lonlat(Vector2(col,   row));
+    memo.lonlat[1] = geo.pixel_to_lonlat(Vector2(col-1, row));
+    memo.lonlat[2] = geo.pixel_to_lonlat(Vector2(col+1, row));
+    memo.lonlat[3] = geo.pixel_to_lonlat(Vector2(col,   row+1));
+    memo.lonlat[4] = geo.pixel_to_lonlat(Vector2(col,   row-1));
+  }
+
+  for (int it = 0; it < 5; it++)
+    lonlat[it] = memo.lonlat[it];
+}
+
 bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
                                     double bottom_h, double top_h,
                                     bool use_pq, double p, double q, // dem partial derivatives
@@ -2083,35 +1926,21 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
     bottom_h = center_h - gridy*q;
   }
 
-  // The xyz position at the center grid point
-  Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
-  double h = center_h;
-  Vector3 lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 base = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the left grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col-1, row));
-  h = left_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 left = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the right grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col+1, row));
-  h = right_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 right = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the bottom grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col, row+1));
-  h = bottom_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 bottom = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the top grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col, row-1));
-  h = top_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 top = geo.datum().geodetic_to_cartesian(lonlat3);
+  // The lon-lat at the center, left, right, bottom, and top grid points
+  Vector2 lonlat[5];
+  gridPointLonLat(geo, col, row, lonlat);
+
+  // The xyz positions at these grid points
+  Vector3 base   = geo.datum().geodetic_to_cartesian
+    (Vector3(lonlat[0](0), lonlat[0](1), center_h));
+  Vector3 left   = geo.datum().geodetic_to_cartesian
+    (Vector3(lonlat[1](0), lonlat[1](1), left_h));
+  Vector3 right  = geo.datum().geodetic_to_cartesian
+    (Vector3(lonlat[2](0), lonlat[2](1), right_h));
+  Vector3 bottom = geo.datum().geodetic_to_cartesian
+    (Vector3(lonlat[3](0), lonlat[3](1), bottom_h));
+  Vector3 top    = geo.datum().geodetic_to_cartesian
+    (Vector3(lonlat[4](0), lonlat[4](1), top_h));
 
   // four-point normal (centered)
   Vector3 dx = right - left;
@@ -2246,6 +2075,22 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   return true;
 }
 
+// The maximum height of the DEM, used to model shadows
+void updateMaxDemHeight(ImageView<double> const& dem, bool model_shadows,
+                        int sample_col_rate, int sample_row_rate,
+                        double & max_dem_height) {
+  max_dem_height = -std::numeric_limits<double>::max();
+  if (model_shadows) {
+    for (int col = 0; col < dem.cols(); col += sample_col_rate) {
+      for (int row = 0; row < dem.rows(); row += sample_row_rate) {
+        if (dem(col, row) > max_dem_height) {
+          max_dem_height = dem(col, row);
+        }
+      }
+    }
+  }
+}
+
 void computeReflectanceAndIntensity(ImageView<double> const& dem,
                                     ImageView<Vector2> const& pq,
                                     cartography::GeoReference const& geo,
@@ -2267,18 +2112,9 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
                                     SlopeErrEstim * slopeErrEstim = NULL,
                                     HeightErrEstim * heightErrEstim = NULL) {
   
-  // Update max_dem_height
-  max_dem_height = -std::numeric_limits<double>::max();
-  if (model_shadows) {
-    for (int col = 0; col < dem.cols(); col += sample_col_rate) {
-      for (int row = 0; row < dem.rows(); row += sample_row_rate) {
-        if (dem(col, row) > max_dem_height) {
-          max_dem_height = dem(col, row);
-        }
-      }
-    }
+  updateMaxDemHeight(dem, model_shadows, sample_col_rate, sample_row_rate, max_dem_height);
+  if (model_shadows)
     vw_out() << "Maximum DEM height: " << max_dem_height << std::endl;
-  }
   
   // Init the reflectance and intensity as invalid. Do it at all grid
   // points, not just where we sample, to ensure that these quantities
@@ -2336,6 +2172,14 @@ std::string model_coeffs_file_name(std::string const& prefix){
   return prefix + "-model_coeffs.txt";
 }
 
+std::string sun_positions_file_name(std::string const& prefix){
+  return prefix + "-sun-positions.txt";
+}
+
+std::string image_footprints_file_name(std::string const& prefix){
+  return prefix + "-image-footprints.txt";
+}
+
 // Form a finer resolution image with given dimensions from a coarse image.
 // Use constant edge extension.
 void interp_image(ImageView<double> const& coarse_image, double scale,
@@ -2362,6 +2206,79 @@ void save_exposures(std::string const& out_prefix,
   exf.close();
 }
 
+// Save the Sun positions in the format read with --sun-positions
+void save_sun_positions(std::string const& out_prefix,
+                        std::vector<std::string> const& input_images,
+                        std::vector<ModelParams> const& model_params){
+  std::string sun_file = sun_positions_file_name(out_prefix);
+  vw_out() << "Writing: " << sun_file << std::endl;
+  std::ofstream ofs(sun_file.c_str());
+  ofs.precision(18);
+  for (size_t image_iter = 0; image_iter < model_params.size(); image_iter++) {
+    Vector3 const& sun = model_params[image_iter].sunPosition;
+    ofs << input_images[image_iter] << " " << sun[0] << " " << sun[1] << " " << sun[2] << "\n";
+  }
+  ofs.close();
+}
+
+// For each image, find the box of DEM pixels which project into it,
+// and save these boxes, one line per image, in the order of the
+// images. The DEM is sampled on a grid of about 100 x 100 points, and
+// the box is grown by the grid spacing. Skipped images get an empty
+// box. This is done once for the full DEM, so that parallel_sfs can
+// load in each tile only the images which see it.
+void save_image_footprints(Options const& opt, ImageView<double> const& dem,
+                           GeoReference const& geo,
+                           std::vector<boost::shared_ptr<CameraModel>> const& cameras){
+
+  int num_samples = 100;
+  int col_step = std::max(1, int(ceil(dem.cols() / double(num_samples))));
+  int row_step = std::max(1, int(ceil(dem.rows() / double(num_samples))));
+  BBox2i dem_box = bounding_box(dem);
+
+  std::string footprint_file = image_footprints_file_name(opt.out_prefix);
+  vw_out() << "Writing: " << footprint_file << std::endl;
+  std::ofstream ofs(footprint_file.c_str());
+  for (size_t image_iter = 0; image_iter < opt.input_images.size(); image_iter++) {
+
+    // An empty box is saved with all values being zero
+    BBox2i footprint;
+    int num_hits = 0;
+    if (opt.skip_images[0].find(image_iter) == opt.skip_images[0].end()) {
+      BBox2i img_box = bounding_box(DiskImageView<float>(opt.input_images[image_iter]));
+      for (int col = 0; col < dem.cols(); col += col_step) {
+        for (int row = 0; row < dem.rows(); row += row_step) {
+          Vector2 ll = geo.pixel_to_lonlat(Vector2(col, row));
+          Vector3 xyz = geo.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1],
+                                                                  dem(col, row)));
+          Vector2 pix;
+          try {
+            pix = cameras[image_iter]->point_to_pixel(xyz);
+          } catch (...) {
+            continue;
+          }
+          if (img_box.contains(pix)) {
+            footprint.grow(Vector2i(col, row));
+            num_hits++;
+          }
+        }
+      }
+    }
+    if (num_hits > 0) {
+      footprint.min() -= Vector2i(col_step, row_step);
+      footprint.max() += Vector2i(col_step, row_step) + Vector2i(1, 1);
+      footprint.crop(dem_box);
+    } else {
+      footprint = BBox2i(0, 0, 0, 0);
+    }
+
+    ofs << opt.input_images[image_iter] << " "
+        << footprint.min().x() << " " << footprint.min().y() << " "
+        << footprint.max().x() << " " << footprint.max().y() << "\n";
+  }
+  ofs.close();
+}
+
 // Find the sun azimuth and elevation at the lon-lat position of the
 // center of the DEM. The result can change depending on the DEM.
 void sun_angles(Options const& opt,
@@ -2445,6 +2362,316 @@ double                                       * g_reflectance_model_coeffs = NULL
 // 1 meter than by a tiny fraction of one millimeter).
 double g_position_scale_factor = 1e+6;
 
+// The state of the solver after an iteration. What the solver changes
+// is copied, so that the results can be written while it continues.
+// The DEMs and what goes with them are copied only if they are saved.
+struct SfsSnapshot {
+  int  iter, level;
+  bool final_iter;
+  std::vector< ImageView<double> >  dem, albedo;
+  std::vector< ImageView<Vector2> > pq;
+  std::vector< std::vector<boost::shared_ptr<CameraModel> > > cameras;
+  std::vector<double> exposures, scaled_sun_posns, max_dem_height, model_coeffs;
+  std::vector< std::vector<double> > haze;
+};
+
+// Write the results of an iteration
+void save_sfs_results(SfsSnapshot & snap) {
+
+  if (!g_opt->save_computed_intensity_only)
+    save_exposures(g_opt->out_prefix, g_opt->input_images, snap.exposures);
+
+  if (g_opt->num_haze_coeffs > 0 && !g_opt->save_computed_intensity_only) {
+    std::string haze_file = haze_file_name(g_opt->out_prefix);
+    vw_out() << "Writing: " << haze_file << std::endl;
+    std::ofstream hzf(haze_file.c_str());
+    hzf.precision(18);
+    for (size_t image_iter = 0; image_iter < snap.haze.size(); image_iter++) {
+      hzf << g_opt->input_images[image_iter];
+      for (size_t hiter = 0; hiter < snap.haze[image_iter].size(); hiter++) {
+        hzf << " " << snap.haze[image_iter][hiter];
+      }
+      hzf << "\n";
+    }
+    hzf.close();
+  }
+  
+  std::string model_coeffs_file = model_coeffs_file_name(g_opt->out_prefix);
+  if (!g_opt->save_computed_intensity_only) {
+    vw_out() << "Writing: " << model_coeffs_file << std::endl;
+    std::ofstream mcf(model_coeffs_file.c_str());
+    mcf.precision(18);
+    for (size_t coeff_iter = 0; coeff_iter < g_num_model_coeffs; coeff_iter++){
+      mcf << snap.model_coeffs[coeff_iter] << " ";
+    }
+    mcf << "\n";
+    mcf.close();
+  }
+  
+  //vw_out() << "Model coefficients: "; 
+  //for (size_t i = 0; i < g_num_model_coeffs; i++)
+  //  vw_out() << snap.model_coeffs[i] << " ";
+  //vw_out() << std::endl;
+  
+  //if (!g_opt->use_approx_adjusted_camera_models) {
+  //  vw_out() << "cam adj: ";
+  //  for (int s = 0; s < int((*g_adjustments).size()); s++) {
+  //    vw_out() << (*g_adjustments)[s] << " ";
+  // }
+  // vw_out() << std::endl;
+  //}
+  
+  //vw_out() << "scaled sun position: ";
+  //for (int s = 0; s < int(snap.scaled_sun_posns.size()); s++) 
+  //  vw_out() << snap.scaled_sun_posns[s] << " ";
+  //vw_out() << std::endl;
+
+  int num_dems = snap.dem.size();
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+
+    std::ostringstream os;
+    if (!snap.final_iter) {
+      os << "-iter" << snap.iter;
+    }else{
+      os << "-final";
+    }
+
+    // Note that for level 0 we don't append the level as part of
+    // the filename. This way, whether we have levels or not,
+    // the lowest level is always named consistently.
+    if ((*g_opt).coarse_levels > 0 && snap.level > 0) os << "-level" << snap.level;
+    if (num_dems > 1)                              os << "-clip"  << dem_iter;
+
+    std::string iter_str = os.str();
+
+    // The DEM with no-data where there are no valid image pixels
+    ImageView<double> dem_nodata;
+    if (g_opt->save_dem_with_nodata) {
+      dem_nodata = ImageView<double>(snap.dem[dem_iter].cols(), snap.dem[dem_iter].rows());
+      fill(dem_nodata, *g_dem_nodata_val);
+    }
+      
+    bool has_georef = true, has_nodata = true;
+    TerminalProgressCallback tpc("asp", ": ");
+    if ( (!g_opt->save_sparingly || snap.final_iter) && !g_opt->save_computed_intensity_only ) {
+      std::string out_dem_file = g_opt->out_prefix + "-DEM"
+        + iter_str + ".tif";
+      vw_out() << "Writing: " << out_dem_file << std::endl;
+      block_write_gdal_image(out_dem_file, snap.dem[dem_iter], has_georef, (*g_geo)[dem_iter],
+                             has_nodata, *g_dem_nodata_val,
+                             *g_opt, tpc);
+    }
+
+    if ((!g_opt->save_sparingly || (snap.final_iter && g_opt->float_albedo)) &&
+        !g_opt->save_computed_intensity_only ) {
+      std::string out_albedo_file = g_opt->out_prefix + "-comp-albedo"
+        + iter_str + ".tif";
+      vw_out() << "Writing: " << out_albedo_file << std::endl;
+      block_write_gdal_image(out_albedo_file, snap.albedo[dem_iter], has_georef,
+                             (*g_geo)[dem_iter],
+                             has_nodata, *g_dem_nodata_val,
+                             *g_opt, tpc);
+    }
+
+    // Print reflectance and other things
+    for (size_t image_iter = 0; image_iter < (*g_masked_images)[dem_iter].size(); image_iter++) {
+
+      if (g_opt->skip_images[dem_iter].find(image_iter) !=
+          g_opt->skip_images[dem_iter].end()) {
+        continue;
+      }
+
+      // Separate into blocks for each image
+      vw_out() << "\n";
+
+      ImageView< PixelMask<double> > reflectance, intensity, comp_intensity;
+      ImageView< double            > blend_weight;
+
+      std::string out_camera_file
+        = asp::bundle_adjust_file_name(g_opt->out_prefix,
+                                       g_opt->input_images[image_iter],
+                                       g_opt->input_cameras[image_iter]);
+      
+      if (!g_opt->use_approx_adjusted_camera_models) {
+        // Save the camera adjustments for the current iteration.
+        // When we use approx adjusted camera models this is not necessary
+        // since then the cameras don't change.
+        //std::string out_camera_file = g_opt->out_prefix + "-camera"
+        //+ iter_str2 + ".adjust";
+        //vw_out() << "Writing: " << out_camera_file << std::endl;
+        AdjustedCameraModel * icam
+          = dynamic_cast<AdjustedCameraModel*>(snap.cameras[dem_iter][image_iter].get());
+        if (icam == NULL)
+          vw_throw( ArgumentErr() << "Expecting an adjusted camera.\n");
+        Vector3 translation = icam->translation();
+        Quaternion<double> rotation = icam->rotation();
+        //asp::write_adjustments(out_camera_file, translation, rotation);
+        
+        // Used to save adjusted files in the format <out prefix>-<input-img>.adjust
+        // so we can later read them with --bundle-adjust-prefix to be
+        // used in another SfS run. Don't do that anymore as normally
+        // the adjustments don't change.
+        //if (snap.level == 0) {
+        //if (!g_opt->save_computed_intensity_only){
+        //  vw_out() << "Writing: " << out_camera_file << std::endl;
+        //  asp::write_adjustments(out_camera_file, translation, rotation);
+        //}
+      }
+      
+      if (g_opt->save_sparingly && !g_opt->save_dem_with_nodata) 
+        continue; // don't write too many things
+      
+      // Manufacture an output prefix for the other data associated with this camera
+      std::string iter_str2 = fs::path(out_camera_file).replace_extension("").string();
+      iter_str2 += iter_str;
+  
+      // Compute reflectance and intensity with optimized DEM
+      int sample_col_rate = 1, sample_row_rate = 1;
+      computeReflectanceAndIntensity(snap.dem[dem_iter], snap.pq[dem_iter],
+                                     (*g_geo)[dem_iter],
+                                     g_opt->model_shadows,
+                                     snap.max_dem_height[dem_iter],
+                                     *g_gridx, *g_gridy,
+                                     sample_col_rate, sample_row_rate,
+                                     (*g_model_params)[image_iter],
+                                     *g_global_params,
+                                     (*g_crop_boxes)[dem_iter][image_iter],
+                                     (*g_masked_images)[dem_iter][image_iter],
+                                     (*g_blend_weights)[dem_iter][image_iter],
+                                     snap.cameras[dem_iter][image_iter].get(),
+                                     &snap.scaled_sun_posns[3*image_iter],
+                                     reflectance, intensity, blend_weight, 
+                                     &snap.model_coeffs[0]);
+
+      // dem_nodata equals to dem if the image has valid pixels and no shadows
+      if (g_opt->save_dem_with_nodata) {
+        for (int col = 0; col < reflectance.cols(); col++) {
+          for (int row = 0; row < reflectance.rows(); row++) {
+            if (is_valid(reflectance(col, row))) 
+              dem_nodata(col, row) = snap.dem[dem_iter](col, row);
+          }
+        }
+      }
+
+      if (g_opt->save_sparingly)
+        continue;
+      
+      // Find the computed intensity
+      comp_intensity.set_size(reflectance.cols(), reflectance.rows());
+      for (int col = 0; col < comp_intensity.cols(); col++) {
+        for (int row = 0; row < comp_intensity.rows(); row++) {
+          comp_intensity(col, row)
+            = snap.albedo[dem_iter](col, row) *
+            nonlin_reflectance(reflectance(col, row), snap.exposures[image_iter],
+                               g_opt->steepness_factor,
+                               &snap.haze[image_iter][0], g_opt->num_haze_coeffs);
+        }
+      }
+
+      std::string out_meas_intensity_file = iter_str2 + "-meas-intensity.tif";
+      vw_out() << "Writing: " << out_meas_intensity_file << std::endl;
+      block_write_gdal_image(out_meas_intensity_file,
+                             apply_mask(intensity, *g_img_nodata_val),
+                             has_georef, (*g_geo)[dem_iter], has_nodata,
+                             *g_img_nodata_val, *g_opt, tpc);
+  
+      std::string out_comp_intensity_file = iter_str2 + "-comp-intensity.tif";
+      vw_out() << "Writing: " << out_comp_intensity_file << std::endl;
+      block_write_gdal_image(out_comp_intensity_file,
+                             apply_mask(comp_intensity, *g_img_nodata_val),
+                             has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
+                             *g_opt, tpc);
+
+      if (g_opt->save_computed_intensity_only) 
+        continue; // don't write too many things
+
+      std::string out_weight_file = iter_str2 + "-blending-weight.tif";
+      vw_out() << "Writing: " << out_weight_file << std::endl;
+      block_write_gdal_image(out_weight_file,
+                             blend_weight,
+                             has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
+                             *g_opt, tpc);
+
+      std::string out_reflectance_file = iter_str2 + "-reflectance.tif";
+      vw_out() << "Writing: " << out_reflectance_file << std::endl;
+      block_write_gdal_image(out_reflectance_file,
+                             apply_mask(reflectance, *g_img_nodata_val),
+                             has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
+                             *g_opt, tpc);
+
+
+      // Find the measured normalized albedo, after correcting for
+      // reflectance.
+      ImageView<double> measured_albedo;
+      measured_albedo.set_size(reflectance.cols(), reflectance.rows());
+      for (int col = 0; col < measured_albedo.cols(); col++) {
+        for (int row = 0; row < measured_albedo.rows(); row++) {
+          if (!is_valid(reflectance(col, row)))
+            measured_albedo(col, row) = 1;
+          else
+            measured_albedo(col, row) = intensity(col, row) /
+              nonlin_reflectance(reflectance(col, row), snap.exposures[image_iter],
+                                 g_opt->steepness_factor,
+                                 &snap.haze[image_iter][0], g_opt->num_haze_coeffs);
+        }
+      }
+      std::string out_albedo_file = iter_str2 + "-meas-albedo.tif";
+      vw_out() << "Writing: " << out_albedo_file << std::endl;
+      block_write_gdal_image(out_albedo_file, measured_albedo,
+                             has_georef, (*g_geo)[dem_iter], has_nodata, 0, *g_opt, tpc);
+
+
+      double imgmean, imgstdev, refmean, refstdev;
+      compute_image_stats(intensity, comp_intensity, imgmean, imgstdev, refmean, refstdev);
+      vw_out() << "meas image mean and std: " << imgmean << ' ' << imgstdev
+               << std::endl;
+      vw_out() << "comp image mean and std: " << refmean << ' ' << refstdev
+               << std::endl;
+
+      vw_out() << "Exposure for image " << image_iter << ": "
+               << snap.exposures[image_iter] << std::endl;
+
+      if (g_opt->num_haze_coeffs > 0) {
+        vw_out() << "Haze for image " << image_iter << ":";
+        for (size_t hiter = 0; hiter < snap.haze[image_iter].size(); hiter++) {
+          vw_out() << " " << snap.haze[image_iter][hiter];
+        }
+        vw_out() << std::endl;
+      }
+      
+#if 0
+      // Dump the points in shadow
+      ImageView<float> shadow; // don't use int, scaled weirdly by ASP on reading
+      
+      Vector3 sunPos = // all wrong here &snap.scaled_sun_posns[3*image_iter]; // fix here
+        // = (*g_model_params)[image_iter].sunPosition;
+        areInShadow(sunPos, snap.dem[dem_iter], *g_gridx, *g_gridy,  (*g_geo)[dem_iter], shadow);
+
+      std::string out_shadow_file = iter_str2 + "-shadow.tif";
+      vw_out() << "Writing: " << out_shadow_file << std::endl;
+      block_write_gdal_image(out_shadow_file, shadow, has_georef, (*g_geo)[dem_iter], has_nodata,
+                             -std::numeric_limits<float>::max(), *g_opt, tpc);
+#endif
+
+    }
+
+    if (g_opt->save_dem_with_nodata) {
+      if ( !g_opt->save_sparingly || snap.final_iter ) {
+        std::string out_dem_nodata_file = g_opt->out_prefix + "-DEM-nodata"
+          + iter_str + ".tif";
+        vw_out() << "Writing: " << out_dem_nodata_file << std::endl;
+        TerminalProgressCallback tpc("asp", ": ");
+        block_write_gdal_image(out_dem_nodata_file, dem_nodata, has_georef, (*g_geo)[dem_iter],
+                               has_nodata, *g_dem_nodata_val,
+                               *g_opt, tpc);
+      }
+    }
+  }
+}
+
+// A function to invoke at every iteration of ceres. The results are
+// written in a background thread, except at the end, or with exact
+// ISIS cameras, which cannot be used by two threads at once.
 class SfsCallback: public ceres::IterationCallback {
 public:
   virtual ceres::CallbackReturnType operator()
@@ -2453,55 +2680,26 @@ public:
     g_iter++;
 
     vw_out() << "Finished iteration: " << g_iter << std::endl;
+    asp::process_metrics().set_solver_state(g_iter, summary.cost);
     callTop();
 
-    if (!g_opt->save_computed_intensity_only)
-      save_exposures(g_opt->out_prefix, g_opt->input_images, *g_exposures);
-
-    if (g_opt->num_haze_coeffs > 0 && !g_opt->save_computed_intensity_only) {
-      std::string haze_file = haze_file_name(g_opt->out_prefix);
-      vw_out() << "Writing: " << haze_file << std::endl;
-      std::ofstream hzf(haze_file.c_str());
-      hzf.precision(18);
-      for (size_t image_iter = 0; image_iter < (*g_haze).size(); image_iter++) {
-        hzf << g_opt->input_images[image_iter];
-        for (size_t hiter = 0; hiter < (*g_haze)[image_iter].size(); hiter++) {
-          hzf << " " << (*g_haze)[image_iter][hiter];
-        }
-        hzf << "\n";
-      }
-      hzf.close();
-    }
-    
-    std::string model_coeffs_file = model_coeffs_file_name(g_opt->out_prefix);
-    if (!g_opt->save_computed_intensity_only) {
-      vw_out() << "Writing: " << model_coeffs_file << std::endl;
-      std::ofstream mcf(model_coeffs_file.c_str());
-      mcf.precision(18);
-      for (size_t coeff_iter = 0; coeff_iter < g_num_model_coeffs; coeff_iter++){
-        mcf << g_reflectance_model_coeffs[coeff_iter] << " ";
-      }
-      mcf << "\n";
-      mcf.close();
-    }
+    boost::shared_ptr<SfsSnapshot> snap(new SfsSnapshot);
+    snap->iter       = g_iter;
+    snap->level      = g_level;
+    snap->final_iter = g_final_iter;
+    snap->exposures  = *g_exposures;
+    snap->haze       = *g_haze;
+    snap->scaled_sun_posns = *g_scaled_sun_posns;
+    snap->model_coeffs.assign(g_reflectance_model_coeffs,
+                              g_reflectance_model_coeffs + g_num_model_coeffs);
+
+    // When saving sparingly, nothing is written for the DEMs at
+    // intermediate iterations
+    bool save_dems = (g_final_iter || !g_opt->save_sparingly || g_opt->save_dem_with_nodata);
     
-    //vw_out() << "Model coefficients: "; 
-    //for (size_t i = 0; i < g_num_model_coeffs; i++)
-    //  vw_out() << g_reflectance_model_coeffs[i] << " ";
-    //vw_out() << std::endl;
-    
-    //if (!g_opt->use_approx_adjusted_camera_models) {
-    //  vw_out() << "cam adj: ";
-    //  for (int s = 0; s < int((*g_adjustments).size()); s++) {
-    //    vw_out() << (*g_adjustments)[s] << " ";
-    // }
-    // vw_out() << std::endl;
-    //}
-    
-    //vw_out() << "scaled sun position: ";
-    //for (int s = 0; s < int((*g_scaled_sun_posns).size()); s++) 
-    //  vw_out() << (*g_scaled_sun_posns)[s] << " ";
-    //vw_out() << std::endl;
+    // The per-image results, which find the maximum DEM height used by
+    // the solver to model shadows, are produced unless saving sparingly
+    bool save_images = !(g_opt->save_sparingly && !g_opt->save_dem_with_nodata);
 
     int num_dems = (*g_dem).size();
     for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
@@ -2531,247 +2729,53 @@ public:
         }
       }
 
-      std::ostringstream os;
-      if (!g_final_iter) {
-        os << "-iter" << g_iter;
-      }else{
-        os << "-final";
+      if (!save_dems)
+        continue;
+
+      snap->dem.push_back(copy((*g_dem)[dem_iter]));
+      snap->albedo.push_back(copy((*g_albedo)[dem_iter]));
+      snap->pq.push_back(copy((*g_pq)[dem_iter]));
+
+      // Copy the cameras, not the underlying models, which do not change
+      snap->cameras.push_back(std::vector<boost::shared_ptr<CameraModel> >());
+      for (size_t image_iter = 0; image_iter < (*g_cameras)[dem_iter].size(); image_iter++) {
+        boost::shared_ptr<CameraModel> cam = (*g_cameras)[dem_iter][image_iter];
+        AdjustedCameraModel * icam = dynamic_cast<AdjustedCameraModel*>(cam.get());
+        if (!g_opt->use_approx_adjusted_camera_models && icam != NULL)
+          cam.reset(new AdjustedCameraModel(*icam));
+        snap->cameras.back().push_back(cam);
       }
 
-      // Note that for level 0 we don't append the level as part of
-      // the filename. This way, whether we have levels or not,
-      // the lowest level is always named consistently.
-      if ((*g_opt).coarse_levels > 0 && g_level > 0) os << "-level" << g_level;
-      if (num_dems > 1)                              os << "-clip"  << dem_iter;
-
-      std::string iter_str = os.str();
-
-      // The DEM with no-data where there are no valid image pixels
-      ImageView<double> dem_nodata;
-      if (g_opt->save_dem_with_nodata) {
-        dem_nodata = ImageView<double>((*g_dem)[dem_iter].cols(), (*g_dem)[dem_iter].rows());
-        fill(dem_nodata, *g_dem_nodata_val);
-      }
-        
-      bool has_georef = true, has_nodata = true;
-      TerminalProgressCallback tpc("asp", ": ");
-      if ( (!g_opt->save_sparingly || g_final_iter) && !g_opt->save_computed_intensity_only ) {
-        std::string out_dem_file = g_opt->out_prefix + "-DEM"
-          + iter_str + ".tif";
-        vw_out() << "Writing: " << out_dem_file << std::endl;
-        block_write_gdal_image(out_dem_file, (*g_dem)[dem_iter], has_georef, (*g_geo)[dem_iter],
-                               has_nodata, *g_dem_nodata_val,
-                               *g_opt, tpc);
-      }
-      
-      if ((!g_opt->save_sparingly || (g_final_iter && g_opt->float_albedo)) &&
-          !g_opt->save_computed_intensity_only ) {
-        std::string out_albedo_file = g_opt->out_prefix + "-comp-albedo"
-          + iter_str + ".tif";
-        vw_out() << "Writing: " << out_albedo_file << std::endl;
-        block_write_gdal_image(out_albedo_file, (*g_albedo)[dem_iter], has_georef,
-                               (*g_geo)[dem_iter],
-                               has_nodata, *g_dem_nodata_val,
-                               *g_opt, tpc);
-      }
-
-      // Print reflectance and other things
-      for (size_t image_iter = 0; image_iter < (*g_masked_images)[dem_iter].size(); image_iter++) {
-
-        if (g_opt->skip_images[dem_iter].find(image_iter) !=
-            g_opt->skip_images[dem_iter].end()) {
-          continue;
-        }
-      
-        // Separate into blocks for each image
-        vw_out() << "\n";
-
-        ImageView< PixelMask<double> > reflectance, intensity, comp_intensity;
-        ImageView< double            > blend_weight;
-
-        std::string out_camera_file
-          = asp::bundle_adjust_file_name(g_opt->out_prefix,
-                                         g_opt->input_images[image_iter],
-                                         g_opt->input_cameras[image_iter]);
-        
-        if (!g_opt->use_approx_adjusted_camera_models) {
-          // Save the camera adjustments for the current iteration.
-          // When we use approx adjusted camera models this is not necessary
-          // since then the cameras don't change.
-          //std::string out_camera_file = g_opt->out_prefix + "-camera"
-          //+ iter_str2 + ".adjust";
-          //vw_out() << "Writing: " << out_camera_file << std::endl;
-          AdjustedCameraModel * icam
-            = dynamic_cast<AdjustedCameraModel*>((*g_cameras)[dem_iter][image_iter].get());
-          if (icam == NULL)
-            vw_throw( ArgumentErr() << "Expecting an adjusted camera.\n");
-          Vector3 translation = icam->translation();
-          Quaternion<double> rotation = icam->rotation();
-          //asp::write_adjustments(out_camera_file, translation, rotation);
-          
-          // Used to save adjusted files in the format <out prefix>-<input-img>.adjust
-          // so we can later read them with --bundle-adjust-prefix to be
-          // used in another SfS run. Don't do that anymore as normally
-          // the adjustments don't change.
-          //if (g_level == 0) {
-          //if (!g_opt->save_computed_intensity_only){
-          //  vw_out() << "Writing: " << out_camera_file << std::endl;
-          //  asp::write_adjustments(out_camera_file, translation, rotation);
-          //}
-        }
-        
-        if (g_opt->save_sparingly && !g_opt->save_dem_with_nodata) 
-          continue; // don't write too many things
-        
-        // Manufacture an output prefix for the other data associated with this camera
-        std::string iter_str2 = fs::path(out_camera_file).replace_extension("").string();
-        iter_str2 += iter_str;
-    
-        // Compute reflectance and intensity with optimized DEM
-        int sample_col_rate = 1, sample_row_rate = 1;
-        computeReflectanceAndIntensity((*g_dem)[dem_iter], (*g_pq)[dem_iter],
-                                       (*g_geo)[dem_iter],
-                                       g_opt->model_shadows,
-                                       (*g_max_dem_height)[dem_iter],
-                                       *g_gridx, *g_gridy,
-                                       sample_col_rate, sample_row_rate,
-                                       (*g_model_params)[image_iter],
-                                       *g_global_params,
-                                       (*g_crop_boxes)[dem_iter][image_iter],
-                                       (*g_masked_images)[dem_iter][image_iter],
-                                       (*g_blend_weights)[dem_iter][image_iter],
-                                       (*g_cameras)[dem_iter][image_iter].get(),
-                                       &(*g_scaled_sun_posns)[3*image_iter],
-                                       reflectance, intensity, blend_weight, 
-                                       g_reflectance_model_coeffs);
-
-        // dem_nodata equals to dem if the image has valid pixels and no shadows
-        if (g_opt->save_dem_with_nodata) {
-          for (int col = 0; col < reflectance.cols(); col++) {
-            for (int row = 0; row < reflectance.rows(); row++) {
-              if (is_valid(reflectance(col, row))) 
-                dem_nodata(col, row) = (*g_dem)[dem_iter](col, row);
-            }
-          }
-        }
-
-        if (g_opt->save_sparingly)
-          continue;
-        
-        // Find the computed intensity
-        comp_intensity.set_size(reflectance.cols(), reflectance.rows());
-        for (int col = 0; col < comp_intensity.cols(); col++) {
-          for (int row = 0; row < comp_intensity.rows(); row++) {
-            comp_intensity(col, row)
-              = (*g_albedo)[dem_iter](col, row) *
-              nonlin_reflectance(reflectance(col, row), (*g_exposures)[image_iter],
-                                 g_opt->steepness_factor,
-                                 &(*g_haze)[image_iter][0], g_opt->num_haze_coeffs);
-          }
-        }
-
-        std::string out_meas_intensity_file = iter_str2 + "-meas-intensity.tif";
-        vw_out() << "Writing: " << out_meas_intensity_file << std::endl;
-        block_write_gdal_image(out_meas_intensity_file,
-                               apply_mask(intensity, *g_img_nodata_val),
-                               has_georef, (*g_geo)[dem_iter], has_nodata,
-                               *g_img_nodata_val, *g_opt, tpc);
-    
-        std::string out_comp_intensity_file = iter_str2 + "-comp-intensity.tif";
-        vw_out() << "Writing: " << out_comp_intensity_file << std::endl;
-        block_write_gdal_image(out_comp_intensity_file,
-                               apply_mask(comp_intensity, *g_img_nodata_val),
-                               has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
-                               *g_opt, tpc);
-
-        if (g_opt->save_computed_intensity_only) 
-          continue; // don't write too many things
-
-        std::string out_weight_file = iter_str2 + "-blending-weight.tif";
-        vw_out() << "Writing: " << out_weight_file << std::endl;
-        block_write_gdal_image(out_weight_file,
-                               blend_weight,
-                               has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
-                               *g_opt, tpc);
-
-        std::string out_reflectance_file = iter_str2 + "-reflectance.tif";
-        vw_out() << "Writing: " << out_reflectance_file << std::endl;
-        block_write_gdal_image(out_reflectance_file,
-                               apply_mask(reflectance, *g_img_nodata_val),
-                               has_georef, (*g_geo)[dem_iter], has_nodata, *g_img_nodata_val,
-                               *g_opt, tpc);
-
-
-        // Find the measured normalized albedo, after correcting for
-        // reflectance.
-        ImageView<double> measured_albedo;
-        measured_albedo.set_size(reflectance.cols(), reflectance.rows());
-        for (int col = 0; col < measured_albedo.cols(); col++) {
-          for (int row = 0; row < measured_albedo.rows(); row++) {
-            if (!is_valid(reflectance(col, row)))
-              measured_albedo(col, row) = 1;
-            else
-              measured_albedo(col, row) = intensity(col, row) /
-                nonlin_reflectance(reflectance(col, row), (*g_exposures)[image_iter],
-                                   g_opt->steepness_factor,
-                                   &(*g_haze)[image_iter][0], g_opt->num_haze_coeffs);
-          }
-        }
-        std::string out_albedo_file = iter_str2 + "-meas-albedo.tif";
-        vw_out() << "Writing: " << out_albedo_file << std::endl;
-        block_write_gdal_image(out_albedo_file, measured_albedo,
-                               has_georef, (*g_geo)[dem_iter], has_nodata, 0, *g_opt, tpc);
-
-
-        double imgmean, imgstdev, refmean, refstdev;
-        compute_image_stats(intensity, comp_intensity, imgmean, imgstdev, refmean, refstdev);
-        vw_out() << "meas image mean and std: " << imgmean << ' ' << imgstdev
-                 << std::endl;
-        vw_out() << "comp image mean and std: " << refmean << ' ' << refstdev
-                 << std::endl;
-
-        vw_out() << "Exposure for image " << image_iter << ": "
-                 << (*g_exposures)[image_iter] << std::endl;
-
-        if (g_opt->num_haze_coeffs > 0) {
-          vw_out() << "Haze for image " << image_iter << ":";
-          for (size_t hiter = 0; hiter < (*g_haze)[image_iter].size(); hiter++) {
-            vw_out() << " " << (*g_haze)[image_iter][hiter];
-          }
-          vw_out() << std::endl;
-        }
-        
-#if 0
-        // Dump the points in shadow
-        ImageView<float> shadow; // don't use int, scaled weirdly by ASP on reading
-        
-        Vector3 sunPos = // all wrong here &(*g_scaled_sun_posns)[3*image_iter]; // fix here
-          // = (*g_model_params)[image_iter].sunPosition;
-          areInShadow(sunPos, (*g_dem)[dem_iter], *g_gridx, *g_gridy,  (*g_geo)[dem_iter], shadow);
-
-        std::string out_shadow_file = iter_str2 + "-shadow.tif";
-        vw_out() << "Writing: " << out_shadow_file << std::endl;
-        block_write_gdal_image(out_shadow_file, shadow, has_georef, (*g_geo)[dem_iter], has_nodata,
-                               -std::numeric_limits<float>::max(), *g_opt, tpc);
-#endif
-
-      }
-
-      if (g_opt->save_dem_with_nodata) {
-        if ( !g_opt->save_sparingly || g_final_iter ) {
-          std::string out_dem_nodata_file = g_opt->out_prefix + "-DEM-nodata"
-            + iter_str + ".tif";
-          vw_out() << "Writing: " << out_dem_nodata_file << std::endl;
-          TerminalProgressCallback tpc("asp", ": ");
-          block_write_gdal_image(out_dem_nodata_file, dem_nodata, has_georef, (*g_geo)[dem_iter],
-                                 has_nodata, *g_dem_nodata_val,
-                                 *g_opt, tpc);
-        }
-      }
+      // Update the maximum DEM height here, as the solver uses it
+      bool has_image = false;
+      for (size_t image_iter = 0; image_iter < (*g_masked_images)[dem_iter].size(); image_iter++)
+        has_image = has_image || (g_opt->skip_images[dem_iter].find(image_iter) ==
+                                  g_opt->skip_images[dem_iter].end());
+      if (save_images && has_image)
+        updateMaxDemHeight((*g_dem)[dem_iter], g_opt->model_shadows, 1, 1,
+                           (*g_max_dem_height)[dem_iter]);
+    }
+    snap->max_dem_height = *g_max_dem_height;
+
+    bool background = (!g_final_iter &&
+                       (g_opt->stereo_session != "isis" ||
+                        g_opt->use_approx_camera_models ||
+                        g_opt->use_approx_adjusted_camera_models));
+    if (background) {
+      m_writer.submit([snap]() { save_sfs_results(*snap); });
+    } else {
+      m_writer.wait();
+      save_sfs_results(*snap);
     }
     
     return ceres::SOLVER_CONTINUE;
   }
+
+  // Wait until the results of the iterations so far are written
+  void wait() { m_writer.wait(); }
+
+private:
+  asp::BackgroundWriter m_writer;
 };
 
 // See SmoothnessError() for the definitions of bottom, top, etc.
@@ -3659,7 +3663,9 @@ void compute_grid_sizes_in_meters(ImageView<double> const& dem,
   if (!gridy_vec.empty()) gridy = gridy_vec[gridy_vec.size()/2];
 }
 
-ImageView<double> comp_blending_weights(MaskedImgT const& img,
+// The weights are kept as float, as they are as large as the cropped
+// image, and float is precise enough for a weight.
+ImageView<float> comp_blending_weights(MaskedImgT const& img,
                                         double blending_dist,
                                         double blending_power,
                                         int min_blend_size){
@@ -3675,7 +3681,7 @@ ImageView<double> comp_blending_weights(MaskedImgT const& img,
   //     return weights;
   //   }
 
-  ImageView<double> weights;
+  ImageView<float> weights;
 
   if (min_blend_size <= 0)
     weights = grassfire(img);
@@ -3685,7 +3691,8 @@ ImageView<double> comp_blending_weights(MaskedImgT const& img,
   // Make the weights plateau at blending_dist distance from the edge.
   for (int col = 0; col < weights.cols(); col++) {
     for (int row = 0; row < weights.rows(); row++) {
-      weights(col, row) = pow( std::min(weights(col, row)/blending_dist, 1.0), blending_power );
+      weights(col, row) = pow( std::min(weights(col, row)/blending_dist, 1.0),
+                               blending_power );
     }
   }
   return weights;
@@ -3765,6 +3772,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "If floating the albedo, a larger value will try harder to keep the optimized albedo close to the nominal value of 1.")
     ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
      "Use the camera adjustments obtained by previously running bundle_adjust with this output prefix.")
+    ("camera-cache-dir", po::value(&opt.camera_cache_dir)->default_value(""),
+     "Save in this directory, in binary, what is parsed from DigitalGlobe, Pleiades, and SPOT5 XML camera files, and reuse it in later runs, such as for other parallel_sfs tiles, as long as the camera file contents are the same.")
     ("float-albedo",   po::bool_switch(&opt.float_albedo)->default_value(false)->implicit_value(true),
      "Float the albedo for each pixel. Will give incorrect results if only one image is present. The albedo is normalized, its nominal value is 1.")
     ("float-exposure",   po::bool_switch(&opt.float_exposure)->default_value(false)->implicit_value(true),
@@ -3817,8 +3826,12 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Skip the current camera if the maximum error between a camera model and its RPC approximation is larger than this.")
     ("use-semi-approx",   po::bool_switch(&opt.use_semi_approx)->default_value(false)->implicit_value(true),
      "This is an undocumented experiment.")
+    ("image-stats-cache-dir", po::value(&opt.image_stats_cache_dir)->default_value(""),
+     "Save to this directory the statistics of the measured and computed intensity of each image over each DEM clip, which are used to find the initial exposures, and reuse them in later runs with the same inputs. This skips the ray tracing for these statistics when modeling shadows.")
+    ("approx-camera-table-dir", po::value(&opt.approx_camera_table_dir)->default_value(""),
+     "Save the tables of the approximate camera models to this directory, and reuse them in later runs with the same cameras, adjustments, and DEM clip. Used with --use-approx-camera-models when the cameras are not floated.")
     ("coarse-levels", po::value(&opt.coarse_levels)->default_value(0),
-     "Solve the problem on a grid coarser than the original by a factor of 2 to this power, then refine the solution on finer grids. It is suggested to not use this option.")
+     "Solve the problem on a grid coarser than the original by a factor of 2 to this power, then refine the solution on finer grids. The DEM and albedo found at each level are upsampled to initialize the next finer level, and the exposures, haze, and camera adjustments carry over.")
     ("max-coarse-iterations", po::value(&opt.max_coarse_iterations)->default_value(10),
      "How many iterations to do at levels of resolution coarser than the final result.")
     ("crop-input-images",   po::bool_switch(&opt.crop_input_images)->default_value(false)->implicit_value(true),
@@ -3886,6 +3899,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "smoothness weight to a very small value.")
     ("save-sparingly",   po::bool_switch(&opt.save_sparingly)->default_value(false)->implicit_value(true),
      "Avoid saving any results except the adjustments and the DEM, as that's a lot of files.")
+    ("profile-cost-functions", po::bool_switch(&opt.profile_cost_functions)->default_value(false)->implicit_value(true),
+     "Count the evaluations of each type of cost function and their run time, and save that, with the solver timings, to <output prefix>-cost-profile.json.")
     ("camera-position-step-size", po::value(&opt.camera_position_step_size)->default_value(1.0),
      "Larger step size will result in more aggressiveness in varying the camera position if it is being floated (which may result in a better solution or in divergence).");
 
@@ -4230,6 +4245,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   // Need this to be able to load adjusted camera models. That will happen
   // in the stereo session.
   asp::stereo_settings().bundle_adjust_prefix = opt.bundle_adjust_prefix;
+  asp::stereo_settings().camera_cache_dir = opt.camera_cache_dir;
 
   if (opt.input_images.size() <= 1 && opt.float_albedo && 
       opt.initial_dem_constraint_weight <= 0 && opt.albedo_constraint_weight <= 0.0)
@@ -4411,59 +4427,110 @@ void run_sfs_level(// Fixed inputs
   }
   
   std::set<int> use_dem, use_albedo; // to avoid a crash in Ceres when a param is fixed but not set
+
+  // The robust loss, and the smoothness, gradient, integrability, and
+  // albedo terms, are the same at every grid point. Make each once, when
+  // first needed, and share it among all residual blocks, rather than
+  // allocating millions of identical copies. Ceres counts the blocks
+  // using each and deletes it once.
+  ceres::LossFunction * loss_function_img   = NULL;
+  ceres::CostFunction * cost_function_sm    = NULL;
+  ceres::CostFunction * cost_function_grad  = NULL;
+  ceres::CostFunction * cost_function_int   = NULL;
+  ceres::CostFunction * cost_function_sm_pq = NULL;
+  ceres::CostFunction * cost_function_ac    = NULL;
   
   for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
     int bd = 1;
     if (opt.boundary_fix) bd = 0;
     
-    // Add a residual block for every grid point not at the boundary
-    for (int col = bd; col < dems[dem_iter].cols()-bd; col++) {
-      for (int row = bd; row < dems[dem_iter].rows()-bd; row++) {
-        
-        // Intensity error for each image
-        for (int image_iter = 0; image_iter < num_images; image_iter++) {
+    // Add a residual block for every grid point not at the boundary.
+    // Ceres evaluates the blocks, and orders the parameters, in the
+    // order they are added. Go over the DEM in square blocks, so that
+    // nearby residuals touch the same few rows of the DEM, albedo, and
+    // images, rather than a column at a time.
+    std::vector<Vector2i> grid_points;
+    asp::blocked_grid_order(BBox2i(bd, bd,
+                                   std::max(dems[dem_iter].cols() - 2*bd, 0),
+                                   std::max(dems[dem_iter].rows() - 2*bd, 0)),
+                            SFS_GRID_BLOCK_SIZE, grid_points);
+    for (size_t pt_iter = 0; pt_iter < grid_points.size(); pt_iter++) {
+      int col = grid_points[pt_iter].x(), row = grid_points[pt_iter].y();
+      
+      // Intensity error for each image
+      for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
-          if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) {
-            continue;
-          }
-          
-          ceres::LossFunction* loss_function_img = NULL;
-          if (opt.robust_threshold > 0) 
-            loss_function_img = new ceres::CauchyLoss(opt.robust_threshold);
+        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) {
+          continue;
+        }
+        
+        if (opt.robust_threshold > 0 && loss_function_img == NULL)
+          loss_function_img = new ceres::CauchyLoss(opt.robust_threshold);
+        
+        if (float_dem_only) {
+          ceres::CostFunction* cost_function_img =
+            IntensityErrorFloatDemOnly::Create(col, row,
+                                               dems[dem_iter],
+                                               albedos[dem_iter](col, row), 
+                                               &reflectance_model_coeffs[0],
+                                               &exposures[image_iter],      // exposure
+                                               &haze[image_iter][0],        // haze
+                                               &adjustments[6*image_iter],  // camera adjustments
+                                               geo[dem_iter],
+                                               opt.model_shadows,
+                                               opt.camera_position_step_size,
+                                               max_dem_height[dem_iter],
+                                               gridx, gridy,
+                                               global_params, model_params[image_iter],
+                                               crop_boxes[dem_iter][image_iter],
+                                               masked_images[dem_iter][image_iter],
+                                               blend_weights[dem_iter][image_iter],
+                                               &scaled_sun_posns[3*image_iter], // sun positions
+                                               cameras[dem_iter][image_iter]);
+          problem.AddResidualBlock(asp::profile_cost(cost_function_img,
+                                                     "IntensityErrorFloatDemOnly"),
+                                   loss_function_img,
+                                   &dems[dem_iter](col-1, row),  // left
+                                   &dems[dem_iter](col, row),    // center
+                                   &dems[dem_iter](col+1, row),  // right
+                                   &dems[dem_iter](col, row+1),  // bottom
+                                   &dems[dem_iter](col, row-1)  // top
+                                   );
+          use_dem.insert(dem_iter); 
           
-          if (float_dem_only) {
-            ceres::CostFunction* cost_function_img =
-              IntensityErrorFloatDemOnly::Create(col, row,
-                                                 dems[dem_iter],
-                                                 albedos[dem_iter](col, row), 
-                                                 &reflectance_model_coeffs[0],
-                                                 &exposures[image_iter],      // exposure
-                                                 &haze[image_iter][0],        // haze
-                                                 &adjustments[6*image_iter],  // camera adjustments
-                                                 geo[dem_iter],
-                                                 opt.model_shadows,
-                                                 opt.camera_position_step_size,
-                                                 max_dem_height[dem_iter],
-                                                 gridx, gridy,
-                                                 global_params, model_params[image_iter],
-                                                 crop_boxes[dem_iter][image_iter],
-                                                 masked_images[dem_iter][image_iter],
-                                                 blend_weights[dem_iter][image_iter],
-                                                 &scaled_sun_posns[3*image_iter], // sun positions
-                                                 cameras[dem_iter][image_iter]);
-            problem.AddResidualBlock(cost_function_img, loss_function_img,
-                                     &dems[dem_iter](col-1, row),  // left
-                                     &dems[dem_iter](col, row),    // center
-                                     &dems[dem_iter](col+1, row),  // right
-                                     &dems[dem_iter](col, row+1),  // bottom
-                                     &dems[dem_iter](col, row-1)  // top
-                                     );
-            use_dem.insert(dem_iter); 
-            
-          }else if (opt.integrability_weight == 0){
-            ceres::CostFunction* cost_function_img =
-              IntensityError::Create(col, row, dems[dem_iter], geo[dem_iter],
+        }else if (opt.integrability_weight == 0){
+          ceres::CostFunction* cost_function_img =
+            IntensityError::Create(col, row, dems[dem_iter], geo[dem_iter],
+                                   opt.model_shadows,
+                                   opt.camera_position_step_size,
+                                   max_dem_height[dem_iter],
+                                   gridx, gridy,
+                                   global_params, model_params[image_iter],
+                                   crop_boxes[dem_iter][image_iter],
+                                   masked_images[dem_iter][image_iter],
+                                   blend_weights[dem_iter][image_iter],
+                                   &scaled_sun_posns[3*image_iter], // sun positions
+                                   cameras[dem_iter][image_iter]);
+          problem.AddResidualBlock(asp::profile_cost(cost_function_img, "IntensityError"),
+                                   loss_function_img,
+                                   &exposures[image_iter],       // exposure
+                                   &haze[image_iter][0],         // haze
+                                   &dems[dem_iter](col-1, row),  // left
+                                   &dems[dem_iter](col, row),    // center
+                                   &dems[dem_iter](col+1, row),  // right
+                                   &dems[dem_iter](col, row+1),  // bottom
+                                   &dems[dem_iter](col, row-1),  // top
+                                   &albedos[dem_iter](col, row), // albedo
+                                   &adjustments[6*image_iter],   // camera
+                                   //&scaled_sun_posns[3*image_iter], // sun positions
+                                   &reflectance_model_coeffs[0]);
+          use_dem.insert(dem_iter); 
+          use_albedo.insert(dem_iter);
+        } else {
+          // Use the integrability constraint
+          ceres::CostFunction* cost_function_img =
+            IntensityErrorPQ::Create(col, row, dems[dem_iter], geo[dem_iter],
                                      opt.model_shadows,
                                      opt.camera_position_step_size,
                                      max_dem_height[dem_iter],
@@ -4472,150 +4539,137 @@ void run_sfs_level(// Fixed inputs
                                      crop_boxes[dem_iter][image_iter],
                                      masked_images[dem_iter][image_iter],
                                      blend_weights[dem_iter][image_iter],
-                                     &scaled_sun_posns[3*image_iter], // sun positions
                                      cameras[dem_iter][image_iter]);
-            problem.AddResidualBlock(cost_function_img, loss_function_img,
-                                     &exposures[image_iter],       // exposure
-                                     &haze[image_iter][0],         // haze
-                                     &dems[dem_iter](col-1, row),  // left
-                                     &dems[dem_iter](col, row),    // center
-                                     &dems[dem_iter](col+1, row),  // right
-                                     &dems[dem_iter](col, row+1),  // bottom
-                                     &dems[dem_iter](col, row-1),  // top
-                                     &albedos[dem_iter](col, row), // albedo
-                                     &adjustments[6*image_iter],   // camera
-                                     //&scaled_sun_posns[3*image_iter], // sun positions
-                                     &reflectance_model_coeffs[0]);
-            use_dem.insert(dem_iter); 
-            use_albedo.insert(dem_iter);
-          } else {
-            // Use the integrability constraint
-            ceres::CostFunction* cost_function_img =
-              IntensityErrorPQ::Create(col, row, dems[dem_iter], geo[dem_iter],
-                                       opt.model_shadows,
-                                       opt.camera_position_step_size,
-                                       max_dem_height[dem_iter],
-                                       gridx, gridy,
-                                       global_params, model_params[image_iter],
-                                       crop_boxes[dem_iter][image_iter],
-                                       masked_images[dem_iter][image_iter],
-                                       blend_weights[dem_iter][image_iter],
-                                       cameras[dem_iter][image_iter]);
-            problem.AddResidualBlock(cost_function_img, loss_function_img,
-                                     &exposures[image_iter],          // exposure
-                                     &haze[image_iter][0],            // haze
-                                     &dems[dem_iter](col, row),       // center
-                                     &pq[dem_iter](col, row)[0],      // pq
-                                     &albedos[dem_iter](col, row),    // albedo
-                                     &adjustments[6*image_iter],      // camera
-                                     &scaled_sun_posns[3*image_iter], // sun positions
-                                     &reflectance_model_coeffs[0]);   // reflectance 
-            
-            
-            use_dem.insert(dem_iter); 
-            use_albedo.insert(dem_iter);
-          }
+          problem.AddResidualBlock(asp::profile_cost(cost_function_img, "IntensityErrorPQ"),
+                                   loss_function_img,
+                                   &exposures[image_iter],          // exposure
+                                   &haze[image_iter][0],            // haze
+                                   &dems[dem_iter](col, row),       // center
+                                   &pq[dem_iter](col, row)[0],      // pq
+                                   &albedos[dem_iter](col, row),    // albedo
+                                   &adjustments[6*image_iter],      // camera
+                                   &scaled_sun_posns[3*image_iter], // sun positions
+                                   &reflectance_model_coeffs[0]);   // reflectance 
           
-        } // end iterating over images
-        
-        if (col > 0 && col < dems[dem_iter].cols()-1 &&
-            row > 0 && row < dems[dem_iter].rows()-1 ) {
           
-          // Smoothness penalty. We always add this, even if the weight is 0,
-          // to make Ceres not complain about blocks not being set. 
-          ceres::LossFunction* loss_function_sm = NULL;
-          ceres::CostFunction* cost_function_sm =
-            SmoothnessError::Create(smoothness_weight, gridx, gridy);
-          problem.AddResidualBlock(cost_function_sm, loss_function_sm,
-                                   &dems[dem_iter](col-1, row+1),  // bottom left
-                                   &dems[dem_iter](col, row+1),    // bottom 
-                                   &dems[dem_iter](col+1, row+1),  // bottom right
-                                   &dems[dem_iter](col-1, row  ),  // left
-                                   &dems[dem_iter](col, row  ),    // center
-                                   &dems[dem_iter](col+1, row  ),  // right 
-                                   &dems[dem_iter](col-1, row-1),  // top left
-                                   &dems[dem_iter](col, row-1),    // top
-                                   &dems[dem_iter](col+1, row-1)); // top right
-
-          // Add curvature in shadow. Note that we use a per-pixel curvature_in_shadow_weight,
-          // to gradually phase it in to avoid artifacts.
-          if (opt.curvature_in_shadow_weight > 0.0 && curvature_in_shadow_weight(col, row) > 0) {
-            ceres::LossFunction* loss_function_cv = NULL;
-            ceres::CostFunction* cost_function_cv =
-              CurvatureInShadowError::Create(opt.curvature_in_shadow,
-                                             curvature_in_shadow_weight(col, row),
-                                             gridx, gridy);
-            problem.AddResidualBlock(cost_function_cv, loss_function_cv,
-                                     &dems[dem_iter](col,   row+1),  // bottom 
-                                     &dems[dem_iter](col-1, row),    // left
-                                     &dems[dem_iter](col,   row),    // center
-                                     &dems[dem_iter](col+1, row),    // right 
-                                     &dems[dem_iter](col,   row-1)); // top
-          }
+          use_dem.insert(dem_iter); 
+          use_albedo.insert(dem_iter);
+        }
+        
+      } // end iterating over images
+      
+      if (col > 0 && col < dems[dem_iter].cols()-1 &&
+          row > 0 && row < dems[dem_iter].rows()-1 ) {
+        
+        // Smoothness penalty. We always add this, even if the weight is 0,
+        // to make Ceres not complain about blocks not being set. 
+        ceres::LossFunction* loss_function_sm = NULL;
+        if (cost_function_sm == NULL)
+          cost_function_sm = asp::profile_cost(SmoothnessError::Create(smoothness_weight,
+                                                                       gridx, gridy),
+                                               "SmoothnessError");
+        problem.AddResidualBlock(cost_function_sm, loss_function_sm,
+                                 &dems[dem_iter](col-1, row+1),  // bottom left
+                                 &dems[dem_iter](col, row+1),    // bottom 
+                                 &dems[dem_iter](col+1, row+1),  // bottom right
+                                 &dems[dem_iter](col-1, row  ),  // left
+                                 &dems[dem_iter](col, row  ),    // center
+                                 &dems[dem_iter](col+1, row  ),  // right 
+                                 &dems[dem_iter](col-1, row-1),  // top left
+                                 &dems[dem_iter](col, row-1),    // top
+                                 &dems[dem_iter](col+1, row-1)); // top right
+
+        // Add curvature in shadow. Note that we use a per-pixel curvature_in_shadow_weight,
+        // to gradually phase it in to avoid artifacts.
+        if (opt.curvature_in_shadow_weight > 0.0 && curvature_in_shadow_weight(col, row) > 0) {
+          ceres::LossFunction* loss_function_cv = NULL;
+          ceres::CostFunction* cost_function_cv =
+            CurvatureInShadowError::Create(opt.curvature_in_shadow,
+                                           curvature_in_shadow_weight(col, row),
+                                           gridx, gridy);
+          problem.AddResidualBlock(asp::profile_cost(cost_function_cv,
+                                                     "CurvatureInShadowError"),
+                                   loss_function_cv,
+                                   &dems[dem_iter](col,   row+1),  // bottom 
+                                   &dems[dem_iter](col-1, row),    // left
+                                   &dems[dem_iter](col,   row),    // center
+                                   &dems[dem_iter](col+1, row),    // right 
+                                   &dems[dem_iter](col,   row-1)); // top
+        }
 
-          // Add gradient weight
-          if (opt.gradient_weight > 0.0) {
-            ceres::LossFunction* loss_function_grad = NULL;
-            ceres::CostFunction* cost_function_grad =
-              GradientError::Create(opt.gradient_weight, gridx, gridy);
-            problem.AddResidualBlock(cost_function_grad, loss_function_grad,
-                                     &dems[dem_iter](col,   row+1),  // bottom 
-                                     &dems[dem_iter](col-1, row),    // left
-                                     &dems[dem_iter](col,   row),    // center
-                                     &dems[dem_iter](col+1, row),    // right 
-                                     &dems[dem_iter](col,   row-1)); // top
+        // Add gradient weight
+        if (opt.gradient_weight > 0.0) {
+          ceres::LossFunction* loss_function_grad = NULL;
+          if (cost_function_grad == NULL)
+            cost_function_grad
+              = asp::profile_cost(GradientError::Create(opt.gradient_weight, gridx, gridy),
+                                  "GradientError");
+          problem.AddResidualBlock(cost_function_grad, loss_function_grad,
+                                   &dems[dem_iter](col,   row+1),  // bottom 
+                                   &dems[dem_iter](col-1, row),    // left
+                                   &dems[dem_iter](col,   row),    // center
+                                   &dems[dem_iter](col+1, row),    // right 
+                                   &dems[dem_iter](col,   row-1)); // top
+        }
+      
+        if (opt.integrability_weight > 0) {
+          ceres::LossFunction* loss_function_int = NULL;
+          if (cost_function_int == NULL)
+            cost_function_int
+              = asp::profile_cost(IntegrabilityError::Create(opt.integrability_weight,
+                                                             gridx, gridy),
+                                  "IntegrabilityError");
+          problem.AddResidualBlock(cost_function_int, loss_function_int,
+                                   &dems[dem_iter](col,   row+1),   // bottom
+                                   &dems[dem_iter](col-1, row),     // left
+                                   &dems[dem_iter](col+1, row),     // right
+                                   &dems[dem_iter](col,   row-1),   // top
+                                   &pq[dem_iter]  (col,   row)[0]); // pq
+
+          if (opt.smoothness_weight_pq > 0) {
+            ceres::LossFunction* loss_function_sm_pq = NULL;
+            if (cost_function_sm_pq == NULL)
+              cost_function_sm_pq
+                = asp::profile_cost(SmoothnessErrorPQ::Create(opt.smoothness_weight_pq,
+                                                              gridx, gridy),
+                                    "SmoothnessErrorPQ");
+            problem.AddResidualBlock(cost_function_sm_pq, loss_function_sm_pq,
+                                     &pq[dem_iter](col, row+1)[0],  // bottom 
+                                     &pq[dem_iter](col-1, row)[0],  // left
+                                     &pq[dem_iter](col+1, row)[0],  // right 
+                                     &pq[dem_iter](col, row-1)[0]); // top
           }
+        }
         
-          if (opt.integrability_weight > 0) {
-            ceres::LossFunction* loss_function_int = NULL;
-            ceres::CostFunction* cost_function_int =
-              IntegrabilityError::Create(opt.integrability_weight, gridx, gridy);
-            problem.AddResidualBlock(cost_function_int, loss_function_int,
-                                     &dems[dem_iter](col,   row+1),   // bottom
-                                     &dems[dem_iter](col-1, row),     // left
-                                     &dems[dem_iter](col+1, row),     // right
-                                     &dems[dem_iter](col,   row-1),   // top
-                                     &pq[dem_iter]  (col,   row)[0]); // pq
-
-            if (opt.smoothness_weight_pq > 0) {
-              ceres::LossFunction* loss_function_sm_pq = NULL;
-              ceres::CostFunction* cost_function_sm_pq =
-                SmoothnessErrorPQ::Create(opt.smoothness_weight_pq, gridx, gridy);
-              problem.AddResidualBlock(cost_function_sm_pq, loss_function_sm_pq,
-                                       &pq[dem_iter](col, row+1)[0],  // bottom 
-                                       &pq[dem_iter](col-1, row)[0],  // left
-                                       &pq[dem_iter](col+1, row)[0],  // right 
-                                       &pq[dem_iter](col, row-1)[0]); // top
-            }
-          }
-          
+        use_dem.insert(dem_iter); 
+        
+        // Deviation from prescribed height constraint
+        if (opt.initial_dem_constraint_weight > 0) {
+          ceres::LossFunction* loss_function_hc = NULL;
+          ceres::CostFunction* cost_function_hc =
+            HeightChangeError::Create(orig_dems[dem_iter](col, row),
+                                      opt.initial_dem_constraint_weight);
+          problem.AddResidualBlock(asp::profile_cost(cost_function_hc, "HeightChangeError"),
+                                   loss_function_hc,
+                                   &dems[dem_iter](col, row));
           use_dem.insert(dem_iter); 
-          
-          // Deviation from prescribed height constraint
-          if (opt.initial_dem_constraint_weight > 0) {
-            ceres::LossFunction* loss_function_hc = NULL;
-            ceres::CostFunction* cost_function_hc =
-              HeightChangeError::Create(orig_dems[dem_iter](col, row),
-                                        opt.initial_dem_constraint_weight);
-            problem.AddResidualBlock(cost_function_hc, loss_function_hc,
-                                     &dems[dem_iter](col, row));
-            use_dem.insert(dem_iter); 
-          }
-          
-          // Deviation from prescribed albedo
-          if (opt.float_albedo > 0 && opt.albedo_constraint_weight > 0) {
-            ceres::LossFunction* loss_function_hc = NULL;
-            ceres::CostFunction* cost_function_hc =
-              AlbedoChangeError::Create(initial_albedo,
-                                        opt.albedo_constraint_weight);
-            problem.AddResidualBlock(cost_function_hc, loss_function_hc,
-                                     &albedos[dem_iter](col, row));
-            use_albedo.insert(dem_iter);
-          }
         }
         
-      } // end row iter
-    } // end col iter
+        // Deviation from prescribed albedo
+        if (opt.float_albedo > 0 && opt.albedo_constraint_weight > 0) {
+          ceres::LossFunction* loss_function_ac = NULL;
+          if (cost_function_ac == NULL)
+            cost_function_ac
+              = asp::profile_cost(AlbedoChangeError::Create(initial_albedo,
+                                                            opt.albedo_constraint_weight),
+                                  "AlbedoChangeError");
+          problem.AddResidualBlock(cost_function_ac, loss_function_ac,
+                                   &albedos[dem_iter](col, row));
+          use_albedo.insert(dem_iter);
+        }
+      }
+      
+    } // end iterating over grid points
     
     // DEM at the boundary must be fixed.
     if (!opt.float_dem_at_boundary) {
@@ -4761,8 +4815,11 @@ void run_sfs_level(// Fixed inputs
   // just keep the DEM at the initial guess, while saving
   // all the output data as if iterations happened.
   ceres::Solver::Summary summary;
-  if (options.max_num_iterations > 0)
+  if (options.max_num_iterations > 0) {
     ceres::Solve(options, &problem, &summary);
+    asp::profile_solver_summary(summary);
+  }
+  callback.wait();
 
   // Save the final results
   g_final_iter = true;
@@ -5005,6 +5062,105 @@ void setUpModelParams(GlobalParams & global_params, Options & opt) {
   }
 }
 
+// The statistics of the measured and computed intensity of an image
+// over a DEM clip, from which its initial exposure is found
+struct ImageStats {
+  ImageStats(): imgmean(0), imgstdev(0), refmean(0), refstdev(0) {}
+  double imgmean, imgstdev, refmean, refstdev;
+};
+
+// Find the statistics of one image over one DEM clip. Read them from
+// the cache if an earlier run with the same inputs saved them, and
+// save them there as soon as they are found otherwise, so that an
+// interrupted run picks up where it stopped. Each task writes only to
+// its own slot, and the first error is kept to be thrown later.
+class ImageStatsTask: public vw::Task, private boost::noncopyable {
+  Options const& m_opt;
+  int m_dem_iter, m_image_iter;
+  ImageView<double> const& m_dem;
+  GeoReference const& m_geo;
+  double m_max_dem_height;
+  double m_gridx, m_gridy;
+  ModelParams const& m_model_params;
+  GlobalParams const& m_global_params;
+  BBox2i m_crop_box;
+  MaskedImgT m_image;
+  DoubleImgT m_blend_weight;
+  CameraModel const* m_camera;
+  double const* m_scaled_sun_posn;
+  ImageStats & m_stats;
+  std::string & m_error;
+  vw::Mutex & m_mutex;
+public:
+  ImageStatsTask(Options const& opt, int dem_iter, int image_iter,
+                 ImageView<double> const& dem, GeoReference const& geo,
+                 double max_dem_height, double gridx, double gridy,
+                 ModelParams const& model_params, GlobalParams const& global_params,
+                 BBox2i const& crop_box, MaskedImgT const& image,
+                 DoubleImgT const& blend_weight, CameraModel const* camera,
+                 double const* scaled_sun_posn, ImageStats & stats,
+                 std::string & error, vw::Mutex & mutex):
+    m_opt(opt), m_dem_iter(dem_iter), m_image_iter(image_iter), m_dem(dem), m_geo(geo),
+    m_max_dem_height(max_dem_height), m_gridx(gridx), m_gridy(gridy),
+    m_model_params(model_params), m_global_params(global_params), m_crop_box(crop_box),
+    m_image(image), m_blend_weight(blend_weight), m_camera(camera),
+    m_scaled_sun_posn(scaled_sun_posn), m_stats(stats), m_error(error), m_mutex(mutex) {}
+
+  void operator()() {
+    try {
+      // Sample the large DEMs. Keep about 200 row and column samples.
+      int sample_col_rate = std::max((int)round(m_dem.cols()/200.0), 1);
+      int sample_row_rate = std::max((int)round(m_dem.rows()/200.0), 1);
+
+      // See if these statistics were saved by an earlier run with
+      // the same inputs. That saves projecting into the cameras,
+      // and the ray tracing when modeling shadows.
+      std::string stats_key, stats_file;
+      if (m_opt.image_stats_cache_dir != "") {
+        Vector3 sun_pos;
+        for (int it = 0; it < 3; it++)
+          sun_pos[it] = m_scaled_sun_posn[it] * m_model_params.sunPosition[it];
+        stats_key = image_stats_key(m_opt, m_dem_iter, m_image_iter, m_global_params,
+                                    sun_pos, m_crop_box, sample_col_rate, sample_row_rate);
+        stats_file = asp::cache_file_name(m_opt.image_stats_cache_dir, "image-stats-",
+                                          stats_key, ".txt");
+        if (read_image_stats(stats_file, stats_key, m_stats.imgmean, m_stats.imgstdev,
+                             m_stats.refmean, m_stats.refstdev)) {
+          vw_out() << "Read image statistics: " << stats_file << std::endl;
+          return;
+        }
+      }
+
+      ImageView<PixelMask<double>> reflectance, intensity;
+      ImageView<double> weight;
+      ImageView<Vector2> pq; // no need for these just for initialization
+      computeReflectanceAndIntensity(m_dem, pq, m_geo,
+                                     m_opt.model_shadows, m_max_dem_height,
+                                     m_gridx, m_gridy, sample_col_rate, sample_row_rate,
+                                     m_model_params, m_global_params, m_crop_box,
+                                     m_image, m_blend_weight, m_camera,
+                                     m_scaled_sun_posn,
+                                     reflectance, intensity, weight,
+                                     &m_opt.model_coeffs_vec[0]);
+
+      // TODO: Below is not the optimal way of finding the exposure!
+      // Find it as the analytical minimum using calculus.
+      compute_image_stats(intensity, reflectance, m_stats.imgmean, m_stats.imgstdev,
+                          m_stats.refmean, m_stats.refstdev);
+
+      if (m_opt.image_stats_cache_dir != "") {
+        vw_out() << "Writing: " << stats_file << std::endl;
+        write_image_stats(stats_file, stats_key, m_stats.imgmean, m_stats.imgstdev,
+                          m_stats.refmean, m_stats.refstdev);
+      }
+    } catch (std::exception const& e) {
+      vw::Mutex::Lock lock(m_mutex);
+      if (m_error == "")
+        m_error = e.what();
+    }
+  }
+};
+
 int main(int argc, char* argv[]) {
   
   Stopwatch sw_total;
@@ -5014,6 +5170,7 @@ int main(int argc, char* argv[]) {
   g_opt = &opt;
   try {
     handle_arguments(argc, argv, opt);
+    asp::cost_profile().set_enabled(opt.profile_cost_functions);
 
     if (opt.compute_exposures_only && !opt.image_exposures_vec.empty()) {
       // TODO: This needs to be adjusted if haze is computed.
@@ -5148,26 +5305,34 @@ int main(int argc, char* argv[]) {
     std::vector<std::vector<boost::shared_ptr<CameraModel>>> cameras(num_dems);
     for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
 
+      // Load the cameras for this clip together, in parallel if the
+      // session allows it
       cameras[dem_iter].resize(num_images);
+      std::vector<int> load_indices;
+      std::vector<std::string> load_images, load_cameras;
       for (int image_iter = 0; image_iter < num_images; image_iter++){
-    
         if (opt.skip_images[dem_iter].find(image_iter)
             != opt.skip_images[dem_iter].end()) continue;
-    
-        typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
-        SessionPtr session(asp::StereoSessionFactory::create
-                           (opt.stereo_session, // in-out
-                            opt,
-                            opt.input_images[image_iter],
-                            opt.input_images[image_iter],
-                            opt.input_cameras[image_iter],
-                            opt.input_cameras[image_iter],
-                            opt.out_prefix));
-    
         vw_out() << "Loading image and camera: " << opt.input_images[image_iter] << " "
                  <<  opt.input_cameras[image_iter] << " for DEM clip " << dem_iter << ".\n";
-        cameras[dem_iter][image_iter] = session->camera_model(opt.input_images[image_iter],
-                                                              opt.input_cameras[image_iter]);
+        load_indices.push_back(image_iter);
+        load_images.push_back(opt.input_images[image_iter]);
+        load_cameras.push_back(opt.input_cameras[image_iter]);
+      }
+      bool approximate_pinhole_intrinsics = false, single_threaded_cameras = false;
+      std::vector<boost::shared_ptr<CameraModel>> loaded_cameras;
+      asp::load_cameras(load_images, load_cameras, opt.out_prefix, opt,
+                        approximate_pinhole_intrinsics,
+                        // Outputs
+                        opt.stereo_session, // in-out
+                        single_threaded_cameras, loaded_cameras);
+      for (size_t it = 0; it < load_indices.size(); it++)
+        cameras[dem_iter][load_indices[it]] = loaded_cameras[it];
+
+      for (int image_iter = 0; image_iter < num_images; image_iter++){
+    
+        if (opt.skip_images[dem_iter].find(image_iter)
+            != opt.skip_images[dem_iter].end()) continue;
 
         if (dem_iter == 0) {
           // Read the sun position from the camera if it is was not read from the list
@@ -5322,7 +5487,8 @@ int main(int argc, char* argv[]) {
               (new ApproxAdjustedCameraModel(exact_adjusted_camera, exact_unadjusted_camera,
                                              img_bbox,
                                              dems[0][dem_iter], geos[0][dem_iter],
-                                             dem_nodata_val, camera_mutex));
+                                             dem_nodata_val, opt.input_cameras[image_iter],
+                                             opt.approx_camera_table_dir, camera_mutex));
             // Adjustments are already baked into the adjusted
             // approximate cameras, that is why the logic as above to
             // reincorporate the adjustments is not needed.
@@ -5543,9 +5709,10 @@ int main(int argc, char* argv[]) {
             // images. Otherwise the weights are too huge.
             if (opt.blending_dist > 0)
               blend_weights_vec[0][dem_iter][image_iter]
-                = comp_blending_weights(masked_images_vec[0][dem_iter][image_iter],
-                                        opt.blending_dist, opt.blending_power,
-                                        opt.min_blend_size);
+                = pixel_cast<double>
+                (comp_blending_weights(masked_images_vec[0][dem_iter][image_iter],
+                                       opt.blending_dist, opt.blending_power,
+                                       opt.min_blend_size));
           }
         }else{
           masked_images_vec[0][dem_iter][image_iter]
@@ -5609,6 +5776,47 @@ int main(int argc, char* argv[]) {
     // skip. If the user provided initial exposures and haze, use those, but
     // still go through the motions to find the images to skip.
     vw_out() << "Computing exposures.\n";
+
+    // The statistics of each image over each clip are independent, so
+    // find them in parallel. Exact ISIS cameras and images are not
+    // thread-safe, so then use one thread, unless the approximate
+    // cameras and images cropped into memory are used.
+    int stats_threads = opt.num_threads;
+    if (stats_threads <= 0)
+      stats_threads = vw_settings().default_num_threads();
+    if (opt.stereo_session == "isis" &&
+        !((opt.use_approx_camera_models || opt.use_approx_adjusted_camera_models) &&
+          opt.crop_input_images))
+      stats_threads = 1;
+    std::vector<std::vector<ImageStats>> image_stats(num_dems,
+                                                     std::vector<ImageStats>(num_images));
+    {
+      std::string error;
+      vw::Mutex mutex;
+      vw::FifoWorkQueue queue(stats_threads);
+      for (int image_iter = 0; image_iter < num_images; image_iter++) {
+        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+          if (opt.skip_images[dem_iter].find(image_iter) !=
+              opt.skip_images[dem_iter].end()) continue;
+          queue.add_task(boost::shared_ptr<ImageStatsTask>
+                         (new ImageStatsTask(opt, dem_iter, image_iter,
+                                             dems[0][dem_iter], geos[0][dem_iter],
+                                             max_dem_height[dem_iter], gridx, gridy,
+                                             model_params[image_iter], global_params,
+                                             crop_boxes[0][dem_iter][image_iter],
+                                             masked_images_vec[0][dem_iter][image_iter],
+                                             blend_weights_vec[0][dem_iter][image_iter],
+                                             cameras[dem_iter][image_iter].get(),
+                                             &scaled_sun_posns[3*image_iter],
+                                             image_stats[dem_iter][image_iter],
+                                             error, mutex)));
+        }
+      }
+      queue.join_all();
+      if (error != "")
+        vw_throw(ArgumentErr() << error);
+    }
+
     std::vector<double> local_exposures_vec(num_images, 0);
     for (int image_iter = 0; image_iter < num_images; image_iter++) {
       
@@ -5618,30 +5826,9 @@ int main(int argc, char* argv[]) {
         if (opt.skip_images[dem_iter].find(image_iter) !=
             opt.skip_images[dem_iter].end()) continue;
         
-        ImageView<PixelMask<double>> reflectance, intensity;
-        ImageView<double> weight;
-        ImageView<Vector2> pq; // no need for these just for initialization
-        
-        // Sample the large DEMs. Keep about 200 row and column samples.
-        int sample_col_rate = std::max((int)round(dems[0][dem_iter].cols()/200.0), 1);
-        int sample_row_rate = std::max((int)round(dems[0][dem_iter].rows()/200.0), 1);
-        computeReflectanceAndIntensity(dems[0][dem_iter], pq, geos[0][dem_iter],
-                                       opt.model_shadows, max_dem_height[dem_iter],
-                                       gridx, gridy, sample_col_rate, sample_row_rate,
-                                       model_params[image_iter],
-                                       global_params,
-                                       crop_boxes[0][dem_iter][image_iter],
-                                       masked_images_vec[0][dem_iter][image_iter],
-                                       blend_weights_vec[0][dem_iter][image_iter],
-                                       cameras[dem_iter][image_iter].get(),
-                                       &scaled_sun_posns[3*image_iter],
-                                       reflectance, intensity, weight,
-                                       &opt.model_coeffs_vec[0]);
-        
-        // TODO: Below is not the optimal way of finding the exposure!
-        // Find it as the analytical minimum using calculus.
-        double imgmean, imgstdev, refmean, refstdev;
-        compute_image_stats(intensity, reflectance, imgmean, imgstdev, refmean, refstdev);
+        ImageStats const& stats = image_stats[dem_iter][image_iter];
+        double imgmean = stats.imgmean, imgstdev = stats.imgstdev;
+        double refmean = stats.refmean, refstdev = stats.refstdev;
         double exposure = imgmean/refmean/initial_albedo;
         vw_out() << "img mean std: " << imgmean << ' ' << imgstdev << std::endl;
         vw_out() << "ref mean std: " << refmean << ' ' << refstdev << std::endl;
@@ -5693,6 +5880,12 @@ int main(int argc, char* argv[]) {
     }
     if (opt.compute_exposures_only){
       save_exposures(opt.out_prefix, opt.input_images, opt.image_exposures_vec);
+      // Save what the parallel_sfs tiles need to know about the images,
+      // so they do not have to find it again
+      if (num_dems == 1) {
+        save_sun_positions(opt.out_prefix, opt.input_images, model_params);
+        save_image_footprints(opt, dems[0][0], geos[0][0], cameras[0]);
+      }
       // all done
       return 0;
     }
@@ -6108,8 +6301,8 @@ int main(int argc, char* argv[]) {
                  Vector2i(tile_size, tile_size), sub_threads), dem_nodata_val),
                has_img_georef, img_georef, has_img_nodata, dem_nodata_val, opt, tpc);
 
-            ImageView<double> memory_weight = copy(DiskImageView<double>(sub_weight));
-            blend_weights_vec[level][dem_iter][image_iter] = memory_weight;
+            ImageView<float> memory_weight = copy(DiskImageView<float>(sub_weight));
+            blend_weights_vec[level][dem_iter][image_iter] = pixel_cast<double>(memory_weight);
           }
         
         }
@@ -6140,6 +6333,12 @@ int main(int argc, char* argv[]) {
             if (adj_cam == NULL)
               vw_throw( ArgumentErr() << "Expecting adjusted camera.\n");
             adj_cam->set_scale(factors[level]);
+          } else {
+            ApproxAdjustedCameraModel * apx_cam
+              = dynamic_cast<ApproxAdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+            if (apx_cam == NULL)
+              vw_throw( ArgumentErr() << "Expecting approximate adjusted camera.\n");
+            apx_cam->set_scale(factors[level]);
           }
         }
       }
@@ -6174,6 +6373,9 @@ int main(int argc, char* argv[]) {
       
     }
 
+    if (opt.profile_cost_functions)
+      asp::cost_profile().write(opt.out_prefix);
+
   } ASP_STANDARD_CATCHES;
   
   VW_OUT(DebugMessage, "asp") << "Number of times we used the global lock: "
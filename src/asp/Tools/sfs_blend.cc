@@ -44,6 +44,7 @@
 #include <vw/Cartography/GeoTransform.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/DistanceTransform.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/math/special_functions/erf.hpp>
@@ -158,7 +159,21 @@ public:
     // boundary is in fact two pixel wide at the light-shadow
     // interface, given how lit_grass_dist and shadow_grass_dist are
     // defined as the negation of each other. The boundary is the set
-    // of pixels where both of these are <= 1.
+    // of pixels where both of these are <= 1. The exact Euclidean
+    // distance to it is found for the whole tile at once, in time
+    // linear in the number of pixels, rather than by searching a
+    // window around each pixel.
+    ImageView<double> not_bd(sfs_dem_crop.cols(), sfs_dem_crop.rows());
+    for (int col = 0; col < sfs_dem_crop.cols(); col++) {
+      for (int row = 0; row < sfs_dem_crop.rows(); row++) {
+        bool on_bd = (lit_grass_dist(col, row) <= 1 && shadow_grass_dist(col, row) <= 1);
+        not_bd(col, row) = !on_bd;
+      }
+    }
+    ImageView<double> bd_dist;
+    bool ignore_borders = true; // the tile border is not a boundary
+    asp::euclidean_distance(not_bd, ignore_borders, bd_dist);
+
     ImageView<float> dist_to_bd;
     dist_to_bd.set_size(sfs_dem_crop.cols(), sfs_dem_crop.rows());
     for (int col = 0; col < sfs_dem_crop.cols(); col++) {
@@ -177,46 +192,14 @@ public:
           continue;
         }
         
-        // Find the shortest Euclidean distance to the no-data region.
-        double max_dist = std::max(m_opt.lit_blend_length, m_opt.shadow_blend_length);
+        // The distance is clamped at the blending length on each side
         double signed_dist = 0.0;
         if (lit_grass_dist(col, row) > 0) {
-          signed_dist = m_opt.lit_blend_length;
+          signed_dist = std::min(bd_dist(col, row), m_opt.lit_blend_length);
         } else if (shadow_grass_dist(col, row) > 0) {
-          signed_dist = -m_opt.shadow_blend_length;
-        }
-        
-        for (int col2 = std::max(0.0, col - max_dist);
-             col2 <= std::min(sfs_dem_crop.cols() - 1.0, col + max_dist);
-             col2++) {
-
-          // Estimate the range of rows for the circle with given radius
-          // at given col value.
-          double ht_val = ceil(sqrt(double(max_dist * max_dist) -
-                                    double((col - col2) * (col - col2))));
-          
-          for (int row2 = std::max(0.0, row - ht_val);
-               row2 <= std::min(sfs_dem_crop.rows() - 1.0, row + ht_val);
-               row2++) {
-
-            if (lit_grass_dist(col2, row2) > 1 || shadow_grass_dist(col2, row2) > 1) 
-              continue; // not at the boundary
-
-            // See if the current point is closer than anything so far
-            double curr_dist = sqrt( double(col - col2) * (col - col2) +
-                                     double(row - row2) * (row - row2) );
-            if (lit_grass_dist(col, row) > 0) {
-              if (curr_dist < signed_dist) 
-                signed_dist = curr_dist;
-            } else if (shadow_grass_dist(col, row) > 0) {
-              if (curr_dist < -signed_dist) 
-                signed_dist = -curr_dist;
-            }
-            
-          }
+          signed_dist = -std::min(bd_dist(col, row), m_opt.shadow_blend_length);
         }
 
-        // The closest we've got
         dist_to_bd(col, row) = signed_dist;
       }
     }
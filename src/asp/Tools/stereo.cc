@@ -28,6 +28,7 @@
 #include <asp/Tools/stereo.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Core/Bathymetry.h>
+#include <asp/Core/ImageAlignment.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 
 // Can't do much about warnings in boost except to hide them
@@ -37,6 +38,9 @@
 #include <boost/accumulators/statistics.hpp>
 #pragma GCC diagnostic pop
 
+#include <fstream>
+#include <sstream>
+
 using namespace vw;
 using namespace vw::cartography;
 using namespace std;
@@ -54,9 +58,9 @@ namespace asp {
     if (b == BBox2i(0, 0, 0, 0)){
 
       // No box was provided. Use the full box.
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
-        DiskImageView<PixelGray<float> > L_img(opt.out_prefix+"-L.tif");
-        b = bounding_box(L_img);
+      if (asp::aligned_image_exists(opt.out_prefix, true)) {
+        Vector2i L_size = asp::aligned_image_size(opt.out_prefix, true);
+        b = BBox2i(0, 0, L_size.x(), L_size.y());
       }else{
         b = full_box; // To not have an empty box
       }
@@ -72,10 +76,10 @@ namespace asp {
         b = HomographyTransform(align_left_matrix).forward_bbox(b);
       }
 
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
+      if (asp::aligned_image_exists(opt.out_prefix, true)) {
         // Intersect with L.tif which is the transformed and processed left image
-        DiskImageView<PixelGray<float> > L_img(opt.out_prefix+"-L.tif");
-        b.crop(bounding_box(L_img));
+        Vector2i L_size = asp::aligned_image_size(opt.out_prefix, true);
+        b.crop(BBox2i(0, 0, L_size.x(), L_size.y()));
       }
 
     }
@@ -269,6 +273,31 @@ namespace asp {
                << "multiview stereo.\n");
   }
 
+  // Read the settings resolved by parallel_stereo before it ran the
+  // tiles, so that each tile process need not find them again. Each
+  // line has an option name and its value. Options the user set
+  // explicitly take precedence. The datum, as WKT, has spaces, so it
+  // is the rest of its line.
+  void read_resolved_settings(std::string const& file, ASPGlobalOptions & opt) {
+    std::ifstream ifs(file.c_str());
+    if (!ifs.good())
+      vw_throw(ArgumentErr() << "Cannot read the resolved settings file: " << file << "\n");
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+      std::istringstream is(line);
+      std::string key, val;
+      if (!(is >> key >> val) || key[0] == '#')
+        continue;
+      if (key == "stereo-session" && opt.stereo_session.empty())
+        opt.stereo_session = val;
+      else if (key == "alignment-method")
+        stereo_settings().alignment_method = val;
+      else if (key == "datum-wkt")
+        stereo_settings().resolved_datum_wkt = line.substr(line.find(val, key.size()));
+    }
+  }
+
   // Parse input command line arguments
   void handle_arguments(int argc, char *argv[], ASPGlobalOptions& opt,
                         boost::program_options::options_description const&
@@ -455,9 +484,9 @@ namespace asp {
         stereo_settings().trans_crop_win = transformed_crop_win(opt);
 
       // Intersect with L.tif which is the transformed and processed left image.
-      if ( fs::exists(opt.out_prefix+"-L.tif") ){
-        DiskImageView<PixelGray<float> > L_img(opt.out_prefix+"-L.tif");
-        stereo_settings().trans_crop_win.crop(bounding_box(L_img));
+      if (asp::aligned_image_exists(opt.out_prefix, true)) {
+        Vector2i L_size = asp::aligned_image_size(opt.out_prefix, true);
+        stereo_settings().trans_crop_win.crop(BBox2i(0, 0, L_size.x(), L_size.y()));
       }
     }else{ 
       // If left_image_crop_win is specified, as can be see in
@@ -468,9 +497,9 @@ namespace asp {
       // we set it to the entire cropped image.
       if (stereo_settings().trans_crop_win == BBox2i(0, 0, 0, 0)) {
         stereo_settings().trans_crop_win = bounding_box(left_image);
-        if ( fs::exists(opt.out_prefix+"-L.tif") ){
-          DiskImageView<PixelGray<float> > L_img(opt.out_prefix+"-L.tif");
-          stereo_settings().trans_crop_win = bounding_box(L_img);
+        if (asp::aligned_image_exists(opt.out_prefix, true)) {
+          Vector2i L_size = asp::aligned_image_size(opt.out_prefix, true);
+          stereo_settings().trans_crop_win = BBox2i(0, 0, L_size.x(), L_size.y());
         }
       }
     } // End crop checking case
@@ -597,6 +626,11 @@ namespace asp {
 
     if (exit_early) 
       return;
+
+    // Skip guessing the session if it was found before
+    bool resolved = !stereo_settings().resolved_settings.empty();
+    if (resolved)
+      read_resolved_settings(stereo_settings().resolved_settings, opt);
     
     // The StereoSession call automatically determines the type of
     // object to create from the input parameters.
@@ -612,8 +646,9 @@ namespace asp {
     // The last thing we do before we get started is to copy the
     // stereo.default settings over into the results directory so that
     // we have a record of the most recent stereo.default that was used
-    // with this data set.
-    asp::stereo_settings().write_copy(argc, argv,
+    // with this data set. The tiles of parallel_stereo need not do it.
+    if (!resolved)
+      asp::stereo_settings().write_copy(argc, argv,
                                       opt.stereo_default_filename,
                                       opt.out_prefix + "-stereo.default");
   }
@@ -660,6 +695,15 @@ namespace asp {
       vw_throw(NoImplErr() << "Computation of low-resolution disparity from "
                 << "DEM is not implemented for map-projected images.\n");
 
+    // Only the default preprocessing can save the alignment in place of L.tif and R.tif
+    if (stereo_settings().skip_aligned_image_files &&
+        (stereo_settings().alignment_method == "epipolar" ||
+         stereo_settings().skip_image_normalization ||
+         opt.session->name() == "isis"))
+      vw_throw(ArgumentErr() << "The option --skip-aligned-image-files does not work "
+               << "with epipolar alignment, with --skip-image-normalization, "
+               << "or with the isis session.\n");
+
     // Must use map-projected images if input DEM is provided
     GeoReference georef1, georef2;
     bool has_georef1 = vw::cartography::read_georeference(georef1, opt.in_file1);
@@ -857,8 +901,9 @@ namespace asp {
                  << "adjustment can be only 1 or 2.\n");
     }
 
-    // Camera checks
-    if (!stereo_settings().correlator_mode) {
+    // Camera checks. Skip them if they were done for the whole run,
+    // as some cameras take a long time to load.
+    if (!stereo_settings().correlator_mode && stereo_settings().resolved_settings.empty()) {
       try {
         // TODO(oalexan1): Remove this extra camera load. Some camera
         // models take a long time to load and this causes us to load
@@ -923,6 +968,13 @@ namespace asp {
     
   } // End user_safety_checks
 
+  void set_intermediate_write_options(vw::GdalWriteOptions & opt) {
+    if (!stereo_settings().uncompressed_intermediates)
+      return;
+    opt.gdal_options["COMPRESS"] = "NONE";
+    opt.gdal_options.erase("PREDICTOR");
+  }
+
   // See if user's request to skip image normalization can be
   // satisfied.  This option is a speedup switch which is only meant
   // to work with with mapprojected images. It is also not documented.
@@ -91,6 +91,10 @@ namespace asp {
 
   bool skip_image_normalization(ASPGlobalOptions const& opt);
 
+  /// With --uncompressed-intermediates, write the disparities and the
+  /// point cloud without compression.
+  void set_intermediate_write_options(vw::GdalWriteOptions & opt);
+
   // Convert, for example, 'asp_mgm' to '2'. For ASP algorithms we
   // use the numbers 0 (BM), 1 (SGM), 2 (MGM), 3 (Final MGM).  For
   // external algorithms will have to examine closer the algorithm
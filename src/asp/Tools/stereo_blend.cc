@@ -39,6 +39,9 @@
 
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Tools/stereo.h>
+#include <asp/Core/StageTiming.h>
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/ImageAlignment.h>
 #include <boost/filesystem.hpp>
 
 using namespace vw;
@@ -196,8 +199,7 @@ void check_size(BBox2i const& bbox, std::string const& image_file) {
 void fill_blend_options(ASPGlobalOptions const& opt, std::string const& in_file,
                         BlendOptions & blend_opt) {
 
-  std::string left_image = opt.out_prefix + "-L.tif";
-  Vector2i full_image_size = file_image_size(left_image);
+  Vector2i full_image_size = asp::aligned_image_size(opt.out_prefix, true);
   blend_opt.full_box = BBox2i(0, 0, full_image_size.x(), full_image_size.y());
   blend_opt.pad_size = stereo_settings().sgm_collar_size;
   
@@ -386,7 +388,12 @@ ImageView<MaskedPixType> tile_blend(ASPGlobalOptions const& opt,
         return output_image;
       
     } else {
-      // A neighboring tile
+      // A neighboring tile. If its padded box does not reach the main
+      // tile, it contributes nothing, so do not read it from disk.
+      if (blend_opt.neib_path[i] == "" ||
+          !blend_opt.padded_neib[i].intersects(blend_opt.main_roi))
+        continue;
+      
       int curr_num_channels = 1;
       bool curr_has_nodata = false;
       float curr_nodata_value = -32768.0;
@@ -404,27 +411,26 @@ ImageView<MaskedPixType> tile_blend(ASPGlobalOptions const& opt,
       padded_box = blend_opt.padded_neib[i];
     }
 
+    // Padded tiles can overlap only partially with the central region of
+    // the main tile. Visit only the overlap, in full image coordinates.
+    BBox2i overlap = padded_box;
+    overlap.crop(blend_opt.main_roi);
+    overlap.crop(vw::bounding_box(image) + padded_box.min());
+    
     // Do the blending, either with the main or neighboring tiles
-    for (int col = 0; col < output_image.cols(); col++) {
-      for (int row = 0; row < output_image.rows(); row++) {
-
-        // Convert the given pixel to the coordinate system of the full image
-        Vector2 pix = Vector2(col, row) + blend_opt.main_roi.min();
+    for (int c = overlap.min().x(); c < overlap.max().x(); c++) {
+      for (int r = overlap.min().y(); r < overlap.max().y(); r++) {
 
-        // Convert the pixel to the coordinate system of the current padded tile
-        pix = pix - padded_box.min();
-
-        // Padded tiles can overlap only partially with the central region of the main
-        // tile. If not in the overlap region, skip the work.
-        if (!vw::bounding_box(image).contains(pix)) 
-          continue;
-
-        if (!is_valid(image(pix[0], pix[1])) || weights(pix[0], pix[1]) <= 0.0) 
+        // The pixel in the coordinate system of the current padded tile
+        int px = c - padded_box.min().x(), py = r - padded_box.min().y();
+        if (!is_valid(image(px, py)) || weights(px, py) <= 0.0) 
           continue; // No useful info
 
+        // The pixel in the coordinate system of the output tile
+        int col = c - blend_opt.main_roi.min().x(), row = r - blend_opt.main_roi.min().y();
         output_image(col, row).validate();
-        output_image(col, row)   += weights(pix[0], pix[1]) * image(pix[0], pix[1]);
-        output_weights(col, row) += weights(pix[0], pix[1]);
+        output_image(col, row)   += weights(px, py) * image(px, py);
+        output_weights(col, row) += weights(px, py);
       }
     }
   }
@@ -451,6 +457,7 @@ ImageView<MaskedPixType> tile_blend(ASPGlobalOptions const& opt,
 void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
                      std::string const& out_file) {
 
+  TimingSpan span("blending");
   BlendOptions blend_opt;
   fill_blend_options(opt, in_file, blend_opt);
 
@@ -459,8 +466,7 @@ void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
   // images are small enough to load entirely into memory.
 
   cartography::GeoReference left_georef;
-  std::string left_image = opt.out_prefix + "-L.tif";
-  bool   has_left_georef = read_georeference(left_georef, left_image);
+  bool   has_left_georef = asp::read_aligned_georef(opt.out_prefix, true, left_georef);
   int num_channels       = 1;
   bool has_nodata        = false;
   float nodata           = -32768.0;
@@ -482,7 +488,10 @@ void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
     vw::cartography::block_write_gdal_image(full_out_file, blended_disp,
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Blending :"));
+                                            asp::MetricsProgressCallback
+                                            ("blending",
+                                             double(blended_disp.cols()) * blended_disp.rows(),
+                                             "\t--> Blending :"));
   } else if (num_channels == 1) {
     // Write a single-channel image with no-data
     ImageView<float> image(blended_disp.cols(), blended_disp.rows());
@@ -497,7 +506,9 @@ void stereo_blending(ASPGlobalOptions const& opt, std::string const& in_file,
     vw::cartography::block_write_gdal_image(full_out_file, image,
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Blending:"));
+                                            asp::MetricsProgressCallback
+                                            ("blending", double(image.cols()) * image.rows(),
+                                             "\t--> Blending:"));
   }
 }
 
@@ -525,6 +536,7 @@ int main(int argc, char* argv[]) {
     //  renames the normal -D.tif file to -Dnosym.tif.
     std::string in_file =  "Dnosym.tif";
 
+    stage_timing().set_stage("blend");
     string out_file = "B.tif";
     if (stereo_settings().subpixel_mode > 6){
       // No further subpixel refinement, skip to the -RD output.
@@ -538,6 +550,9 @@ int main(int argc, char* argv[]) {
       out_file = "L-R-disp-diff-blend.tif";
       stereo_blending(opt, in_file, out_file);
     }
+
+    if (stereo_settings().save_timing_log)
+      stage_timing().write(opt.out_prefix);
     
     vw_out() << "\n[ " << current_posix_time_string() << " ] : BLENDING FINISHED\n";
 
@@ -26,10 +26,17 @@
 #include <vw/Stereo/Correlation.h>
 
 #include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/DisparityEncoding.h>
 #include <asp/Core/DemDisparity.h>
+#include <asp/Core/SparseDisparity.h>
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/IpMatchingAlgs.h>         // Lightweight header
+#include <asp/Core/ImageAlignment.h>
 #include <asp/Core/LocalAlignment.h>
+#include <asp/Core/StageTiming.h>
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/PrefetchView.h>
+#include <asp/Core/StereoPlugin.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Tools/stereo.h>
 
@@ -91,9 +98,18 @@ void read_search_range_from_D_sub(std::string const& d_sub_file, ASPGlobalOption
   vw_out() << "\t--> Full-res search range based on D_sub: " << search_range << "\n";
 }
 
+/// Whether D_sub for seed mode 3 is made by the external sparse_disp
+/// tool. That is the case only when options for it were passed in.
+bool use_sparse_disp_tool() {
+  return stereo_settings().seed_mode == 3 &&
+    !stereo_settings().sparse_disp_options.empty();
+}
+
 /// Produces the low-resolution disparity file D_sub
 void produce_lowres_disparity(ASPGlobalOptions & opt) {
 
+  TimingSpan span("D_sub");
+
   // Set up handles to read the input images
   DiskImageView<vw::uint8> Lmask(opt.out_prefix + "-lMask.tif"),
     Rmask(opt.out_prefix + "-rMask.tif");
@@ -118,9 +134,9 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
   std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
   std::string spread_file = opt.out_prefix + "-D_sub_spread.tif";
 
-  if (stereo_settings().seed_mode != 3 && fs::exists(spread_file)) {
-    // We will recreate D_sub below unless seed_mode is 3, when the work
-    // happens in sparse_disp outside this logic. We may or may not recreate
+  if (!use_sparse_disp_tool() && fs::exists(spread_file)) {
+    // We will recreate D_sub below unless the work happens in the
+    // sparse_disp tool outside this logic. We may or may not recreate
     // D_sub_spread, but in either case wipe the existing one or else
     // it may be a leftover from a previous run with different image
     // sizes, and in that case it will be inconsistent with D_sub
@@ -165,9 +181,12 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
       blob_filter_area = 0;
     }
 
-    // Process the entire D_sub in memory as it is small enough
-    int collar_size = 0; // Since there won't be tiles as the all the processing is done at once
-    ImageView<PixelMask<Vector2f>> d_sub =
+    // D_sub is small enough to be kept in memory. With block matching
+    // it is computed in tiles in parallel. Each tile still does
+    // coarse-to-fine correlation, narrowing the search range at each
+    // level. SGM and MGM are done at once, as they need the whole image.
+    int collar_size = 0; // Block matching tiles need no collar
+    ImageViewRef<PixelMask<Vector2f>> d_sub_view =
       vw::stereo::pyramid_correlate
       (// Compute image correlation using the PyramidCorrelationView class
        left_sub, right_sub, left_mask_sub, right_mask_sub,
@@ -178,6 +197,15 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
        collar_size, sgm_subpixel_mode, sgm_search_buffer, stereo_settings().corr_memory_limit_mb,
        blob_filter_area, lr_disp_diff, region_ul, stereo_settings().stereo_debug);
 
+    ImageView<PixelMask<Vector2f>> d_sub;
+    if (stereo_alg == vw::stereo::VW_CORRELATION_BM) {
+      const int lowres_tile_size = 512; // Leave enough room for the pyramid levels
+      d_sub = block_rasterize(d_sub_view, Vector2i(lowres_tile_size, lowres_tile_size),
+                              vw_settings().default_num_threads());
+    } else {
+      d_sub = d_sub_view;
+    }
+
     if (stereo_settings().rm_quantile_multiple <= 0.0) {
       // Filter D_sub using thresholds (the default)
       d_sub = rm_outliers_using_thresh
@@ -243,7 +271,17 @@ void produce_lowres_disparity(ASPGlobalOptions & opt) {
     produce_dem_disparity(opt, left_camera_model, right_camera_model, opt.session->name());
     
   }else if (stereo_settings().seed_mode == 3) {
-    // D_sub is already generated by now by sparse_disp
+
+    if (!use_sparse_disp_tool()) {
+      // Sparse template matching, in-process. Pad the search range as
+      // for seed mode 1.
+      Vector2 expansion(search_range.width(), search_range.height());
+      expansion *= stereo_settings().seed_percent_pad / 2.0f;
+      search_range.min() -= expansion;
+      search_range.max() += expansion;
+      asp::produce_sparse_disparity(opt, search_range);
+    }
+    // Otherwise D_sub is already generated by now by sparse_disp
   }
 
   // Read this to print some text while still in low-res disparity
@@ -271,6 +309,8 @@ void load_or_compute_ip(std::string const & left_unalgined_image,
                         boost::shared_ptr<asp::StereoSession> session,
                         // Output
                         std::string & match_filename) {
+
+  TimingSpan span("ip detection");
   
   const std::string left_aligned_image_file  = out_prefix + "-L.tif";
   const std::string right_aligned_image_file = out_prefix + "-R.tif";
@@ -322,23 +362,17 @@ void load_or_compute_ip(std::string const & left_unalgined_image,
 
   vw_out() << "No IP file found, computing IP now.\n";
   
-  // Load the images
-  boost::shared_ptr<DiskImageResource> left_rsrc (DiskImageResourcePtr(left_aligned_image_file)),
-    right_rsrc(DiskImageResourcePtr(right_aligned_image_file));
-
   std::string left_ip_filename  = ip::ip_filename(out_prefix, left_aligned_image_file);
   std::string right_ip_filename = ip::ip_filename(out_prefix, right_aligned_image_file);
 
-  // Read the no-data values written to disk previously when
-  // the normalized left and right sub-images were created.
-  float left_nodata_value  = std::numeric_limits<float>::quiet_NaN();
-  float right_nodata_value = std::numeric_limits<float>::quiet_NaN();
-  if (left_rsrc->has_nodata_read ()) left_nodata_value  = left_rsrc->nodata_read ();
-  if (right_rsrc->has_nodata_read()) right_nodata_value = right_rsrc->nodata_read();
-  
-  // These images can be big, so use ImageViewRef
-  ImageViewRef<float> left_image  = DiskImageView<float>(left_rsrc);
-  ImageViewRef<float> right_image = DiskImageView<float>(right_rsrc);
+  // Load the images, and the no-data values written to disk
+  // previously when the normalized left and right images were
+  // created. These images can be big, so use ImageViewRef.
+  float left_nodata_value = 0.0, right_nodata_value = 0.0;
+  ImageViewRef<float> left_image
+    = asp::read_aligned_image(out_prefix, true,  left_nodata_value);
+  ImageViewRef<float> right_image
+    = asp::read_aligned_image(out_prefix, false, right_nodata_value);
 
   // No interest point operations have been performed before
   vw_out() << "\t    * Detecting interest points.\n";
@@ -440,7 +474,8 @@ BBox2 approximate_search_range(ASPGlobalOptions & opt, std::string const& match_
     bool use_sphere_for_non_earth = true;
     cartography::Datum datum = opt.session->get_datum(left_camera_model.get(),
                                                       use_sphere_for_non_earth);
-    asp::filter_ip_by_lonlat_and_elevation(opt.session->tx_left(), opt.session->tx_right(),
+    asp::filter_ip_by_lonlat_and_elevation(!opt.session->has_thread_safe_cameras(),
+                                           opt.session->tx_left(), opt.session->tx_right(),
                                            left_camera_model.get(),
                                            right_camera_model.get(),
                                            datum, in_left_ip, in_right_ip,
@@ -465,7 +500,8 @@ BBox2 approximate_search_range(ASPGlobalOptions & opt, std::string const& match_
   if (stereo_settings().ip_filter_using_dem != "" &&
       !stereo_settings().correlator_mode          &&
       opt.session->have_datum()) {
-    ip_filter_using_dem(stereo_settings().ip_filter_using_dem,  
+    ip_filter_using_dem(!opt.session->has_thread_safe_cameras(),
+                        stereo_settings().ip_filter_using_dem,  
                         opt.session->tx_left(), opt.session->tx_right(),  
                         left_camera_model, right_camera_model,  
                         matched_left_ip,  matched_right_ip);
@@ -593,6 +629,8 @@ BBox2 approximate_search_range(ASPGlobalOptions & opt, std::string const& match_
 /// The first step of correlation computation.
 void lowres_correlation(ASPGlobalOptions & opt) {
 
+  TimingSpan span("low-res correlation");
+
   vw_out() << "\n[ " << current_posix_time_string()
            << " ] : Stage 1 --> LOW-RESOLUTION CORRELATION\n";
 
@@ -610,7 +648,7 @@ void lowres_correlation(ASPGlobalOptions & opt) {
 
   }else if (stereo_settings().seed_mode == 2){
     // Do nothing as we will compute the search range based on D_sub
-  }else if (stereo_settings().seed_mode == 3){
+  }else if (use_sparse_disp_tool()){
     // Do nothing as low-res disparity (D_sub) is already provided by sparse_disp
   } else { // Regular seed mode
 
@@ -675,7 +713,7 @@ void lowres_correlation(ASPGlobalOptions & opt) {
     }
 
     if (rebuild) {
-      // It will be rebuilt except for seed-mode 3 when sparse_disp takes care of it.
+      // It will be rebuilt unless the sparse_disp tool takes care of it.
       produce_lowres_disparity(opt);
     } else {
       vw_out() << "\t--> Using cached low-resolution disparity: " << sub_disp_file << "\n";
@@ -686,6 +724,76 @@ void lowres_correlation(ASPGlobalOptions & opt) {
            << " ] : LOW-RESOLUTION CORRELATION FINISHED\n";
 } // End lowres_correlation
 
+/// Find the full-resolution search range for a region of L.tif. With a
+/// seed mode, this is based on the portion of D_sub (and D_sub_spread,
+/// if provided) corresponding to this region. The upscale factor
+/// converts from D_sub pixels to full-resolution pixels.
+BBox2 calc_local_search_range(BBox2i const& bbox, Vector2 const& upscale_factor,
+                              ImageViewRef<PixelMask<Vector2f>> const& sub_disp,
+                              ImageViewRef<PixelMask<Vector2i>> const& sub_disp_spread) {
+
+  BBox2 local_search_range;
+  if (stereo_settings().seed_mode == 0) {
+    local_search_range = stereo_settings().search_range;
+    VW_OUT(DebugMessage,"stereo") << "Searching with " << stereo_settings().search_range << "\n";
+    return local_search_range;
+  }
+
+  // The low-res version of bbox
+  BBox2i seed_bbox(elem_quot(bbox.min(), upscale_factor),
+                   elem_quot(bbox.max(), upscale_factor));
+  seed_bbox.expand(1);
+  seed_bbox.crop(bounding_box(sub_disp));
+  // Get the disparity range in d_sub corresponding to this tile.
+  VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
+  ImageViewRef<PixelMask<Vector2f>> disparity_in_box = crop(sub_disp, seed_bbox);
+
+  local_search_range = stereo::get_disparity_range(disparity_in_box);
+
+  bool has_sub_disp_spread = (sub_disp_spread.cols() != 0 &&
+                              sub_disp_spread.rows() != 0);
+  // Sanity check: If sub_disp_spread was provided, it better have the same size as sub_disp.
+  if (has_sub_disp_spread &&
+      sub_disp_spread.cols() != sub_disp.cols() &&
+      sub_disp_spread.rows() != sub_disp.rows()){
+    vw_throw(ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+  }
+
+  if (has_sub_disp_spread){
+    // Expand the disparity range by sub_disp_spread.
+    ImageViewRef<PixelMask<Vector2i>> spread_in_box = crop(sub_disp_spread, seed_bbox);
+
+    BBox2 spread = stereo::get_disparity_range(spread_in_box);
+    local_search_range.min() -= spread.max();
+    local_search_range.max() += spread.max();
+  } //endif has_sub_disp_spread
+
+  local_search_range = grow_bbox_to_int(local_search_range);
+  // Expand local_search_range by 1. This is necessary since
+  // sub_disp is integer-valued, and perhaps the search
+  // range was supposed to be a fraction of integer bigger.
+  local_search_range.expand(1);
+
+  // Scale the search range to full-resolution
+  local_search_range.min() = floor(elem_prod(local_search_range.min(), upscale_factor));
+  local_search_range.max() = ceil (elem_prod(local_search_range.max(), upscale_factor));
+
+  // If the user specified a search range limit, apply it here.
+  if ((stereo_settings().corr_search_limit.min() != Vector2i()) || 
+      (stereo_settings().corr_search_limit.max() != Vector2i())) {     
+    local_search_range.crop(stereo_settings().corr_search_limit);
+    vw_out() << "\t--> Local search range constrained to: "
+             << local_search_range << "\n";
+  }
+
+  VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
+                                 << bbox << ") local search range "
+                                 << local_search_range << " vs "
+                                 << stereo_settings().search_range << "\n";
+
+  return local_search_range;
+}
+
 /// This correlator takes a low resolution disparity image as an input
 /// so that it may narrow its search range for each tile that is processed.
 class SeededCorrelatorView: public ImageViewBase<SeededCorrelatorView> {
@@ -699,12 +807,12 @@ class SeededCorrelatorView: public ImageViewBase<SeededCorrelatorView> {
 
   // Settings
   Vector2  m_upscale_factor;
-  BBox2i   m_seed_bbox;
   Vector2i m_kernel_size;
   stereo::CostFunctionType m_cost_mode;
   int      m_corr_timeout;
   double   m_seconds_per_op;
   Vector2  m_region_ul; // the upper-left corner of the region containing all pixels to process
+  int      m_collar_size; // the padding for each block with SGM/MGM
 public:
 
   // Set these input types here instead of making them template arguments
@@ -724,16 +832,17 @@ public:
                        stereo::CostFunctionType cost_mode,
                        int corr_timeout, double seconds_per_op,
                        Vector2i const& region_ul,
-                       ImageView<PixelMask<float>> * lr_disp_diff):
+                       ImageView<PixelMask<float>> * lr_disp_diff,
+                       int collar_size):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_left_mask (left_mask.impl ()), m_right_mask (right_mask.impl ()),
     m_sub_disp(sub_disp.impl()), m_sub_disp_spread(sub_disp_spread.impl()),
     m_kernel_size(kernel_size),  m_cost_mode(cost_mode),
     m_corr_timeout(corr_timeout), m_seconds_per_op(seconds_per_op),
-    m_region_ul(region_ul), m_lr_disp_diff(lr_disp_diff) {
+    m_region_ul(region_ul), m_lr_disp_diff(lr_disp_diff),
+    m_collar_size(collar_size) {
     m_upscale_factor[0] = double(m_left_image.cols()) / m_sub_disp.cols();
     m_upscale_factor[1] = double(m_left_image.rows()) / m_sub_disp.rows();
-    m_seed_bbox = bounding_box(m_sub_disp);
   }
 
   // Image View interface
@@ -760,65 +869,8 @@ public:
       = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
     
     // User strategies
-    BBox2 local_search_range;
-    if (stereo_settings().seed_mode > 0) {
-
-      // The low-res version of bbox
-      BBox2i seed_bbox(elem_quot(bbox.min(), m_upscale_factor),
-                       elem_quot(bbox.max(), m_upscale_factor));
-      seed_bbox.expand(1);
-      seed_bbox.crop(m_seed_bbox);
-      // Get the disparity range in d_sub corresponding to this tile.
-      VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
-      DispSeedImageType disparity_in_box = crop(m_sub_disp, seed_bbox);
-
-      local_search_range = stereo::get_disparity_range(disparity_in_box);
-
-      bool has_sub_disp_spread = (m_sub_disp_spread.cols() != 0 &&
-                                  m_sub_disp_spread.rows() != 0);
-      // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
-      if (has_sub_disp_spread &&
-          m_sub_disp_spread.cols() != m_sub_disp.cols() &&
-          m_sub_disp_spread.rows() != m_sub_disp.rows()){
-        vw_throw(ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
-      }
-
-      if (has_sub_disp_spread){
-        // Expand the disparity range by m_sub_disp_spread.
-        SpreadImageType spread_in_box = crop(m_sub_disp_spread, seed_bbox);
-
-        BBox2 spread = stereo::get_disparity_range(spread_in_box);
-        local_search_range.min() -= spread.max();
-        local_search_range.max() += spread.max();
-      } //endif has_sub_disp_spread
-
-      local_search_range = grow_bbox_to_int(local_search_range);
-      // Expand local_search_range by 1. This is necessary since
-      // m_sub_disp is integer-valued, and perhaps the search
-      // range was supposed to be a fraction of integer bigger.
-      local_search_range.expand(1);
-
-      // Scale the search range to full-resolution
-      local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
-      local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
-
-      // If the user specified a search range limit, apply it here.
-      if ((stereo_settings().corr_search_limit.min() != Vector2i()) || 
-          (stereo_settings().corr_search_limit.max() != Vector2i())) {     
-        local_search_range.crop(stereo_settings().corr_search_limit);
-        vw_out() << "\t--> Local search range constrained to: "
-                 << local_search_range << "\n";
-      }
-
-      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
-                                     << bbox << ") local search range "
-                                     << local_search_range << " vs "
-                                     << stereo_settings().search_range << "\n";
-
-    } else{ // seed mode == 0
-      local_search_range = stereo_settings().search_range;
-      VW_OUT(DebugMessage,"stereo") << "Searching with " << stereo_settings().search_range << "\n";
-    }
+    BBox2 local_search_range = calc_local_search_range(bbox, m_upscale_factor,
+                                                       m_sub_disp, m_sub_disp_spread);
 
     SemiGlobalMatcher::SgmSubpixelMode sgm_subpixel_mode = get_sgm_subpixel_mode();
     Vector2i sgm_search_buffer = stereo_settings().sgm_search_buffer;
@@ -840,7 +892,7 @@ public:
                                   rm_half_kernel,
                                   stereo_settings().corr_max_levels,
                                   stereo_alg,
-                                  stereo_settings().sgm_collar_size,
+                                  m_collar_size,
                                   sgm_subpixel_mode, sgm_search_buffer,
                                   stereo_settings().corr_memory_limit_mb,
                                   stereo_settings().corr_blob_filter_area,
@@ -850,6 +902,7 @@ public:
     // Crop the disparity to given box, bringing all the computation in the box
     // in memory. 
     ImageView<pixel_type> cropped_disp = crop(disparity_map, bbox);
+    asp::process_metrics().add_tiles("correlation", 1);
 
     // Place the result in the appropriate place in the virtual image
     return CropView<ImageView<result_type>>(cropped_disp,
@@ -864,6 +917,101 @@ public:
 }; // End class SeededCorrelatorView
 
 
+/// The inputs to full-resolution 2D correlation. These are loaded once
+/// and can be reused for many tiles, such as with --corr-worker-mode.
+struct Corr2DInputs {
+  ImageViewRef<PixelGray<float>>     left_image, right_image;
+  ImageViewRef<vw::uint8>            left_mask, right_mask;
+  ImageViewRef<PixelMask<Vector2f>>  sub_disp;
+  ImageViewRef<PixelMask<Vector2i>>  sub_disp_spread;
+  bool                               has_left_georef;
+  cartography::GeoReference          left_georef;
+  Corr2DInputs(): has_left_georef(false) {}
+};
+
+/// Find the size of the blocks into which to subdivide a region of L.tif to
+/// correlate with SGM/MGM, so that the estimated memory use per block
+/// fits within --sgm-memory-budget-mb. If the region already fits,
+/// return the size of the region. The memory is estimated as the block
+/// area, with the collar, times the area of its search range from D_sub,
+/// times the bytes per cost value. This is an upper bound, as SGM
+/// narrows down the search range per pixel at full resolution. The
+/// collar size is increased, if needed, so that the blocks blend well.
+int sgm_block_size_for_budget(BBox2i const& crop_win, Corr2DInputs const& inputs,
+                              int & collar_size) {
+
+  // Rough number of bytes per pixel per disparity used by SGM/MGM,
+  // for the costs and the accumulation buffers.
+  const double SGM_BYTES_PER_DISP = 4.0;
+  const int MIN_BLOCK_SIZE  = 256;
+  const int MIN_COLLAR_SIZE = 128;
+  const int TILE_MULTIPLE   = 16; // like in main()
+  double budget_mb = stereo_settings().sgm_memory_budget_mb;
+
+  int full_size = std::max(crop_win.width(), crop_win.height());
+  Vector2 upscale_factor(0, 0);
+  if (stereo_settings().seed_mode > 0)
+    upscale_factor = Vector2(double(inputs.left_image.cols()) / inputs.sub_disp.cols(),
+                             double(inputs.left_image.rows()) / inputs.sub_disp.rows());
+  
+  int block_size = full_size;
+  while (1) {
+
+    // The collar is only needed if subdividing
+    int collar = collar_size;
+    if (block_size < full_size)
+      collar = std::max(collar_size, MIN_COLLAR_SIZE);
+
+    // Find the largest memory use among the blocks
+    double max_mb = 0.0;
+    std::vector<BBox2i> blocks = subdivide_bbox(crop_win, block_size, block_size);
+    for (size_t it = 0; it < blocks.size(); it++) {
+      BBox2i const& block = blocks[it];
+      BBox2 search_range = calc_local_search_range(block, upscale_factor,
+                                                   inputs.sub_disp, inputs.sub_disp_spread);
+      double num_pix  = double(block.width() + 2*collar) * double(block.height() + 2*collar);
+      double num_disp = (search_range.width() + 1.0) * (search_range.height() + 1.0);
+      max_mb = std::max(max_mb, num_pix * num_disp * SGM_BYTES_PER_DISP / (1024.0 * 1024.0));
+    }
+
+    if (max_mb <= budget_mb || block_size <= MIN_BLOCK_SIZE) {
+      if (block_size < full_size) {
+        collar_size = collar;
+        vw_out() << "\t--> Subdividing the region to correlate into blocks of size "
+                 << block_size << " with a collar of " << collar_size << " pixels, "
+                 << "with estimated memory use per block of " << max_mb << " MB.\n";
+      }
+      break;
+    }
+    
+    // Halve the block size, keeping it a multiple of TILE_MULTIPLE
+    block_size = std::max(MIN_BLOCK_SIZE, TILE_MULTIPLE * ((block_size/2 + TILE_MULTIPLE - 1)
+                                                            / TILE_MULTIPLE));
+  }
+  
+  return block_size;
+}
+
+void load_corr_2d_inputs(ASPGlobalOptions const& opt, Corr2DInputs & inputs);
+void correlate_tile_2D(ASPGlobalOptions & opt, Corr2DInputs const& inputs,
+                       BBox2i const& left_trans_crop_win);
+
+/// Find the full-resolution search range and the inputs needed for 2D correlation.
+/// This does not depend on the tile being processed.
+void prepare_fullres_correlation_2D(ASPGlobalOptions& opt) {
+  
+  std::string d_sub_file  = opt.out_prefix + "-D_sub.tif";
+  read_search_range_from_D_sub(d_sub_file, opt);
+
+  // If the user specified a search range limit, apply it here.
+  if ((stereo_settings().corr_search_limit.min() != Vector2i()) || 
+      (stereo_settings().corr_search_limit.max() != Vector2i())) {     
+    stereo_settings().search_range.crop(stereo_settings().corr_search_limit);
+    vw_out() << "\t--> Detected search range constrained to: "
+             << stereo_settings().search_range << "\n";
+  }
+}
+
 /// Stereo correlation function using ASP's block-matching and MGM/SGM
 /// algorithms which can handle a 2D disparity.
 void stereo_correlation_2D(ASPGlobalOptions& opt) {
@@ -879,60 +1027,68 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
   if (stereo_settings().compute_low_res_disparity_only) 
     return; // Just computed the low-res disparity, so quit.
 
-  std::string d_sub_file  = opt.out_prefix + "-D_sub.tif";
-  std::string spread_file = opt.out_prefix + "-D_sub_spread.tif";
+  prepare_fullres_correlation_2D(opt);
 
-  read_search_range_from_D_sub(d_sub_file, opt);
+  // Load up for the actual native resolution processing
+  Corr2DInputs inputs;
+  load_corr_2d_inputs(opt, inputs);
 
-  // If the user specified a search range limit, apply it here.
-  if ((stereo_settings().corr_search_limit.min() != Vector2i()) || 
-      (stereo_settings().corr_search_limit.max() != Vector2i())) {     
-    stereo_settings().search_range.crop(stereo_settings().corr_search_limit);
-    vw_out() << "\t--> Detected search range constrained to: "
-             << stereo_settings().search_range << "\n";
-  }
+  correlate_tile_2D(opt, inputs, stereo_settings().trans_crop_win);
+} // End function stereo_correlation_2D
 
-  // Load up for the actual native resolution processing
+/// Load the images, masks, and low-resolution disparity needed for
+/// full-resolution 2D correlation.
+void load_corr_2d_inputs(ASPGlobalOptions const& opt, Corr2DInputs & inputs) {
 
-  std::string left_image_file = opt.out_prefix + "-L.tif";
-  std::string right_image_file = opt.out_prefix + "-R.tif";
+  TimingSpan span("image load");
   
-  boost::shared_ptr<DiskImageResource>
-    left_rsrc (vw::DiskImageResourcePtr(left_image_file)),
-    right_rsrc(vw::DiskImageResourcePtr(right_image_file));
-
-  // Load the normalized images.
-  DiskImageView<PixelGray<float>> left_disk_image(left_rsrc), right_disk_image(right_rsrc);
+  std::string d_sub_file       = opt.out_prefix + "-D_sub.tif";
+  std::string spread_file      = opt.out_prefix + "-D_sub_spread.tif";
   
-  DiskImageView<vw::uint8> Lmask(opt.out_prefix + "-lMask.tif"),
-    Rmask(opt.out_prefix + "-rMask.tif");
-  ImageViewRef<PixelMask<Vector2f> > sub_disp;
+  // Load the normalized images. Without L.tif and R.tif, each tile
+  // is resampled from the input images as it is needed.
+  inputs.left_image
+    = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, true));
+  inputs.right_image
+    = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, false));
+  
+  inputs.left_mask  = DiskImageView<vw::uint8>(opt.out_prefix + "-lMask.tif");
+  inputs.right_mask = DiskImageView<vw::uint8>(opt.out_prefix + "-rMask.tif");
   
   if (stereo_settings().seed_mode > 0) {
-    if (!load_D_sub(d_sub_file, sub_disp)) {
+    if (!load_D_sub(d_sub_file, inputs.sub_disp)) {
       std::string msg = "Could not read " + d_sub_file + ".";
       if (stereo_settings().skip_low_res_disparity_comp)
         msg += " Perhaps one should disable --skip-low-res-disparity-comp.";
       vw_throw(ArgumentErr() << msg << "\n");
     }
   }
-  ImageViewRef<PixelMask<Vector2i> > sub_disp_spread;
+  
   if (stereo_settings().seed_mode == 2 ||  stereo_settings().seed_mode == 3){
     // D_sub_spread is mandatory for seed_mode 2 and 3.
-    sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
+    inputs.sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
   }else if (stereo_settings().seed_mode == 1){
     // D_sub_spread is optional for seed_mode 1, we use it only if it is provided.
     if (fs::exists(spread_file)) {
       try {
-        sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
+        inputs.sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
       }
       catch (...) {}
     }
   }
 
+  inputs.has_left_georef = asp::read_aligned_georef(opt.out_prefix, true, inputs.left_georef);
+}
+
+/// Correlate the given region of L.tif and write the disparity for it.
+void correlate_tile_2D(ASPGlobalOptions & opt, Corr2DInputs const& inputs,
+                       BBox2i const& left_trans_crop_win) {
+
+  // This includes writing the disparity, as that is when it is computed
+  TimingSpan span("correlation");
+  
   stereo::CostFunctionType cost_mode = get_cost_mode_value();
   Vector2i kernel_size = stereo_settings().corr_kernel;
-  BBox2i left_trans_crop_win = stereo_settings().trans_crop_win;
   int corr_timeout   = stereo_settings().corr_timeout;
   double seconds_per_op = 0.0;
   if (corr_timeout > 0)
@@ -959,24 +1115,47 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
     lr_disp_diff_ptr = &lr_disp_diff;
   }
 
+  vw::stereo::CorrelationAlgorithm stereo_alg
+    = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
+  bool using_sgm = (stereo_alg > vw::stereo::VW_CORRELATION_BM &&
+                    stereo_alg < vw::stereo::VW_CORRELATION_OTHER);
+  
+  // With SGM, usually the entire image chunk is done as one tile, as
+  // otherwise there will be artifacts at tile boundaries. If a memory
+  // budget is set, and the chunk would not fit in it, subdivide it
+  // into blocks, each with a collar and its own search range.
+  int collar_size = stereo_settings().sgm_collar_size;
+  int sgm_block_size = std::max(left_trans_crop_win.width(), left_trans_crop_win.height());
+  if (using_sgm && stereo_settings().sgm_memory_budget_mb > 0)
+    sgm_block_size = sgm_block_size_for_budget(left_trans_crop_win, inputs, collar_size);
+  bool subdivide_sgm = (using_sgm && sgm_block_size <
+                        std::max(left_trans_crop_win.width(), left_trans_crop_win.height()));
+
+  // Read the images ahead of the tiles being correlated. With SGM
+  // the chunk is usually one tile, so there is nothing to read ahead.
+  ImageViewRef<PixelGray<float>> left_image = inputs.left_image;
+  ImageViewRef<PixelGray<float>> right_image = inputs.right_image;
+  if (!using_sgm && stereo_settings().prefetch_tiles > 0) {
+    int num_threads = vw_settings().default_num_threads();
+    left_image = asp::prefetch_view(inputs.left_image, opt.raster_tile_size,
+                                    left_trans_crop_win,
+                                    stereo_settings().prefetch_tiles, num_threads);
+    right_image = asp::prefetch_view(inputs.right_image, opt.raster_tile_size,
+                                     left_trans_crop_win,
+                                     stereo_settings().prefetch_tiles, num_threads);
+  }
+
   // Set up the reference to the stereo disparity code
   // - Processing is limited to left_trans_crop_win for use with parallel_stereo.
   ImageViewRef<PixelMask<Vector2f>> fullres_disparity =
-    crop(SeededCorrelatorView(left_disk_image, right_disk_image, Lmask, Rmask,
-                              sub_disp, sub_disp_spread, kernel_size, 
+    crop(SeededCorrelatorView(left_image, right_image,
+                              inputs.left_mask, inputs.right_mask,
+                              inputs.sub_disp, inputs.sub_disp_spread, kernel_size, 
                               cost_mode, corr_timeout, seconds_per_op,
-                              region_ul, lr_disp_diff_ptr), 
+                              region_ul, lr_disp_diff_ptr, collar_size), 
          left_trans_crop_win);
 
-  // With SGM, we must do the entire image chunk as one
-  // tile. Otherwise, if it gets done in smaller tiles, there will be
-  // artifacts at tile boundaries.
-  vw::stereo::CorrelationAlgorithm stereo_alg
-    = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
-  
-  bool using_sgm = (stereo_alg > vw::stereo::VW_CORRELATION_BM &&
-                    stereo_alg < vw::stereo::VW_CORRELATION_OTHER);
-  if (using_sgm) {
+  if (using_sgm && !subdivide_sgm) {
     Vector2i image_size = bounding_box(fullres_disparity).size();
     int max_dim = std::max(image_size[0], image_size[1]);
     if (stereo_settings().corr_tile_size_ovr < max_dim)
@@ -1007,8 +1186,8 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
     vw_out() << "\t--------------------------------------------------\n";
   }
   
-  cartography::GeoReference left_georef;
-  bool   has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+  cartography::GeoReference left_georef = inputs.left_georef;
+  bool   has_left_georef = inputs.has_left_georef;
   bool   has_nodata      = false;
   double nodata          = -32768.0;
 
@@ -1022,21 +1201,45 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
     // Rasterize the image first as one block, then write it out using multiple small blocks.
     // - If we don't do this, the output image file is not tiled and handles very slowly.
     // - This is possible because with SGM the image must be small enough to fit in memory.
-    ImageView<PixelMask<Vector2f>> result = fullres_disparity;
+    ImageView<PixelMask<Vector2f>> result;
+    if (subdivide_sgm) 
+      result = block_rasterize(fullres_disparity, Vector2i(sgm_block_size, sgm_block_size),
+                               vw_settings().default_num_threads());
+    else
+      result = fullres_disparity;
     opt.raster_tile_size = Vector2i(ASPGlobalOptions::rfne_tile_size(), // small block size
                                     ASPGlobalOptions::rfne_tile_size());
     vw::cartography::block_write_gdal_image(d_file, result,
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Correlation :"));
-
+                                            asp::MetricsProgressCallback
+                                            ("correlation", double(result.cols()) * result.rows(),
+                                             "\t--> Correlation :"));
+
+  } else if (asp::use_compact_disparity()) {
+    // Save the difference from the upsampled D_sub as 16-bit integers
+    Vector2 seed_scale(double(inputs.left_image.cols()) / inputs.sub_disp.cols(),
+                       double(inputs.left_image.rows()) / inputs.sub_disp.rows());
+    asp::block_write_compact_disparity(d_file, fullres_disparity,
+                                       left_trans_crop_win.min(),
+                                       ImageView<PixelMask<Vector2f>>(inputs.sub_disp),
+                                       seed_scale, asp::D_DISP_QUANTUM,
+                                       has_left_georef, left_georef, opt,
+                                       asp::MetricsProgressCallback
+                                       ("correlation",
+                                        double(fullres_disparity.cols()) * fullres_disparity.rows(),
+                                        "\t--> Correlation :"));
   } else {
     // Otherwise cast back to integer results to save on storage space.
     vw::cartography::block_write_gdal_image(d_file, 
                                             pixel_cast<PixelMask<Vector2i>>(fullres_disparity),
                                             has_left_georef, left_georef,
                                             has_nodata, nodata, opt,
-                                            TerminalProgressCallback("asp", "\t--> Correlation :"));
+                                            asp::MetricsProgressCallback
+                                            ("correlation",
+                                             double(fullres_disparity.cols()) *
+                                             fullres_disparity.rows(),
+                                             "\t--> Correlation :"));
   }
 
   if (stereo_settings().save_lr_disp_diff) {
@@ -1055,7 +1258,7 @@ void stereo_correlation_2D(ASPGlobalOptions& opt) {
   }
 
   return;
-} // End function stereo_correlation_2D
+} // End function correlate_tile_2D
 
 // A small function we will invoke repeatedly to save the disparity
 void save_disparity(ASPGlobalOptions& opt,
@@ -1104,6 +1307,8 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
   // which is incompatible with local alignment and stereo for pairs of tiles.
   if (stereo_settings().compute_low_res_disparity_only) 
     return;
+
+  TimingSpan span("correlation");
   
   // The dimensions of the tile and the final disparity
   BBox2i tile_crop_win = stereo_settings().trans_crop_win;
@@ -1160,6 +1365,7 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
     //  right_extra_factor = 2.0;
     // }
     try {
+      TimingSpan span("local alignment");
       local_alignment(// Inputs
                       opt, alg_name, opt.session->name(),
                       max_tile_size, left_extra_factor, right_extra_factor,
@@ -1435,77 +1641,95 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
       std::string plugin_path = it1->second;
       std::string plugin_lib = it2->second;
 
-      // Set up the environemnt
-      bp::environment e = boost::this_process::environment();
-      e["LD_LIBRARY_PATH"] = plugin_lib;   // For Linux
-      e["DYLD_LIBRARY_PATH"] = plugin_lib; // For OSX
-      vw_out() << "Path to libraries: " << plugin_lib << std::endl;
-      for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++) {
-        e[it->first] = it->second;
-      }
+      if (asp::is_shared_library_plugin(plugin_path)) {
+        // Call the plugin in this process, with the images in memory
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        vw_out() << "Calling: " << plugin_path << " " << options << std::endl;
+        try {
+          ImageView<float> left_image  = DiskImageView<float>(left_aligned_file);
+          ImageView<float> right_image = DiskImageView<float>(right_aligned_file);
+          asp::call_stereo_plugin(plugin_path, options, env_vars_map, min_disp, max_disp,
+                                  left_image, right_image, aligned_disp);
+        } catch(std::exception const& e){
+          // If this tile fails, write an empty disparity
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
+      } else {
+        // Set up the environemnt
+        bp::environment e = boost::this_process::environment();
+        e["LD_LIBRARY_PATH"] = plugin_lib;   // For Linux
+        e["DYLD_LIBRARY_PATH"] = plugin_lib; // For OSX
+        vw_out() << "Path to libraries: " << plugin_lib << std::endl;
+        for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++) {
+          e[it->first] = it->second;
+        }
       
-      // Call an external program which will write the disparity to disk
-      std::string cmd = plugin_path + " " + options + " " 
-        + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
+        // Call an external program which will write the disparity to disk
+        std::string cmd = plugin_path + " " + options + " " 
+          + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
       
-      if (alg_name == "msmw" || alg_name == "msmw2") {
-        // Need to provide the output mask
-        cmd += " " + mask_file;
-      }
+        if (alg_name == "msmw" || alg_name == "msmw2") {
+          // Need to provide the output mask
+          cmd += " " + mask_file;
+        }
 
-      int timeout = stereo_settings().corr_timeout;
+        int timeout = stereo_settings().corr_timeout;
 
-      if (env_vars != "") 
-        vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
 
-      vw_out() << cmd << std::endl;
+        vw_out() << cmd << std::endl;
 
-      // Use boost::process to run the given process with timeout.
-      bp::child c(cmd, e);
-      std::error_code ec;
-      if (!c.wait_for(std::chrono::seconds(timeout), ec)) {
-        vw_out() << "\n" << "Timeout reached. Process terminated after "
-                 << timeout << " seconds. See the --corr-timeout option.\n";
-        c.terminate(ec);
-      }      
+        // Use boost::process to run the given process with timeout.
+        bp::child c(cmd, e);
+        std::error_code ec;
+        if (!c.wait_for(std::chrono::seconds(timeout), ec)) {
+          vw_out() << "\n" << "Timeout reached. Process terminated after "
+                   << timeout << " seconds. See the --corr-timeout option.\n";
+          c.terminate(ec);
+        }      
         
-      // Read the disparity from disk. This may fail, for example, the
-      // disparity may time out or it may not have good data. In that
-      // case just make an empty disparity, as we don't want
-      // the processing of the full image to fail because of a tile.
-      try {
-        aligned_disp = DiskImageView<float>(aligned_disp_file);
-      } catch(std::exception const& e){
-        // If this tile fails, write an empty disparity
-        vw_out() << e.what() << std::endl;
-        save_empty_disparity(opt, tile_crop_win, out_disp_file);
-        return;
-      }
+        // Read the disparity from disk. This may fail, for example, the
+        // disparity may time out or it may not have good data. In that
+        // case just make an empty disparity, as we don't want
+        // the processing of the full image to fail because of a tile.
+        try {
+          aligned_disp = DiskImageView<float>(aligned_disp_file);
+        } catch(std::exception const& e){
+          // If this tile fails, write an empty disparity
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
       
-      if (alg_name == "msmw" || alg_name == "msmw2") {
-        // TODO(oalexan1): Make this into a function
-        // Apply the mask, which for this algorithm is stored separately.
-        // For that need to read things in memory.
-        ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
-        DiskImageView<vw::uint8> mask(mask_file);
-
-        if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
-          vw_throw(ArgumentErr() << "Expecting that the following images would "
-                   << "have the same dimensions: "
-                   << aligned_disp_file << ' ' << mask_file << ".\n");
+        if (alg_name == "msmw" || alg_name == "msmw2") {
+          // TODO(oalexan1): Make this into a function
+          // Apply the mask, which for this algorithm is stored separately.
+          // For that need to read things in memory.
+          ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
+          DiskImageView<vw::uint8> mask(mask_file);
+
+          if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
+            vw_throw(ArgumentErr() << "Expecting that the following images would "
+                     << "have the same dimensions: "
+                     << aligned_disp_file << ' ' << mask_file << ".\n");
           
-        float nan = std::numeric_limits<float>::quiet_NaN();
-        for (int col = 0; col < local_disp.cols(); col++) {
-          for (int row = 0; row < local_disp.rows(); row++) {
-            if (mask(col, row) != 0) 
-              local_disp(col, row) = aligned_disp(col, row);
-            else
-              local_disp(col, row) = nan;
+          float nan = std::numeric_limits<float>::quiet_NaN();
+          for (int col = 0; col < local_disp.cols(); col++) {
+            for (int row = 0; row < local_disp.rows(); row++) {
+              if (mask(col, row) != 0) 
+                local_disp(col, row) = aligned_disp(col, row);
+              else
+                local_disp(col, row) = nan;
+            }
           }
-        }
         
-        // Assign the image we just made to the handle
-        aligned_disp = local_disp;
+          // Assign the image we just made to the handle
+          aligned_disp = local_disp;
+        }
       }
     }
 
@@ -1596,6 +1820,72 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
 
 } // End function stereo_correlation_1D
 
+/// Correlate many tiles in one process. Each line of standard input has
+/// the output prefix for a tile, followed by its crop window in L.tif
+/// (xoff yoff xsize ysize). The stereo session, cameras, images, and
+/// low-resolution disparity are loaded once and reused for all tiles,
+/// which avoids the process startup cost when the tiles are small.
+void stereo_correlation_worker(ASPGlobalOptions& opt) {
+
+  bool local_epipolar = (stereo_settings().alignment_method == "local_epipolar");
+
+  // Same logic as in stereo_correlation_2D(), but done only once for all tiles
+  Corr2DInputs inputs;
+  if (!local_epipolar) {
+    if (!stereo_settings().skip_low_res_disparity_comp || stereo_settings().seed_mode == 0)
+      lowres_correlation(opt);
+    prepare_fullres_correlation_2D(opt);
+    load_corr_2d_inputs(opt, inputs);
+  }
+  
+  int num_tiles = 0, num_failed = 0;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+
+    std::istringstream iss(line);
+    std::string tile_prefix;
+    int xoff = 0, yoff = 0, xsize = 0, ysize = 0;
+    if (!(iss >> tile_prefix)) 
+      continue; // empty line
+    if (!(iss >> xoff >> yoff >> xsize >> ysize))
+      vw_throw(ArgumentErr() << "Could not parse the tile: " << line << "\n");
+
+    // Each tile gets its own copy of the options, as these are modified
+    // when writing the output.
+    ASPGlobalOptions tile_opt = opt;
+    tile_opt.out_prefix = tile_prefix;
+    stereo_settings().trans_crop_win = BBox2i(xoff, yoff, xsize, ysize);
+    num_tiles++;
+    
+    vw_out() << "\n[ " << current_posix_time_string() << " ] : Correlating tile: "
+             << tile_prefix << "\n";
+    std::string d_file = tile_prefix + "-D.tif";
+    try {
+      if (local_epipolar)
+        stereo_correlation_1D(tile_opt);
+      else
+        correlate_tile_2D(tile_opt, inputs, stereo_settings().trans_crop_win);
+      vw_out() << "Finished tile: " << tile_prefix << std::endl;
+    } catch (std::exception const& e) {
+      // Go on with the other tiles, but do not leave behind partial results
+      vw_out() << "Failed tile: " << tile_prefix << ". " << e.what() << std::endl;
+      num_failed++;
+      if (fs::exists(d_file))
+        fs::remove(d_file);
+    }
+
+    // Save the timing for each tile. The one-time setup above is part
+    // of the first tile.
+    if (stereo_settings().save_timing_log)
+      stage_timing().write(tile_prefix);
+    stage_timing().reset();
+  }
+
+  if (num_failed > 0) 
+    vw_throw(ArgumentErr() << "Correlation failed for " << num_failed << " out of "
+             << num_tiles << " tiles.\n");
+}
+
 int main(int argc, char* argv[]) {
 
   try {
@@ -1609,6 +1899,7 @@ int main(int argc, char* argv[]) {
     asp::parse_multiview(argc, argv, CorrelationDescription(),
                          verbose, output_prefix, opt_vec);
     ASPGlobalOptions opt = opt_vec[0];
+    asp::set_intermediate_write_options(opt);
 
     // Leave the number of parallel block threads equal to the default unless we
     //  are using SGM in which case only one block at a time should be processed.
@@ -1660,7 +1951,14 @@ int main(int argc, char* argv[]) {
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : Stage 1 --> CORRELATION\n";
 
-    if (stereo_settings().alignment_method == "local_epipolar") {
+    stage_timing().set_stage("corr");
+    if (stereo_settings().corr_worker_mode) {
+      // Correlate the tiles passed in on standard input
+      if (stereo_settings().compute_low_res_disparity_only)
+        vw_throw(ArgumentErr() << "Cannot compute only the low-resolution disparity "
+                 << "in worker mode.\n");
+      stereo_correlation_worker(opt);
+    } else if (stereo_settings().alignment_method == "local_epipolar") {
       // Need to have the low-res 2D disparity to later guide the
       // per-tile correlation. Use here the ASP MGM algorithm as the
       // most reliable one, unless we do good old block-matching
@@ -1668,6 +1966,8 @@ int main(int argc, char* argv[]) {
         if (stereo_settings().stereo_algorithm != "asp_bm")
           stereo_settings().stereo_algorithm = "asp_mgm";
         stereo_correlation_2D(opt);
+        if (stereo_settings().save_timing_log)
+          stage_timing().write(opt.out_prefix);
         return 0;
       }
       // This will be invoked per-tile.
@@ -1678,6 +1978,10 @@ int main(int argc, char* argv[]) {
       stereo_correlation_2D(opt);
     }
 
+    // In worker mode the timing was saved for each tile
+    if (stereo_settings().save_timing_log && !stereo_settings().corr_worker_mode)
+      stage_timing().write(opt.out_prefix);
+
     vw_out() << "\n[ " << current_posix_time_string() << " ] : CORRELATION FINISHED\n";
     
     xercesc::XMLPlatformUtils::Terminate();
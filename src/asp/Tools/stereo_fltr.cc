@@ -28,6 +28,12 @@
 #include <vw/Image/InpaintView.h>
 
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/DisparityFilter.h>
+#include <asp/Core/DisparityEncoding.h>
+#include <asp/Core/TiledComponents.h>
+#include <asp/Core/PrefetchView.h>
+#include <asp/Core/StageTiming.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Gotcha/CBatchProc.h>
 
@@ -40,207 +46,32 @@ using namespace asp;
 using namespace std;
 
 
-/// Apply a set of smoothing filters to the subpixel disparity results.
-template <class ImageT, class DispImageT>
-class TextureAwareDisparityFilter: public ImageViewBase<TextureAwareDisparityFilter<ImageT, DispImageT> >{
-  ImageT     m_img;
-  DispImageT m_disp_img;
-  
-  int   m_median_filter_size;     ///< Step 1: Apply a median filter of this size
-  int   m_texture_smooth_range;   ///< Step 2: Compute texture measure of input image with this kernel size
-  float m_texture_max;            ///< Step 3: Perform texture-aware smoothing of the disparity.  m_texture_max
-  int   m_max_smooth_kernel_size; ///<         smooths more pixels, and the smooth_kernel_size increases the smoothing intensity.
-  
-public:
-  TextureAwareDisparityFilter( ImageViewBase<ImageT    > const& img,
-                               ImageViewBase<DispImageT> const& disp_img,
-                               int   median_filter_size,
-                               int   texture_smooth_range,
-                               float texture_max,
-                               int   max_smooth_kernel_size):
-    m_img(img.impl()), m_disp_img(disp_img.impl()),
-    m_median_filter_size(median_filter_size),
-    m_texture_smooth_range(texture_smooth_range),
-    m_texture_max(texture_max),
-    m_max_smooth_kernel_size(max_smooth_kernel_size)
-     {}
-
-  // Image View interface
-  typedef typename DispImageT::pixel_type pixel_type;
-  typedef pixel_type                      result_type;
-  typedef ProceduralPixelAccessor<TextureAwareDisparityFilter> pixel_accessor;
-
-  inline int32 cols  () const { return m_disp_img.cols(); }
-  inline int32 rows  () const { return m_disp_img.rows(); }
-  inline int32 planes() const { return 1; }
-
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
-  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "TextureAwareDisparityFilter::operator()(...) is not implemented");
-    return pixel_type();
-  }
-
-  typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-
-    // Figure out the largest kernel expansion we need to support the filtering
-    int max_half_kernel = m_texture_smooth_range;
-    if (m_max_smooth_kernel_size > max_half_kernel)
-      max_half_kernel = m_max_smooth_kernel_size;
-    max_half_kernel += m_median_filter_size; // Don't forget we apply two kernels in succession
-    max_half_kernel /= 2;
-
-    // Rasterize both input image regions
-    BBox2i bbox2 = bbox;
-    bbox2.expand(max_half_kernel);
-    bbox2.crop(bounding_box(m_img)); // Restrict to valid input area
-    ImageView<typename ImageT::pixel_type> input_tile      = crop(m_img,      bbox2);
-    ImageView<pixel_type                 > input_disp_tile = crop(m_disp_img, bbox2);
-
-    ImageView<float> texture_image;
-    vw::stereo::texture_measure(input_tile, texture_image, m_texture_smooth_range);
-    //write_image( "texture_image.tif", texture_image );
-
-
-    ImageView<pixel_type > disp_tile_median;
-    vw::stereo::disparity_median_filter(input_disp_tile, disp_tile_median, m_median_filter_size);
-    
-    ImageView<pixel_type > disp_tile_filtered;
-    vw::stereo::texture_preserving_disparity_filter(disp_tile_median, disp_tile_filtered, texture_image, 
-                                                    m_texture_max, m_max_smooth_kernel_size);
-
-    // Fake the bounds on the returned image region
-    return prerasterize_type(disp_tile_filtered,
-                             -bbox2.min().x(), -bbox2.min().y(),
-                             cols(), rows() );
-  }
-
-  template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
-  }
-};
-
-template <class ImageT, class DispImageT>
-TextureAwareDisparityFilter<ImageT, DispImageT>
-texture_aware_disparity_filter( ImageViewBase<ImageT    > const& img,
-                                ImageViewBase<DispImageT> const& disp_img,
-                                int   median_filter_size,
-                                int   texture_smooth_range,
-                                float texture_max,
-                                int   max_smooth_kernel_size) {
-  typedef TextureAwareDisparityFilter<ImageT, DispImageT> return_type;
-  return return_type(img.impl(), disp_img.impl(), median_filter_size, 
-                     texture_smooth_range, texture_max, max_smooth_kernel_size);
-}
-
-// Erode blobs from given image by iterating through tiles, biasing
-// each tile by a factor of blob size, removing blobs in the tile,
-// then shrinking the tile back. The bias is necessary to help avoid
-// fragmenting (and then unnecessarily removing) blobs.
+// Remove the blobs with no more than erode-max-size pixels. The blobs
+// are found in the whole image first, labeling tiles in parallel and
+// merging the blobs across tile borders, so no blob is cut by a tile
+// boundary. The image is rendered twice.
 template <class ImageT>
-class PerTileErode: public ImageViewBase<PerTileErode<ImageT> >{
-  ImageT m_img;
-public:
-  PerTileErode( ImageViewBase<ImageT>   const& img):
-    m_img(img.impl()){}
-
-  // Image View interface
-  typedef typename ImageT::pixel_type pixel_type;
-  typedef pixel_type                  result_type;
-  typedef ProceduralPixelAccessor<PerTileErode> pixel_accessor;
-
-  inline int32 cols  () const { return m_img.cols(); }
-  inline int32 rows  () const { return m_img.rows(); }
-  inline int32 planes() const { return 1; }
-
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
-  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "PerTileErode::operator()(...) is not implemented");
-    return pixel_type();
-  }
-
-  typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-
-    int area = stereo_settings().erode_max_size;
-
-    // We look a beyond the current tile, to avoid cutting blobs
-    // if possible. Skinny blobs will be cut though.
-    int bias = 2*int(ceil(sqrt(double(area))));
-
-    BBox2i bbox2 = bbox;
-    bbox2.expand(bias);
-    bbox2.crop(bounding_box(m_img));
-    ImageView<pixel_type> tile_img = crop(m_img, bbox2);
-
-    int tile_size = max(bbox2.width(), bbox2.height()); // don't subsplit
-    BlobIndexThreaded smallBlobIndex(tile_img, area, tile_size);
-    ImageView<pixel_type> clean_tile_img = applyErodeView(tile_img,
-                                                          smallBlobIndex);
-    return prerasterize_type(clean_tile_img,
-                             -bbox2.min().x(), -bbox2.min().y(),
-                             cols(), rows() );
-  }
-
-  template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
-  }
-};
-
-template <class ImageT>
-PerTileErode<ImageT>
-per_tile_erode( ImageViewBase<ImageT> const& img) {
-  typedef PerTileErode<ImageT> return_type;
-  return return_type( img.impl() );
+RemoveSmallComponentsView<ImageT>
+remove_small_blobs(ImageViewBase<ImageT> const& img, ASPGlobalOptions const& opt) {
+  int tile_size = opt.raster_tile_size[0];
+  if (tile_size != opt.raster_tile_size[1] || tile_size <= 0)
+    tile_size = vw_settings().default_tile_size();
+  boost::shared_ptr<TiledComponents>
+    comp(new TiledComponents(img.impl(), tile_size, vw_settings().default_num_threads()));
+  return remove_small_components(img.impl(), comp, stereo_settings().erode_max_size);
 }
 
-// Run several cleanup passes with desired cleanup mode.
-template <class ViewT>
-struct MultipleDisparityCleanUp {
-  typedef ImageViewRef< typename ViewT::pixel_type > result_type;
-
-  inline result_type operator()( ImageViewBase<ViewT> const& input, int N) {
-
-    result_type out = input;
-    for (int i = 0; i < N; i++){
-      int mode = stereo_settings().filter_mode;
-      if (mode == 1){
-        out = stereo::disparity_cleanup_using_mean
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().max_mean_diff);
-      }else if (mode == 2){
-        out = stereo::disparity_cleanup_using_thresh
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().rm_threshold,
-           stereo_settings().rm_min_matches/100.0);
-      }else
-        vw_throw( ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
-                  << "Got: " << mode << "\n" );
-    }
-
-    return out;
-  }
-};
-
+// Write the good pixel map, subsampled so that the user can actually view it
 template <class ImageT>
-void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
-                                   ASPGlobalOptions const& opt) {
-  // Write Good Pixel Map
-  // Sub-sampling so that the user can actually view it.
+void write_good_pixel_map(ImageViewBase<ImageT> const& inputview,
+                          ASPGlobalOptions const& opt,
+                          bool has_left_georef,
+                          cartography::GeoReference const& left_georef) {
   double sub_scale = double( min( inputview.impl().cols(),
                                 inputview.impl().rows() ) ) / 2048.0;
   if (sub_scale < 1) // Don't use a sub_scale less than one.
     sub_scale = 1;
 
-  // Write out the good pixel map
   std::string goodPixelFile = opt.out_prefix + "-GoodPixelMap.tif";
   vw_out() << "Writing: " << goodPixelFile << std::endl;
   ImageViewRef<  PixelRGB<uint8> > goodPixelImage
@@ -251,12 +82,8 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
                   )
                  ), sub_scale);
 
-  // Determine if we can attach geo information to the output image
-  cartography::GeoReference left_georef;
-  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
   bool has_nodata = false;
   double nodata = -32768.0;
-
   vw::cartography::GeoReference good_pixel_georef;
   if (has_left_georef) {
     // Account for scale. Note that goodPixelImage is not guaranteed to respect
@@ -270,11 +97,31 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
     ( goodPixelFile, goodPixelImage, has_left_georef, good_pixel_georef,
       has_nodata, nodata,
       opt, TerminalProgressCallback("asp", "\t--> Good pixel map: ") );
+}
+
+// Write F.tif and the good pixel map. When F.tif is the input view
+// itself, with no hole filling or blob removal, it is written first and
+// the good pixel map is made from it, so the filters producing the input
+// view run only once for each tile.
+template <class ImageT>
+void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
+                                   ASPGlobalOptions const& opt) {
+
+  // Determine if we can attach geo information to the output image
+  cartography::GeoReference left_georef;
+  bool has_left_georef = asp::read_aligned_georef(opt.out_prefix, true, left_georef);
+  bool has_nodata = false;
+  double nodata = -32768.0;
 
   bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
 
   string outF = opt.out_prefix + "-F.tif";
 
+  // F.tif differs from the input view, so filter the input view for the
+  // good pixel map
+  if (stereo_settings().enable_fill_holes || removeSmallBlobs)
+    write_good_pixel_map(inputview, opt, has_left_georef, left_georef);
+
   // Fill holes
   if(stereo_settings().enable_fill_holes) {
     // Generate a list of blobs below a maximum size
@@ -307,11 +154,11 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
       // - Blob removal is done second to make sure inner-blob holes are removed.
       vw_out() << "Writing: " << outF << endl;
       vw::cartography::block_write_gdal_image( outF,
-                                   per_tile_erode
+                                   remove_small_blobs
                                    (inpaint(inputview.impl(),
                                             smallHoleIndex,
                                             use_grassfire,
-                                            default_inpaint_val) ),
+                                            default_inpaint_val), opt),
                                    has_left_georef, left_georef,
                                    has_nodata, nodata, opt,
                                    TerminalProgressCallback
@@ -326,12 +173,14 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
                                    has_nodata, nodata, opt,
                                    TerminalProgressCallback
                                    ("asp", "\t--> Filtering: ") );
+      write_good_pixel_map(DiskImageView<typename ImageT::pixel_type>(outF), opt,
+                           has_left_georef, left_georef);
     }
     else { // Add small blob removal step
       vw_out() << "\t--> Removing small blobs.\n";
       // Write out the image to disk, removing the blobs in the process
       vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image(outF, per_tile_erode(inputview.impl()),
+      vw::cartography::block_write_gdal_image(outF, remove_small_blobs(inputview.impl(), opt),
                                   has_left_georef, left_georef,
                                   has_nodata, nodata, opt,
                                   TerminalProgressCallback
@@ -343,6 +192,14 @@ void write_good_pixel_and_filtered(ImageViewBase<ImageT> const& inputview,
 
 void stereo_filtering(ASPGlobalOptions& opt) {
 
+  TimingSpan span("filtering");
+
+  if (asp::stream_filtering()) {
+    vw_out() << "\t--> With --stream-filtering, the disparity will be filtered "
+             << "during triangulation. Not writing F.tif.\n";
+    return;
+  }
+
   string post_correlation_fname;
   opt.session->pre_filtering_hook(opt.out_prefix+"-RD.tif",
                                   post_correlation_fname);
@@ -354,8 +211,8 @@ void stereo_filtering(ASPGlobalOptions& opt) {
     // disparity map filtering process.
 
     // Apply filtering for high frequencies
-    typedef DiskImageView<PixelMask<Vector2f> > input_type;
-    input_type disparity_disk_image(post_correlation_fname);
+    typedef ImageViewRef<PixelMask<Vector2f> > input_type;
+    input_type disparity_disk_image = asp::read_disparity(post_correlation_fname);
 
     // Applying additional clipping from the edge. We make new
     // mask files to avoid a weird and tricky segfault due to ownership issues.
@@ -366,8 +223,6 @@ void stereo_filtering(ASPGlobalOptions& opt) {
       mask_buffer = max( stereo_settings().subpixel_kernel );
 
 
-    DiskImageView<PixelGray<float> > left_disk_image (opt.out_prefix+"-L.tif");
-
     vw_out() << "\t--> Cleaning up disparity map prior to filtering processes ("
              << stereo_settings().rm_cleanup_passes << " pass).\n";
 
@@ -411,30 +266,13 @@ void stereo_filtering(ASPGlobalOptions& opt) {
         ( ErodeView<ImageViewRef<PixelMask<Vector2f> > >(filtered_disparity,
                                                          bindex ), opt );
     } else { // mask_flatfield == false
-      // No Erosion step
-      if ( stereo_settings().rm_cleanup_passes >= 1 ) {
-        // Apply an outlier removal filter
-        write_good_pixel_and_filtered
-          (stereo::disparity_mask
-            (MultipleDisparityCleanUp<input_type>()
-              (disparity_disk_image, stereo_settings().rm_cleanup_passes),
-               apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-               apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
-             opt);
-      }
-      else { // No cleanup passes
-        write_good_pixel_and_filtered
-          (stereo::disparity_mask
-            (
-             texture_aware_disparity_filter(left_disk_image, disparity_disk_image, 
-                                            stereo_settings().median_filter_size,
-                                            stereo_settings().disp_smooth_size+2, // Compute texture a little larger than smooth radius
-                                            stereo_settings().disp_smooth_texture, 
-                                            stereo_settings().disp_smooth_size),
-              apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
-              apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
-            opt);
-      } // End cleanup passes check
+      // No Erosion step. Read the disparity ahead of the tiles being filtered.
+      ImageViewRef<PixelMask<Vector2f>> disparity
+        = asp::prefetch_view(disparity_disk_image, opt.raster_tile_size,
+                             bounding_box(disparity_disk_image),
+                             stereo_settings().prefetch_tiles,
+                             vw_settings().default_num_threads());
+      write_good_pixel_and_filtered(local_disparity_filter(opt, disparity), opt);
     } // End mask_flatfield check
 
   } catch (IOErr const& e) {
@@ -445,6 +283,8 @@ void stereo_filtering(ASPGlobalOptions& opt) {
 
 void gotcha_disparity_refinement(ASPGlobalOptions& opt) {
 
+  TimingSpan span("gotcha refinement");
+
   // Apply Gotcha on tiles of size 1024
   opt.raster_tile_size = Vector2i(ASPGlobalOptions::corr_tile_size(),
                                   ASPGlobalOptions::corr_tile_size());
@@ -478,14 +318,12 @@ void gotcha_disparity_refinement(ASPGlobalOptions& opt) {
     = opt.session->pre_pointcloud_hook(disp_file_nogotcha);
 
   // TODO(oalexan1): How about no-data pixels in the left and right images?
-  std::string L_file = opt.out_prefix + "-L.tif";
-  std::string R_file = opt.out_prefix + "-R.tif";
-  DiskImageView<float> left_image (L_file);
-  DiskImageView<float> right_image(R_file);
+  ImageViewRef<float> left_image  = asp::read_aligned_image(opt.out_prefix, true);
+  ImageViewRef<float> right_image = asp::read_aligned_image(opt.out_prefix, false);
   
   // Determine if we can attach geo information to the output disparity
   cartography::GeoReference left_georef;
-  bool has_left_georef = read_georeference(left_georef, L_file);
+  bool has_left_georef = asp::read_aligned_georef(opt.out_prefix, true, left_georef);
   bool has_nodata = false;
   double nodata = -32768.0;
   vw_out() << "Writing Gotcha-refined disparity: " << disp_file << endl;
@@ -522,13 +360,18 @@ int main(int argc, char* argv[]) {
     asp::parse_multiview(argc, argv, FilteringDescription(),
                          verbose, output_prefix, opt_vec);
     ASPGlobalOptions opt = opt_vec[0];
+    asp::set_intermediate_write_options(opt);
 
     // Internal Processes
     //---------------------------------------------------------
+    stage_timing().set_stage("fltr");
     stereo_filtering(opt);
 
     if (stereo_settings().gotcha_disparity_refinement)
       gotcha_disparity_refinement(opt);
+
+    if (stereo_settings().save_timing_log)
+      stage_timing().write(opt.out_prefix);
     
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : FILTERING FINISHED \n";
@@ -241,7 +241,7 @@ void readImages(std::vector<std::string> const& all_files,
         // Found a vwip file
         stereo_settings().vwip_files.push_back(file);
         is_image = false;
-      }else if (get_extension(file) == ".nvm") {
+      }else if (get_extension(file) == ".nvm" || get_extension(file) == ".bnvm") {
         // Found an nvm file
         if (!stereo_settings().nvm.empty()) // sanity check
           vw_out() << "Multiple nvm files specified. Will load only: " << file << "\n";
@@ -297,25 +297,14 @@ int main(int argc, char** argv) {
     readImages(all_files, images, output_prefix);
 
     if (stereo_settings().create_image_pyramids_only) {
-      // Just create the image pyramids and exit. 
+      // Just create the image pyramids and exit. Hillshading is done
+      // on the fly from these, so no hillshaded images are needed.
       for (size_t i = 0; i < images.size(); i++) {
         vw::gui::imageData img;
         img.read(images[i], opt);
-        if (stereo_settings().hillshade) {
-          // Create hillshaded images. 
-          std::string hillshaded_file;
-          bool have_gui = false; // so we don't use a pop up before the gui got started
-          bool success = vw::gui::write_hillshade(opt,
-                                                  have_gui,
-                                                  stereo_settings().hillshade_azimuth,
-                                                  stereo_settings().hillshade_elevation,
-                                                  images[i],
-                                                  // Output
-                                                  hillshaded_file);
-          if (success) // build the pyramids
-            img.read(hillshaded_file, opt, vw::gui::HILLSHADED_VIEW);
-        }
       }
+      vw::gui::shrink_pyramid_cache(stereo_settings().pyramid_cache_dir,
+                                    stereo_settings().pyramid_cache_size_mb);
       return 0;
     }
 
@@ -26,6 +26,8 @@
 #include <vw/Stereo/CorrelationView.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/ImageAlignment.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace vw;
@@ -33,6 +35,68 @@ using namespace asp;
 using namespace std;
 namespace fs = boost::filesystem;
 
+// Read the list of tiles for a parallel_stereo run. Return their names
+// and boxes in L.tif pixel coordinates.
+void read_tile_list(ASPGlobalOptions const& opt,
+                    std::vector<std::string> & tile_names,
+                    std::vector<BBox2i> & boxes) {
+
+  tile_names.clear();
+  boxes.clear();
+  
+  std::string line;
+  std::string dir_list = opt.out_prefix + "-dirList.txt";
+  vw_out() << "Reading list of tiles: " << dir_list << "\n";
+  std::ifstream ifs(dir_list);
+  while (ifs >> line) {
+    std::string::size_type pos = line.find(opt.out_prefix);
+    if (pos == std::string::npos) 
+      vw_throw(ArgumentErr() << "Could not find the output prefix in " << dir_list << ".\n");
+
+    std::string tile_name = line;
+    line.replace(pos, opt.out_prefix.size() + 1, ""); // add 1 to replace the dash
+
+    int start_x, start_y, wid_x, wid_y;
+    int ans = sscanf(line.c_str(), "%d_%d_%d_%d", &start_x, &start_y, &wid_x, &wid_y);
+    if (ans != 4) 
+      vw_throw(ArgumentErr() << "Error parsing 4 numbers from string: " << line);
+
+    tile_names.push_back(tile_name);
+    boxes.push_back(BBox2i(start_x, start_y, wid_x, wid_y));
+  }
+}
+
+// Estimate the cost of correlation for each tile of a parallel_stereo run,
+// and save these to disk. Tiles with bigger search range and more valid
+// pixels take longer to process.
+void estimate_tile_costs(ASPGlobalOptions const& opt) {
+
+  std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+  if (stereo_settings().seed_mode == 0 || !fs::exists(d_sub_file)) {
+    vw_out() << "No low-resolution disparity exists. Cannot estimate tile costs.\n";
+    return;
+  }
+
+  std::vector<std::string> tile_names;
+  std::vector<BBox2i> boxes;
+  read_tile_list(opt, tile_names, boxes);
+
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> sub_disp;
+  vw::Vector2 upsample_scale;
+  asp::load_D_sub_and_scale(opt, d_sub_file, sub_disp, upsample_scale);
+
+  std::vector<double> costs;
+  asp::estimate_corr_costs(sub_disp, upsample_scale, boxes, costs);
+
+  std::string cost_file = opt.out_prefix + "-tileCosts.txt";
+  vw_out() << "Writing: " << cost_file << "\n";
+  std::ofstream ofs(cost_file.c_str());
+  ofs.precision(17);
+  for (size_t it = 0; it < tile_names.size(); it++)
+    ofs << tile_names[it] << " " << costs[it] << "\n";
+  ofs.close();
+}
+
 // Find the tile at given location for a parallel_stereo run with local epipolar
 // alignment.
 void find_tile_at_loc(std::string const& tile_at_loc, ASPGlobalOptions const& opt) {
@@ -59,28 +123,13 @@ void find_tile_at_loc(std::string const& tile_at_loc, ASPGlobalOptions const& op
   pix = tx_left->forward(pix);
 
   // Read the tiles
-  std::string line;
-  std::string dir_list = opt.out_prefix + "-dirList.txt";
-  vw_out() << "Reading list of tiles: " << dir_list << "\n";
-  std::ifstream ifs(dir_list);
+  std::vector<std::string> tile_names;
   std::vector<BBox2i> boxes;
+  read_tile_list(opt, tile_names, boxes);
   bool success = false;
-  while (ifs >> line) {
-    std::string::size_type pos = line.find(opt.out_prefix);
-    if (pos == std::string::npos) 
-      vw_throw(ArgumentErr() << "Could not find the output prefix in " << dir_list << ".\n");
-
-    std::string tile_name = line;
-    line.replace(pos, opt.out_prefix.size() + 1, ""); // add 1 to replace the dash
-
-    int start_x, start_y, wid_x, wid_y;
-    int ans = sscanf(line.c_str(), "%d_%d_%d_%d", &start_x, &start_y, &wid_x, &wid_y);
-    if (ans != 4) 
-      vw_throw(ArgumentErr() << "Error parsing 4 numbers from string: " << line);
-
-    BBox2i box(start_x, start_y, wid_x, wid_y);
-    if (box.contains(pix)) {
-      std::cout << "Tile with location: " << tile_name << std::endl;
+  for (size_t it = 0; it < boxes.size(); it++) {
+    if (boxes[it].contains(pix)) {
+      std::cout << "Tile with location: " << tile_names[it] << std::endl;
       success = true;
     }
   }
@@ -89,6 +138,16 @@ void find_tile_at_loc(std::string const& tile_at_loc, ASPGlobalOptions const& op
     vw_out() << "No tile found at location.\n"; 
 }
 
+// Print the names of the options in a group, so that parallel_stereo
+// can tell which options affect only the later stages
+void print_stage_options(std::string const& name,
+                         boost::program_options::options_description const& desc) {
+  vw_out() << name;
+  for (size_t it = 0; it < desc.options().size(); it++)
+    vw_out() << "," << desc.options()[it]->long_name();
+  vw_out() << endl;
+}
+
 int main(int argc, char* argv[]) {
 
   try {
@@ -110,6 +169,11 @@ int main(int argc, char* argv[]) {
       find_tile_at_loc(stereo_settings().tile_at_loc, opt);
       return 1;
     }
+
+    if (stereo_settings().estimate_tile_costs) {
+      estimate_tile_costs(opt);
+      return 0;
+    }
     
     vw_out() << "in_file1,"        << opt.in_file1        << endl;
     vw_out() << "in_file2,"        << opt.in_file2        << endl;
@@ -139,8 +203,8 @@ int main(int argc, char* argv[]) {
     vw_out() << "trans_left_image,"  << trans_left_image  << endl;
     vw_out() << "trans_right_image," << trans_right_image << endl;
     Vector2 trans_left_image_size;
-    if ( fs::exists(trans_left_image) )
-      trans_left_image_size = file_image_size(trans_left_image);
+    if (asp::aligned_image_exists(opt.out_prefix, true))
+      trans_left_image_size = asp::aligned_image_size(opt.out_prefix, true);
     vw_out() << "trans_left_image_size," << trans_left_image_size.x() << "," << trans_left_image_size.y() << endl;
 
     cartography::GeoReference georef = opt.session->get_georef();
@@ -203,6 +267,12 @@ int main(int argc, char* argv[]) {
     vw_out() << "save_lr_disp_diff," << stereo_settings().save_lr_disp_diff << std::endl;
 
     vw_out() << "correlator_mode," << stereo_settings().correlator_mode << endl;
+    vw_out() << "stream_filtering," << stereo_settings().stream_filtering << endl;
+    vw_out() << "save_timing_log," << stereo_settings().save_timing_log << endl;
+
+    print_stage_options("subpixel_options",      SubpixelDescription());
+    print_stage_options("filtering_options",     FilteringDescription());
+    print_stage_options("triangulation_options", TriangulationDescription());
     
     // This block of code should be in its own executable but I am
     // reluctant to create one just for it. This functionality will be
@@ -27,10 +27,13 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/InterestPoint/Matcher.h>
 #include <asp/Core/IpMatchingAlgs.h>        // Lightweight header
+#include <asp/Core/ImageAlignment.h>
 #include <asp/Sessions/CameraUtils.h>
 #include <vw/Math/Functors.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/MaskedSubsample.h>
+#include <asp/Core/StageTiming.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -129,6 +132,18 @@ void create_sym_links(std::string const& left_input_file,
   }
 } // End function create_sym_links
 
+/// The scale at which to subsample the images, so that they have
+/// about 1500 x 1500 pixels, but no more than 0.6.
+float find_sub_scale(Vector2i const& left_size, Vector2i const& right_size) {
+  double s = 1500.0;
+  float  sub_scale = sqrt(s * s / (float(left_size.x())  * float(left_size.y())))
+                   + sqrt(s * s / (float(right_size.x()) * float(right_size.y())));
+  sub_scale /= 2;
+  if ( sub_scale > 0.6 ) // ???
+    sub_scale = 0.6;
+  return sub_scale;
+}
+
 /// The main preprocessing function
 void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
 
@@ -145,6 +160,7 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
 
   // Need to also write the transformed bathy masks to disk, those
   // will be used in stereo_tri.
+  stage_timing().start("image normalization and alignment");
   if (skip_img_norm)
     create_sym_links(opt.in_file1, opt.in_file2, opt.out_prefix,
                      left_image_file, right_image_file);
@@ -152,14 +168,17 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     opt.session->preprocessing_hook(adjust_left_image_size,
                                         opt.in_file1,    opt.in_file2,
                                         left_image_file, right_image_file);
-
-  boost::shared_ptr<DiskImageResource>
-    left_rsrc (vw::DiskImageResourcePtr(left_image_file)),
-    right_rsrc(vw::DiskImageResourcePtr(right_image_file));
-
-  // Load the normalized images.
-  DiskImageView<PixelGray<float> > left_image (left_rsrc ),
-                                   right_image(right_rsrc);
+  stage_timing().stop("image normalization and alignment");
+
+  // Load the normalized images. With --skip-aligned-image-files
+  // these are produced on the fly from the input images.
+  float left_aligned_nodata = 0.0, right_aligned_nodata = 0.0;
+  ImageViewRef<PixelGray<float>> left_image
+    = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, true,
+                                                           left_aligned_nodata));
+  ImageViewRef<PixelGray<float>> right_image
+    = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, false,
+                                                           right_aligned_nodata));
 
   // If we crop the images, we must always rebuild the masks
   // and subsample the images and masks.
@@ -201,20 +220,29 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
   }
 
   cartography::GeoReference left_georef, right_georef;
-  bool has_left_georef  = read_georeference(left_georef,  left_image_file );
-  bool has_right_georef = read_georeference(right_georef, right_image_file);
+  bool has_left_georef  = asp::read_aligned_georef(opt.out_prefix, true,  left_georef);
+  bool has_right_georef = asp::read_aligned_georef(opt.out_prefix, false, right_georef);
 
   // The output no-data value must be < 0 as the images are scaled to around [0, 1].
   bool  has_nodata    = true;
   float output_nodata = -32768.0;
 
 
+  float sub_scale = find_sub_scale(bounding_box(left_image).size(),
+                                   bounding_box(right_image).size());
+
+  // When the subsampled images are found by super sampling, they are
+  // accumulated from the same tiles as the masks while those are
+  // written, so the images are read only once.
+  boost::shared_ptr<SubsampleAccumulator> left_sub_acc, right_sub_acc;
+
   if (!rebuild) {
     vw_out() << "\t--> Using cached masks.\n";
   }else{
 
     vw_out() << "\t--> Generating image masks... \n";
 
+    TimingSpan span("masks");
     Stopwatch sw;
     sw.start();
 
@@ -227,13 +255,9 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                                 right_image.cols(), right_image.rows() ),
                   asp::threaded_edge_mask(right_image,0,0,1024));
 
-    // Read the no-data values of L.tif and R.tif.
-    float left_nodata_value  = std::numeric_limits<float>::quiet_NaN();
-    float right_nodata_value = std::numeric_limits<float>::quiet_NaN();
-    if ( left_rsrc->has_nodata_read() )
-      left_nodata_value  = left_rsrc->nodata_read();
-    if ( right_rsrc->has_nodata_read() )
-      right_nodata_value = right_rsrc->nodata_read();
+    // The no-data values of L.tif and R.tif
+    float left_nodata_value  = left_aligned_nodata;
+    float right_nodata_value = right_aligned_nodata;
 
     // We need to treat the following special case: if the user
     // skipped image normalization, so we are still using the original
@@ -320,6 +344,7 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     // mask, and vice-versa to reduce noise, if the images
     // are map-projected.
     vw_out() << "Writing masks: " << left_mask_file << ' ' << right_mask_file << ".\n";
+    ImageViewRef<PixelMask<uint8>> left_out_mask = left_mask, right_out_mask = right_mask;
     if (has_left_georef && has_right_georef && !opt.input_dem.empty()){
       // Left image mask transformed into right coordinates
       ImageViewRef< PixelMask<uint8> > warped_left_mask
@@ -336,30 +361,38 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                ),
                bounding_box(left_mask));
 
-      vw::cartography::block_write_gdal_image(left_mask_file,
-                                  apply_mask(intersect_mask(left_mask, warped_right_mask)),
-                                  has_left_georef, left_georef,
-                                  has_nodata, output_nodata,
-                                  opt, TerminalProgressCallback("asp", "\t    Mask L: ")
-                                  );
-      vw::cartography::block_write_gdal_image(right_mask_file,
-                                  apply_mask(intersect_mask(right_mask, warped_left_mask)),
-                                  has_right_georef, right_georef,
-                                  has_nodata, output_nodata,
-                                  opt, TerminalProgressCallback("asp", "\t    Mask R: "));
+      left_out_mask  = intersect_mask(left_mask,  warped_right_mask);
+      right_out_mask = intersect_mask(right_mask, warped_left_mask);
+    }
+    // With no DEM to map-project to, the masks are not intersected.
+    // TODO: Even so, the trick above with intersecting the masks will still work,
+    // if the images are map-projected (such as with cam2map-ed cubes),
+    // but this would require careful research.
+
+    if (sub_scale <= 0.5) {
+      left_sub_acc.reset(new SubsampleAccumulator(left_image.cols(), left_image.rows(),
+                                                  sub_scale));
+      right_sub_acc.reset(new SubsampleAccumulator(right_image.cols(), right_image.rows(),
+                                                   sub_scale));
+      vw::cartography::block_write_gdal_image
+        (left_mask_file,
+         apply_mask(accumulate_subsample(left_image, left_out_mask, left_sub_acc)),
+         has_left_georef, left_georef, has_nodata, output_nodata,
+         opt, TerminalProgressCallback("asp", "\t    Mask L: "));
+      vw::cartography::block_write_gdal_image
+        (right_mask_file,
+         apply_mask(accumulate_subsample(right_image, right_out_mask, right_sub_acc)),
+         has_right_georef, right_georef, has_nodata, output_nodata,
+         opt, TerminalProgressCallback("asp", "\t    Mask R: "));
     }else{
-      // No DEM to map-project to.
-      // TODO: Even so, the trick above with intersecting the masks will still work,
-      // if the images are map-projected (such as with cam2map-ed cubes),
-      // but this would require careful research.
-      vw::cartography::block_write_gdal_image(left_mask_file, apply_mask(left_mask),
+      vw::cartography::block_write_gdal_image(left_mask_file, apply_mask(left_out_mask),
                                    has_left_georef, left_georef,
                                    has_nodata, output_nodata,
-                                   opt, TerminalProgressCallback("asp", "\t Mask L: ") );
-      vw::cartography::block_write_gdal_image( right_mask_file, apply_mask(right_mask),
+                                   opt, TerminalProgressCallback("asp", "\t    Mask L: "));
+      vw::cartography::block_write_gdal_image(right_mask_file, apply_mask(right_out_mask),
                                    has_right_georef, right_georef,
                                    has_nodata, output_nodata,
-                                   opt, TerminalProgressCallback("asp", "\t Mask R: ") );
+                                   opt, TerminalProgressCallback("asp", "\t    Mask R: "));
     }
 
     sw.stop();
@@ -378,12 +411,15 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                     !is_latest_timestamp(lmsub, in_file_list ) ||
                     !is_latest_timestamp(rmsub, in_file_list )  );
 
-  // We must always redo the subsampling if we are allowed to crop the images
-  rebuild = crop_left || crop_right || inputs_changed;
+  // We must always redo the subsampling if we are allowed to crop the images.
+  // If the subsampled images were found along with the masks, save them.
+  rebuild = crop_left || crop_right || inputs_changed || left_sub_acc;
 
   try {
     // First try to see if the subsampled images exist.
-    if (!fs::exists(lsub)  || !fs::exists(rsub) ||
+    if (rebuild) {
+      // Nothing to check
+    }else if (!fs::exists(lsub)  || !fs::exists(rsub) ||
         !fs::exists(lmsub) || !fs::exists(rmsub)){
       rebuild = true;
     }else{
@@ -401,66 +437,68 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
   if (rebuild) {
     // Produce subsampled images, these will be used later for auto
     // search range detection.
-    double s = 1500.0;
-    float  sub_scale = sqrt(s * s / (float(left_image.cols ()) * float(left_image.rows ())))
-                     + sqrt(s * s / (float(right_image.cols()) * float(right_image.rows())));
-    sub_scale /= 2;
-    if ( sub_scale > 0.6 ) // ???
-      sub_scale = 0.6;
-
-    // Solving for the number of threads and the tile size to use for
-    // subsampling while only using 500 MiB of memory. (The cache code
-    // is a little slow on releasing so it will probably use 1.5GiB
-    // memory during subsampling) Also tile size must be a power of 2
-    // and greater than or equal to 64 px.
-    uint32 sub_threads = vw_settings().default_num_threads() + 1;
-    uint32 tile_power  = 0;
-    while (tile_power < 6 && sub_threads > 1) {
-      sub_threads--;
-      tile_power = boost::numeric_cast<uint32>
-        (log10(500e6*sub_scale*sub_scale/(4.0*float(sub_threads)))/(2*log10(2)));
-    }
-    uint32 sub_tile_size = 1u << tile_power;
-    if (sub_tile_size > vw_settings().default_tile_size())
-      sub_tile_size = vw_settings().default_tile_size();
-    Vector2 sub_tile_size_vec(sub_tile_size, sub_tile_size);
-    vw_out() << "\t--> Creating previews. Subsampling by " << sub_scale
-             << " by using a tile of size " << sub_tile_size << " and "
-             << sub_threads << " threads.\n";
+    TimingSpan span("subsampled images");
 
-    // Resample the images and the masks. We must use the masks when
-    // resampling the images to interpolate correctly around invalid pixels.
-
-    DiskImageView<uint8> left_mask(left_mask_file), right_mask(right_mask_file);
     // Below we use ImageView instead of ImageViewRef as the output
     // images are small.  Using an ImageViewRef would make the
     // subsampling operations happen twice, once for L_sub.tif and
     // second time for lMask_sub.tif.
     ImageView<PixelMask<PixelGray<float>>> left_sub_image, right_sub_image;
-    if (sub_scale > 0.5) {
-      // When we are near the pixel input to output ratio, standard
-      // interpolation gives the best possible results.
-      left_sub_image  = block_rasterize(resample(copy_mask(left_image,  create_mask(left_mask)),
-                                                 sub_scale), 
-                                        sub_tile_size_vec, sub_threads);
-      right_sub_image = block_rasterize(resample(copy_mask(right_image, create_mask(right_mask)),
-                                                 sub_scale), 
-                                        sub_tile_size_vec, sub_threads);
+    if (left_sub_acc) {
+      vw_out() << "\t--> Creating previews. Subsampled by " << sub_scale
+               << " while writing the masks.\n";
+      left_sub_image  = left_sub_acc->result();
+      right_sub_image = right_sub_acc->result();
     } else {
-      // When we heavily reduce the image size, super sampling seems
-      // like the best approach. The method below should be equivalent.
-      left_sub_image
-        = block_rasterize
-        (cache_tile_aware_render(resample_aa(copy_mask(left_image,create_mask(left_mask)),
-                                             sub_scale),
-                                 Vector2i(256,256) * sub_scale),
-         sub_tile_size_vec, sub_threads);
-      right_sub_image
-        = block_rasterize
-        (cache_tile_aware_render(resample_aa(copy_mask(right_image,create_mask(right_mask)),
-                                             sub_scale),
-                                 Vector2i(256,256) * sub_scale),
-         sub_tile_size_vec, sub_threads);
+      // Solving for the number of threads and the tile size to use for
+      // subsampling while only using 500 MiB of memory. (The cache code
+      // is a little slow on releasing so it will probably use 1.5GiB
+      // memory during subsampling) Also tile size must be a power of 2
+      // and greater than or equal to 64 px.
+      uint32 sub_threads = vw_settings().default_num_threads() + 1;
+      uint32 tile_power  = 0;
+      while (tile_power < 6 && sub_threads > 1) {
+        sub_threads--;
+        tile_power = boost::numeric_cast<uint32>
+          (log10(500e6*sub_scale*sub_scale/(4.0*float(sub_threads)))/(2*log10(2)));
+      }
+      uint32 sub_tile_size = 1u << tile_power;
+      if (sub_tile_size > vw_settings().default_tile_size())
+        sub_tile_size = vw_settings().default_tile_size();
+      Vector2 sub_tile_size_vec(sub_tile_size, sub_tile_size);
+      vw_out() << "\t--> Creating previews. Subsampling by " << sub_scale
+               << " by using a tile of size " << sub_tile_size << " and "
+               << sub_threads << " threads.\n";
+
+      // Resample the images and the masks. We must use the masks when
+      // resampling the images to interpolate correctly around invalid pixels.
+
+      DiskImageView<uint8> left_mask(left_mask_file), right_mask(right_mask_file);
+      if (sub_scale > 0.5) {
+        // When we are near the pixel input to output ratio, standard
+        // interpolation gives the best possible results.
+        left_sub_image  = block_rasterize(resample(copy_mask(left_image,  create_mask(left_mask)),
+                                                   sub_scale), 
+                                          sub_tile_size_vec, sub_threads);
+        right_sub_image = block_rasterize(resample(copy_mask(right_image, create_mask(right_mask)),
+                                                   sub_scale), 
+                                          sub_tile_size_vec, sub_threads);
+      } else {
+        // When we heavily reduce the image size, super sampling seems
+        // like the best approach. The method below should be equivalent.
+        left_sub_image
+          = block_rasterize
+          (cache_tile_aware_render(resample_aa(copy_mask(left_image,create_mask(left_mask)),
+                                               sub_scale),
+                                   Vector2i(256,256) * sub_scale),
+           sub_tile_size_vec, sub_threads);
+        right_sub_image
+          = block_rasterize
+          (cache_tile_aware_render(resample_aa(copy_mask(right_image,create_mask(right_mask)),
+                                               sub_scale),
+                                   Vector2i(256,256) * sub_scale),
+           sub_tile_size_vec, sub_threads);
+      }
     }
 
     // Enforce no predictor in compression, it works badly with sub-images
@@ -537,6 +575,8 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
 // matching points meet
 void estimate_convergence_angle(ASPGlobalOptions const& opt) {
 
+  TimingSpan span("convergence angle");
+
   // For alignment method none the ip match file does not exist yet,
   // and it is done later only for subsampled images. For alignment
   // method epipolar need to undo the alignment. Hence don't estimate
@@ -609,9 +649,13 @@ int main(int argc, char* argv[]) {
     bool adjust_left_image_size = (opt_vec.size() == 1 &&
                                    !stereo_settings().part_of_multiview_run);
 
+    stage_timing().set_stage("pprc");
     stereo_preprocessing(adjust_left_image_size, opt);
 
     estimate_convergence_angle(opt);
+
+    if (stereo_settings().save_timing_log)
+      stage_timing().write(opt.out_prefix);
     
     vw_out() << "\n[ " << current_posix_time_string() << " ] : PREPROCESSING FINISHED \n";
 
@@ -22,7 +22,6 @@
 #include <asp/Tools/stereo.h>
 #include <vw/Stereo/PreFilter.h>
 #include <vw/Stereo/CostFunctions.h>
-#include <vw/Stereo/ParabolaSubpixelView.h>
 #include <vw/Stereo/SubpixelView.h>
 #include <vw/Stereo/EMSubpixelCorrelatorView.h>
 #include <vw/Stereo/DisparityMap.h>
@@ -30,6 +29,13 @@
 #include <vw/FileIO/DiskImageResourceOpenEXR.h>
 #include <vw/Image/InpaintView.h>
 #include <asp/Sessions/StereoSession.h>
+#include <asp/Core/StageTiming.h>
+#include <asp/Core/ProcessMetrics.h>
+#include <asp/Core/ImageAlignment.h>
+#include <asp/Core/DisparityEncoding.h>
+#include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/ParabolaSubpixel.h>
+#include <asp/Core/TileArena.h>
 
 #include <xercesc/util/PlatformUtils.hpp>
 
@@ -70,15 +76,9 @@ refine_disparity(Image1T const& left_image,
   }
   
   if (stereo_settings().subpixel_mode == 1) {
-    // Parabola
+    // Parabola. This is done per tile, in PerTileRfne.
     if (verbose)
       vw_out() << "\t--> Using parabola subpixel mode.\n";
-
-    refined_disp = parabola_subpixel(integer_disp,
-                                      left_image, right_image,
-                                      prefilter_mode, stereo_settings().slogW,
-                                      stereo_settings().subpixel_kernel);
-    
   } // End parabola cases
   if (stereo_settings().subpixel_mode == 2) {
     // Bayes EM
@@ -185,9 +185,29 @@ refine_disparity(Image1T const& left_image,
     }
   }
 
+  if (verbose && stereo_settings().subpixel_min_confidence > 0 &&
+      stereo_settings().subpixel_mode >= 2 && stereo_settings().subpixel_mode <= 5)
+    vw_out() << "\t--> Using parabola subpixel mode for pixels with confidence under "
+             << stereo_settings().subpixel_min_confidence << ".\n";
+
   return refined_disp;
 }
 
+// The image as prefiltered for subpixel refinement
+template <class ImageT>
+ImageViewRef<float> subpixel_prefilter(ImageViewBase<ImageT> const& image) {
+  ImageViewRef<float> img = select_channel(image.impl(), 0);
+  if (stereo_settings().pre_filter_mode == PREFILTER_LOG) {
+    stereo::LaplacianOfGaussian prefilter(stereo_settings().slogW);
+    return prefilter.filter(img);
+  }
+  if (stereo_settings().pre_filter_mode == PREFILTER_MEANSUB) {
+    stereo::SubtractedMean prefilter(stereo_settings().slogW);
+    return prefilter.filter(img);
+  }
+  return img;
+}
+
 // Perform refinement in each tile. If using local homography,
 // apply the local homography transform for the given tile
 // to the right image before doing refinement in that tile.
@@ -199,6 +219,7 @@ class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT>
   SeedDispT            m_sub_disp;
   ASPGlobalOptions const&       m_opt;
   Vector2              m_upscale_factor;
+  ImageViewRef<float>  m_left_filtered, m_right_filtered; // for parabola fitting
 
 public:
   PerTileRfne(ImageViewBase<Image1T>   const& left_image,
@@ -212,6 +233,9 @@ public:
 
     m_upscale_factor = Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
                                double(m_left_image.impl().rows()) / m_sub_disp.rows());
+
+    m_left_filtered  = subpixel_prefilter(m_left_image);
+    m_right_filtered = subpixel_prefilter(m_right_image);
   }
 
   // Image View interface
@@ -232,10 +256,59 @@ public:
 
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    // The temporaries of the tile are taken from the arena of this
+    // thread, and given back when the tile is done
+    asp::TileArenaScope scope;
     ImageView<pixel_type> tile_disparity;
     bool verbose = false;
-    tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
-                                           m_integer_disp, m_opt, verbose), bbox);
+    int mode = stereo_settings().subpixel_mode;
+    double min_confidence = stereo_settings().subpixel_min_confidence;
+    bool do_h = !stereo_settings().disable_h_subpixel;
+    bool do_v = !stereo_settings().disable_v_subpixel;
+
+    if (mode == 1) {
+      ImageView<pixel_type> disp = crop(m_integer_disp, bbox);
+      ImageView<float> confidence;
+      parabola_subpixel(m_left_filtered, m_right_filtered, disp, bbox,
+                        stereo_settings().subpixel_kernel, do_h, do_v,
+                        tile_disparity, confidence);
+    } else if (min_confidence > 0 && mode >= 2 && mode <= 5) {
+      // Find the confidence with parabola fitting, also a kernel beyond
+      // the tile, as the slower methods use disparities around each pixel.
+      BBox2i region = bbox;
+      region.expand(max(stereo_settings().subpixel_kernel));
+      region.crop(bounding_box(m_integer_disp));
+      ImageView<pixel_type> disp = crop(m_integer_disp, region);
+      ImageView<pixel_type> parabola_disp;
+      ImageView<float> confidence;
+      parabola_subpixel(m_left_filtered, m_right_filtered, disp, region,
+                        stereo_settings().subpixel_kernel, do_h, do_v,
+                        parabola_disp, confidence);
+
+      // Refine with the selected method only the confident pixels
+      for (int row = 0; row < disp.rows(); row++) {
+        for (int col = 0; col < disp.cols(); col++) {
+          if (confidence(col, row) < min_confidence)
+            invalidate(disp(col, row));
+        }
+      }
+      ImageViewRef<pixel_type> confident_disp
+        = crop(edge_extend(disp, ZeroEdgeExtension()),
+               -region.min().x(), -region.min().y(), cols(), rows());
+      tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
+                                             confident_disp, m_opt, verbose), bbox);
+
+      for (int row = 0; row < tile_disparity.rows(); row++) {
+        for (int col = 0; col < tile_disparity.cols(); col++) {
+          Vector2i pix = Vector2i(col, row) + bbox.min() - region.min();
+          if (confidence(pix.x(), pix.y()) < min_confidence)
+            tile_disparity(col, row) = parabola_disp(pix.x(), pix.y());
+        }
+      }
+    } else {
+      tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
+                                             m_integer_disp, m_opt, verbose), bbox);
+    }
     
     prerasterize_type disparity = prerasterize_type(tile_disparity,
                                                     -bbox.min().x(), -bbox.min().y(),
@@ -262,28 +335,34 @@ per_tile_rfne(ImageViewBase<Image1T  > const& left,
 
 void stereo_refinement(ASPGlobalOptions const& opt) {
 
+  // This includes writing the disparity, as that is when it is computed
+  TimingSpan span("subpixel refinement");
+
   ImageViewRef<PixelGray<float>> left_image, right_image;
   ImageViewRef<PixelMask<Vector2f> > input_disp;
   ImageViewRef<PixelMask<Vector2f> > sub_disp;
-  string left_image_file  = opt.out_prefix+"-L.tif";
-  string right_image_file = opt.out_prefix+"-R.tif";
   string left_mask_file   = opt.out_prefix+"-lMask.tif";
   string right_mask_file  = opt.out_prefix+"-rMask.tif";
 
   int kernel_size = std::max(stereo_settings().subpixel_kernel[0],
                              stereo_settings().subpixel_kernel[1]);
   
-  left_image  = DiskImageView<PixelGray<float>>(left_image_file);
-  right_image = DiskImageView<PixelGray<float>>(right_image_file);
+  float left_nodata_val = 0.0, right_nodata_val = 0.0;
+  left_image  = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, true,
+                                                                     left_nodata_val));
+  right_image = pixel_cast<PixelGray<float>>(asp::read_aligned_image(opt.out_prefix, false,
+                                                                     right_nodata_val));
   
   // It is better to fill no-data pixels with an average from
   // neighbors than to use no-data values in processing. This is a
   // temporary band-aid solution.
-  float left_nodata_val = -std::numeric_limits<float>::max();
-  if (vw::read_nodata_val(left_image_file, left_nodata_val))
+  if (std::isnan(left_nodata_val))
+    left_nodata_val = -std::numeric_limits<float>::max();
+  else
     vw_out() << "Left image nodata: " << left_nodata_val << std::endl;
-  float right_nodata_val = -std::numeric_limits<float>::max();
-  if (vw::read_nodata_val(right_image_file, right_nodata_val))
+  if (std::isnan(right_nodata_val))
+    right_nodata_val = -std::numeric_limits<float>::max();
+  else
     vw_out() << "Right image nodata: " << right_nodata_val << std::endl;
   
   left_image = apply_mask(vw::fill_nodata_with_avg
@@ -298,14 +377,8 @@ void stereo_refinement(ASPGlobalOptions const& opt) {
   if (stereo_settings().subpix_from_blend) { // Read the stereo_blend output file
     input_disp = DiskImageView< PixelMask<Vector2f> >(blend_file);
   } else {
-    // Read the stereo_corr output file
-    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(disp_file));
-    ChannelTypeEnum disp_data_type = rsrc->channel_type();
-    if (disp_data_type == VW_CHANNEL_INT32)
-      input_disp = pixel_cast<PixelMask<Vector2f> >
-        (DiskImageView< PixelMask<Vector2i> >(disp_file));
-    else // File on disk is float
-      input_disp = DiskImageView< PixelMask<Vector2f> >(disp_file);
+    // Read the stereo_corr output file, which may be integer, float, or compact
+    input_disp = asp::read_disparity(disp_file);
   }
   
   bool skip_img_norm = asp::skip_image_normalization(opt);
@@ -357,16 +430,36 @@ void stereo_refinement(ASPGlobalOptions const& opt) {
            stereo_settings().trans_crop_win);
   
   cartography::GeoReference left_georef;
-  bool   has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+  bool   has_left_georef = asp::read_aligned_georef(opt.out_prefix, true, left_georef);
   bool   has_nodata      = false;
   double nodata          = -32768.0;
 
   string rd_file = opt.out_prefix + "-RD.tif";
   vw_out() << "Writing: " << rd_file << "\n";
-  vw::cartography::block_write_gdal_image(rd_file, refined_disp,
-                              has_left_georef, left_georef,
-                              has_nodata, nodata, opt,
-                              TerminalProgressCallback("asp", "\t--> Refinement :"));
+  if (asp::use_compact_disparity()) {
+    // Save the difference from the upsampled D_sub as 16-bit integers
+    std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+    if (!asp::load_D_sub(d_sub_file, sub_disp))
+      vw_throw(ArgumentErr() << "Could not read " << d_sub_file << ".\n");
+    Vector2 seed_scale(double(left_image.cols()) / sub_disp.cols(),
+                       double(left_image.rows()) / sub_disp.rows());
+    asp::block_write_compact_disparity(rd_file, refined_disp,
+                                       stereo_settings().trans_crop_win.min(),
+                                       ImageView<PixelMask<Vector2f>>(sub_disp),
+                                       seed_scale, asp::RD_DISP_QUANTUM,
+                                       has_left_georef, left_georef, opt,
+                                       asp::MetricsProgressCallback
+                                       ("refinement",
+                                        double(refined_disp.cols()) * refined_disp.rows(),
+                                        "\t--> Refinement :"));
+  } else {
+    vw::cartography::block_write_gdal_image(rd_file, refined_disp,
+                                has_left_georef, left_georef,
+                                has_nodata, nodata, opt,
+                                asp::MetricsProgressCallback
+                                ("refinement", double(refined_disp.cols()) * refined_disp.rows(),
+                                 "\t--> Refinement :"));
+  }
 }
 
 int main(int argc, char* argv[]) {
@@ -385,6 +478,7 @@ int main(int argc, char* argv[]) {
     asp::parse_multiview(argc, argv, SubpixelDescription(),
                          verbose, output_prefix, opt_vec);
     ASPGlobalOptions opt = opt_vec[0];
+    asp::set_intermediate_write_options(opt);
 
     // Subpixel refinement uses smaller tiles.
     //---------------------------------------------------------
@@ -393,8 +487,12 @@ int main(int argc, char* argv[]) {
 
     // Internal Processes
     //---------------------------------------------------------
+    stage_timing().set_stage("rfne");
     stereo_refinement(opt);
 
+    if (stereo_settings().save_timing_log)
+      stage_timing().write(opt.out_prefix);
+
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : REFINEMENT FINISHED \n";
 
@@ -22,11 +22,22 @@
 #include <vw/Stereo/StereoView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Image/Filter.h>
+#include <vw/FileIO/DiskImageUtils.h>
+#include <vw/Cartography/PointImageManipulation.h>
 #include <vw/InterestPoint/Matcher.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RayTableCamera.h>
 #include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/DisparityFilter.h>
+#include <asp/Core/DisparityEncoding.h>
 #include <asp/Core/Bathymetry.h>
+#include <asp/Core/MultiRayIntersect.h>
+#include <asp/Core/PixelMapGrid.h>
+#include <asp/Core/OrthoRasterizer.h>
+#include <asp/Core/PointUtils.h>
+#include <asp/Core/StageTiming.h>
+#include <asp/Core/ProcessMetrics.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
@@ -58,6 +69,8 @@ class StereoTXAndErrorView:
   std::vector<vw::TransformPtr> m_transforms; // e.g., map-projection or homography to undo
   vw::stereo::StereoModel       m_stereo_model;
   asp::BathyStereoModel         m_bathy_model;
+  std::vector<const vw::camera::CameraModel*> m_cameras;
+  double                        m_angle_tol;
   bool                          m_is_map_projected;
   bool                          m_bathy_correct;
   OUTPUT_CLOUD_TYPE             m_cloud_type;
@@ -77,6 +90,8 @@ public:
                        std::vector<vw::TransformPtr> const& transforms,
                        vw::stereo::StereoModel       const& stereo_model,
                        asp::BathyStereoModel         const& bathy_model,
+                       std::vector<const vw::camera::CameraModel*> const& cameras,
+                       double angle_tol,
                        bool is_map_projected,
                        bool bathy_correct, OUTPUT_CLOUD_TYPE cloud_type,
                        ImageViewRef<PixelMask<float>> left_aligned_bathy_mask,
@@ -85,6 +100,8 @@ public:
     m_transforms(transforms),
     m_stereo_model(stereo_model),
     m_bathy_model(bathy_model),
+    m_cameras(cameras),
+    m_angle_tol(angle_tol),
     m_is_map_projected(is_map_projected),
     m_bathy_correct(bathy_correct),
     m_cloud_type(cloud_type),
@@ -201,9 +218,23 @@ public:
     return result; // Contains location and error vector
   }
   
-  typedef StereoTXAndErrorView prerasterize_type;
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return PreRasterHelper(bbox, m_transforms);
+
+    // A view with the disparities for this box in memory
+    StereoTXAndErrorView view = PreRasterHelper(bbox, m_transforms);
+
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    if (use_ray_bundles()) {
+      view.triangulate_ray_bundles(bbox, tile);
+    } else {
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++)
+          tile(col, row) = view(col + bbox.min().x(), row + bbox.min().y());
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
   template <class DestT>
   inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
@@ -212,6 +243,62 @@ public:
 
 private:
 
+  /// With more than two images, and no bathymetry or least squares
+  /// refinement, intersect the rays of a whole row of pixels at once
+  bool use_ray_bundles() const {
+    return m_disparity_maps.size() > 1 && !m_bathy_correct &&
+      !stereo_settings().use_least_squares;
+  }
+
+  /// Triangulate the pixels in the given box, one row at a time.
+  /// The rays are found here, and intersected in closed form in one
+  /// batch for the row. A camera which fails to project a pixel
+  /// makes only that ray invalid.
+  void triangulate_ray_bundles(BBox2i const& bbox, ImageView<pixel_type> & tile) const {
+
+    int num_disp = m_disparity_maps.size();
+    int num_cols = bbox.width();
+    asp::RayBundles rays;
+    std::vector<Vector3> xyz, err;
+    double max_err = stereo_settings().max_valid_triangulation_error;
+
+    for (int row = 0; row < bbox.height(); row++) {
+      int j = row + bbox.min().y();
+      rays.reset(num_disp + 1, num_cols);
+      for (int c = 0; c <= num_disp; c++) {
+        for (int col = 0; col < num_cols; col++) {
+          int i = col + bbox.min().x();
+          Vector2 pix;
+          if (c == 0) {
+            pix = m_transforms[0]->reverse(Vector2(i, j)); // De-warp "left" pixel
+          } else {
+            DPixelT disp = m_disparity_maps[c-1](i, j);
+            if (!is_valid(disp))
+              continue;
+            pix = m_transforms[c]->reverse(Vector2(i, j) + stereo::DispHelper(disp));
+          }
+          if (pix != pix || pix == camera::CameraModel::invalid_pixel())
+            continue;
+          try {
+            rays.set_ray(c, col, m_cameras[c]->camera_center(pix),
+                         m_cameras[c]->pixel_to_vector(pix));
+          } catch (...) {}
+        }
+      }
+
+      rays.intersect(m_angle_tol, xyz, err);
+
+      for (int col = 0; col < num_cols; col++) {
+        pixel_type result;
+        if (max_err <= 0.0 || norm_2(err[col]) <= max_err) {
+          subvector(result, 0, 3) = xyz[col];
+          subvector(result, 3, 3) = err[col];
+        }
+        tile(col, row) = result;
+      }
+    }
+  }
+
   // Find the region associated with the right image that we need to bring in memory
   // based on the disparity 
   BBox2i calc_right_bbox(BBox2i const& left_bbox, ImageView<DPixelT> const& disparity) const {
@@ -224,7 +311,7 @@ private:
   
   /// RPC Map Transform needs to be explicitly copied and told to cache for performance.
   template <class T>
-  prerasterize_type PreRasterHelper(BBox2i const& bbox, std::vector<T> const& transforms) const {
+  StereoTXAndErrorView PreRasterHelper(BBox2i const& bbox, std::vector<T> const& transforms) const {
 
     ImageViewRef<PixelMask<float>> in_memory_left_aligned_bathy_mask;
     ImageViewRef<PixelMask<float>> in_memory_right_aligned_bathy_mask;
@@ -261,9 +348,9 @@ private:
         }
       }
 
-      return prerasterize_type(disparity_cropviews, transforms,
-                               m_stereo_model, m_bathy_model,
-                               m_is_map_projected, m_bathy_correct, m_cloud_type,
+      return StereoTXAndErrorView(disparity_cropviews, transforms,
+                                  m_stereo_model, m_bathy_model, m_cameras, m_angle_tol,
+                                  m_is_map_projected, m_bathy_correct, m_cloud_type,
                                in_memory_left_aligned_bathy_mask,
                                in_memory_right_aligned_bathy_mask);
     }
@@ -279,7 +366,7 @@ private:
     // to manually copy the Map2CamTrans type which is pretty hacky.
     std::vector<T> transforms_copy(transforms.size());
     for (size_t i = 0; i < transforms.size(); ++i)
-      transforms_copy[i] = vw::cartography::mapproj_trans_copy(transforms[i]);
+      transforms_copy[i] = asp::grid_interp_trans_copy(transforms[i]);
 
     // As a side effect, this call makes transforms_copy create a local cache we want later
     transforms_copy[0]->reverse_bbox(bbox); 
@@ -325,9 +412,9 @@ private:
       transforms_copy[p+1]->reverse_bbox(right_bbox);
     }
 
-    return prerasterize_type(disparity_cropviews, transforms_copy,
-                             m_stereo_model, m_bathy_model,
-                             m_is_map_projected, m_bathy_correct, m_cloud_type,
+    return StereoTXAndErrorView(disparity_cropviews, transforms_copy,
+                                m_stereo_model, m_bathy_model, m_cameras, m_angle_tol,
+                                m_is_map_projected, m_bathy_correct, m_cloud_type,
                              in_memory_left_aligned_bathy_mask, in_memory_right_aligned_bathy_mask);
   } // End function PreRasterHelper() maprojected version
 }; // End class StereoTXAndErrorView
@@ -338,6 +425,8 @@ stereo_error_triangulate(std::vector<DispImageType> const& disparities,
                          std::vector<vw::TransformPtr>  const& transforms,
                          vw::stereo::StereoModel        const& stereo_model,
                          asp::BathyStereoModel          const& bathy_model,
+                         std::vector<const vw::camera::CameraModel*> const& cameras,
+                         double angle_tol,
                          bool is_map_projected,
                          bool bathy_correct,
                          OUTPUT_CLOUD_TYPE cloud_type,
@@ -346,7 +435,7 @@ stereo_error_triangulate(std::vector<DispImageType> const& disparities,
   
   typedef StereoTXAndErrorView result_type;
   return result_type(disparities, transforms, stereo_model, bathy_model,
-                     is_map_projected, bathy_correct, cloud_type,
+                     cameras, angle_tol, is_map_projected, bathy_correct, cloud_type,
                      left_aligned_bathy_mask, right_aligned_bathy_mask);
 }
 
@@ -382,24 +471,154 @@ void save_point_cloud(Vector3 const& shift, ImageT const& point_cloud,
   bool has_nodata = false;
   double nodata = -std::numeric_limits<float>::max(); // smallest float
 
-  if (opt.session->supports_multi_threading()){
+  asp::MetricsProgressCallback
+    progress("triangulation", double(point_cloud.cols()) * point_cloud.rows(),
+             "\t--> Triangulating: ");
+  if (stereo_settings().save_quantized_point_cloud) {
+    if (shift == Vector3())
+      vw_throw(ArgumentErr() << "Cannot save a quantized point cloud without "
+               << "the cloud center. Do not use --save-double-precision-point-cloud.\n");
+    asp::write_quantized_gdal_image
+      (point_cloud_file, shift,
+       stereo_settings().point_cloud_rounding_error,
+       point_cloud, has_georef, georef,
+       opt.session->has_thread_safe_cameras(),
+       opt, progress);
+  }else if (opt.session->has_thread_safe_cameras()){
     asp::block_write_approx_gdal_image
       (point_cloud_file, shift,
        stereo_settings().point_cloud_rounding_error,
        point_cloud,
        has_georef, georef, has_nodata, nodata,
-       opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+       opt, progress);
   }else{
-    // ISIS does not support multi-threading
+    // The cameras do not support multi-threading
     asp::write_approx_gdal_image
       (point_cloud_file, shift,
        stereo_settings().point_cloud_rounding_error,
        point_cloud,
        has_georef, georef, has_nodata, nodata,
-       opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+       opt, progress);
   }
 }
 
+// The first three elements of a point with its error norm
+struct PointOnly : public ReturnFixedType<Vector3> {
+  Vector3 operator() (Vector4 const& pt) const {
+    return subvector(pt, 0, 3);
+  }
+};
+
+// Grid the triangulated points into a DEM, the triangulation error,
+// and the number of points per grid point, as point2dem does with
+// its default options, but without going through PC.tif. The points
+// in a collar around the crop window are used as well, so the DEMs of
+// neighboring parallel_stereo tiles agree where they overlap. The
+// points are read once to find their extent and again when gridding,
+// so they are cached.
+void write_tri_dem(std::string const& output_prefix,
+                   Vector3 const& cloud_center,
+                   ImageViewRef<Vector4> const& point_cloud,
+                   ASPGlobalOptions const& opt) {
+
+  BBox2i box = stereo_settings().trans_crop_win;
+  box.expand(stereo_settings().dem_collar_size);
+  box.crop(bounding_box(point_cloud));
+
+  // The cameras are invoked as the points are read
+  vw::GdalWriteOptions local_opt = opt;
+  if (!opt.session->has_thread_safe_cameras()) {
+    local_opt.num_threads = 1;
+    vw_settings().set_default_num_threads(1);
+  }
+
+  int ts = ASPGlobalOptions::tri_tile_size();
+  ImageViewRef<Vector4> points = block_cache(crop(point_cloud, box), Vector2i(ts, ts),
+                                             local_opt.num_threads);
+  ImageViewRef<Vector3> xyz = per_pixel_filter(points, PointOnly());
+
+  cartography::GeoReference georef = opt.session->get_georef();
+  if (stereo_settings().dem_t_srs != "") {
+    bool have_user_datum = false, have_input_georef = true;
+    asp::set_srs_string(stereo_settings().dem_t_srs, have_user_datum,
+                        cartography::Datum(), have_input_georef, georef);
+  }
+
+  // Use the cloud center to pick the longitude range, if available,
+  // so that all parallel_stereo tiles make the same choice
+  double avg_lon = 0.0;
+  if (cloud_center != Vector3())
+    avg_lon = (cloud_center.x() >= 0) ? 0 : 180;
+  else
+    avg_lon = asp::find_avg_lon(xyz);
+  if (georef.overall_proj4_str().find("+proj=aea") == std::string::npos)
+    georef.set_lon_center(avg_lon < 100);
+
+  // Invalid points become NaN, which the rasterizer skips
+  ImageViewRef<Vector3> proj_points
+    = geodetic_to_point(asp::recenter_longitude(cartesian_to_geodetic(xyz, georef), avg_lon),
+                        georef);
+
+  vw::Mutex count_mutex;
+  std::int64_t num_invalid_pixels = 0;
+  ImageViewRef<double> error_image; // outliers were removed during triangulation
+  double nodata = -std::numeric_limits<float>::max();
+  boost::shared_ptr<asp::OrthoRasterizerView> rasterizer;
+  try {
+    rasterizer.reset(new asp::OrthoRasterizerView
+                     (proj_points, select_channel(proj_points, 2),
+                      0.0, 0.0, false, // search radius and sigma factors, surface sampling
+                      ts, BBox2(), asp::NO_OUTLIER_REMOVAL_METHOD, Vector2(),
+                      error_image, 0.0, BBox3(), 0.0, // no error filtering
+                      Vector2(), 0, false, // no median filter, erosion, or las files
+                      "weighted_average", 1.0,
+                      &num_invalid_pixels, &count_mutex,
+                      TerminalProgressCallback("asp", "\t--> Point extent: ")));
+  } catch (ArgumentErr const& e) {
+    // This happens for a tile with no valid points, which must not stop
+    // the other tiles
+    vw_out(WarningMessage) << e.what() << "Will not write a DEM.\n";
+    return;
+  }
+  rasterizer->set_use_minz_as_default(false);
+  rasterizer->set_default_value(nodata);
+  rasterizer->initialize_spacing(stereo_settings().dem_spacing);
+  vw_out() << "\t--> DEM spacing: " << rasterizer->spacing() << "\n";
+
+  georef.set_transform(rasterizer->geo_transform());
+  if (georef.pixel_interpretation() == cartography::GeoReference::PixelAsArea) {
+    Matrix3x3 transform = georef.transform();
+    transform(0,2) -= 0.5 * transform(0,0);
+    transform(1,2) -= 0.5 * transform(1,1);
+    georef.set_transform(transform);
+  }
+
+  bool has_georef = true, has_nodata = true;
+  std::string dem_file = output_prefix + "-DEM.tif";
+  vw_out() << "Writing: " << dem_file << "\n";
+  vw::cartography::block_write_gdal_image(dem_file, *rasterizer,
+                                          has_georef, georef, has_nodata, nodata, local_opt,
+                                          TerminalProgressCallback("asp", "\t--> DEM: "));
+
+  // The rest are the same grid with other values or another filter
+  asp::OrthoRasterizerView err_rasterizer = *rasterizer;
+  ImageViewRef<double> error = select_channel(points, 3);
+  err_rasterizer.set_texture(error);
+  std::string err_file = output_prefix + "-IntersectionErr.tif";
+  vw_out() << "Writing: " << err_file << "\n";
+  vw::cartography::block_write_gdal_image(err_file, err_rasterizer,
+                                          has_georef, georef, has_nodata, nodata, local_opt,
+                                          TerminalProgressCallback("asp", "\t--> Error: "));
+
+  asp::OrthoRasterizerView count_rasterizer = *rasterizer;
+  count_rasterizer.set_filter("count");
+  std::string count_file = output_prefix + "-count-DEM.tif";
+  vw_out() << "Writing: " << count_file << "\n";
+  vw::cartography::block_write_gdal_image(count_file, count_rasterizer,
+                                          has_georef, georef, has_nodata, nodata, local_opt,
+                                          TerminalProgressCallback("asp", "\t--> Count: "));
+}
+
 // TODO(oalexan1): Move this to some low-level utils file  
 Vector3 find_approx_points_median(std::vector<Vector3> const& points){
 
@@ -573,7 +792,7 @@ void disp_or_matches_or_jitter_work(std::string const& output_prefix,
                               max_num_matches, gen_triplets, is_map_projected);
       
     int num_threads = opt.num_threads;
-    if (!opt.session->supports_multi_threading()) 
+    if (!opt.session->has_thread_safe_cameras()) 
       num_threads = 1;
         
     asp::jitter_adjust(image_files, camera_files, cameras,
@@ -603,6 +822,9 @@ void disp_or_matches_or_jitter_work(std::string const& output_prefix,
 /// Main triangulation function
 void stereo_triangulation(std::string const& output_prefix,
                           std::vector<ASPGlobalOptions> const& opt_vec) {
+
+  // This includes writing the point cloud, as that is when it is computed
+  TimingSpan span("triangulation");
     
   try { // Outer try/catch
     
@@ -661,10 +883,17 @@ void stereo_triangulation(std::string const& output_prefix,
                              << "Will not be able to filter triangulated points by radius.\n";
     } // End try/catch
 
+    // With --stream-filtering there is no F.tif, and each tile of
+    // RD.tif is filtered here when it is needed.
     std::vector<DispImageType> disparity_maps;
-    for (int p = 0; p < (int)opt_vec.size(); p++)
-      disparity_maps.push_back
-        (opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+    for (int p = 0; p < (int)opt_vec.size(); p++) {
+      std::string disp_file = asp::filtered_disparity_file(opt_vec[p].out_prefix);
+      if (asp::stream_filtering())
+        disparity_maps.push_back
+          (asp::local_disparity_filter(opt_vec[p], asp::read_disparity(disp_file)));
+      else
+        disparity_maps.push_back(opt_vec[p].session->pre_pointcloud_hook(disp_file));
+    }
 
     bool do_disp_or_matches_or_jitter_work
       = (stereo_settings().unalign_disparity                        ||
@@ -686,6 +915,40 @@ void stereo_triangulation(std::string const& output_prefix,
     if (is_map_projected)
       vw_out() << "\t--> Inputs are map projected." << std::endl;
 
+    // Interpolate the projection of map-projected pixels into the
+    // cameras, if desired. The grid is made for each tile, when the
+    // copy of the transform for that tile caches its part of the DEM.
+    if (is_map_projected && stereo_settings().unproject_grid_spacing > 0) {
+      vw_out() << "\t--> Interpolating the unprojection with grid spacing "
+               << stereo_settings().unproject_grid_spacing << " pixels.\n";
+      for (size_t t = 0; t < transforms.size(); t++)
+        transforms[t] = vw::TransformPtr
+          (new asp::GridInterpTransform(transforms[t],
+                                        stereo_settings().unproject_grid_spacing,
+                                        stereo_settings().unproject_tolerance));
+    }
+
+    // Replace the cameras with ones interpolating in a ray table, if
+    // desired. With map-projected images the input images are not the
+    // ones the cameras see, so their extent is not known here.
+    std::vector<boost::shared_ptr<asp::RayTableCamera>> ray_tables;
+    if (stereo_settings().ray_table_spacing > 0) {
+      if (is_map_projected) {
+        vw_out(WarningMessage) << "Not using a ray table with map-projected images.\n";
+      } else {
+        vw_out() << "\t--> Using a ray table with spacing "
+                 << stereo_settings().ray_table_spacing << " pixels.\n";
+        for (size_t c = 0; c < cameras.size(); c++) {
+          boost::shared_ptr<asp::RayTableCamera> ray_table
+            (new asp::RayTableCamera(cameras[c], vw::file_image_size(image_files[c]),
+                                     stereo_settings().ray_table_spacing,
+                                     stereo_settings().ray_table_max_error));
+          ray_tables.push_back(ray_table);
+          cameras[c] = ray_table;
+        }
+      }
+    }
+
     // Strip the smart pointers and form the stereo model
     std::vector<const vw::camera::CameraModel *> camera_ptrs;
     int num_cams = cameras.size();
@@ -758,7 +1021,7 @@ void stereo_triangulation(std::string const& output_prefix,
     ImageViewRef<Vector6> point_cloud = per_pixel_filter
         (stereo_error_triangulate
          (disparity_maps, transforms, stereo_model, bathy_stereo_model,
-          is_map_projected, bathy_correct,
+          camera_ptrs, angle_tol, is_map_projected, bathy_correct,
           cloud_type, left_aligned_bathy_mask, right_aligned_bathy_mask),
          universe_radius_func);
     
@@ -790,7 +1053,9 @@ void stereo_triangulation(std::string const& output_prefix,
     // so force rasterization in that box only using crop().
     BBox2i cbox = stereo_settings().trans_crop_win;
     std::string point_cloud_file = output_prefix + "-PC.tif";
-    if (stereo_settings().compute_error_vector){
+    if (stereo_settings().no_point_cloud){
+      vw_out() << "Not writing the point cloud, per --no-point-cloud.\n";
+    }else if (stereo_settings().compute_error_vector){
 
       if (num_cams > 2)
         vw_out(WarningMessage) << "For more than two cameras, the error "
@@ -804,6 +1069,17 @@ void stereo_triangulation(std::string const& output_prefix,
       save_point_cloud(cloud_center, crop_pc, point_cloud_file, opt_vec[0]);
     } // End if/else
 
+    if (stereo_settings().write_dem)
+      write_tri_dem(output_prefix, cloud_center, point_and_error_norm(point_cloud),
+                    opt_vec[0]);
+
+    for (size_t c = 0; c < ray_tables.size(); c++)
+      vw_out() << "\t--> Ray table for camera " << c << ": built "
+               << ray_tables[c]->num_built_blocks() << " blocks, of which "
+               << ray_tables[c]->num_exact_blocks() << " use the exact camera. "
+               << "Max checked error: " << ray_tables[c]->max_checked_error()
+               << " pixels.\n";
+
     // Must print this at the end, as it contains statistics on the number of rejected points.
     vw_out() << "\t--> " << universe_radius_func;
 
@@ -844,27 +1120,39 @@ int main(int argc, char* argv[]) {
                        output_prefix);
     }
 
+    if (asp::stereo_settings().no_point_cloud && !asp::stereo_settings().write_dem)
+      vw_throw(ArgumentErr() << "The option --no-point-cloud needs --write-dem.\n");
+    if (asp::stereo_settings().dem_collar_size < 0)
+      vw_throw(ArgumentErr() << "The value of --dem-collar-size must be non-negative.\n");
+
     // Keep only those stereo pairs for which filtered disparity exists
     std::vector<asp::ASPGlobalOptions> opt_vec_new;
     for (int p = 0; p < (int)opt_vec.size(); p++){
-      if (fs::exists(opt_vec[p].out_prefix+"-F.tif"))
+      if (fs::exists(asp::filtered_disparity_file(opt_vec[p].out_prefix)))
         opt_vec_new.push_back(opt_vec[p]);
     }
     opt_vec = opt_vec_new;
     if (opt_vec.empty())
-      vw_throw( ArgumentErr() << "No valid F.tif files found.\n" );
+      vw_throw( ArgumentErr() << "No valid "
+                << (asp::stream_filtering() ? "RD.tif" : "F.tif") << " files found.\n" );
 
     // Triangulation uses small tiles.
     //---------------------------------------------------------
     int ts = asp::ASPGlobalOptions::tri_tile_size();
-    for (int s = 0; s < (int)opt_vec.size(); s++)
+    for (int s = 0; s < (int)opt_vec.size(); s++) {
       opt_vec[s].raster_tile_size = Vector2i(ts, ts);
+      asp::set_intermediate_write_options(opt_vec[s]);
+    }
 
     // Internal Processes
     //---------------------------------------------------------
 
+    asp::stage_timing().set_stage("tri");
     asp::stereo_triangulation(output_prefix, opt_vec);
 
+    if (asp::stereo_settings().save_timing_log)
+      asp::stage_timing().write(output_prefix);
+
     vw_out() << "\n[ " << asp::current_posix_time_string() << " ] : TRIANGULATION FINISHED \n";
 
     xercesc::XMLPlatformUtils::Terminate();
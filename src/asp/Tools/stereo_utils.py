@@ -263,8 +263,9 @@ def calc_lowres_disp(args, opt, sep, resume = False):
                 print("Will recreate: " + d_sub + " and " + d_sub_spread)
 
     if will_run:
-        if (opt.seed_mode == 3):
-            # This uses the python sparse_disp tool
+        if (opt.seed_mode == 3) and (opt.sparse_disp_options is not None):
+            # This uses the python sparse_disp tool. Otherwise stereo_corr
+            # does the sparse matching itself.
             run_sparse_disp(args, opt)
         else:
             local_args = args[:] # deep copy to use locally
@@ -315,6 +316,13 @@ def run_multiview(prog_name, args, extra_args, entry_point, stop_point,
     # Must make sure to use the same Python invoked by parent
     python_path = sys.executable
 
+    # The pairs share the first image. Let its statistics and interest
+    # points be found only once, and reused for the other pairs,
+    # unless the user chose where to keep them.
+    cache_args = []
+    if '--ip-cache-dir' not in args:
+        cache_args = ['--ip-cache-dir', settings['out_prefix'][0] + '-cache']
+
     # Run all steps but tri
     for s in sorted(settings.keys()):
 
@@ -330,6 +338,8 @@ def run_multiview(prog_name, args, extra_args, entry_point, stop_point,
         local_args.extend(['--entry-point', str(local_entry)])
         local_args.extend(['--stop-point',  str(local_stop)])
         local_args.extend(extra_args)
+        if '--ip-cache-dir' not in local_args:
+            local_args.extend(cache_args)
         cmd = [python_path] + local_args
         # Go on even if some of the runs fail
         try:
@@ -41,6 +41,8 @@
 #include <xercesc/util/PlatformUtils.hpp>
 #include <boost/dll.hpp>
 
+#include <algorithm>
+
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 using namespace vw;
@@ -538,6 +540,76 @@ void get_offsets(int tdi, bool is_wv01, bool is_forward,
   }
 }
 
+// Given tabulated CCD offsets and the columns where they start,
+// find for each image column the shift to apply to it, which is
+// minus the sum of the offsets starting to the left of it.
+void accumulate_offsets(std::vector<double> const& pos, std::vector<double> const& ccd,
+                        int num_cols, std::vector<double> & shift) {
+
+  std::vector<std::pair<double, double>> offsets;
+  for (size_t t = 0; t < pos.size(); t++)
+    offsets.push_back(std::make_pair(pos[t], ccd[t]));
+  std::sort(offsets.begin(), offsets.end());
+
+  shift.assign(num_cols, 0.0);
+  double val = 0.0;
+  size_t t = 0;
+  for (int col = 0; col < num_cols; col++) {
+    while (t < offsets.size() && offsets[t].first < col) {
+      val -= offsets[t].second;
+      t++;
+    }
+    shift[col] = val;
+  }
+}
+
+// Resample an image region, shifting each column by the given amounts
+// with bilinear interpolation and constant edge extension, as
+// interpolate() would do. Since the shift is the same for all pixels
+// in a column, the interpolation weights and the integer part of the
+// shift are found once per column, and the loops over the pixels
+// have no rounding or branching, except for rows next to the
+// boundary.
+template <class PixelT>
+void shift_columns(ImageView<PixelT> const& src, BBox2i const& src_box,
+                   BBox2i const& bbox,
+                   std::vector<double> const& shift_x, std::vector<double> const& shift_y,
+                   ImageView<PixelT> & tile) {
+
+  int ncols = bbox.width(), nrows = bbox.height();
+  int last_col = src.cols() - 1, last_row = src.rows() - 1;
+  tile.set_size(ncols, nrows);
+
+  // Per column, the two input columns, the row offset, and the weights
+  std::vector<int> x0(ncols), x1(ncols), dy(ncols);
+  std::vector<double> wx(ncols), wy(ncols);
+  for (int c = 0; c < ncols; c++) {
+    int col = c + bbox.min().x();
+    double x = col - src_box.min().x() + shift_x[col];
+    double y = shift_y[col] - src_box.min().y();
+    double fx = floor(x), fy = floor(y);
+    x0[c] = std::max(0, std::min(last_col, int(fx)));
+    x1[c] = std::max(0, std::min(last_col, int(fx) + 1));
+    dy[c] = int(fy);
+    wx[c] = x - fx;
+    wy[c] = y - fy;
+  }
+
+  for (int r = 0; r < nrows; r++) {
+    int row = r + bbox.min().y();
+    PixelT * out = &tile(0, r);
+    for (int c = 0; c < ncols; c++) {
+      int y0 = row + dy[c];
+      int y1 = y0 + 1;
+      y0 = std::max(0, std::min(last_row, y0));
+      y1 = std::max(0, std::min(last_row, y1));
+      PixelT top = src(x0[c], y0) * (1.0 - wx[c]) + src(x1[c], y0) * wx[c];
+      PixelT bot = src(x0[c], y1) * (1.0 - wx[c]) + src(x1[c], y1) * wx[c];
+      out[c] = top * (1.0 - wy[c]) + bot * wy[c];
+    }
+  }
+}
+
 // Apply WorldView corrections to each vertical block as high as the image
 // corresponding to one CCD sensor.
 template <class ImageT>
@@ -546,7 +618,7 @@ class WVPerBlockCorrectView: public ImageViewBase<WVPerBlockCorrectView<ImageT>>
   int m_tdi;
   bool m_is_wv01, m_is_forward;
   double m_pitch_ratio;
-  std::vector<double> m_posx, m_ccdx, m_posy, m_ccdy;
+  std::vector<double> m_shift_x, m_shift_y; // for each column
   
   typedef typename ImageT::pixel_type PixelT;
 
@@ -555,18 +627,22 @@ public:
                  double pitch_ratio):
     m_img(img), m_tdi(tdi), m_is_wv01(is_wv01), m_is_forward(is_forward),
     m_pitch_ratio(pitch_ratio){
-    
-    get_offsets(m_tdi, m_is_wv01, m_is_forward,  
-                m_posx, m_ccdx, m_posy, m_ccdy);
+
+    std::vector<double> posx, ccdx, posy, ccdy;
+    get_offsets(m_tdi, m_is_wv01, m_is_forward, posx, ccdx, posy, ccdy);
 
     // Compensate for the variable pitch ratio
-    for (int i = 0; i < (int)m_posx.size(); i++) m_posx[i] *= m_pitch_ratio;
-    for (int i = 0; i < (int)m_posy.size(); i++) m_posy[i] *= m_pitch_ratio;
+    for (int i = 0; i < (int)posx.size(); i++) posx[i] *= m_pitch_ratio;
+    for (int i = 0; i < (int)posy.size(); i++) posy[i] *= m_pitch_ratio;
     
-    VW_ASSERT(m_posx.size() == m_ccdx.size() &&
-              m_posy.size() == m_ccdy.size(),
+    VW_ASSERT(posx.size() == ccdx.size() &&
+              posy.size() == ccdy.size(),
               ArgumentErr() << "wv_correct: Expecting the arrays of positions "
               << "and offsets to have the same sizes.");
+
+    // Accumulate the corrections up to each column, once for all tiles
+    accumulate_offsets(posx, ccdx, m_img.cols(), m_shift_x);
+    accumulate_offsets(posy, ccdy, m_img.cols(), m_shift_y);
   }
   
   typedef PixelT pixel_type;
@@ -596,37 +672,8 @@ public:
     biased_box.crop(bounding_box(m_img));
     
     ImageView<result_type> cropped_img = crop(m_img, biased_box);
-    InterpolationView<EdgeExtensionView< ImageView<result_type>,
-      ConstantEdgeExtension >, BilinearInterpolation> interp_img
-      = interpolate(cropped_img, BilinearInterpolation(),
-                    ConstantEdgeExtension());
-
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-
-      // Accumulate the corrections up to the current column
-      double valx = 0, valy = 0;
-      if (m_ccdx.size() > 0){
-        valx = 0.0;
-        for (size_t t = 0; t < m_ccdx.size(); t++){
-          if (m_posx[t] < col){
-            valx -= m_ccdx[t];
-          }
-        }
-        valy = 0.0;
-        for (size_t t = 0; t < m_ccdy.size(); t++){
-          if (m_posy[t] < col){
-            valy -= m_ccdy[t];
-          }
-        }
-      }
-      
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        tile(col - bbox.min().x(), row - bbox.min().y() )
-          = interp_img(col - biased_box.min().x() + valx,
-                       row - biased_box.min().y() + valy);
-      }
-    }
+    ImageView<result_type> tile;
+    shift_columns(cropped_img, biased_box, bbox, m_shift_x, m_shift_y, tile);
     
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );
@@ -650,6 +697,7 @@ template <class ImageT>
 class WVPerColumnCorrectView: public ImageViewBase< WVPerColumnCorrectView<ImageT> >{
   ImageT m_img;
   std::vector<double> m_dx, m_dy;
+  std::vector<double> m_shift_x, m_shift_y; // minus the corrections
   typedef typename ImageT::pixel_type PixelT;
 
 public:
@@ -675,6 +723,13 @@ public:
       // vw_throw( ArgumentErr() << "Expecting as many corrections as columns.\n" );
     }
 
+    m_shift_x.resize(m_dx.size());
+    m_shift_y.resize(m_dy.size());
+    for (size_t it = 0; it < m_dx.size(); it++) {
+      m_shift_x[it] = -m_dx[it];
+      m_shift_y[it] = -m_dy[it];
+    }
+
   }
   
   typedef PixelT pixel_type;
@@ -702,23 +757,10 @@ public:
     biased_box.expand(bias);
     biased_box.crop(bounding_box(m_img));
     
+    // Note that the same correction is used for an entire column
     ImageView<result_type> cropped_img = crop(m_img, biased_box);
-    InterpolationView<EdgeExtensionView< ImageView<result_type>,
-      ConstantEdgeExtension >, BilinearInterpolation> interp_img
-      = interpolate(cropped_img, BilinearInterpolation(),
-                    ConstantEdgeExtension());
-
-    
-    ImageView<result_type> tile(bbox.width(), bbox.height());
-
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++) {
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
-        // Note that the same correction is used for an entire column
-        tile(col - bbox.min().x(), row - bbox.min().y() )
-          = interp_img(col - biased_box.min().x() - m_dx[col],
-                       row - biased_box.min().y() - m_dy[col]);
-      }
-    }
+    ImageView<result_type> tile;
+    shift_columns(cropped_img, biased_box, bbox, m_shift_x, m_shift_y, tile);
 
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );